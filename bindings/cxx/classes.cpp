@@ -332,10 +332,42 @@ shared_ptr<Packet> Context::create_logic_packet(
 	return shared_ptr<Packet>{new Packet{nullptr, packet}, default_delete<Packet>{}};
 }
 
+shared_ptr<Packet> Context::create_logic_packet(
+	vector<uint8_t> data, unsigned int unit_size)
+{
+	auto storage = make_shared<vector<uint8_t> >(move(data));
+	auto packet = create_logic_packet(storage->data(), storage->size(),
+		unit_size);
+	packet->_storage = move(storage);
+	return packet;
+}
+
+shared_ptr<Packet> Context::create_logic_packet(
+	unique_ptr<uint8_t[]> data, size_t data_length, unsigned int unit_size)
+{
+	shared_ptr<uint8_t> storage(data.release(), default_delete<uint8_t[]>());
+	auto packet = create_logic_packet(storage.get(), data_length, unit_size);
+	packet->_storage = move(storage);
+	return packet;
+}
+
 shared_ptr<Packet> Context::create_analog_packet(
 	vector<shared_ptr<Channel> > channels,
 	const float *data_pointer, unsigned int num_samples, const Quantity *mq,
 	const Unit *unit, vector<const QuantityFlag *> mqflags)
+{
+	return create_analog_packet(move(channels), data_pointer, num_samples,
+		sizeof(float), true, true, sr_rational{1, 1}, sr_rational{0, 1},
+		mq, unit, move(mqflags), nullptr);
+}
+
+shared_ptr<Packet> Context::create_analog_packet(
+	vector<shared_ptr<Channel> > channels,
+	const void *data_pointer, unsigned int num_samples,
+	unsigned int unit_size, bool is_signed, bool is_float,
+	struct sr_rational scale, struct sr_rational offset,
+	const Quantity *mq, const Unit *unit,
+	vector<const QuantityFlag *> mqflags, shared_ptr<void> storage)
 {
 	auto analog = g_new0(struct sr_datafeed_analog, 1);
 	auto meaning = g_new0(struct sr_analog_meaning, 1);
@@ -352,9 +384,9 @@ shared_ptr<Packet> Context::create_analog_packet(
 
 	analog->encoding = encoding;
 
-	encoding->unitsize = sizeof(float);
-	encoding->is_signed = TRUE;
-	encoding->is_float = TRUE;
+	encoding->unitsize = unit_size;
+	encoding->is_signed = is_signed;
+	encoding->is_float = is_float;
 #ifdef WORDS_BIGENDIAN
 	encoding->is_bigendian = TRUE;
 #else
@@ -362,21 +394,22 @@ shared_ptr<Packet> Context::create_analog_packet(
 #endif
 	encoding->digits = 0;
 	encoding->is_digits_decimal = FALSE;
-	encoding->scale.p = 1;
-	encoding->scale.q = 1;
-	encoding->offset.p = 0;
-	encoding->offset.q = 1;
+	encoding->scale = scale;
+	encoding->offset = offset;
 
 	analog->spec = spec;
 
 	spec->spec_digits = 0;
 
 	analog->num_samples = num_samples;
-	analog->data = (float*)data_pointer;
+	analog->data = const_cast<void *>(data_pointer);
 	auto packet = g_new(struct sr_datafeed_packet, 1);
 	packet->type = SR_DF_ANALOG;
 	packet->payload = analog;
-	return shared_ptr<Packet>{new Packet{nullptr, packet}, default_delete<Packet>{}};
+	auto result = shared_ptr<Packet>{new Packet{nullptr, packet},
+		default_delete<Packet>{}};
+	result->_storage = move(storage);
+	return result;
 }
 
 shared_ptr<Packet> Context::create_end_packet()
@@ -898,16 +931,54 @@ float TriggerMatch::value() const
 DatafeedCallbackData::DatafeedCallbackData(Session *session,
 		DatafeedCallbackFunction callback) :
 	_callback(move(callback)),
-	_session(session)
+	_session(session),
+	_sdi(nullptr),
+	_device_ptr(nullptr)
+{
+}
+
+DatafeedCallbackData::DatafeedCallbackData(Session *session,
+		DatafeedViewCallbackFunction callback) :
+	_view_callback(move(callback)),
+	_session(session),
+	_sdi(nullptr),
+	_device_ptr(nullptr)
 {
 }
 
 void DatafeedCallbackData::run(const struct sr_dev_inst *sdi,
 	const struct sr_datafeed_packet *pkt)
 {
-	auto device = _session->get_device(sdi);
-	shared_ptr<Packet> packet {new Packet{device, pkt}, default_delete<Packet>{}};
-	_callback(move(device), move(packet));
+	if (_view_callback) {
+		if (sdi != _sdi) {
+			_device_ptr = _session->get_device_ptr(sdi);
+			_sdi = sdi;
+		}
+		_view_callback(*_device_ptr, PacketView{pkt});
+		if (pkt->type == SR_DF_END)
+			_sdi = nullptr;
+		return;
+	}
+
+	// Look the device up again only when it changes.
+	if (sdi != _sdi || !_device) {
+		_device = _session->get_device(sdi);
+		_sdi = sdi;
+	}
+	// Reuse the last packet, unless the callback kept a reference to it.
+	if (_packet && _packet.use_count() == 1)
+		_packet->assign(_device, pkt);
+	else
+		_packet.reset(new Packet{_device, pkt}, default_delete<Packet>{});
+	_callback(_device, _packet);
+
+	// The references would keep the session alive, don't hold them
+	// between acquisitions.
+	if (pkt->type == SR_DF_END) {
+		_packet.reset();
+		_device.reset();
+		_sdi = nullptr;
+	}
 }
 
 SessionDevice::SessionDevice(struct sr_dev_inst *structure) :
@@ -965,6 +1036,17 @@ shared_ptr<Device> Session::get_device(const struct sr_dev_inst *sdi)
 		throw Error(SR_ERR_BUG);
 }
 
+Device *Session::get_device_ptr(const struct sr_dev_inst *sdi)
+{
+	auto owned = _owned_devices.find(sdi);
+	if (owned != _owned_devices.end())
+		return owned->second.get();
+	auto other = _other_devices.find(sdi);
+	if (other != _other_devices.end())
+		return other->second.get();
+	throw Error(SR_ERR_BUG);
+}
+
 void Session::add_device(shared_ptr<Device> device)
 {
 	const auto dev_struct = device->_structure;
@@ -1006,6 +1088,11 @@ void Session::stop()
 	check(sr_session_stop(_structure));
 }
 
+void Session::reconfigure()
+{
+	check(sr_session_reconfigure(_structure));
+}
+
 bool Session::is_running() const
 {
 	const int ret = sr_session_is_running(_structure);
@@ -1014,6 +1101,37 @@ bool Session::is_running() const
 	return (ret != 0);
 }
 
+SessionStats Session::stats() const
+{
+	struct sr_session_stats *stats;
+	SessionStats result;
+
+	check(sr_session_stats_get(_structure, &stats));
+
+	for (int i = 0; i < SR_DF_NUM_TYPES; i++) {
+		const PacketType *const type = PacketType::get(SR_DF_HEADER + i);
+		result.packets[type] = stats->packets[i];
+		result.bytes[type] = stats->bytes[i];
+	}
+	result.transform_us.assign(stats->transform_us,
+		stats->transform_us + stats->num_transforms);
+	result.callback_us.assign(stats->callback_us,
+		stats->callback_us + stats->num_callbacks);
+	result.usb_completed = stats->usb_completed;
+	result.usb_timed_out = stats->usb_timed_out;
+	result.usb_errors = stats->usb_errors;
+	result.queue_dropped = stats->queue_dropped;
+	result.queue_stalled = stats->queue_stalled;
+	result.queue_max_fill = stats->queue_max_fill;
+	result.source_timeouts = stats->source_timeouts;
+	result.source_latency_us = stats->source_latency_us;
+	result.source_max_latency_us = stats->source_max_latency_us;
+
+	sr_session_stats_free(stats);
+
+	return result;
+}
+
 static void session_stopped_callback(void *data) noexcept
 {
 	auto *const callback = static_cast<SessionStoppedCallback*>(data);
@@ -1047,6 +1165,15 @@ void Session::add_datafeed_callback(DatafeedCallbackFunction callback)
 	_datafeed_callbacks.push_back(move(cb_data));
 }
 
+void Session::add_datafeed_view_callback(DatafeedViewCallbackFunction callback)
+{
+	unique_ptr<DatafeedCallbackData> cb_data
+		{new DatafeedCallbackData{this, move(callback)}};
+	check(sr_session_datafeed_callback_add(_structure,
+			&datafeed_callback, cb_data.get()));
+	_datafeed_callbacks.push_back(move(cb_data));
+}
+
 void Session::remove_datafeed_callbacks()
 {
 	check(sr_session_datafeed_callback_remove_all(_structure));
@@ -1080,36 +1207,130 @@ shared_ptr<Context> Session::context()
 
 Packet::Packet(shared_ptr<Device> device,
 	const struct sr_datafeed_packet *structure) :
-	_structure(structure),
-	_device(move(device))
+	_structure(nullptr)
+{
+	assign(move(device), structure);
+}
+
+Packet::~Packet()
+{
+}
+
+/* Point the packet at another one. A payload of the same type is reused. */
+void Packet::assign(shared_ptr<Device> device,
+	const struct sr_datafeed_packet *structure)
 {
+	const int old_type = _structure ? _structure->type : -1;
+
+	_structure = structure;
+	_device = move(device);
+
+	if (structure->type != old_type)
+		_payload.reset();
+
 	switch (structure->type)
 	{
-		case SR_DF_HEADER:
-			_payload.reset(new Header{
-				static_cast<const struct sr_datafeed_header *>(
-					structure->payload)});
+		case SR_DF_HEADER: {
+			auto *const payload = static_cast<const struct sr_datafeed_header *>(
+				structure->payload);
+			if (_payload)
+				static_cast<Header *>(_payload.get())->_structure = payload;
+			else
+				_payload.reset(new Header{payload});
 			break;
-		case SR_DF_META:
-			_payload.reset(new Meta{
-				static_cast<const struct sr_datafeed_meta *>(
-					structure->payload)});
+		}
+		case SR_DF_META: {
+			auto *const payload = static_cast<const struct sr_datafeed_meta *>(
+				structure->payload);
+			if (_payload)
+				static_cast<Meta *>(_payload.get())->_structure = payload;
+			else
+				_payload.reset(new Meta{payload});
 			break;
-		case SR_DF_LOGIC:
-			_payload.reset(new Logic{
-				static_cast<const struct sr_datafeed_logic *>(
-					structure->payload)});
+		}
+		case SR_DF_LOGIC: {
+			auto *const payload = static_cast<const struct sr_datafeed_logic *>(
+				structure->payload);
+			if (_payload)
+				static_cast<Logic *>(_payload.get())->_structure = payload;
+			else
+				_payload.reset(new Logic{payload});
+			break;
+		}
+		case SR_DF_ANALOG: {
+			auto *const payload = static_cast<const struct sr_datafeed_analog *>(
+				structure->payload);
+			if (_payload)
+				static_cast<Analog *>(_payload.get())->_structure = payload;
+			else
+				_payload.reset(new Analog{payload});
 			break;
-		case SR_DF_ANALOG:
-			_payload.reset(new Analog{
-				static_cast<const struct sr_datafeed_analog *>(
-					structure->payload)});
+		}
+		default:
+			_payload.reset();
 			break;
 	}
 }
 
-Packet::~Packet()
+PacketView::PacketView(const struct sr_datafeed_packet *structure) :
+	_structure(structure)
+{
+}
+
+const PacketType *PacketView::type() const
+{
+	return PacketType::get(_structure->type);
+}
+
+const struct sr_datafeed_packet *PacketView::structure() const
+{
+	return _structure;
+}
+
+const void *PacketView::data_pointer() const
+{
+	switch (_structure->type) {
+	case SR_DF_LOGIC:
+		return static_cast<const struct sr_datafeed_logic *>(
+			_structure->payload)->data;
+	case SR_DF_ANALOG:
+		return static_cast<const struct sr_datafeed_analog *>(
+			_structure->payload)->data;
+	default:
+		throw Error(SR_ERR_NA);
+	}
+}
+
+size_t PacketView::data_length() const
 {
+	if (_structure->type != SR_DF_LOGIC)
+		throw Error(SR_ERR_NA);
+	return static_cast<const struct sr_datafeed_logic *>(
+		_structure->payload)->length;
+}
+
+unsigned int PacketView::unit_size() const
+{
+	if (_structure->type != SR_DF_LOGIC)
+		throw Error(SR_ERR_NA);
+	return static_cast<const struct sr_datafeed_logic *>(
+		_structure->payload)->unitsize;
+}
+
+unsigned int PacketView::num_samples() const
+{
+	if (_structure->type != SR_DF_ANALOG)
+		throw Error(SR_ERR_NA);
+	return static_cast<const struct sr_datafeed_analog *>(
+		_structure->payload)->num_samples;
+}
+
+void PacketView::get_data_as_float(float *dest) const
+{
+	if (_structure->type != SR_DF_ANALOG)
+		throw Error(SR_ERR_NA);
+	check(sr_analog_to_float(static_cast<const struct sr_datafeed_analog *>(
+		_structure->payload), dest));
 }
 
 const PacketType *Packet::type() const
@@ -1125,6 +1346,21 @@ shared_ptr<PacketPayload> Packet::payload()
 		throw Error(SR_ERR_NA);
 }
 
+shared_ptr<Packet> Packet::retain()
+{
+	if (_storage)
+		return shared_from_this();
+
+	auto *const ref = sr_packet_ref(_structure);
+	if (!ref)
+		throw Error(SR_ERR_ARG);
+
+	auto result = shared_ptr<Packet>{new Packet{_device, ref},
+		default_delete<Packet>{}};
+	result->_storage = shared_ptr<void>{ref, sr_packet_unref};
+	return result;
+}
+
 PacketPayload::PacketPayload()
 {
 }
@@ -1218,6 +1454,12 @@ unsigned int Logic::unit_size() const
 	return _structure->unitsize;
 }
 
+DataView<uint8_t> Logic::bytes() const
+{
+	return DataView<uint8_t>(static_cast<const uint8_t *>(_structure->data),
+		_structure->length);
+}
+
 Analog::Analog(const struct sr_datafeed_analog *structure) :
 	PacketPayload(),
 	_structure(structure)
@@ -1244,6 +1486,20 @@ void Analog::get_data_as_float(float *dest)
 	check(sr_analog_to_float(_structure, dest));
 }
 
+void Analog::get_data_as_float(vector<float> &dest)
+{
+	dest.resize(data_count());
+	if (dest.empty())
+		return;
+	check(sr_analog_to_float(_structure, dest.data()));
+}
+
+size_t Analog::data_count() const
+{
+	return static_cast<size_t>(_structure->num_samples) *
+		g_slist_length(_structure->meaning->channels);
+}
+
 unsigned int Analog::num_samples() const
 {
 	return _structure->num_samples;
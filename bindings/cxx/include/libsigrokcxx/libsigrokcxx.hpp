@@ -81,6 +81,7 @@ G_GNUC_END_IGNORE_DEPRECATIONS
 #include <functional>
 #include <stdexcept>
 #include <memory>
+#include <type_traits>
 #include <vector>
 #include <map>
 #include <set>
@@ -109,6 +110,7 @@ class SR_API TriggerMatch;
 class SR_API TriggerMatchType;
 class SR_API ChannelType;
 class SR_API Packet;
+class SR_API PacketView;
 class SR_API PacketPayload;
 class SR_API PacketType;
 class SR_API Quantity;
@@ -281,11 +283,74 @@ public:
 	/** Create a logic packet. */
 	std::shared_ptr<Packet> create_logic_packet(
 		void *data_pointer, size_t data_length, unsigned int unit_size);
+	/** Create a logic packet which owns the data, without copying it.
+	 * @param data Data, moved into the packet and freed with it. */
+	std::shared_ptr<Packet> create_logic_packet(
+		std::vector<uint8_t> data, unsigned int unit_size);
+	/** Create a logic packet which owns the data, without copying it.
+	 * @param data Data, moved into the packet and freed with it.
+	 * @param data_length Data length in bytes. */
+	std::shared_ptr<Packet> create_logic_packet(
+		std::unique_ptr<uint8_t[]> data, size_t data_length,
+		unsigned int unit_size);
 	/** Create an analog packet. */
 	std::shared_ptr<Packet> create_analog_packet(
 		std::vector<std::shared_ptr<Channel> > channels,
 		const float *data_pointer, unsigned int num_samples, const Quantity *mq,
 		const Unit *unit, std::vector<const QuantityFlag *> mqflags);
+	/**
+	 * Create an analog packet which owns the data, without copying it.
+	 *
+	 * T can be float, double or an integer type, in host byte order.
+	 * Each value gets multiplied by scale, then offset gets added.
+	 *
+	 * @param data Interleaved samples of all channels, moved into the
+	 *             packet and freed with it.
+	 */
+	template <class T>
+	std::shared_ptr<Packet> create_analog_packet(
+		std::vector<std::shared_ptr<Channel> > channels,
+		std::vector<T> data, const Quantity *mq, const Unit *unit,
+		std::vector<const QuantityFlag *> mqflags,
+		struct sr_rational scale = sr_rational{1, 1},
+		struct sr_rational offset = sr_rational{0, 1})
+	{
+		static_assert(std::is_arithmetic<T>::value,
+			"Analog samples are numbers");
+		const size_t num_channels = channels.empty() ? 1 : channels.size();
+		auto storage = std::make_shared<std::vector<T> >(std::move(data));
+		return create_analog_packet(std::move(channels), storage->data(),
+			storage->size() / num_channels, sizeof(T),
+			std::is_signed<T>::value, std::is_floating_point<T>::value,
+			scale, offset, mq, unit, std::move(mqflags), storage);
+	}
+	/**
+	 * Create an analog packet which owns the data, without copying it.
+	 *
+	 * @param data Interleaved samples of all channels, moved into the
+	 *             packet and freed with it.
+	 * @see create_analog_packet(std::vector<std::shared_ptr<Channel> >,
+	 *      std::vector<T>, const Quantity *, const Unit *,
+	 *      std::vector<const QuantityFlag *>, struct sr_rational,
+	 *      struct sr_rational)
+	 */
+	template <class T>
+	std::shared_ptr<Packet> create_analog_packet(
+		std::vector<std::shared_ptr<Channel> > channels,
+		std::unique_ptr<T[]> data, unsigned int num_samples,
+		const Quantity *mq, const Unit *unit,
+		std::vector<const QuantityFlag *> mqflags,
+		struct sr_rational scale = sr_rational{1, 1},
+		struct sr_rational offset = sr_rational{0, 1})
+	{
+		static_assert(std::is_arithmetic<T>::value,
+			"Analog samples are numbers");
+		std::shared_ptr<T> storage(data.release(), std::default_delete<T[]>());
+		return create_analog_packet(std::move(channels), storage.get(),
+			num_samples, sizeof(T),
+			std::is_signed<T>::value, std::is_floating_point<T>::value,
+			scale, offset, mq, unit, std::move(mqflags), storage);
+	}
 	/** Create an end packet. */
 	std::shared_ptr<Packet> create_end_packet();
 	/** Load a saved session.
@@ -310,6 +375,14 @@ private:
 	LogCallbackFunction _log_callback;
 	Context();
 	~Context();
+	std::shared_ptr<Packet> create_analog_packet(
+		std::vector<std::shared_ptr<Channel> > channels,
+		const void *data_pointer, unsigned int num_samples,
+		unsigned int unit_size, bool is_signed, bool is_float,
+		struct sr_rational scale, struct sr_rational offset,
+		const Quantity *mq, const Unit *unit,
+		std::vector<const QuantityFlag *> mqflags,
+		std::shared_ptr<void> storage);
 	friend class Session;
 	friend class Driver;
 	friend struct std::default_delete<Context>;
@@ -578,6 +651,10 @@ typedef std::function<void()> SessionStoppedCallback;
 typedef std::function<void(std::shared_ptr<Device>, std::shared_ptr<Packet>)>
 	DatafeedCallbackFunction;
 
+/** Type of lightweight datafeed callback, see add_datafeed_view_callback() */
+typedef std::function<void(Device &, const PacketView &)>
+	DatafeedViewCallbackFunction;
+
 /* Data required for C callback function to call a C++ datafeed callback */
 class SR_PRIV DatafeedCallbackData
 {
@@ -586,9 +663,18 @@ public:
 		const struct sr_datafeed_packet *pkt);
 private:
 	DatafeedCallbackFunction _callback;
+	DatafeedViewCallbackFunction _view_callback;
 	DatafeedCallbackData(Session *session,
 		DatafeedCallbackFunction callback);
+	DatafeedCallbackData(Session *session,
+		DatafeedViewCallbackFunction callback);
 	Session *_session;
+	/* Device of the last packet, and that packet for reuse. These are
+	 * dropped at the end of the stream, they keep the session alive. */
+	const struct sr_dev_inst *_sdi;
+	std::shared_ptr<Device> _device;
+	Device *_device_ptr;
+	std::shared_ptr<Packet> _packet;
 	friend class Session;
 };
 
@@ -607,6 +693,31 @@ private:
 };
 
 /** A sigrok session */
+/** Performance counters of a session run */
+struct SR_API SessionStats
+{
+	/** Packets sent by the devices, per packet type. */
+	std::map<const PacketType *, uint64_t> packets;
+	/** Sample data bytes of these packets, per packet type. */
+	std::map<const PacketType *, uint64_t> bytes;
+	/** Microseconds spent in each transform. */
+	std::vector<uint64_t> transform_us;
+	/** Microseconds spent in each datafeed callback. */
+	std::vector<uint64_t> callback_us;
+	/** USB transfers which completed, timed out, or failed. */
+	uint64_t usb_completed;
+	uint64_t usb_timed_out;
+	uint64_t usb_errors;
+	/** Datafeed queue statistics. */
+	uint64_t queue_dropped;
+	uint64_t queue_stalled;
+	size_t queue_max_fill;
+	/** Event source timeouts, and how late they were dispatched. */
+	uint64_t source_timeouts;
+	uint64_t source_latency_us;
+	uint64_t source_max_latency_us;
+};
+
 class SR_API Session : public UserOwned<Session>
 {
 public:
@@ -620,6 +731,13 @@ public:
 	/** Add a datafeed callback to this session.
 	 * @param callback Callback of the form callback(Device, Packet). */
 	void add_datafeed_callback(DatafeedCallbackFunction callback);
+	/** Add a lightweight datafeed callback to this session.
+	 *
+	 * The callback gets references to the device and to a view of the
+	 * packet, which are only valid during the call. Nothing is
+	 * allocated per packet.
+	 * @param callback Callback of the form callback(Device &, const PacketView &). */
+	void add_datafeed_view_callback(DatafeedViewCallbackFunction callback);
 	/** Remove all datafeed callbacks from this session. */
 	void remove_datafeed_callbacks();
 	/** Start the session. */
@@ -630,6 +748,8 @@ public:
 	void stop();
 	/** Return whether the session is running. */
 	bool is_running() const;
+	/** Apply configuration changes to the running session. */
+	void reconfigure();
 	/** Set callback to be invoked on session stop. */
 	void set_stopped_callback(SessionStoppedCallback callback);
 	/** Get current trigger setting. */
@@ -641,11 +761,14 @@ public:
 	void set_trigger(std::shared_ptr<Trigger> trigger);
 	/** Get filename this session was loaded from. */
 	std::string filename() const;
+	/** Get the performance counters of the current or last run. */
+	SessionStats stats() const;
 private:
 	explicit Session(std::shared_ptr<Context> context);
 	Session(std::shared_ptr<Context> context, std::string filename);
 	~Session();
 	std::shared_ptr<Device> get_device(const struct sr_dev_inst *sdi);
+	Device *get_device_ptr(const struct sr_dev_inst *sdi);
 	struct sr_session *_structure;
 	const std::shared_ptr<Context> _context;
 	std::map<const struct sr_dev_inst *, std::unique_ptr<SessionDevice> > _owned_devices;
@@ -669,13 +792,23 @@ public:
 	const PacketType *type() const;
 	/** Payload of this packet. */
 	std::shared_ptr<PacketPayload> payload();
+	/**
+	 * A packet whose data stays valid after the datafeed callback has
+	 * returned. The data only gets copied if the driver cannot hand over
+	 * its buffers. Packets which own their data return themselves.
+	 */
+	std::shared_ptr<Packet> retain();
 private:
 	Packet(std::shared_ptr<Device> device,
 		const struct sr_datafeed_packet *structure);
 	~Packet();
+	void assign(std::shared_ptr<Device> device,
+		const struct sr_datafeed_packet *structure);
 	const struct sr_datafeed_packet *_structure;
 	std::shared_ptr<Device> _device;
 	std::unique_ptr<PacketPayload> _payload;
+	/* Data owned by the packet, if any. */
+	std::shared_ptr<void> _storage;
 
 	friend class Session;
 	friend class Output;
@@ -688,6 +821,58 @@ private:
 	friend struct std::default_delete<Packet>;
 };
 
+/**
+ * Non-owning view of an array of samples inside a packet payload.
+ *
+ * The view is only valid as long as the payload it was taken from.
+ */
+template <class T>
+class SR_API DataView
+{
+public:
+	DataView(const T *data, size_t size) : _data(data), _size(size) {}
+	/** Pointer to the first element. */
+	const T *data() const { return _data; }
+	/** Number of elements. */
+	size_t size() const { return _size; }
+	/** True if the view has no elements. */
+	bool empty() const { return _size == 0; }
+	const T *begin() const { return _data; }
+	const T *end() const { return _data + _size; }
+	const T &operator[](size_t i) const { return _data[i]; }
+private:
+	const T *_data;
+	size_t _size;
+};
+
+/** Non-owning view of a datafeed packet, only valid during the callback */
+class SR_API PacketView
+{
+public:
+	/** Type of this packet. */
+	const PacketType *type() const;
+	/** The underlying C packet. */
+	const struct sr_datafeed_packet *structure() const;
+	/** Pointer to the logic or analog data. */
+	const void *data_pointer() const;
+	/** Logic data length in bytes. */
+	size_t data_length() const;
+	/** Size of each logic sample in bytes. */
+	unsigned int unit_size() const;
+	/** Number of analog samples. */
+	unsigned int num_samples() const;
+	/**
+	 * Fills dest pointer with the analog data converted to float.
+	 * The pointer must have space for num_samples() floats.
+	 */
+	void get_data_as_float(float *dest) const;
+private:
+	explicit PacketView(const struct sr_datafeed_packet *structure);
+	const struct sr_datafeed_packet *_structure;
+
+	friend class DatafeedCallbackData;
+};
+
 /** Abstract base class for datafeed packet payloads */
 class SR_API PacketPayload
 {
@@ -753,6 +938,24 @@ public:
 	size_t data_length() const;
 	/* Size of each sample in bytes. */
 	unsigned int unit_size() const;
+	/** The data as bytes, without copying; unit_size() bytes per sample. */
+	DataView<uint8_t> bytes() const;
+	/**
+	 * The data as samples of type T, without copying.
+	 *
+	 * @throws Error SR_ERR_NA if sizeof(T) differs from unit_size().
+	 */
+	template <class T>
+	DataView<T> samples() const
+	{
+		static_assert(std::is_integral<T>::value &&
+			std::is_unsigned<T>::value,
+			"Logic samples are unsigned integers");
+		if (_structure->unitsize != sizeof(T))
+			throw Error(SR_ERR_NA);
+		return DataView<T>(static_cast<const T *>(_structure->data),
+			_structure->length / sizeof(T));
+	}
 private:
 	explicit Logic(const struct sr_datafeed_logic *structure);
 	~Logic();
@@ -778,6 +981,36 @@ public:
 	 * The pointer must have space for num_samples() floats.
 	 */
 	void get_data_as_float(float *dest);
+	/**
+	 * Converts the analog data to float into dest, which gets resized
+	 * to hold the samples of all channels. Reusing the same vector for
+	 * every packet avoids allocations once it has grown large enough.
+	 */
+	void get_data_as_float(std::vector<float> &dest);
+	/**
+	 * The raw data as values of type T, without copying or conversion.
+	 *
+	 * Scale and offset are not applied. Only available when T matches
+	 * the encoding of the samples, i.e. its size, signedness and float
+	 * type, and the samples are in host byte order.
+	 *
+	 * @throws Error SR_ERR_NA if the encoding does not match T.
+	 */
+	template <class T>
+	DataView<T> as() const
+	{
+		static_assert(std::is_arithmetic<T>::value,
+			"Analog samples are numbers");
+		const struct sr_analog_encoding *enc = _structure->encoding;
+		if (enc->unitsize != sizeof(T) ||
+				bool(enc->is_float) != std::is_floating_point<T>::value ||
+				(!enc->is_float &&
+					bool(enc->is_signed) != std::is_signed<T>::value) ||
+				(sizeof(T) > 1 && bool(enc->is_bigendian) != host_is_bigendian()))
+			throw Error(SR_ERR_NA);
+		return DataView<T>(static_cast<const T *>(_structure->data),
+			data_count());
+	}
 	/** Number of samples in this packet. */
 	unsigned int num_samples() const;
 	/** Channels for which this packet contains data. */
@@ -837,6 +1070,13 @@ public:
 	std::shared_ptr<Logic> get_logic_via_schmitt_trigger(float lo_thr,
 		float hi_thr, uint8_t *state, uint8_t *data_ptr=nullptr) const;
 private:
+	/* Number of values in the data, for all channels. */
+	size_t data_count() const;
+	static bool host_is_bigendian()
+	{
+		const uint16_t word = 1;
+		return *reinterpret_cast<const uint8_t *>(&word) == 0;
+	}
 	explicit Analog(const struct sr_datafeed_analog *structure);
 	~Analog();
 	std::shared_ptr<PacketPayload> share_owned_by(std::shared_ptr<Packet> parent);
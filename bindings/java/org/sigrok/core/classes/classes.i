@@ -372,6 +372,95 @@ typedef jobject jdatafeedcallback;
   }
 }
 
+/*
+ * Support direct NIO buffers over packet data, without copying it.
+ *
+ * The buffers point into the packet, so they are only valid as long as
+ * the payload object they came from is in use. Call Packet.retain()
+ * to keep data from a datafeed callback beyond the callback.
+ */
+
+%inline {
+typedef jobject jbytebuffer;
+typedef jobject jfloatbuffer;
+}
+
+%typemap(jni) jbytebuffer "jobject"
+%typemap(jtype) jbytebuffer "java.nio.ByteBuffer"
+%typemap(jstype) jbytebuffer "java.nio.ByteBuffer"
+%typemap(javaout) jbytebuffer { return $jnicall; }
+%typemap(out) jbytebuffer %{ $result = $1; %}
+
+%typemap(jni) jfloatbuffer "jobject"
+%typemap(jtype) jfloatbuffer "java.nio.FloatBuffer"
+%typemap(jstype) jfloatbuffer "java.nio.FloatBuffer"
+%typemap(javain) jfloatbuffer "$javainput"
+%typemap(in) jfloatbuffer %{ $1 = $input; %}
+
+%extend sigrok::Logic
+{
+  /* View of the data, unit_size() bytes per sample. */
+  jbytebuffer data_buffer(JNIEnv *env)
+  {
+    return env->NewDirectByteBuffer($self->data_pointer(),
+      $self->data_length());
+  }
+}
+
+%extend sigrok::Analog
+{
+  /* Number of values in the data, for all channels. */
+  jlong num_values()
+  {
+    return (jlong)$self->num_samples() * $self->channels().size();
+  }
+
+  /* View of the data as it was encoded, see unitsize(). */
+  jbytebuffer data_buffer(JNIEnv *env)
+  {
+    return env->NewDirectByteBuffer($self->data_pointer(),
+      (jlong)$self->num_samples() * $self->channels().size() *
+      $self->unitsize());
+  }
+
+  /* Convert the data of all channels to float into a direct buffer. */
+  void get_data_as_float(JNIEnv *env, jfloatbuffer dest)
+  {
+    jlong count = (jlong)$self->num_samples() * $self->channels().size();
+    void *data = env->GetDirectBufferAddress(dest);
+    if (!data || env->GetDirectBufferCapacity(dest) < count)
+      throw sigrok::Error(SR_ERR_ARG);
+    if (count)
+      $self->get_data_as_float((float *)data);
+  }
+}
+
+%typemap(javacode) sigrok::Logic %{
+  /** Read-only view of the data, without copying it. */
+  public java.nio.ByteBuffer getDataBuffer() {
+    return data_buffer().asReadOnlyBuffer()
+      .order(java.nio.ByteOrder.LITTLE_ENDIAN);
+  }
+%}
+
+%typemap(javacode) sigrok::Analog %{
+  /** Read-only view of the encoded data, without copying it. */
+  public java.nio.ByteBuffer getDataBuffer() {
+    return data_buffer().asReadOnlyBuffer()
+      .order(is_bigendian() ? java.nio.ByteOrder.BIG_ENDIAN :
+        java.nio.ByteOrder.LITTLE_ENDIAN);
+  }
+
+  /** The data of all channels converted to float, in a new buffer. */
+  public java.nio.FloatBuffer getDataAsFloat() {
+    java.nio.FloatBuffer dest = java.nio.ByteBuffer
+      .allocateDirect(4 * (int)num_values())
+      .order(java.nio.ByteOrder.nativeOrder()).asFloatBuffer();
+    get_data_as_float(dest);
+    return dest;
+  }
+%}
+
 %include "doc.i"
 
 %define %enumextras(Class)
@@ -71,6 +71,19 @@ typedef guint pyg_flags_type;
 #define string_to_python PyString_FromString
 #endif
 
+/*
+ * Releases the GIL for as long as it is in scope, e.g. while libsigrok
+ * blocks on device I/O. Callbacks into Python reacquire it as needed.
+ */
+class GILRelease
+{
+public:
+    GILRelease() : _state(PyEval_SaveThread()) {}
+    ~GILRelease() { PyEval_RestoreThread(_state); }
+private:
+    PyThreadState *_state;
+};
+
 %}
 
 %init %{
@@ -91,8 +104,32 @@ typedef guint pyg_flags_type;
 #endif
     }
     import_array();
+#if PY_VERSION_HEX < 0x03070000
+    PyEval_InitThreads();
+#endif
 %}
 
+/* Calls which can block on device I/O run without holding the GIL. */
+%define %nogil(method)
+%exception method {
+    try {
+        GILRelease nogil;
+        $action
+    } catch (sigrok::Error &e) {
+        SWIG_exception(swig_exception_code(e.result),
+            const_cast<char*>(e.what()));
+    }
+}
+%enddef
+
+%nogil(sigrok::Session::start)
+%nogil(sigrok::Session::run)
+%nogil(sigrok::Session::stop)
+%nogil(sigrok::Device::open)
+%nogil(sigrok::Device::close)
+%nogil(sigrok::Configurable::config_get)
+%nogil(sigrok::Configurable::config_list)
+
 %include "../../../swig/templates.i"
 
 /* Map file objects to file descriptors. */
@@ -299,6 +336,38 @@ typedef guint pyg_flags_type;
 
 #include "libsigrokcxx/libsigrokcxx.hpp"
 
+static void packet_capsule_free(PyObject *capsule)
+{
+    delete static_cast<std::shared_ptr<sigrok::Packet> *>(
+        PyCapsule_GetPointer(capsule, "sigrok.Packet"));
+}
+
+/*
+ * Make a NumPy array which points into a packet's data hold a reference
+ * to the packet. For packets returned by Packet.retain(), the array then
+ * stays valid for as long as it is used.
+ */
+PyObject *array_keep_packet(PyObject *array, std::shared_ptr<sigrok::Packet> packet)
+{
+    if (!array || !packet)
+        return array;
+
+    auto holder = new std::shared_ptr<sigrok::Packet>(std::move(packet));
+    PyObject *base = PyCapsule_New(holder, "sigrok.Packet", packet_capsule_free);
+    if (!base) {
+        delete holder;
+        Py_DECREF(array);
+        return nullptr;
+    }
+    /* This steals the reference to base, even upon failure. */
+    if (PyArray_SetBaseObject((PyArrayObject *)array, base) < 0) {
+        Py_DECREF(array);
+        return nullptr;
+    }
+
+    return array;
+}
+
 /* Convert from a Python dict to a std::map<std::string, std::string> */
 std::map<std::string, std::string> dict_to_map_string(PyObject *dict)
 {
@@ -474,6 +543,7 @@ std::map<std::string, Glib::VariantBase> dict_to_map_options(PyObject *dict,
             options[key] = value;
         }
 
+        GILRelease nogil;
         return $self->scan(options);
     }
 }
@@ -528,10 +598,94 @@ std::map<std::string, Glib::VariantBase> dict_to_map_options(PyObject *dict,
 {
     void config_set(const ConfigKey *key, PyObject *input)
     {
-        $self->config_set(key, python_to_variant_by_key(input, key));
+        auto value = python_to_variant_by_key(input, key);
+        GILRelease nogil;
+        $self->config_set(key, value);
+    }
+}
+
+/* Support datafeed callbacks which get a list of packets per call. */
+%extend sigrok::Session
+{
+    void _add_datafeed_batch_callback(PyObject *callback, unsigned int batch_size)
+    {
+        typedef std::vector<std::pair<std::shared_ptr<sigrok::Device>,
+            std::shared_ptr<sigrok::Packet> > > Batch;
+
+        if (!PyCallable_Check(callback) || batch_size == 0)
+            throw sigrok::Error(SR_ERR_ARG);
+
+        auto batch = std::make_shared<Batch>();
+        batch->reserve(batch_size);
+
+        Py_INCREF(callback);
+
+        $self->add_datafeed_callback([=] (std::shared_ptr<sigrok::Device> device,
+                std::shared_ptr<sigrok::Packet> packet) {
+            const bool last = (packet->type() == sigrok::PacketType::END);
+
+            /* Packets in a batch outlive the datafeed callback. */
+            batch->emplace_back(device, packet->retain());
+            if (batch->size() < batch_size && !last)
+                return;
+
+            auto gstate = PyGILState_Ensure();
+
+            auto list = PyList_New(batch->size());
+            for (size_t i = 0; i < batch->size(); i++) {
+                auto device_obj = SWIG_NewPointerObj(
+                    SWIG_as_voidptr(new std::shared_ptr<sigrok::Device>((*batch)[i].first)),
+                    SWIGTYPE_p_std__shared_ptrT_sigrok__Device_t, SWIG_POINTER_OWN);
+                auto packet_obj = SWIG_NewPointerObj(
+                    SWIG_as_voidptr(new std::shared_ptr<sigrok::Packet>((*batch)[i].second)),
+                    SWIGTYPE_p_std__shared_ptrT_sigrok__Packet_t, SWIG_POINTER_OWN);
+                PyList_SET_ITEM(list, i,
+                    Py_BuildValue("(NN)", device_obj, packet_obj));
+            }
+            batch->clear();
+
+            auto result = PyObject_CallFunctionObjArgs(callback, list, nullptr);
+
+            Py_XDECREF(list);
+
+            bool completed = !PyErr_Occurred();
+
+            if (!completed)
+                PyErr_Print();
+
+            bool valid_result = (completed && result == Py_None);
+
+            Py_XDECREF(result);
+
+            if (completed && !valid_result)
+            {
+                PyErr_SetString(PyExc_TypeError,
+                    "Datafeed callback did not return None");
+                PyErr_Print();
+            }
+
+            PyGILState_Release(gstate);
+
+            if (!valid_result)
+                throw sigrok::Error(SR_ERR);
+        });
     }
 }
 
+%pythoncode
+{
+    def _Session_add_datafeed_batch_callback(self, callback, batch_size=64):
+        """Add a datafeed callback which gets a list of packets per call.
+
+        The callback gets called as callback([(device, packet), ...])
+        with up to batch_size packets, and with the rest at the end of
+        the acquisition. The packets stay valid after the call, see
+        Packet.retain()."""
+        self._add_datafeed_batch_callback(callback, batch_size)
+
+    Session.add_datafeed_batch_callback = _Session_add_datafeed_batch_callback
+}
+
 /* Return NumPy array from Analog::data(). */
 %extend sigrok::Analog
 {
@@ -542,13 +696,82 @@ std::map<std::string, Glib::VariantBase> dict_to_map_options(PyObject *dict,
         dims[0] = $self->channels().size();
         dims[1] = $self->num_samples();
         int typenum = NPY_FLOAT;
+#ifdef WORDS_BIGENDIAN
+        bool native = $self->is_bigendian();
+#else
+        bool native = !$self->is_bigendian();
+#endif
+        if ($self->is_float() && $self->unitsize() == sizeof(float) && native) {
+            void *data = $self->data_pointer();
+            return array_keep_packet(
+                PyArray_SimpleNewFromData(nd, dims, typenum, data),
+                $self->parent());
+        }
+
+        /* Other encodings need converting, into an array of its own. */
+        PyObject *array = PyArray_SimpleNew(nd, dims, typenum);
+        if (array && dims[0] && dims[1])
+            $self->get_data_as_float(
+                (float *)PyArray_DATA((PyArrayObject *)array));
+        return array;
+    }
+
+    PyObject * _raw_data()
+    {
+        npy_intp dims[2];
+        dims[0] = $self->channels().size();
+        dims[1] = $self->num_samples();
+        int typenum;
+        switch ($self->unitsize()) {
+        case 1:
+            typenum = $self->is_signed() ? NPY_INT8 : NPY_UINT8;
+            break;
+        case 2:
+            typenum = $self->is_signed() ? NPY_INT16 : NPY_UINT16;
+            break;
+        case 4:
+            typenum = $self->is_float() ? NPY_FLOAT32 :
+                $self->is_signed() ? NPY_INT32 : NPY_UINT32;
+            break;
+        case 8:
+            typenum = $self->is_float() ? NPY_FLOAT64 :
+                $self->is_signed() ? NPY_INT64 : NPY_UINT64;
+            break;
+        default:
+            PyErr_SetString(PyExc_ValueError, "Unsupported analog encoding");
+            return nullptr;
+        }
+        if ($self->is_float() && $self->unitsize() < 4) {
+            PyErr_SetString(PyExc_ValueError, "Unsupported analog encoding");
+            return nullptr;
+        }
+        PyArray_Descr *descr = PyArray_DescrFromType(typenum);
+#ifdef WORDS_BIGENDIAN
+        bool native = $self->is_bigendian();
+#else
+        bool native = !$self->is_bigendian();
+#endif
+        if (!native) {
+            PyArray_Descr *swapped = PyArray_DescrNewByteorder(descr, NPY_SWAP);
+            Py_DECREF(descr);
+            descr = swapped;
+        }
         void *data = $self->data_pointer();
-        return PyArray_SimpleNewFromData(nd, dims, typenum, data);
+        return array_keep_packet(
+            PyArray_NewFromDescr(&PyArray_Type, descr, 2, dims, nullptr,
+                data, NPY_ARRAY_CARRAY, nullptr),
+            $self->parent());
     }
 
 %pythoncode
 {
-    data = property(_data)
+    data = property(_data, doc=
+        """Samples converted to float32, shape (channels, samples).""")
+    raw_data = property(_raw_data, doc=
+        """Samples as they were encoded, without copying them.
+
+        Apply scale() and offset() to get the values of data:
+        raw_data * scale().value() + offset().value().""")
 }
 }
 
@@ -562,7 +785,9 @@ std::map<std::string, Glib::VariantBase> dict_to_map_options(PyObject *dict,
         dims[1] = $self->unit_size();
         int typenum = NPY_UINT8;
         void *data = $self->data_pointer();
-        return PyArray_SimpleNewFromData(2, dims, typenum, data);
+        return array_keep_packet(
+            PyArray_SimpleNewFromData(2, dims, typenum, data),
+            $self->parent());
     }
 
 %pythoncode
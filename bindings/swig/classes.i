@@ -80,6 +80,15 @@ template< class T > class enable_shared_from_this;
 #define SR_PRIV
 
 %ignore sigrok::DatafeedCallbackData;
+%ignore sigrok::PacketView;
+%ignore sigrok::Session::add_datafeed_view_callback;
+%ignore sigrok::DataView;
+%ignore sigrok::Logic::bytes;
+%ignore sigrok::Logic::samples;
+%ignore sigrok::Analog::as;
+%ignore sigrok::Analog::get_data_as_float(std::vector<float> &);
+%ignore sigrok::Context::create_logic_packet(std::vector<uint8_t>, unsigned int);
+%ignore sigrok::Context::create_logic_packet(std::unique_ptr<uint8_t[]>, size_t, unsigned int);
 
 #ifndef SWIGJAVA
 
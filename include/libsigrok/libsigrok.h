@@ -168,10 +168,70 @@ enum sr_packettype {
 	SR_DF_FRAME_END,
 	/** Payload is struct sr_datafeed_analog. */
 	SR_DF_ANALOG,
+	/**
+	 * Payload is struct sr_datafeed_logic_rle. Only passed to
+	 * applications which enabled it with sr_session_logic_rle_set(),
+	 * and to output modules with the SR_OUTPUT_LOGIC_RLE flag.
+	 * Everyone else receives the equivalent SR_DF_LOGIC packets.
+	 */
+	SR_DF_LOGIC_RLE,
 
 	/* Update datafeed_dump() (session.c) upon changes! */
 };
 
+/** Number of datafeed packet types, see struct sr_session_stats. */
+#define SR_DF_NUM_TYPES (SR_DF_LOGIC_RLE - SR_DF_HEADER + 1)
+
+/**
+ * Bit of a packet type in the masks of
+ * sr_session_datafeed_callback_add_filtered().
+ */
+#define SR_DF_MASK(type) (1U << ((type) - SR_DF_HEADER))
+/** Mask of all packet types. */
+#define SR_DF_MASK_ALL ((1U << SR_DF_NUM_TYPES) - 1)
+
+/** What to do when the datafeed queue is full. */
+enum sr_session_queue_policy {
+	/** Wait until the datafeed callbacks caught up. */
+	SR_SESSION_QUEUE_BLOCK = 10000,
+	/** Discard sample data packets. */
+	SR_SESSION_QUEUE_DROP,
+	/** Grow the queue beyond its configured depth. */
+	SR_SESSION_QUEUE_GROW,
+};
+
+/** Threads of a session, see sr_session_thread_sched_set(). */
+enum sr_session_thread {
+	/** The thread running sr_session_run(), for as long as it does. */
+	SR_SESSION_THREAD_MAIN = 10000,
+	/** Per-device acquisition threads, see sr_session_dev_threads_set(). */
+	SR_SESSION_THREAD_ACQUISITION,
+	/** The datafeed delivery thread, see sr_session_datafeed_queue_set(). */
+	SR_SESSION_THREAD_DATAFEED,
+	/** The USB event thread, which the context's sessions share. */
+	SR_SESSION_THREAD_USB_EVENTS,
+};
+
+/** Scheduling policies for struct sr_thread_sched. */
+enum sr_sched_policy {
+	/** Leave the thread's policy and priority alone. */
+	SR_SCHED_DEFAULT = 0,
+	/** Real-time, first in first out (SCHED_FIFO). */
+	SR_SCHED_FIFO,
+	/** Real-time, round robin (SCHED_RR). */
+	SR_SCHED_RR,
+};
+
+/** CPU affinity and scheduling of a thread. */
+struct sr_thread_sched {
+	/** CPUs the thread may run on, bit n for CPU n. 0 for any. */
+	uint64_t cpu_mask;
+	/** Scheduling policy, one of enum sr_sched_policy. */
+	int policy;
+	/** Real-time priority, within the policy's range (1 to 99 on Linux). */
+	int priority;
+};
+
 /** Measured quantity, sr_analog_meaning.mq. */
 enum sr_mq {
 	SR_MQ_VOLTAGE = 10000,
@@ -467,6 +527,42 @@ struct sr_context;
  */
 struct sr_session;
 
+/**
+ * @struct sr_sessionfile
+ * Opaque structure representing an open session file, for random
+ * access to its sample data.
+ *
+ * @see sr_sessionfile_open(), sr_sessionfile_close().
+ */
+struct sr_sessionfile;
+
+/**
+ * @struct sr_session_merge
+ * Opaque structure representing the merged, time ordered datafeed of
+ * the devices in a session.
+ *
+ * @see sr_session_merge_new(), sr_session_merge_free().
+ */
+struct sr_session_merge;
+
+/**
+ * @struct sr_session_preview
+ * Opaque structure representing a decimated preview of the datafeed of
+ * the devices in a session.
+ *
+ * @see sr_session_preview_new(), sr_session_preview_free().
+ */
+struct sr_session_preview;
+
+/**
+ * @struct sr_shmring_reader
+ * Opaque structure representing a reader of a datafeed in shared
+ * memory.
+ *
+ * @see sr_shmring_reader_open(), sr_shmring_reader_close().
+ */
+struct sr_shmring_reader;
+
 struct sr_rational {
 	/** Numerator of the rational number. */
 	int64_t p;
@@ -498,6 +594,18 @@ struct sr_datafeed_logic {
 	void *data;
 };
 
+/** Run-length encoded logic datafeed payload for type SR_DF_LOGIC_RLE. */
+struct sr_datafeed_logic_rle {
+	/** Number of runs. */
+	uint64_t num_runs;
+	/** Size of one sample in bytes. */
+	uint16_t unitsize;
+	/** One sample per run, num_runs * unitsize bytes. */
+	void *values;
+	/** Number of repetitions of each run's sample. */
+	uint64_t *counts;
+};
+
 /** Analog datafeed payload for type SR_DF_ANALOG. */
 struct sr_datafeed_analog {
 	void *data;
@@ -507,6 +615,110 @@ struct sr_datafeed_analog {
 	struct sr_analog_spec *spec;
 };
 
+/** Timing of a datafeed packet's samples, see sr_packet_timing_get(). */
+struct sr_packet_timing {
+	/** Index of the first sample since the device's SR_DF_HEADER. */
+	uint64_t first_sample;
+	/** Host time of the data in usecs, from g_get_monotonic_time(). */
+	int64_t host_time;
+	/** Device timestamp of the first sample, in units of 1 / hw_rate s. */
+	uint64_t hw_time;
+	/** Device timestamp clock rate in Hz, 0 if there is no timestamp. */
+	uint64_t hw_rate;
+};
+
+/** How sr_session_merge_new() lines up the devices' samples. */
+enum sr_merge_align {
+	/** Sample 0 of every device is at time 0, e.g. on a shared start. */
+	SR_MERGE_ALIGN_START = 10000,
+	/** By the host time at which the devices' samples arrived. */
+	SR_MERGE_ALIGN_HOST,
+	/** The trigger position of every device is at time 0. */
+	SR_MERGE_ALIGN_TRIGGER,
+};
+
+/** Where a merged packet is on the common timebase. */
+struct sr_merge_position {
+	/** Time of the packet's first sample in ns, can be negative. */
+	int64_t time_ns;
+	/** Time right after its last sample, time_ns without samples. */
+	int64_t end_ns;
+	/** Index of the first sample since the device's SR_DF_HEADER. */
+	uint64_t first_sample;
+	/** The device's samplerate in Hz, 0 if it has none. */
+	uint64_t samplerate;
+	/** The buffering limits forced the packet out of time order. */
+	gboolean late;
+};
+
+/**
+ * Min/max envelope of a device's samples, see sr_session_preview_new().
+ *
+ * Every point covers samples_per_point samples, the last point of an
+ * acquisition possibly less. Logic data comes for all logic channels at
+ * once, analog data for one channel at a time.
+ */
+struct sr_preview {
+	/** Index of the first point since the device's SR_DF_HEADER. */
+	uint64_t first_point;
+	/** Number of points. */
+	uint64_t num_points;
+	/** Number of samples every point covers. */
+	uint64_t samples_per_point;
+	/** The device's samplerate in Hz, 0 if it has none. */
+	uint64_t samplerate;
+	/** The analog channel, NULL for logic data. */
+	struct sr_channel *channel;
+	/** Size of a logic point in bytes, like the logic unitsize. */
+	uint16_t unitsize;
+	/** Logic: bits which were high in all of the point's samples. */
+	const uint8_t *logic_min;
+	/** Logic: bits which were high in any of the point's samples. */
+	const uint8_t *logic_max;
+	/** Analog: lowest value of every point. */
+	const float *analog_min;
+	/** Analog: highest value of every point. */
+	const float *analog_max;
+};
+
+/** Distribution of the data's age, see sr_session_latency_trace_set(). */
+struct sr_latency_stats {
+	/** Number of packets traced, 0 if there were none. */
+	uint64_t count;
+	/** Median, 99th percentile and maximum age in usecs. */
+	uint64_t p50_us;
+	uint64_t p99_us;
+	uint64_t max_us;
+};
+
+/** Performance counters of a session, see sr_session_stats_get(). */
+struct sr_session_stats {
+	/** Packets sent by the devices, indexed by (type - SR_DF_HEADER). */
+	uint64_t packets[SR_DF_NUM_TYPES];
+	/** Sample data bytes of these packets, same indices. */
+	uint64_t bytes[SR_DF_NUM_TYPES];
+	/** Microseconds spent in each transform, in list order. */
+	uint64_t *transform_us;
+	size_t num_transforms;
+	/** Microseconds spent in each datafeed callback, in list order. */
+	uint64_t *callback_us;
+	size_t num_callbacks;
+	/** Age of the data at each datafeed callback, same order. */
+	struct sr_latency_stats *callback_latency;
+	/** USB transfers which completed, timed out, or failed. */
+	uint64_t usb_completed;
+	uint64_t usb_timed_out;
+	uint64_t usb_errors;
+	/** See sr_session_datafeed_queue_stats_get(). */
+	uint64_t queue_dropped;
+	uint64_t queue_stalled;
+	size_t queue_max_fill;
+	/** Event source timeouts, and how late they were dispatched. */
+	uint64_t source_timeouts;
+	uint64_t source_latency_us;
+	uint64_t source_max_latency_us;
+};
+
 struct sr_analog_encoding {
 	uint8_t unitsize;
 	gboolean is_signed;
@@ -577,12 +789,42 @@ struct sr_resource {
 enum sr_output_flag {
 	/** If set, this output module writes the output itself. */
 	SR_OUTPUT_INTERNAL_IO_HANDLING = 0x01,
+	/** If set, this output module accepts SR_DF_LOGIC_RLE packets. */
+	SR_OUTPUT_LOGIC_RLE = 0x02,
+};
+
+/** When an output writer syncs its file, see sr_output_writer_new(). */
+enum sr_output_sync {
+	/** Leave it to the operating system. */
+	SR_OUTPUT_SYNC_NONE = 10000,
+	/** Once, when the writer is freed. */
+	SR_OUTPUT_SYNC_CLOSE,
+	/** After every block. */
+	SR_OUTPUT_SYNC_BLOCK,
+};
+
+/** Counters of an output writer, see sr_output_writer_stats_get(). */
+struct sr_output_writer_stats {
+	/** Bytes and blocks written to the file so far. */
+	uint64_t bytes_written;
+	uint64_t blocks_written;
+	/** Microseconds the writer thread spent writing and syncing. */
+	uint64_t write_us;
+	/** Times the sender waited for a free block, and for how long. */
+	uint64_t stalls;
+	uint64_t stall_us;
+	/** Largest number of blocks waiting to be written. */
+	size_t max_queued;
+	/** Whether the file is written with O_DIRECT. */
+	gboolean direct;
 };
 
 struct sr_input;
 struct sr_input_module;
+struct sr_input_runner;
 struct sr_output;
 struct sr_output_module;
+struct sr_output_writer;
 struct sr_transform;
 struct sr_transform_module;
 
@@ -1059,6 +1301,20 @@ enum sr_configkey {
 	/** Number of powerline cycles for ADC integration time. */
 	SR_CONF_ADC_POWERLINE_CYCLES,
 
+	/**
+	 * Number of simultaneously submitted USB transfers. 0 selects
+	 * the driver's default, which adapts to the host at runtime.
+	 * Reading it returns the number currently in use.
+	 */
+	SR_CONF_USB_TRANSFER_DEPTH,
+
+	/**
+	 * Size of a USB transfer in bytes. 0 selects the driver's default,
+	 * which adapts to the host across acquisitions. Reading it returns
+	 * the size currently in use.
+	 */
+	SR_CONF_USB_TRANSFER_SIZE,
+
 	/* Update sr_key_info_config[] (hwdriver.c) upon changes! */
 
 	/*--- Acquisition modes, sample limiting ----------------------------*/
@@ -1098,6 +1354,18 @@ enum sr_configkey {
 	/** Self test mode. */
 	SR_CONF_TEST_MODE,
 
+	/**
+	 * Send data as fast as the session accepts it, instead of at the
+	 * pace of the samplerate. For load tests.
+	 */
+	SR_CONF_MAX_THROUGHPUT,
+
+	/**
+	 * Send the samples of all analog channels in one packet, interleaved
+	 * (all channels' first sample, then all channels' second sample...).
+	 */
+	SR_CONF_ANALOG_GROUP_PACKETS,
+
 	/* Update sr_key_info_config[] (hwdriver.c) upon changes! */
 };
 
@@ -1108,6 +1376,14 @@ enum sr_configkey {
  */
 struct sr_dev_inst;
 
+/** Device events reported by sr_hotplug_start(). */
+enum sr_hotplug_event {
+	/** A newly connected device was found. */
+	SR_HOTPLUG_ARRIVED = 10000,
+	/** The connection of a known device went away. */
+	SR_HOTPLUG_LEFT,
+};
+
 /** Types of device instance, struct sr_dev_inst.type */
 enum sr_dev_inst_type {
 	/** Device instance type for USB devices. */
@@ -1188,6 +1464,26 @@ struct sr_dev_driver {
 	int (*config_list) (uint32_t key, GVariant **data,
 			const struct sr_dev_inst *sdi,
 			const struct sr_channel_group *cg);
+	/** Query several configuration keys at once (optional).
+	 *  Only the keys whose results[] entry is SR_OK must be handled,
+	 *  setting their data and results[] entries. Returning SR_ERR_NA
+	 *  makes the caller query the keys one by one with config_get().
+	 *  @see sr_config_get_multi().
+	 */
+	int (*config_get_multi) (struct sr_config *configs,
+			unsigned int num, int *results,
+			const struct sr_dev_inst *sdi,
+			const struct sr_channel_group *cg);
+	/** Set several configuration keys at once (optional).
+	 *  Only the keys whose results[] entry is SR_OK must be handled,
+	 *  setting their results[] entries. Returning SR_ERR_NA makes the
+	 *  caller set the keys one by one with config_set().
+	 *  @see sr_config_set_multi().
+	 */
+	int (*config_set_multi) (const struct sr_config *configs,
+			unsigned int num, int *results,
+			const struct sr_dev_inst *sdi,
+			const struct sr_channel_group *cg);
 
 	/* Device-specific */
 	/** Open device */
@@ -1198,6 +1494,12 @@ struct sr_dev_driver {
 	int (*dev_acquisition_start) (const struct sr_dev_inst *sdi);
 	/** End data acquisition on the specified device. */
 	int (*dev_acquisition_stop) (struct sr_dev_inst *sdi);
+	/**
+	 * Apply configuration changes to a running acquisition (optional).
+	 * Returning SR_ERR_NA makes the caller restart the acquisition.
+	 * @see sr_session_reconfigure()
+	 */
+	int (*dev_acquisition_reconfigure) (const struct sr_dev_inst *sdi);
 
 	/* Dynamic */
 	/** Device driver context, considered private. Initialized by init(). */
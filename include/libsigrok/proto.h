@@ -57,6 +57,11 @@ SR_API int sr_a2l_threshold(const struct sr_datafeed_analog *analog,
 SR_API int sr_a2l_schmitt_trigger(const struct sr_datafeed_analog *analog,
 		float lo_thr, float hi_thr, uint8_t *state, uint8_t *output,
 		uint64_t count);
+SR_API int sr_a2l_threshold_packed(const struct sr_datafeed_analog *analog,
+		float threshold, uint8_t *output, uint64_t count);
+SR_API int sr_a2l_schmitt_trigger_packed(const struct sr_datafeed_analog *analog,
+		float lo_thr, float hi_thr, uint8_t *state, uint8_t *output,
+		uint64_t count);
 
 /*--- log.c -----------------------------------------------------------------*/
 
@@ -68,6 +73,8 @@ SR_API int sr_log_loglevel_get(void);
 SR_API int sr_log_callback_set(sr_log_callback cb, void *cb_data);
 SR_API int sr_log_callback_set_default(void);
 SR_API int sr_log_callback_get(sr_log_callback *cb, void **cb_data);
+SR_API int sr_log_async_start(size_t num_messages);
+SR_API int sr_log_async_stop(void);
 
 /*--- device.c --------------------------------------------------------------*/
 
@@ -84,6 +91,7 @@ SR_API GSList *sr_dev_list(const struct sr_dev_driver *driver);
 SR_API int sr_dev_clear(const struct sr_dev_driver *driver);
 SR_API int sr_dev_open(struct sr_dev_inst *sdi);
 SR_API int sr_dev_close(struct sr_dev_inst *sdi);
+SR_API int sr_dev_keepalive_set(struct sr_dev_inst *sdi, gboolean enable);
 
 SR_API struct sr_dev_driver *sr_dev_inst_driver_get(const struct sr_dev_inst *sdi);
 SR_API const char *sr_dev_inst_vendor_get(const struct sr_dev_inst *sdi);
@@ -105,6 +113,10 @@ SR_API int sr_driver_init(struct sr_context *ctx,
 		struct sr_dev_driver *driver);
 SR_API GArray *sr_driver_scan_options_list(const struct sr_dev_driver *driver);
 SR_API GSList *sr_driver_scan(struct sr_dev_driver *driver, GSList *options);
+SR_API int sr_scan_begin(struct sr_context *ctx);
+SR_API int sr_scan_end(struct sr_context *ctx);
+SR_API GSList *sr_driver_scan_parallel(struct sr_dev_driver **drivers,
+		GSList *options, unsigned int max_threads, unsigned int timeout_ms);
 SR_API int sr_config_get(const struct sr_dev_driver *driver,
 		const struct sr_dev_inst *sdi,
 		const struct sr_channel_group *cg,
@@ -112,6 +124,13 @@ SR_API int sr_config_get(const struct sr_dev_driver *driver,
 SR_API int sr_config_set(const struct sr_dev_inst *sdi,
 		const struct sr_channel_group *cg,
 		uint32_t key, GVariant *data);
+SR_API int sr_config_get_multi(const struct sr_dev_driver *driver,
+		const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		struct sr_config *configs, unsigned int num, int *results);
+SR_API int sr_config_set_multi(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		const struct sr_config *configs, unsigned int num, int *results);
 SR_API int sr_config_commit(const struct sr_dev_inst *sdi);
 SR_API int sr_config_list(const struct sr_dev_driver *driver,
 		const struct sr_dev_inst *sdi,
@@ -145,18 +164,110 @@ SR_API int sr_session_trigger_set(struct sr_session *session, struct sr_trigger
 SR_API int sr_session_datafeed_callback_remove_all(struct sr_session *session);
 SR_API int sr_session_datafeed_callback_add(struct sr_session *session,
 		sr_datafeed_callback cb, void *cb_data);
+SR_API int sr_session_datafeed_callback_remove(struct sr_session *session,
+		sr_datafeed_callback cb, void *cb_data);
+SR_API int sr_session_datafeed_callback_add_filtered(struct sr_session *session,
+		sr_datafeed_callback cb, void *cb_data, uint32_t types,
+		const struct sr_dev_inst *sdi, const GSList *channels);
+SR_API int sr_session_logic_rle_set(struct sr_session *session,
+		gboolean enable);
+SR_API int sr_session_analog_interleave_set(struct sr_session *session,
+		gboolean enable);
+SR_API int sr_session_trigger_inplace_set(struct sr_session *session,
+		gboolean enable);
+SR_API int sr_session_dev_threads_set(struct sr_session *session,
+		gboolean enable);
+SR_API int sr_session_parallel_start_set(struct sr_session *session,
+		gboolean enable);
+SR_API int sr_session_analog_batch_set(struct sr_session *session,
+		unsigned int max_delay_ms);
+SR_API int sr_session_timer_slack_set(struct sr_session *session,
+		unsigned int slack_ms);
+SR_API int sr_session_thread_sched_set(struct sr_session *session,
+		int thread, const struct sr_thread_sched *sched);
+SR_API int sr_session_mem_lock_set(struct sr_session *session,
+		gboolean enable);
+SR_API int sr_session_latency_trace_set(struct sr_session *session,
+		gboolean enable);
+SR_API int sr_session_dev_latency_get(struct sr_session *session,
+		const struct sr_dev_inst *sdi, struct sr_latency_stats *stats);
+SR_API int sr_session_dev_arm_time_get(struct sr_session *session,
+		const struct sr_dev_inst *sdi, uint64_t *arm_us);
+SR_API int sr_session_datafeed_queue_set(struct sr_session *session,
+		size_t depth, int policy);
+SR_API int sr_session_datafeed_queue_stats_get(struct sr_session *session,
+		uint64_t *dropped, uint64_t *stalled, size_t *max_fill);
+SR_API int sr_session_stats_get(struct sr_session *session,
+		struct sr_session_stats **stats);
+SR_API void sr_session_stats_free(struct sr_session_stats *stats);
 
 /* Session control */
 SR_API int sr_session_start(struct sr_session *session);
 SR_API int sr_session_run(struct sr_session *session);
+SR_API int sr_session_poll_fd_get(struct sr_session *session, int *fd);
+SR_API int sr_session_dispatch_pending(struct sr_session *session);
 SR_API int sr_session_stop(struct sr_session *session);
 SR_API int sr_session_is_running(struct sr_session *session);
+SR_API int sr_session_reconfigure(struct sr_session *session);
 SR_API int sr_session_stopped_callback_set(struct sr_session *session,
 		sr_session_stopped_callback cb, void *cb_data);
 
 SR_API int sr_packet_copy(const struct sr_datafeed_packet *packet,
 		struct sr_datafeed_packet **copy);
 SR_API void sr_packet_free(struct sr_datafeed_packet *packet);
+SR_API struct sr_datafeed_packet *sr_packet_ref(
+		const struct sr_datafeed_packet *packet);
+SR_API void sr_packet_unref(struct sr_datafeed_packet *packet);
+SR_API uint64_t sr_packet_sequence_get(
+		const struct sr_datafeed_packet *packet);
+SR_API int sr_packet_timing_get(const struct sr_datafeed_packet *packet,
+		struct sr_packet_timing *timing);
+SR_API int sr_packet_trigger_get(const struct sr_datafeed_packet *packet,
+		uint64_t *trigger_at);
+
+/*--- session_merge.c -------------------------------------------------------*/
+
+typedef void (*sr_merge_callback)(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet,
+		const struct sr_merge_position *pos, void *cb_data);
+
+SR_API int sr_session_merge_new(struct sr_session *session,
+		struct sr_session_merge **merge, enum sr_merge_align align,
+		sr_merge_callback cb, void *cb_data);
+SR_API int sr_session_merge_limits_set(struct sr_session_merge *merge,
+		uint64_t max_bytes, uint64_t max_delay_us);
+SR_API void sr_session_merge_free(struct sr_session_merge *merge);
+
+/*--- session_preview.c -----------------------------------------------------*/
+
+typedef void (*sr_preview_callback)(const struct sr_dev_inst *sdi,
+		const struct sr_preview *preview, void *cb_data);
+
+SR_API int sr_session_preview_new(struct sr_session *session,
+		struct sr_session_preview **preview, uint64_t rate,
+		sr_preview_callback cb, void *cb_data);
+SR_API void sr_session_preview_free(struct sr_session_preview *preview);
+
+/* Session file access */
+SR_API int sr_sessionfile_open(const char *filename,
+		struct sr_sessionfile **sf);
+SR_API int sr_sessionfile_close(struct sr_sessionfile *sf);
+SR_API int sr_sessionfile_logic_info(struct sr_sessionfile *sf,
+		uint64_t *num_samples, unsigned int *unitsize,
+		uint64_t *samplerate);
+SR_API int sr_sessionfile_logic_read(struct sr_sessionfile *sf,
+		uint64_t start, uint64_t count, void *buf, uint64_t *read_count);
+SR_API int sr_sessionfile_summary_info(struct sr_sessionfile *sf,
+		uint64_t *block_samples, unsigned int *factor,
+		unsigned int *num_levels);
+SR_API int sr_sessionfile_logic_summary_read(struct sr_sessionfile *sf,
+		unsigned int level, uint64_t first, uint64_t count,
+		uint8_t *or_bits, uint8_t *and_bits, uint64_t *transitions,
+		uint64_t *read_count);
+SR_API int sr_sessionfile_analog_summary_read(struct sr_sessionfile *sf,
+		unsigned int channel, unsigned int level, uint64_t first,
+		uint64_t count, float *min, float *max, float *mean,
+		uint64_t *read_count);
 
 /*--- input/input.c ---------------------------------------------------------*/
 
@@ -176,9 +287,17 @@ SR_API int sr_input_scan_file(const char *filename, const struct sr_input **in);
 SR_API const struct sr_input_module *sr_input_module_get(const struct sr_input *in);
 SR_API struct sr_dev_inst *sr_input_dev_inst_get(const struct sr_input *in);
 SR_API int sr_input_send(const struct sr_input *in, GString *buf);
+SR_API int sr_input_send_mapped(const struct sr_input *in,
+		const char *filename);
 SR_API int sr_input_end(const struct sr_input *in);
 SR_API int sr_input_reset(const struct sr_input *in);
 SR_API void sr_input_free(const struct sr_input *in);
+SR_API int sr_input_runner_new(const struct sr_input *in,
+		const char *filename, size_t depth,
+		struct sr_input_runner **runner);
+SR_API int sr_input_runner_wait_ready(struct sr_input_runner *runner);
+SR_API int sr_input_runner_run(struct sr_input_runner *runner);
+SR_API void sr_input_runner_free(struct sr_input_runner *runner);
 
 /*--- output/output.c -------------------------------------------------------*/
 
@@ -198,7 +317,22 @@ SR_API gboolean sr_output_test_flag(const struct sr_output_module *omod,
 		uint64_t flag);
 SR_API int sr_output_send(const struct sr_output *o,
 		const struct sr_datafeed_packet *packet, GString **out);
+typedef int (*sr_output_sink_callback)(const void *data, size_t length,
+		void *cb_data);
+SR_API int sr_output_send_sink(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet,
+		sr_output_sink_callback cb, void *cb_data);
+SR_API int sr_output_send_file(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, FILE *file);
 SR_API int sr_output_free(const struct sr_output *o);
+SR_API int sr_output_writer_new(const struct sr_output *o,
+		const char *filename, size_t depth, int sync, gboolean direct,
+		struct sr_output_writer **writer);
+SR_API int sr_output_writer_send(struct sr_output_writer *writer,
+		const struct sr_datafeed_packet *packet);
+SR_API int sr_output_writer_stats_get(struct sr_output_writer *writer,
+		struct sr_output_writer_stats *stats);
+SR_API int sr_output_writer_free(struct sr_output_writer *writer);
 
 /*--- transform/transform.c -------------------------------------------------*/
 
@@ -225,6 +359,8 @@ SR_API int sr_trigger_match_add(struct sr_trigger_stage *stage,
 
 SR_API GSList *sr_serial_list(const struct sr_dev_driver *driver);
 SR_API void sr_serial_free(struct sr_serial_port *serial);
+SR_API int sr_serial_bt_discovery_start(void);
+SR_API int sr_serial_bt_discovery_stop(void);
 
 /*--- resource.c ------------------------------------------------------------*/
 
@@ -242,6 +378,43 @@ SR_API int sr_resource_set_hooks(struct sr_context *ctx,
 		sr_resource_close_callback close_cb,
 		sr_resource_read_callback read_cb, void *cb_data);
 
+/*--- hotplug.c -------------------------------------------------------------*/
+
+typedef void (*sr_hotplug_callback)(struct sr_dev_inst *sdi, int event,
+		void *cb_data);
+
+SR_API int sr_hotplug_start(struct sr_context *ctx,
+		struct sr_dev_driver **drivers, sr_hotplug_callback cb,
+		void *cb_data);
+SR_API int sr_hotplug_stop(struct sr_context *ctx);
+
+/*--- usb_replay.c ----------------------------------------------------------*/
+
+SR_API int sr_usb_record_start(struct sr_dev_inst *sdi, const char *path);
+SR_API int sr_usb_record_stop(struct sr_dev_inst *sdi);
+SR_API int sr_usb_recording_driver_get(const char *path, char **driver);
+
+/*--- mem_budget.c ----------------------------------------------------------*/
+
+SR_API int sr_mem_budget_set(struct sr_context *ctx, uint64_t bytes,
+		const char *spill_dir);
+SR_API int sr_mem_usage_get(struct sr_context *ctx, const char *component,
+		uint64_t *in_memory, uint64_t *spilled);
+
+/*--- shmring.c -------------------------------------------------------------*/
+
+SR_API int sr_shmring_reader_open(const char *name,
+		struct sr_shmring_reader **reader);
+SR_API void sr_shmring_reader_close(struct sr_shmring_reader *reader);
+SR_API GSList *sr_shmring_reader_channels(const struct sr_shmring_reader *reader);
+SR_API int sr_shmring_reader_next(struct sr_shmring_reader *reader,
+		const struct sr_datafeed_packet **packet);
+SR_API int sr_shmring_reader_check(const struct sr_shmring_reader *reader);
+
+/*--- scan_cache.c ----------------------------------------------------------*/
+
+SR_API int sr_scan_cache_set(struct sr_context *ctx, const char *filename);
+
 /*--- strutil.c -------------------------------------------------------------*/
 
 SR_API char *sr_si_string_u64(uint64_t x, const char *unit);
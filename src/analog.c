@@ -154,6 +154,113 @@ SR_PRIV int sr_analog_init(struct sr_datafeed_analog *analog,
 	return SR_OK;
 }
 
+/*
+ * The conversion loops in sr_analog_to_float() get all invariants (scale,
+ * offset, signedness, endianness) resolved before they are entered, and
+ * their bodies are free of branches, which lets compilers vectorize them.
+ * Suitably aligned input in host byte order gets read directly, all other
+ * input goes through the byte-wise accessors. The loops continue at i,
+ * after the samples which the SIMD code below already converted.
+ */
+/** @cond PRIVATE */
+#define CONVERT_LOOP(expr) \
+	do { \
+		for (; i < count; i++) \
+			outbuf[i] = scale * (float)(expr) + offset; \
+	} while (0)
+/** @endcond */
+
+#ifdef __SSE2__
+/* Convert 8 integers which are widened to 16 bits in v. */
+static inline void convert8_sse2(__m128i v, gboolean is_signed,
+		float *outbuf, __m128 scale, __m128 offset)
+{
+	__m128i lo, hi;
+
+	if (is_signed) {
+		lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+	} else {
+		lo = _mm_unpacklo_epi16(v, _mm_setzero_si128());
+		hi = _mm_unpackhi_epi16(v, _mm_setzero_si128());
+	}
+	_mm_storeu_ps(&outbuf[0],
+		_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(lo), scale), offset));
+	_mm_storeu_ps(&outbuf[4],
+		_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(hi), scale), offset));
+}
+
+/*
+ * Convert 8 and 16 bit integers in host byte order, 8 samples per step.
+ * Returns the number of converted samples, CONVERT_LOOP() does the rest.
+ */
+static size_t convert_int_sse2(const uint8_t *data, unsigned int unitsize,
+		gboolean is_signed, float *outbuf, size_t count,
+		float scale, float offset)
+{
+	const __m128 vscale = _mm_set1_ps(scale);
+	const __m128 voffset = _mm_set1_ps(offset);
+	__m128i v;
+	size_t i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		if (unitsize == 2) {
+			v = _mm_loadu_si128((const __m128i *)&data[2 * i]);
+		} else {
+			v = _mm_loadl_epi64((const __m128i *)&data[i]);
+			if (is_signed)
+				v = _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8);
+			else
+				v = _mm_unpacklo_epi8(v, _mm_setzero_si128());
+		}
+		convert8_sse2(v, is_signed, &outbuf[i], vscale, voffset);
+	}
+
+	return i;
+}
+#endif
+
+#ifdef __ARM_NEON
+/* The same as convert_int_sse2(), for NEON. */
+static size_t convert_int_neon(const uint8_t *data, unsigned int unitsize,
+		gboolean is_signed, float *outbuf, size_t count,
+		float scale, float offset)
+{
+	const float32x4_t vscale = vdupq_n_f32(scale);
+	const float32x4_t voffset = vdupq_n_f32(offset);
+	float32x4_t lo, hi;
+	int16x8_t s;
+	uint16x8_t u;
+	size_t i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		if (is_signed) {
+			if (unitsize == 2)
+				s = vld1q_s16((const int16_t *)
+					(const void *)&data[2 * i]);
+			else
+				s = vmovl_s8(vld1_s8((const int8_t *)&data[i]));
+			lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(s)));
+			hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(s)));
+		} else {
+			if (unitsize == 2)
+				u = vld1q_u16((const uint16_t *)
+					(const void *)&data[2 * i]);
+			else
+				u = vmovl_u8(vld1_u8(&data[i]));
+			lo = vcvtq_f32_u32(vmovl_u16(vget_low_u16(u)));
+			hi = vcvtq_f32_u32(vmovl_u16(vget_high_u16(u)));
+		}
+		vst1q_f32(&outbuf[i],
+			vaddq_f32(vmulq_f32(lo, vscale), voffset));
+		vst1q_f32(&outbuf[i + 4],
+			vaddq_f32(vmulq_f32(hi, vscale), voffset));
+	}
+
+	return i;
+}
+#endif
+
 /**
  * Convert an analog datafeed payload to an array of floats.
  *
@@ -174,14 +281,20 @@ SR_PRIV int sr_analog_init(struct sr_datafeed_analog *analog,
 SR_API int sr_analog_to_float(const struct sr_datafeed_analog *analog,
 		float *outbuf)
 {
-	unsigned int b, count;
-	gboolean bigendian;
+	const struct sr_analog_encoding *enc;
+	const uint8_t *data;
+	size_t i, count;
+	float scale, offset;
+	gboolean bigendian, native;
 
 	if (!analog || !(analog->data) || !(analog->meaning)
 			|| !(analog->encoding) || !outbuf)
 		return SR_ERR_ARG;
 
+	enc = analog->encoding;
+	data = analog->data;
 	count = analog->num_samples * g_slist_length(analog->meaning->channels);
+	i = 0;
 
 #ifdef WORDS_BIGENDIAN
 	bigendian = TRUE;
@@ -189,106 +302,111 @@ SR_API int sr_analog_to_float(const struct sr_datafeed_analog *analog,
 	bigendian = FALSE;
 #endif
 
-	if (!analog->encoding->is_float) {
-		float offset = analog->encoding->offset.p / (float)analog->encoding->offset.q;
-		float scale = analog->encoding->scale.p / (float)analog->encoding->scale.q;
-		gboolean is_signed = analog->encoding->is_signed;
-		gboolean is_bigendian = analog->encoding->is_bigendian;
-		int8_t *data8 = (int8_t *)(analog->data);
-		int16_t *data16 = (int16_t *)(analog->data);
-		int32_t *data32 = (int32_t *)(analog->data);
-
-		switch (analog->encoding->unitsize) {
-		case 1:
-			if (is_signed) {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * data8[i];
-					outbuf[i] += offset;
-				}
-			} else {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * R8(data8 + i);
-					outbuf[i] += offset;
-				}
-			}
-			break;
-		case 2:
-			if (is_signed && is_bigendian) {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * RB16S(&data16[i]);
-					outbuf[i] += offset;
-				}
-			} else if (is_bigendian) {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * RB16(&data16[i]);
-					outbuf[i] += offset;
-				}
-			} else if (is_signed) {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * RL16S(&data16[i]);
-					outbuf[i] += offset;
-				}
-			} else {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * RL16(&data16[i]);
-					outbuf[i] += offset;
-				}
-			}
-			break;
-		case 4:
-			if (is_signed && is_bigendian) {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * RB32S(&data32[i]);
-					outbuf[i] += offset;
-				}
-			} else if (is_bigendian) {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * RB32(&data32[i]);
-					outbuf[i] += offset;
-				}
-			} else if (is_signed) {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * RL32S(&data32[i]);
-					outbuf[i] += offset;
-				}
-			} else {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * RL32(&data32[i]);
-					outbuf[i] += offset;
-				}
-			}
-			break;
-		default:
+	if (enc->unitsize < 1 || enc->unitsize > 4) {
+		if (!enc->is_float || enc->unitsize != sizeof(double)) {
 			sr_err("Unsupported unit size '%d' for analog-to-float"
-			       " conversion.", analog->encoding->unitsize);
+			       " conversion.", enc->unitsize);
 			return SR_ERR;
 		}
-		return SR_OK;
+	}
+	if (enc->is_float && enc->unitsize != sizeof(float)
+			&& enc->unitsize != sizeof(double)) {
+		sr_err("Unsupported float unit size '%d' for analog-to-float"
+		       " conversion.", enc->unitsize);
+		return SR_ERR;
 	}
 
-	if (analog->encoding->unitsize == sizeof(float)
-			&& analog->encoding->is_bigendian == bigendian
-			&& analog->encoding->scale.p == 1
-			&& analog->encoding->scale.q == 1
-			&& analog->encoding->offset.p / (float)analog->encoding->offset.q == 0) {
-		/* The data is already in the right format. */
-		memcpy(outbuf, analog->data, count * sizeof(float));
-	} else {
-		for (unsigned int i = 0; i < count; i += analog->encoding->unitsize) {
-			for (b = 0; b < analog->encoding->unitsize; b++) {
-				if (analog->encoding->is_bigendian == bigendian)
-					((uint8_t *)outbuf)[i + b] =
-						((uint8_t *)analog->data)[i * analog->encoding->unitsize + b];
-				else
-					((uint8_t *)outbuf)[i + (analog->encoding->unitsize - b)] =
-						((uint8_t *)analog->data)[i * analog->encoding->unitsize + b];
-			}
-			if (analog->encoding->scale.p != 1
-					|| analog->encoding->scale.q != 1)
-				outbuf[i] = (outbuf[i] * analog->encoding->scale.p) / analog->encoding->scale.q;
-			float offset = ((float)analog->encoding->offset.p / (float)analog->encoding->offset.q);
-			outbuf[i] += offset;
+	native = (!enc->is_bigendian == !bigendian)
+		&& ((uintptr_t)data % enc->unitsize) == 0;
+	scale = enc->scale.p / (float)enc->scale.q;
+	offset = enc->offset.p / (float)enc->offset.q;
+
+	if (enc->is_float && enc->unitsize == sizeof(double)) {
+		if (native)
+			CONVERT_LOOP(((const double *)(const void *)data)[i]);
+		else if (enc->is_bigendian)
+			CONVERT_LOOP(RBDB(&data[i * sizeof(double)]));
+		else
+			CONVERT_LOOP(RLDB(&data[i * sizeof(double)]));
+		return SR_OK;
+	}
+	if (enc->is_float) {
+		if (native && enc->scale.p == 1 && enc->scale.q == 1
+				&& offset == 0) {
+			/* The data is already in the right format. */
+			memcpy(outbuf, data, count * sizeof(float));
+		} else if (native) {
+			CONVERT_LOOP(((const float *)(const void *)data)[i]);
+		} else if (enc->is_bigendian) {
+			CONVERT_LOOP(RBFL(&data[i * sizeof(float)]));
+		} else {
+			CONVERT_LOOP(RLFL(&data[i * sizeof(float)]));
 		}
+		return SR_OK;
+	}
+
+	switch (enc->unitsize) {
+	case 1:
+#if defined(__SSE2__)
+		i = convert_int_sse2(data, 1, enc->is_signed, outbuf, count,
+			scale, offset);
+#elif defined(__ARM_NEON)
+		i = convert_int_neon(data, 1, enc->is_signed, outbuf, count,
+			scale, offset);
+#endif
+		if (enc->is_signed)
+			CONVERT_LOOP(((const int8_t *)data)[i]);
+		else
+			CONVERT_LOOP(data[i]);
+		break;
+	case 2:
+#if defined(__SSE2__)
+		if (native)
+			i = convert_int_sse2(data, 2, enc->is_signed, outbuf,
+				count, scale, offset);
+#elif defined(__ARM_NEON)
+		if (native)
+			i = convert_int_neon(data, 2, enc->is_signed, outbuf,
+				count, scale, offset);
+#endif
+		if (native && enc->is_signed)
+			CONVERT_LOOP(((const int16_t *)(const void *)data)[i]);
+		else if (native)
+			CONVERT_LOOP(((const uint16_t *)(const void *)data)[i]);
+		else if (enc->is_signed && enc->is_bigendian)
+			CONVERT_LOOP(RB16S(&data[2 * i]));
+		else if (enc->is_bigendian)
+			CONVERT_LOOP(RB16(&data[2 * i]));
+		else if (enc->is_signed)
+			CONVERT_LOOP(RL16S(&data[2 * i]));
+		else
+			CONVERT_LOOP(RL16(&data[2 * i]));
+		break;
+	case 3:
+		/* No host type to read these directly. */
+		if (enc->is_signed && enc->is_bigendian)
+			CONVERT_LOOP(RB24S(&data[3 * i]));
+		else if (enc->is_bigendian)
+			CONVERT_LOOP(RB24(&data[3 * i]));
+		else if (enc->is_signed)
+			CONVERT_LOOP(RL24S(&data[3 * i]));
+		else
+			CONVERT_LOOP(RL24(&data[3 * i]));
+		break;
+	case 4:
+		if (native && enc->is_signed)
+			CONVERT_LOOP(((const int32_t *)(const void *)data)[i]);
+		else if (native)
+			CONVERT_LOOP(((const uint32_t *)(const void *)data)[i]);
+		else if (enc->is_signed && enc->is_bigendian)
+			CONVERT_LOOP(RB32S(&data[4 * i]));
+		else if (enc->is_bigendian)
+			CONVERT_LOOP(RB32(&data[4 * i]));
+		else if (enc->is_signed)
+			CONVERT_LOOP(RL32S(&data[4 * i]));
+		else
+			CONVERT_LOOP(RL32(&data[4 * i]));
+		break;
 	}
 
 	return SR_OK;
@@ -432,6 +550,33 @@ SR_API void sr_rational_set(struct sr_rational *r, int64_t p, uint64_t q)
 	r->q = q;
 }
 
+/**
+ * Set sr_rational r to an approximation of a floating point value.
+ *
+ * The denominator is the smallest power of ten which keeps at least nine
+ * significant digits (up to 10^15), which is plenty for the scale and
+ * offset of instrument readings.
+ *
+ * @param[out] r Rational number struct to set. Must not be NULL.
+ * @param[in] value The value.
+ *
+ * @private
+ */
+SR_PRIV void sr_rational_from_double(struct sr_rational *r, double value)
+{
+	uint64_t q;
+
+	if (!r)
+		return;
+
+	q = 1;
+	while (value != 0.0 && q < 1000000000000000ULL && fabs(value * q) < 1e9)
+		q *= 10;
+
+	r->p = llround(value * q);
+	r->q = q;
+}
+
 #ifndef HAVE___INT128_T
 struct sr_int128_t {
 	int64_t high;
@@ -628,4 +773,146 @@ SR_API int sr_rational_div(struct sr_rational *res, const struct sr_rational *nu
 	return sr_rational_mult(res, num, &t);
 }
 
+/**
+ * Prepare to collect the samples of several channels for one packet.
+ *
+ * @param channels The channels, in the order of their values within a
+ *                 sample. The list is copied.
+ * @param size Number of samples per channel to make room for. More
+ *             samples are taken, at the cost of reallocations.
+ *
+ * @private
+ */
+SR_PRIV struct sr_analog_interleave *sr_analog_interleave_new(
+		const GSList *channels, size_t size)
+{
+	struct sr_analog_interleave *il;
+
+	il = g_malloc0(sizeof(*il));
+	il->channels = g_slist_copy((GSList *)channels);
+	il->num_channels = g_slist_length(il->channels);
+	il->size = MAX(size, 1);
+	il->fill = g_malloc0(il->num_channels * sizeof(il->fill[0]));
+	il->data = g_malloc(il->size * il->num_channels * sizeof(float));
+
+	return il;
+}
+
+/** @private */
+SR_PRIV void sr_analog_interleave_free(struct sr_analog_interleave *il)
+{
+	if (!il)
+		return;
+
+	g_slist_free(il->channels);
+	g_free(il->fill);
+	g_free(il->data);
+	g_free(il->scratch);
+	g_free(il);
+}
+
+/**
+ * Add the samples of a single channel packet, after the channel's
+ * samples which were added before.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG The packet's channel is not one of the collected.
+ *
+ * @private
+ */
+SR_PRIV int sr_analog_interleave_add(struct sr_analog_interleave *il,
+		const struct sr_datafeed_analog *analog)
+{
+	const float *src;
+	float *dst;
+	size_t c, i, n, stride;
+	int ret;
+
+	if (!il || !analog || !analog->meaning->channels ||
+			analog->meaning->channels->next)
+		return SR_ERR_ARG;
+	c = g_slist_index(il->channels, analog->meaning->channels->data);
+	if (c >= il->num_channels)
+		return SR_ERR_ARG;
+
+	n = analog->num_samples;
+	if (n > il->scratch_size) {
+		g_free(il->scratch);
+		il->scratch = g_malloc(n * sizeof(float));
+		il->scratch_size = n;
+	}
+	if ((ret = sr_analog_to_float(analog, il->scratch)) != SR_OK)
+		return ret;
+
+	if (il->fill[c] + n > il->size) {
+		il->size = MAX(il->fill[c] + n, 2 * il->size);
+		il->data = g_realloc(il->data,
+			il->size * il->num_channels * sizeof(float));
+	}
+
+	/* Keep the most digits, so no channel loses resolution. */
+	if (!il->fill[c] || analog->encoding->digits > il->digits)
+		il->digits = analog->encoding->digits;
+	il->mq = analog->meaning->mq;
+	il->unit = analog->meaning->unit;
+	il->mqflags = analog->meaning->mqflags;
+
+	stride = il->num_channels;
+	src = il->scratch;
+	dst = il->data + il->fill[c] * stride + c;
+	for (i = 0; i < n; i++)
+		dst[i * stride] = src[i];
+	il->fill[c] += n;
+
+	return SR_OK;
+}
+
+/**
+ * Send the samples which all channels have, as one packet. Samples
+ * which some of the channels have already are kept for the next one.
+ *
+ * @private
+ */
+SR_PRIV int sr_analog_interleave_send(struct sr_analog_interleave *il,
+		const struct sr_dev_inst *sdi)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	size_t c, num, most;
+	int ret;
+
+	if (!il)
+		return SR_ERR_ARG;
+
+	num = most = il->fill[0];
+	for (c = 1; c < il->num_channels; c++) {
+		num = MIN(num, il->fill[c]);
+		most = MAX(most, il->fill[c]);
+	}
+	if (!num)
+		return SR_OK;
+
+	sr_analog_init(&analog, &encoding, &meaning, &spec, il->digits);
+	analog.meaning->channels = il->channels;
+	analog.meaning->mq = il->mq;
+	analog.meaning->unit = il->unit;
+	analog.meaning->mqflags = il->mqflags;
+	analog.num_samples = num;
+	analog.data = il->data;
+	packet.type = SR_DF_ANALOG;
+	packet.payload = &analog;
+	ret = sr_session_send(sdi, &packet);
+
+	if (most > num)
+		memmove(il->data, il->data + num * il->num_channels,
+			(most - num) * il->num_channels * sizeof(float));
+	for (c = 0; c < il->num_channels; c++)
+		il->fill[c] -= num;
+
+	return ret;
+}
+
 /** @} */
@@ -20,6 +20,7 @@
 
 #include <config.h>
 #include <glib.h>
+#include <string.h>
 #ifdef _WIN32
 #include <winsock2.h>
 #endif
@@ -282,258 +283,267 @@ static void print_resourcepaths(void)
 }
 
 /**
- * Sanity-check all libsigrok drivers.
+ * Sanity-check a libsigrok driver.
  *
- * @param[in] ctx Pointer to a libsigrok context struct. Must not be NULL.
+ * This runs when the driver gets initialized, instead of for all drivers
+ * in sr_init().
  *
- * @retval SR_OK All drivers are OK
- * @retval SR_ERR One or more drivers have issues.
- * @retval SR_ERR_ARG Invalid argument.
+ * @param[in] driver The driver to check. Must not be NULL.
+ *
+ * @retval SR_OK The driver is OK.
+ * @retval SR_ERR The driver has issues.
+ *
+ * @private
  */
-static int sanity_check_all_drivers(const struct sr_context *ctx)
+SR_PRIV int sr_driver_sanity_check(const struct sr_dev_driver *driver)
 {
-	int i, errors, ret = SR_OK;
-	struct sr_dev_driver **drivers;
+	int errors;
 	const char *d;
 
-	if (!ctx)
-		return SR_ERR_ARG;
-
-	sr_spew("Sanity-checking all drivers.");
-
-	drivers = sr_driver_list(ctx);
-	for (i = 0; drivers[i]; i++) {
-		errors = 0;
+	errors = 0;
 
-		d = (drivers[i]->name) ? drivers[i]->name : "NULL";
+	d = (driver->name) ? driver->name : "NULL";
 
-		if (!drivers[i]->name) {
-			sr_err("No name in driver %d ('%s').", i, d);
-			errors++;
-		}
-		if (!drivers[i]->longname) {
-			sr_err("No longname in driver %d ('%s').", i, d);
-			errors++;
-		}
-		if (drivers[i]->api_version < 1) {
-			sr_err("API version in driver %d ('%s') < 1.", i, d);
-			errors++;
-		}
-		if (!drivers[i]->init) {
-			sr_err("No init in driver %d ('%s').", i, d);
-			errors++;
-		}
-		if (!drivers[i]->cleanup) {
-			sr_err("No cleanup in driver %d ('%s').", i, d);
-			errors++;
-		}
-		if (!drivers[i]->scan) {
-			sr_err("No scan in driver %d ('%s').", i, d);
-			errors++;
-		}
-		if (!drivers[i]->dev_list) {
-			sr_err("No dev_list in driver %d ('%s').", i, d);
-			errors++;
-		}
-		if (!drivers[i]->dev_clear) {
-			sr_err("No dev_clear in driver %d ('%s').", i, d);
-			errors++;
-		}
-		/* Note: config_get() is optional. */
-		if (!drivers[i]->config_set) {
-			sr_err("No config_set in driver %d ('%s').", i, d);
-			errors++;
-		}
-		/* Note: config_channel_set() is optional. */
-		/* Note: config_commit() is optional. */
-		if (!drivers[i]->config_list) {
-			sr_err("No config_list in driver %d ('%s').", i, d);
-			errors++;
-		}
-		if (!drivers[i]->dev_open) {
-			sr_err("No dev_open in driver %d ('%s').", i, d);
-			errors++;
-		}
-		if (!drivers[i]->dev_close) {
-			sr_err("No dev_close in driver %d ('%s').", i, d);
-			errors++;
-		}
-		if (!drivers[i]->dev_acquisition_start) {
-			sr_err("No dev_acquisition_start in driver %d ('%s').",
-			       i, d);
-			errors++;
-		}
-		if (!drivers[i]->dev_acquisition_stop) {
-			sr_err("No dev_acquisition_stop in driver %d ('%s').",
-			       i, d);
-			errors++;
-		}
-
-		/* Note: 'priv' is allowed to be NULL. */
-
-		if (errors == 0)
-			continue;
-
-		ret = SR_ERR;
+	if (!driver->name) {
+		sr_err("No name in driver '%s'.", d);
+		errors++;
+	}
+	if (!driver->longname) {
+		sr_err("No longname in driver '%s'.", d);
+		errors++;
+	}
+	if (driver->api_version < 1) {
+		sr_err("API version in driver '%s' < 1.", d);
+		errors++;
+	}
+	if (!driver->init) {
+		sr_err("No init in driver '%s'.", d);
+		errors++;
+	}
+	if (!driver->cleanup) {
+		sr_err("No cleanup in driver '%s'.", d);
+		errors++;
+	}
+	if (!driver->scan) {
+		sr_err("No scan in driver '%s'.", d);
+		errors++;
+	}
+	if (!driver->dev_list) {
+		sr_err("No dev_list in driver '%s'.", d);
+		errors++;
+	}
+	if (!driver->dev_clear) {
+		sr_err("No dev_clear in driver '%s'.", d);
+		errors++;
+	}
+	/* Note: config_get() is optional. */
+	if (!driver->config_set) {
+		sr_err("No config_set in driver '%s'.", d);
+		errors++;
+	}
+	/* Note: config_channel_set() is optional. */
+	/* Note: config_commit() is optional. */
+	if (!driver->config_list) {
+		sr_err("No config_list in driver '%s'.", d);
+		errors++;
+	}
+	if (!driver->dev_open) {
+		sr_err("No dev_open in driver '%s'.", d);
+		errors++;
+	}
+	if (!driver->dev_close) {
+		sr_err("No dev_close in driver '%s'.", d);
+		errors++;
+	}
+	if (!driver->dev_acquisition_start) {
+		sr_err("No dev_acquisition_start in driver '%s'.", d);
+		errors++;
+	}
+	if (!driver->dev_acquisition_stop) {
+		sr_err("No dev_acquisition_stop in driver '%s'.", d);
+		errors++;
 	}
 
-	return ret;
+	/* Note: 'priv' is allowed to be NULL. */
+
+	return errors ? SR_ERR : SR_OK;
 }
 
 /**
- * Sanity-check all libsigrok input modules.
+ * Sanity-check a libsigrok input module, before it gets used.
+ *
+ * @param[in] imod The module to check. Must not be NULL.
+ *
+ * @retval SR_OK The module is OK.
+ * @retval SR_ERR The module has issues.
  *
- * @retval SR_OK All modules are OK
- * @retval SR_ERR One or more modules have issues.
+ * @private
  */
-static int sanity_check_all_input_modules(void)
+SR_PRIV int sr_input_module_sanity_check(const struct sr_input_module *imod)
 {
-	int i, errors, ret = SR_OK;
-	const struct sr_input_module **inputs;
+	int errors;
 	const char *d;
 
-	sr_spew("Sanity-checking all input modules.");
+	errors = 0;
 
-	inputs = sr_input_list();
-	for (i = 0; inputs[i]; i++) {
-		errors = 0;
-
-		d = (inputs[i]->id) ? inputs[i]->id : "NULL";
-
-		if (!inputs[i]->id) {
-			sr_err("No ID in module %d ('%s').", i, d);
-			errors++;
-		}
-		if (!inputs[i]->name) {
-			sr_err("No name in module %d ('%s').", i, d);
-			errors++;
-		}
-		if (!inputs[i]->desc) {
-			sr_err("No description in module %d ('%s').", i, d);
-			errors++;
-		}
-		if (!inputs[i]->init) {
-			sr_err("No init in module %d ('%s').", i, d);
-			errors++;
-		}
-		if (!inputs[i]->receive) {
-			sr_err("No receive in module %d ('%s').", i, d);
-			errors++;
-		}
-		if (!inputs[i]->end) {
-			sr_err("No end in module %d ('%s').", i, d);
-			errors++;
-		}
+	d = (imod->id) ? imod->id : "NULL";
 
-		if (errors == 0)
-			continue;
-
-		ret = SR_ERR;
+	if (!imod->id) {
+		sr_err("No ID in module '%s'.", d);
+		errors++;
+	}
+	if (!imod->name) {
+		sr_err("No name in module '%s'.", d);
+		errors++;
+	}
+	if (!imod->desc) {
+		sr_err("No description in module '%s'.", d);
+		errors++;
+	}
+	if (!imod->init) {
+		sr_err("No init in module '%s'.", d);
+		errors++;
+	}
+	if (!imod->receive) {
+		sr_err("No receive in module '%s'.", d);
+		errors++;
+	}
+	if (!imod->end) {
+		sr_err("No end in module '%s'.", d);
+		errors++;
 	}
 
-	return ret;
+	return errors ? SR_ERR : SR_OK;
 }
 
 /**
- * Sanity-check all libsigrok output modules.
+ * Sanity-check a libsigrok output module, before it gets used.
  *
- * @retval SR_OK All modules are OK
- * @retval SR_ERR One or more modules have issues.
+ * @param[in] omod The module to check. Must not be NULL.
+ *
+ * @retval SR_OK The module is OK.
+ * @retval SR_ERR The module has issues.
+ *
+ * @private
  */
-static int sanity_check_all_output_modules(void)
+SR_PRIV int sr_output_module_sanity_check(const struct sr_output_module *omod)
 {
-	int i, errors, ret = SR_OK;
-	const struct sr_output_module **outputs;
+	int errors;
 	const char *d;
 
-	sr_spew("Sanity-checking all output modules.");
-
-	outputs = sr_output_list();
-	for (i = 0; outputs[i]; i++) {
-		errors = 0;
-
-		d = (outputs[i]->id) ? outputs[i]->id : "NULL";
-
-		if (!outputs[i]->id) {
-			sr_err("No ID in module %d ('%s').", i, d);
-			errors++;
-		}
-		if (!outputs[i]->name) {
-			sr_err("No name in module %d ('%s').", i, d);
-			errors++;
-		}
-		if (!outputs[i]->desc) {
-			sr_err("No description in module '%s'.", d);
-			errors++;
-		}
-		if (!outputs[i]->receive) {
-			sr_err("No receive in module '%s'.", d);
-			errors++;
-		}
+	errors = 0;
 
-		if (errors == 0)
-			continue;
+	d = (omod->id) ? omod->id : "NULL";
 
-		ret = SR_ERR;
+	if (!omod->id) {
+		sr_err("No ID in module '%s'.", d);
+		errors++;
+	}
+	if (!omod->name) {
+		sr_err("No name in module '%s'.", d);
+		errors++;
+	}
+	if (!omod->desc) {
+		sr_err("No description in module '%s'.", d);
+		errors++;
+	}
+	if (!omod->receive && !omod->receive_append) {
+		sr_err("No receive in module '%s'.", d);
+		errors++;
 	}
 
-	return ret;
+	return errors ? SR_ERR : SR_OK;
 }
 
 /**
- * Sanity-check all libsigrok transform modules.
+ * Sanity-check a libsigrok transform module, before it gets used.
+ *
+ * @param[in] tmod The module to check. Must not be NULL.
  *
- * @retval SR_OK All modules are OK
- * @retval SR_ERR One or more modules have issues.
+ * @retval SR_OK The module is OK.
+ * @retval SR_ERR The module has issues.
+ *
+ * @private
  */
-static int sanity_check_all_transform_modules(void)
+SR_PRIV int sr_transform_module_sanity_check(const struct sr_transform_module *tmod)
 {
-	int i, errors, ret = SR_OK;
-	const struct sr_transform_module **transforms;
+	int errors;
 	const char *d;
 
-	sr_spew("Sanity-checking all transform modules.");
-
-	transforms = sr_transform_list();
-	for (i = 0; transforms[i]; i++) {
-		errors = 0;
+	errors = 0;
 
-		d = (transforms[i]->id) ? transforms[i]->id : "NULL";
+	d = (tmod->id) ? tmod->id : "NULL";
 
-		if (!transforms[i]->id) {
-			sr_err("No ID in module %d ('%s').", i, d);
-			errors++;
-		}
-		if (!transforms[i]->name) {
-			sr_err("No name in module %d ('%s').", i, d);
-			errors++;
-		}
-		if (!transforms[i]->desc) {
-			sr_err("No description in module '%s'.", d);
-			errors++;
-		}
-		/* Note: options() is optional. */
-		/* Note: init() is optional. */
-		if (!transforms[i]->receive) {
-			sr_err("No receive in module '%s'.", d);
-			errors++;
-		}
-		/* Note: cleanup() is optional. */
+	if (!tmod->id) {
+		sr_err("No ID in module '%s'.", d);
+		errors++;
+	}
+	if (!tmod->name) {
+		sr_err("No name in module '%s'.", d);
+		errors++;
+	}
+	if (!tmod->desc) {
+		sr_err("No description in module '%s'.", d);
+		errors++;
+	}
+	/* Note: options() is optional. */
+	/* Note: init() is optional. */
+	if (!tmod->receive) {
+		sr_err("No receive in module '%s'.", d);
+		errors++;
+	}
+	/* Note: cleanup() is optional. */
 
-		if (errors == 0)
-			continue;
+	return errors ? SR_ERR : SR_OK;
+}
 
-		ret = SR_ERR;
+#ifdef HAVE_LIBUSB_1_0
+/**
+ * Initialize libusb for a context, when a driver first needs it.
+ *
+ * Many uses of libsigrok (loading files, converting data, tests) never
+ * touch USB, so sr_init() leaves this to the first device scan. It is
+ * safe to call this from several threads, only the first call does the
+ * work.
+ *
+ * @param[in] ctx The libsigrok context. Must not be NULL.
+ *
+ * @retval SR_OK libusb is initialized, ctx->libusb_ctx can be used.
+ * @retval SR_ERR libusb could not be initialized.
+ *
+ * @private
+ */
+SR_PRIV int sr_libusb_init(struct sr_context *ctx)
+{
+	gsize state;
+	int ret;
+
+	if (g_once_init_enter(&ctx->libusb_state)) {
+		ret = libusb_init(&ctx->libusb_ctx);
+		if (ret == LIBUSB_SUCCESS) {
+			state = LIBUSB_STATE_READY;
+		} else {
+			sr_err("libusb_init() returned %s.",
+				libusb_error_name(ret));
+			ctx->libusb_ctx = NULL;
+			state = LIBUSB_STATE_FAILED;
+		}
+		g_once_init_leave(&ctx->libusb_state, state);
 	}
 
-	return ret;
+	return ctx->libusb_state == LIBUSB_STATE_READY ? SR_OK : SR_ERR;
 }
+#endif
 
 /**
  * Initialize libsigrok.
  *
  * This function must be called before any other libsigrok function.
  *
+ * If the environment variable SIGROK_USB_EVENT_THREAD is set (and not "0"),
+ * USB events are handled in a dedicated thread instead of the session's
+ * main loop, and session datafeed delivery is queued by default.
+ *
  * @param ctx Pointer to a libsigrok context struct pointer. Must not be NULL.
  *            This will be a pointer to a newly allocated libsigrok context
  *            object upon success, and is undefined upon errors.
@@ -549,6 +559,9 @@ SR_API int sr_init(struct sr_context **ctx)
 {
 	int ret = SR_ERR;
 	struct sr_context *context;
+#ifdef HAVE_LIBUSB_1_0
+	const char *env;
+#endif
 #ifdef _WIN32
 	WSADATA wsadata;
 #endif
@@ -563,29 +576,22 @@ SR_API int sr_init(struct sr_context **ctx)
 	}
 
 	context = g_malloc0(sizeof(struct sr_context));
+	g_mutex_init(&context->resource_cache_mutex);
+	g_mutex_init(&context->scan_cache_mutex);
+	g_mutex_init(&context->mem_mutex);
+#ifdef HAVE_LIBUSB_1_0
+	g_mutex_init(&context->usb_snapshot_mutex);
+	g_mutex_init(&context->fpga_mutex);
+	g_mutex_init(&context->usb_thread_mutex);
+#endif
 
+	/*
+	 * Drivers and modules get sanity-checked when they are first used,
+	 * and libusb gets initialized by the first scan, see
+	 * sr_libusb_init(). HIDAPI initializes itself upon its first use.
+	 */
 	sr_drivers_init(context);
 
-	if (sanity_check_all_drivers(context) < 0) {
-		sr_err("Internal driver error(s), aborting.");
-		goto done;
-	}
-
-	if (sanity_check_all_input_modules() < 0) {
-		sr_err("Internal input module error(s), aborting.");
-		goto done;
-	}
-
-	if (sanity_check_all_output_modules() < 0) {
-		sr_err("Internal output module error(s), aborting.");
-		goto done;
-	}
-
-	if (sanity_check_all_transform_modules() < 0) {
-		sr_err("Internal transform module error(s), aborting.");
-		goto done;
-	}
-
 #ifdef _WIN32
 	if ((ret = WSAStartup(MAKEWORD(2, 2), &wsadata)) != 0) {
 		sr_err("WSAStartup failed with error code %d.", ret);
@@ -595,26 +601,10 @@ SR_API int sr_init(struct sr_context **ctx)
 #endif
 
 #ifdef HAVE_LIBUSB_1_0
-	ret = libusb_init(&context->libusb_ctx);
-	if (LIBUSB_SUCCESS != ret) {
-		sr_err("libusb_init() returned %s.", libusb_error_name(ret));
-		ret = SR_ERR;
-		goto done;
-	}
-#endif
-#ifdef HAVE_LIBHIDAPI
-	/*
-	 * According to <hidapi.h>, the hid_init() routine just returns
-	 * zero or non-zero, and hid_error() appears to relate to calls
-	 * for a specific device after hid_open(). Which means that there
-	 * is no more detailled information available beyond success/fail
-	 * at this point in time.
-	 */
-	if (hid_init() != 0) {
-		sr_err("HIDAPI hid_init() failed.");
-		ret = SR_ERR;
-		goto done;
-	}
+	env = g_getenv("SIGROK_USB_EVENT_THREAD");
+	context->usb_event_thread = env && strcmp(env, "0") != 0;
+	if (context->usb_event_thread)
+		sr_info("Handling USB events in a separate thread.");
 #endif
 	sr_resource_set_hooks(context, NULL, NULL, NULL, NULL);
 
@@ -644,6 +634,7 @@ SR_API int sr_exit(struct sr_context *ctx)
 		return SR_ERR;
 	}
 
+	sr_hotplug_stop(ctx);
 	sr_hw_cleanup_all(ctx);
 
 #ifdef _WIN32
@@ -654,9 +645,25 @@ SR_API int sr_exit(struct sr_context *ctx)
 	hid_exit();
 #endif
 #ifdef HAVE_LIBUSB_1_0
-	libusb_exit(ctx->libusb_ctx);
+	if (ctx->libusb_state == LIBUSB_STATE_READY) {
+		usb_event_thread_cleanup(ctx);
+		sr_usb_snapshot_invalidate(ctx);
+		libusb_exit(ctx->libusb_ctx);
+	}
+	g_mutex_clear(&ctx->usb_snapshot_mutex);
+	if (ctx->fpga_bitstreams)
+		g_hash_table_destroy(ctx->fpga_bitstreams);
+	g_mutex_clear(&ctx->fpga_mutex);
+	g_mutex_clear(&ctx->usb_thread_mutex);
 #endif
 
+	sr_scan_cache_set(ctx, NULL);
+	g_mutex_clear(&ctx->scan_cache_mutex);
+	sr_mem_cleanup(ctx);
+	if (ctx->resource_cache)
+		g_hash_table_destroy(ctx->resource_cache);
+	g_mutex_clear(&ctx->resource_cache_mutex);
+
 	g_free(sr_driver_list(ctx));
 	g_free(ctx);
 
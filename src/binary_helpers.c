@@ -22,6 +22,8 @@
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
 
+#define LOG_PREFIX "binary-helpers"
+
 SR_PRIV int bv_get_value(float *out, const struct binary_value_spec *spec, const void *data, size_t length)
 {
 	float value;
@@ -92,14 +94,96 @@ SR_PRIV int bv_send_analog_channel(const struct sr_dev_inst *sdi, struct sr_chan
 	analog.num_samples = 1;
 
 	err = sr_session_send(sdi, &packet);
-	if (err != SR_OK)
-		goto err_free;
-
-	return SR_OK;
-
-err_free:
 	g_slist_free(meaning.channels);
 
 err_out:
 	return err;
 }
+
+SR_PRIV int bv_send_analog_channels(const struct sr_dev_inst *sdi,
+				    const struct binary_analog_channel *specs, const void *data, size_t length)
+{
+	struct sr_channel *ch;
+	GSList *l;
+	int err;
+
+	for (l = sdi->channels; l && specs->name; l = l->next, specs++) {
+		ch = l->data;
+		if (!ch->enabled)
+			continue;
+		err = bv_send_analog_channel(sdi, ch, specs, data, length);
+		if (err != SR_OK)
+			return err;
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Set up polling, typically upon acquisition start.
+ *
+ * @param poller The polling state.
+ * @param period_ms Shortest time between requests.
+ * @param timeout_ms Time after which a response is considered lost.
+ */
+SR_PRIV void bv_poller_init(struct bv_poller *poller,
+			    unsigned int period_ms, unsigned int timeout_ms)
+{
+	poller->period_us = period_ms * (int64_t)1000;
+	poller->timeout_us = timeout_ms * (int64_t)1000;
+	poller->sent_us = 0;
+	poller->next_us = 0;
+}
+
+/**
+ * Check whether a request is due. Gives up on a pending request which
+ * timed out. When called from an event source's callback, this has the
+ * callback run again when the next request or timeout is due.
+ *
+ * @param poller The polling state.
+ * @return TRUE when the next request should be sent now.
+ */
+SR_PRIV gboolean bv_poller_due(struct bv_poller *poller)
+{
+	int64_t now;
+
+	now = g_get_monotonic_time();
+
+	if (poller->sent_us) {
+		if (now < poller->sent_us + poller->timeout_us) {
+			sr_session_source_wake_at(poller->sent_us + poller->timeout_us);
+			return FALSE;
+		}
+		sr_dbg("No response to poll request, sending another one.");
+		poller->sent_us = 0;
+	}
+
+	if (now < poller->next_us) {
+		sr_session_source_wake_at(poller->next_us);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Note that a request was sent.
+ *
+ * @param poller The polling state.
+ */
+SR_PRIV void bv_poller_sent(struct bv_poller *poller)
+{
+	poller->sent_us = g_get_monotonic_time();
+	poller->next_us = poller->sent_us + poller->period_us;
+	sr_session_source_wake_at(poller->sent_us + poller->timeout_us);
+}
+
+/**
+ * Note that the response to the pending request was received.
+ *
+ * @param poller The polling state.
+ */
+SR_PRIV void bv_poller_done(struct bv_poller *poller)
+{
+	poller->sent_us = 0;
+}
@@ -96,6 +96,18 @@
 #define CONNECT_RFCOMM_TRIES	3
 #define CONNECT_RFCOMM_RETRY_MS	100
 
+/* ATT MTU limits, and BLE connection parameter units and limits. */
+#define BLE_ATT_MTU_MIN		23
+#define BLE_ATT_MTU_MAX		517
+#define BLE_CONN_INTERVAL_UNIT_US	1250
+#define BLE_CONN_INTERVAL_MIN	6
+#define BLE_CONN_INTERVAL_MAX	3200
+#define BLE_SUPERVISION_TIMEOUT	400	/* In 10ms units. */
+#define BLE_CONN_UPDATE_TIMEOUT_MS	1000
+
+/* Messages to handle per sr_bt_check_notify() call, at most. */
+#define NOTIFY_BATCH_MAX	64
+
 /* Silence warning about (currently) unused routine. */
 #define WITH_WRITE_TYPE_HANDLE	0
 
@@ -239,6 +251,9 @@ struct sr_bt_desc {
 	uint16_t write_handle;
 	uint16_t cccd_handle;
 	uint16_t cccd_value;
+	uint16_t mtu;
+	uint16_t conn_interval_min;
+	uint16_t conn_interval_max;
 	/* Internal state. */
 	int devid;
 	int fd;
@@ -379,6 +394,53 @@ SR_PRIV int sr_bt_config_notify(struct sr_bt_desc *desc,
 	return 0;
 }
 
+/*
+ * Have sr_bt_connect_ble() ask for a larger ATT MTU, so that peripherals
+ * can send more data per notification. The peripheral picks the MTU it
+ * supports, up to the requested one.
+ */
+SR_PRIV int sr_bt_config_mtu(struct sr_bt_desc *desc, uint16_t mtu)
+{
+	if (!desc)
+		return -1;
+	if (mtu && (mtu < BLE_ATT_MTU_MIN || mtu > BLE_ATT_MTU_MAX))
+		return -1;
+
+	desc->mtu = mtu;
+
+	return 0;
+}
+
+/*
+ * Have sr_bt_connect_ble() ask for a connection interval in the given
+ * range, for devices which send more notifications than the default
+ * interval can carry. Zero keeps the interval which the connection
+ * starts with. This needs the CAP_NET_ADMIN capability.
+ */
+SR_PRIV int sr_bt_config_conn_interval(struct sr_bt_desc *desc,
+	unsigned int min_us, unsigned int max_us)
+{
+	unsigned int min, max;
+
+	if (!desc)
+		return -1;
+	if (min_us > max_us)
+		return -1;
+
+	if (!max_us) {
+		desc->conn_interval_min = 0;
+		desc->conn_interval_max = 0;
+		return 0;
+	}
+
+	min = (min_us + BLE_CONN_INTERVAL_UNIT_US - 1) / BLE_CONN_INTERVAL_UNIT_US;
+	max = (max_us + BLE_CONN_INTERVAL_UNIT_US - 1) / BLE_CONN_INTERVAL_UNIT_US;
+	desc->conn_interval_min = CLAMP(min, BLE_CONN_INTERVAL_MIN, BLE_CONN_INTERVAL_MAX);
+	desc->conn_interval_max = CLAMP(max, BLE_CONN_INTERVAL_MIN, BLE_CONN_INTERVAL_MAX);
+
+	return 0;
+}
+
 static int sr_bt_desc_open(struct sr_bt_desc *desc, int *id_ref)
 {
 	int id, sock;
@@ -657,6 +719,65 @@ SR_PRIV int sr_bt_scan_bt(struct sr_bt_desc *desc, int duration)
 /* }}} scan */
 /* {{{ connect/disconnect */
 
+static void sr_bt_request_conn_params(struct sr_bt_desc *desc)
+{
+	struct l2cap_conninfo info;
+	socklen_t len;
+	int id, dd, ret;
+
+	if (!desc->conn_interval_max)
+		return;
+
+	memset(&info, 0, sizeof(info));
+	len = sizeof(info);
+	ret = getsockopt(desc->fd, SOL_L2CAP, L2CAP_CONNINFO, &info, &len);
+	if (ret < 0) {
+		sr_warn("Cannot get BLE connection handle: %s.",
+			g_strerror(errno));
+		return;
+	}
+
+	if (desc->local_addr[0])
+		id = hci_devid(desc->local_addr);
+	else
+		id = hci_get_route(NULL);
+	dd = (id < 0) ? -1 : hci_open_dev(id);
+	if (dd < 0) {
+		sr_warn("Cannot open HCI device: %s.", g_strerror(errno));
+		return;
+	}
+
+	sr_dbg("BLE connection interval %u-%u (x1.25ms)",
+		desc->conn_interval_min, desc->conn_interval_max);
+	ret = hci_le_conn_update(dd, info.hci_handle,
+		desc->conn_interval_min, desc->conn_interval_max,
+		0, BLE_SUPERVISION_TIMEOUT, BLE_CONN_UPDATE_TIMEOUT_MS);
+	if (ret < 0)
+		sr_warn("Cannot update BLE connection parameters: %s.",
+			g_strerror(errno));
+
+	hci_close_dev(dd);
+}
+
+static void sr_bt_request_mtu(struct sr_bt_desc *desc)
+{
+	ssize_t wrlen;
+
+	if (!desc->mtu)
+		return;
+
+	/*
+	 * The request's only parameter is the MTU, where other requests
+	 * have their handle. The response gets handled (and logged) by
+	 * sr_bt_check_notify().
+	 */
+	sr_dbg("BLE exchange MTU, requesting %u", desc->mtu);
+	wrlen = sr_bt_write_type_handle_bytes(desc, BLE_ATT_EXCHANGE_MTU_REQ,
+		desc->mtu, NULL, 0);
+	if (wrlen < 0)
+		sr_warn("Cannot request BLE ATT MTU.");
+}
+
 SR_PRIV int sr_bt_connect_ble(struct sr_bt_desc *desc)
 {
 	struct sockaddr_l2 sl2;
@@ -784,6 +905,9 @@ SR_PRIV int sr_bt_connect_ble(struct sr_bt_desc *desc)
 		return ret;
 	}
 
+	sr_bt_request_conn_params(desc);
+	sr_bt_request_mtu(desc);
+
 	return 0;
 }
 
@@ -898,27 +1022,18 @@ SR_PRIV int sr_bt_start_notify(struct sr_bt_desc *desc)
 	return 0;
 }
 
-SR_PRIV int sr_bt_check_notify(struct sr_bt_desc *desc)
+/*
+ * Handle one message from the Bluetooth socket. Returns 1 when data was
+ * passed to the data callback, 0 for other messages, negative on errors.
+ */
+static int sr_bt_handle_message(struct sr_bt_desc *desc,
+	uint8_t *buf, ssize_t rdlen)
 {
-	uint8_t buf[1024];
-	ssize_t rdlen;
 	uint8_t packet_type;
 	uint16_t packet_handle;
 	uint8_t *packet_data;
 	size_t packet_dlen;
-
-	if (!desc)
-		return -1;
-
-	if (sr_bt_check_socket_usable(desc) < 0)
-		return -2;
-
-	/* Get another message from the Bluetooth socket. */
-	rdlen = sr_bt_read(desc, buf, sizeof(buf));
-	if (rdlen < 0)
-		return -2;
-	if (!rdlen)
-		return 0;
+	int ret;
 
 	/* Get header fields and references to the payload data. */
 	packet_type = 0x00;
@@ -939,6 +1054,11 @@ SR_PRIV int sr_bt_check_notify(struct sr_bt_desc *desc)
 		sr_spew("read() len %zd, type 0x%02x (%s)", rdlen, buf[0], "error response");
 		/* EMPTY */
 		break;
+	case BLE_ATT_EXCHANGE_MTU_RESP:
+		/* The "handle" is the peripheral's MTU. */
+		sr_dbg("BLE ATT MTU %u (requested %u)",
+			MIN(packet_handle, desc->mtu), desc->mtu);
+		break;
 	case BLE_ATT_WRITE_RESP:
 		sr_spew("read() len %zd, type 0x%02x (%s)", rdlen, buf[0], "write response");
 		/* EMPTY */
@@ -946,22 +1066,18 @@ SR_PRIV int sr_bt_check_notify(struct sr_bt_desc *desc)
 	case BLE_ATT_HANDLE_INDICATION:
 		sr_spew("read() len %zd, type 0x%02x (%s)", rdlen, buf[0], "handle indication");
 		sr_bt_write_type(desc, BLE_ATT_HANDLE_CONFIRMATION);
-		if (packet_handle != desc->read_handle)
-			return -4;
-		if (!packet_data)
-			return -4;
-		if (!desc->data_cb)
-			return 0;
-		return desc->data_cb(desc->data_cb_data, packet_data, packet_dlen);
+		/* FALLTHROUGH */
 	case BLE_ATT_HANDLE_NOTIFICATION:
-		sr_spew("read() len %zd, type 0x%02x (%s)", rdlen, buf[0], "handle notification");
+		if (packet_type == BLE_ATT_HANDLE_NOTIFICATION)
+			sr_spew("read() len %zd, type 0x%02x (%s)", rdlen, buf[0], "handle notification");
 		if (packet_handle != desc->read_handle)
 			return -4;
 		if (!packet_data)
 			return -4;
 		if (!desc->data_cb)
 			return 0;
-		return desc->data_cb(desc->data_cb_data, packet_data, packet_dlen);
+		ret = desc->data_cb(desc->data_cb_data, packet_data, packet_dlen);
+		return (ret < 0) ? ret : 1;
 	default:
 		sr_spew("unsupported type 0x%02x", packet_type);
 		return -3;
@@ -970,6 +1086,52 @@ SR_PRIV int sr_bt_check_notify(struct sr_bt_desc *desc)
 	return 0;
 }
 
+/*
+ * Handle the messages which the Bluetooth socket has pending, up to a
+ * batch limit (so that a fast sender can't starve the caller). Returns
+ * the number of notifications and indications which were passed to the
+ * data callback, which is 0 when there were none, or a negative value
+ * upon errors.
+ */
+SR_PRIV int sr_bt_check_notify(struct sr_bt_desc *desc)
+{
+	uint8_t buf[1024];
+	struct pollfd fds[1];
+	ssize_t rdlen;
+	int ret, count, msgs;
+
+	if (!desc)
+		return -1;
+
+	if (sr_bt_check_socket_usable(desc) < 0)
+		return -2;
+
+	count = 0;
+	for (msgs = 0; msgs < NOTIFY_BATCH_MAX; msgs++) {
+		/* Get another message from the Bluetooth socket. */
+		memset(fds, 0, sizeof(fds));
+		fds[0].fd = desc->fd;
+		fds[0].events = POLLIN;
+		ret = poll(fds, ARRAY_SIZE(fds), 0);
+		if (ret < 0)
+			return -2;
+		if (!ret || !(fds[0].revents & POLLIN))
+			break;
+		rdlen = read(desc->fd, buf, sizeof(buf));
+		if (rdlen < 0)
+			return -2;
+		if (!rdlen)
+			break;
+
+		ret = sr_bt_handle_message(desc, buf, rdlen);
+		if (ret < 0)
+			return ret;
+		count += ret;
+	}
+
+	return count;
+}
+
 /* }}} indication/notification */
 /* {{{ read/write */
 
@@ -23,6 +23,8 @@
  * Conversion helper functions.
  */
 
+#include <config.h>
+#include <math.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
 
@@ -107,3 +109,270 @@ SR_API int sr_a2l_schmitt_trigger(const struct sr_datafeed_analog *analog,
 
 	return SR_OK;
 }
+
+/*
+ * The packed converters compare the raw values of integer encoded input
+ * against thresholds which got converted to the raw domain once, instead
+ * of converting every sample to float. "value >= threshold" becomes
+ * "raw >= thr.raw" for positive scales, and "!(raw >= thr.raw)" for
+ * negative ones. The comparison loops have a fixed length of one output
+ * byte and no branches, which lets compilers vectorize them.
+ */
+struct raw_threshold {
+	/* The threshold for integer encodings. */
+	int64_t raw;
+	/* The threshold for float encodings. */
+	float rawf;
+	/* 0xff when the comparison's results need to be inverted. */
+	uint8_t invert;
+};
+
+/** @cond PRIVATE */
+#define PACK_BITS(bits, n, cmp) \
+	do { \
+		bits = 0; \
+		for (j = 0; j < (n); j++) { \
+			k = i + j; \
+			bits |= (uint8_t)(cmp) << j; \
+		} \
+	} while (0)
+
+#define THRESHOLD_LOOP(expr, field) \
+	do { \
+		for (i = 0; i + 8 <= count; i += 8) { \
+			PACK_BITS(bits, 8, (expr) >= thr.field); \
+			output[i / 8] = bits ^ thr.invert; \
+		} \
+		if (i < count) { \
+			PACK_BITS(bits, count - i, (expr) >= thr.field); \
+			output[i / 8] = (bits ^ thr.invert) & \
+				((1 << (count - i)) - 1); \
+		} \
+	} while (0)
+
+#define SCHMITT_LOOP(expr, field) \
+	do { \
+		for (i = 0; i < count; i += 8) { \
+			n = MIN(count - i, 8); \
+			if (n == 8) { \
+				PACK_BITS(ge_lo, 8, (expr) >= lo.field); \
+				PACK_BITS(gt_hi, 8, (expr) >= hi.field); \
+			} else { \
+				PACK_BITS(ge_lo, n, (expr) >= lo.field); \
+				PACK_BITS(gt_hi, n, (expr) >= hi.field); \
+			} \
+			ge_lo ^= lo.invert; \
+			gt_hi ^= hi.invert; \
+			bits = 0; \
+			for (j = 0; j < n; j++) { \
+				s = (ge_lo >> j) & ((gt_hi >> j) | s) & 1; \
+				bits |= s << j; \
+			} \
+			output[i / 8] = bits; \
+		} \
+	} while (0)
+
+#define DISPATCH_LOOP(LOOP) \
+	do { \
+		if (enc->is_float && native) \
+			LOOP(((const float *)(const void *)data)[k], rawf); \
+		else if (enc->is_float && enc->is_bigendian) \
+			LOOP(RBFL(&data[k * 4]), rawf); \
+		else if (enc->is_float) \
+			LOOP(RLFL(&data[k * 4]), rawf); \
+		else if (enc->unitsize == 1 && enc->is_signed) \
+			LOOP(((const int8_t *)data)[k], raw); \
+		else if (enc->unitsize == 1) \
+			LOOP(data[k], raw); \
+		else if (enc->unitsize == 2 && native && enc->is_signed) \
+			LOOP(((const int16_t *)(const void *)data)[k], raw); \
+		else if (enc->unitsize == 2 && native) \
+			LOOP(((const uint16_t *)(const void *)data)[k], raw); \
+		else if (enc->unitsize == 2 && enc->is_signed && enc->is_bigendian) \
+			LOOP(RB16S(&data[k * 2]), raw); \
+		else if (enc->unitsize == 2 && enc->is_bigendian) \
+			LOOP(RB16(&data[k * 2]), raw); \
+		else if (enc->unitsize == 2 && enc->is_signed) \
+			LOOP(RL16S(&data[k * 2]), raw); \
+		else if (enc->unitsize == 2) \
+			LOOP(RL16(&data[k * 2]), raw); \
+		else if (native && enc->is_signed) \
+			LOOP(((const int32_t *)(const void *)data)[k], raw); \
+		else if (native) \
+			LOOP(((const uint32_t *)(const void *)data)[k], raw); \
+		else if (enc->is_signed && enc->is_bigendian) \
+			LOOP(RB32S(&data[k * 4]), raw); \
+		else if (enc->is_bigendian) \
+			LOOP(RB32(&data[k * 4]), raw); \
+		else if (enc->is_signed) \
+			LOOP(RL32S(&data[k * 4]), raw); \
+		else \
+			LOOP(RL32(&data[k * 4]), raw); \
+	} while (0)
+/** @endcond */
+
+/*
+ * Convert "value >= threshold" (or "value > threshold" if strict) to
+ * the raw domain of the encoding.
+ */
+static void raw_threshold(const struct sr_analog_encoding *enc,
+		float threshold, gboolean strict, struct raw_threshold *thr)
+{
+	double scale, offset, t;
+	gboolean above;
+
+	scale = enc->scale.p / (double)enc->scale.q;
+	offset = enc->offset.p / (double)enc->offset.q;
+
+	if (scale == 0) {
+		/* All values are the offset, make the comparison constant. */
+		thr->raw = INT64_MIN;
+		thr->rawf = -INFINITY;
+		if (strict)
+			thr->invert = offset > threshold ? 0 : 0xff;
+		else
+			thr->invert = offset >= threshold ? 0 : 0xff;
+		return;
+	}
+
+	/*
+	 * With a negative scale, value >= threshold is raw <= t, which
+	 * is !(raw > t), so the strictness flips along with the result.
+	 */
+	t = (threshold - offset) / scale;
+	above = !strict != !(scale < 0);
+	thr->rawf = above ? nextafterf(t, INFINITY) : t;
+	t = CLAMP(t, -1e12, 1e12);
+	/* Don't let rounding errors move thresholds which hit a raw value. */
+	if (fabs(t - round(t)) < 1e-9 * MAX(fabs(t), 1))
+		t = round(t);
+	thr->raw = above ? (int64_t)floor(t) + 1 : (int64_t)ceil(t);
+	thr->invert = scale < 0 ? 0xff : 0;
+}
+
+static int check_packed_args(const struct sr_datafeed_analog *analog,
+		const uint8_t *output)
+{
+	const struct sr_analog_encoding *enc;
+
+	if (!analog || !analog->data || !analog->encoding || !output)
+		return SR_ERR_ARG;
+
+	enc = analog->encoding;
+	if (enc->is_float ? enc->unitsize != sizeof(float) :
+			enc->unitsize != 1 && enc->unitsize != 2 &&
+			enc->unitsize != 4) {
+		sr_err("Unsupported unit size '%d' for analog-to-logic"
+			" conversion.", enc->unitsize);
+		return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
+static gboolean is_native(const struct sr_analog_encoding *enc,
+		const void *data)
+{
+#ifdef WORDS_BIGENDIAN
+	return enc->is_bigendian && ((uintptr_t)data % enc->unitsize) == 0;
+#else
+	return !enc->is_bigendian && ((uintptr_t)data % enc->unitsize) == 0;
+#endif
+}
+
+/**
+ * Convert analog values to packed logic values by using a fixed threshold.
+ *
+ * Unlike sr_a2l_threshold(), this works on the payload's encoding
+ * directly, integer encoded samples are never converted to float.
+ *
+ * @param[in] analog The analog input values.
+ * @param[in] threshold The threshold to use.
+ * @param[out] output The converted output values, one bit per sample with
+ *                    the first sample in the LSB of the first byte. Must
+ *                    provide space for (count + 7) / 8 bytes. Unused bits
+ *                    of the last byte are 0.
+ * @param[in] count The number of samples to process.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR Unsupported encoding.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_a2l_threshold_packed(const struct sr_datafeed_analog *analog,
+		float threshold, uint8_t *output, uint64_t count)
+{
+	const struct sr_analog_encoding *enc;
+	const uint8_t *data;
+	struct raw_threshold thr;
+	uint64_t i, j, k;
+	uint8_t bits;
+	gboolean native;
+	int ret;
+
+	if ((ret = check_packed_args(analog, output)) != SR_OK)
+		return ret;
+
+	enc = analog->encoding;
+	data = analog->data;
+	native = is_native(enc, data);
+	raw_threshold(enc, threshold, FALSE, &thr);
+
+	DISPATCH_LOOP(THRESHOLD_LOOP);
+
+	return SR_OK;
+}
+
+/**
+ * Convert analog values to packed logic values by using a Schmitt-trigger
+ * algorithm.
+ *
+ * Unlike sr_a2l_schmitt_trigger(), this works on the payload's encoding
+ * directly, integer encoded samples are never converted to float.
+ *
+ * @param analog The analog input values.
+ * @param lo_thr The low threshold - result becomes 0 below it.
+ * @param hi_thr The high threshold - result becomes 1 above it.
+ * @param state The internal converter state. Must contain the state of logic
+ *        sample n-1, will contain the state of logic sample n+count upon exit.
+ * @param output The converted output values, one bit per sample with the
+ *        first sample in the LSB of the first byte. Must provide space for
+ *        (count + 7) / 8 bytes. Unused bits of the last byte are 0.
+ * @param count The number of samples to process.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR Unsupported encoding.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_a2l_schmitt_trigger_packed(const struct sr_datafeed_analog *analog,
+		float lo_thr, float hi_thr, uint8_t *state, uint8_t *output,
+		uint64_t count)
+{
+	const struct sr_analog_encoding *enc;
+	const uint8_t *data;
+	struct raw_threshold lo, hi;
+	uint64_t i, j, k, n;
+	uint8_t bits, ge_lo, gt_hi, s;
+	gboolean native;
+	int ret;
+
+	if (!state)
+		return SR_ERR_ARG;
+	if ((ret = check_packed_args(analog, output)) != SR_OK)
+		return ret;
+
+	enc = analog->encoding;
+	data = analog->data;
+	native = is_native(enc, data);
+	raw_threshold(enc, lo_thr, FALSE, &lo);
+	raw_threshold(enc, hi_thr, TRUE, &hi);
+
+	s = *state & 1;
+	DISPATCH_LOOP(SCHMITT_LOOP);
+	*state = s;
+
+	return SR_OK;
+}
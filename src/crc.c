@@ -19,25 +19,165 @@
 
 #include <config.h>
 #include <stdint.h>
+#include <glib.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
 
-SR_PRIV uint16_t sr_crc16(uint16_t crc, const uint8_t *buffer, int len)
+/*
+ * Table driven checksums, shared by the protocol drivers.
+ *
+ * The CRCs process four input bytes per step (slice-by-4): table k holds
+ * the register contribution of a byte which is followed by k more bytes,
+ * so four lookups replace 32 shift and xor rounds. Tables get built on
+ * first use. All functions take the value of a previous call (or the
+ * initial value), so checksums can be computed incrementally.
+ */
+
+#define CRC_SLICES 4
+
+/* Reflected (LSB first) CRCs of up to 32 bits share one implementation. */
+static uint32_t crc16_modbus_table[CRC_SLICES][256];
+static uint32_t crc16_mcrf4xx_table[CRC_SLICES][256];
+static uint32_t crc32_table[CRC_SLICES][256];
+static uint8_t crc8_table[CRC_SLICES][256];
+
+static void crc_table_reflected(uint32_t table[CRC_SLICES][256], uint32_t poly)
 {
-	int i;
+	uint32_t crc;
+	int i, j, k;
 
-	if (!buffer || len < 0)
+	for (i = 0; i < 256; i++) {
+		crc = i;
+		for (j = 0; j < 8; j++)
+			crc = (crc & 1) ? (crc >> 1) ^ poly : crc >> 1;
+		table[0][i] = crc;
+	}
+	for (k = 1; k < CRC_SLICES; k++) {
+		for (i = 0; i < 256; i++) {
+			crc = table[k - 1][i];
+			table[k][i] = (crc >> 8) ^ table[0][crc & 0xff];
+		}
+	}
+}
+
+static void crc_table_msb8(uint8_t table[CRC_SLICES][256], uint8_t poly)
+{
+	uint8_t crc;
+	int i, j, k;
+
+	for (i = 0; i < 256; i++) {
+		crc = i;
+		for (j = 0; j < 8; j++)
+			crc = (crc & 0x80) ? (crc << 1) ^ poly : crc << 1;
+		table[0][i] = crc;
+	}
+	for (k = 1; k < CRC_SLICES; k++) {
+		for (i = 0; i < 256; i++)
+			table[k][i] = table[0][table[k - 1][i]];
+	}
+}
+
+static void crc_tables_init(void)
+{
+	static gsize initialized;
+
+	if (!g_once_init_enter(&initialized))
+		return;
+
+	crc_table_reflected(crc16_modbus_table, 0xa001);
+	crc_table_reflected(crc16_mcrf4xx_table, 0x8408);
+	crc_table_reflected(crc32_table, 0xedb88320);
+	crc_table_msb8(crc8_table, 0x07);
+
+	g_once_init_leave(&initialized, 1);
+}
+
+static uint32_t crc_reflected(const uint32_t table[CRC_SLICES][256],
+	uint32_t crc, const uint8_t *buffer, size_t len)
+{
+	while (len >= CRC_SLICES) {
+		crc ^= RL32(buffer);
+		crc = table[3][crc & 0xff] ^ table[2][(crc >> 8) & 0xff] ^
+			table[1][(crc >> 16) & 0xff] ^ table[0][crc >> 24];
+		buffer += CRC_SLICES;
+		len -= CRC_SLICES;
+	}
+	while (len--)
+		crc = (crc >> 8) ^ table[0][(crc ^ *buffer++) & 0xff];
+
+	return crc;
+}
+
+SR_PRIV uint8_t sr_crc8(uint8_t crc, const uint8_t *buffer, size_t len)
+{
+	if (!buffer)
 		return crc;
 
-	while (len--) {
-		crc ^= *buffer++;
-		for (i = 0; i < 8; i++) {
-			int carry = crc & 1;
-			crc >>= 1;
-			if (carry)
-				crc ^= 0xA001;
-		}
+	crc_tables_init();
+
+	while (len >= CRC_SLICES) {
+		crc = crc8_table[3][crc ^ buffer[0]] ^ crc8_table[2][buffer[1]] ^
+			crc8_table[1][buffer[2]] ^ crc8_table[0][buffer[3]];
+		buffer += CRC_SLICES;
+		len -= CRC_SLICES;
 	}
+	while (len--)
+		crc = crc8_table[0][crc ^ *buffer++];
 
 	return crc;
 }
+
+SR_PRIV uint16_t sr_crc16(uint16_t crc, const uint8_t *buffer, int len)
+{
+	if (!buffer || len < 0)
+		return crc;
+
+	crc_tables_init();
+
+	return crc_reflected(crc16_modbus_table, crc, buffer, len);
+}
+
+SR_PRIV uint16_t sr_crc16_mcrf4xx(uint16_t crc, const uint8_t *buffer,
+	size_t len)
+{
+	if (!buffer)
+		return crc;
+
+	crc_tables_init();
+
+	return crc_reflected(crc16_mcrf4xx_table, crc, buffer, len);
+}
+
+SR_PRIV uint32_t sr_crc32(uint32_t crc, const uint8_t *buffer, size_t len)
+{
+	if (!buffer)
+		return crc;
+
+	crc_tables_init();
+
+	return ~crc_reflected(crc32_table, ~crc, buffer, len);
+}
+
+SR_PRIV uint8_t sr_sum8(uint8_t sum, const uint8_t *buffer, size_t len)
+{
+	while (len--)
+		sum += *buffer++;
+
+	return sum;
+}
+
+SR_PRIV uint16_t sr_sum16(uint16_t sum, const uint8_t *buffer, size_t len)
+{
+	while (len--)
+		sum += *buffer++;
+
+	return sum;
+}
+
+SR_PRIV uint8_t sr_xor8(uint8_t sum, const uint8_t *buffer, size_t len)
+{
+	while (len--)
+		sum ^= *buffer++;
+
+	return sum;
+}
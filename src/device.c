@@ -477,6 +477,7 @@ SR_PRIV void sr_dev_inst_free(struct sr_dev_inst *sdi)
 	g_free(sdi->version);
 	g_free(sdi->serial_num);
 	g_free(sdi->connection_id);
+	sr_config_cache_free(sdi);
 	g_free(sdi);
 }
 
@@ -516,6 +517,11 @@ SR_PRIV struct sr_usb_dev_inst *sr_usb_dev_inst_new(uint8_t bus,
  */
 SR_PRIV void sr_usb_dev_inst_free(struct sr_usb_dev_inst *usb)
 {
+	if (!usb)
+		return;
+
+	sr_usb_record_free(usb->record);
+	sr_usb_replay_free(usb->replay);
 	g_free(usb);
 }
 
@@ -677,6 +683,14 @@ SR_API int sr_dev_open(struct sr_dev_inst *sdi)
 		return SR_ERR;
 	}
 
+	if (sdi->parked) {
+		sr_dbg("%s: Reusing kept open device instance.",
+			sdi->driver->name);
+		sdi->parked = FALSE;
+		sdi->status = SR_ST_ACTIVE;
+		return SR_OK;
+	}
+
 	sr_dbg("%s: Opening device instance.", sdi->driver->name);
 
 	ret = sdi->driver->dev_open(sdi);
@@ -719,11 +733,63 @@ SR_API int sr_dev_close(struct sr_dev_inst *sdi)
 
 	sdi->status = SR_ST_INACTIVE;
 
+	if (sdi->keepalive) {
+		/* The driver's state and cached values stay for the reopen. */
+		sr_dbg("%s: Keeping device instance open.", sdi->driver->name);
+		sdi->parked = TRUE;
+		return SR_OK;
+	}
+
+	sr_config_cache_invalidate(sdi, TRUE);
+
 	sr_dbg("%s: Closing device instance.", sdi->driver->name);
 
 	return sdi->driver->dev_close(sdi);
 }
 
+/**
+ * Keep a device instance open across sessions.
+ *
+ * Opening a device can take long: drivers check or upload firmware,
+ * configure FPGAs, and query the device's identity and settings. When
+ * keep-alive is enabled, sr_dev_close() leaves the device open in the
+ * driver, including its configuration and the cached config values,
+ * and the next sr_dev_open() takes it back without asking the driver.
+ * While a device is kept alive, sr_config_set() also skips setting
+ * cacheable values which the device is known to use already, so that
+ * setting up the same configuration for each session is cheap.
+ *
+ * The device gets closed for real when keep-alive is disabled again
+ * while it is closed, or when the driver clears its instances (e.g.
+ * at sr_exit() time). Devices which got disconnected meanwhile only
+ * show when they are used.
+ *
+ * @param sdi Device instance to use. Must not be NULL.
+ * @param enable TRUE to keep the device open.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid arguments.
+ * @retval SR_ERR Closing the kept open device failed.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_dev_keepalive_set(struct sr_dev_inst *sdi, gboolean enable)
+{
+	if (!sdi || !sdi->driver || !sdi->driver->dev_close)
+		return SR_ERR_ARG;
+
+	sdi->keepalive = enable;
+	if (enable || !sdi->parked)
+		return SR_OK;
+
+	sdi->parked = FALSE;
+	sr_config_cache_invalidate(sdi, TRUE);
+
+	sr_dbg("%s: Closing kept open device instance.", sdi->driver->name);
+
+	return sdi->driver->dev_close(sdi);
+}
+
 /**
  * Queries a device instances' driver.
  *
@@ -843,7 +909,7 @@ SR_API const char *sr_dev_inst_connid_get(const struct sr_dev_inst *sdi)
 		drvc = sdi->driver->context;
 		usb = sdi->conn;
 
-		if ((cnt = libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist)) < 0) {
+		if ((cnt = sr_usb_get_device_list(drvc->sr_ctx, &devlist)) < 0) {
 			sr_err("Failed to retrieve device list: %s.",
 			       libusb_error_name(cnt));
 			return NULL;
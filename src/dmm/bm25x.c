@@ -203,7 +203,7 @@ SR_PRIV int sr_brymen_bm25x_parse(const uint8_t *buf, float *floatval,
 
 	val = decode_value(buf, &exponent);
 	exponent += decode_prefix(buf);
-	val *= powf(10, exponent);
+	val *= sr_dmm_pow10f(exponent);
 
 	if (buf[3] & 1)
 		val = -val;
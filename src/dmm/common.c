@@ -0,0 +1,82 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Helpers which several of the DMM chip parsers share. Stream detection
+ * runs the packet_valid() routines at every candidate offset, and the
+ * parsers run for every packet, so these avoid branches and libm calls.
+ */
+
+#include <config.h>
+#include <math.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "dmm"
+
+/**
+ * Check the sync nibbles of a packet, where the upper nibble of each
+ * byte holds its position (1, 2, 3, ...), like in FS9721 and DTM0660
+ * packets. This rejects wrong offsets after one byte most of the time,
+ * so packet_valid() routines want to check this first.
+ *
+ * @param buf The packet. Must not be NULL.
+ * @param len The packet length, at most 15.
+ *
+ * @return TRUE when all sync nibbles match, FALSE otherwise.
+ *
+ * @private
+ */
+SR_PRIV gboolean sr_dmm_sync_nibbles_valid(const uint8_t *buf, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if ((buf[i] >> 4) != i + 1)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Get the power of ten for a display value's exponent, from a table for
+ * all exponents which DMMs use.
+ *
+ * @param exponent The exponent.
+ *
+ * @return 10 to the power of @a exponent.
+ *
+ * @private
+ */
+SR_PRIV float sr_dmm_pow10f(int exponent)
+{
+	static const float pow10[] = {
+		1e-15f, 1e-14f, 1e-13f, 1e-12f, 1e-11f, 1e-10f, 1e-9f, 1e-8f,
+		1e-7f, 1e-6f, 1e-5f, 1e-4f, 1e-3f, 1e-2f, 1e-1f,
+		1e0f,
+		1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f,
+		1e9f, 1e10f, 1e11f, 1e12f, 1e13f, 1e14f, 1e15f,
+	};
+	const int offset = (ARRAY_SIZE(pow10) - 1) / 2;
+
+	if (exponent < -offset || exponent > offset)
+		return sr_dmm_pow10f(exponent);
+
+	return pow10[exponent + offset];
+}
@@ -39,49 +39,24 @@
 
 #define LOG_PREFIX "dtm0660"
 
+/*
+ * Segment patterns of the digits 0-9, stored as the digit plus one so
+ * that all other patterns read as 0 (invalid).
+ */
+static const uint8_t digit_lut[256] = {
+	[0xeb] = 1, [0x0a] = 2, [0xad] = 3, [0x8f] = 4, [0x4e] = 5,
+	[0xc7] = 6, [0xe7] = 7, [0x8a] = 8, [0xef] = 9, [0xcf] = 10,
+};
+
 static int parse_digit(uint8_t b)
 {
-	switch (b) {
-	case 0xeb:
-		return 0;
-	case 0x0a:
-		return 1;
-	case 0xad:
-		return 2;
-	case 0x8f:
-		return 3;
-	case 0x4e:
-		return 4;
-	case 0xc7:
-		return 5;
-	case 0xe7:
-		return 6;
-	case 0x8a:
-		return 7;
-	case 0xef:
-		return 8;
-	case 0xcf:
-		return 9;
-	default:
-		sr_dbg("Invalid digit byte: 0x%02x.", b);
-		return -1;
-	}
-}
+	int digit;
 
-static gboolean sync_nibbles_valid(const uint8_t *buf)
-{
-	int i;
-
-	/* Check the synchronization nibbles, and make sure they all match. */
-	for (i = 0; i < DTM0660_PACKET_SIZE; i++) {
-		if (((buf[i] >> 4) & 0x0f) != (i + 1)) {
-			sr_dbg("Sync nibble in byte %d (0x%02x) is invalid.",
-			       i, buf[i]);
-			return FALSE;
-		}
-	}
+	digit = digit_lut[b] - 1;
+	if (digit < 0)
+		sr_dbg("Invalid digit byte: 0x%02x.", b);
 
-	return TRUE;
+	return digit;
 }
 
 static gboolean flags_valid(const struct dtm0660_info *info)
@@ -267,7 +242,7 @@ static void handle_flags(struct sr_datafeed_analog *analog, float *floatval,
 		*exponent += 3;
 	if (info->is_mega)
 		*exponent += 6;
-	*floatval *= powf(10, (*exponent - initial_exponent));
+	*floatval *= sr_dmm_pow10f((*exponent - initial_exponent));
 
 	/* Measurement modes */
 	if (info->is_volt) {
@@ -349,9 +324,12 @@ SR_PRIV gboolean sr_dtm0660_packet_valid(const uint8_t *buf)
 {
 	struct dtm0660_info info;
 
+	if (!sr_dmm_sync_nibbles_valid(buf, DTM0660_PACKET_SIZE))
+		return FALSE;
+
 	parse_flags(buf, &info);
 
-	return (sync_nibbles_valid(buf) && flags_valid(&info));
+	return flags_valid(&info);
 }
 
 /**
@@ -636,7 +636,6 @@ static const struct mode_range_item *mode_range_get_scale(
 SR_PRIV gboolean sr_eev121gw_packet_valid(const uint8_t *buf)
 {
 	uint8_t csum;
-	size_t idx;
 
 	/* Leading byte, literal / fixed value. */
 	if (buf[OFF_START_CMD] != VAL_START_CMD)
@@ -658,9 +657,7 @@ SR_PRIV gboolean sr_eev121gw_packet_valid(const uint8_t *buf)
 		return FALSE;
 
 	/* Checksum, XOR over all previous bytes. */
-	csum = 0x00;
-	for (idx = OFF_START_CMD; idx < OFF_CHECKSUM; idx++)
-		csum ^= buf[idx];
+	csum = sr_xor8(0, &buf[OFF_START_CMD], OFF_CHECKSUM - OFF_START_CMD);
 	if (csum != buf[OFF_CHECKSUM]) {
 		/* Non-critical condition, almost expected to see invalid data. */
 		sr_spew("Packet csum: want %02x, got %02x.", csum, buf[OFF_CHECKSUM]);
@@ -1230,7 +1227,7 @@ static int sr_eev121gw_parse(const uint8_t *buf, float *floatval,
 	 */
 	*floatval = info_local->uint_value;
 	if (info_local->factor)
-		*floatval *= powf(10, -info_local->factor);
+		*floatval *= sr_dmm_pow10f(-info_local->factor);
 	if (info_local->is_ofl)
 		*floatval = INFINITY;
 	if (info_local->is_neg)
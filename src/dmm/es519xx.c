@@ -195,7 +195,7 @@ static int parse_range(uint8_t b, float *floatval, struct es519xx_info *info)
 		exponent = exponents_19200_14b[mode][idx];
 
 	/* Apply respective exponent (mode-dependent) on the value. */
-	*floatval *= powf(10, exponent);
+	*floatval *= sr_dmm_pow10f(exponent);
 	sr_dbg("Applying exponent %d, new value is %f.", exponent, *floatval);
 
 	info->digits = -exponent;
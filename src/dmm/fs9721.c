@@ -40,49 +40,24 @@
 
 #define LOG_PREFIX "fs9721"
 
+/*
+ * Segment patterns of the digits 0-9, stored as the digit plus one so
+ * that all other patterns read as 0 (invalid).
+ */
+static const uint8_t digit_lut[256] = {
+	[0x7d] = 1, [0x05] = 2, [0x5b] = 3, [0x1f] = 4, [0x27] = 5,
+	[0x3e] = 6, [0x7e] = 7, [0x15] = 8, [0x7f] = 9, [0x3f] = 10,
+};
+
 static int parse_digit(uint8_t b)
 {
-	switch (b) {
-	case 0x7d:
-		return 0;
-	case 0x05:
-		return 1;
-	case 0x5b:
-		return 2;
-	case 0x1f:
-		return 3;
-	case 0x27:
-		return 4;
-	case 0x3e:
-		return 5;
-	case 0x7e:
-		return 6;
-	case 0x15:
-		return 7;
-	case 0x7f:
-		return 8;
-	case 0x3f:
-		return 9;
-	default:
-		sr_dbg("Invalid digit byte: 0x%02x.", b);
-		return -1;
-	}
-}
+	int digit;
 
-static gboolean sync_nibbles_valid(const uint8_t *buf)
-{
-	int i;
-
-	/* Check the synchronization nibbles, and make sure they all match. */
-	for (i = 0; i < FS9721_PACKET_SIZE; i++) {
-		if (((buf[i] >> 4) & 0x0f) != (i + 1)) {
-			sr_dbg("Sync nibble in byte %d (0x%02x) is invalid.",
-			       i, buf[i]);
-			return FALSE;
-		}
-	}
+	digit = digit_lut[b] - 1;
+	if (digit < 0)
+		sr_dbg("Invalid digit byte: 0x%02x.", b);
 
-	return TRUE;
+	return digit;
 }
 
 static gboolean flags_valid(const struct fs9721_info *info)
@@ -257,7 +232,7 @@ static void handle_flags(struct sr_datafeed_analog *analog, float *floatval,
 		*exponent += 3;
 	if (info->is_mega)
 		*exponent += 6;
-	*floatval *= powf(10, *exponent);
+	*floatval *= sr_dmm_pow10f(*exponent);
 
 	/* Measurement modes */
 	if (info->is_volt) {
@@ -327,9 +302,12 @@ SR_PRIV gboolean sr_fs9721_packet_valid(const uint8_t *buf)
 {
 	struct fs9721_info info;
 
+	if (!sr_dmm_sync_nibbles_valid(buf, FS9721_PACKET_SIZE))
+		return FALSE;
+
 	parse_flags(buf, &info);
 
-	return (sync_nibbles_valid(buf) && flags_valid(&info));
+	return flags_valid(&info);
 }
 
 /**
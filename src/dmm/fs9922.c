@@ -236,7 +236,7 @@ static void handle_flags(struct sr_datafeed_analog *analog, float *floatval,
 		*exponent += 3;
 	if (info->is_mega)
 		*exponent += 6;
-	*floatval *= powf(10, *exponent);
+	*floatval *= sr_dmm_pow10f(*exponent);
 
 	/* Measurement modes */
 	if (info->is_volt || info->is_diode) {
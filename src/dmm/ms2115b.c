@@ -334,7 +334,7 @@ static int ms2115b_parse(const uint8_t *buf, float *floatval,
 		return SR_OK;
 	}
 
-	*floatval *= powf(10, exponent);
+	*floatval *= sr_dmm_pow10f(exponent);
 
 	handle_flags(analog, floatval, info_local);
 
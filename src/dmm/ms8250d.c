@@ -199,7 +199,7 @@ static void handle_flags(struct sr_datafeed_analog *analog, float *floatval,
 		*exponent += 3;
 	if (info->is_mega)
 		*exponent += 6;
-	*floatval *= powf(10, *exponent);
+	*floatval *= sr_dmm_pow10f(*exponent);
 
 	/* Measurement modes */
 	if (info->is_volt) {
@@ -365,7 +365,7 @@ SR_PRIV int sr_ms8250d_parse(const uint8_t *buf, float *floatval,
 	*floatval = (double)((digit1 * 1000) + (digit2 * 100) + (digit3 * 10) + digit4);
 
 	sec_floatval = (double)(sec_digit1 * 1000) + (sec_digit2 * 100) + (sec_digit3 * 10) + sec_digit4;
-	sec_floatval *= powf(10, sec_exponent);
+	sec_floatval *= sr_dmm_pow10f(sec_exponent);
 
 	/* Apply sign. */
 	*floatval *= sign;
@@ -142,13 +142,11 @@ struct rs9lcd_packet {
 static gboolean checksum_valid(const struct rs9lcd_packet *rs_packet)
 {
 	uint8_t *raw;
-	uint8_t sum = 0;
-	int i;
+	uint8_t sum;
 
 	raw = (void *)rs_packet;
 
-	for (i = 0; i < RS9LCD_PACKET_SIZE - 1; i++)
-		sum += raw[i];
+	sum = sr_sum8(0, raw, RS9LCD_PACKET_SIZE - 1);
 
 	/* This is just a funky constant added to the checksum. */
 	sum += 57;
@@ -300,7 +298,7 @@ static double lcd_to_double(const struct rs9lcd_packet *rs_packet, int type,
 	else if (rs_packet->indicatrix1 & IND1_MEGA)
 		*exponent += 6;
 
-	return rawval * powf(10, *exponent);
+	return rawval * sr_dmm_pow10f(*exponent);
 }
 
 static gboolean is_celsius(const struct rs9lcd_packet *rs_packet)
@@ -130,7 +130,7 @@ SR_PRIV int sr_ut372_parse(const uint8_t *buf, float *floatval,
 			exponent = -i;
 	}
 
-	*floatval = (float) value * powf(10, exponent);
+	*floatval = (float) value * sr_dmm_pow10f(exponent);
 
 	analog->encoding->digits = -exponent;
 	analog->spec->spec_digits = -exponent;
@@ -158,7 +158,7 @@ static int parse_range(uint8_t b, float *floatval, int *exponent,
 	*exponent = exponents[mode][idx];
 
 	/* Apply respective exponent (mode-dependent) on the value. */
-	*floatval *= powf(10, *exponent);
+	*floatval *= sr_dmm_pow10f(*exponent);
 	sr_dbg("Applying exponent %d, new value is %f.", *exponent, *floatval);
 
 	return SR_OK;
@@ -161,7 +161,7 @@ static void handle_flags(struct sr_datafeed_analog *analog, float *floatval,
 		factor += 3;
 	if (info->is_mega)
 		factor += 6;
-	*floatval *= powf(10, factor);
+	*floatval *= sr_dmm_pow10f(factor);
 
 	/* Measurement modes */
 	if (info->is_volt) {
@@ -104,6 +104,9 @@ SR_PRIV int ezusb_upload_firmware(struct sr_context *ctx, libusb_device *dev,
 	sr_info("uploading firmware to device on %d.%d",
 		libusb_get_bus_number(dev), libusb_get_device_address(dev));
 
+	/* The device renumerates, later scans must not see it as it was. */
+	sr_usb_snapshot_invalidate(ctx);
+
 	if ((ret = libusb_open(dev, &hdl)) < 0) {
 		sr_err("failed to open device: %s.", libusb_error_name(ret));
 		return SR_ERR;
@@ -142,3 +145,92 @@ SR_PRIV int ezusb_upload_firmware(struct sr_context *ctx, libusb_device *dev,
 
 	return SR_OK;
 }
+
+/* A firmware upload queued by ezusb_upload_firmware_queue(). */
+struct ezusb_upload {
+	struct sr_context *ctx;
+	libusb_device *dev;
+	int configuration;
+	const char *name;
+	int64_t *fw_updated;
+	GThread *thread;
+};
+
+static gpointer upload_thread(gpointer data)
+{
+	struct ezusb_upload *upload;
+
+	upload = data;
+	if (ezusb_upload_firmware(upload->ctx, upload->dev,
+			upload->configuration, upload->name) == SR_OK) {
+		/* Store when this device's FW was updated. */
+		*upload->fw_updated = g_get_monotonic_time();
+	} else {
+		sr_err("Firmware upload failed for "
+		       "device %d.%d (logical), name %s.",
+		       libusb_get_bus_number(upload->dev),
+		       libusb_get_device_address(upload->dev),
+		       upload->name);
+	}
+
+	return NULL;
+}
+
+/**
+ * Queue a firmware upload, to be run by ezusb_upload_firmware_run().
+ *
+ * @param uploads The queue, an empty GSList to begin with.
+ * @param ctx libsigrok context.
+ * @param dev The device to upload to. It gets referenced until the run.
+ * @param configuration The USB configuration to set.
+ * @param name The firmware resource name.
+ * @param fw_updated Where to store the upload time, which is left as is
+ *                   when the upload fails.
+ */
+SR_PRIV void ezusb_upload_firmware_queue(GSList **uploads,
+		struct sr_context *ctx, libusb_device *dev,
+		int configuration, const char *name, int64_t *fw_updated)
+{
+	struct ezusb_upload *upload;
+
+	upload = g_malloc0(sizeof(*upload));
+	upload->ctx = ctx;
+	upload->dev = libusb_ref_device(dev);
+	upload->configuration = configuration;
+	upload->name = name;
+	upload->fw_updated = fw_updated;
+	*uploads = g_slist_append(*uploads, upload);
+}
+
+/**
+ * Run queued firmware uploads concurrently, and free the queue.
+ *
+ * Devices renumerate on their own after the upload, so overlapping the
+ * uploads also overlaps their renumeration delays.
+ *
+ * @param uploads The queue.
+ */
+SR_PRIV void ezusb_upload_firmware_run(GSList *uploads)
+{
+	struct ezusb_upload *upload;
+	GSList *l;
+
+	for (l = uploads; l; l = l->next) {
+		upload = l->data;
+		/* The last one, or the only one, runs right here. */
+		if (l->next)
+			upload->thread = g_thread_try_new("sr-ezusb-upload",
+				upload_thread, upload, NULL);
+		if (!upload->thread)
+			upload_thread(upload);
+	}
+
+	for (l = uploads; l; l = l->next) {
+		upload = l->data;
+		if (upload->thread)
+			g_thread_join(upload->thread);
+		libusb_unref_device(upload->dev);
+		g_free(upload);
+	}
+	g_slist_free(uploads);
+}
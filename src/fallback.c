@@ -36,4 +36,14 @@ SR_API void sr_serial_free(struct sr_serial_port *serial)
 	(void)serial;
 }
 
+SR_API int sr_serial_bt_discovery_start(void)
+{
+	return SR_ERR_NA;
+}
+
+SR_API int sr_serial_bt_discovery_stop(void)
+{
+	return SR_OK;
+}
+
 #endif
@@ -32,14 +32,11 @@ typedef enum {
 
 static gboolean appa_55ii_checksum(const uint8_t *buf)
 {
-	int i, size, checksum;
+	int size;
 
 	size = buf[3] + 4;
-	checksum = 0;
-	for (i = 0; i < size; i++)
-		checksum += buf[i];
 
-	return buf[size] == (checksum & 0xFF);
+	return buf[size] == sr_sum8(0, buf, size);
 }
 
 SR_PRIV gboolean appa_55ii_packet_valid(const uint8_t *buf)
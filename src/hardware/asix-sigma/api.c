@@ -70,6 +70,7 @@ static const int32_t trigger_matches[] = {
 static void clear_helper(struct dev_context *devc)
 {
 	(void)sigma_force_close(devc);
+	soft_trigger_logic_free(devc->stl);
 }
 
 static int dev_clear(const struct sr_dev_driver *di)
@@ -107,7 +108,6 @@ static gboolean known_vid_pid(const struct libusb_device_descriptor *des)
 static GSList *scan(struct sr_dev_driver *di, GSList *options)
 {
 	struct drv_context *drvc;
-	libusb_context *usbctx;
 	const char *conn;
 	GSList *l, *conn_devices;
 	struct sr_config *src;
@@ -128,7 +128,6 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	size_t devidx, chidx;
 
 	drvc = di->context;
-	usbctx = drvc->sr_ctx->libusb_ctx;
 
 	/* Find all devices which match an (optional) conn= spec. */
 	conn = NULL;
@@ -142,13 +141,13 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	}
 	conn_devices = NULL;
 	if (conn)
-		conn_devices = sr_usb_find(usbctx, conn);
+		conn_devices = sr_usb_find(drvc->sr_ctx, conn);
 	if (conn && !conn_devices)
 		return NULL;
 
 	/* Find all ASIX logic analyzers (which match the connection spec). */
 	devices = NULL;
-	libusb_get_device_list(usbctx, &devlist);
+	sr_usb_get_device_list(drvc->sr_ctx, &devlist);
 	for (devidx = 0; devlist[devidx]; devidx++) {
 		devitem = devlist[devidx];
 
@@ -621,6 +620,8 @@ static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 	if (devc->state == SIGMA_CAPTURE) {
 		devc->state = SIGMA_STOPPING;
 	} else {
+		if (devc->state == SIGMA_DOWNLOAD)
+			sigma_abort_download(devc);
 		devc->state = SIGMA_IDLE;
 		(void)sr_session_source_remove(sdi->session, -1);
 	}
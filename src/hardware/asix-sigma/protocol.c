@@ -25,6 +25,9 @@
  */
 
 #include <config.h>
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
 #include "protocol.h"
 
 /*
@@ -1152,12 +1155,14 @@ struct submit_buffer {
 	uint8_t *sample_data;
 	uint8_t *write_pointer;
 	struct sr_dev_inst *sdi;
+	struct sr_context *mem_ctx;
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
 };
 
 static int alloc_submit_buffer(struct sr_dev_inst *sdi)
 {
+	struct drv_context *drvc;
 	struct dev_context *devc;
 	struct submit_buffer *buffer;
 	size_t size;
@@ -1172,7 +1177,9 @@ static int alloc_submit_buffer(struct sr_dev_inst *sdi)
 	size /= buffer->unit_size;
 	buffer->max_samples = size;
 	size *= buffer->unit_size;
-	buffer->sample_data = g_try_malloc0(size);
+	drvc = sdi->driver->context;
+	buffer->mem_ctx = drvc->sr_ctx;
+	buffer->sample_data = sr_mem_alloc(buffer->mem_ctx, LOG_PREFIX, size);
 	if (!buffer->sample_data)
 		return SR_ERR_MALLOC;
 	buffer->write_pointer = buffer->sample_data;
@@ -1232,7 +1239,7 @@ static void free_submit_buffer(struct dev_context *devc)
 		return;
 	devc->buffer = NULL;
 
-	g_free(buffer->sample_data);
+	sr_mem_free(buffer->mem_ctx, buffer->sample_data);
 	g_free(buffer);
 }
 
@@ -1265,6 +1272,7 @@ static int addto_submit_buffer(struct dev_context *devc,
 {
 	struct submit_buffer *buffer;
 	struct sr_sw_limits *limits;
+	size_t n, i;
 	int ret;
 
 	buffer = devc->buffer;
@@ -1273,21 +1281,25 @@ static int addto_submit_buffer(struct dev_context *devc,
 		count = 0;
 
 	/*
-	 * Individually accumulate and check each sample, such that
-	 * accumulation between flushes won't exceed local storage, and
-	 * enforcement of user specified limits is exact.
+	 * Accumulate runs of the sample, such that accumulation between
+	 * flushes won't exceed local storage, and enforcement of user
+	 * specified limits is exact. The submit limit only has a sample
+	 * count.
 	 */
-	while (count--) {
-		write_u16le_inc(&buffer->write_pointer, sample);
-		buffer->curr_samples++;
+	if (!devc->use_triggers)
+		count = MIN(count, sr_sw_limits_samples_remaining(limits));
+	while (count) {
+		n = MIN(count, buffer->max_samples - buffer->curr_samples);
+		for (i = 0; i < n; i++)
+			write_u16le_inc(&buffer->write_pointer, sample);
+		buffer->curr_samples += n;
 		if (buffer->curr_samples == buffer->max_samples) {
 			ret = flush_submit_buffer(devc);
 			if (ret != SR_OK)
 				return ret;
 		}
-		sr_sw_limits_update_samples_read(limits, 1);
-		if (!devc->use_triggers && sr_sw_limits_check(limits))
-			break;
+		sr_sw_limits_update_samples_read(limits, n);
+		count -= n;
 	}
 
 	return SR_OK;
@@ -1390,12 +1402,57 @@ static void rewind_trig_arm_pos(struct dev_context *devc, size_t count)
 	}
 }
 
+/* A block of DRAM lines, received by one read call. */
+struct sigma_fetch_block {
+	size_t lines_rcvd;	/* Zero when the read failed. */
+	struct sigma_dram_line lines[];
+};
+
+/* Three blocks: one gets decoded, one gets read, one is ready. */
+#define FETCH_BLOCK_COUNT	3
+
+static gpointer sigma_fetch_thread(gpointer data)
+{
+	struct dev_context *devc;
+	struct sigma_sample_interp *interp;
+	struct sigma_fetch_block *block;
+	size_t line, done, count;
+	int ret;
+
+	devc = data;
+	interp = &devc->interp;
+
+	line = interp->start.line;
+	done = 0;
+	while (done < interp->fetch.lines_total) {
+		block = g_async_queue_pop(interp->fetch.empty_blocks);
+		if (g_atomic_int_get(&interp->fetch.abort)) {
+			g_free(block);
+			break;
+		}
+		count = interp->fetch.lines_total - done;
+		if (count > interp->fetch.lines_per_read)
+			count = interp->fetch.lines_per_read;
+		ret = sigma_read_dram(devc, line, count,
+			(uint8_t *)block->lines);
+		block->lines_rcvd = (ret == SR_OK) ? count : 0;
+		g_async_queue_push(interp->fetch.filled_blocks, block);
+		if (ret != SR_OK)
+			break;
+		done += count;
+		line = (line + count) % ROW_COUNT;
+	}
+
+	return NULL;
+}
+
 static int alloc_sample_buffer(struct dev_context *devc,
 	size_t stop_pos, size_t trig_pos, uint8_t mode)
 {
 	struct sigma_sample_interp *interp;
+	struct sigma_fetch_block *block;
 	gboolean wrapped;
-	size_t alloc_size;
+	size_t alloc_size, i;
 
 	interp = &devc->interp;
 
@@ -1447,25 +1504,37 @@ static int alloc_sample_buffer(struct dev_context *devc,
 	interp->fetch.lines_total %= ROW_COUNT;
 	interp->fetch.lines_done = 0;
 
-	/* Arrange for chunked download, N lines per USB request. */
+	/*
+	 * Arrange for chunked download, N lines per USB request. A reader
+	 * thread keeps fetching blocks from the device while previously
+	 * received blocks get decoded.
+	 */
 	interp->fetch.lines_per_read = 32;
 	alloc_size = sizeof(devc->interp.fetch.rcvd_lines[0]);
 	alloc_size *= devc->interp.fetch.lines_per_read;
-	devc->interp.fetch.rcvd_lines = g_try_malloc0(alloc_size);
-	if (!devc->interp.fetch.rcvd_lines)
-		return SR_ERR_MALLOC;
+	interp->fetch.empty_blocks = g_async_queue_new();
+	interp->fetch.filled_blocks = g_async_queue_new();
+	for (i = 0; i < FETCH_BLOCK_COUNT; i++) {
+		block = g_try_malloc0(sizeof(*block) + alloc_size);
+		if (!block)
+			return SR_ERR_MALLOC;
+		g_async_queue_push(interp->fetch.empty_blocks, block);
+	}
+	interp->fetch.abort = 0;
+	interp->fetch.thread = g_thread_new("sigma-fetch",
+		sigma_fetch_thread, devc);
 
 	return SR_OK;
 }
 
+static void sigma_deinterlace_init(void);
 static uint16_t sigma_deinterlace_data_4x4(uint16_t indata, int idx);
 static uint16_t sigma_deinterlace_data_2x8(uint16_t indata, int idx);
 
 static int fetch_sample_buffer(struct dev_context *devc)
 {
 	struct sigma_sample_interp *interp;
-	size_t count;
-	int ret;
+	struct sigma_fetch_block *block;
 	const uint8_t *rdptr;
 	uint16_t ts, data;
 
@@ -1474,17 +1543,19 @@ static int fetch_sample_buffer(struct dev_context *devc)
 	/* First invocation? Seed the iteration position. */
 	if (!interp->fetch.lines_done) {
 		interp->iter = interp->start;
+		sigma_deinterlace_init();
 	}
 
-	/* Get another set of DRAM lines in one read call. */
-	count = interp->fetch.lines_total - interp->fetch.lines_done;
-	if (count > interp->fetch.lines_per_read)
-		count = interp->fetch.lines_per_read;
-	ret = sigma_read_dram(devc, interp->iter.line, count,
-		(uint8_t *)interp->fetch.rcvd_lines);
-	if (ret != SR_OK)
-		return ret;
-	interp->fetch.lines_rcvd = count;
+	/* Hand the previous block back, get the next from the reader. */
+	if (interp->fetch.curr_block)
+		g_async_queue_push(interp->fetch.empty_blocks,
+			interp->fetch.curr_block);
+	block = g_async_queue_pop(interp->fetch.filled_blocks);
+	interp->fetch.curr_block = block;
+	if (!block->lines_rcvd)
+		return SR_ERR_IO;
+	interp->fetch.rcvd_lines = block->lines;
+	interp->fetch.lines_rcvd = block->lines_rcvd;
 	interp->fetch.curr_line = &interp->fetch.rcvd_lines[0];
 
 	/* First invocation? Get initial timestamp and sample data. */
@@ -1506,9 +1577,36 @@ static int fetch_sample_buffer(struct dev_context *devc)
 
 static void free_sample_buffer(struct dev_context *devc)
 {
-	g_free(devc->interp.fetch.rcvd_lines);
-	devc->interp.fetch.rcvd_lines = NULL;
-	devc->interp.fetch.lines_per_read = 0;
+	struct sigma_sample_interp *interp;
+	struct sigma_fetch_block *block;
+
+	interp = &devc->interp;
+
+	/* Stop the reader, it may wait for an empty block. */
+	if (interp->fetch.thread) {
+		g_atomic_int_set(&interp->fetch.abort, 1);
+		g_async_queue_push(interp->fetch.empty_blocks,
+			g_malloc0(sizeof(*block)));
+		g_thread_join(interp->fetch.thread);
+		interp->fetch.thread = NULL;
+	}
+
+	g_free(interp->fetch.curr_block);
+	interp->fetch.curr_block = NULL;
+	if (interp->fetch.empty_blocks) {
+		while ((block = g_async_queue_try_pop(interp->fetch.empty_blocks)))
+			g_free(block);
+		g_async_queue_unref(interp->fetch.empty_blocks);
+		interp->fetch.empty_blocks = NULL;
+	}
+	if (interp->fetch.filled_blocks) {
+		while ((block = g_async_queue_try_pop(interp->fetch.filled_blocks)))
+			g_free(block);
+		g_async_queue_unref(interp->fetch.filled_blocks);
+		interp->fetch.filled_blocks = NULL;
+	}
+	interp->fetch.rcvd_lines = NULL;
+	interp->fetch.lines_per_read = 0;
 }
 
 /*
@@ -1607,21 +1705,47 @@ SR_PRIV int sigma_convert_trigger(const struct sr_dev_inst *sdi)
 	struct sr_trigger_stage *stage;
 	struct sr_trigger_match *match;
 	const GSList *l, *m;
+	struct soft_trigger_hw_caps caps;
 	uint16_t channelbit;
 	size_t edge_count;
 
 	devc = sdi->priv;
 	memset(&devc->trigger, 0, sizeof(devc->trigger));
 	devc->use_triggers = FALSE;
+	soft_trigger_logic_free(devc->stl);
+	devc->stl = NULL;
+	devc->stl_armed = FALSE;
 
 	/* TODO Consider additional SR_CONF_TRIGGER_PATTERN support. */
 	trigger = sr_session_trigger_get(sdi->session);
 	if (!trigger)
 		return SR_OK;
 
+	/*
+	 * The hardware takes one stage. When it can, further stages get
+	 * checked in software after the first one matched. Edge and level
+	 * matches are supported for the first stage, see below.
+	 */
+	caps.max_stages = 1;
+	caps.matches = SOFT_TRIGGER_MATCH(SR_TRIGGER_RISING) |
+		SOFT_TRIGGER_MATCH(SR_TRIGGER_FALLING);
+	if (devc->clock.samplerate < SR_MHZ(100))
+		caps.matches |= SOFT_TRIGGER_MATCH(SR_TRIGGER_ZERO) |
+			SOFT_TRIGGER_MATCH(SR_TRIGGER_ONE);
+	caps.max_edges = 1;
+	if (trigger->stages && trigger->stages->next &&
+			soft_trigger_hw_stages(trigger, &caps) == 1) {
+		sr_dbg("Checking trigger stages after the first in software.");
+		devc->stl = soft_trigger_logic_new_split(sdi, trigger, 2);
+		if (!devc->stl)
+			return SR_ERR;
+	}
+
 	edge_count = 0;
 	for (l = trigger->stages; l; l = l->next) {
 		stage = l->data;
+		if (devc->stl && stage->stage > 0)
+			break;
 		for (m = stage->matches; m; m = m->next) {
 			match = m->data;
 			/* Ignore disabled channels with a trigger. */
@@ -1733,16 +1857,74 @@ static int send_trigger_marker(struct dev_context *devc)
 	return SR_OK;
 }
 
+/*
+ * The hardware's stage matched at this sample. Send the trigger, or
+ * have the remaining stages checked in the samples which follow.
+ */
+static void hw_trigger_matched(struct dev_context *devc, uint16_t sample)
+{
+	uint8_t buf[sizeof(uint16_t)];
+
+	if (!devc->stl) {
+		(void)send_trigger_marker(devc);
+		return;
+	}
+	write_u16le(buf, sample);
+	soft_trigger_logic_hw_fired(devc->stl, buf, 1);
+	devc->stl_armed = TRUE;
+}
+
+/*
+ * Check the remaining trigger stages, return how many repetitions of
+ * the sample go before the trigger, or -1. Beyond the number of stages,
+ * repetitions of the same sample won't make a difference.
+ */
+static int soft_trigger_check(struct dev_context *devc,
+	uint16_t sample, size_t count)
+{
+	uint8_t buf[sizeof(uint16_t)];
+	size_t i;
+
+	write_u16le(buf, sample);
+	for (i = 0; i < count && i <= devc->stl->num_stages; i++) {
+		if (soft_trigger_logic_scan(devc->stl, buf, sizeof(buf)) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
 static int check_and_submit_sample(struct dev_context *devc,
 	uint16_t sample, size_t count)
 {
 	gboolean triggered;
-	int ret;
+	int before, ret;
+
+	if (devc->stl_armed) {
+		before = soft_trigger_check(devc, sample, count);
+		if (before < 0)
+			return addto_submit_buffer(devc, sample, count);
+		ret = addto_submit_buffer(devc, sample, before);
+		if (ret != SR_OK)
+			return ret;
+		(void)send_trigger_marker(devc);
+		soft_trigger_logic_free(devc->stl);
+		devc->stl = NULL;
+		devc->stl_armed = FALSE;
+		return addto_submit_buffer(devc, sample, count - before);
+	}
 
 	triggered = sample_matches_trigger(devc, sample);
 	if (triggered) {
-		send_trigger_marker(devc);
+		hw_trigger_matched(devc, sample);
 		devc->interp.trig_chk.matched = TRUE;
+		/* Repetitions can match the following stages. */
+		if (devc->stl_armed && count > 1) {
+			ret = addto_submit_buffer(devc, sample, 1);
+			if (ret != SR_OK)
+				return ret;
+			return check_and_submit_sample(devc, sample, count - 1);
+		}
 	}
 
 	ret = addto_submit_buffer(devc, sample, count);
@@ -1786,7 +1968,7 @@ static void sigma_location_check(struct dev_context *devc)
 	 */
 	if (interp->trig_chk.armed) {
 		if (sigma_location_is_eq(&interp->iter, &interp->trig, TRUE)) {
-			(void)send_trigger_marker(devc);
+			hw_trigger_matched(devc, interp->last.sample);
 			interp->trig_chk.matched = TRUE;
 		}
 	}
@@ -1808,6 +1990,43 @@ static uint16_t sigma_dram_cluster_data(struct sigma_dram_cluster *cl, int idx)
 	return read_u16le((const uint8_t *)&cl->samples[idx]);
 }
 
+/*
+ * Lookup tables for the deinterlacing of 100MHz and 200MHz sample data,
+ * per byte of a 16bit item. At 100MHz an entry holds the byte's even
+ * bits in its low nibble and the odd bits in its high nibble. At 200MHz
+ * an entry holds the byte's bits N and N + 4 in its bits 2N and 2N + 1.
+ * With BMI2 a parallel bit extract gets a sample's bits directly.
+ */
+static uint8_t deinterlace_2x8_lut[256];
+static uint8_t deinterlace_4x4_lut[256];
+
+static void sigma_deinterlace_init(void)
+{
+	static gsize initialized;
+	size_t byte, bit;
+	uint8_t entry;
+
+	if (!g_once_init_enter(&initialized))
+		return;
+
+	for (byte = 0; byte < 256; byte++) {
+		entry = 0;
+		for (bit = 0; bit < 8; bit++) {
+			if (byte & (1 << bit))
+				entry |= 1 << (bit / 2 + 4 * (bit % 2));
+		}
+		deinterlace_2x8_lut[byte] = entry;
+		entry = 0;
+		for (bit = 0; bit < 8; bit++) {
+			if (byte & (1 << bit))
+				entry |= 1 << (2 * (bit % 4) + bit / 4);
+		}
+		deinterlace_4x4_lut[byte] = entry;
+	}
+
+	g_once_init_leave(&initialized, 1);
+}
+
 /*
  * Deinterlace sample data that was retrieved at 100MHz samplerate.
  * One 16bit item contains two samples of 8bits each. The bits of
@@ -1815,19 +2034,16 @@ static uint16_t sigma_dram_cluster_data(struct sigma_dram_cluster *cl, int idx)
  */
 static uint16_t sigma_deinterlace_data_2x8(uint16_t indata, int idx)
 {
-	uint16_t outdata;
+#ifdef __BMI2__
+	return _pext_u32(indata, 0x5555 << idx);
+#else
+	uint8_t lo, hi;
+
+	lo = deinterlace_2x8_lut[indata & 0xff] >> (4 * idx);
+	hi = deinterlace_2x8_lut[indata >> 8] >> (4 * idx);
 
-	indata >>= idx;
-	outdata = 0;
-	outdata |= (indata >> (0 * 2 - 0)) & (1 << 0);
-	outdata |= (indata >> (1 * 2 - 1)) & (1 << 1);
-	outdata |= (indata >> (2 * 2 - 2)) & (1 << 2);
-	outdata |= (indata >> (3 * 2 - 3)) & (1 << 3);
-	outdata |= (indata >> (4 * 2 - 4)) & (1 << 4);
-	outdata |= (indata >> (5 * 2 - 5)) & (1 << 5);
-	outdata |= (indata >> (6 * 2 - 6)) & (1 << 6);
-	outdata |= (indata >> (7 * 2 - 7)) & (1 << 7);
-	return outdata;
+	return (lo & 0x0f) | ((hi & 0x0f) << 4);
+#endif
 }
 
 /*
@@ -1837,15 +2053,16 @@ static uint16_t sigma_deinterlace_data_2x8(uint16_t indata, int idx)
  */
 static uint16_t sigma_deinterlace_data_4x4(uint16_t indata, int idx)
 {
-	uint16_t outdata;
+#ifdef __BMI2__
+	return _pext_u32(indata, 0x1111 << idx);
+#else
+	uint8_t lo, hi;
 
-	indata >>= idx;
-	outdata = 0;
-	outdata |= (indata >> (0 * 4 - 0)) & (1 << 0);
-	outdata |= (indata >> (1 * 4 - 1)) & (1 << 1);
-	outdata |= (indata >> (2 * 4 - 2)) & (1 << 2);
-	outdata |= (indata >> (3 * 4 - 3)) & (1 << 3);
-	return outdata;
+	lo = deinterlace_4x4_lut[indata & 0xff] >> (2 * idx);
+	hi = deinterlace_4x4_lut[indata >> 8] >> (2 * idx);
+
+	return (lo & 0x03) | ((hi & 0x03) << 2);
+#endif
 }
 
 static void sigma_decode_dram_cluster(struct dev_context *devc,
@@ -1854,7 +2071,7 @@ static void sigma_decode_dram_cluster(struct dev_context *devc,
 {
 	uint16_t tsdiff, ts, sample, item16;
 	size_t count;
-	size_t evt;
+	size_t evt, idx, samples_per_event;
 
 	/*
 	 * If this cluster is not adjacent to the previously received
@@ -1882,31 +2099,16 @@ static void sigma_decode_dram_cluster(struct dev_context *devc,
 	 * before submission is transparent to this code path, specific
 	 * buffer depth is neither assumed nor required here.
 	 */
-	sample = 0;
+	samples_per_event = devc->interp.samples_per_event;
 	for (evt = 0; evt < events_in_cluster; evt++) {
 		item16 = sigma_dram_cluster_data(dram_cluster, evt);
-		if (devc->interp.samples_per_event == 4) {
-			sample = sigma_deinterlace_data_4x4(item16, 0);
-			check_and_submit_sample(devc, sample, 1);
-			devc->interp.last.sample = sample;
-			sample = sigma_deinterlace_data_4x4(item16, 1);
-			check_and_submit_sample(devc, sample, 1);
-			devc->interp.last.sample = sample;
-			sample = sigma_deinterlace_data_4x4(item16, 2);
-			check_and_submit_sample(devc, sample, 1);
-			devc->interp.last.sample = sample;
-			sample = sigma_deinterlace_data_4x4(item16, 3);
-			check_and_submit_sample(devc, sample, 1);
-			devc->interp.last.sample = sample;
-		} else if (devc->interp.samples_per_event == 2) {
-			sample = sigma_deinterlace_data_2x8(item16, 0);
-			check_and_submit_sample(devc, sample, 1);
-			devc->interp.last.sample = sample;
-			sample = sigma_deinterlace_data_2x8(item16, 1);
-			check_and_submit_sample(devc, sample, 1);
-			devc->interp.last.sample = sample;
-		} else {
-			sample = item16;
+		for (idx = 0; idx < samples_per_event; idx++) {
+			if (samples_per_event == 4)
+				sample = sigma_deinterlace_data_4x4(item16, idx);
+			else if (samples_per_event == 2)
+				sample = sigma_deinterlace_data_2x8(item16, idx);
+			else
+				sample = item16;
 			check_and_submit_sample(devc, sample, 1);
 			devc->interp.last.sample = sample;
 		}
@@ -2070,13 +2272,12 @@ static int download_capture(struct sr_dev_inst *sdi)
 			interp->fetch.lines_done++;
 		}
 
-		/* Keep returning to application code for large data sets. */
-		if (!--chunks_per_receive_call) {
-			ret = flush_submit_buffer(devc);
-			if (ret != SR_OK)
-				return FALSE;
+		/*
+		 * Keep returning to application code for large data sets.
+		 * The submit buffer gets flushed when full, or at the end.
+		 */
+		if (!--chunks_per_receive_call)
 			break;
-		}
 	}
 
 	/*
@@ -2167,6 +2368,16 @@ static int sigma_capture_mode(struct sr_dev_inst *sdi)
 	return TRUE;
 }
 
+/*
+ * Release the download resources when the application stops the
+ * acquisition before all of the sample memory was retrieved.
+ */
+SR_PRIV void sigma_abort_download(struct dev_context *devc)
+{
+	free_sample_buffer(devc);
+	free_submit_buffer(devc);
+}
+
 SR_PRIV int sigma_receive_data(int fd, int revents, void *cb_data)
 {
 	struct sr_dev_inst *sdi;
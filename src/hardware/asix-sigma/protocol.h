@@ -368,6 +368,11 @@ struct dev_context {
 			size_t lines_rcvd;
 			struct sigma_dram_line *rcvd_lines;
 			struct sigma_dram_line *curr_line;
+			/* Reader thread, fetches blocks ahead of decoding. */
+			GThread *thread;
+			GAsyncQueue *empty_blocks, *filled_blocks;
+			struct sigma_fetch_block *curr_block;
+			int abort;
 		} fetch;
 		struct {
 			gboolean armed;
@@ -378,6 +383,9 @@ struct dev_context {
 	uint64_t capture_ratio;
 	struct sigma_trigger trigger;
 	gboolean use_triggers;
+	/* Stages after the first, checked in software once it matched. */
+	struct soft_trigger_logic *stl;
+	gboolean stl_armed;
 	gboolean late_trigger_timeout;
 	enum {
 		SIGMA_UNINITIALIZED = 0,
@@ -421,5 +429,6 @@ SR_PRIV int sigma_build_basic_trigger(struct dev_context *devc,
 
 /* Callback to periodically drive acuisition progress. */
 SR_PRIV int sigma_receive_data(int fd, int revents, void *cb_data);
+SR_PRIV void sigma_abort_download(struct dev_context *devc);
 
 #endif
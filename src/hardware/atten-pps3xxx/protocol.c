@@ -130,10 +130,7 @@ SR_PRIV void send_config(const struct sr_dev_inst *sdi)
 	packet[18] = devc->over_current_protection_set ? 1 : 0;
 	packet[19] = devc->channel_mode_set;
 	/* Checksum. */
-	value = 0;
-	for (i = 0; i < PACKET_SIZE - 1; i++)
-		value += packet[i];
-	packet[i] = value & 0xff;
+	packet[PACKET_SIZE - 1] = sr_sum8(0, packet, PACKET_SIZE - 1);
 	send_packet(sdi, packet);
 	devc->config_dirty = FALSE;
 
@@ -68,6 +68,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	const char *conn;
 	gchar **params;
 	int i, maxch;
+	uint64_t rcvbuf;
 
 	maxch = NUM_CHANNELS;
 	conn = NULL;
@@ -120,6 +121,20 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 		devc->beaglelogic = &beaglelogic_tcp_ops;
 		devc->address = g_strdup(params[1]);
 		devc->port = g_strdup(params[2]);
+		devc->tcp_rcvbuf = TCP_RCVBUF_SIZE;
+
+		/* Optional socket tuning: tcp-raw/<host>/<port>/rcvbuf=4m/nodelay */
+		for (i = 3; params[i]; i++) {
+			if (g_str_has_prefix(params[i], "rcvbuf=") &&
+					sr_parse_sizestring(params[i] + 7, &rcvbuf) == SR_OK &&
+					rcvbuf <= G_MAXINT)
+				devc->tcp_rcvbuf = rcvbuf;
+			else if (!g_ascii_strcasecmp(params[i], "nodelay"))
+				devc->tcp_nodelay = TRUE;
+			else
+				sr_warn("Ignoring unknown connection option '%s'.",
+					params[i]);
+		}
 		g_strfreev(params);
 
 		if (devc->beaglelogic->open(devc) != SR_OK)
@@ -126,7 +126,13 @@ struct beaglelogic_ops {
 SR_PRIV extern const struct beaglelogic_ops beaglelogic_native_ops;
 SR_PRIV extern const struct beaglelogic_ops beaglelogic_tcp_ops;
 
+SR_PRIV struct beaglelogic_mapping *beaglelogic_mapping_ref(
+		struct beaglelogic_mapping *mapping);
+SR_PRIV void beaglelogic_mapping_unref(void *data);
+
 SR_PRIV int beaglelogic_tcp_detect(struct dev_context *devc);
 SR_PRIV int beaglelogic_tcp_drain(struct dev_context *devc);
+SR_PRIV int beaglelogic_tcp_read_batch(struct dev_context *devc,
+		uint8_t *buf, int maxlen);
 
 #endif
@@ -117,19 +117,57 @@ static int beaglelogic_set_bufunitsize(struct dev_context *devc)
 	return ioctl(devc->fd, IOCTL_BL_SET_BUFUNIT_SIZE, devc->bufunitsize);
 }
 
+/*
+ * Packets point into the mapping, which gets unmapped when the device
+ * is closed and the last packet referencing it is released.
+ */
+SR_PRIV struct beaglelogic_mapping *beaglelogic_mapping_ref(
+		struct beaglelogic_mapping *mapping)
+{
+	g_atomic_int_inc(&mapping->refcount);
+
+	return mapping;
+}
+
+SR_PRIV void beaglelogic_mapping_unref(void *data)
+{
+	struct beaglelogic_mapping *mapping;
+
+	mapping = data;
+	if (!g_atomic_int_dec_and_test(&mapping->refcount))
+		return;
+
+	munmap(mapping->addr, mapping->length);
+	g_free(mapping);
+}
+
 static int beaglelogic_mmap(struct dev_context *devc)
 {
 	if (!devc->buffersize)
 		beaglelogic_get_buffersize(devc);
 	devc->sample_buf = mmap(NULL, devc->buffersize,
 			PROT_READ, MAP_SHARED, devc->fd, 0);
+	if (devc->sample_buf == MAP_FAILED)
+		return -1;
+
+	devc->mapping = g_malloc0(sizeof(*devc->mapping));
+	devc->mapping->refcount = 1;
+	devc->mapping->addr = devc->sample_buf;
+	devc->mapping->length = devc->buffersize;
 
-	return ((devc->sample_buf == MAP_FAILED) ? -1 : SR_OK);
+	return SR_OK;
 }
 
 static int beaglelogic_munmap(struct dev_context *devc)
 {
-	return munmap(devc->sample_buf, devc->buffersize);
+	if (!devc->mapping)
+		return SR_OK;
+
+	beaglelogic_mapping_unref(devc->mapping);
+	devc->mapping = NULL;
+	devc->sample_buf = NULL;
+
+	return SR_OK;
 }
 
 SR_PRIV const struct beaglelogic_ops beaglelogic_native_ops = {
@@ -34,6 +34,7 @@
 #ifndef _WIN32
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #endif
@@ -42,6 +43,28 @@
 #include "protocol.h"
 #include "beaglelogic.h"
 
+static void beaglelogic_tcp_set_options(struct dev_context *devc)
+{
+	int opt;
+
+	/* Must happen before connect() for the window scale to cover it. */
+	if (devc->tcp_rcvbuf > 0) {
+		opt = devc->tcp_rcvbuf;
+		if (setsockopt(devc->socket, SOL_SOCKET, SO_RCVBUF,
+				(const void *)&opt, sizeof(opt)) < 0)
+			sr_warn("Cannot set receive buffer size: %s",
+				g_strerror(errno));
+	}
+
+	if (devc->tcp_nodelay) {
+		opt = 1;
+		if (setsockopt(devc->socket, IPPROTO_TCP, TCP_NODELAY,
+				(const void *)&opt, sizeof(opt)) < 0)
+			sr_warn("Cannot disable Nagle's algorithm: %s",
+				g_strerror(errno));
+	}
+}
+
 static int beaglelogic_tcp_open(struct dev_context *devc)
 {
 	struct addrinfo hints;
@@ -65,6 +88,7 @@ static int beaglelogic_tcp_open(struct dev_context *devc)
 		if ((devc->socket = socket(res->ai_family, res->ai_socktype,
 						res->ai_protocol)) < 0)
 			continue;
+		beaglelogic_tcp_set_options(devc);
 		if (connect(devc->socket, res->ai_addr, res->ai_addrlen) != 0) {
 			close(devc->socket);
 			devc->socket = -1;
@@ -138,6 +162,40 @@ static int beaglelogic_tcp_read_data(struct dev_context *devc, char *buf,
 	return len;
 }
 
+/*
+ * Read as much sample data as is available, up to maxlen bytes. This
+ * blocks until some data arrives, then keeps reading what the socket
+ * has buffered without waiting for more.
+ */
+SR_PRIV int beaglelogic_tcp_read_batch(struct dev_context *devc,
+		uint8_t *buf, int maxlen)
+{
+	int len, total;
+
+	total = beaglelogic_tcp_read_data(devc, (char *)buf, maxlen);
+	if (total <= 0)
+		return total;
+
+#ifdef MSG_DONTWAIT
+	while (total < maxlen) {
+		len = recv(devc->socket, (char *)buf + total, maxlen - total,
+			MSG_DONTWAIT);
+		if (len <= 0) {
+			if (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+				sr_err("Receive error: %s", g_strerror(errno));
+				return SR_ERR;
+			}
+			break;
+		}
+		total += len;
+	}
+#else
+	(void)len;
+#endif
+
+	return total;
+}
+
 SR_PRIV int beaglelogic_tcp_drain(struct dev_context *devc)
 {
 	char *buf = g_malloc(1024);
@@ -32,14 +32,37 @@
 #include "protocol.h"
 #include "beaglelogic.h"
 
-/* Define data packet size independent of packet (bufunitsize bytes) size
- * from the BeagleLogic kernel module */
+/* Data packet size in case the kernel module's bufunitsize is unknown */
 #define PACKET_SIZE	(512 * 1024)
 
+/* Check whether the buffer unit at the read position is filled. */
+static gboolean beaglelogic_native_ready(int fd)
+{
+	GPollFD pollfd;
+
+	pollfd.fd = fd;
+	pollfd.events = G_IO_IN;
+	pollfd.revents = 0;
+
+	return g_poll(&pollfd, 1, 0) > 0 && (pollfd.revents & G_IO_IN);
+}
+
+static void beaglelogic_native_send(const struct sr_dev_inst *sdi,
+		struct dev_context *devc, struct sr_datafeed_packet *packet)
+{
+	sr_session_send_zerocopy(sdi, packet, beaglelogic_mapping_unref,
+		beaglelogic_mapping_ref(devc->mapping));
+}
+
 /* This implementation is zero copy from the libsigrok side.
  * It does not copy any data, just passes a pointer from the mmap'ed
- * kernel buffers appropriately. It is up to the application which is
- * using libsigrok to decide how to deal with the data.
+ * kernel buffers appropriately. Packets hold a reference on the mapping,
+ * so applications can keep them. Note that in continuous mode the kernel
+ * keeps overwriting the buffers, one ring pass after they were sent.
+ *
+ * All buffer units which the kernel has filled so far get sent in one
+ * packet (up to the end of the ring), instead of one packet and one
+ * wakeup per PACKET_SIZE.
  */
 SR_PRIV int beaglelogic_native_receive_data(int fd, int revents, void *cb_data)
 {
@@ -50,7 +73,7 @@ SR_PRIV int beaglelogic_native_receive_data(int fd, int revents, void *cb_data)
 
 	int trigger_offset;
 	int pre_trigger_samples;
-	uint32_t packetsize;
+	uint32_t packetsize, chunksize, chunk;
 	uint64_t bytes_remaining;
 
 	if (!(sdi = cb_data) || !(devc = sdi->priv))
@@ -60,7 +83,18 @@ SR_PRIV int beaglelogic_native_receive_data(int fd, int revents, void *cb_data)
 	logic.unitsize = SAMPLEUNIT_TO_BYTES(devc->sampleunit);
 
 	if (revents == G_IO_IN) {
-		sr_info("In callback G_IO_IN, offset=%d", devc->offset);
+		/* Collect the filled buffer units, moving the read pointer. */
+		chunksize = devc->bufunitsize ? devc->bufunitsize : PACKET_SIZE;
+		packetsize = 0;
+		do {
+			chunk = chunksize - (devc->offset + packetsize) % chunksize;
+			packetsize += chunk;
+			lseek(fd, chunk, SEEK_CUR);
+		} while (devc->offset + packetsize < devc->buffersize &&
+				beaglelogic_native_ready(fd));
+
+		sr_spew("In callback G_IO_IN, offset=%u, size=%u",
+			devc->offset, packetsize);
 
 		bytes_remaining = (devc->limit_samples * logic.unitsize) -
 				devc->bytes_read;
@@ -73,7 +107,7 @@ SR_PRIV int beaglelogic_native_receive_data(int fd, int revents, void *cb_data)
 
 		if (devc->trigger_fired) {
 			/* Send the incoming transfer to the session bus. */
-			sr_session_send(sdi, &packet);
+			beaglelogic_native_send(sdi, devc, &packet);
 		} else {
 			/* Check for trigger */
 			trigger_offset = soft_trigger_logic_check(devc->stl,
@@ -85,15 +119,12 @@ SR_PRIV int beaglelogic_native_receive_data(int fd, int revents, void *cb_data)
 						bytes_remaining);
 				logic.data += trigger_offset;
 
-				sr_session_send(sdi, &packet);
+				beaglelogic_native_send(sdi, devc, &packet);
 
 				devc->trigger_fired = TRUE;
 			}
 		}
 
-		/* Move the read pointer forward */
-		lseek(fd, packetsize, SEEK_CUR);
-
 		/* Update byte count and offset (roll over if needed) */
 		devc->bytes_read += logic.length;
 		if ((devc->offset += packetsize) >= devc->buffersize) {
@@ -117,6 +148,14 @@ SR_PRIV int beaglelogic_native_receive_data(int fd, int revents, void *cb_data)
 	return TRUE;
 }
 
+/* Hand the buffer over to the session, and receive into a new one. */
+static void beaglelogic_tcp_send(const struct sr_dev_inst *sdi,
+		struct dev_context *devc, struct sr_datafeed_packet *packet)
+{
+	sr_session_send_zerocopy(sdi, packet, g_free, devc->tcp_buffer);
+	devc->tcp_buffer = g_malloc(TCP_BUFFER_SIZE);
+}
+
 SR_PRIV int beaglelogic_tcp_receive_data(int fd, int revents, void *cb_data)
 {
 	const struct sr_dev_inst *sdi;
@@ -130,6 +169,8 @@ SR_PRIV int beaglelogic_tcp_receive_data(int fd, int revents, void *cb_data)
 	uint32_t packetsize;
 	uint64_t bytes_remaining;
 
+	(void)fd;
+
 	if (!(sdi = cb_data) || !(devc = sdi->priv))
 		return TRUE;
 
@@ -139,11 +180,10 @@ SR_PRIV int beaglelogic_tcp_receive_data(int fd, int revents, void *cb_data)
 	if (revents == G_IO_IN) {
 		sr_info("In callback G_IO_IN");
 
-		len = recv(fd, devc->tcp_buffer, TCP_BUFFER_SIZE, 0);
-		if (len < 0) {
-			sr_err("Receive error: %s", g_strerror(errno));
+		len = beaglelogic_tcp_read_batch(devc, devc->tcp_buffer,
+			TCP_BUFFER_SIZE);
+		if (len < 0)
 			return SR_ERR;
-		}
 
 		packetsize = len;
 
@@ -158,7 +198,7 @@ SR_PRIV int beaglelogic_tcp_receive_data(int fd, int revents, void *cb_data)
 
 		if (devc->trigger_fired) {
 			/* Send the incoming transfer to the session bus. */
-			sr_session_send(sdi, &packet);
+			beaglelogic_tcp_send(sdi, devc, &packet);
 		} else {
 			/* Check for trigger */
 			trigger_offset = soft_trigger_logic_check(devc->stl,
@@ -170,7 +210,7 @@ SR_PRIV int beaglelogic_tcp_receive_data(int fd, int revents, void *cb_data)
 						bytes_remaining);
 				logic.data += trigger_offset;
 
-				sr_session_send(sdi, &packet);
+				beaglelogic_tcp_send(sdi, devc, &packet);
 
 				devc->trigger_fired = TRUE;
 			}
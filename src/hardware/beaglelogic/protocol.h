@@ -32,7 +32,17 @@
 
 #define SAMPLEUNIT_TO_BYTES(x)	((x) == 1 ? 1 : 2)
 
-#define TCP_BUFFER_SIZE         (128 * 1024)
+#define TCP_BUFFER_SIZE         (1024 * 1024)
+
+/* Default socket receive buffer, lets the TCP window cover the link. */
+#define TCP_RCVBUF_SIZE         (4 * 1024 * 1024)
+
+/** The mmap'd kernel buffer, shared with the packets pointing into it. */
+struct beaglelogic_mapping {
+	int refcount;
+	uint8_t *addr;
+	size_t length;
+};
 
 /** Private, per-device-instance driver context. */
 struct dev_context {
@@ -48,6 +58,8 @@ struct dev_context {
 	int socket;
 	unsigned int read_timeout;
 	unsigned char *tcp_buffer;
+	int tcp_rcvbuf;
+	gboolean tcp_nodelay;
 
 	/* Acquisition settings: see beaglelogic.h */
 	uint64_t cur_samplerate;
@@ -68,6 +80,7 @@ struct dev_context {
 	uint64_t sent_samples;
 	uint32_t offset;
 	uint8_t *sample_buf;	/* mmap'd kernel buffer here */
+	struct beaglelogic_mapping *mapping;
 
 	/* Trigger logic */
 	struct soft_trigger_logic *stl;
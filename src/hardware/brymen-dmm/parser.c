@@ -127,8 +127,7 @@ SR_PRIV gboolean brymen_packet_is_valid(const uint8_t *buf)
 {
 	struct brymen_header *hdr;
 	struct brymen_tail *tail;
-	int i;
-	uint8_t chksum = 0;
+	uint8_t chksum;
 	uint8_t *payload;
 
 	payload = (uint8_t *)(buf + sizeof(struct brymen_header));
@@ -136,8 +135,7 @@ SR_PRIV gboolean brymen_packet_is_valid(const uint8_t *buf)
 	hdr = (void *)buf;
 	tail = (void *)(payload + hdr->len);
 
-	for (i = 0; i< hdr->len; i++)
-		chksum ^= payload[i];
+	chksum = sr_xor8(0, payload, hdr->len);
 
 	if (tail->checksum != chksum) {
 		sr_dbg("Packet has invalid checksum 0x%.2x. Expected 0x%.2x.",
@@ -146,12 +146,12 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 		}
 	}
 	if (conn)
-		conn_devices = sr_usb_find(drvc->sr_ctx->libusb_ctx, conn);
+		conn_devices = sr_usb_find(drvc->sr_ctx, conn);
 	else
 		conn_devices = NULL;
 
 	devices = NULL;
-	libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	sr_usb_get_device_list(drvc->sr_ctx, &devlist);
 
 	for (i = 0; devlist[i]; i++) {
 		if (conn) {
@@ -255,6 +255,20 @@ static int dev_open(struct sr_dev_inst *sdi)
 		goto err_ftdi_free;
 	}
 
+	/* Set the FTDI latency timer to 2ms (default is 16ms). */
+	if ((ret = ftdi_set_latency_timer(devc->ftdic, 2)) < 0) {
+		sr_err("Failed to set FTDI latency timer (%d): %s.",
+		       ret, ftdi_get_error_string(devc->ftdic));
+		goto err_ftdi_free;
+	}
+
+	/* Use large USB transfers for reading the sample memory. */
+	if ((ret = ftdi_read_data_set_chunksize(devc->ftdic, 64 * 1024)) < 0) {
+		sr_err("Failed to set FTDI read data chunk size (%d): %s.",
+		       ret, ftdi_get_error_string(devc->ftdic));
+		goto err_ftdi_free;
+	}
+
 	g_usleep(100 * 1000);
 
 	return SR_OK;
@@ -392,18 +406,16 @@ static int receive_data(int fd, int revents, void *cb_data)
 		return FALSE;
 	}
 
-	/* Get one block of data. */
-	if ((ret = cv_read_block(devc)) < 0) {
-		sr_err("Failed to read data block: %d.", ret);
+	/* Get one chunk of data (if the read completed). */
+	if ((ret = cv_read_chunk(devc)) < 0) {
+		sr_err("Failed to read data: %d.", ret);
 		sr_dev_acquisition_stop(sdi);
 		return FALSE;
 	}
 
 	/* We need to get exactly NUM_BLOCKS blocks (i.e. 8MB) of data. */
-	if (devc->block_counter != (NUM_BLOCKS - 1)) {
-		devc->block_counter++;
+	if (devc->block_counter != NUM_BLOCKS)
 		return TRUE;
-	}
 
 	sr_dbg("Sampling finished, sending data to session bus now.");
 
@@ -474,6 +486,12 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		return SR_ERR;
 	}
 
+	devc->read_buf = 0;
+	if (cv_read_submit(devc) != SR_OK) {
+		sr_err("Acquisition failed to start.");
+		return SR_ERR;
+	}
+
 	std_session_send_df_header(sdi);
 
 	/* Time when we should be done (for detecting trigger timeouts). */
@@ -490,6 +508,13 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 
 static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 {
+	struct dev_context *devc;
+
+	devc = sdi->priv;
+
+	if (devc->ftdic)
+		cv_read_cancel(devc);
+
 	sr_session_source_remove(sdi->session, -1);
 	std_session_send_df_end(sdi);
 
@@ -348,42 +348,62 @@ SR_PRIV int cv_set_samplerate(const struct sr_dev_inst *sdi, uint64_t samplerate
 }
 
 /**
- * Get a block of data from the device.
+ * Start reading the next chunk of data from the device.
+ *
+ * The read goes into the mangled_buf[] which is not being de-mangled.
  *
  * @param devc The struct containing private per-device-instance data. Must not
  *             be NULL. devc->ftdic must not be NULL either.
  *
  * @return SR_OK upon success, or SR_ERR upon errors.
  */
-SR_PRIV int cv_read_block(struct dev_context *devc)
+SR_PRIV int cv_read_submit(struct dev_context *devc)
 {
-	int i, byte_offset, m, mi, p, q, index, bytes_read;
-	gint64 now;
-
 	/* Note: Caller checked that devc and devc->ftdic != NULL. */
 
-	sr_spew("Reading block %d.", devc->block_counter);
+	devc->tc = ftdi_read_data_submit(devc->ftdic,
+			devc->mangled_buf[devc->read_buf],
+			sizeof(devc->mangled_buf[0]));
+	if (!devc->tc) {
+		sr_err("Failed to submit FTDI read: %s.",
+		       ftdi_get_error_string(devc->ftdic));
+		return SR_ERR;
+	}
 
-	bytes_read = cv_read(devc, devc->mangled_buf, BS);
+	return SR_OK;
+}
 
-	/* If first block read got 0 bytes, retry until success or timeout. */
-	if ((bytes_read == 0) && (devc->block_counter == 0)) {
-		do {
-			sr_spew("Reading block 0 (again).");
-			/* Note: If bytes_read < 0 cv_read() will log errors. */
-			bytes_read = cv_read(devc, devc->mangled_buf, BS);
-			now = g_get_monotonic_time();
-		} while ((devc->done > now) && (bytes_read == 0));
-	}
+/**
+ * Cancel the read in flight (if any).
+ *
+ * @param devc The struct containing private per-device-instance data. Must not
+ *             be NULL. devc->ftdic must not be NULL either.
+ */
+SR_PRIV void cv_read_cancel(struct dev_context *devc)
+{
+	struct timeval tv;
 
-	/* Check if block read was successful or a timeout occurred. */
-	if (bytes_read != BS) {
-		sr_err("Trigger timed out. Bytes read: %d.", bytes_read);
-		(void) reset_device(devc); /* Ignore errors. */
-		return SR_ERR;
-	}
+	if (!devc->tc)
+		return;
+
+	libusb_cancel_transfer(devc->tc->transfer);
+	tv.tv_sec = 1;
+	tv.tv_usec = 0;
+	libusb_handle_events_timeout_completed(devc->ftdic->usb_ctx, &tv,
+					       &devc->tc->completed);
+
+	/* Older libftdi versions resubmit cancelled reads, don't hang then. */
+	if (devc->tc->completed)
+		(void) ftdi_transfer_data_done(devc->tc);
+	else
+		sr_warn("Failed to cancel FTDI read.");
+	devc->tc = NULL;
+}
+
+static void demangle_block(struct dev_context *devc, const uint8_t *buf)
+{
+	int i, byte_offset, m, mi, p, q, index;
 
-	/* De-mangle the data. */
 	sr_spew("Demangling block %d.", devc->block_counter);
 	byte_offset = devc->block_counter * BS;
 	m = byte_offset / (1024 * 1024);
@@ -394,12 +414,73 @@ SR_PRIV int cv_read_block(struct dev_context *devc)
 			index = m * 2 + (((byte_offset + i) - mi) / 2) * 16;
 			index += (devc->divcount == 0) ? p : (1 - p);
 		} else {
+			/* This also swaps the low and high sample bytes. */
 			p = i & (1 << 0);
 			q = i & (1 << 1);
 			index = m * 4 + (((byte_offset + i) - mi) / 4) * 32;
-			index += q + (1 - p);
+			index += q + p;
 		}
-		devc->final_buf[index] = devc->mangled_buf[i];
+		devc->final_buf[index] = buf[i];
+	}
+}
+
+/**
+ * Check for the read in flight, and de-mangle its data once it completed.
+ *
+ * The read of the next chunk gets submitted before de-mangling, so that
+ * the USB transfer runs while the host is busy.
+ *
+ * @param devc The struct containing private per-device-instance data. Must not
+ *             be NULL. devc->ftdic and devc->tc must not be NULL either.
+ *
+ * @return SR_OK upon success (also if the read is still in flight),
+ *         or SR_ERR upon errors and trigger timeouts.
+ */
+SR_PRIV int cv_read_chunk(struct dev_context *devc)
+{
+	struct timeval tv;
+	const uint8_t *buf;
+	int i, bytes_read;
+
+	/* Note: Caller checked that devc and devc->ftdic != NULL. */
+
+	/* Don't block the session's main loop for long. */
+	tv.tv_sec = 0;
+	tv.tv_usec = 10 * 1000;
+	libusb_handle_events_timeout_completed(devc->ftdic->usb_ctx, &tv,
+					       &devc->tc->completed);
+	if (!devc->tc->completed) {
+		/* The device only starts sending data once it triggered. */
+		if (devc->block_counter == 0 &&
+				g_get_monotonic_time() > devc->done) {
+			sr_err("Trigger timed out.");
+			cv_read_cancel(devc);
+			(void) reset_device(devc); /* Ignore errors. */
+			return SR_ERR;
+		}
+		return SR_OK;
+	}
+
+	bytes_read = ftdi_transfer_data_done(devc->tc);
+	devc->tc = NULL;
+	if (bytes_read != (int)sizeof(devc->mangled_buf[0])) {
+		sr_err("Failed to read block %d. Bytes read: %d.",
+		       devc->block_counter, bytes_read);
+		(void) reset_device(devc); /* Ignore errors. */
+		return SR_ERR;
+	}
+
+	buf = devc->mangled_buf[devc->read_buf];
+	devc->read_buf ^= 1;
+	if (devc->block_counter + CHUNK_BLOCKS < NUM_BLOCKS &&
+			cv_read_submit(devc) != SR_OK) {
+		(void) reset_device(devc); /* Ignore errors. */
+		return SR_ERR;
+	}
+
+	for (i = 0; i < CHUNK_BLOCKS; i++) {
+		demangle_block(devc, buf + i * BS);
+		devc->block_counter++;
 	}
 
 	return SR_OK;
@@ -407,8 +488,8 @@ SR_PRIV int cv_read_block(struct dev_context *devc)
 
 SR_PRIV void cv_send_block_to_session_bus(const struct sr_dev_inst *sdi, int block)
 {
-	int i, idx;
-	uint8_t sample, expected_sample, tmp8;
+	int i, swap;
+	uint8_t sample, expected_sample;
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
 	int trigger_point; /* Relative trigger point (in this block). */
@@ -422,6 +503,7 @@ SR_PRIV void cv_send_block_to_session_bus(const struct sr_dev_inst *sdi, int blo
 
 	/* Check if we can find the trigger condition in this block. */
 	trigger_point = -1;
+	swap = (devc->prof->model == CHRONOVU_LA16) ? 1 : 0;
 	expected_sample = devc->trigger_pattern & devc->trigger_mask;
 	for (i = 0; i < BS; i++) {
 		/* Don't continue if the trigger was found previously. */
@@ -436,7 +518,8 @@ SR_PRIV void cv_send_block_to_session_bus(const struct sr_dev_inst *sdi, int blo
 		if (devc->trigger_mask == 0x0000)
 			break;
 
-		sample = *(devc->final_buf + (block * BS) + i);
+		/* LA16 samples were byte-swapped while de-mangling. */
+		sample = devc->final_buf[((block * BS) + i) ^ swap];
 
 		if ((sample & devc->trigger_mask) == expected_sample) {
 			trigger_point = i;
@@ -445,16 +528,6 @@ SR_PRIV void cv_send_block_to_session_bus(const struct sr_dev_inst *sdi, int blo
 		}
 	}
 
-	/* Swap low and high bytes of the 16-bit LA16 samples. */
-	if (devc->prof->model == CHRONOVU_LA16) {
-		for (i = 0; i < BS; i += 2) {
-			idx = (block * BS) + i;
-			tmp8 = devc->final_buf[idx];
-			devc->final_buf[idx] = devc->final_buf[idx + 1];
-			devc->final_buf[idx + 1] = tmp8;
-		}
-	}
-
 	/* If no trigger was found, send one SR_DF_LOGIC packet. */
 	if (trigger_point == -1) {
 		/* Send an SR_DF_LOGIC packet to the session bus. */
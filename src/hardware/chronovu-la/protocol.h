@@ -35,6 +35,7 @@
 
 #define BS				4096 /* Block size */
 #define NUM_BLOCKS			2048 /* Number of blocks */
+#define CHUNK_BLOCKS			16 /* Number of blocks per FTDI read */
 
 enum {
 	CHRONOVU_LA8,
@@ -59,10 +60,18 @@ struct dev_context {
 	uint64_t limit_samples;
 
 	/**
-	 * A buffer containing some (mangled) samples from the device.
+	 * Two buffers containing some (mangled) samples from the device.
+	 * One of them gets filled by the read in flight, while the other
+	 * one gets de-mangled.
 	 * Format: Pretty mangled-up (due to hardware reasons), see code.
 	 */
-	uint8_t mangled_buf[BS];
+	uint8_t mangled_buf[2][CHUNK_BLOCKS * BS];
+
+	/** Index of the mangled_buf[] the read in flight fills. */
+	int read_buf;
+
+	/** The asynchronous FTDI read in flight (if any). */
+	struct ftdi_transfer_control *tc;
 
 	/**
 	 * An 8MB buffer where we'll store the de-mangled samples.
@@ -100,7 +109,7 @@ struct dev_context {
 	/** Used for keeping track how much time has passed. */
 	gint64 done;
 
-	/** Counter/index for the data block to be read. */
+	/** Counter/index for the data block to be de-mangled. */
 	int block_counter;
 
 	/** The divcount value (determines the sample period). */
@@ -122,7 +131,9 @@ SR_PRIV uint8_t cv_samplerate_to_divcount(const struct sr_dev_inst *sdi,
 SR_PRIV int cv_write(struct dev_context *devc, uint8_t *buf, int size);
 SR_PRIV int cv_convert_trigger(const struct sr_dev_inst *sdi);
 SR_PRIV int cv_set_samplerate(const struct sr_dev_inst *sdi, uint64_t samplerate);
-SR_PRIV int cv_read_block(struct dev_context *devc);
+SR_PRIV int cv_read_submit(struct dev_context *devc);
+SR_PRIV void cv_read_cancel(struct dev_context *devc);
+SR_PRIV int cv_read_chunk(struct dev_context *devc);
 SR_PRIV void cv_send_block_to_session_bus(const struct sr_dev_inst *sdi, int block);
 
 #endif
@@ -35,7 +35,7 @@ static void process_packet(const struct sr_dev_inst *sdi)
 	struct sr_analog_spec spec;
 	GString *dbg;
 	float fvalue;
-	int checksum, mode, i;
+	int mode, i;
 
 	devc = sdi->priv;
 	if (sr_log_loglevel_get() >= SR_LOG_SPEW) {
@@ -57,10 +57,7 @@ static void process_packet(const struct sr_dev_inst *sdi)
 		return;
 	}
 
-	checksum = 0;
-	for (i = 0; i < 9; i++)
-		checksum += devc->buf[i];
-	if ((checksum & 0xff) != devc->buf[9]) {
+	if (sr_sum8(0, devc->buf, 9) != devc->buf[9]) {
 		sr_dbg("invalid packet checksum.");
 		return;
 	}
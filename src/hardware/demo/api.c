@@ -69,6 +69,9 @@ static const uint32_t devopts[] = {
 	SR_CONF_AVG_SAMPLES | SR_CONF_GET | SR_CONF_SET,
 	SR_CONF_TRIGGER_MATCH | SR_CONF_LIST,
 	SR_CONF_CAPTURE_RATIO | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_MAX_THROUGHPUT | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_BUFFERSIZE | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_ANALOG_GROUP_PACKETS | SR_CONF_GET | SR_CONF_SET,
 };
 
 static const uint32_t devopts_cg_logic[] = {
@@ -93,6 +96,8 @@ static const int32_t trigger_matches[] = {
 	SR_TRIGGER_RISING,
 	SR_TRIGGER_FALLING,
 	SR_TRIGGER_EDGE,
+	SR_TRIGGER_OVER,
+	SR_TRIGGER_UNDER,
 };
 
 static const uint64_t samplerates[] = {
@@ -148,6 +153,8 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	devc->limit_frames = limit_frames;
 	devc->capture_ratio = 20;
 	devc->stl = NULL;
+	devc->sta = NULL;
+	devc->block_size = DEFAULT_MAX_THROUGHPUT_BUFSIZE;
 
 	if (num_logic_channels > 0) {
 		/* Logic channels, all in one channel group. */
@@ -208,6 +215,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 			ag->pattern = pattern;
 			ag->avg_val = 0.0f;
 			ag->num_avgs = 0;
+			ag->block = NULL;
 			g_hash_table_insert(devc->ch_ag, ch, ag);
 
 			if (++pattern == ARRAY_SIZE(analog_pattern_str))
@@ -265,6 +273,15 @@ static int config_get(uint32_t key, GVariant **data,
 	case SR_CONF_LIMIT_FRAMES:
 		*data = g_variant_new_uint64(devc->limit_frames);
 		break;
+	case SR_CONF_MAX_THROUGHPUT:
+		*data = g_variant_new_boolean(devc->max_throughput);
+		break;
+	case SR_CONF_BUFFERSIZE:
+		*data = g_variant_new_uint64(devc->block_size);
+		break;
+	case SR_CONF_ANALOG_GROUP_PACKETS:
+		*data = g_variant_new_boolean(devc->analog_group);
+		break;
 	case SR_CONF_AVERAGING:
 		*data = g_variant_new_boolean(devc->avg);
 		break;
@@ -355,6 +372,18 @@ static int config_set(uint32_t key, GVariant *data,
 	case SR_CONF_LIMIT_FRAMES:
 		devc->limit_frames = g_variant_get_uint64(data);
 		break;
+	case SR_CONF_MAX_THROUGHPUT:
+		devc->max_throughput = g_variant_get_boolean(data);
+		break;
+	case SR_CONF_BUFFERSIZE:
+		if (g_variant_get_uint64(data) == 0 ||
+				g_variant_get_uint64(data) > MAX_THROUGHPUT_MAX_BUFSIZE)
+			return SR_ERR_ARG;
+		devc->block_size = g_variant_get_uint64(data);
+		break;
+	case SR_CONF_ANALOG_GROUP_PACKETS:
+		devc->analog_group = g_variant_get_boolean(data);
+		break;
 	case SR_CONF_AVERAGING:
 		devc->avg = g_variant_get_boolean(data);
 		sr_dbg("%s averaging", devc->avg ? "Enabling" : "Disabling");
@@ -495,39 +524,15 @@ static int config_list(uint32_t key, GVariant **data,
 	return SR_OK;
 }
 
-static int dev_acquisition_start(const struct sr_dev_inst *sdi)
+static void count_enabled_channels(const struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
 	GSList *l;
 	struct sr_channel *ch;
 	int bitpos;
 	uint8_t mask;
-	struct sr_trigger *trigger;
 
 	devc = sdi->priv;
-	devc->sent_samples = 0;
-	devc->sent_frame_samples = 0;
-
-	/* Setup triggers */
-	if ((trigger = sr_session_trigger_get(sdi->session))) {
-		int pre_trigger_samples = 0;
-		if (devc->limit_samples > 0)
-			pre_trigger_samples = (devc->capture_ratio * devc->limit_samples) / 100;
-		devc->stl = soft_trigger_logic_new(sdi, trigger, pre_trigger_samples);
-		if (!devc->stl)
-			return SR_ERR_MALLOC;
-
-		/* Disable all analog channels since using them when there are logic
-		 * triggers set up would require having pre-trigger sample buffers
-		 * for analog sample data.
-		 */
-		for (l = sdi->channels; l; l = l->next) {
-			ch = l->data;
-			if (ch->type == SR_CHANNEL_ANALOG)
-				ch->enabled = FALSE;
-		}
-	}
-	devc->trigger_fired = FALSE;
 
 	/*
 	 * Determine the numbers of logic and analog channels that are
@@ -566,9 +571,107 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		devc->enabled_logic_channels,
 		devc->first_partial_logic_index,
 		devc->first_partial_logic_mask);
+}
+
+static gboolean trigger_is_analog(const struct sr_trigger *trigger)
+{
+	const struct sr_trigger_stage *stage;
+	const struct sr_trigger_match *match;
+	const GSList *l, *m;
+
+	for (l = trigger->stages; l; l = l->next) {
+		stage = l->data;
+		for (m = stage->matches; m; m = m->next) {
+			match = m->data;
+			if (match->channel->type == SR_CHANNEL_ANALOG)
+				return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+static int dev_acquisition_start(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	GSList *l;
+	struct sr_channel *ch;
+	struct sr_trigger *trigger;
+
+	devc = sdi->priv;
+	devc->sent_samples = 0;
+	devc->sent_frame_samples = 0;
+
+	/* Setup triggers */
+	if ((trigger = sr_session_trigger_get(sdi->session))) {
+		int pre_trigger_samples = 0;
+		if (devc->limit_samples > 0)
+			pre_trigger_samples = (devc->capture_ratio * devc->limit_samples) / 100;
+		if (trigger_is_analog(trigger)) {
+			if (devc->avg) {
+				sr_err("Analog triggers don't support averaging.");
+				return SR_ERR_NA;
+			}
+			devc->sta = soft_trigger_analog_new(sdi, trigger,
+				pre_trigger_samples, ANALOG_TRIGGER_HYSTERESIS);
+			if (!devc->sta)
+				return SR_ERR_ARG;
 
-	sr_session_source_add(sdi->session, -1, 0, 100,
-			demo_prepare_data, (struct sr_dev_inst *)sdi);
+			/*
+			 * Only the trigger channel has a pre-trigger buffer,
+			 * disable all other channels.
+			 */
+			for (l = sdi->channels; l; l = l->next) {
+				ch = l->data;
+				if (ch != devc->sta->channel)
+					ch->enabled = FALSE;
+			}
+		} else {
+			devc->stl = soft_trigger_logic_new(sdi, trigger,
+				pre_trigger_samples);
+			if (!devc->stl)
+				return SR_ERR_MALLOC;
+
+			/* Disable all analog channels since using them when there are logic
+			 * triggers set up would require having pre-trigger sample buffers
+			 * for analog sample data.
+			 */
+			for (l = sdi->channels; l; l = l->next) {
+				ch = l->data;
+				if (ch->type == SR_CHANNEL_ANALOG)
+					ch->enabled = FALSE;
+			}
+		}
+	}
+	devc->trigger_fired = FALSE;
+
+	count_enabled_channels(sdi);
+
+	if (devc->max_throughput) {
+		/* There is no room for checking triggers. */
+		if (devc->stl || devc->sta || (!devc->enabled_logic_channels &&
+				!devc->enabled_analog_channels)) {
+			sr_err("Max throughput mode needs enabled channels, "
+				"and does not support triggers.");
+			if (devc->stl) {
+				soft_trigger_logic_free(devc->stl);
+				devc->stl = NULL;
+			}
+			if (devc->sta) {
+				soft_trigger_analog_free(devc->sta);
+				devc->sta = NULL;
+			}
+			return SR_ERR_NA;
+		}
+		if (demo_max_throughput_start((struct sr_dev_inst *)sdi) != SR_OK)
+			return SR_ERR_MALLOC;
+		sr_session_fd_source_add(sdi->session, (void *)sdi, -1, 0, 0,
+				demo_send_max_throughput, (struct sr_dev_inst *)sdi);
+	} else {
+		/* Keyed on the device, for several demo devices per session. */
+		sr_session_fd_source_add(sdi->session, (void *)sdi, -1, 0, 100,
+				demo_prepare_data, (struct sr_dev_inst *)sdi);
+	}
 
 	std_session_send_df_header(sdi);
 
@@ -583,11 +686,32 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	return SR_OK;
 }
 
+/*
+ * The data generation catches up with the elapsed time at the current
+ * samplerate, so only the enabled channels need to be counted again.
+ * Max throughput mode sends prepared buffers, and soft triggers have
+ * their pre-trigger buffers sized for the channels at start.
+ */
+static int dev_acquisition_reconfigure(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+
+	devc = sdi->priv;
+
+	if (devc->max_throughput || devc->stl || devc->sta)
+		return SR_ERR_NA;
+
+	count_enabled_channels(sdi);
+
+	return sr_session_send_meta(sdi, SR_CONF_SAMPLERATE,
+		g_variant_new_uint64(devc->cur_samplerate));
+}
+
 static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
 
-	sr_session_source_remove(sdi->session, -1);
+	sr_session_source_remove_internal(sdi->session, (void *)sdi);
 
 	devc = sdi->priv;
 	if (devc->limit_frames > 0)
@@ -595,10 +719,17 @@ static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 
 	std_session_send_df_end(sdi);
 
+	if (devc->block_samples)
+		demo_max_throughput_stop(devc);
+
 	if (devc->stl) {
 		soft_trigger_logic_free(devc->stl);
 		devc->stl = NULL;
 	}
+	if (devc->sta) {
+		soft_trigger_analog_free(devc->sta);
+		devc->sta = NULL;
+	}
 
 	return SR_OK;
 }
@@ -619,6 +750,7 @@ static struct sr_dev_driver demo_driver_info = {
 	.dev_close = std_dummy_dev_close,
 	.dev_acquisition_start = dev_acquisition_start,
 	.dev_acquisition_stop = dev_acquisition_stop,
+	.dev_acquisition_reconfigure = dev_acquisition_reconfigure,
 	.context = NULL,
 };
 SR_REGISTER_DEV_DRIVER(demo_driver_info);
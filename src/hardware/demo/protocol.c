@@ -399,6 +399,106 @@ static void logic_fixup_feed(struct dev_context *devc,
 	}
 }
 
+/* The unit for a given quantity. */
+static enum sr_unit analog_unit(enum sr_mq mq)
+{
+	if (mq == SR_MQ_VOLTAGE)
+		return SR_UNIT_VOLT;
+	else if (mq == SR_MQ_CURRENT)
+		return SR_UNIT_AMPERE;
+	else if (mq == SR_MQ_RESISTANCE)
+		return SR_UNIT_OHM;
+	else if (mq == SR_MQ_CAPACITANCE)
+		return SR_UNIT_FARAD;
+	else if (mq == SR_MQ_TEMPERATURE)
+		return SR_UNIT_CELSIUS;
+	else if (mq == SR_MQ_FREQUENCY)
+		return SR_UNIT_HERTZ;
+	else if (mq == SR_MQ_DUTY_CYCLE)
+		return SR_UNIT_PERCENTAGE;
+	else if (mq == SR_MQ_CONTINUITY)
+		return SR_UNIT_OHM;
+	else if (mq == SR_MQ_PULSE_WIDTH)
+		return SR_UNIT_PERCENTAGE;
+	else if (mq == SR_MQ_CONDUCTANCE)
+		return SR_UNIT_SIEMENS;
+	else if (mq == SR_MQ_POWER)
+		return SR_UNIT_WATT;
+	else if (mq == SR_MQ_GAIN)
+		return SR_UNIT_UNITLESS;
+	else if (mq == SR_MQ_SOUND_PRESSURE_LEVEL)
+		return SR_UNIT_DECIBEL_SPL;
+	else if (mq == SR_MQ_CARBON_MONOXIDE)
+		return SR_UNIT_CONCENTRATION;
+	else if (mq == SR_MQ_RELATIVE_HUMIDITY)
+		return SR_UNIT_HUMIDITY_293K;
+	else if (mq == SR_MQ_TIME)
+		return SR_UNIT_SECOND;
+	else if (mq == SR_MQ_WIND_SPEED)
+		return SR_UNIT_METER_SECOND;
+	else if (mq == SR_MQ_PRESSURE)
+		return SR_UNIT_HECTOPASCAL;
+	else if (mq == SR_MQ_PARALLEL_INDUCTANCE)
+		return SR_UNIT_HENRY;
+	else if (mq == SR_MQ_PARALLEL_CAPACITANCE)
+		return SR_UNIT_FARAD;
+	else if (mq == SR_MQ_PARALLEL_RESISTANCE)
+		return SR_UNIT_OHM;
+	else if (mq == SR_MQ_SERIES_INDUCTANCE)
+		return SR_UNIT_HENRY;
+	else if (mq == SR_MQ_SERIES_CAPACITANCE)
+		return SR_UNIT_FARAD;
+	else if (mq == SR_MQ_SERIES_RESISTANCE)
+		return SR_UNIT_OHM;
+	else if (mq == SR_MQ_DISSIPATION_FACTOR)
+		return SR_UNIT_UNITLESS;
+	else if (mq == SR_MQ_QUALITY_FACTOR)
+		return SR_UNIT_UNITLESS;
+	else if (mq == SR_MQ_PHASE_ANGLE)
+		return SR_UNIT_DEGREE;
+	else if (mq == SR_MQ_DIFFERENCE)
+		return SR_UNIT_UNITLESS;
+	else if (mq == SR_MQ_COUNT)
+		return SR_UNIT_PIECE;
+	else if (mq == SR_MQ_POWER_FACTOR)
+		return SR_UNIT_UNITLESS;
+	else if (mq == SR_MQ_APPARENT_POWER)
+		return SR_UNIT_VOLT_AMPERE;
+	else if (mq == SR_MQ_MASS)
+		return SR_UNIT_GRAM;
+	else if (mq == SR_MQ_HARMONIC_RATIO)
+		return SR_UNIT_UNITLESS;
+	else
+		return SR_UNIT_UNITLESS;
+}
+
+/* Hold back the samples until the trigger fired, send the rest after it. */
+static void send_analog_triggered(struct analog_gen *ag,
+		struct sr_dev_inst *sdi, struct sr_datafeed_packet *packet)
+{
+	struct dev_context *devc;
+	float *data;
+	int offset;
+
+	devc = sdi->priv;
+	offset = soft_trigger_analog_check(devc->sta, &ag->packet, NULL);
+	if (offset < -1) {
+		sr_err("Cannot check analog trigger: %s.", sr_strerror(offset));
+		sr_dev_acquisition_stop(sdi);
+		return;
+	}
+	if (offset < 0)
+		return;
+
+	devc->trigger_fired = TRUE;
+	data = ag->packet.data;
+	ag->packet.data = data + offset;
+	ag->packet.num_samples -= offset;
+	if (ag->packet.num_samples)
+		sr_session_send(sdi, packet);
+	ag->packet.data = data;
+}
+
 static void send_analog_packet(struct analog_gen *ag,
 		struct sr_dev_inst *sdi, uint64_t *analog_sent,
 		uint64_t analog_pos, uint64_t analog_todo)
@@ -425,75 +525,7 @@ static void send_analog_packet(struct analog_gen *ag,
 	ag->packet.meaning->mq = ag->mq;
 	ag->packet.meaning->mqflags = ag->mq_flags;
 
-	/* Set a unit for the given quantity. */
-	if (ag->mq == SR_MQ_VOLTAGE)
-		ag->packet.meaning->unit = SR_UNIT_VOLT;
-	else if (ag->mq == SR_MQ_CURRENT)
-		ag->packet.meaning->unit = SR_UNIT_AMPERE;
-	else if (ag->mq == SR_MQ_RESISTANCE)
-		ag->packet.meaning->unit = SR_UNIT_OHM;
-	else if (ag->mq == SR_MQ_CAPACITANCE)
-		ag->packet.meaning->unit = SR_UNIT_FARAD;
-	else if (ag->mq == SR_MQ_TEMPERATURE)
-		ag->packet.meaning->unit = SR_UNIT_CELSIUS;
-	else if (ag->mq == SR_MQ_FREQUENCY)
-		ag->packet.meaning->unit = SR_UNIT_HERTZ;
-	else if (ag->mq == SR_MQ_DUTY_CYCLE)
-		ag->packet.meaning->unit = SR_UNIT_PERCENTAGE;
-	else if (ag->mq == SR_MQ_CONTINUITY)
-		ag->packet.meaning->unit = SR_UNIT_OHM;
-	else if (ag->mq == SR_MQ_PULSE_WIDTH)
-		ag->packet.meaning->unit = SR_UNIT_PERCENTAGE;
-	else if (ag->mq == SR_MQ_CONDUCTANCE)
-		ag->packet.meaning->unit = SR_UNIT_SIEMENS;
-	else if (ag->mq == SR_MQ_POWER)
-		ag->packet.meaning->unit = SR_UNIT_WATT;
-	else if (ag->mq == SR_MQ_GAIN)
-		ag->packet.meaning->unit = SR_UNIT_UNITLESS;
-	else if (ag->mq == SR_MQ_SOUND_PRESSURE_LEVEL)
-		ag->packet.meaning->unit = SR_UNIT_DECIBEL_SPL;
-	else if (ag->mq == SR_MQ_CARBON_MONOXIDE)
-		ag->packet.meaning->unit = SR_UNIT_CONCENTRATION;
-	else if (ag->mq == SR_MQ_RELATIVE_HUMIDITY)
-		ag->packet.meaning->unit = SR_UNIT_HUMIDITY_293K;
-	else if (ag->mq == SR_MQ_TIME)
-		ag->packet.meaning->unit = SR_UNIT_SECOND;
-	else if (ag->mq == SR_MQ_WIND_SPEED)
-		ag->packet.meaning->unit = SR_UNIT_METER_SECOND;
-	else if (ag->mq == SR_MQ_PRESSURE)
-		ag->packet.meaning->unit = SR_UNIT_HECTOPASCAL;
-	else if (ag->mq == SR_MQ_PARALLEL_INDUCTANCE)
-		ag->packet.meaning->unit = SR_UNIT_HENRY;
-	else if (ag->mq == SR_MQ_PARALLEL_CAPACITANCE)
-		ag->packet.meaning->unit = SR_UNIT_FARAD;
-	else if (ag->mq == SR_MQ_PARALLEL_RESISTANCE)
-		ag->packet.meaning->unit = SR_UNIT_OHM;
-	else if (ag->mq == SR_MQ_SERIES_INDUCTANCE)
-		ag->packet.meaning->unit = SR_UNIT_HENRY;
-	else if (ag->mq == SR_MQ_SERIES_CAPACITANCE)
-		ag->packet.meaning->unit = SR_UNIT_FARAD;
-	else if (ag->mq == SR_MQ_SERIES_RESISTANCE)
-		ag->packet.meaning->unit = SR_UNIT_OHM;
-	else if (ag->mq == SR_MQ_DISSIPATION_FACTOR)
-		ag->packet.meaning->unit = SR_UNIT_UNITLESS;
-	else if (ag->mq == SR_MQ_QUALITY_FACTOR)
-		ag->packet.meaning->unit = SR_UNIT_UNITLESS;
-	else if (ag->mq == SR_MQ_PHASE_ANGLE)
-		ag->packet.meaning->unit = SR_UNIT_DEGREE;
-	else if (ag->mq == SR_MQ_DIFFERENCE)
-		ag->packet.meaning->unit = SR_UNIT_UNITLESS;
-	else if (ag->mq == SR_MQ_COUNT)
-		ag->packet.meaning->unit = SR_UNIT_PIECE;
-	else if (ag->mq == SR_MQ_POWER_FACTOR)
-		ag->packet.meaning->unit = SR_UNIT_UNITLESS;
-	else if (ag->mq == SR_MQ_APPARENT_POWER)
-		ag->packet.meaning->unit = SR_UNIT_VOLT_AMPERE;
-	else if (ag->mq == SR_MQ_MASS)
-		ag->packet.meaning->unit = SR_UNIT_GRAM;
-	else if (ag->mq == SR_MQ_HARMONIC_RATIO)
-		ag->packet.meaning->unit = SR_UNIT_UNITLESS;
-	else
-		ag->packet.meaning->unit = SR_UNIT_UNITLESS;
+	ag->packet.meaning->unit = analog_unit(ag->mq);
 
 	if (!devc->avg) {
 		ag_pattern_pos = analog_pos % pattern->num_samples;
@@ -524,7 +556,10 @@ static void send_analog_packet(struct analog_gen *ag,
 			ag->packet.data = pattern->data + ag_pattern_pos;
 		}
 		ag->packet.num_samples = sending_now;
-		sr_session_send(sdi, &packet);
+		if (devc->sta && !devc->trigger_fired)
+			send_analog_triggered(ag, sdi, &packet);
+		else
+			sr_session_send(sdi, &packet);
 
 		/* Whichever channel group gets there first. */
 		*analog_sent = MAX(*analog_sent, sending_now);
@@ -747,3 +782,342 @@ SR_PRIV int demo_prepare_data(int fd, int revents, void *cb_data)
 
 	return G_SOURCE_CONTINUE;
 }
+
+static void sample_block_unref(void *data)
+{
+	struct sample_block *block;
+
+	block = data;
+	if (g_atomic_int_dec_and_test(&block->refcount))
+		g_free(block);
+}
+
+static struct sample_block *sample_block_new(size_t length)
+{
+	struct sample_block *block;
+
+	block = g_try_malloc(sizeof(*block) + length);
+	if (!block) {
+		sr_err("Cannot allocate %zu bytes of sample data.", length);
+		return NULL;
+	}
+	block->refcount = 1;
+	block->length = length;
+
+	return block;
+}
+
+/*
+ * Quantize a channel's waveform to 8 bits over the ADC range [lo, hi],
+ * like a scope would. Periodic patterns are computed for one period,
+ * which then gets repeated.
+ */
+static void analog_block_fill(struct dev_context *devc, struct analog_gen *ag,
+		float lo, float hi, uint8_t *data, size_t stride)
+{
+	struct analog_pattern *pattern;
+	uint64_t i;
+	float value;
+	long raw;
+
+	pattern = devc->analog_patterns[ag->pattern];
+	for (i = 0; i < devc->block_samples; i++) {
+		if (i >= ANALOG_SAMPLES_PER_PERIOD &&
+				ag->pattern != PATTERN_ANALOG_RANDOM) {
+			data[i * stride] = data[(i - ANALOG_SAMPLES_PER_PERIOD) * stride];
+			continue;
+		}
+		if (ag->pattern == PATTERN_ANALOG_RANDOM)
+			value = (rand() % 1000) / 500.0 - 1;
+		else
+			value = (pattern->data[i] - DEFAULT_ANALOG_OFFSET) /
+				DEFAULT_ANALOG_AMPLITUDE;
+		value = value * ag->amplitude + ag->offset;
+		raw = lroundf((value - lo) / (hi - lo) * 255);
+		data[i * stride] = CLAMP(raw, 0, 255);
+	}
+}
+
+/* Encoding of 8-bit samples over the ADC range [lo, hi]. */
+static void analog_encoding_8bit(struct sr_analog_encoding *encoding,
+		float lo, float hi)
+{
+	encoding->unitsize = 1;
+	encoding->is_signed = FALSE;
+	encoding->is_float = FALSE;
+	encoding->is_bigendian = FALSE;
+	encoding->digits = MAX(0, (int)ceil(-log10((hi - lo) / 255)));
+	encoding->is_digits_decimal = TRUE;
+	sr_rational_set(&encoding->scale, llround((hi - lo) * 1000000),
+		255 * 1000000);
+	sr_rational_set(&encoding->offset, llround(lo * 1000000), 1000000);
+}
+
+static void analog_range(const struct analog_gen *ag, float *lo, float *hi)
+{
+	*lo = ag->offset - fabsf(ag->amplitude);
+	*hi = ag->offset + fabsf(ag->amplitude);
+	/* A flat line still needs a range to quantize to. */
+	if (*hi - *lo < 1e-6)
+		*hi = *lo + 1;
+}
+
+static int analog_blocks_new(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	struct sr_channel *ch;
+	struct analog_gen *ag;
+	struct sample_block *block;
+	GSList *l;
+	float lo, hi, ch_lo, ch_hi;
+	size_t num_channels, i;
+
+	devc = sdi->priv;
+
+	/* Channels in the order of the device's channel list. */
+	lo = hi = 0;
+	for (l = sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->type != SR_CHANNEL_ANALOG || !ch->enabled)
+			continue;
+		ag = g_hash_table_lookup(devc->ch_ag, ch);
+		analog_range(ag, &ch_lo, &ch_hi);
+		if (devc->analog_group) {
+			lo = devc->analog_channels ? MIN(lo, ch_lo) : ch_lo;
+			hi = devc->analog_channels ? MAX(hi, ch_hi) : ch_hi;
+			devc->analog_channels = g_slist_append(devc->analog_channels, ch);
+			continue;
+		}
+		if (!(ag->block = sample_block_new(devc->block_samples)))
+			return SR_ERR_MALLOC;
+		analog_block_fill(devc, ag, ch_lo, ch_hi, ag->block->data, 1);
+		ag->block_encoding = ag->encoding;
+		analog_encoding_8bit(&ag->block_encoding, ch_lo, ch_hi);
+		ag->meaning.mq = ag->mq;
+		ag->meaning.mqflags = ag->mq_flags;
+		ag->meaning.unit = analog_unit(ag->mq);
+	}
+	if (!devc->analog_channels)
+		return SR_OK;
+
+	/*
+	 * The group packet has one encoding, so all channels share the
+	 * ADC range. They get the first channel's quantity as well.
+	 */
+	num_channels = g_slist_length(devc->analog_channels);
+	block = sample_block_new(devc->block_samples * num_channels);
+	if (!block)
+		return SR_ERR_MALLOC;
+	devc->analog_block = block;
+	for (l = devc->analog_channels, i = 0; l; l = l->next, i++) {
+		ag = g_hash_table_lookup(devc->ch_ag, l->data);
+		analog_block_fill(devc, ag, lo, hi, block->data + i, num_channels);
+	}
+
+	ag = g_hash_table_lookup(devc->ch_ag, devc->analog_channels->data);
+	devc->analog_encoding = ag->encoding;
+	analog_encoding_8bit(&devc->analog_encoding, lo, hi);
+	devc->analog_meaning.mq = ag->mq;
+	devc->analog_meaning.mqflags = ag->mq_flags;
+	devc->analog_meaning.unit = analog_unit(ag->mq);
+	devc->analog_meaning.channels = devc->analog_channels;
+	devc->analog_spec = ag->spec;
+
+	return SR_OK;
+}
+
+static void max_throughput_free(struct dev_context *devc)
+{
+	GHashTableIter iter;
+	struct analog_gen *ag;
+	void *value;
+
+	if (devc->block) {
+		sample_block_unref(devc->block);
+		devc->block = NULL;
+	}
+	if (devc->analog_block) {
+		sample_block_unref(devc->analog_block);
+		devc->analog_block = NULL;
+	}
+	g_slist_free(devc->analog_channels);
+	devc->analog_channels = NULL;
+	devc->block_samples = 0;
+
+	g_hash_table_iter_init(&iter, devc->ch_ag);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		ag = value;
+		if (ag->block) {
+			sample_block_unref(ag->block);
+			ag->block = NULL;
+		}
+	}
+}
+
+/*
+ * Precompute the data for max throughput mode: one packet's worth of
+ * samples of each channel, which is sent over and over again.
+ */
+SR_PRIV int demo_max_throughput_start(struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	struct sample_block *block;
+	struct sr_datafeed_logic logic;
+	size_t length, done, chunk;
+	uint64_t samples;
+
+	devc = sdi->priv;
+
+	if (devc->enabled_logic_channels)
+		samples = devc->block_size / devc->logic_unitsize;
+	else
+		samples = devc->block_size;
+	/* Analog waveforms must not jump from one packet to the next. */
+	if (devc->enabled_analog_channels)
+		samples -= samples % ANALOG_SAMPLES_PER_PERIOD;
+	samples = MAX(samples, ANALOG_SAMPLES_PER_PERIOD);
+	devc->block_samples = samples;
+
+	if (devc->enabled_logic_channels) {
+		length = samples * devc->logic_unitsize;
+		if (!(block = sample_block_new(length)))
+			return SR_ERR_MALLOC;
+		for (done = 0; done < length; done += chunk) {
+			chunk = MIN(length - done, LOGIC_BUFSIZE /
+				devc->logic_unitsize * devc->logic_unitsize);
+			logic_generator(sdi, chunk);
+			memcpy(block->data + done, devc->logic_data, chunk);
+		}
+		logic.length = length;
+		logic.unitsize = devc->logic_unitsize;
+		logic.data = block->data;
+		logic_fixup_feed(devc, &logic);
+		devc->block = block;
+	}
+
+	if (analog_blocks_new(sdi) != SR_OK) {
+		max_throughput_free(devc);
+		return SR_ERR_MALLOC;
+	}
+
+	return SR_OK;
+}
+
+static void send_analog_blocks(struct sr_dev_inst *sdi, uint64_t samples)
+{
+	struct dev_context *devc;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_analog analog;
+	struct analog_gen *ag;
+	GHashTableIter iter;
+	void *value;
+
+	devc = sdi->priv;
+
+	packet.type = SR_DF_ANALOG;
+	packet.payload = &analog;
+	analog.num_samples = samples;
+
+	if (devc->analog_block) {
+		analog.data = devc->analog_block->data;
+		analog.encoding = &devc->analog_encoding;
+		analog.meaning = &devc->analog_meaning;
+		analog.spec = &devc->analog_spec;
+		g_atomic_int_inc(&devc->analog_block->refcount);
+		sr_session_send_zerocopy(sdi, &packet, sample_block_unref,
+			devc->analog_block);
+		return;
+	}
+
+	g_hash_table_iter_init(&iter, devc->ch_ag);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		ag = value;
+		if (!ag->block)
+			continue;
+		analog.data = ag->block->data;
+		analog.encoding = &ag->block_encoding;
+		analog.meaning = &ag->meaning;
+		analog.spec = &ag->spec;
+		g_atomic_int_inc(&ag->block->refcount);
+		sr_session_send_zerocopy(sdi, &packet, sample_block_unref,
+			ag->block);
+	}
+}
+
+/* Callback sending data as fast as the session takes it. */
+SR_PRIV int demo_send_max_throughput(int fd, int revents, void *cb_data)
+{
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	struct sample_block *block;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	uint64_t samples;
+	int64_t now, burst_end;
+
+	(void)fd;
+	(void)revents;
+
+	sdi = cb_data;
+	devc = sdi->priv;
+	block = devc->block;
+
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.unitsize = devc->logic_unitsize;
+
+	/* Leave the main loop some room to handle stop requests. */
+	now = g_get_monotonic_time();
+	burst_end = now + MAX_THROUGHPUT_BURST_US;
+	do {
+		if (devc->limit_msec &&
+				now - devc->start_us >= (int64_t)devc->limit_msec * 1000) {
+			sr_dev_acquisition_stop(sdi);
+			break;
+		}
+		samples = devc->block_samples;
+		if (devc->limit_samples) {
+			if (devc->sent_samples >= devc->limit_samples) {
+				sr_dev_acquisition_stop(sdi);
+				break;
+			}
+			samples = MIN(samples,
+				devc->limit_samples - devc->sent_samples);
+		}
+
+		/* Consumers may keep the packets, the data never changes. */
+		if (block) {
+			logic.length = samples * devc->logic_unitsize;
+			logic.data = block->data;
+			g_atomic_int_inc(&block->refcount);
+			sr_session_send_zerocopy(sdi, &packet,
+				sample_block_unref, block);
+		}
+		if (devc->enabled_analog_channels)
+			send_analog_blocks(sdi, samples);
+		devc->sent_samples += samples;
+
+		now = g_get_monotonic_time();
+	} while (now < burst_end);
+
+	return G_SOURCE_CONTINUE;
+}
+
+/* Report the throughput of max throughput mode, and release its data. */
+SR_PRIV void demo_max_throughput_stop(struct dev_context *devc)
+{
+	int64_t elapsed_us;
+	uint64_t bytes;
+	double secs;
+
+	elapsed_us = g_get_monotonic_time() - devc->start_us;
+	bytes = devc->sent_samples * devc->enabled_analog_channels;
+	if (devc->block)
+		bytes += devc->sent_samples * devc->logic_unitsize;
+	secs = MAX(elapsed_us, 1) / (double)G_USEC_PER_SEC;
+	sr_info("Sent %" PRIu64 " samples (%" PRIu64 " bytes) in %.3f s: "
+		"%.1f MB/s, %.1f Msamples/s.", devc->sent_samples, bytes, secs,
+		bytes / secs / 1e6, devc->sent_samples / secs / 1e6);
+
+	max_throughput_free(devc);
+}
@@ -38,9 +38,17 @@
 #define SAMPLES_PER_FRAME		1000UL
 #define DEFAULT_LIMIT_FRAMES		0
 
+/* Default packet size for max throughput mode, stays cache resident. */
+#define DEFAULT_MAX_THROUGHPUT_BUFSIZE	(256 * 1024)
+#define MAX_THROUGHPUT_MAX_BUFSIZE	(64 * 1024 * 1024)
+/* Max throughput mode sends for this long per main loop iteration. */
+#define MAX_THROUGHPUT_BURST_US		10000
+
 #define DEFAULT_ANALOG_ENCODING_DIGITS	4
 #define DEFAULT_ANALOG_SPEC_DIGITS		4
 #define DEFAULT_ANALOG_AMPLITUDE		10
+/* Keeps noise around an analog trigger level from firing the trigger. */
+#define ANALOG_TRIGGER_HYSTERESIS		(DEFAULT_ANALOG_AMPLITUDE / 50.0)
 #define DEFAULT_ANALOG_OFFSET			0.
 
 /* Logic patterns we can generate. */
@@ -111,6 +119,13 @@ struct analog_pattern {
 	unsigned int num_samples;
 };
 
+/* Precomputed sample data, sent over and over in max throughput mode. */
+struct sample_block {
+	gint refcount;
+	size_t length;
+	uint8_t data[];
+};
+
 struct dev_context {
 	uint64_t cur_samplerate;
 	uint64_t limit_samples;
@@ -142,6 +157,19 @@ struct dev_context {
 	uint64_t capture_ratio;
 	gboolean trigger_fired;
 	struct soft_trigger_logic *stl;
+	struct soft_trigger_analog *sta;
+	/* Max throughput mode */
+	gboolean max_throughput;
+	uint64_t block_size;
+	uint64_t block_samples;
+	struct sample_block *block;
+	/* All analog channels in one packet, interleaved. */
+	gboolean analog_group;
+	struct sample_block *analog_block;
+	GSList *analog_channels;
+	struct sr_analog_encoding analog_encoding;
+	struct sr_analog_meaning analog_meaning;
+	struct sr_analog_spec analog_spec;
 };
 
 struct analog_gen {
@@ -158,10 +186,16 @@ struct analog_gen {
 	struct sr_analog_spec spec;
 	float avg_val; /* Average value */
 	unsigned int num_avgs; /* Number of samples averaged */
+	/* 8-bit samples for max throughput mode. */
+	struct sample_block *block;
+	struct sr_analog_encoding block_encoding;
 };
 
 SR_PRIV void demo_generate_analog_pattern(struct dev_context *devc);
 SR_PRIV void demo_free_analog_pattern(struct dev_context *devc);
 SR_PRIV int demo_prepare_data(int fd, int revents, void *cb_data);
+SR_PRIV int demo_max_throughput_start(struct sr_dev_inst *sdi);
+SR_PRIV int demo_send_max_throughput(int fd, int revents, void *cb_data);
+SR_PRIV void demo_max_throughput_stop(struct dev_context *devc);
 
 #endif
@@ -65,6 +65,8 @@ static const uint32_t devopts[] = {
 	SR_CONF_CAPTURE_RATIO | SR_CONF_GET | SR_CONF_SET,
 	SR_CONF_EXTERNAL_CLOCK | SR_CONF_GET | SR_CONF_SET,
 	SR_CONF_CLOCK_EDGE | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
+	SR_CONF_USB_TRANSFER_DEPTH | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_USB_TRANSFER_SIZE | SR_CONF_GET | SR_CONF_SET,
 };
 
 static const int32_t trigger_matches[] = {
@@ -128,7 +130,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	struct sr_channel_group *cg;
 	struct sr_config *src;
 	const struct dslogic_profile *prof;
-	GSList *l, *devices, *conn_devices;
+	GSList *l, *devices, *uploads, *conn_devices;
 	gboolean has_firmware;
 	struct libusb_device_descriptor des;
 	libusb_device **devlist;
@@ -150,13 +152,14 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 		}
 	}
 	if (conn)
-		conn_devices = sr_usb_find(drvc->sr_ctx->libusb_ctx, conn);
+		conn_devices = sr_usb_find(drvc->sr_ctx, conn);
 	else
 		conn_devices = NULL;
 
 	/* Find all DSLogic compatible devices and upload firmware to them. */
 	devices = NULL;
-	libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	uploads = NULL;
+	sr_usb_get_device_list(drvc->sr_ctx, &devlist);
 	for (i = 0; devlist[i]; i++) {
 		if (conn) {
 			usb = NULL;
@@ -257,7 +260,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 
 		devc->samplerates = samplerates;
 		devc->num_samplerates = ARRAY_SIZE(samplerates);
-		has_firmware = usb_match_manuf_prod(devlist[i], "DreamSourceLab", "USB-based Instrument");
+		has_firmware = usb_match_manuf_prod(drvc->sr_ctx, devlist[i], "DreamSourceLab", "USB-based Instrument");
 
 		if (has_firmware) {
 			/* Already has the firmware, so fix the new address. */
@@ -267,17 +270,10 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 			sdi->conn = sr_usb_dev_inst_new(libusb_get_bus_number(devlist[i]),
 					libusb_get_device_address(devlist[i]), NULL);
 		} else {
-			if (ezusb_upload_firmware(drvc->sr_ctx, devlist[i],
-					USB_CONFIGURATION, prof->firmware) == SR_OK) {
-				/* Store when this device's FW was updated. */
-				devc->fw_updated = g_get_monotonic_time();
-			} else {
-				sr_err("Firmware upload failed for "
-				       "device %d.%d (logical), name %s.",
-				       libusb_get_bus_number(devlist[i]),
-				       libusb_get_device_address(devlist[i]),
-				       prof->firmware);
-			}
+			/* Upload along with all other devices, see below. */
+			ezusb_upload_firmware_queue(&uploads, drvc->sr_ctx,
+				devlist[i], USB_CONFIGURATION, prof->firmware,
+				&devc->fw_updated);
 			sdi->inst_type = SR_INST_USB;
 			sdi->conn = sr_usb_dev_inst_new(libusb_get_bus_number(devlist[i]),
 					0xff, NULL);
@@ -286,6 +282,9 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	libusb_free_device_list(devlist, 1);
 	g_slist_free_full(conn_devices, (GDestroyNotify)sr_usb_dev_inst_free);
 
+	/* Uploads and renumeration of several devices can overlap. */
+	ezusb_upload_firmware_run(uploads);
+
 	return std_scan_complete(di, devices);
 }
 
@@ -307,8 +306,14 @@ static int dev_open(struct sr_dev_inst *sdi)
 	ret = SR_ERR;
 	if (devc->fw_updated > 0) {
 		sr_info("Waiting for device to reset.");
-		/* Takes >= 300ms for the FX2 to be gone from the USB bus. */
-		g_usleep(300 * 1000);
+		/*
+		 * Takes >= 300ms for the FX2 to be gone from the USB bus.
+		 * Counted from the upload, which for devices found by the
+		 * same scan was at about the same time.
+		 */
+		timediff_us = g_get_monotonic_time() - devc->fw_updated;
+		if (timediff_us < 300 * 1000)
+			g_usleep(300 * 1000 - timediff_us);
 		timediff_ms = 0;
 		while (timediff_ms < MAX_RENUM_DELAY_MS) {
 			if ((ret = dslogic_dev_open(sdi, di)) == SR_OK)
@@ -372,13 +377,17 @@ static int dev_open(struct sr_dev_inst *sdi)
 
 static int dev_close(struct sr_dev_inst *sdi)
 {
+	struct dev_context *devc;
 	struct sr_usb_dev_inst *usb;
 
+	devc = sdi->priv;
 	usb = sdi->conn;
 
 	if (!usb->devhdl)
 		return SR_ERR_BUG;
 
+	sr_usb_xfer_pool_free(&devc->xfer_pool);
+
 	sr_info("Closing device on %d.%d (logical) / %s (physical) interface %d.",
 		usb->bus, usb->address, sdi->connection_id, USB_INTERFACE);
 	libusb_release_interface(usb->devhdl, USB_INTERFACE);
@@ -445,6 +454,9 @@ static int config_get(uint32_t key, GVariant **data,
 			return SR_ERR_BUG;
 		*data = g_variant_new_string(signal_edges[0]);
 		break;
+	case SR_CONF_USB_TRANSFER_DEPTH:
+	case SR_CONF_USB_TRANSFER_SIZE:
+		return sr_usb_xfer_pool_config_get(&devc->xfer_pool, key, data);
 	default:
 		return SR_ERR_NA;
 	}
@@ -500,6 +512,9 @@ static int config_set(uint32_t key, GVariant *data,
 			return SR_ERR_ARG;
 		devc->clock_edge = idx;
 		break;
+	case SR_CONF_USB_TRANSFER_DEPTH:
+	case SR_CONF_USB_TRANSFER_SIZE:
+		return sr_usb_xfer_pool_config_set(&devc->xfer_pool, key, data);
 	default:
 		return SR_ERR_NA;
 	}
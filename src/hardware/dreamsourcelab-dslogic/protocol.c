@@ -634,6 +634,9 @@ SR_PRIV int dslogic_dev_open(struct sr_dev_inst *sdi, struct sr_dev_driver *di)
 		sr_info("Detected REVID=%d, it's a Cypress CY7C68013%s.",
 			revid, (revid != 1) ? " (FX2)" : "A (FX2LP)");
 
+		devc->usb3 = libusb_get_device_speed(devlist[i]) >=
+			LIBUSB_SPEED_SUPER;
+
 		ret = SR_OK;
 
 		break;
@@ -675,8 +678,23 @@ static void abort_acquisition(struct dev_context *devc)
 static void finish_acquisition(struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
+	struct dslogic_stream *stream;
+	double secs;
 
 	devc = sdi->priv;
+	stream = &devc->stream;
+
+	if (stream->completed) {
+		g_async_queue_unref(stream->completed);
+		stream->completed = NULL;
+	}
+	if (stream->bytes) {
+		secs = (stream->last_us - stream->start_us) /
+			(double)G_USEC_PER_SEC;
+		sr_info("Streamed %" PRIu64 " bytes in %.1f s, %.1f MB/s.",
+			stream->bytes, secs,
+			secs > 0 ? stream->bytes / secs / 1e6 : 0);
+	}
 
 	std_session_send_df_end(sdi);
 
@@ -696,10 +714,7 @@ static void free_transfer(struct libusb_transfer *transfer)
 	sdi = transfer->user_data;
 	devc = sdi->priv;
 
-	g_free(transfer->buffer);
-	transfer->buffer = NULL;
-	libusb_free_transfer(transfer);
-
+	/* Transfers and their buffers are owned by the transfer pool. */
 	for (i = 0; i < devc->num_transfers; i++) {
 		if (devc->transfers[i] == transfer) {
 			devc->transfers[i] = NULL;
@@ -708,15 +723,54 @@ static void free_transfer(struct libusb_transfer *transfer)
 	}
 
 	devc->submitted_transfers--;
-	if (devc->submitted_transfers == 0)
-		finish_acquisition(sdi);
+	if (devc->submitted_transfers == 0) {
+		/* The session's thread ends a stream, see receive_data(). */
+		if (devc->stream.thread)
+			g_atomic_int_set(&devc->stream.finished, 1);
+		else
+			finish_acquisition(sdi);
+	}
+}
+
+static int submit_transfer(const struct sr_dev_inst *sdi, unsigned int i)
+{
+	struct dev_context *devc;
+	int ret;
+
+	devc = sdi->priv;
+
+	if ((ret = sr_usb_transfer_submit(devc->xfer_pool.transfers[i])) != 0) {
+		sr_err("Failed to submit transfer: %s.",
+		       libusb_error_name(ret));
+		return SR_ERR;
+	}
+	devc->transfers[i] = devc->xfer_pool.transfers[i];
+	devc->submitted_transfers++;
+
+	return SR_OK;
 }
 
 static void resubmit_transfer(struct libusb_transfer *transfer)
 {
+	struct sr_dev_inst *const sdi = transfer->user_data;
+	struct dev_context *const devc = sdi->priv;
+	unsigned int i, depth;
 	int ret;
 
-	if ((ret = libusb_submit_transfer(transfer)) == LIBUSB_SUCCESS)
+	/* Keep as many transfers in flight as the host needs. */
+	depth = sr_usb_xfer_pool_adapt(&devc->xfer_pool, transfer);
+	if ((unsigned int)devc->submitted_transfers > depth) {
+		free_transfer(transfer);
+		return;
+	}
+	for (i = 0; i < devc->num_transfers; i++) {
+		if ((unsigned int)devc->submitted_transfers >= depth)
+			break;
+		if (!devc->transfers[i] && submit_transfer(sdi, i) != SR_OK)
+			break;
+	}
+
+	if ((ret = sr_usb_transfer_submit(transfer)) == LIBUSB_SUCCESS)
 		return;
 
 	sr_err("%s: %s", __func__, libusb_error_name(ret));
@@ -724,27 +778,32 @@ static void resubmit_transfer(struct libusb_transfer *transfer)
 
 }
 
+/*
+ * The device sends blocks of one 64bit word per enabled channel, each
+ * holding 64 consecutive samples of that channel. Put the words at
+ * their channels' bit positions and transpose them to get 64 samples.
+ */
 static void deinterleave_buffer(const uint8_t *src, size_t length,
 	uint16_t *dst_ptr, size_t channel_count, uint16_t channel_mask)
 {
-	uint16_t sample;
+	unsigned int bit[16];
+	unsigned int i, n;
+	uint64_t words[16];
+
+	n = 0;
+	for (i = 0; i < 16 && n < channel_count; i++) {
+		if (channel_mask & (1 << i))
+			bit[n++] = i;
+	}
+	memset(words, 0, sizeof(words));
 
 	for (const uint64_t *src_ptr = (uint64_t*)src;
 		src_ptr < (uint64_t*)(src + length);
 		src_ptr += channel_count) {
-		for (int bit = 0; bit != 64; bit++) {
-			const uint64_t *word_ptr = src_ptr;
-			sample = 0;
-			for (unsigned int channel = 0; channel != 16;
-				channel++) {
-				const uint16_t m = channel_mask >> channel;
-				if (!m)
-					break;
-				if ((m & 1) && ((*word_ptr++ >> bit) & UINT64_C(1)))
-					sample |= 1 << channel;
-			}
-			*dst_ptr++ = sample;
-		}
+		for (i = 0; i < n; i++)
+			words[bit[i]] = src_ptr[i];
+		sr_transpose16x64(words, dst_ptr);
+		dst_ptr += 64;
 	}
 }
 
@@ -765,7 +824,40 @@ static void send_data(struct sr_dev_inst *sdi,
 	sr_session_send(sdi, &packet);
 }
 
-static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
+/*
+ * Track the stream's throughput, and tell once per second how it keeps
+ * up with the rate the samplerate and channels need.
+ */
+static void stream_account(struct dev_context *devc, size_t length)
+{
+	struct dslogic_stream *stream;
+	int64_t now;
+	double secs, rate, expected;
+
+	stream = &devc->stream;
+	now = g_get_monotonic_time();
+	if (!stream->start_us)
+		stream->start_us = stream->report_us = now;
+	stream->last_us = now;
+	stream->bytes += length;
+	stream->report_bytes += length;
+	if (now - stream->report_us < G_USEC_PER_SEC)
+		return;
+
+	secs = (now - stream->report_us) / (double)G_USEC_PER_SEC;
+	rate = stream->report_bytes / secs / 1e6;
+	expected = stream->expected_bytes_per_sec / 1e6;
+	if (rate < expected * 0.95)
+		sr_warn("Streaming %.1f MB/s, %.1f MB/s needed.",
+			rate, expected);
+	else
+		sr_dbg("Streaming %.1f MB/s, %d transfers waiting for decoding.",
+			rate, g_async_queue_length(stream->completed));
+	stream->report_us = now;
+	stream->report_bytes = 0;
+}
+
+static void process_transfer(struct libusb_transfer *transfer)
 {
 	struct sr_dev_inst *const sdi = transfer->user_data;
 	struct dev_context *const devc = sdi->priv;
@@ -865,6 +957,8 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 			send_data(sdi, devc->deinterleave_buffer, num_samples);
 			devc->sent_samples += num_samples;
 		}
+		if (devc->stream.completed)
+			stream_account(devc, transfer->actual_length);
 	}
 
 	if (devc->limit_samples && devc->sent_samples >= devc->limit_samples) {
@@ -874,19 +968,64 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 		resubmit_transfer(transfer);
 }
 
+static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
+{
+	struct sr_dev_inst *const sdi = transfer->user_data;
+	struct dev_context *const devc = sdi->priv;
+
+	sr_usb_transfer_account(sdi, transfer);
+
+	/* Streams get decoded by stream_thread(), keep the callback short. */
+	if (devc->stream.thread) {
+		g_async_queue_push(devc->stream.completed, transfer);
+		return;
+	}
+
+	process_transfer(transfer);
+}
+
+/*
+ * Decode a continuous stream away from the USB event handling, so that
+ * transfers get resubmitted while earlier ones are still being decoded.
+ * Transfers complete in order, and there is one decoder, so samples
+ * stay in order. Resubmission, the transfer pool's sizing and abort
+ * handling all run here while the thread exists.
+ */
+static gpointer stream_thread(gpointer data)
+{
+	struct sr_dev_inst *const sdi = data;
+	struct dev_context *const devc = sdi->priv;
+
+	while (!g_atomic_int_get(&devc->stream.finished))
+		process_transfer(g_async_queue_pop(devc->stream.completed));
+
+	return NULL;
+}
+
 static int receive_data(int fd, int revents, void *cb_data)
 {
 	struct timeval tv;
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
 	struct drv_context *drvc;
 
 	(void)fd;
 	(void)revents;
 
-	drvc = (struct drv_context *)cb_data;
+	sdi = cb_data;
+	devc = sdi->priv;
+	drvc = sdi->driver->context;
 
 	tv.tv_sec = tv.tv_usec = 0;
 	libusb_handle_events_timeout(drvc->sr_ctx->libusb_ctx, &tv);
 
+	/* The decoder freed the last transfer of a stream. */
+	if (devc->stream.thread && g_atomic_int_get(&devc->stream.finished)) {
+		g_thread_join(devc->stream.thread);
+		devc->stream.thread = NULL;
+		finish_acquisition(sdi);
+	}
+
 	return TRUE;
 }
 
@@ -911,8 +1050,10 @@ static size_t get_buffer_size(const struct sr_dev_inst *sdi)
 	 * The buffer should be large enough to hold 10ms of data and
 	 * a multiple of the size of a data atom.
 	 */
+	const struct dev_context *devc = sdi->priv;
 	const size_t block_size = enabled_channel_count(sdi) * 512;
-	const size_t s = 10 * to_bytes_per_ms(sdi);
+	const size_t s = sr_usb_xfer_pool_buffer_size(&devc->xfer_pool,
+		10 * to_bytes_per_ms(sdi));
 	if (!block_size)
 		return s;
 	return ((s + block_size - 1) / block_size) * block_size;
@@ -920,10 +1061,19 @@ static size_t get_buffer_size(const struct sr_dev_inst *sdi)
 
 static unsigned int get_number_of_transfers(const struct sr_dev_inst *sdi)
 {
-	/* Total buffer size should be able to hold about 100ms of data. */
+	/*
+	 * Total buffer size should be able to hold about 100ms of data.
+	 * Streams over USB3 get 250ms, so that host latencies don't
+	 * overflow the device's FIFO at SuperSpeed rates.
+	 */
+	const struct dev_context *devc = sdi->priv;
+	const gboolean deep = devc->usb3 && devc->continuous_mode;
+	const unsigned int max = deep ? NUM_SIMUL_TRANSFERS_USB3 :
+		NUM_SIMUL_TRANSFERS;
 	const unsigned int s = get_buffer_size(sdi);
-	const unsigned int n = (100 * to_bytes_per_ms(sdi) + s - 1) / s;
-	return (n > NUM_SIMUL_TRANSFERS) ? NUM_SIMUL_TRANSFERS : n;
+	const unsigned int n = ((deep ? 250 : 100) * to_bytes_per_ms(sdi) +
+		s - 1) / s;
+	return sr_usb_xfer_pool_depth(&devc->xfer_pool, MIN(n, max));
 }
 
 static unsigned int get_timeout(const struct sr_dev_inst *sdi)
@@ -946,7 +1096,6 @@ static int start_transfers(const struct sr_dev_inst *sdi)
 	struct libusb_transfer *transfer;
 	unsigned int i;
 	int ret;
-	unsigned char *buf;
 
 	devc = sdi->priv;
 	usb = sdi->conn;
@@ -956,8 +1105,15 @@ static int start_transfers(const struct sr_dev_inst *sdi)
 	devc->empty_transfer_count = 0;
 	devc->submitted_transfers = 0;
 
+	ret = sr_usb_xfer_pool_alloc(&devc->xfer_pool, usb->devhdl,
+		num_transfers, size);
+	if (ret != SR_OK)
+		return ret;
+
+	/* The pool may hold spare transfers, for when the host lags. */
 	g_free(devc->transfers);
-	devc->transfers = g_try_malloc0(sizeof(*devc->transfers) * num_transfers);
+	devc->transfers = g_try_malloc0(sizeof(*devc->transfers) *
+		devc->xfer_pool.num_transfers);
 	if (!devc->transfers) {
 		sr_err("USB transfers malloc failed.");
 		return SR_ERR_MALLOC;
@@ -971,29 +1127,38 @@ static int start_transfers(const struct sr_dev_inst *sdi)
 		return SR_ERR_MALLOC;
 	}
 
-	devc->num_transfers = num_transfers;
-	for (i = 0; i < num_transfers; i++) {
-		if (!(buf = g_try_malloc(size))) {
-			sr_err("USB transfer buffer malloc failed.");
-			return SR_ERR_MALLOC;
-		}
-		transfer = libusb_alloc_transfer(0);
+	/* Transfers wait longer with more of them in flight. */
+	devc->num_transfers = devc->xfer_pool.num_transfers;
+	for (i = 0; i < devc->num_transfers; i++) {
+		transfer = devc->xfer_pool.transfers[i];
 		libusb_fill_bulk_transfer(transfer, usb->devhdl,
-				6 | LIBUSB_ENDPOINT_IN, buf, size,
-				receive_transfer, (void *)sdi, timeout);
+				6 | LIBUSB_ENDPOINT_IN, transfer->buffer, size,
+				receive_transfer, (void *)sdi,
+				timeout * devc->num_transfers / num_transfers);
+	}
+	for (i = 0; i < num_transfers; i++) {
 		sr_info("submitting transfer: %d", i);
-		if ((ret = libusb_submit_transfer(transfer)) != 0) {
-			sr_err("Failed to submit transfer: %s.",
-			       libusb_error_name(ret));
-			libusb_free_transfer(transfer);
-			g_free(buf);
+		if (submit_transfer(sdi, i) != SR_OK) {
 			abort_acquisition(devc);
-			return SR_ERR;
+			ret = SR_ERR;
+			break;
 		}
-		devc->transfers[i] = transfer;
-		devc->submitted_transfers++;
 	}
 
+	/*
+	 * This runs in a transfer callback, none of the submitted transfers
+	 * can complete before the decoder exists.
+	 */
+	if (devc->continuous_mode && devc->submitted_transfers) {
+		memset(&devc->stream, 0, sizeof(devc->stream));
+		devc->stream.expected_bytes_per_sec = 1000 * to_bytes_per_ms(sdi);
+		devc->stream.completed = g_async_queue_new();
+		devc->stream.thread = g_thread_new("dslogic-stream",
+			stream_thread, (void *)sdi);
+	}
+	if (ret != SR_OK)
+		return ret;
+
 	std_session_send_df_header(sdi);
 
 	return SR_OK;
@@ -1048,7 +1213,10 @@ SR_PRIV int dslogic_acquisition_start(const struct sr_dev_inst *sdi)
 	devc->empty_transfer_count = 0;
 	devc->acq_aborted = FALSE;
 
-	usb_source_add(sdi->session, devc->ctx, timeout, receive_data, drvc);
+	/* Streams end in receive_data(), check often enough. */
+	usb_source_add(sdi->session, devc->ctx,
+		devc->continuous_mode ? MIN(timeout, 10) : timeout,
+		receive_data, (void *)sdi);
 
 	if ((ret = command_stop_acquisition(sdi)) != SR_OK)
 		return ret;
@@ -36,6 +36,7 @@
 
 #define MAX_RENUM_DELAY_MS	3000
 #define NUM_SIMUL_TRANSFERS	32
+#define NUM_SIMUL_TRANSFERS_USB3	128
 #define MAX_EMPTY_TRANSFERS	(NUM_SIMUL_TRANSFERS * 2)
 
 #define NUM_CHANNELS		16
@@ -105,6 +106,22 @@ struct dslogic_profile {
 	uint64_t mem_depth;
 };
 
+/* Continuous mode decoding, see stream_thread(). */
+struct dslogic_stream {
+	GThread *thread;
+	/* Completed transfers, in order, waiting to be decoded. */
+	GAsyncQueue *completed;
+	/* Set by the decoder once the last transfer was freed. */
+	gint finished;
+	/* Rate reporting, only touched by the decoder. */
+	uint64_t expected_bytes_per_sec;
+	int64_t start_us;
+	int64_t report_us;
+	int64_t last_us;
+	uint64_t bytes;
+	uint64_t report_bytes;
+};
+
 struct dev_context {
 	const struct dslogic_profile *profile;
 	/*
@@ -130,6 +147,7 @@ struct dev_context {
 
 	unsigned int num_transfers;
 	struct libusb_transfer **transfers;
+	struct sr_usb_xfer_pool xfer_pool;
 	struct sr_context *ctx;
 
 	uint16_t *deinterleave_buffer;
@@ -138,6 +156,9 @@ struct dev_context {
 	uint32_t trigger_pos;
 	gboolean external_clock;
 	gboolean continuous_mode;
+	/* Connected at SuperSpeed, transfer queues get deeper. */
+	gboolean usb3;
+	struct dslogic_stream stream;
 	int clock_edge;
 	double cur_threshold;
 };
@@ -138,9 +138,6 @@ static void scan_device(struct ftdi_context *ftdic,
 
 	devc = g_malloc0(sizeof(struct dev_context));
 
-	/* Allocate memory for the incoming data. */
-	devc->data_buf = g_malloc0(DATA_BUF_SIZE);
-
 	devc->desc = desc;
 
 	vendor = g_malloc(32);
@@ -182,7 +179,6 @@ err_free_strings:
 	g_free(vendor);
 	g_free(model);
 	g_free(serial_num);
-	g_free(devc->data_buf);
 	g_free(devc);
 }
 
@@ -245,9 +241,9 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 
 	if (conn) {
 		devices = NULL;
-		libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+		sr_usb_get_device_list(drvc->sr_ctx, &devlist);
 		for (i = 0; devlist[i]; i++) {
-			conn_devices = sr_usb_find(drvc->sr_ctx->libusb_ctx, conn);
+			conn_devices = sr_usb_find(drvc->sr_ctx, conn);
 			for (l = conn_devices; l; l = l->next) {
 				usb = l->data;
 				if (usb->bus == libusb_get_bus_number(devlist[i])
@@ -265,14 +261,9 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	return std_scan_complete(di, devices);
 }
 
-static void clear_helper(struct dev_context *devc)
-{
-	g_free(devc->data_buf);
-}
-
 static int dev_clear(const struct sr_dev_driver *di)
 {
-	return std_dev_clear_with_callback(di, (std_dev_clear_callback)clear_helper);
+	return std_dev_clear(di);
 }
 
 static int dev_open(struct sr_dev_inst *sdi)
@@ -316,6 +307,13 @@ static int dev_open(struct sr_dev_inst *sdi)
 		goto err_dev_open_close_ftdic;
 	}
 
+	ret = ftdi_read_data_set_chunksize(devc->ftdic, DATA_BUF_SIZE);
+	if (ret < 0) {
+		sr_err("Failed to set FTDI read data chunk size (%d): %s.",
+		       ret, ftdi_get_error_string(devc->ftdic));
+		goto err_dev_open_close_ftdic;
+	}
+
 	return SR_OK;
 
 err_dev_open_close_ftdic:
@@ -432,12 +430,14 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 
 	/* Properly reset internal variables before every new acquisition. */
 	devc->samples_sent = 0;
-	devc->bytes_received = 0;
+
+	if (ftdi_la_start_transfers(sdi) != SR_OK)
+		return SR_ERR;
 
 	std_session_send_df_header(sdi);
 
-	/* Hook up a dummy handler to receive data from the device. */
-	sr_session_source_add(sdi->session, -1, G_IO_IN, 0,
+	/* Hook up a dummy handler to handle the transfers' events. */
+	sr_session_source_add(sdi->session, -1, 0, 0,
 			      ftdi_la_receive_data, (void *)sdi);
 
 	return SR_OK;
@@ -445,9 +445,8 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 
 static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 {
-	sr_session_source_remove(sdi->session, -1);
-
-	std_session_send_df_end(sdi);
+	/* The acquisition ends once all transfers were cancelled. */
+	ftdi_la_abort_acquisition(sdi->priv);
 
 	return SR_OK;
 }
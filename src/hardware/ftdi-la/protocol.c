@@ -19,9 +19,11 @@
 
 #include <config.h>
 #include <ftdi.h>
+#include <string.h>
 #include "protocol.h"
 
-static void send_samples(struct sr_dev_inst *sdi, uint64_t samples_to_send)
+static void send_samples(struct sr_dev_inst *sdi, uint8_t *data,
+		uint64_t samples_to_send)
 {
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
@@ -35,11 +37,10 @@ static void send_samples(struct sr_dev_inst *sdi, uint64_t samples_to_send)
 	packet.payload = &logic;
 	logic.length = samples_to_send;
 	logic.unitsize = 1;
-	logic.data = devc->data_buf;
+	logic.data = data;
 	sr_session_send(sdi, &packet);
 
 	devc->samples_sent += samples_to_send;
-	devc->bytes_received -= samples_to_send;
 }
 
 SR_PRIV int ftdi_la_set_samplerate(struct dev_context *devc)
@@ -56,12 +57,163 @@ SR_PRIV int ftdi_la_set_samplerate(struct dev_context *devc)
 	return SR_OK;
 }
 
+static void free_transfer(struct libusb_transfer *transfer)
+{
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	unsigned int i;
+
+	sdi = transfer->user_data;
+	devc = sdi->priv;
+
+	g_free(transfer->buffer);
+	transfer->buffer = NULL;
+	libusb_free_transfer(transfer);
+
+	for (i = 0; i < NUM_XFERS; i++) {
+		if (devc->xfers[i] == transfer) {
+			devc->xfers[i] = NULL;
+			break;
+		}
+	}
+
+	devc->num_xfers_pending--;
+}
+
+/*
+ * Strip the two modem status bytes the FTDI chip puts in front of
+ * every USB packet, and return the number of data bytes remaining.
+ */
+static int strip_status_bytes(struct dev_context *devc, uint8_t *buf,
+		int length)
+{
+	int packet_size, offset, chunk, num_bytes;
+
+	packet_size = devc->ftdic->max_packet_size;
+	num_bytes = 0;
+	for (offset = 0; offset < length; offset += packet_size) {
+		chunk = MIN(packet_size, length - offset) - 2;
+		if (chunk <= 0)
+			continue;
+		memmove(buf + num_bytes, buf + offset + 2, chunk);
+		num_bytes += chunk;
+	}
+
+	return num_bytes;
+}
+
+static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
+{
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	uint64_t num_samples;
+	int ret;
+
+	sdi = transfer->user_data;
+	devc = sdi->priv;
+
+	if (devc->acq_aborted) {
+		free_transfer(transfer);
+		return;
+	}
+
+	switch (transfer->status) {
+	case LIBUSB_TRANSFER_COMPLETED:
+	case LIBUSB_TRANSFER_TIMED_OUT:
+		break;
+	default:
+		sr_err("FTDI transfer failed: %s.",
+		       libusb_error_name(transfer->status));
+		free_transfer(transfer);
+		ftdi_la_abort_acquisition(devc);
+		return;
+	}
+
+	num_samples = strip_status_bytes(devc, transfer->buffer,
+			transfer->actual_length);
+	if (num_samples == 0) {
+		sr_spew("Received 0 bytes, nothing to do.");
+	} else if (devc->limit_samples &&
+			devc->samples_sent + num_samples >= devc->limit_samples) {
+		send_samples(sdi, transfer->buffer,
+			devc->limit_samples - devc->samples_sent);
+		sr_info("Requested number of samples reached.");
+		free_transfer(transfer);
+		ftdi_la_abort_acquisition(devc);
+		return;
+	} else {
+		send_samples(sdi, transfer->buffer, num_samples);
+	}
+
+	if ((ret = libusb_submit_transfer(transfer)) != 0) {
+		sr_err("Failed to resubmit FTDI transfer: %s.",
+		       libusb_error_name(ret));
+		free_transfer(transfer);
+		ftdi_la_abort_acquisition(devc);
+	}
+}
+
+/**
+ * Queue several bulk transfers for reading the FTDI chip's data.
+ *
+ * This keeps the chip's FIFO drained while the host is busy elsewhere,
+ * which a single synchronous read at a time does not do at high rates.
+ * The transfers use the FTDI context's USB device handle, the session's
+ * source handles the FTDI context's libusb events.
+ */
+SR_PRIV int ftdi_la_start_transfers(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	struct libusb_transfer *transfer;
+	unsigned int i;
+	int ret;
+
+	devc = sdi->priv;
+
+	devc->acq_aborted = FALSE;
+	devc->num_xfers_pending = 0;
+	for (i = 0; i < NUM_XFERS; i++) {
+		transfer = libusb_alloc_transfer(0);
+		libusb_fill_bulk_transfer(transfer, devc->ftdic->usb_dev,
+			devc->ftdic->out_ep, g_malloc(DATA_BUF_SIZE),
+			DATA_BUF_SIZE, receive_transfer, (void *)sdi, 0);
+		if ((ret = libusb_submit_transfer(transfer)) != 0) {
+			sr_err("Failed to submit FTDI transfer: %s.",
+			       libusb_error_name(ret));
+			g_free(transfer->buffer);
+			libusb_free_transfer(transfer);
+			ftdi_la_abort_acquisition(devc);
+			while (devc->num_xfers_pending > 0)
+				libusb_handle_events(devc->ftdic->usb_ctx);
+			return SR_ERR;
+		}
+		devc->xfers[i] = transfer;
+		devc->num_xfers_pending++;
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Cancel all transfers. The acquisition ends once they are all freed.
+ */
+SR_PRIV void ftdi_la_abort_acquisition(struct dev_context *devc)
+{
+	unsigned int i;
+
+	devc->acq_aborted = TRUE;
+
+	for (i = 0; i < NUM_XFERS; i++) {
+		if (devc->xfers[i])
+			libusb_cancel_transfer(devc->xfers[i]);
+	}
+}
+
 SR_PRIV int ftdi_la_receive_data(int fd, int revents, void *cb_data)
 {
 	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
-	int bytes_read;
-	uint64_t n;
+	struct timeval tv;
 
 	(void)fd;
 	(void)revents;
@@ -70,35 +222,17 @@ SR_PRIV int ftdi_la_receive_data(int fd, int revents, void *cb_data)
 		return TRUE;
 	if (!(devc = sdi->priv))
 		return TRUE;
-	if (!(revents == G_IO_IN || revents == 0))
-		return TRUE;
 	if (!devc->ftdic)
 		return TRUE;
 
-	/* Get a block of data. */
-	bytes_read = ftdi_read_data(devc->ftdic, devc->data_buf, DATA_BUF_SIZE);
-	if (bytes_read < 0) {
-		sr_err("Failed to read FTDI data (%d): %s.",
-		       bytes_read, ftdi_get_error_string(devc->ftdic));
-		sr_dev_acquisition_stop(sdi);
-		return FALSE;
-	}
-	if (bytes_read == 0) {
-		sr_spew("Received 0 bytes, nothing to do.");
-		return TRUE;
-	}
-	sr_spew("Got some data.");
-	devc->bytes_received += bytes_read;
+	/* Only wait briefly, this runs in the session's main loop. */
+	tv.tv_sec = 0;
+	tv.tv_usec = 10 * 1000;
+	libusb_handle_events_timeout(devc->ftdic->usb_ctx, &tv);
 
-	n = devc->samples_sent + devc->bytes_received;
-
-	if (devc->limit_samples && (n >= devc->limit_samples)) {
-		send_samples(sdi, devc->limit_samples - devc->samples_sent);
-		sr_info("Requested number of samples reached.");
-		sr_dev_acquisition_stop(sdi);
-		return TRUE;
-	} else {
-		send_samples(sdi, devc->bytes_received);
+	if (devc->num_xfers_pending == 0) {
+		sr_session_source_remove(sdi->session, -1);
+		std_session_send_df_end(sdi);
 	}
 
 	return TRUE;
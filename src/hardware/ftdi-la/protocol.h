@@ -22,12 +22,14 @@
 
 #include <stdint.h>
 #include <glib.h>
+#include <libusb.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
 
 #define LOG_PREFIX "ftdi-la"
 
-#define DATA_BUF_SIZE (16 * 1024)
+#define DATA_BUF_SIZE (64 * 1024)
+#define NUM_XFERS 8
 
 struct ftdi_chip_desc {
 	uint16_t vendor;
@@ -43,12 +45,15 @@ struct dev_context {
 	uint64_t limit_samples;
 	uint32_t cur_samplerate;
 
-	unsigned char *data_buf;
+	struct libusb_transfer *xfers[NUM_XFERS];
+	int num_xfers_pending;
+	gboolean acq_aborted;
 	uint64_t samples_sent;
-	uint64_t bytes_received;
 };
 
 SR_PRIV int ftdi_la_set_samplerate(struct dev_context *devc);
+SR_PRIV int ftdi_la_start_transfers(const struct sr_dev_inst *sdi);
+SR_PRIV void ftdi_la_abort_acquisition(struct dev_context *devc);
 SR_PRIV int ftdi_la_receive_data(int fd, int revents, void *cb_data);
 
 #endif
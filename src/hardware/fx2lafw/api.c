@@ -131,6 +131,8 @@ static const uint32_t devopts[] = {
 	SR_CONF_SAMPLERATE | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
 	SR_CONF_TRIGGER_MATCH | SR_CONF_LIST,
 	SR_CONF_CAPTURE_RATIO | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_USB_TRANSFER_DEPTH | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_USB_TRANSFER_SIZE | SR_CONF_GET | SR_CONF_SET,
 };
 
 static const int32_t trigger_matches[] = {
@@ -175,26 +177,118 @@ static gboolean is_plausible(const struct libusb_device_descriptor *des)
 	return FALSE;
 }
 
+static struct sr_dev_inst *dev_inst_new(const struct fx2lafw_profile *prof,
+		const char *serial_num, const char *connection_id)
+{
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	struct sr_channel *ch;
+	struct sr_channel_group *cg;
+	int j, num_logic_channels, num_analog_channels;
+	char channel_name[16];
+
+	sdi = g_malloc0(sizeof(struct sr_dev_inst));
+	sdi->status = SR_ST_INITIALIZING;
+	sdi->vendor = g_strdup(prof->vendor);
+	sdi->model = g_strdup(prof->model);
+	sdi->version = g_strdup(prof->model_version);
+	sdi->serial_num = g_strdup(serial_num);
+	sdi->connection_id = g_strdup(connection_id);
+
+	/* Fill in channellist according to this device's profile. */
+	num_logic_channels = prof->dev_caps & DEV_CAPS_16BIT ? 16 : 8;
+	num_analog_channels = prof->dev_caps & DEV_CAPS_AX_ANALOG ? 1 : 0;
+
+	/* Logic channels, all in one channel group. */
+	cg = g_malloc0(sizeof(struct sr_channel_group));
+	cg->name = g_strdup("Logic");
+	for (j = 0; j < num_logic_channels; j++) {
+		sprintf(channel_name, "D%d", j);
+		ch = sr_channel_new(sdi, j, SR_CHANNEL_LOGIC,
+					TRUE, channel_name);
+		cg->channels = g_slist_append(cg->channels, ch);
+	}
+	sdi->channel_groups = g_slist_append(NULL, cg);
+
+	for (j = 0; j < num_analog_channels; j++) {
+		snprintf(channel_name, 16, "A%d", j);
+		ch = sr_channel_new(sdi, j + num_logic_channels,
+				SR_CHANNEL_ANALOG, TRUE, channel_name);
+
+		/* Every analog channel gets its own channel group. */
+		cg = g_malloc0(sizeof(struct sr_channel_group));
+		cg->name = g_strdup(channel_name);
+		cg->channels = g_slist_append(NULL, ch);
+		sdi->channel_groups = g_slist_append(sdi->channel_groups, cg);
+	}
+
+	devc = fx2lafw_dev_new();
+	devc->profile = prof;
+	devc->samplerates = samplerates;
+	devc->num_samplerates = ARRAY_SIZE(samplerates);
+	sdi->priv = devc;
+
+	return sdi;
+}
+
+/* Set up a device which acquires from a USB recording. */
+static GSList *scan_replay(const char *conn)
+{
+	struct sr_dev_inst *sdi;
+	struct sr_usb_dev_inst *usb;
+	struct dev_context *devc;
+	const struct sr_usb_replay_info *info;
+	const struct fx2lafw_profile *prof;
+	int j;
+
+	if (!(usb = sr_usb_replay_open(conn, "fx2lafw")))
+		return NULL;
+	info = sr_usb_replay_info_get(usb);
+
+	prof = NULL;
+	for (j = 0; supported_fx2[j].vid; j++) {
+		if (info->vid == supported_fx2[j].vid &&
+				info->pid == supported_fx2[j].pid &&
+				(!info->model ||
+				 !g_strcmp0(info->model, supported_fx2[j].model))) {
+			prof = &supported_fx2[j];
+			break;
+		}
+	}
+	if (!prof) {
+		sr_err("Recording is of an unknown device %04x:%04x.",
+			info->vid, info->pid);
+		sr_usb_dev_inst_free(usb);
+		return NULL;
+	}
+
+	sdi = dev_inst_new(prof, "", conn);
+	sdi->status = SR_ST_INACTIVE;
+	sdi->inst_type = SR_INST_USB;
+	sdi->conn = usb;
+	sr_usb_replay_channels_apply(sdi);
+	devc = sdi->priv;
+	devc->cur_samplerate = info->samplerate;
+
+	return g_slist_append(NULL, sdi);
+}
+
 static GSList *scan(struct sr_dev_driver *di, GSList *options)
 {
 	struct drv_context *drvc;
 	struct dev_context *devc;
 	struct sr_dev_inst *sdi;
 	struct sr_usb_dev_inst *usb;
-	struct sr_channel *ch;
-	struct sr_channel_group *cg;
 	struct sr_config *src;
 	const struct fx2lafw_profile *prof;
-	GSList *l, *devices, *conn_devices;
+	GSList *l, *devices, *uploads, *conn_devices;
 	gboolean has_firmware;
 	struct libusb_device_descriptor des;
 	libusb_device **devlist;
 	struct libusb_device_handle *hdl;
 	int ret, i, j;
-	int num_logic_channels = 0, num_analog_channels = 0;
 	const char *conn;
 	char manufacturer[64], product[64], serial_num[64], connection_id[64];
-	char channel_name[16];
 
 	drvc = di->context;
 
@@ -207,14 +301,17 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 			break;
 		}
 	}
+	if (conn && g_str_has_prefix(conn, SR_USB_REPLAY_PREFIX))
+		return std_scan_complete(di, scan_replay(conn));
 	if (conn)
-		conn_devices = sr_usb_find(drvc->sr_ctx->libusb_ctx, conn);
+		conn_devices = sr_usb_find(drvc->sr_ctx, conn);
 	else
 		conn_devices = NULL;
 
 	/* Find all fx2lafw compatible devices and upload firmware to them. */
 	devices = NULL;
-	libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	uploads = NULL;
+	sr_usb_get_device_list(drvc->sr_ctx, &devlist);
 	for (i = 0; devlist[i]; i++) {
 		if (conn) {
 			usb = NULL;
@@ -293,49 +390,11 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 		if (!prof)
 			continue;
 
-		sdi = g_malloc0(sizeof(struct sr_dev_inst));
-		sdi->status = SR_ST_INITIALIZING;
-		sdi->vendor = g_strdup(prof->vendor);
-		sdi->model = g_strdup(prof->model);
-		sdi->version = g_strdup(prof->model_version);
-		sdi->serial_num = g_strdup(serial_num);
-		sdi->connection_id = g_strdup(connection_id);
-
-		/* Fill in channellist according to this device's profile. */
-		num_logic_channels = prof->dev_caps & DEV_CAPS_16BIT ? 16 : 8;
-		num_analog_channels = prof->dev_caps & DEV_CAPS_AX_ANALOG ? 1 : 0;
-
-		/* Logic channels, all in one channel group. */
-		cg = g_malloc0(sizeof(struct sr_channel_group));
-		cg->name = g_strdup("Logic");
-		for (j = 0; j < num_logic_channels; j++) {
-			sprintf(channel_name, "D%d", j);
-			ch = sr_channel_new(sdi, j, SR_CHANNEL_LOGIC,
-						TRUE, channel_name);
-			cg->channels = g_slist_append(cg->channels, ch);
-		}
-		sdi->channel_groups = g_slist_append(NULL, cg);
-
-		for (j = 0; j < num_analog_channels; j++) {
-			snprintf(channel_name, 16, "A%d", j);
-			ch = sr_channel_new(sdi, j + num_logic_channels,
-					SR_CHANNEL_ANALOG, TRUE, channel_name);
-
-			/* Every analog channel gets its own channel group. */
-			cg = g_malloc0(sizeof(struct sr_channel_group));
-			cg->name = g_strdup(channel_name);
-			cg->channels = g_slist_append(NULL, ch);
-			sdi->channel_groups = g_slist_append(sdi->channel_groups, cg);
-		}
-
-		devc = fx2lafw_dev_new();
-		devc->profile = prof;
-		sdi->priv = devc;
+		sdi = dev_inst_new(prof, serial_num, connection_id);
+		devc = sdi->priv;
 		devices = g_slist_append(devices, sdi);
 
-		devc->samplerates = samplerates;
-		devc->num_samplerates = ARRAY_SIZE(samplerates);
-		has_firmware = usb_match_manuf_prod(devlist[i],
+		has_firmware = usb_match_manuf_prod(drvc->sr_ctx, devlist[i],
 				"sigrok", "fx2lafw");
 
 		if (has_firmware) {
@@ -346,17 +405,10 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 			sdi->conn = sr_usb_dev_inst_new(libusb_get_bus_number(devlist[i]),
 					libusb_get_device_address(devlist[i]), NULL);
 		} else {
-			if (ezusb_upload_firmware(drvc->sr_ctx, devlist[i],
-					USB_CONFIGURATION, prof->firmware) == SR_OK) {
-				/* Store when this device's FW was updated. */
-				devc->fw_updated = g_get_monotonic_time();
-			} else {
-				sr_err("Firmware upload failed for "
-				       "device %d.%d (logical), name %s.",
-				       libusb_get_bus_number(devlist[i]),
-				       libusb_get_device_address(devlist[i]),
-				       prof->firmware);
-			}
+			/* Upload along with all other devices, see below. */
+			ezusb_upload_firmware_queue(&uploads, drvc->sr_ctx,
+				devlist[i], USB_CONFIGURATION, prof->firmware,
+				&devc->fw_updated);
 			sdi->inst_type = SR_INST_USB;
 			sdi->conn = sr_usb_dev_inst_new(libusb_get_bus_number(devlist[i]),
 					0xff, NULL);
@@ -365,6 +417,9 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	libusb_free_device_list(devlist, 1);
 	g_slist_free_full(conn_devices, (GDestroyNotify)sr_usb_dev_inst_free);
 
+	/* Uploads and renumeration of several devices can overlap. */
+	ezusb_upload_firmware_run(uploads);
+
 	return std_scan_complete(di, devices);
 }
 
@@ -389,6 +444,12 @@ static int dev_open(struct sr_dev_inst *sdi)
 	devc = sdi->priv;
 	usb = sdi->conn;
 
+	if (usb->replay) {
+		if (devc->cur_samplerate == 0)
+			devc->cur_samplerate = devc->samplerates[0];
+		return SR_OK;
+	}
+
 	/*
 	 * If the firmware was recently uploaded, wait up to MAX_RENUM_DELAY_MS
 	 * milliseconds for the FX2 to renumerate.
@@ -396,8 +457,14 @@ static int dev_open(struct sr_dev_inst *sdi)
 	ret = SR_ERR;
 	if (devc->fw_updated > 0) {
 		sr_info("Waiting for device to reset.");
-		/* Takes >= 300ms for the FX2 to be gone from the USB bus. */
-		g_usleep(300 * 1000);
+		/*
+		 * Takes >= 300ms for the FX2 to be gone from the USB bus.
+		 * Counted from the upload, which for devices found by the
+		 * same scan was at about the same time.
+		 */
+		timediff_us = g_get_monotonic_time() - devc->fw_updated;
+		if (timediff_us < 300 * 1000)
+			g_usleep(300 * 1000 - timediff_us);
 		timediff_ms = 0;
 		while (timediff_ms < MAX_RENUM_DELAY_MS) {
 			if ((ret = fx2lafw_dev_open(sdi, di)) == SR_OK)
@@ -452,13 +519,19 @@ static int dev_open(struct sr_dev_inst *sdi)
 
 static int dev_close(struct sr_dev_inst *sdi)
 {
+	struct dev_context *devc;
 	struct sr_usb_dev_inst *usb;
 
+	devc = sdi->priv;
 	usb = sdi->conn;
 
 	if (!usb->devhdl)
 		return SR_ERR_BUG;
 
+	sr_usb_xfer_pool_free(&devc->xfer_pool);
+	if (usb->replay)
+		return SR_OK;
+
 	sr_info("Closing device on %d.%d (logical) / %s (physical) interface %d.",
 		usb->bus, usb->address, sdi->connection_id, USB_INTERFACE);
 	libusb_release_interface(usb->devhdl, USB_INTERFACE);
@@ -504,6 +577,9 @@ static int config_get(uint32_t key, GVariant **data,
 	case SR_CONF_CAPTURE_RATIO:
 		*data = g_variant_new_uint64(devc->capture_ratio);
 		break;
+	case SR_CONF_USB_TRANSFER_DEPTH:
+	case SR_CONF_USB_TRANSFER_SIZE:
+		return sr_usb_xfer_pool_config_get(&devc->xfer_pool, key, data);
 	default:
 		return SR_ERR_NA;
 	}
@@ -539,6 +615,9 @@ static int config_set(uint32_t key, GVariant *data,
 	case SR_CONF_CAPTURE_RATIO:
 		devc->capture_ratio = g_variant_get_uint64(data);
 		break;
+	case SR_CONF_USB_TRANSFER_DEPTH:
+	case SR_CONF_USB_TRANSFER_SIZE:
+		return sr_usb_xfer_pool_config_set(&devc->xfer_pool, key, data);
 	default:
 		return SR_ERR_NA;
 	}
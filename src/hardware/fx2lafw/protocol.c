@@ -275,19 +275,23 @@ SR_PRIV void fx2lafw_abort_acquisition(struct dev_context *devc)
 
 	for (i = devc->num_transfers - 1; i >= 0; i--) {
 		if (devc->transfers[i])
-			libusb_cancel_transfer(devc->transfers[i]);
+			sr_usb_transfer_cancel(devc->transfers[i]);
 	}
 }
 
 static void finish_acquisition(struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
+	struct sr_usb_dev_inst *usb;
 
 	devc = sdi->priv;
+	usb = sdi->conn;
 
 	std_session_send_df_end(sdi);
 
-	usb_source_remove(sdi->session, devc->ctx);
+	/* A replay ends by itself, when no transfers are left. */
+	if (!usb->replay)
+		usb_source_remove(sdi->session, devc->ctx);
 
 	devc->num_transfers = 0;
 	g_free(devc->transfers);
@@ -313,10 +317,7 @@ static void free_transfer(struct libusb_transfer *transfer)
 	sdi = transfer->user_data;
 	devc = sdi->priv;
 
-	g_free(transfer->buffer);
-	transfer->buffer = NULL;
-	libusb_free_transfer(transfer);
-
+	/* Transfers and their buffers are owned by the transfer pool. */
 	for (i = 0; i < devc->num_transfers; i++) {
 		if (devc->transfers[i] == transfer) {
 			devc->transfers[i] = NULL;
@@ -329,11 +330,48 @@ static void free_transfer(struct libusb_transfer *transfer)
 		finish_acquisition(sdi);
 }
 
+static int submit_transfer(const struct sr_dev_inst *sdi, unsigned int i)
+{
+	struct dev_context *devc;
+	int ret;
+
+	devc = sdi->priv;
+
+	if ((ret = sr_usb_transfer_submit(devc->xfer_pool.transfers[i])) != 0) {
+		sr_err("Failed to submit transfer: %s.",
+		       libusb_error_name(ret));
+		return SR_ERR;
+	}
+	devc->transfers[i] = devc->xfer_pool.transfers[i];
+	devc->submitted_transfers++;
+
+	return SR_OK;
+}
+
 static void resubmit_transfer(struct libusb_transfer *transfer)
 {
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	unsigned int i, depth;
 	int ret;
 
-	if ((ret = libusb_submit_transfer(transfer)) == LIBUSB_SUCCESS)
+	sdi = transfer->user_data;
+	devc = sdi->priv;
+
+	/* Keep as many transfers in flight as the host needs. */
+	depth = sr_usb_xfer_pool_adapt(&devc->xfer_pool, transfer);
+	if ((unsigned int)devc->submitted_transfers > depth) {
+		free_transfer(transfer);
+		return;
+	}
+	for (i = 0; i < devc->num_transfers; i++) {
+		if ((unsigned int)devc->submitted_transfers >= depth)
+			break;
+		if (!devc->transfers[i] && submit_transfer(sdi, i) != SR_OK)
+			break;
+	}
+
+	if ((ret = sr_usb_transfer_submit(transfer)) == LIBUSB_SUCCESS)
 		return;
 
 	sr_err("%s: %s", __func__, libusb_error_name(ret));
@@ -350,6 +388,10 @@ static void mso_send_data_proc(struct sr_dev_inst *sdi,
 	struct sr_analog_encoding encoding;
 	struct sr_analog_meaning meaning;
 	struct sr_analog_spec spec;
+#ifdef __SSE2__
+	const __m128i byte_mask = _mm_set1_epi16(0xff);
+	__m128i lo, hi;
+#endif
 
 	(void)sample_width;
 
@@ -357,12 +399,24 @@ static void mso_send_data_proc(struct sr_dev_inst *sdi,
 
 	length /= 2;
 
-	/* Send the logic */
-	for (i = 0; i < length; i++) {
+	/* Split the interleaved logic and analog bytes. */
+	i = 0;
+#ifdef __SSE2__
+	for (; i + 16 <= length; i += 16) {
+		lo = _mm_loadu_si128((const __m128i *)&data[i * 2]);
+		hi = _mm_loadu_si128((const __m128i *)&data[i * 2 + 16]);
+		_mm_storeu_si128((__m128i *)&devc->logic_buffer[i],
+			_mm_packus_epi16(_mm_and_si128(lo, byte_mask),
+				_mm_and_si128(hi, byte_mask)));
+		_mm_storeu_si128((__m128i *)&devc->analog_buffer[i],
+			_mm_packus_epi16(_mm_srli_epi16(lo, 8),
+				_mm_srli_epi16(hi, 8)));
+	}
+#endif
+	for (; i < length; i++) {
 		devc->logic_buffer[i] = data[i * 2];
-		/* Rescale to -10V - +10V from 0-255. */
-		devc->analog_buffer[i] = (data[i * 2 + 1] - 128.0f) / 12.8f;
-	};
+		devc->analog_buffer[i] = data[i * 2 + 1];
+	}
 
 	const struct sr_datafeed_logic logic = {
 		.length = length,
@@ -382,6 +436,18 @@ static void mso_send_data_proc(struct sr_dev_inst *sdi,
 	analog.meaning->mq = SR_MQ_VOLTAGE;
 	analog.meaning->unit = SR_UNIT_VOLT;
 	analog.meaning->mqflags = 0 /* SR_MQFLAG_DC */;
+	/*
+	 * Send the raw ADC bytes, and let the encoding rescale them to
+	 * -10V - +10V from 0-255, i.e. (raw - 128) / 12.8. Consumers which
+	 * need floats get them from sr_analog_to_float().
+	 */
+	analog.encoding->unitsize = 1;
+	analog.encoding->is_signed = FALSE;
+	analog.encoding->is_float = FALSE;
+	analog.encoding->scale.p = 5;
+	analog.encoding->scale.q = 64;
+	analog.encoding->offset.p = -10;
+	analog.encoding->offset.q = 1;
 	analog.num_samples = length;
 	analog.data = devc->analog_buffer;
 
@@ -422,6 +488,8 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 	sdi = transfer->user_data;
 	devc = sdi->priv;
 
+	sr_usb_transfer_account(sdi, transfer);
+
 	/*
 	 * If acquisition has already ended, just free any queued up
 	 * transfer that come in.
@@ -583,7 +651,9 @@ static size_t get_buffer_size(struct dev_context *devc)
 	 * a multiple of 512.
 	 */
 	s = 10 * to_bytes_per_ms(devc->cur_samplerate);
-	return (s + 511) & ~511;
+	s = (s + 511) & ~511;
+
+	return sr_usb_xfer_pool_buffer_size(&devc->xfer_pool, s);
 }
 
 static unsigned int get_number_of_transfers(struct dev_context *devc)
@@ -595,9 +665,9 @@ static unsigned int get_number_of_transfers(struct dev_context *devc)
 		get_buffer_size(devc));
 
 	if (n > NUM_SIMUL_TRANSFERS)
-		return NUM_SIMUL_TRANSFERS;
+		n = NUM_SIMUL_TRANSFERS;
 
-	return n;
+	return sr_usb_xfer_pool_depth(&devc->xfer_pool, n);
 }
 
 static unsigned int get_timeout(struct dev_context *devc)
@@ -635,7 +705,6 @@ static int start_transfers(const struct sr_dev_inst *sdi)
 	struct libusb_transfer *transfer;
 	unsigned int i, num_transfers;
 	int timeout, ret;
-	unsigned char *buf;
 	size_t size;
 
 	devc = sdi->priv;
@@ -663,34 +732,34 @@ static int start_transfers(const struct sr_dev_inst *sdi)
 	size = get_buffer_size(devc);
 	devc->submitted_transfers = 0;
 
-	devc->transfers = g_try_malloc0(sizeof(*devc->transfers) * num_transfers);
+	ret = sr_usb_xfer_pool_alloc(&devc->xfer_pool, usb->devhdl,
+		num_transfers, size);
+	if (ret != SR_OK)
+		return ret;
+
+	/* The pool may hold spare transfers, for when the host lags. */
+	devc->num_transfers = devc->xfer_pool.num_transfers;
+	devc->transfers = g_try_malloc0(sizeof(*devc->transfers) *
+		devc->num_transfers);
 	if (!devc->transfers) {
 		sr_err("USB transfers malloc failed.");
 		return SR_ERR_MALLOC;
 	}
 
-	timeout = get_timeout(devc);
-	devc->num_transfers = num_transfers;
-	for (i = 0; i < num_transfers; i++) {
-		if (!(buf = g_try_malloc(size))) {
-			sr_err("USB transfer buffer malloc failed.");
-			return SR_ERR_MALLOC;
-		}
-		transfer = libusb_alloc_transfer(0);
+	/* Transfers wait longer with more of them in flight. */
+	timeout = get_timeout(devc) * devc->num_transfers / num_transfers;
+	for (i = 0; i < devc->num_transfers; i++) {
+		transfer = devc->xfer_pool.transfers[i];
 		libusb_fill_bulk_transfer(transfer, usb->devhdl,
-				2 | LIBUSB_ENDPOINT_IN, buf, size,
+				2 | LIBUSB_ENDPOINT_IN, transfer->buffer, size,
 				receive_transfer, (void *)sdi, timeout);
+	}
+	for (i = 0; i < num_transfers; i++) {
 		sr_info("submitting transfer: %d", i);
-		if ((ret = libusb_submit_transfer(transfer)) != 0) {
-			sr_err("Failed to submit transfer: %s.",
-			       libusb_error_name(ret));
-			libusb_free_transfer(transfer);
-			g_free(buf);
+		if (submit_transfer(sdi, i) != SR_OK) {
 			fx2lafw_abort_acquisition(devc);
 			return SR_ERR;
 		}
-		devc->transfers[i] = transfer;
-		devc->submitted_transfers++;
 	}
 
 	/*
@@ -713,12 +782,14 @@ SR_PRIV int fx2lafw_start_acquisition(const struct sr_dev_inst *sdi)
 	struct sr_dev_driver *di;
 	struct drv_context *drvc;
 	struct dev_context *devc;
+	struct sr_usb_dev_inst *usb;
 	int timeout, ret;
 	size_t size;
 
 	di = sdi->driver;
 	drvc = di->context;
 	devc = sdi->priv;
+	usb = sdi->conn;
 
 	devc->ctx = drvc->sr_ctx;
 	devc->num_frames = 0;
@@ -732,17 +803,20 @@ SR_PRIV int fx2lafw_start_acquisition(const struct sr_dev_inst *sdi)
 	}
 
 	timeout = get_timeout(devc);
-	usb_source_add(sdi->session, devc->ctx, timeout, receive_data, drvc);
+	if (!usb->replay)
+		usb_source_add(sdi->session, devc->ctx, timeout,
+			receive_data, drvc);
 
 	size = get_buffer_size(devc);
 	/* Prepare for analog sampling. */
 	if (g_slist_length(devc->enabled_analog_channels) > 0) {
 		/* We need a buffer half the size of a transfer. */
 		devc->logic_buffer = g_try_malloc(size / 2);
-		devc->analog_buffer = g_try_malloc(
-			sizeof(float) * size / 2);
+		devc->analog_buffer = g_try_malloc(size / 2);
 	}
 	start_transfers(sdi);
+	if (usb->replay)
+		return sr_usb_replay_start(sdi);
 	if ((ret = command_start_acquisition(sdi)) != SR_OK) {
 		fx2lafw_abort_acquisition(devc);
 		return ret;
@@ -893,12 +893,7 @@ static void dump_msg14(guchar *buf, gboolean raw)
  */
 static guchar calc_chksum_14(guchar *dta)
 {
-	guchar cnt, chs;
-
-	for (chs = 0, cnt = 0; cnt < (GMC_REPLY_SIZE - 1); cnt++)
-		chs += dta[cnt];
-
-	return (64 - chs) & MASK_6BITS;
+	return (64 - sr_sum8(0, dta, GMC_REPLY_SIZE - 1)) & MASK_6BITS;
 }
 
 /** Check 14-byte message, Metrahit 2x. */
@@ -74,8 +74,7 @@ SR_PRIV int gwinstek_gds_800_receive_data(int fd, int revents, void *cb_data)
 	char command[32];
 	char *response;
 	float volts_per_division;
-	int num_samples, i;
-	float samples[MAX_SAMPLES];
+	int num_samples;
 	uint32_t sample_rate;
 	char *end_ptr;
 
@@ -236,15 +235,16 @@ SR_PRIV int gwinstek_gds_800_receive_data(int fd, int revents, void *cb_data)
 		float vbitlog = log10f(vbit);
 		int digits = -(int)vbitlog + (vbitlog < 0.0);
 
-		/* Convert data. */
-		for (i = 0; i < num_samples; i++)
-			samples[i] = ((float) ((int16_t) (RB16(&devc->rcv_buffer[i*2])))) * vbit;
-
-		/* Fill frame. */
+		/* Fill frame, with the samples as received (big endian int16). */
 		sr_analog_init(&analog, &encoding, &meaning, &spec, digits);
+		encoding.unitsize = sizeof(int16_t);
+		encoding.is_signed = TRUE;
+		encoding.is_float = FALSE;
+		encoding.is_bigendian = TRUE;
+		sr_rational_from_double(&encoding.scale, vbit);
 		analog.meaning->channels = g_slist_append(NULL, g_slist_nth_data(sdi->channels, devc->cur_acq_channel));
 		analog.num_samples = num_samples;
-		analog.data = samples;
+		analog.data = devc->rcv_buffer;
 		analog.meaning->mq = SR_MQ_VOLTAGE;
 		analog.meaning->unit = SR_UNIT_VOLT;
 		analog.meaning->mqflags = 0;
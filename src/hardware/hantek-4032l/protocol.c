@@ -63,6 +63,8 @@ static void finish_acquisition(struct sr_dev_inst *sdi)
 
 	devc->num_transfers = 0;
 	g_free(devc->transfers);
+	g_free(devc->spare_bufs);
+	devc->spare_bufs = NULL;
 }
 
 static void free_transfer(struct libusb_transfer *transfer)
@@ -82,6 +84,8 @@ static void free_transfer(struct libusb_transfer *transfer)
 	for (i = 0; i < devc->num_transfers; i++) {
 		if (devc->transfers[i] == transfer) {
 			devc->transfers[i] = NULL;
+			g_free(devc->spare_bufs[i]);
+			devc->spare_bufs[i] = NULL;
 			break;
 		}
 	}
@@ -101,6 +105,37 @@ static void resubmit_transfer(struct libusb_transfer *transfer)
 	free_transfer(transfer);
 }
 
+/*
+ * Resubmit a data transfer before its data gets sent, so the device
+ * need not wait for the session. The transfer continues with its spare
+ * buffer, and the received data becomes the spare, which stays valid
+ * until the callback returns.
+ */
+static gboolean resubmit_data_transfer(struct libusb_transfer *transfer)
+{
+	struct sr_dev_inst *sdi = transfer->user_data;
+	struct dev_context *devc = sdi->priv;
+	uint8_t *data;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < devc->num_transfers; i++) {
+		if (devc->transfers[i] == transfer)
+			break;
+	}
+
+	data = transfer->buffer;
+	transfer->buffer = devc->spare_bufs[i];
+	if ((ret = libusb_submit_transfer(transfer)) != LIBUSB_SUCCESS) {
+		sr_err("%s: %s", __func__, libusb_error_name(ret));
+		transfer->buffer = data;
+		return FALSE;
+	}
+	devc->spare_bufs[i] = data;
+
+	return TRUE;
+}
+
 static void send_data(struct sr_dev_inst *sdi,
 	uint32_t *data, size_t sample_count)
 {
@@ -162,6 +197,7 @@ void LIBUSB_CALL h4032l_data_transfer_callback(struct libusb_transfer *transfer)
 	uint32_t max_samples = transfer->actual_length / sizeof(uint32_t);
 	uint32_t *buf;
 	uint32_t num_samples;
+	gboolean resubmitted;
 
 	/*
 	 * If acquisition has already ended, just free any queued up
@@ -185,6 +221,20 @@ void LIBUSB_CALL h4032l_data_transfer_callback(struct libusb_transfer *transfer)
 
 	num_samples = MIN(devc->remaining_samples, max_samples);
 	devc->remaining_samples -= num_samples;
+
+	/* Resubmit first if more data is to come, then send this. */
+	if (devc->remaining_samples > 0 &&
+	    ((devc->submitted_transfers - 1) * H4032L_DATA_BUFFER_SIZE) <
+	    (int32_t)(devc->remaining_samples * sizeof(uint32_t))) {
+		resubmitted = resubmit_data_transfer(transfer);
+		send_data(sdi, buf, num_samples);
+		sr_dbg("Remaining: %d %08X %08X.", devc->remaining_samples,
+			buf[0], buf[1]);
+		if (!resubmitted)
+			free_transfer(transfer);
+		return;
+	}
+
 	send_data(sdi, buf, num_samples);
 	sr_dbg("Remaining: %d %08X %08X.", devc->remaining_samples,
 		buf[0], buf[1]);
@@ -195,14 +245,8 @@ void LIBUSB_CALL h4032l_data_transfer_callback(struct libusb_transfer *transfer)
 			sr_err("Mismatch magic number of end poll.");
 
 		abort_acquisition(devc);
-		free_transfer(transfer);
-	} else {
-		if (((devc->submitted_transfers - 1) * H4032L_DATA_BUFFER_SIZE) <
-		    (int32_t)(devc->remaining_samples * sizeof(uint32_t)))
-			resubmit_transfer(transfer);
-		else
-			free_transfer(transfer);
 	}
+	free_transfer(transfer);
 }
 
 void LIBUSB_CALL h4032l_usb_callback(struct libusb_transfer *transfer)
@@ -377,6 +421,8 @@ SR_PRIV int h4032l_start_data_transfers(const struct sr_dev_inst *sdi)
 
 	g_free(devc->transfers);
 	devc->transfers = g_malloc(sizeof(*devc->transfers) * num_transfers);
+	g_free(devc->spare_bufs);
+	devc->spare_bufs = g_malloc0(sizeof(*devc->spare_bufs) * num_transfers);
 	devc->num_transfers = num_transfers;
 
 	for (i = 0; i < num_transfers; i++) {
@@ -399,6 +445,7 @@ SR_PRIV int h4032l_start_data_transfers(const struct sr_dev_inst *sdi)
 			return SR_ERR;
 		}
 		devc->transfers[i] = transfer;
+		devc->spare_bufs[i] = g_malloc(H4032L_DATA_BUFFER_SIZE);
 		devc->submitted_transfers++;
 	}
 
@@ -445,6 +492,7 @@ SR_PRIV int h4032l_start(const struct sr_dev_inst *sdi)
 	}
 
 	devc->transfers = g_malloc0(sizeof(*devc->transfers));
+	devc->spare_bufs = g_malloc0(sizeof(*devc->spare_bufs));
 	devc->submitted_transfers++;
 	devc->num_transfers = 1;
 	devc->transfers[0] = transfer;
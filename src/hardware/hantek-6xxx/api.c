@@ -209,12 +209,12 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 		}
 	}
 	if (conn)
-		conn_devices = sr_usb_find(drvc->sr_ctx->libusb_ctx, conn);
+		conn_devices = sr_usb_find(drvc->sr_ctx, conn);
 	else
 		conn_devices = NULL;
 
 	/* Find all Hantek 60xx devices and upload firmware to all of them. */
-	libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	sr_usb_get_device_list(drvc->sr_ctx, &devlist);
 	for (i = 0; devlist[i]; i++) {
 		if (conn) {
 			usb = NULL;
@@ -528,9 +528,7 @@ static void send_chunk(struct sr_dev_inst *sdi, unsigned char *buf,
 	struct sr_analog_spec spec;
 	struct dev_context *devc = sdi->priv;
 	GSList *channels = devc->enabled_channels;
-
-	const float ch_bit[] = { RANGE(0) / 255, RANGE(1) / 255 };
-	const float ch_center[] = { RANGE(0) / 2, RANGE(1) / 2 };
+	uint8_t *data;
 
 	sr_analog_init(&analog, &encoding, &meaning, &spec, 0);
 
@@ -542,44 +540,57 @@ static void send_chunk(struct sr_dev_inst *sdi, unsigned char *buf,
 	analog.meaning->unit = SR_UNIT_VOLT;
 	analog.meaning->mqflags = 0;
 
-	analog.data = g_try_malloc(num_samples * sizeof(float));
-	if (!analog.data) {
+	/* The raw ADC values go out, the encoding converts them to volts. */
+	analog.encoding->unitsize = 1;
+	analog.encoding->is_signed = FALSE;
+	analog.encoding->is_float = FALSE;
+
+	data = g_try_malloc(num_samples);
+	if (!data) {
 		sr_err("Analog data buffer malloc failed.");
 		devc->dev_state = STOPPING;
 		return;
 	}
+	analog.data = data;
 
 	for (int ch = 0; ch < NUM_CHANNELS; ch++) {
 		if (!devc->ch_enabled[ch])
 			continue;
 
-		float vdivlog = log10f(ch_bit[ch]);
+		float vdivlog = log10f(RANGE(ch) / 255);
 		int digits = -(int)vdivlog + (vdivlog < 0.0);
 		analog.encoding->digits = digits;
 		analog.spec->spec_digits = digits;
 		analog.meaning->channels = g_slist_append(NULL, channels->data);
 
-		for (int i = 0; i < num_samples; i++) {
-			/*
-			 * The device always sends data for both channels. If a channel
-			 * is disabled, it contains a copy of the enabled channel's
-			 * data. However, we only send the requested channels to
-			 * the bus.
-			 *
-			 * Voltage values are encoded as a value 0-255, where the
-			 * value is a point in the range represented by the vdiv
-			 * setting. There are 10 vertical divs, so e.g. 500mV/div
-			 * represents 5V peak-to-peak where 0 = -2.5V and 255 = +2.5V.
-			 */
-			((float *)analog.data)[i] = ch_bit[ch] * *(buf + i * 2 + ch) - ch_center[ch];
-		}
+		/*
+		 * Voltage values are encoded as a value 0-255, where the
+		 * value is a point in the range represented by the vdiv
+		 * setting. There are 10 vertical divs, so e.g. 500mV/div
+		 * represents 5V peak-to-peak where 0 = -2.5V and 255 = +2.5V.
+		 */
+		sr_rational_set(&analog.encoding->scale,
+			vdivs[devc->voltage[ch]][0] * VDIV_MULTIPLIER,
+			vdivs[devc->voltage[ch]][1] * 255);
+		sr_rational_set(&analog.encoding->offset,
+			-(int64_t)vdivs[devc->voltage[ch]][0] * VDIV_MULTIPLIER,
+			vdivs[devc->voltage[ch]][1] * 2);
+
+		/*
+		 * The device always sends data for both channels. If a channel
+		 * is disabled, it contains a copy of the enabled channel's
+		 * data. However, we only send the requested channels to
+		 * the bus.
+		 */
+		for (int i = 0; i < num_samples; i++)
+			data[i] = buf[i * 2 + ch];
 
 		sr_session_send(sdi, &packet);
 		g_slist_free(analog.meaning->channels);
 
 		channels = channels->next;
 	}
-	g_free(analog.data);
+	g_free(data);
 }
 
 /*
@@ -592,6 +603,9 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 {
 	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
+	uint64_t samples_received;
+	gboolean done;
+	int i;
 
 	sdi = transfer->user_data;
 	devc = sdi->priv;
@@ -601,12 +615,17 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 		libusb_free_transfer(transfer);
 		devc->dev_state = CAPTURE;
 		devc->aq_started = g_get_monotonic_time();
-		read_channel(sdi, data_amount(sdi));
+		/* Keep several transfers queued, for gapless streaming. */
+		for (i = 0; i < NUM_TRANSFERS; i++)
+			read_channel(sdi, data_amount(sdi));
 		return;
 	}
 
-	if (devc->dev_state != CAPTURE)
+	if (devc->dev_state != CAPTURE) {
+		g_free(transfer->buffer);
+		libusb_free_transfer(transfer);
 		return;
+	}
 
 	sr_spew("receive_transfer(): calculated samplerate == %" PRIu64 "ks/s",
 		(uint64_t)(transfer->actual_length * 1000 /
@@ -616,31 +635,38 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 	sr_spew("receive_transfer(): status %s received %d bytes.",
 		libusb_error_name(transfer->status), transfer->actual_length);
 
-	if (transfer->actual_length == 0)
-		/* Nothing to send to the bus. */
-		return;
-
-	unsigned samples_received = transfer->actual_length / NUM_CHANNELS;
-	send_chunk(sdi, transfer->buffer, samples_received);
+	/* Transfers queued ahead may hold more than the limit asks for. */
+	samples_received = transfer->actual_length / NUM_CHANNELS;
+	if (devc->limit_samples)
+		samples_received = MIN(samples_received,
+			devc->limit_samples - devc->samp_received);
 	devc->samp_received += samples_received;
 
-	g_free(transfer->buffer);
-	libusb_free_transfer(transfer);
-
+	done = FALSE;
 	if (devc->limit_samples && devc->samp_received >= devc->limit_samples) {
 		sr_info("Requested number of samples reached, stopping. %"
 			PRIu64 " <= %" PRIu64, devc->limit_samples,
 			devc->samp_received);
-		sr_dev_acquisition_stop(sdi);
+		done = TRUE;
 	} else if (devc->limit_msec && (g_get_monotonic_time() -
 			devc->aq_started) / 1000 >= devc->limit_msec) {
 		sr_info("Requested time limit reached, stopping. %d <= %d",
 			(uint32_t)devc->limit_msec,
 			(uint32_t)(g_get_monotonic_time() - devc->aq_started) / 1000);
-		sr_dev_acquisition_stop(sdi);
+		done = TRUE;
 	} else {
+		/* Replace this transfer before sending its data. */
 		read_channel(sdi, data_amount(sdi));
 	}
+
+	if (samples_received > 0)
+		send_chunk(sdi, transfer->buffer, samples_received);
+
+	g_free(transfer->buffer);
+	libusb_free_transfer(transfer);
+
+	if (done)
+		sr_dev_acquisition_stop(sdi);
 }
 
 static int read_channel(const struct sr_dev_inst *sdi, uint32_t amount)
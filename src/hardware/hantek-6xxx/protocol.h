@@ -66,6 +66,9 @@
 #define MAX_PACKET_SIZE		(12 * 1024 * 1024)
 #endif
 
+/* Number of data transfers kept queued while capturing. */
+#define NUM_TRANSFERS		4
+
 #define HANTEK_EP_IN		0x86
 #define USB_INTERFACE		0
 #define USB_CONFIGURATION	1
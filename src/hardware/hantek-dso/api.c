@@ -257,6 +257,7 @@ static void clear_helper(struct dev_context *devc)
 {
 	g_free(devc->triggersource);
 	g_slist_free(devc->enabled_channels);
+	sr_analog_interleave_free(devc->interleave);
 }
 
 static int dev_clear(const struct sr_dev_driver *di)
@@ -292,12 +293,12 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 		}
 	}
 	if (conn)
-		conn_devices = sr_usb_find(drvc->sr_ctx->libusb_ctx, conn);
+		conn_devices = sr_usb_find(drvc->sr_ctx, conn);
 	else
 		conn_devices = NULL;
 
 	/* Find all Hantek DSO devices and upload firmware to all of them. */
-	libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	sr_usb_get_device_list(drvc->sr_ctx, &devlist);
 	for (i = 0; devlist[i]; i++) {
 		if (conn) {
 			usb = NULL;
@@ -652,6 +653,7 @@ static void send_chunk(struct sr_dev_inst *sdi, unsigned char *buf,
 	struct sr_analog_spec spec;
 	struct dev_context *devc = sdi->priv;
 	GSList *channels = devc->enabled_channels;
+	uint8_t *data;
 
 	packet.type = SR_DF_ANALOG;
 	packet.payload = &analog;
@@ -661,8 +663,17 @@ static void send_chunk(struct sr_dev_inst *sdi, unsigned char *buf,
 	analog.meaning->mq = SR_MQ_VOLTAGE;
 	analog.meaning->unit = SR_UNIT_VOLT;
 	analog.meaning->mqflags = 0;
-	/* TODO: Check malloc return value. */
-	analog.data = g_try_malloc(num_samples * sizeof(float));
+
+	/* The raw ADC values go out, the encoding converts them to volts. */
+	analog.encoding->unitsize = 1;
+	analog.encoding->is_signed = FALSE;
+	analog.encoding->is_float = FALSE;
+
+	if (!(data = g_try_malloc(num_samples))) {
+		sr_err("Analog data buffer malloc failed.");
+		return;
+	}
+	analog.data = data;
 
 	for (int ch = 0; ch < NUM_CHANNELS; ch++) {
 		if (!devc->ch_enabled[ch])
@@ -675,28 +686,42 @@ static void send_chunk(struct sr_dev_inst *sdi, unsigned char *buf,
 		analog.spec->spec_digits = digits;
 		analog.meaning->channels = g_slist_append(NULL, channels->data);
 
-		for (int i = 0; i < num_samples; i++) {
-			/*
-			 * The device always sends data for both channels. If a channel
-			 * is disabled, it contains a copy of the enabled channel's
-			 * data. However, we only send the requested channels to
-			 * the bus.
-			 *
-			 * Voltage values are encoded as a value 0-255 (0-512 on the
-			 * DSO-5200*), where the value is a point in the range
-			 * represented by the vdiv setting. There are 8 vertical divs,
-			 * so e.g. 500mV/div represents 4V peak-to-peak where 0 = -2V
-			 * and 255 = +2V.
-			 */
-			/* TODO: Support for DSO-5xxx series 9-bit samples. */
-			((float *)analog.data)[i] = range / 255 * *(buf + i * 2 + 1 - ch) - range / 2;
-		}
-		sr_session_send(sdi, &packet);
+		/*
+		 * Voltage values are encoded as a value 0-255 (0-512 on the
+		 * DSO-5200*), where the value is a point in the range
+		 * represented by the vdiv setting. There are 8 vertical divs,
+		 * so e.g. 500mV/div represents 4V peak-to-peak where 0 = -2V
+		 * and 255 = +2V.
+		 */
+		sr_rational_set(&analog.encoding->scale,
+			vdivs[devc->voltage[ch]][0] * 8,
+			vdivs[devc->voltage[ch]][1] * 255);
+		sr_rational_set(&analog.encoding->offset,
+			-(int64_t)vdivs[devc->voltage[ch]][0] * 4,
+			vdivs[devc->voltage[ch]][1]);
+
+		/*
+		 * The device always sends data for both channels. If a channel
+		 * is disabled, it contains a copy of the enabled channel's
+		 * data. However, we only send the requested channels to
+		 * the bus.
+		 */
+		/* TODO: Support for DSO-5xxx series 9-bit samples. */
+		for (int i = 0; i < num_samples; i++)
+			data[i] = buf[i * 2 + 1 - ch];
+
+		if (devc->interleave)
+			sr_analog_interleave_add(devc->interleave, &analog);
+		else
+			sr_session_send(sdi, &packet);
 		g_slist_free(analog.meaning->channels);
 
 		channels = channels->next;
 	}
-	g_free(analog.data);
+	g_free(data);
+
+	if (devc->interleave)
+		sr_analog_interleave_send(devc->interleave, sdi);
 }
 
 /*
@@ -922,6 +947,13 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	if (dso_init(sdi) != SR_OK)
 		return SR_ERR;
 
+	sr_analog_interleave_free(devc->interleave);
+	devc->interleave = NULL;
+	if (sr_session_takes_analog_interleaved(sdi->session) &&
+			g_slist_length(devc->enabled_channels) > 1)
+		devc->interleave = sr_analog_interleave_new(
+			devc->enabled_channels, devc->framesize);
+
 	if (dso_capture_start(sdi) != SR_OK)
 		return SR_ERR;
 
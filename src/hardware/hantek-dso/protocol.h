@@ -212,6 +212,8 @@ struct dev_context {
 	unsigned int samp_buffered;
 	unsigned int trigger_offset;
 	unsigned char *framebuf;
+	/* Both channels go out in one packet, see send_chunk(). */
+	struct sr_analog_interleave *interleave;
 };
 
 SR_PRIV int dso_open(struct sr_dev_inst *sdi);
@@ -35,6 +35,12 @@ static const uint32_t devopts[] = {
 	SR_CONF_LIMIT_SAMPLES | SR_CONF_SET,
 	SR_CONF_MEASURED_QUANTITY | SR_CONF_SET,
 	SR_CONF_ADC_POWERLINE_CYCLES | SR_CONF_SET | SR_CONF_GET,
+	SR_CONF_DATA_SOURCE | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
+};
+
+static const char *data_sources[] = {
+	[DATA_SOURCE_LIVE] = "Live",
+	[DATA_SOURCE_BURST] = "Burst",
 };
 
 static struct sr_dev_driver hp_3457a_driver_info;
@@ -235,6 +241,9 @@ static int config_get(uint32_t key, GVariant **data,
 	case SR_CONF_ADC_POWERLINE_CYCLES:
 		*data = g_variant_new_double(devc->nplc);
 		break;
+	case SR_CONF_DATA_SOURCE:
+		*data = g_variant_new_string(data_sources[devc->data_source]);
+		break;
 	default:
 		return SR_ERR_NA;
 	}
@@ -249,6 +258,7 @@ static int config_set(uint32_t key, GVariant *data,
 	enum sr_mqflag mq_flags;
 	struct dev_context *devc;
 	GVariant *tuple_child;
+	int idx;
 
 	(void)cg;
 
@@ -267,6 +277,12 @@ static int config_set(uint32_t key, GVariant *data,
 		return hp_3457a_set_mq(sdi, mq, mq_flags);
 	case SR_CONF_ADC_POWERLINE_CYCLES:
 		return hp_3457a_set_nplc(sdi, g_variant_get_double(data));
+	case SR_CONF_DATA_SOURCE:
+		idx = std_str_idx(data, ARRAY_AND_SIZE(data_sources));
+		if (idx < 0)
+			return SR_ERR_ARG;
+		devc->data_source = idx;
+		break;
 	default:
 		return SR_ERR_NA;
 	}
@@ -282,7 +298,18 @@ static int config_list(uint32_t key, GVariant **data,
 	 * plug-in cards.
 	 */
 
-	return STD_CONFIG_LIST(key, data, sdi, cg, scanopts, drvopts, devopts);
+	switch (key) {
+	case SR_CONF_SCAN_OPTIONS:
+	case SR_CONF_DEVICE_OPTIONS:
+		return STD_CONFIG_LIST(key, data, sdi, cg, scanopts, drvopts, devopts);
+	case SR_CONF_DATA_SOURCE:
+		*data = g_variant_new_strv(ARRAY_AND_SIZE(data_sources));
+		break;
+	default:
+		return SR_ERR_NA;
+	}
+
+	return SR_OK;
 }
 
 static void create_channel_index_list(GSList *channels, GArray **arr)
@@ -312,6 +339,7 @@ static void create_channel_index_list(GSList *channels, GArray **arr)
  *   Activate the scan-advance feature. This automatically connects the next
  *   channel in the scan list to the A/D converter. This way, we do not need to
  *   occupy the HP-IB bus to send channel select commands.
+ * In burst mode, hp_3457a_burst_start() triggers blocks of readings instead.
  */
 static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 {
@@ -323,16 +351,11 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	struct channel_context *chanc;
 	GArray *ch_list;
 	GSList *channels;
+	gboolean burst;
 
 	scpi = sdi->conn;
 	devc = sdi->priv;
-
-	ret = sr_scpi_source_add(sdi->session, scpi, G_IO_IN, 100,
-				 hp_3457a_receive_data, (void *)sdi);
-	if (ret != SR_OK)
-		return ret;
-
-	std_session_send_df_header(sdi);
+	burst = devc->data_source == DATA_SOURCE_BURST;
 
 	front_selected = rear_selected = FALSE;
 	devc->active_channels = NULL;
@@ -377,10 +400,33 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		g_array_free(ch_list, TRUE);
 	}
 
-	/* Start first measurement. */
-	sr_scpi_send(scpi, "TRIG SGL");
-	devc->acq_state = ACQ_TRIGGERED_MEASUREMENT;
 	devc->num_samples = 0;
+	if (burst) {
+		ret = hp_3457a_burst_start(sdi);
+		if (ret != SR_OK) {
+			hp_3457a_burst_stop(sdi);
+			g_slist_free(devc->active_channels);
+			return ret;
+		}
+	}
+
+	ret = sr_scpi_source_add(sdi->session, scpi, G_IO_IN, burst ? 10 : 100,
+		burst ? hp_3457a_receive_burst : hp_3457a_receive_data,
+		(void *)sdi);
+	if (ret != SR_OK) {
+		if (burst)
+			hp_3457a_burst_stop(sdi);
+		g_slist_free(devc->active_channels);
+		return ret;
+	}
+
+	std_session_send_df_header(sdi);
+
+	/* Start first measurement. */
+	if (!burst) {
+		sr_scpi_send(scpi, "TRIG SGL");
+		devc->acq_state = ACQ_TRIGGERED_MEASUREMENT;
+	}
 
 	return SR_OK;
 }
@@ -391,6 +437,8 @@ static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 
 	devc = sdi->priv;
 
+	if (devc->data_source == DATA_SOURCE_BURST)
+		hp_3457a_burst_stop(sdi);
 	g_slist_free(devc->active_channels);
 
 	return SR_OK;
@@ -483,3 +483,205 @@ SR_PRIV int hp_3457a_receive_data(int fd, int revents, void *cb_data)
 
 	return TRUE;
 }
+
+/*
+ * Burst readings: instead of triggering and reading out every reading
+ * with a few ASCII queries, the instrument takes a block of readings
+ * per trigger and sends them as 64 bit IEEE floats:
+ *   OFORMAT DREAL
+ *     Packed binary output, 8 bytes per reading instead of 16 or more.
+ *   MEM FIFO, MFORMAT DREAL
+ *     Keep readings in the reading memory while the bus is busy (with
+ *     other instruments, or with the controller decoding the previous
+ *     block), and send them in the order they were taken.
+ *   NRDGS n,AUTO
+ *     Take n readings per trigger. The next block gets triggered right
+ *     after the previous one was received, before it gets decoded.
+ * The block size follows the NPLC setting, so that a block takes about
+ * 100 ms. With a scan list, readings alternate between the channels.
+ * There is no HIRES register per reading, so bursts need NPLC below 10.
+ */
+SR_PRIV int hp_3457a_burst_start(const struct sr_dev_inst *sdi)
+{
+	struct sr_scpi_dev_inst *scpi;
+	struct dev_context *devc;
+	unsigned int num;
+	int ret;
+
+	scpi = sdi->conn;
+	devc = sdi->priv;
+
+	if (is_highres_enabled(devc)) {
+		sr_err("Burst readings need NPLC below 10.");
+		return SR_ERR_ARG;
+	}
+
+	ret = sr_scpi_get_double(scpi, "RANGE?", &devc->measurement_range);
+	if (ret != SR_OK)
+		return ret;
+
+	num = 5.0 / MAX(devc->nplc, 1e-6);
+	num = CLAMP(num, 1, HP_3457A_BURST_READINGS);
+	num -= num % devc->num_active_channels;
+	devc->burst_readings = MAX(num, devc->num_active_channels);
+
+	g_free(devc->burst_buf);
+	g_free(devc->burst_values);
+	devc->burst_buf = g_malloc(devc->burst_readings * sizeof(double));
+	devc->burst_values = g_malloc(devc->burst_readings * sizeof(float));
+
+	sr_scpi_send(scpi, "OFORMAT DREAL");
+	sr_scpi_send(scpi, "MFORMAT DREAL");
+	sr_scpi_send(scpi, "MEM FIFO");
+	ret = sr_scpi_send(scpi, "NRDGS %u,AUTO", devc->burst_readings);
+	if (ret != SR_OK)
+		return ret;
+	ret = sr_scpi_send(scpi, "TRIG SGL");
+	devc->burst_pending = ret == SR_OK;
+
+	return ret;
+}
+
+/* Read a triggered block of readings into the burst buffer. */
+static int burst_read(struct sr_scpi_dev_inst *scpi, struct dev_context *devc)
+{
+	size_t len, pos;
+	int ret;
+
+	devc->burst_pending = FALSE;
+	len = devc->burst_readings * sizeof(double);
+	if (sr_scpi_read_begin(scpi) != SR_OK)
+		return SR_ERR;
+	for (pos = 0; pos < len; pos += ret) {
+		ret = sr_scpi_read_data(scpi, (char *)devc->burst_buf + pos,
+			len - pos);
+		if (ret < 0)
+			return SR_ERR;
+		if (ret == 0 && sr_scpi_read_complete(scpi))
+			break;
+	}
+	if (pos != len) {
+		sr_err("Short burst: %zu of %zu bytes.", pos, len);
+		return SR_ERR_DATA;
+	}
+
+	return SR_OK;
+}
+
+/* Return to the ASCII, one reading per trigger setup of dev_open(). */
+SR_PRIV void hp_3457a_burst_stop(const struct sr_dev_inst *sdi)
+{
+	struct sr_scpi_dev_inst *scpi;
+	struct dev_context *devc;
+
+	scpi = sdi->conn;
+	devc = sdi->priv;
+
+	/* Don't leave a block in the output buffer. */
+	if (devc->burst_pending)
+		burst_read(scpi, devc);
+
+	sr_scpi_send(scpi, "TRIG HOLD");
+	sr_scpi_send(scpi, "NRDGS 1,AUTO");
+	sr_scpi_send(scpi, "MEM OFF");
+	sr_scpi_send(scpi, "OFORMAT ASCII");
+
+	g_free(devc->burst_buf);
+	devc->burst_buf = NULL;
+	g_free(devc->burst_values);
+	devc->burst_values = NULL;
+}
+
+/* Send the block's readings of one channel, which are every n-th. */
+static void burst_send_channel(struct sr_dev_inst *sdi,
+	struct sr_channel *channel, size_t first, size_t step, size_t num)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	struct dev_context *devc;
+	double value, largest;
+	size_t i, count;
+
+	devc = sdi->priv;
+
+	largest = 0;
+	count = 0;
+	for (i = first; i < num; i += step) {
+		value = RBDB(devc->burst_buf + i * sizeof(double));
+		largest = MAX(largest, fabs(value));
+		devc->burst_values[count++] = value;
+	}
+	if (!count)
+		return;
+
+	packet.type = SR_DF_ANALOG;
+	packet.payload = &analog;
+	sr_analog_init(&analog, &encoding, &meaning, &spec,
+		7 - calculate_num_zero_digits(largest, devc->measurement_range));
+	encoding.unitsize = sizeof(float);
+	meaning.channels = g_slist_append(NULL, channel);
+	meaning.mq = devc->measurement_mq;
+	meaning.mqflags = devc->measurement_mq_flags;
+	meaning.unit = devc->measurement_unit;
+	analog.num_samples = count;
+	analog.data = devc->burst_values;
+
+	sr_session_send(sdi, &packet);
+
+	g_slist_free(meaning.channels);
+}
+
+SR_PRIV int hp_3457a_receive_burst(int fd, int revents, void *cb_data)
+{
+	struct sr_scpi_dev_inst *scpi;
+	struct dev_context *devc;
+	struct sr_dev_inst *sdi;
+	GSList *l;
+	size_t num, step, first;
+
+	(void)fd;
+	(void)revents;
+
+	if (!(sdi = cb_data))
+		return TRUE;
+
+	if (!(devc = sdi->priv))
+		return TRUE;
+
+	scpi = sdi->conn;
+
+	if (!devc->burst_pending)
+		return TRUE;
+	if (burst_read(scpi, devc) != SR_OK) {
+		sr_dev_acquisition_stop(sdi);
+		return FALSE;
+	}
+
+	num = devc->burst_readings;
+	if (devc->limit_samples)
+		num = MIN(num, devc->limit_samples - devc->num_samples);
+	devc->num_samples += num;
+
+	/* Have the instrument take the next block while this one decodes. */
+	if (!devc->limit_samples || devc->num_samples < devc->limit_samples)
+		devc->burst_pending = sr_scpi_send(scpi, "TRIG SGL") == SR_OK;
+
+	step = devc->num_active_channels;
+	first = 0;
+	for (l = devc->active_channels; l; l = l->next)
+		burst_send_channel(sdi, l->data, first++, step, num);
+
+	if (devc->limit_samples && (devc->num_samples >= devc->limit_samples)) {
+		sr_dev_acquisition_stop(sdi);
+		return FALSE;
+	}
+	if (!devc->burst_pending) {
+		sr_dev_acquisition_stop(sdi);
+		return FALSE;
+	}
+
+	return TRUE;
+}
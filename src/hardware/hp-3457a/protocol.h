@@ -51,6 +51,15 @@ enum acquisition_state {
 	ACQ_GOT_CHANNEL_SYNC,
 };
 
+/* Where readings come from, see hp_3457a_burst_start(). */
+enum data_source {
+	DATA_SOURCE_LIVE,
+	DATA_SOURCE_BURST,
+};
+
+/* Most readings per burst block, 8 bytes each in DREAL format. */
+#define HP_3457A_BURST_READINGS	256
+
 /* Channel connector (front terminals, or rear card. */
 enum channel_conn {
 	CONN_FRONT,
@@ -77,6 +86,12 @@ struct dev_context {
 	double hires_register;
 	double measurement_range;
 	double last_channel_sync;
+
+	enum data_source data_source;
+	unsigned int burst_readings;
+	gboolean burst_pending;
+	uint8_t *burst_buf;
+	float *burst_values;
 };
 
 struct channel_context {
@@ -86,6 +101,9 @@ struct channel_context {
 
 SR_PRIV const struct rear_card_info *hp_3457a_probe_rear_card(struct sr_scpi_dev_inst *scpi);
 SR_PRIV int hp_3457a_receive_data(int fd, int revents, void *cb_data);
+SR_PRIV int hp_3457a_burst_start(const struct sr_dev_inst *sdi);
+SR_PRIV void hp_3457a_burst_stop(const struct sr_dev_inst *sdi);
+SR_PRIV int hp_3457a_receive_burst(int fd, int revents, void *cb_data);
 SR_PRIV int hp_3457a_set_mq(const struct sr_dev_inst *sdi, enum sr_mq mq,
 			    enum sr_mqflag mq_flags);
 SR_PRIV int hp_3457a_set_nplc(const struct sr_dev_inst *sdi, float nplc);
@@ -343,8 +343,10 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	sr_scpi_send(scpi, "T1");
 	/* Get device status. */
 	hp_3478a_get_status_bytes(sdi);
+	devc->status_age = 0;
 
-	return sr_scpi_source_add(sdi->session, scpi, G_IO_IN, 100,
+	/* The data ready poll is a cheap serial poll, do it often. */
+	return sr_scpi_source_add(sdi->session, scpi, G_IO_IN, 10,
 			hp_3478a_receive_data, (void *)sdi);
 }
 
@@ -504,10 +504,15 @@ SR_PRIV int hp_3478a_receive_data(int fd, int revents, void *cb_data)
 	/*
 	 * This is necessary to get the actual range for the encoding digits.
 	 * Must be called after reading the value, because it resets the
-	 * status register!
+	 * status register! The range only changes between readings when
+	 * autoranging, otherwise an occasional check is enough.
 	 */
-	if (hp_3478a_get_status_bytes(sdi) != SR_OK)
-		return FALSE;
+	if ((devc->acquisition_mq_flags & SR_MQFLAG_AUTORANGE) ||
+			++devc->status_age >= HP_3478A_STATUS_INTERVAL) {
+		if (hp_3478a_get_status_bytes(sdi) != SR_OK)
+			return FALSE;
+		devc->status_age = 0;
+	}
 
 	acq_send_measurement(sdi);
 	sr_sw_limits_update_samples_read(&devc->limits, 1);
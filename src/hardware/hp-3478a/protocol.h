@@ -127,6 +127,12 @@ enum trigger_state {
 	TRIGGER_INTERNAL,
 };
 
+/*
+ * Without autoranging, the status bytes only change from the front panel.
+ * Check them every that many readings then, instead of after every one.
+ */
+#define HP_3478A_STATUS_INTERVAL	64
+
 /* Possible line frequencies */
 enum line_freq {
 	LINE_50HZ,
@@ -152,6 +158,9 @@ struct dev_context {
 	enum line_freq line;
 	gboolean auto_zero;
 	gboolean calibration;
+
+	/** Readings since the status bytes were last read. */
+	unsigned int status_age;
 };
 
 struct channel_context {
@@ -161,16 +161,17 @@ SR_PRIV int ipdbg_la_tcp_close(struct ipdbg_la_tcp *tcp)
 static int tcp_send(struct ipdbg_la_tcp *tcp, const uint8_t *buf, size_t len)
 {
 	int out;
-	out = send(tcp->socket, (const char *)buf, len, 0);
 
-	if (out < 0) {
-		sr_err("Send error: %s", g_strerror(errno));
-		return SR_ERR;
+	while (len > 0) {
+		out = send(tcp->socket, (const char *)buf, len, 0);
+		if (out < 0) {
+			sr_err("Send error: %s", g_strerror(errno));
+			return SR_ERR;
+		}
+		buf += out;
+		len -= out;
 	}
 
-	if (out < (int)len)
-		sr_dbg("Only sent %d/%d bytes of data.", out, (int)len);
-
 	return SR_OK;
 }
 
@@ -309,23 +310,29 @@ SR_PRIV int ipdbg_la_receive_data(int fd, int revents, void *cb_data)
 
 	if (devc->num_transfers <
 		(devc->limit_samples_max * devc->data_width_bytes)) {
-		const size_t bufsize = 1024;
-		uint8_t buffer[bufsize];
+		const uint64_t wanted = devc->limit_samples * devc->data_width_bytes;
+		uint8_t discard[16 * 1024];
+		uint8_t *buffer;
+		size_t bufsize;
+
+		/*
+		 * Receive straight into the sample buffer, with as much as
+		 * the socket has. The device sends all of its sample memory,
+		 * samples beyond the limit get dropped.
+		 */
+		if (devc->num_transfers < wanted) {
+			buffer = &(devc->raw_sample_buf[devc->num_transfers]);
+			bufsize = wanted - devc->num_transfers;
+		} else {
+			buffer = discard;
+			bufsize = MIN(sizeof(discard),
+				devc->limit_samples_max * devc->data_width_bytes -
+				devc->num_transfers);
+		}
 
 		const int recd = ipdbg_la_tcp_receive(tcp, buffer, bufsize);
-		if ( recd > 0) {
-			int num_move = (((devc->num_transfers + recd) <=
-							 (devc->limit_samples * devc->data_width_bytes))
-			?
-				recd
-			:
-				(int)((devc->limit_samples * devc->data_width_bytes) -
-						devc->num_transfers));
-			if ( num_move > 0 )
-				memcpy(&(devc->raw_sample_buf[devc->num_transfers]),
-						buffer, num_move);
+		if (recd > 0)
 			devc->num_transfers += recd;
-		}
 	} else {
 		if (devc->delay_value > 0) {
 			/* There are pre-trigger samples, send those first. */
@@ -359,27 +366,33 @@ SR_PRIV int ipdbg_la_receive_data(int fd, int revents, void *cb_data)
 	return TRUE;
 }
 
-static int send_escaping(struct ipdbg_la_tcp *tcp, uint8_t *data_to_send,
+/*
+ * Append data to a command, escaping the bytes which have a special
+ * meaning to the IPDBG hub. Commands get sent with a single write.
+ */
+static void append_escaping(GByteArray *cmd, const uint8_t *data_to_send,
 	uint32_t length)
 {
-	uint8_t escape = CMD_ESCAPE;
+	const uint8_t escape = CMD_ESCAPE;
 
 	while (length--) {
 		uint8_t payload = *data_to_send++;
 
-		if (payload == CMD_RESET)
-			if (tcp_send(tcp, &escape, 1) != SR_OK)
-				sr_warn("Couldn't send escape");
-
-		if (payload == CMD_ESCAPE)
-			if (tcp_send(tcp, &escape, 1) != SR_OK)
-				sr_warn("Couldn't send escape");
+		if (payload == CMD_RESET || payload == CMD_ESCAPE)
+			g_byte_array_append(cmd, &escape, 1);
 
-		if (tcp_send(tcp, &payload, 1) != SR_OK)
-			sr_warn("Couldn't send data");
+		g_byte_array_append(cmd, &payload, 1);
 	}
+}
 
-	return SR_OK;
+static int send_cmd(struct ipdbg_la_tcp *tcp, GByteArray *cmd)
+{
+	int ret;
+
+	ret = tcp_send(tcp, cmd->data, cmd->len);
+	g_byte_array_free(cmd, TRUE);
+
+	return ret;
 }
 
 SR_PRIV int ipdbg_la_send_delay(struct dev_context *devc,
@@ -387,11 +400,9 @@ SR_PRIV int ipdbg_la_send_delay(struct dev_context *devc,
 {
 	devc->delay_value = ((devc->limit_samples - 1) / 100.0) * devc->capture_ratio;
 
-	uint8_t buf;
-	buf = CMD_CFG_LA;
-	tcp_send(tcp, &buf, 1);
-	buf = CMD_LA_DELAY;
-	tcp_send(tcp, &buf, 1);
+	const uint8_t header[] = { CMD_CFG_LA, CMD_LA_DELAY };
+	GByteArray *cmd = g_byte_array_new();
+	g_byte_array_append(cmd, header, sizeof(header));
 
 	uint8_t delay_buf[4] = { devc->delay_value & 0x000000ff,
 		(devc->delay_value >> 8) & 0x000000ff,
@@ -400,77 +411,40 @@ SR_PRIV int ipdbg_la_send_delay(struct dev_context *devc,
 	};
 
 	for (uint64_t i = 0; i < devc->addr_width_bytes; i++)
-		send_escaping(tcp, &(delay_buf[devc->addr_width_bytes - 1 - i]), 1);
+		append_escaping(cmd, &(delay_buf[devc->addr_width_bytes - 1 - i]), 1);
 
-	return SR_OK;
+	return send_cmd(tcp, cmd);
+}
+
+static void append_trigger(GByteArray *cmd, uint8_t select, uint8_t set,
+	const uint8_t *data, uint32_t width_bytes)
+{
+	const uint8_t header[] = { CMD_CFG_TRIGGER, select, set };
+
+	g_byte_array_append(cmd, header, sizeof(header));
+
+	/* The most significant byte goes first. */
+	for (size_t i = 0; i < width_bytes; i++)
+		append_escaping(cmd, data + width_bytes - 1 - i, 1);
 }
 
 SR_PRIV int ipdbg_la_send_trigger(struct dev_context *devc,
 	struct ipdbg_la_tcp *tcp)
 {
-	uint8_t buf;
-
-	/* Mask */
-	buf = CMD_CFG_TRIGGER;
-	tcp_send(tcp, &buf, 1);
-	buf = CMD_TRIG_MASKS;
-	tcp_send(tcp, &buf, 1);
-	buf = CMD_TRIG_MASK;
-	tcp_send(tcp, &buf, 1);
-
-	for (size_t i = 0; i < devc->data_width_bytes; i++)
-		send_escaping(tcp,
-			devc->trigger_mask + devc->data_width_bytes - 1 - i, 1);
-
-	/* Value */
-	buf = CMD_CFG_TRIGGER;
-	tcp_send(tcp, &buf, 1);
-	buf = CMD_TRIG_MASKS;
-	tcp_send(tcp, &buf, 1);
-	buf = CMD_TRIG_VALUE;
-	tcp_send(tcp, &buf, 1);
-
-	for (size_t i = 0; i < devc->data_width_bytes; i++)
-		send_escaping(tcp,
-			devc->trigger_value + devc->data_width_bytes - 1 - i, 1);
-
-	/* Mask_last */
-	buf = CMD_CFG_TRIGGER;
-	tcp_send(tcp, &buf, 1);
-	buf = CMD_TRIG_MASKS_LAST;
-	tcp_send(tcp, &buf, 1);
-	buf = CMD_TRIG_MASK_LAST;
-	tcp_send(tcp, &buf, 1);
-
-	for (size_t i = 0; i < devc->data_width_bytes; i++)
-		send_escaping(tcp,
-			devc->trigger_mask_last + devc->data_width_bytes - 1 - i, 1);
-
-	/* Value_last */
-	buf = CMD_CFG_TRIGGER;
-	tcp_send(tcp, &buf, 1);
-	buf = CMD_TRIG_MASKS_LAST;
-	tcp_send(tcp, &buf, 1);
-	buf = CMD_TRIG_VALUE_LAST;
-	tcp_send(tcp, &buf, 1);
-
-	for (size_t i = 0; i < devc->data_width_bytes; i++)
-		send_escaping(tcp,
-			devc->trigger_value_last + devc->data_width_bytes - 1 - i, 1);
-
-	/* Edge_mask */
-	buf = CMD_CFG_TRIGGER;
-	tcp_send(tcp, &buf, 1);
-	buf = CMD_TRIG_SELECT_EDGE_MASK;
-	tcp_send(tcp, &buf, 1);
-	buf = CMD_TRIG_SET_EDGE_MASK;
-	tcp_send(tcp, &buf, 1);
-
-	for (size_t i = 0; i < devc->data_width_bytes; i++)
-		send_escaping(tcp,
-			devc->trigger_edge_mask + devc->data_width_bytes - 1 - i, 1);
-
-	return SR_OK;
+	GByteArray *cmd = g_byte_array_new();
+
+	append_trigger(cmd, CMD_TRIG_MASKS, CMD_TRIG_MASK,
+		devc->trigger_mask, devc->data_width_bytes);
+	append_trigger(cmd, CMD_TRIG_MASKS, CMD_TRIG_VALUE,
+		devc->trigger_value, devc->data_width_bytes);
+	append_trigger(cmd, CMD_TRIG_MASKS_LAST, CMD_TRIG_MASK_LAST,
+		devc->trigger_mask_last, devc->data_width_bytes);
+	append_trigger(cmd, CMD_TRIG_MASKS_LAST, CMD_TRIG_VALUE_LAST,
+		devc->trigger_value_last, devc->data_width_bytes);
+	append_trigger(cmd, CMD_TRIG_SELECT_EDGE_MASK, CMD_TRIG_SET_EDGE_MASK,
+		devc->trigger_edge_mask, devc->data_width_bytes);
+
+	return send_cmd(tcp, cmd);
 }
 
 SR_PRIV void ipdbg_la_get_addrwidth_and_datawidth(
@@ -57,6 +57,7 @@ static const int32_t trigger_matches[] = {
 	SR_TRIGGER_ONE,
 	SR_TRIGGER_RISING,
 	SR_TRIGGER_FALLING,
+	SR_TRIGGER_EDGE,
 };
 
 static const char *channel_names[] = {
@@ -139,13 +140,13 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 		}
 	}
 	if (conn)
-		conn_devices = sr_usb_find(drvc->sr_ctx->libusb_ctx, conn);
+		conn_devices = sr_usb_find(drvc->sr_ctx, conn);
 	else
 		conn_devices = NULL;
 
 	/* Find all LA2016 devices and upload firmware to them. */
 	devices = NULL;
-	libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	sr_usb_get_device_list(drvc->sr_ctx, &devlist);
 	for (i = 0; devlist[i]; i++) {
 		if (conn) {
 			usb = NULL;
@@ -507,133 +508,307 @@ static int config_list(uint32_t key, GVariant **data, const struct sr_dev_inst *
 	return SR_OK;
 }
 
-static void send_chunk(struct sr_dev_inst *sdi, transfer_packet_t *packets, unsigned int num_tfers)
+static void abort_acquisition(struct dev_context *devc)
 {
-	struct dev_context *devc;
-	struct sr_datafeed_logic logic;
-	struct sr_datafeed_packet sr_packet;
-	transfer_packet_t *packet;
+	unsigned int i;
+
+	for (i = 0; i < LA2016_NUM_TRANSFERS; i++)
+		if (devc->transfers[i])
+			libusb_cancel_transfer(devc->transfers[i]);
+}
+
+static void job_free(void *data)
+{
+	struct la2016_job *job;
+
+	job = data;
+	if (job->raw)
+		g_bytes_unref(job->raw);
+	g_free(job->values);
+	g_free(job->counts);
+	g_free(job);
+}
+
+/*
+ * Decode one slice of repetition packets on the worker pool, either
+ * into samples or into runs. Slices don't depend on each other, the
+ * trigger position was determined when the slice got queued.
+ */
+static void decode_job(gpointer data, gpointer user_data)
+{
+	struct la2016_job *job;
 	acq_packet_t *p;
-	unsigned int max_samples, n_samples, total_samples, free_n_samples, ptotal;
-	unsigned int i, j, k;
-	int do_signal_trigger;
+	uint64_t n, total;
+	unsigned int i, j, k, idx;
 	uint16_t *wp;
 
-	devc = sdi->priv;
+	job = data;
+	(void)user_data;
+
+	job->trigger_pos = -1;
+	for (i = 0; i < job->num_packets; i++)
+		transfer_packet_host(job->packets[i]);
+
+	if (job->rle) {
+		job->values = g_malloc(job->num_packets * 5 * sizeof(uint16_t));
+		job->counts = g_malloc(job->num_packets * 5 * sizeof(uint64_t));
+	} else {
+		total = 0;
+		for (i = 0; i < job->num_packets; i++)
+			for (k = 0; k < ARRAY_SIZE(job->packets[i].packet); k++)
+				total += job->packets[i].packet[k].repetitions;
+		job->values = g_malloc(total * sizeof(uint16_t));
+	}
 
-	logic.unitsize = 2;
-	logic.data = devc->convbuffer;
+	n = 0;
+	idx = 0;
+	wp = job->values;
+	for (i = 0; i < job->num_packets; i++) {
+		for (k = 0; k < ARRAY_SIZE(job->packets[i].packet); k++, idx++) {
+			if (idx && idx == job->trigger_at)
+				job->trigger_pos = n;
+			p = &job->packets[i].packet[k];
+			if (!p->repetitions)
+				continue;
+			if (job->rle) {
+				job->values[n] = p->state;
+				job->counts[n++] = p->repetitions;
+			} else {
+				for (j = 0; j < p->repetitions; j++)
+					*(wp++) = p->state;
+				n += p->repetitions;
+			}
+		}
+	}
+	if (idx == job->trigger_at)
+		job->trigger_pos = n;
+	job->length = n;
 
-	sr_packet.type = SR_DF_LOGIC;
-	sr_packet.payload = &logic;
+	g_bytes_unref(job->raw);
+	job->raw = NULL;
+	g_atomic_int_set(&job->done, 1);
+}
 
-	max_samples = devc->convbuffer_size / 2;
-	n_samples = 0;
-	wp = (uint16_t*)devc->convbuffer;
-	total_samples = 0;
-	do_signal_trigger = 0;
+/* Split a received transfer into slices, and queue them for decoding. */
+static void queue_jobs(struct dev_context *devc, uint8_t *buffer, int length)
+{
+	struct la2016_job *job;
+	GBytes *raw;
+	unsigned int i, num_tfers;
+	uint64_t reps;
+
+	/* Slices decode in place, the buffer is writable. */
+	raw = sr_mem_bytes_new(devc->ctx, buffer, length);
+	num_tfers = length / sizeof(transfer_packet_t);
+
+	for (i = 0; i < num_tfers; i += LA2016_DECODE_SLICE) {
+		job = g_malloc0(sizeof(*job));
+		job->raw = g_bytes_ref(raw);
+		job->packets = (transfer_packet_t *)buffer + i;
+		job->num_packets = MIN(LA2016_DECODE_SLICE, num_tfers - i);
+		job->rle = devc->logic_rle;
+
+		reps = job->num_packets * ARRAY_SIZE(job->packets->packet);
+		if (devc->trigger_rep > devc->n_reps_queued &&
+				devc->trigger_rep <= devc->n_reps_queued + reps)
+			job->trigger_at = devc->trigger_rep - devc->n_reps_queued;
+		devc->n_reps_queued += reps;
+
+		g_queue_push_tail(&devc->decode_jobs, job);
+		g_thread_pool_push(devc->decode_pool, job, NULL);
+	}
 
-	if (devc->had_triggers_configured && devc->reading_behind_trigger == 0 && devc->info.n_rep_packets_before_trigger == 0) {
-		sr_packet.type = SR_DF_TRIGGER;
-		sr_packet.payload = NULL;
-		sr_session_send(sdi, &sr_packet);
-		devc->reading_behind_trigger = 1;
+	g_bytes_unref(raw);
+}
 
-		do_signal_trigger = 0;
+static void send_values(const struct sr_dev_inst *sdi, struct la2016_job *job,
+		uint64_t start, uint64_t end, gboolean release, int64_t trigger_pos)
+{
+	struct sr_datafeed_packet sr_packet;
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_logic_rle rle;
+
+	if (job->rle) {
+		rle.num_runs = end - start;
+		rle.unitsize = 2;
+		rle.values = job->values + start;
+		rle.counts = job->counts + start;
+		sr_packet.type = SR_DF_LOGIC_RLE;
+		sr_packet.payload = &rle;
+	} else {
+		logic.unitsize = 2;
+		logic.length = (end - start) * 2;
+		logic.data = job->values + start;
 		sr_packet.type = SR_DF_LOGIC;
 		sr_packet.payload = &logic;
 	}
 
-	for (i = 0; i < num_tfers; i++) {
-		transfer_packet_host(packets[i]);
-		packet = packets + i;
-		ptotal = 0;
-		for (k = 0; k < ARRAY_SIZE(packet->packet); k++) {
-			free_n_samples = max_samples - n_samples;
-			if (free_n_samples < 256 || do_signal_trigger) {
-				logic.length = n_samples * 2;
-				sr_session_send(sdi, &sr_packet);
-				n_samples = 0;
-				wp = (uint16_t*)devc->convbuffer;
-				if (do_signal_trigger) {
-					sr_packet.type = SR_DF_TRIGGER;
-					sr_packet.payload = NULL;
-					sr_session_send(sdi, &sr_packet);
-					
-					do_signal_trigger = 0;
-					sr_packet.type = SR_DF_LOGIC;
-					sr_packet.payload = &logic;
-				}
-			}
-			p = packet->packet + k;
-			for (j = 0; j < p->repetitions; j++)
-				*(wp++) = p->state;
-			n_samples += p->repetitions;
-			total_samples += p->repetitions;
-			ptotal += p->repetitions;
-			devc->total_samples += p->repetitions;
-			if (!devc->reading_behind_trigger) {
-				devc->n_reps_until_trigger --;
-				if (devc->n_reps_until_trigger == 0) {
-					devc->reading_behind_trigger = 1;
-					do_signal_trigger = 1;
-					sr_dbg("  here is trigger position after %" PRIu64 " samples, %.6fms",
-					       devc->total_samples,
-					       (double)devc->total_samples / devc->cur_samplerate * 1e3);
-				}
-			}
-		}
-	}
-	if (n_samples) {
-		logic.length = n_samples * 2;
+	/* The samples before a trigger are sent from the same buffer. */
+	if (trigger_pos >= 0)
+		sr_session_send_triggered(sdi, &sr_packet, trigger_pos - start,
+			release ? job_free : NULL, job);
+	else if (release)
+		sr_session_send_zerocopy(sdi, &sr_packet, job_free, job);
+	else
 		sr_session_send(sdi, &sr_packet);
-		if (do_signal_trigger) {
-			sr_packet.type = SR_DF_TRIGGER;
-			sr_packet.payload = NULL;
-			sr_session_send(sdi, &sr_packet);
-		}
+}
+
+/*
+ * Find the trigger position where the stages the hardware did not take
+ * matched, from the sample where the hardware fired on.
+ */
+static int64_t soft_trigger_pos(struct dev_context *devc,
+		struct la2016_job *job)
+{
+	uint64_t start;
+	int offset;
+
+	start = 0;
+	if (devc->soft_state == SOFT_TRIGGER_WAIT_HW) {
+		if (job->trigger_pos < 0)
+			return -1;
+		start = job->trigger_pos;
+		devc->soft_state = SOFT_TRIGGER_HW_FIRED;
 	}
-	sr_dbg("send_chunk done after %d samples", total_samples);
+	if (devc->soft_state == SOFT_TRIGGER_HW_FIRED && start < job->length) {
+		soft_trigger_logic_hw_fired(devc->stl,
+			(const uint8_t *)(job->values + start), devc->hw_stages);
+		devc->soft_state = SOFT_TRIGGER_SCAN;
+		start++;
+	}
+	if (devc->soft_state != SOFT_TRIGGER_SCAN || start >= job->length)
+		return -1;
+
+	offset = soft_trigger_logic_scan(devc->stl,
+		(const uint8_t *)(job->values + start),
+		(job->length - start) * 2);
+	if (offset < 0)
+		return -1;
+	devc->soft_state = SOFT_TRIGGER_DONE;
+
+	return start + offset / 2;
+}
+
+static void send_job(const struct sr_dev_inst *sdi, struct la2016_job *job)
+{
+	struct dev_context *devc;
+	uint64_t split, length;
+	int64_t trigger_pos;
+
+	devc = sdi->priv;
+
+	trigger_pos = job->trigger_pos;
+	if (devc->stl)
+		trigger_pos = soft_trigger_pos(devc, job);
+	length = job->length;
+
+	/* Samples carry the trigger, runs get sent around it. */
+	if (trigger_pos >= 0 && !job->rle) {
+		sr_dbg("  here is trigger position");
+		send_values(sdi, job, 0, length, TRUE, trigger_pos);
+		return;
+	}
+
+	split = trigger_pos >= 0 ? (uint64_t)trigger_pos : length;
+
+	if (split)
+		send_values(sdi, job, 0, split, split == length, -1);
+	else if (split == length)
+		job_free(job);
+
+	if (trigger_pos >= 0) {
+		sr_dbg("  here is trigger position");
+		std_session_send_df_trigger(sdi);
+	}
+
+	if (split < length)
+		send_values(sdi, job, split, length, TRUE, -1);
+}
+
+static void transfer_done(struct dev_context *devc, struct libusb_transfer *transfer)
+{
+	unsigned int i;
+
+	for (i = 0; i < LA2016_NUM_TRANSFERS; i++)
+		if (devc->transfers[i] == transfer)
+			devc->transfers[i] = NULL;
+	sr_mem_free(devc->ctx, transfer->buffer);
+	libusb_free_transfer(transfer);
+	devc->num_transfers_active--;
 }
 
 static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 {
 	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
-	struct sr_usb_dev_inst *usb;
-	int ret;
 
 	sdi = transfer->user_data;
 	devc = sdi->priv;
-	usb = sdi->conn;
+
+	sr_usb_transfer_account(sdi, transfer);
 
 	sr_dbg("receive_transfer(): status %s received %d bytes.",
 	       libusb_error_name(transfer->status), transfer->actual_length);
 
-	if (transfer->status == LIBUSB_TRANSFER_TIMED_OUT) {
+	if (transfer->status == LIBUSB_TRANSFER_TIMED_OUT)
 		sr_err("bulk transfer timeout!");
-		devc->transfer_finished = 1;
-	}
-	send_chunk(sdi, (transfer_packet_t*)transfer->buffer, transfer->actual_length / sizeof(transfer_packet_t));
-
-	devc->n_bytes_to_read -= transfer->actual_length;
-	if (devc->n_bytes_to_read) {
-		uint32_t to_read = devc->n_bytes_to_read;
-		if (to_read > LA2016_BULK_MAX)
-			to_read = LA2016_BULK_MAX;
-		libusb_fill_bulk_transfer(
-			transfer, usb->devhdl,
-			0x86, transfer->buffer, to_read,
-			receive_transfer, (void*)sdi, DEFAULT_TIMEOUT_MS);
-
-		if ((ret = libusb_submit_transfer(transfer)) == 0)
-			return;
-		sr_err("Failed to submit further transfer: %s.", libusb_error_name(ret));
+	if (transfer->status != LIBUSB_TRANSFER_COMPLETED)
+		devc->n_bytes_to_submit = 0;
+
+	if (transfer->actual_length > 0)
+		queue_jobs(devc, transfer->buffer, transfer->actual_length);
+	else
+		sr_mem_free(devc->ctx, transfer->buffer);
+	transfer->buffer = NULL;
+
+	devc->n_bytes_to_read -= MIN(devc->n_bytes_to_read,
+		(unsigned int)transfer->actual_length);
+	if (devc->n_bytes_to_submit &&
+			la2016_submit_transfer(sdi, transfer, receive_transfer) == SR_OK)
+		return;
+
+	transfer_done(devc, transfer);
+}
+
+static int start_decoding(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	GError *error;
+
+	devc = sdi->priv;
+
+	error = NULL;
+	devc->decode_pool = g_thread_pool_new(decode_job, NULL,
+		g_get_num_processors(), FALSE, &error);
+	if (!devc->decode_pool) {
+		sr_err("Cannot create decoder threads: %s.", error->message);
+		g_error_free(error);
+		return SR_ERR;
 	}
+	g_queue_init(&devc->decode_jobs);
+	devc->n_reps_queued = 0;
+	devc->trigger_rep = 0;
+	/* The soft trigger checks samples, not runs. */
+	devc->logic_rle = !devc->stl &&
+		sr_session_takes_logic_rle(sdi->session);
+	devc->soft_state = devc->hw_stages > 0 ?
+		SOFT_TRIGGER_WAIT_HW : SOFT_TRIGGER_SCAN;
 
-	g_free(transfer->buffer);
-	libusb_free_transfer(transfer);
-	devc->transfer_finished = 1;
+	return SR_OK;
+}
+
+static void stop_decoding(struct dev_context *devc)
+{
+	struct la2016_job *job;
+
+	g_thread_pool_free(devc->decode_pool, FALSE, TRUE);
+	devc->decode_pool = NULL;
+
+	while ((job = g_queue_pop_head(&devc->decode_jobs)))
+		job_free(job);
+
+	soft_trigger_logic_free(devc->stl);
+	devc->stl = NULL;
 }
 
 static int handle_event(int fd, int revents, void *cb_data)
@@ -642,6 +817,7 @@ static int handle_event(int fd, int revents, void *cb_data)
 	struct dev_context *devc;
 	struct drv_context *drvc;
 	struct sr_datafeed_packet packet;
+	struct la2016_job *job;
 	struct timeval tv;
 
 	(void)fd;
@@ -658,23 +834,42 @@ static int handle_event(int fd, int revents, void *cb_data)
 		}
 		devc->have_trigger = 1;
 		devc->transfer_finished = 0;
-		devc->reading_behind_trigger = 0;
-		devc->total_samples = 0;
+		if (start_decoding(sdi) != SR_OK)
+			return FALSE;
 		/* we can start retrieving data! */
 		if (la2016_start_retrieval(sdi, receive_transfer) != SR_OK) {
 			sr_err("failed to start retrieval!");
+			stop_decoding(devc);
 			return FALSE;
 		}
 		sr_dbg("retrieval is started...");
 		packet.type = SR_DF_FRAME_BEGIN;
 		sr_session_send(sdi, &packet);
 
+		/* The trigger can be right at the start of the data. */
+		devc->trigger_rep = devc->info.n_rep_packets_before_trigger;
+		if (devc->had_triggers_configured && devc->trigger_rep == 0) {
+			if (devc->stl)
+				devc->soft_state = SOFT_TRIGGER_HW_FIRED;
+			else
+				std_session_send_df_trigger(sdi);
+		}
+
 		return TRUE;
 	}
 
 	tv.tv_sec = tv.tv_usec = 0;
 	libusb_handle_events_timeout(drvc->sr_ctx->libusb_ctx, &tv);
 
+	/* Send the decoded slices in order. */
+	while ((job = g_queue_peek_head(&devc->decode_jobs)) &&
+			g_atomic_int_get(&job->done)) {
+		g_queue_pop_head(&devc->decode_jobs);
+		send_job(sdi, job);
+	}
+	if (!devc->num_transfers_active && g_queue_is_empty(&devc->decode_jobs))
+		devc->transfer_finished = 1;
+
 	if (devc->transfer_finished) {
 		sr_dbg("transfer is finished!");
 		packet.type = SR_DF_FRAME_END;
@@ -685,8 +880,7 @@ static int handle_event(int fd, int revents, void *cb_data)
 
 		la2016_stop_acquisition(sdi);
 
-		g_free(devc->convbuffer);
-		devc->convbuffer = NULL;
+		stop_decoding(devc);
 
 		sr_dbg("transfer is now finished");
 	}
@@ -694,12 +888,6 @@ static int handle_event(int fd, int revents, void *cb_data)
 	return TRUE;
 }
 
-static void abort_acquisition(struct dev_context *devc)
-{
-	if (devc->transfer)
-		libusb_cancel_transfer(devc->transfer);
-}
-
 static int configure_channels(const struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
@@ -735,19 +923,11 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		return SR_ERR;
 	}
 
-	devc->convbuffer_size = 4 * 1024 * 1024;
-	if (!(devc->convbuffer = g_try_malloc(devc->convbuffer_size))) {
-		sr_err("Conversion buffer malloc failed.");
-		return SR_ERR_MALLOC;
-	}
-
-	if ((ret = la2016_setup_acquisition(sdi)) != SR_OK) {
-		g_free(devc->convbuffer);
-		devc->convbuffer = NULL;
+	if ((ret = la2016_setup_acquisition(sdi)) != SR_OK)
 		return ret;
-	}
 
 	devc->ctx = drvc->sr_ctx;
+	devc->numa_node = sr_usb_numa_node(sdi->conn);
 
 	if ((ret = la2016_start_acquisition(sdi)) != SR_OK) {
 		abort_acquisition(devc);
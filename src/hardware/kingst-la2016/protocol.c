@@ -95,76 +95,37 @@ static int ctrl_out(const struct sr_dev_inst *sdi,
 	return SR_OK;
 }
 
-static int upload_fpga_bitstream(const struct sr_dev_inst *sdi)
+static int fpga_is_configured(const struct sr_dev_inst *sdi,
+		gboolean *configured)
 {
-	struct dev_context *devc;
-	struct drv_context *drvc;
-	struct sr_usb_dev_inst *usb;
-	struct sr_resource bitstream;
-	uint32_t cmd;
-	uint8_t cmd_resp;
-	uint8_t block[4096];
-	int len, act_len;
-	unsigned int pos;
+	uint16_t state;
 	int ret;
-	unsigned int zero_pad_to = 0x2c000;
 
-	devc = sdi->priv;
-	drvc = sdi->driver->context;
-	usb = sdi->conn;
+	if ((ret = ctrl_in(sdi, 32, CTRL_RUN, 0, &state, sizeof(state))) != SR_OK)
+		return ret;
+	*configured = state != 0xffff;
 
-	sr_info("Uploading FPGA bitstream '%s'.", FPGA_FIRMWARE);
+	return SR_OK;
+}
 
-	ret = sr_resource_open(drvc->sr_ctx, &bitstream, SR_RESOURCE_FIRMWARE, FPGA_FIRMWARE);
-	if (ret != SR_OK) {
-		sr_err("could not find la2016 firmware %s!", FPGA_FIRMWARE);
-		return ret;
-	}
+static int fpga_upload_begin(const struct sr_dev_inst *sdi, size_t size)
+{
+	uint32_t cmd;
+	int ret;
 
-	devc->bitstream_size = (uint32_t)bitstream.size;
-	WL32(&cmd, devc->bitstream_size);
+	WL32(&cmd, size);
 	if ((ret = ctrl_out(sdi, 80, 0x00, 0, &cmd, sizeof(cmd))) != SR_OK) {
 		sr_err("failed to give upload init command");
-		sr_resource_close(drvc->sr_ctx, &bitstream);
 		return ret;
 	}
 
-	pos = 0;
-	while (1) {
-		if (pos < bitstream.size) {
-			len = (int)sr_resource_read(drvc->sr_ctx, &bitstream, &block, sizeof(block));
-			if (len < 0) {
-				sr_err("failed to read from fpga bitstream!");
-				sr_resource_close(drvc->sr_ctx, &bitstream);
-				return SR_ERR;
-			}
-		} else {
-			// fill with zero's until zero_pad_to
-			len = zero_pad_to - pos;
-			if ((unsigned)len > sizeof(block))
-				len = sizeof(block);
-			memset(&block, 0, len);
-		}
-		if (len == 0)
-			break;
-
-		ret = libusb_bulk_transfer(usb->devhdl, 2, (unsigned char*)&block[0], len, &act_len, DEFAULT_TIMEOUT_MS);
-		if (ret != 0) {
-			sr_dbg("failed to write fpga bitstream block at %#x len %d: %s.", pos, (int)len, libusb_error_name(ret));
-			ret = SR_ERR;
-			break;
-		}
-		if (act_len != len) {
-			sr_dbg("failed to write fpga bitstream block at %#x len %d: act_len is %d.", pos, (int)len, act_len);
-			ret = SR_ERR;
-			break;
-		}
-		pos += len;
-	}
-	sr_resource_close(drvc->sr_ctx, &bitstream);
-	if (ret != 0)
-		return ret;
-	sr_info("FPGA bitstream upload (%" PRIu64 " bytes) done.", bitstream.size);
+	return SR_OK;
+}
+
+static int fpga_upload_end(const struct sr_dev_inst *sdi)
+{
+	uint8_t cmd_resp;
+	int ret;
 
 	if ((ret = ctrl_in(sdi, 80, 0x00, 0, &cmd_resp, sizeof(cmd_resp))) != SR_OK) {
 		sr_err("failed to read response after FPGA bitstream upload");
@@ -176,6 +137,33 @@ static int upload_fpga_bitstream(const struct sr_dev_inst *sdi)
 	}
 
 	g_usleep(30000);
+	return SR_OK;
+}
+
+static const struct sr_usb_fpga_loader fpga_loader = {
+	.endpoint = 2,
+	.pad_to = 0x2c000,
+	.timeout = 1000, /* ms, per transfer of up to 64 KiB */
+	.is_configured = fpga_is_configured,
+	.begin = fpga_upload_begin,
+	.end = fpga_upload_end,
+};
+
+static int upload_fpga_bitstream(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	size_t size;
+	int ret;
+
+	devc = sdi->priv;
+
+	ret = sr_usb_fpga_configure(sdi, &fpga_loader, FPGA_FIRMWARE,
+		fpga_loader.pad_to, &size);
+	if (ret != SR_OK) {
+		sr_err("could not upload la2016 firmware %s!", FPGA_FIRMWARE);
+		return ret;
+	}
+	devc->bitstream_size = (uint32_t)size;
 
 	if ((ret = ctrl_out(sdi, 16, 0x01, 0, NULL, 0)) != SR_OK) {
 		sr_err("failed enable fpga");
@@ -310,12 +298,21 @@ static int set_defaults(const struct sr_dev_inst *sdi)
 	return SR_OK;
 }
 
+/* One stage, with at most one edge. Further stages get checked in software. */
+static const struct soft_trigger_hw_caps la2016_trigger_caps = {
+	.max_stages = 1,
+	.matches = SOFT_TRIGGER_MATCH(SR_TRIGGER_ZERO) |
+		SOFT_TRIGGER_MATCH(SR_TRIGGER_ONE) |
+		SOFT_TRIGGER_MATCH(SR_TRIGGER_RISING) |
+		SOFT_TRIGGER_MATCH(SR_TRIGGER_FALLING),
+	.max_edges = 1,
+};
+
 static int set_trigger_config(const struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
 	struct sr_trigger *trigger;
 	trigger_cfg_t cfg;
-	GSList *stages;
 	GSList *channel;
 	struct sr_trigger_stage *stage1;
 	struct sr_trigger_match *match;
@@ -329,16 +326,30 @@ static int set_trigger_config(const struct sr_dev_inst *sdi)
 
 	cfg.channels = devc->cur_channels;
 
+	soft_trigger_logic_free(devc->stl);
+	devc->stl = NULL;
+	devc->hw_stages = 0;
 	if (trigger && trigger->stages) {
-		stages = trigger->stages;
-		stage1 = stages->data;
-		if (stages->next) {
-			sr_err("Only one trigger stage supported for now.");
-			return SR_ERR;
+		devc->hw_stages = soft_trigger_hw_stages(trigger,
+			&la2016_trigger_caps);
+		if (devc->hw_stages < (int)g_slist_length(trigger->stages)) {
+			sr_dbg("Hardware takes %d of %u trigger stages.",
+				devc->hw_stages, g_slist_length(trigger->stages));
+			devc->stl = soft_trigger_logic_new_split(sdi, trigger, 2);
+			if (!devc->stl)
+				return SR_ERR;
 		}
+	}
+
+	if (devc->hw_stages > 0) {
+		stage1 = trigger->stages->data;
 		channel = stage1->matches;
 		while (channel) {
 			match = channel->data;
+			if (!match->channel->enabled) {
+				channel = channel->next;
+				continue;
+			}
 			ch_mask = 1 << match->channel->index;
 
 			switch (match->match) {
@@ -558,25 +569,59 @@ SR_PRIV int la2016_has_triggered(const struct sr_dev_inst *sdi)
 	return (state & 0x3) == 1;
 }
 
-SR_PRIV int la2016_start_retrieval(const struct sr_dev_inst *sdi, libusb_transfer_cb_fn cb)
+/* Read the next part of the capture memory into a new buffer. */
+SR_PRIV int la2016_submit_transfer(const struct sr_dev_inst *sdi,
+		struct libusb_transfer *transfer, libusb_transfer_cb_fn cb)
 {
 	struct dev_context *devc;
 	struct sr_usb_dev_inst *usb;
 	int ret;
-	uint32_t bulk_cfg[2];
 	uint32_t to_read;
 	uint8_t *buffer;
 
 	devc = sdi->priv;
 	usb = sdi->conn;
 
+	to_read = MIN(devc->n_bytes_to_submit, LA2016_TRANSFER_SIZE);
+	buffer = sr_mem_alloc_node(devc->ctx, LOG_PREFIX, to_read,
+		devc->numa_node);
+	if (!buffer) {
+		sr_err("Failed to allocate %d bytes for bulk transfer", to_read);
+		return SR_ERR_MALLOC;
+	}
+
+	libusb_fill_bulk_transfer(
+		transfer, usb->devhdl,
+		0x86, buffer, to_read,
+		cb, (void *)sdi, LA2016_TRANSFER_TIMEOUT_MS);
+
+	if ((ret = sr_usb_transfer_submit(transfer)) != 0) {
+		sr_err("Failed to submit transfer: %s.", libusb_error_name(ret));
+		transfer->buffer = NULL;
+		sr_mem_free(devc->ctx, buffer);
+		return SR_ERR;
+	}
+	devc->n_bytes_to_submit -= to_read;
+
+	return SR_OK;
+}
+
+SR_PRIV int la2016_start_retrieval(const struct sr_dev_inst *sdi, libusb_transfer_cb_fn cb)
+{
+	struct dev_context *devc;
+	struct libusb_transfer *transfer;
+	int ret;
+	uint32_t bulk_cfg[2];
+	unsigned int i;
+
+	devc = sdi->priv;
+
 	if ((ret = get_capture_info(sdi)) != SR_OK)
 		return ret;
 
 	devc->n_transfer_packets_to_read = devc->info.n_rep_packets / 5;
 	devc->n_bytes_to_read = devc->n_transfer_packets_to_read * sizeof(transfer_packet_t);
 	devc->read_pos = devc->info.write_pos - devc->n_bytes_to_read;
-	devc->n_reps_until_trigger = devc->info.n_rep_packets_before_trigger;
 
 	sr_dbg("want to read %d tfer-packets starting from pos %d",
 	       devc->n_transfer_packets_to_read, devc->read_pos);
@@ -597,28 +642,22 @@ SR_PRIV int la2016_start_retrieval(const struct sr_dev_inst *sdi, libusb_transfe
 		return ret;
 	}
 
-	to_read = devc->n_bytes_to_read;
-	if (to_read > LA2016_BULK_MAX)
-		to_read = LA2016_BULK_MAX;
-
-	buffer = g_try_malloc(to_read);
-	if (!buffer) {
-		sr_err("Failed to allocate %d bytes for bulk transfer", to_read);
-		return SR_ERR_MALLOC;
-	}
-
-	devc->transfer = libusb_alloc_transfer(0);
-	libusb_fill_bulk_transfer(
-		devc->transfer, usb->devhdl,
-		0x86, buffer, to_read,
-		cb, (void *)sdi, DEFAULT_TIMEOUT_MS);
-
-	if ((ret = libusb_submit_transfer(devc->transfer)) != 0) {
-		sr_err("Failed to submit transfer: %s.", libusb_error_name(ret));
-		libusb_free_transfer(devc->transfer);
-		devc->transfer = NULL;
-		g_free(buffer);
-		return SR_ERR;
+	/*
+	 * Keep several transfers in flight, so that the device never waits
+	 * for the next one to be submitted while the last one gets handled.
+	 */
+	devc->n_bytes_to_submit = devc->n_bytes_to_read;
+	devc->num_transfers_active = 0;
+	for (i = 0; i < LA2016_NUM_TRANSFERS && devc->n_bytes_to_submit; i++) {
+		transfer = libusb_alloc_transfer(0);
+		if (!transfer)
+			return devc->num_transfers_active ? SR_OK : SR_ERR_MALLOC;
+		if (la2016_submit_transfer(sdi, transfer, cb) != SR_OK) {
+			libusb_free_transfer(transfer);
+			return devc->num_transfers_active ? SR_OK : SR_ERR;
+		}
+		devc->transfers[i] = transfer;
+		devc->num_transfers_active++;
 	}
 
 	return SR_OK;
@@ -36,7 +36,13 @@
 #define LA2016_PID		0x01a2
 #define USB_INTERFACE		0
 
-#define LA2016_BULK_MAX         8388608
+/* Capture memory gets read with several bulk transfers in flight. */
+#define LA2016_NUM_TRANSFERS    4
+#define LA2016_TRANSFER_SIZE    (2 * 1024 * 1024)
+#define LA2016_TRANSFER_TIMEOUT_MS 1000
+
+/* Received data gets decoded in slices of this many transfer packets. */
+#define LA2016_DECODE_SLICE     4096
 
 #define MAX_RENUM_DELAY_MS	3000
 #define DEFAULT_TIMEOUT_MS      200
@@ -83,6 +89,23 @@ typedef struct transfer_packet {
 	uint8_t seq;
 } __attribute__((__packed__)) transfer_packet_t;
 
+/* A slice of received capture data, decoded on the worker pool. */
+struct la2016_job {
+	GBytes *raw;
+	transfer_packet_t *packets;
+	unsigned int num_packets;
+	/* Trigger after this many acq packets of the slice, 0 for none. */
+	unsigned int trigger_at;
+	gboolean rle;
+
+	/* Results, valid once done is set. */
+	int done;
+	uint16_t *values;	/* Samples, or one value per run. */
+	uint64_t *counts;	/* Repetitions per run (RLE only). */
+	uint64_t length;	/* Number of samples or runs. */
+	int64_t trigger_pos;	/* Sample or run of the trigger, or -1. */
+};
+
 typedef struct pwm_setting {
 	uint8_t enabled;
 	float freq;
@@ -92,6 +115,8 @@ typedef struct pwm_setting {
 
 struct dev_context {
 	struct sr_context *ctx;
+	/* Of the USB controller, for the transfer buffers. -1 if unknown. */
+	int numa_node;
 
 	int64_t fw_updated;
 	pwm_setting_t pwm_setting[2];
@@ -115,14 +140,34 @@ struct dev_context {
 	capture_info_t info;
 	unsigned int n_transfer_packets_to_read; /* each with 5 acq packets */
 	unsigned int n_bytes_to_read;
-	unsigned int n_reps_until_trigger;
-	unsigned int reading_behind_trigger;
-	uint64_t total_samples;
+	unsigned int n_bytes_to_submit;
 	uint32_t read_pos;
 
-	unsigned int convbuffer_size;
-	uint8_t *convbuffer;
-	struct libusb_transfer *transfer;
+	struct libusb_transfer *transfers[LA2016_NUM_TRANSFERS];
+	int num_transfers_active;
+
+	/*
+	 * Slices get decoded in parallel and sent in the order of this
+	 * queue. Acq packets are counted to find the trigger position.
+	 */
+	GThreadPool *decode_pool;
+	GQueue decode_jobs;
+	uint64_t n_reps_queued;
+	uint64_t trigger_rep;
+	gboolean logic_rle;
+
+	/*
+	 * Trigger stages after the first, or ones the hardware can't do,
+	 * get checked in the decoded samples.
+	 */
+	struct soft_trigger_logic *stl;
+	int hw_stages;
+	enum {
+		SOFT_TRIGGER_WAIT_HW,	/* Hardware stages didn't fire yet. */
+		SOFT_TRIGGER_HW_FIRED,	/* They fired at the next sample. */
+		SOFT_TRIGGER_SCAN,	/* Checking the remaining stages. */
+		SOFT_TRIGGER_DONE,	/* The trigger was sent. */
+	} soft_state;
 };
 
 SR_PRIV int la2016_upload_firmware(struct sr_context *sr_ctx, libusb_device *dev, uint16_t product_id);
@@ -132,6 +177,8 @@ SR_PRIV int la2016_stop_acquisition(const struct sr_dev_inst *sdi);
 SR_PRIV int la2016_abort_acquisition(const struct sr_dev_inst *sdi);
 SR_PRIV int la2016_has_triggered(const struct sr_dev_inst *sdi);
 SR_PRIV int la2016_start_retrieval(const struct sr_dev_inst *sdi, libusb_transfer_cb_fn cb);
+SR_PRIV int la2016_submit_transfer(const struct sr_dev_inst *sdi,
+		struct libusb_transfer *transfer, libusb_transfer_cb_fn cb);
 SR_PRIV int la2016_init_device(const struct sr_dev_inst *sdi);
 SR_PRIV int la2016_deinit_device(const struct sr_dev_inst *sdi);
 
@@ -126,7 +126,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 
 	devices = NULL;
 
-	libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	sr_usb_get_device_list(drvc->sr_ctx, &devlist);
 
 	for (i = 0; devlist[i]; i++) {
 		libusb_get_device_descriptor(devlist[i], &des);
@@ -258,7 +258,7 @@ static int dev_open(struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
 	int64_t timediff_us, timediff_ms;
-	int ret;
+	int ret, i;
 
 	devc = sdi->priv;
 
@@ -312,7 +312,8 @@ static int dev_open(struct sr_dev_inst *sdi)
 	devc->conv8to16 = g_malloc(CONV_8TO16_BUF_SIZE);
 
 	devc->intr_xfer = libusb_alloc_transfer(0);
-	devc->bulk_xfer = libusb_alloc_transfer(0);
+	for (i = 0; i < NUM_BULK_XFERS; i++)
+		devc->bulk_xfers[i] = libusb_alloc_transfer(0);
 
 	return SR_OK;
 }
@@ -321,6 +322,7 @@ static int dev_close(struct sr_dev_inst *sdi)
 {
 	struct sr_usb_dev_inst *usb;
 	struct dev_context *devc;
+	int i;
 
 	usb = sdi->conn;
 	devc = sdi->priv;
@@ -337,10 +339,12 @@ static int dev_close(struct sr_dev_inst *sdi)
 		devc->intr_xfer = NULL;
 	}
 
-	if (devc->bulk_xfer) {
-		devc->bulk_xfer->buffer = NULL; /* Points into devc. */
-		libusb_free_transfer(devc->bulk_xfer);
-		devc->bulk_xfer = NULL;
+	for (i = 0; i < NUM_BULK_XFERS; i++) {
+		if (!devc->bulk_xfers[i])
+			continue;
+		devc->bulk_xfers[i]->buffer = NULL; /* Points into devc. */
+		libusb_free_transfer(devc->bulk_xfers[i]);
+		devc->bulk_xfers[i] = NULL;
 	}
 
 	if (!usb->devhdl)
@@ -42,7 +42,6 @@
 #define FPGA_FIRMWARE_16 "lecroy-logicstudio16-16.bitstream"
 
 #define FPGA_FIRMWARE_SIZE 464196
-#define FPGA_FIRMWARE_CHUNK_SIZE 2048
 
 #define NUM_TRIGGER_STAGES 2
 #define TRIGGER_CFG_SIZE 45
@@ -241,14 +240,49 @@ static void prep_regw(struct regval *regval, uint8_t reg, uint16_t val)
 	regval->val = val;
 }
 
+/*
+ * Queue bulk transfers for the rest of the sample buffer, all at once,
+ * so that the device always has one to fill. Transfers on an endpoint
+ * complete in order, so each one gets the next part of the buffer.
+ */
+static void submit_bulk_transfers(const struct sr_dev_inst *sdi)
+{
+	struct sr_usb_dev_inst *usb;
+	struct dev_context *devc;
+	struct libusb_transfer *xfer;
+	uint32_t offset, length;
+	int i;
+
+	usb = sdi->conn;
+	devc = sdi->priv;
+
+	offset = devc->total_received_sample_bytes;
+	for (i = 0; i < NUM_BULK_XFERS && offset < SAMPLE_BUF_SIZE; i++) {
+		/* The first transfer of a fetch is a bit larger. */
+		length = MIN(offset ? 16 << 10 : 17 << 10,
+			SAMPLE_BUF_SIZE - offset);
+
+		xfer = devc->bulk_xfers[i];
+		libusb_fill_bulk_transfer(xfer, usb->devhdl, EP_BULK,
+			devc->fetched_samples + offset, length,
+			recv_bulk_transfer, (void *)sdi, USB_TIMEOUT_MS);
+
+		if (libusb_submit_transfer(xfer) < 0) {
+			sr_err("Failed to submit bulk transfer.");
+			break;
+		}
+
+		devc->num_bulk_xfers_pending++;
+		offset += length;
+	}
+}
+
 static void LIBUSB_CALL handle_fetch_samples_done(struct libusb_transfer *xfer)
 {
 	const struct sr_dev_inst *sdi;
-	struct sr_usb_dev_inst *usb;
 	struct dev_context *devc;
 
 	sdi = xfer->user_data;
-	usb = sdi->conn;
 	devc = sdi->priv;
 
 	g_free(xfer->buffer);
@@ -256,11 +290,8 @@ static void LIBUSB_CALL handle_fetch_samples_done(struct libusb_transfer *xfer)
 
 	libusb_free_transfer(xfer);
 
-	libusb_fill_bulk_transfer(devc->bulk_xfer, usb->devhdl, EP_BULK,
-		devc->fetched_samples, 17 << 10,
-		recv_bulk_transfer, (void *)sdi, USB_TIMEOUT_MS);
-
-	libusb_submit_transfer(devc->bulk_xfer);
+	devc->num_bulk_xfers_pending = 0;
+	submit_bulk_transfers(sdi);
 }
 
 static void calc_unk0(uint32_t *a, uint32_t *b)
@@ -416,32 +447,53 @@ out:
 	return resubmit_intr_xfer;
 }
 
-static int upload_fpga_bitstream(const struct sr_dev_inst *sdi,
-	const char *firmware_name)
+static int fpga_upload_verify(const struct sr_dev_inst *sdi,
+	uint8_t *upload_succeeded)
 {
-	struct drv_context *drvc;
 	struct sr_usb_dev_inst *usb;
-	struct sr_resource firmware;
-	uint8_t firmware_chunk[FPGA_FIRMWARE_CHUNK_SIZE];
-	uint8_t upload_succeeded;
-	ssize_t chunk_size;
-	int i, r, ret, actual_length;
+	int r;
 
-	drvc = sdi->driver->context;
 	usb = sdi->conn;
 
-	ret = sr_resource_open(drvc->sr_ctx, &firmware,
-			SR_RESOURCE_FIRMWARE, firmware_name);
+	*upload_succeeded = 0x00;
+
+	r = libusb_control_transfer(usb->devhdl, CTRL_IN,
+		USB_COMMAND_VERIFY_UPLOAD, 0x07, 5444,
+		upload_succeeded, sizeof(*upload_succeeded),
+		USB_TIMEOUT_MS);
+
+	if (r != sizeof(*upload_succeeded)) {
+		sr_err("CTRL_IN failed: %i.", r);
+		return SR_ERR;
+	}
+
+	return SR_OK;
+}
 
-	if (ret != SR_OK)
+static int fpga_is_configured(const struct sr_dev_inst *sdi,
+	gboolean *configured)
+{
+	uint8_t upload_succeeded;
+	int ret;
+
+	if ((ret = fpga_upload_verify(sdi, &upload_succeeded)) != SR_OK)
 		return ret;
 
-	ret = SR_ERR;
+	*configured = upload_succeeded == 0x01;
 
-	if (firmware.size != FPGA_FIRMWARE_SIZE) {
-		sr_err("Invalid FPGA firmware file size: %" PRIu64 " bytes.",
-			firmware.size);
-		goto out;
+	return SR_OK;
+}
+
+static int fpga_upload_begin(const struct sr_dev_inst *sdi, size_t size)
+{
+	struct sr_usb_dev_inst *usb;
+	int r;
+
+	usb = sdi->conn;
+
+	if (size != FPGA_FIRMWARE_SIZE) {
+		sr_err("Invalid FPGA firmware file size: %zu bytes.", size);
+		return SR_ERR;
 	}
 
 	/* Initiate upload. */
@@ -451,57 +503,45 @@ static int upload_fpga_bitstream(const struct sr_dev_inst *sdi,
 
 	if (r != 0) {
 		sr_err("Failed to initiate firmware upload: %s.",
-				libusb_error_name(ret));
-		goto out;
+				libusb_error_name(r));
+		return SR_ERR;
 	}
 
-	for (;;) {
-		chunk_size = sr_resource_read(drvc->sr_ctx, &firmware,
-			firmware_chunk, sizeof(firmware_chunk));
-
-		if (chunk_size < 0)
-			goto out;
-
-		if (chunk_size == 0)
-			break;
-
-		actual_length = chunk_size;
-
-		r = libusb_bulk_transfer(usb->devhdl, EP_BITSTREAM,
-			firmware_chunk, chunk_size, &actual_length, USB_TIMEOUT_MS);
+	return SR_OK;
+}
 
-		if (r != 0 || (ssize_t)actual_length != chunk_size) {
-			sr_err("FPGA firmware upload failed.");
-			goto out;
-		}
-	}
+static int fpga_upload_end(const struct sr_dev_inst *sdi)
+{
+	uint8_t upload_succeeded;
+	int i, ret;
 
 	/* Verify upload. */
 	for (i = 0; i < 4; i++) {
 		g_usleep(250000);
 
-		upload_succeeded = 0x00;
-
-		r = libusb_control_transfer(usb->devhdl, CTRL_IN,
-			USB_COMMAND_VERIFY_UPLOAD, 0x07, 5444,
-			&upload_succeeded, sizeof(upload_succeeded),
-			USB_TIMEOUT_MS);
+		if ((ret = fpga_upload_verify(sdi, &upload_succeeded)) != SR_OK)
+			return ret;
 
-		if (r != sizeof(upload_succeeded)) {
-			sr_err("CTRL_IN failed: %i.", r);
-			return SR_ERR;
-		}
-
-		if (upload_succeeded == 0x01) {
-			ret = SR_OK;
-			break;
-		}
+		if (upload_succeeded == 0x01)
+			return SR_OK;
 	}
 
-out:
-	sr_resource_close(drvc->sr_ctx, &firmware);
+	return SR_ERR;
+}
 
-	return ret;
+static const struct sr_usb_fpga_loader fpga_loader = {
+	.endpoint = EP_BITSTREAM,
+	.timeout = 1000, /* ms, per transfer of up to 64 KiB */
+	.is_configured = fpga_is_configured,
+	.begin = fpga_upload_begin,
+	.end = fpga_upload_end,
+};
+
+static int upload_fpga_bitstream(const struct sr_dev_inst *sdi,
+	const char *firmware_name)
+{
+	return sr_usb_fpga_configure(sdi, &fpga_loader, firmware_name,
+		FPGA_FIRMWARE_SIZE, NULL);
 }
 
 static int upload_trigger(const struct sr_dev_inst *sdi,
@@ -1005,6 +1045,7 @@ static void LIBUSB_CALL recv_bulk_transfer(struct libusb_transfer *xfer)
 	struct drv_context *drvc;
 	uint32_t bytes_left, length;
 	uint16_t read_offset, trigger_offset;
+	uint8_t *received;
 
 	sdi = xfer->user_data;
 
@@ -1014,16 +1055,20 @@ static void LIBUSB_CALL recv_bulk_transfer(struct libusb_transfer *xfer)
 	drvc = sdi->driver->context;
 	devc = sdi->priv;
 
+	/*
+	 * A short transfer leaves a gap before the data of the ones after
+	 * it, which gets closed as they complete.
+	 */
+	received = devc->fetched_samples + devc->total_received_sample_bytes;
+	if (xfer->buffer != received)
+		memmove(received, xfer->buffer, xfer->actual_length);
 	devc->total_received_sample_bytes += xfer->actual_length;
 
-	if (devc->total_received_sample_bytes < SAMPLE_BUF_SIZE) {
-		xfer->buffer = devc->fetched_samples
-			+ devc->total_received_sample_bytes;
-
-		xfer->length = MIN(16 << 10,
-			SAMPLE_BUF_SIZE - devc->total_received_sample_bytes);
+	if (--devc->num_bulk_xfers_pending > 0)
+		return;
 
-		libusb_submit_transfer(xfer);
+	if (devc->total_received_sample_bytes < SAMPLE_BUF_SIZE) {
+		submit_bulk_transfers(sdi);
 		return;
 	}
 
@@ -28,6 +28,8 @@
 #define LOG_PREFIX "lecroy-logicstudio"
 
 #define SAMPLE_BUF_SIZE 40960u
+/* Enough bulk transfers in flight to fetch the whole sample buffer. */
+#define NUM_BULK_XFERS 3
 #define CONV_8TO16_BUF_SIZE 8192
 #define INTR_BUF_SIZE 32
 
@@ -35,7 +37,8 @@ struct samplerate_info;
 
 struct dev_context {
 	struct libusb_transfer *intr_xfer;
-	struct libusb_transfer *bulk_xfer;
+	struct libusb_transfer *bulk_xfers[NUM_BULK_XFERS];
+	int num_bulk_xfers_pending;
 
 	const struct samplerate_info *samplerate_info;
 
@@ -44,6 +44,7 @@ static const uint32_t devopts[] = {
 	SR_CONF_HORIZ_TRIGGERPOS | SR_CONF_GET | SR_CONF_SET,
 	SR_CONF_TRIGGER_SOURCE | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
 	SR_CONF_TRIGGER_SLOPE | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
+	SR_CONF_DATA_SOURCE | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
 };
 
 static const uint32_t devopts_cg_analog[] = {
@@ -52,6 +53,12 @@ static const uint32_t devopts_cg_analog[] = {
 	SR_CONF_COUPLING | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
 };
 
+/* Do not change the order of entries */
+static const char *data_sources[] = {
+	"Live",
+	"Segmented",
+};
+
 static struct sr_dev_inst *probe_device(struct sr_scpi_dev_inst *scpi)
 {
 	struct sr_dev_inst *sdi;
@@ -188,6 +195,9 @@ static int config_get(uint32_t key, GVariant **data,
 	case SR_CONF_ENABLED:
 		*data = g_variant_new_boolean(FALSE);
 		break;
+	case SR_CONF_DATA_SOURCE:
+		*data = g_variant_new_string(data_sources[devc->data_source]);
+		break;
 	default:
 		return SR_ERR_NA;
 	}
@@ -283,6 +293,12 @@ static int config_set(uint32_t key, GVariant *data,
 			return SR_ERR;
 		ret = SR_OK;
 		break;
+	case SR_CONF_DATA_SOURCE:
+		if ((idx = std_str_idx(data, ARRAY_AND_SIZE(data_sources))) < 0)
+			return SR_ERR_ARG;
+		devc->data_source = idx;
+		ret = SR_OK;
+		break;
 	default:
 		ret = SR_ERR_NA;
 		break;
@@ -346,6 +362,9 @@ static int config_list(uint32_t key, GVariant **data,
 			return SR_ERR_ARG;
 		*data = std_gvar_tuple_array(*model->vdivs, model->num_vdivs);
 		break;
+	case SR_CONF_DATA_SOURCE:
+		*data = g_variant_new_strv(ARRAY_AND_SIZE(data_sources));
+		break;
 	default:
 		return SR_ERR_NA;
 	}
@@ -460,6 +479,10 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 
 	devc->current_channel = devc->enabled_channels;
 
+	/* A sequence must be captured first, live data may be there already. */
+	if (devc->data_source == DATA_SOURCE_SEGMENTED)
+		lecroy_xstream_arm(sdi);
+
 	return lecroy_xstream_request_data(sdi);
 
 free_enabled:
@@ -481,9 +504,13 @@ static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 	devc->num_frames = 0;
 	g_slist_free(devc->enabled_channels);
 	devc->enabled_channels = NULL;
+	lecroy_xstream_segments_free(devc);
 	scpi = sdi->conn;
 	sr_scpi_source_remove(sdi->session, scpi);
 
+	if (devc->data_source == DATA_SOURCE_SEGMENTED)
+		sr_scpi_send(scpi, "SEQUENCE OFF");
+
 	return SR_OK;
 }
 
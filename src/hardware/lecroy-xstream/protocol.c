@@ -543,7 +543,8 @@ SR_PRIV int lecroy_xstream_init_device(struct sr_dev_inst *sdi)
 }
 
 static int lecroy_waveform_2_x_to_analog(GByteArray *data,
-		struct lecroy_wavedesc *desc, struct sr_datafeed_analog *analog)
+		struct lecroy_wavedesc *desc, unsigned int segment,
+		unsigned int num_segments, struct sr_datafeed_analog *analog)
 {
 	struct sr_analog_encoding *encoding = analog->encoding;
 	struct sr_analog_meaning *meaning = analog->meaning;
@@ -551,13 +552,25 @@ static int lecroy_waveform_2_x_to_analog(GByteArray *data,
 	float *data_float;
 	int16_t *waveform_data;
 	unsigned int i, num_samples;
+	size_t offset;
+
+	/* Segments follow each other, after the trigger time array. */
+	offset = desc->version_2_x.wave_descriptor_length
+		+ desc->version_2_x.user_text_len
+		+ desc->version_2_x.res_desc1
+		+ desc->version_2_x.trigtime_array_length
+		+ desc->version_2_x.ris_time1_array_length
+		+ desc->version_2_x.res_array1;
+	if (offset + desc->version_2_x.wave_array_count * sizeof(int16_t) > data->len) {
+		sr_err("Waveform data is truncated.");
+		return SR_ERR;
+	}
 
-	data_float = g_malloc(desc->version_2_x.wave_array_count * sizeof(float));
-	num_samples = desc->version_2_x.wave_array_count;
+	num_samples = desc->version_2_x.wave_array_count / num_segments;
+	data_float = g_malloc(num_samples * sizeof(float));
 
-	waveform_data = (int16_t*)(data->data +
-		+ desc->version_2_x.wave_descriptor_length
-		+ desc->version_2_x.user_text_len);
+	waveform_data = (int16_t *)(data->data + offset)
+		+ (size_t)segment * num_samples;
 
 	for (i = 0; i < num_samples; i++)
 		data_float[i] = (float)waveform_data[i]
@@ -594,23 +607,172 @@ static int lecroy_waveform_2_x_to_analog(GByteArray *data,
 	return SR_OK;
 }
 
-static int lecroy_waveform_to_analog(GByteArray *data,
-		struct sr_datafeed_analog *analog)
+static struct lecroy_wavedesc *lecroy_waveform_desc(GByteArray *data)
 {
 	struct lecroy_wavedesc *desc;
 
 	if (data->len < sizeof(struct lecroy_wavedesc))
-		return SR_ERR;
+		return NULL;
 
 	desc = (struct lecroy_wavedesc*)data->data;
 
 	if (!strncmp(desc->template_name, "LECROY_2_2", 16) ||
 	    !strncmp(desc->template_name, "LECROY_2_3", 16)) {
-		return lecroy_waveform_2_x_to_analog(data, desc, analog);
+		return desc;
 	}
 
 	sr_err("Waveformat template '%.16s' not supported.", desc->template_name);
-	return SR_ERR;
+	return NULL;
+}
+
+/* The number of segments in a (sequence) waveform, 0 if it is invalid. */
+static unsigned int lecroy_waveform_segments(GByteArray *data)
+{
+	struct lecroy_wavedesc *desc;
+
+	if (!(desc = lecroy_waveform_desc(data)))
+		return 0;
+
+	return MAX(desc->version_2_x.subarray_count, 1);
+}
+
+static int lecroy_waveform_to_analog(GByteArray *data, unsigned int segment,
+		unsigned int num_segments, struct sr_datafeed_analog *analog)
+{
+	struct lecroy_wavedesc *desc;
+
+	if (!(desc = lecroy_waveform_desc(data)))
+		return SR_ERR;
+
+	return lecroy_waveform_2_x_to_analog(data, desc, segment, num_segments,
+		analog);
+}
+
+SR_PRIV void lecroy_xstream_segments_free(struct dev_context *devc)
+{
+	GSList *l;
+
+	for (l = devc->segment_blocks; l; l = l->next)
+		g_byte_array_free(l->data, TRUE);
+	g_slist_free(devc->segment_blocks);
+	devc->segment_blocks = NULL;
+}
+
+SR_PRIV int lecroy_xstream_arm(const struct sr_dev_inst *sdi)
+{
+	char command[MAX_COMMAND_SIZE];
+	struct dev_context *devc;
+	unsigned int segments;
+
+	devc = sdi->priv;
+
+	if (devc->data_source == DATA_SOURCE_SEGMENTED) {
+		segments = MAX_SEQUENCE_SEGMENTS;
+		if (devc->frame_limit)
+			segments = MIN(segments, devc->frame_limit - devc->num_frames);
+		g_snprintf(command, sizeof(command), "SEQUENCE ON,%u", segments);
+		if (sr_scpi_send(sdi->conn, command) != SR_OK)
+			return SR_ERR;
+	}
+
+	/* Wait for trigger, then begin fetching data. */
+	g_snprintf(command, sizeof(command), "ARM;WAIT;*OPC");
+	return sr_scpi_send(sdi->conn, command);
+}
+
+static int send_segment(const struct sr_dev_inst *sdi, struct sr_channel *ch,
+		GByteArray *data, unsigned int segment, unsigned int num_segments)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+
+	analog.encoding = &encoding;
+	analog.meaning = &meaning;
+	analog.spec = &spec;
+
+	if (lecroy_waveform_to_analog(data, segment, num_segments,
+			&analog) != SR_OK)
+		return SR_ERR;
+
+	meaning.channels = g_slist_append(NULL, ch);
+	packet.payload = &analog;
+	packet.type = SR_DF_ANALOG;
+	sr_session_send(sdi, &packet);
+
+	g_slist_free(meaning.channels);
+	g_free(analog.data);
+
+	return SR_OK;
+}
+
+/*
+ * In segmented mode, the scope captures a sequence of segments at full
+ * trigger rate, and each channel's waveform holds all of them. Once these
+ * are in for all enabled channels, each segment becomes a frame.
+ */
+static int receive_segments(struct sr_dev_inst *sdi, GByteArray *data)
+{
+	struct dev_context *devc;
+	struct scope_state *state;
+	struct lecroy_wavedesc *desc;
+	GSList *l, *c;
+	unsigned int segment, num_segments;
+	gboolean done;
+
+	devc = sdi->priv;
+	state = devc->model_state;
+
+	devc->segment_blocks = g_slist_append(devc->segment_blocks, data);
+
+	if (devc->current_channel->next) {
+		devc->current_channel = devc->current_channel->next;
+		lecroy_xstream_request_data(sdi);
+		return TRUE;
+	}
+
+	num_segments = G_MAXUINT;
+	for (l = devc->segment_blocks; l; l = l->next)
+		num_segments = MIN(num_segments, lecroy_waveform_segments(l->data));
+	sr_dbg("Received %u segments.", num_segments);
+
+	done = num_segments == 0;
+	if (!done && state->sample_rate == 0) {
+		desc = lecroy_waveform_desc(devc->segment_blocks->data);
+		if (lecroy_xstream_update_sample_rate(sdi,
+				desc->version_2_x.wave_array_count / num_segments) != SR_OK)
+			done = TRUE;
+	}
+
+	for (segment = 0; !done && segment < num_segments; segment++) {
+		std_session_send_df_frame_begin(sdi);
+		for (l = devc->segment_blocks, c = devc->enabled_channels;
+				l && c; l = l->next, c = c->next) {
+			if (send_segment(sdi, c->data, l->data, segment,
+					num_segments) != SR_OK)
+				done = TRUE;
+		}
+		std_session_send_df_frame_end(sdi);
+
+		devc->num_frames++;
+		if (devc->frame_limit && (devc->num_frames == devc->frame_limit))
+			done = TRUE;
+	}
+
+	lecroy_xstream_segments_free(devc);
+
+	if (done) {
+		sr_dev_acquisition_stop(sdi);
+		return TRUE;
+	}
+
+	devc->current_channel = devc->enabled_channels;
+	lecroy_xstream_arm(sdi);
+	lecroy_xstream_request_data(sdi);
+
+	return TRUE;
 }
 
 SR_PRIV int lecroy_xstream_receive_data(int fd, int revents, void *cb_data)
@@ -650,11 +812,14 @@ SR_PRIV int lecroy_xstream_receive_data(int fd, int revents, void *cb_data)
 		return TRUE;
 	}
 
+	if (devc->data_source == DATA_SOURCE_SEGMENTED)
+		return receive_segments(sdi, data);
+
 	analog.encoding = &encoding;
 	analog.meaning = &meaning;
 	analog.spec = &spec;
 
-	if (lecroy_waveform_to_analog(data, &analog) != SR_OK)
+	if (lecroy_waveform_to_analog(data, 0, 1, &analog) != SR_OK)
 		return SR_ERR;
 
 	if (analog.num_samples == 0) {
@@ -717,10 +882,7 @@ SR_PRIV int lecroy_xstream_receive_data(int fd, int revents, void *cb_data)
 	} else {
 		devc->current_channel = devc->enabled_channels;
 
-		/* Wait for trigger, then begin fetching data. */
-		g_snprintf(command, sizeof(command), "ARM;WAIT;*OPC");
-		sr_scpi_send(sdi->conn, command);
-
+		lecroy_xstream_arm(sdi);
 		lecroy_xstream_request_data(sdi);
 	}
 
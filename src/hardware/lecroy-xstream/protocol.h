@@ -31,6 +31,14 @@
 #define MAX_INSTRUMENT_VERSIONS 10
 #define MAX_COMMAND_SIZE 48
 #define MAX_ANALOG_CHANNEL_COUNT 4
+/* Most segments to capture per sequence acquisition. */
+#define MAX_SEQUENCE_SEGMENTS 1000
+
+enum data_source {
+	DATA_SOURCE_LIVE,
+	/* Capture a sequence of segments, download all of them at once. */
+	DATA_SOURCE_SEGMENTED,
+};
 
 struct scope_config {
 	const char *name[MAX_INSTRUMENT_VERSIONS];
@@ -88,13 +96,19 @@ struct dev_context {
 	uint64_t num_frames;
 
 	uint64_t frame_limit;
+
+	enum data_source data_source;
+	/* Sequence waveforms received so far, one per enabled channel. */
+	GSList *segment_blocks;
 };
 
 SR_PRIV int lecroy_xstream_init_device(struct sr_dev_inst *sdi);
 SR_PRIV int lecroy_xstream_request_data(const struct sr_dev_inst *sdi);
+SR_PRIV int lecroy_xstream_arm(const struct sr_dev_inst *sdi);
 SR_PRIV int lecroy_xstream_receive_data(int fd, int revents, void *cb_data);
 
 SR_PRIV void lecroy_xstream_state_free(struct scope_state *state);
+SR_PRIV void lecroy_xstream_segments_free(struct dev_context *devc);
 SR_PRIV int lecroy_xstream_state_get(struct sr_dev_inst *sdi);
 SR_PRIV int lecroy_xstream_channel_state_set(const struct sr_dev_inst *sdi,
 		const int ch_index, gboolean ch_state);
@@ -365,8 +365,8 @@ static int pickit2_submit_logic_data(struct sr_dev_inst *sdi)
 	logic.unitsize = sizeof(uint8_t);
 	logic.data = &devc->samples_conv[0];
 	logic.length = conv_len;
-	limit = devc->sw_limits.limit_samples;
-	if (limit && limit < logic.length)
+	limit = sr_sw_limits_samples_remaining(&devc->sw_limits);
+	if (limit < logic.length)
 		logic.length = limit;
 	sr_session_send(sdi, &packet);
 
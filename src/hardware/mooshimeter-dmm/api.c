@@ -115,6 +115,14 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	if (ret < 0)
 		goto err;
 
+	/*
+	 * Sample data streams in many small notifications, which the
+	 * default connection interval (up to 50ms) slows down.
+	 */
+	ret = sr_bt_config_conn_interval(desc, 7500, 15000);
+	if (ret < 0)
+		goto err;
+
 	ret = sr_bt_connect_ble(desc);
 	if (ret < 0)
 		goto err;
@@ -1135,23 +1135,6 @@ static void startup_send_tree_crc(struct startup_context *ctx)
 	set_tree_integer(ctx->sdi, target, ctx->crc);
 }
 
-static uint32_t crc32(const uint8_t *ptr, size_t size)
-{
-	uint32_t result = 0xFFFFFFFF;
-	uint32_t t;
-	for (; size; size--, ptr++) {
-		result ^= *ptr;
-		for (int i = 0; i < 8; i++) {
-			t = result & 1;
-			result >>= 1;
-			if (t)
-				result ^= 0xEDB88320;
-		}
-	}
-
-	return ~result;
-}
-
 static void startup_tree_updated(struct config_tree_node *node, void *param)
 {
 	struct startup_context *ctx = param;
@@ -1169,7 +1152,8 @@ static void startup_tree_updated(struct config_tree_node *node, void *param)
 	size_t size;
 	struct config_tree_node *target;
 
-	ctx->crc = crc32(node->value.b->data, node->value.b->len);
+	ctx->crc = sr_crc32(SR_CRC32_DEFAULT_INIT,
+		node->value.b->data, node->value.b->len);
 
 	tree_data = g_byte_array_new();
 	g_byte_array_set_size(tree_data, 4096);
@@ -0,0 +1,238 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "protocol.h"
+
+static const uint32_t scanopts[] = {
+	SR_CONF_CONN,
+};
+
+static const uint32_t drvopts[] = {
+	SR_CONF_LOGIC_ANALYZER,
+	SR_CONF_OSCILLOSCOPE,
+};
+
+static const uint32_t devopts[] = {
+	SR_CONF_CONTINUOUS,
+	SR_CONF_CONN | SR_CONF_GET,
+	SR_CONF_SAMPLERATE | SR_CONF_GET,
+	SR_CONF_LIMIT_SAMPLES | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_LIMIT_MSEC | SR_CONF_GET | SR_CONF_SET,
+};
+
+static GSList *scan(struct sr_dev_driver *di, GSList *options)
+{
+	struct sr_config *src;
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	const char *conn;
+	gchar **params;
+	GSList *l;
+
+	conn = NULL;
+	for (l = options; l; l = l->next) {
+		src = l->data;
+		if (src->key == SR_CONF_CONN)
+			conn = g_variant_get_string(src->data, NULL);
+	}
+	if (!conn)
+		return NULL;
+
+	/* tcp/<host>[/<port>] */
+	params = g_strsplit(conn, "/", 0);
+	if (!params || !params[0] || !params[1] ||
+			g_ascii_strcasecmp(params[0], "tcp")) {
+		sr_err("Invalid connection '%s', expected tcp/<host>/<port>.",
+			conn);
+		g_strfreev(params);
+		return NULL;
+	}
+
+	devc = g_malloc0(sizeof(struct dev_context));
+	devc->socket = -1;
+	devc->address = g_strdup(params[1]);
+	if (params[2])
+		devc->port = g_strdup(params[2]);
+	else
+		devc->port = g_strdup_printf("%d", NETFEED_DEFAULT_PORT);
+	g_strfreev(params);
+	sr_sw_limits_init(&devc->limits);
+
+	sdi = g_malloc0(sizeof(struct sr_dev_inst));
+	sdi->status = SR_ST_INACTIVE;
+	sdi->vendor = g_strdup("sigrok");
+	sdi->model = g_strdup("netfeed");
+	sdi->connection_id = g_strdup_printf("%s:%s", devc->address,
+		devc->port);
+	sdi->priv = devc;
+
+	/* The server describes its channels when a client connects. */
+	if (netfeed_open(devc) != SR_OK)
+		goto err_free;
+	if (netfeed_read_header(sdi) != SR_OK) {
+		netfeed_close(devc);
+		goto err_free;
+	}
+	netfeed_close(devc);
+	sr_info("Netfeed with %u channels found at %s.",
+		g_slist_length(sdi->channels), sdi->connection_id);
+
+	return std_scan_complete(di, g_slist_append(NULL, sdi));
+
+err_free:
+	g_free(devc->address);
+	g_free(devc->port);
+	sdi->priv = NULL;
+	sr_dev_inst_free(sdi);
+	g_free(devc);
+
+	return NULL;
+}
+
+static int dev_open(struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+
+	devc = sdi->priv;
+	if (!devc->buf) {
+		devc->buf_size = NETFEED_BUFSIZE;
+		devc->buf = g_malloc(devc->buf_size);
+	}
+
+	return netfeed_open(devc);
+}
+
+static int dev_close(struct sr_dev_inst *sdi)
+{
+	return netfeed_close(sdi->priv);
+}
+
+static void clear_helper(struct dev_context *devc)
+{
+	g_free(devc->address);
+	g_free(devc->port);
+	g_free(devc->buf);
+	g_free(devc->fbuf);
+}
+
+static int dev_clear(const struct sr_dev_driver *di)
+{
+	return std_dev_clear_with_callback(di, (std_dev_clear_callback)clear_helper);
+}
+
+static int config_get(uint32_t key, GVariant **data,
+	const struct sr_dev_inst *sdi, const struct sr_channel_group *cg)
+{
+	struct dev_context *devc;
+
+	(void)cg;
+
+	if (!sdi)
+		return SR_ERR_ARG;
+	devc = sdi->priv;
+
+	switch (key) {
+	case SR_CONF_CONN:
+		*data = g_variant_new_printf("tcp/%s/%s", devc->address,
+			devc->port);
+		break;
+	case SR_CONF_SAMPLERATE:
+		*data = g_variant_new_uint64(devc->samplerate);
+		break;
+	case SR_CONF_LIMIT_SAMPLES:
+	case SR_CONF_LIMIT_MSEC:
+		return sr_sw_limits_config_get(&devc->limits, key, data);
+	default:
+		return SR_ERR_NA;
+	}
+
+	return SR_OK;
+}
+
+static int config_set(uint32_t key, GVariant *data,
+	const struct sr_dev_inst *sdi, const struct sr_channel_group *cg)
+{
+	struct dev_context *devc;
+
+	(void)cg;
+
+	devc = sdi->priv;
+
+	return sr_sw_limits_config_set(&devc->limits, key, data);
+}
+
+static int config_list(uint32_t key, GVariant **data,
+	const struct sr_dev_inst *sdi, const struct sr_channel_group *cg)
+{
+	return STD_CONFIG_LIST(key, data, sdi, cg, scanopts, drvopts, devopts);
+}
+
+static int dev_acquisition_start(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	int ret;
+
+	devc = sdi->priv;
+
+	/*
+	 * A previous acquisition's connection was closed, the server
+	 * starts over with the magic for the new one.
+	 */
+	if (devc->socket < 0 && (ret = netfeed_open(devc)) != SR_OK)
+		return ret;
+
+	sr_sw_limits_acquisition_start(&devc->limits);
+	std_session_send_df_header(sdi);
+
+	return sr_session_source_add(sdi->session, devc->socket, G_IO_IN,
+		100, netfeed_receive_data, (void *)sdi);
+}
+
+static int dev_acquisition_stop(struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+
+	devc = sdi->priv;
+
+	sr_session_source_remove(sdi->session, devc->socket);
+	/* Left unread, the connection would stall the server. */
+	netfeed_close(devc);
+	std_session_send_df_end(sdi);
+
+	return SR_OK;
+}
+
+static struct sr_dev_driver netfeed_driver_info = {
+	.name = "netfeed",
+	.longname = "Network datafeed client",
+	.api_version = 1,
+	.init = std_init,
+	.cleanup = std_cleanup,
+	.scan = scan,
+	.dev_list = std_dev_list,
+	.dev_clear = dev_clear,
+	.config_get = config_get,
+	.config_set = config_set,
+	.config_list = config_list,
+	.dev_open = dev_open,
+	.dev_close = dev_close,
+	.dev_acquisition_start = dev_acquisition_start,
+	.dev_acquisition_stop = dev_acquisition_stop,
+	.context = NULL,
+};
+SR_REGISTER_DEV_DRIVER(netfeed_driver_info);
@@ -0,0 +1,428 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#ifdef _WIN32
+#define _WIN32_WINNT 0x0501
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#endif
+#include <string.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#endif
+#include <errno.h>
+#include "protocol.h"
+
+SR_PRIV int netfeed_open(struct dev_context *devc)
+{
+	struct addrinfo hints;
+	struct addrinfo *results, *res;
+	int err, opt;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+
+	err = getaddrinfo(devc->address, devc->port, &hints, &results);
+
+	if (err) {
+		sr_err("Address lookup failed: %s:%s: %s", devc->address,
+			devc->port, gai_strerror(err));
+		return SR_ERR;
+	}
+
+	for (res = results; res; res = res->ai_next) {
+		if ((devc->socket = socket(res->ai_family, res->ai_socktype,
+						res->ai_protocol)) < 0)
+			continue;
+		if (connect(devc->socket, res->ai_addr, res->ai_addrlen) != 0) {
+			close(devc->socket);
+			devc->socket = -1;
+			continue;
+		}
+		break;
+	}
+
+	freeaddrinfo(results);
+
+	if (devc->socket < 0) {
+		sr_err("Failed to connect to %s:%s: %s", devc->address,
+			devc->port, g_strerror(errno));
+		return SR_ERR;
+	}
+
+	opt = 1;
+	setsockopt(devc->socket, IPPROTO_TCP, TCP_NODELAY,
+		(const void *)&opt, sizeof(opt));
+
+	devc->buf_len = 0;
+	devc->magic_seen = FALSE;
+
+	return SR_OK;
+}
+
+SR_PRIV int netfeed_close(struct dev_context *devc)
+{
+	if (devc->socket < 0)
+		return SR_OK;
+
+	if (close(devc->socket) < 0)
+		return SR_ERR;
+	devc->socket = -1;
+
+	return SR_OK;
+}
+
+/* Receive exactly len bytes, within timeout_ms between any two of them. */
+static int recv_all(struct dev_context *devc, uint8_t *buf, size_t len,
+		unsigned int timeout_ms)
+{
+	fd_set fds;
+	struct timeval tv;
+	int ret;
+
+	while (len > 0) {
+		FD_ZERO(&fds);
+		FD_SET(devc->socket, &fds);
+		tv.tv_sec = timeout_ms / 1000;
+		tv.tv_usec = (timeout_ms % 1000) * 1000;
+		ret = select(devc->socket + 1, &fds, NULL, NULL, &tv);
+		if (ret == 0) {
+			sr_err("Timeout waiting for %s:%s.", devc->address,
+				devc->port);
+			return SR_ERR_TIMEOUT;
+		}
+		if (ret > 0)
+			ret = recv(devc->socket, (char *)buf, len, 0);
+		if (ret < 0) {
+			sr_err("Receive error: %s", g_strerror(errno));
+			return SR_ERR_IO;
+		}
+		if (ret == 0) {
+			sr_err("Connection closed by %s:%s.", devc->address,
+				devc->port);
+			return SR_ERR_IO;
+		}
+		buf += ret;
+		len -= ret;
+	}
+
+	return SR_OK;
+}
+
+/*
+ * Channels get created from the first header (at scan time). Later
+ * ones only update the samplerate, the channels' state is the client's
+ * to set.
+ */
+static int header_parse(struct sr_dev_inst *sdi, const uint8_t *p,
+		size_t len)
+{
+	struct dev_context *devc;
+	const uint8_t *end;
+	uint32_t i, num_channels;
+	uint16_t name_len;
+	uint8_t type, enabled;
+	char *name;
+	gboolean create;
+
+	devc = sdi->priv;
+	end = p + len;
+	if (len < 12)
+		return SR_ERR_DATA;
+	devc->samplerate = read_u64le_inc(&p);
+	num_channels = read_u32le_inc(&p);
+
+	create = !sdi->channels;
+	for (i = 0; create && i < num_channels; i++) {
+		if (end - p < 4)
+			return SR_ERR_DATA;
+		type = read_u8_inc(&p);
+		enabled = read_u8_inc(&p);
+		name_len = read_u16le_inc(&p);
+		if (end - p < name_len)
+			return SR_ERR_DATA;
+		name = g_strndup((const char *)p, name_len);
+		p += name_len;
+		if (type != NETFEED_CHANNEL_LOGIC && type != NETFEED_CHANNEL_ANALOG)
+			sr_warn("Channel %s has unknown type %u.", name, type);
+		sr_channel_new(sdi, i, type == NETFEED_CHANNEL_LOGIC ?
+			SR_CHANNEL_LOGIC : SR_CHANNEL_ANALOG, enabled, name);
+		g_free(name);
+	}
+
+	return SR_OK;
+}
+
+SR_PRIV int netfeed_read_header(struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	uint8_t buf[NETFEED_FRAME_LEN], *payload;
+	uint32_t len;
+	int ret;
+
+	devc = sdi->priv;
+
+	ret = recv_all(devc, buf, NETFEED_MAGIC_LEN, NETFEED_TIMEOUT_MS);
+	if (ret != SR_OK)
+		return ret;
+	if (memcmp(buf, NETFEED_MAGIC, NETFEED_MAGIC_LEN)) {
+		sr_err("%s:%s does not serve a netfeed.", devc->address,
+			devc->port);
+		return SR_ERR_DATA;
+	}
+	devc->magic_seen = TRUE;
+
+	ret = recv_all(devc, buf, NETFEED_FRAME_LEN, NETFEED_TIMEOUT_MS);
+	if (ret != SR_OK)
+		return ret;
+	len = read_u32le(buf);
+	if (buf[4] != NETFEED_HEADER || len > NETFEED_MAX_PAYLOAD) {
+		sr_err("Invalid netfeed header.");
+		return SR_ERR_DATA;
+	}
+	payload = g_malloc(len);
+	ret = recv_all(devc, payload, len, NETFEED_TIMEOUT_MS);
+	if (ret == SR_OK && (ret = header_parse(sdi, payload, len)) != SR_OK)
+		sr_err("Invalid netfeed header.");
+	g_free(payload);
+
+	return ret;
+}
+
+static int send_logic(const struct sr_dev_inst *sdi, const uint8_t *p,
+		size_t len)
+{
+	struct dev_context *devc;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	uint64_t samples;
+
+	devc = sdi->priv;
+	if (len < NETFEED_LOGIC_LEN)
+		return SR_ERR_DATA;
+	logic.unitsize = read_u32le_inc(&p);
+	len -= NETFEED_LOGIC_LEN;
+	if (!logic.unitsize)
+		return SR_ERR_DATA;
+
+	samples = len / logic.unitsize;
+	samples = MIN(samples, sr_sw_limits_samples_remaining(&devc->limits));
+	if (!samples)
+		return SR_OK;
+
+	/* The data is passed on from the receive buffer. */
+	logic.length = samples * logic.unitsize;
+	logic.data = (void *)p;
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	sr_session_send(sdi, &packet);
+	sr_sw_limits_update_samples_read(&devc->limits, samples);
+
+	return SR_OK;
+}
+
+static int send_analog(const struct sr_dev_inst *sdi, const uint8_t *p,
+		size_t len)
+{
+	struct dev_context *devc;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	struct sr_channel *ch;
+	const GSList *l;
+	uint32_t index, num;
+	uint64_t samples;
+	int digits;
+
+	devc = sdi->priv;
+	if (len < NETFEED_ANALOG_LEN)
+		return SR_ERR_DATA;
+	index = read_u32le_inc(&p);
+	ch = NULL;
+	for (l = sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->index == (int)index)
+			break;
+	}
+	if (!l)
+		return SR_ERR_DATA;
+
+	num = (len - NETFEED_ANALOG_LEN) / sizeof(float);
+	samples = MIN(num, sr_sw_limits_samples_remaining(&devc->limits));
+	if (!samples)
+		return SR_OK;
+
+	sr_analog_init(&analog, &encoding, &meaning, &spec, 0);
+	meaning.mq = read_u32le_inc(&p);
+	meaning.unit = read_u32le_inc(&p);
+	meaning.mqflags = read_u64le_inc(&p);
+	digits = (int32_t)read_u32le_inc(&p);
+	encoding.digits = spec.spec_digits = digits;
+	encoding.is_bigendian = FALSE;
+	meaning.channels = g_slist_append(NULL, ch);
+
+	/* Receivers may access the samples as floats, which needs alignment. */
+	if ((uintptr_t)p % G_ALIGNOF(float)) {
+		if (devc->fbuf_len < samples) {
+			devc->fbuf = g_realloc(devc->fbuf, samples * sizeof(float));
+			devc->fbuf_len = samples;
+		}
+		memcpy(devc->fbuf, p, samples * sizeof(float));
+		analog.data = devc->fbuf;
+	} else {
+		analog.data = (void *)p;
+	}
+	analog.num_samples = samples;
+	packet.type = SR_DF_ANALOG;
+	packet.payload = &analog;
+	sr_session_send(sdi, &packet);
+	g_slist_free(meaning.channels);
+	sr_sw_limits_update_samples_read(&devc->limits, samples);
+
+	return SR_OK;
+}
+
+static int frame_handle(struct sr_dev_inst *sdi, int type,
+		const uint8_t *payload, size_t len, gboolean *done)
+{
+	struct dev_context *devc;
+
+	devc = sdi->priv;
+
+	switch (type) {
+	case NETFEED_HEADER:
+		return header_parse(sdi, payload, len);
+	case NETFEED_LOGIC:
+		return send_logic(sdi, payload, len);
+	case NETFEED_ANALOG:
+		return send_analog(sdi, payload, len);
+	case NETFEED_SAMPLERATE:
+		if (len < 8)
+			return SR_ERR_DATA;
+		devc->samplerate = read_u64le(payload);
+		return sr_session_send_meta(sdi, SR_CONF_SAMPLERATE,
+			g_variant_new_uint64(devc->samplerate));
+	case NETFEED_TRIGGER:
+		return std_session_send_df_trigger(sdi);
+	case NETFEED_FRAME_BEGIN:
+		return std_session_send_df_frame_begin(sdi);
+	case NETFEED_FRAME_END:
+		return std_session_send_df_frame_end(sdi);
+	case NETFEED_END:
+		sr_info("The remote acquisition ended.");
+		*done = TRUE;
+		return SR_OK;
+	default:
+		/* Newer servers may send more, skip what is unknown. */
+		sr_spew("Skipping netfeed frame of type %d.", type);
+		return SR_OK;
+	}
+}
+
+SR_PRIV int netfeed_receive_data(int fd, int revents, void *cb_data)
+{
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	size_t pos, len, need;
+	gboolean done;
+	ssize_t ret;
+
+	(void)fd;
+
+	if (!(sdi = cb_data) || !(devc = sdi->priv))
+		return TRUE;
+
+	if (!(revents & G_IO_IN)) {
+		if (sr_sw_limits_check(&devc->limits))
+			sr_dev_acquisition_stop(sdi);
+		return TRUE;
+	}
+
+	ret = recv(devc->socket, (char *)devc->buf + devc->buf_len,
+		devc->buf_size - devc->buf_len, 0);
+	if (ret <= 0) {
+		if (ret < 0)
+			sr_err("Receive error: %s", g_strerror(errno));
+		else
+			sr_err("Connection closed by %s:%s.", devc->address,
+				devc->port);
+		sr_dev_acquisition_stop(sdi);
+		return TRUE;
+	}
+	devc->buf_len += ret;
+
+	pos = 0;
+	if (!devc->magic_seen) {
+		if (devc->buf_len < NETFEED_MAGIC_LEN)
+			return TRUE;
+		if (memcmp(devc->buf, NETFEED_MAGIC, NETFEED_MAGIC_LEN)) {
+			sr_err("%s:%s does not serve a netfeed.",
+				devc->address, devc->port);
+			sr_dev_acquisition_stop(sdi);
+			return TRUE;
+		}
+		devc->magic_seen = TRUE;
+		pos = NETFEED_MAGIC_LEN;
+	}
+
+	done = FALSE;
+	need = 0;
+	while (devc->buf_len - pos >= NETFEED_FRAME_LEN) {
+		len = read_u32le(devc->buf + pos);
+		if (len > NETFEED_MAX_PAYLOAD) {
+			sr_err("Invalid netfeed frame length %zu.", len);
+			sr_dev_acquisition_stop(sdi);
+			return TRUE;
+		}
+		if (devc->buf_len - pos - NETFEED_FRAME_LEN < len) {
+			need = NETFEED_FRAME_LEN + len;
+			break;
+		}
+		if (frame_handle(sdi, devc->buf[pos + 4],
+				devc->buf + pos + NETFEED_FRAME_LEN, len,
+				&done) != SR_OK) {
+			sr_err("Invalid netfeed frame of type %u.",
+				devc->buf[pos + 4]);
+			done = TRUE;
+		}
+		pos += NETFEED_FRAME_LEN + len;
+		if (done || sr_sw_limits_check(&devc->limits)) {
+			sr_dev_acquisition_stop(sdi);
+			return TRUE;
+		}
+	}
+
+	/* Keep the partial frame, in a buffer which can hold all of it. */
+	devc->buf_len -= pos;
+	memmove(devc->buf, devc->buf + pos, devc->buf_len);
+	if (need > devc->buf_size) {
+		devc->buf = g_realloc(devc->buf, need);
+		devc->buf_size = need;
+	}
+
+	return TRUE;
+}
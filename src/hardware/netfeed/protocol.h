@@ -0,0 +1,54 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBSIGROK_HARDWARE_NETFEED_PROTOCOL_H
+#define LIBSIGROK_HARDWARE_NETFEED_PROTOCOL_H
+
+#include <stdint.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "netfeed.h"
+
+#define LOG_PREFIX "netfeed"
+
+/* Receive buffer size to start with, grows for larger frames. */
+#define NETFEED_BUFSIZE		(256 * 1024)
+#define NETFEED_TIMEOUT_MS	3000
+
+struct dev_context {
+	char *address;
+	char *port;
+	int socket;
+	uint64_t samplerate;
+	struct sr_sw_limits limits;
+
+	/* Bytes received and not parsed yet. */
+	uint8_t *buf;
+	size_t buf_size;
+	size_t buf_len;
+	gboolean magic_seen;
+	float *fbuf;
+	size_t fbuf_len;
+};
+
+SR_PRIV int netfeed_open(struct dev_context *devc);
+SR_PRIV int netfeed_close(struct dev_context *devc);
+SR_PRIV int netfeed_read_header(struct sr_dev_inst *sdi);
+SR_PRIV int netfeed_receive_data(int fd, int revents, void *cb_data);
+
+#endif
@@ -86,6 +86,14 @@ SR_PRIV void ols_channel_mask(const struct sr_dev_inst *sdi)
 	}
 }
 
+/* The hardware stages match levels, edges get checked in software. */
+static const struct soft_trigger_hw_caps ols_trigger_caps = {
+	.max_stages = NUM_TRIGGER_STAGES,
+	.matches = SOFT_TRIGGER_MATCH(SR_TRIGGER_ZERO) |
+		SOFT_TRIGGER_MATCH(SR_TRIGGER_ONE),
+	.max_edges = -1,
+};
+
 SR_PRIV int ols_convert_trigger(const struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
@@ -102,19 +110,29 @@ SR_PRIV int ols_convert_trigger(const struct sr_dev_inst *sdi)
 		devc->trigger_mask[i] = 0;
 		devc->trigger_value[i] = 0;
 	}
+	soft_trigger_logic_free(devc->stl);
+	devc->stl = NULL;
 
 	if (!(trigger = sr_session_trigger_get(sdi->session)))
 		return SR_OK;
 
-	devc->num_stages = g_slist_length(trigger->stages);
-	if (devc->num_stages > NUM_TRIGGER_STAGES) {
-		sr_err("This device only supports %d trigger stages.",
-				NUM_TRIGGER_STAGES);
-		return SR_ERR;
+	/*
+	 * The hardware takes the leading stages it can express. The rest
+	 * gets checked in the captured samples, from where it fired on.
+	 */
+	devc->num_stages = soft_trigger_hw_stages(trigger, &ols_trigger_caps);
+	if (devc->num_stages < (int)g_slist_length(trigger->stages)) {
+		sr_dbg("Hardware takes %d of %u trigger stages.",
+			devc->num_stages, g_slist_length(trigger->stages));
+		devc->stl = soft_trigger_logic_new_split(sdi, trigger, 4);
+		if (!devc->stl)
+			return SR_ERR;
 	}
 
 	for (l = trigger->stages; l; l = l->next) {
 		stage = l->data;
+		if (stage->stage >= devc->num_stages)
+			break;
 		for (m = stage->matches; m; m = m->next) {
 			match = m->data;
 			if (!match->channel->enabled)
@@ -354,14 +372,223 @@ SR_PRIV int ols_set_samplerate(const struct sr_dev_inst *sdi,
 
 SR_PRIV void abort_acquisition(const struct sr_dev_inst *sdi)
 {
+	struct dev_context *devc;
 	struct sr_serial_dev_inst *serial;
 
+	devc = sdi->priv;
 	serial = sdi->conn;
 	serial_source_remove(sdi->session, serial);
 
+	soft_trigger_logic_free(devc->stl);
+	devc->stl = NULL;
+
 	std_session_send_df_end(sdi);
 }
 
+/*
+ * Store one sample, or the count of the next sample in RLE mode. The
+ * OLS sends its sample buffer backwards, so samples get stored from the
+ * end of the buffer towards its start, and the buffer can be sent as is.
+ */
+static void ols_receive_sample(struct dev_context *devc,
+		int num_ols_changrp, const unsigned char *bytes)
+{
+	unsigned char raw[4], expanded[4], *dst;
+	uint32_t sample;
+	uint64_t count, done, chunk, run;
+	int j;
+	unsigned int i;
+
+	devc->cnt_samples++;
+	devc->cnt_samples_rle++;
+
+	/*
+	 * Got a full sample. Convert from the OLS's little-endian
+	 * sample to the local format.
+	 */
+	memset(raw, 0, sizeof(raw));
+	memcpy(raw, bytes, num_ols_changrp);
+	sample = raw[0] | (raw[1] << 8) | (raw[2] << 16) | ((uint32_t)raw[3] << 24);
+	sr_spew("Received sample 0x%.*x.", num_ols_changrp * 2, sample);
+	if (devc->flag_reg & FLAG_RLE) {
+		/*
+		 * In RLE mode the high bit of the sample is the
+		 * "count" flag, meaning this sample is the number
+		 * of times the previous sample occurred.
+		 */
+		if (raw[num_ols_changrp - 1] & 0x80) {
+			/* Clear the high bit. */
+			sample &= ~((uint32_t)0x80 << (num_ols_changrp - 1) * 8);
+			devc->rle_count = sample;
+			devc->cnt_samples_rle += devc->rle_count;
+			sr_spew("RLE count: %u.", devc->rle_count);
+			return;
+		}
+	}
+	devc->num_samples += devc->rle_count + 1;
+	if (devc->num_samples > devc->limit_samples) {
+		/* Save us from overrunning the buffer. */
+		devc->rle_count -= devc->num_samples - devc->limit_samples;
+		devc->num_samples = devc->limit_samples;
+	}
+
+	if (num_ols_changrp < 4) {
+		/*
+		 * Some channel groups may have been turned
+		 * off, to speed up transfer between the
+		 * hardware and the PC. Expand that here before
+		 * submitting it over the session bus --
+		 * whatever is listening on the bus will be
+		 * expecting a full 32-bit sample, based on
+		 * the number of channels.
+		 */
+		j = 0;
+		memset(expanded, 0, sizeof(expanded));
+		for (i = 0; i < 4; i++) {
+			if (((devc->flag_reg >> 2) & (1 << i)) == 0) {
+				/*
+				 * This channel group was
+				 * enabled, copy from received
+				 * sample.
+				 */
+				expanded[i] = raw[j++];
+			} else if (devc->flag_reg & FLAG_DEMUX && (i > 2)) {
+				/* group 2 & 3 get added to 0 & 1 */
+				expanded[i - 2] = raw[j++];
+			}
+		}
+		memcpy(raw, expanded, sizeof(raw));
+	}
+
+	count = devc->rle_count + 1;
+	devc->rle_count = 0;
+
+	if (devc->rle_values) {
+		/* Keep the run as is, the frontend takes RLE packets. */
+		run = devc->limit_samples - ++devc->num_runs;
+		memcpy(devc->rle_values + run * 4, raw, 4);
+		devc->rle_counts[run] = count;
+		return;
+	}
+
+	/* Doubling copies of the sample fill long runs quickly. */
+	dst = devc->raw_sample_buf +
+		(devc->limit_samples - devc->num_samples) * 4;
+	memcpy(dst, raw, 4);
+	for (done = 1; done < count; done += chunk) {
+		chunk = MIN(done, count - done);
+		memcpy(dst + done * 4, dst, chunk * 4);
+	}
+}
+
+static void ols_receive_byte(const struct sr_dev_inst *sdi,
+		int num_ols_changrp, unsigned char byte)
+{
+	struct dev_context *devc;
+
+	devc = sdi->priv;
+
+	/* Ignore it if we've read enough. */
+	if (devc->num_samples >= devc->limit_samples)
+		return;
+
+	devc->sample[devc->num_bytes++] = byte;
+	if (devc->num_bytes == num_ols_changrp) {
+		ols_receive_sample(devc, num_ols_changrp, devc->sample);
+		devc->num_bytes = 0;
+	}
+}
+
+static void send_runs(const struct sr_dev_inst *sdi, uint64_t first,
+		uint64_t num_runs)
+{
+	struct dev_context *devc;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic_rle rle;
+
+	devc = sdi->priv;
+
+	packet.type = SR_DF_LOGIC_RLE;
+	packet.payload = &rle;
+	rle.num_runs = num_runs;
+	rle.unitsize = 4;
+	rle.values = devc->rle_values + first * 4;
+	rle.counts = devc->rle_counts + first;
+	sr_session_send(sdi, &packet);
+}
+
+/* Send the runs, with the trigger (if any) splitting the run it is in. */
+static void send_rle_samples(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	uint64_t first, end, run, pre, count;
+
+	devc = sdi->priv;
+
+	end = devc->limit_samples;
+	first = end - devc->num_runs;
+	if (devc->trigger_at == -1) {
+		send_runs(sdi, first, end - first);
+		return;
+	}
+
+	pre = 0;
+	for (run = first; run < end; run++) {
+		if (pre + devc->rle_counts[run] > (uint64_t)devc->trigger_at)
+			break;
+		pre += devc->rle_counts[run];
+	}
+	if (run < end && pre < (uint64_t)devc->trigger_at) {
+		count = devc->rle_counts[run];
+		devc->rle_counts[run] = devc->trigger_at - pre;
+		send_runs(sdi, first, run + 1 - first);
+		devc->rle_counts[run] = count - devc->rle_counts[run];
+	} else if (run > first) {
+		send_runs(sdi, first, run - first);
+	}
+
+	std_session_send_df_trigger(sdi);
+
+	if (run < end)
+		send_runs(sdi, run, end - run);
+}
+
+/*
+ * Move the trigger position to where the stages which the hardware did
+ * not take matched, after the hardware fired. Without a match in the
+ * captured samples, there is no trigger.
+ */
+static void locate_soft_trigger(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	const uint8_t *samples;
+	int start, offset;
+
+	devc = sdi->priv;
+	if (!devc->raw_sample_buf)
+		return;
+
+	samples = devc->raw_sample_buf +
+		(devc->limit_samples - devc->num_samples) * 4;
+	start = 0;
+	if (devc->num_stages > 0) {
+		if (devc->trigger_at < 0 ||
+				(unsigned int)devc->trigger_at >= devc->num_samples) {
+			devc->trigger_at = -1;
+			return;
+		}
+		soft_trigger_logic_hw_fired(devc->stl,
+			samples + devc->trigger_at * 4, devc->num_stages);
+		start = devc->trigger_at + 1;
+	}
+
+	offset = soft_trigger_logic_scan(devc->stl, samples + start * 4,
+		(devc->num_samples - start) * 4);
+	devc->trigger_at = offset < 0 ? -1 : start + offset;
+	sr_dbg("Soft trigger stages %s.", offset < 0 ? "did not match" :
+		"matched");
+}
+
 SR_PRIV int ols_receive_data(int fd, int revents, void *cb_data)
 {
 	struct dev_context *devc;
@@ -369,10 +596,10 @@ SR_PRIV int ols_receive_data(int fd, int revents, void *cb_data)
 	struct sr_serial_dev_inst *serial;
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
-	uint32_t sample;
-	int num_ols_changrp, offset, j;
+	const uint8_t *data;
+	size_t len, pos;
+	int num_ols_changrp;
 	unsigned int i;
-	unsigned char byte;
 
 	(void)fd;
 
@@ -386,13 +613,29 @@ SR_PRIV int ols_receive_data(int fd, int revents, void *cb_data)
 	}
 
 	if (devc->num_transfers++ == 0) {
-		devc->raw_sample_buf = g_try_malloc(devc->limit_samples * 4);
-		if (!devc->raw_sample_buf) {
-			sr_err("Sample buffer malloc failed.");
-			return FALSE;
+		devc->num_runs = 0;
+		if ((devc->flag_reg & FLAG_RLE) && !devc->stl &&
+				sr_session_takes_logic_rle(sdi->session)) {
+			devc->rle_values = g_try_malloc(devc->limit_samples * 4);
+			devc->rle_counts = g_try_malloc(devc->limit_samples *
+				sizeof(uint64_t));
+			if (!devc->rle_values || !devc->rle_counts) {
+				sr_err("Sample buffer malloc failed.");
+				g_free(devc->rle_values);
+				devc->rle_values = NULL;
+				g_free(devc->rle_counts);
+				devc->rle_counts = NULL;
+				return FALSE;
+			}
+		} else {
+			devc->raw_sample_buf = g_try_malloc(devc->limit_samples * 4);
+			if (!devc->raw_sample_buf) {
+				sr_err("Sample buffer malloc failed.");
+				return FALSE;
+			}
+			/* fill with 1010... for debugging */
+			memset(devc->raw_sample_buf, 0x82, devc->limit_samples * 4);
 		}
-		/* fill with 1010... for debugging */
-		memset(devc->raw_sample_buf, 0x82, devc->limit_samples * 4);
 	}
 
 	num_ols_changrp = 0;
@@ -403,92 +646,23 @@ SR_PRIV int ols_receive_data(int fd, int revents, void *cb_data)
 	}
 
 	if (revents == G_IO_IN && devc->num_samples < devc->limit_samples) {
-		if (serial_read_nonblocking(serial, &byte, 1) != 1)
+		/* Parse all the data that came in, in place. */
+		if (serial_peek(serial, &data, &len) != SR_OK || len == 0)
 			return FALSE;
-		devc->cnt_bytes++;
-
-		/* Ignore it if we've read enough. */
-		if (devc->num_samples >= devc->limit_samples)
-			return TRUE;
-
-		devc->sample[devc->num_bytes++] = byte;
-		sr_spew("Received byte 0x%.2x.", byte);
-		if (devc->num_bytes == num_ols_changrp) {
-			devc->cnt_samples++;
-			devc->cnt_samples_rle++;
-			/*
-			 * Got a full sample. Convert from the OLS's little-endian
-			 * sample to the local format.
-			 */
-			sample = devc->sample[0] | (devc->sample[1] << 8) \
-					| (devc->sample[2] << 16) | (devc->sample[3] << 24);
-			sr_dbg("Received sample 0x%.*x.", devc->num_bytes * 2, sample);
-			if (devc->flag_reg & FLAG_RLE) {
-				/*
-				 * In RLE mode the high bit of the sample is the
-				 * "count" flag, meaning this sample is the number
-				 * of times the previous sample occurred.
-				 */
-				if (devc->sample[devc->num_bytes - 1] & 0x80) {
-					/* Clear the high bit. */
-					sample &= ~(0x80 << (devc->num_bytes - 1) * 8);
-					devc->rle_count = sample;
-					devc->cnt_samples_rle += devc->rle_count;
-					sr_dbg("RLE count: %u.", devc->rle_count);
-					devc->num_bytes = 0;
-					return TRUE;
-				}
-			}
-			devc->num_samples += devc->rle_count + 1;
-			if (devc->num_samples > devc->limit_samples) {
-				/* Save us from overrunning the buffer. */
-				devc->rle_count -= devc->num_samples - devc->limit_samples;
-				devc->num_samples = devc->limit_samples;
-			}
-
-			if (num_ols_changrp < 4) {
-				/*
-				 * Some channel groups may have been turned
-				 * off, to speed up transfer between the
-				 * hardware and the PC. Expand that here before
-				 * submitting it over the session bus --
-				 * whatever is listening on the bus will be
-				 * expecting a full 32-bit sample, based on
-				 * the number of channels.
-				 */
-				j = 0;
-				memset(devc->tmp_sample, 0, 4);
-				for (i = 0; i < 4; i++) {
-					if (((devc->flag_reg >> 2) & (1 << i)) == 0) {
-						/*
-						 * This channel group was
-						 * enabled, copy from received
-						 * sample.
-						 */
-						devc->tmp_sample[i] = devc->sample[j++];
-					} else if (devc->flag_reg & FLAG_DEMUX && (i > 2)) {
-						/* group 2 & 3 get added to 0 & 1 */
-						devc->tmp_sample[i - 2] = devc->sample[j++];
-					}
-				}
-				memcpy(devc->sample, devc->tmp_sample, 4);
-				sr_spew("Expanded sample: 0x%.8x.", sample);
-			}
-
-			/*
-			 * the OLS sends its sample buffer backwards.
-			 * store it in reverse order here, so we can dump
-			 * this on the session bus later.
-			 */
-			offset = (devc->limit_samples - devc->num_samples) * 4;
-			for (i = 0; i <= devc->rle_count; i++) {
-				memcpy(devc->raw_sample_buf + offset + (i * 4),
-				       devc->sample, 4);
-			}
-			memset(devc->sample, 0, 4);
-			devc->num_bytes = 0;
-			devc->rle_count = 0;
+		devc->cnt_bytes += len;
+		pos = 0;
+		/* Complete the sample which the previous read left partial. */
+		while (pos < len && devc->num_bytes > 0)
+			ols_receive_byte(sdi, num_ols_changrp, data[pos++]);
+		/* Decode whole samples straight from the receive buffer. */
+		while (len - pos >= (size_t)num_ols_changrp &&
+				devc->num_samples < devc->limit_samples) {
+			ols_receive_sample(devc, num_ols_changrp, &data[pos]);
+			pos += num_ols_changrp;
 		}
+		while (pos < len)
+			ols_receive_byte(sdi, num_ols_changrp, data[pos++]);
+		serial_consume(serial, len);
 	} else {
 		/*
 		 * This is the main loop telling us a timeout was reached, or
@@ -498,7 +672,11 @@ SR_PRIV int ols_receive_data(int fd, int revents, void *cb_data)
 		sr_dbg("Received %d bytes, %d samples, %d decompressed samples.",
 				devc->cnt_bytes, devc->cnt_samples,
 				devc->cnt_samples_rle);
-		if (devc->trigger_at != -1) {
+		if (devc->stl)
+			locate_soft_trigger(sdi);
+		if (devc->rle_values) {
+			send_rle_samples(sdi);
+		} else if (devc->trigger_at != -1) {
 			/*
 			 * A trigger was set up, so we need to tell the frontend
 			 * about it.
@@ -536,6 +714,11 @@ SR_PRIV int ols_receive_data(int fd, int revents, void *cb_data)
 			sr_session_send(sdi, &packet);
 		}
 		g_free(devc->raw_sample_buf);
+		devc->raw_sample_buf = NULL;
+		g_free(devc->rle_values);
+		devc->rle_values = NULL;
+		g_free(devc->rle_counts);
+		devc->rle_counts = NULL;
 
 		serial_flush(serial);
 		abort_acquisition(sdi);
@@ -81,6 +81,8 @@ struct dev_context {
 	uint32_t trigger_mask[NUM_TRIGGER_STAGES];
 	uint32_t trigger_value[NUM_TRIGGER_STAGES];
 	int num_stages;
+	/* Checks the trigger stages which the hardware cannot, or NULL. */
+	struct soft_trigger_logic *stl;
 	uint16_t flag_reg;
 
 	unsigned int num_transfers;
@@ -92,8 +94,12 @@ struct dev_context {
 
 	unsigned int rle_count;
 	unsigned char sample[4];
-	unsigned char tmp_sample[4];
 	unsigned char *raw_sample_buf;
+
+	/* RLE passthrough: one value and count per run, stored backwards. */
+	unsigned char *rle_values;
+	uint64_t *rle_counts;
+	uint64_t num_runs;
 };
 
 SR_PRIV extern const char *ols_channel_names[];
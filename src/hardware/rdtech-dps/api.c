@@ -163,70 +163,94 @@ static int dev_close(struct sr_dev_inst *sdi)
 	return sr_modbus_close(modbus);
 }
 
+/*
+ * All registers of a register block (0x00-0x0C, 0x50-0x5F) can be read,
+ * the blocks are farther apart than this.
+ */
+#define MAX_REGISTER_GAP 16
+
+/* The register which holds a key's value, or -1. */
+static int key_register(uint32_t key)
+{
+	switch (key) {
+	case SR_CONF_ENABLED:
+		return REG_ENABLE;
+	case SR_CONF_REGULATION:
+		return REG_CV_CC;
+	case SR_CONF_VOLTAGE:
+		return REG_UOUT;
+	case SR_CONF_VOLTAGE_TARGET:
+		return REG_USET;
+	case SR_CONF_CURRENT:
+		return REG_IOUT;
+	case SR_CONF_CURRENT_LIMIT:
+		return REG_ISET;
+	case SR_CONF_OVER_VOLTAGE_PROTECTION_ACTIVE:
+	case SR_CONF_OVER_CURRENT_PROTECTION_ACTIVE:
+		return REG_PROTECT;
+	case SR_CONF_OVER_VOLTAGE_PROTECTION_THRESHOLD:
+		return PRE_OVPSET;
+	case SR_CONF_OVER_CURRENT_PROTECTION_THRESHOLD:
+		return PRE_OCPSET;
+	default:
+		return -1;
+	}
+}
+
+static GVariant *register_value(const struct dev_context *devc,
+	uint32_t key, uint16_t ivalue)
+{
+	switch (key) {
+	case SR_CONF_ENABLED:
+		return g_variant_new_boolean(ivalue);
+	case SR_CONF_REGULATION:
+		return g_variant_new_string((ivalue == MODE_CC) ? "CC" : "CV");
+	case SR_CONF_VOLTAGE:
+	case SR_CONF_VOLTAGE_TARGET:
+	case SR_CONF_OVER_VOLTAGE_PROTECTION_THRESHOLD:
+		return g_variant_new_double((float)ivalue / devc->voltage_multiplier);
+	case SR_CONF_CURRENT:
+	case SR_CONF_CURRENT_LIMIT:
+	case SR_CONF_OVER_CURRENT_PROTECTION_THRESHOLD:
+		return g_variant_new_double((float)ivalue / devc->current_multiplier);
+	case SR_CONF_OVER_VOLTAGE_PROTECTION_ACTIVE:
+		return g_variant_new_boolean(ivalue == STATE_OVP);
+	case SR_CONF_OVER_CURRENT_PROTECTION_ACTIVE:
+		return g_variant_new_boolean(ivalue == STATE_OCP);
+	default:
+		return NULL;
+	}
+}
+
 static int config_get(uint32_t key, GVariant **data,
 	const struct sr_dev_inst *sdi, const struct sr_channel_group *cg)
 {
 	struct dev_context *devc;
-	int ret;
+	int reg, ret;
 	uint16_t ivalue;
 
 	(void)cg;
 
 	devc = sdi->priv;
 
+	if ((reg = key_register(key)) >= 0) {
+		if ((ret = rdtech_dps_get_reg(sdi, reg, &ivalue)) == SR_OK)
+			*data = register_value(devc, key, ivalue);
+		return ret;
+	}
+
 	ret = SR_OK;
 	switch (key) {
 	case SR_CONF_LIMIT_SAMPLES:
 	case SR_CONF_LIMIT_MSEC:
 		ret = sr_sw_limits_config_get(&devc->limits, key, data);
 		break;
-	case SR_CONF_ENABLED:
-		if ((ret = rdtech_dps_get_reg(sdi, REG_ENABLE, &ivalue)) == SR_OK)
-			*data = g_variant_new_boolean(ivalue);
-		break;
-	case SR_CONF_REGULATION:
-		if ((ret = rdtech_dps_get_reg(sdi, REG_CV_CC, &ivalue)) != SR_OK)
-			break;
-		*data = g_variant_new_string((ivalue == MODE_CC) ? "CC" : "CV");
-		break;
-	case SR_CONF_VOLTAGE:
-		if ((ret = rdtech_dps_get_reg(sdi, REG_UOUT, &ivalue)) == SR_OK)
-			*data = g_variant_new_double((float)ivalue / devc->voltage_multiplier);
-		break;
-	case SR_CONF_VOLTAGE_TARGET:
-		if ((ret = rdtech_dps_get_reg(sdi, REG_USET, &ivalue)) == SR_OK)
-			*data = g_variant_new_double((float)ivalue / devc->voltage_multiplier);
-		break;
-	case SR_CONF_CURRENT:
-		if ((ret = rdtech_dps_get_reg(sdi, REG_IOUT, &ivalue)) == SR_OK)
-			*data = g_variant_new_double((float)ivalue / devc->current_multiplier);
-		break;
-	case SR_CONF_CURRENT_LIMIT:
-		if ((ret = rdtech_dps_get_reg(sdi, REG_ISET, &ivalue)) == SR_OK)
-			*data = g_variant_new_double((float)ivalue / devc->current_multiplier);
-		break;
 	case SR_CONF_OVER_VOLTAGE_PROTECTION_ENABLED:
 		*data = g_variant_new_boolean(TRUE);
 		break;
-	case SR_CONF_OVER_VOLTAGE_PROTECTION_ACTIVE:
-		if ((ret = rdtech_dps_get_reg(sdi, REG_PROTECT, &ivalue)) == SR_OK)
-			*data = g_variant_new_boolean(ivalue == STATE_OVP);
-		break;
-	case SR_CONF_OVER_VOLTAGE_PROTECTION_THRESHOLD:
-		if ((ret = rdtech_dps_get_reg(sdi, PRE_OVPSET, &ivalue)) == SR_OK)
-			*data = g_variant_new_double((float)ivalue / devc->voltage_multiplier);
-		break;
 	case SR_CONF_OVER_CURRENT_PROTECTION_ENABLED:
 		*data = g_variant_new_boolean(TRUE);
 		break;
-	case SR_CONF_OVER_CURRENT_PROTECTION_ACTIVE:
-		if ((ret = rdtech_dps_get_reg(sdi, REG_PROTECT, &ivalue)) == SR_OK)
-			*data = g_variant_new_boolean(ivalue == STATE_OCP);
-		break;
-	case SR_CONF_OVER_CURRENT_PROTECTION_THRESHOLD:
-		if ((ret = rdtech_dps_get_reg(sdi, PRE_OCPSET, &ivalue)) == SR_OK)
-			*data = g_variant_new_double((float)ivalue / devc->current_multiplier);
-		break;
 	default:
 		return SR_ERR_NA;
 	}
@@ -234,6 +258,62 @@ static int config_get(uint32_t key, GVariant **data,
 	return ret;
 }
 
+/* Read the registers of all keys with as few Modbus requests as possible. */
+static int config_get_multi(struct sr_config *configs, unsigned int num,
+	int *results, const struct sr_dev_inst *sdi,
+	const struct sr_channel_group *cg)
+{
+	struct dev_context *devc;
+	struct sr_modbus_read *reads;
+	uint16_t *values;
+	unsigned int *index, i, n;
+	int reg, tries;
+
+	if (!sdi)
+		return SR_ERR_NA;
+
+	devc = sdi->priv;
+
+	reads = g_malloc(num * sizeof(*reads));
+	values = g_malloc(num * sizeof(*values));
+	index = g_malloc(num * sizeof(*index));
+
+	n = 0;
+	for (i = 0; i < num; i++) {
+		if (results[i] != SR_OK)
+			continue;
+		if ((reg = key_register(configs[i].key)) < 0) {
+			results[i] = config_get(configs[i].key,
+				&configs[i].data, sdi, cg);
+			continue;
+		}
+		reads[n].address = reg;
+		reads[n].nb_registers = 1;
+		reads[n].registers = &values[n];
+		index[n++] = i;
+	}
+
+	g_mutex_lock(&devc->rw_mutex);
+	tries = 0;
+	while (sr_modbus_read_holding_registers_multi(sdi->conn, reads, n,
+			MAX_REGISTER_GAP) != SR_OK && ++tries < 3)
+		;
+	g_mutex_unlock(&devc->rw_mutex);
+
+	for (i = 0; i < n; i++) {
+		results[index[i]] = reads[i].result;
+		if (reads[i].result == SR_OK)
+			configs[index[i]].data = register_value(devc,
+				configs[index[i]].key, RB16(&values[i]));
+	}
+
+	g_free(index);
+	g_free(values);
+	g_free(reads);
+
+	return SR_OK;
+}
+
 static int config_set(uint32_t key, GVariant *data,
 	const struct sr_dev_inst *sdi, const struct sr_channel_group *cg)
 {
@@ -349,6 +429,7 @@ static struct sr_dev_driver rdtech_dps_driver_info = {
 	.config_get = config_get,
 	.config_set = config_set,
 	.config_list = config_list,
+	.config_get_multi = config_get_multi,
 	.dev_open = dev_open,
 	.dev_close = dev_close,
 	.dev_acquisition_start = dev_acquisition_start,
@@ -142,7 +142,10 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	sr_sw_limits_acquisition_start(&devc->limits);
 	std_session_send_df_header(sdi);
 
-	serial_source_add(sdi->session, serial, G_IO_IN, 50,
+	/* Requests and their timeouts wake up the source when due. */
+	bv_poller_init(&devc->poller, RDTECH_TC_POLL_PERIOD_MS,
+		       RDTECH_TC_TIMEOUT_MS);
+	serial_source_add(sdi->session, serial, G_IO_IN, RDTECH_TC_TIMEOUT_MS,
 			  rdtech_tc_receive_data, (void *)sdi);
 
 	return rdtech_tc_poll(sdi);
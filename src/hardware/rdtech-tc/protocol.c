@@ -30,8 +30,6 @@
 #define SERIAL_WRITE_TIMEOUT_MS 1
 
 #define TC_POLL_LEN 192
-#define TC_POLL_PERIOD_MS 100
-#define TC_TIMEOUT_MS 1000
 
 static const char POLL_CMD[] = "getva";
 
@@ -126,7 +124,7 @@ SR_PRIV int rdtech_tc_probe(struct sr_serial_dev_inst *serial, struct dev_contex
 		return SR_ERR;
 	}
 
-	len = serial_read_blocking(serial, devc->buf, TC_POLL_LEN, TC_TIMEOUT_MS);
+	len = serial_read_blocking(serial, devc->buf, TC_POLL_LEN, RDTECH_TC_TIMEOUT_MS);
 	if (len != TC_POLL_LEN) {
 		sr_err("Failed to read probe response.");
 		return SR_ERR;
@@ -156,7 +154,7 @@ SR_PRIV int rdtech_tc_poll(const struct sr_dev_inst *sdi)
 		return SR_ERR;
 	}
 
-	devc->cmd_sent_at = g_get_monotonic_time() / 1000;
+	bv_poller_sent(&devc->poller);
 
 	return SR_OK;
 }
@@ -165,8 +163,6 @@ static void handle_poll_data(const struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc = sdi->priv;
 	uint8_t poll_pkt[TC_POLL_LEN];
-	int i;
-	GSList *ch;
 
 	sr_spew("Received poll packet (len: %d).", devc->buflen);
 	if (devc->buflen != TC_POLL_LEN) {
@@ -179,10 +175,7 @@ static void handle_poll_data(const struct sr_dev_inst *sdi)
 		return;
 	}
 
-	for (ch = sdi->channels, i = 0; ch; ch = g_slist_next(ch), i++) {
-		bv_send_analog_channel(sdi, ch->data,
-				       &devc->channels[i], poll_pkt, TC_POLL_LEN);
-        }
+	bv_send_analog_channels(sdi, devc->channels, poll_pkt, TC_POLL_LEN);
 
 	sr_sw_limits_update_samples_read(&devc->limits, 1);
 }
@@ -194,17 +187,19 @@ static void recv_poll_data(struct sr_dev_inst *sdi, struct sr_serial_dev_inst *s
 
 	/* Serial data arrived. */
 	while (devc->buflen < TC_POLL_LEN) {
-		len = serial_read_nonblocking(serial, devc->buf + devc->buflen, 1);
+		len = serial_read_nonblocking(serial, devc->buf + devc->buflen,
+					      TC_POLL_LEN - devc->buflen);
 		if (len < 1)
 			return;
 
-		devc->buflen++;
+		devc->buflen += len;
 	}
 
 	if (devc->buflen == TC_POLL_LEN)
 		handle_poll_data(sdi);
 
 	devc->buflen = 0;
+	bv_poller_done(&devc->poller);
 }
 
 SR_PRIV int rdtech_tc_receive_data(int fd, int revents, void *cb_data)
@@ -212,7 +207,6 @@ SR_PRIV int rdtech_tc_receive_data(int fd, int revents, void *cb_data)
 	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
 	struct sr_serial_dev_inst *serial;
-	int64_t now, elapsed;
 
 	(void)fd;
 
@@ -231,10 +225,7 @@ SR_PRIV int rdtech_tc_receive_data(int fd, int revents, void *cb_data)
 		return TRUE;
 	}
 
-	now = g_get_monotonic_time() / 1000;
-	elapsed = now - devc->cmd_sent_at;
-
-	if (elapsed > TC_POLL_PERIOD_MS)
+	if (bv_poller_due(&devc->poller))
 		rdtech_tc_poll(sdi);
 
 	return TRUE;
@@ -26,6 +26,8 @@
 #define LOG_PREFIX "rdtech-tc"
 
 #define RDTECH_TC_BUFSIZE 256
+#define RDTECH_TC_POLL_PERIOD_MS 100
+#define RDTECH_TC_TIMEOUT_MS 1000
 
 struct rdtech_dev_info {
 	char *model_name;
@@ -40,7 +42,7 @@ struct dev_context {
 
 	uint8_t buf[RDTECH_TC_BUFSIZE];
 	int buflen;
-	int64_t cmd_sent_at;
+	struct bv_poller poller;
 };
 
 SR_PRIV int rdtech_tc_probe(struct sr_serial_dev_inst *serial, struct dev_context  *devc);
@@ -29,8 +29,6 @@
 #define SERIAL_WRITE_TIMEOUT_MS 1
 
 #define UM_POLL_LEN 130
-#define UM_POLL_PERIOD_MS 100
-#define UM_TIMEOUT_MS 1000
 
 #define UM_CMD_POLL 0xf0
 
@@ -112,7 +110,7 @@ SR_PRIV const struct rdtech_um_profile *rdtech_um_probe(struct sr_serial_dev_ins
 		return NULL;
 	}
 
-	len = serial_read_blocking(serial, buf, UM_POLL_LEN, UM_TIMEOUT_MS);
+	len = serial_read_blocking(serial, buf, UM_POLL_LEN, RDTECH_UM_TIMEOUT_MS);
 	if (len != UM_POLL_LEN) {
 		sr_err("Failed to read probe response.");
 		return NULL;
@@ -144,7 +142,7 @@ SR_PRIV int rdtech_um_poll(const struct sr_dev_inst *sdi)
 		return SR_ERR;
 	}
 
-	devc->cmd_sent_at = g_get_monotonic_time() / 1000;
+	bv_poller_sent(&devc->poller);
 
 	return SR_OK;
 }
@@ -152,8 +150,6 @@ SR_PRIV int rdtech_um_poll(const struct sr_dev_inst *sdi)
 static void handle_poll_data(const struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc = sdi->priv;
-	int i;
-	GSList *ch;
 
 	sr_spew("Received poll packet (len: %d).", devc->buflen);
 	if (devc->buflen != UM_POLL_LEN) {
@@ -161,10 +157,8 @@ static void handle_poll_data(const struct sr_dev_inst *sdi)
 		return;
 	}
 
-	for (ch = sdi->channels, i = 0; ch; ch = g_slist_next(ch), i++)
-		bv_send_analog_channel(sdi, ch->data,
-				       &devc->profile->channels[i],
-				       devc->buf, devc->buflen);
+	bv_send_analog_channels(sdi, devc->profile->channels,
+				devc->buf, devc->buflen);
 
 	sr_sw_limits_update_samples_read(&devc->limits, 1);
 }
@@ -177,14 +171,15 @@ static void recv_poll_data(struct sr_dev_inst *sdi, struct sr_serial_dev_inst *s
 
 	/* Serial data arrived. */
 	while (devc->buflen < UM_POLL_LEN) {
-		len = serial_read_nonblocking(serial, devc->buf + devc->buflen, 1);
+		len = serial_read_nonblocking(serial, devc->buf + devc->buflen,
+					      UM_POLL_LEN - devc->buflen);
 		if (len < 1)
 			return;
 
-		devc->buflen++;
+		devc->buflen += len;
 
 		/* Check if the poll model ID matches the profile. */
-		if (devc->buflen == 2 && RB16(devc->buf) != p->model_id) {
+		while (devc->buflen >= 2 && RB16(devc->buf) != p->model_id) {
 			sr_warn("Illegal model ID in poll response (0x%.4" PRIx16 "),"
 				" skipping 1 byte.",
 				RB16(devc->buf));
@@ -199,6 +194,7 @@ static void recv_poll_data(struct sr_dev_inst *sdi, struct sr_serial_dev_inst *s
 		sr_warn("Skipping packet with illegal checksum / end marker.");
 
 	devc->buflen = 0;
+	bv_poller_done(&devc->poller);
 }
 
 SR_PRIV int rdtech_um_receive_data(int fd, int revents, void *cb_data)
@@ -206,7 +202,6 @@ SR_PRIV int rdtech_um_receive_data(int fd, int revents, void *cb_data)
 	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
 	struct sr_serial_dev_inst *serial;
-	int64_t now, elapsed;
 
 	(void)fd;
 
@@ -225,10 +220,7 @@ SR_PRIV int rdtech_um_receive_data(int fd, int revents, void *cb_data)
 		return TRUE;
 	}
 
-	now = g_get_monotonic_time() / 1000;
-	elapsed = now - devc->cmd_sent_at;
-
-	if (elapsed > UM_POLL_PERIOD_MS)
+	if (bv_poller_due(&devc->poller))
 		rdtech_um_poll(sdi);
 
 	return TRUE;
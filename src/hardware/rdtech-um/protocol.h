@@ -26,6 +26,8 @@
 #define LOG_PREFIX "rdtech-um"
 
 #define RDTECH_UM_BUFSIZE 256
+#define RDTECH_UM_POLL_PERIOD_MS 100
+#define RDTECH_UM_TIMEOUT_MS 1000
 
 enum rdtech_um_model_id {
 	RDTECH_UM24C = 0x0963,
@@ -54,7 +56,7 @@ struct dev_context {
 
 	char buf[RDTECH_UM_BUFSIZE];
 	int buflen;
-	int64_t cmd_sent_at;
+	struct bv_poller poller;
 };
 
 SR_PRIV const struct rdtech_um_profile *rdtech_um_probe(struct sr_serial_dev_inst *serial);
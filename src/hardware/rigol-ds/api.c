@@ -299,12 +299,12 @@ static void clear_helper(struct dev_context *devc)
 {
 	unsigned int i;
 
-	g_free(devc->data);
 	g_free(devc->buffer);
 	for (i = 0; i < ARRAY_SIZE(devc->coupling); i++)
 		g_free(devc->coupling[i]);
 	g_free(devc->trigger_source);
 	g_free(devc->trigger_slope);
+	sr_analog_interleave_free(devc->interleave);
 	g_free(devc->analog_groups);
 }
 
@@ -433,7 +433,6 @@ static struct sr_dev_inst *probe_device(struct sr_scpi_dev_inst *scpi)
 	}
 
 	devc->buffer = g_malloc(ACQ_BUFFER_SIZE);
-	devc->data = g_malloc(ACQ_BUFFER_SIZE * sizeof(float));
 
 	devc->data_source = DATA_SOURCE_LIVE;
 
@@ -879,7 +878,7 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	struct dev_context *devc;
 	struct sr_channel *ch;
 	gboolean some_digital;
-	GSList *l;
+	GSList *l, *analog_channels;
 	char *cmd;
 	int protocol;
 
@@ -889,6 +888,8 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 
 	devc->num_frames = 0;
 	devc->num_frames_segmented = 0;
+	devc->block_size = ACQ_BLOCK_SIZE;
+	devc->wav_start = devc->wav_stop = 0;
 
 	some_digital = FALSE;
 	for (l = sdi->channels; l; l = l->next) {
@@ -988,6 +989,26 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	devc->analog_frame_size = analog_frame_size(sdi);
 	devc->digital_frame_size = digital_frame_size(sdi);
 
+	/*
+	 * Collect the analog channels of a frame into one packet when the
+	 * session takes those, unless the frame is too deep to hold.
+	 */
+	sr_analog_interleave_free(devc->interleave);
+	devc->interleave = NULL;
+	analog_channels = NULL;
+	for (l = devc->enabled_channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->type == SR_CHANNEL_ANALOG)
+			analog_channels = g_slist_append(analog_channels, ch);
+	}
+	if (sr_session_takes_analog_interleaved(sdi->session) &&
+			g_slist_length(analog_channels) > 1 &&
+			devc->analog_frame_size * g_slist_length(analog_channels) <=
+			MAX_INTERLEAVED_VALUES)
+		devc->interleave = sr_analog_interleave_new(analog_channels,
+			devc->analog_frame_size);
+	g_slist_free(analog_channels);
+
 	switch (devc->model->series->protocol) {
 	case PROTOCOL_V2:
 		if (rigol_ds_config_set(sdi, ":ACQ:MEMD LONG") != SR_OK)
@@ -1054,6 +1075,8 @@ static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 
 	g_slist_free(devc->enabled_channels);
 	devc->enabled_channels = NULL;
+	sr_analog_interleave_free(devc->interleave);
+	devc->interleave = NULL;
 	scpi = sdi->conn;
 	sr_scpi_source_remove(sdi->session, scpi);
 
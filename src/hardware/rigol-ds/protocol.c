@@ -27,7 +27,6 @@
 #include <string.h>
 #include <math.h>
 #include <ctype.h>
-#include <time.h>
 #include <glib.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
@@ -98,23 +97,24 @@ static void rigol_ds_set_wait_event(struct dev_context *devc, enum wait_events e
 	else
 		devc->wait_status = 1;
 	devc->wait_event = event;
+	devc->wait_until = 0;
 }
 
 /*
- * Waiting for a event will return a timeout after 2 to 3 seconds in order
- * to not block the application.
+ * The waits below don't block. Each call does at most one status request,
+ * and returns SR_ERR_TIMEOUT while the event has not happened yet. Then
+ * rigol_ds_receive() tries again when the session next calls it, so that
+ * the session (and other devices in it) keep running in the meantime.
  */
 static int rigol_ds_event_wait(const struct sr_dev_inst *sdi, char status1, char status2)
 {
 	char *buf;
 	struct dev_context *devc;
-	time_t start;
+	gboolean done;
 
 	if (!(devc = sdi->priv))
 		return SR_ERR;
 
-	start = time(NULL);
-
 	/*
 	 * Trigger status may return:
 	 * "TD" or "T'D" - triggered
@@ -123,33 +123,21 @@ static int rigol_ds_event_wait(const struct sr_dev_inst *sdi, char status1, char
 	 * "WAIT"        - waiting for trigger
 	 * "STOP"        - stopped
 	 */
+	if (sr_scpi_get_string(sdi->conn, ":TRIG:STAT?", &buf) != SR_OK)
+		return SR_ERR;
+	done = buf[0] == status1 || buf[0] == status2;
+	g_free(buf);
 
 	if (devc->wait_status == 1) {
-		do {
-			if (time(NULL) - start >= 3) {
-				sr_dbg("Timeout waiting for trigger");
-				return SR_ERR_TIMEOUT;
-			}
-
-			if (sr_scpi_get_string(sdi->conn, ":TRIG:STAT?", &buf) != SR_OK)
-				return SR_ERR;
-		} while (buf[0] == status1 || buf[0] == status2);
-
-		devc->wait_status = 2;
+		/* Wait for the previous event to be over. */
+		if (!done)
+			devc->wait_status = 2;
+		return SR_ERR_TIMEOUT;
 	}
-	if (devc->wait_status == 2) {
-		do {
-			if (time(NULL) - start >= 3) {
-				sr_dbg("Timeout waiting for trigger");
-				return SR_ERR_TIMEOUT;
-			}
-
-			if (sr_scpi_get_string(sdi->conn, ":TRIG:STAT?", &buf) != SR_OK)
-				return SR_ERR;
-		} while (buf[0] != status1 && buf[0] != status2);
+	if (!done)
+		return SR_ERR_TIMEOUT;
 
-		rigol_ds_set_wait_event(devc, WAIT_NONE);
-	}
+	rigol_ds_set_wait_event(devc, WAIT_NONE);
 
 	return SR_OK;
 }
@@ -166,7 +154,7 @@ static int rigol_ds_event_wait(const struct sr_dev_inst *sdi, char status1, char
  *
  * The workaround is to only wait for the trigger when the timebase is slow
  * enough. Of course this means that for faster timebases sample data can be
- * returned multiple times, this effect is mitigated somewhat by sleeping
+ * returned multiple times, this effect is mitigated somewhat by waiting
  * for about one sweep time in that case.
  */
 static int rigol_ds_trigger_wait(const struct sr_dev_inst *sdi)
@@ -178,20 +166,22 @@ static int rigol_ds_trigger_wait(const struct sr_dev_inst *sdi)
 		return SR_ERR;
 
 	/*
-	 * If timebase < 50 msecs/DIV just sleep about one sweep time except
+	 * If timebase < 50 msecs/DIV just wait about one sweep time except
 	 * for really fast sweeps.
 	 */
 	if (devc->timebase < 0.0499) {
-		if (devc->timebase > 0.99e-6) {
+		if (devc->timebase > 0.99e-6 && !devc->wait_until) {
 			/*
 			 * Timebase * num hor. divs * 85(%) * 1e6(usecs) / 100
 			 * -> 85 percent of sweep time
 			 */
 			s = (devc->timebase * devc->model->series->num_horizontal_divs
 			     * 85e6) / 100L;
-			sr_spew("Sleeping for %ld usecs instead of trigger-wait", s);
-			g_usleep(s);
+			sr_spew("Waiting for %ld usecs instead of trigger-wait", s);
+			devc->wait_until = g_get_monotonic_time() + s;
 		}
+		if (g_get_monotonic_time() < devc->wait_until)
+			return SR_ERR_TIMEOUT;
 		rigol_ds_set_wait_event(devc, WAIT_NONE);
 		return SR_OK;
 	} else {
@@ -265,37 +255,37 @@ static int rigol_ds_block_wait(const struct sr_dev_inst *sdi)
 {
 	char *buf;
 	struct dev_context *devc;
-	time_t start;
-	int len;
+	int64_t now;
+	int len, ret;
 
 	if (!(devc = sdi->priv))
 		return SR_ERR;
 
 	if (devc->model->series->protocol == PROTOCOL_V3) {
-
-		start = time(NULL);
-
-		do {
-			if (time(NULL) - start >= 3) {
-				sr_dbg("Timeout waiting for data block");
-				return SR_ERR_TIMEOUT;
-			}
-
-			/*
-			 * The scope copies data really slowly from sample
-			 * memory to its output buffer, so try not to bother
-			 * it too much with SCPI requests but don't wait too
-			 * long for short sample frame sizes.
-			 */
-			g_usleep(devc->analog_frame_size < (15 * 1000) ? (100 * 1000) : (1000 * 1000));
-
-			/* "READ,nnnn" (still working) or "IDLE,nnnn" (finished) */
-			if (sr_scpi_get_string(sdi->conn, ":WAV:STAT?", &buf) != SR_OK)
-				return SR_ERR;
-
-			if (parse_int(buf + 5, &len) != SR_OK)
-				return SR_ERR;
-		} while (buf[0] == 'R' && len < (1000 * 1000));
+		/*
+		 * The scope copies data really slowly from sample
+		 * memory to its output buffer, so try not to bother
+		 * it too much with SCPI requests but don't wait too
+		 * long for short sample frame sizes.
+		 */
+		now = g_get_monotonic_time();
+		if (!devc->wait_until)
+			devc->wait_until = now + (devc->analog_frame_size < (15 * 1000) ?
+				(100 * 1000) : (1000 * 1000));
+		if (now < devc->wait_until)
+			return SR_ERR_TIMEOUT;
+
+		/* "READ,nnnn" (still working) or "IDLE,nnnn" (finished) */
+		if (sr_scpi_get_string(sdi->conn, ":WAV:STAT?", &buf) != SR_OK)
+			return SR_ERR;
+		ret = parse_int(buf + 5, &len);
+		if (ret == SR_OK && buf[0] == 'R' && len < (1000 * 1000)) {
+			devc->wait_until = 0;
+			ret = SR_ERR_TIMEOUT;
+		}
+		g_free(buf);
+		if (ret != SR_OK)
+			return ret;
 	}
 
 	rigol_ds_set_wait_event(devc, WAIT_NONE);
@@ -327,6 +317,36 @@ SR_PRIV int rigol_ds_config_set(const struct sr_dev_inst *sdi, const char *forma
 	}
 }
 
+/*
+ * The ADCs have 8 bits, wider formats would only add padding. ASCII
+ * can't be read in chunks of samples, so there is no fallback.
+ */
+static const struct sr_scpi_wave_format wave_formats[] = {
+	{ "BYTE", 1, FALSE, FALSE },
+};
+
+/*
+ * Size blocks so that each takes about ACQ_BLOCK_TIME_US at the measured
+ * throughput. Larger blocks make the per block commands cheaper, smaller
+ * ones get the first data faster. Only full blocks are measured, short
+ * ones are mostly overhead.
+ */
+static void rigol_ds_adapt_block_size(struct dev_context *devc)
+{
+	int64_t elapsed;
+	uint64_t size;
+
+	elapsed = MAX(g_get_monotonic_time() - devc->block_start, 1);
+	size = devc->num_block_bytes * ACQ_BLOCK_TIME_US / elapsed;
+	size = MIN(size, 2 * devc->block_size);
+	size = CLAMP(size, ACQ_BLOCK_SIZE, ACQ_BLOCK_SIZE_MAX);
+	if (size != devc->block_size)
+		sr_dbg("Block of %" PRIu64 " bytes took %" PRIi64 " ms, "
+			"now using blocks of %" PRIu64 ".", devc->num_block_bytes,
+			elapsed / 1000, size);
+	devc->block_size = size;
+}
+
 /* Start capturing a new frameset */
 SR_PRIV int rigol_ds_capture_start(const struct sr_dev_inst *sdi)
 {
@@ -350,6 +370,10 @@ SR_PRIV int rigol_ds_capture_start(const struct sr_dev_inst *sdi)
 		sr_dbg("Starting data capture for frameset %" PRIu64 " of %"
 		       PRIu64, devc->num_frames + 1, limit_frames);
 
+	/* V1 and V2 always send bytes. */
+	if (first_frame && devc->model->series->protocol < PROTOCOL_V3)
+		devc->wave_format = &wave_formats[0];
+
 	switch (devc->model->series->protocol) {
 	case PROTOCOL_V1:
 		rigol_ds_set_wait_event(devc, WAIT_TRIGGER);
@@ -376,8 +400,12 @@ SR_PRIV int rigol_ds_capture_start(const struct sr_dev_inst *sdi)
 	case PROTOCOL_V3:
 	case PROTOCOL_V4:
 	case PROTOCOL_V5:
-		if (first_frame && rigol_ds_config_set(sdi, ":WAV:FORM BYTE") != SR_OK)
-			return SR_ERR;
+		if (first_frame) {
+			devc->wave_format = sr_scpi_wave_format_negotiate(sdi->conn,
+				":WAV:FORM", wave_formats, ARRAY_SIZE(wave_formats));
+			if (!devc->wave_format)
+				return SR_ERR;
+		}
 		if (devc->data_source == DATA_SOURCE_LIVE) {
 			if (first_frame && rigol_ds_config_set(sdi, ":WAV:MODE NORM") != SR_OK)
 				return SR_ERR;
@@ -449,6 +477,8 @@ SR_PRIV int rigol_ds_channel_start(const struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
 	struct sr_channel *ch;
+	struct sr_scpi_batch *batch;
+	int ret;
 
 	if (!(devc = sdi->priv))
 		return SR_ERR;
@@ -508,24 +538,27 @@ SR_PRIV int rigol_ds_channel_start(const struct sr_dev_inst *sdi)
 		if (devc->data_source != DATA_SOURCE_LIVE) {
 			if (rigol_ds_config_set(sdi, ":WAV:RES") != SR_OK)
 				return SR_ERR;
+			devc->wav_start = devc->wav_stop = 0;
 		}
 		break;
 	}
 
 	if (devc->model->series->protocol >= PROTOCOL_V3 &&
 			ch->type == SR_CHANNEL_ANALOG) {
-		/* Vertical increment. */
-		if (first_frame && sr_scpi_get_float(sdi->conn, ":WAV:YINC?",
-				&devc->vert_inc[ch->index]) != SR_OK)
-			return SR_ERR;
-		/* Vertical origin. */
-		if (first_frame && sr_scpi_get_float(sdi->conn, ":WAV:YOR?",
-			&devc->vert_origin[ch->index]) != SR_OK)
-			return SR_ERR;
-		/* Vertical reference. */
-		if (first_frame && sr_scpi_get_int(sdi->conn, ":WAV:YREF?",
-				&devc->vert_reference[ch->index]) != SR_OK)
-			return SR_ERR;
+		/* Vertical increment, origin and reference, in one go. */
+		if (first_frame) {
+			batch = sr_scpi_batch_new();
+			sr_scpi_batch_add_float(batch,
+				&devc->vert_inc[ch->index], ":WAV:YINC?");
+			sr_scpi_batch_add_float(batch,
+				&devc->vert_origin[ch->index], ":WAV:YOR?");
+			sr_scpi_batch_add_int(batch,
+				&devc->vert_reference[ch->index], ":WAV:YREF?");
+			ret = sr_scpi_batch_run(sdi->conn, batch);
+			sr_scpi_batch_free(batch);
+			if (ret != SR_OK)
+				return SR_ERR;
+		}
 	} else if (ch->type == SR_CHANNEL_ANALOG) {
 		devc->vert_inc[ch->index] = devc->vdiv[ch->index] / 25.6;
 	}
@@ -607,10 +640,11 @@ SR_PRIV int rigol_ds_receive(int fd, int revents, void *cb_data)
 	struct sr_analog_meaning meaning;
 	struct sr_analog_spec spec;
 	struct sr_datafeed_logic logic;
-	double vdiv, offset, origin;
-	int len, i, vref;
-	struct sr_channel *ch;
+	double vdiv, offset, origin, scale, bias;
+	int len, vref;
+	struct sr_channel *ch, *next_ch;
 	gsize expected_data_bytes;
+	uint64_t start, stop;
 
 	(void)fd;
 
@@ -625,8 +659,6 @@ SR_PRIV int rigol_ds_receive(int fd, int revents, void *cb_data)
 	if (!(revents == G_IO_IN || revents == 0))
 		return TRUE;
 
-	const gboolean first_frame = (devc->num_frames == 0);
-
 	switch (devc->wait_event) {
 	case WAIT_NONE:
 		break;
@@ -660,15 +692,26 @@ SR_PRIV int rigol_ds_receive(int fd, int revents, void *cb_data)
 
 	if (devc->num_block_bytes == 0) {
 		if (devc->model->series->protocol >= PROTOCOL_V4) {
-			if (first_frame && rigol_ds_config_set(sdi, ":WAV:START %d",
-					devc->num_channel_bytes + 1) != SR_OK)
-				return TRUE;
-			if (first_frame && rigol_ds_config_set(sdi, ":WAV:STOP %d",
-					MIN(devc->num_channel_bytes + ACQ_BLOCK_SIZE,
-						devc->analog_frame_size)) != SR_OK)
-				return TRUE;
+			/* Only change the range when it differs. */
+			start = devc->num_channel_bytes + 1;
+			stop = MIN(devc->num_channel_bytes + devc->block_size,
+				devc->analog_frame_size);
+			if (start != devc->wav_start) {
+				if (rigol_ds_config_set(sdi, ":WAV:START %" PRIu64,
+						start) != SR_OK)
+					return TRUE;
+				devc->wav_start = start;
+			}
+			if (stop != devc->wav_stop) {
+				if (rigol_ds_config_set(sdi, ":WAV:STOP %" PRIu64,
+						stop) != SR_OK)
+					return TRUE;
+				devc->wav_stop = stop;
+			}
 		}
 
+		devc->block_start = g_get_monotonic_time();
+
 		if (devc->model->series->protocol >= PROTOCOL_V3) {
 			if (rigol_ds_config_set(sdi, ":WAV:BEG") != SR_OK)
 				return TRUE;
@@ -734,24 +777,35 @@ SR_PRIV int rigol_ds_receive(int fd, int revents, void *cb_data)
 		vdiv = devc->vert_inc[ch->index];
 		origin = devc->vert_origin[ch->index];
 		offset = devc->vert_offset[ch->index];
-		if (devc->model->series->protocol >= PROTOCOL_V3)
-			for (i = 0; i < len; i++)
-				devc->data[i] = ((int)devc->buffer[i] - vref - origin) * vdiv;
-		else
-			for (i = 0; i < len; i++)
-				devc->data[i] = (128 - devc->buffer[i]) * vdiv - offset;
+		if (devc->model->series->protocol >= PROTOCOL_V3) {
+			scale = vdiv;
+			bias = -(vref + origin) * vdiv;
+		} else {
+			scale = -vdiv;
+			bias = 128 * vdiv - offset;
+		}
 		float vdivlog = log10f(vdiv);
 		int digits = -(int)vdivlog + (vdivlog < 0.0);
 		sr_analog_init(&analog, &encoding, &meaning, &spec, digits);
+		if (sr_scpi_wave_encoding(devc->wave_format, scale, bias,
+				&encoding) != SR_OK) {
+			sr_err("Unsupported waveform format, aborting capture.");
+			std_session_send_df_frame_end(sdi);
+			sr_dev_acquisition_stop(sdi);
+			return TRUE;
+		}
 		analog.meaning->channels = g_slist_append(NULL, ch);
-		analog.num_samples = len;
-		analog.data = devc->data;
+		analog.num_samples = len / devc->wave_format->unitsize;
+		analog.data = devc->buffer;
 		analog.meaning->mq = SR_MQ_VOLTAGE;
 		analog.meaning->unit = SR_UNIT_VOLT;
 		analog.meaning->mqflags = 0;
 		packet.type = SR_DF_ANALOG;
 		packet.payload = &analog;
-		sr_session_send(sdi, &packet);
+		if (devc->interleave)
+			sr_analog_interleave_add(devc->interleave, &analog);
+		else
+			sr_session_send(sdi, &packet);
 		g_slist_free(analog.meaning->channels);
 	} else {
 		logic.length = len;
@@ -767,6 +821,9 @@ SR_PRIV int rigol_ds_receive(int fd, int revents, void *cb_data)
 
 	if (devc->num_block_read == devc->num_block_bytes) {
 		sr_dbg("Block has been completed");
+		if (devc->model->series->protocol >= PROTOCOL_V4 &&
+				devc->num_block_bytes == devc->block_size)
+			rigol_ds_adapt_block_size(devc);
 		if (devc->model->series->protocol >= PROTOCOL_V3) {
 			/* Discard the terminating linefeed */
 			sr_scpi_read_data(scpi, (char *)devc->buffer, 1);
@@ -805,6 +862,13 @@ SR_PRIV int rigol_ds_receive(int fd, int revents, void *cb_data)
 			rigol_ds_config_set(sdi, ":WAV:END");
 	}
 
+	/* The analog channels come first, send them after the last one. */
+	next_ch = devc->channel_entry->next ?
+		devc->channel_entry->next->data : NULL;
+	if (devc->interleave && ch->type == SR_CHANNEL_ANALOG &&
+			(!next_ch || next_ch->type != SR_CHANNEL_ANALOG))
+		sr_analog_interleave_send(devc->interleave, sdi);
+
 	if (devc->channel_entry->next) {
 		/* We got the frame for this channel, now get the next channel. */
 		devc->channel_entry = devc->channel_entry->next;
@@ -971,32 +1035,29 @@ SR_PRIV int rigol_ds_get_dev_cfg(const struct sr_dev_inst *sdi)
 SR_PRIV int rigol_ds_get_dev_cfg_vertical(const struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
-	char *cmd;
+	struct sr_scpi_batch *batch;
 	unsigned int i;
 	int res;
 
 	devc = sdi->priv;
 
-	/* Vertical gain. */
+	/* Vertical gain and offset, in as few round trips as possible. */
+	batch = sr_scpi_batch_new();
 	for (i = 0; i < devc->model->analog_channels; i++) {
-		cmd = g_strdup_printf(":CHAN%d:SCAL?", i + 1);
-		res = sr_scpi_get_float(sdi->conn, cmd, &devc->vdiv[i]);
-		g_free(cmd);
-		if (res != SR_OK)
-			return SR_ERR;
+		sr_scpi_batch_add_float(batch, &devc->vdiv[i],
+			":CHAN%d:SCAL?", i + 1);
+		sr_scpi_batch_add_float(batch, &devc->vert_offset[i],
+			":CHAN%d:OFFS?", i + 1);
 	}
+	res = sr_scpi_batch_run(sdi->conn, batch);
+	sr_scpi_batch_free(batch);
+	if (res != SR_OK)
+		return SR_ERR;
+
 	sr_dbg("Current vertical gain:");
 	for (i = 0; i < devc->model->analog_channels; i++)
 		sr_dbg("CH%d %g", i + 1, devc->vdiv[i]);
 
-	/* Vertical offset. */
-	for (i = 0; i < devc->model->analog_channels; i++) {
-		cmd = g_strdup_printf(":CHAN%d:OFFS?", i + 1);
-		res = sr_scpi_get_float(sdi->conn, cmd, &devc->vert_offset[i]);
-		g_free(cmd);
-		if (res != SR_OK)
-			return SR_ERR;
-	}
 	sr_dbg("Current vertical offset:");
 	for (i = 0; i < devc->model->analog_channels; i++)
 		sr_dbg("CH%d %g", i + 1, devc->vert_offset[i]);
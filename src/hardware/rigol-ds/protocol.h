@@ -31,8 +31,14 @@
 /* Size of acquisition buffers */
 #define ACQ_BUFFER_SIZE (32 * 1024)
 
-/* Maximum number of samples to retrieve at once. */
+/* Initial and maximum number of samples to retrieve at once. */
 #define ACQ_BLOCK_SIZE (30 * 1000)
+#define ACQ_BLOCK_SIZE_MAX (250 * 1000)
+/* How long retrieving a block should take, the block size adapts to it. */
+#define ACQ_BLOCK_TIME_US (200 * 1000)
+
+/* Most values of a frame to collect into one interleaved packet. */
+#define MAX_INTERLEAVED_VALUES (16 * 1000 * 1000)
 
 #define MAX_ANALOG_CHANNELS 4
 #define MAX_DIGITAL_CHANNELS 16
@@ -148,6 +154,8 @@ struct dev_context {
 	uint64_t num_frames_segmented;
 	/* GSList entry for the current channel. */
 	GSList *channel_entry;
+	/* Collects a frame's analog channels into one packet, or NULL. */
+	struct sr_analog_interleave *interleave;
 	/* Number of bytes received for current channel. */
 	uint64_t num_channel_bytes;
 	/* Number of bytes of block header read */
@@ -156,13 +164,23 @@ struct dev_context {
 	uint64_t num_block_bytes;
 	/* Number of data block bytes already read */
 	uint64_t num_block_read;
+	/* Number of samples to retrieve per block */
+	uint64_t block_size;
+	/* Monotonic time the current block was requested at */
+	int64_t block_start;
+	/* Sample range last set with :WAV:START and :WAV:STOP, or 0 */
+	uint64_t wav_start;
+	uint64_t wav_stop;
 	/* What to wait for in *_receive */
 	enum wait_events wait_event;
 	/* Trigger/block copying/stop waiting status */
 	int wait_status;
-	/* Acq buffers used for reading from the scope and sending data to app */
+	/* Monotonic time before which not to poll the scope again, or 0 */
+	int64_t wait_until;
+	/* Format of the waveform data */
+	const struct sr_scpi_wave_format *wave_format;
+	/* Acq buffer used for reading from the scope and sending data to app */
 	unsigned char *buffer;
-	float *data;
 };
 
 SR_PRIV int rigol_ds_config_set(const struct sr_dev_inst *sdi, const char *format, ...);
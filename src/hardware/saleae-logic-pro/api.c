@@ -190,7 +190,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 		}
 	}
 
-	libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	sr_usb_get_device_list(drvc->sr_ctx, &devlist);
 	for (unsigned int i = 0; devlist[i]; i++) {
 		libusb_get_device_descriptor(devlist[i], &des);
 
@@ -214,10 +214,11 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 		/* Give the device some time to come back and scan again */
 		libusb_free_device_list(devlist, 1);
 		g_usleep(500 * 1000);
-		libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+		sr_usb_snapshot_invalidate(drvc->sr_ctx);
+		sr_usb_get_device_list(drvc->sr_ctx, &devlist);
 	}
 	if (conn)
-		conn_devices = sr_usb_find(drvc->sr_ctx->libusb_ctx, conn);
+		conn_devices = sr_usb_find(drvc->sr_ctx, conn);
 	for (unsigned int i = 0; devlist[i]; i++) {
 		if (conn_devices) {
 			struct sr_usb_dev_inst *usb = NULL;
@@ -408,8 +409,6 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 
 	usb = sdi->conn;
 
-	devc->conv_buffer = g_malloc(CONV_BUFFER_SIZE);
-
 	devc->num_transfers = BUF_COUNT;
 	devc->transfers = g_malloc0(sizeof(*devc->transfers) * BUF_COUNT);
 	for (i = 0; i < devc->num_transfers; i++) {
@@ -443,7 +442,6 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 
 static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 {
-	struct dev_context *devc = sdi->priv;
 	struct drv_context *drvc = sdi->driver->context;
 
 	saleae_logic_pro_stop(sdi);
@@ -452,8 +450,6 @@ static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 
 	usb_source_remove(sdi->session, drvc->sr_ctx);
 
-	g_free(devc->conv_buffer);
-
 	return SR_OK;
 }
 
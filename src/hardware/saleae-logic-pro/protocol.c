@@ -578,6 +578,7 @@ static int configure_channels(const struct sr_dev_inst *sdi)
 			continue;
 
 		mask = 1 << c->index;
+		devc->dig_channel_index[devc->dig_channel_cnt] = c->index;
 		devc->dig_channel_masks[devc->dig_channel_cnt++] = mask;
 		devc->dig_channel_mask |= mask;
 
@@ -795,7 +796,7 @@ SR_PRIV int saleae_logic_pro_start(const struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc = sdi->priv;
 
-	devc->conv_size = 0;
+	memset(devc->batch_words, 0, sizeof(devc->batch_words));
 	devc->batch_index = 0;
 
 	write_reg(sdi, 0x00, 0x01);
@@ -838,57 +839,53 @@ static void saleae_logic_pro_send_data(const struct sr_dev_inst *sdi,
 		.payload = &logic
 	};
 
-	sr_session_send(sdi, &packet);
+	/* The buffer is the packet's now, callbacks may keep it. */
+	sr_session_send_zerocopy(sdi, &packet, g_free, data);
 }
 
 /*
  * One batch from the device consists of 32 samples per active digital channel.
  * This stream of batches is packed into USB packets with 16384 bytes each.
+ * Complete batches get converted into a new buffer, which is returned
+ * with its length. A partial batch waits in the device context.
  */
-static void saleae_logic_pro_convert_data(const struct sr_dev_inst *sdi,
-					 const uint32_t *src, size_t srccnt)
+static uint16_t *saleae_logic_pro_convert_data(const struct sr_dev_inst *sdi,
+					 const uint32_t *src, size_t srccnt, size_t *length)
 {
 	struct dev_context *devc = sdi->priv;
-	uint8_t *dst = devc->conv_buffer;
-	uint32_t samples;
-	uint16_t channel_mask;
-	unsigned int sample_index, batch_index;
-	uint16_t *dst_batch;
+	uint16_t *dst, *dst_batch;
+	size_t num_batches;
+	unsigned int batch_index;
 
-	/* Copy partial batch to the beginning. */
-	memcpy(dst, dst + devc->conv_size, CONV_BATCH_SIZE);
-	/* Reset converted size. */
-	devc->conv_size = 0;
+	*length = 0;
+	if (!devc->dig_channel_cnt)
+		return NULL;
 
 	batch_index = devc->batch_index;
-	while (srccnt--) {
-		samples = *src++;
-		dst_batch = (uint16_t*)dst;
-
-		/* First index of the batch. */
-		if (batch_index == 0)
-			memset(dst, 0, CONV_BATCH_SIZE);
+	num_batches = (batch_index + srccnt) / devc->dig_channel_cnt;
+	*length = num_batches * CONV_BATCH_SIZE;
+	dst = dst_batch = num_batches ? g_malloc(*length) : NULL;
 
-		/* Convert one channel. */
-		channel_mask = devc->dig_channel_masks[batch_index];
-		for (sample_index = 0; sample_index <= 31; sample_index++)
-			if ((samples >> (31 - sample_index)) & 1)
-				dst_batch[sample_index] |= channel_mask;
+	while (srccnt--) {
+		devc->batch_words[devc->dig_channel_index[batch_index]] = *src++;
 
 		/* Last index of the batch. */
 		if (++batch_index == devc->dig_channel_cnt) {
-			devc->conv_size += CONV_BATCH_SIZE;
+			sr_transpose16x32(devc->batch_words, dst_batch);
+			dst_batch += CONV_BATCH_SIZE / sizeof(*dst_batch);
 			batch_index = 0;
-			dst += CONV_BATCH_SIZE;
 		}
 	}
 	devc->batch_index = batch_index;
+
+	return dst;
 }
 
 SR_PRIV void LIBUSB_CALL saleae_logic_pro_receive_data(struct libusb_transfer *transfer)
 {
 	const struct sr_dev_inst *sdi = transfer->user_data;
-	struct dev_context *devc = sdi->priv;
+	uint16_t *data;
+	size_t length;
 	int ret;
 
 	switch (transfer->status) {
@@ -903,8 +900,10 @@ SR_PRIV void LIBUSB_CALL saleae_logic_pro_receive_data(struct libusb_transfer *t
 		return;
 	}
 
-	saleae_logic_pro_convert_data(sdi, (uint32_t*)transfer->buffer, 16 * 1024 / 4);
-	saleae_logic_pro_send_data(sdi, devc->conv_buffer, devc->conv_size, 2);
+	data = saleae_logic_pro_convert_data(sdi, (uint32_t *)transfer->buffer,
+		transfer->actual_length / sizeof(uint32_t), &length);
+	if (data)
+		saleae_logic_pro_send_data(sdi, data, length, 2);
 
 	if ((ret = libusb_submit_transfer(transfer)) != LIBUSB_SUCCESS)
 		sr_dbg("FIXME resubmit failed");
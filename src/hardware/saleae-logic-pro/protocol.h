@@ -30,16 +30,11 @@
 /* 16 channels * 32 samples */
 #define CONV_BATCH_SIZE (2 * 32)
 
-/*
- * One packet + one partial conversion: Worst case is only one active
- * channel converted to 2 bytes per sample, with 8 * 16384 samples per packet.
- */
-#define CONV_BUFFER_SIZE (2 * 8 * 16384 + CONV_BATCH_SIZE)
-
 struct dev_context {
 	unsigned int dig_channel_cnt;
 	uint16_t dig_channel_mask;
 	uint16_t dig_channel_masks[16];
+	uint8_t dig_channel_index[16];
 	uint64_t dig_samplerate;
 
 	uint32_t lfsr;
@@ -48,8 +43,8 @@ struct dev_context {
 	unsigned int submitted_transfers;
 	struct libusb_transfer **transfers;
 
-	uint8_t *conv_buffer;
-	unsigned int conv_size;
+	/* The batch being received, one word per channel, by index. */
+	uint32_t batch_words[16];
 	unsigned int batch_index;
 };
 
@@ -55,6 +55,8 @@ static const uint32_t devopts[] = {
 	SR_CONF_VOLTAGE_THRESHOLD | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
 	SR_CONF_TRIGGER_MATCH | SR_CONF_LIST,
 	SR_CONF_CAPTURE_RATIO | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_USB_TRANSFER_DEPTH | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_USB_TRANSFER_SIZE | SR_CONF_GET | SR_CONF_SET,
 };
 
 static const int32_t trigger_matches[] = {
@@ -145,7 +147,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	struct sr_dev_inst *sdi;
 	struct sr_usb_dev_inst *usb;
 	struct sr_config *src;
-	GSList *l, *devices, *conn_devices;
+	GSList *l, *devices, *uploads, *conn_devices;
 	struct libusb_device_descriptor des;
 	libusb_device **devlist;
 	unsigned int i, j;
@@ -164,13 +166,14 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 		}
 	}
 	if (conn)
-		conn_devices = sr_usb_find(drvc->sr_ctx->libusb_ctx, conn);
+		conn_devices = sr_usb_find(drvc->sr_ctx, conn);
 	else
 		conn_devices = NULL;
 
 	/* Find all Logic16 devices and upload firmware to them. */
 	devices = NULL;
-	libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	uploads = NULL;
+	sr_usb_get_device_list(drvc->sr_ctx, &devlist);
 	for (i = 0; devlist[i]; i++) {
 		if (conn) {
 			usb = NULL;
@@ -218,13 +221,10 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 				libusb_get_bus_number(devlist[i]),
 				libusb_get_device_address(devlist[i]), NULL);
 		} else {
-			if (ezusb_upload_firmware(drvc->sr_ctx, devlist[i],
-					USB_CONFIGURATION, FX2_FIRMWARE) == SR_OK) {
-				/* Store when this device's FW was updated. */
-				devc->fw_updated = g_get_monotonic_time();
-			} else {
-				sr_err("Firmware upload failed, name %s.", FX2_FIRMWARE);
-			}
+			/* Upload along with all other devices, see below. */
+			ezusb_upload_firmware_queue(&uploads, drvc->sr_ctx,
+				devlist[i], USB_CONFIGURATION, FX2_FIRMWARE,
+				&devc->fw_updated);
 			sdi->inst_type = SR_INST_USB;
 			sdi->conn = sr_usb_dev_inst_new(
 				libusb_get_bus_number(devlist[i]), 0xff, NULL);
@@ -233,6 +233,9 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	libusb_free_device_list(devlist, 1);
 	g_slist_free_full(conn_devices, (GDestroyNotify)sr_usb_dev_inst_free);
 
+	/* Uploads and renumeration of several devices can overlap. */
+	ezusb_upload_firmware_run(uploads);
+
 	return std_scan_complete(di, devices);
 }
 
@@ -349,8 +352,14 @@ static int dev_open(struct sr_dev_inst *sdi)
 	ret = SR_ERR;
 	if (devc->fw_updated > 0) {
 		sr_info("Waiting for device to reset.");
-		/* Takes >= 300ms for the FX2 to be gone from the USB bus. */
-		g_usleep(300 * 1000);
+		/*
+		 * Takes >= 300ms for the FX2 to be gone from the USB bus.
+		 * Counted from the upload, which for devices found by the
+		 * same scan was at about the same time.
+		 */
+		timediff_us = g_get_monotonic_time() - devc->fw_updated;
+		if (timediff_us < 300 * 1000)
+			g_usleep(300 * 1000 - timediff_us);
 		timediff_ms = 0;
 		while (timediff_ms < MAX_RENUM_DELAY_MS) {
 			if ((ret = logic16_dev_open(sdi)) == SR_OK)
@@ -386,13 +395,17 @@ static int dev_open(struct sr_dev_inst *sdi)
 
 static int dev_close(struct sr_dev_inst *sdi)
 {
+	struct dev_context *devc;
 	struct sr_usb_dev_inst *usb;
 
+	devc = sdi->priv;
 	usb = sdi->conn;
 
 	if (!usb->devhdl)
 		return SR_ERR_BUG;
 
+	sr_usb_xfer_pool_free(&devc->xfer_pool);
+
 	sr_info("Closing device on %d.%d (logical) / %s (physical) interface %d.",
 		usb->bus, usb->address, sdi->connection_id, USB_INTERFACE);
 	libusb_release_interface(usb->devhdl, USB_INTERFACE);
@@ -445,6 +458,12 @@ static int config_get(uint32_t key, GVariant **data,
 			return SR_OK;
 		}
 		return SR_ERR;
+	case SR_CONF_USB_TRANSFER_DEPTH:
+	case SR_CONF_USB_TRANSFER_SIZE:
+		if (!sdi)
+			return SR_ERR;
+		devc = sdi->priv;
+		return sr_usb_xfer_pool_config_get(&devc->xfer_pool, key, data);
 	default:
 		return SR_ERR_NA;
 	}
@@ -477,6 +496,9 @@ static int config_set(uint32_t key, GVariant *data,
 			return SR_ERR_ARG;
 		devc->selected_voltage_range = thresholds_ranges[idx].range;
 		break;
+	case SR_CONF_USB_TRANSFER_DEPTH:
+	case SR_CONF_USB_TRANSFER_SIZE:
+		return sr_usb_xfer_pool_config_set(&devc->xfer_pool, key, data);
 	default:
 		return SR_ERR_NA;
 	}
@@ -533,7 +555,9 @@ static size_t get_buffer_size(struct dev_context *devc)
 	 * a multiple of 512.
 	 */
 	s = 10 * bytes_per_ms(devc);
-	return (s + 511) & ~511;
+	s = (s + 511) & ~511;
+
+	return sr_usb_xfer_pool_buffer_size(&devc->xfer_pool, s);
 }
 
 static unsigned int get_number_of_transfers(struct dev_context *devc)
@@ -544,9 +568,9 @@ static unsigned int get_number_of_transfers(struct dev_context *devc)
 	n = 500 * bytes_per_ms(devc) / get_buffer_size(devc);
 
 	if (n > NUM_SIMUL_TRANSFERS)
-		return NUM_SIMUL_TRANSFERS;
+		n = NUM_SIMUL_TRANSFERS;
 
-	return n;
+	return sr_usb_xfer_pool_depth(&devc->xfer_pool, n);
 }
 
 static unsigned int get_timeout(struct dev_context *devc)
@@ -578,16 +602,6 @@ static int configure_channels(const struct sr_dev_inst *sdi)
 		channel_bit = 1 << (ch->index);
 
 		devc->cur_channels |= channel_bit;
-
-#ifdef WORDS_BIGENDIAN
-		/*
-		 * Output logic data should be stored in little endian format.
-		 * To speed things up during conversion, do the switcharoo
-		 * here instead.
-		 */
-		channel_bit = 1 << (ch->index ^ 8);
-#endif
-
 		devc->channel_masks[devc->num_channels++] = channel_bit;
 	}
 
@@ -631,7 +645,6 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	struct libusb_transfer *transfer;
 	unsigned int i, timeout, num_transfers;
 	int ret;
-	unsigned char *buf;
 	size_t size, convsize;
 
 	drvc = di->context;
@@ -647,7 +660,7 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	devc->sent_samples = 0;
 	devc->empty_transfer_count = 0;
 	devc->cur_channel = 0;
-	memset(devc->channel_data, 0, sizeof(devc->channel_data));
+	memset(devc->channel_words, 0, sizeof(devc->channel_words));
 
 	if ((trigger = sr_session_trigger_get(sdi->session))) {
 		int pre_trigger_samples = 0;
@@ -666,6 +679,11 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	convsize = (size / devc->num_channels + 2) * 16;
 	devc->submitted_transfers = 0;
 
+	ret = sr_usb_xfer_pool_alloc(&devc->xfer_pool, usb->devhdl,
+		num_transfers, size);
+	if (ret != SR_OK)
+		return ret;
+
 	devc->convbuffer_size = convsize;
 	if (!(devc->convbuffer = g_try_malloc(convsize))) {
 		sr_err("Conversion buffer malloc failed.");
@@ -688,25 +706,13 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 
 	devc->num_transfers = num_transfers;
 	for (i = 0; i < num_transfers; i++) {
-		if (!(buf = g_try_malloc(size))) {
-			sr_err("USB transfer buffer malloc failed.");
-			if (devc->submitted_transfers)
-				abort_acquisition(devc);
-			else {
-				g_free(devc->transfers);
-				g_free(devc->convbuffer);
-			}
-			return SR_ERR_MALLOC;
-		}
-		transfer = libusb_alloc_transfer(0);
+		transfer = devc->xfer_pool.transfers[i];
 		libusb_fill_bulk_transfer(transfer, usb->devhdl,
-				2 | LIBUSB_ENDPOINT_IN, buf, size,
+				2 | LIBUSB_ENDPOINT_IN, transfer->buffer, size,
 				logic16_receive_transfer, (void *)sdi, timeout);
-		if ((ret = libusb_submit_transfer(transfer)) != 0) {
+		if ((ret = sr_usb_transfer_submit(transfer)) != 0) {
 			sr_err("Failed to submit transfer: %s.",
 			       libusb_error_name(ret));
-			libusb_free_transfer(transfer);
-			g_free(buf);
 			abort_acquisition(devc);
 			return SR_ERR;
 		}
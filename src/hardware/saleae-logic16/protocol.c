@@ -33,6 +33,7 @@
 
 #define FPGA_FIRMWARE_18	"saleae-logic16-fpga-18.bitstream"
 #define FPGA_FIRMWARE_33	"saleae-logic16-fpga-33.bitstream"
+#define FPGA_BITSTREAM_MAX_SIZE	(1024 * 1024)
 
 #define MAX_SAMPLE_RATE		SR_MHZ(100)
 #define MAX_SAMPLE_RATE_X_CH	SR_MHZ(300)
@@ -460,12 +461,13 @@ static int configure_led(const struct sr_dev_inst *sdi)
 static int upload_fpga_bitstream(const struct sr_dev_inst *sdi,
 				 enum voltage_range vrange)
 {
-	uint64_t sum;
-	struct sr_resource bitstream;
+	gsize sum, size;
+	GBytes *bitstream;
+	const uint8_t *data;
 	struct dev_context *devc;
 	struct drv_context *drvc;
 	const char *name;
-	ssize_t chunksize;
+	size_t chunksize;
 	int ret;
 	uint8_t command[64];
 
@@ -489,40 +491,35 @@ static int upload_fpga_bitstream(const struct sr_dev_inst *sdi,
 		}
 
 		sr_info("Uploading FPGA bitstream '%s'.", name);
-		ret = sr_resource_open(drvc->sr_ctx, &bitstream,
-				SR_RESOURCE_FIRMWARE, name);
-		if (ret != SR_OK)
-			return ret;
+		bitstream = sr_resource_load_bytes(drvc->sr_ctx,
+				SR_RESOURCE_FIRMWARE, name,
+				FPGA_BITSTREAM_MAX_SIZE);
+		if (!bitstream)
+			return SR_ERR;
+		data = g_bytes_get_data(bitstream, &size);
 
 		command[0] = COMMAND_FPGA_UPLOAD_INIT;
 		if ((ret = do_ep1_command(sdi, command, 1, NULL, 0)) != SR_OK) {
-			sr_resource_close(drvc->sr_ctx, &bitstream);
+			g_bytes_unref(bitstream);
 			return ret;
 		}
 
-		sum = 0;
-		while (1) {
-			chunksize = sr_resource_read(drvc->sr_ctx, &bitstream,
-					&command[2], sizeof(command) - 2);
-			if (chunksize < 0) {
-				sr_resource_close(drvc->sr_ctx, &bitstream);
-				return SR_ERR;
-			}
-			if (chunksize == 0)
-				break;
+		for (sum = 0; sum < size; sum += chunksize) {
+			chunksize = MIN(size - sum, sizeof(command) - 2);
 			command[0] = COMMAND_FPGA_UPLOAD_SEND_DATA;
 			command[1] = chunksize;
+			memcpy(&command[2], &data[sum], chunksize);
 
 			ret = do_ep1_command(sdi, command, chunksize + 2,
 					NULL, 0);
 			if (ret != SR_OK) {
-				sr_resource_close(drvc->sr_ctx, &bitstream);
+				g_bytes_unref(bitstream);
 				return ret;
 			}
-			sum += chunksize;
 		}
-		sr_resource_close(drvc->sr_ctx, &bitstream);
-		sr_info("FPGA bitstream upload (%" PRIu64 " bytes) done.", sum);
+		g_bytes_unref(bitstream);
+		sr_info("FPGA bitstream upload (%" G_GSIZE_FORMAT " bytes) done.",
+			sum);
 	}
 
 	/* This needs to be called before accessing any FPGA registers. */
@@ -774,10 +771,7 @@ static void free_transfer(struct libusb_transfer *transfer)
 	sdi = transfer->user_data;
 	devc = sdi->priv;
 
-	g_free(transfer->buffer);
-	transfer->buffer = NULL;
-	libusb_free_transfer(transfer);
-
+	/* Transfers and their buffers are owned by the transfer pool. */
 	for (i = 0; i < devc->num_transfers; i++) {
 		if (devc->transfers[i] == transfer) {
 			devc->transfers[i] = NULL;
@@ -794,7 +788,7 @@ static void resubmit_transfer(struct libusb_transfer *transfer)
 {
 	int ret;
 
-	if ((ret = libusb_submit_transfer(transfer)) == LIBUSB_SUCCESS)
+	if ((ret = sr_usb_transfer_submit(transfer)) == LIBUSB_SUCCESS)
 		return;
 
 	free_transfer(transfer);
@@ -803,38 +797,42 @@ static void resubmit_transfer(struct libusb_transfer *transfer)
 	sr_err("%s: %s", __func__, libusb_error_name(ret));
 }
 
+/*
+ * The device sends one 16bit word per enabled channel in turn, each
+ * holding 16 consecutive samples of that channel (the first one in the
+ * MSB). Collect the words of a block at their channels' bit positions
+ * in the output and transpose them to get the samples.
+ */
 static size_t convert_sample_data(struct dev_context *devc,
 		uint8_t *dest, size_t destcnt, const uint8_t *src, size_t srccnt)
 {
-	uint16_t *channel_data;
+	uint16_t *words, samples[16];
+	unsigned int bit[16];
 	int i, cur_channel;
 	size_t ret = 0;
-	uint16_t sample, channel_mask;
 
 	srccnt /= 2;
 
-	channel_data = devc->channel_data;
+	for (i = 0; i < devc->num_channels; i++)
+		for (bit[i] = 0; !(devc->channel_masks[i] & (1 << bit[i]));)
+			bit[i]++;
+
+	words = devc->channel_words;
 	cur_channel = devc->cur_channel;
 
 	while (srccnt--) {
-		sample = src[0] | (src[1] << 8);
+		words[bit[cur_channel]] = src[0] | (src[1] << 8);
 		src += 2;
 
-		channel_mask = devc->channel_masks[cur_channel];
-
-		for (i = 15; i >= 0; --i, sample >>= 1)
-			if (sample & 1)
-				channel_data[i] |= channel_mask;
-
 		if (++cur_channel == devc->num_channels) {
 			cur_channel = 0;
 			if (destcnt < 16 * 2) {
 				sr_err("Conversion buffer too small!");
 				break;
 			}
-			memcpy(dest, channel_data, 16 * 2);
-			memset(channel_data, 0, 16 * 2);
-			dest += 16 * 2;
+			sr_transpose16x16(words, samples);
+			for (i = 0; i < 16; i++)
+				write_u16le_inc(&dest, samples[i]);
 			ret += 16;
 			destcnt -= 16 * 2;
 		}
@@ -859,6 +857,8 @@ SR_PRIV void LIBUSB_CALL logic16_receive_transfer(struct libusb_transfer *transf
 	sdi = transfer->user_data;
 	devc = sdi->priv;
 
+	sr_usb_transfer_account(sdi, transfer);
+
 	/*
 	 * If acquisition has already ended, just free any queued up
 	 * transfer that come in.
@@ -80,7 +80,7 @@ struct dev_context {
 	int num_channels;
 	int cur_channel;
 	uint16_t channel_masks[16];
-	uint16_t channel_data[16];
+	uint16_t channel_words[16];
 	uint8_t *convbuffer;
 	size_t convbuffer_size;
 	struct soft_trigger_logic *stl;
@@ -88,6 +88,7 @@ struct dev_context {
 
 	unsigned int num_transfers;
 	struct libusb_transfer **transfers;
+	struct sr_usb_xfer_pool xfer_pool;
 	struct sr_context *ctx;
 
 	const uint8_t *fpga_register_map;
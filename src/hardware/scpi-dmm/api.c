@@ -38,6 +38,19 @@ static const uint32_t devopts_generic[] = {
 	SR_CONF_MEASURED_QUANTITY | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
 };
 
+static const uint32_t devopts_burst[] = {
+	SR_CONF_CONTINUOUS,
+	SR_CONF_LIMIT_SAMPLES | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_LIMIT_MSEC | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_MEASURED_QUANTITY | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
+	SR_CONF_DATA_SOURCE | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
+};
+
+/* Indexed by enum scpi_dmm_data_source. */
+static const char *data_sources[] = {
+	"Live", "Burst",
+};
+
 static const struct scpi_command cmdset_agilent[] = {
 	{ DMM_CMD_SETUP_REMOTE, "\n", },
 	{ DMM_CMD_SETUP_FUNC, "CONF:%s", },
@@ -49,6 +62,27 @@ static const struct scpi_command cmdset_agilent[] = {
 	ALL_ZERO,
 };
 
+/*
+ * The Truevolt meters (34465A, 34470A) can also keep their readings in
+ * their reading memory, at the rate of the current NPLC/aperture setup,
+ * while R? removes blocks of them. That takes kS/s instead of one
+ * query round trip per reading.
+ */
+static const struct scpi_command cmdset_truevolt[] = {
+	{ DMM_CMD_SETUP_REMOTE, "\n", },
+	{ DMM_CMD_SETUP_FUNC, "CONF:%s", },
+	{ DMM_CMD_QUERY_FUNC, "CONF?", },
+	{ DMM_CMD_START_ACQ, "MEAS", },
+	{ DMM_CMD_STOP_ACQ, "ABORT", },
+	{ DMM_CMD_QUERY_VALUE, "READ?", },
+	{ DMM_CMD_QUERY_PREC, "CONF?", },
+	{ DMM_CMD_SETUP_BURST, "TRIG:SOUR IMM;:TRIG:COUN INF;:SAMP:COUN 1", },
+	{ DMM_CMD_START_BURST, "INIT", },
+	{ DMM_CMD_QUERY_BURST, "R? %d", },
+	{ DMM_CMD_STOP_BURST, "TRIG:COUN 1", },
+	ALL_ZERO,
+};
+
 /*
  * cmdset_hp is used for the 34401A, which was added to this code after the
  * 34405A and 34465A. It differs in starting the measurement with INIT: using
@@ -123,9 +157,16 @@ SR_PRIV const struct scpi_dmm_model models[] = {
 	},
 	{
 		"Keysight", "34465A",
-		1, 5, cmdset_agilent, ARRAY_AND_SIZE(mqopts_agilent_34405a),
+		1, 5, cmdset_truevolt, ARRAY_AND_SIZE(mqopts_agilent_34405a),
 		scpi_dmm_get_meas_agilent,
-		ARRAY_AND_SIZE(devopts_generic),
+		ARRAY_AND_SIZE(devopts_burst),
+		0,
+	},
+	{
+		"Keysight", "34470A",
+		1, 7, cmdset_truevolt, ARRAY_AND_SIZE(mqopts_agilent_34405a),
+		scpi_dmm_get_meas_agilent,
+		ARRAY_AND_SIZE(devopts_burst),
 		0,
 	},
 	{
@@ -266,6 +307,11 @@ static int config_get(uint32_t key, GVariant **data,
 		arr[1] = g_variant_new_uint64(mqflag);
 		*data = g_variant_new_tuple(arr, ARRAY_SIZE(arr));
 		return SR_OK;
+	case SR_CONF_DATA_SOURCE:
+		if (!scpi_dmm_has_burst(sdi))
+			return SR_ERR_NA;
+		*data = g_variant_new_string(data_sources[devc->data_source]);
+		return SR_OK;
 	default:
 		return SR_ERR_NA;
 	}
@@ -278,6 +324,7 @@ static int config_set(uint32_t key, GVariant *data,
 	enum sr_mq mq;
 	enum sr_mqflag mqflag;
 	GVariant *tuple_child;
+	int idx;
 
 	(void)cg;
 
@@ -295,6 +342,13 @@ static int config_set(uint32_t key, GVariant *data,
 		mqflag = g_variant_get_uint64(tuple_child);
 		g_variant_unref(tuple_child);
 		return scpi_dmm_set_mq(sdi, mq, mqflag);
+	case SR_CONF_DATA_SOURCE:
+		if (!scpi_dmm_has_burst(sdi))
+			return SR_ERR_NA;
+		if ((idx = std_str_idx(data, ARRAY_AND_SIZE(data_sources))) < 0)
+			return SR_ERR_ARG;
+		devc->data_source = idx;
+		return SR_OK;
 	default:
 		return SR_ERR_NA;
 	}
@@ -334,6 +388,11 @@ static int config_list(uint32_t key, GVariant **data,
 		}
 		*data = g_variant_builder_end(&gvb);
 		return SR_OK;
+	case SR_CONF_DATA_SOURCE:
+		if (!devc || !scpi_dmm_has_burst(sdi))
+			return SR_ERR_NA;
+		*data = g_variant_new_strv(ARRAY_AND_SIZE(data_sources));
+		return SR_OK;
 	default:
 		(void)devc;
 		return SR_ERR_NA;
@@ -356,12 +415,18 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	if (ret != SR_OK)
 		return ret;
 
-	command = sr_scpi_cmd_get(devc->cmdset, DMM_CMD_START_ACQ);
-	if (command && *command) {
-		scpi_dmm_cmd_delay(scpi);
-		ret = sr_scpi_send(scpi, command);
+	if (devc->data_source == DMM_SOURCE_BURST) {
+		ret = scpi_dmm_burst_start(sdi);
 		if (ret != SR_OK)
 			return ret;
+	} else {
+		command = sr_scpi_cmd_get(devc->cmdset, DMM_CMD_START_ACQ);
+		if (command && *command) {
+			scpi_dmm_cmd_delay(scpi);
+			ret = sr_scpi_send(scpi, command);
+			if (ret != SR_OK)
+				return ret;
+		}
 	}
 
 	sr_sw_limits_acquisition_start(&devc->limits);
@@ -370,7 +435,8 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		return ret;
 
 	ret = sr_scpi_source_add(sdi->session, scpi, G_IO_IN, 10,
-		scpi_dmm_receive_data, (void *)sdi);
+		devc->data_source == DMM_SOURCE_BURST ?
+		scpi_dmm_receive_burst : scpi_dmm_receive_data, (void *)sdi);
 	if (ret != SR_OK)
 		return ret;
 
@@ -388,9 +454,13 @@ static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 
 	command = sr_scpi_cmd_get(devc->cmdset, DMM_CMD_STOP_ACQ);
 	if (command && *command) {
-		scpi_dmm_cmd_delay(scpi);
+		/* *OPC? would wait for the end of an endless burst. */
+		if (devc->data_source != DMM_SOURCE_BURST)
+			scpi_dmm_cmd_delay(scpi);
 		(void)sr_scpi_send(scpi, command);
 	}
+	if (devc->data_source == DMM_SOURCE_BURST)
+		scpi_dmm_burst_stop(sdi);
 	sr_scpi_source_remove(sdi->session, scpi);
 
 	std_session_send_df_end(sdi);
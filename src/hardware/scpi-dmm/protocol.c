@@ -148,46 +148,34 @@ SR_PRIV int scpi_dmm_set_mq(const struct sr_dev_inst *sdi,
 	return SR_OK;
 }
 
-SR_PRIV int scpi_dmm_get_meas_agilent(const struct sr_dev_inst *sdi, size_t ch)
+/*
+ * Get the meter's current function, and the exponent of its precision.
+ * Returns +1 when the function is unknown, measurements should get
+ * skipped then.
+ */
+static int get_mode_precision(const struct sr_dev_inst *sdi,
+	enum sr_mq *mq, enum sr_mqflag *mqflag, int *prec_exp)
 {
-	struct sr_scpi_dev_inst *scpi;
-	struct dev_context *devc;
-	struct scpi_dmm_acq_info *info;
-	struct sr_datafeed_analog *analog;
 	int ret;
-	enum sr_mq mq;
-	enum sr_mqflag mqflag;
 	char *mode_response;
 	const char *p;
 	char **fields;
 	size_t count;
 	char prec_text[20];
 	const struct mqopt_item *item;
-	int prec_exp;
-	const char *command;
-	char *response;
-	gboolean use_double;
-	int sig_digits, val_exp;
-	int digits;
-	enum sr_unit unit;
-
-	scpi = sdi->conn;
-	devc = sdi->priv;
-	info = &devc->run_acq_info;
-	analog = &info->analog[ch];
 
 	/*
 	 * Get the meter's current mode, keep the response around.
 	 * Skip the measurement if the mode is uncertain.
 	 */
-	ret = scpi_dmm_get_mq(sdi, &mq, &mqflag, &mode_response, &item);
+	ret = scpi_dmm_get_mq(sdi, mq, mqflag, &mode_response, &item);
 	if (ret != SR_OK) {
 		g_free(mode_response);
 		return ret;
 	}
 	if (!mode_response)
 		return SR_ERR;
-	if (!mq) {
+	if (!*mq) {
 		g_free(mode_response);
 		return +1;
 	}
@@ -236,12 +224,102 @@ SR_PRIV int scpi_dmm_get_meas_agilent(const struct sr_dev_inst *sdi, size_t ch)
 		p++;
 	ret = SR_OK;
 	if (!p || !*p)
-		prec_exp = 0;
+		*prec_exp = 0;
 	else if (*p != 'e' && *p != 'E')
 		ret = SR_ERR_DATA;
 	else
-		ret = sr_atoi(++p, &prec_exp);
+		ret = sr_atoi(++p, prec_exp);
 	g_free(mode_response);
+
+	return ret;
+}
+
+/*
+ * Fill in the 'analog' description: encoding, meaning. Callers will
+ * fill in the data, the sample count, and channel name, and will send
+ * out the packet.
+ */
+static int describe_analog(struct sr_datafeed_analog *analog,
+	enum sr_mq mq, enum sr_mqflag mqflag, int digits, size_t unitsize)
+{
+	enum sr_unit unit;
+
+	analog->encoding->unitsize = unitsize;
+	analog->encoding->is_float = TRUE;
+#ifdef WORDS_BIGENDIAN
+	analog->encoding->is_bigendian = TRUE;
+#else
+	analog->encoding->is_bigendian = FALSE;
+#endif
+	analog->encoding->digits = digits;
+	analog->meaning->mq = mq;
+	analog->meaning->mqflags = mqflag;
+	switch (mq) {
+	case SR_MQ_VOLTAGE:
+		unit = SR_UNIT_VOLT;
+		break;
+	case SR_MQ_CURRENT:
+		unit = SR_UNIT_AMPERE;
+		break;
+	case SR_MQ_RESISTANCE:
+	case SR_MQ_CONTINUITY:
+		unit = SR_UNIT_OHM;
+		break;
+	case SR_MQ_CAPACITANCE:
+		unit = SR_UNIT_FARAD;
+		break;
+	case SR_MQ_TEMPERATURE:
+		unit = SR_UNIT_CELSIUS;
+		break;
+	case SR_MQ_FREQUENCY:
+		unit = SR_UNIT_HERTZ;
+		break;
+	case SR_MQ_TIME:
+		unit = SR_UNIT_SECOND;
+		break;
+	default:
+		return SR_ERR_NA;
+	}
+	analog->meaning->unit = unit;
+	analog->spec->spec_digits = digits;
+
+	return SR_OK;
+}
+
+/* Map overload readings (+/-9.9E37) to infinity. */
+static double reading_value(double value)
+{
+	if (value > +9e37)
+		return +INFINITY;
+	if (value < -9e37)
+		return -INFINITY;
+
+	return value;
+}
+
+SR_PRIV int scpi_dmm_get_meas_agilent(const struct sr_dev_inst *sdi, size_t ch)
+{
+	struct sr_scpi_dev_inst *scpi;
+	struct dev_context *devc;
+	struct scpi_dmm_acq_info *info;
+	struct sr_datafeed_analog *analog;
+	int ret;
+	enum sr_mq mq;
+	enum sr_mqflag mqflag;
+	const char *p;
+	int prec_exp;
+	const char *command;
+	char *response;
+	gboolean use_double;
+	int sig_digits, val_exp;
+	int digits;
+
+	scpi = sdi->conn;
+	devc = sdi->priv;
+	info = &devc->run_acq_info;
+	analog = &info->analog[ch];
+
+	ret = get_mode_precision(sdi, &mq, &mqflag, &prec_exp);
 	if (ret != SR_OK)
 		return ret;
 
@@ -282,11 +360,8 @@ SR_PRIV int scpi_dmm_get_meas_agilent(const struct sr_dev_inst *sdi, size_t ch)
 	}
 	if (!response)
 		return SR_ERR;
-	if (info->d_value > +9e37) {
-		info->d_value = +INFINITY;
-	} else if (info->d_value < -9e37) {
-		info->d_value = -INFINITY;
-	} else {
+	info->d_value = reading_value(info->d_value);
+	if (!isinf(info->d_value)) {
 		p = response;
 		while (p && *p && g_ascii_isspace(*p))
 			p++;
@@ -344,58 +419,16 @@ SR_PRIV int scpi_dmm_get_meas_agilent(const struct sr_dev_inst *sdi, size_t ch)
 	digits -= val_exp;
 #endif
 
-	/*
-	 * Fill in the 'analog' description: value, encoding, meaning.
-	 * Callers will fill in the sample count, and channel name,
-	 * and will send out the packet.
-	 */
 	if (use_double) {
 		analog->data = &info->d_value;
-		analog->encoding->unitsize = sizeof(info->d_value);
-	} else {
-		info->f_value = info->d_value;
-		analog->data = &info->f_value;
-		analog->encoding->unitsize = sizeof(info->f_value);
-	}
-	analog->encoding->is_float = TRUE;
-#ifdef WORDS_BIGENDIAN
-	analog->encoding->is_bigendian = TRUE;
-#else
-	analog->encoding->is_bigendian = FALSE;
-#endif
-	analog->encoding->digits = digits;
-	analog->meaning->mq = mq;
-	analog->meaning->mqflags = mqflag;
-	switch (mq) {
-	case SR_MQ_VOLTAGE:
-		unit = SR_UNIT_VOLT;
-		break;
-	case SR_MQ_CURRENT:
-		unit = SR_UNIT_AMPERE;
-		break;
-	case SR_MQ_RESISTANCE:
-	case SR_MQ_CONTINUITY:
-		unit = SR_UNIT_OHM;
-		break;
-	case SR_MQ_CAPACITANCE:
-		unit = SR_UNIT_FARAD;
-		break;
-	case SR_MQ_TEMPERATURE:
-		unit = SR_UNIT_CELSIUS;
-		break;
-	case SR_MQ_FREQUENCY:
-		unit = SR_UNIT_HERTZ;
-		break;
-	case SR_MQ_TIME:
-		unit = SR_UNIT_SECOND;
-		break;
-	default:
-		return SR_ERR_NA;
+		return describe_analog(analog, mq, mqflag, digits,
+			sizeof(info->d_value));
 	}
-	analog->meaning->unit = unit;
-	analog->spec->spec_digits = digits;
+	info->f_value = info->d_value;
+	analog->data = &info->f_value;
 
-	return SR_OK;
+	return describe_analog(analog, mq, mqflag, digits,
+		sizeof(info->f_value));
 }
 
 /* Strictly speaking this is a timer controlled poll routine. */
@@ -484,3 +517,200 @@ SR_PRIV int scpi_dmm_receive_data(int fd, int revents, void *cb_data)
 
 	return TRUE;
 }
+
+/* Whether the model can buffer readings, and drain them in blocks. */
+SR_PRIV gboolean scpi_dmm_has_burst(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	const char *command;
+
+	devc = sdi->priv;
+	command = sr_scpi_cmd_get(devc->cmdset, DMM_CMD_QUERY_BURST);
+
+	return command && *command;
+}
+
+/*
+ * Have the meter take readings at the rate of its current setup, and
+ * keep them in its reading memory. scpi_dmm_receive_burst() drains
+ * the memory in blocks of up to SCPI_DMM_BURST_READINGS readings. The
+ * function cannot change during a burst, so its precision only gets
+ * queried here.
+ */
+SR_PRIV int scpi_dmm_burst_start(const struct sr_dev_inst *sdi)
+{
+	struct sr_scpi_dev_inst *scpi;
+	struct dev_context *devc;
+	const char *command;
+	int ret, prec_exp;
+
+	scpi = sdi->conn;
+	devc = sdi->priv;
+
+	ret = get_mode_precision(sdi, &devc->burst.mq, &devc->burst.mqflag,
+		&prec_exp);
+	if (ret > 0) {
+		sr_err("Unknown meter function, cannot start a burst.");
+		return SR_ERR_NA;
+	}
+	if (ret != SR_OK)
+		return ret;
+	devc->burst.digits = -prec_exp;
+
+	if (!devc->burst.values) {
+		devc->burst.text_size = SCPI_DMM_BURST_READINGS *
+			SCPI_DMM_BURST_TEXT_LEN;
+		devc->burst.text = g_malloc(devc->burst.text_size + 1);
+		devc->burst.values = g_malloc(SCPI_DMM_BURST_READINGS *
+			sizeof(devc->burst.values[0]));
+	}
+	g_free(devc->burst.query);
+	devc->burst.query = g_strdup_printf(sr_scpi_cmd_get(devc->cmdset,
+		DMM_CMD_QUERY_BURST), SCPI_DMM_BURST_READINGS);
+
+	command = sr_scpi_cmd_get(devc->cmdset, DMM_CMD_SETUP_BURST);
+	if (command && *command) {
+		scpi_dmm_cmd_delay(scpi);
+		if ((ret = sr_scpi_send(scpi, command)) != SR_OK)
+			return ret;
+	}
+	command = sr_scpi_cmd_get(devc->cmdset, DMM_CMD_START_BURST);
+	if (command && *command) {
+		scpi_dmm_cmd_delay(scpi);
+		if ((ret = sr_scpi_send(scpi, command)) != SR_OK)
+			return ret;
+	}
+
+	return SR_OK;
+}
+
+/* Leave the trigger setup the way live readings expect it. */
+SR_PRIV void scpi_dmm_burst_stop(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	const char *command;
+
+	devc = sdi->priv;
+
+	command = sr_scpi_cmd_get(devc->cmdset, DMM_CMD_STOP_BURST);
+	if (command && *command) {
+		scpi_dmm_cmd_delay(sdi->conn);
+		(void)sr_scpi_send(sdi->conn, command);
+	}
+	g_free(devc->burst.query);
+	devc->burst.query = NULL;
+	g_free(devc->burst.text);
+	devc->burst.text = NULL;
+	g_free(devc->burst.values);
+	devc->burst.values = NULL;
+}
+
+/*
+ * Parse a block of comma separated readings in place. Returns the
+ * number of readings, unparsable ones are skipped.
+ */
+static size_t burst_parse(char *text, double *values, size_t max)
+{
+	char *token, *end;
+	size_t num;
+
+	num = 0;
+	for (token = text; token && *token && num < max; token = end) {
+		end = strchr(token, ',');
+		if (end)
+			*end++ = '\0';
+		if (sr_atod_ascii(g_strstrip(token), &values[num]) != SR_OK) {
+			sr_dbg("Skipping unparsable reading '%s'.", token);
+			continue;
+		}
+		values[num] = reading_value(values[num]);
+		num++;
+	}
+
+	return num;
+}
+
+/* Timer controlled poll routine for burst mode. */
+SR_PRIV int scpi_dmm_receive_burst(int fd, int revents, void *cb_data)
+{
+	struct sr_dev_inst *sdi;
+	struct sr_scpi_dev_inst *scpi;
+	struct dev_context *devc;
+	struct scpi_dmm_acq_info *info;
+	struct sr_datafeed_analog *analog;
+	struct sr_channel *channel;
+	float *f_values;
+	size_t len, num, i;
+	uint64_t left;
+	int ret;
+
+	(void)fd;
+	(void)revents;
+
+	sdi = cb_data;
+	if (!sdi)
+		return TRUE;
+	scpi = sdi->conn;
+	devc = sdi->priv;
+	if (!scpi || !devc || !devc->burst.query)
+		return TRUE;
+	info = &devc->run_acq_info;
+
+	ret = sr_scpi_get_block_into(scpi, devc->burst.query,
+		devc->burst.text, devc->burst.text_size, &len);
+	if (ret != SR_OK) {
+		sr_err("Cannot read the meter's readings: %s.",
+			sr_strerror(ret));
+		sr_dev_acquisition_stop(sdi);
+		return TRUE;
+	}
+	devc->burst.text[len] = '\0';
+	num = burst_parse(devc->burst.text, devc->burst.values,
+		SCPI_DMM_BURST_READINGS);
+	if (devc->limits.limit_samples) {
+		left = devc->limits.limit_samples - MIN(
+			devc->limits.samples_read, devc->limits.limit_samples);
+		num = MIN(num, left);
+	}
+
+	channel = sdi->channels ? sdi->channels->data : NULL;
+	if (num && channel && channel->enabled) {
+		analog = &info->analog[0];
+		info->packet.type = SR_DF_ANALOG;
+		info->packet.payload = analog;
+		sr_analog_init(analog, &info->encoding[0], &info->meaning[0],
+			&info->spec[0], 0);
+		if (devc->model->digits > 6) {
+			analog->data = devc->burst.values;
+			ret = describe_analog(analog, devc->burst.mq,
+				devc->burst.mqflag, devc->burst.digits,
+				sizeof(double));
+		} else {
+			/*
+			 * Narrow in place. A float never overlaps the
+			 * doubles which are still to be converted.
+			 */
+			f_values = (float *)devc->burst.values;
+			for (i = 0; i < num; i++)
+				f_values[i] = devc->burst.values[i];
+			analog->data = f_values;
+			ret = describe_analog(analog, devc->burst.mq,
+				devc->burst.mqflag, devc->burst.digits,
+				sizeof(float));
+		}
+		if (ret != SR_OK) {
+			sr_dev_acquisition_stop(sdi);
+			return TRUE;
+		}
+		analog->num_samples = num;
+		analog->meaning->channels = g_slist_append(NULL, channel);
+		sr_session_send(sdi, &info->packet);
+		g_slist_free(analog->meaning->channels);
+	}
+	if (num)
+		sr_sw_limits_update_samples_read(&devc->limits, num);
+	if (sr_sw_limits_check(&devc->limits))
+		sr_dev_acquisition_stop(sdi);
+
+	return TRUE;
+}
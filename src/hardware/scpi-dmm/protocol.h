@@ -32,6 +32,10 @@
 
 #define SCPI_DMM_MAX_CHANNELS	1
 
+/* Readings per block in burst mode, and the text length of one. */
+#define SCPI_DMM_BURST_READINGS	4096
+#define SCPI_DMM_BURST_TEXT_LEN	24
+
 enum scpi_dmm_cmdcode {
 	DMM_CMD_SETUP_REMOTE,
 	DMM_CMD_SETUP_FUNC,
@@ -40,6 +44,15 @@ enum scpi_dmm_cmdcode {
 	DMM_CMD_STOP_ACQ,
 	DMM_CMD_QUERY_VALUE,
 	DMM_CMD_QUERY_PREC,
+	DMM_CMD_SETUP_BURST,
+	DMM_CMD_START_BURST,
+	DMM_CMD_QUERY_BURST,
+	DMM_CMD_STOP_BURST,
+};
+
+enum scpi_dmm_data_source {
+	DMM_SOURCE_LIVE,
+	DMM_SOURCE_BURST,
 };
 
 struct mqopt_item {
@@ -83,6 +96,17 @@ struct dev_context {
 		struct sr_analog_meaning meaning[SCPI_DMM_MAX_CHANNELS];
 		struct sr_analog_spec spec[SCPI_DMM_MAX_CHANNELS];
 	} run_acq_info;
+	enum scpi_dmm_data_source data_source;
+	/* Draining the meter's reading memory, see scpi_dmm_burst_start(). */
+	struct {
+		enum sr_mq mq;
+		enum sr_mqflag mqflag;
+		int digits;
+		char *query;
+		char *text;
+		size_t text_size;
+		double *values;
+	} burst;
 };
 
 SR_PRIV void scpi_dmm_cmd_delay(struct sr_scpi_dev_inst *scpi);
@@ -97,5 +121,9 @@ SR_PRIV int scpi_dmm_set_mq(const struct sr_dev_inst *sdi,
 	enum sr_mq mq, enum sr_mqflag flag);
 SR_PRIV int scpi_dmm_get_meas_agilent(const struct sr_dev_inst *sdi, size_t ch);
 SR_PRIV int scpi_dmm_receive_data(int fd, int revents, void *cb_data);
+SR_PRIV gboolean scpi_dmm_has_burst(const struct sr_dev_inst *sdi);
+SR_PRIV int scpi_dmm_burst_start(const struct sr_dev_inst *sdi);
+SR_PRIV void scpi_dmm_burst_stop(const struct sr_dev_inst *sdi);
+SR_PRIV int scpi_dmm_receive_burst(int fd, int revents, void *cb_data);
 
 #endif
@@ -36,6 +36,24 @@ static const uint32_t drvopts[] = {
 	SR_CONF_POWER_SUPPLY,
 };
 
+/*
+ * Settings can also be changed on the front panel, so their values are
+ * only kept for a short while. Measurements and protection trips are
+ * always queried.
+ */
+#define SETTING_TTL_MS 500
+static const struct sr_config_cache_key cache_keys[] = {
+	{ SR_CONF_ENABLED, SR_CONFIG_CACHE_TTL, SETTING_TTL_MS },
+	{ SR_CONF_VOLTAGE_TARGET, SR_CONFIG_CACHE_TTL, SETTING_TTL_MS },
+	{ SR_CONF_OUTPUT_FREQUENCY_TARGET, SR_CONFIG_CACHE_TTL, SETTING_TTL_MS },
+	{ SR_CONF_CURRENT_LIMIT, SR_CONFIG_CACHE_TTL, SETTING_TTL_MS },
+	{ SR_CONF_OVER_VOLTAGE_PROTECTION_ENABLED, SR_CONFIG_CACHE_TTL, SETTING_TTL_MS },
+	{ SR_CONF_OVER_VOLTAGE_PROTECTION_THRESHOLD, SR_CONFIG_CACHE_TTL, SETTING_TTL_MS },
+	{ SR_CONF_OVER_CURRENT_PROTECTION_ENABLED, SR_CONFIG_CACHE_TTL, SETTING_TTL_MS },
+	{ SR_CONF_OVER_CURRENT_PROTECTION_THRESHOLD, SR_CONFIG_CACHE_TTL, SETTING_TTL_MS },
+	{ SR_CONF_OVER_TEMPERATURE_PROTECTION, SR_CONFIG_CACHE_TTL, SETTING_TTL_MS },
+};
+
 static const struct pps_channel_instance pci[] = {
 	{ SR_MQ_VOLTAGE, SCPI_CMD_GET_MEAS_VOLTAGE, "V" },
 	{ SR_MQ_CURRENT, SCPI_CMD_GET_MEAS_CURRENT, "I" },
@@ -102,6 +120,7 @@ static struct sr_dev_inst *probe_device(struct sr_scpi_dev_inst *scpi,
 	devc->device = device;
 	sr_sw_limits_init(&devc->limits);
 	sdi->priv = devc;
+	sr_config_cache_init(sdi, cache_keys, ARRAY_SIZE(cache_keys));
 
 	if (device->num_channels) {
 		/* Static channels and groups. */
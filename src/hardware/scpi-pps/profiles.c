@@ -403,6 +403,7 @@ static const struct scpi_command rigol_dp800_cmd[] = {
 	{ SCPI_CMD_GET_MEAS_VOLTAGE, ":MEAS:VOLT?" },
 	{ SCPI_CMD_GET_MEAS_CURRENT, ":MEAS:CURR?" },
 	{ SCPI_CMD_GET_MEAS_POWER, ":MEAS:POWE?" },
+	{ SCPI_CMD_GET_MEAS_ALL, ":MEAS:ALL?" },
 	{ SCPI_CMD_GET_VOLTAGE_TARGET, ":SOUR:VOLT?" },
 	{ SCPI_CMD_SET_VOLTAGE_TARGET, ":SOUR:VOLT %.6f" },
 	{ SCPI_CMD_GET_CURRENT_LIMIT, ":SOUR:CURR?" },
@@ -25,21 +25,140 @@
 #include "scpi.h"
 #include "protocol.h"
 
-SR_PRIV int scpi_pps_receive_data(int fd, int revents, void *cb_data)
+/* Index of a channel's value in SCPI_CMD_GET_MEAS_ALL responses, or -1. */
+static int meas_all_index(enum sr_mq mq)
+{
+	switch (mq) {
+	case SR_MQ_VOLTAGE:
+		return 0;
+	case SR_MQ_CURRENT:
+		return 1;
+	case SR_MQ_POWER:
+		return 2;
+	default:
+		return -1;
+	}
+}
+
+/*
+ * Get all measurements of the selected channel group with one query.
+ * The response lists voltage, current and power (or the first of them),
+ * separated by commas, or by semicolons for chained queries.
+ */
+static int get_meas_all(const struct sr_dev_inst *sdi,
+	int channel_group_cmd, const char *channel_group_name,
+	double *values, size_t *count)
+{
+	struct dev_context *devc;
+	GVariant *gvdata;
+	const char *response;
+	char **tokens;
+	size_t i;
+	int ret;
+
+	devc = sdi->priv;
+
+	ret = sr_scpi_cmd_resp(sdi, devc->device->commands,
+		channel_group_cmd, channel_group_name, &gvdata,
+		G_VARIANT_TYPE_STRING, SCPI_CMD_GET_MEAS_ALL);
+	if (ret != SR_OK)
+		return ret;
+
+	response = g_variant_get_string(gvdata, NULL);
+	tokens = g_strsplit_set(response, ",;", 0);
+	for (i = 0; i < *count && tokens[i]; i++) {
+		ret = sr_atod_ascii(g_strstrip(tokens[i]), &values[i]);
+		if (ret != SR_OK) {
+			sr_err("Invalid measurement value '%s' in '%s'.",
+				tokens[i], response);
+			break;
+		}
+	}
+	*count = i;
+	g_strfreev(tokens);
+	g_variant_unref(gvdata);
+
+	return ret;
+}
+
+static void send_value(const struct sr_dev_inst *sdi, struct sr_channel *ch,
+	float f)
 {
 	struct dev_context *devc;
-	const struct scpi_pps *device;
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_analog analog;
 	struct sr_analog_encoding encoding;
 	struct sr_analog_meaning meaning;
 	struct sr_analog_spec spec;
+	struct pps_channel *pch;
+	const struct channel_spec *ch_spec;
+
+	devc = sdi->priv;
+	pch = ch->priv;
+
+	ch_spec = &devc->device->channels[pch->hw_output_idx];
+	packet.type = SR_DF_ANALOG;
+	packet.payload = &analog;
+	/* Note: digits/spec_digits will be overridden later. */
+	sr_analog_init(&analog, &encoding, &meaning, &spec, 0);
+	analog.meaning->channels = g_slist_append(NULL, ch);
+	analog.num_samples = 1;
+	analog.meaning->mq = pch->mq;
+	analog.meaning->mqflags = pch->mqflags;
+	if (pch->mq == SR_MQ_VOLTAGE) {
+		analog.meaning->unit = SR_UNIT_VOLT;
+		analog.encoding->digits = ch_spec->voltage[4];
+		analog.spec->spec_digits = ch_spec->voltage[3];
+	} else if (pch->mq == SR_MQ_CURRENT) {
+		analog.meaning->unit = SR_UNIT_AMPERE;
+		analog.encoding->digits = ch_spec->current[4];
+		analog.spec->spec_digits = ch_spec->current[3];
+	} else if (pch->mq == SR_MQ_POWER) {
+		analog.meaning->unit = SR_UNIT_WATT;
+		analog.encoding->digits = ch_spec->power[4];
+		analog.spec->spec_digits = ch_spec->power[3];
+	} else if (pch->mq == SR_MQ_FREQUENCY) {
+		analog.meaning->unit = SR_UNIT_HERTZ;
+		analog.encoding->digits = ch_spec->frequency[4];
+		analog.spec->spec_digits = ch_spec->frequency[3];
+	}
+	analog.data = &f;
+	sr_session_send(sdi, &packet);
+	g_slist_free(analog.meaning->channels);
+}
+
+/* Move on to the next channel. Returns TRUE when all have been sampled. */
+static gboolean next_channel(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+
+	devc = sdi->priv;
+
+	if (g_slist_length(sdi->channels) > 1) {
+		devc->cur_acquisition_channel =
+			sr_next_enabled_channel(sdi, devc->cur_acquisition_channel);
+	}
+
+	if (devc->cur_acquisition_channel != sr_next_enabled_channel(sdi, NULL))
+		return FALSE;
+
+	/* First enabled channel, so each channel has been sampled */
+	sr_sw_limits_update_samples_read(&devc->limits, 1);
+
+	return TRUE;
+}
+
+SR_PRIV int scpi_pps_receive_data(int fd, int revents, void *cb_data)
+{
+	struct dev_context *devc;
+	const struct scpi_pps *device;
 	struct sr_dev_inst *sdi;
 	int channel_group_cmd;
 	const char *channel_group_name;
-	struct pps_channel *pch;
-	const struct channel_spec *ch_spec;
-	int ret;
+	struct pps_channel *pch, *next_pch;
+	double values[3];
+	size_t num_values;
+	int ret, idx;
 	float f;
 	GVariant *gvdata;
 	const GVariantType *gvtype;
@@ -75,69 +194,63 @@ SR_PRIV int scpi_pps_receive_data(int fd, int revents, void *cb_data)
 		device->update_status(sdi);
 	}
 
-	if (pch->mq == SR_MQ_VOLTAGE) {
-		gvtype = G_VARIANT_TYPE_DOUBLE;
-		cmd = SCPI_CMD_GET_MEAS_VOLTAGE;
-	} else if (pch->mq == SR_MQ_FREQUENCY) {
-		gvtype = G_VARIANT_TYPE_DOUBLE;
-		cmd = SCPI_CMD_GET_MEAS_FREQUENCY;
-	} else if (pch->mq == SR_MQ_CURRENT) {
-		gvtype = G_VARIANT_TYPE_DOUBLE;
-		cmd = SCPI_CMD_GET_MEAS_CURRENT;
-	} else if (pch->mq == SR_MQ_POWER) {
-		gvtype = G_VARIANT_TYPE_DOUBLE;
-		cmd = SCPI_CMD_GET_MEAS_POWER;
+	/*
+	 * Devices which can return all measurements of an output in one
+	 * response get one query for all of its (adjacent) channels,
+	 * instead of one query per channel.
+	 */
+	if (meas_all_index(pch->mq) >= 0 &&
+			sr_scpi_cmd_get(device->commands, SCPI_CMD_GET_MEAS_ALL)) {
+		num_values = ARRAY_SIZE(values);
+		ret = get_meas_all(sdi, channel_group_cmd, channel_group_name,
+			values, &num_values);
+		if (ret != SR_OK)
+			return ret;
+		while (TRUE) {
+			idx = meas_all_index(pch->mq);
+			if ((size_t)idx >= num_values) {
+				sr_err("No value for channel %s in response.",
+					devc->cur_acquisition_channel->name);
+				return SR_ERR_DATA;
+			}
+			send_value(sdi, devc->cur_acquisition_channel,
+				(float)values[idx]);
+			if (next_channel(sdi))
+				break;
+			next_pch = devc->cur_acquisition_channel->priv;
+			if (next_pch->hw_output_idx != pch->hw_output_idx ||
+					meas_all_index(next_pch->mq) < 0)
+				break;
+			pch = next_pch;
+		}
 	} else {
-		return SR_ERR;
-	}
+		if (pch->mq == SR_MQ_VOLTAGE) {
+			gvtype = G_VARIANT_TYPE_DOUBLE;
+			cmd = SCPI_CMD_GET_MEAS_VOLTAGE;
+		} else if (pch->mq == SR_MQ_FREQUENCY) {
+			gvtype = G_VARIANT_TYPE_DOUBLE;
+			cmd = SCPI_CMD_GET_MEAS_FREQUENCY;
+		} else if (pch->mq == SR_MQ_CURRENT) {
+			gvtype = G_VARIANT_TYPE_DOUBLE;
+			cmd = SCPI_CMD_GET_MEAS_CURRENT;
+		} else if (pch->mq == SR_MQ_POWER) {
+			gvtype = G_VARIANT_TYPE_DOUBLE;
+			cmd = SCPI_CMD_GET_MEAS_POWER;
+		} else {
+			return SR_ERR;
+		}
 
-	ret = sr_scpi_cmd_resp(sdi, devc->device->commands,
-		channel_group_cmd, channel_group_name, &gvdata, gvtype, cmd);
+		ret = sr_scpi_cmd_resp(sdi, devc->device->commands,
+			channel_group_cmd, channel_group_name, &gvdata, gvtype, cmd);
 
-	if (ret != SR_OK)
-		return ret;
+		if (ret != SR_OK)
+			return ret;
 
-	ch_spec = &devc->device->channels[pch->hw_output_idx];
-	packet.type = SR_DF_ANALOG;
-	packet.payload = &analog;
-	/* Note: digits/spec_digits will be overridden later. */
-	sr_analog_init(&analog, &encoding, &meaning, &spec, 0);
-	analog.meaning->channels = g_slist_append(NULL, devc->cur_acquisition_channel);
-	analog.num_samples = 1;
-	analog.meaning->mq = pch->mq;
-	analog.meaning->mqflags = pch->mqflags;
-	if (pch->mq == SR_MQ_VOLTAGE) {
-		analog.meaning->unit = SR_UNIT_VOLT;
-		analog.encoding->digits = ch_spec->voltage[4];
-		analog.spec->spec_digits = ch_spec->voltage[3];
-	} else if (pch->mq == SR_MQ_CURRENT) {
-		analog.meaning->unit = SR_UNIT_AMPERE;
-		analog.encoding->digits = ch_spec->current[4];
-		analog.spec->spec_digits = ch_spec->current[3];
-	} else if (pch->mq == SR_MQ_POWER) {
-		analog.meaning->unit = SR_UNIT_WATT;
-		analog.encoding->digits = ch_spec->power[4];
-		analog.spec->spec_digits = ch_spec->power[3];
-	} else if (pch->mq == SR_MQ_FREQUENCY) {
-		analog.meaning->unit = SR_UNIT_HERTZ;
-		analog.encoding->digits = ch_spec->frequency[4];
-		analog.spec->spec_digits = ch_spec->frequency[3];
+		f = (float)g_variant_get_double(gvdata);
+		g_variant_unref(gvdata);
+		send_value(sdi, devc->cur_acquisition_channel, f);
+		next_channel(sdi);
 	}
-	f = (float)g_variant_get_double(gvdata);
-	g_variant_unref(gvdata);
-	analog.data = &f;
-	sr_session_send(sdi, &packet);
-	g_slist_free(analog.meaning->channels);
-
-	/* Next channel. */
-	if (g_slist_length(sdi->channels) > 1) {
-		devc->cur_acquisition_channel =
-			sr_next_enabled_channel(sdi, devc->cur_acquisition_channel);
-	}
-
-	if (devc->cur_acquisition_channel == sr_next_enabled_channel(sdi, NULL))
-		/* First enabled channel, so each channel has been sampled */
-		sr_sw_limits_update_samples_read(&devc->limits, 1);
 
 	/* Stop if limits have been hit. */
 	if (sr_sw_limits_check(&devc->limits))
@@ -66,6 +66,8 @@ enum pps_scpi_cmds {
 	SCPI_CMD_GET_OVER_CURRENT_PROTECTION_ACTIVE,
 	SCPI_CMD_GET_OVER_CURRENT_PROTECTION_THRESHOLD,
 	SCPI_CMD_SET_OVER_CURRENT_PROTECTION_THRESHOLD,
+	/* Voltage, current and power (or the first of them) in one response. */
+	SCPI_CMD_GET_MEAS_ALL,
 };
 
 /* Defines the SCPI dialect */
@@ -180,18 +180,37 @@ static int config_list(uint32_t key, GVariant **data,
 
 static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 {
+	struct dmm_info *dmm;
 	struct dev_context *devc;
 	struct sr_serial_dev_inst *serial;
+	int timeout;
 
+	dmm = (struct dmm_info *)sdi->driver;
 	devc = sdi->priv;
 
 	sr_sw_limits_acquisition_start(&devc->limits);
 	std_session_send_df_header(sdi);
 
+	/*
+	 * receive_data() sets when it needs to run next, for requests and
+	 * the time limit. Only meters which get asked again without a
+	 * request timeout (after a lost reply) need a short interval.
+	 */
+	timeout = DMM_IDLE_TIMEOUT_MS;
+	if (dmm->packet_request)
+		timeout = dmm->req_timeout_ms ?
+			MIN(timeout, dmm->req_timeout_ms) : DMM_REQUEST_POLL_MS;
+	if (devc->limits.limit_msec)
+		timeout = MIN(timeout, devc->limits.limit_msec / 1000 + 1);
+
 	serial = sdi->conn;
-	serial_source_add(sdi->session, serial, G_IO_IN, 50,
+	serial_source_add(sdi->session, serial, G_IO_IN, timeout,
 		      receive_data, (void *)sdi);
 
+	/* Don't wait for the first timeout to ask for the first packet. */
+	devc->req_next_at = 0;
+	req_packet((struct sr_dev_inst *)sdi);
+
 	return SR_OK;
 }
 
@@ -126,7 +126,8 @@ static void handle_new_data(struct sr_dev_inst *sdi, void *info)
 {
 	struct dmm_info *dmm;
 	struct dev_context *devc;
-	int len, offset;
+	const uint8_t *data;
+	size_t len, offset;
 	struct sr_serial_dev_inst *serial;
 
 	dmm = (struct dmm_info *)sdi->driver;
@@ -134,22 +135,17 @@ static void handle_new_data(struct sr_dev_inst *sdi, void *info)
 	devc = sdi->priv;
 	serial = sdi->conn;
 
-	/* Try to get as much data as the buffer can hold. */
-	len = DMM_BUFSIZE - devc->buflen;
-	len = serial_read_nonblocking(serial, devc->buf + devc->buflen, len);
-	if (len == 0)
-		return; /* No new bytes, nothing to do. */
-	if (len < 0) {
-		sr_err("Serial port read error: %d.", len);
+	/* Get all the data that arrived, plus what is left from before. */
+	if (serial_peek(serial, &data, &len) != SR_OK) {
+		sr_err("Serial port read error.");
 		return;
 	}
-	devc->buflen += len;
 
-	/* Now look for packets in that data. */
+	/* Now look for packets in that data, in place. */
 	offset = 0;
-	while ((devc->buflen - offset) >= dmm->packet_size) {
-		if (dmm->packet_valid(devc->buf + offset)) {
-			handle_packet(devc->buf + offset, sdi, info);
+	while ((len - offset) >= dmm->packet_size) {
+		if (dmm->packet_valid(data + offset)) {
+			handle_packet(data + offset, sdi, info);
 			offset += dmm->packet_size;
 
 			/* Request next packet, if required. */
@@ -164,10 +160,10 @@ static void handle_new_data(struct sr_dev_inst *sdi, void *info)
 		}
 	}
 
-	/* If we have any data left, move it to the beginning of our buffer. */
-	if (devc->buflen > offset)
-		memmove(devc->buf, devc->buf + offset, devc->buflen - offset);
-	devc->buflen -= offset;
+	/* Keep any data left for the next round, but don't fall behind. */
+	if (len - offset > DMM_BACKLOG_SIZE)
+		offset = len - DMM_BACKLOG_SIZE;
+	serial_consume(serial, offset);
 }
 
 int receive_data(int fd, int revents, void *cb_data)
@@ -198,8 +194,15 @@ int receive_data(int fd, int revents, void *cb_data)
 			return FALSE;
 	}
 
-	if (sr_sw_limits_check(&devc->limits))
+	if (sr_sw_limits_check(&devc->limits)) {
 		sr_dev_acquisition_stop(sdi);
+		return TRUE;
+	}
+
+	/* Sleep until the next request or the end of the acquisition. */
+	if (dmm->packet_request && devc->req_next_at > g_get_monotonic_time())
+		sr_session_source_wake_at(devc->req_next_at);
+	sr_session_source_wake_at(sr_sw_limits_deadline(&devc->limits));
 
 	return TRUE;
 }
@@ -62,15 +62,16 @@ struct dmm_info {
 	gsize info_size;
 };
 
-#define DMM_BUFSIZE 256
+/* Most received data to keep around for parsing. */
+#define DMM_BACKLOG_SIZE 256
+
+/* Event source timeouts (ms), see dev_acquisition_start(). */
+#define DMM_IDLE_TIMEOUT_MS	1000
+#define DMM_REQUEST_POLL_MS	50
 
 struct dev_context {
 	struct sr_sw_limits limits;
 
-	uint8_t buf[DMM_BUFSIZE];
-	int bufoffset;
-	int buflen;
-
 	/**
 	 * The timestamp [µs] to send the next request.
 	 * Used only if device needs polling.
@@ -240,6 +240,7 @@ static void clear_helper(void *priv)
 		return;
 	g_free(devc->analog_groups);
 	g_free(devc->enabled_channels);
+	sr_analog_interleave_free(devc->interleave);
 }
 
 static int dev_clear(const struct sr_dev_driver *di)
@@ -800,7 +801,7 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	struct dev_context *devc;
 	struct sr_channel *ch;
 	gboolean some_digital;
-	GSList *l, *d;
+	GSList *l, *d, *analog_channels;
 
 	scpi = sdi->conn;
 	devc = sdi->priv;
@@ -865,6 +866,27 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	// devc->digital_frame_size = devc->model->series->buffer_samples;
 
 	siglent_sds_get_dev_cfg_horizontal(sdi);
+
+	/*
+	 * Collect the analog channels of a frame into one packet when the
+	 * session takes those, unless the frame is too deep to hold.
+	 */
+	sr_analog_interleave_free(devc->interleave);
+	devc->interleave = NULL;
+	analog_channels = NULL;
+	for (l = devc->enabled_channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->type == SR_CHANNEL_ANALOG)
+			analog_channels = g_slist_append(analog_channels, ch);
+	}
+	if (sr_session_takes_analog_interleaved(sdi->session) &&
+			g_slist_length(analog_channels) > 1 &&
+			devc->memory_depth_analog * g_slist_length(analog_channels) <=
+			MAX_INTERLEAVED_VALUES)
+		devc->interleave = sr_analog_interleave_new(analog_channels,
+			devc->memory_depth_analog);
+	g_slist_free(analog_channels);
+
 	switch (devc->model->series->protocol) {
 	case SPO_MODEL:
 		if (siglent_sds_config_set(sdi, "WFSU SP,0,TYPE,1") != SR_OK)
@@ -915,6 +937,8 @@ static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 
 	g_slist_free(devc->enabled_channels);
 	devc->enabled_channels = NULL;
+	sr_analog_interleave_free(devc->interleave);
+	devc->interleave = NULL;
 	scpi = sdi->conn;
 	sr_scpi_source_remove(sdi->session, scpi);
 
@@ -465,7 +465,7 @@ SR_PRIV int siglent_sds_receive(int fd, int revents, void *cb_data)
 	struct sr_analog_spec spec;
 	struct sr_datafeed_logic logic;
 	struct sr_channel *ch;
-	int len, i;
+	int len;
 	float wait;
 	gboolean read_complete = FALSE;
 
@@ -576,33 +576,31 @@ SR_PRIV int siglent_sds_receive(int fd, int revents, void *cb_data)
 				if (ch->type == SR_CHANNEL_ANALOG) {
 					float vdiv = devc->vdiv[ch->index];
 					float offset = devc->vert_offset[ch->index];
-					GArray *float_data;
-					static GArray *data;
-					float voltage, vdivlog;
+					float vdivlog;
 					int digits;
 
-					data = g_array_sized_new(FALSE, FALSE, sizeof(uint8_t), len);
-					g_array_append_vals(data, devc->buffer, len);
-					float_data = g_array_new(FALSE, FALSE, sizeof(float));
-					for (i = 0; i < len; i++) {
-						voltage = (float)g_array_index(data, int8_t, i) / 25;
-						voltage = ((vdiv * voltage) - offset);
-						g_array_append_val(float_data, voltage);
-					}
 					vdivlog = log10f(vdiv);
 					digits = -(int) vdivlog + (vdivlog < 0.0);
 					sr_analog_init(&analog, &encoding, &meaning, &spec, digits);
+					/* The raw values are signed, 25 per division. */
+					encoding.unitsize = sizeof(int8_t);
+					encoding.is_signed = TRUE;
+					encoding.is_float = FALSE;
+					sr_rational_from_double(&encoding.scale, vdiv / 25);
+					sr_rational_from_double(&encoding.offset, -offset);
 					analog.meaning->channels = g_slist_append(NULL, ch);
-					analog.num_samples = float_data->len;
-					analog.data = (float *)float_data->data;
+					analog.num_samples = len;
+					analog.data = devc->buffer;
 					analog.meaning->mq = SR_MQ_VOLTAGE;
 					analog.meaning->unit = SR_UNIT_VOLT;
 					analog.meaning->mqflags = 0;
 					packet.type = SR_DF_ANALOG;
 					packet.payload = &analog;
-					sr_session_send(sdi, &packet);
+					if (devc->interleave)
+						sr_analog_interleave_add(devc->interleave, &analog);
+					else
+						sr_session_send(sdi, &packet);
 					g_slist_free(analog.meaning->channels);
-					g_array_free(data, TRUE);
 				}
 				len = 0;
 				if (devc->num_samples == (devc->num_block_bytes - SIGLENT_HEADER_SIZE)) {
@@ -629,6 +627,8 @@ SR_PRIV int siglent_sds_receive(int fd, int revents, void *cb_data)
 				siglent_sds_channel_start(sdi);
 			} else {
 				/* Done with this frame. */
+				if (devc->interleave)
+					sr_analog_interleave_send(devc->interleave, sdi);
 				std_session_send_df_frame_end(sdi);
 				if (++devc->num_frames == devc->limit_frames) {
 					/* Last frame, stop capture. */
@@ -646,6 +646,9 @@ SR_PRIV int siglent_sds_receive(int fd, int revents, void *cb_data)
 	} else {
 		if (!siglent_sds_get_digital(sdi, ch))
 			return TRUE;
+		/* The analog channels come first, their frame is complete. */
+		if (devc->interleave)
+			sr_analog_interleave_send(devc->interleave, sdi);
 		logic.length = devc->dig_buffer->len;
 		logic.unitsize = 2;
 		logic.data = devc->dig_buffer->data;
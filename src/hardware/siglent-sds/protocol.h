@@ -37,6 +37,9 @@
 /* Maximum number of samples to retrieve at once. */
 #define ACQ_BLOCK_SIZE (30 * 1000)
 
+/* Most values of a frame to collect into one interleaved packet. */
+#define MAX_INTERLEAVED_VALUES (16 * 1000 * 1000)
+
 #define MAX_ANALOG_CHANNELS 4
 #define MAX_DIGITAL_CHANNELS 16
 
@@ -137,6 +140,8 @@ struct dev_context {
 	uint64_t num_frames;
 	/* GSList entry for the current channel. */
 	GSList *channel_entry;
+	/* Collects a frame's analog channels into one packet, or NULL. */
+	struct sr_analog_interleave *interleave;
 	/* Number of bytes received for current channel. */
 	uint64_t num_channel_bytes;
 	/* Number of bytes of block header read. */
@@ -116,8 +116,10 @@ struct acquisition_state {
 	unsigned int mem_addr_fill;	/* capture memory fill level */
 	unsigned int mem_addr_done;	/* next address to be processed */
 	unsigned int mem_addr_next;	/* start address for next async read */
+	unsigned int mem_addr_end;	/* end of the data in the in buffer */
 	unsigned int mem_addr_stop;	/* end of memory range to be read */
 	unsigned int in_index;		/* position in read transfer buffer */
+	int in_length;			/* size of data in read transfer buffer */
 	unsigned int out_index;		/* position in logic packet buffer */
 	enum rle_state rle;		/* RLE decoding state */
 
@@ -129,7 +131,9 @@ struct acquisition_state {
 	unsigned int reg_seq_len;	/* length of register/value sequence */
 
 	struct regval reg_sequence[MAX_REG_SEQ_LEN];	/* register buffer */
-	uint32_t xfer_buf_in[MAX_ACQ_RECV_LEN32];	/* USB in buffer */
+	uint32_t *xfer_buf_in;				/* received data */
+	/* USB in buffers, one gets decoded while the other one is filled. */
+	uint32_t xfer_bufs_in[2][MAX_ACQ_RECV_LEN32];
 	uint16_t xfer_buf_out[MAX_ACQ_SEND_LEN16];	/* USB out buffer */
 	uint8_t out_packet[PACKET_SIZE];		/* logic payload */
 };
@@ -184,6 +184,50 @@ static void handle_length_response(const struct sr_dev_inst *sdi)
 	submit_request(sdi, STATE_READ_PREPARE);
 }
 
+/*
+ * Send off the samples gathered in the output packet. The run lengths
+ * from capture memory make the sample count the device's own clock.
+ */
+static void send_logic_packet(const struct sr_dev_inst *sdi,
+	const struct sr_datafeed_packet *packet)
+{
+	struct dev_context *devc;
+	struct acquisition_state *acq;
+	struct sr_packet_timing timing;
+
+	devc = sdi->priv;
+	acq = devc->acquisition;
+
+	memset(&timing, 0, sizeof(timing));
+	timing.first_sample = acq->samples_done - acq->out_index;
+	if (devc->cfg_clock_source == CLOCK_INTERNAL) {
+		timing.hw_time = timing.first_sample;
+		timing.hw_rate = devc->samplerate;
+	}
+	sr_session_send_timed(sdi, packet, &timing);
+	acq->out_index = 0;
+}
+
+/*
+ * Request the next block of capture memory into the other in buffer, so
+ * that the device sends it while the current block is being decoded.
+ */
+static void request_next_block(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	struct acquisition_state *acq;
+
+	devc = sdi->priv;
+	acq = devc->acquisition;
+
+	if (acq->xfer_buf_in == acq->xfer_bufs_in[0])
+		acq->xfer_in->buffer = (unsigned char *)acq->xfer_bufs_in[1];
+	else
+		acq->xfer_in->buffer = (unsigned char *)acq->xfer_bufs_in[0];
+
+	submit_request(sdi, STATE_READ_REQUEST);
+}
+
 /* Evaluate and act on the response to a capture memory read request. */
 static void handle_read_response(const struct sr_dev_inst *sdi)
 {
@@ -192,6 +236,7 @@ static void handle_read_response(const struct sr_dev_inst *sdi)
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
 	unsigned int end_addr;
+	gboolean requested;
 
 	devc = sdi->priv;
 	acq = devc->acquisition;
@@ -202,8 +247,10 @@ static void handle_read_response(const struct sr_dev_inst *sdi)
 	logic.unitsize = (devc->model->num_channels + 7) / 8;
 	logic.data = acq->out_packet;
 
-	end_addr = MIN(acq->mem_addr_next, acq->mem_addr_stop);
+	acq->mem_addr_end = acq->mem_addr_next;
+	end_addr = MIN(acq->mem_addr_end, acq->mem_addr_stop);
 	acq->in_index = 0;
+	requested = FALSE;
 
 	/*
 	 * Repeatedly call the model-specific read response handler until
@@ -217,27 +264,27 @@ static void handle_read_response(const struct sr_dev_inst *sdi)
 			devc->transfer_error = TRUE;
 			return;
 		}
+		/* The response checked out, request the next block. */
+		if (!requested && acq->mem_addr_next < acq->mem_addr_stop
+				&& acq->samples_done < acq->samples_max) {
+			request_next_block(sdi);
+			requested = TRUE;
+		}
 		if (acq->out_index * logic.unitsize >= PACKET_SIZE) {
 			/* Send off full logic packet. */
 			logic.length = acq->out_index * logic.unitsize;
-			sr_session_send(sdi, &packet);
-			acq->out_index = 0;
+			send_logic_packet(sdi, &packet);
 		}
 	}
 
-	if (!devc->cancel_requested
-			&& acq->samples_done < acq->samples_max
-			&& acq->mem_addr_next < acq->mem_addr_stop) {
-		/* Request the next block. */
-		submit_request(sdi, STATE_READ_REQUEST);
+	/* Decode the next block once it arrived. */
+	if (requested)
 		return;
-	}
 
 	/* Send partially filled packet as it is the last one. */
 	if (!devc->cancel_requested && acq->out_index > 0) {
- 		logic.length = acq->out_index * logic.unitsize;
-		sr_session_send(sdi, &packet);
-		acq->out_index = 0;
+		logic.length = acq->out_index * logic.unitsize;
+		send_logic_packet(sdi, &packet);
 	}
 	submit_request(sdi, STATE_READ_FINISH);
 }
@@ -398,6 +445,8 @@ static void LIBUSB_CALL transfer_in_completed(struct libusb_transfer *transfer)
 		devc->transfer_error = TRUE;
 		return;
 	}
+	acq->xfer_buf_in = (uint32_t *)transfer->buffer;
+	acq->in_length = transfer->actual_length;
 
 	if (acq->reg_seq_pos < acq->reg_seq_len && !devc->cancel_requested) {
 		/* Complete register read sequence. */
@@ -476,9 +525,10 @@ static int init_acquisition_state(const struct sr_dev_inst *sdi)
 				  &transfer_out_completed,
 				  (struct sr_dev_inst *)sdi, USB_TIMEOUT_MS);
 
+	acq->xfer_buf_in = acq->xfer_bufs_in[0];
 	libusb_fill_bulk_transfer(acq->xfer_in, usb->devhdl, EP_REPLY,
 				  (unsigned char *)acq->xfer_buf_in,
-				  sizeof(acq->xfer_buf_in),
+				  sizeof(acq->xfer_bufs_in[0]),
 				  &transfer_in_completed,
 				  (struct sr_dev_inst *)sdi, USB_TIMEOUT_MS);
 
@@ -120,6 +120,19 @@
 #define FW_CHUNK_SIZE 250
 #define XILINX_SYNC_WORD 0xAA995566
 
+/*
+ * Sample memory is read in chunks of RLE records. Each chunk is fetched
+ * by several bulk transfers in flight, and decoded as they come in.
+ */
+enum {
+	RLE_SAMPLE_SIZE = sizeof(uint32_t) + sizeof(uint16_t),
+	RLE_SAMPLES_COUNT = 0x100000,
+	RLE_BUF_SIZE = RLE_SAMPLES_COUNT * RLE_SAMPLE_SIZE,
+	RLE_END_MARKER = 0xFFFF,
+	DATA_XFER_SIZE = 0x10000 * RLE_SAMPLE_SIZE,
+	DECODE_BUF_SAMPLES = 0x10000,
+};
+
 static int la_write_cmd_buf(const struct sr_usb_dev_inst *usb, uint8_t cmd,
 		unsigned int addr, unsigned int len, const void *data)
 {
@@ -412,15 +425,8 @@ static int sla5032_get_status(const struct sr_usb_dev_inst *usb, uint32_t status
 	return ret;
 }
 
-static int la_read_samples_data(const struct sr_usb_dev_inst *usb, void *buf,
-		unsigned int len, int *xfer_len)
-{
-	return libusb_bulk_transfer(usb->devhdl, EP_DATA, (uint8_t *)buf, len,
-			xfer_len, USB_DATA_TIMEOUT_MS);
-}
-
-static int sla5032_read_data_chunk(const struct sr_usb_dev_inst *usb,
-		void *buf, unsigned int len, int *xfer_len)
+/* Have the device send the next chunk of sample data on EP_DATA. */
+static int sla5032_request_data_chunk(const struct sr_usb_dev_inst *usb)
 {
 	int ret;
 
@@ -436,11 +442,7 @@ static int sla5032_read_data_chunk(const struct sr_usb_dev_inst *usb,
 	if (ret != SR_OK)
 		return ret;
 
-	ret = la_set_res_reg_bit(usb, 5, 4, 1);
-	if (ret != SR_OK)
-		return ret;
-
-	return la_read_samples_data(usb, buf, len, xfer_len);
+	return la_set_res_reg_bit(usb, 5, 4, 1);
 }
 
 static int sla5032_set_read_back(const struct sr_usb_dev_inst *usb)
@@ -683,185 +685,339 @@ SR_PRIV int sla5032_apply_fpga_config(const struct sr_dev_inst *sdi)
 	return ret;
 }
 
-/* Callback handling data */
-static int la_prepare_data(int fd, int revents, void *cb_data)
+static void send_samples(const struct sr_dev_inst *sdi)
 {
-	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
-	struct sr_usb_dev_inst *usb;
-	int i, j, ret, xfer_len;
-	uint8_t *rle_buf, *samples;
-	const uint8_t *p, *q;
-	uint16_t rle_count;
-	int samples_count, rle_samples_count;
-	uint32_t status[3];
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
-	uint32_t value;
 	int trigger_offset;
 
-	enum {
-		RLE_SAMPLE_SIZE = sizeof(uint32_t) + sizeof(uint16_t),
-		RLE_SAMPLES_COUNT = 0x100000,
-		RLE_BUF_SIZE = RLE_SAMPLES_COUNT * RLE_SAMPLE_SIZE,
-		RLE_END_MARKER = 0xFFFF,
-	};
+	devc = sdi->priv;
 
-	(void)fd;
-	(void)revents;
+	if (!devc->num_samples)
+		return;
+
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.unitsize = sizeof(uint32_t);
+
+	if (devc->trigger_fired) {
+		/* Send the incoming transfer to the session bus. */
+		logic.length = devc->num_samples * sizeof(uint32_t);
+		logic.data = devc->samples;
+		sr_session_send(sdi, &packet);
+	} else {
+		trigger_offset = soft_trigger_logic_check(devc->stl,
+			devc->samples, devc->num_samples * sizeof(uint32_t), NULL);
+		if (trigger_offset > -1) {
+			logic.length = (devc->num_samples - trigger_offset) *
+				sizeof(uint32_t);
+			logic.data = devc->samples +
+				trigger_offset * sizeof(uint32_t);
+			sr_session_send(sdi, &packet);
+
+			devc->trigger_fired = TRUE;
+		}
+	}
+
+	devc->num_samples = 0;
+}
+
+/* Decode RLE records, returns TRUE at the end of the sample data. */
+static gboolean decode_rle(const struct sr_dev_inst *sdi,
+		const uint8_t *p, int len)
+{
+	struct dev_context *devc;
+	int i, j, rle_samples_count;
+	uint16_t rle_count;
+	uint32_t value;
 
-	sdi = cb_data;
 	devc = sdi->priv;
-	usb = sdi->conn;
 
-	memset(status, 0, sizeof(status));
-	ret = sla5032_get_status(usb, status);
-	if (ret != SR_OK) {
-		sla5032_write_reg14_zero(usb);
-		sr_dev_acquisition_stop(sdi);
-		return G_SOURCE_CONTINUE;
-	}
+	rle_samples_count = len / RLE_SAMPLE_SIZE;
+	for (i = 0; i < rle_samples_count; i++) {
+		value = RL32(p);
+		p += sizeof(uint32_t); /* read sample value */
 
-	/* data not ready (acquision in progress) */
-	if (status[1] != 3)
-		return G_SOURCE_CONTINUE;
+		rle_count = RL16(p); /* read RLE counter */
+		p += sizeof(uint16_t);
 
-	sr_dbg("acquision done, status: %u.", (unsigned int)status[2]);
+		if (rle_count == RLE_END_MARKER) {
+			sr_dbg("RLE end marker found.");
+			return TRUE;
+		}
 
-	/* data ready (download, decode and send to sigrok) */
-	ret = sla5032_set_read_back(usb);
-	if (ret != SR_OK) {
-		sla5032_write_reg14_zero(usb);
-		sr_dev_acquisition_stop(sdi);
-		return G_SOURCE_CONTINUE;
+		for (j = 0; j <= rle_count; j++) {
+			if (devc->num_samples == DECODE_BUF_SAMPLES)
+				send_samples(sdi);
+			WL32(devc->samples + devc->num_samples * sizeof(uint32_t),
+				value);
+			devc->num_samples++;
+		}
 	}
 
-	rle_buf = g_try_malloc(RLE_BUF_SIZE);
-	if (rle_buf == NULL) {
-		sla5032_write_reg14_zero(usb);
-		sr_dev_acquisition_stop(sdi);
-		return G_SOURCE_CONTINUE;
+	return FALSE;
+}
+
+static void LIBUSB_CALL recv_data_transfer(struct libusb_transfer *xfer);
+
+static int submit_data_transfer(const struct sr_dev_inst *sdi,
+		struct libusb_transfer *xfer)
+{
+	struct dev_context *devc;
+	struct sr_usb_dev_inst *usb;
+	int ret, length;
+
+	devc = sdi->priv;
+	usb = sdi->conn;
+
+	length = MIN(DATA_XFER_SIZE, RLE_BUF_SIZE - devc->chunk_requested);
+	libusb_fill_bulk_transfer(xfer, usb->devhdl, EP_DATA, xfer->buffer,
+		length, recv_data_transfer, (void *)sdi, USB_DATA_TIMEOUT_MS);
+
+	ret = libusb_submit_transfer(xfer);
+	if (ret != 0) {
+		sr_err("Failed to submit data transfer: %s.",
+			libusb_error_name(ret));
+		return SR_ERR;
 	}
 
-	do {
-		xfer_len = 0;
-		ret = sla5032_read_data_chunk(usb, rle_buf, RLE_BUF_SIZE, &xfer_len);
-		if (ret != SR_OK) {
-			sla5032_write_reg14_zero(usb);
-			g_free(rle_buf);
-			sr_dev_acquisition_stop(sdi);
+	devc->chunk_requested += length;
+	devc->num_xfers_pending++;
 
-			sr_dbg("acquision done, ret: %d.", ret);
-			return G_SOURCE_CONTINUE;
-		}
+	return SR_OK;
+}
 
-		sr_dbg("acquision done, xfer_len: %d.", xfer_len);
+static int request_data_chunk(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	int i, ret;
 
-		if (xfer_len == 0) {
-			sla5032_write_reg14_zero(usb);
-			g_free(rle_buf);
-			sr_dev_acquisition_stop(sdi);
-			return G_SOURCE_CONTINUE;
-		}
+	devc = sdi->priv;
 
-		p = rle_buf;
-		samples_count = 0;
-		rle_samples_count = xfer_len / RLE_SAMPLE_SIZE;
+	ret = sla5032_request_data_chunk(sdi->conn);
+	if (ret != SR_OK)
+		return ret;
 
-		sr_dbg("acquision done, rle_samples_count: %d.", rle_samples_count);
+	devc->state = STATE_READ_PREPARE;
+	devc->chunk_requested = 0;
+	for (i = 0; i < NUM_DATA_XFERS; i++) {
+		ret = submit_data_transfer(sdi, devc->xfers[i]);
+		if (ret != SR_OK)
+			return ret;
+	}
 
-		for (i = 0; i < rle_samples_count; i++) {
-			p += sizeof(uint32_t); /* skip sample value */
+	return SR_OK;
+}
 
-			rle_count = RL16(p); /* read RLE counter */
-			p += sizeof(uint16_t);
-			if (rle_count == RLE_END_MARKER) {
-				rle_samples_count = i;
-				break;
-			}
-			samples_count += rle_count + 1;
-		}
-		sr_dbg("acquision done, samples_count: %d.", samples_count);
-
-		if (samples_count == 0) {
-			sr_dbg("acquision done, no samples.");
-			sla5032_write_reg14_zero(usb);
-			g_free(rle_buf);
-			sr_dev_acquisition_stop(sdi);
-			return G_SOURCE_CONTINUE;
-		}
+/* Stop at the end of the data, or on errors. Transfers still wind down. */
+static void download_end(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	int i;
 
-		/* Decode RLE */
-		samples = g_try_malloc(samples_count * sizeof(uint32_t));
-		if (!samples) {
-			sr_dbg("memory allocation error.");
-			sla5032_write_reg14_zero(usb);
-			g_free(rle_buf);
-			sr_dev_acquisition_stop(sdi);
-			return G_SOURCE_CONTINUE;
-		}
+	devc = sdi->priv;
 
-		p = rle_buf;
-		q = samples;
-		for (i = 0; i < rle_samples_count; i++) {
-			value = RL32(p);
-			p += sizeof(uint32_t); /* read sample value */
+	devc->state = STATE_READ_FINISH;
+	for (i = 0; i < NUM_DATA_XFERS; i++)
+		libusb_cancel_transfer(devc->xfers[i]);
+}
 
-			rle_count = RL16(p); /* read RLE counter */
-			p += sizeof(uint16_t);
+static void LIBUSB_CALL recv_data_transfer(struct libusb_transfer *xfer)
+{
+	const struct sr_dev_inst *sdi;
+	struct dev_context *devc;
 
-			if (rle_count == RLE_END_MARKER) {
-				sr_dbg("RLE end marker found.");
-				break;
-			}
+	sdi = xfer->user_data;
+	devc = sdi->priv;
 
-			for (j = 0; j <= rle_count; j++) {
-				WL32(q, value);
-				q += sizeof(uint32_t);
-			}
-		}
+	devc->num_xfers_pending--;
 
-		if (devc->trigger_fired) {
-			/* Send the incoming transfer to the session bus. */
-			packet.type = SR_DF_LOGIC;
-			packet.payload = &logic;
+	if (devc->state != STATE_READ_PREPARE)
+		return;
 
-			logic.length = samples_count * sizeof(uint32_t);
-			logic.unitsize = sizeof(uint32_t);
-			logic.data = samples;
-			sr_session_send(sdi, &packet);
-		} else {
-			trigger_offset = soft_trigger_logic_check(devc->stl,
-				samples, samples_count * sizeof(uint32_t), NULL);
-			if (trigger_offset > -1) {
-				packet.type = SR_DF_LOGIC;
-				packet.payload = &logic;
-				int num_samples = samples_count - trigger_offset;
-
-				logic.length = num_samples * sizeof(uint32_t);
-				logic.unitsize = sizeof(uint32_t);
-				logic.data = samples + trigger_offset * sizeof(uint32_t);
-				sr_session_send(sdi, &packet);
-
-				devc->trigger_fired = TRUE;
-			}
-		}
+	if (xfer->status != LIBUSB_TRANSFER_COMPLETED) {
+		sr_err("Sample data transfer failed, status %d.", xfer->status);
+		download_end(sdi);
+		return;
+	}
 
-		g_free(samples);
-	} while (rle_samples_count == RLE_SAMPLES_COUNT);
+	sr_spew("Received %d bytes of sample data.", xfer->actual_length);
 
-	sr_dbg("acquision stop, rle_samples_count < RLE_SAMPLES_COUNT.");
+	/* Data which ends within a chunk was the last chunk. */
+	if (decode_rle(sdi, xfer->buffer, xfer->actual_length) ||
+			xfer->actual_length < xfer->length) {
+		download_end(sdi);
+		return;
+	}
 
-	sla5032_write_reg14_zero(usb);
+	if (devc->chunk_requested < RLE_BUF_SIZE) {
+		if (submit_data_transfer(sdi, xfer) != SR_OK)
+			download_end(sdi);
+	} else if (!devc->num_xfers_pending) {
+		/* The next chunk gets requested outside of event handling. */
+		devc->state = STATE_READ_REQUEST;
+	}
+}
 
-	sr_dev_acquisition_stop(sdi); /* if all data transfered */
+static void download_free(struct dev_context *devc)
+{
+	int i;
+
+	for (i = 0; i < NUM_DATA_XFERS; i++) {
+		if (!devc->xfers[i])
+			continue;
+		g_free(devc->xfers[i]->buffer);
+		libusb_free_transfer(devc->xfers[i]);
+		devc->xfers[i] = NULL;
+	}
 
-	g_free(rle_buf);
+	g_free(devc->samples);
+	devc->samples = NULL;
+	devc->num_samples = 0;
 
 	if (devc->stl) {
 		soft_trigger_logic_free(devc->stl);
 		devc->stl = NULL;
 	}
+}
+
+/* Callback handling the sample data download */
+static int la_download_data(int fd, int revents, void *cb_data)
+{
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	struct drv_context *drvc;
+	struct timeval tv;
+
+	(void)fd;
+	(void)revents;
+
+	sdi = cb_data;
+	devc = sdi->priv;
+	drvc = sdi->driver->context;
+
+	tv.tv_sec = tv.tv_usec = 0;
+	libusb_handle_events_timeout_completed(drvc->sr_ctx->libusb_ctx,
+		&tv, NULL);
+
+	if (devc->state == STATE_READ_REQUEST && request_data_chunk(sdi) != SR_OK)
+		download_end(sdi);
+
+	if (devc->state != STATE_READ_FINISH || devc->num_xfers_pending)
+		return G_SOURCE_CONTINUE;
+
+	sr_dbg("Sample data download done.");
+
+	send_samples(sdi);
+	sla5032_write_reg14_zero(sdi->conn);
+	download_free(devc);
+	usb_source_remove(sdi->session, drvc->sr_ctx);
+	devc->state = STATE_STATUS_WAIT;
+
+	sr_dev_acquisition_stop(sdi); /* if all data transfered */
+
+	return G_SOURCE_CONTINUE;
+}
+
+static int download_start(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	struct drv_context *drvc;
+	int i, ret;
+
+	devc = sdi->priv;
+	drvc = sdi->driver->context;
+
+	devc->samples = g_try_malloc(DECODE_BUF_SAMPLES * sizeof(uint32_t));
+	if (!devc->samples)
+		return SR_ERR_MALLOC;
+	devc->num_samples = 0;
+	devc->num_xfers_pending = 0;
+
+	for (i = 0; i < NUM_DATA_XFERS; i++) {
+		devc->xfers[i] = libusb_alloc_transfer(0);
+		if (!devc->xfers[i])
+			return SR_ERR_MALLOC;
+		devc->xfers[i]->buffer = g_try_malloc(DATA_XFER_SIZE);
+		if (!devc->xfers[i]->buffer)
+			return SR_ERR_MALLOC;
+	}
+
+	ret = usb_source_add(sdi->session, drvc->sr_ctx, 100,
+		la_download_data, (struct sr_dev_inst *)sdi);
+	if (ret != SR_OK)
+		return ret;
+
+	if (request_data_chunk(sdi) != SR_OK)
+		download_end(sdi);
+
+	return SR_OK;
+}
+
+/*
+ * Stop a sample data download that is in progress. Returns TRUE if the
+ * acquisition stops (and gets stopped again) once the transfers wound
+ * down.
+ */
+SR_PRIV gboolean sla5032_abort_download(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+
+	devc = sdi->priv;
+
+	if (!devc->samples)
+		return FALSE;
+
+	if (devc->state != STATE_READ_FINISH)
+		download_end(sdi);
+
+	return TRUE;
+}
+
+/* Callback handling data */
+static int la_prepare_data(int fd, int revents, void *cb_data)
+{
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	struct sr_usb_dev_inst *usb;
+	int ret;
+	uint32_t status[3];
+
+	(void)fd;
+	(void)revents;
+
+	sdi = cb_data;
+	devc = sdi->priv;
+	usb = sdi->conn;
+
+	/* The download is handled by la_download_data(). */
+	if (devc->state != STATE_STATUS_WAIT)
+		return G_SOURCE_CONTINUE;
+
+	memset(status, 0, sizeof(status));
+	ret = sla5032_get_status(usb, status);
+	if (ret != SR_OK) {
+		sla5032_write_reg14_zero(usb);
+		sr_dev_acquisition_stop(sdi);
+		return G_SOURCE_CONTINUE;
+	}
+
+	/* data not ready (acquision in progress) */
+	if (status[1] != 3)
+		return G_SOURCE_CONTINUE;
+
+	sr_dbg("acquision done, status: %u.", (unsigned int)status[2]);
+
+	/* data ready (download, decode and send to sigrok) */
+	ret = sla5032_set_read_back(usb);
+	if (ret == SR_OK)
+		ret = download_start(sdi);
+	if (ret != SR_OK) {
+		download_free(devc);
+		sla5032_write_reg14_zero(usb);
+		sr_dev_acquisition_stop(sdi);
+	}
 
 	return G_SOURCE_CONTINUE;
 }
@@ -944,6 +1100,7 @@ SR_PRIV int sla5032_start_acquisition(const struct sr_dev_inst *sdi)
 	if (ret != SR_OK)
 		return ret;
 
+	devc->state = STATE_STATUS_WAIT;
 	sr_session_source_add(sdi->session, -1, 0, poll_interval_ms,
 			la_prepare_data, (struct sr_dev_inst *)sdi);
 
@@ -47,6 +47,9 @@ enum {
 	USB_DATA_TIMEOUT_MS	= 2000,
 };
 
+/* Sample data transfers in flight during the download. */
+#define NUM_DATA_XFERS		4
+
 /* USB device end points. */
 enum usb_endpoint {
 	EP_COMMAND = 4 | LIBUSB_ENDPOINT_OUT,
@@ -104,9 +107,17 @@ struct dev_context {
 	int active_fpga_config;		/* FPGA configuration index */
 
 	enum protocol_state state;	/* async protocol state */
+
+	/* Sample data download, see la_download_data(). */
+	struct libusb_transfer *xfers[NUM_DATA_XFERS];
+	int num_xfers_pending;
+	int chunk_requested;		/* bytes of the current chunk */
+	uint8_t *samples;		/* decoded samples not sent yet */
+	size_t num_samples;
 };
 
 SR_PRIV int sla5032_start_acquisition(const struct sr_dev_inst *sdi);
 SR_PRIV int sla5032_apply_fpga_config(const struct sr_dev_inst *sdi);
+SR_PRIV gboolean sla5032_abort_download(const struct sr_dev_inst *sdi);
 
 #endif
@@ -67,10 +67,10 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 		if (src->key != SR_CONF_CONN)
 			continue;
 		str = g_variant_get_string(src->data, NULL);
-		conn_devices = sr_usb_find(drvc->sr_ctx->libusb_ctx, str);
+		conn_devices = sr_usb_find(drvc->sr_ctx, str);
 	}
 
-	libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	sr_usb_get_device_list(drvc->sr_ctx, &devlist);
 	for (i = 0; devlist[i]; i++) {
 		if (conn_devices) {
 			usb = NULL;
@@ -254,7 +254,7 @@ static void receive_data(struct sr_dev_inst *sdi, unsigned char *data, int len)
 	if (!testo_check_packet_prefix(devc->reply, devc->reply_size))
 		return;
 
-	crc = crc16_mcrf4xx(0xffff, devc->reply, devc->reply_size - 2);
+	crc = sr_crc16_mcrf4xx(SR_CRC16_DEFAULT_INIT, devc->reply, devc->reply_size - 2);
 	if (crc == RL16(&devc->reply[devc->reply_size - 2])) {
 		testo_receive_packet(sdi);
 		sr_sw_limits_update_samples_read(&devc->sw_limits, 1);
@@ -1045,13 +1045,7 @@ static time_t ut181a_get_epoch_for_timestamp(uint32_t ts)
  */
 static uint16_t ut181a_checksum(const uint8_t *data, size_t dlen)
 {
-	uint16_t cs;
-
-	cs = 0;
-	while (dlen-- > 0)
-		cs += *data++;
-
-	return cs;
+	return sr_sum16(0, data, dlen);
 }
 
 /**
@@ -23,7 +23,7 @@
 #define USB_INTERFACE			0
 #define USB_CONFIGURATION		1
 #define NUM_TRIGGER_STAGES		4
-#define PACKET_SIZE			2048	/* ?? */
+#define MAX_PACKET_SIZE			(64 * 1024) /* Bytes per bulk read */
 
 //#define ZP_EXPERIMENTAL
 
@@ -179,7 +179,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	devices = NULL;
 
 	/* Find all ZEROPLUS analyzers and add them to device list. */
-	libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist); /* TODO: Errors. */
+	sr_usb_get_device_list(drvc->sr_ctx, &devlist); /* TODO: Errors. */
 
 	for (i = 0; devlist[i]; i++) {
 		libusb_get_device_descriptor(devlist[i], &des);
@@ -438,7 +438,7 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	struct sr_datafeed_logic logic;
 	unsigned int samples_read;
 	int res;
-	unsigned int packet_num, n;
+	unsigned int packet_num, packet_size, n;
 	unsigned char *buf;
 	unsigned int status;
 	unsigned int stop_address;
@@ -497,7 +497,12 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		return SR_OK;
 	}
 
-	buf = g_malloc(PACKET_SIZE);
+	/*
+	 * Read the sample memory in large bulk reads, every read costs a
+	 * control request. All memory sizes are powers of two.
+	 */
+	packet_size = MIN(n, MAX_PACKET_SIZE);
+	buf = g_malloc(packet_size);
 
 	/* Check if the trigger is in the samples we are throwing away */
 	trigger_now = now_address == trigger_address ||
@@ -545,21 +550,21 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 
 	/* Send the incoming transfer to the session bus. */
 	samples_read = 0;
-	for (packet_num = 0; packet_num < n / PACKET_SIZE; packet_num++) {
+	for (packet_num = 0; packet_num < n / packet_size; packet_num++) {
 		unsigned int len;
 		unsigned int buf_offset;
 
-		res = analyzer_read_data(usb->devhdl, buf, PACKET_SIZE);
-		if (res != PACKET_SIZE)
-			sr_warn("Tried to read %d bytes, actually read %d.",
-				PACKET_SIZE, res);
+		res = analyzer_read_data(usb->devhdl, buf, packet_size);
+		if (res != (int)packet_size)
+			sr_warn("Tried to read %u bytes, actually read %d.",
+				packet_size, res);
 
-		if (discard >= PACKET_SIZE / 4) {
-			discard -= PACKET_SIZE / 4;
+		if (discard >= packet_size / 4) {
+			discard -= packet_size / 4;
 			continue;
 		}
 
-		len = PACKET_SIZE - discard * 4;
+		len = packet_size - discard * 4;
 		buf_offset = discard * 4;
 		discard = 0;
 
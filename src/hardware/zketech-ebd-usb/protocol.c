@@ -199,10 +199,7 @@ SR_PRIV int ebd_receive_data(int fd, int revents, void *cb_data)
 		return (ret < 0) ? ret : SR_ERR;
 	}
 
-	uint8_t xor = reply[1] ^ reply[2] ^ reply[3] ^ reply[4] ^ \
-		      reply[5] ^ reply[6] ^ reply[7] ^ reply[8] ^ \
-		      reply[9] ^ reply[10] ^ reply[11] ^ reply[12] ^ \
-		      reply[13] ^ reply[14] ^ reply[15] ^ reply[16];
+	uint8_t xor = sr_xor8(0, &reply[1], 16);
 
 	if (reply[MSG_FRAME_BEGIN_POS] != MSG_FRAME_BEGIN || \
 			reply[MSG_FRAME_END_POS] != MSG_FRAME_END || \
@@ -0,0 +1,511 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "hotplug"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Incremental device discovery driven by hotplug notifications.
+ */
+
+/**
+ * @defgroup grp_hotplug Hotplug
+ *
+ * Incremental device discovery.
+ *
+ * Instead of rescanning all drivers periodically, an application can
+ * have libsigrok watch for devices coming and going, and only probe
+ * the connection that changed.
+ *
+ * @{
+ */
+
+/** @cond PRIVATE */
+/* How often the thread wakes up to check for stop requests, in ms. */
+#define HOTPLUG_TICK_MS		100
+/* How often port lists get polled where no notification exists, in ms. */
+#define HOTPLUG_POLL_MS		1000
+
+enum {
+	HOTPLUG_CONN_USB,
+	HOTPLUG_CONN_SERIAL,
+};
+/** @endcond */
+
+struct hotplug_event {
+	int event;
+	int conn_type;
+	/* "bus.address" for USB, the port name for serial. */
+	char *conn;
+	uint8_t bus;
+	uint8_t address;
+};
+
+struct sr_hotplug {
+	struct sr_context *ctx;
+	/* NULL-terminated, split by the kind of connection they scan. */
+	struct sr_dev_driver **usb_drivers;
+	struct sr_dev_driver **serial_drivers;
+	sr_hotplug_callback cb;
+	void *cb_data;
+	GThread *thread;
+	gint stop;
+	GAsyncQueue *events;
+	/* Connections seen by the last poll, as strings. */
+	GSList *usb_known;
+	GSList *serial_known;
+#ifdef HAVE_LIBUSB_1_0
+	gboolean usb_notify;
+	libusb_hotplug_callback_handle usb_handle;
+#endif
+};
+
+static void hotplug_event_free(void *data)
+{
+	struct hotplug_event *ev;
+
+	ev = data;
+	g_free(ev->conn);
+	g_free(ev);
+}
+
+static void hotplug_event_push(struct sr_hotplug *hp, int event,
+		int conn_type, const char *conn)
+{
+	struct hotplug_event *ev;
+	unsigned int bus, address;
+
+	ev = g_malloc0(sizeof(*ev));
+	ev->event = event;
+	ev->conn_type = conn_type;
+	ev->conn = g_strdup(conn);
+	if (conn_type == HOTPLUG_CONN_USB
+			&& sscanf(conn, "%u.%u", &bus, &address) == 2) {
+		ev->bus = bus;
+		ev->address = address;
+	}
+	g_async_queue_push(hp->events, ev);
+}
+
+/*
+ * Compare the connections of the previous poll against the current
+ * ones, queue an event for every difference, and keep the current
+ * list for the next round. Takes ownership of "now".
+ */
+static void hotplug_diff(struct sr_hotplug *hp, int conn_type,
+		GSList **known, GSList *now)
+{
+	GSList *l;
+
+	for (l = now; l; l = l->next) {
+		if (!g_slist_find_custom(*known, l->data, (GCompareFunc)strcmp))
+			hotplug_event_push(hp, SR_HOTPLUG_ARRIVED,
+				conn_type, l->data);
+	}
+	for (l = *known; l; l = l->next) {
+		if (!g_slist_find_custom(now, l->data, (GCompareFunc)strcmp))
+			hotplug_event_push(hp, SR_HOTPLUG_LEFT,
+				conn_type, l->data);
+	}
+	g_slist_free_full(*known, g_free);
+	*known = now;
+}
+
+static GSList *serial_ports_list(void)
+{
+	GSList *ports, *names, *l;
+	struct sr_serial_port *port;
+
+	names = NULL;
+	ports = sr_serial_list(NULL);
+	for (l = ports; l; l = l->next) {
+		port = l->data;
+		names = g_slist_prepend(names, g_strdup(port->name));
+	}
+	g_slist_free_full(ports, (GDestroyNotify)sr_serial_free);
+
+	return names;
+}
+
+#ifdef HAVE_LIBUSB_1_0
+static GSList *usb_devices_list(struct sr_context *ctx)
+{
+	libusb_device **devlist;
+	GSList *names;
+	ssize_t count, i;
+
+	names = NULL;
+	count = libusb_get_device_list(ctx->libusb_ctx, &devlist);
+	if (count < 0) {
+		sr_err("Failed to get device list: %s.",
+			libusb_error_name((int)count));
+		return NULL;
+	}
+	for (i = 0; i < count; i++) {
+		names = g_slist_prepend(names, g_strdup_printf("%d.%d",
+			libusb_get_bus_number(devlist[i]),
+			libusb_get_device_address(devlist[i])));
+	}
+	libusb_free_device_list(devlist, 1);
+
+	return names;
+}
+
+/*
+ * Runs in libusb's event handling, which must not be re-entered from
+ * here. Only queue the event, the probing happens in process_event().
+ */
+static int LIBUSB_CALL usb_hotplug_cb(libusb_context *usbctx,
+		libusb_device *dev, libusb_hotplug_event event, void *user_data)
+{
+	struct sr_hotplug *hp;
+	char conn[16];
+
+	(void)usbctx;
+
+	hp = user_data;
+	snprintf(conn, sizeof(conn), "%d.%d", libusb_get_bus_number(dev),
+		libusb_get_device_address(dev));
+	hotplug_event_push(hp, event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED ?
+		SR_HOTPLUG_ARRIVED : SR_HOTPLUG_LEFT, HOTPLUG_CONN_USB, conn);
+
+	return 0;
+}
+
+static void usb_hotplug_start(struct sr_hotplug *hp)
+{
+	int ret;
+
+	if (!*hp->usb_drivers || sr_libusb_init(hp->ctx) != SR_OK)
+		return;
+
+	if (libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
+		ret = libusb_hotplug_register_callback(hp->ctx->libusb_ctx,
+			LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED |
+			LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT, 0,
+			LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY,
+			LIBUSB_HOTPLUG_MATCH_ANY, usb_hotplug_cb, hp,
+			&hp->usb_handle);
+		if (ret == LIBUSB_SUCCESS) {
+			hp->usb_notify = TRUE;
+			return;
+		}
+		sr_warn("Failed to register USB hotplug callback: %s.",
+			libusb_error_name(ret));
+	}
+
+	/* No notifications on this platform, compare device lists. */
+	sr_dbg("Polling for USB devices.");
+	hp->usb_known = usb_devices_list(hp->ctx);
+}
+
+static void usb_hotplug_stop(struct sr_hotplug *hp)
+{
+	if (hp->usb_notify)
+		libusb_hotplug_deregister_callback(hp->ctx->libusb_ctx,
+			hp->usb_handle);
+	hp->usb_notify = FALSE;
+}
+#endif
+
+static gboolean sdi_has_conn(const struct sr_dev_inst *sdi,
+		const struct hotplug_event *ev)
+{
+#ifdef HAVE_LIBUSB_1_0
+	const struct sr_usb_dev_inst *usb;
+#endif
+#ifdef HAVE_SERIAL_COMM
+	const struct sr_serial_dev_inst *serial;
+#endif
+
+	if (!sdi->conn)
+		return FALSE;
+
+#ifdef HAVE_LIBUSB_1_0
+	if (ev->conn_type == HOTPLUG_CONN_USB && sdi->inst_type == SR_INST_USB) {
+		usb = sdi->conn;
+		return usb->bus == ev->bus && usb->address == ev->address;
+	}
+#endif
+#ifdef HAVE_SERIAL_COMM
+	if (ev->conn_type == HOTPLUG_CONN_SERIAL
+			&& sdi->inst_type == SR_INST_SERIAL) {
+		serial = sdi->conn;
+		return serial->port && !strcmp(serial->port, ev->conn);
+	}
+#endif
+
+	return FALSE;
+}
+
+static void process_event(struct sr_hotplug *hp, struct hotplug_event *ev)
+{
+	struct sr_dev_driver **drivers;
+	struct sr_config *src;
+	GSList *options, *devices, *l;
+	int i;
+
+	drivers = ev->conn_type == HOTPLUG_CONN_USB ?
+		hp->usb_drivers : hp->serial_drivers;
+
+	sr_dbg("%s %s.", ev->conn,
+		ev->event == SR_HOTPLUG_ARRIVED ? "arrived" : "left");
+
+	/* A scan pass in progress must not keep using stale lists. */
+#ifdef HAVE_LIBUSB_1_0
+	if (ev->conn_type == HOTPLUG_CONN_USB)
+		sr_usb_snapshot_invalidate(hp->ctx);
+#endif
+#ifdef HAVE_SERIAL_COMM
+	if (ev->conn_type == HOTPLUG_CONN_SERIAL)
+		sr_serial_cache_invalidate();
+#endif
+
+	if (ev->event == SR_HOTPLUG_LEFT) {
+		for (i = 0; drivers[i]; i++) {
+			for (l = sr_dev_list(drivers[i]); l; l = l->next) {
+				if (sdi_has_conn(l->data, ev))
+					hp->cb(l->data, SR_HOTPLUG_LEFT,
+						hp->cb_data);
+			}
+		}
+		return;
+	}
+
+	/* Only the drivers that could own this connection get to probe it. */
+	src = sr_config_new(SR_CONF_CONN, g_variant_new_string(ev->conn));
+	options = g_slist_append(NULL, src);
+	for (i = 0; drivers[i]; i++) {
+		devices = sr_driver_scan(drivers[i], options);
+		for (l = devices; l; l = l->next)
+			hp->cb(l->data, SR_HOTPLUG_ARRIVED, hp->cb_data);
+		g_slist_free(devices);
+	}
+	g_slist_free_full(options, (GDestroyNotify)sr_config_free);
+}
+
+static gpointer hotplug_thread(gpointer data)
+{
+	struct sr_hotplug *hp;
+	struct hotplug_event *ev;
+	gint64 next_poll, now;
+#ifdef HAVE_LIBUSB_1_0
+	struct timeval tv;
+#endif
+
+	hp = data;
+	next_poll = g_get_monotonic_time() + HOTPLUG_POLL_MS * 1000;
+
+	while (!g_atomic_int_get(&hp->stop)) {
+#ifdef HAVE_LIBUSB_1_0
+		if (hp->usb_notify) {
+			tv.tv_sec = 0;
+			tv.tv_usec = HOTPLUG_TICK_MS * 1000;
+			libusb_handle_events_timeout_completed(
+				hp->ctx->libusb_ctx, &tv, NULL);
+		} else {
+			g_usleep(HOTPLUG_TICK_MS * 1000);
+		}
+#else
+		g_usleep(HOTPLUG_TICK_MS * 1000);
+#endif
+
+		now = g_get_monotonic_time();
+		if (now >= next_poll) {
+			next_poll = now + HOTPLUG_POLL_MS * 1000;
+			if (*hp->serial_drivers)
+				hotplug_diff(hp, HOTPLUG_CONN_SERIAL,
+					&hp->serial_known, serial_ports_list());
+#ifdef HAVE_LIBUSB_1_0
+			if (*hp->usb_drivers && !hp->usb_notify
+					&& hp->ctx->libusb_ctx)
+				hotplug_diff(hp, HOTPLUG_CONN_USB,
+					&hp->usb_known,
+					usb_devices_list(hp->ctx));
+#endif
+		}
+
+		while ((ev = g_async_queue_try_pop(hp->events))) {
+			if (!g_atomic_int_get(&hp->stop))
+				process_event(hp, ev);
+			hotplug_event_free(ev);
+		}
+	}
+
+	return NULL;
+}
+
+static gboolean scan_option_has(const struct sr_dev_driver *driver,
+		uint32_t key)
+{
+	GArray *opts;
+	gboolean found;
+	unsigned int i;
+
+	if (!(opts = sr_driver_scan_options_list(driver)))
+		return FALSE;
+	found = FALSE;
+	for (i = 0; i < opts->len && !found; i++)
+		found = g_array_index(opts, uint32_t, i) == key;
+	g_array_free(opts, TRUE);
+
+	return found;
+}
+
+static void hotplug_free(struct sr_hotplug *hp)
+{
+	g_async_queue_unref(hp->events);
+	g_slist_free_full(hp->usb_known, g_free);
+	g_slist_free_full(hp->serial_known, g_free);
+	g_free(hp->usb_drivers);
+	g_free(hp->serial_drivers);
+	g_free(hp);
+}
+
+/**
+ * Start watching for devices being connected and disconnected.
+ *
+ * A thread gets started which listens for libusb hotplug notifications
+ * (or compares device lists, where the platform has none), and polls the
+ * list of serial ports. For every connection that appears, only the
+ * given drivers which can own it are asked to scan it, with SR_CONF_CONN
+ * set to that connection. Devices found that way are reported with
+ * SR_HOTPLUG_ARRIVED. When a connection goes away, the devices of the
+ * given drivers that were using it are reported with SR_HOTPLUG_LEFT;
+ * they stay owned by their driver, as with any other device instance.
+ *
+ * Drivers whose scan options include SR_CONF_SERIALCOMM are considered
+ * serial drivers, other drivers accepting SR_CONF_CONN USB drivers.
+ * Drivers taking no connection at all are not probed.
+ *
+ * The callback runs in the hotplug thread.
+ *
+ * @param ctx The libsigrok context. Must not be NULL.
+ * @param drivers NULL-terminated list of initialized drivers to probe
+ *                with. Must not be NULL.
+ * @param cb Function which gets called for every device event.
+ *           Must not be NULL.
+ * @param cb_data Opaque pointer passed to the callback.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR Hotplug discovery is already running on this context.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_hotplug_start(struct sr_context *ctx,
+		struct sr_dev_driver **drivers, sr_hotplug_callback cb,
+		void *cb_data)
+{
+	struct sr_hotplug *hp;
+	unsigned int i, num_usb, num_serial, num_drivers;
+
+	if (!ctx || !drivers || !cb)
+		return SR_ERR_ARG;
+
+	if (ctx->hotplug) {
+		sr_err("Hotplug discovery already running.");
+		return SR_ERR;
+	}
+
+	for (num_drivers = 0; drivers[num_drivers]; num_drivers++)
+		;
+
+	hp = g_malloc0(sizeof(*hp));
+	hp->ctx = ctx;
+	hp->cb = cb;
+	hp->cb_data = cb_data;
+	hp->events = g_async_queue_new_full(hotplug_event_free);
+	hp->usb_drivers = g_malloc0_n(num_drivers + 1, sizeof(*drivers));
+	hp->serial_drivers = g_malloc0_n(num_drivers + 1, sizeof(*drivers));
+
+	num_usb = num_serial = 0;
+	for (i = 0; i < num_drivers; i++) {
+		if (!drivers[i]->context) {
+			sr_err("Driver %s was not initialized.",
+				drivers[i]->name);
+			hotplug_free(hp);
+			return SR_ERR_ARG;
+		}
+		if (!scan_option_has(drivers[i], SR_CONF_CONN))
+			continue;
+		if (scan_option_has(drivers[i], SR_CONF_SERIALCOMM))
+			hp->serial_drivers[num_serial++] = drivers[i];
+		else
+			hp->usb_drivers[num_usb++] = drivers[i];
+	}
+	sr_dbg("Watching with %u USB and %u serial drivers.",
+		num_usb, num_serial);
+
+#ifdef HAVE_LIBUSB_1_0
+	usb_hotplug_start(hp);
+#endif
+	/* Ports present now are the caller's initial scan's business. */
+	if (*hp->serial_drivers)
+		hp->serial_known = serial_ports_list();
+
+	hp->thread = g_thread_new("sr-hotplug", hotplug_thread, hp);
+	ctx->hotplug = hp;
+
+	return SR_OK;
+}
+
+/**
+ * Stop watching for devices, as started by sr_hotplug_start().
+ *
+ * Waits for a scan in progress to finish. No callbacks are made after
+ * this returns.
+ *
+ * @param ctx The libsigrok context. Must not be NULL.
+ *
+ * @retval SR_OK Success, also when no discovery was running.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_hotplug_stop(struct sr_context *ctx)
+{
+	struct sr_hotplug *hp;
+
+	if (!ctx)
+		return SR_ERR_ARG;
+
+	if (!(hp = ctx->hotplug))
+		return SR_OK;
+
+	g_atomic_int_set(&hp->stop, 1);
+	g_thread_join(hp->thread);
+#ifdef HAVE_LIBUSB_1_0
+	usb_hotplug_stop(hp);
+#endif
+	ctx->hotplug = NULL;
+	hotplug_free(hp);
+
+	return SR_OK;
+}
+
+/** @} */
@@ -215,6 +215,10 @@ static struct sr_key_info sr_key_info_config[] = {
 		"Probe factor", NULL},
 	{SR_CONF_ADC_POWERLINE_CYCLES, SR_T_FLOAT, "nplc",
 		"Number of ADC powerline cycles", NULL},
+	{SR_CONF_USB_TRANSFER_DEPTH, SR_T_UINT64, "usb_transfer_depth",
+		"USB transfer depth", NULL},
+	{SR_CONF_USB_TRANSFER_SIZE, SR_T_UINT64, "usb_transfer_size",
+		"USB transfer size", NULL},
 
 	/* Acquisition modes, sample limiting */
 	{SR_CONF_LIMIT_MSEC, SR_T_UINT64, "limit_time",
@@ -231,6 +235,10 @@ static struct sr_key_info sr_key_info_config[] = {
 		"Device mode", NULL},
 	{SR_CONF_TEST_MODE, SR_T_STRING, "test_mode",
 		"Test mode", NULL},
+	{SR_CONF_MAX_THROUGHPUT, SR_T_BOOL, "max_throughput",
+		"Maximum throughput", NULL},
+	{SR_CONF_ANALOG_GROUP_PACKETS, SR_T_BOOL, "analog_group_packets",
+		"Analog group packets", NULL},
 
 	ALL_ZERO
 };
@@ -418,6 +426,11 @@ SR_API int sr_driver_init(struct sr_context *ctx, struct sr_dev_driver *driver)
 
 	/* No log message here, too verbose and not very useful. */
 
+	if (sr_driver_sanity_check(driver) != SR_OK) {
+		sr_err("Internal driver error(s), can't initialize.");
+		return SR_ERR_BUG;
+	}
+
 	if ((ret = driver->init(driver, ctx)) < 0)
 		sr_err("Failed to initialize the driver: %d.", ret);
 
@@ -532,6 +545,7 @@ static int check_options(struct sr_dev_driver *driver, GSList *options,
  */
 SR_API GSList *sr_driver_scan(struct sr_dev_driver *driver, GSList *options)
 {
+	struct sr_context *ctx;
 	GSList *l;
 
 	if (!driver) {
@@ -549,13 +563,240 @@ SR_API GSList *sr_driver_scan(struct sr_dev_driver *driver, GSList *options)
 			return NULL;
 	}
 
+#ifdef HAVE_LIBUSB_1_0
+	/* Scans are where drivers first look for USB devices. */
+	if (sr_libusb_init(((struct drv_context *)driver->context)->sr_ctx) != SR_OK)
+		return NULL;
+#endif
+
+	/* A scan is a pass of its own, unless the caller started one. */
+	ctx = ((struct drv_context *)driver->context)->sr_ctx;
+	sr_scan_begin(ctx);
 	l = driver->scan(driver, options);
+	sr_scan_end(ctx);
 
 	sr_spew("Scan found %d devices (%s).", g_slist_length(l), driver->name);
 
 	return l;
 }
 
+/**
+ * Start a scan pass, which several driver scans are part of.
+ *
+ * Within a pass, drivers share one enumeration of the USB devices and
+ * the string descriptors they read, and one of the serial ports, instead
+ * of each of them enumerating the bus and opening the devices. Frontends which scan with several
+ * drivers in a row call this before the first sr_driver_scan(), and
+ * sr_scan_end() after the last one. Devices which were plugged in
+ * during the pass are not found until the next one.
+ * sr_driver_scan_parallel() does this by itself.
+ *
+ * Passes can nest, the outermost one counts.
+ *
+ * @param ctx The libsigrok context. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_scan_begin(struct sr_context *ctx)
+{
+	if (!ctx)
+		return SR_ERR_ARG;
+
+#ifdef HAVE_LIBUSB_1_0
+	sr_usb_snapshot_begin(ctx);
+#endif
+#ifdef HAVE_SERIAL_COMM
+	sr_serial_cache_begin();
+#endif
+
+	return SR_OK;
+}
+
+/**
+ * End a scan pass which sr_scan_begin() started.
+ *
+ * @param ctx The libsigrok context. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_scan_end(struct sr_context *ctx)
+{
+	if (!ctx)
+		return SR_ERR_ARG;
+
+#ifdef HAVE_LIBUSB_1_0
+	sr_usb_snapshot_end(ctx);
+#endif
+#ifdef HAVE_SERIAL_COMM
+	sr_serial_cache_end();
+#endif
+
+	return SR_OK;
+}
+
+/** State shared by sr_driver_scan_parallel() and its scan threads. */
+struct parallel_scan {
+	/* One reference for the caller, and one per scan job. */
+	gint refcount;
+	GMutex mutex;
+	GCond cond;
+	/* Deep copy, late jobs may still run after the caller returned. */
+	GSList *options;
+	unsigned int pending;
+	/* The deadline passed, skip remaining jobs and drop their results. */
+	gboolean done;
+	GSList *devices;
+};
+
+static void parallel_scan_unref(struct parallel_scan *scan)
+{
+	if (!g_atomic_int_dec_and_test(&scan->refcount))
+		return;
+
+	g_slist_free_full(scan->options, (GDestroyNotify)sr_config_free);
+	g_mutex_clear(&scan->mutex);
+	g_cond_clear(&scan->cond);
+	g_free(scan);
+}
+
+static void parallel_scan_job(gpointer data, gpointer user_data)
+{
+	struct sr_dev_driver *driver;
+	struct parallel_scan *scan;
+	gboolean skip;
+	GSList *l;
+
+	driver = data;
+	scan = user_data;
+
+	g_mutex_lock(&scan->mutex);
+	skip = scan->done;
+	g_mutex_unlock(&scan->mutex);
+
+	l = skip ? NULL : sr_driver_scan(driver, scan->options);
+
+	g_mutex_lock(&scan->mutex);
+	if (scan->done) {
+		/* The devices remain available via sr_dev_list(). */
+		if (l)
+			sr_warn("Scan of %s finished after the deadline.",
+				driver->name);
+		g_slist_free(l);
+	} else {
+		scan->devices = g_slist_concat(scan->devices, l);
+	}
+	scan->pending--;
+	g_cond_signal(&scan->cond);
+	g_mutex_unlock(&scan->mutex);
+
+	parallel_scan_unref(scan);
+}
+
+/**
+ * Have multiple hardware drivers scan for devices concurrently.
+ *
+ * Each driver's scan runs in a thread of a thread pool, as if
+ * sr_driver_scan() was called for it. This saves time when scans wait
+ * for timeouts, like probes of serial ports or network instruments.
+ * The devices of drivers which did not finish by the deadline are not
+ * returned, but they are available via sr_dev_list() once their scan
+ * is done. Scans which did not start by the deadline are skipped.
+ *
+ * The scan of one driver still runs in a single thread. All drivers
+ * in @a drivers must have been initialized with sr_driver_init().
+ *
+ * @param drivers A NULL terminated array of drivers, like the one
+ *                returned by sr_driver_list(). Must not be NULL.
+ * @param options A list of 'struct sr_config' options to pass to each
+ *                driver's scanner. Drivers which don't support all of
+ *                them find no devices. Can be NULL/empty.
+ * @param max_threads Maximum number of scans running at the same time,
+ *                    0 for one thread per driver.
+ * @param timeout_ms Deadline for all scans in milliseconds, 0 to wait
+ *                   for all of them.
+ *
+ * @return A GSList * of 'struct sr_dev_inst', in no specific order,
+ *         or NULL if no devices were found (or errors were encountered).
+ *         This list must be freed by the caller using g_slist_free(),
+ *         but without freeing the data pointed to in the list.
+ *
+ * @since 0.6.0
+ */
+SR_API GSList *sr_driver_scan_parallel(struct sr_dev_driver **drivers,
+		GSList *options, unsigned int max_threads, unsigned int timeout_ms)
+{
+	struct parallel_scan *scan;
+	struct sr_config *src;
+	struct sr_context *ctx;
+	GThreadPool *pool;
+	GSList *l, *devices;
+	gint64 end_time;
+	int i;
+
+	if (!drivers) {
+		sr_err("%s: drivers was NULL", __func__);
+		return NULL;
+	}
+
+	/* Late jobs still have a pass of their own. */
+	ctx = NULL;
+	if (drivers[0] && drivers[0]->context)
+		ctx = ((struct drv_context *)drivers[0]->context)->sr_ctx;
+	if (ctx)
+		sr_scan_begin(ctx);
+
+	scan = g_malloc0(sizeof(*scan));
+	scan->refcount = 1;
+	g_mutex_init(&scan->mutex);
+	g_cond_init(&scan->cond);
+	for (l = options; l; l = l->next) {
+		src = l->data;
+		scan->options = g_slist_append(scan->options,
+			sr_config_new(src->key, src->data));
+	}
+
+	pool = g_thread_pool_new(parallel_scan_job, scan,
+		max_threads ? (gint)max_threads : -1, FALSE, NULL);
+
+	end_time = g_get_monotonic_time() + timeout_ms * G_TIME_SPAN_MILLISECOND;
+
+	g_mutex_lock(&scan->mutex);
+	for (i = 0; drivers[i]; i++) {
+		g_atomic_int_inc(&scan->refcount);
+		scan->pending++;
+		g_thread_pool_push(pool, drivers[i], NULL);
+	}
+	while (scan->pending > 0) {
+		if (!timeout_ms)
+			g_cond_wait(&scan->cond, &scan->mutex);
+		else if (!g_cond_wait_until(&scan->cond, &scan->mutex, end_time))
+			break;
+	}
+	if (scan->pending > 0)
+		sr_info("Scan deadline passed, %u drivers did not finish.",
+			scan->pending);
+	scan->done = TRUE;
+	devices = scan->devices;
+	scan->devices = NULL;
+	g_mutex_unlock(&scan->mutex);
+
+	/* Don't wait, unfinished jobs release the pool when they are done. */
+	g_thread_pool_free(pool, FALSE, FALSE);
+	parallel_scan_unref(scan);
+	if (ctx)
+		sr_scan_end(ctx);
+
+	sr_dbg("Parallel scan found %d devices.", g_slist_length(devices));
+
+	return devices;
+}
+
 /**
  * Call driver cleanup function for all drivers.
  *
@@ -681,9 +922,13 @@ static void log_key(const struct sr_dev_inst *sdi,
 	g_free(tmp_str);
 }
 
+/*
+ * The driver's SR_CONF_DEVICE_OPTIONS get looked up for each call, unless
+ * the caller has already done that and passes them as dev_opts.
+ */
 static int check_key(const struct sr_dev_driver *driver,
 		const struct sr_dev_inst *sdi, const struct sr_channel_group *cg,
-		uint32_t key, unsigned int op, GVariant *data)
+		uint32_t key, unsigned int op, GVariant *data, GVariant *dev_opts)
 {
 	const struct sr_key_info *srci;
 	gsize num_opts, i;
@@ -729,7 +974,9 @@ static int check_key(const struct sr_dev_driver *driver,
 		break;
 	}
 
-	if (sr_config_list(driver, sdi, cg, SR_CONF_DEVICE_OPTIONS, &gvar_opts) != SR_OK) {
+	if (dev_opts) {
+		gvar_opts = g_variant_ref(dev_opts);
+	} else if (sr_config_list(driver, sdi, cg, SR_CONF_DEVICE_OPTIONS, &gvar_opts) != SR_OK) {
 		/* Driver publishes no options. */
 		sr_err("No options available%s.", suffix);
 		return SR_ERR_ARG;
@@ -756,6 +1003,13 @@ static int check_key(const struct sr_dev_driver *driver,
 	return SR_OK;
 }
 
+static GVariant *config_cache_lookup(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg, uint32_t key);
+static void config_cache_store(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg, uint32_t key, GVariant *data);
+static gboolean config_cache_unchanged(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg, uint32_t key, GVariant *data);
+
 /**
  * Query value of a configuration key at the given driver or device instance.
  *
@@ -794,7 +1048,7 @@ SR_API int sr_config_get(const struct sr_dev_driver *driver,
 	if (!driver->config_get)
 		return SR_ERR_ARG;
 
-	if (check_key(driver, sdi, cg, key, SR_CONF_GET, NULL) != SR_OK)
+	if (check_key(driver, sdi, cg, key, SR_CONF_GET, NULL, NULL) != SR_OK)
 		return SR_ERR_ARG;
 
 	if (sdi && !sdi->priv) {
@@ -802,11 +1056,17 @@ SR_API int sr_config_get(const struct sr_dev_driver *driver,
 		return SR_ERR;
 	}
 
+	if ((*data = config_cache_lookup(sdi, cg, key))) {
+		log_key(sdi, cg, key, SR_CONF_GET, *data);
+		return SR_OK;
+	}
+
 	if ((ret = driver->config_get(key, data, sdi, cg)) == SR_OK) {
 		log_key(sdi, cg, key, SR_CONF_GET, *data);
 		/* Got a floating reference from the driver. Sink it here,
 		 * caller will need to unref when done with it. */
 		g_variant_ref_sink(*data);
+		config_cache_store(sdi, cg, key, *data);
 	}
 
 	if (ret == SR_ERR_CHANNEL_GROUP)
@@ -852,11 +1112,17 @@ SR_API int sr_config_set(const struct sr_dev_inst *sdi,
 		sr_err("%s: Device instance not active, can't set config.",
 			sdi->driver->name);
 		ret = SR_ERR_DEV_CLOSED;
-	} else if (check_key(sdi->driver, sdi, cg, key, SR_CONF_SET, data) != SR_OK)
+	} else if (check_key(sdi->driver, sdi, cg, key, SR_CONF_SET, data, NULL) != SR_OK)
 		return SR_ERR_ARG;
 	else if ((ret = sr_variant_type_check(key, data)) == SR_OK) {
 		log_key(sdi, cg, key, SR_CONF_SET, data);
-		ret = sdi->driver->config_set(key, data, sdi, cg);
+		if (config_cache_unchanged(sdi, cg, key, data)) {
+			sr_spew("%s: Value unchanged, not setting it again.",
+				sdi->driver->name);
+		} else {
+			ret = sdi->driver->config_set(key, data, sdi, cg);
+			sr_config_cache_invalidate(sdi, FALSE);
+		}
 	}
 
 	g_variant_unref(data);
@@ -868,6 +1134,464 @@ SR_API int sr_config_set(const struct sr_dev_inst *sdi,
 	return ret;
 }
 
+/*
+ * Config cache
+ *
+ * Drivers declare which of their keys can be cached with
+ * sr_config_cache_init(). sr_config_get() can then return the values
+ * from memory, instead of asking the device each time. Setting any key
+ * drops all values which aren't static, since keys often depend on each
+ * other (e.g. a range limits a target value).
+ */
+
+/* The result of a key that was taken from the cache. */
+#define RESULT_CACHED 1
+
+struct config_cache_entry {
+	const struct sr_channel_group *cg;
+	uint32_t key;
+	GVariant *data;
+	/* Monotonic time at which the value expires, 0 if it doesn't. */
+	int64_t expires;
+};
+
+static GMutex config_cache_mutex;
+
+/**
+ * Declare which config keys of a device instance can be cached.
+ *
+ * @param sdi The device instance.
+ * @param keys The keys and their policies. Must stay valid for the
+ *             lifetime of the device instance, i.e. be static.
+ * @param num_keys The number of entries in @a keys.
+ *
+ * @private
+ */
+SR_PRIV void sr_config_cache_init(struct sr_dev_inst *sdi,
+		const struct sr_config_cache_key *keys, size_t num_keys)
+{
+	if (!sdi)
+		return;
+
+	sr_config_cache_free(sdi);
+	sdi->cache_keys = keys;
+	sdi->num_cache_keys = num_keys;
+	if (keys && num_keys)
+		sdi->config_cache = g_array_new(FALSE, FALSE,
+			sizeof(struct config_cache_entry));
+}
+
+/* Must be called with config_cache_mutex held. */
+static void config_cache_drop(GArray *cache, guint index)
+{
+	struct config_cache_entry *entry;
+
+	entry = &g_array_index(cache, struct config_cache_entry, index);
+	g_variant_unref(entry->data);
+	g_array_remove_index_fast(cache, index);
+}
+
+/**
+ * Drop cached config values of a device instance.
+ *
+ * Besides sr_config_set() doing this, drivers need to call it when the
+ * device changed its settings on its own.
+ *
+ * @param sdi The device instance.
+ * @param all Also drop the values of SR_CONFIG_CACHE_STATIC keys.
+ *
+ * @private
+ */
+SR_PRIV void sr_config_cache_invalidate(const struct sr_dev_inst *sdi,
+		gboolean all)
+{
+	const struct sr_config_cache_key *ck;
+	struct config_cache_entry *entry;
+	guint i;
+	size_t j;
+
+	if (!sdi || !sdi->config_cache)
+		return;
+
+	g_mutex_lock(&config_cache_mutex);
+	for (i = sdi->config_cache->len; i-- > 0; ) {
+		entry = &g_array_index(sdi->config_cache,
+			struct config_cache_entry, i);
+		if (!all) {
+			ck = NULL;
+			for (j = 0; j < sdi->num_cache_keys && !ck; j++) {
+				if (sdi->cache_keys[j].key == entry->key)
+					ck = &sdi->cache_keys[j];
+			}
+			if (ck && ck->policy == SR_CONFIG_CACHE_STATIC)
+				continue;
+		}
+		config_cache_drop(sdi->config_cache, i);
+	}
+	g_mutex_unlock(&config_cache_mutex);
+}
+
+/**
+ * Free the config cache of a device instance.
+ *
+ * @param sdi The device instance.
+ *
+ * @private
+ */
+SR_PRIV void sr_config_cache_free(struct sr_dev_inst *sdi)
+{
+	if (!sdi || !sdi->config_cache)
+		return;
+
+	sr_config_cache_invalidate(sdi, TRUE);
+	g_array_free(sdi->config_cache, TRUE);
+	sdi->config_cache = NULL;
+	sdi->cache_keys = NULL;
+	sdi->num_cache_keys = 0;
+}
+
+static const struct sr_config_cache_key *config_cache_key(
+		const struct sr_dev_inst *sdi, uint32_t key)
+{
+	size_t i;
+
+	if (!sdi || !sdi->config_cache)
+		return NULL;
+
+	for (i = 0; i < sdi->num_cache_keys; i++) {
+		if (sdi->cache_keys[i].key == key)
+			break;
+	}
+	if (i == sdi->num_cache_keys)
+		return NULL;
+	if (sdi->cache_keys[i].policy == SR_CONFIG_CACHE_LIVE)
+		return NULL;
+
+	return &sdi->cache_keys[i];
+}
+
+/* Get a new reference to a cached value, or NULL. */
+static GVariant *config_cache_lookup(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg, uint32_t key)
+{
+	struct config_cache_entry *entry;
+	GVariant *data;
+	guint i;
+
+	if (!config_cache_key(sdi, key))
+		return NULL;
+
+	data = NULL;
+	g_mutex_lock(&config_cache_mutex);
+	for (i = 0; i < sdi->config_cache->len; i++) {
+		entry = &g_array_index(sdi->config_cache,
+			struct config_cache_entry, i);
+		if (entry->key != key || entry->cg != cg)
+			continue;
+		if (entry->expires && g_get_monotonic_time() >= entry->expires)
+			config_cache_drop(sdi->config_cache, i);
+		else
+			data = g_variant_ref(entry->data);
+		break;
+	}
+	g_mutex_unlock(&config_cache_mutex);
+
+	return data;
+}
+
+static void config_cache_store(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg, uint32_t key, GVariant *data)
+{
+	const struct sr_config_cache_key *ck;
+	struct config_cache_entry entry, *e;
+	guint i;
+
+	/* Values read from a closed device needn't be what it will use. */
+	if (!(ck = config_cache_key(sdi, key)) || sdi->status != SR_ST_ACTIVE)
+		return;
+
+	entry.cg = cg;
+	entry.key = key;
+	entry.data = g_variant_ref(data);
+	entry.expires = 0;
+	if (ck->policy == SR_CONFIG_CACHE_TTL)
+		entry.expires = g_get_monotonic_time() + ck->ttl_ms * (int64_t)1000;
+
+	g_mutex_lock(&config_cache_mutex);
+	for (i = 0; i < sdi->config_cache->len; i++) {
+		e = &g_array_index(sdi->config_cache,
+			struct config_cache_entry, i);
+		if (e->key == key && e->cg == cg) {
+			g_variant_unref(e->data);
+			*e = entry;
+			break;
+		}
+	}
+	if (i == sdi->config_cache->len)
+		g_array_append_val(sdi->config_cache, entry);
+	g_mutex_unlock(&config_cache_mutex);
+}
+
+/*
+ * Whether setting a value can be skipped on a kept open device (see
+ * sr_dev_keepalive_set()), since the device already uses it. Values
+ * which expire may have changed behind the cache's back.
+ */
+static gboolean config_cache_unchanged(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg, uint32_t key, GVariant *data)
+{
+	const struct sr_config_cache_key *ck;
+	GVariant *cached;
+	gboolean unchanged;
+
+	if (!sdi->keepalive)
+		return FALSE;
+	if (!(ck = config_cache_key(sdi, key)) ||
+			ck->policy == SR_CONFIG_CACHE_TTL)
+		return FALSE;
+	if (!(cached = config_cache_lookup(sdi, cg, key)))
+		return FALSE;
+
+	unchanged = g_variant_equal(cached, data);
+	g_variant_unref(cached);
+
+	return unchanged;
+}
+
+/* The first per-key error, or SR_OK if all keys were handled. */
+static int multi_result(const int *results, unsigned int num)
+{
+	unsigned int i;
+
+	for (i = 0; i < num; i++) {
+		if (results[i] != SR_OK)
+			return results[i];
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Query the values of several configuration keys at once.
+ *
+ * This works like calling sr_config_get() for each key, but the device
+ * options only need to be looked up once, and drivers which implement
+ * config_get_multi() can query all keys in one round trip to the device
+ * (e.g. a single SCPI query). Other drivers get asked for one key after
+ * the other.
+ *
+ * @param[in] driver The sr_dev_driver struct to query. Must not be NULL.
+ * @param[in] sdi (optional) The device instance, see sr_config_get().
+ * @param[in] cg The channel group on the device, or NULL.
+ * @param[in,out] configs The keys to query. Upon return, the data field of
+ *                each key holds its value, or NULL if it couldn't be
+ *                queried. The caller must unref each value which is set.
+ * @param[in] num The number of keys in @a configs.
+ * @param[out] results (optional) Array of @a num elements which receives
+ *             the result of each key, as sr_config_get() would return it.
+ *
+ * @retval SR_OK All keys were queried.
+ * @retval SR_ERR Invalid arguments.
+ * @retval other The result of the first key which couldn't be queried.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_config_get_multi(const struct sr_dev_driver *driver,
+		const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		struct sr_config *configs, unsigned int num, int *results)
+{
+	GVariant *dev_opts;
+	int *rets, ret;
+	unsigned int i;
+
+	if (!driver || (num && !configs))
+		return SR_ERR;
+
+	rets = results ? results : g_malloc(num * sizeof(*rets));
+	for (i = 0; i < num; i++) {
+		configs[i].data = NULL;
+		rets[i] = SR_ERR_ARG;
+	}
+
+	if (!driver->config_get) {
+		ret = num ? SR_ERR_ARG : SR_OK;
+		goto out;
+	}
+
+	if (sdi && !sdi->priv) {
+		sr_err("Can't get config (sdi != NULL, sdi->priv == NULL).");
+		for (i = 0; i < num; i++)
+			rets[i] = SR_ERR;
+		ret = num ? SR_ERR : SR_OK;
+		goto out;
+	}
+
+	dev_opts = NULL;
+	if (sr_config_list(driver, sdi, cg, SR_CONF_DEVICE_OPTIONS,
+			&dev_opts) != SR_OK)
+		dev_opts = NULL;
+	for (i = 0; i < num; i++) {
+		if (check_key(driver, sdi, cg, configs[i].key,
+				SR_CONF_GET, NULL, dev_opts) != SR_OK)
+			continue;
+		configs[i].data = config_cache_lookup(sdi, cg, configs[i].key);
+		rets[i] = configs[i].data ? RESULT_CACHED : SR_OK;
+	}
+	if (dev_opts)
+		g_variant_unref(dev_opts);
+
+	/* The driver handles the keys whose result is SR_OK. */
+	ret = SR_ERR_NA;
+	if (driver->config_get_multi)
+		ret = driver->config_get_multi(configs, num, rets, sdi, cg);
+	for (i = 0; i < num; i++) {
+		if (rets[i] == RESULT_CACHED) {
+			rets[i] = SR_OK;
+			log_key(sdi, cg, configs[i].key, SR_CONF_GET,
+				configs[i].data);
+			continue;
+		}
+		if (rets[i] != SR_OK)
+			continue;
+		if (ret == SR_ERR_NA)
+			rets[i] = driver->config_get(configs[i].key,
+				&configs[i].data, sdi, cg);
+		else if (ret != SR_OK)
+			rets[i] = ret;
+		if (rets[i] == SR_OK && !configs[i].data)
+			rets[i] = SR_ERR_BUG;
+		if (rets[i] == SR_OK) {
+			log_key(sdi, cg, configs[i].key, SR_CONF_GET,
+				configs[i].data);
+			g_variant_ref_sink(configs[i].data);
+			config_cache_store(sdi, cg, configs[i].key,
+				configs[i].data);
+		} else {
+			if (configs[i].data) {
+				g_variant_ref_sink(configs[i].data);
+				g_variant_unref(configs[i].data);
+			}
+			configs[i].data = NULL;
+		}
+		if (rets[i] == SR_ERR_CHANNEL_GROUP)
+			sr_err("%s: No channel group specified.",
+				(sdi) ? sdi->driver->name : "unknown");
+	}
+	ret = multi_result(rets, num);
+
+out:
+	if (!results)
+		g_free(rets);
+
+	return ret;
+}
+
+/**
+ * Set the values of several configuration keys in a device instance at once.
+ *
+ * This works like calling sr_config_set() for each key, but the device
+ * options only need to be looked up once, and drivers which implement
+ * config_set_multi() can send all keys in one round trip to the device.
+ * Other drivers get the keys set one after the other, in order.
+ *
+ * @param[in] sdi The device instance. Must not be NULL. sdi->driver and
+ *                sdi->priv must not be NULL either.
+ * @param[in] cg The channel group on the device, or NULL.
+ * @param[in] configs The keys and their new values. Floating references
+ *            can be passed in; they get sunk and unreferenced after use.
+ * @param[in] num The number of keys in @a configs.
+ * @param[out] results (optional) Array of @a num elements which receives
+ *             the result of each key, as sr_config_set() would return it.
+ *
+ * @retval SR_OK All keys were set.
+ * @retval SR_ERR Invalid arguments.
+ * @retval other The result of the first key which couldn't be set.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_config_set_multi(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		const struct sr_config *configs, unsigned int num, int *results)
+{
+	GVariant *dev_opts;
+	int *rets, ret;
+	unsigned int i;
+
+	if (num && !configs)
+		return SR_ERR;
+
+	rets = results ? results : g_malloc(num * sizeof(*rets));
+	for (i = 0; i < num; i++) {
+		if (configs[i].data)
+			g_variant_ref_sink(configs[i].data);
+	}
+
+	ret = SR_OK;
+	if (!sdi || !sdi->driver || !sdi->priv)
+		ret = SR_ERR;
+	else if (!sdi->driver->config_set)
+		ret = SR_ERR_ARG;
+	else if (sdi->status != SR_ST_ACTIVE) {
+		sr_err("%s: Device instance not active, can't set config.",
+			sdi->driver->name);
+		ret = SR_ERR_DEV_CLOSED;
+	}
+	for (i = 0; i < num; i++)
+		rets[i] = configs[i].data ? ret : SR_ERR;
+	if (ret != SR_OK)
+		goto out;
+
+	dev_opts = NULL;
+	if (sr_config_list(sdi->driver, sdi, cg, SR_CONF_DEVICE_OPTIONS,
+			&dev_opts) != SR_OK)
+		dev_opts = NULL;
+	for (i = 0; i < num; i++) {
+		if (rets[i] != SR_OK)
+			continue;
+		if (check_key(sdi->driver, sdi, cg, configs[i].key,
+				SR_CONF_SET, configs[i].data, dev_opts) != SR_OK)
+			rets[i] = SR_ERR_ARG;
+		else
+			rets[i] = sr_variant_type_check(configs[i].key,
+				configs[i].data);
+		if (rets[i] == SR_OK)
+			log_key(sdi, cg, configs[i].key, SR_CONF_SET,
+				configs[i].data);
+	}
+	if (dev_opts)
+		g_variant_unref(dev_opts);
+
+	/* The driver handles the keys whose result is SR_OK. */
+	ret = SR_ERR_NA;
+	if (sdi->driver->config_set_multi)
+		ret = sdi->driver->config_set_multi(configs, num, rets, sdi, cg);
+	for (i = 0; i < num; i++) {
+		if (rets[i] != SR_OK)
+			continue;
+		if (ret == SR_ERR_NA)
+			rets[i] = sdi->driver->config_set(configs[i].key,
+				configs[i].data, sdi, cg);
+		else if (ret != SR_OK)
+			rets[i] = ret;
+		if (rets[i] == SR_ERR_CHANNEL_GROUP)
+			sr_err("%s: No channel group specified.",
+				sdi->driver->name);
+	}
+	sr_config_cache_invalidate(sdi, FALSE);
+	ret = multi_result(rets, num);
+
+out:
+	for (i = 0; i < num; i++) {
+		if (configs[i].data)
+			g_variant_unref(configs[i].data);
+	}
+	if (!results)
+		g_free(rets);
+
+	return ret;
+}
+
 /**
  * Apply configuration settings to the device hardware.
  *
@@ -889,8 +1613,10 @@ SR_API int sr_config_commit(const struct sr_dev_inst *sdi)
 		sr_err("%s: Device instance not active, can't commit config.",
 			sdi->driver->name);
 		ret = SR_ERR_DEV_CLOSED;
-	} else
+	} else {
 		ret = sdi->driver->config_commit(sdi);
+		sr_config_cache_invalidate(sdi, FALSE);
+	}
 
 	return ret;
 }
@@ -938,7 +1664,7 @@ SR_API int sr_config_list(const struct sr_dev_driver *driver,
 		return SR_ERR_ARG;
 
 	if (key != SR_CONF_SCAN_OPTIONS && key != SR_CONF_DEVICE_OPTIONS) {
-		if (check_key(driver, sdi, cg, key, SR_CONF_LIST, NULL) != SR_OK)
+		if (check_key(driver, sdi, cg, key, SR_CONF_LIST, NULL, NULL) != SR_OK)
 			return SR_ERR_ARG;
 	}
 
@@ -1002,6 +1728,48 @@ static struct sr_key_info *get_keytable(int keytype)
 	return table;
 }
 
+/*
+ * Hash tables which find a key table's entries by key and by id. They
+ * are built upon first use, and never change after that.
+ */
+struct key_index {
+	gsize initialized;
+	GHashTable *by_key;
+	GHashTable *by_id;
+};
+
+static struct key_index key_indexes[SR_KEY_MQFLAGS + 1];
+
+static const struct key_index *get_keyindex(int keytype)
+{
+	struct sr_key_info *table;
+	struct key_index *index;
+	gpointer key;
+	int i;
+
+	if (!(table = get_keytable(keytype)))
+		return NULL;
+
+	index = &key_indexes[keytype];
+	if (g_once_init_enter(&index->initialized)) {
+		index->by_key = g_hash_table_new(g_direct_hash, g_direct_equal);
+		index->by_id = g_hash_table_new(g_str_hash, g_str_equal);
+		/* Like a search through the table, the first entry wins. */
+		for (i = 0; table[i].key; i++) {
+			key = GUINT_TO_POINTER(table[i].key);
+			if (!g_hash_table_contains(index->by_key, key))
+				g_hash_table_insert(index->by_key, key, &table[i]);
+			if (table[i].id && !g_hash_table_contains(index->by_id,
+					table[i].id))
+				g_hash_table_insert(index->by_id,
+					(gpointer)table[i].id, &table[i]);
+		}
+		g_once_init_leave(&index->initialized, 1);
+	}
+
+	return index;
+}
+
 /**
  * Get information about a key, by key.
  *
@@ -1015,18 +1783,12 @@ static struct sr_key_info *get_keytable(int keytype)
  */
 SR_API const struct sr_key_info *sr_key_info_get(int keytype, uint32_t key)
 {
-	struct sr_key_info *table;
-	int i;
+	const struct key_index *index;
 
-	if (!(table = get_keytable(keytype)))
+	if (!(index = get_keyindex(keytype)))
 		return NULL;
 
-	for (i = 0; table[i].key; i++) {
-		if (table[i].key == key)
-			return &table[i];
-	}
-
-	return NULL;
+	return g_hash_table_lookup(index->by_key, GUINT_TO_POINTER(key));
 }
 
 /**
@@ -1042,20 +1804,12 @@ SR_API const struct sr_key_info *sr_key_info_get(int keytype, uint32_t key)
  */
 SR_API const struct sr_key_info *sr_key_info_name_get(int keytype, const char *keyid)
 {
-	struct sr_key_info *table;
-	int i;
+	const struct key_index *index;
 
-	if (!(table = get_keytable(keytype)))
+	if (!keyid || !(index = get_keyindex(keytype)))
 		return NULL;
 
-	for (i = 0; table[i].key; i++) {
-		if (!table[i].id)
-			continue;
-		if (!strcmp(table[i].id, keyid))
-			return &table[i];
-	}
-
-	return NULL;
+	return g_hash_table_lookup(index->by_id, keyid);
 }
 
 /** @} */
@@ -66,7 +66,8 @@ static int init(struct sr_input *in, GHashTable *options)
 	return SR_OK;
 }
 
-static int process_buffer(struct sr_input *in)
+/* Send the complete samples of the data, and return their size. */
+static size_t process_data(struct sr_input *in, char *data, size_t len)
 {
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
@@ -91,36 +92,82 @@ static int process_buffer(struct sr_input *in)
 	logic.unitsize = inc->unitsize;
 
 	/* Cut off at multiple of unitsize. */
-	chunk_size = in->buf->len / logic.unitsize * logic.unitsize;
+	chunk_size = len / logic.unitsize * logic.unitsize;
 
 	for (i = 0; i < chunk_size; i += chunk) {
-		logic.data = in->buf->str + i;
+		logic.data = data + i;
 		chunk = MIN(CHUNK_SIZE, chunk_size - i);
 		chunk /= logic.unitsize;
 		chunk *= logic.unitsize;
 		logic.length = chunk;
 		sr_session_send(in->sdi, &packet);
 	}
-	g_string_erase(in->buf, 0, chunk_size);
+
+	return chunk_size;
+}
+
+static int process_buffer(struct sr_input *in)
+{
+	size_t used;
+
+	used = process_data(in, in->buf->str, in->buf->len);
+	g_string_erase(in->buf, 0, used);
 
 	return SR_OK;
 }
 
+/*
+ * Samples get sent from the caller's buffer as they are. Only the very
+ * first data, which arrives before the frontend could set up the session,
+ * and the bytes of an incomplete sample at the end get kept in in->buf.
+ */
 static int receive(struct sr_input *in, GString *buf)
 {
-	int ret;
+	struct context *inc;
+	char *data;
+	size_t len, fill, used;
+
+	if (!in->sdi_ready) {
+		g_string_append_len(in->buf, buf->str, buf->len);
+		/* sdi is ready, notify frontend. */
+		in->sdi_ready = TRUE;
+		return SR_OK;
+	}
+
+	inc = in->priv;
+	data = buf->str;
+	len = buf->len;
+
+	if (in->buf->len) {
+		/* Complete the kept bytes to whole samples first. */
+		fill = in->buf->len % inc->unitsize;
+		fill = fill ? inc->unitsize - fill : 0;
+		fill = MIN(fill, len);
+		g_string_append_len(in->buf, data, fill);
+		data += fill;
+		len -= fill;
+		process_buffer(in);
+	}
 
-	g_string_append_len(in->buf, buf->str, buf->len);
+	used = process_data(in, data, len);
+	g_string_append_len(in->buf, data + used, len - used);
 
+	return SR_OK;
+}
+
+static int receive_mapped(struct sr_input *in, char *data, size_t len,
+		size_t *used)
+{
 	if (!in->sdi_ready) {
 		/* sdi is ready, notify frontend. */
 		in->sdi_ready = TRUE;
+		*used = 0;
 		return SR_OK;
 	}
 
-	ret = process_buffer(in);
+	*used = process_data(in, data, len);
 
-	return ret;
+	return SR_OK;
 }
 
 static int end(struct sr_input *in)
@@ -174,6 +221,7 @@ SR_PRIV struct sr_input_module input_binary = {
 	.options = get_options,
 	.init = init,
 	.receive = receive,
+	.receive_mapped = receive_mapped,
 	.end = end,
 	.reset = reset,
 };
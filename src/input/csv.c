@@ -243,6 +243,16 @@ struct context {
 	uint8_t *sample_buffer;		/**!< Buffer for a single sample. */
 	csv_analog_t *analog_sample_buffer;	/**!< Buffer for one set of analog values. */
 
+	/* Column text spans of the current line (points into the line). */
+	char **columns;
+	size_t columns_alloced;
+
+	/* Table driven parser for single-bit binary columns (optional). */
+	struct bin_column {
+		size_t byte_idx;
+		uint8_t bit_mask;
+	} *bin_columns;
+
 	uint8_t *datafeed_buffer;	/**!< Queue for datafeed submission. */
 	size_t datafeed_buf_size;
 	size_t datafeed_buf_fill;
@@ -756,10 +766,42 @@ static void strip_comment(char *buf, const GString *prefix)
  * @returns An array of strings, representing the columns' text.
  *
  * This routine splits a text line on previously determined separators.
+ * The line gets modified in place, the returned array references the
+ * columns' text within the line. The array is owned by the context and
+ * gets re-used for subsequent lines, callers must not release it.
  */
 static char **split_line(char *buf, struct context *inc)
 {
-	return g_strsplit(buf, inc->delimiter->str, 0);
+	const char *delim;
+	size_t delim_len, count;
+	char *next, **columns;
+
+	delim = inc->delimiter->str;
+	delim_len = inc->delimiter->len;
+	if (!delim_len)
+		return NULL;
+
+	count = 0;
+	while (TRUE) {
+		if (count + 1 >= inc->columns_alloced) {
+			inc->columns_alloced = 2 * inc->columns_alloced + 16;
+			columns = g_realloc(inc->columns,
+				inc->columns_alloced * sizeof(columns[0]));
+			inc->columns = columns;
+		}
+		inc->columns[count++] = buf;
+		if (delim_len == 1)
+			next = strchr(buf, delim[0]);
+		else
+			next = strstr(buf, delim);
+		if (!next)
+			break;
+		*next = '\0';
+		buf = next + delim_len;
+	}
+	inc->columns[count] = NULL;
+
+	return inc->columns;
 }
 
 /**
@@ -1038,6 +1080,91 @@ static const col_parse_cb col_parse_funcs[] = {
 	[FORMAT_TIME] = parse_timestamp,
 };
 
+/*
+ * Setup the table driven parser for the common case of input data which
+ * exclusively consists of single-bit binary columns (optionally mixed
+ * with ignored columns) and uses a single character column separator.
+ * Leaves the table empty when the input data does not qualify.
+ */
+static void setup_binary_parser(struct context *inc)
+{
+	const struct column_details *details;
+	struct bin_column *bin_columns;
+	size_t col_idx;
+	char sep;
+
+	if (inc->delimiter->len != 1)
+		return;
+	sep = inc->delimiter->str[0];
+	if (sep == '0' || sep == '1')
+		return;
+	if (!inc->logic_channels || inc->analog_channels)
+		return;
+
+	bin_columns = g_malloc0_n(inc->column_want_count, sizeof(bin_columns[0]));
+	for (col_idx = 0; col_idx < inc->column_want_count; col_idx++) {
+		details = &inc->column_details[col_idx];
+		if (format_is_ignore(details->text_format))
+			continue;
+		if (details->text_format != FORMAT_BIN || details->channel_count != 1) {
+			g_free(bin_columns);
+			return;
+		}
+		bin_columns[col_idx].byte_idx = details->channel_offset / 8;
+		bin_columns[col_idx].bit_mask = 1 << (details->channel_offset % 8);
+	}
+	inc->bin_columns = bin_columns;
+	sr_dbg("Using table driven parser for binary columns.");
+}
+
+/**
+ * Parse a text line of single-bit binary columns.
+ *
+ * @param[in] line	The input text line (comments were stripped).
+ * @param[in] inc	The input module's context.
+ *
+ * @returns TRUE when the line was parsed, FALSE when the line does not
+ *   strictly match the expected layout.
+ *
+ * Does not split the line into columns, but walks the text once and
+ * sets the logic levels in the current sample set. Callers fall back to
+ * the generic code path for lines which this routine does not handle,
+ * which also provides the diagnostics for invalid input data.
+ */
+static gboolean parse_binary_line(const char *line, struct context *inc)
+{
+	const struct bin_column *col;
+	size_t col_idx;
+	const char *p;
+	char sep;
+
+	sep = inc->delimiter->str[0];
+	p = line;
+	clear_logic_samples(inc);
+	for (col_idx = 0; col_idx < inc->column_want_count; col_idx++) {
+		if (col_idx) {
+			if (*p != sep)
+				return FALSE;
+			p++;
+		}
+		col = &inc->bin_columns[col_idx];
+		if (!col->bit_mask) {
+			while (*p && *p != sep)
+				p++;
+			continue;
+		}
+		if (*p == '1')
+			inc->sample_buffer[col->byte_idx] |= col->bit_mask;
+		else if (*p != '0')
+			return FALSE;
+		p++;
+		if (*p && *p != sep)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
 /*
  * BEWARE! Implementor's notes. Sync with feature set and default option
  * values required during maintenance of the input module implementation.
@@ -1341,7 +1468,6 @@ static int initial_parse(const struct sr_input *in, GString *buf)
 
 	ret = SR_OK;
 	inc = in->priv;
-	columns = NULL;
 
 	/* Search for the first line to process (header or data). */
 	line_number = 0;
@@ -1451,9 +1577,9 @@ static int initial_parse(const struct sr_input *in, GString *buf)
 		inc->analog_datafeed_buf_fill = 0;
 	}
 
+	setup_binary_parser(inc);
+
 out:
-	if (columns)
-		g_strfreev(columns);
 	g_strfreev(lines);
 
 	return ret;
@@ -1521,12 +1647,13 @@ static int process_buffer(struct sr_input *in, gboolean is_eof)
 {
 	struct context *inc;
 	gsize num_columns;
-	size_t line_idx, col_idx, col_nr;
+	size_t col_idx, col_nr;
 	const struct column_details *details;
 	col_parse_cb parse_func;
 	int ret;
-	char *processed_up_to;
-	char **lines, *line, **columns, *column;
+	char *processed_up_to, *next_line;
+	char *line, **columns, *column;
+	size_t term_len;
 
 	inc = in->priv;
 	if (!inc->started) {
@@ -1560,10 +1687,16 @@ static int process_buffer(struct sr_input *in, gboolean is_eof)
 		processed_up_to += strlen(inc->termination);
 	}
 
-	/* Split input text lines and process their columns. */
+	/* Split input text lines (in place) and process their columns. */
 	ret = SR_OK;
-	lines = g_strsplit(in->buf->str, inc->termination, 0);
-	for (line_idx = 0; (line = lines[line_idx]); line_idx++) {
+	term_len = strlen(inc->termination);
+	next_line = in->buf->str[0] ? in->buf->str : NULL;
+	while ((line = next_line)) {
+		next_line = strstr(line, inc->termination);
+		if (next_line) {
+			*next_line = '\0';
+			next_line += term_len;
+		}
 		inc->line_number++;
 		if (inc->line_number < inc->start_line) {
 			sr_spew("Line %zu skipped (before start).", inc->line_number);
@@ -1588,19 +1721,26 @@ static int process_buffer(struct sr_input *in, gboolean is_eof)
 			continue;
 		}
 
+		/* Take the fast path for lines of single-bit columns. */
+		if (inc->bin_columns && parse_binary_line(line, inc)) {
+			ret = queue_logic_samples(in);
+			if (ret != SR_OK) {
+				sr_err("Sending samples failed.");
+				return SR_ERR;
+			}
+			continue;
+		}
+
 		/* Split the line into columns, check for minimum length. */
 		columns = split_line(line, inc);
 		if (!columns) {
 			sr_err("Error while parsing line %zu.", inc->line_number);
-			g_strfreev(lines);
 			return SR_ERR;
 		}
 		num_columns = g_strv_length(columns);
 		if (num_columns < inc->column_want_count) {
 			sr_err("Insufficient column count %zu in line %zu.",
 				num_columns, inc->line_number);
-			g_strfreev(columns);
-			g_strfreev(lines);
 			return SR_ERR;
 		}
 
@@ -1617,11 +1757,8 @@ static int process_buffer(struct sr_input *in, gboolean is_eof)
 			if (!parse_func)
 				continue;
 			ret = parse_func(column, inc, details);
-			if (ret != SR_OK) {
-				g_strfreev(columns);
-				g_strfreev(lines);
+			if (ret != SR_OK)
 				return SR_ERR;
-			}
 		}
 
 		/* Send sample data to the session bus (buffered). */
@@ -1629,14 +1766,9 @@ static int process_buffer(struct sr_input *in, gboolean is_eof)
 		ret += queue_analog_samples(in);
 		if (ret != SR_OK) {
 			sr_err("Sending samples failed.");
-			g_strfreev(columns);
-			g_strfreev(lines);
 			return SR_ERR;
 		}
-
-		g_strfreev(columns);
 	}
-	g_strfreev(lines);
 	g_string_erase(in->buf, 0, processed_up_to - in->buf->str);
 
 	return ret;
@@ -1714,6 +1846,10 @@ static void cleanup(struct sr_input *in)
 	/* TODO Release channel names (before releasing details). */
 	g_free(inc->column_details);
 	inc->column_details = NULL;
+	g_free(inc->columns);
+	inc->columns = NULL;
+	g_free(inc->bin_columns);
+	inc->bin_columns = NULL;
 
 	/* Clear internal state, but keep what .init() has provided. */
 	save_ctx = *inc;
@@ -29,6 +29,11 @@ struct feed_queue_logic {
 	uint8_t *data_bytes;
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
+	/* Runs that submit() collects, see feed_queue_logic_send_runs(). */
+	size_t run_alloc;
+	size_t run_fill;
+	uint8_t *run_values;
+	uint64_t *run_counts;
 };
 
 SR_API struct feed_queue_logic *feed_queue_logic_alloc(struct sr_dev_inst *sdi,
@@ -56,44 +61,243 @@ SR_API struct feed_queue_logic *feed_queue_logic_alloc(struct sr_dev_inst *sdi,
 	return q;
 }
 
+/* Fill count samples at dst with copies of one sample. */
+static void fill_repeat(uint8_t *dst, const uint8_t *sample,
+	size_t unit_size, size_t count)
+{
+	size_t done, n;
+
+	if (!count)
+		return;
+
+	if (unit_size == 1) {
+		memset(dst, sample[0], count);
+		return;
+	}
+
+	/* Double the filled range with every copy. */
+	memcpy(dst, sample, unit_size);
+	done = 1;
+	while (done < count) {
+		n = MIN(done, count - done);
+		memcpy(&dst[done * unit_size], dst, n * unit_size);
+		done += n;
+	}
+}
+
+/*
+ * Have feed_queue_logic_submit() collect runs of samples, and send
+ * up to run_count of them per SR_DF_LOGIC_RLE packet. The cost of
+ * sparse data (like the long idle periods of imported simulations)
+ * then follows the number of value changes instead of the number of
+ * samples. The session expands the runs for consumers which cannot
+ * handle the RLE format.
+ */
+SR_API int feed_queue_logic_send_runs(struct feed_queue_logic *q,
+	size_t run_count)
+{
+	int ret;
+
+	ret = feed_queue_logic_flush(q);
+	if (ret != SR_OK)
+		return ret;
+
+	g_free(q->run_values);
+	g_free(q->run_counts);
+	q->run_values = NULL;
+	q->run_counts = NULL;
+	q->run_alloc = 0;
+	if (!run_count)
+		return SR_OK;
+
+	q->run_values = g_try_malloc(run_count * q->unit_size);
+	q->run_counts = g_try_malloc(run_count * sizeof(q->run_counts[0]));
+	if (!q->run_values || !q->run_counts) {
+		g_free(q->run_values);
+		g_free(q->run_counts);
+		q->run_values = NULL;
+		q->run_counts = NULL;
+		return SR_ERR_MALLOC;
+	}
+	q->run_alloc = run_count;
+
+	return SR_OK;
+}
+
+static int flush_samples(struct feed_queue_logic *q)
+{
+	int ret;
+
+	if (!q->fill_count)
+		return SR_OK;
+
+	q->logic.length = q->fill_count * q->unit_size;
+	ret = sr_session_send(q->sdi, &q->packet);
+	if (ret != SR_OK)
+		return ret;
+	q->fill_count = 0;
+
+	return SR_OK;
+}
+
+static int flush_runs(struct feed_queue_logic *q)
+{
+	struct sr_datafeed_logic_rle rle;
+	struct sr_datafeed_packet packet;
+	int ret;
+
+	if (!q->run_fill)
+		return SR_OK;
+
+	rle.num_runs = q->run_fill;
+	rle.unitsize = q->unit_size;
+	rle.values = q->run_values;
+	rle.counts = q->run_counts;
+	packet.type = SR_DF_LOGIC_RLE;
+	packet.payload = &rle;
+	ret = sr_session_send(q->sdi, &packet);
+	if (ret != SR_OK)
+		return ret;
+	q->run_fill = 0;
+
+	return SR_OK;
+}
+
+/* Extend the last run when the sample did not change. */
+static int submit_run(struct feed_queue_logic *q,
+	const uint8_t *data, size_t count)
+{
+	uint8_t *last;
+	int ret;
+
+	if (!count)
+		return SR_OK;
+
+	if (q->run_fill) {
+		last = &q->run_values[(q->run_fill - 1) * q->unit_size];
+		if (memcmp(last, data, q->unit_size) == 0) {
+			q->run_counts[q->run_fill - 1] += count;
+			return SR_OK;
+		}
+	}
+	if (q->run_fill == q->run_alloc) {
+		ret = flush_runs(q);
+		if (ret != SR_OK)
+			return ret;
+	}
+	memcpy(&q->run_values[q->run_fill * q->unit_size], data, q->unit_size);
+	q->run_counts[q->run_fill++] = count;
+
+	return SR_OK;
+}
+
+/* Submit count repetitions of one sample. */
 SR_API int feed_queue_logic_submit(struct feed_queue_logic *q,
 	const uint8_t *data, size_t count)
 {
-	uint8_t *wrptr;
+	struct sr_datafeed_logic_rle rle;
+	struct sr_datafeed_packet packet;
+	uint64_t run_count;
+	size_t n;
 	int ret;
 
-	wrptr = &q->data_bytes[q->fill_count * q->unit_size];
-	while (count--) {
-		memcpy(wrptr, data, q->unit_size);
-		wrptr += q->unit_size;
-		q->fill_count++;
+	if (q->run_alloc) {
+		ret = flush_samples(q);
+		if (ret != SR_OK)
+			return ret;
+		return submit_run(q, data, count);
+	}
+
+	/*
+	 * Send runs which would fill at least one whole chunk as a
+	 * single run-length encoded packet. The session expands them
+	 * for consumers which cannot handle the RLE format.
+	 */
+	if (count >= q->alloc_count) {
+		ret = feed_queue_logic_flush(q);
+		if (ret != SR_OK)
+			return ret;
+		run_count = count;
+		rle.num_runs = 1;
+		rle.unitsize = q->unit_size;
+		rle.values = (void *)data;
+		rle.counts = &run_count;
+		packet.type = SR_DF_LOGIC_RLE;
+		packet.payload = &rle;
+		return sr_session_send(q->sdi, &packet);
+	}
+
+	while (count) {
+		n = MIN(count, q->alloc_count - q->fill_count);
+		fill_repeat(&q->data_bytes[q->fill_count * q->unit_size],
+			data, q->unit_size, n);
+		q->fill_count += n;
+		count -= n;
 		if (q->fill_count == q->alloc_count) {
 			ret = feed_queue_logic_flush(q);
 			if (ret != SR_OK)
 				return ret;
-			wrptr = &q->data_bytes[0];
 		}
 	}
 
 	return SR_OK;
 }
 
-SR_API int feed_queue_logic_flush(struct feed_queue_logic *q)
+/* Submit count consecutive samples. */
+SR_API int feed_queue_logic_submit_many(struct feed_queue_logic *q,
+	const uint8_t *data, size_t count)
 {
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_packet packet;
+	size_t n;
 	int ret;
 
-	if (!q->fill_count)
-		return SR_OK;
-
-	q->logic.length = q->fill_count * q->unit_size;
-	ret = sr_session_send(q->sdi, &q->packet);
+	ret = flush_runs(q);
 	if (ret != SR_OK)
 		return ret;
-	q->fill_count = 0;
+
+	while (count) {
+		/* Send full chunks from the caller's buffer, without a copy. */
+		if (!q->fill_count && count >= q->alloc_count) {
+			logic = q->logic;
+			logic.length = q->alloc_count * q->unit_size;
+			logic.data = (void *)data;
+			packet.type = SR_DF_LOGIC;
+			packet.payload = &logic;
+			ret = sr_session_send(q->sdi, &packet);
+			if (ret != SR_OK)
+				return ret;
+			data += logic.length;
+			count -= q->alloc_count;
+			continue;
+		}
+		n = MIN(count, q->alloc_count - q->fill_count);
+		memcpy(&q->data_bytes[q->fill_count * q->unit_size],
+			data, n * q->unit_size);
+		q->fill_count += n;
+		data += n * q->unit_size;
+		count -= n;
+		if (q->fill_count == q->alloc_count) {
+			ret = feed_queue_logic_flush(q);
+			if (ret != SR_OK)
+				return ret;
+		}
+	}
 
 	return SR_OK;
 }
 
+SR_API int feed_queue_logic_flush(struct feed_queue_logic *q)
+{
+	int ret;
+
+	ret = flush_runs(q);
+	if (ret != SR_OK)
+		return ret;
+
+	return flush_samples(q);
+}
+
 SR_API void feed_queue_logic_free(struct feed_queue_logic *q)
 {
 
@@ -101,6 +305,8 @@ SR_API void feed_queue_logic_free(struct feed_queue_logic *q)
 		return;
 
 	g_free(q->data_bytes);
+	g_free(q->run_values);
+	g_free(q->run_counts);
 	g_free(q);
 }
 
@@ -108,7 +314,9 @@ struct feed_queue_analog {
 	struct sr_dev_inst *sdi;
 	size_t alloc_count;
 	size_t fill_count;
-	float *data_values;
+	/* Samples in the queue's encoding, float unless set otherwise. */
+	uint8_t *data_bytes;
+	size_t unit_size;
 	int digits;
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_analog analog;
@@ -126,8 +334,9 @@ SR_API struct feed_queue_analog *feed_queue_analog_alloc(struct sr_dev_inst *sdi
 	q = g_malloc0(sizeof(*q));
 	q->sdi = sdi;
 	q->alloc_count = sample_count;
-	q->data_values = g_try_malloc(q->alloc_count * sizeof(float));
-	if (!q->data_values) {
+	q->unit_size = sizeof(float);
+	q->data_bytes = g_try_malloc(q->alloc_count * q->unit_size);
+	if (!q->data_bytes) {
 		g_free(q);
 		return NULL;
 	}
@@ -140,18 +349,103 @@ SR_API struct feed_queue_analog *feed_queue_analog_alloc(struct sr_dev_inst *sdi
 	q->packet.payload = &q->analog;
 	q->encoding.is_signed = TRUE;
 	q->meaning.channels = q->channels;
-	q->analog.data = q->data_values;
+	q->analog.data = q->data_bytes;
 
 	return q;
 }
 
-SR_API int feed_queue_analog_submit(struct feed_queue_analog *q,
-	float data, size_t count)
+/*
+ * Have the queue take integer samples of unit_size bytes in host byte
+ * order, see feed_queue_analog_submit_raw(). They get sent as they are,
+ * the values are raw * scale + offset. Queued samples get sent first.
+ */
+SR_API int feed_queue_analog_encoding_set(struct feed_queue_analog *q,
+	size_t unit_size, gboolean is_signed,
+	const struct sr_rational *scale, const struct sr_rational *offset)
 {
+	uint8_t *data;
 	int ret;
 
-	while (count--) {
-		q->data_values[q->fill_count++] = data;
+	if (!q || !scale || !offset || !scale->q || !offset->q)
+		return SR_ERR_ARG;
+	if (unit_size != 1 && unit_size != 2 && unit_size != 4 &&
+			unit_size != 8)
+		return SR_ERR_ARG;
+
+	ret = feed_queue_analog_flush(q);
+	if (ret != SR_OK)
+		return ret;
+
+	if (unit_size != q->unit_size) {
+		data = g_try_realloc(q->data_bytes, q->alloc_count * unit_size);
+		if (!data)
+			return SR_ERR_MALLOC;
+		q->data_bytes = data;
+		q->unit_size = unit_size;
+		q->analog.data = q->data_bytes;
+	}
+	q->encoding.unitsize = unit_size;
+	q->encoding.is_float = FALSE;
+	q->encoding.is_signed = is_signed;
+	q->encoding.scale = *scale;
+	q->encoding.offset = *offset;
+
+	return SR_OK;
+}
+
+/* Submit count repetitions of one sample in the queue's encoding. */
+static int submit_repeat(struct feed_queue_analog *q,
+	const uint8_t *sample, size_t count)
+{
+	size_t n;
+	int ret;
+
+	while (count) {
+		n = MIN(count, q->alloc_count - q->fill_count);
+		fill_repeat(&q->data_bytes[q->fill_count * q->unit_size],
+			sample, q->unit_size, n);
+		q->fill_count += n;
+		count -= n;
+		if (q->fill_count == q->alloc_count) {
+			ret = feed_queue_analog_flush(q);
+			if (ret != SR_OK)
+				return ret;
+		}
+	}
+
+	return SR_OK;
+}
+
+/* Submit count consecutive samples in the queue's encoding. */
+static int submit_many(struct feed_queue_analog *q,
+	const uint8_t *data, size_t count)
+{
+	struct sr_datafeed_analog analog;
+	struct sr_datafeed_packet packet;
+	size_t n;
+	int ret;
+
+	while (count) {
+		/* Send full chunks from the caller's buffer, without a copy. */
+		if (!q->fill_count && count >= q->alloc_count) {
+			analog = q->analog;
+			analog.num_samples = q->alloc_count;
+			analog.data = (void *)data;
+			packet.type = SR_DF_ANALOG;
+			packet.payload = &analog;
+			ret = sr_session_send(q->sdi, &packet);
+			if (ret != SR_OK)
+				return ret;
+			data += q->alloc_count * q->unit_size;
+			count -= q->alloc_count;
+			continue;
+		}
+		n = MIN(count, q->alloc_count - q->fill_count);
+		memcpy(&q->data_bytes[q->fill_count * q->unit_size],
+			data, n * q->unit_size);
+		q->fill_count += n;
+		data += n * q->unit_size;
+		count -= n;
 		if (q->fill_count == q->alloc_count) {
 			ret = feed_queue_analog_flush(q);
 			if (ret != SR_OK)
@@ -162,6 +456,39 @@ SR_API int feed_queue_analog_submit(struct feed_queue_analog *q,
 	return SR_OK;
 }
 
+/* Submit count repetitions of one value, for float queues. */
+SR_API int feed_queue_analog_submit(struct feed_queue_analog *q,
+	float data, size_t count)
+{
+	if (!q->encoding.is_float)
+		return SR_ERR_ARG;
+
+	return submit_repeat(q, (const uint8_t *)&data, count);
+}
+
+/* Submit count consecutive values, for float queues. */
+SR_API int feed_queue_analog_submit_many(struct feed_queue_analog *q,
+	const float *data, size_t count)
+{
+	if (!q->encoding.is_float)
+		return SR_ERR_ARG;
+
+	return submit_many(q, (const uint8_t *)data, count);
+}
+
+/*
+ * Submit count consecutive integer samples, for queues which were set
+ * up with feed_queue_analog_encoding_set().
+ */
+SR_API int feed_queue_analog_submit_raw(struct feed_queue_analog *q,
+	const void *data, size_t count)
+{
+	if (q->encoding.is_float)
+		return SR_ERR_ARG;
+
+	return submit_many(q, data, count);
+}
+
 SR_API int feed_queue_analog_flush(struct feed_queue_analog *q)
 {
 	int ret;
@@ -184,7 +511,7 @@ SR_API void feed_queue_analog_free(struct feed_queue_analog *q)
 	if (!q)
 		return;
 
-	g_free(q->data_values);
+	g_free(q->data_bytes);
 	g_slist_free(q->channels);
 	g_free(q);
 }
@@ -0,0 +1,510 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "netfeed.h"
+
+#define LOG_PREFIX "input/framed"
+
+/*
+ * Reads what the "framed" output module writes (see netfeed.h), and
+ * sends the packets it was written from. The channels come from the
+ * first header frame, which directly follows the magic.
+ */
+
+struct context {
+	gboolean magic_seen;
+	gboolean started;
+	uint64_t samplerate;
+	/* Aligned copies of analog samples and of run counts. */
+	uint64_t *abuf;
+	size_t abuf_len;
+	uint64_t *counts;
+	size_t counts_len;
+};
+
+static int init(struct sr_input *in, GHashTable *options)
+{
+	(void)options;
+
+	in->sdi = g_malloc0(sizeof(struct sr_dev_inst));
+	in->priv = g_malloc0(sizeof(struct context));
+
+	return SR_OK;
+}
+
+static int format_match(GHashTable *metadata, unsigned int *confidence)
+{
+	GString *header;
+
+	header = g_hash_table_lookup(metadata, GINT_TO_POINTER(SR_INPUT_META_HEADER));
+	if (!header || header->len < NETFEED_MAGIC_LEN)
+		return SR_ERR;
+	if (memcmp(header->str, NETFEED_MAGIC, NETFEED_MAGIC_LEN))
+		return SR_ERR;
+	*confidence = 1;
+
+	return SR_OK;
+}
+
+static int header_parse(struct sr_input *in, const uint8_t *p, size_t len,
+		gboolean create)
+{
+	struct context *inc;
+	const uint8_t *end;
+	uint32_t i, num_channels;
+	uint16_t name_len;
+	uint8_t type, enabled;
+	char *name;
+
+	inc = in->priv;
+	end = p + len;
+	if (len < 12)
+		return SR_ERR_DATA;
+	inc->samplerate = read_u64le_inc(&p);
+	num_channels = read_u32le_inc(&p);
+
+	for (i = 0; create && i < num_channels; i++) {
+		if (end - p < 4)
+			return SR_ERR_DATA;
+		type = read_u8_inc(&p);
+		enabled = read_u8_inc(&p);
+		name_len = read_u16le_inc(&p);
+		if (end - p < name_len)
+			return SR_ERR_DATA;
+		name = g_strndup((const char *)p, name_len);
+		p += name_len;
+		sr_channel_new(in->sdi, i, type == NETFEED_CHANNEL_LOGIC ?
+			SR_CHANNEL_LOGIC : SR_CHANNEL_ANALOG, enabled, name);
+		g_free(name);
+	}
+
+	return SR_OK;
+}
+
+static struct sr_channel *channel_find(const struct sr_input *in,
+		uint32_t index)
+{
+	struct sr_channel *ch;
+	GSList *l;
+
+	for (l = in->sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if ((uint32_t)ch->index == index)
+			return ch;
+	}
+
+	return NULL;
+}
+
+static int send_meta(struct sr_input *in, const uint8_t *p, size_t len)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_meta meta;
+	const uint8_t *end;
+	uint32_t i, num, key, size;
+	uint16_t type_len;
+	char *type;
+	GVariant *data, *swapped;
+	int ret;
+
+	end = p + len;
+	if (len < 4)
+		return SR_ERR_DATA;
+	num = read_u32le_inc(&p);
+
+	ret = SR_OK;
+	meta.config = NULL;
+	for (i = 0; i < num; i++) {
+		if (end - p < 6) {
+			ret = SR_ERR_DATA;
+			break;
+		}
+		key = read_u32le_inc(&p);
+		type_len = read_u16le_inc(&p);
+		if (end - p < type_len + 4) {
+			ret = SR_ERR_DATA;
+			break;
+		}
+		type = g_strndup((const char *)p, type_len);
+		p += type_len;
+		size = read_u32le_inc(&p);
+		if ((size_t)(end - p) < size ||
+				!g_variant_type_string_is_valid(type)) {
+			g_free(type);
+			ret = SR_ERR_DATA;
+			break;
+		}
+		data = g_variant_new_from_data(G_VARIANT_TYPE(type),
+			g_memdup(p, size), size, FALSE, g_free, NULL);
+		p += size;
+		g_free(type);
+		if (G_BYTE_ORDER == G_BIG_ENDIAN) {
+			swapped = g_variant_byteswap(data);
+			g_variant_unref(g_variant_ref_sink(data));
+			data = swapped;
+		}
+		meta.config = g_slist_append(meta.config, sr_config_new(key, data));
+	}
+
+	if (ret == SR_OK && meta.config) {
+		packet.type = SR_DF_META;
+		packet.payload = &meta;
+		ret = sr_session_send(in->sdi, &packet);
+	}
+	g_slist_free_full(meta.config, (GDestroyNotify)sr_config_free);
+
+	return ret;
+}
+
+static int send_logic(struct sr_input *in, const uint8_t *p, size_t len)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+
+	if (len < NETFEED_LOGIC_LEN)
+		return SR_ERR_DATA;
+	logic.unitsize = read_u32le_inc(&p);
+	len -= NETFEED_LOGIC_LEN;
+	if (!logic.unitsize || len % logic.unitsize)
+		return SR_ERR_DATA;
+	logic.length = len;
+	logic.data = (void *)p;
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+
+	return sr_session_send(in->sdi, &packet);
+}
+
+static int send_logic_rle(struct sr_input *in, const uint8_t *p, size_t len)
+{
+	struct context *inc;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic_rle rle;
+	const uint8_t *counts;
+	uint64_t i;
+
+	inc = in->priv;
+	if (len < NETFEED_LOGIC_RLE_LEN)
+		return SR_ERR_DATA;
+	rle.unitsize = read_u32le_inc(&p);
+	rle.num_runs = read_u64le_inc(&p);
+	len -= NETFEED_LOGIC_RLE_LEN;
+	if (!rle.unitsize || len / (rle.unitsize + 8) != rle.num_runs ||
+			len % (rle.unitsize + 8))
+		return SR_ERR_DATA;
+
+	rle.values = (void *)p;
+	counts = p + rle.num_runs * rle.unitsize;
+	if (inc->counts_len < rle.num_runs) {
+		inc->counts = g_realloc(inc->counts,
+			rle.num_runs * sizeof(uint64_t));
+		inc->counts_len = rle.num_runs;
+	}
+	for (i = 0; i < rle.num_runs; i++)
+		inc->counts[i] = read_u64le_inc(&counts);
+	rle.counts = inc->counts;
+	packet.type = SR_DF_LOGIC_RLE;
+	packet.payload = &rle;
+
+	return sr_session_send(in->sdi, &packet);
+}
+
+static int send_analog(struct sr_input *in, const uint8_t *p, size_t len)
+{
+	struct context *inc;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	struct sr_channel *ch;
+	uint32_t i, num_channels;
+	uint64_t size;
+	uint8_t flags;
+	int ret;
+
+	inc = in->priv;
+	if (len < NETFEED_ANALOG_RAW_LEN)
+		return SR_ERR_DATA;
+	len -= NETFEED_ANALOG_RAW_LEN;
+
+	memset(&encoding, 0, sizeof(encoding));
+	memset(&meaning, 0, sizeof(meaning));
+	memset(&spec, 0, sizeof(spec));
+	meaning.mq = read_u32le_inc(&p);
+	meaning.unit = read_u32le_inc(&p);
+	meaning.mqflags = read_u64le_inc(&p);
+	encoding.unitsize = read_u8_inc(&p);
+	flags = read_u8_inc(&p);
+	encoding.is_signed = !!(flags & NETFEED_ENC_SIGNED);
+	encoding.is_float = !!(flags & NETFEED_ENC_FLOAT);
+	encoding.is_bigendian = !!(flags & NETFEED_ENC_BIGENDIAN);
+	encoding.is_digits_decimal = !!(flags & NETFEED_ENC_DIGITS_DECIMAL);
+	encoding.digits = (int8_t)read_u8_inc(&p);
+	spec.spec_digits = (int8_t)read_u8_inc(&p);
+	analog.num_samples = read_u32le_inc(&p);
+	encoding.scale.p = (int64_t)read_u64le_inc(&p);
+	encoding.scale.q = read_u64le_inc(&p);
+	encoding.offset.p = (int64_t)read_u64le_inc(&p);
+	encoding.offset.q = read_u64le_inc(&p);
+	num_channels = read_u32le_inc(&p);
+
+	if (!encoding.unitsize || len / 4 < num_channels)
+		return SR_ERR_DATA;
+	len -= 4 * num_channels;
+	/* Interleaved packets hold one value per channel and sample. */
+	size = (uint64_t)analog.num_samples * encoding.unitsize *
+		MAX(num_channels, 1);
+	if (size != len)
+		return SR_ERR_DATA;
+
+	for (i = 0; i < num_channels; i++) {
+		if (!(ch = channel_find(in, read_u32le_inc(&p)))) {
+			g_slist_free(meaning.channels);
+			return SR_ERR_DATA;
+		}
+		meaning.channels = g_slist_append(meaning.channels, ch);
+	}
+
+	/* Receivers may access the samples as their type, which needs alignment. */
+	if ((uintptr_t)p % sizeof(uint64_t)) {
+		if (inc->abuf_len < size) {
+			inc->abuf = g_realloc(inc->abuf, size);
+			inc->abuf_len = size;
+		}
+		memcpy(inc->abuf, p, size);
+		analog.data = inc->abuf;
+	} else {
+		analog.data = (void *)p;
+	}
+	analog.encoding = &encoding;
+	analog.meaning = &meaning;
+	analog.spec = &spec;
+	packet.type = SR_DF_ANALOG;
+	packet.payload = &analog;
+	ret = sr_session_send(in->sdi, &packet);
+	g_slist_free(meaning.channels);
+
+	return ret;
+}
+
+static int frame_handle(struct sr_input *in, int type,
+		const uint8_t *payload, size_t len)
+{
+	struct context *inc;
+	int ret;
+
+	inc = in->priv;
+
+	switch (type) {
+	case NETFEED_HEADER:
+		if ((ret = header_parse(in, payload, len, FALSE)) != SR_OK)
+			return ret;
+		if (inc->started)
+			std_session_send_df_end(in->sdi);
+		std_session_send_df_header(in->sdi);
+		inc->started = TRUE;
+		if (!inc->samplerate)
+			return SR_OK;
+		return sr_session_send_meta(in->sdi, SR_CONF_SAMPLERATE,
+			g_variant_new_uint64(inc->samplerate));
+	case NETFEED_META:
+		return send_meta(in, payload, len);
+	case NETFEED_SAMPLERATE:
+		if (len < 8)
+			return SR_ERR_DATA;
+		inc->samplerate = read_u64le(payload);
+		return sr_session_send_meta(in->sdi, SR_CONF_SAMPLERATE,
+			g_variant_new_uint64(inc->samplerate));
+	case NETFEED_LOGIC:
+		return send_logic(in, payload, len);
+	case NETFEED_LOGIC_RLE:
+		return send_logic_rle(in, payload, len);
+	case NETFEED_ANALOG_RAW:
+		return send_analog(in, payload, len);
+	case NETFEED_TRIGGER:
+		return std_session_send_df_trigger(in->sdi);
+	case NETFEED_FRAME_BEGIN:
+		return std_session_send_df_frame_begin(in->sdi);
+	case NETFEED_FRAME_END:
+		return std_session_send_df_frame_end(in->sdi);
+	case NETFEED_END:
+		inc->started = FALSE;
+		return std_session_send_df_end(in->sdi);
+	default:
+		sr_spew("Skipping frame of type %d.", type);
+		return SR_OK;
+	}
+}
+
+/* Handle the complete frames in the buffer, keep the rest. */
+static int process_buffer(struct sr_input *in)
+{
+	struct context *inc;
+	const uint8_t *p;
+	size_t pos, len;
+	int type, ret;
+
+	inc = in->priv;
+	p = (const uint8_t *)in->buf->str;
+	pos = 0;
+	ret = SR_OK;
+
+	if (!inc->magic_seen) {
+		if (in->buf->len < NETFEED_MAGIC_LEN)
+			return SR_OK;
+		if (memcmp(p, NETFEED_MAGIC, NETFEED_MAGIC_LEN)) {
+			sr_err("Not a framed datafeed.");
+			return SR_ERR_DATA;
+		}
+		inc->magic_seen = TRUE;
+		pos = NETFEED_MAGIC_LEN;
+	}
+
+	while (in->buf->len - pos >= NETFEED_FRAME_LEN) {
+		len = read_u32le(p + pos);
+		if (len > NETFEED_MAX_PAYLOAD) {
+			sr_err("Frame of %zu bytes is too large.", len);
+			ret = SR_ERR_DATA;
+			break;
+		}
+		if (in->buf->len - pos - NETFEED_FRAME_LEN < len)
+			break;
+		type = p[pos + 4];
+		ret = frame_handle(in, type, p + pos + NETFEED_FRAME_LEN, len);
+		pos += NETFEED_FRAME_LEN + len;
+		if (ret != SR_OK) {
+			sr_err("Invalid frame of type %d.", type);
+			break;
+		}
+	}
+	g_string_erase(in->buf, 0, pos);
+
+	return ret;
+}
+
+/* Create the channels from the header which follows the magic. */
+static int channels_create(struct sr_input *in, gboolean *ready)
+{
+	const uint8_t *p;
+	size_t len;
+
+	*ready = FALSE;
+	p = (const uint8_t *)in->buf->str;
+	if (in->buf->len < NETFEED_MAGIC_LEN + NETFEED_FRAME_LEN)
+		return SR_OK;
+	if (memcmp(p, NETFEED_MAGIC, NETFEED_MAGIC_LEN)) {
+		sr_err("Not a framed datafeed.");
+		return SR_ERR_DATA;
+	}
+	p += NETFEED_MAGIC_LEN;
+	len = read_u32le(p);
+	if (p[4] != NETFEED_HEADER || len > NETFEED_MAX_PAYLOAD) {
+		sr_err("The datafeed does not start with a header.");
+		return SR_ERR_DATA;
+	}
+	if (in->buf->len - NETFEED_MAGIC_LEN - NETFEED_FRAME_LEN < len)
+		return SR_OK;
+	*ready = TRUE;
+
+	return header_parse(in, p + NETFEED_FRAME_LEN, len, TRUE);
+}
+
+static int receive(struct sr_input *in, GString *buf)
+{
+	gboolean ready;
+	int ret;
+
+	g_string_append_len(in->buf, buf->str, buf->len);
+
+	if (!in->sdi_ready) {
+		if ((ret = channels_create(in, &ready)) != SR_OK)
+			return ret;
+		/* sdi is ready, notify frontend. */
+		in->sdi_ready = ready;
+		return SR_OK;
+	}
+
+	return process_buffer(in);
+}
+
+static int end(struct sr_input *in)
+{
+	struct context *inc;
+	int ret;
+
+	if (!in->sdi_ready) {
+		sr_err("The datafeed ended before its header.");
+		return SR_ERR_DATA;
+	}
+
+	ret = process_buffer(in);
+	if (ret == SR_OK && in->buf->len)
+		sr_warn("Dropping %zu bytes of an incomplete frame.",
+			in->buf->len);
+
+	inc = in->priv;
+	if (inc->started)
+		std_session_send_df_end(in->sdi);
+	inc->started = FALSE;
+
+	return ret;
+}
+
+static void cleanup(struct sr_input *in)
+{
+	struct context *inc;
+
+	inc = in->priv;
+	g_free(inc->abuf);
+	g_free(inc->counts);
+	inc->abuf = NULL;
+	inc->counts = NULL;
+	inc->abuf_len = inc->counts_len = 0;
+}
+
+static int reset(struct sr_input *in)
+{
+	struct context *inc;
+
+	inc = in->priv;
+	inc->magic_seen = FALSE;
+	inc->started = FALSE;
+	g_string_truncate(in->buf, 0);
+
+	return SR_OK;
+}
+
+SR_PRIV struct sr_input_module input_framed = {
+	.id = "framed",
+	.name = "Framed",
+	.desc = "Framed binary datafeed, from the framed output",
+	.exts = (const char*[]){"srnf", NULL},
+	.metadata = { SR_INPUT_META_HEADER | SR_INPUT_META_REQUIRED },
+	.format_match = format_match,
+	.init = init,
+	.receive = receive,
+	.end = end,
+	.cleanup = cleanup,
+	.reset = reset,
+};
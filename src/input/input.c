@@ -31,6 +31,10 @@
 
 /** @cond PRIVATE */
 #define CHUNK_SIZE	(4 * 1024 * 1024)
+/* Chunks read ahead by an input runner, unless the caller asks otherwise. */
+#define RUNNER_DEFAULT_DEPTH	4
+/* A positive identification, no other module can do better. */
+#define MATCH_CONFIDENCE_BEST	1
 /** @endcond */
 
 /**
@@ -65,6 +69,7 @@
 /** @cond PRIVATE */
 extern SR_PRIV struct sr_input_module input_chronovu_la8;
 extern SR_PRIV struct sr_input_module input_csv;
+extern SR_PRIV struct sr_input_module input_framed;
 extern SR_PRIV struct sr_input_module input_binary;
 extern SR_PRIV struct sr_input_module input_trace32_ad;
 extern SR_PRIV struct sr_input_module input_vcd;
@@ -79,6 +84,7 @@ static const struct sr_input_module *input_module_list[] = {
 	&input_binary,
 	&input_chronovu_la8,
 	&input_csv,
+	&input_framed,
 	&input_trace32_ad,
 	&input_vcd,
 	&input_wav,
@@ -263,6 +269,11 @@ SR_API struct sr_input *sr_input_new(const struct sr_input_module *imod,
 	gpointer key, value;
 	int i;
 
+	if (sr_input_module_sanity_check(imod) != SR_OK) {
+		sr_err("Internal input module error(s), can't use it.");
+		return NULL;
+	}
+
 	in = g_malloc0(sizeof(struct sr_input));
 	in->module = imod;
 
@@ -340,6 +351,46 @@ static gboolean check_required_metadata(const uint8_t *metadata, uint8_t *avail)
 	return TRUE;
 }
 
+static gboolean module_has_ext(const struct sr_input_module *imod,
+		const char *ext)
+{
+	const char *const *e;
+
+	for (e = imod->exts; e && *e; e++) {
+		if (g_ascii_strcasecmp(*e, ext) == 0)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*
+ * Get the order in which to try the modules' format_match(). Modules
+ * which list the file's extension come first, so that detection can
+ * usually stop at the first module (see MATCH_CONFIDENCE_BEST).
+ */
+static void scan_order(const char *filename,
+		const struct sr_input_module **order)
+{
+	const char *ext;
+	unsigned int i, count;
+
+	ext = filename ? strrchr(filename, '.') : NULL;
+	if (ext && (strchr(ext, '/') || strchr(ext, G_DIR_SEPARATOR)))
+		ext = NULL;
+
+	count = 0;
+	for (i = 0; ext && input_module_list[i]; i++) {
+		if (module_has_ext(input_module_list[i], ext + 1))
+			order[count++] = input_module_list[i];
+	}
+	for (i = 0; input_module_list[i]; i++) {
+		if (!ext || !module_has_ext(input_module_list[i], ext + 1))
+			order[count++] = input_module_list[i];
+	}
+	order[count] = NULL;
+}
+
 /**
  * Try to find an input module that can parse the given buffer.
  *
@@ -364,6 +415,7 @@ static gboolean check_required_metadata(const uint8_t *metadata, uint8_t *avail)
 SR_API int sr_input_scan_buffer(GString *buf, const struct sr_input **in)
 {
 	const struct sr_input_module *imod, *best_imod;
+	const struct sr_input_module *order[ARRAY_SIZE(input_module_list)];
 	GHashTable *meta;
 	unsigned int m, i;
 	unsigned int conf, best_conf;
@@ -377,8 +429,9 @@ SR_API int sr_input_scan_buffer(GString *buf, const struct sr_input **in)
 	*in = NULL;
 	best_imod = NULL;
 	best_conf = ~0;
-	for (i = 0; input_module_list[i]; i++) {
-		imod = input_module_list[i];
+	scan_order(NULL, order);
+	for (i = 0; order[i]; i++) {
+		imod = order[i];
 		if (!imod->metadata[0]) {
 			/* Module has no metadata for matching so will take
 			 * any input. No point in letting it try to match. */
@@ -419,6 +472,8 @@ SR_API int sr_input_scan_buffer(GString *buf, const struct sr_input **in)
 			continue;
 		best_imod = imod;
 		best_conf = conf;
+		if (best_conf <= MATCH_CONFIDENCE_BEST)
+			break;
 	}
 
 	if (best_imod) {
@@ -444,6 +499,7 @@ SR_API int sr_input_scan_file(const char *filename, const struct sr_input **in)
 	int64_t filesize;
 	FILE *stream;
 	const struct sr_input_module *imod, *best_imod;
+	const struct sr_input_module *order[ARRAY_SIZE(input_module_list)];
 	GHashTable *meta;
 	GString *header;
 	size_t count;
@@ -497,8 +553,9 @@ SR_API int sr_input_scan_file(const char *filename, const struct sr_input **in)
 
 	best_imod = NULL;
 	best_conf = ~0;
-	for (i = 0; input_module_list[i]; i++) {
-		imod = input_module_list[i];
+	scan_order(filename, order);
+	for (i = 0; order[i]; i++) {
+		imod = order[i];
 		if (!imod->metadata[0]) {
 			/* Module has no metadata for matching so will take
 			 * any input. No point in letting it try to match. */
@@ -524,6 +581,8 @@ SR_API int sr_input_scan_file(const char *filename, const struct sr_input **in)
 			continue;
 		best_imod = imod;
 		best_conf = conf;
+		if (best_conf <= MATCH_CONFIDENCE_BEST)
+			break;
 	}
 	g_hash_table_destroy(meta);
 	g_string_free(header, TRUE);
@@ -582,6 +641,9 @@ SR_API struct sr_dev_inst *sr_input_dev_inst_get(const struct sr_input *in)
  * the chance to examine the device instance, attach session callbacks
  * and so on.
  *
+ * Input modules may send sample data which points into @a buf, and
+ * receivers of the data may modify it in place (e.g. transforms).
+ *
  * @since 0.4.0
  */
 SR_API int sr_input_send(const struct sr_input *in, GString *buf)
@@ -593,6 +655,125 @@ SR_API int sr_input_send(const struct sr_input *in, GString *buf)
 	return in->module->receive((struct sr_input *)in, buf);
 }
 
+static void mapped_drop(struct sr_input *in)
+{
+	if (in->mapped)
+		g_mapped_file_unref(in->mapped);
+	g_free(in->mapped_name);
+	in->mapped = NULL;
+	in->mapped_name = NULL;
+	in->mapped_pos = 0;
+}
+
+/**
+ * Send the contents of a file to the specified input instance, without
+ * reading it into buffers first.
+ *
+ * The file gets mapped into memory, and input modules which support it
+ * parse the data in place and send sample data which points into the
+ * mapping. Other input modules receive the data like from sr_input_send().
+ *
+ * Like sr_input_send(), this returns the moment the device instance got
+ * ready, which gives the caller the chance to examine it, or to set up
+ * the session. Calling this function again with the same file sends the
+ * remaining data. Then call sr_input_end() as usual:
+ *
+ * @code
+ * sr_input_send_mapped(in, filename);
+ * sdi = sr_input_dev_inst_get(in);
+ * ...
+ * sr_input_send_mapped(in, filename);
+ * sr_input_end(in);
+ * @endcode
+ *
+ * Don't mix this with sr_input_send() calls for the same input instance,
+ * before sr_input_reset() got called.
+ *
+ * @param in The input instance. Must not be NULL.
+ * @param filename The name of the file. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR The file cannot be mapped.
+ * @retval other Error code from the input module.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_input_send_mapped(const struct sr_input *in_ro,
+		const char *filename)
+{
+	struct sr_input *in;
+	FILE *stream;
+	GError *error;
+	GString *chunk;
+	char *data;
+	size_t len, used;
+	gboolean was_ready;
+	int ret;
+
+	in = (struct sr_input *)in_ro;	/* "un-const" */
+	if (!in || !in->module || !filename)
+		return SR_ERR_ARG;
+
+	if (!in->mapped || strcmp(in->mapped_name, filename)) {
+		mapped_drop(in);
+		stream = g_fopen(filename, "rb");
+		if (!stream) {
+			sr_err("Failed to open %s: %s", filename, g_strerror(errno));
+			return SR_ERR;
+		}
+		/*
+		 * Transforms may modify sample data in place (e.g. invert),
+		 * so map the file writable. Such a mapping is private, pages
+		 * only get copied when written to, and never reach the file.
+		 */
+		error = NULL;
+		in->mapped = g_mapped_file_new_from_fd(fileno(stream), TRUE, &error);
+		fclose(stream);
+		if (!in->mapped) {
+			sr_err("Failed to map %s: %s", filename, error->message);
+			g_error_free(error);
+			return SR_ERR;
+		}
+		in->mapped_name = g_strdup(filename);
+	}
+	data = g_mapped_file_get_contents(in->mapped);
+	len = g_mapped_file_get_length(in->mapped);
+	sr_spew("Sending %zu mapped bytes to %s module.",
+		len - in->mapped_pos, in->module->id);
+
+	ret = SR_OK;
+	chunk = NULL;
+	while (in->mapped_pos < len) {
+		was_ready = in->sdi_ready;
+		if (in->module->receive_mapped) {
+			used = 0;
+			ret = in->module->receive_mapped(in, data + in->mapped_pos,
+				len - in->mapped_pos, &used);
+		} else {
+			used = MIN(CHUNK_SIZE, len - in->mapped_pos);
+			if (!chunk)
+				chunk = g_string_sized_new(used);
+			g_string_truncate(chunk, 0);
+			g_string_append_len(chunk, data + in->mapped_pos, used);
+			ret = in->module->receive(in, chunk);
+		}
+		in->mapped_pos += used;
+		if (ret != SR_OK)
+			break;
+		/* Let the caller see the device instance before samples flow. */
+		if (!was_ready && in->sdi_ready)
+			break;
+		/* The module cannot use the rest, e.g. a partial sample. */
+		if (!used)
+			break;
+	}
+	if (chunk)
+		g_string_free(chunk, TRUE);
+
+	return ret;
+}
+
 /**
  * Signal the input module no more data will come.
  *
@@ -603,8 +784,13 @@ SR_API int sr_input_send(const struct sr_input *in, GString *buf)
  */
 SR_API int sr_input_end(const struct sr_input *in)
 {
+	int ret;
+
 	sr_spew("Calling end() on %s module.", in->module->id);
-	return in->module->end((struct sr_input *)in);
+	ret = in->module->end((struct sr_input *)in);
+	mapped_drop((struct sr_input *)in);
+
+	return ret;
 }
 
 /**
@@ -657,6 +843,7 @@ SR_API int sr_input_reset(const struct sr_input *in_ro)
 	if (in->buf)
 		g_string_truncate(in->buf, 0);
 	in->sdi_ready = FALSE;
+	mapped_drop(in);
 
 	return rc;
 }
@@ -691,8 +878,344 @@ SR_API void sr_input_free(const struct sr_input *in)
 			" unprocessed bytes at free time.", in->buf->len);
 	}
 	g_string_free(in->buf, TRUE);
+	mapped_drop((struct sr_input *)in);
 	g_free(in->priv);
 	g_free((gpointer)in);
 }
 
+/** @cond PRIVATE */
+struct sr_input_runner {
+	struct sr_input *in;
+	FILE *stream;
+	size_t depth;
+	GThread *io_thread;
+	GThread *parse_thread;
+	/* Chunks to read into, and chunks read. An empty one ends the file. */
+	GAsyncQueue *free_chunks;
+	GAsyncQueue *full_chunks;
+	/* Protects the state below, signals its changes. */
+	GMutex mutex;
+	GCond cond;
+	/* Device instance ready, or the parser gave up before. */
+	gboolean ready;
+	/* The caller set up the session, samples may flow. */
+	gboolean go;
+	gboolean done;
+	gboolean abort;
+	int io_status;
+	int status;
+	/* Session whose delivery thread sr_input_runner_run() started. */
+	struct sr_session *delivery;
+};
+/** @endcond */
+
+static void runner_state_set(struct sr_input_runner *r, gboolean *flag)
+{
+	g_mutex_lock(&r->mutex);
+	*flag = TRUE;
+	g_cond_broadcast(&r->cond);
+	g_mutex_unlock(&r->mutex);
+}
+
+static gboolean runner_aborted(struct sr_input_runner *r)
+{
+	gboolean abort;
+
+	g_mutex_lock(&r->mutex);
+	abort = r->abort;
+	g_mutex_unlock(&r->mutex);
+
+	return abort;
+}
+
+/* Read the file ahead, as far as there are free chunks. */
+static gpointer runner_io_thread(gpointer data)
+{
+	struct sr_input_runner *r;
+	GString *chunk;
+	size_t count;
+
+	r = data;
+
+	do {
+		chunk = g_async_queue_pop(r->free_chunks);
+		count = 0;
+		if (!runner_aborted(r)) {
+			count = fread(chunk->str, 1, chunk->allocated_len - 1,
+				r->stream);
+			if (!count && ferror(r->stream)) {
+				sr_err("Failed to read input: %s", g_strerror(errno));
+				r->io_status = SR_ERR_IO;
+			}
+		}
+		g_string_set_size(chunk, count);
+		g_async_queue_push(r->full_chunks, chunk);
+	} while (count);
+
+	return NULL;
+}
+
+/*
+ * Feed the chunks to the input module. Once the device instance got
+ * ready, wait for the caller to set up the session before going on.
+ */
+static gpointer runner_parse_thread(gpointer data)
+{
+	struct sr_input_runner *r;
+	GString *chunk;
+	gboolean was_ready, last;
+	int ret;
+
+	r = data;
+
+	do {
+		chunk = g_async_queue_pop(r->full_chunks);
+		last = !chunk->len;
+		if (!last && r->status == SR_OK && !runner_aborted(r)) {
+			was_ready = r->in->sdi_ready;
+			ret = sr_input_send(r->in, chunk);
+			if (ret != SR_OK)
+				r->status = ret;
+			if (!was_ready && r->in->sdi_ready) {
+				g_mutex_lock(&r->mutex);
+				r->ready = TRUE;
+				g_cond_broadcast(&r->cond);
+				while (!r->go && !r->abort)
+					g_cond_wait(&r->cond, &r->mutex);
+				g_mutex_unlock(&r->mutex);
+			}
+		}
+		g_async_queue_push(r->free_chunks, chunk);
+	} while (!last);
+
+	if (r->status == SR_OK)
+		r->status = r->io_status;
+
+	/* The data ended or failed before the device instance got ready. */
+	g_mutex_lock(&r->mutex);
+	r->ready = TRUE;
+	g_cond_broadcast(&r->cond);
+	while (!r->go && !r->abort)
+		g_cond_wait(&r->cond, &r->mutex);
+	g_mutex_unlock(&r->mutex);
+
+	if (!runner_aborted(r)) {
+		ret = sr_input_end(r->in);
+		if (r->status == SR_OK)
+			r->status = ret;
+	}
+	runner_state_set(r, &r->done);
+
+	return NULL;
+}
+
+/**
+ * Send the contents of a file to an input instance in the background.
+ *
+ * Reading, parsing and delivering the data each run in a thread of its
+ * own, with bounded queues in between, so that file conversions use the
+ * disk, the input module and the datafeed callbacks (e.g. output modules)
+ * at the same time:
+ *
+ * - An I/O thread reads the file ahead, up to @a depth chunks.
+ * - A parser thread passes the chunks to the input module.
+ * - The session's datafeed delivery thread passes the packets to the
+ *   callbacks, see sr_session_datafeed_queue_set(). Callbacks must be
+ *   thread-safe therefore.
+ *
+ * Like with sr_input_send(), the caller gets the chance to examine the
+ * device instance before sample data flows:
+ *
+ * @code
+ * sr_input_runner_new(in, filename, 0, &runner);
+ * sr_input_runner_wait_ready(runner);
+ * sdi = sr_input_dev_inst_get(in);
+ * sr_session_dev_add(session, sdi);
+ * ...
+ * sr_input_runner_run(runner);
+ * sr_input_runner_free(runner);
+ * @endcode
+ *
+ * The input instance must not be used otherwise until the runner got
+ * freed.
+ *
+ * @param in The input instance. Must not be NULL.
+ * @param filename The name of the file. Must not be NULL.
+ * @param depth Number of chunks to read ahead, and of packets to queue
+ *              for delivery, 0 for a default.
+ * @param runner Will contain the runner. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR The file cannot be opened, or a thread cannot start.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_input_runner_new(const struct sr_input *in,
+		const char *filename, size_t depth,
+		struct sr_input_runner **runner)
+{
+	struct sr_input_runner *r;
+	size_t i;
+
+	if (!in || !in->module || !filename || !runner)
+		return SR_ERR_ARG;
+	*runner = NULL;
+
+	r = g_malloc0(sizeof(*r));
+	r->in = (struct sr_input *)in;	/* "un-const" */
+	r->depth = depth ? depth : RUNNER_DEFAULT_DEPTH;
+	r->stream = g_fopen(filename, "rb");
+	if (!r->stream) {
+		sr_err("Failed to open %s: %s", filename, g_strerror(errno));
+		g_free(r);
+		return SR_ERR;
+	}
+	r->free_chunks = g_async_queue_new();
+	r->full_chunks = g_async_queue_new();
+	g_mutex_init(&r->mutex);
+	g_cond_init(&r->cond);
+	/* One more than the read ahead, for the one being parsed. */
+	for (i = 0; i <= r->depth; i++)
+		g_async_queue_push(r->free_chunks, g_string_sized_new(CHUNK_SIZE));
+	r->status = SR_OK;
+	r->io_status = SR_OK;
+
+	r->io_thread = g_thread_try_new("sr-input-io", runner_io_thread,
+		r, NULL);
+	if (r->io_thread)
+		r->parse_thread = g_thread_try_new("sr-input-parse",
+			runner_parse_thread, r, NULL);
+	if (!r->parse_thread) {
+		sr_err("Cannot create input runner threads.");
+		sr_input_runner_free(r);
+		return SR_ERR;
+	}
+
+	*runner = r;
+
+	return SR_OK;
+}
+
+/**
+ * Wait until the device instance of the runner's input instance is
+ * ready, see sr_input_dev_inst_get().
+ *
+ * This also returns when the data ended or failed before, then the
+ * device instance may not be ready.
+ *
+ * @param runner The runner. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval other Error code from reading, or from the input module.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_input_runner_wait_ready(struct sr_input_runner *runner)
+{
+	int ret;
+
+	if (!runner)
+		return SR_ERR_ARG;
+
+	g_mutex_lock(&runner->mutex);
+	while (!runner->ready)
+		g_cond_wait(&runner->cond, &runner->mutex);
+	ret = runner->status;
+	g_mutex_unlock(&runner->mutex);
+
+	return ret;
+}
+
+/**
+ * Let the runner send the rest of the file, and wait until it is done.
+ *
+ * The input module's end() routine runs once the data ended, and all
+ * packets are delivered to the datafeed callbacks when this returns.
+ * While the device instance's session is not running, a datafeed
+ * delivery thread gets started for the time of the run.
+ *
+ * @param runner The runner. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval other Error code from reading, or from the input module.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_input_runner_run(struct sr_input_runner *runner)
+{
+	struct sr_session *session;
+	int ret;
+
+	if (!runner || !runner->parse_thread)
+		return SR_ERR_ARG;
+
+	sr_input_runner_wait_ready(runner);
+
+	session = runner->in->sdi ? runner->in->sdi->session : NULL;
+	if (session && !session->running && !session->df_queue &&
+			sr_session_datafeed_thread_start(session,
+			runner->depth) == SR_OK)
+		runner->delivery = session;
+
+	g_mutex_lock(&runner->mutex);
+	runner->go = TRUE;
+	g_cond_broadcast(&runner->cond);
+	while (!runner->done)
+		g_cond_wait(&runner->cond, &runner->mutex);
+	ret = runner->status;
+	g_mutex_unlock(&runner->mutex);
+
+	g_thread_join(runner->parse_thread);
+	g_thread_join(runner->io_thread);
+	runner->parse_thread = runner->io_thread = NULL;
+
+	sr_session_datafeed_thread_stop(runner->delivery);
+	runner->delivery = NULL;
+
+	return ret;
+}
+
+/**
+ * Free a runner. When sr_input_runner_run() was not called, the rest
+ * of the file gets discarded, and the input module's end() routine
+ * does not run.
+ *
+ * @param runner The runner. NULL is accepted.
+ *
+ * @since 0.6.0
+ */
+SR_API void sr_input_runner_free(struct sr_input_runner *runner)
+{
+	GString *chunk;
+
+	if (!runner)
+		return;
+
+	runner_state_set(runner, &runner->abort);
+	if (runner->parse_thread)
+		g_thread_join(runner->parse_thread);
+	else if (runner->io_thread) {
+		/* No parser, take the chunks until the reader is done. */
+		while ((chunk = g_async_queue_pop(runner->full_chunks))->len)
+			g_async_queue_push(runner->free_chunks, chunk);
+		g_async_queue_push(runner->free_chunks, chunk);
+	}
+	if (runner->io_thread)
+		g_thread_join(runner->io_thread);
+
+	while ((chunk = g_async_queue_try_pop(runner->free_chunks)))
+		g_string_free(chunk, TRUE);
+	while ((chunk = g_async_queue_try_pop(runner->full_chunks)))
+		g_string_free(chunk, TRUE);
+	g_async_queue_unref(runner->free_chunks);
+	g_async_queue_unref(runner->full_chunks);
+	g_mutex_clear(&runner->mutex);
+	g_cond_clear(&runner->cond);
+	fclose(runner->stream);
+	g_free(runner);
+}
+
 /** @} */
@@ -130,10 +130,9 @@ struct context {
 	uint64_t wires_grouped;
 	GSList *signal_groups;
 	GSList *channels;
+	size_t header_scanned;
 	size_t unitsize;
-	size_t samples_per_chunk;
-	size_t samples_in_buffer;
-	uint8_t *feed_buffer;
+	struct feed_queue_logic *feed_logic;
 };
 
 static struct signal_group_desc *alloc_signal_group(const char *name)
@@ -658,14 +657,13 @@ static int process_keyvalue_line(struct context *inc, char *line)
 	return SR_OK;
 }
 
-/* Check for, and isolate another line of text input. */
-static int have_text_line(struct sr_input *in, char **line, char **next)
+/* Check for, and isolate another line of text input at sol_ptr. */
+static int have_text_line(char *sol_ptr, char **line, char **next)
 {
-	char *sol_ptr, *eol_ptr;
+	char *eol_ptr;
 
-	if (!in || !in->buf || !in->buf->str)
+	if (!sol_ptr)
 		return 0;
-	sol_ptr = in->buf->str;
 	eol_ptr = strstr(sol_ptr, CRLF);
 	if (!eol_ptr)
 		return 0;
@@ -738,12 +736,24 @@ static int process_text_line(struct context *inc, char *line)
 	return rc;
 }
 
-/* Tell whether received data is sufficient for session feed preparation. */
-static int have_header(GString *buf)
+/*
+ * Tell whether received data is sufficient for session feed preparation.
+ * Only the text which was received since the last call gets searched
+ * (plus what a key which spans chunks needs), the header is huge.
+ */
+static int have_header(struct context *inc, GString *buf)
 {
 	const char *assumed_last_key = CRLF LAST_KEYWORD CONT_OPEN;
+	size_t start;
+
+	start = inc->header_scanned;
+	if (start > strlen(assumed_last_key))
+		start -= strlen(assumed_last_key);
+	else
+		start = 0;
+	inc->header_scanned = buf->len;
 
-	if (strstr(buf->str, assumed_last_key))
+	if (strstr(&buf->str[start], assumed_last_key))
 		return TRUE;
 
 	return FALSE;
@@ -756,15 +766,18 @@ static int parse_header(struct sr_input *in)
 	char *line, *next;
 	int rc;
 
+	/* Walk the lines in place, drop them all at once. */
 	inc = in->priv;
-	while (have_text_line(in, &line, &next)) {
+	rc = SR_OK;
+	next = in->buf->str;
+	while (have_text_line(next, &line, &next)) {
 		rc = process_text_line(inc, line);
-		g_string_erase(in->buf, 0, next - line);
 		if (rc)
-			return rc;
+			break;
 	}
+	g_string_erase(in->buf, 0, next - in->buf->str);
 
-	return SR_OK;
+	return rc;
 }
 
 /* Create sigrok channels and groups. */
@@ -828,26 +841,21 @@ static int create_feed_buffer(struct sr_input *in)
 	inc = in->priv;
 
 	inc->unitsize = (inc->channel_count + 7) / 8;
-	inc->samples_per_chunk = CHUNK_SIZE / inc->unitsize;
-	inc->samples_in_buffer = 0;
-	inc->feed_buffer = g_malloc0(inc->samples_per_chunk * inc->unitsize);
-	if (!inc->feed_buffer)
+	inc->feed_logic = feed_queue_logic_alloc(in->sdi,
+		CHUNK_SIZE / inc->unitsize, inc->unitsize);
+	if (!inc->feed_logic)
 		return SR_ERR_MALLOC;
 
 	return SR_OK;
 }
 
-/* Send all accumulated sample data values to the session. */
-static int send_buffer(struct sr_input *in)
+/* Send the initial packets before the first sample data. */
+static int start_feed(struct sr_input *in)
 {
 	struct context *inc;
-	struct sr_datafeed_packet packet;
-	struct sr_datafeed_logic logic;
 	int rc;
 
 	inc = in->priv;
-	if (!inc->samples_in_buffer)
-		return SR_OK;
 
 	if (!inc->header_sent) {
 		rc = std_session_send_df_header(in->sdi);
@@ -864,60 +872,26 @@ static int send_buffer(struct sr_input *in)
 		inc->rate_sent = TRUE;
 	}
 
-	packet.type = SR_DF_LOGIC;
-	packet.payload = &logic;
-	logic.unitsize = inc->unitsize;
-	logic.data = inc->feed_buffer;
-	logic.length = inc->unitsize * inc->samples_in_buffer;
-	rc = sr_session_send(in->sdi, &packet);
-
-	inc->samples_in_buffer = 0;
-
-	if (rc)
-		return rc;
-
 	return SR_OK;
 }
 
 /*
- * Add N copies of the current sample to the buffer. Send the buffer to
- * the session feed when a maximum amount of data was collected.
+ * Add N copies of the current sample to the session feed. The feed
+ * queue fills the copies in bulk, and sends full chunks.
  */
 static int add_samples(struct sr_input *in, uint64_t samples, size_t count)
 {
 	struct context *inc;
 	uint8_t sample_buffer[sizeof(uint64_t)];
 	size_t idx;
-	size_t copy_count;
-	uint8_t *p;
-	int rc;
 
 	inc = in->priv;
 	for (idx = 0; idx < inc->unitsize; idx++) {
 		sample_buffer[idx] = samples & 0xff;
 		samples >>= 8;
 	}
-	while (count) {
-		copy_count = inc->samples_per_chunk - inc->samples_in_buffer;
-		if (copy_count > count)
-			copy_count = count;
-		count -= copy_count;
-
-		p = inc->feed_buffer + inc->samples_in_buffer * inc->unitsize;
-		while (copy_count-- > 0) {
-			memcpy(p, sample_buffer, inc->unitsize);
-			p += inc->unitsize;
-			inc->samples_in_buffer++;
-		}
-
-		if (inc->samples_in_buffer == inc->samples_per_chunk) {
-			rc = send_buffer(in);
-			if (rc)
-				return rc;
-		}
-	}
 
-	return SR_OK;
+	return feed_queue_logic_submit(inc->feed_logic, sample_buffer, count);
 }
 
 /* Pass on previously received samples to the session. */
@@ -929,6 +903,11 @@ static int process_queued_samples(struct sr_input *in)
 	int rc;
 
 	inc = in->priv;
+	if (inc->sample_lines_fed < inc->sample_lines_total) {
+		rc = start_feed(in);
+		if (rc)
+			return rc;
+	}
 	while (inc->sample_lines_fed < inc->sample_lines_total) {
 		entry = &inc->sample_data_queue[inc->sample_lines_fed++];
 		sample_bits = entry->bits;
@@ -1076,7 +1055,7 @@ static int receive(struct sr_input *in, GString *buf)
 	 */
 	inc = in->priv;
 	if (!inc->got_header) {
-		if (!have_header(in->buf))
+		if (!have_header(inc, in->buf))
 			return SR_OK;
 		rc = parse_header(in);
 		if (rc)
@@ -1110,12 +1089,12 @@ static int end(struct sr_input *in)
 	rc = process_queued_samples(in);
 	if (rc)
 		return rc;
-	rc = send_buffer(in);
+	inc = in->priv;
+	rc = feed_queue_logic_flush(inc->feed_logic);
 	if (rc)
 		return rc;
 
 	/* End the session feed if one was started. */
-	inc = in->priv;
 	if (inc->header_sent) {
 		rc = std_session_send_df_end(in->sdi);
 		inc->header_sent = FALSE;
@@ -1150,7 +1129,7 @@ static void cleanup(struct sr_input *in)
 		g_free(inc->signal_names[idx]);
 	g_slist_free_full(inc->signal_groups, sg_free);
 	g_slist_free_full(inc->channels, g_free);
-	g_free(inc->feed_buffer);
+	feed_queue_logic_free(inc->feed_logic);
 	memset(inc, 0, sizeof(*inc));
 }
 
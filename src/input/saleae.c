@@ -38,6 +38,9 @@
  * reject such input specs. Merging multiple exported channels into either
  * another input file or a sigrok session is supposed to be done outside
  * of this input module. Support for ZIP archives is currently missing.
+ * As an exception, the "channel_files" option names further Logic 2
+ * digital exports, which get parsed in parallel and merged with the
+ * input file into multi-channel samples.
  *
  * TODO
  * - Need to create a channel group in addition to channels?
@@ -111,6 +114,22 @@ enum input_stage {
 	STAGE_L2A_EVERY_VALUE,
 };
 
+/*
+ * The transitions of one Logic 2 digital channel, as the sample numbers
+ * at which its level toggles. Worker threads fill these in for channel
+ * files, while receive() does for the input file (with no filename).
+ */
+struct merge_channel {
+	const char *filename;
+	double start_time;
+	double sample_period;
+	gboolean init_state;
+	GArray *toggles;
+	size_t next;
+	int rc;
+	GThread *thread;
+};
+
 struct context {
 	struct context_options {
 		enum logic_format format;
@@ -118,6 +137,7 @@ struct context {
 		size_t word_size;
 		size_t channel_count;
 		uint64_t sample_rate;
+		char **channel_files;
 	} options;
 	struct {
 		gboolean got_header;
@@ -168,6 +188,11 @@ struct context {
 			float analog;
 		} last;
 	} feed;
+	struct {
+		size_t count;
+		struct merge_channel *channels;
+		uint64_t sample_pos;
+	} merge;
 };
 
 static const char *format_texts[] = {
@@ -671,6 +696,241 @@ static int parse_header(struct sr_input *in)
 	return SR_OK;
 }
 
+/* Convert the time between two transitions to a number of samples. */
+static uint64_t time_to_samples(double diff_time, double sample_period)
+{
+	diff_time /= sample_period;
+	diff_time += 0.5;
+	return (uint64_t)diff_time;
+}
+
+/*
+ * Get the transitions from a Logic 2 digital export file. Runs in a
+ * worker thread, and must not touch the input instance.
+ */
+static gpointer parse_channel_file(gpointer data)
+{
+	struct merge_channel *ch;
+	GMappedFile *file;
+	GError *error;
+	const uint8_t *read_pos;
+	size_t read_len, want_len;
+	uint64_t count, idx, sample_pos;
+	double begin_time, last_time, next_time;
+
+	ch = data;
+	error = NULL;
+	file = g_mapped_file_new(ch->filename, FALSE, &error);
+	if (!file) {
+		sr_err("Cannot open channel file '%s': %s.",
+			ch->filename, error->message);
+		g_error_free(error);
+		ch->rc = SR_ERR_IO;
+		return NULL;
+	}
+	read_pos = (const uint8_t *)g_mapped_file_get_contents(file);
+	read_len = g_mapped_file_get_length(file);
+
+	/* Same header layout as in parse_header(). */
+	want_len = sizeof(uint64_t) + 3 * sizeof(uint32_t);
+	want_len += 2 * sizeof(double) + sizeof(uint64_t);
+	if (read_len < want_len ||
+			check_format(read_pos, read_len) != FMT_LOGIC2_DIGITAL) {
+		sr_err("Channel file '%s' is no Logic 2 digital export.",
+			ch->filename);
+		g_mapped_file_unref(file);
+		ch->rc = SR_ERR_DATA;
+		return NULL;
+	}
+	(void)read_u64le_inc(&read_pos);
+	(void)read_u32le_inc(&read_pos);
+	(void)read_u32le_inc(&read_pos);
+	ch->init_state = read_u32le_inc(&read_pos) ? TRUE : FALSE;
+	begin_time = read_dblle_inc(&read_pos);
+	(void)read_dblle_inc(&read_pos);
+	count = read_u64le_inc(&read_pos);
+	read_len -= want_len;
+	if (count > read_len / sizeof(double)) {
+		sr_warn("Channel file '%s' lacks %" PRIu64 " transitions.",
+			ch->filename, count - read_len / sizeof(double));
+		count = read_len / sizeof(double);
+	}
+
+	/* Count samples like the input file's channel does. */
+	sample_pos = 0;
+	if (begin_time > ch->start_time)
+		sample_pos = time_to_samples(begin_time - ch->start_time,
+			ch->sample_period);
+	last_time = begin_time;
+	g_array_set_size(ch->toggles, count);
+	for (idx = 0; idx < count; idx++) {
+		next_time = read_dblle_inc(&read_pos);
+		sample_pos += time_to_samples(next_time - last_time,
+			ch->sample_period);
+		g_array_index(ch->toggles, uint64_t, idx) = sample_pos;
+		last_time = next_time;
+	}
+	g_mapped_file_unref(file);
+	sr_dbg("Channel file '%s', %" PRIu64 " transitions.",
+		ch->filename, count);
+
+	ch->rc = SR_OK;
+	return NULL;
+}
+
+/* Start parsing the channel files, after the input file's header. */
+static int start_channel_files(struct sr_input *in)
+{
+	struct context *inc;
+	struct merge_channel *ch;
+	size_t count, idx;
+
+	inc = in->priv;
+	if (!inc->options.channel_files)
+		return SR_OK;
+	if (inc->logic_state.format != FMT_LOGIC2_DIGITAL) {
+		sr_err("Channel files need a Logic 2 digital input file.");
+		return SR_ERR_DATA;
+	}
+
+	count = 1 + g_strv_length(inc->options.channel_files);
+	inc->merge.count = count;
+	inc->merge.channels = g_malloc0(count * sizeof(inc->merge.channels[0]));
+	inc->merge.sample_pos = 0;
+	for (idx = 0; idx < count; idx++) {
+		ch = &inc->merge.channels[idx];
+		ch->toggles = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+		ch->start_time = inc->logic_state.l2d.begin_time;
+		ch->sample_period = inc->logic_state.l2d.sample_period;
+	}
+	inc->merge.channels[0].init_state = inc->logic_state.l2d.init_state != 0;
+	inc->logic_state.channel_count = count;
+
+	/* The input file's channel gets parsed as it arrives. */
+	for (idx = 1; idx < count; idx++) {
+		ch = &inc->merge.channels[idx];
+		ch->filename = inc->options.channel_files[idx - 1];
+		ch->thread = g_thread_try_new("sr-saleae-parse",
+			parse_channel_file, ch, NULL);
+		if (!ch->thread)
+			parse_channel_file(ch);
+	}
+
+	return SR_OK;
+}
+
+/* Wait for the channel files' workers. */
+static int join_channel_files(struct sr_input *in)
+{
+	struct context *inc;
+	struct merge_channel *ch;
+	size_t idx;
+	int rc;
+
+	inc = in->priv;
+	rc = SR_OK;
+	for (idx = 1; idx < inc->merge.count; idx++) {
+		ch = &inc->merge.channels[idx];
+		if (ch->thread) {
+			g_thread_join(ch->thread);
+			ch->thread = NULL;
+		}
+		if (ch->rc && !rc)
+			rc = ch->rc;
+	}
+
+	return rc;
+}
+
+/* Move the heap's first channel down to where its next toggle belongs. */
+static void merge_sift_down(const struct merge_channel *channels,
+	size_t *heap, size_t len)
+{
+	size_t pos, child, tmp;
+	uint64_t key, child_key;
+
+	pos = 0;
+	key = g_array_index(channels[heap[0]].toggles, uint64_t,
+		channels[heap[0]].next);
+	while ((child = 2 * pos + 1) < len) {
+		child_key = g_array_index(channels[heap[child]].toggles,
+			uint64_t, channels[heap[child]].next);
+		if (child + 1 < len && g_array_index(
+				channels[heap[child + 1]].toggles, uint64_t,
+				channels[heap[child + 1]].next) < child_key) {
+			child++;
+			child_key = g_array_index(channels[heap[child]].toggles,
+				uint64_t, channels[heap[child]].next);
+		}
+		if (key <= child_key)
+			break;
+		tmp = heap[pos];
+		heap[pos] = heap[child];
+		heap[child] = tmp;
+		pos = child;
+	}
+}
+
+/*
+ * Merge the channels' transitions into samples. A min-heap of channels,
+ * ordered by their next toggle, yields the toggles of all channels in
+ * sample order. The samples end at the last transition of any channel,
+ * like they do for a single channel.
+ */
+static int merge_channels(struct sr_input *in)
+{
+	struct context *inc;
+	struct merge_channel *channels, *ch;
+	size_t *heap, len, idx;
+	uint64_t value, pos, next;
+	int rc;
+
+	inc = in->priv;
+	channels = inc->merge.channels;
+	heap = g_malloc(inc->merge.count * sizeof(heap[0]));
+
+	value = 0;
+	len = 0;
+	for (idx = 0; idx < inc->merge.count; idx++) {
+		ch = &channels[idx];
+		if (ch->init_state)
+			value |= UINT64_C(1) << idx;
+		if (!ch->toggles->len)
+			continue;
+		/* Sift up. */
+		heap[len] = idx;
+		for (pos = len++; pos; pos = (pos - 1) / 2) {
+			next = (pos - 1) / 2;
+			if (g_array_index(channels[heap[next]].toggles, uint64_t, 0)
+					<= g_array_index(ch->toggles, uint64_t, 0))
+				break;
+			heap[pos] = heap[next];
+			heap[next] = idx;
+		}
+	}
+
+	rc = SR_OK;
+	pos = 0;
+	while (len) {
+		ch = &channels[heap[0]];
+		next = g_array_index(ch->toggles, uint64_t, ch->next);
+		if (next > pos) {
+			rc = addto_feed_buffer_logic(in, value, next - pos);
+			if (rc)
+				break;
+			pos = next;
+		}
+		value ^= UINT64_C(1) << heap[0];
+		if (++ch->next == ch->toggles->len)
+			heap[0] = heap[--len];
+		if (len)
+			merge_sift_down(channels, heap, len);
+	}
+	g_free(heap);
+
+	return rc;
+}
+
 /* Check availablity of the next sample data item. */
 static gboolean have_next_item(struct sr_input *in,
 	const uint8_t *buff, size_t blen,
@@ -810,13 +1070,19 @@ static int parse_next_item(struct sr_input *in,
 		diff_time = next_time - inc->feed.last.time;
 		if (inc->logic_state.l2d.min_time_step > diff_time)
 			inc->logic_state.l2d.min_time_step = diff_time;
-		diff_time /= inc->logic_state.l2d.sample_period;
-		diff_time += 0.5;
-		count = (uint64_t)diff_time;
-		digital = inc->feed.last.digital;
-		rc = addto_feed_buffer_logic(in, digital, count);
-		if (rc)
-			return rc;
+		count = time_to_samples(diff_time,
+			inc->logic_state.l2d.sample_period);
+		if (inc->merge.count) {
+			/* Keep the transition, samples get sent by end(). */
+			inc->merge.sample_pos += count;
+			g_array_append_val(inc->merge.channels[0].toggles,
+				inc->merge.sample_pos);
+		} else {
+			digital = inc->feed.last.digital;
+			rc = addto_feed_buffer_logic(in, digital, count);
+			if (rc)
+				return rc;
+		}
 		inc->feed.last.time = next_time;
 		inc->feed.last.digital = 1 - inc->feed.last.digital;
 		return SR_OK;
@@ -932,7 +1198,8 @@ static int format_match(GHashTable *metadata, unsigned int *confidence)
 static int init(struct sr_input *in, GHashTable *options)
 {
 	struct context *inc;
-	const char *type, *fmt_text;
+	const char *type, *fmt_text, *files;
+	char **file_list;
 	enum logic_format format, fmt_idx;
 	gboolean changed;
 	size_t size, count;
@@ -949,6 +1216,7 @@ static int init(struct sr_input *in, GHashTable *options)
 	size = g_variant_get_uint32(g_hash_table_lookup(options, "wordsize"));
 	count = g_variant_get_uint32(g_hash_table_lookup(options, "logic_channels"));
 	rate = g_variant_get_uint64(g_hash_table_lookup(options, "samplerate"));
+	files = g_variant_get_string(g_hash_table_lookup(options, "channel_files"), NULL);
 	sr_dbg("Caller options: type '%s', changed %d, wordsize %zu, channels %zu, rate %" PRIu64 ".",
 		type, changed ? 1 : 0, size, count, rate);
 
@@ -971,6 +1239,16 @@ static int init(struct sr_input *in, GHashTable *options)
 		sr_err("Need a word size.");
 		return SR_ERR_ARG;
 	}
+	file_list = NULL;
+	if (files && *files) {
+		file_list = g_strsplit(files, G_SEARCHPATH_SEPARATOR_S, 0);
+		/* One bit per channel in the merged samples. */
+		if (g_strv_length(file_list) >= 8 * sizeof(inc->feed.last.digital)) {
+			sr_err("Too many channel files.");
+			g_strfreev(file_list);
+			return SR_ERR_ARG;
+		}
+	}
 
 	/*
 	 * Keep input specs around. We never get back to .init() even
@@ -981,6 +1259,7 @@ static int init(struct sr_input *in, GHashTable *options)
 	inc->options.word_size = size;
 	inc->options.channel_count = count;
 	inc->options.sample_rate = rate;
+	inc->options.channel_files = file_list;
 	sr_dbg("Resulting options: type '%s', changed %d",
 		get_format_text(format), changed ? 1 : 0);
 
@@ -1013,6 +1292,9 @@ static int receive(struct sr_input *in, GString *buf)
 		inc->module_state.got_header = TRUE;
 		text = get_format_text(inc->logic_state.format) ? : "<unknown>";
 		sr_info("Using file format: '%s'.", text);
+		rc = start_channel_files(in);
+		if (rc)
+			return rc;
 		rc = create_channels(in);
 		if (rc)
 			return rc;
@@ -1035,6 +1317,7 @@ static int end(struct sr_input *in)
 	/* Nothing to do here if we never started feeding the session. */
 	if (!in->sdi_ready)
 		return SR_OK;
+	inc = in->priv;
 
 	/*
 	 * Process input data which may not have been inspected before.
@@ -1043,12 +1326,19 @@ static int end(struct sr_input *in)
 	rc = parse_samples(in);
 	if (rc)
 		return rc;
+	if (inc->merge.count) {
+		rc = join_channel_files(in);
+		if (rc)
+			return rc;
+		rc = merge_channels(in);
+		if (rc)
+			return rc;
+	}
 	rc = flush_feed_buffer(in);
 	if (rc)
 		return rc;
 
 	/* End the session feed if one was started. */
-	inc = in->priv;
 	if (inc->module_state.header_sent) {
 		rc = std_session_send_df_end(in->sdi);
 		if (rc)
@@ -1063,7 +1353,26 @@ static int end(struct sr_input *in)
 	return SR_OK;
 }
 
-static void cleanup(struct sr_input *in)
+static void relse_merge_channels(struct sr_input *in)
+{
+	struct context *inc;
+	struct merge_channel *ch;
+	size_t idx;
+
+	inc = in->priv;
+	for (idx = 0; idx < inc->merge.count; idx++) {
+		ch = &inc->merge.channels[idx];
+		if (ch->thread)
+			g_thread_join(ch->thread);
+		g_array_free(ch->toggles, TRUE);
+	}
+	g_free(inc->merge.channels);
+	inc->merge.channels = NULL;
+	inc->merge.count = 0;
+}
+
+/* Release the input's state, but keep what .init() has provided. */
+static void relse_state(struct sr_input *in)
 {
 	struct context *inc;
 	struct context_options save_opts;
@@ -1081,6 +1390,7 @@ static void cleanup(struct sr_input *in)
 
 	/* Release dynamically allocated resources. */
 	relse_feed_buffer(in);
+	relse_merge_channels(in);
 
 	/* Clear internal state, but keep what .init() has provided. */
 	save_opts = inc->options;
@@ -1088,6 +1398,18 @@ static void cleanup(struct sr_input *in)
 	inc->options = save_opts;
 }
 
+static void cleanup(struct sr_input *in)
+{
+	struct context *inc;
+
+	relse_state(in);
+	if (!in || !in->priv)
+		return;
+	inc = in->priv;
+	g_strfreev(inc->options.channel_files);
+	inc->options.channel_files = NULL;
+}
+
 static int reset(struct sr_input *in)
 {
 	struct context *inc;
@@ -1102,7 +1424,7 @@ static int reset(struct sr_input *in)
 	 * routine also keeps the user specified option values, the module
 	 * will derive internal state again when the input gets re-read.
 	 */
-	cleanup(in);
+	relse_state(in);
 	in->sdi->channels = inc->module_state.prev_channels;
 
 	inc->module_state.got_header = FALSE;
@@ -1119,6 +1441,7 @@ enum option_index {
 	OPT_WORD_SIZE,
 	OPT_NUM_LOGIC,
 	OPT_SAMPLERATE,
+	OPT_CHANNEL_FILES,
 	OPT_MAX,
 };
 
@@ -1148,6 +1471,12 @@ static struct sr_option options[] = {
 		"The samplerate. Needed when the file content lacks this information.",
 		NULL, NULL,
 	},
+	[OPT_CHANNEL_FILES] = {
+		"channel_files", "Channel files.",
+		"Further Logic 2 digital export files, one per channel, separated "
+		"like directories in PATH. They get merged with the input file.",
+		NULL, NULL,
+	},
 	[OPT_MAX] = ALL_ZERO,
 };
 
@@ -1181,6 +1510,7 @@ static const struct sr_option *get_options(void)
 	options[OPT_WORD_SIZE].values = l;
 	options[OPT_NUM_LOGIC].def = g_variant_ref_sink(g_variant_new_uint32(0));
 	options[OPT_SAMPLERATE].def = g_variant_ref_sink(g_variant_new_uint64(0));
+	options[OPT_CHANNEL_FILES].def = g_variant_ref_sink(g_variant_new_string(""));
 
 	return options;
 }
@@ -100,7 +100,8 @@ struct context {
 	int32_t last_record;
 	uint64_t samplerate;
 	double timestamp_scale;
-	GString *out_buf;
+	size_t unitsize;
+	struct feed_queue_logic *feed_logic;
 };
 
 static int process_header(GString *buf, struct context *inc);
@@ -182,7 +183,13 @@ static int init(struct sr_input *in, GHashTable *options)
 		return SR_ERR;
 	}
 
-	inc->out_buf = g_string_sized_new(CHUNK_SIZE);
+	inc->unitsize = (g_slist_length(in->sdi->channels) + 7) / 8;
+	inc->feed_logic = feed_queue_logic_alloc(in->sdi,
+		CHUNK_SIZE / inc->unitsize, inc->unitsize);
+	if (!inc->feed_logic) {
+		sr_err("Cannot allocate buffers.");
+		return SR_ERR_MALLOC;
+	}
 
 	return SR_OK;
 }
@@ -415,34 +422,54 @@ static void send_metadata(struct sr_input *in)
 	inc->meta_sent = TRUE;
 }
 
-static void flush_output_buffer(struct sr_input *in)
+/*
+ * Send a record's sample, repeated until the next record's timestamp.
+ * The feed queue fills the repetitions in bulk.
+ */
+static void submit_record(struct sr_input *in, const char *record,
+	uint64_t timestamp, const char *payload)
 {
 	struct context *inc;
-	struct sr_datafeed_packet packet;
-	struct sr_datafeed_logic logic;
+	uint64_t next_timestamp;
+	size_t count;
 
 	inc = in->priv;
 
-	if (inc->out_buf->len) {
-		packet.type = SR_DF_LOGIC;
-		packet.payload = &logic;
-		logic.unitsize = (g_slist_length(in->sdi->channels) + 7) / 8;
-		logic.data = inc->out_buf->str;
-		logic.length = inc->out_buf->len;
-		sr_session_send(in->sdi, &packet);
+	if (timestamp == inc->trigger_timestamp && !inc->trigger_sent) {
+		sr_dbg("Trigger @%lf s, record #%d.",
+			timestamp * TIMESTAMP_RESOLUTION, inc->cur_record);
+		/* Previous samples go before the trigger. */
+		feed_queue_logic_flush(inc->feed_logic);
+		std_session_send_df_trigger(in->sdi);
+		inc->trigger_sent = TRUE;
+	}
+
+	/* Is this the last record in the file? */
+	if (inc->cur_record == inc->record_count - 1) {
+		/* It is, so send the last sample data only once. */
+		count = 1;
+	} else {
+		/* It's not, so fill the time gap by sending lots of data. */
+		next_timestamp = RL64(record + inc->record_size);
+		count = (next_timestamp - timestamp) / inc->timestamp_scale;
 
-		g_string_truncate(inc->out_buf, 0);
+		/* Make sure we send at least one data set. */
+		if (count == 0)
+			count = 1;
 	}
+
+	feed_queue_logic_submit(inc->feed_logic,
+		(const uint8_t *)payload, count);
 }
 
 static void process_record_pi(struct sr_input *in, gsize start)
 {
 	struct context *inc;
-	uint64_t timestamp, next_timestamp;
+	uint64_t timestamp;
 	uint32_t pod_data;
 	char single_payload[12 * 3];
 	GString *buf;
-	int i, pod_count, clk_offset, packet_count, pod;
+	int i, pod_count, clk_offset, pod;
 	int payload_bit, payload_len, value;
 
 	inc = in->priv;
@@ -560,48 +587,19 @@ static void process_record_pi(struct sr_input *in, gsize start)
 	if (payload_bit)
 		payload_len++;
 
-	i = (g_slist_length(in->sdi->channels) + 7) / 8;
-	if (payload_len != i) {
-		sr_err("Payload unit size is %d but should be %d!", payload_len, i);
+	if ((size_t)payload_len != inc->unitsize) {
+		sr_err("Payload unit size is %d but should be %zu!",
+			payload_len, inc->unitsize);
 		return;
 	}
 
-	if (timestamp == inc->trigger_timestamp && !inc->trigger_sent) {
-		sr_dbg("Trigger @%lf s, record #%d.",
-			timestamp * TIMESTAMP_RESOLUTION, inc->cur_record);
-		std_session_send_df_trigger(in->sdi);
-		inc->trigger_sent = TRUE;
-	}
-
-	/* Is this the last record in the file? */
-	if (inc->cur_record == inc->record_count - 1) {
-		/* It is, so send the last sample data only once. */
-		g_string_append_len(inc->out_buf, single_payload, payload_len);
-	} else {
-		/* It's not, so fill the time gap by sending lots of data. */
-		next_timestamp = RL64(buf->str + start + inc->record_size);
-		packet_count = (int)(next_timestamp - timestamp) / inc->timestamp_scale;
-
-		/* Make sure we send at least one data set. */
-		if (packet_count == 0)
-			packet_count = 1;
-
-		for (i = 0; i < packet_count; i++)
-			g_string_append_len(inc->out_buf, single_payload, payload_len);
-	}
-
-	if (inc->out_buf->len >= CHUNK_SIZE)
-		flush_output_buffer(in);
+	submit_record(in, buf->str + start, timestamp, single_payload);
 }
 
 static void process_record_iprobe(struct sr_input *in, gsize start)
 {
-	struct context *inc;
-	uint64_t timestamp, next_timestamp;
+	uint64_t timestamp;
 	char single_payload[3];
-	int i, payload_len, packet_count;
-
-	inc = in->priv;
 
 	/*
 	 * 0x00 u64 timestamp
@@ -613,34 +611,8 @@ static void process_record_iprobe(struct sr_input *in, gsize start)
 	single_payload[0] = R8(in->buf->str + start + 0x08);
 	single_payload[1] = R8(in->buf->str + start + 0x09);
 	single_payload[2] = R8(in->buf->str + start + 0x0A) & 1;
-	payload_len = 3;
-
-	if (timestamp == inc->trigger_timestamp && !inc->trigger_sent) {
-		sr_dbg("Trigger @%lf s, record #%d.",
-			timestamp * TIMESTAMP_RESOLUTION, inc->cur_record);
-		std_session_send_df_trigger(in->sdi);
-		inc->trigger_sent = TRUE;
-	}
-
-	/* Is this the last record in the file? */
-	if (inc->cur_record == inc->record_count - 1) {
-		/* It is, so send the last sample data only once. */
-		g_string_append_len(inc->out_buf, single_payload, payload_len);
-	} else {
-		/* It's not, so fill the time gap by sending lots of data. */
-		next_timestamp = RL64(in->buf->str + start + inc->record_size);
-		packet_count = (int)(next_timestamp - timestamp) / inc->timestamp_scale;
-
-		/* Make sure we send at least one data set. */
-		if (packet_count == 0)
-			packet_count = 1;
-
-		for (i = 0; i < packet_count; i++)
-			g_string_append_len(inc->out_buf, single_payload, payload_len);
-	}
 
-	if (inc->out_buf->len >= CHUNK_SIZE)
-		flush_output_buffer(in);
+	submit_record(in, in->buf->str + start, timestamp, single_payload);
 }
 
 static void process_practice_token(struct sr_input *in, char *cmd_token)
@@ -832,7 +804,7 @@ static int end(struct sr_input *in)
 	else
 		ret = SR_OK;
 
-	flush_output_buffer(in);
+	feed_queue_logic_flush(inc->feed_logic);
 
 	if (inc->meta_sent)
 		std_session_send_df_end(in->sdi);
@@ -855,6 +827,16 @@ static int reset(struct sr_input *in)
 	return SR_OK;
 }
 
+static void cleanup(struct sr_input *in)
+{
+	struct context *inc;
+
+	inc = in->priv;
+
+	feed_queue_logic_free(inc->feed_logic);
+	inc->feed_logic = NULL;
+}
+
 static struct sr_option options[] = {
 	{ "podA", "Import pod A / iprobe",
 		"Create channels and data for pod A / iprobe", NULL, NULL },
@@ -909,4 +891,5 @@ SR_PRIV struct sr_input_module input_trace32_ad = {
 	.receive = receive,
 	.end = end,
 	.reset = reset,
+	.cleanup = cleanup,
 };
@@ -116,6 +116,8 @@ struct context {
 		uint64_t compress;
 		uint64_t skip_starttime;
 		gboolean skip_specified;
+		size_t threads;
+		gboolean runs;
 	} options;
 	gboolean use_skip;
 	gboolean started;
@@ -123,11 +125,12 @@ struct context {
 	uint64_t prev_timestamp;
 	uint64_t samplerate;
 	size_t vcdsignals; /* VCD signals (input) */
-	GSList *ignored_signals;
+	GHashTable *ignored_signals; /* identifiers of skipped signals */
 	gboolean data_after_timestamp;
 	gboolean ignore_end_keyword;
 	gboolean skip_until_end;
 	GSList *channels;
+	GHashTable *signals; /* identifier -> list of vcd_channel */
 	size_t unit_size;
 	size_t logic_count;
 	size_t analog_count;
@@ -630,8 +633,10 @@ static int parse_header_var(struct context *inc, char *contents)
 	if (inc->options.maxchannels && next_size > inc->options.maxchannels) {
 		sr_warn("Skipping '%s%s', exceeds requested channel count %zu.",
 			ref, idx ? idx : "", inc->options.maxchannels);
-		inc->ignored_signals = g_slist_append(inc->ignored_signals,
-			g_strdup(id));
+		if (!inc->ignored_signals)
+			inc->ignored_signals = g_hash_table_new_full(g_str_hash,
+				g_str_equal, g_free, NULL);
+		g_hash_table_add(inc->ignored_signals, g_strdup(id));
 		g_strfreev(parts);
 		return SR_OK;
 	}
@@ -838,6 +843,10 @@ static void create_feeds(const struct sr_input *in)
 	inc->unit_size = (inc->logic_count + 7) / 8;
 	inc->feed_logic = feed_queue_logic_alloc(in->sdi,
 		CHUNK_SIZE / inc->unit_size, inc->unit_size);
+	if (inc->feed_logic && inc->options.runs &&
+			feed_queue_logic_send_runs(inc->feed_logic,
+			CHUNK_SIZE / (inc->unit_size + sizeof(uint64_t))) != SR_OK)
+		sr_warn("Cannot allocate runs, sending samples.");
 
 	/* Create one feed per analog channel. */
 	for (l = inc->channels; l; l = l->next) {
@@ -853,6 +862,33 @@ static void create_feeds(const struct sr_input *in)
 	}
 }
 
+/*
+ * Map VCD identifiers to the list of signals which they reference.
+ * Avoids a linear search and string compares for every value change.
+ * Lists keep the order of the channels list. The table gets read from
+ * several threads in parallel while sample data gets tokenized, and
+ * is not modified after the header was parsed.
+ */
+static void create_signal_table(struct context *inc)
+{
+	GSList *l, *chans;
+	struct vcd_channel *vcd_ch;
+
+	inc->signals = g_hash_table_new_full(g_str_hash, g_str_equal,
+		NULL, (GDestroyNotify)g_slist_free);
+	for (l = inc->channels; l; l = l->next) {
+		vcd_ch = l->data;
+		chans = g_hash_table_lookup(inc->signals, vcd_ch->identifier);
+		if (chans) {
+			/* Appending to a non-empty list keeps its head. */
+			(void)g_slist_append(chans, vcd_ch);
+			continue;
+		}
+		chans = g_slist_append(NULL, vcd_ch);
+		g_hash_table_insert(inc->signals, vcd_ch->identifier, chans);
+	}
+}
+
 /*
  * Keep track of a previously created channel list, in preparation of
  * re-reading the input file. Gets called from reset()/cleanup() paths.
@@ -977,6 +1013,7 @@ done_section:
 	if (!check_header_in_reread(in))
 		return SR_ERR_DATA;
 	create_feeds(in);
+	create_signal_table(inc);
 
 	/*
 	 * Allocate space for text to number conversion, and buffers to
@@ -1046,17 +1083,12 @@ static void add_samples(const struct sr_input *in, size_t count, gboolean flush)
 	}
 }
 
-static gint vcd_compare_id(gconstpointer a, gconstpointer b)
-{
-	return strcmp((const char *)a, (const char *)b);
-}
-
 static gboolean is_ignored(struct context *inc, const char *id)
 {
-	GSList *ignored;
+	if (!inc->ignored_signals)
+		return FALSE;
 
-	ignored = g_slist_find_custom(inc->ignored_signals, id, vcd_compare_id);
-	return ignored != NULL;
+	return g_hash_table_contains(inc->ignored_signals, id);
 }
 
 /*
@@ -1086,11 +1118,13 @@ static float get_int_val(uint8_t *in_bits_data, size_t in_bits_count)
 }
 
 /*
- * Set a logic channel's level depending on the VCD signal's identifier
- * and parsed value. Multi-bit VCD values will affect several sigrok
- * channels. One VCD signal name can translate to several sigrok channels.
+ * Set a logic channel's level depending on parsed value of a VCD signal.
+ * Multi-bit VCD values will affect several sigrok channels. One VCD
+ * signal name can translate to several sigrok channels, the caller has
+ * looked up the list of signals for the value change's identifier.
+ * Returns whether any of the signals was updated.
  */
-static void process_bits(struct context *inc, char *identifier,
+static gboolean apply_bits(struct context *inc, GSList *chans,
 	uint8_t *in_bits_data, size_t in_bits_count)
 {
 	size_t size;
@@ -1106,10 +1140,8 @@ static void process_bits(struct context *inc, char *identifier,
 	size = 0;
 	have_int = FALSE;
 	int_val = 0;
-	for (l = inc->channels; l; l = l->next) {
+	for (l = chans; l; l = l->next) {
 		vcd_ch = l->data;
-		if (g_strcmp0(identifier, vcd_ch->identifier) != 0)
-			continue;
 		if (vcd_ch->type == SR_CHANNEL_ANALOG) {
 			/* Special case for 'integer' VCD signal types. */
 			size = vcd_ch->size; /* Flag for "VCD signal found". */
@@ -1122,9 +1154,9 @@ static void process_bits(struct context *inc, char *identifier,
 		}
 		if (vcd_ch->type != SR_CHANNEL_LOGIC)
 			continue;
-		sr_spew("Processing %s data, id '%s', ch %zu sz %zu",
-			(size == 1) ? "bit" : "vector",
-			identifier, vcd_ch->array_index, vcd_ch->size);
+		sr_spew("Processing %s data, ch %zu sz %zu",
+			(vcd_ch->size == 1) ? "bit" : "vector",
+			vcd_ch->array_index, vcd_ch->size);
 
 		/* Found our (logic) channel. Setup in/out bit positions. */
 		size = vcd_ch->size;
@@ -1165,7 +1197,20 @@ static void process_bits(struct context *inc, char *identifier,
 			}
 		}
 	}
-	if (!size && !is_ignored(inc, identifier))
+
+	return size != 0;
+}
+
+static void process_bits(struct context *inc, char *identifier,
+	uint8_t *in_bits_data, size_t in_bits_count)
+{
+	GSList *chans;
+
+	sr_spew("Processing value change for id '%s'.", identifier);
+	chans = g_hash_table_lookup(inc->signals, identifier);
+	if (apply_bits(inc, chans, in_bits_data, in_bits_count))
+		return;
+	if (!is_ignored(inc, identifier))
 		sr_warn("VCD signal not found for ID '%s'.", identifier);
 }
 
@@ -1173,27 +1218,37 @@ static void process_bits(struct context *inc, char *identifier,
  * Set an analog channel's value from a floating point number. One
  * VCD signal name can translate to several sigrok channels.
  */
-static void process_real(struct context *inc, char *identifier, float real_val)
+static gboolean apply_real(struct context *inc, GSList *chans, float real_val)
 {
 	gboolean found;
 	GSList *l;
 	struct vcd_channel *vcd_ch;
 
 	found = FALSE;
-	for (l = inc->channels; l; l = l->next) {
+	for (l = chans; l; l = l->next) {
 		vcd_ch = l->data;
 		if (vcd_ch->type != SR_CHANNEL_ANALOG)
 			continue;
-		if (g_strcmp0(identifier, vcd_ch->identifier) != 0)
-			continue;
 
 		/* Found our (analog) channel. */
 		found = TRUE;
-		sr_spew("Processing real data, id '%s', ch %zu, val %.16g",
-			identifier, vcd_ch->array_index, real_val);
+		sr_spew("Processing real data, ch %zu, val %.16g",
+			vcd_ch->array_index, real_val);
 		inc->current_floats[vcd_ch->array_index] = real_val;
 	}
-	if (!found && !is_ignored(inc, identifier))
+
+	return found;
+}
+
+static void process_real(struct context *inc, char *identifier, float real_val)
+{
+	GSList *chans;
+
+	sr_spew("Processing real value for id '%s'.", identifier);
+	chans = g_hash_table_lookup(inc->signals, identifier);
+	if (apply_real(inc, chans, real_val))
+		return;
+	if (!is_ignored(inc, identifier))
 		sr_warn("VCD signal not found for ID '%s'.", identifier);
 }
 
@@ -1240,6 +1295,85 @@ static uint8_t vcd_char_to_value(char bit_char, int *warn)
 	return ~0;
 }
 
+/*
+ * Numbers prefixed by '#' are timestamps, which translate to sigrok
+ * sample numbers. Apply optional downsampling, and apply the 'skip'
+ * logic. Check the recent timestamp for plausibility. Submit the
+ * corresponding number of samples of previously accumulated data
+ * values to the session feed.
+ */
+static int process_timestamp(const struct sr_input *in, uint64_t timestamp)
+{
+	struct context *inc;
+	size_t count;
+
+	inc = in->priv;
+
+	sr_spew("Got timestamp: %" PRIu64, timestamp);
+	if (inc->options.downsample > 1) {
+		timestamp /= inc->options.downsample;
+		sr_spew("Downsampled timestamp: %" PRIu64, timestamp);
+	}
+
+	/*
+	 * Skip < 0 => skip until first timestamp.
+	 * Skip = 0 => don't skip
+	 * Skip > 0 => skip until timestamp >= skip.
+	 */
+	if (inc->options.skip_specified && !inc->use_skip) {
+		sr_dbg("Seeding skip from user spec %" PRIu64,
+			inc->options.skip_starttime);
+		inc->prev_timestamp = inc->options.skip_starttime;
+		inc->use_skip = TRUE;
+	}
+	if (!inc->use_skip) {
+		sr_dbg("Seeding skip from first timestamp");
+		inc->options.skip_starttime = timestamp;
+		inc->prev_timestamp = timestamp;
+		inc->use_skip = TRUE;
+		return SR_OK;
+	}
+	if (inc->options.skip_starttime && timestamp < inc->options.skip_starttime) {
+		sr_spew("Timestamp skipped, before user spec");
+		inc->prev_timestamp = inc->options.skip_starttime;
+		return SR_OK;
+	}
+	if (timestamp == inc->prev_timestamp) {
+		/*
+		 * Ignore repeated timestamps (e.g. sigrok
+		 * outputs these). Can also happen when
+		 * downsampling makes distinct input values
+		 * end up at the same scaled down value.
+		 * Also transparently covers the initial
+		 * timestamp.
+		 */
+		sr_spew("Timestamp is identical to previous timestamp");
+		return SR_OK;
+	}
+	if (timestamp < inc->prev_timestamp) {
+		sr_err("Invalid timestamp: %" PRIu64 " (leap backwards).", timestamp);
+		return SR_ERR_DATA;
+	}
+	if (inc->options.compress) {
+		/* Compress long idle periods */
+		count = timestamp - inc->prev_timestamp;
+		if (count > inc->options.compress) {
+			sr_dbg("Long idle period, compressing");
+			count = timestamp - inc->options.compress;
+			inc->prev_timestamp = count;
+		}
+	}
+
+	/* Generate samples from prev_timestamp up to timestamp - 1. */
+	count = timestamp - inc->prev_timestamp;
+	sr_spew("Got a new timestamp, feeding %zu samples", count);
+	add_samples(in, count, FALSE);
+	inc->prev_timestamp = timestamp;
+	inc->data_after_timestamp = FALSE;
+
+	return SR_OK;
+}
+
 /* Parse one text line of the data section. */
 static int parse_textline(const struct sr_input *in, char *lines)
 {
@@ -1251,7 +1385,6 @@ static int parse_textline(const struct sr_input *in, char *lines)
 	gboolean is_timestamp, is_section, is_real, is_multibit, is_singlebit;
 	uint64_t timestamp;
 	char *identifier, *endptr;
-	size_t count;
 
 	inc = in->priv;
 
@@ -1334,14 +1467,7 @@ static int parse_textline(const struct sr_input *in, char *lines)
 			continue;
 		}
 
-		/*
-		 * Numbers prefixed by '#' are timestamps, which translate
-		 * to sigrok sample numbers. Apply optional downsampling,
-		 * and apply the 'skip' logic. Check the recent timestamp
-		 * for plausibility. Submit the corresponding number of
-		 * samples of previously accumulated data values to the
-		 * session feed.
-		 */
+		/* Numbers prefixed by '#' are timestamps. */
 		is_timestamp = curr_first == '#' && g_ascii_isdigit(curr_word[1]);
 		if (is_timestamp) {
 			endptr = NULL;
@@ -1351,68 +1477,9 @@ static int parse_textline(const struct sr_input *in, char *lines)
 				ret = SR_ERR_DATA;
 				break;
 			}
-			sr_spew("Got timestamp: %" PRIu64, timestamp);
-			if (inc->options.downsample > 1) {
-				timestamp /= inc->options.downsample;
-				sr_spew("Downsampled timestamp: %" PRIu64, timestamp);
-			}
-
-			/*
-			 * Skip < 0 => skip until first timestamp.
-			 * Skip = 0 => don't skip
-			 * Skip > 0 => skip until timestamp >= skip.
-			 */
-			if (inc->options.skip_specified && !inc->use_skip) {
-				sr_dbg("Seeding skip from user spec %" PRIu64,
-					inc->options.skip_starttime);
-				inc->prev_timestamp = inc->options.skip_starttime;
-				inc->use_skip = TRUE;
-			}
-			if (!inc->use_skip) {
-				sr_dbg("Seeding skip from first timestamp");
-				inc->options.skip_starttime = timestamp;
-				inc->prev_timestamp = timestamp;
-				inc->use_skip = TRUE;
-				continue;
-			}
-			if (inc->options.skip_starttime && timestamp < inc->options.skip_starttime) {
-				sr_spew("Timestamp skipped, before user spec");
-				inc->prev_timestamp = inc->options.skip_starttime;
-				continue;
-			}
-			if (timestamp == inc->prev_timestamp) {
-				/*
-				 * Ignore repeated timestamps (e.g. sigrok
-				 * outputs these). Can also happen when
-				 * downsampling makes distinct input values
-				 * end up at the same scaled down value.
-				 * Also transparently covers the initial
-				 * timestamp.
-				 */
-				sr_spew("Timestamp is identical to previous timestamp");
-				continue;
-			}
-			if (timestamp < inc->prev_timestamp) {
-				sr_err("Invalid timestamp: %" PRIu64 " (leap backwards).", timestamp);
-				ret = SR_ERR_DATA;
+			ret = process_timestamp(in, timestamp);
+			if (ret != SR_OK)
 				break;
-			}
-			if (inc->options.compress) {
-				/* Compress long idle periods */
-				count = timestamp - inc->prev_timestamp;
-				if (count > inc->options.compress) {
-					sr_dbg("Long idle period, compressing");
-					count = timestamp - inc->options.compress;
-					inc->prev_timestamp = count;
-				}
-			}
-
-			/* Generate samples from prev_timestamp up to timestamp - 1. */
-			count = timestamp - inc->prev_timestamp;
-			sr_spew("Got a new timestamp, feeding %zu samples", count);
-			add_samples(in, count, FALSE);
-			inc->prev_timestamp = timestamp;
-			inc->data_after_timestamp = FALSE;
 			continue;
 		}
 		inc->data_after_timestamp = TRUE;
@@ -1552,7 +1619,7 @@ static int parse_textline(const struct sr_input *in, char *lines)
 				ret = SR_ERR_DATA;
 				break;
 			}
-			if (sr_log_loglevel_get() >= SR_LOG_SPEW) {
+			if (sr_log_enabled(SR_LOG_SPEW)) {
 				bits_val_text = sr_hexdump_new(inc->conv_bits.value,
 					value_ptr - inc->conv_bits.value + 1);
 				sr_spew("Vector value: %s.", bits_val_text->str);
@@ -1608,13 +1675,525 @@ static int parse_textline(const struct sr_input *in, char *lines)
 	return ret;
 }
 
+/*
+ * Process complete text lines in the [start, end) range of the input
+ * buffer. Lines get modified in place. Returns the position after the
+ * last line that was processed in *next.
+ */
+static int process_lines(const struct sr_input *in,
+	char *start, char *end, char **next)
+{
+	int ret;
+	char *rdptr, *endptr, *trimptr;
+	size_t rdlen;
+
+	ret = SR_OK;
+	rdptr = start;
+	while (TRUE) {
+		rdlen = end - rdptr;
+		endptr = g_strstr_len(rdptr, rdlen, "\n");
+		if (!endptr)
+			break;
+		trimptr = endptr;
+		*endptr++ = '\0';
+		while (g_ascii_isspace(*rdptr))
+			rdptr++;
+		while (trimptr > rdptr && g_ascii_isspace(trimptr[-1]))
+			*(--trimptr) = '\0';
+		if (!*rdptr) {
+			rdptr = endptr;
+			continue;
+		}
+		ret = parse_textline(in, rdptr);
+		rdptr = endptr;
+		if (ret != SR_OK)
+			break;
+	}
+	*next = rdptr;
+
+	return ret;
+}
+
+/*
+ * Parallel tokenization of sample data.
+ *
+ * Large input buffers get split into slices at text lines which start
+ * with a timestamp. Worker threads tokenize the slices and decode the
+ * value changes into a list of tokens each, without modifying the input
+ * text nor the context's state. Identifiers get resolved to signals by
+ * means of the (read-only) signal table. The calling thread then applies
+ * the slices' tokens in input order, which keeps the emission of sample
+ * data strictly sequential.
+ *
+ * Workers speculatively assume that their slice does not start within
+ * a section (like $comment ... $end). When that assumption turns out to
+ * be wrong, or a worker finds input that it does not handle (syntax
+ * errors, unusual formatting), the respective text gets processed by
+ * the sequential parser, which also emits the diagnostics for it.
+ */
+#define SLICE_MIN_SIZE (256 * 1024)
+#define SLICE_MAX_COUNT 16
+#define SLICE_TEXT_MAX 64
+#define WINDOW_SIZE (SLICE_MAX_COUNT * SLICE_MIN_SIZE)
+
+enum vcd_token_type {
+	TOKEN_TIMESTAMP,
+	TOKEN_BITS,
+	TOKEN_REAL,
+	TOKEN_IGNORED,
+	TOKEN_UNKNOWN_ID,
+};
+
+struct vcd_token {
+	enum vcd_token_type type;
+	GSList *chans;
+	union {
+		uint64_t timestamp;
+		float real_val;
+		struct {
+			size_t offset;
+			size_t count;
+		} bits;
+		size_t id_offset;
+	} u;
+};
+
+struct parse_slice {
+	struct context *inc;
+	char *start, *end;
+	GArray *tokens;
+	GByteArray *arena;
+	GString *id_text;
+	char *resync;
+	gboolean skip_until_end;
+	gboolean ignore_end_keyword;
+	GThread *thread;
+};
+
+static gboolean slice_next_word(const char **pos, const char *end,
+	const char **word, size_t *len)
+{
+	const char *p;
+
+	p = *pos;
+	while (p < end && g_ascii_isspace(*p))
+		p++;
+	if (p == end)
+		return FALSE;
+	*word = p;
+	while (p < end && !g_ascii_isspace(*p))
+		p++;
+	*len = p - *word;
+	*pos = p;
+
+	return TRUE;
+}
+
+static gboolean slice_word_is(const char *word, size_t len, const char *text)
+{
+	return len == strlen(text) && memcmp(word, text, len) == 0;
+}
+
+/* Append a value change token for an identifier to the slice. */
+static void slice_add_value(struct parse_slice *slice, struct vcd_token *tok,
+	const char *id, size_t id_len)
+{
+	struct context *inc;
+
+	inc = slice->inc;
+
+	g_string_truncate(slice->id_text, 0);
+	g_string_append_len(slice->id_text, id, id_len);
+	tok->chans = g_hash_table_lookup(inc->signals, slice->id_text->str);
+	if (!tok->chans) {
+		if (is_ignored(inc, slice->id_text->str)) {
+			tok->type = TOKEN_IGNORED;
+		} else {
+			tok->type = TOKEN_UNKNOWN_ID;
+			tok->u.id_offset = slice->arena->len;
+			g_byte_array_append(slice->arena,
+				(const guint8 *)id, id_len);
+			g_byte_array_append(slice->arena,
+				(const guint8 *)"", 1);
+		}
+	}
+	g_array_append_val(slice->tokens, *tok);
+}
+
+/*
+ * Tokenize one text line of the slice. Mirrors the word handling of
+ * parse_textline(), and gives up on anything unexpected.
+ */
+static int slice_tokenize_line(struct parse_slice *slice,
+	const char *line, const char *end)
+{
+	struct context *inc;
+	const char *pos, *word, *next;
+	size_t len, next_len, bit_count, sig_count;
+	char first, text[SLICE_TEXT_MAX];
+	struct vcd_token tok;
+	uint64_t timestamp, digit;
+	uint8_t *value_ptr, value_mask, bit_value;
+	const char *bits;
+
+	inc = slice->inc;
+
+	pos = line;
+	while (slice_next_word(&pos, end, &word, &len)) {
+		if (slice->skip_until_end) {
+			if (slice_word_is(word, len, "$end"))
+				slice->skip_until_end = FALSE;
+			continue;
+		}
+		if (slice->ignore_end_keyword && slice_word_is(word, len, "$end")) {
+			slice->ignore_end_keyword = FALSE;
+			continue;
+		}
+
+		first = g_ascii_tolower(word[0]);
+		if (first == '$' && len > 1) {
+			if (slice_word_is(word, len, "$dumpvars") ||
+			    slice_word_is(word, len, "$dumpon") ||
+			    slice_word_is(word, len, "$dumpoff"))
+				slice->ignore_end_keyword = TRUE;
+			else
+				slice->skip_until_end = TRUE;
+			continue;
+		}
+
+		memset(&tok, 0, sizeof(tok));
+		if (first == '#' && len > 1 && g_ascii_isdigit(word[1])) {
+			timestamp = 0;
+			for (bits = &word[1]; bits < &word[len]; bits++) {
+				if (!g_ascii_isdigit(*bits))
+					return SR_ERR_DATA;
+				digit = *bits - '0';
+				if (timestamp > (UINT64_MAX - digit) / 10)
+					return SR_ERR_DATA;
+				timestamp = timestamp * 10 + digit;
+			}
+			tok.type = TOKEN_TIMESTAMP;
+			tok.u.timestamp = timestamp;
+			g_array_append_val(slice->tokens, tok);
+			continue;
+		}
+
+		if (first == 'r' && len > 1) {
+			if (len - 1 >= sizeof(text))
+				return SR_ERR_DATA;
+			if (!slice_next_word(&pos, end, &next, &next_len))
+				return SR_ERR_DATA;
+			memcpy(text, &word[1], len - 1);
+			text[len - 1] = '\0';
+			tok.type = TOKEN_REAL;
+			if (sr_atof_ascii(text, &tok.u.real_val) != SR_OK)
+				return SR_ERR_DATA;
+			slice_add_value(slice, &tok, next, next_len);
+			continue;
+		}
+
+		if (first == 'b' && len > 1) {
+			bit_count = len - 1;
+			if (bit_count > inc->conv_bits.max_bits)
+				return SR_ERR_DATA;
+			if (!slice_next_word(&pos, end, &next, &next_len))
+				return SR_ERR_DATA;
+			tok.type = TOKEN_BITS;
+			tok.u.bits.offset = slice->arena->len;
+			g_byte_array_set_size(slice->arena,
+				slice->arena->len + inc->conv_bits.unit_size);
+			value_ptr = &slice->arena->data[tok.u.bits.offset];
+			memset(value_ptr, 0, inc->conv_bits.unit_size);
+			value_mask = 1 << 0;
+			sig_count = 0;
+			for (bits = &word[len - 1]; bits > word; bits--) {
+				bit_value = vcd_char_to_value(*bits, NULL);
+				if (bit_value == 1)
+					*value_ptr |= value_mask;
+				else if (bit_value != 0)
+					return SR_ERR_DATA;
+				sig_count++;
+				value_mask <<= 1;
+				if (!value_mask) {
+					value_ptr++;
+					value_mask = 1 << 0;
+				}
+			}
+			tok.u.bits.count = sig_count;
+			slice_add_value(slice, &tok, next, next_len);
+			continue;
+		}
+
+		if (first == '0' || first == '1' || first == 'x' || first == 'z') {
+			bit_value = vcd_char_to_value(word[0], NULL);
+			if (bit_value != 0 && bit_value != 1)
+				return SR_ERR_DATA;
+			next = &word[1];
+			next_len = len - 1;
+			if (!next_len && !slice_next_word(&pos, end, &next, &next_len))
+				return SR_ERR_DATA;
+			tok.type = TOKEN_BITS;
+			tok.u.bits.offset = slice->arena->len;
+			tok.u.bits.count = 1;
+			g_byte_array_append(slice->arena, &bit_value, 1);
+			slice_add_value(slice, &tok, next, next_len);
+			continue;
+		}
+
+		return SR_ERR_DATA;
+	}
+
+	return SR_OK;
+}
+
+static gpointer slice_tokenize(gpointer data)
+{
+	struct parse_slice *slice;
+	const char *line, *eol;
+	gboolean skip_until_end, ignore_end_keyword;
+	guint token_count, arena_len;
+
+	slice = data;
+
+	line = slice->start;
+	while (line < slice->end) {
+		eol = memchr(line, '\n', slice->end - line);
+		if (!eol)
+			eol = slice->end;
+
+		/* Keep the state at the start of the line, for resync. */
+		skip_until_end = slice->skip_until_end;
+		ignore_end_keyword = slice->ignore_end_keyword;
+		token_count = slice->tokens->len;
+		arena_len = slice->arena->len;
+		if (slice_tokenize_line(slice, line, eol) != SR_OK) {
+			slice->skip_until_end = skip_until_end;
+			slice->ignore_end_keyword = ignore_end_keyword;
+			g_array_set_size(slice->tokens, token_count);
+			g_byte_array_set_size(slice->arena, arena_len);
+			slice->resync = (char *)line;
+			break;
+		}
+		line = eol + 1;
+	}
+
+	return NULL;
+}
+
+/* Apply a slice's tokens to the context, in input order. */
+static int slice_apply(const struct sr_input *in, struct parse_slice *slice)
+{
+	struct context *inc;
+	struct vcd_token *tok;
+	guint idx;
+	int ret;
+	char *next;
+
+	inc = in->priv;
+
+	for (idx = 0; idx < slice->tokens->len; idx++) {
+		tok = &g_array_index(slice->tokens, struct vcd_token, idx);
+		switch (tok->type) {
+		case TOKEN_TIMESTAMP:
+			ret = process_timestamp(in, tok->u.timestamp);
+			if (ret != SR_OK)
+				return ret;
+			break;
+		case TOKEN_BITS:
+			inc->data_after_timestamp = TRUE;
+			apply_bits(inc, tok->chans,
+				&slice->arena->data[tok->u.bits.offset],
+				tok->u.bits.count);
+			break;
+		case TOKEN_REAL:
+			inc->data_after_timestamp = TRUE;
+			apply_real(inc, tok->chans, tok->u.real_val);
+			break;
+		case TOKEN_IGNORED:
+			inc->data_after_timestamp = TRUE;
+			break;
+		case TOKEN_UNKNOWN_ID:
+			inc->data_after_timestamp = TRUE;
+			sr_warn("VCD signal not found for ID '%s'.",
+				&slice->arena->data[tok->u.id_offset]);
+			break;
+		}
+	}
+	inc->skip_until_end = slice->skip_until_end;
+	inc->ignore_end_keyword = slice->ignore_end_keyword;
+
+	if (!slice->resync)
+		return SR_OK;
+	return process_lines(in, slice->resync, slice->end, &next);
+}
+
+/*
+ * Determine the number of slices for a text range. Returns 0 when the
+ * sequential parser should be used.
+ */
+static size_t slice_count(struct context *inc, size_t len)
+{
+	size_t count;
+
+	if (!inc->signals)
+		return 0;
+	if (sr_log_enabled(SR_LOG_SPEW))
+		return 0;
+
+	count = inc->options.threads;
+	if (!count)
+		count = g_get_num_processors();
+	if (count > SLICE_MAX_COUNT)
+		count = SLICE_MAX_COUNT;
+	if (count > len / SLICE_MIN_SIZE)
+		count = len / SLICE_MIN_SIZE;
+	if (count < 2)
+		return 0;
+
+	return count;
+}
+
+/* Find the start of the next text line which holds a timestamp. */
+static char *slice_boundary(char *pos, char *end)
+{
+	while (pos < end) {
+		pos = memchr(pos, '\n', end - pos);
+		if (!pos)
+			return end;
+		pos++;
+		if (end - pos >= 2 && pos[0] == '#' && g_ascii_isdigit(pos[1]))
+			return pos;
+	}
+
+	return end;
+}
+
+static int process_lines_parallel(const struct sr_input *in,
+	char *start, char *end, size_t count, char **next)
+{
+	struct context *inc;
+	struct parse_slice *slices, *slice;
+	size_t idx, used;
+	char *pos, *line_end, *nominal;
+	int ret;
+
+	inc = in->priv;
+
+	/* Only complete text lines get split into slices. */
+	line_end = end;
+	while (line_end > start && line_end[-1] != '\n')
+		line_end--;
+
+	slices = g_malloc0(count * sizeof(slices[0]));
+	pos = start;
+	for (used = 0; used < count && pos < line_end; used++) {
+		slice = &slices[used];
+		slice->inc = inc;
+		slice->start = pos;
+		if (used + 1 == count) {
+			pos = line_end;
+		} else {
+			nominal = start + (line_end - start) / count * (used + 1);
+			if (nominal < slice->start)
+				nominal = slice->start;
+			pos = slice_boundary(nominal, line_end);
+		}
+		slice->end = pos;
+		slice->tokens = g_array_new(FALSE, FALSE, sizeof(struct vcd_token));
+		slice->arena = g_byte_array_new();
+		slice->id_text = g_string_sized_new(16);
+	}
+
+	/* Tokenize in parallel, the first slice runs in the caller's thread. */
+	for (idx = 1; idx < used; idx++) {
+		slice = &slices[idx];
+		slice->thread = g_thread_try_new("sr-vcd-parse",
+			slice_tokenize, slice, NULL);
+	}
+	slice_tokenize(&slices[0]);
+	for (idx = 1; idx < used; idx++) {
+		slice = &slices[idx];
+		if (slice->thread)
+			g_thread_join(slice->thread);
+		else
+			slice_tokenize(slice);
+	}
+
+	/* Apply the slices in input order. */
+	ret = SR_OK;
+	*next = line_end;
+	for (idx = 0; idx < used; idx++) {
+		slice = &slices[idx];
+		if (inc->skip_until_end || inc->ignore_end_keyword)
+			ret = process_lines(in, slice->start, slice->end, &pos);
+		else
+			ret = slice_apply(in, slice);
+		if (ret != SR_OK) {
+			*next = slice->end;
+			break;
+		}
+	}
+
+	for (idx = 0; idx < used; idx++) {
+		slice = &slices[idx];
+		g_array_free(slice->tokens, TRUE);
+		g_byte_array_free(slice->arena, TRUE);
+		g_string_free(slice->id_text, TRUE);
+	}
+	g_free(slices);
+
+	return ret;
+}
+
+/*
+ * Process complete text lines in the [start, end) range, in windows of
+ * a fixed size. This bounds the parser's memory use (the slices' token
+ * lists) no matter how much text was passed in. Only a single text line
+ * which is longer than a window gets processed in one go.
+ */
+static int process_text(const struct sr_input *in,
+	char *start, char *end, char **next)
+{
+	struct context *inc;
+	char *win_end, *pos;
+	size_t count;
+	int ret;
+
+	inc = in->priv;
+
+	ret = SR_OK;
+	while (start < end) {
+		win_end = end;
+		if ((size_t)(end - start) > WINDOW_SIZE) {
+			win_end = start + WINDOW_SIZE;
+			while (win_end > start && win_end[-1] != '\n')
+				win_end--;
+			if (win_end == start)
+				win_end = end;
+		}
+		count = slice_count(inc, win_end - start);
+		if (count)
+			ret = process_lines_parallel(in, start, win_end, count, &pos);
+		else
+			ret = process_lines(in, start, win_end, &pos);
+		if (pos == start)
+			break;
+		start = pos;
+		if (ret != SR_OK)
+			break;
+	}
+	*next = start;
+
+	return ret;
+}
+
 static int process_buffer(struct sr_input *in, gboolean is_eof)
 {
 	struct context *inc;
 	uint64_t samplerate;
 	GVariant *gvar;
 	int ret;
-	char *rdptr, *endptr, *trimptr;
+	char *rdptr, *endptr;
 	size_t rdlen;
 
 	inc = in->priv;
@@ -1641,28 +2220,9 @@ static int process_buffer(struct sr_input *in, gboolean is_eof)
 		g_string_append_c(in->buf, '\n');
 
 	/* Find and process complete text lines in the input data. */
-	ret = SR_OK;
 	rdptr = in->buf->str;
-	while (TRUE) {
-		rdlen = &in->buf->str[in->buf->len] - rdptr;
-		endptr = g_strstr_len(rdptr, rdlen, "\n");
-		if (!endptr)
-			break;
-		trimptr = endptr;
-		*endptr++ = '\0';
-		while (g_ascii_isspace(*rdptr))
-			rdptr++;
-		while (trimptr > rdptr && g_ascii_isspace(trimptr[-1]))
-			*(--trimptr) = '\0';
-		if (!*rdptr) {
-			rdptr = endptr;
-			continue;
-		}
-		ret = parse_textline(in, rdptr);
-		rdptr = endptr;
-		if (ret != SR_OK)
-			break;
-	}
+	endptr = &in->buf->str[in->buf->len];
+	ret = process_text(in, rdptr, endptr, &rdptr);
 	rdlen = rdptr - in->buf->str;
 	g_string_erase(in->buf, 0, rdlen);
 
@@ -1674,10 +2234,20 @@ static int format_match(GHashTable *metadata, unsigned int *confidence)
 	GString *buf, *tmpbuf;
 	gboolean status;
 	char *name, *contents;
+	const char *end;
 
 	buf = g_hash_table_lookup(metadata,
 		GINT_TO_POINTER(SR_INPUT_META_HEADER));
-	tmpbuf = g_string_new_len(buf->str, buf->len);
+
+	/*
+	 * Only the first section gets parsed, don't copy all of the
+	 * (potentially megabytes of) header. Text without an '$end'
+	 * has no complete section.
+	 */
+	end = g_strstr_len(buf->str, buf->len, "$end");
+	if (!end)
+		return SR_ERR;
+	tmpbuf = g_string_new_len(buf->str, end + strlen("$end") - buf->str);
 
 	/*
 	 * If we can parse the first section correctly, then it is
@@ -1715,6 +2285,12 @@ static int init(struct sr_input *in, GHashTable *options)
 	inc->options.compress = g_variant_get_uint64(data);
 	inc->options.compress /= inc->options.downsample;
 
+	data = g_hash_table_lookup(options, "threads");
+	inc->options.threads = g_variant_get_uint32(data);
+
+	data = g_hash_table_lookup(options, "runs");
+	inc->options.runs = g_variant_get_boolean(data);
+
 	data = g_hash_table_lookup(options, "skip");
 	if (data) {
 		inc->options.skip_specified = TRUE;
@@ -1797,6 +2373,9 @@ static void cleanup(struct sr_input *in)
 
 	keep_header_for_reread(in);
 
+	if (inc->signals)
+		g_hash_table_destroy(inc->signals);
+	inc->signals = NULL;
 	g_slist_free_full(inc->channels, free_channel);
 	inc->channels = NULL;
 	feed_queue_logic_free(inc->feed_logic);
@@ -1809,7 +2388,8 @@ static void cleanup(struct sr_input *in)
 	inc->current_floats = NULL;
 	g_string_free(inc->scope_prefix, TRUE);
 	inc->scope_prefix = NULL;
-	g_slist_free_full(inc->ignored_signals, g_free);
+	if (inc->ignored_signals)
+		g_hash_table_destroy(inc->ignored_signals);
 	inc->ignored_signals = NULL;
 	free_text_split(inc, NULL);
 }
@@ -1842,6 +2422,8 @@ enum vcd_option_t {
 	OPT_DOWN_SAMPLE,
 	OPT_SKIP_COUNT,
 	OPT_COMPRESS,
+	OPT_THREADS,
+	OPT_RUNS,
 	OPT_MAX,
 };
 
@@ -1869,6 +2451,19 @@ static struct sr_option options[] = {
 		"Compress idle periods which are longer than the specified number of timescale ticks.",
 		NULL, NULL,
 	},
+	[OPT_THREADS] = {
+		"threads", "Parser threads",
+		"Number of threads which tokenize sample data in parallel. "
+		"Value 0 uses one thread per CPU, value 1 disables parallel parsing.",
+		NULL, NULL,
+	},
+	[OPT_RUNS] = {
+		"runs", "Send runs of samples",
+		"Send logic data as runs of unchanged samples (RLE), which keeps "
+		"sparse activity at fine timescales fast to import. Receivers "
+		"which do not take RLE data get it expanded.",
+		NULL, NULL,
+	},
 	[OPT_MAX] = ALL_ZERO,
 };
 
@@ -1879,6 +2474,8 @@ static const struct sr_option *get_options(void)
 		options[OPT_DOWN_SAMPLE].def = g_variant_ref_sink(g_variant_new_uint64(1));
 		options[OPT_SKIP_COUNT].def = g_variant_ref_sink(g_variant_new_uint64(~UINT64_C(0)));
 		options[OPT_COMPRESS].def = g_variant_ref_sink(g_variant_new_uint64(0));
+		options[OPT_THREADS].def = g_variant_ref_sink(g_variant_new_uint32(0));
+		options[OPT_RUNS].def = g_variant_ref_sink(g_variant_new_boolean(FALSE));
 	}
 
 	return options;
@@ -54,58 +54,67 @@ struct context {
 	gboolean create_channels;
 };
 
-static int parse_wav_header(GString *buf, struct context *inc)
+static int parse_wav_header(const char *data, size_t len, struct context *inc)
 {
 	uint64_t samplerate;
 	unsigned int fmt_code, samplesize, num_channels, unitsize;
 
-	if (buf->len < MIN_DATA_CHUNK_OFFSET)
+	if (len < MIN_DATA_CHUNK_OFFSET)
 		return SR_ERR_NA;
 
-	fmt_code = RL16(buf->str + 20);
-	samplerate = RL32(buf->str + 24);
+	fmt_code = RL16(data + 20);
+	samplerate = RL32(data + 24);
 
-	samplesize = RL16(buf->str + 32);
-	num_channels = RL16(buf->str + 22);
+	samplesize = RL16(data + 32);
+	num_channels = RL16(data + 22);
 	if (num_channels == 0)
 		return SR_ERR;
 	unitsize = samplesize / num_channels;
-	if (unitsize != 1 && unitsize != 2 && unitsize != 4) {
-		sr_err("Only 8, 16 or 32 bits per sample supported.");
+	if (unitsize < 1 || (unitsize > 4 && unitsize != 8)) {
+		sr_err("Only 8, 16, 24, 32 or 64 bits per sample supported.");
 		return SR_ERR_DATA;
 	}
 
 	if (fmt_code == WAVE_FORMAT_PCM_) {
+		if (unitsize == 8) {
+			sr_err("Only 8, 16, 24 or 32-bit PCM supported.");
+			return SR_ERR_DATA;
+		}
 	} else if (fmt_code == WAVE_FORMAT_IEEE_FLOAT_) {
-		if (unitsize != 4) {
-			sr_err("only 32-bit floats supported.");
+		if (unitsize != 4 && unitsize != 8) {
+			sr_err("only 32-bit and 64-bit floats supported.");
 			return SR_ERR_DATA;
 		}
 	} else if (fmt_code == WAVE_FORMAT_EXTENSIBLE_) {
-		if (buf->len < 70)
+		if (len < 70)
 			/* Not enough for extensible header and next chunk. */
 			return SR_ERR_NA;
 
-		if (RL16(buf->str + 16) != 40) {
+		if (RL16(data + 16) != 40) {
 			sr_err("WAV extensible format chunk must be 40 bytes.");
 			return SR_ERR;
 		}
-		if (RL16(buf->str + 36) != 22) {
+		if (RL16(data + 36) != 22) {
 			sr_err("WAV extension must be 22 bytes.");
 			return SR_ERR;
 		}
-		if (RL16(buf->str + 34) != RL16(buf->str + 38)) {
+		if (RL16(data + 34) != RL16(data + 38)) {
 			sr_err("Reduced valid bits per sample not supported.");
 			return SR_ERR_DATA;
 		}
 		/* Real format code is the first two bytes of the GUID. */
-		fmt_code = RL16(buf->str + 44);
+		fmt_code = RL16(data + 44);
 		if (fmt_code != WAVE_FORMAT_PCM_ && fmt_code != WAVE_FORMAT_IEEE_FLOAT_) {
 			sr_err("Only PCM and floating point samples are supported.");
 			return SR_ERR_DATA;
 		}
-		if (fmt_code == WAVE_FORMAT_IEEE_FLOAT_ && unitsize != 4) {
-			sr_err("only 32-bit floats supported.");
+		if (fmt_code == WAVE_FORMAT_PCM_ && unitsize == 8) {
+			sr_err("Only 8, 16, 24 or 32-bit PCM supported.");
+			return SR_ERR_DATA;
+		}
+		if (fmt_code == WAVE_FORMAT_IEEE_FLOAT_
+				&& unitsize != 4 && unitsize != 8) {
+			sr_err("only 32-bit and 64-bit floats supported.");
 			return SR_ERR_DATA;
 		}
 	} else {
@@ -141,7 +150,7 @@ static int format_match(GHashTable *metadata, unsigned int *confidence)
 	 * Only gets called when we already know this is a WAV file, so
 	 * this parser can log error messages.
 	 */
-	if ((ret = parse_wav_header(buf, NULL)) != SR_OK)
+	if ((ret = parse_wav_header(buf->str, buf->len, NULL)) != SR_OK)
 		return ret;
 
 	*confidence = 1;
@@ -164,23 +173,23 @@ static int init(struct sr_input *in, GHashTable *options)
 	return SR_OK;
 }
 
-static int find_data_chunk(GString *buf, int initial_offset)
+static int find_data_chunk(const char *data, size_t len, int initial_offset)
 {
 	unsigned int offset, i;
 
 	offset = initial_offset;
-	while (offset < MIN(MAX_DATA_CHUNK_OFFSET, buf->len)) {
-		if (!memcmp(buf->str + offset, "data", 4))
+	while (offset < MAX_DATA_CHUNK_OFFSET && offset + 8 <= len) {
+		if (!memcmp(data + offset, "data", 4))
 			/* Skip into the samples. */
 			return offset + 8;
 		for (i = 0; i < 4; i++) {
-			if (!isalnum(buf->str[offset + i])
-					&& !isblank(buf->str[offset + i]))
+			if (!isalnum(data[offset + i])
+					&& !isblank(data[offset + i]))
 				/* Doesn't look like a chunk ID. */
 				return -1;
 		}
 		/* Skip past this chunk. */
-		offset += 8 + RL32(buf->str + offset + 4);
+		offset += 8 + RL32(data + offset + 4);
 	}
 
 	if (offset > MAX_DATA_CHUNK_OFFSET)
@@ -189,7 +198,11 @@ static int find_data_chunk(GString *buf, int initial_offset)
 	return offset;
 }
 
-static void send_chunk(const struct sr_input *in, int offset, int num_samples)
+/*
+ * The samples get sent as they are in the file, with an encoding which
+ * scales them like the former conversion to float did.
+ */
+static void send_chunk(const struct sr_input *in, char *data, int num_samples)
 {
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_analog analog;
@@ -197,66 +210,56 @@ static void send_chunk(const struct sr_input *in, int offset, int num_samples)
 	struct sr_analog_meaning meaning;
 	struct sr_analog_spec spec;
 	struct context *inc;
-	float *fdata;
-	int total_samples, samplenum;
-	char *s, *d;
 
 	inc = in->priv;
 
-	total_samples = num_samples * inc->num_channels;
-	fdata = g_malloc0(total_samples * sizeof(float));
-	s = in->buf->str + offset;
-	d = (char *)fdata;
-
-	for (samplenum = 0; samplenum < total_samples; samplenum++) {
-		if (inc->fmt_code == WAVE_FORMAT_PCM_) {
-			switch (inc->unitsize) {
-			case 1:
-				/* 8-bit PCM samples are unsigned. */
-				fdata[samplenum] = *(uint8_t*)(s) / (float)255;
-				break;
-			case 2:
-				fdata[samplenum] = RL16S(s) / (float)INT16_MAX;
-				break;
-			case 4:
-				fdata[samplenum] = RL32S(s) / (float)INT32_MAX;
-				break;
-			}
-		} else {
-			/* BINARY32 float */
-#ifdef WORDS_BIGENDIAN
-			int i;
-			for (i = 0; i < inc->unitsize; i++)
-				d[i] = s[inc->unitsize - 1 - i];
-#else
-			memcpy(d, s, inc->unitsize);
-#endif
-		}
-		s += inc->unitsize;
-		d += inc->unitsize;
-	}
-
 	/* TODO: Use proper 'digits' value for this device (and its modes). */
 	sr_analog_init(&analog, &encoding, &meaning, &spec, 2);
+	encoding.unitsize = inc->unitsize;
+	encoding.is_bigendian = FALSE;
+	if (inc->fmt_code == WAVE_FORMAT_PCM_) {
+		/* 8-bit PCM samples are unsigned. */
+		encoding.is_signed = inc->unitsize != 1;
+		encoding.is_float = FALSE;
+		switch (inc->unitsize) {
+		case 1:
+			encoding.scale.q = UINT8_MAX;
+			break;
+		case 2:
+			encoding.scale.q = INT16_MAX;
+			break;
+		case 3:
+			encoding.scale.q = (1 << 23) - 1;
+			break;
+		case 4:
+			encoding.scale.q = INT32_MAX;
+			break;
+		}
+	} else {
+		/* BINARY32 or BINARY64 float */
+		encoding.is_signed = TRUE;
+	}
 	packet.type = SR_DF_ANALOG;
 	packet.payload = &analog;
 	analog.num_samples = num_samples;
-	analog.data = fdata;
+	analog.data = data;
 	analog.meaning->channels = in->sdi->channels;
 	analog.meaning->mq = 0;
 	analog.meaning->mqflags = 0;
 	analog.meaning->unit = 0;
 	sr_session_send(in->sdi, &packet);
-	g_free(fdata);
 }
 
-static int process_buffer(struct sr_input *in)
+/* Send the complete samples of the data, and tell the size they took. */
+static int process_data(struct sr_input *in, char *data, size_t len,
+		size_t *used)
 {
 	struct context *inc;
-	int offset, chunk_samples, total_samples, processed, max_chunk_samples;
-	int num_samples, i;
+	size_t offset, total_samples, max_chunk_samples, num_samples;
+	int data_offset, i;
 
 	inc = in->priv;
+	*used = 0;
 	if (!inc->started) {
 		std_session_send_df_header(in->sdi);
 		(void)sr_session_send_meta(in->sdi, SR_CONF_SAMPLERATE,
@@ -264,54 +267,82 @@ static int process_buffer(struct sr_input *in)
 		inc->started = TRUE;
 	}
 
+	offset = 0;
 	if (!inc->found_data) {
 		/* Skip past size of 'fmt ' chunk. */
-		i = 20 + RL32(in->buf->str + 16);
-		offset = find_data_chunk(in->buf, i);
-		if (offset < 0) {
-			if (in->buf->len > MAX_DATA_CHUNK_OFFSET) {
+		i = 20 + RL32(data + 16);
+		data_offset = find_data_chunk(data, len, i);
+		if (data_offset < 0) {
+			if (len > MAX_DATA_CHUNK_OFFSET) {
 				sr_err("Couldn't find data chunk.");
 				return SR_ERR;
 			}
+			/* Not enough data yet. */
+			return SR_OK;
 		}
+		offset = data_offset;
 		inc->found_data = TRUE;
-	} else
-		offset = 0;
+	}
 
 	/* Round off up to the last channels * unitsize boundary. */
-	chunk_samples = (in->buf->len - offset) / inc->samplesize;
+	total_samples = offset < len ? (len - offset) / inc->samplesize : 0;
 	max_chunk_samples = CHUNK_SIZE / inc->samplesize;
-	processed = 0;
-	total_samples = chunk_samples;
-	while (processed < total_samples) {
-		if (chunk_samples > max_chunk_samples)
-			num_samples = max_chunk_samples;
-		else
-			num_samples = chunk_samples;
-		send_chunk(in, offset, num_samples);
+	while (total_samples > 0) {
+		num_samples = MIN(total_samples, max_chunk_samples);
+		send_chunk(in, data + offset, num_samples);
 		offset += num_samples * inc->samplesize;
-		chunk_samples -= num_samples;
-		processed += num_samples;
+		total_samples -= num_samples;
 	}
-
-	if ((unsigned int)offset < in->buf->len) {
-		/*
-		 * The incoming buffer wasn't processed completely. Stash
-		 * the leftover data for next time.
-		 */
-		g_string_erase(in->buf, 0, offset);
-	} else
-		g_string_truncate(in->buf, 0);
+	*used = MIN(offset, len);
 
 	return SR_OK;
 }
 
-static int receive(struct sr_input *in, GString *buf)
+static int process_buffer(struct sr_input *in)
+{
+	size_t used;
+	int ret;
+
+	/*
+	 * The incoming buffer may not get processed completely. Stash
+	 * the leftover data for next time.
+	 */
+	ret = process_data(in, in->buf->str, in->buf->len, &used);
+	g_string_erase(in->buf, 0, used);
+
+	return ret;
+}
+
+/* Parse the header, and create the channels. */
+static int setup_sdi(struct sr_input *in, const char *data, size_t len)
 {
 	struct context *inc;
 	int ret;
 	char channelname[16];
 
+	inc = in->priv;
+	if ((ret = parse_wav_header(data, len, inc)) != SR_OK)
+		return ret;
+
+	if (inc->create_channels) {
+		for (int i = 0; i < inc->num_channels; i++) {
+			snprintf(channelname, sizeof(channelname), "CH%d", i + 1);
+			sr_channel_new(in->sdi, i, SR_CHANNEL_ANALOG, TRUE, channelname);
+		}
+	}
+
+	inc->create_channels = FALSE;
+
+	/* sdi is ready, notify frontend. */
+	in->sdi_ready = TRUE;
+
+	return SR_OK;
+}
+
+static int receive(struct sr_input *in, GString *buf)
+{
+	int ret;
+
 	g_string_append_len(in->buf, buf->str, buf->len);
 
 	if (in->buf->len < MIN_DATA_CHUNK_OFFSET) {
@@ -322,26 +353,11 @@ static int receive(struct sr_input *in, GString *buf)
 		return SR_OK;
 	}
 
-	inc = in->priv;
 	if (!in->sdi_ready) {
-		if ((ret = parse_wav_header(in->buf, inc)) == SR_ERR_NA)
+		if ((ret = setup_sdi(in, in->buf->str, in->buf->len)) == SR_ERR_NA)
 			/* Not enough data yet. */
 			return SR_OK;
-		else if (ret != SR_OK)
-			return ret;
-
-		if (inc->create_channels) {
-			for (int i = 0; i < inc->num_channels; i++) {
-				snprintf(channelname, sizeof(channelname), "CH%d", i + 1);
-				sr_channel_new(in->sdi, i, SR_CHANNEL_ANALOG, TRUE, channelname);
-			}
-		}
-
-		inc->create_channels = FALSE;
-
-		/* sdi is ready, notify frontend. */
-		in->sdi_ready = TRUE;
-		return SR_OK;
+		return ret;
 	}
 
 	ret = process_buffer(in);
@@ -349,6 +365,22 @@ static int receive(struct sr_input *in, GString *buf)
 	return ret;
 }
 
+static int receive_mapped(struct sr_input *in, char *data, size_t len,
+		size_t *used)
+{
+	int ret;
+
+	if (!in->sdi_ready) {
+		*used = 0;
+		if ((ret = setup_sdi(in, data, len)) == SR_ERR_NA)
+			/* The file is too short. */
+			return SR_OK;
+		return ret;
+	}
+
+	return process_data(in, data, len, used);
+}
+
 static int end(struct sr_input *in)
 {
 	struct context *inc;
@@ -389,6 +421,7 @@ SR_PRIV struct sr_input_module input_wav = {
 	.format_match = format_match,
 	.init = init,
 	.receive = receive,
+	.receive_mapped = receive_mapped,
 	.end = end,
 	.reset = reset,
 };
@@ -23,6 +23,12 @@
 #include "config.h"
 
 #include <glib.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
 #ifdef HAVE_LIBHIDAPI
 #include <hidapi.h>
 #endif
@@ -158,6 +164,59 @@ static inline uint32_t read_u24le(const uint8_t *p)
 
 	return u;
 }
+#define RL24(x) read_u24le((const uint8_t *)(x))
+
+/**
+ * Read a 24 bits little endian signed integer out of memory.
+ * @param x a pointer to the input memory
+ * @return the corresponding signed integer
+ */
+static inline int32_t read_i24le(const uint8_t *p)
+{
+	uint32_t u;
+	int32_t i;
+
+	u = read_u24le(p);
+	i = (int32_t)(u << 8) >> 8;
+
+	return i;
+}
+#define RL24S(x) read_i24le((const uint8_t *)(x))
+
+/**
+ * Read a 24 bits big endian unsigned integer out of memory.
+ * @param x a pointer to the input memory
+ * @return the corresponding unsigned integer
+ */
+static inline uint32_t read_u24be(const uint8_t *p)
+{
+	uint32_t u;
+
+	u = 0;
+	u <<= 8; u |= p[0];
+	u <<= 8; u |= p[1];
+	u <<= 8; u |= p[2];
+
+	return u;
+}
+#define RB24(x) read_u24be((const uint8_t *)(x))
+
+/**
+ * Read a 24 bits big endian signed integer out of memory.
+ * @param x a pointer to the input memory
+ * @return the corresponding signed integer
+ */
+static inline int32_t read_i24be(const uint8_t *p)
+{
+	uint32_t u;
+	int32_t i;
+
+	u = read_u24be(p);
+	i = (int32_t)(u << 8) >> 8;
+
+	return i;
+}
+#define RB24S(x) read_i24be((const uint8_t *)(x))
 
 /**
  * Read a 32 bits big endian unsigned integer out of memory.
@@ -380,6 +439,29 @@ static inline double read_dblle(const uint8_t *p)
 }
 #define RLDB(x) read_dblle((const uint8_t *)(x))
 
+/**
+ * Read a 64 bits big endian float out of memory (double precision).
+ * @param x a pointer to the input memory
+ * @return the corresponding floating point value
+ */
+static inline double read_dblbe(const uint8_t *p)
+{
+	/*
+	 * Implementor's note: Strictly speaking the "union" trick
+	 * is not portable. But this phrase was found to work on the
+	 * project's supported platforms, and serve well until a more
+	 * appropriate phrase is found.
+	 */
+	union { uint64_t u64; double flt; } u;
+	double f;
+
+	u.u64 = read_u64be(p);
+	f = u.flt;
+
+	return f;
+}
+#define RBDB(x) read_dblbe((const uint8_t *)(x))
+
 /**
  * Write a 8 bits unsigned integer to memory.
  * @param p a pointer to the output memory
@@ -776,6 +858,201 @@ static inline void write_dblle_inc(uint8_t **p, double x)
 	*p += sizeof(x);
 }
 
+/**
+ * Transpose an 8x8 bit matrix, bit (8 * r + c) moves to bit (8 * c + r).
+ *
+ * Logic analyzers which send per-channel planes of samples use this to
+ * turn 8 samples of 8 channels into 8 sample bytes in three steps, on
+ * all 64 bits at once. See Hacker's Delight, 7-3.
+ * @param[in] x The matrix, row r in byte r.
+ * @return The transposed matrix.
+ */
+static inline uint64_t sr_transpose8x8(uint64_t x)
+{
+	uint64_t t;
+
+	t = (x ^ (x >> 7)) & UINT64_C(0x00aa00aa00aa00aa);
+	x = x ^ t ^ (t << 7);
+	t = (x ^ (x >> 14)) & UINT64_C(0x0000cccc0000cccc);
+	x = x ^ t ^ (t << 14);
+	t = (x ^ (x >> 28)) & UINT64_C(0x00000000f0f0f0f0);
+	x = x ^ t ^ (t << 28);
+
+	return x;
+}
+
+/*
+ * Bit transposes for logic analyzers which send a word per channel in
+ * turn: words[c] holds consecutive samples of the channel which becomes
+ * bit c of the samples, the words of disabled channels are zero. With
+ * SSE2 one byte of all 16 words goes into a vector and the bytes' top
+ * bits form a sample, the _portable variants are the fallback.
+ */
+
+/* Row r of lo and hi holds 8 samples of channel r and 8 + r. */
+static inline void sr_transpose16x8_rows(uint64_t lo, uint64_t hi,
+		uint16_t *samples, gboolean msb_first)
+{
+	int i, shift;
+
+	lo = sr_transpose8x8(lo);
+	hi = sr_transpose8x8(hi);
+	for (i = 0; i < 8; i++) {
+		shift = 8 * (msb_first ? 7 - i : i);
+		samples[i] = ((lo >> shift) & 0xff) |
+			(((hi >> shift) & 0xff) << 8);
+	}
+}
+
+/**
+ * Transpose 16 words of 16 samples each, the first sample in the MSB.
+ * @param[in] words The channels' words.
+ * @param[out] samples The 16 samples.
+ */
+static inline void sr_transpose16x16_portable(const uint16_t *words,
+		uint16_t *samples)
+{
+	uint64_t lo, hi;
+	int shift, i;
+
+	for (shift = 8; shift >= 0; shift -= 8, samples += 8) {
+		lo = hi = 0;
+		for (i = 0; i < 8; i++) {
+			lo |= (uint64_t)((words[i] >> shift) & 0xff) << (8 * i);
+			hi |= (uint64_t)((words[i + 8] >> shift) & 0xff) << (8 * i);
+		}
+		sr_transpose16x8_rows(lo, hi, samples, TRUE);
+	}
+}
+
+/**
+ * Transpose 16 words of 32 samples each, the first sample in the MSB.
+ * @param[in] words The channels' words.
+ * @param[out] samples The 32 samples.
+ */
+static inline void sr_transpose16x32_portable(const uint32_t *words,
+		uint16_t *samples)
+{
+	uint64_t lo, hi;
+	int shift, i;
+
+	for (shift = 24; shift >= 0; shift -= 8, samples += 8) {
+		lo = hi = 0;
+		for (i = 0; i < 8; i++) {
+			lo |= (uint64_t)((words[i] >> shift) & 0xff) << (8 * i);
+			hi |= (uint64_t)((words[i + 8] >> shift) & 0xff) << (8 * i);
+		}
+		sr_transpose16x8_rows(lo, hi, samples, TRUE);
+	}
+}
+
+/**
+ * Transpose 16 words of 64 samples each, the first sample in the LSB.
+ * @param[in] words The channels' words.
+ * @param[out] samples The 64 samples.
+ */
+static inline void sr_transpose16x64_portable(const uint64_t *words,
+		uint16_t *samples)
+{
+	uint64_t lo, hi;
+	int shift, i;
+
+	for (shift = 0; shift < 64; shift += 8, samples += 8) {
+		lo = hi = 0;
+		for (i = 0; i < 8; i++) {
+			lo |= ((words[i] >> shift) & 0xff) << (8 * i);
+			hi |= ((words[i + 8] >> shift) & 0xff) << (8 * i);
+		}
+		sr_transpose16x8_rows(lo, hi, samples, FALSE);
+	}
+}
+
+#ifdef __SSE2__
+/* Byte c of x holds 8 samples of channel c, the first in bit 7 or 0. */
+static inline void sr_transpose16x8_sse2(__m128i x, uint16_t *samples,
+		gboolean msb_first)
+{
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		samples[msb_first ? i : 7 - i] = _mm_movemask_epi8(x);
+		x = _mm_add_epi8(x, x);
+	}
+}
+
+static inline void sr_transpose16x16(const uint16_t *words, uint16_t *samples)
+{
+	const __m128i byte_mask = _mm_set1_epi16(0xff);
+	__m128i w0, w1;
+
+	w0 = _mm_loadu_si128((const __m128i *)&words[0]);
+	w1 = _mm_loadu_si128((const __m128i *)&words[8]);
+	sr_transpose16x8_sse2(_mm_packus_epi16(_mm_srli_epi16(w0, 8),
+		_mm_srli_epi16(w1, 8)), &samples[0], TRUE);
+	sr_transpose16x8_sse2(_mm_packus_epi16(_mm_and_si128(w0, byte_mask),
+		_mm_and_si128(w1, byte_mask)), &samples[8], TRUE);
+}
+
+static inline void sr_transpose16x32(const uint32_t *words, uint16_t *samples)
+{
+	const __m128i byte_mask = _mm_set1_epi32(0xff);
+	__m128i w[4], count;
+	int shift;
+
+	w[0] = _mm_loadu_si128((const __m128i *)&words[0]);
+	w[1] = _mm_loadu_si128((const __m128i *)&words[4]);
+	w[2] = _mm_loadu_si128((const __m128i *)&words[8]);
+	w[3] = _mm_loadu_si128((const __m128i *)&words[12]);
+	for (shift = 24; shift >= 0; shift -= 8, samples += 8) {
+		count = _mm_cvtsi32_si128(shift);
+		sr_transpose16x8_sse2(_mm_packus_epi16(
+			_mm_packs_epi32(
+				_mm_and_si128(_mm_srl_epi32(w[0], count), byte_mask),
+				_mm_and_si128(_mm_srl_epi32(w[1], count), byte_mask)),
+			_mm_packs_epi32(
+				_mm_and_si128(_mm_srl_epi32(w[2], count), byte_mask),
+				_mm_and_si128(_mm_srl_epi32(w[3], count), byte_mask))),
+			samples, TRUE);
+	}
+}
+
+static inline void sr_transpose16x64(const uint64_t *words, uint16_t *samples)
+{
+	const __m128i byte_mask = _mm_set1_epi64x(0xff);
+	__m128i w[8], b[8], count;
+	int shift, i;
+
+	for (i = 0; i < 8; i++)
+		w[i] = _mm_loadu_si128((const __m128i *)&words[2 * i]);
+	for (shift = 0; shift < 64; shift += 8, samples += 8) {
+		count = _mm_cvtsi32_si128(shift);
+		for (i = 0; i < 8; i++)
+			b[i] = _mm_and_si128(_mm_srl_epi64(w[i], count), byte_mask);
+		sr_transpose16x8_sse2(_mm_packus_epi16(
+			_mm_packus_epi16(_mm_packs_epi32(b[0], b[1]),
+				_mm_packs_epi32(b[2], b[3])),
+			_mm_packus_epi16(_mm_packs_epi32(b[4], b[5]),
+				_mm_packs_epi32(b[6], b[7]))),
+			samples, FALSE);
+	}
+}
+#else
+static inline void sr_transpose16x16(const uint16_t *words, uint16_t *samples)
+{
+	sr_transpose16x16_portable(words, samples);
+}
+
+static inline void sr_transpose16x32(const uint32_t *words, uint16_t *samples)
+{
+	sr_transpose16x32_portable(words, samples);
+}
+
+static inline void sr_transpose16x64(const uint64_t *words, uint16_t *samples)
+{
+	sr_transpose16x64_portable(words, samples);
+}
+#endif
+
 /* Portability fixes for FreeBSD. */
 #ifdef __FreeBSD__
 #define LIBUSB_CLASS_APPLICATION 0xfe
@@ -860,15 +1137,57 @@ static inline void write_dblle_inc(uint8_t **p, double x)
 
 SR_API void sr_drivers_init(struct sr_context *context);
 
+struct usb_event_thread;
+struct sr_usb_snapshot;
+struct sr_hotplug;
+
+/** @cond PRIVATE */
+#define LIBUSB_STATE_READY	1
+#define LIBUSB_STATE_FAILED	2
+/** @endcond */
+
 struct sr_context {
 	struct sr_dev_driver **driver_list;
 #ifdef HAVE_LIBUSB_1_0
+	/* Only valid after sr_libusb_init() succeeded. */
 	libusb_context *libusb_ctx;
+	/* 0 until sr_libusb_init() ran, then LIBUSB_STATE_*. */
+	volatile gsize libusb_state;
+	/* Enumeration of the current scan pass, see sr_scan_begin(). */
+	struct sr_usb_snapshot *usb_snapshot;
+	unsigned int usb_snapshot_users;
+	GMutex usb_snapshot_mutex;
+	/* Bitstream checksums by device, see sr_usb_fpga_configure(). */
+	GHashTable *fpga_bitstreams;
+	GMutex fpga_mutex;
+	/* Handle libusb events in a thread of their own. */
+	gboolean usb_event_thread;
+	struct usb_event_thread *usb_thread;
+	/* Sessions using usb_thread, both protected by the mutex. */
+	unsigned int usb_thread_users;
+	GMutex usb_thread_mutex;
 #endif
 	sr_resource_open_callback resource_open_cb;
 	sr_resource_close_callback resource_close_cb;
 	sr_resource_read_callback resource_read_cb;
 	void *resource_cb_data;
+	/* Sessions which exist in this context. */
+	gint num_sessions;
+	/* Device discovery started by sr_hotplug_start(). */
+	struct sr_hotplug *hotplug;
+	/* Resources loaded by sr_resource_load_bytes(), by type and name. */
+	GHashTable *resource_cache;
+	GMutex resource_cache_mutex;
+	/* Probe results cached by sr_scan_cache_set(). */
+	GKeyFile *scan_cache;
+	char *scan_cache_file;
+	GMutex scan_cache_mutex;
+	/* Capture-sized buffers, see sr_mem_budget_set(). */
+	uint64_t mem_budget;
+	char *mem_spill_dir;
+	GHashTable *mem_usage;
+	GHashTable *mem_blocks;
+	GMutex mem_mutex;
 };
 
 /** Input module metadata keys. */
@@ -894,6 +1213,11 @@ struct sr_input {
 	struct sr_dev_inst *sdi;
 	gboolean sdi_ready;
 	void *priv;
+	/** The file which sr_input_send_mapped() sends, NULL if none. */
+	GMappedFile *mapped;
+	char *mapped_name;
+	/** How much of the mapped file was sent so far. */
+	size_t mapped_pos;
 };
 
 /** Input (file) module driver. */
@@ -967,6 +1291,8 @@ struct sr_input_module {
 	 * and the application can pick the best match, or try fallbacks
 	 * in case of errors. This approach also copes with formats that
 	 * are unreliable to detect in the absence of magic signatures.
+	 * A confidence of 1 is for positive identifications (like magic
+	 * signatures), and ends the search for a module.
 	 */
 	int (*format_match) (GHashTable *metadata, unsigned int *confidence);
 
@@ -995,6 +1321,26 @@ struct sr_input_module {
 	 */
 	int (*receive) (struct sr_input *in, GString *buf);
 
+	/**
+	 * Send data from a memory mapped file to the specified input instance.
+	 *
+	 * This works like receive(), but the module parses the data in place
+	 * instead of appending it to in->buf, and may send sample data which
+	 * points into it. The data is the part of the file which was not used
+	 * yet, and stays valid until the function returns. It is a private
+	 * mapping, so receivers of the sample data may modify it.
+	 *
+	 * This function is optional. Without it, sr_input_send_mapped() copies
+	 * the file's data into receive() calls.
+	 *
+	 * @param[out] used The number of bytes the module is done with.
+	 *
+	 * @retval SR_OK Success
+	 * @retval other Negative error code.
+	 */
+	int (*receive_mapped) (struct sr_input *in, char *data,
+		size_t len, size_t *used);
+
 	/**
 	 * Signal the input module no more data will come.
 	 *
@@ -1052,6 +1398,12 @@ struct sr_output {
 	 * there, and only flush it when it reaches a certain size.
 	 */
 	void *priv;
+
+	/**
+	 * Buffer which receive_append() writes into, reused for every
+	 * packet sent with sr_output_send_sink().
+	 */
+	GString *buf;
 };
 
 /** Output module driver. */
@@ -1134,6 +1486,22 @@ struct sr_output_module {
 	int (*receive) (const struct sr_output *o,
 			const struct sr_datafeed_packet *packet, GString **out);
 
+	/**
+	 * Like receive(), but the output gets appended to the caller's
+	 * <code>out</code> buffer, which can be reused for many packets.
+	 * Modules can implement this instead of receive(), sr_output_send()
+	 * then passes a new GString.
+	 *
+	 * @param o Pointer to the respective 'struct sr_output'.
+	 * @param packet The complete packet.
+	 * @param out The buffer to append the output to.
+	 *
+	 * @retval SR_OK Success
+	 * @retval other Negative error code.
+	 */
+	int (*receive_append) (const struct sr_output *o,
+			const struct sr_datafeed_packet *packet, GString *out);
+
 	/**
 	 * This function is called after the caller is finished using
 	 * the output module, and can be used to free any internal
@@ -1161,6 +1529,12 @@ struct sr_transform {
 	 * state between calls into its callback functions.
 	 */
 	void *priv;
+
+	/** Time spent in receive() during the session run, in microseconds. */
+	uint64_t busy_us;
+
+	/** Buffers of the module, see sr_transform_buffer(). */
+	GArray *buffers;
 };
 
 struct sr_transform_module {
@@ -1234,6 +1608,9 @@ struct sr_transform_module {
 
 #ifdef HAVE_LIBUSB_1_0
 /** USB device instance */
+struct sr_usb_record;
+struct sr_usb_replay;
+
 struct sr_usb_dev_inst {
 	/** USB bus */
 	uint8_t bus;
@@ -1241,6 +1618,10 @@ struct sr_usb_dev_inst {
 	uint8_t address;
 	/** libusb device handle */
 	struct libusb_device_handle *devhdl;
+	/** Recording of the transfers, see sr_usb_record_start(). */
+	struct sr_usb_record *record;
+	/** Recording this device replays, see sr_usb_replay_open(). */
+	struct sr_usb_replay *replay;
 };
 #endif
 
@@ -1248,6 +1629,7 @@ struct sr_serial_dev_inst;
 #ifdef HAVE_SERIAL_COMM
 struct ser_lib_functions;
 struct ser_hid_chip_functions;
+struct ser_hid_reader;
 struct sr_bt_desc;
 typedef void (*serial_rx_chunk_callback)(struct sr_serial_dev_inst *serial,
 	void *cb_data, const void *buf, size_t count);
@@ -1264,6 +1646,9 @@ struct sr_serial_dev_inst {
 		int stop_bits;
 	} comm_params;
 	GString *rcv_buffer;
+	/** Data read ahead by serial_peek(), and how much was consumed. */
+	GString *peek_buffer;
+	size_t peek_consumed;
 	serial_rx_chunk_callback rx_chunk_cb_func;
 	void *rx_chunk_cb_data;
 #ifdef HAVE_LIBSERIALPORT
@@ -1285,6 +1670,7 @@ struct sr_serial_dev_inst {
 	const char *hid_path;
 	hid_device *hid_dev;
 	GSList *hid_source_args;
+	struct ser_hid_reader *hid_reader;
 #endif
 #ifdef HAVE_BLUETOOTH
 	enum ser_bt_conn_t {
@@ -1318,6 +1704,8 @@ struct drv_context {
 	/** sigrok context */
 	struct sr_context *sr_ctx;
 	GSList *instances;
+	/** Serializes changes to the instances list. */
+	GMutex instances_mutex;
 };
 
 /*--- log.c -----------------------------------------------------------------*/
@@ -1333,12 +1721,55 @@ SR_PRIV int sr_log(int loglevel, const char *format, ...)
 SR_PRIV int sr_log(int loglevel, const char *format, ...) G_GNUC_PRINTF(2, 3);
 #endif
 
-/* Message logging helpers with subsystem-specific prefix string. */
-#define sr_spew(...)	sr_log(SR_LOG_SPEW, LOG_PREFIX ": " __VA_ARGS__)
-#define sr_dbg(...)	sr_log(SR_LOG_DBG,  LOG_PREFIX ": " __VA_ARGS__)
-#define sr_info(...)	sr_log(SR_LOG_INFO, LOG_PREFIX ": " __VA_ARGS__)
-#define sr_warn(...)	sr_log(SR_LOG_WARN, LOG_PREFIX ": " __VA_ARGS__)
-#define sr_err(...)	sr_log(SR_LOG_ERR,  LOG_PREFIX ": " __VA_ARGS__)
+extern SR_PRIV int sr_log_curlevel;
+
+/*
+ * Most verbose loglevel which is compiled in. Builds which never need
+ * spew or debug messages can lower it (e.g. -DSR_LOG_MAX_LEVEL=SR_LOG_INFO),
+ * the compiler then drops these messages altogether.
+ */
+#ifndef SR_LOG_MAX_LEVEL
+#define SR_LOG_MAX_LEVEL SR_LOG_SPEW
+#endif
+
+/*
+ * Whether messages of the given loglevel are output. This is cheap, use
+ * it to avoid preparing log output (like hex dumps) on hot paths.
+ */
+#define sr_log_enabled(loglevel) \
+	((loglevel) <= SR_LOG_MAX_LEVEL && (loglevel) <= sr_log_curlevel)
+
+/*
+ * Message logging helpers with subsystem-specific prefix string. The
+ * arguments are only evaluated (and formatted) if the message is output.
+ */
+#define sr_log_gated(loglevel, ...) do { \
+	if (sr_log_enabled(loglevel)) \
+		sr_log(loglevel, LOG_PREFIX ": " __VA_ARGS__); \
+} while (0)
+
+#define sr_spew(...)	sr_log_gated(SR_LOG_SPEW, __VA_ARGS__)
+#define sr_dbg(...)	sr_log_gated(SR_LOG_DBG,  __VA_ARGS__)
+#define sr_info(...)	sr_log_gated(SR_LOG_INFO, __VA_ARGS__)
+#define sr_warn(...)	sr_log_gated(SR_LOG_WARN, __VA_ARGS__)
+#define sr_err(...)	sr_log_gated(SR_LOG_ERR,  __VA_ARGS__)
+
+/*
+ * Static USDT probe points, for use with SystemTap, perf or bpftrace.
+ * Probes are only built in with --enable-probes, and they cost a NOP
+ * until a tracer attaches. The provider name is "libsigrok".
+ */
+#ifdef HAVE_PROBES
+#include <sys/sdt.h>
+#define SR_PROBE1(name, a1) DTRACE_PROBE1(libsigrok, name, a1)
+#define SR_PROBE2(name, a1, a2) DTRACE_PROBE2(libsigrok, name, a1, a2)
+#define SR_PROBE3(name, a1, a2, a3) \
+	DTRACE_PROBE3(libsigrok, name, a1, a2, a3)
+#else
+#define SR_PROBE1(name, a1) do { } while (0)
+#define SR_PROBE2(name, a1, a2) do { } while (0)
+#define SR_PROBE3(name, a1, a2, a3) do { } while (0)
+#endif
 
 /*--- device.c --------------------------------------------------------------*/
 
@@ -1394,6 +1825,16 @@ struct sr_dev_inst {
 	void *priv;
 	/** Session to which this device is currently assigned. */
 	struct sr_session *session;
+	/** Config keys whose values can be cached, see sr_config_cache_init(). */
+	const struct sr_config_cache_key *cache_keys;
+	/** Number of entries in cache_keys. */
+	size_t num_cache_keys;
+	/** Cached config values, managed by hwdriver.c. */
+	GArray *config_cache;
+	/** Whether sr_dev_close() keeps the device open, see sr_dev_keepalive_set(). */
+	gboolean keepalive;
+	/** Whether the device is closed, but still open in the driver. */
+	gboolean parked;
 };
 
 /* Generic device instances */
@@ -1441,6 +1882,26 @@ SR_PRIV void sr_serial_dev_inst_free(struct sr_serial_dev_inst *serial);
 SR_PRIV struct sr_usbtmc_dev_inst *sr_usbtmc_dev_inst_new(const char *device);
 SR_PRIV void sr_usbtmc_dev_inst_free(struct sr_usbtmc_dev_inst *usbtmc);
 
+/*--- backend.c -------------------------------------------------------------*/
+
+SR_PRIV int sr_driver_sanity_check(const struct sr_dev_driver *driver);
+SR_PRIV int sr_input_module_sanity_check(const struct sr_input_module *imod);
+SR_PRIV int sr_output_module_sanity_check(const struct sr_output_module *omod);
+SR_PRIV int sr_transform_module_sanity_check(const struct sr_transform_module *tmod);
+#ifdef HAVE_LIBUSB_1_0
+SR_PRIV int sr_libusb_init(struct sr_context *ctx);
+#endif
+
+/*--- sched.c ---------------------------------------------------------------*/
+
+struct sr_thread_sched_state;
+
+SR_PRIV struct sr_thread_sched_state *sr_thread_sched_apply(
+		const struct sr_thread_sched *sched, gboolean save);
+SR_PRIV void sr_thread_sched_restore(struct sr_thread_sched_state *state);
+SR_PRIV void sr_mem_lock_acquire(void);
+SR_PRIV void sr_mem_lock_release(void);
+
 /*--- hwdriver.c ------------------------------------------------------------*/
 
 SR_PRIV const GVariantType *sr_variant_type_get(int datatype);
@@ -1451,8 +1912,37 @@ SR_PRIV void sr_config_free(struct sr_config *src);
 SR_PRIV int sr_dev_acquisition_start(struct sr_dev_inst *sdi);
 SR_PRIV int sr_dev_acquisition_stop(struct sr_dev_inst *sdi);
 
+/** How sr_config_get() may cache the value of a config key. */
+enum sr_config_cache_policy {
+	/** Always ask the driver (the default for keys not listed). */
+	SR_CONFIG_CACHE_LIVE = 0,
+	/** The value never changes while the device is open. */
+	SR_CONFIG_CACHE_STATIC,
+	/** The value only changes when config keys get set. */
+	SR_CONFIG_CACHE_UNTIL_SET,
+	/** Like SR_CONFIG_CACHE_UNTIL_SET, but also expires after ttl_ms. */
+	SR_CONFIG_CACHE_TTL,
+};
+
+/** Cache policy of a config key, declared by drivers next to their devopts. */
+struct sr_config_cache_key {
+	uint32_t key;
+	enum sr_config_cache_policy policy;
+	/** Lifetime of cached values, for SR_CONFIG_CACHE_TTL. */
+	unsigned int ttl_ms;
+};
+
+SR_PRIV void sr_config_cache_init(struct sr_dev_inst *sdi,
+		const struct sr_config_cache_key *keys, size_t num_keys);
+SR_PRIV void sr_config_cache_invalidate(const struct sr_dev_inst *sdi,
+		gboolean all);
+SR_PRIV void sr_config_cache_free(struct sr_dev_inst *sdi);
+
 /*--- session.c -------------------------------------------------------------*/
 
+struct datafeed_queue;
+struct session_poll;
+
 struct sr_session {
 	/** Context this session exists in. */
 	struct sr_context *ctx;
@@ -1463,6 +1953,16 @@ struct sr_session {
 	/** List of struct datafeed_callback pointers. */
 	GSList *datafeed_callbacks;
 	GSList *transforms;
+	/**
+	 * The two lists above as arrays, which get walked for each packet,
+	 * see sr_session_plan_update().
+	 */
+	struct datafeed_callback **callback_plan;
+	unsigned int num_callback_plan;
+	/** Packet types which any of the callbacks takes (SR_DF_MASK()). */
+	uint32_t callback_types;
+	struct sr_transform **transform_plan;
+	unsigned int num_transform_plan;
 	struct sr_trigger *trigger;
 
 	/** Callback to invoke on session stop. */
@@ -1475,16 +1975,93 @@ struct sr_session {
 	/** Context of the session main loop. */
 	GMainContext *main_context;
 
+	/** Protects the event source table and the stop check ID. */
+	GRecMutex sources_mutex;
 	/** Registered event sources for this session. */
 	GHashTable *event_sources;
 	/** Session main loop. */
 	GMainLoop *main_loop;
+	/** Pollable fd for external event loops, see sr_session_poll_fd_get(). */
+	struct session_poll *poll;
 	/** ID of idle source for dispatching the session stop notification. */
 	unsigned int stop_check_id;
 	/** Whether the session has been started. */
 	gboolean running;
+
+	/** Whether datafeed callbacks accept SR_DF_LOGIC_RLE packets. */
+	gboolean logic_rle;
+	/** Whether drivers may send several channels per SR_DF_ANALOG packet. */
+	gboolean analog_interleaved;
+	/** Whether datafeed callbacks take triggers marked in packets. */
+	gboolean trigger_inplace;
+	/** Datafeed queue depth, zero for synchronous delivery. */
+	size_t queue_depth;
+	/** What to do when the datafeed queue is full. */
+	int queue_policy;
+	/** Datafeed delivery thread and queue while running. */
+	struct datafeed_queue *df_queue;
+	/** Datafeed queue statistics of the last run. */
+	uint64_t queue_dropped;
+	uint64_t queue_stalled;
+	size_t queue_max_fill;
+	/** Whether each device runs in its own acquisition thread. */
+	gboolean per_dev_threads;
+	/** List of per-device acquisition threads while running. */
+	GSList *dev_threads;
+	/** Whether the devices get started in parallel. */
+	gboolean parallel_start;
+	/** Whether packets are held while the devices get started. */
+	gint start_holding;
+	/** Protects the held packets, struct datafeed_queue_item pointers. */
+	GMutex hold_mutex;
+	GSList *held;
+	/** Protects the counters below, see sr_session_stats_get(). */
+	GMutex stats_mutex;
+	/** Counters of the current or last run, without the arrays. */
+	struct sr_session_stats stats;
+	/** Latency budget for batching analog packets, 0 if disabled. */
+	unsigned int analog_batch_ms;
+	/** Grid which event source timeouts get aligned to, 0 if disabled. */
+	int64_t timer_slack_us;
+	/** Per thread settings, by enum sr_session_thread - 10000. */
+	struct sr_thread_sched thread_sched[4];
+	/** Whether to lock memory while running, and whether it is. */
+	gboolean mem_lock;
+	gboolean mem_locked;
+	/** Protects the pending batches, held while sending them. */
+	GRecMutex batch_mutex;
+	/** List of pending struct analog_batch pointers. */
+	GSList *analog_batches;
+	/** Timer which flushes batches that exceeded the latency budget. */
+	GSource *batch_timer;
+	/** Samples sent per device (logic) or channel (analog). */
+	GHashTable *sample_counts;
+	/** Whether to trace the data's age, see sr_session_latency_trace_set(). */
+	gboolean latency_trace;
+	/** Age of the data per device, struct latency_hist by sdi. */
+	GHashTable *dev_latency;
+	/** Time each device took to start, uint64_t microseconds by sdi. */
+	GHashTable *dev_arm_us;
 };
 
+/**
+ * Move a timeout to the end of its slot of a timer slack grid, so that
+ * all sources which are due within a slot get dispatched together.
+ * Sources with shorter timeouts than the slack keep their exact timing.
+ * @param due_us the monotonic time the source is due at
+ * @param timeout_us the source's timeout
+ * @param slack_us the slot size, 0 if timer slack is disabled
+ * @return the time the source gets dispatched at
+ */
+static inline int64_t sr_timer_slack_align(int64_t due_us,
+		int64_t timeout_us, int64_t slack_us)
+{
+	if (slack_us <= 0 || timeout_us < slack_us)
+		return due_us;
+
+	return (due_us + slack_us - 1) / slack_us * slack_us;
+}
+
 SR_PRIV int sr_session_source_add_internal(struct sr_session *session,
 		void *key, GSource *source);
 SR_PRIV int sr_session_source_remove_internal(struct sr_session *session,
@@ -1497,6 +2074,10 @@ SR_PRIV int sr_session_fd_source_add(struct sr_session *session,
 
 SR_PRIV int sr_session_source_add(struct sr_session *session, int fd,
 		int events, int timeout, sr_receive_data_callback cb, void *cb_data);
+SR_PRIV void sr_session_source_wake_at(int64_t due_us);
+SR_PRIV int64_t sr_session_source_time(void);
+SR_PRIV void sr_session_receive_mark(int64_t time);
+SR_PRIV int sr_session_source_notify(struct sr_session *session, void *key);
 SR_PRIV int sr_session_source_add_pollfd(struct sr_session *session,
 		GPollFD *pollfd, int timeout, sr_receive_data_callback cb,
 		void *cb_data);
@@ -1513,6 +2094,29 @@ SR_PRIV int sr_session_send_meta(const struct sr_dev_inst *sdi,
 		uint32_t key, GVariant *var);
 SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
 		const struct sr_datafeed_packet *packet);
+SR_PRIV void sr_session_plan_update(struct sr_session *session);
+SR_PRIV gboolean sr_session_takes_logic_rle(const struct sr_session *session);
+SR_PRIV gboolean sr_session_takes_analog_interleaved(
+		const struct sr_session *session);
+SR_PRIV gboolean sr_session_takes_trigger_inplace(
+		const struct sr_session *session);
+SR_PRIV int sr_session_datafeed_thread_start(struct sr_session *session,
+		size_t depth);
+SR_PRIV void sr_session_datafeed_thread_stop(struct sr_session *session);
+SR_PRIV int sr_transform_send(const struct sr_transform *t,
+		struct sr_datafeed_packet *packet);
+SR_PRIV int sr_logic_rle_expand(const struct sr_datafeed_logic_rle *rle,
+		int (*cb)(const struct sr_datafeed_packet *packet, void *cb_data),
+		void *cb_data);
+SR_PRIV int sr_session_send_zerocopy(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet,
+		GDestroyNotify release, void *release_data);
+SR_PRIV int sr_session_send_timed(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet,
+		const struct sr_packet_timing *timing);
+SR_PRIV int sr_session_send_triggered(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, uint64_t trigger_at,
+		GDestroyNotify release, void *release_data);
 SR_PRIV int sr_sessionfile_check(const char *filename);
 SR_PRIV struct sr_dev_inst *sr_session_prepare_sdi(const char *filename,
 		struct sr_session **session);
@@ -1527,6 +2131,59 @@ SR_PRIV void sr_zip_discard(struct zip *archive);
 
 SR_PRIV GKeyFile *sr_sessionfile_read_metadata(struct zip *archive,
 			const struct zip_stat *entry);
+SR_PRIV GKeyFile *sr_sessionfile_load_metadata(const char *filename);
+SR_PRIV int sr_sessionfile_xor_filter(GKeyFile *kf, gboolean *xor_delta);
+SR_PRIV void sr_sessionfile_xor_decode(uint8_t *data, size_t length,
+		uint8_t *prev, size_t unitsize);
+
+/*--- output/output.c ------------------------------------------------------*/
+
+/** Consecutive columns whose bits are in the same sample byte. */
+struct sr_output_logic_group {
+	/** Position of the byte within a sample. */
+	size_t byte_pos;
+	/** First column, and number of columns (at most 8). */
+	size_t first;
+	size_t count;
+	/** The columns' 0/1 values for every value of the byte. */
+	uint8_t spread[256][8];
+};
+
+/**
+ * Where the enabled logic channels are in a sample, built once at an
+ * output module's init(). Columns are the enabled logic channels in
+ * the order of the device's channel list.
+ */
+struct sr_output_logic_map {
+	/** Number of columns. */
+	size_t num_channels;
+	/** The channel of every column. */
+	struct sr_channel **channels;
+	/** Byte position and bit mask of every column within a sample. */
+	size_t *byte_pos;
+	uint8_t *bit_mask;
+	/** Sample bytes up to the last one with an enabled channel. */
+	size_t num_bytes;
+	/** Enabled bits of a sample, as little endian 64 bit words. */
+	size_t num_words;
+	uint64_t *word_mask;
+	/** Whether the bit positions ascend with the columns. */
+	gboolean ascending;
+	/** Byte groups, for sr_output_logic_gather(). */
+	size_t num_groups;
+	struct sr_output_logic_group *groups;
+};
+
+SR_PRIV struct sr_output_logic_map *sr_output_logic_map_new(
+		const struct sr_dev_inst *sdi);
+SR_PRIV void sr_output_logic_map_free(struct sr_output_logic_map *map);
+SR_PRIV void sr_output_logic_gather(const struct sr_output_logic_map *map,
+		const uint8_t *sample, size_t unitsize, uint8_t *row);
+
+/*--- transform/transform.c -----------------------------------------------*/
+
+SR_PRIV void *sr_transform_buffer(const struct sr_transform *t,
+		unsigned int id, size_t size);
 
 /*--- analog.c --------------------------------------------------------------*/
 
@@ -1535,6 +2192,39 @@ SR_PRIV int sr_analog_init(struct sr_datafeed_analog *analog,
                            struct sr_analog_meaning *meaning,
                            struct sr_analog_spec *spec,
                            int digits);
+SR_PRIV void sr_rational_from_double(struct sr_rational *r, double value);
+
+/**
+ * Collects the samples of several analog channels of a device, which
+ * get sent as one interleaved SR_DF_ANALOG packet of float values.
+ */
+struct sr_analog_interleave {
+	/** The packet's channels, in this order within a sample. */
+	GSList *channels;
+	size_t num_channels;
+	/** Room for this many samples per channel. */
+	size_t size;
+	/** Samples collected per channel. */
+	size_t *fill;
+	/** The samples, num_channels values per sample. */
+	float *data;
+	/** Conversion buffer for a packet's samples. */
+	float *scratch;
+	size_t scratch_size;
+	/** Taken from the packets which get added. */
+	int digits;
+	enum sr_mq mq;
+	enum sr_unit unit;
+	enum sr_mqflag mqflags;
+};
+
+SR_PRIV struct sr_analog_interleave *sr_analog_interleave_new(
+		const GSList *channels, size_t size);
+SR_PRIV void sr_analog_interleave_free(struct sr_analog_interleave *il);
+SR_PRIV int sr_analog_interleave_add(struct sr_analog_interleave *il,
+		const struct sr_datafeed_analog *analog);
+SR_PRIV int sr_analog_interleave_send(struct sr_analog_interleave *il,
+		const struct sr_dev_inst *sdi);
 
 /*--- std.c -----------------------------------------------------------------*/
 
@@ -1624,6 +2314,31 @@ SR_PRIV gssize sr_resource_read(struct sr_context *ctx,
 SR_PRIV void *sr_resource_load(struct sr_context *ctx, int type,
 		const char *name, size_t *size, size_t max_size)
 		G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
+SR_PRIV GBytes *sr_resource_load_bytes(struct sr_context *ctx, int type,
+		const char *name, size_t max_size) G_GNUC_WARN_UNUSED_RESULT;
+SR_PRIV void sr_resource_cache_clear(struct sr_context *ctx);
+
+/*--- mem_budget.c ----------------------------------------------------------*/
+
+SR_PRIV gboolean sr_mem_reserve(struct sr_context *ctx,
+		const char *component, size_t size);
+SR_PRIV void sr_mem_release(struct sr_context *ctx, const char *component,
+		size_t size);
+SR_PRIV void *sr_mem_alloc(struct sr_context *ctx, const char *component,
+		size_t size);
+SR_PRIV void *sr_mem_alloc_node(struct sr_context *ctx,
+		const char *component, size_t size, int node);
+SR_PRIV void sr_mem_free(struct sr_context *ctx, void *buf);
+SR_PRIV GBytes *sr_mem_bytes_new(struct sr_context *ctx, void *buf,
+		size_t size);
+SR_PRIV void sr_mem_cleanup(struct sr_context *ctx);
+
+/*--- scan_cache.c ----------------------------------------------------------*/
+
+SR_PRIV char *sr_scan_cache_lookup(struct sr_context *ctx, const char *key,
+		const char *identity, const char *name);
+SR_PRIV void sr_scan_cache_store(struct sr_context *ctx, const char *key,
+		const char *identity, const char *name, const char *value);
 
 /*--- strutil.c -------------------------------------------------------------*/
 
@@ -1640,26 +2355,88 @@ SR_PRIV void sr_hexdump_free(GString *s);
 
 /*--- soft-trigger.c --------------------------------------------------------*/
 
+struct soft_trigger_stage;
+
+/*
+ * Circular buffer which holds the most recent samples before a trigger.
+ * Where possible, the buffer's pages are mapped twice in a row, so that
+ * its content is contiguous at any head position.
+ */
+struct soft_trigger_history {
+	/* The context whose memory budget the buffer counts against. */
+	struct sr_context *ctx;
+	uint8_t *buffer;
+	/* The buffer's size, of each of its views when mirrored. */
+	size_t capacity;
+	/* The number of most recent bytes to keep. */
+	size_t size;
+	size_t head;
+	size_t fill;
+	gboolean mirrored;
+};
+
 struct soft_trigger_logic {
 	const struct sr_dev_inst *sdi;
 	const struct sr_trigger *trigger;
-	int count;
+	struct soft_trigger_stage *stages;
+	size_t num_stages;
+	size_t num_words;
 	int unitsize;
 	int cur_stage;
 	uint8_t *prev_sample;
-	uint8_t *pre_trigger_buffer;
-	uint8_t *pre_trigger_head;
-	int pre_trigger_size;
-	int pre_trigger_fill;
+	gboolean have_prev;
+	struct soft_trigger_history pre_trigger;
 };
 
 SR_PRIV int logic_channel_unitsize(GSList *channels);
 SR_PRIV struct soft_trigger_logic *soft_trigger_logic_new(
 		const struct sr_dev_inst *sdi, struct sr_trigger *trigger,
 		int pre_trigger_samples);
+SR_PRIV struct soft_trigger_logic *soft_trigger_logic_new_split(
+		const struct sr_dev_inst *sdi, struct sr_trigger *trigger,
+		int unitsize);
 SR_PRIV void soft_trigger_logic_free(struct soft_trigger_logic *st);
 SR_PRIV int soft_trigger_logic_check(struct soft_trigger_logic *st, uint8_t *buf,
 		int len, int *pre_trigger_samples);
+SR_PRIV int soft_trigger_logic_scan(struct soft_trigger_logic *st,
+		const uint8_t *buf, int len);
+
+/* What a hardware trigger can express, see soft_trigger_hw_stages(). */
+struct soft_trigger_hw_caps {
+	/* Most stages the hardware checks in sequence. */
+	int max_stages;
+	/* The match types it checks, SOFT_TRIGGER_MATCH() bits. */
+	uint32_t matches;
+	/* Most edge matches within a stage, -1 for any number. */
+	int max_edges;
+};
+#define SOFT_TRIGGER_MATCH(m)	(UINT32_C(1) << (m))
+
+SR_PRIV int soft_trigger_hw_stages(const struct sr_trigger *trigger,
+		const struct soft_trigger_hw_caps *caps);
+SR_PRIV void soft_trigger_logic_hw_fired(struct soft_trigger_logic *st,
+		const uint8_t *sample, int hw_stages);
+
+struct soft_trigger_analog {
+	const struct sr_dev_inst *sdi;
+	const struct sr_channel *channel;
+	int match;
+	float level;
+	/* The level to cross first, which arms the trigger. */
+	float arm_level;
+	gboolean armed;
+	int pre_trigger_samples;
+	/* Unit size of the samples, 0 until the first packet. */
+	int unitsize;
+	struct soft_trigger_history pre_trigger;
+};
+
+SR_PRIV struct soft_trigger_analog *soft_trigger_analog_new(
+		const struct sr_dev_inst *sdi, struct sr_trigger *trigger,
+		int pre_trigger_samples, float hysteresis);
+SR_PRIV void soft_trigger_analog_free(struct soft_trigger_analog *sta);
+SR_PRIV int soft_trigger_analog_check(struct soft_trigger_analog *sta,
+		const struct sr_datafeed_analog *analog, int *pre_trigger_samples);
 
 /*--- serial.c --------------------------------------------------------------*/
 
@@ -1675,6 +2452,10 @@ typedef GSList *(*sr_ser_list_append_t)(GSList *devs, const char *name,
 		const char *desc);
 typedef GSList *(*sr_ser_find_append_t)(GSList *devs, const char *name);
 
+SR_PRIV void sr_serial_cache_begin(void);
+SR_PRIV void sr_serial_cache_end(void);
+SR_PRIV void sr_serial_cache_invalidate(void);
+
 SR_PRIV int serial_open(struct sr_serial_dev_inst *serial, int flags);
 SR_PRIV int serial_close(struct sr_serial_dev_inst *serial);
 SR_PRIV int serial_flush(struct sr_serial_dev_inst *serial);
@@ -1688,6 +2469,9 @@ SR_PRIV int serial_read_blocking(struct sr_serial_dev_inst *serial, void *buf,
 		size_t count, unsigned int timeout_ms);
 SR_PRIV int serial_read_nonblocking(struct sr_serial_dev_inst *serial, void *buf,
 		size_t count);
+SR_PRIV int serial_peek(struct sr_serial_dev_inst *serial,
+		const uint8_t **data, size_t *len);
+SR_PRIV void serial_consume(struct sr_serial_dev_inst *serial, size_t len);
 SR_PRIV int serial_set_read_chunk_cb(struct sr_serial_dev_inst *serial,
 		serial_rx_chunk_callback cb, void *cb_data);
 SR_PRIV int serial_set_params(struct sr_serial_dev_inst *serial, int baudrate,
@@ -1801,6 +2585,9 @@ SR_PRIV int sr_bt_config_rfcomm(struct sr_bt_desc *desc, size_t channel);
 SR_PRIV int sr_bt_config_notify(struct sr_bt_desc *desc,
 	uint16_t read_handle, uint16_t write_handle,
 	uint16_t cccd_handle, uint16_t cccd_value);
+SR_PRIV int sr_bt_config_mtu(struct sr_bt_desc *desc, uint16_t mtu);
+SR_PRIV int sr_bt_config_conn_interval(struct sr_bt_desc *desc,
+	unsigned int min_us, unsigned int max_us);
 
 SR_PRIV int sr_bt_scan_le(struct sr_bt_desc *desc, int duration);
 SR_PRIV int sr_bt_scan_bt(struct sr_bt_desc *desc, int duration);
@@ -1826,20 +2613,139 @@ SR_PRIV int ezusb_install_firmware(struct sr_context *ctx, libusb_device_handle
 				   const char *name);
 SR_PRIV int ezusb_upload_firmware(struct sr_context *ctx, libusb_device *dev,
 				  int configuration, const char *name);
+SR_PRIV void ezusb_upload_firmware_queue(GSList **uploads,
+		struct sr_context *ctx, libusb_device *dev,
+		int configuration, const char *name, int64_t *fw_updated);
+SR_PRIV void ezusb_upload_firmware_run(GSList *uploads);
 #endif
 
 /*--- usb.c -----------------------------------------------------------------*/
 
 #ifdef HAVE_LIBUSB_1_0
-SR_PRIV GSList *sr_usb_find(libusb_context *usb_ctx, const char *conn);
+SR_PRIV void sr_usb_snapshot_begin(struct sr_context *ctx);
+SR_PRIV void sr_usb_snapshot_end(struct sr_context *ctx);
+SR_PRIV void sr_usb_snapshot_invalidate(struct sr_context *ctx);
+SR_PRIV ssize_t sr_usb_get_device_list(struct sr_context *ctx,
+		libusb_device ***list);
+SR_PRIV GSList *sr_usb_find(struct sr_context *ctx, const char *conn);
 SR_PRIV int sr_usb_open(libusb_context *usb_ctx, struct sr_usb_dev_inst *usb);
 SR_PRIV void sr_usb_close(struct sr_usb_dev_inst *usb);
 SR_PRIV int usb_source_add(struct sr_session *session, struct sr_context *ctx,
 		int timeout, sr_receive_data_callback cb, void *cb_data);
 SR_PRIV int usb_source_remove(struct sr_session *session, struct sr_context *ctx);
+SR_PRIV void usb_event_thread_cleanup(struct sr_context *ctx);
 SR_PRIV int usb_get_port_path(libusb_device *dev, char *path, int path_len);
-SR_PRIV gboolean usb_match_manuf_prod(libusb_device *dev,
-		const char *manufacturer, const char *product);
+SR_PRIV gboolean usb_match_manuf_prod(struct sr_context *ctx,
+		libusb_device *dev, const char *manufacturer, const char *product);
+
+#define USB_XFER_POOL_MAX_DEPTH 256
+#define USB_XFER_POOL_MAX_SIZE (16 * 1024 * 1024)
+
+/** Bulk transfers and their buffers, kept across acquisitions. */
+struct sr_usb_xfer_pool {
+	struct libusb_transfer **transfers;
+	unsigned int num_transfers;
+	size_t buffer_size;
+	libusb_device_handle *devhdl;
+	/* Buffers were allocated with libusb_dev_mem_alloc(). */
+	gboolean dev_mem;
+	/* SR_CONF_USB_TRANSFER_DEPTH/_SIZE, 0 means driver default. */
+	unsigned int user_depth;
+	size_t user_size;
+	/* Runtime sizing, see sr_usb_xfer_pool_adapt(). */
+	unsigned int depth;
+	unsigned int min_depth;
+	size_t size;
+	int size_shift;
+	unsigned int warmup;
+	unsigned int window_count;
+	int64_t window_start;
+	int64_t last_complete;
+	unsigned int burst;
+	unsigned int max_burst;
+};
+
+SR_PRIV size_t sr_usb_xfer_pool_buffer_size(const struct sr_usb_xfer_pool *pool,
+		size_t size);
+SR_PRIV unsigned int sr_usb_xfer_pool_depth(const struct sr_usb_xfer_pool *pool,
+		unsigned int num);
+SR_PRIV int sr_usb_xfer_pool_alloc(struct sr_usb_xfer_pool *pool,
+		libusb_device_handle *devhdl, unsigned int num, size_t size);
+SR_PRIV void sr_usb_xfer_pool_free(struct sr_usb_xfer_pool *pool);
+SR_PRIV unsigned int sr_usb_xfer_pool_adapt(struct sr_usb_xfer_pool *pool,
+		const struct libusb_transfer *transfer);
+SR_PRIV int sr_usb_xfer_pool_config_get(const struct sr_usb_xfer_pool *pool,
+		uint32_t key, GVariant **data);
+SR_PRIV int sr_usb_xfer_pool_config_set(struct sr_usb_xfer_pool *pool,
+		uint32_t key, GVariant *data);
+SR_PRIV void sr_usb_transfer_account(const struct sr_dev_inst *sdi,
+		const struct libusb_transfer *transfer);
+SR_PRIV int sr_usb_transfer_submit(struct libusb_transfer *transfer);
+SR_PRIV int sr_usb_numa_node(const struct sr_usb_dev_inst *usb);
+SR_PRIV int sr_usb_bulk_write(struct sr_context *ctx,
+		const struct sr_usb_dev_inst *usb, unsigned char endpoint,
+		const uint8_t *data, size_t len, unsigned int timeout);
+
+/** Device specifics for sr_usb_fpga_configure(). */
+struct sr_usb_fpga_loader {
+	/* Bulk OUT endpoint the bitstream gets written to. */
+	unsigned char endpoint;
+	/* Zero-pad the bitstream to this many bytes, 0 for no padding. */
+	size_t pad_to;
+	/* Timeout per transfer, in ms. */
+	unsigned int timeout;
+	/*
+	 * Tells whether the FPGA runs a bitstream. Optional, without it
+	 * the bitstream gets uploaded every time.
+	 */
+	int (*is_configured)(const struct sr_dev_inst *sdi,
+			gboolean *configured);
+	/* Prepares the upload of "size" bytes. Optional. */
+	int (*begin)(const struct sr_dev_inst *sdi, size_t size);
+	/* Completes and checks the upload. Optional. */
+	int (*end)(const struct sr_dev_inst *sdi);
+};
+
+SR_PRIV int sr_usb_fpga_configure(const struct sr_dev_inst *sdi,
+		const struct sr_usb_fpga_loader *loader, const char *name,
+		size_t max_size, size_t *size);
+SR_PRIV int sr_usb_transfer_cancel(struct libusb_transfer *transfer);
+#endif
+
+/*--- usb_replay.c ----------------------------------------------------------*/
+
+#ifdef HAVE_LIBUSB_1_0
+/** SR_CONF_CONN prefix of a USB recording to replay. */
+#define SR_USB_REPLAY_PREFIX "replay:"
+
+/** What a USB recording tells about the recorded device. */
+struct sr_usb_replay_info {
+	uint16_t vid;
+	uint16_t pid;
+	/* The device instance's model, NULL if it had none. */
+	char *model;
+	/* 0 if the driver had no samplerate. */
+	uint64_t samplerate;
+	/* Names of the enabled channels. */
+	char **channels;
+};
+
+SR_PRIV void sr_usb_record_transfer(const struct sr_dev_inst *sdi,
+		const struct libusb_transfer *transfer);
+SR_PRIV void sr_usb_record_free(struct sr_usb_record *rec);
+SR_PRIV struct sr_usb_dev_inst *sr_usb_replay_open(const char *conn,
+		const char *driver);
+SR_PRIV const struct sr_usb_replay_info *sr_usb_replay_info_get(
+		const struct sr_usb_dev_inst *usb);
+SR_PRIV void sr_usb_replay_channels_apply(struct sr_dev_inst *sdi);
+SR_PRIV void sr_usb_replay_free(struct sr_usb_replay *r);
+SR_PRIV struct sr_usb_replay *sr_usb_replay_get(
+		const struct libusb_device_handle *devhdl);
+SR_PRIV int sr_usb_replay_submit(struct sr_usb_replay *r,
+		struct libusb_transfer *transfer);
+SR_PRIV int sr_usb_replay_cancel(struct sr_usb_replay *r,
+		struct libusb_transfer *transfer);
+SR_PRIV int sr_usb_replay_start(const struct sr_dev_inst *sdi);
 #endif
 
 /*--- binary_helpers.c ------------------------------------------------------*/
@@ -1910,9 +2816,59 @@ SR_PRIV int bv_get_value(float *out, const struct binary_value_spec *spec, const
 SR_PRIV int bv_send_analog_channel(const struct sr_dev_inst *sdi, struct sr_channel *ch,
 				   const struct binary_analog_channel *spec, const void *data, size_t length);
 
+/**
+ * Send analog packets for the enabled channels of a device, based on
+ * a table of binary analog channel specifications.
+ *
+ * @param sdi Device instance, its channels are in the order of @a specs
+ * @param specs Channel specifications, terminated by one without a name
+ * @param data Pointer to binary blob
+ * @param length Size of binary blob
+ * @return SR_OK on success, SR_ERR_* error code on failure.
+ */
+SR_PRIV int bv_send_analog_channels(const struct sr_dev_inst *sdi,
+				    const struct binary_analog_channel *specs, const void *data, size_t length);
+
+/**
+ * Request/response polling state, for devices which send a block of
+ * measurements in response to a request. There is at most one request
+ * pending. The next one is due a period after the previous one, or upon
+ * its response when the device takes longer than a period to respond.
+ */
+struct bv_poller {
+	/** Shortest time between requests */
+	int64_t period_us;
+	/** Time after which a response is considered lost */
+	int64_t timeout_us;
+	/** When the pending request was sent, 0 if none is pending */
+	int64_t sent_us;
+	/** When the next request is due */
+	int64_t next_us;
+};
+
+SR_PRIV void bv_poller_init(struct bv_poller *poller,
+			    unsigned int period_ms, unsigned int timeout_ms);
+SR_PRIV gboolean bv_poller_due(struct bv_poller *poller);
+SR_PRIV void bv_poller_sent(struct bv_poller *poller);
+SR_PRIV void bv_poller_done(struct bv_poller *poller);
+
 /*--- crc.c -----------------------------------------------------------------*/
 
+#define SR_CRC8_DEFAULT_INIT 0x00U
 #define SR_CRC16_DEFAULT_INIT 0xffffU
+#define SR_CRC32_DEFAULT_INIT 0x00000000U
+
+/**
+ * Calculate a CRC8 checksum using the 0x07 polynomial, MSB first.
+ *
+ * This CRC8 flavor is also known as CRC-8/SMBUS.
+ *
+ * @param crc Initial value (typically 0), or the result of a previous call
+ * @param buffer Input buffer
+ * @param len Buffer length
+ * @return Checksum
+ */
+SR_PRIV uint8_t sr_crc8(uint8_t crc, const uint8_t *buffer, size_t len);
 
 /**
  * Calculate a CRC16 checksum using the 0x8005 polynomial.
@@ -1926,12 +2882,71 @@ SR_PRIV int bv_send_analog_channel(const struct sr_dev_inst *sdi, struct sr_chan
  */
 SR_PRIV uint16_t sr_crc16(uint16_t crc, const uint8_t *buffer, int len);
 
+/**
+ * Calculate a CRC16 checksum using the reflected 0x1021 polynomial.
+ *
+ * This CRC16 flavor is also known as CRC-16/MCRF4XX. Unlike X.25 there
+ * is no final inversion.
+ *
+ * @param crc Initial value (typically 0xffff)
+ * @param buffer Input buffer
+ * @param len Buffer length
+ * @return Checksum
+ */
+SR_PRIV uint16_t sr_crc16_mcrf4xx(uint16_t crc, const uint8_t *buffer,
+	size_t len);
+
+/**
+ * Calculate a CRC32 checksum using the 0x04c11db7 polynomial.
+ *
+ * This is the CRC of zlib, Ethernet and PNG. Like zlib's crc32(), the
+ * inversions are applied internally, so results can be passed back in.
+ *
+ * @param crc Initial value (0), or the result of a previous call
+ * @param buffer Input buffer
+ * @param len Buffer length
+ * @return Checksum
+ */
+SR_PRIV uint32_t sr_crc32(uint32_t crc, const uint8_t *buffer, size_t len);
+
+/**
+ * Calculate the 8 bit sum of the bytes in a buffer.
+ *
+ * @param sum Initial value, or the result of a previous call
+ * @param buffer Input buffer
+ * @param len Buffer length
+ * @return Sum modulo 256
+ */
+SR_PRIV uint8_t sr_sum8(uint8_t sum, const uint8_t *buffer, size_t len);
+
+/**
+ * Calculate the 16 bit sum of the bytes in a buffer.
+ *
+ * @param sum Initial value, or the result of a previous call
+ * @param buffer Input buffer
+ * @param len Buffer length
+ * @return Sum modulo 65536
+ */
+SR_PRIV uint16_t sr_sum16(uint16_t sum, const uint8_t *buffer, size_t len);
+
+/**
+ * Calculate the XOR of the bytes in a buffer.
+ *
+ * @param sum Initial value, or the result of a previous call
+ * @param buffer Input buffer
+ * @param len Buffer length
+ * @return Checksum
+ */
+SR_PRIV uint8_t sr_xor8(uint8_t sum, const uint8_t *buffer, size_t len);
+
 /*--- modbus/modbus.c -------------------------------------------------------*/
 
 struct sr_modbus_dev_inst {
 	const char *name;
 	const char *prefix;
 	int priv_size;
+	/* Requests which may be sent ahead of reading replies (0 means 1). */
+	unsigned int max_pending;
 	GSList *(*scan)(int modbusaddr);
 	int (*dev_inst_new)(void *priv, const char *resource,
 		char **params, const char *serialcomm, int modbusaddr);
@@ -1949,6 +2964,18 @@ struct sr_modbus_dev_inst {
 	void *priv;
 };
 
+/** One of the reads of sr_modbus_read_holding_registers_multi(). */
+struct sr_modbus_read {
+	/** The Modbus address of the first register to read. */
+	int address;
+	/** The number of registers to read. */
+	int nb_registers;
+	/** Buffer which receives the registers values. */
+	uint16_t *registers;
+	/** The result of this read. */
+	int result;
+};
+
 SR_PRIV GSList *sr_modbus_scan(struct drv_context *drvc, GSList *options,
 		struct sr_dev_inst *(*probe_device)(struct sr_modbus_dev_inst *modbus));
 SR_PRIV struct sr_modbus_dev_inst *modbus_dev_inst_new(const char *resource,
@@ -1971,6 +2998,9 @@ SR_PRIV int sr_modbus_read_coils(struct sr_modbus_dev_inst *modbus,
 SR_PRIV int sr_modbus_read_holding_registers(struct sr_modbus_dev_inst *modbus,
                                              int address, int nb_registers,
                                              uint16_t *registers);
+SR_PRIV int sr_modbus_read_holding_registers_multi(
+		struct sr_modbus_dev_inst *modbus,
+		struct sr_modbus_read *reads, int num, int max_gap);
 SR_PRIV int sr_modbus_write_coil(struct sr_modbus_dev_inst *modbus,
                                  int address, int value);
 SR_PRIV int sr_modbus_write_multiple_registers(struct sr_modbus_dev_inst*modbus,
@@ -1979,6 +3009,11 @@ SR_PRIV int sr_modbus_write_multiple_registers(struct sr_modbus_dev_inst*modbus,
 SR_PRIV int sr_modbus_close(struct sr_modbus_dev_inst *modbus);
 SR_PRIV void sr_modbus_free(struct sr_modbus_dev_inst *modbus);
 
+/*--- dmm/common.c ----------------------------------------------------------*/
+
+SR_PRIV gboolean sr_dmm_sync_nibbles_valid(const uint8_t *buf, size_t len);
+SR_PRIV float sr_dmm_pow10f(int exponent);
+
 /*--- dmm/es519xx.c ---------------------------------------------------------*/
 
 /**
@@ -2398,6 +3433,8 @@ SR_PRIV int sr_sw_limits_config_set(struct sr_sw_limits *limits, uint32_t key,
 	GVariant *data);
 SR_PRIV void sr_sw_limits_acquisition_start(struct sr_sw_limits *limits);
 SR_PRIV gboolean sr_sw_limits_check(struct sr_sw_limits *limits);
+SR_PRIV int64_t sr_sw_limits_deadline(const struct sr_sw_limits *limits);
+SR_PRIV uint64_t sr_sw_limits_samples_remaining(const struct sr_sw_limits *limits);
 SR_PRIV void sr_sw_limits_update_samples_read(struct sr_sw_limits *limits,
 	uint64_t samples_read);
 SR_PRIV void sr_sw_limits_update_frames_read(struct sr_sw_limits *limits,
@@ -2412,8 +3449,12 @@ struct feed_queue_analog;
 SR_API struct feed_queue_logic *feed_queue_logic_alloc(
 	struct sr_dev_inst *sdi,
 	size_t sample_count, size_t unit_size);
+SR_API int feed_queue_logic_send_runs(struct feed_queue_logic *q,
+	size_t run_count);
 SR_API int feed_queue_logic_submit(struct feed_queue_logic *q,
 	const uint8_t *data, size_t count);
+SR_API int feed_queue_logic_submit_many(struct feed_queue_logic *q,
+	const uint8_t *data, size_t count);
 SR_API int feed_queue_logic_flush(struct feed_queue_logic *q);
 SR_API void feed_queue_logic_free(struct feed_queue_logic *q);
 
@@ -2422,6 +3463,13 @@ SR_API struct feed_queue_analog *feed_queue_analog_alloc(
 	size_t sample_count, int digits, struct sr_channel *ch);
 SR_API int feed_queue_analog_submit(struct feed_queue_analog *q,
 	float data, size_t count);
+SR_API int feed_queue_analog_submit_many(struct feed_queue_analog *q,
+	const float *data, size_t count);
+SR_API int feed_queue_analog_encoding_set(struct feed_queue_analog *q,
+	size_t unit_size, gboolean is_signed,
+	const struct sr_rational *scale, const struct sr_rational *offset);
+SR_API int feed_queue_analog_submit_raw(struct feed_queue_analog *q,
+	const void *data, size_t count);
 SR_API int feed_queue_analog_flush(struct feed_queue_analog *q);
 SR_API void feed_queue_analog_free(struct feed_queue_analog *q);
 
@@ -20,6 +20,7 @@
 #include <config.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include <glib/gprintf.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
@@ -42,8 +43,11 @@
  * @{
  */
 
-/* Currently selected libsigrok loglevel. Default: SR_LOG_WARN. */
-static int cur_loglevel = SR_LOG_WARN; /* Show errors+warnings per default. */
+/*
+ * Currently selected libsigrok loglevel. Default: SR_LOG_WARN.
+ * Not static, the logging macros check it before calling sr_log().
+ */
+SR_PRIV int sr_log_curlevel = SR_LOG_WARN; /* Show errors+warnings per default. */
 
 /* Function prototype. */
 static int sr_logv(void *cb_data, int loglevel, const char *format,
@@ -58,11 +62,57 @@ static sr_log_callback sr_log_cb = sr_logv;
  */
 static void *sr_log_cb_data = NULL;
 
+/*
+ * Keeps the callback and its data consistent for threads which log
+ * while another one changes them. Only held to copy them, not while
+ * the callback runs.
+ */
+static GRWLock sr_log_cb_lock;
+
 /** @cond PRIVATE */
 #define LOGLEVEL_TIMESTAMP SR_LOG_DBG
 /** @endcond */
 static int64_t sr_log_start_time = 0;
 
+/** @cond PRIVATE */
+/* Longest message the asynchronous sink keeps, longer ones get cut. */
+#define LOG_ASYNC_MSG_SIZE 256
+/* How long the writer sleeps when there is nothing to write, in us. */
+#define LOG_ASYNC_IDLE_US 5000
+/** @endcond */
+
+/*
+ * Slot of the asynchronous sink's ring. The sequence number tells
+ * producers and the writer whose turn the slot is (a bounded queue
+ * after D. Vyukov): "pos" for a free slot at that position, "pos + 1"
+ * for a message written there.
+ */
+struct log_record {
+	gint seq;
+	int loglevel;
+	int64_t time;
+	/* Identifies repeats of the same message together with the text. */
+	const char *format;
+	char text[LOG_ASYNC_MSG_SIZE];
+};
+
+/* Asynchronous sink, see sr_log_async_start(). */
+static struct {
+	struct log_record *ring;
+	guint mask;
+	/* Next position producers write to, and the writer reads from. */
+	gint head;
+	guint tail;
+	gint active;
+	/* Threads in the middle of putting a message into the ring. */
+	gint producers;
+	gint dropped;
+	GThread *thread;
+	gint running;
+	/* The message the writer currently emits was taken at this time. */
+	int64_t emit_time;
+} log_async;
+
 /**
  * Set the libsigrok loglevel.
  *
@@ -90,7 +140,7 @@ SR_API int sr_log_loglevel_set(int loglevel)
 	if (loglevel >= LOGLEVEL_TIMESTAMP && sr_log_start_time == 0)
 		sr_log_start_time = g_get_monotonic_time();
 
-	cur_loglevel = loglevel;
+	sr_log_curlevel = loglevel;
 
 	sr_dbg("libsigrok loglevel set to %d.", loglevel);
 
@@ -106,7 +156,7 @@ SR_API int sr_log_loglevel_set(int loglevel)
  */
 SR_API int sr_log_loglevel_get(void)
 {
-	return cur_loglevel;
+	return sr_log_curlevel;
 }
 
 /**
@@ -120,6 +170,10 @@ SR_API int sr_log_loglevel_get(void)
  *                never used or interpreted in any way. The pointer is allowed
  *                to be NULL if the caller doesn't need/want to pass any data.
  *
+ * The callback gets called from whichever thread logs. This can be
+ * changed while other threads log; messages which were being emitted
+ * at that time may still reach the previous callback.
+ *
  * @return SR_OK upon success, SR_ERR_ARG upon invalid arguments.
  *
  * @since 0.3.0
@@ -133,8 +187,10 @@ SR_API int sr_log_callback_set(sr_log_callback cb, void *cb_data)
 
 	/* Note: 'cb_data' is allowed to be NULL. */
 
+	g_rw_lock_writer_lock(&sr_log_cb_lock);
 	sr_log_cb = cb;
 	sr_log_cb_data = cb_data;
+	g_rw_lock_writer_unlock(&sr_log_cb_lock);
 
 	return SR_OK;
 }
@@ -154,8 +210,10 @@ SR_API int sr_log_callback_set_default(void)
 	 * Note: No log output in this function, as it should safely work
 	 * even if the currently set log callback is buggy/broken.
 	 */
+	g_rw_lock_writer_lock(&sr_log_cb_lock);
 	sr_log_cb = sr_logv;
 	sr_log_cb_data = NULL;
+	g_rw_lock_writer_unlock(&sr_log_cb_lock);
 
 	return SR_OK;
 }
@@ -174,10 +232,12 @@ SR_API int sr_log_callback_set_default(void)
  */
 SR_API int sr_log_callback_get(sr_log_callback *cb, void **cb_data)
 {
+	g_rw_lock_reader_lock(&sr_log_cb_lock);
 	if (cb)
 		*cb = sr_log_cb;
 	if (cb_data)
 		*cb_data = sr_log_cb_data;
+	g_rw_lock_reader_unlock(&sr_log_cb_lock);
 
 	return SR_OK;
 }
@@ -186,63 +246,300 @@ static int sr_logv(void *cb_data, int loglevel, const char *format, va_list args
 {
 	uint64_t elapsed_us, minutes;
 	unsigned int rest_us, seconds, microseconds;
-	char *raw_output, *output;
-	int raw_len, raw_idx, idx, ret;
+	char *raw_output;
+	GString *output;
+	int raw_len, raw_idx, ret;
 
 	/* This specific log callback doesn't need the void pointer data. */
 	(void)cb_data;
 
 	(void)loglevel;
 
-	if (cur_loglevel >= LOGLEVEL_TIMESTAMP) {
-		elapsed_us = g_get_monotonic_time() - sr_log_start_time;
+	if ((raw_len = g_vasprintf(&raw_output, format, args)) < 0)
+		return SR_ERR;
+
+	output = g_string_sized_new(raw_len + 32);
+	if (sr_log_curlevel >= LOGLEVEL_TIMESTAMP) {
+		if (log_async.thread && g_thread_self() == log_async.thread)
+			elapsed_us = log_async.emit_time - sr_log_start_time;
+		else
+			elapsed_us = g_get_monotonic_time() - sr_log_start_time;
 
 		minutes = elapsed_us / G_TIME_SPAN_MINUTE;
 		rest_us = elapsed_us % G_TIME_SPAN_MINUTE;
 		seconds = rest_us / G_TIME_SPAN_SECOND;
 		microseconds = rest_us % G_TIME_SPAN_SECOND;
 
-		ret = g_fprintf(stderr, "sr: [%.2" PRIu64 ":%.2u.%.6u] ",
+		g_string_append_printf(output, "sr: [%.2" PRIu64 ":%.2u.%.6u] ",
 				minutes, seconds, microseconds);
 	} else {
-		ret = fputs("sr: ", stderr);
+		g_string_append(output, "sr: ");
 	}
 
-	if (ret < 0 || (raw_len = g_vasprintf(&raw_output, format, args)) < 0)
-		return SR_ERR;
-
-	output = g_malloc0(raw_len + 1);
-
 	/* Copy the string without any unwanted newlines. */
-	raw_idx = idx = 0;
-	while (raw_idx < raw_len) {
-		if (raw_output[raw_idx] != '\n') {
-			output[idx] = raw_output[raw_idx];
-			idx++;
-		}
-		raw_idx++;
+	for (raw_idx = 0; raw_idx < raw_len; raw_idx++) {
+		if (raw_output[raw_idx] != '\n')
+			g_string_append_c(output, raw_output[raw_idx]);
 	}
+	g_string_append_c(output, '\n');
 
-	g_fprintf(stderr, "%s\n", output);
+	/*
+	 * A single write per message, messages of concurrent threads
+	 * don't get mixed up then.
+	 */
+	ret = fputs(output->str, stderr);
 	fflush(stderr);
 	g_free(raw_output);
-	g_free(output);
+	g_string_free(output, TRUE);
 
-	return SR_OK;
+	return ret < 0 ? SR_ERR : SR_OK;
 }
 
 /** @private */
+static int log_emit(int loglevel, const char *format, ...)
+{
+	int ret;
+	va_list args;
+	sr_log_callback cb;
+	void *cb_data;
+
+	g_rw_lock_reader_lock(&sr_log_cb_lock);
+	cb = sr_log_cb;
+	cb_data = sr_log_cb_data;
+	g_rw_lock_reader_unlock(&sr_log_cb_lock);
+
+	va_start(args, format);
+	ret = cb(cb_data, loglevel, format, args);
+	va_end(args);
+
+	return ret;
+}
+
+/* Put a message into the ring, or count it as dropped when it's full. */
+static void log_async_put(int loglevel, const char *format, va_list args)
+{
+	struct log_record *rec;
+	guint pos;
+	gint diff;
+
+	pos = (guint)g_atomic_int_get(&log_async.head);
+	for (;;) {
+		rec = &log_async.ring[pos & log_async.mask];
+		diff = (gint)((guint)g_atomic_int_get(&rec->seq) - pos);
+		if (diff == 0) {
+			if (g_atomic_int_compare_and_exchange(&log_async.head,
+					(gint)pos, (gint)(pos + 1)))
+				break;
+			pos = (guint)g_atomic_int_get(&log_async.head);
+		} else if (diff < 0) {
+			g_atomic_int_inc(&log_async.dropped);
+			return;
+		} else {
+			pos = (guint)g_atomic_int_get(&log_async.head);
+		}
+	}
+
+	rec->loglevel = loglevel;
+	rec->time = g_get_monotonic_time();
+	rec->format = format;
+	g_vsnprintf(rec->text, sizeof(rec->text), format, args);
+	g_atomic_int_set(&rec->seq, (gint)(pos + 1));
+}
+
+/* Take the next message out of the ring, if there is one. */
+static gboolean log_async_get(struct log_record *out)
+{
+	struct log_record *rec;
+	guint pos;
+
+	pos = log_async.tail;
+	rec = &log_async.ring[pos & log_async.mask];
+	if ((gint)((guint)g_atomic_int_get(&rec->seq) - (pos + 1)) < 0)
+		return FALSE;
+
+	out->loglevel = rec->loglevel;
+	out->time = rec->time;
+	out->format = rec->format;
+	memcpy(out->text, rec->text, sizeof(out->text));
+	g_atomic_int_set(&rec->seq, (gint)(pos + log_async.mask + 1));
+	log_async.tail = pos + 1;
+
+	return TRUE;
+}
+
+static void log_async_flush_repeats(const struct log_record *last,
+		unsigned int *repeats)
+{
+	if (!*repeats)
+		return;
+	log_async.emit_time = last->time;
+	log_emit(last->loglevel, "Last message repeated %u times.", *repeats);
+	*repeats = 0;
+}
+
+static gpointer log_async_thread(gpointer data)
+{
+	struct log_record rec, last;
+	unsigned int repeats;
+	gboolean have_last, stopping;
+	int dropped;
+
+	(void)data;
+
+	have_last = FALSE;
+	repeats = 0;
+	for (;;) {
+		/* Once stopped, drain what is left before leaving. */
+		stopping = !g_atomic_int_get(&log_async.running);
+		if (!log_async_get(&rec)) {
+			/* Report repeats once the run has been over for a bit. */
+			if (have_last && (stopping || g_get_monotonic_time() >
+					last.time + G_TIME_SPAN_SECOND))
+				log_async_flush_repeats(&last, &repeats);
+			if (stopping)
+				break;
+			g_usleep(LOG_ASYNC_IDLE_US);
+			continue;
+		}
+
+		if ((dropped = g_atomic_int_and(&log_async.dropped, 0))) {
+			log_async.emit_time = rec.time;
+			log_emit(SR_LOG_WARN, "log: %d messages dropped.", dropped);
+		}
+
+		/* Runs of the very same message get emitted once. */
+		if (have_last && rec.format == last.format
+				&& !strcmp(rec.text, last.text)) {
+			repeats++;
+			last.time = rec.time;
+			continue;
+		}
+		if (have_last)
+			log_async_flush_repeats(&last, &repeats);
+
+		log_async.emit_time = rec.time;
+		log_emit(rec.loglevel, "%s", rec.text);
+		last = rec;
+		have_last = TRUE;
+	}
+
+	return NULL;
+}
+
+/**
+ * Emit log messages from a background thread.
+ *
+ * By default, messages are formatted and written by the thread which
+ * logs, e.g. the USB event thread in the middle of an acquisition. With
+ * verbose log levels, that can take long enough to lose samples. Once
+ * this is called, messages are formatted into a lock-free ring buffer
+ * instead, and a writer thread passes them on to the log callback.
+ *
+ * Messages longer than 255 characters get cut. When the ring is full,
+ * messages get dropped, and the number of dropped messages is logged
+ * later. A run of identical messages is logged once, followed by the
+ * number of repeats.
+ *
+ * The log callback gets called from the writer thread then, with the
+ * message preformatted ("%s" as the format).
+ *
+ * @param num_messages Number of messages which the ring holds. Gets
+ *                     rounded up to a power of two. 0 selects 4096.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR The asynchronous sink is running already.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_log_async_start(size_t num_messages)
+{
+	guint size, i;
+
+	if (log_async.thread) {
+		sr_err("Asynchronous logging already started.");
+		return SR_ERR;
+	}
+
+	if (!num_messages)
+		num_messages = 4096;
+	num_messages = MIN(num_messages, 1U << 20);
+	for (size = 2; size < num_messages; size <<= 1)
+		;
+
+	log_async.ring = g_malloc0_n(size, sizeof(*log_async.ring));
+	for (i = 0; i < size; i++)
+		log_async.ring[i].seq = (gint)i;
+	log_async.mask = size - 1;
+	log_async.head = 0;
+	log_async.tail = 0;
+	log_async.dropped = 0;
+	log_async.running = 1;
+	log_async.thread = g_thread_new("sr-log", log_async_thread, NULL);
+	g_atomic_int_set(&log_async.active, 1);
+
+	return SR_OK;
+}
+
+/**
+ * Return to emitting log messages from the thread which logs.
+ *
+ * Messages in the ring get written before this returns.
+ *
+ * @retval SR_OK Success, also when the asynchronous sink was not running.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_log_async_stop(void)
+{
+	if (!log_async.thread)
+		return SR_OK;
+
+	/* New messages go the synchronous way, wait for those under way. */
+	g_atomic_int_set(&log_async.active, 0);
+	while (g_atomic_int_get(&log_async.producers))
+		g_thread_yield();
+
+	g_atomic_int_set(&log_async.running, 0);
+	g_thread_join(log_async.thread);
+	log_async.thread = NULL;
+
+	g_free(log_async.ring);
+	log_async.ring = NULL;
+
+	return SR_OK;
+}
+
 SR_PRIV int sr_log(int loglevel, const char *format, ...)
 {
 	int ret;
 	va_list args;
+	sr_log_callback cb;
+	void *cb_data;
 
 	/* Only output messages of at least the selected loglevel(s). */
-	if (loglevel > cur_loglevel)
+	if (loglevel > sr_log_curlevel)
 		return SR_OK;
 
+	if (g_atomic_int_get(&log_async.active)) {
+		g_atomic_int_inc(&log_async.producers);
+		/* Checked again, sr_log_async_stop() may be waiting. */
+		if (g_atomic_int_get(&log_async.active)) {
+			va_start(args, format);
+			log_async_put(loglevel, format, args);
+			va_end(args);
+			g_atomic_int_dec_and_test(&log_async.producers);
+			return SR_OK;
+		}
+		g_atomic_int_dec_and_test(&log_async.producers);
+	}
+
+	g_rw_lock_reader_lock(&sr_log_cb_lock);
+	cb = sr_log_cb;
+	cb_data = sr_log_cb_data;
+	g_rw_lock_reader_unlock(&sr_log_cb_lock);
+
 	va_start(args, format);
-	ret = sr_log_cb(sr_log_cb_data, loglevel, format, args);
+	ret = cb(cb_data, loglevel, format, args);
 	va_end(args);
 
 	return ret;
@@ -0,0 +1,515 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <string.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "mem-budget"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Memory budget for capture-sized buffers.
+ */
+
+/*
+ * Buffers which would exceed the budget are mappings of unlinked files
+ * in the spill directory. The kernel writes their pages back to the
+ * file and drops them under memory pressure, instead of running out of
+ * memory. Blocks are recorded by their address, usage by component.
+ *
+ * Large buffers in memory are anonymous mappings in whole huge pages,
+ * which saves TLB misses when they are walked sample by sample.
+ */
+struct mem_block {
+	const char *component;
+	size_t size;
+	gboolean spilled;
+	/* Length of an anonymous mapping, 0 for g_malloc()'d blocks. */
+	size_t mapped;
+};
+
+/* Buffers from this size on are mapped, in multiples of it. */
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/* From <linux/mempolicy.h>, which libc does not wrap. */
+#define MPOL_PREFERRED 1
+
+struct mem_usage {
+	uint64_t in_memory;
+	uint64_t spilled;
+};
+
+static struct mem_usage *usage_get(struct sr_context *ctx,
+		const char *component)
+{
+	struct mem_usage *usage;
+
+	if (!ctx->mem_usage)
+		ctx->mem_usage = g_hash_table_new_full(g_str_hash,
+			g_str_equal, g_free, g_free);
+	usage = g_hash_table_lookup(ctx->mem_usage, component);
+	if (!usage) {
+		usage = g_malloc0(sizeof(*usage));
+		g_hash_table_insert(ctx->mem_usage, g_strdup(component), usage);
+	}
+
+	return usage;
+}
+
+/* Sum up the usage of one component, or of all. Call with the lock. */
+static void usage_sum(struct sr_context *ctx, const char *component,
+		struct mem_usage *total)
+{
+	GHashTableIter iter;
+	struct mem_usage *usage;
+	void *key, *value;
+
+	memset(total, 0, sizeof(*total));
+	if (!ctx->mem_usage)
+		return;
+
+	g_hash_table_iter_init(&iter, ctx->mem_usage);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		if (component && strcmp(key, component))
+			continue;
+		usage = value;
+		total->in_memory += usage->in_memory;
+		total->spilled += usage->spilled;
+	}
+}
+
+/**
+ * Set the memory budget for capture-sized buffers.
+ *
+ * Drivers, outputs and soft triggers allocate buffers whose size depends
+ * on the capture's size. Within the budget, these are taken from memory.
+ * Beyond it, they are backed by temporary files, so that large captures
+ * don't run the host out of memory.
+ *
+ * @param ctx The libsigrok context. Must not be NULL.
+ * @param bytes The budget in bytes, 0 for no limit (the default).
+ * @param spill_dir Directory for the temporary files. NULL selects the
+ *                  system's directory for temporary files.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_mem_budget_set(struct sr_context *ctx, uint64_t bytes,
+		const char *spill_dir)
+{
+	if (!ctx)
+		return SR_ERR_ARG;
+
+	g_mutex_lock(&ctx->mem_mutex);
+	ctx->mem_budget = bytes;
+	g_free(ctx->mem_spill_dir);
+	ctx->mem_spill_dir = g_strdup(spill_dir);
+	g_mutex_unlock(&ctx->mem_mutex);
+
+	return SR_OK;
+}
+
+/**
+ * Get the memory use of capture-sized buffers.
+ *
+ * @param ctx The libsigrok context. Must not be NULL.
+ * @param component A component's name, which is its log prefix (e.g.
+ *                  "soft-trigger"), or NULL for the total of all of them.
+ * @param in_memory The number of bytes taken from memory. Can be NULL.
+ * @param spilled The number of bytes backed by files. Can be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_mem_usage_get(struct sr_context *ctx, const char *component,
+		uint64_t *in_memory, uint64_t *spilled)
+{
+	struct mem_usage total;
+
+	if (!ctx)
+		return SR_ERR_ARG;
+
+	g_mutex_lock(&ctx->mem_mutex);
+	usage_sum(ctx, component, &total);
+	g_mutex_unlock(&ctx->mem_mutex);
+
+	if (in_memory)
+		*in_memory = total.in_memory;
+	if (spilled)
+		*spilled = total.spilled;
+
+	return SR_OK;
+}
+
+/**
+ * Reserve memory within the budget, for a buffer the caller allocates.
+ *
+ * @param ctx The libsigrok context. NULL reserves without a budget.
+ * @param component The name of the component which uses the memory.
+ * @param size The buffer's size in bytes.
+ *
+ * @return TRUE if the buffer fits into the budget, and was accounted for.
+ *         Release it with sr_mem_release().
+ *
+ * @private
+ */
+SR_PRIV gboolean sr_mem_reserve(struct sr_context *ctx,
+		const char *component, size_t size)
+{
+	struct mem_usage total;
+	gboolean fits;
+
+	if (!ctx)
+		return TRUE;
+
+	g_mutex_lock(&ctx->mem_mutex);
+	fits = TRUE;
+	if (ctx->mem_budget) {
+		usage_sum(ctx, NULL, &total);
+		fits = total.in_memory + size <= ctx->mem_budget;
+	}
+	if (fits)
+		usage_get(ctx, component)->in_memory += size;
+	g_mutex_unlock(&ctx->mem_mutex);
+
+	return fits;
+}
+
+/**
+ * Release memory which sr_mem_reserve() accounted for.
+ *
+ * @private
+ */
+SR_PRIV void sr_mem_release(struct sr_context *ctx, const char *component,
+		size_t size)
+{
+	if (!ctx)
+		return;
+
+	g_mutex_lock(&ctx->mem_mutex);
+	usage_get(ctx, component)->in_memory -= size;
+	g_mutex_unlock(&ctx->mem_mutex);
+}
+
+#ifdef HAVE_SYS_MMAN_H
+/* Map an unlinked temporary file of the given size. */
+static void *spill_map(const char *dir, size_t size)
+{
+	char *path;
+	void *buf;
+	int fd;
+
+	path = g_build_filename(dir ? dir : g_get_tmp_dir(),
+		"sigrok-spill-XXXXXX", NULL);
+	fd = g_mkstemp(path);
+	if (fd < 0) {
+		sr_err("Cannot create spill file '%s': %s.", path,
+			g_strerror(errno));
+		g_free(path);
+		return NULL;
+	}
+	g_unlink(path);
+	g_free(path);
+
+	buf = NULL;
+	if (ftruncate(fd, size) == 0) {
+		buf = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			fd, 0);
+		if (buf == MAP_FAILED)
+			buf = NULL;
+	}
+	if (!buf)
+		sr_err("Cannot map spill file: %s.", g_strerror(errno));
+	close(fd);
+
+	return buf;
+}
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+/* Prefer a NUMA node for a mapping's pages. Best effort. */
+static void numa_prefer(void *buf, size_t len, int node)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+	unsigned long mask[4];
+	size_t bits, word_bits;
+
+	bits = sizeof(mask) * 8;
+	word_bits = sizeof(mask[0]) * 8;
+	if (node < 0 || (size_t)node >= bits)
+		return;
+	memset(mask, 0, sizeof(mask));
+	mask[node / word_bits] |= 1UL << (node % word_bits);
+	if (syscall(SYS_mbind, buf, len, MPOL_PREFERRED, mask, bits, 0) != 0)
+		sr_spew("Cannot prefer NUMA node %d: %s.", node,
+			g_strerror(errno));
+#else
+	(void)buf;
+	(void)len;
+	(void)node;
+#endif
+}
+
+/*
+ * Map anonymous memory in whole huge pages. Reserved huge pages are
+ * taken when there are any, otherwise transparent huge pages are asked
+ * for. Pages get their node when first written to, so that the
+ * writing thread gets local memory unless a node is given.
+ */
+static void *huge_map(size_t size, int node, size_t *mapped)
+{
+	void *buf;
+	size_t len;
+
+	len = (size + HUGE_PAGE_SIZE - 1) & ~(size_t)(HUGE_PAGE_SIZE - 1);
+	buf = MAP_FAILED;
+#ifdef MAP_HUGETLB
+	buf = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+	if (buf == MAP_FAILED) {
+		buf = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (buf == MAP_FAILED)
+			return NULL;
+#ifdef MADV_HUGEPAGE
+		madvise(buf, len, MADV_HUGEPAGE);
+#endif
+	}
+	numa_prefer(buf, len, node);
+	*mapped = len;
+
+	return buf;
+}
+#endif
+
+/**
+ * Allocate a capture-sized buffer within the memory budget.
+ *
+ * Buffers which don't fit into the budget are backed by a temporary
+ * file. Their content is not initialized either way.
+ *
+ * @param ctx The libsigrok context. NULL allocates without a budget.
+ * @param component The name of the component which uses the buffer.
+ * @param size The buffer's size in bytes.
+ *
+ * @return The buffer, NULL if it could not be allocated. Free it with
+ *         sr_mem_free(), with the same context.
+ *
+ * @private
+ */
+SR_PRIV void *sr_mem_alloc(struct sr_context *ctx, const char *component,
+		size_t size)
+{
+	return sr_mem_alloc_node(ctx, component, size, -1);
+}
+
+/**
+ * Allocate a capture-sized buffer on a NUMA node.
+ *
+ * Like sr_mem_alloc(), but the buffer's pages preferably come from the
+ * given node, e.g. the one of the USB controller which fills it (see
+ * sr_usb_numa_node()). Other nodes are used when that one runs out.
+ *
+ * @param node The NUMA node, or -1 for the node of the thread which
+ *             first writes to the buffer.
+ *
+ * @private
+ */
+SR_PRIV void *sr_mem_alloc_node(struct sr_context *ctx,
+		const char *component, size_t size, int node)
+{
+	struct mem_block *block;
+#ifdef HAVE_SYS_MMAN_H
+	char *dir;
+#endif
+	void *buf;
+
+	if (!ctx)
+		return g_try_malloc(size);
+	if (!size)
+		return NULL;
+
+	block = g_malloc0(sizeof(*block));
+	block->component = component;
+	block->size = size;
+
+	buf = NULL;
+	if (sr_mem_reserve(ctx, component, size)) {
+#ifdef HAVE_SYS_MMAN_H
+		if (size >= HUGE_PAGE_SIZE)
+			buf = huge_map(size, node, &block->mapped);
+#endif
+		if (!buf)
+			buf = g_try_malloc(size);
+		if (!buf)
+			sr_mem_release(ctx, component, size);
+	} else {
+#ifdef HAVE_SYS_MMAN_H
+		g_mutex_lock(&ctx->mem_mutex);
+		dir = g_strdup(ctx->mem_spill_dir);
+		g_mutex_unlock(&ctx->mem_mutex);
+		buf = spill_map(dir, size);
+		g_free(dir);
+		block->spilled = buf != NULL;
+		if (buf)
+			sr_dbg("Spilled %zu bytes of '%s' to a file.",
+				size, component);
+#else
+		sr_warn("Memory budget exceeded, no spill files here.");
+		buf = g_try_malloc(size);
+		if (buf) {
+			g_mutex_lock(&ctx->mem_mutex);
+			usage_get(ctx, component)->in_memory += size;
+			g_mutex_unlock(&ctx->mem_mutex);
+		}
+#endif
+	}
+	if (!buf) {
+		g_free(block);
+		return NULL;
+	}
+
+	g_mutex_lock(&ctx->mem_mutex);
+	/* Buffers in memory were accounted for by sr_mem_reserve(). */
+	if (block->spilled)
+		usage_get(ctx, component)->spilled += size;
+	if (!ctx->mem_blocks)
+		ctx->mem_blocks = g_hash_table_new_full(g_direct_hash,
+			g_direct_equal, NULL, g_free);
+	g_hash_table_insert(ctx->mem_blocks, buf, block);
+	g_mutex_unlock(&ctx->mem_mutex);
+
+	return buf;
+}
+
+/**
+ * Free a buffer from sr_mem_alloc().
+ *
+ * @param ctx The context the buffer was allocated with.
+ * @param buf The buffer. Can be NULL.
+ *
+ * @private
+ */
+SR_PRIV void sr_mem_free(struct sr_context *ctx, void *buf)
+{
+	struct mem_block *block;
+	struct mem_usage *usage;
+
+	if (!buf)
+		return;
+	if (!ctx) {
+		g_free(buf);
+		return;
+	}
+
+	g_mutex_lock(&ctx->mem_mutex);
+	block = ctx->mem_blocks ?
+		g_hash_table_lookup(ctx->mem_blocks, buf) : NULL;
+	if (!block) {
+		g_mutex_unlock(&ctx->mem_mutex);
+		sr_err("%s: unknown buffer %p.", __func__, buf);
+		return;
+	}
+	g_hash_table_steal(ctx->mem_blocks, buf);
+	usage = usage_get(ctx, block->component);
+	if (block->spilled)
+		usage->spilled -= block->size;
+	else
+		usage->in_memory -= block->size;
+	g_mutex_unlock(&ctx->mem_mutex);
+
+#ifdef HAVE_SYS_MMAN_H
+	if (block->spilled)
+		munmap(buf, block->size);
+	else if (block->mapped)
+		munmap(buf, block->mapped);
+	else
+#endif
+		g_free(buf);
+	g_free(block);
+}
+
+struct mem_bytes {
+	struct sr_context *ctx;
+	void *buf;
+};
+
+static void mem_bytes_free(void *data)
+{
+	struct mem_bytes *mb;
+
+	mb = data;
+	sr_mem_free(mb->ctx, mb->buf);
+	g_free(mb);
+}
+
+/**
+ * Hand a buffer from sr_mem_alloc() over to a GBytes.
+ *
+ * The buffer gets freed with the last reference to the GBytes.
+ *
+ * @param ctx The context the buffer was allocated with.
+ * @param buf The buffer.
+ * @param size The number of valid bytes in it.
+ *
+ * @private
+ */
+SR_PRIV GBytes *sr_mem_bytes_new(struct sr_context *ctx, void *buf,
+		size_t size)
+{
+	struct mem_bytes *mb;
+
+	mb = g_malloc(sizeof(*mb));
+	mb->ctx = ctx;
+	mb->buf = buf;
+
+	return g_bytes_new_with_free_func(buf, size, mem_bytes_free, mb);
+}
+
+/** @private */
+SR_PRIV void sr_mem_cleanup(struct sr_context *ctx)
+{
+	if (ctx->mem_blocks && g_hash_table_size(ctx->mem_blocks))
+		sr_warn("%u buffers were not freed.",
+			g_hash_table_size(ctx->mem_blocks));
+	if (ctx->mem_blocks)
+		g_hash_table_destroy(ctx->mem_blocks);
+	if (ctx->mem_usage)
+		g_hash_table_destroy(ctx->mem_usage);
+	g_free(ctx->mem_spill_dir);
+	g_mutex_clear(&ctx->mem_mutex);
+}
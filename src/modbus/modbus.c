@@ -25,9 +25,11 @@
 
 #define LOG_PREFIX "modbus"
 
+SR_PRIV extern const struct sr_modbus_dev_inst modbus_tcp_dev;
 SR_PRIV extern const struct sr_modbus_dev_inst modbus_serial_rtu_dev;
 
 static const struct sr_modbus_dev_inst *modbus_devs[] = {
+	&modbus_tcp_dev,
 #ifdef HAVE_SERIAL_COMM
 	&modbus_serial_rtu_dev, /* Must be last as it matches any resource. */
 #endif
@@ -155,6 +157,8 @@ SR_PRIV struct sr_modbus_dev_inst *modbus_dev_inst_new(const char *resource,
 			*modbus = *modbus_dev;
 			modbus->priv = g_malloc0(modbus->priv_size);
 			modbus->read_timeout_ms = 1000;
+			if (!modbus->max_pending)
+				modbus->max_pending = 1;
 			params = g_strsplit(resource, "/", 0);
 			if (modbus->dev_inst_new(modbus->priv, resource,
 			                         params, serialcomm, modbusaddr) != SR_OK) {
@@ -478,6 +482,154 @@ SR_PRIV int sr_modbus_read_holding_registers(struct sr_modbus_dev_inst *modbus,
 	return SR_OK;
 }
 
+/** @private */
+struct read_block {
+	int address;
+	int nb_registers;
+	/* The reads this block covers, in the sorted array. */
+	int first, num;
+	uint16_t *registers;
+	int result;
+};
+
+static int read_address_compare(gconstpointer a, gconstpointer b,
+		gpointer user_data)
+{
+	const struct sr_modbus_read *ra, *rb;
+
+	(void)user_data;
+
+	ra = *(struct sr_modbus_read * const *)a;
+	rb = *(struct sr_modbus_read * const *)b;
+
+	return ra->address - rb->address;
+}
+
+/**
+ * Read several ranges of holding registers with as few requests as possible.
+ *
+ * Ranges which overlap, or which are at most max_gap registers apart, get
+ * read with a single request (of at most 125 registers). This needs the
+ * registers in the gaps to be readable, which only the driver knows from
+ * the device's register map. With transports which allow it (Modbus/TCP),
+ * several requests get sent before their replies are read.
+ *
+ * @param modbus Previously initialized Modbus device structure.
+ * @param reads The reads to do. Each read's result is set, the registers
+ *              of each successful read are stored in its buffer.
+ * @param num The number of reads.
+ * @param max_gap The maximum number of registers between two ranges which
+ *                may be read along with them. 0 merges only ranges which
+ *                overlap or touch, so no other registers get read.
+ *
+ * @return SR_OK if all reads succeeded, otherwise the result of the first
+ *         read which failed.
+ */
+SR_PRIV int sr_modbus_read_holding_registers_multi(
+		struct sr_modbus_dev_inst *modbus,
+		struct sr_modbus_read *reads, int num, int max_gap)
+{
+	struct sr_modbus_read **sorted, *read;
+	struct read_block *blocks, *block;
+	uint16_t *buf;
+	int num_blocks, total, i, j, end, next, sent, ret;
+
+	if (!modbus || num < 0 || (num && !reads))
+		return SR_ERR_ARG;
+
+	sorted = g_malloc(num * sizeof(*sorted));
+	blocks = g_malloc(num * sizeof(*blocks));
+
+	/* Merge the ranges, in the order of their addresses. */
+	for (i = j = 0; i < num; i++) {
+		reads[i].result = SR_ERR_ARG;
+		if (reads[i].address < 0 || reads[i].address > 0xFFFF
+		    || reads[i].nb_registers < 1 || reads[i].nb_registers > 125
+		    || !reads[i].registers)
+			continue;
+		sorted[j++] = &reads[i];
+	}
+	g_qsort_with_data(sorted, j, sizeof(*sorted),
+		read_address_compare, NULL);
+
+	num_blocks = total = 0;
+	block = NULL;
+	for (i = 0; i < j; i++) {
+		read = sorted[i];
+		end = read->address + read->nb_registers;
+		if (block && read->address <= block->address
+				+ block->nb_registers + max_gap
+		    && MAX(end, block->address + block->nb_registers)
+				- block->address <= 125) {
+			block->nb_registers = MAX(end, block->address
+				+ block->nb_registers) - block->address;
+			block->num++;
+			continue;
+		}
+		if (block)
+			total += block->nb_registers;
+		block = &blocks[num_blocks++];
+		block->address = read->address;
+		block->nb_registers = read->nb_registers;
+		block->first = i;
+		block->num = 1;
+	}
+	if (block)
+		total += block->nb_registers;
+
+	buf = g_malloc(total * sizeof(*buf));
+	for (i = total = 0; i < num_blocks; i++) {
+		blocks[i].registers = buf + total;
+		total += blocks[i].nb_registers;
+	}
+
+	/* Send up to max_pending requests, then read their replies. */
+	for (i = 0; i < num_blocks; i = next) {
+		next = MIN(num_blocks, i + (int)modbus->max_pending);
+		for (sent = i; sent < next; sent++) {
+			block = &blocks[sent];
+			block->result = sr_modbus_read_holding_registers(modbus,
+				block->address, block->nb_registers, NULL);
+			if (block->result != SR_OK)
+				break;
+		}
+		for (j = i; j < next; j++) {
+			block = &blocks[j];
+			if (j < sent)
+				block->result = sr_modbus_read_holding_registers(
+					modbus, -1, block->nb_registers,
+					block->registers);
+			else if (j > sent)
+				block->result = blocks[sent].result;
+		}
+	}
+
+	ret = SR_OK;
+	for (i = 0; i < num_blocks; i++) {
+		block = &blocks[i];
+		for (j = block->first; j < block->first + block->num; j++) {
+			read = sorted[j];
+			read->result = block->result;
+			if (block->result == SR_OK)
+				memcpy(read->registers, block->registers
+					+ (read->address - block->address),
+					read->nb_registers * sizeof(uint16_t));
+		}
+	}
+	for (i = 0; i < num; i++) {
+		if (reads[i].result != SR_OK) {
+			ret = reads[i].result;
+			break;
+		}
+	}
+
+	g_free(buf);
+	g_free(blocks);
+	g_free(sorted);
+
+	return ret;
+}
+
 /**
  * Send a Modbus write coil command.
  *
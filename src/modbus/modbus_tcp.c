@@ -0,0 +1,376 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#ifdef _WIN32
+#define _WIN32_WINNT 0x0501
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#endif
+#include <glib.h>
+#include <string.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#endif
+#include <errno.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "modbus_tcp"
+
+#define DEFAULT_PORT "502"
+
+/* MBAP header: transaction ID, protocol ID, length, unit ID. */
+#define MBAP_HEADER_SIZE 7
+#define MAX_PDU_SIZE 253
+
+/*
+ * Requests which may be sent before their replies are read. Modbus/TCP
+ * servers answer the requests of a connection in order, the transaction
+ * IDs only serve to skip stale replies (of requests which timed out).
+ */
+#define MAX_PENDING 8
+
+struct modbus_tcp {
+	char *address;
+	char *port;
+	int socket;
+	uint8_t unit_id;
+	uint16_t next_tid;
+	uint16_t pending[MAX_PENDING];
+	unsigned int first_pending;
+	unsigned int num_pending;
+	/* Bytes of the current reply which were not read yet. */
+	unsigned int remaining;
+};
+
+static int modbus_tcp_dev_inst_new(void *priv, const char *resource,
+		char **params, const char *serialcomm, int modbusaddr)
+{
+	struct modbus_tcp *tcp = priv;
+
+	(void)resource;
+	(void)serialcomm;
+
+	if (!params || !params[1] || !*params[1]) {
+		sr_err("Invalid parameters.");
+		return SR_ERR;
+	}
+
+	tcp->address = g_strdup(params[1]);
+	tcp->port = g_strdup(params[2] ? params[2] : DEFAULT_PORT);
+	tcp->socket = -1;
+	tcp->unit_id = modbusaddr;
+
+	return SR_OK;
+}
+
+static int modbus_tcp_open(void *priv)
+{
+	struct modbus_tcp *tcp = priv;
+	struct addrinfo hints;
+	struct addrinfo *results, *res;
+	int err;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+
+	err = getaddrinfo(tcp->address, tcp->port, &hints, &results);
+
+	if (err) {
+		sr_err("Address lookup failed: %s:%s: %s", tcp->address, tcp->port,
+			gai_strerror(err));
+		return SR_ERR;
+	}
+
+	for (res = results; res; res = res->ai_next) {
+		if ((tcp->socket = socket(res->ai_family, res->ai_socktype,
+						res->ai_protocol)) < 0)
+			continue;
+		if (connect(tcp->socket, res->ai_addr, res->ai_addrlen) != 0) {
+			close(tcp->socket);
+			tcp->socket = -1;
+			continue;
+		}
+		break;
+	}
+
+	freeaddrinfo(results);
+
+	if (tcp->socket < 0) {
+		sr_err("Failed to connect to %s:%s: %s", tcp->address, tcp->port,
+				g_strerror(errno));
+		return SR_ERR;
+	}
+
+	tcp->num_pending = 0;
+	tcp->remaining = 0;
+
+	return SR_OK;
+}
+
+static int modbus_tcp_source_add(struct sr_session *session, void *priv,
+		int events, int timeout, sr_receive_data_callback cb, void *cb_data)
+{
+	struct modbus_tcp *tcp = priv;
+
+	return sr_session_source_add(session, tcp->socket, events, timeout,
+			cb, cb_data);
+}
+
+static int modbus_tcp_source_remove(struct sr_session *session, void *priv)
+{
+	struct modbus_tcp *tcp = priv;
+
+	return sr_session_source_remove(session, tcp->socket);
+}
+
+/* Receive up to len bytes, waiting at most timeout_ms for the first one. */
+static int tcp_recv(struct modbus_tcp *tcp, uint8_t *buf, int len,
+		unsigned int timeout_ms)
+{
+	fd_set fds;
+	struct timeval tv;
+	int ret;
+
+	FD_ZERO(&fds);
+	FD_SET(tcp->socket, &fds);
+	tv.tv_sec = timeout_ms / 1000;
+	tv.tv_usec = (timeout_ms % 1000) * 1000;
+	ret = select(tcp->socket + 1, &fds, NULL, NULL, &tv);
+	if (ret < 0) {
+		sr_err("Receive error: %s", g_strerror(errno));
+		return SR_ERR;
+	}
+	if (ret == 0)
+		return 0;
+
+	ret = recv(tcp->socket, (char *)buf, len, 0);
+	if (ret < 0) {
+		sr_err("Receive error: %s", g_strerror(errno));
+		return SR_ERR;
+	}
+	if (ret == 0) {
+		sr_err("Connection closed by %s:%s.", tcp->address, tcp->port);
+		return SR_ERR;
+	}
+
+	return ret;
+}
+
+/* Receive exactly len bytes, within timeout_ms between any two of them. */
+static int tcp_recv_all(struct modbus_tcp *tcp, uint8_t *buf, int len,
+		unsigned int timeout_ms)
+{
+	int ret;
+
+	while (len > 0) {
+		ret = tcp_recv(tcp, buf, len, timeout_ms);
+		if (ret <= 0)
+			return SR_ERR;
+		buf += ret;
+		len -= ret;
+	}
+
+	return SR_OK;
+}
+
+static int tcp_skip(struct modbus_tcp *tcp)
+{
+	uint8_t buf[64];
+	int len;
+
+	while (tcp->remaining > 0) {
+		len = MIN(tcp->remaining, sizeof(buf));
+		if (tcp_recv_all(tcp, buf, len, 100) != SR_OK)
+			return SR_ERR;
+		tcp->remaining -= len;
+	}
+
+	return SR_OK;
+}
+
+/* The oldest pending transaction got its reply, or never will. */
+static void pending_done(struct modbus_tcp *tcp)
+{
+	tcp->first_pending = (tcp->first_pending + 1) % MAX_PENDING;
+	tcp->num_pending--;
+}
+
+static int modbus_tcp_send(void *priv,
+		const uint8_t *buffer, int buffer_size)
+{
+	struct modbus_tcp *tcp = priv;
+	uint8_t frame[MBAP_HEADER_SIZE + MAX_PDU_SIZE];
+	int len, out;
+	uint16_t tid;
+
+	if (buffer_size > MAX_PDU_SIZE)
+		return SR_ERR_ARG;
+
+	if (tcp->num_pending == MAX_PENDING) {
+		sr_err("Too many pending Modbus transactions.");
+		return SR_ERR;
+	}
+
+	tid = tcp->next_tid++;
+	WB16(frame + 0, tid);
+	WB16(frame + 2, 0);
+	WB16(frame + 4, buffer_size + 1);
+	W8(frame + 6, tcp->unit_id);
+	memcpy(frame + MBAP_HEADER_SIZE, buffer, buffer_size);
+	len = MBAP_HEADER_SIZE + buffer_size;
+
+	out = send(tcp->socket, (const char *)frame, len, 0);
+	if (out < 0) {
+		sr_err("Send error: %s", g_strerror(errno));
+		return SR_ERR;
+	}
+	if (out < len) {
+		sr_err("Only sent %d/%d bytes of Modbus request.", out, len);
+		return SR_ERR;
+	}
+
+	tcp->pending[(tcp->first_pending + tcp->num_pending++) % MAX_PENDING] = tid;
+
+	return SR_OK;
+}
+
+static int modbus_tcp_read_begin(void *priv, uint8_t *function_code)
+{
+	struct modbus_tcp *tcp = priv;
+	uint8_t header[MBAP_HEADER_SIZE];
+	unsigned int length;
+	uint16_t tid;
+
+	if (!tcp->num_pending) {
+		sr_err("No Modbus request to read the reply of.");
+		return SR_ERR;
+	}
+
+	/* A previous reply may not have been read completely. */
+	if (tcp_skip(tcp) != SR_OK)
+		return SR_ERR;
+
+	while (1) {
+		if (tcp_recv_all(tcp, header, sizeof(header), 500) != SR_OK) {
+			pending_done(tcp);
+			return SR_ERR;
+		}
+		tid = RB16(header + 0);
+		length = RB16(header + 4);
+		if (RB16(header + 2) != 0 || length < 2
+		    || length > MAX_PDU_SIZE + 1) {
+			sr_err("Invalid Modbus/TCP header.");
+			return SR_ERR_DATA;
+		}
+		tcp->remaining = length - 1;
+		if (tid == tcp->pending[tcp->first_pending])
+			break;
+		sr_dbg("Skipping reply of Modbus transaction %u.", tid);
+		if (tcp_skip(tcp) != SR_OK)
+			return SR_ERR;
+	}
+
+	pending_done(tcp);
+
+	if (R8(header + 6) != tcp->unit_id)
+		sr_dbg("Reply from unit %u instead of %u.", R8(header + 6),
+			tcp->unit_id);
+
+	if (tcp_recv_all(tcp, function_code, 1, 100) != SR_OK)
+		return SR_ERR;
+	tcp->remaining--;
+
+	return SR_OK;
+}
+
+static int modbus_tcp_read_data(void *priv, uint8_t *buf, int maxlen)
+{
+	struct modbus_tcp *tcp = priv;
+	int ret;
+
+	if (!tcp->remaining)
+		return SR_ERR;
+
+	ret = tcp_recv(tcp, buf, MIN((unsigned int)maxlen, tcp->remaining), 10);
+	if (ret > 0)
+		tcp->remaining -= ret;
+
+	return ret;
+}
+
+static int modbus_tcp_read_end(void *priv)
+{
+	struct modbus_tcp *tcp = priv;
+
+	if (tcp->remaining) {
+		sr_err("Modbus reply is %u bytes longer than expected.",
+			tcp->remaining);
+		tcp_skip(tcp);
+		return SR_ERR_DATA;
+	}
+
+	return SR_OK;
+}
+
+static int modbus_tcp_close(void *priv)
+{
+	struct modbus_tcp *tcp = priv;
+
+	tcp->num_pending = 0;
+	tcp->remaining = 0;
+
+	if (close(tcp->socket) < 0)
+		return SR_ERR;
+	tcp->socket = -1;
+
+	return SR_OK;
+}
+
+static void modbus_tcp_free(void *priv)
+{
+	struct modbus_tcp *tcp = priv;
+
+	g_free(tcp->address);
+	g_free(tcp->port);
+}
+
+SR_PRIV const struct sr_modbus_dev_inst modbus_tcp_dev = {
+	.name          = "tcp",
+	.prefix        = "modbus-tcp",
+	.priv_size     = sizeof(struct modbus_tcp),
+	.max_pending   = MAX_PENDING,
+	.scan          = NULL,
+	.dev_inst_new  = modbus_tcp_dev_inst_new,
+	.open          = modbus_tcp_open,
+	.source_add    = modbus_tcp_source_add,
+	.source_remove = modbus_tcp_source_remove,
+	.send          = modbus_tcp_send,
+	.read_begin    = modbus_tcp_read_begin,
+	.read_data     = modbus_tcp_read_data,
+	.read_end      = modbus_tcp_read_end,
+	.close         = modbus_tcp_close,
+	.free          = modbus_tcp_free,
+};
@@ -0,0 +1,92 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBSIGROK_NETFEED_H
+#define LIBSIGROK_NETFEED_H
+
+/*
+ * Framing of a datafeed over a TCP stream, as the "netfeed" output
+ * module serves it and the "netfeed" driver receives it. All numbers
+ * are little endian.
+ *
+ * The server starts with NETFEED_MAGIC, followed by NETFEED_HEADER.
+ * Each frame is a header (u32 payload length, u8 type, 3 zero bytes)
+ * and the payload:
+ *
+ *  NETFEED_HEADER      u64 samplerate, u32 number of channels, and for
+ *                      each channel: u8 type (NETFEED_CHANNEL_*),
+ *                      u8 enabled, u16 name length, the name (not
+ *                      terminated).
+ *  NETFEED_LOGIC       u32 unit size, the sample data.
+ *  NETFEED_ANALOG      u32 channel index, u32 mq, u32 unit, u64 mqflags,
+ *                      i32 digits, 32bit float samples.
+ *  NETFEED_SAMPLERATE  u64 samplerate, sent for SR_DF_META.
+ *  others              no payload.
+ *
+ * The "framed" output and input modules use the same framing to pass
+ * whole datafeeds between processes, and add frames which carry packets
+ * without loss:
+ *
+ *  NETFEED_META        u32 number of items, and for each item: u32 key,
+ *                      u16 type string length, the GVariant type string,
+ *                      u32 data length, the serialized GVariant (little
+ *                      endian).
+ *  NETFEED_ANALOG_RAW  u32 mq, u32 unit, u64 mqflags, u8 unit size,
+ *                      u8 flags (NETFEED_ENC_*), i8 digits, i8 spec
+ *                      digits, u32 samples per channel, i64/u64 scale,
+ *                      i64/u64 offset, u32 number of channels, u32 index
+ *                      of each channel, the samples as encoded.
+ *  NETFEED_LOGIC_RLE   u32 unit size, u64 number of runs, the values,
+ *                      a u64 count for each value.
+ *
+ * Receivers skip frame types they don't know.
+ */
+#define NETFEED_MAGIC		"SRNF\x01\0\0\0"
+#define NETFEED_MAGIC_LEN	8
+#define NETFEED_FRAME_LEN	8
+#define NETFEED_DEFAULT_PORT	5885
+/* Frames are sent as packets come, this only guards the receiver. */
+#define NETFEED_MAX_PAYLOAD	(64 * 1024 * 1024)
+
+#define NETFEED_CHANNEL_LOGIC	0
+#define NETFEED_CHANNEL_ANALOG	1
+
+#define NETFEED_LOGIC_LEN	4
+#define NETFEED_ANALOG_LEN	24
+#define NETFEED_ANALOG_RAW_LEN	60
+#define NETFEED_LOGIC_RLE_LEN	12
+
+#define NETFEED_ENC_SIGNED		(1 << 0)
+#define NETFEED_ENC_FLOAT		(1 << 1)
+#define NETFEED_ENC_BIGENDIAN		(1 << 2)
+#define NETFEED_ENC_DIGITS_DECIMAL	(1 << 3)
+
+enum netfeed_type {
+	NETFEED_HEADER = 1,
+	NETFEED_LOGIC,
+	NETFEED_ANALOG,
+	NETFEED_SAMPLERATE,
+	NETFEED_TRIGGER,
+	NETFEED_FRAME_BEGIN,
+	NETFEED_FRAME_END,
+	NETFEED_END,
+	NETFEED_META,
+	NETFEED_ANALOG_RAW,
+	NETFEED_LOGIC_RLE,
+};
+
+#endif
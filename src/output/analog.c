@@ -34,6 +34,7 @@ struct context {
 	GPtrArray *channellist;
 	int digits;
 	float *fdata;
+	size_t fdata_size;
 };
 
 enum {
@@ -72,8 +73,51 @@ static int init(struct sr_output *o, GHashTable *options)
 	return SR_OK;
 }
 
-static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
-		GString **out)
+/*
+ * Up to this many digits, a float times the power of ten is exact in a
+ * double (24 + 21 + 9 bits). Rounding that to an integer then gives the
+ * same result as printf's "%.*f", without going through the C library.
+ */
+#define FAST_MAX_DIGITS 9
+
+static const double pow10_table[FAST_MAX_DIGITS + 1] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+};
+
+static void append_fixed(GString *out, float value, int digits)
+{
+	char buf[32], *p;
+	double scaled;
+	uint64_t n;
+	int i;
+
+	scaled = 0;
+	if (digits <= FAST_MAX_DIGITS && isfinite(value))
+		scaled = rint(fabs((double)value) * pow10_table[digits]);
+	if (digits > FAST_MAX_DIGITS || !isfinite(value) || scaled >= 1e15) {
+		g_string_append_printf(out, "%.*f", digits, value);
+		return;
+	}
+
+	n = scaled;
+	p = buf + sizeof(buf);
+	for (i = 0; i < digits; i++) {
+		*--p = '0' + n % 10;
+		n /= 10;
+	}
+	if (digits)
+		*--p = '.';
+	do {
+		*--p = '0' + n % 10;
+		n /= 10;
+	} while (n);
+	if (signbit(value))
+		*--p = '-';
+	g_string_append_len(out, p, buf + sizeof(buf) - p);
+}
+
+static int receive_append(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString *out)
 {
 	struct context *ctx;
 	const struct sr_datafeed_analog *analog;
@@ -82,22 +126,24 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 	const struct sr_key_info *srci;
 	struct sr_channel *ch;
 	GSList *l;
-	float *fdata;
+	float *fdata, value;
 	unsigned int i;
+	size_t num_values;
 	int num_channels, c, ret, digits, actual_digits;
-	char *number, *suffix;
+	gboolean si_friendly;
+	const char *prefix;
+	char *suffix;
 
-	*out = NULL;
 	if (!o || !o->sdi)
 		return SR_ERR_ARG;
 	ctx = o->priv;
 
 	switch (packet->type) {
 	case SR_DF_FRAME_BEGIN:
-		*out = g_string_new("FRAME-BEGIN\n");
+		g_string_append(out, "FRAME-BEGIN\n");
 		break;
 	case SR_DF_FRAME_END:
-		*out = g_string_new("FRAME-END\n");
+		g_string_append(out, "FRAME-END\n");
 		break;
 	case SR_DF_META:
 		meta = packet->payload;
@@ -105,60 +151,68 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 			src = l->data;
 			if (!(srci = sr_key_info_get(SR_KEY_CONFIG, src->key)))
 				return SR_ERR;
-			*out = g_string_sized_new(512);
-			g_string_append(*out, "META ");
-			g_string_append_printf(*out, "%s: ", srci->id);
+			g_string_append(out, "META ");
+			g_string_append_printf(out, "%s: ", srci->id);
 			if (srci->datatype == SR_T_BOOL) {
-				g_string_append_printf(*out, "%u",
+				g_string_append_printf(out, "%u",
 					g_variant_get_boolean(src->data));
 			} else if (srci->datatype == SR_T_FLOAT) {
-				g_string_append_printf(*out, "%f",
+				g_string_append_printf(out, "%f",
 					g_variant_get_double(src->data));
 			} else if (srci->datatype == SR_T_UINT64) {
-				g_string_append_printf(*out, "%"
+				g_string_append_printf(out, "%"
 					G_GUINT64_FORMAT,
 					g_variant_get_uint64(src->data));
 			} else if (srci->datatype == SR_T_STRING) {
-				g_string_append_printf(*out, "%s",
+				g_string_append_printf(out, "%s",
 					g_variant_get_string(src->data, NULL));
 			}
-			g_string_append(*out, "\n");
+			g_string_append(out, "\n");
 		}
 		break;
 	case SR_DF_ANALOG:
 		analog = packet->payload;
 		num_channels = g_slist_length(analog->meaning->channels);
-		if (!(fdata = g_try_realloc(ctx->fdata,
-						analog->num_samples * num_channels * sizeof(float))))
-			return SR_ERR_MALLOC;
-		ctx->fdata = fdata;
+		/* The conversion buffer is kept, and only ever grows. */
+		num_values = (size_t)analog->num_samples * num_channels;
+		if (num_values > ctx->fdata_size) {
+			if (!(fdata = g_try_realloc(ctx->fdata,
+					num_values * sizeof(float))))
+				return SR_ERR_MALLOC;
+			ctx->fdata = fdata;
+			ctx->fdata_size = num_values;
+		}
+		fdata = ctx->fdata;
 		if ((ret = sr_analog_to_float(analog, fdata)) != SR_OK)
 			return ret;
-		*out = g_string_sized_new(512);
 		if (ctx->digits == DIGITS_ALL)
 			digits = analog->encoding->digits;
 		else
 			digits = analog->spec->spec_digits;
 		if (!analog->encoding->is_digits_decimal)
 			digits = copysign(ceil(abs(digits) * BIN_TO_DEC_DIGITS), digits);
-		gboolean si_friendly = sr_analog_si_prefix_friendly(analog->meaning->unit);
+
+		/*
+		 * The unit is the same for the whole packet. Only the SI
+		 * prefix depends on the value, and is a static string.
+		 */
+		si_friendly = sr_analog_si_prefix_friendly(analog->meaning->unit);
 		sr_analog_unit_to_string(analog, &suffix);
 		for (i = 0; i < analog->num_samples; i++) {
 			for (l = analog->meaning->channels, c = 0; l; l = l->next, c++) {
-				float value = fdata[i * num_channels + c];
-				const char *prefix = "";
+				value = fdata[i * num_channels + c];
+				prefix = "";
 				actual_digits = digits;
 				if (si_friendly)
 					prefix = sr_analog_si_prefix(&value, &actual_digits);
 				ch = l->data;
-				g_string_append_printf(*out, "%s: ", ch->name);
-				number = g_strdup_printf("%.*f", MAX(actual_digits, 0), value);
-				g_string_append(*out, number);
-				g_free(number);
-				g_string_append(*out, " ");
-				g_string_append(*out, prefix);
-				g_string_append(*out, suffix);
-				g_string_append(*out, "\n");
+				g_string_append(out, ch->name);
+				g_string_append_len(out, ": ", 2);
+				append_fixed(out, value, MAX(actual_digits, 0));
+				g_string_append_c(out, ' ');
+				g_string_append(out, prefix);
+				g_string_append(out, suffix);
+				g_string_append_c(out, '\n');
 			}
 		}
 		g_free(suffix);
@@ -218,6 +272,6 @@ SR_PRIV struct sr_output_module output_analog = {
 	.flags = 0,
 	.options = get_options,
 	.init = init,
-	.receive = receive,
+	.receive_append = receive_append,
 	.cleanup = cleanup
 };
@@ -0,0 +1,780 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Apache Arrow IPC output, in the file format (which readers can map)
+ * or the stream format. Each enabled channel is a column: logic ones
+ * are Bool (bit-packed), analog ones Float32, or their native integer
+ * type with "scale" and "offset" field metadata. An optional "time"
+ * column holds the time since the start as a Duration in nanoseconds.
+ * Record batches get written as soon as all columns have data.
+ *
+ * Options and their values:
+ *
+ * native: Keep integer analog samples as they are, instead of Float32.
+ *         Defaults to FALSE.
+ *
+ * time:   Add a "time" column first, if the samplerate is known.
+ *         Defaults to FALSE.
+ *
+ * stream: Write the stream format, without the file format's footer.
+ *         Defaults to FALSE.
+ *
+ * The Arrow metadata are flatbuffers, which get built in place here,
+ * front to back: each table comes after its vtable, and anything a
+ * table refers to comes after the table.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "output/arrow"
+
+#define ARROW_MAGIC		"ARROW1\0\0"
+#define ARROW_MAGIC_LEN		6
+#define ARROW_CONTINUATION	0xffffffff
+
+/* Values of the Arrow schema. */
+#define METADATA_V5		4
+#define HEADER_SCHEMA		1
+#define HEADER_RECORD_BATCH	3
+#define TYPE_INT		2
+#define TYPE_FLOATING_POINT	3
+#define TYPE_BOOL		6
+#define TYPE_DURATION		18
+#define PRECISION_SINGLE	1
+#define TIME_UNIT_NANOSECOND	3
+
+#define FB_MAX_FIELDS 8
+
+enum {
+	COL_LOGIC,
+	COL_FLOAT,
+	COL_INT,
+};
+
+struct column {
+	const struct sr_channel *ch;
+	int kind;
+	/* Whether the kind of analog column got set, by its first packet. */
+	gboolean known;
+	/* Integer columns only. */
+	unsigned int unitsize;
+	gboolean is_signed;
+	struct sr_rational scale, offset;
+	/* Rows not written yet, one byte per row for logic columns. */
+	GByteArray *data;
+	uint64_t rows;
+};
+
+struct block {
+	uint64_t offset;
+	uint32_t meta_len;
+	uint64_t body_len;
+};
+
+struct context {
+	gboolean native;
+	gboolean time;
+	gboolean stream;
+	uint64_t samplerate;
+	struct column *columns;
+	unsigned int num_columns;
+	gboolean schema_done;
+	uint64_t rows_written;
+	/* Bytes written, and the record batches' blocks for the footer. */
+	uint64_t written;
+	GArray *blocks;
+	float *fbuf;
+	size_t fbuf_len;
+};
+
+struct fb_table {
+	size_t pos;
+	size_t field[FB_MAX_FIELDS];
+};
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+	struct context *ctx;
+	struct sr_channel *ch;
+	GVariant *gvar;
+	GSList *l;
+	unsigned int i;
+
+	if (!o || !o->sdi)
+		return SR_ERR_ARG;
+
+	ctx = g_malloc0(sizeof(*ctx));
+	o->priv = ctx;
+	ctx->native = g_variant_get_boolean(g_hash_table_lookup(options, "native"));
+	ctx->time = g_variant_get_boolean(g_hash_table_lookup(options, "time"));
+	ctx->stream = g_variant_get_boolean(g_hash_table_lookup(options, "stream"));
+	ctx->blocks = g_array_new(FALSE, FALSE, sizeof(struct block));
+
+	for (l = o->sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->enabled && (ch->type == SR_CHANNEL_LOGIC ||
+				ch->type == SR_CHANNEL_ANALOG))
+			ctx->num_columns++;
+	}
+	ctx->columns = g_malloc0(ctx->num_columns * sizeof(*ctx->columns));
+	for (i = 0, l = o->sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (!ch->enabled || (ch->type != SR_CHANNEL_LOGIC &&
+				ch->type != SR_CHANNEL_ANALOG))
+			continue;
+		ctx->columns[i].ch = ch;
+		ctx->columns[i].kind = (ch->type == SR_CHANNEL_LOGIC) ?
+			COL_LOGIC : COL_FLOAT;
+		ctx->columns[i++].data = g_byte_array_new();
+	}
+
+	if (sr_config_get(o->sdi->driver, o->sdi, NULL, SR_CONF_SAMPLERATE,
+			&gvar) == SR_OK) {
+		ctx->samplerate = g_variant_get_uint64(gvar);
+		g_variant_unref(gvar);
+	}
+
+	return SR_OK;
+}
+
+/* Append len zero bytes, return where they start. */
+static size_t fb_zeros(GByteArray *b, size_t len)
+{
+	size_t pos;
+
+	pos = b->len;
+	g_byte_array_set_size(b, pos + len);
+	memset(b->data + pos, 0, len);
+
+	return pos;
+}
+
+static void fb_pad(GByteArray *b, size_t align)
+{
+	if (b->len % align)
+		fb_zeros(b, align - b->len % align);
+}
+
+/*
+ * Append a vtable and its table. sizes[] holds the size of each field
+ * in schema order, 0 for absent ones. The fields are zero, for the
+ * caller to set.
+ */
+static void fb_table(GByteArray *b, struct fb_table *t,
+		const uint8_t *sizes, unsigned int n)
+{
+	size_t vt;
+	unsigned int i;
+
+	fb_pad(b, 2);
+	vt = fb_zeros(b, 4 + 2 * n);
+	fb_pad(b, 4);
+	t->pos = fb_zeros(b, 4);
+	for (i = 0; i < n; i++) {
+		t->field[i] = 0;
+		if (!sizes[i])
+			continue;
+		fb_pad(b, sizes[i]);
+		t->field[i] = fb_zeros(b, sizes[i]);
+		write_u16le(b->data + vt + 4 + 2 * i, t->field[i] - t->pos);
+	}
+	write_u16le(b->data + vt, 4 + 2 * n);
+	write_u16le(b->data + vt + 2, b->len - t->pos);
+	write_u32le(b->data + t->pos, t->pos - vt);
+}
+
+/* Point the offset at pos to target, which comes after it. */
+static void fb_offset(GByteArray *b, size_t pos, size_t target)
+{
+	write_u32le(b->data + pos, target - pos);
+}
+
+static size_t fb_string(GByteArray *b, const char *s)
+{
+	size_t pos, len;
+
+	fb_pad(b, 4);
+	len = strlen(s);
+	pos = fb_zeros(b, 4 + len + 1);
+	write_u32le(b->data + pos, len);
+	memcpy(b->data + pos + 4, s, len);
+
+	return pos;
+}
+
+/* Append a vector of n zero elements, aligned for them. */
+static size_t fb_vector(GByteArray *b, size_t n, size_t size, size_t align)
+{
+	size_t pos;
+
+	while ((b->len + 4) % align)
+		fb_zeros(b, 1);
+	pos = fb_zeros(b, 4 + n * size);
+	write_u32le(b->data + pos, n);
+
+	return pos;
+}
+
+/* A vector of key/value metadata, at the offset at pos. */
+static void fb_metadata(GByteArray *b, size_t pos, const char **kv,
+		unsigned int n)
+{
+	static const uint8_t sizes[] = { 4, 4 };
+	struct fb_table t;
+	size_t vec;
+	unsigned int i;
+
+	vec = fb_vector(b, n, 4, 4);
+	fb_offset(b, pos, vec);
+	for (i = 0; i < n; i++) {
+		fb_table(b, &t, sizes, G_N_ELEMENTS(sizes));
+		fb_offset(b, vec + 4 + 4 * i, t.pos);
+		fb_offset(b, t.field[0], fb_string(b, kv[2 * i]));
+		fb_offset(b, t.field[1], fb_string(b, kv[2 * i + 1]));
+	}
+}
+
+/* A Field table for a column, or for the time column if col is NULL. */
+static size_t fb_field(GByteArray *b, const struct column *col)
+{
+	/* name, nullable, type_type, type, dictionary, children, metadata */
+	uint8_t sizes[] = { 4, 1, 1, 4, 0, 4, 0 };
+	static const uint8_t int_sizes[] = { 4, 1 };
+	static const uint8_t short_sizes[] = { 2 };
+	struct fb_table t, tt;
+	const char *kv[4];
+	char *scale, *offset;
+
+	if (col && col->kind == COL_INT)
+		sizes[6] = 4;
+	fb_table(b, &t, sizes, G_N_ELEMENTS(sizes));
+	fb_offset(b, t.field[0], fb_string(b, col ? col->ch->name : "time"));
+
+	if (!col) {
+		b->data[t.field[2]] = TYPE_DURATION;
+		fb_table(b, &tt, short_sizes, 1);
+		write_u16le(b->data + tt.field[0], TIME_UNIT_NANOSECOND);
+	} else if (col->kind == COL_LOGIC) {
+		b->data[t.field[2]] = TYPE_BOOL;
+		fb_table(b, &tt, NULL, 0);
+	} else if (col->kind == COL_FLOAT) {
+		b->data[t.field[2]] = TYPE_FLOATING_POINT;
+		fb_table(b, &tt, short_sizes, 1);
+		write_u16le(b->data + tt.field[0], PRECISION_SINGLE);
+	} else {
+		b->data[t.field[2]] = TYPE_INT;
+		fb_table(b, &tt, int_sizes, 2);
+		write_u32le(b->data + tt.field[0], col->unitsize * 8);
+		b->data[tt.field[1]] = col->is_signed;
+	}
+	fb_offset(b, t.field[3], tt.pos);
+	fb_offset(b, t.field[5], fb_vector(b, 0, 4, 4));
+
+	if (col && col->kind == COL_INT) {
+		scale = g_strdup_printf("%" PRId64 "/%" PRIu64,
+			col->scale.p, col->scale.q);
+		offset = g_strdup_printf("%" PRId64 "/%" PRIu64,
+			col->offset.p, col->offset.q);
+		kv[0] = "scale";
+		kv[1] = scale;
+		kv[2] = "offset";
+		kv[3] = offset;
+		fb_metadata(b, t.field[6], kv, 2);
+		g_free(scale);
+		g_free(offset);
+	}
+
+	return t.pos;
+}
+
+static gboolean has_time(const struct context *ctx)
+{
+	return ctx->time && ctx->samplerate;
+}
+
+/* A Schema table, at the offset at pos. */
+static void fb_schema(const struct context *ctx, GByteArray *b, size_t pos)
+{
+	static const uint8_t sizes[] = { 2, 4, 4 };
+	struct fb_table t;
+	const char *kv[2];
+	char *rate;
+	size_t vec;
+	unsigned int i, n;
+
+	/* Endianness is little, which is 0. */
+	fb_table(b, &t, sizes, G_N_ELEMENTS(sizes));
+	fb_offset(b, pos, t.pos);
+
+	n = has_time(ctx) ? 1 : 0;
+	vec = fb_vector(b, n + ctx->num_columns, 4, 4);
+	fb_offset(b, t.field[1], vec);
+	if (n)
+		fb_offset(b, vec + 4, fb_field(b, NULL));
+	for (i = 0; i < ctx->num_columns; i++)
+		fb_offset(b, vec + 4 + 4 * (n + i),
+			fb_field(b, &ctx->columns[i]));
+
+	rate = g_strdup_printf("%" PRIu64, ctx->samplerate);
+	kv[0] = "samplerate";
+	kv[1] = rate;
+	fb_metadata(b, t.field[2], kv, 1);
+	g_free(rate);
+}
+
+/* Start a Message of the given type, return the offset to its header. */
+static size_t fb_message(GByteArray *b, int type, uint64_t body_len)
+{
+	static const uint8_t sizes[] = { 2, 1, 4, 8 };
+	struct fb_table t;
+
+	fb_zeros(b, 4);
+	fb_table(b, &t, sizes, G_N_ELEMENTS(sizes));
+	fb_offset(b, 0, t.pos);
+	write_u16le(b->data + t.field[0], METADATA_V5);
+	b->data[t.field[1]] = type;
+	write_u64le(b->data + t.field[3], body_len);
+
+	return t.field[2];
+}
+
+static void out_append(struct context *ctx, GString *out, const void *data,
+		size_t len)
+{
+	g_string_append_len(out, data, len);
+	ctx->written += len;
+}
+
+/* Write an encapsulated message, which starts at an 8 byte boundary. */
+static void message_append(struct context *ctx, GString *out, GByteArray *fb,
+		const GByteArray *body, struct block *block)
+{
+	uint8_t prefix[8];
+
+	fb_pad(fb, 8);
+	write_u32le(prefix, ARROW_CONTINUATION);
+	write_u32le(prefix + 4, fb->len);
+	if (block) {
+		block->offset = ctx->written;
+		block->meta_len = sizeof(prefix) + fb->len;
+		block->body_len = body ? body->len : 0;
+	}
+	out_append(ctx, out, prefix, sizeof(prefix));
+	out_append(ctx, out, fb->data, fb->len);
+	if (body)
+		out_append(ctx, out, body->data, body->len);
+}
+
+static void schema_append(struct context *ctx, GString *out)
+{
+	GByteArray *fb;
+
+	if (ctx->schema_done)
+		return;
+	ctx->schema_done = TRUE;
+	if (ctx->time && !ctx->samplerate)
+		sr_warn("No samplerate, leaving out the time column.");
+
+	if (!ctx->stream)
+		out_append(ctx, out, ARROW_MAGIC, 8);
+	fb = g_byte_array_new();
+	fb_schema(ctx, fb, fb_message(fb, HEADER_SCHEMA, 0));
+	message_append(ctx, out, fb, NULL, NULL);
+	g_byte_array_free(fb, TRUE);
+}
+
+static uint64_t column_rows(const struct context *ctx)
+{
+	uint64_t rows;
+	unsigned int i;
+
+	rows = ctx->num_columns ? UINT64_MAX : 0;
+	for (i = 0; i < ctx->num_columns; i++)
+		rows = MIN(rows, ctx->columns[i].rows);
+
+	return rows;
+}
+
+static size_t column_elemsize(const struct column *col)
+{
+	switch (col->kind) {
+	case COL_LOGIC:
+		return 1;
+	case COL_INT:
+		return col->unitsize;
+	default:
+		return sizeof(float);
+	}
+}
+
+/* Append a column's values to the body, and note its buffers. */
+static void body_column(const struct context *ctx, const struct column *col,
+		uint64_t rows, GByteArray *body, uint64_t *buffers)
+{
+	uint8_t *p;
+	uint64_t i, n;
+	size_t pos;
+
+	/* No nulls, so the validity buffer is empty. */
+	buffers[0] = body->len;
+	buffers[1] = 0;
+	buffers[2] = body->len;
+
+	if (!col) {
+		pos = fb_zeros(body, rows * sizeof(uint64_t));
+		for (i = 0; i < rows; i++) {
+			n = ctx->rows_written + i;
+			/* Exact, for samplerates up to 18 GHz. */
+			write_u64le(body->data + pos + 8 * i,
+				n / ctx->samplerate * SR_GHZ(1) +
+				n % ctx->samplerate * SR_GHZ(1) / ctx->samplerate);
+		}
+		buffers[3] = rows * sizeof(uint64_t);
+	} else if (col->kind == COL_LOGIC) {
+		pos = fb_zeros(body, (rows + 7) / 8);
+		p = body->data + pos;
+		for (i = 0; i < rows; i++)
+			p[i / 8] |= col->data->data[i] << (i % 8);
+		buffers[3] = (rows + 7) / 8;
+	} else {
+		n = rows * column_elemsize(col);
+		g_byte_array_append(body, col->data->data, n);
+		buffers[3] = n;
+	}
+	fb_pad(body, 8);
+}
+
+/* Write the rows which all columns have as a record batch. */
+static void batch_append(struct context *ctx, GString *out)
+{
+	static const uint8_t sizes[] = { 8, 4, 4 };
+	struct fb_table t;
+	struct block block;
+	struct column *col;
+	GByteArray *fb, *body;
+	uint64_t rows, *buffers;
+	size_t header, nodes, bufs;
+	unsigned int i, n, num_fields;
+
+	if (!(rows = column_rows(ctx)))
+		return;
+	schema_append(ctx, out);
+
+	n = has_time(ctx) ? 1 : 0;
+	num_fields = n + ctx->num_columns;
+	buffers = g_malloc(num_fields * 4 * sizeof(uint64_t));
+	body = g_byte_array_new();
+	if (n)
+		body_column(ctx, NULL, rows, body, buffers);
+	for (i = 0; i < ctx->num_columns; i++) {
+		col = &ctx->columns[i];
+		body_column(ctx, col, rows, body, buffers + 4 * (n + i));
+		g_byte_array_remove_range(col->data, 0,
+			rows * column_elemsize(col));
+		col->rows -= rows;
+	}
+
+	fb = g_byte_array_new();
+	header = fb_message(fb, HEADER_RECORD_BATCH, body->len);
+	fb_table(fb, &t, sizes, G_N_ELEMENTS(sizes));
+	fb_offset(fb, header, t.pos);
+	write_u64le(fb->data + t.field[0], rows);
+	nodes = fb_vector(fb, num_fields, 16, 8);
+	fb_offset(fb, t.field[1], nodes);
+	for (i = 0; i < num_fields; i++)
+		write_u64le(fb->data + nodes + 4 + 16 * i, rows);
+	bufs = fb_vector(fb, 2 * num_fields, 16, 8);
+	fb_offset(fb, t.field[2], bufs);
+	for (i = 0; i < 4 * num_fields; i++)
+		write_u64le(fb->data + bufs + 4 + 8 * i, buffers[i]);
+
+	message_append(ctx, out, fb, body, &block);
+	g_array_append_val(ctx->blocks, block);
+	ctx->rows_written += rows;
+
+	g_byte_array_free(fb, TRUE);
+	g_byte_array_free(body, TRUE);
+	g_free(buffers);
+}
+
+static void footer_append(struct context *ctx, GString *out)
+{
+	static const uint8_t sizes[] = { 2, 4, 0, 4 };
+	const struct block *block;
+	struct fb_table t;
+	GByteArray *fb;
+	uint8_t tmp[8];
+	size_t vec;
+	unsigned int i;
+
+	fb = g_byte_array_new();
+	fb_zeros(fb, 4);
+	fb_table(fb, &t, sizes, G_N_ELEMENTS(sizes));
+	fb_offset(fb, 0, t.pos);
+	write_u16le(fb->data + t.field[0], METADATA_V5);
+	vec = fb_vector(fb, ctx->blocks->len, 24, 8);
+	fb_offset(fb, t.field[3], vec);
+	for (i = 0; i < ctx->blocks->len; i++) {
+		block = &g_array_index(ctx->blocks, struct block, i);
+		write_u64le(fb->data + vec + 4 + 24 * i, block->offset);
+		write_u32le(fb->data + vec + 4 + 24 * i + 8, block->meta_len);
+		write_u64le(fb->data + vec + 4 + 24 * i + 16, block->body_len);
+	}
+	fb_schema(ctx, fb, t.field[1]);
+
+	out_append(ctx, out, fb->data, fb->len);
+	write_u32le(tmp, fb->len);
+	out_append(ctx, out, tmp, 4);
+	out_append(ctx, out, ARROW_MAGIC, ARROW_MAGIC_LEN);
+	g_byte_array_free(fb, TRUE);
+}
+
+static struct column *column_find(struct context *ctx,
+		const struct sr_channel *ch)
+{
+	unsigned int i;
+
+	for (i = 0; i < ctx->num_columns; i++)
+		if (ctx->columns[i].ch == ch)
+			return &ctx->columns[i];
+
+	return NULL;
+}
+
+static void logic_append(struct context *ctx,
+		const struct sr_datafeed_logic *logic)
+{
+	const uint8_t *data;
+	struct column *col;
+	uint64_t i, n;
+	unsigned int c, byte, bit;
+	size_t pos;
+	uint8_t *p;
+
+	if (!logic->unitsize)
+		return;
+	n = logic->length / logic->unitsize;
+	data = logic->data;
+
+	for (c = 0; c < ctx->num_columns; c++) {
+		col = &ctx->columns[c];
+		byte = col->ch->index / 8;
+		bit = col->ch->index % 8;
+		if (col->kind != COL_LOGIC || byte >= logic->unitsize)
+			continue;
+		pos = fb_zeros(col->data, n);
+		p = col->data->data + pos;
+		for (i = 0; i < n; i++)
+			p[i] = (data[i * logic->unitsize + byte] >> bit) & 1;
+		col->rows += n;
+	}
+}
+
+static int analog_append(struct context *ctx,
+		const struct sr_datafeed_analog *analog)
+{
+	const struct sr_analog_encoding *enc;
+	struct column *col;
+	uint8_t *p, tmp;
+	size_t i, len;
+	unsigned int j, n;
+	int ret;
+
+	if (!analog->meaning->channels || !analog->num_samples)
+		return SR_OK;
+	if (g_slist_length(analog->meaning->channels) > 1) {
+		sr_dbg("Skipping analog packet of several channels.");
+		return SR_OK;
+	}
+	if (!(col = column_find(ctx, analog->meaning->channels->data)))
+		return SR_OK;
+	enc = analog->encoding;
+	n = analog->num_samples;
+
+	if (!col->known) {
+		col->known = TRUE;
+		if (ctx->native && !enc->is_float && (enc->unitsize == 1 ||
+				enc->unitsize == 2 || enc->unitsize == 4 ||
+				enc->unitsize == 8)) {
+			col->kind = COL_INT;
+			col->unitsize = enc->unitsize;
+			col->is_signed = enc->is_signed;
+			col->scale = enc->scale;
+			col->offset = enc->offset;
+		}
+	}
+
+	if (col->kind == COL_INT) {
+		if (enc->is_float || enc->unitsize != col->unitsize ||
+				enc->is_signed != col->is_signed ||
+				sr_rational_eq(&enc->scale, &col->scale) != 1 ||
+				sr_rational_eq(&enc->offset, &col->offset) != 1) {
+			sr_err("Encoding of channel %s changed, cannot keep "
+				"its native samples.", col->ch->name);
+			return SR_ERR_DATA;
+		}
+		len = (size_t)n * col->unitsize;
+		i = fb_zeros(col->data, len);
+		p = col->data->data + i;
+		memcpy(p, analog->data, len);
+		if (enc->is_bigendian && col->unitsize > 1) {
+			for (i = 0; i < len; i += col->unitsize)
+				for (j = 0; j < col->unitsize / 2; j++) {
+					tmp = p[i + j];
+					p[i + j] = p[i + col->unitsize - 1 - j];
+					p[i + col->unitsize - 1 - j] = tmp;
+				}
+		}
+	} else {
+		if (ctx->fbuf_len < n) {
+			ctx->fbuf = g_realloc(ctx->fbuf, n * sizeof(float));
+			ctx->fbuf_len = n;
+		}
+		if ((ret = sr_analog_to_float(analog, ctx->fbuf)) != SR_OK)
+			return ret;
+		i = fb_zeros(col->data, n * sizeof(float));
+		p = col->data->data + i;
+		for (j = 0; j < n; j++)
+			write_fltle(p + j * sizeof(float), ctx->fbuf[j]);
+	}
+	col->rows += n;
+
+	return SR_OK;
+}
+
+static void end_append(struct context *ctx, GString *out)
+{
+	uint8_t eos[8];
+	unsigned int i;
+
+	batch_append(ctx, out);
+	for (i = 0; i < ctx->num_columns; i++) {
+		if (ctx->columns[i].rows)
+			sr_warn("Dropping %" PRIu64 " samples of channel %s, "
+				"which the other channels do not have.",
+				ctx->columns[i].rows, ctx->columns[i].ch->name);
+		g_byte_array_set_size(ctx->columns[i].data, 0);
+		ctx->columns[i].rows = 0;
+	}
+	schema_append(ctx, out);
+
+	write_u32le(eos, ARROW_CONTINUATION);
+	write_u32le(eos + 4, 0);
+	out_append(ctx, out, eos, sizeof(eos));
+	if (!ctx->stream)
+		footer_append(ctx, out);
+}
+
+static int receive_append(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString *out)
+{
+	struct context *ctx;
+	const struct sr_datafeed_meta *meta;
+	const struct sr_config *src;
+	GSList *l;
+	int ret;
+
+	if (!o || !o->sdi || !(ctx = o->priv))
+		return SR_ERR_ARG;
+
+	switch (packet->type) {
+	case SR_DF_META:
+		meta = packet->payload;
+		for (l = meta->config; l; l = l->next) {
+			src = l->data;
+			if (src->key != SR_CONF_SAMPLERATE)
+				continue;
+			/* The schema has the samplerate, it cannot change. */
+			if (!ctx->schema_done)
+				ctx->samplerate = g_variant_get_uint64(src->data);
+			else if (g_variant_get_uint64(src->data) != ctx->samplerate)
+				sr_warn("Samplerate changed, the output keeps "
+					"the initial one.");
+		}
+		break;
+	case SR_DF_LOGIC:
+		logic_append(ctx, packet->payload);
+		batch_append(ctx, out);
+		break;
+	case SR_DF_ANALOG:
+		if ((ret = analog_append(ctx, packet->payload)) != SR_OK)
+			return ret;
+		batch_append(ctx, out);
+		break;
+	case SR_DF_END:
+		end_append(ctx, out);
+		break;
+	default:
+		break;
+	}
+
+	return SR_OK;
+}
+
+static struct sr_option options[] = {
+	{ "native", "Native", "Keep integer analog samples, with their scale as metadata", NULL, NULL },
+	{ "time", "Time", "Add a column with the time of each sample", NULL, NULL },
+	{ "stream", "Stream", "Write the stream format, which has no footer", NULL, NULL },
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	if (!options[0].def) {
+		options[0].def = g_variant_ref_sink(g_variant_new_boolean(FALSE));
+		options[1].def = g_variant_ref_sink(g_variant_new_boolean(FALSE));
+		options[2].def = g_variant_ref_sink(g_variant_new_boolean(FALSE));
+	}
+
+	return options;
+}
+
+static int cleanup(struct sr_output *o)
+{
+	struct context *ctx;
+	unsigned int i;
+
+	if (!o || !o->sdi || !(ctx = o->priv))
+		return SR_ERR_ARG;
+
+	for (i = 0; i < ctx->num_columns; i++)
+		g_byte_array_free(ctx->columns[i].data, TRUE);
+	g_free(ctx->columns);
+	g_array_free(ctx->blocks, TRUE);
+	g_free(ctx->fbuf);
+	g_free(ctx);
+	o->priv = NULL;
+
+	return SR_OK;
+}
+
+SR_PRIV struct sr_output_module output_arrow = {
+	.id = "arrow",
+	.name = "Apache Arrow",
+	.desc = "Apache Arrow IPC file, one column per channel",
+	.exts = (const char *[]){"arrow", NULL},
+	.flags = 0,
+	.options = get_options,
+	.init = init,
+	.receive_append = receive_append,
+	.cleanup = cleanup,
+};
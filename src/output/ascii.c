@@ -42,7 +42,7 @@ struct context {
 	size_t spl_cnt;
 	int trigger;
 	uint64_t samplerate;
-	int *channel_index;
+	struct sr_output_logic_map *map;
 	char **aligned_names;
 	size_t max_namelen;
 	char **line_values;
@@ -57,7 +57,6 @@ static int init(struct sr_output *o, GHashTable *options)
 {
 	struct context *ctx;
 	struct sr_channel *ch;
-	GSList *l;
 	size_t j, max_namelen, alloc_line_len;
 
 	if (!o || !o->sdi)
@@ -75,57 +74,34 @@ static int init(struct sr_output *o, GHashTable *options)
 	}
 	ctx->edges = (strlen(ctx->charset) >= 4) ? TRUE : FALSE;
 
-	for (l = o->sdi->channels; l; l = l->next) {
-		ch = l->data;
-		if (ch->type != SR_CHANNEL_LOGIC)
-			continue;
-		if (!ch->enabled)
-			continue;
-		ctx->num_enabled_channels++;
-	}
-	ctx->channel_index = g_malloc0(sizeof(ctx->channel_index[0]) * ctx->num_enabled_channels);
+	ctx->map = sr_output_logic_map_new(o->sdi);
+	ctx->num_enabled_channels = ctx->map->num_channels;
 	ctx->aligned_names = g_malloc0(sizeof(ctx->aligned_names[0]) * ctx->num_enabled_channels);
 	ctx->lines = g_malloc0(sizeof(ctx->lines[0]) * ctx->num_enabled_channels);
 	ctx->prev_sample = g_malloc0(g_slist_length(o->sdi->channels));
 
 	/* Get the maximum length across all active logic channels. */
 	max_namelen = 0;
-	for (l = o->sdi->channels; l; l = l->next) {
-		ch = l->data;
-		if (ch->type != SR_CHANNEL_LOGIC)
-			continue;
-		if (!ch->enabled)
-			continue;
-		max_namelen = MAX(max_namelen, strlen(ch->name));
-	}
+	for (j = 0; j < ctx->num_enabled_channels; j++)
+		max_namelen = MAX(max_namelen, strlen(ctx->map->channels[j]->name));
 	ctx->max_namelen = max_namelen;
 
 	alloc_line_len = ctx->max_namelen + 8 + ctx->spl;
-	j = 0;
-	for (l = o->sdi->channels; l; l = l->next) {
-		ch = l->data;
-		if (ch->type != SR_CHANNEL_LOGIC)
-			continue;
-		if (!ch->enabled)
-			continue;
-
-		ctx->channel_index[j] = ch->index;
+	for (j = 0; j < ctx->num_enabled_channels; j++) {
+		ch = ctx->map->channels[j];
 		ctx->aligned_names[j] = g_strdup_printf("%*s", (int)max_namelen, ch->name);
 
 		ctx->lines[j] = g_string_sized_new(alloc_line_len);
 		g_string_printf(ctx->lines[j], "%s:", ctx->aligned_names[j]);
-
-		j++;
 	}
 
 	return SR_OK;
 }
 
-static GString *gen_header(const struct sr_output *o)
+static void gen_header(const struct sr_output *o, GString *header)
 {
 	struct context *ctx;
 	GVariant *gvar;
-	GString *header;
 	size_t num_channels;
 	char *samplerate_s;
 
@@ -138,8 +114,7 @@ static GString *gen_header(const struct sr_output *o)
 		}
 	}
 
-	header = g_string_sized_new(512);
-	g_string_printf(header, "%s %s\n", PACKAGE_NAME, sr_package_version_string_get());
+	g_string_append_printf(header, "%s %s\n", PACKAGE_NAME, sr_package_version_string_get());
 	num_channels = g_slist_length(o->sdi->channels);
 	g_string_append_printf(header, "Acquisition with %zu/%zu channels",
 			ctx->num_enabled_channels, num_channels);
@@ -149,8 +124,6 @@ static GString *gen_header(const struct sr_output *o)
 		g_free(samplerate_s);
 	}
 	g_string_append_printf(header, "\n");
-
-	return header;
 }
 
 static void maybe_add_trigger(struct context *ctx, GString *out)
@@ -172,23 +145,66 @@ static void maybe_add_trigger(struct context *ctx, GString *out)
 		offset + 1, "^", offset);
 }
 
-static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
-		GString **out)
+/*
+ * Append a run of samples of one channel to its line buffer. Writes
+ * the text directly into the (pre-sized) line buffer. The previous
+ * sample is needed to tell edges from levels.
+ */
+static void append_chars(struct context *ctx, size_t ch,
+	const uint8_t *prev, const uint8_t *data, size_t unitsize, size_t count)
+{
+	GString *line;
+	const uint8_t *p;
+	uint8_t bitmask, curbit, prevbit;
+	size_t bytepos, len, pos, i, charidx;
+	char *wp;
+
+	line = ctx->lines[ch];
+	bytepos = ctx->map->byte_pos[ch];
+	bitmask = ctx->map->bit_mask[ch];
+	p = data + bytepos;
+	prevbit = prev[bytepos] & bitmask;
+	pos = ctx->spl_cnt;
+
+	len = line->len;
+	g_string_set_size(line, len + count);
+	wp = &line->str[len];
+	for (i = 0; i < count; i++) {
+		curbit = *p & bitmask;
+		charidx = curbit ? 1 : 0;
+		if (ctx->edges && pos + i > 0 && curbit != prevbit)
+			charidx += 2;
+		*wp++ = ctx->charset[charidx];
+		prevbit = curbit;
+		p += unitsize;
+	}
+}
+
+static void flush_lines(struct context *ctx, GString *out)
+{
+	size_t j;
+
+	for (j = 0; j < ctx->num_enabled_channels; j++) {
+		g_string_append_len(out, ctx->lines[j]->str, ctx->lines[j]->len);
+		g_string_append_c(out, '\n');
+		g_string_truncate(ctx->lines[j], ctx->max_namelen + 1);
+	}
+	if (ctx->num_enabled_channels)
+		maybe_add_trigger(ctx, out);
+}
+
+static int receive_append(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString *out)
 {
 	const struct sr_datafeed_meta *meta;
 	const struct sr_datafeed_logic *logic;
 	const struct sr_config *src;
 	GSList *l;
 	struct context *ctx;
-	size_t idx, i, j;
-	size_t num_samples;
-	const uint8_t *curr_sample;
-	size_t bytepos;
-	uint8_t bitmask, curbit, prevbit;
-	char c;
-	size_t charidx;
+	size_t i, j;
+	size_t num_samples, count;
+	const uint8_t *curr_sample, *prev_sample;
 
-	*out = NULL;
 	if (!o || !o->sdi)
 		return SR_ERR_ARG;
 	if (!(ctx = o->priv))
@@ -209,57 +225,46 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		break;
 	case SR_DF_LOGIC:
 		if (!ctx->header_done) {
-			*out = gen_header(o);
+			gen_header(o, out);
 			ctx->header_done = TRUE;
-		} else {
-			*out = g_string_sized_new(512);
 		}
 
+		/*
+		 * Process the samples in runs up to the end of the current
+		 * line, one channel at a time. Flush all channels' lines
+		 * when they are complete.
+		 */
 		logic = packet->payload;
-		num_samples = logic->length / logic->unitsize;
+		num_samples = logic->unitsize ? logic->length / logic->unitsize : 0;
 		curr_sample = logic->data;
-		while (num_samples--) {
-			ctx->spl_cnt++;
-			for (j = 0; j < ctx->num_enabled_channels; j++) {
-				idx = ctx->channel_index[j];
-				bytepos = idx / 8;
-				bitmask = 1U << (idx % 8);
-				curbit = curr_sample[bytepos] & bitmask;
-				prevbit = ctx->prev_sample[bytepos] & bitmask;
-
-				charidx = curbit ? 1 : 0;
-				if (ctx->edges && ctx->spl_cnt > 1) {
-					if (curbit != prevbit)
-						charidx += 2;
-				}
-				c = ctx->charset[charidx];
-				g_string_append_c(ctx->lines[j], c);
-
-				if (ctx->spl_cnt == ctx->spl) {
-					/* Flush line buffers. */
-					g_string_append_len(*out, ctx->lines[j]->str, ctx->lines[j]->len);
-					g_string_append_c(*out, '\n');
-					if (j + 1 == ctx->num_enabled_channels)
-						maybe_add_trigger(ctx, *out);
-					g_string_printf(ctx->lines[j], "%s:", ctx->aligned_names[j]);
-				}
-			}
-			if (ctx->spl_cnt == ctx->spl)
-				/* Line buffers were already flushed. */
+		prev_sample = ctx->prev_sample;
+		while (num_samples) {
+			count = num_samples;
+			if (ctx->spl && count > ctx->spl - ctx->spl_cnt)
+				count = ctx->spl - ctx->spl_cnt;
+			for (j = 0; j < ctx->num_enabled_channels; j++)
+				append_chars(ctx, j, prev_sample, curr_sample,
+					logic->unitsize, count);
+			ctx->spl_cnt += count;
+			curr_sample += count * logic->unitsize;
+			prev_sample = curr_sample - logic->unitsize;
+			num_samples -= count;
+			if (ctx->spl_cnt == ctx->spl) {
+				flush_lines(ctx, out);
 				ctx->spl_cnt = 0;
-			memcpy(ctx->prev_sample, curr_sample, logic->unitsize);
-			curr_sample += logic->unitsize;
+			}
 		}
+		if (prev_sample != ctx->prev_sample)
+			memcpy(ctx->prev_sample, prev_sample, logic->unitsize);
 		break;
 	case SR_DF_END:
 		if (ctx->spl_cnt) {
 			/* Line buffers need flushing. */
-			*out = g_string_sized_new(512);
 			for (i = 0; i < ctx->num_enabled_channels; i++) {
-				g_string_append_len(*out, ctx->lines[i]->str, ctx->lines[i]->len);
-				g_string_append_c(*out, '\n');
+				g_string_append_len(out, ctx->lines[i]->str, ctx->lines[i]->len);
+				g_string_append_c(out, '\n');
 			}
-			maybe_add_trigger(ctx, *out);
+			maybe_add_trigger(ctx, out);
 		}
 		break;
 	}
@@ -278,7 +283,7 @@ static int cleanup(struct sr_output *o)
 	if (!(ctx = o->priv))
 		return SR_OK;
 
-	g_free(ctx->channel_index);
+	sr_output_logic_map_free(ctx->map);
 	g_free(ctx->prev_sample);
 	for (i = 0; i < ctx->num_enabled_channels; i++) {
 		g_free(ctx->aligned_names[i]);
@@ -319,6 +324,6 @@ SR_PRIV struct sr_output_module output_ascii = {
 	.flags = 0,
 	.options = get_options,
 	.init = init,
-	.receive = receive,
+	.receive_append = receive_append,
 	.cleanup = cleanup,
 };
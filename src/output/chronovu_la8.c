@@ -27,28 +27,37 @@
 
 #define LOG_PREFIX "output/chronovu-la8"
 
+/*
+ * The file has a fixed size data part, followed by the clock divider
+ * and the trigger position (see input/chronovu_la8.c). That trailer is
+ * written at the end, so the samples can be written as they come in.
+ */
+#define LA8_DATA_SIZE (8 * 1024 * 1024)
+
 struct context {
-	unsigned int num_enabled_channels;
-	gboolean triggered;
 	uint64_t samplerate;
 	uint64_t samplecount;
-	int *channel_index;
-	GString *pretrig_buf;
+	/* Bytes per sample in the file, 1 for LA8 or 2 for LA16. */
+	unsigned int unitsize;
+	size_t data_size;
+	gboolean triggered;
+	uint32_t trigger_pos;
 };
 
 /**
- * Check if the given samplerate is supported by the LA8 hardware.
+ * Check if the given samplerate is supported by the LA8/LA16 hardware.
  *
+ * @param base The base clock (in Hz), 100MHz for LA8, 200MHz for LA16.
  * @param samplerate The samplerate (in Hz) to check.
  *
  * @return 1 if the samplerate is supported/valid, 0 otherwise.
  */
-static gboolean is_valid_samplerate(uint64_t samplerate)
+static gboolean is_valid_samplerate(uint64_t base, uint64_t samplerate)
 {
 	unsigned int i;
 
 	for (i = 0; i < 255; i++) {
-		if (samplerate == (SR_MHZ(100) / (i + 1)))
+		if (samplerate == (base / (i + 1)))
 			return TRUE;
 	}
 
@@ -61,59 +70,107 @@ static gboolean is_valid_samplerate(uint64_t samplerate)
  * LA8 hardware: sample period = (divcount + 1) * 10ns.
  * Min. value for divcount: 0x00 (10ns sample period, 100MHz samplerate).
  * Max. value for divcount: 0xfe (2550ns sample period, 392.15kHz samplerate).
+ * The LA16 runs from a 200MHz base clock instead.
  *
+ * @param base The base clock in Hz.
  * @param samplerate The samplerate in Hz.
  *
  * @return The divcount value as needed by the hardware, or 0xff upon errors.
  */
-static uint8_t samplerate_to_divcount(uint64_t samplerate)
+static uint8_t samplerate_to_divcount(uint64_t base, uint64_t samplerate)
 {
-	if (samplerate == 0 || !is_valid_samplerate(samplerate)) {
+	if (samplerate == 0 || !is_valid_samplerate(base, samplerate)) {
 		sr_warn("Invalid samplerate (%" PRIu64 "Hz)", samplerate);
 		return 0xff;
 	}
 
-	return (SR_MHZ(100) / samplerate) - 1;
+	return (base / samplerate) - 1;
 }
 
 static int init(struct sr_output *o, GHashTable *options)
 {
-	struct context *ctx;
-	struct sr_channel *ch;
-	GSList *l;
-
 	(void)options;
 
 	if (!o || !o->sdi)
 		return SR_ERR_ARG;
 
-	ctx = g_malloc0(sizeof(struct context));
-	o->priv = ctx;
+	o->priv = g_malloc0(sizeof(struct context));
+
+	return SR_OK;
+}
+
+static void append_logic(struct context *ctx,
+		const struct sr_datafeed_logic *logic, GString *out)
+{
+	const uint8_t *data;
+	uint64_t num_samples, count, i;
+	size_t len;
+	uint8_t *p;
+
+	num_samples = logic->length / logic->unitsize;
+	if (!ctx->unitsize)
+		ctx->unitsize = logic->unitsize > 1 ? 2 : 1;
+
+	/* Samples which don't fit are dropped, like the hardware does. */
+	count = MIN(num_samples, (LA8_DATA_SIZE - ctx->data_size) / ctx->unitsize);
+	if (count < num_samples && ctx->data_size < LA8_DATA_SIZE)
+		sr_warn("Capture exceeds the file's data size, truncating.");
+
+	if (logic->unitsize == ctx->unitsize) {
+		g_string_append_len(out, logic->data, count * ctx->unitsize);
+	} else {
+		/* Keep the low byte(s), which the file format has room for. */
+		len = out->len;
+		g_string_set_size(out, len + count * ctx->unitsize);
+		p = (uint8_t *)&out->str[len];
+		data = logic->data;
+		for (i = 0; i < count; i++) {
+			memset(p, 0, ctx->unitsize);
+			memcpy(p, data, MIN(ctx->unitsize, logic->unitsize));
+			p += ctx->unitsize;
+			data += logic->unitsize;
+		}
+	}
+	ctx->data_size += count * ctx->unitsize;
+	ctx->samplecount += num_samples;
+}
 
-	for (l = o->sdi->channels; l; l = l->next) {
-		ch = l->data;
-		if (ch->type != SR_CHANNEL_LOGIC)
-			continue;
-		if (!ch->enabled)
-			continue;
-		ctx->num_enabled_channels++;
+static void append_trailer(const struct sr_output *o, struct context *ctx,
+		GString *out)
+{
+	GVariant *gvar;
+	size_t len;
+	uint8_t c[5];
+
+	/* Pad the capture to the fixed data size. */
+	len = out->len;
+	g_string_set_size(out, len + LA8_DATA_SIZE - ctx->data_size);
+	memset(&out->str[len], 0, LA8_DATA_SIZE - ctx->data_size);
+	ctx->data_size = LA8_DATA_SIZE;
+
+	if (!ctx->samplerate && sr_config_get(o->sdi->driver, o->sdi, NULL,
+			SR_CONF_SAMPLERATE, &gvar) == SR_OK) {
+		ctx->samplerate = g_variant_get_uint64(gvar);
+		g_variant_unref(gvar);
 	}
-	ctx->channel_index = g_malloc(sizeof(int) * ctx->num_enabled_channels);
-	ctx->pretrig_buf = g_string_sized_new(1024);
 
-	return SR_OK;
+	/* One byte for the 'divcount' value. */
+	c[0] = samplerate_to_divcount(ctx->unitsize == 2 ?
+		SR_MHZ(200) : SR_MHZ(100), ctx->samplerate);
+	/* Four bytes (little endian) for the trigger point. */
+	WL32(&c[1], ctx->trigger_pos);
+	g_string_append_len(out, (const char *)c, sizeof(c));
 }
 
-static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
-		GString **out)
+static int receive_append(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString *out)
 {
+	const struct sr_datafeed_meta *meta;
 	const struct sr_datafeed_logic *logic;
+	const struct sr_config *src;
 	struct context *ctx;
-	GVariant *gvar;
-	uint64_t samplerate;
-	gchar c[4];
+	GSList *l;
 
-	*out = NULL;
 	if (!o || !o->sdi)
 		return SR_ERR_ARG;
 	if (!(ctx = o->priv))
@@ -121,45 +178,35 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 
 	switch (packet->type) {
 	case SR_DF_HEADER:
-		/* One byte for the 'divcount' value. */
-		if (sr_config_get(o->sdi->driver, o->sdi, NULL, SR_CONF_SAMPLERATE,
-				&gvar) == SR_OK) {
-			samplerate = g_variant_get_uint64(gvar);
-			g_variant_unref(gvar);
-		} else
-			samplerate = 0;
-		c[0] = samplerate_to_divcount(samplerate);
-		*out = g_string_new_len(c, 1);
+		ctx->samplerate = 0;
+		ctx->samplecount = 0;
+		ctx->unitsize = 0;
+		ctx->data_size = 0;
 		ctx->triggered = FALSE;
+		ctx->trigger_pos = 0;
+		break;
+	case SR_DF_META:
+		meta = packet->payload;
+		for (l = meta->config; l; l = l->next) {
+			src = l->data;
+			if (src->key == SR_CONF_SAMPLERATE)
+				ctx->samplerate = g_variant_get_uint64(src->data);
+		}
 		break;
 	case SR_DF_TRIGGER:
-		/* Four bytes (little endian) for the trigger point. */
-		c[0] = ctx->samplecount & 0xff;
-		c[1] = (ctx->samplecount >> 8) & 0xff;
-		c[2] = (ctx->samplecount >> 16) & 0xff;
-		c[3] = (ctx->samplecount >> 24) & 0xff;
-		*out = g_string_new_len(c, 4);
-		/* Flush the pre-trigger buffer. */
-		if (ctx->pretrig_buf->len)
-			g_string_append_len(*out, ctx->pretrig_buf->str,
-					ctx->pretrig_buf->len);
+		if (!ctx->triggered && ctx->samplecount <= G_MAXUINT32)
+			ctx->trigger_pos = ctx->samplecount;
 		ctx->triggered = TRUE;
 		break;
 	case SR_DF_LOGIC:
 		logic = packet->payload;
-		if (!ctx->triggered)
-			g_string_append_len(ctx->pretrig_buf, logic->data, logic->length);
-		else
-			*out = g_string_new_len(logic->data, logic->length);
-		ctx->samplecount += logic->length / logic->unitsize;
+		if (logic->unitsize && logic->length >= logic->unitsize)
+			append_logic(ctx, logic, out);
 		break;
 	case SR_DF_END:
-		if (!ctx->triggered && ctx->pretrig_buf->len) {
-			/* We never got a trigger, submit an empty one. */
-			*out = g_string_sized_new(ctx->pretrig_buf->len + 4);
-			g_string_append_len(*out, "\x00\x00\x00\x00", 4);
-			g_string_append_len(*out, ctx->pretrig_buf->str, ctx->pretrig_buf->len);
-		}
+		if (!ctx->unitsize)
+			ctx->unitsize = 1;
+		append_trailer(o, ctx, out);
 		break;
 	}
 
@@ -168,18 +215,11 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 
 static int cleanup(struct sr_output *o)
 {
-	struct context *ctx;
-
 	if (!o || !o->sdi)
 		return SR_ERR_ARG;
 
-	if (o->priv) {
-		ctx = o->priv;
-		g_string_free(ctx->pretrig_buf, TRUE);
-		g_free(ctx->channel_index);
-		g_free(o->priv);
-		o->priv = NULL;
-	}
+	g_free(o->priv);
+	o->priv = NULL;
 
 	return SR_OK;
 }
@@ -192,6 +232,6 @@ SR_PRIV struct sr_output_module output_chronovu_la8 = {
 	.flags = 0,
 	.options = NULL,
 	.init = init,
-	.receive = receive,
+	.receive_append = receive_append,
 	.cleanup = cleanup,
 };
@@ -69,6 +69,31 @@ struct ctx_channel {
 	float min, max;
 };
 
+/*
+ * Large packets get split into slices of rows, which worker threads
+ * format in parallel. The slices' text gets concatenated in order.
+ */
+#define SLICE_MIN_ROWS 16384
+#define SLICE_MAX_COUNT 16
+
+struct context;
+
+struct row_slice {
+	const struct context *ctx;
+	unsigned int start, end;
+	/* Sample number for the time column of the first row. */
+	uint64_t time_index;
+	gboolean trigger;
+	/* Number of rows which got formatted. */
+	unsigned int rows;
+	float *min, *max;
+	GString *out;
+	/* Space to format one row in. */
+	char *row;
+	size_t row_size;
+	GThread *thread;
+};
+
 struct context {
 	/* Options */
 	const char *gnuplot;
@@ -82,11 +107,13 @@ struct context {
 	gboolean time;
 	gboolean do_trigger;
 	gboolean dedup;
+	unsigned int threads;
 
 	/* Plot data */
 	unsigned int num_analog_channels;
 	unsigned int num_logic_channels;
 	struct ctx_channel *channels;
+	struct sr_output_logic_map *map;
 
 	/* Metadata */
 	gboolean trigger;
@@ -96,9 +123,9 @@ struct context {
 	uint64_t sample_rate;
 	uint64_t sample_scale;
 	uint64_t out_sample_count;
-	uint8_t *previous_sample;
 	float *analog_samples;
 	uint8_t *logic_samples;
+	struct row_slice *slices;
 	const char *xlabel;	/* Don't free: will point to a static string. */
 	const char *title;	/* Don't free: will point into the driver struct. */
 };
@@ -142,6 +169,7 @@ static int init(struct sr_output *o, GHashTable *options)
 		g_hash_table_lookup(options, "label"), NULL);
 	ctx->dedup = g_variant_get_boolean(g_hash_table_lookup(options, "dedup"));
 	ctx->dedup &= ctx->time;
+	ctx->threads = g_variant_get_uint32(g_hash_table_lookup(options, "threads"));
 
 	if (*ctx->gnuplot && g_strcmp0(ctx->record, "\n"))
 		sr_warn("gnuplot record separator must be newline.");
@@ -158,6 +186,7 @@ static int init(struct sr_output *o, GHashTable *options)
 	sr_dbg("header = %d, time = %d, do_trigger = %d, dedup = %d",
 	       ctx->header, ctx->time, ctx->do_trigger, ctx->dedup);
 	sr_dbg("label_do = %d, label_names = %d", ctx->label_do, ctx->label_names);
+	sr_dbg("threads = %u", ctx->threads);
 
 	analog_channels = logic_channels = 0;
 	/* Get the number of channels, and the unitsize. */
@@ -193,6 +222,8 @@ static int init(struct sr_output *o, GHashTable *options)
 			} else if (ch->type == SR_CHANNEL_LOGIC) {
 				ctx->channels[i].min = 0;
 				ctx->channels[i].max = 1;
+				if (ctx->label_do && !ctx->label_names)
+					ctx->channels[i].label = "logic";
 			} else {
 				sr_warn("Unknown channel type %d.", ch->type);
 			}
@@ -201,6 +232,7 @@ static int init(struct sr_output *o, GHashTable *options)
 			ctx->channels[i++].ch = ch;
 		}
 	}
+	ctx->map = sr_output_logic_map_new(o->sdi);
 
 	return SR_OK;
 }
@@ -210,19 +242,17 @@ static const char *xlabels[] = {
 	"femtoseconds", "attoseconds",
 };
 
-static GString *gen_header(const struct sr_output *o,
-			   const struct sr_datafeed_header *hdr)
+static void gen_header(const struct sr_output *o,
+		       const struct sr_datafeed_header *hdr, GString *header)
 {
 	struct context *ctx;
 	struct sr_channel *ch;
 	GVariant *gvar;
-	GString *header;
 	GSList *channels, *l;
 	unsigned int num_channels, i;
 	char *samplerate_s;
 
 	ctx = o->priv;
-	header = g_string_sized_new(512);
 
 	if (ctx->sample_rate == 0) {
 		if (sr_config_get(o->sdi->driver, o->sdi, NULL,
@@ -281,8 +311,6 @@ static GString *gen_header(const struct sr_output *o,
 	/* Time column requested but samplerate unknown. Emit a warning. */
 	if (ctx->time && !ctx->sample_rate)
 		sr_warn("Samplerate unknown, cannot provide timestamps.");
-
-	return header;
 }
 
 /*
@@ -308,6 +336,29 @@ static GString *gen_header(const struct sr_output *o,
  * otherwise the data in the second packet will overwrite the data in
  * the first packet.
  */
+/*
+ * Check whether a packet carries all analog channels, in the order of
+ * the columns. Its values then are the row layout already.
+ */
+static gboolean analog_in_order(const struct context *ctx,
+				const struct sr_analog_meaning *meaning)
+{
+	size_t idx_have, num_have_ch;
+	GSList *l;
+
+	l = meaning->channels;
+	num_have_ch = ctx->num_analog_channels + ctx->num_logic_channels;
+	for (idx_have = 0; idx_have < num_have_ch; idx_have++) {
+		if (ctx->channels[idx_have].ch->type != SR_CHANNEL_ANALOG)
+			continue;
+		if (!l || l->data != ctx->channels[idx_have].ch)
+			return FALSE;
+		l = l->next;
+	}
+
+	return !l;
+}
+
 static void process_analog(struct context *ctx,
 			   const struct sr_datafeed_analog *analog)
 {
@@ -334,6 +385,22 @@ static void process_analog(struct context *ctx,
 	num_rcvd_ch = g_slist_length(meaning->channels);
 	ctx->channels_seen += num_rcvd_ch;
 	sr_dbg("Processing packet of %zu analog channels", num_rcvd_ch);
+
+	if (num_rcvd_ch > 1 && analog_in_order(ctx, meaning)) {
+		num_have_ch = ctx->num_analog_channels + ctx->num_logic_channels;
+		for (idx_have = 0; idx_have < num_have_ch; idx_have++) {
+			if (ctx->channels[idx_have].ch->type != SR_CHANNEL_ANALOG)
+				continue;
+			if (ctx->label_do && !ctx->label_names) {
+				sr_analog_unit_to_string(analog,
+					&ctx->channels[idx_have].label);
+			}
+		}
+		if (sr_analog_to_float(analog, ctx->analog_samples) != SR_OK)
+			sr_warn("Problems converting data to floating point values.");
+		return;
+	}
+
 	fdata = g_malloc(analog->num_samples * num_rcvd_ch * sizeof(float));
 	if ((ret = sr_analog_to_float(analog, fdata)) != SR_OK)
 		sr_warn("Problems converting data to floating point values.");
@@ -370,9 +437,9 @@ static void process_analog(struct context *ctx,
 static void process_logic(struct context *ctx,
 			  const struct sr_datafeed_logic *logic)
 {
-	unsigned int i, j, ch, num_samples;
-	int idx;
-	uint8_t *sample;
+	unsigned int i, num_samples;
+	const uint8_t *sample;
+	uint8_t *row;
 
 	num_samples = logic->length / logic->unitsize;
 	ctx->channels_seen += ctx->logic_channel_count;
@@ -386,27 +453,274 @@ static void process_logic(struct context *ctx,
 		sr_warn("Expecting %u samples, got %u",
 			ctx->num_samples, num_samples);
 
-	for (j = ch = 0; ch < ctx->num_logic_channels; j++) {
-		if (ctx->channels[j].ch->type == SR_CHANNEL_LOGIC) {
-			for (i = 0; i < num_samples; i++) {
-				sample = logic->data + i * logic->unitsize;
-				idx = ctx->channels[j].ch->index;
-				if (ctx->label_do && !ctx->label_names)
-					ctx->channels[j].label = "logic";
-				ctx->logic_samples[i * ctx->num_logic_channels + ch] = sample[idx / 8] & (1 << (idx % 8));
-			}
-			ch++;
+	sample = logic->data;
+	row = ctx->logic_samples;
+	for (i = 0; i < num_samples; i++) {
+		sr_output_logic_gather(ctx->map, sample, logic->unitsize, row);
+		sample += logic->unitsize;
+		row += ctx->num_logic_channels;
+	}
+}
+
+static const char digit_pairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+/* Append the decimal digits of v, two at a time. */
+static char *append_u64(char *p, uint64_t v)
+{
+	char tmp[20], *t;
+	size_t len;
+
+	t = tmp + sizeof(tmp);
+	while (v >= 100) {
+		t -= 2;
+		memcpy(t, &digit_pairs[(v % 100) * 2], 2);
+		v /= 100;
+	}
+	if (v >= 10) {
+		t -= 2;
+		memcpy(t, &digit_pairs[v * 2], 2);
+	} else {
+		*--t = '0' + v;
+	}
+	len = tmp + sizeof(tmp) - t;
+	memcpy(p, t, len);
+
+	return p + len;
+}
+
+/*
+ * Append v like "%g" does, but with a '.' in any locale. Values with a
+ * decimal exponent of -4 to 5 are what "%g" prints without exponent,
+ * and for these the float times 10^(5 - exponent) is exact in a double
+ * (5^9 fits 21 bits), so rounding it to an integer (to even, as printf
+ * does) yields the correct six significant digits. Others are rare
+ * enough to go through g_ascii_formatd().
+ */
+static char *append_float(char *p, float value)
+{
+	static const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+	};
+	double v, x;
+	uint64_t n;
+	int e, i, len;
+	char digits[6];
+
+	v = value;
+	if (v == 0 || !isfinite(v) || fabs(v) < 1e-4 || fabs(v) >= 1e6) {
+		if (v == 0) {
+			if (signbit(v))
+				*p++ = '-';
+			*p++ = '0';
+			return p;
 		}
+		g_ascii_formatd(p, G_ASCII_DTOSTR_BUF_SIZE, "%g", v);
+		return p + strlen(p);
 	}
+
+	if (v < 0) {
+		*p++ = '-';
+		v = -v;
+	}
+
+	e = floor(log10(v));
+	e = CLAMP(e, -4, 5);
+	x = v * pow10[5 - e];
+	if (x < 1e5 && e > -4) {
+		e--;
+		x = v * pow10[5 - e];
+	} else if (x >= 1e6 && e < 5) {
+		e++;
+		x = v * pow10[5 - e];
+	}
+	n = llrint(x);
+	if (n >= 1000000) {
+		/* Rounded up to the next power of ten. */
+		n /= 10;
+		e++;
+		if (e > 5) {
+			g_ascii_formatd(p, G_ASCII_DTOSTR_BUF_SIZE, "%g", v);
+			return p + strlen(p);
+		}
+	}
+
+	for (i = 5; i >= 0; i--) {
+		digits[i] = '0' + n % 10;
+		n /= 10;
+	}
+	/* Drop trailing zeros of the fraction. */
+	len = 6;
+	while (len > MAX(e + 1, 1) && digits[len - 1] == '0')
+		len--;
+
+	if (e >= 0) {
+		memcpy(p, digits, e + 1);
+		p += e + 1;
+		if (len > e + 1) {
+			*p++ = '.';
+			memcpy(p, digits + e + 1, len - e - 1);
+			p += len - e - 1;
+		}
+	} else {
+		*p++ = '0';
+		*p++ = '.';
+		for (i = 0; i < -e - 1; i++)
+			*p++ = '0';
+		memcpy(p, digits, len);
+		p += len;
+	}
+
+	return p;
+}
+
+/* Whether dedup drops row i, which is when it equals the previous row. */
+static gboolean row_is_dup(const struct context *ctx, unsigned int i)
+{
+	const float *analog_samples;
+	const uint8_t *logic_samples;
+	unsigned int nl, na;
+
+	if (!ctx->dedup || i == 0 || i == ctx->num_samples - 1)
+		return FALSE;
+
+	nl = ctx->num_logic_channels;
+	na = ctx->num_analog_channels;
+	logic_samples = ctx->logic_samples;
+	analog_samples = ctx->analog_samples;
+	if (nl && memcmp(&logic_samples[i * nl], &logic_samples[(i - 1) * nl], nl))
+		return FALSE;
+	if (na && memcmp(&analog_samples[i * na], &analog_samples[(i - 1) * na],
+			na * sizeof(float)))
+		return FALSE;
+
+	return TRUE;
 }
 
-static void dump_saved_values(struct context *ctx, GString **out)
+/*
+ * Format the rows of one slice of the saved samples. This only reads
+ * the context, so that slices can get formatted in parallel. The
+ * channels' ranges get collected in the slice, and merged later.
+ */
+static gpointer slice_format(gpointer data)
 {
-	unsigned int i, j, analog_size, num_channels;
+	struct row_slice *slice;
+	const struct context *ctx;
+	unsigned int i, j, a, l, num_channels;
+	size_t vlen, rlen;
 	double sample_time_dbl;
-	uint64_t sample_time_u64;
-	float *analog_sample, value;
-	uint8_t *logic_sample;
+	uint64_t sample_time_u64, time_index;
+	const float *analog_sample;
+	const uint8_t *logic_sample;
+	float value;
+	gboolean trigger;
+	char *p;
+
+	slice = data;
+	ctx = slice->ctx;
+	num_channels = ctx->num_logic_channels + ctx->num_analog_channels;
+	vlen = strlen(ctx->value);
+	rlen = strlen(ctx->record);
+	time_index = slice->time_index;
+	trigger = slice->trigger;
+
+	for (i = slice->start; i < slice->end; i++) {
+		if (row_is_dup(ctx, i))
+			continue;
+		analog_sample = &ctx->analog_samples[i * ctx->num_analog_channels];
+		logic_sample = &ctx->logic_samples[i * ctx->num_logic_channels];
+
+		p = slice->row;
+		if (ctx->time && !ctx->sample_rate) {
+			*p++ = '0';
+			memcpy(p, ctx->value, vlen);
+			p += vlen;
+		} else if (ctx->time) {
+			sample_time_dbl = time_index++;
+			sample_time_dbl /= ctx->sample_rate;
+			sample_time_dbl *= ctx->sample_scale;
+			sample_time_u64 = sample_time_dbl;
+			p = append_u64(p, sample_time_u64);
+			memcpy(p, ctx->value, vlen);
+			p += vlen;
+		}
+
+		if (!ctx->num_analog_channels) {
+			/* Pure logic data, just one digit per channel. */
+			for (j = 0; j < num_channels; j++) {
+				*p++ = logic_sample[j] ? '1' : '0';
+				memcpy(p, ctx->value, vlen);
+				p += vlen;
+			}
+		} else for (j = a = l = 0; j < num_channels; j++) {
+			/* Samples are stored by their index within their type. */
+			if (ctx->channels[j].ch->type == SR_CHANNEL_ANALOG) {
+				value = analog_sample[a++];
+				slice->max[j] = fmax(value, slice->max[j]);
+				slice->min[j] = fmin(value, slice->min[j]);
+				p = append_float(p, value);
+			} else if (ctx->channels[j].ch->type == SR_CHANNEL_LOGIC) {
+				*p++ = logic_sample[l++] ? '1' : '0';
+			} else {
+				sr_warn("Unexpected channel type: %d",
+					ctx->channels[j].ch->type);
+				continue;
+			}
+			memcpy(p, ctx->value, vlen);
+			p += vlen;
+		}
+
+		if (ctx->do_trigger) {
+			*p++ = trigger ? '1' : '0';
+			memcpy(p, ctx->value, vlen);
+			p += vlen;
+			trigger = FALSE;
+		}
+		/* Drop last separator. */
+		p--;
+		memcpy(p, ctx->record, rlen);
+		p += rlen;
+		g_string_append_len(slice->out, slice->row, p - slice->row);
+		slice->rows++;
+	}
+
+	return NULL;
+}
+
+/*
+ * Determine the number of slices to format the saved samples in, 1 to
+ * format them in the caller's thread only.
+ */
+static unsigned int slice_count(const struct context *ctx)
+{
+	unsigned int count;
+
+	count = ctx->threads;
+	if (!count)
+		count = g_get_num_processors();
+	if (count > SLICE_MAX_COUNT)
+		count = SLICE_MAX_COUNT;
+	if (count > ctx->num_samples / SLICE_MIN_ROWS)
+		count = ctx->num_samples / SLICE_MIN_ROWS;
+
+	return MAX(count, 1);
+}
+
+static void dump_saved_values(struct context *ctx, GString *out)
+{
+	struct row_slice *slice;
+	unsigned int i, j, num_channels, count, rows, pos;
+	uint64_t time_index;
+	size_t row_size;
 
 	/* If we haven't seen samples we're expecting, skip them. */
 	if ((ctx->num_analog_channels && !ctx->analog_samples) ||
@@ -415,104 +729,121 @@ static void dump_saved_values(struct context *ctx, GString **out)
 	} else {
 		sr_info("Dumping %u samples", ctx->num_samples);
 
-		*out = g_string_sized_new(512);
 		num_channels =
 		    ctx->num_logic_channels + ctx->num_analog_channels;
 
 		if (ctx->label_do) {
 			if (ctx->time)
-				g_string_append_printf(*out, "%s%s",
+				g_string_append_printf(out, "%s%s",
 					ctx->label_names ? "Time" : ctx->xlabel,
 					ctx->value);
 			for (i = 0; i < num_channels; i++) {
-				g_string_append_printf(*out, "%s%s",
+				g_string_append_printf(out, "%s%s",
 					ctx->channels[i].label, ctx->value);
 				if (ctx->channels[i].ch->type == SR_CHANNEL_ANALOG
 						&& ctx->label_names)
 					g_free(ctx->channels[i].label);
 			}
 			if (ctx->do_trigger)
-				g_string_append_printf(*out, "Trigger%s",
+				g_string_append_printf(out, "Trigger%s",
 						       ctx->value);
 			/* Drop last separator. */
-			g_string_truncate(*out, (*out)->len - 1);
-			g_string_append(*out, ctx->record);
+			g_string_truncate(out, out->len - 1);
+			g_string_append(out, ctx->record);
 
 			ctx->label_do = FALSE;
 		}
 
-		analog_size = ctx->num_analog_channels * sizeof(float);
-		if (ctx->dedup && !ctx->previous_sample)
-			ctx->previous_sample = g_malloc0(analog_size + ctx->num_logic_channels);
-
-		for (i = 0; i < ctx->num_samples; i++) {
-			analog_sample =
-			    &ctx->analog_samples[i * ctx->num_analog_channels];
-			logic_sample =
-			    &ctx->logic_samples[i * ctx->num_logic_channels];
-
-			if (ctx->dedup) {
-				if (i > 0 && i < ctx->num_samples - 1 &&
-				    !memcmp(logic_sample, ctx->previous_sample,
-					    ctx->num_logic_channels) &&
-				    !memcmp(analog_sample,
-					    ctx->previous_sample +
-					    ctx->num_logic_channels,
-					    analog_size))
-					continue;
-				memcpy(ctx->previous_sample, logic_sample,
-				       ctx->num_logic_channels);
-				memcpy(ctx->previous_sample
-				       + ctx->num_logic_channels,
-				       analog_sample, analog_size);
+		/* Each slice formats rows into a buffer which fits any row. */
+		row_size = 20 + strlen(ctx->value)
+			+ num_channels * (G_ASCII_DTOSTR_BUF_SIZE + strlen(ctx->value))
+			+ 1 + strlen(ctx->value) + strlen(ctx->record);
+		count = slice_count(ctx);
+		if (!ctx->slices)
+			ctx->slices = g_malloc0(SLICE_MAX_COUNT * sizeof(ctx->slices[0]));
+
+		/*
+		 * The time column counts the rows which dedup keeps, so with
+		 * dedup the slices' first sample times need counting up front.
+		 */
+		time_index = ctx->out_sample_count;
+		pos = 0;
+		for (i = 0; i < count; i++) {
+			slice = &ctx->slices[i];
+			slice->ctx = ctx;
+			slice->start = (uint64_t)ctx->num_samples * i / count;
+			slice->end = (uint64_t)ctx->num_samples * (i + 1) / count;
+			for (; pos < slice->start; pos++)
+				if (!row_is_dup(ctx, pos))
+					time_index++;
+			slice->time_index = time_index;
+			slice->trigger = i == 0 && ctx->trigger;
+			slice->rows = 0;
+			if (slice->row_size < row_size) {
+				g_free(slice->row);
+				slice->row = g_malloc(row_size);
+				slice->row_size = row_size;
 			}
-
-			if (ctx->time && !ctx->sample_rate) {
-				g_string_append_printf(*out, "0%s", ctx->value);
-			} else if (ctx->time) {
-				sample_time_dbl = ctx->out_sample_count++;
-				sample_time_dbl /= ctx->sample_rate;
-				sample_time_dbl *= ctx->sample_scale;
-				sample_time_u64 = sample_time_dbl;
-				g_string_append_printf(*out, "%" PRIu64 "%s",
-					sample_time_u64, ctx->value);
+			if (!slice->min) {
+				slice->min = g_malloc(num_channels * sizeof(float));
+				slice->max = g_malloc(num_channels * sizeof(float));
 			}
-
 			for (j = 0; j < num_channels; j++) {
-				if (ctx->channels[j].ch->type == SR_CHANNEL_ANALOG) {
-					value = ctx->analog_samples[i * ctx->num_analog_channels + j];
-					ctx->channels[j].max =
-					    fmax(value, ctx->channels[j].max);
-					ctx->channels[j].min =
-					    fmin(value, ctx->channels[j].min);
-					g_string_append_printf(*out, "%g%s",
-						value, ctx->value);
-				} else if (ctx->channels[j].ch->type == SR_CHANNEL_LOGIC) {
-					g_string_append_printf(*out, "%c%s",
-							       ctx->logic_samples[i * ctx->num_logic_channels + j] ? '1' : '0', ctx->value);
-				} else {
-					sr_warn("Unexpected channel type: %d",
-						ctx->channels[i].ch->type);
-				}
+				slice->min[j] = ctx->channels[j].min;
+				slice->max[j] = ctx->channels[j].max;
 			}
+			/* The first slice appends to the output right away. */
+			if (i == 0)
+				slice->out = out;
+			else if (!slice->out)
+				slice->out = g_string_sized_new(512);
+			else
+				g_string_truncate(slice->out, 0);
+		}
+
+		/* Format in parallel, the first slice runs in the caller's thread. */
+		for (i = 1; i < count; i++) {
+			slice = &ctx->slices[i];
+			slice->thread = g_thread_try_new("sr-csv-format",
+				slice_format, slice, NULL);
+		}
+		slice_format(&ctx->slices[0]);
+		for (i = 1; i < count; i++) {
+			slice = &ctx->slices[i];
+			if (slice->thread)
+				g_thread_join(slice->thread);
+			else
+				slice_format(slice);
+			slice->thread = NULL;
+		}
 
-			if (ctx->do_trigger) {
-				g_string_append_printf(*out, "%d%s",
-					ctx->trigger, ctx->value);
-				ctx->trigger = FALSE;
+		/* Concatenate the rows in order, and merge the ranges. */
+		rows = 0;
+		for (i = 0; i < count; i++) {
+			slice = &ctx->slices[i];
+			if (i > 0)
+				g_string_append_len(out, slice->out->str,
+					slice->out->len);
+			rows += slice->rows;
+			for (j = 0; j < num_channels; j++) {
+				ctx->channels[j].min =
+				    fmin(slice->min[j], ctx->channels[j].min);
+				ctx->channels[j].max =
+				    fmax(slice->max[j], ctx->channels[j].max);
 			}
-			g_string_truncate(*out, (*out)->len - 1);
-			g_string_append(*out, ctx->record);
 		}
+		ctx->slices[0].out = NULL;
+		if (ctx->time && ctx->sample_rate)
+			ctx->out_sample_count += rows;
+		if (ctx->do_trigger && ctx->num_samples)
+			ctx->trigger = FALSE;
 	}
 
 	/* Discard all of the working space. */
-	g_free(ctx->previous_sample);
 	g_free(ctx->analog_samples);
 	g_free(ctx->logic_samples);
 	ctx->channels_seen = 0;
 	ctx->num_samples = 0;
-	ctx->previous_sample = NULL;
 	ctx->analog_samples = NULL;
 	ctx->logic_samples = NULL;
 }
@@ -569,12 +900,11 @@ static void save_gnuplot(struct context *ctx)
 	g_string_free(script, TRUE);
 }
 
-static int receive(const struct sr_output *o,
-		   const struct sr_datafeed_packet *packet, GString **out)
+static int receive_append(const struct sr_output *o,
+		   const struct sr_datafeed_packet *packet, GString *out)
 {
 	struct context *ctx;
 
-	*out = NULL;
 	if (!o || !o->sdi)
 		return SR_ERR_ARG;
 	if (!(ctx = o->priv))
@@ -583,7 +913,7 @@ static int receive(const struct sr_output *o,
 	sr_dbg("Got packet of type %d", packet->type);
 	switch (packet->type) {
 	case SR_DF_HEADER:
-		*out = gen_header(o, packet->payload);
+		gen_header(o, packet->payload, out);
 		break;
 	case SR_DF_TRIGGER:
 		ctx->trigger = TRUE;
@@ -595,8 +925,6 @@ static int receive(const struct sr_output *o,
 		process_analog(ctx, packet->payload);
 		break;
 	case SR_DF_FRAME_BEGIN:
-		*out = g_string_new(ctx->frame);
-		/* Fallthrough */
 	case SR_DF_END:
 		/* Got to end of frame/session with part of the data. */
 		if (ctx->channels_seen)
@@ -610,12 +938,17 @@ static int receive(const struct sr_output *o,
 	if (ctx->channels_seen >= ctx->channel_count)
 		dump_saved_values(ctx, out);
 
+	/* The frame separator follows the previous frame's rows. */
+	if (packet->type == SR_DF_FRAME_BEGIN)
+		g_string_append(out, ctx->frame);
+
 	return SR_OK;
 }
 
 static int cleanup(struct sr_output *o)
 {
 	struct context *ctx;
+	unsigned int i;
 
 	if (!o || !o->sdi)
 		return SR_ERR_ARG;
@@ -627,8 +960,18 @@ static int cleanup(struct sr_output *o)
 		g_free((gpointer)ctx->comment);
 		g_free((gpointer)ctx->gnuplot);
 		g_free((gpointer)ctx->value);
-		g_free(ctx->previous_sample);
+		if (ctx->slices) {
+			for (i = 0; i < SLICE_MAX_COUNT; i++) {
+				g_free(ctx->slices[i].min);
+				g_free(ctx->slices[i].max);
+				if (ctx->slices[i].out)
+					g_string_free(ctx->slices[i].out, TRUE);
+				g_free(ctx->slices[i].row);
+			}
+			g_free(ctx->slices);
+		}
 		g_free(ctx->channels);
+		sr_output_logic_map_free(ctx->map);
 		g_free(o->priv);
 		o->priv = NULL;
 	}
@@ -648,6 +991,8 @@ static struct sr_option options[] = {
 	{"time", "Time column", "Output sample time as column 1", NULL, NULL},
 	{"trigger", "Trigger column", "Output trigger indicator as last column ", NULL, NULL},
 	{"dedup", "Dedup rows", "Set to false to output duplicate rows", NULL, NULL},
+	{"threads", "Format threads", "Number of threads which format rows of large packets in parallel. "
+		"Value 0 uses one thread per CPU, value 1 disables parallel formatting.", NULL, NULL},
 	ALL_ZERO
 };
 
@@ -671,6 +1016,7 @@ static const struct sr_option *get_options(void)
 		options[8].def = g_variant_ref_sink(g_variant_new_boolean(FALSE));
 		options[9].def = g_variant_ref_sink(g_variant_new_boolean(FALSE));
 		options[10].def = g_variant_ref_sink(g_variant_new_boolean(FALSE));
+		options[11].def = g_variant_ref_sink(g_variant_new_uint32(1));
 	}
 
 	return options;
@@ -684,6 +1030,6 @@ SR_PRIV struct sr_output_module output_csv = {
 	.flags = 0,
 	.options = get_options,
 	.init = init,
-	.receive = receive,
+	.receive_append = receive_append,
 	.cleanup = cleanup,
 };
@@ -0,0 +1,391 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "netfeed.h"
+
+#define LOG_PREFIX "output/framed"
+
+/*
+ * Writes the datafeed in the netfeed framing (see netfeed.h), with the
+ * frames which keep every packet as it was sent: the "framed" input
+ * module reads the stream back into the same packets, e.g. at the other
+ * end of a pipe.
+ */
+
+struct context {
+	gboolean magic_done;
+	gboolean rle;
+};
+
+static void frame_begin(GString *out, enum netfeed_type type, size_t len)
+{
+	uint8_t frame[NETFEED_FRAME_LEN];
+
+	memset(frame, 0, sizeof(frame));
+	write_u32le(frame, len);
+	frame[4] = type;
+	g_string_append_len(out, (const char *)frame, sizeof(frame));
+}
+
+static void frame_append(GString *out, enum netfeed_type type,
+		const void *head, size_t head_len, const void *data, size_t len)
+{
+	frame_begin(out, type, head_len + len);
+	if (head_len)
+		g_string_append_len(out, head, head_len);
+	if (len)
+		g_string_append_len(out, data, len);
+}
+
+static void header_append(const struct sr_output *o, GString *out)
+{
+	const struct sr_channel *ch;
+	uint64_t samplerate;
+	GVariant *gvar;
+	GString *buf;
+	uint8_t tmp[12], *p;
+	size_t len;
+	GSList *l;
+
+	samplerate = 0;
+	if (sr_config_get(o->sdi->driver, o->sdi, NULL,
+			SR_CONF_SAMPLERATE, &gvar) == SR_OK) {
+		samplerate = g_variant_get_uint64(gvar);
+		g_variant_unref(gvar);
+	}
+
+	buf = g_string_sized_new(256);
+	p = tmp;
+	write_u64le_inc(&p, samplerate);
+	write_u32le_inc(&p, g_slist_length(o->sdi->channels));
+	g_string_append_len(buf, (const char *)tmp, p - tmp);
+	for (l = o->sdi->channels; l; l = l->next) {
+		ch = l->data;
+		len = MIN(strlen(ch->name), G_MAXUINT16);
+		p = tmp;
+		write_u8_inc(&p, ch->type == SR_CHANNEL_LOGIC ?
+			NETFEED_CHANNEL_LOGIC : NETFEED_CHANNEL_ANALOG);
+		write_u8_inc(&p, ch->enabled);
+		write_u16le_inc(&p, len);
+		g_string_append_len(buf, (const char *)tmp, p - tmp);
+		g_string_append_len(buf, ch->name, len);
+	}
+	frame_append(out, NETFEED_HEADER, buf->str, buf->len, NULL, 0);
+	g_string_free(buf, TRUE);
+}
+
+static void meta_append(const struct sr_datafeed_meta *meta, GString *out)
+{
+	const struct sr_config *src;
+	const char *type;
+	GVariant *data;
+	GString *buf;
+	uint8_t tmp[8];
+	size_t len;
+	GSList *l;
+
+	buf = g_string_sized_new(64);
+	write_u32le(tmp, g_slist_length(meta->config));
+	g_string_append_len(buf, (const char *)tmp, 4);
+	for (l = meta->config; l; l = l->next) {
+		src = l->data;
+		/* The serialized form is in host byte order. */
+		if (G_BYTE_ORDER == G_BIG_ENDIAN)
+			data = g_variant_byteswap(src->data);
+		else
+			data = g_variant_get_normal_form(src->data);
+		type = g_variant_get_type_string(data);
+		len = strlen(type);
+		write_u32le(tmp, src->key);
+		write_u16le(tmp + 4, len);
+		g_string_append_len(buf, (const char *)tmp, 6);
+		g_string_append_len(buf, type, len);
+		write_u32le(tmp, g_variant_get_size(data));
+		g_string_append_len(buf, (const char *)tmp, 4);
+		g_string_append_len(buf, g_variant_get_data(data),
+			g_variant_get_size(data));
+		g_variant_unref(data);
+	}
+	frame_append(out, NETFEED_META, buf->str, buf->len, NULL, 0);
+	g_string_free(buf, TRUE);
+}
+
+static uint64_t count_runs(const uint8_t *data, uint64_t len,
+		unsigned int unitsize)
+{
+	uint64_t i, runs;
+
+	runs = 1;
+	for (i = unitsize; i < len; i += unitsize) {
+		if (memcmp(data + i, data + i - unitsize, unitsize))
+			runs++;
+	}
+
+	return runs;
+}
+
+/* Appends an RLE frame of the samples, which must not be empty. */
+static void rle_append(const uint8_t *data, uint64_t len,
+		unsigned int unitsize, uint64_t runs, GString *out)
+{
+	uint8_t head[NETFEED_LOGIC_RLE_LEN], count[8], *p;
+	uint64_t i, start;
+
+	p = head;
+	write_u32le_inc(&p, unitsize);
+	write_u64le_inc(&p, runs);
+	frame_begin(out, NETFEED_LOGIC_RLE,
+		sizeof(head) + runs * (unitsize + 8));
+	g_string_append_len(out, (const char *)head, sizeof(head));
+	g_string_append_len(out, (const char *)data, unitsize);
+	for (i = unitsize; i < len; i += unitsize) {
+		if (memcmp(data + i, data + i - unitsize, unitsize))
+			g_string_append_len(out, (const char *)data + i, unitsize);
+	}
+	start = 0;
+	for (i = unitsize; i <= len; i += unitsize) {
+		if (i < len && !memcmp(data + i, data + i - unitsize, unitsize))
+			continue;
+		write_u64le(count, (i - start) / unitsize);
+		g_string_append_len(out, (const char *)count, sizeof(count));
+		start = i;
+	}
+}
+
+static void logic_append(const struct context *ctx,
+		const struct sr_datafeed_logic *logic, GString *out)
+{
+	uint8_t head[NETFEED_LOGIC_LEN];
+	const uint8_t *data;
+	uint64_t left, max, len, runs;
+
+	if (!logic->unitsize)
+		return;
+	write_u32le(head, logic->unitsize);
+
+	/* Keep each frame within what receivers accept. */
+	max = NETFEED_MAX_PAYLOAD - NETFEED_LOGIC_RLE_LEN;
+	max -= max % logic->unitsize;
+	data = logic->data;
+	left = logic->length - logic->length % logic->unitsize;
+	for (; left > 0; left -= len) {
+		len = MIN(left, max);
+		runs = ctx->rle ? count_runs(data, len, logic->unitsize) : 0;
+		if (runs && runs * (logic->unitsize + 8) +
+				NETFEED_LOGIC_RLE_LEN < len + sizeof(head))
+			rle_append(data, len, logic->unitsize, runs, out);
+		else
+			frame_append(out, NETFEED_LOGIC, head, sizeof(head),
+				data, len);
+		data += len;
+	}
+}
+
+static void logic_rle_append(const struct sr_datafeed_logic_rle *rle,
+		GString *out)
+{
+	uint8_t head[NETFEED_LOGIC_RLE_LEN], count[8], *p;
+	const uint8_t *values;
+	uint64_t i, done, runs, max;
+
+	if (!rle->unitsize || !rle->num_runs)
+		return;
+
+	max = (NETFEED_MAX_PAYLOAD - sizeof(head)) / (rle->unitsize + 8);
+	values = rle->values;
+	for (done = 0; done < rle->num_runs; done += runs) {
+		runs = MIN(rle->num_runs - done, max);
+		p = head;
+		write_u32le_inc(&p, rle->unitsize);
+		write_u64le_inc(&p, runs);
+		frame_begin(out, NETFEED_LOGIC_RLE,
+			sizeof(head) + runs * (rle->unitsize + 8));
+		g_string_append_len(out, (const char *)head, sizeof(head));
+		g_string_append_len(out, (const char *)values +
+			done * rle->unitsize, runs * rle->unitsize);
+		for (i = done; i < done + runs; i++) {
+			write_u64le(count, rle->counts[i]);
+			g_string_append_len(out, (const char *)count,
+				sizeof(count));
+		}
+	}
+}
+
+static void analog_append(const struct sr_datafeed_analog *analog,
+		GString *out)
+{
+	const struct sr_analog_encoding *enc;
+	const struct sr_channel *ch;
+	const uint8_t *data;
+	GString *head;
+	uint8_t tmp[NETFEED_ANALOG_RAW_LEN], *p, flags;
+	uint32_t num_channels, left, max, num;
+	size_t stride;
+	GSList *l;
+
+	enc = analog->encoding;
+	if (!enc->unitsize || !analog->num_samples)
+		return;
+	num_channels = g_slist_length(analog->meaning->channels);
+
+	flags = 0;
+	if (enc->is_signed)
+		flags |= NETFEED_ENC_SIGNED;
+	if (enc->is_float)
+		flags |= NETFEED_ENC_FLOAT;
+	if (enc->is_bigendian)
+		flags |= NETFEED_ENC_BIGENDIAN;
+	if (enc->is_digits_decimal)
+		flags |= NETFEED_ENC_DIGITS_DECIMAL;
+
+	/* Interleaved packets hold one value per channel and sample. */
+	stride = (size_t)enc->unitsize * MAX(num_channels, 1);
+	max = (NETFEED_MAX_PAYLOAD - sizeof(tmp) - 4 * num_channels) / stride;
+
+	head = g_string_sized_new(sizeof(tmp) + 4 * num_channels);
+	data = analog->data;
+	for (left = analog->num_samples; left > 0; left -= num) {
+		num = MIN(left, max);
+		p = tmp;
+		write_u32le_inc(&p, analog->meaning->mq);
+		write_u32le_inc(&p, analog->meaning->unit);
+		write_u64le_inc(&p, analog->meaning->mqflags);
+		write_u8_inc(&p, enc->unitsize);
+		write_u8_inc(&p, flags);
+		write_u8_inc(&p, (uint8_t)enc->digits);
+		write_u8_inc(&p, (uint8_t)analog->spec->spec_digits);
+		write_u32le_inc(&p, num);
+		write_u64le_inc(&p, (uint64_t)enc->scale.p);
+		write_u64le_inc(&p, enc->scale.q);
+		write_u64le_inc(&p, (uint64_t)enc->offset.p);
+		write_u64le_inc(&p, enc->offset.q);
+		write_u32le_inc(&p, num_channels);
+		g_string_assign(head, "");
+		g_string_append_len(head, (const char *)tmp, p - tmp);
+		for (l = analog->meaning->channels; l; l = l->next) {
+			ch = l->data;
+			write_u32le(tmp, ch->index);
+			g_string_append_len(head, (const char *)tmp, 4);
+		}
+		frame_append(out, NETFEED_ANALOG_RAW, head->str, head->len,
+			data, num * stride);
+		data += num * stride;
+	}
+	g_string_free(head, TRUE);
+}
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+	struct context *ctx;
+
+	if (!o || !o->sdi)
+		return SR_ERR_ARG;
+
+	o->priv = ctx = g_malloc0(sizeof(struct context));
+	ctx->rle = g_variant_get_boolean(g_hash_table_lookup(options, "rle"));
+
+	return SR_OK;
+}
+
+static int receive_append(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString *out)
+{
+	struct context *ctx;
+
+	if (!o || !o->sdi || !(ctx = o->priv))
+		return SR_ERR_ARG;
+
+	if (!ctx->magic_done) {
+		g_string_append_len(out, NETFEED_MAGIC, NETFEED_MAGIC_LEN);
+		ctx->magic_done = TRUE;
+	}
+
+	switch (packet->type) {
+	case SR_DF_HEADER:
+		header_append(o, out);
+		break;
+	case SR_DF_META:
+		meta_append(packet->payload, out);
+		break;
+	case SR_DF_LOGIC:
+		logic_append(ctx, packet->payload, out);
+		break;
+	case SR_DF_LOGIC_RLE:
+		logic_rle_append(packet->payload, out);
+		break;
+	case SR_DF_ANALOG:
+		analog_append(packet->payload, out);
+		break;
+	case SR_DF_TRIGGER:
+		frame_append(out, NETFEED_TRIGGER, NULL, 0, NULL, 0);
+		break;
+	case SR_DF_FRAME_BEGIN:
+		frame_append(out, NETFEED_FRAME_BEGIN, NULL, 0, NULL, 0);
+		break;
+	case SR_DF_FRAME_END:
+		frame_append(out, NETFEED_FRAME_END, NULL, 0, NULL, 0);
+		break;
+	case SR_DF_END:
+		frame_append(out, NETFEED_END, NULL, 0, NULL, 0);
+		break;
+	default:
+		break;
+	}
+
+	return SR_OK;
+}
+
+static struct sr_option options[] = {
+	{ "rle", "Run-length encode", "Send logic data as runs where that is shorter", NULL, NULL },
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	if (!options[0].def)
+		options[0].def = g_variant_ref_sink(g_variant_new_boolean(FALSE));
+
+	return options;
+}
+
+static int cleanup(struct sr_output *o)
+{
+	if (!o)
+		return SR_ERR_ARG;
+
+	g_free(o->priv);
+	o->priv = NULL;
+
+	return SR_OK;
+}
+
+SR_PRIV struct sr_output_module output_framed = {
+	.id = "framed",
+	.name = "Framed",
+	.desc = "Framed binary datafeed, for the framed input",
+	.exts = (const char*[]){"srnf", NULL},
+	.flags = SR_OUTPUT_LOGIC_RLE,
+	.options = get_options,
+	.init = init,
+	.receive_append = receive_append,
+	.cleanup = cleanup,
+};
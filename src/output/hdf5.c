@@ -0,0 +1,480 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * HDF5 output, for long recordings. Each enabled analog channel gets an
+ * extendable, chunked one-dimensional dataset, in a group named after
+ * its channel group (if it has one). Samples keep the type they come
+ * in, the "scale" and "offset" attributes give their values (value =
+ * sample * scale + offset), "unit" their unit. Logic data goes to a
+ * "logic" dataset of unitsize bytes per sample. Any range of samples
+ * can be read without reading what comes before it.
+ *
+ * Options and their values:
+ *
+ * chunk:    Samples per chunk. Defaults to 65536.
+ *
+ * compress: Deflate level of the chunks, 0 to 9. Defaults to 0 (none).
+ *
+ * shuffle:  Shuffle the bytes of samples before compressing, which
+ *           helps with slowly changing values. Defaults to TRUE.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+#include <hdf5.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "output/hdf5"
+
+struct channel_ds {
+	const struct sr_channel *ch;
+	char *path;
+	/* Created with the channel's first packet, which sets its type. */
+	hid_t dset;
+	gboolean is_float;
+	gboolean is_signed;
+	unsigned int unitsize;
+	struct sr_rational scale, offset;
+	hsize_t len;
+};
+
+struct out_context {
+	hid_t file;
+	uint64_t samplerate;
+	hsize_t chunk;
+	unsigned int compress;
+	gboolean shuffle;
+	struct channel_ds *channels;
+	unsigned int num_channels;
+	hid_t logic;
+	unsigned int logic_unitsize;
+	hsize_t logic_len;
+};
+
+static char *channel_path(const struct sr_dev_inst *sdi,
+		const struct sr_channel *ch)
+{
+	const struct sr_channel_group *cg;
+	char *group, *name, *path;
+	GSList *l;
+
+	/* HDF5 paths separate names with '/'. */
+	name = g_strdelimit(g_strdup(ch->name), "/", '_');
+	for (l = sdi->channel_groups; l; l = l->next) {
+		cg = l->data;
+		if (!g_slist_find(cg->channels, ch))
+			continue;
+		group = g_strdelimit(g_strdup(cg->name), "/", '_');
+		path = g_strdup_printf("/%s/%s", group, name);
+		g_free(group);
+		g_free(name);
+		return path;
+	}
+	path = g_strdup_printf("/%s", name);
+	g_free(name);
+
+	return path;
+}
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+	struct out_context *outc;
+	struct sr_channel *ch;
+	GVariant *gvar;
+	GSList *l;
+	unsigned int i;
+
+	if (!o || !o->sdi)
+		return SR_ERR_ARG;
+	if (!o->filename || o->filename[0] == '\0') {
+		sr_info("hdf5 output module requires a file name, cannot save.");
+		return SR_ERR_ARG;
+	}
+
+	outc = g_malloc0(sizeof(*outc));
+	outc->chunk = MAX(g_variant_get_uint32(
+		g_hash_table_lookup(options, "chunk")), 1);
+	outc->compress = MIN(g_variant_get_uint32(
+		g_hash_table_lookup(options, "compress")), 9);
+	outc->shuffle = g_variant_get_boolean(
+		g_hash_table_lookup(options, "shuffle"));
+	if (outc->compress && !H5Zfilter_avail(H5Z_FILTER_DEFLATE)) {
+		sr_warn("The HDF5 library has no deflate filter, not compressing.");
+		outc->compress = 0;
+	}
+
+	/* Errors get reported here, not printed by the library. */
+	H5Eset_auto2(H5E_DEFAULT, NULL, NULL);
+	outc->file = H5Fcreate(o->filename, H5F_ACC_TRUNC, H5P_DEFAULT,
+		H5P_DEFAULT);
+	if (outc->file < 0) {
+		sr_err("Cannot create HDF5 file '%s'.", o->filename);
+		g_free(outc);
+		return SR_ERR;
+	}
+	outc->logic = -1;
+
+	for (l = o->sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->enabled && ch->type == SR_CHANNEL_ANALOG)
+			outc->num_channels++;
+	}
+	outc->channels = g_malloc0(outc->num_channels *
+		sizeof(*outc->channels));
+	for (i = 0, l = o->sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (!ch->enabled || ch->type != SR_CHANNEL_ANALOG)
+			continue;
+		outc->channels[i].ch = ch;
+		outc->channels[i].path = channel_path(o->sdi, ch);
+		outc->channels[i++].dset = -1;
+	}
+
+	if (sr_config_get(o->sdi->driver, o->sdi, NULL, SR_CONF_SAMPLERATE,
+			&gvar) == SR_OK) {
+		outc->samplerate = g_variant_get_uint64(gvar);
+		g_variant_unref(gvar);
+	}
+	o->priv = outc;
+
+	return SR_OK;
+}
+
+static void attr_write(hid_t obj, const char *name, hid_t type,
+		const void *value)
+{
+	hid_t space, attr;
+
+	if (H5Aexists(obj, name) > 0)
+		H5Adelete(obj, name);
+	space = H5Screate(H5S_SCALAR);
+	attr = H5Acreate2(obj, name, type, space, H5P_DEFAULT, H5P_DEFAULT);
+	if (attr < 0 || H5Awrite(attr, type, value) < 0)
+		sr_warn("Cannot write attribute '%s'.", name);
+	if (attr >= 0)
+		H5Aclose(attr);
+	H5Sclose(space);
+}
+
+static void attr_string(hid_t obj, const char *name, const char *value)
+{
+	hid_t type;
+
+	type = H5Tcopy(H5T_C_S1);
+	H5Tset_size(type, MAX(strlen(value), 1));
+	attr_write(obj, name, type, value);
+	H5Tclose(type);
+}
+
+static void attr_rational(hid_t obj, const char *name,
+		const struct sr_rational *r)
+{
+	double value;
+
+	value = r->q ? (double)r->p / r->q : 0;
+	attr_write(obj, name, H5T_NATIVE_DOUBLE, &value);
+}
+
+/* A chunked dataset which grows along its first dimension. */
+static hid_t dataset_create(struct out_context *outc, const char *path,
+		hid_t type, int rank, hsize_t width)
+{
+	hsize_t dims[2], maxdims[2], chunk[2];
+	hid_t space, lcpl, dcpl, dset;
+
+	dims[0] = 0;
+	maxdims[0] = H5S_UNLIMITED;
+	chunk[0] = outc->chunk;
+	dims[1] = maxdims[1] = chunk[1] = width;
+	space = H5Screate_simple(rank, dims, maxdims);
+
+	lcpl = H5Pcreate(H5P_LINK_CREATE);
+	H5Pset_create_intermediate_group(lcpl, 1);
+	dcpl = H5Pcreate(H5P_DATASET_CREATE);
+	H5Pset_chunk(dcpl, rank, chunk);
+	if (outc->compress) {
+		if (outc->shuffle)
+			H5Pset_shuffle(dcpl);
+		H5Pset_deflate(dcpl, outc->compress);
+	}
+
+	dset = H5Dcreate2(outc->file, path, type, space, lcpl, dcpl,
+		H5P_DEFAULT);
+	if (dset < 0)
+		sr_err("Cannot create dataset '%s'.", path);
+	else if (outc->samplerate)
+		attr_write(dset, "samplerate", H5T_NATIVE_UINT64,
+			&outc->samplerate);
+
+	H5Pclose(dcpl);
+	H5Pclose(lcpl);
+	H5Sclose(space);
+
+	return dset;
+}
+
+static int dataset_append(hid_t dset, hid_t mtype, hsize_t *len, int rank,
+		hsize_t width, hsize_t n, const void *data)
+{
+	hsize_t size[2], start[2], count[2];
+	hid_t fspace, mspace;
+	herr_t ret;
+
+	size[0] = *len + n;
+	start[0] = *len;
+	count[0] = n;
+	size[1] = count[1] = width;
+	start[1] = 0;
+	if (H5Dset_extent(dset, size) < 0)
+		return SR_ERR_IO;
+
+	fspace = H5Dget_space(dset);
+	H5Sselect_hyperslab(fspace, H5S_SELECT_SET, start, NULL, count, NULL);
+	mspace = H5Screate_simple(rank, count, NULL);
+	ret = H5Dwrite(dset, mtype, mspace, fspace, H5P_DEFAULT, data);
+	H5Sclose(mspace);
+	H5Sclose(fspace);
+	if (ret < 0)
+		return SR_ERR_IO;
+	*len += n;
+
+	return SR_OK;
+}
+
+/* The HDF5 type of samples, in the file (little endian) or in memory. */
+static hid_t sample_type(gboolean is_float, gboolean is_signed,
+		unsigned int unitsize, gboolean bigendian)
+{
+	if (is_float) {
+		if (unitsize == 4)
+			return bigendian ? H5T_IEEE_F32BE : H5T_IEEE_F32LE;
+		if (unitsize == 8)
+			return bigendian ? H5T_IEEE_F64BE : H5T_IEEE_F64LE;
+		return -1;
+	}
+
+	switch (unitsize) {
+	case 1:
+		return is_signed ? H5T_STD_I8LE : H5T_STD_U8LE;
+	case 2:
+		if (is_signed)
+			return bigendian ? H5T_STD_I16BE : H5T_STD_I16LE;
+		return bigendian ? H5T_STD_U16BE : H5T_STD_U16LE;
+	case 4:
+		if (is_signed)
+			return bigendian ? H5T_STD_I32BE : H5T_STD_I32LE;
+		return bigendian ? H5T_STD_U32BE : H5T_STD_U32LE;
+	case 8:
+		if (is_signed)
+			return bigendian ? H5T_STD_I64BE : H5T_STD_I64LE;
+		return bigendian ? H5T_STD_U64BE : H5T_STD_U64LE;
+	default:
+		return -1;
+	}
+}
+
+static int analog_write(struct out_context *outc,
+		const struct sr_datafeed_analog *analog)
+{
+	const struct sr_analog_encoding *enc;
+	struct channel_ds *cds;
+	const struct sr_channel *ch;
+	hid_t type;
+	unsigned int i;
+	char *unit;
+
+	if (!analog->meaning->channels || !analog->num_samples)
+		return SR_OK;
+	if (g_slist_length(analog->meaning->channels) > 1) {
+		sr_dbg("Skipping analog packet of several channels.");
+		return SR_OK;
+	}
+	ch = analog->meaning->channels->data;
+	for (i = 0; i < outc->num_channels; i++)
+		if (outc->channels[i].ch == ch)
+			break;
+	if (i == outc->num_channels)
+		return SR_OK;
+	cds = &outc->channels[i];
+	enc = analog->encoding;
+
+	if (cds->dset < 0) {
+		type = sample_type(enc->is_float, enc->is_signed,
+			enc->unitsize, FALSE);
+		if (type < 0) {
+			sr_err("Unsupported sample type of channel %s.",
+				ch->name);
+			return SR_ERR_DATA;
+		}
+		cds->dset = dataset_create(outc, cds->path, type, 1, 1);
+		if (cds->dset < 0)
+			return SR_ERR_IO;
+		cds->is_float = enc->is_float;
+		cds->is_signed = enc->is_signed;
+		cds->unitsize = enc->unitsize;
+		cds->scale = enc->scale;
+		cds->offset = enc->offset;
+		attr_rational(cds->dset, "scale", &cds->scale);
+		attr_rational(cds->dset, "offset", &cds->offset);
+		if (sr_analog_unit_to_string(analog, &unit) == SR_OK) {
+			attr_string(cds->dset, "unit", unit);
+			g_free(unit);
+		}
+	} else if (!enc->is_float != !cds->is_float ||
+			!enc->is_signed != !cds->is_signed ||
+			enc->unitsize != cds->unitsize ||
+			sr_rational_eq(&enc->scale, &cds->scale) != 1 ||
+			sr_rational_eq(&enc->offset, &cds->offset) != 1) {
+		sr_err("Encoding of channel %s changed, cannot append its "
+			"samples.", ch->name);
+		return SR_ERR_DATA;
+	}
+
+	type = sample_type(enc->is_float, enc->is_signed, enc->unitsize,
+		enc->is_bigendian);
+	if (dataset_append(cds->dset, type, &cds->len, 1, 1,
+			analog->num_samples, analog->data) != SR_OK) {
+		sr_err("Cannot append to dataset '%s'.", cds->path);
+		return SR_ERR_IO;
+	}
+
+	return SR_OK;
+}
+
+static int logic_write(struct out_context *outc,
+		const struct sr_datafeed_logic *logic)
+{
+	if (!logic->unitsize || !logic->length)
+		return SR_OK;
+
+	if (outc->logic < 0) {
+		outc->logic = dataset_create(outc, "/logic", H5T_STD_U8LE, 2,
+			logic->unitsize);
+		if (outc->logic < 0)
+			return SR_ERR_IO;
+		outc->logic_unitsize = logic->unitsize;
+	} else if (logic->unitsize != outc->logic_unitsize) {
+		sr_err("Logic unit size changed, cannot append.");
+		return SR_ERR_DATA;
+	}
+
+	if (dataset_append(outc->logic, H5T_NATIVE_UCHAR, &outc->logic_len, 2,
+			logic->unitsize, logic->length / logic->unitsize,
+			logic->data) != SR_OK) {
+		sr_err("Cannot append to the logic dataset.");
+		return SR_ERR_IO;
+	}
+
+	return SR_OK;
+}
+
+static int receive(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString **out)
+{
+	struct out_context *outc;
+	const struct sr_datafeed_meta *meta;
+	const struct sr_config *src;
+	GSList *l;
+
+	*out = NULL;
+	if (!o || !o->sdi || !(outc = o->priv))
+		return SR_ERR_ARG;
+
+	switch (packet->type) {
+	case SR_DF_META:
+		meta = packet->payload;
+		for (l = meta->config; l; l = l->next) {
+			src = l->data;
+			if (src->key == SR_CONF_SAMPLERATE)
+				outc->samplerate = g_variant_get_uint64(src->data);
+		}
+		break;
+	case SR_DF_LOGIC:
+		return logic_write(outc, packet->payload);
+	case SR_DF_ANALOG:
+		return analog_write(outc, packet->payload);
+	case SR_DF_END:
+		if (outc->samplerate)
+			attr_write(outc->file, "samplerate", H5T_NATIVE_UINT64,
+				&outc->samplerate);
+		if (H5Fflush(outc->file, H5F_SCOPE_GLOBAL) < 0) {
+			sr_err("Cannot write the HDF5 file.");
+			return SR_ERR_IO;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return SR_OK;
+}
+
+static struct sr_option options[] = {
+	{ "chunk", "Chunk size", "Samples per chunk of the datasets", NULL, NULL },
+	{ "compress", "Compression", "Deflate level of the chunks, 0 for none", NULL, NULL },
+	{ "shuffle", "Shuffle", "Shuffle the sample bytes before compressing", NULL, NULL },
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	if (!options[0].def) {
+		options[0].def = g_variant_ref_sink(g_variant_new_uint32(65536));
+		options[1].def = g_variant_ref_sink(g_variant_new_uint32(0));
+		options[2].def = g_variant_ref_sink(g_variant_new_boolean(TRUE));
+	}
+
+	return options;
+}
+
+static int cleanup(struct sr_output *o)
+{
+	struct out_context *outc;
+	unsigned int i;
+
+	if (!o || !(outc = o->priv))
+		return SR_OK;
+
+	for (i = 0; i < outc->num_channels; i++) {
+		if (outc->channels[i].dset >= 0)
+			H5Dclose(outc->channels[i].dset);
+		g_free(outc->channels[i].path);
+	}
+	g_free(outc->channels);
+	if (outc->logic >= 0)
+		H5Dclose(outc->logic);
+	H5Fclose(outc->file);
+	g_free(outc);
+	o->priv = NULL;
+
+	return SR_OK;
+}
+
+SR_PRIV struct sr_output_module output_hdf5 = {
+	.id = "hdf5",
+	.name = "HDF5",
+	.desc = "HDF5 file with a chunked dataset per channel",
+	.exts = (const char *[]){"h5", "hdf5", NULL},
+	.flags = SR_OUTPUT_INTERNAL_IO_HANDLING,
+	.options = get_options,
+	.init = init,
+	.receive = receive,
+	.cleanup = cleanup,
+};
@@ -28,6 +28,8 @@
 
 #define DEFAULT_SAMPLES_PER_LINE 192
 
+static const char hex_digits[] = "0123456789abcdef";
+
 struct context {
 	unsigned int num_enabled_channels;
 	int spl;
@@ -35,20 +37,19 @@ struct context {
 	int spl_cnt;
 	int trigger;
 	uint64_t samplerate;
-	int *channel_index;
-	char **channel_names;
+	struct sr_output_logic_map *map;
 	char **line_values;
 	uint8_t *sample_buf;
 	gboolean header_done;
 	GString **lines;
+	size_t *prefix_len;
 };
 
 static int init(struct sr_output *o, GHashTable *options)
 {
 	struct context *ctx;
 	struct sr_channel *ch;
-	GSList *l;
-	unsigned int i, j;
+	unsigned int j;
 
 	if (!o || !o->sdi)
 		return SR_ERR_ARG;
@@ -58,42 +59,28 @@ static int init(struct sr_output *o, GHashTable *options)
 	ctx->trigger = -1;
 	ctx->spl = g_variant_get_uint32(g_hash_table_lookup(options, "width"));
 
-	for (l = o->sdi->channels; l; l = l->next) {
-		ch = l->data;
-		if (ch->type != SR_CHANNEL_LOGIC)
-			continue;
-		if (!ch->enabled)
-			continue;
-		ctx->num_enabled_channels++;
-	}
-	ctx->channel_index = g_malloc(sizeof(int) * ctx->num_enabled_channels);
-	ctx->channel_names = g_malloc(sizeof(char *) * ctx->num_enabled_channels);
+	ctx->map = sr_output_logic_map_new(o->sdi);
+	ctx->num_enabled_channels = ctx->map->num_channels;
 	ctx->lines = g_malloc(sizeof(GString *) * ctx->num_enabled_channels);
 	ctx->sample_buf = g_malloc(ctx->num_enabled_channels);
+	ctx->prefix_len = g_malloc(sizeof(size_t) * ctx->num_enabled_channels);
 
-	j = 0;
-	for (i = 0, l = o->sdi->channels; l; l = l->next, i++) {
-		ch = l->data;
-		if (ch->type != SR_CHANNEL_LOGIC)
-			continue;
-		if (!ch->enabled)
-			continue;
-		ctx->channel_index[j] = ch->index;
-		ctx->channel_names[j] = ch->name;
-		ctx->lines[j] = g_string_sized_new(80);
+	for (j = 0; j < ctx->num_enabled_channels; j++) {
+		ch = ctx->map->channels[j];
+		ctx->lines[j] = g_string_sized_new(strlen(ch->name) + 5 +
+			(ctx->spl / 8) * 3);
 		ctx->sample_buf[j] = 0;
 		g_string_printf(ctx->lines[j], "%s:", ch->name);
-		j++;
+		ctx->prefix_len[j] = ctx->lines[j]->len;
 	}
 
 	return SR_OK;
 }
 
-static GString *gen_header(const struct sr_output *o)
+static void gen_header(const struct sr_output *o, GString *header)
 {
 	struct context *ctx;
 	GVariant *gvar;
-	GString *header;
 	int num_channels;
 	char *samplerate_s;
 
@@ -106,8 +93,7 @@ static GString *gen_header(const struct sr_output *o)
 		}
 	}
 
-	header = g_string_sized_new(512);
-	g_string_printf(header, "%s %s\n", PACKAGE_NAME, sr_package_version_string_get());
+	g_string_append_printf(header, "%s %s\n", PACKAGE_NAME, sr_package_version_string_get());
 	num_channels = g_slist_length(o->sdi->channels);
 	g_string_append_printf(header, "Acquisition with %d/%d channels",
 			ctx->num_enabled_channels, num_channels);
@@ -117,23 +103,82 @@ static GString *gen_header(const struct sr_output *o)
 		g_free(samplerate_s);
 	}
 	g_string_append_printf(header, "\n");
+}
+
+/*
+ * Append a run of samples of one channel to its line buffer. Collects
+ * a byte's worth of bits, then writes its two hex digits and a space
+ * directly into the (pre-sized) line buffer.
+ */
+static void append_hex(struct context *ctx, size_t ch,
+	const uint8_t *data, size_t unitsize, size_t count)
+{
+	GString *line;
+	const uint8_t *p;
+	uint8_t mask, bits;
+	size_t len, i;
+	int pos;
+	char *wp;
+
+	line = ctx->lines[ch];
+	p = data + ctx->map->byte_pos[ch];
+	mask = ctx->map->bit_mask[ch];
+	pos = ctx->spl_cnt;
+	bits = ctx->sample_buf[ch];
+
+	len = line->len;
+	g_string_set_size(line, len + (count / 8 + 1) * 3);
+	wp = &line->str[len];
+	for (i = 0; i < count; i++) {
+		bits <<= 1;
+		if (*p & mask)
+			bits |= 1;
+		p += unitsize;
+		if ((++pos & 7) == 0) {
+			/* Buffered a byte's worth, output hex. */
+			*wp++ = hex_digits[bits >> 4];
+			*wp++ = hex_digits[bits & 0xf];
+			*wp++ = ' ';
+			bits = 0;
+		}
+	}
+	g_string_truncate(line, wp - line->str);
+	ctx->sample_buf[ch] = bits;
+}
+
+static void flush_lines(struct context *ctx, GString *out)
+{
+	unsigned int j;
+	int offset;
 
-	return header;
+	for (j = 0; j < ctx->num_enabled_channels; j++) {
+		g_string_append_len(out, ctx->lines[j]->str, ctx->lines[j]->len);
+		g_string_append_c(out, '\n');
+		g_string_truncate(ctx->lines[j], ctx->prefix_len[j]);
+	}
+	if (ctx->num_enabled_channels && ctx->trigger > -1) {
+		/*
+		 * Sample data lines have one character per nibble,
+		 * plus one separator per byte. Align trigger marker
+		 * to this layout.
+		 */
+		offset = ctx->trigger / 4 + ctx->trigger / 8;
+		g_string_append_printf(out, "T:%*s^ %d\n", offset, "", ctx->trigger);
+		ctx->trigger = -1;
+	}
 }
 
-static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
-		GString **out)
+static int receive_append(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString *out)
 {
 	const struct sr_datafeed_meta *meta;
 	const struct sr_datafeed_logic *logic;
 	const struct sr_config *src;
 	GSList *l;
 	struct context *ctx;
-	int idx, pos, offset;
-	uint64_t i, j;
-	gchar *p;
+	const uint8_t *data;
+	uint64_t i, j, num_samples, count;
 
-	*out = NULL;
 	if (!o || !o->sdi)
 		return SR_ERR_ARG;
 	if (!(ctx = o->priv))
@@ -154,60 +199,42 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		break;
 	case SR_DF_LOGIC:
 		if (!ctx->header_done) {
-			*out = gen_header(o);
+			gen_header(o, out);
 			ctx->header_done = TRUE;
-		} else
-			*out = g_string_sized_new(512);
+		}
 
+		/*
+		 * Process the samples in runs up to the end of the current
+		 * line, one channel at a time. Flush all channels' lines
+		 * when they are complete.
+		 */
 		logic = packet->payload;
-		for (i = 0; i <= logic->length - logic->unitsize; i += logic->unitsize) {
-			ctx->spl_cnt++;
-			pos = ctx->spl_cnt & 7;
-			for (j = 0; j < ctx->num_enabled_channels; j++) {
-				idx = ctx->channel_index[j];
-				p = logic->data + i + idx / 8;
-				ctx->sample_buf[j] <<= 1;
-				if (*p & (1 << (idx % 8)))
-					ctx->sample_buf[j] |= 1;
-				if (ctx->spl_cnt && pos == 0) {
-					/* Buffered a byte's worth, output hex. */
-					g_string_append_printf(ctx->lines[j], "%.2x ",
-							ctx->sample_buf[j]);
-					ctx->sample_buf[j] = 0;
-				}
-
-				if (ctx->spl_cnt == ctx->spl) {
-					/* Flush line buffers. */
-					g_string_append_len(*out, ctx->lines[j]->str, ctx->lines[j]->len);
-					g_string_append_c(*out, '\n');
-					if (j == ctx->num_enabled_channels - 1 && ctx->trigger > -1) {
-						/*
-						 * Sample data lines have one character per nibble,
-						 * plus one separator per byte. Align trigger marker
-						 * to this layout.
-						 */
-						offset = ctx->trigger / 4 + ctx->trigger / 8;
-						g_string_append_printf(*out, "T:%*s^ %d\n", offset, "", ctx->trigger);
-						ctx->trigger = -1;
-					}
-					g_string_printf(ctx->lines[j], "%s:", ctx->channel_names[j]);
-				}
-			}
-			if (ctx->spl_cnt == ctx->spl)
-				/* Line buffers were already flushed. */
+		data = logic->data;
+		num_samples = logic->unitsize ? logic->length / logic->unitsize : 0;
+		while (num_samples) {
+			count = num_samples;
+			if (ctx->spl > 0 && count > (uint64_t)(ctx->spl - ctx->spl_cnt))
+				count = ctx->spl - ctx->spl_cnt;
+			for (j = 0; j < ctx->num_enabled_channels; j++)
+				append_hex(ctx, j, data, logic->unitsize, count);
+			ctx->spl_cnt += count;
+			data += count * logic->unitsize;
+			num_samples -= count;
+			if (ctx->spl_cnt == ctx->spl) {
+				flush_lines(ctx, out);
 				ctx->spl_cnt = 0;
+			}
 		}
 		break;
 	case SR_DF_END:
 		if (ctx->spl_cnt) {
 			/* Line buffers need flushing. */
-			*out = g_string_sized_new(512);
 			for (i = 0; i < ctx->num_enabled_channels; i++) {
 				if (ctx->spl_cnt & 7)
 					g_string_append_printf(ctx->lines[i], "%.2x ",
 							ctx->sample_buf[i] << (8 - (ctx->spl_cnt & 7)));
-				g_string_append_len(*out, ctx->lines[i]->str, ctx->lines[i]->len);
-				g_string_append_c(*out, '\n');
+				g_string_append_len(out, ctx->lines[i]->str, ctx->lines[i]->len);
+				g_string_append_c(out, '\n');
 			}
 		}
 		break;
@@ -227,9 +254,9 @@ static int cleanup(struct sr_output *o)
 	if (!(ctx = o->priv))
 		return SR_OK;
 
-	g_free(ctx->channel_index);
+	sr_output_logic_map_free(ctx->map);
 	g_free(ctx->sample_buf);
-	g_free(ctx->channel_names);
+	g_free(ctx->prefix_len);
 	for (i = 0; i < ctx->num_enabled_channels; i++)
 		g_string_free(ctx->lines[i], TRUE);
 	g_free(ctx->lines);
@@ -262,6 +289,6 @@ SR_PRIV struct sr_output_module output_hex = {
 	.flags = 0,
 	.options = get_options,
 	.init = init,
-	.receive = receive,
+	.receive_append = receive_append,
 	.cleanup = cleanup,
 };
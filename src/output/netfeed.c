@@ -0,0 +1,447 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Serve the datafeed to a client over TCP, see netfeed.h for the
+ * framing. One client at a time gets served. It can connect while the
+ * acquisition runs, and gets a NETFEED_HEADER first. Sample data is
+ * sent from the packets' buffers with sendmsg(), without copying it.
+ * A client which stalls the datafeed for too long gets dropped.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <string.h>
+#include <glib.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#endif
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "netfeed.h"
+
+#define LOG_PREFIX "output/netfeed"
+
+#ifndef _WIN32
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/* How long a client may stall the datafeed before it gets dropped. */
+#define SEND_TIMEOUT_MS 2000
+
+struct out_context {
+	int listen_fd;
+	int client_fd;
+	uint64_t samplerate;
+	float *fbuf;
+	size_t fbuf_len;
+};
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+	struct out_context *outc;
+	struct addrinfo hints, *results, *res;
+	const char *address;
+	char *port;
+	GVariant *gvar;
+	int fd, opt, err;
+
+	if (!o || !o->sdi)
+		return SR_ERR_ARG;
+
+	address = g_variant_get_string(g_hash_table_lookup(options,
+		"address"), NULL);
+	port = g_strdup_printf("%u", g_variant_get_uint32(
+		g_hash_table_lookup(options, "port")));
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+	hints.ai_flags = AI_PASSIVE;
+	err = getaddrinfo(*address ? address : NULL, port, &hints, &results);
+	if (err) {
+		sr_err("Address lookup failed: %s:%s: %s", address, port,
+			gai_strerror(err));
+		g_free(port);
+		return SR_ERR;
+	}
+
+	fd = -1;
+	for (res = results; res; res = res->ai_next) {
+		fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+		if (fd < 0)
+			continue;
+		opt = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+		if (bind(fd, res->ai_addr, res->ai_addrlen) == 0 &&
+				listen(fd, 1) == 0)
+			break;
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(results);
+	if (fd < 0) {
+		sr_err("Cannot listen on %s:%s: %s", address, port,
+			g_strerror(errno));
+		g_free(port);
+		return SR_ERR;
+	}
+	/* Clients get accepted as packets come, without waiting. */
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	sr_info("Serving the datafeed on port %s.", port);
+	g_free(port);
+
+	outc = g_malloc0(sizeof(*outc));
+	outc->listen_fd = fd;
+	outc->client_fd = -1;
+	if (sr_config_get(o->sdi->driver, o->sdi, NULL, SR_CONF_SAMPLERATE,
+			&gvar) == SR_OK) {
+		outc->samplerate = g_variant_get_uint64(gvar);
+		g_variant_unref(gvar);
+	}
+	o->priv = outc;
+
+	return SR_OK;
+}
+
+static void client_drop(struct out_context *outc, const char *reason)
+{
+	sr_warn("Dropping the client: %s.", reason);
+	close(outc->client_fd);
+	outc->client_fd = -1;
+}
+
+/* Send all of the vector, short writes continue where they stopped. */
+static int send_iov(struct out_context *outc, struct iovec *iov, int iovcnt)
+{
+	struct msghdr msg;
+	ssize_t ret;
+	size_t n;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iovcnt;
+	while (msg.msg_iovlen > 0) {
+		ret = sendmsg(outc->client_fd, &msg, MSG_NOSIGNAL);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0) {
+			client_drop(outc, errno == EAGAIN || errno == EWOULDBLOCK ?
+				"too slow" : g_strerror(errno));
+			return SR_ERR_IO;
+		}
+		while (ret > 0 && msg.msg_iovlen > 0) {
+			n = MIN((size_t)ret, msg.msg_iov->iov_len);
+			msg.msg_iov->iov_base = (uint8_t *)msg.msg_iov->iov_base + n;
+			msg.msg_iov->iov_len -= n;
+			ret -= n;
+			if (!msg.msg_iov->iov_len) {
+				msg.msg_iov++;
+				msg.msg_iovlen--;
+			}
+		}
+	}
+
+	return SR_OK;
+}
+
+static int send_frame(struct out_context *outc, enum netfeed_type type,
+		const void *head, size_t head_len, const void *data, size_t len)
+{
+	uint8_t frame[NETFEED_FRAME_LEN];
+	struct iovec iov[3];
+
+	if (outc->client_fd < 0)
+		return SR_OK;
+
+	memset(frame, 0, sizeof(frame));
+	write_u32le(frame, head_len + len);
+	frame[4] = type;
+	iov[0].iov_base = frame;
+	iov[0].iov_len = sizeof(frame);
+	iov[1].iov_base = (void *)head;
+	iov[1].iov_len = head_len;
+	iov[2].iov_base = (void *)data;
+	iov[2].iov_len = len;
+
+	return send_iov(outc, iov, 3);
+}
+
+static int send_header(const struct sr_output *o)
+{
+	struct out_context *outc;
+	const struct sr_channel *ch;
+	GByteArray *buf;
+	uint8_t tmp[12], *p;
+	size_t len;
+	GSList *l;
+	int ret;
+
+	outc = o->priv;
+	buf = g_byte_array_new();
+	p = tmp;
+	write_u64le_inc(&p, outc->samplerate);
+	write_u32le_inc(&p, g_slist_length(o->sdi->channels));
+	g_byte_array_append(buf, tmp, p - tmp);
+	for (l = o->sdi->channels; l; l = l->next) {
+		ch = l->data;
+		len = MIN(strlen(ch->name), G_MAXUINT16);
+		p = tmp;
+		write_u8_inc(&p, ch->type == SR_CHANNEL_LOGIC ?
+			NETFEED_CHANNEL_LOGIC : NETFEED_CHANNEL_ANALOG);
+		write_u8_inc(&p, ch->enabled);
+		write_u16le_inc(&p, len);
+		g_byte_array_append(buf, tmp, p - tmp);
+		g_byte_array_append(buf, (const uint8_t *)ch->name, len);
+	}
+	ret = send_frame(outc, NETFEED_HEADER, buf->data, buf->len, NULL, 0);
+	g_byte_array_free(buf, TRUE);
+
+	return ret;
+}
+
+static void client_accept(const struct sr_output *o)
+{
+	struct out_context *outc;
+	struct iovec iov;
+	struct timeval tv;
+	int fd, opt;
+
+	outc = o->priv;
+	if (outc->client_fd >= 0)
+		return;
+	fd = accept(outc->listen_fd, NULL, NULL);
+	if (fd < 0)
+		return;
+
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+	tv.tv_sec = SEND_TIMEOUT_MS / 1000;
+	tv.tv_usec = (SEND_TIMEOUT_MS % 1000) * 1000;
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	opt = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+	outc->client_fd = fd;
+	sr_info("Client connected.");
+
+	iov.iov_base = NETFEED_MAGIC;
+	iov.iov_len = NETFEED_MAGIC_LEN;
+	if (send_iov(outc, &iov, 1) == SR_OK)
+		send_header(o);
+}
+
+static int send_logic(struct out_context *outc,
+		const struct sr_datafeed_logic *logic)
+{
+	uint8_t head[NETFEED_LOGIC_LEN];
+	const uint8_t *data;
+	uint64_t left, max, len;
+	int ret;
+
+	if (!logic->unitsize)
+		return SR_OK;
+	write_u32le(head, logic->unitsize);
+
+	/* Keep each frame within what receivers accept. */
+	max = NETFEED_MAX_PAYLOAD - sizeof(head);
+	max -= max % logic->unitsize;
+	data = logic->data;
+	for (left = logic->length; left > 0; left -= len) {
+		len = MIN(left, max);
+		ret = send_frame(outc, NETFEED_LOGIC, head, sizeof(head),
+			data, len);
+		if (ret != SR_OK)
+			return ret;
+		data += len;
+	}
+
+	return SR_OK;
+}
+
+static int send_analog(struct out_context *outc,
+		const struct sr_datafeed_analog *analog)
+{
+	const struct sr_analog_encoding *enc;
+	const struct sr_channel *ch;
+	uint8_t head[NETFEED_ANALOG_LEN], *p;
+	const void *data;
+	size_t len;
+	int ret;
+
+	if (!analog->meaning->channels || !analog->num_samples)
+		return SR_OK;
+	if (g_slist_length(analog->meaning->channels) > 1) {
+		sr_dbg("Skipping analog packet of several channels.");
+		return SR_OK;
+	}
+	ch = analog->meaning->channels->data;
+
+	/* Floats as the framing has them are sent without conversion. */
+	enc = analog->encoding;
+	len = analog->num_samples * sizeof(float);
+	if (G_BYTE_ORDER == G_LITTLE_ENDIAN && enc->is_float &&
+			!enc->is_bigendian && enc->unitsize == sizeof(float) &&
+			enc->scale.p == 1 && enc->scale.q == 1 &&
+			enc->offset.p == 0) {
+		data = analog->data;
+	} else {
+		if (outc->fbuf_len < analog->num_samples) {
+			outc->fbuf = g_realloc(outc->fbuf, len);
+			outc->fbuf_len = analog->num_samples;
+		}
+		if ((ret = sr_analog_to_float(analog, outc->fbuf)) != SR_OK)
+			return ret;
+		if (G_BYTE_ORDER != G_LITTLE_ENDIAN) {
+			for (p = (uint8_t *)outc->fbuf;
+					p < (uint8_t *)outc->fbuf + len; p += 4)
+				write_fltle(p, *(float *)p);
+		}
+		data = outc->fbuf;
+	}
+
+	p = head;
+	write_u32le_inc(&p, ch->index);
+	write_u32le_inc(&p, analog->meaning->mq);
+	write_u32le_inc(&p, analog->meaning->unit);
+	write_u64le_inc(&p, analog->meaning->mqflags);
+	write_u32le_inc(&p, (uint32_t)(int32_t)enc->digits);
+
+	return send_frame(outc, NETFEED_ANALOG, head, sizeof(head), data, len);
+}
+
+static int receive(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString **out)
+{
+	struct out_context *outc;
+	const struct sr_datafeed_meta *meta;
+	const struct sr_config *src;
+	uint8_t rate[8];
+	GVariant *gvar;
+	GSList *l;
+
+	*out = NULL;
+	if (!o || !o->sdi || !(outc = o->priv))
+		return SR_ERR_ARG;
+
+	client_accept(o);
+
+	/*
+	 * Send errors drop the client, the session which serves it goes
+	 * on regardless.
+	 */
+	switch (packet->type) {
+	case SR_DF_HEADER:
+		if (sr_config_get(o->sdi->driver, o->sdi, NULL,
+				SR_CONF_SAMPLERATE, &gvar) == SR_OK) {
+			outc->samplerate = g_variant_get_uint64(gvar);
+			g_variant_unref(gvar);
+		}
+		send_header(o);
+		break;
+	case SR_DF_META:
+		meta = packet->payload;
+		for (l = meta->config; l; l = l->next) {
+			src = l->data;
+			if (src->key != SR_CONF_SAMPLERATE)
+				continue;
+			outc->samplerate = g_variant_get_uint64(src->data);
+			write_u64le(rate, outc->samplerate);
+			send_frame(outc, NETFEED_SAMPLERATE, rate, sizeof(rate),
+				NULL, 0);
+		}
+		break;
+	case SR_DF_LOGIC:
+		send_logic(outc, packet->payload);
+		break;
+	case SR_DF_ANALOG:
+		send_analog(outc, packet->payload);
+		break;
+	case SR_DF_TRIGGER:
+		send_frame(outc, NETFEED_TRIGGER, NULL, 0, NULL, 0);
+		break;
+	case SR_DF_FRAME_BEGIN:
+		send_frame(outc, NETFEED_FRAME_BEGIN, NULL, 0, NULL, 0);
+		break;
+	case SR_DF_FRAME_END:
+		send_frame(outc, NETFEED_FRAME_END, NULL, 0, NULL, 0);
+		break;
+	case SR_DF_END:
+		send_frame(outc, NETFEED_END, NULL, 0, NULL, 0);
+		break;
+	default:
+		break;
+	}
+
+	return SR_OK;
+}
+
+static struct sr_option options[] = {
+	{ "address", "Address", "Local address to listen on, empty for all", NULL, NULL },
+	{ "port", "Port", "TCP port to listen on", NULL, NULL },
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	if (!options[0].def) {
+		options[0].def = g_variant_ref_sink(g_variant_new_string(""));
+		options[1].def = g_variant_ref_sink(
+			g_variant_new_uint32(NETFEED_DEFAULT_PORT));
+	}
+
+	return options;
+}
+
+static int cleanup(struct sr_output *o)
+{
+	struct out_context *outc;
+
+	outc = o->priv;
+	if (!outc)
+		return SR_OK;
+
+	if (outc->client_fd >= 0)
+		close(outc->client_fd);
+	close(outc->listen_fd);
+	g_free(outc->fbuf);
+	g_free(outc);
+	o->priv = NULL;
+
+	return SR_OK;
+}
+
+SR_PRIV struct sr_output_module output_netfeed = {
+	.id = "netfeed",
+	.name = "Network datafeed",
+	.desc = "Serve the datafeed to a netfeed client over TCP",
+	.exts = NULL,
+	.flags = SR_OUTPUT_INTERNAL_IO_HANDLING,
+	.options = get_options,
+	.init = init,
+	.receive = receive,
+	.cleanup = cleanup,
+};
+
+#endif
@@ -33,9 +33,20 @@
 
 #define LOG_PREFIX "output/ols"
 
+/*
+ * The file is "compressed": a line only gets written when the sample
+ * value changes. The last sample is always written at the end, so that
+ * readers get the length of the capture.
+ */
 struct context {
 	uint64_t samplerate;
 	uint64_t num_samples;
+	gboolean header_done;
+	/* The value and index of the last line written. */
+	unsigned int unitsize;
+	uint8_t *last;
+	gboolean have_last;
+	uint64_t last_index;
 };
 
 static int init(struct sr_output *o, GHashTable *options)
@@ -52,11 +63,11 @@ static int init(struct sr_output *o, GHashTable *options)
 	return SR_OK;
 }
 
-static GString *gen_header(const struct sr_dev_inst *sdi, struct context *ctx)
+static void gen_header(const struct sr_dev_inst *sdi, struct context *ctx,
+		GString *s)
 {
 	struct sr_channel *ch;
 	GSList *l;
-	GString *s;
 	GVariant *gvar;
 	int num_enabled_channels;
 
@@ -76,28 +87,77 @@ static GString *gen_header(const struct sr_dev_inst *sdi, struct context *ctx)
 		num_enabled_channels++;
 	}
 
-	s = g_string_sized_new(512);
 	g_string_append_printf(s, ";Rate: %"PRIu64"\n", ctx->samplerate);
 	g_string_append_printf(s, ";Channels: %d\n", num_enabled_channels);
 	g_string_append_printf(s, ";EnabledChannels: -1\n");
 	g_string_append_printf(s, ";Compressed: true\n");
 	g_string_append_printf(s, ";CursorEnabled: false\n");
+}
+
+/* Write a line: the sample in hex (MSB first, as OLS wants it), and its index. */
+static void append_sample(GString *out, const uint8_t *sample,
+		unsigned int unitsize, uint64_t index)
+{
+	static const char hex[] = "0123456789abcdef";
+	char buf[24], *p;
+	unsigned int j;
+	size_t len;
+
+	len = out->len;
+	g_string_set_size(out, len + 2 * unitsize);
+	p = &out->str[len];
+	for (j = 0; j < unitsize; j++) {
+		*p++ = hex[sample[unitsize - 1 - j] >> 4];
+		*p++ = hex[sample[unitsize - 1 - j] & 0x0f];
+	}
+
+	p = buf + sizeof(buf);
+	*--p = '\n';
+	do {
+		*--p = '0' + index % 10;
+		index /= 10;
+	} while (index);
+	*--p = '@';
+	g_string_append_len(out, p, buf + sizeof(buf) - p);
+}
+
+static void feed_run(struct context *ctx, GString *out,
+		const uint8_t *sample, uint64_t count)
+{
+	if (!count)
+		return;
+
+	if (!ctx->have_last || memcmp(sample, ctx->last, ctx->unitsize)) {
+		append_sample(out, sample, ctx->unitsize, ctx->num_samples);
+		memcpy(ctx->last, sample, ctx->unitsize);
+		ctx->have_last = TRUE;
+		ctx->last_index = ctx->num_samples;
+	}
+	ctx->num_samples += count;
+}
+
+static void set_unitsize(struct context *ctx, unsigned int unitsize)
+{
+	if (ctx->unitsize == unitsize)
+		return;
 
-	return s;
+	ctx->unitsize = unitsize;
+	ctx->last = g_realloc(ctx->last, unitsize);
+	ctx->have_last = FALSE;
 }
 
-static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
-		GString **out)
+static int receive_append(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString *out)
 {
 	struct context *ctx;
 	const struct sr_datafeed_meta *meta;
 	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_logic_rle *rle;
 	const struct sr_config *src;
+	const uint8_t *data;
 	GSList *l;
-	unsigned int i, j;
-	uint8_t c;
+	uint64_t i;
 
-	*out = NULL;
 	if (!o || !o->sdi)
 		return SR_ERR_ARG;
 	ctx = o->priv;
@@ -113,18 +173,36 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		break;
 	case SR_DF_LOGIC:
 		logic = packet->payload;
-		if (ctx->num_samples == 0) {
+		if (!logic->unitsize || logic->length < logic->unitsize)
+			break;
+		if (!ctx->header_done) {
 			/* First logic packet in the feed. */
-			*out = gen_header(o->sdi, ctx);
-		} else
-			*out = g_string_sized_new(512);
-		for (i = 0; i <= logic->length - logic->unitsize; i += logic->unitsize) {
-			for (j = 0; j < logic->unitsize; j++) {
-				/* The OLS format wants the samples presented MSB first. */
-				c = *((uint8_t *)logic->data + i + logic->unitsize - 1 - j);
-				g_string_append_printf(*out, "%02x", c);
-			}
-			g_string_append_printf(*out, "@%"PRIu64"\n", ctx->num_samples++);
+			gen_header(o->sdi, ctx, out);
+			ctx->header_done = TRUE;
+		}
+		set_unitsize(ctx, logic->unitsize);
+		data = logic->data;
+		for (i = 0; i < logic->length / logic->unitsize; i++)
+			feed_run(ctx, out, data + i * logic->unitsize, 1);
+		break;
+	case SR_DF_LOGIC_RLE:
+		rle = packet->payload;
+		if (!rle->unitsize || !rle->num_runs)
+			break;
+		if (!ctx->header_done) {
+			gen_header(o->sdi, ctx, out);
+			ctx->header_done = TRUE;
+		}
+		set_unitsize(ctx, rle->unitsize);
+		data = rle->values;
+		for (i = 0; i < rle->num_runs; i++)
+			feed_run(ctx, out, data + i * rle->unitsize, rle->counts[i]);
+		break;
+	case SR_DF_END:
+		if (ctx->have_last && ctx->last_index + 1 < ctx->num_samples) {
+			append_sample(out, ctx->last, ctx->unitsize,
+				ctx->num_samples - 1);
+			ctx->last_index = ctx->num_samples - 1;
 		}
 		break;
 	}
@@ -140,6 +218,7 @@ static int cleanup(struct sr_output *o)
 		return SR_ERR_ARG;
 
 	ctx = o->priv;
+	g_free(ctx->last);
 	g_free(ctx);
 	o->priv = NULL;
 
@@ -151,9 +230,9 @@ SR_PRIV struct sr_output_module output_ols = {
 	.name = "OLS",
 	.desc = "OpenBench Logic Sniffer data",
 	.exts = (const char*[]){"ols", NULL},
-	.flags = 0,
+	.flags = SR_OUTPUT_LOGIC_RLE,
 	.options = NULL,
 	.init = init,
-	.receive = receive,
+	.receive_append = receive_append,
 	.cleanup = cleanup
 };
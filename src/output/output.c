@@ -18,7 +18,15 @@
  */
 
 #include <config.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#ifdef _WIN32
+#include <io.h>
+#endif
+#include <glib/gstdio.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
 
@@ -61,8 +69,20 @@ extern SR_PRIV struct sr_output_module output_vcd;
 extern SR_PRIV struct sr_output_module output_ols;
 extern SR_PRIV struct sr_output_module output_chronovu_la8;
 extern SR_PRIV struct sr_output_module output_csv;
+extern SR_PRIV struct sr_output_module output_arrow;
+#ifdef HAVE_LIBHDF5
+extern SR_PRIV struct sr_output_module output_hdf5;
+#endif
 extern SR_PRIV struct sr_output_module output_analog;
 extern SR_PRIV struct sr_output_module output_srzip;
+extern SR_PRIV struct sr_output_module output_srraw;
+extern SR_PRIV struct sr_output_module output_framed;
+#ifndef _WIN32
+extern SR_PRIV struct sr_output_module output_netfeed;
+#endif
+#ifdef HAVE_SHM_OPEN
+extern SR_PRIV struct sr_output_module output_shmring;
+#endif
 extern SR_PRIV struct sr_output_module output_wav;
 extern SR_PRIV struct sr_output_module output_wavedrom;
 extern SR_PRIV struct sr_output_module output_null;
@@ -73,12 +93,24 @@ static const struct sr_output_module *output_module_list[] = {
 	&output_binary,
 	&output_bits,
 	&output_csv,
+	&output_arrow,
+#ifdef HAVE_LIBHDF5
+	&output_hdf5,
+#endif
 	&output_hex,
 	&output_ols,
 	&output_vcd,
 	&output_chronovu_la8,
 	&output_analog,
 	&output_srzip,
+	&output_srraw,
+	&output_framed,
+#ifndef _WIN32
+	&output_netfeed,
+#endif
+#ifdef HAVE_SHM_OPEN
+	&output_shmring,
+#endif
 	&output_wav,
 	&output_wavedrom,
 	&output_null,
@@ -271,10 +303,16 @@ SR_API const struct sr_output *sr_output_new(const struct sr_output_module *omod
 	gpointer key, value;
 	int i;
 
+	if (sr_output_module_sanity_check(omod) != SR_OK) {
+		sr_err("Internal output module error(s), can't use it.");
+		return NULL;
+	}
+
 	op = g_malloc(sizeof(struct sr_output));
 	op->module = omod;
 	op->sdi = sdi;
 	op->filename = g_strdup(filename);
+	op->buf = NULL;
 
 	new_opts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
 			(GDestroyNotify)g_variant_unref);
@@ -288,6 +326,7 @@ SR_API const struct sr_output *sr_output_new(const struct sr_output_module *omod
 				if (!g_variant_is_of_type(value, gvt)) {
 					sr_err("Invalid type for '%s' option.",
 						(char *)key);
+					g_free((char *)op->filename);
 					g_free(op);
 					return NULL;
 				}
@@ -308,6 +347,7 @@ SR_API const struct sr_output *sr_output_new(const struct sr_output_module *omod
 					sr_err("Output module '%s' has no option '%s'",
 						omod->id, (char *)key);
 					g_hash_table_destroy(new_opts);
+					g_free((char *)op->filename);
 					g_free(op);
 					return NULL;
 				}
@@ -316,27 +356,208 @@ SR_API const struct sr_output *sr_output_new(const struct sr_output_module *omod
 	}
 
 	if (op->module->init && op->module->init(op, new_opts) != SR_OK) {
+		g_free((char *)op->filename);
 		g_free(op);
 		op = NULL;
 	}
+	if (op && omod->receive_append)
+		op->buf = g_string_sized_new(4096);
 	if (new_opts)
 		g_hash_table_destroy(new_opts);
 
 	return op;
 }
 
+/*
+ * Run a packet through the module, appending the output to a buffer.
+ * Modules which only implement receive() get their GString copied.
+ */
+static int output_append(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString *buf)
+{
+	GString *out;
+	int ret;
+
+	if (o->module->receive_append)
+		return o->module->receive_append(o, packet, buf);
+
+	out = NULL;
+	ret = o->module->receive(o, packet, &out);
+	if (out) {
+		g_string_append_len(buf, out->str, out->len);
+		g_string_free(out, TRUE);
+	}
+
+	return ret;
+}
+
+struct output_rle_expand {
+	const struct sr_output *o;
+	GString *out;
+};
+
+static int output_rle_expand_cb(const struct sr_datafeed_packet *packet,
+		void *cb_data)
+{
+	struct output_rle_expand *ctx;
+	GString *out;
+	int ret;
+
+	ctx = cb_data;
+	if (ctx->out)
+		return output_append(ctx->o, packet, ctx->out);
+	if (ctx->o->module->receive_append) {
+		ctx->out = g_string_new(NULL);
+		return output_append(ctx->o, packet, ctx->out);
+	}
+	out = NULL;
+	ret = ctx->o->module->receive(ctx->o, packet, &out);
+	ctx->out = out;
+
+	return ret;
+}
+
+/* Expand SR_DF_LOGIC_RLE packets for modules which don't take them. */
+static gboolean output_rle_expand(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet)
+{
+	return packet->type == SR_DF_LOGIC_RLE &&
+		!(o->module->flags & SR_OUTPUT_LOGIC_RLE);
+}
+
 /**
  * Send a packet to the specified output instance.
  *
  * The instance's output is returned as a newly allocated GString,
  * which must be freed by the caller.
  *
+ * SR_DF_LOGIC_RLE packets are expanded into SR_DF_LOGIC packets for
+ * output modules which don't handle run-length encoded data.
+ *
+ * @see sr_output_send_sink()
+ *
  * @since 0.4.0
  */
 SR_API int sr_output_send(const struct sr_output *o,
 		const struct sr_datafeed_packet *packet, GString **out)
 {
-	return o->module->receive(o, packet, out);
+	struct output_rle_expand ctx;
+	int ret;
+
+	if (!output_rle_expand(o, packet)) {
+		if (!o->module->receive_append)
+			return o->module->receive(o, packet, out);
+		*out = g_string_new(NULL);
+		ret = o->module->receive_append(o, packet, *out);
+		if (!(*out)->len) {
+			g_string_free(*out, TRUE);
+			*out = NULL;
+		}
+		return ret;
+	}
+
+	ctx.o = o;
+	ctx.out = NULL;
+	ret = sr_logic_rle_expand(packet->payload, output_rle_expand_cb, &ctx);
+	if (ctx.out && !ctx.out->len) {
+		g_string_free(ctx.out, TRUE);
+		ctx.out = NULL;
+	}
+	*out = ctx.out;
+
+	return ret;
+}
+
+/**
+ * Send a packet to the specified output instance, and pass its output
+ * on to a callback.
+ *
+ * Unlike with sr_output_send(), the output is not handed over in a
+ * newly allocated GString. Most text output modules write into a buffer
+ * which the output instance reuses for every packet, so no allocation
+ * or copying is needed per packet.
+ *
+ * @param o The output instance. Must not be NULL.
+ * @param packet The packet. Must not be NULL.
+ * @param cb Called with the output (if there was any), which is only
+ *           valid during the call. A negative return value is passed on
+ *           as the error code. Must not be NULL.
+ * @param cb_data Passed on to cb.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval other The output module's or the callback's error code.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_output_send_sink(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet,
+		sr_output_sink_callback cb, void *cb_data)
+{
+	struct output_rle_expand ctx;
+	GString *buf;
+	int ret;
+
+	if (!o || !packet || !cb)
+		return SR_ERR_ARG;
+
+	buf = o->buf;
+	if (output_rle_expand(o, packet)) {
+		ctx.o = o;
+		ctx.out = buf;
+		ret = sr_logic_rle_expand(packet->payload,
+			output_rle_expand_cb, &ctx);
+		buf = ctx.out;
+	} else if (buf) {
+		ret = output_append(o, packet, buf);
+	} else {
+		ret = o->module->receive(o, packet, &buf);
+	}
+
+	if (buf && buf->len && ret == SR_OK)
+		ret = cb(buf->str, buf->len, cb_data);
+	if (buf == o->buf)
+		g_string_truncate(buf, 0);
+	else if (buf)
+		g_string_free(buf, TRUE);
+
+	return ret;
+}
+
+static int output_write_file(const void *data, size_t length, void *cb_data)
+{
+	if (fwrite(data, 1, length, cb_data) != length) {
+		sr_err("Failed to write output: %s", g_strerror(errno));
+		return SR_ERR_IO;
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Send a packet to the specified output instance, and write its output
+ * to a file.
+ *
+ * @param o The output instance. Must not be NULL.
+ * @param packet The packet. Must not be NULL.
+ * @param file The file to write to. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_IO Write error.
+ * @retval other The output module's error code.
+ *
+ * @see sr_output_send_sink()
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_output_send_file(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, FILE *file)
+{
+	if (!file)
+		return SR_ERR_ARG;
+
+	return sr_output_send_sink(o, packet, output_write_file, file);
 }
 
 /**
@@ -354,10 +575,540 @@ SR_API int sr_output_free(const struct sr_output *o)
 	ret = SR_OK;
 	if (o->module->cleanup)
 		ret = o->module->cleanup((struct sr_output *)o);
+	if (o->buf)
+		g_string_free(o->buf, TRUE);
 	g_free((char *)o->filename);
 	g_free((gpointer)o);
 
 	return ret;
 }
 
+/* Size of an output writer block, a multiple of the O_DIRECT alignment. */
+#define WRITER_BLOCK_SIZE (1024 * 1024)
+#define WRITER_BLOCK_ALIGN 4096
+#define WRITER_DEFAULT_DEPTH 16
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+struct writer_block {
+	uint8_t *data;
+	size_t fill;
+};
+
+struct sr_output_writer {
+	const struct sr_output *o;
+	int fd;
+	int sync;
+	GThread *thread;
+	/* The block which the sender currently fills. */
+	struct writer_block *cur;
+	/* Protects everything below, signals queued and free blocks. */
+	GMutex mutex;
+	GCond cond;
+	GQueue queued;
+	GQueue free;
+	size_t depth;
+	size_t num_blocks;
+	gboolean stop;
+	/* The first write error, reported to the sender. */
+	int error;
+	struct sr_output_writer_stats stats;
+};
+
+static struct writer_block *writer_block_new(void)
+{
+	struct writer_block *blk;
+	void *data;
+
+#ifdef _WIN32
+	data = _aligned_malloc(WRITER_BLOCK_SIZE, WRITER_BLOCK_ALIGN);
+#else
+	if (posix_memalign(&data, WRITER_BLOCK_ALIGN, WRITER_BLOCK_SIZE) != 0)
+		data = NULL;
+#endif
+	if (!data)
+		return NULL;
+
+	blk = g_malloc(sizeof(*blk));
+	blk->data = data;
+	blk->fill = 0;
+
+	return blk;
+}
+
+static void writer_block_free(struct writer_block *blk)
+{
+#ifdef _WIN32
+	_aligned_free(blk->data);
+#else
+	free(blk->data);
+#endif
+	g_free(blk);
+}
+
+static int writer_block_write(struct sr_output_writer *w,
+		const struct writer_block *blk)
+{
+	const uint8_t *p;
+	size_t remain;
+	ssize_t ret;
+
+	p = blk->data;
+	remain = blk->fill;
+	while (remain) {
+		ret = write(w->fd, p, remain);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0) {
+			sr_err("Cannot write output: %s", g_strerror(errno));
+			return SR_ERR_IO;
+		}
+		p += ret;
+		remain -= ret;
+	}
+
+	return SR_OK;
+}
+
+static int writer_sync(int fd)
+{
+#ifdef _WIN32
+	if (_commit(fd) < 0) {
+#else
+	if (fsync(fd) < 0) {
+#endif
+		sr_err("Cannot sync output: %s", g_strerror(errno));
+		return SR_ERR_IO;
+	}
+
+	return SR_OK;
+}
+
+static gpointer writer_thread(gpointer data)
+{
+	struct sr_output_writer *w;
+	struct writer_block *blk;
+	int64_t start;
+	int ret;
+
+	w = data;
+	g_mutex_lock(&w->mutex);
+	while (TRUE) {
+		while (g_queue_is_empty(&w->queued) && !w->stop)
+			g_cond_wait(&w->cond, &w->mutex);
+		blk = g_queue_pop_head(&w->queued);
+		if (!blk)
+			break;
+		ret = w->error;
+		/* O_DIRECT writes must be aligned, the tail is written without. */
+#ifdef O_DIRECT
+		if (w->stats.direct && blk->fill % WRITER_BLOCK_ALIGN) {
+			fcntl(w->fd, F_SETFL, fcntl(w->fd, F_GETFL) & ~O_DIRECT);
+			w->stats.direct = FALSE;
+		}
+#endif
+		g_mutex_unlock(&w->mutex);
+
+		/* After an error, the blocks only get recycled. */
+		start = g_get_monotonic_time();
+		if (ret == SR_OK)
+			ret = writer_block_write(w, blk);
+		if (ret == SR_OK && w->sync == SR_OUTPUT_SYNC_BLOCK)
+			ret = writer_sync(w->fd);
+
+		g_mutex_lock(&w->mutex);
+		if (w->error == SR_OK) {
+			w->error = ret;
+			w->stats.bytes_written += blk->fill;
+			w->stats.blocks_written++;
+			w->stats.write_us += g_get_monotonic_time() - start;
+		}
+		blk->fill = 0;
+		g_queue_push_tail(&w->free, blk);
+		g_cond_broadcast(&w->cond);
+	}
+	g_mutex_unlock(&w->mutex);
+
+	return NULL;
+}
+
+/* Hand the current block to the writer thread, and get a free one. */
+static void writer_queue(struct sr_output_writer *w)
+{
+	int64_t start;
+
+	g_mutex_lock(&w->mutex);
+	g_queue_push_tail(&w->queued, w->cur);
+	w->stats.max_queued = MAX(w->stats.max_queued, w->queued.length);
+	g_cond_broadcast(&w->cond);
+	w->cur = g_queue_pop_head(&w->free);
+	if (!w->cur && w->num_blocks < w->depth) {
+		w->cur = writer_block_new();
+		if (w->cur)
+			w->num_blocks++;
+	}
+	if (!w->cur) {
+		w->stats.stalls++;
+		start = g_get_monotonic_time();
+		while (g_queue_is_empty(&w->free))
+			g_cond_wait(&w->cond, &w->mutex);
+		w->stats.stall_us += g_get_monotonic_time() - start;
+		w->cur = g_queue_pop_head(&w->free);
+	}
+	g_mutex_unlock(&w->mutex);
+}
+
+static int writer_append(const void *data, size_t length, void *cb_data)
+{
+	struct sr_output_writer *w;
+	const uint8_t *p;
+	size_t n;
+
+	w = cb_data;
+	p = data;
+	while (length) {
+		n = MIN(length, WRITER_BLOCK_SIZE - w->cur->fill);
+		memcpy(w->cur->data + w->cur->fill, p, n);
+		w->cur->fill += n;
+		p += n;
+		length -= n;
+		if (w->cur->fill == WRITER_BLOCK_SIZE)
+			writer_queue(w);
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Create a writer which writes an output instance's output to a file
+ * from a separate thread.
+ *
+ * With sr_output_send() and its variants, the output gets written by
+ * the thread which calls them, which is usually the one running the
+ * acquisition. A slow disk or network file system then delays the
+ * acquisition, and devices can overrun. A writer only runs the output
+ * module in the sending thread. Its output is collected in blocks,
+ * which a dedicated thread writes to the file.
+ *
+ * When all blocks are waiting to be written, sr_output_writer_send()
+ * waits for the writer thread. How often and how long that happened is
+ * part of the writer's counters.
+ *
+ * With O_DIRECT, the file is written bypassing the page cache, where the
+ * platform and file system support it. Output is then only written in
+ * whole blocks, until the writer is freed.
+ *
+ * @param o The output instance. Must not be NULL. It must not be used
+ *          otherwise until the writer is freed, and must outlive it.
+ * @param filename The file to create, or to truncate. Must not be NULL.
+ * @param depth The number of blocks of 1 MiB, or 0 for the default.
+ * @param sync One of enum sr_output_sync.
+ * @param direct TRUE to try to write with O_DIRECT.
+ * @param writer Pointer to store the new writer in. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_IO The file cannot be created.
+ * @retval SR_ERR_MALLOC Out of memory.
+ * @retval SR_ERR Cannot create the writer thread.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_output_writer_new(const struct sr_output *o,
+		const char *filename, size_t depth, int sync, gboolean direct,
+		struct sr_output_writer **writer)
+{
+	struct sr_output_writer *w;
+	int flags;
+
+	if (!o || !filename || !writer)
+		return SR_ERR_ARG;
+
+	switch (sync) {
+	case SR_OUTPUT_SYNC_NONE:
+	case SR_OUTPUT_SYNC_CLOSE:
+	case SR_OUTPUT_SYNC_BLOCK:
+		break;
+	default:
+		sr_err("Invalid output sync policy %d.", sync);
+		return SR_ERR_ARG;
+	}
+
+	w = g_malloc0(sizeof(*w));
+	w->o = o;
+	w->fd = -1;
+	w->sync = sync;
+	w->depth = depth ? MAX(depth, 2) : WRITER_DEFAULT_DEPTH;
+	g_mutex_init(&w->mutex);
+	g_cond_init(&w->cond);
+	g_queue_init(&w->queued);
+	g_queue_init(&w->free);
+
+	w->cur = writer_block_new();
+	if (!w->cur) {
+		sr_output_writer_free(w);
+		return SR_ERR_MALLOC;
+	}
+	w->num_blocks = 1;
+
+	flags = O_WRONLY | O_CREAT | O_TRUNC | O_BINARY;
+#ifdef O_DIRECT
+	/* Not all file systems support O_DIRECT, fall back silently. */
+	if (direct) {
+		w->fd = g_open(filename, flags | O_DIRECT, 0644);
+		w->stats.direct = w->fd >= 0;
+	}
+#else
+	(void)direct;
+#endif
+	if (w->fd < 0)
+		w->fd = g_open(filename, flags, 0644);
+	if (w->fd < 0) {
+		sr_err("Cannot create '%s': %s", filename, g_strerror(errno));
+		sr_output_writer_free(w);
+		return SR_ERR_IO;
+	}
+
+	w->thread = g_thread_try_new("sr-output-writer", writer_thread,
+		w, NULL);
+	if (!w->thread) {
+		sr_err("Cannot create output writer thread.");
+		sr_output_writer_free(w);
+		return SR_ERR;
+	}
+
+	sr_dbg("Writing '%s' from a separate thread (%zu blocks%s).",
+		filename, w->depth, w->stats.direct ? ", O_DIRECT" : "");
+	*writer = w;
+
+	return SR_OK;
+}
+
+/**
+ * Send a packet to a writer's output instance, and queue its output.
+ *
+ * At the end of an acquisition, an incomplete block is queued as well,
+ * unless the file is written with O_DIRECT.
+ *
+ * @param writer The writer. Must not be NULL.
+ * @param packet The packet. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_IO An earlier write failed.
+ * @retval other The output module's error code.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_output_writer_send(struct sr_output_writer *writer,
+		const struct sr_datafeed_packet *packet)
+{
+	gboolean direct;
+	int ret;
+
+	if (!writer || !packet)
+		return SR_ERR_ARG;
+
+	g_mutex_lock(&writer->mutex);
+	ret = writer->error;
+	direct = writer->stats.direct;
+	g_mutex_unlock(&writer->mutex);
+	if (ret != SR_OK)
+		return ret;
+
+	ret = sr_output_send_sink(writer->o, packet, writer_append, writer);
+	if (ret == SR_OK && packet->type == SR_DF_END && !direct &&
+			writer->cur->fill)
+		writer_queue(writer);
+
+	return ret;
+}
+
+/**
+ * Get the counters of a writer.
+ *
+ * @param writer The writer. Must not be NULL.
+ * @param stats Pointer to store the counters in. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_output_writer_stats_get(struct sr_output_writer *writer,
+		struct sr_output_writer_stats *stats)
+{
+	if (!writer || !stats)
+		return SR_ERR_ARG;
+
+	g_mutex_lock(&writer->mutex);
+	*stats = writer->stats;
+	g_mutex_unlock(&writer->mutex);
+
+	return SR_OK;
+}
+
+/**
+ * Write all queued output, close the file, and free the writer.
+ *
+ * The output instance is not freed.
+ *
+ * @param writer The writer. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_IO Writing, syncing or closing the file failed.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_output_writer_free(struct sr_output_writer *writer)
+{
+	struct writer_block *blk;
+	int ret;
+
+	if (!writer)
+		return SR_ERR_ARG;
+
+	if (writer->thread) {
+		g_mutex_lock(&writer->mutex);
+		if (writer->cur->fill) {
+			g_queue_push_tail(&writer->queued, writer->cur);
+			writer->cur = NULL;
+		}
+		writer->stop = TRUE;
+		g_cond_broadcast(&writer->cond);
+		g_mutex_unlock(&writer->mutex);
+		g_thread_join(writer->thread);
+	}
+
+	ret = writer->error;
+	if (writer->fd >= 0) {
+		if (ret == SR_OK && writer->sync == SR_OUTPUT_SYNC_CLOSE)
+			ret = writer_sync(writer->fd);
+		if (close(writer->fd) < 0 && ret == SR_OK) {
+			sr_err("Cannot close output: %s", g_strerror(errno));
+			ret = SR_ERR_IO;
+		}
+	}
+
+	if (writer->stats.stalls)
+		sr_warn("Output writer stalled %" PRIu64 " times, "
+			"for %" PRIu64 " ms.", writer->stats.stalls,
+			writer->stats.stall_us / 1000);
+
+	if (writer->cur)
+		writer_block_free(writer->cur);
+	while ((blk = g_queue_pop_head(&writer->free)))
+		writer_block_free(blk);
+	g_mutex_clear(&writer->mutex);
+	g_cond_clear(&writer->cond);
+	g_free(writer);
+
+	return ret;
+}
+
+/** @private */
+SR_PRIV struct sr_output_logic_map *sr_output_logic_map_new(
+		const struct sr_dev_inst *sdi)
+{
+	struct sr_output_logic_map *map;
+	struct sr_output_logic_group *group;
+	struct sr_channel *ch;
+	GSList *l;
+	size_t i, pos, bit;
+	unsigned int v;
+
+	map = g_malloc0(sizeof(*map));
+	map->ascending = TRUE;
+
+	for (l = sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->type == SR_CHANNEL_LOGIC && ch->enabled)
+			map->num_channels++;
+	}
+	map->channels = g_malloc0(map->num_channels * sizeof(map->channels[0]));
+	map->byte_pos = g_malloc0(map->num_channels * sizeof(map->byte_pos[0]));
+	map->bit_mask = g_malloc0(map->num_channels * sizeof(map->bit_mask[0]));
+
+	i = 0;
+	for (l = sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->type != SR_CHANNEL_LOGIC || !ch->enabled)
+			continue;
+		if (i && ch->index <= map->channels[i - 1]->index)
+			map->ascending = FALSE;
+		map->channels[i] = ch;
+		map->byte_pos[i] = ch->index / 8;
+		map->bit_mask[i] = 1 << (ch->index % 8);
+		map->num_bytes = MAX(map->num_bytes, map->byte_pos[i] + 1);
+		i++;
+	}
+
+	map->num_words = (map->num_bytes + 7) / 8;
+	map->word_mask = g_malloc0(map->num_words * sizeof(map->word_mask[0]));
+	for (i = 0; i < map->num_channels; i++) {
+		pos = map->channels[i]->index;
+		map->word_mask[pos / 64] |= UINT64_C(1) << (pos % 64);
+	}
+
+	/* Split the columns where the next one is in another byte. */
+	for (i = 0; i < map->num_channels; i++) {
+		if (!i || map->byte_pos[i] != map->byte_pos[i - 1] ||
+				map->groups[map->num_groups - 1].count == 8) {
+			map->groups = g_realloc(map->groups,
+				++map->num_groups * sizeof(map->groups[0]));
+			group = &map->groups[map->num_groups - 1];
+			memset(group, 0, sizeof(*group));
+			group->byte_pos = map->byte_pos[i];
+			group->first = i;
+		}
+		group = &map->groups[map->num_groups - 1];
+		bit = map->channels[i]->index % 8;
+		for (v = 0; v < 256; v++)
+			group->spread[v][group->count] = (v >> bit) & 1;
+		group->count++;
+	}
+
+	return map;
+}
+
+/** @private */
+SR_PRIV void sr_output_logic_map_free(struct sr_output_logic_map *map)
+{
+	if (!map)
+		return;
+
+	g_free(map->channels);
+	g_free(map->byte_pos);
+	g_free(map->bit_mask);
+	g_free(map->word_mask);
+	g_free(map->groups);
+	g_free(map);
+}
+
+/**
+ * Get the 0/1 values of all columns of one sample, row must have room
+ * for num_channels values. Channels beyond the unitsize are 0.
+ *
+ * @private
+ */
+SR_PRIV void sr_output_logic_gather(const struct sr_output_logic_map *map,
+		const uint8_t *sample, size_t unitsize, uint8_t *row)
+{
+	const struct sr_output_logic_group *group;
+	size_t i;
+
+	for (i = 0; i < map->num_groups; i++) {
+		group = &map->groups[i];
+		if (group->byte_pos < unitsize)
+			memcpy(row + group->first,
+				group->spread[sample[group->byte_pos]],
+				group->count);
+		else
+			memset(row + group->first, 0, group->count);
+	}
+}
+
 /** @} */
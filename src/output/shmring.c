@@ -0,0 +1,404 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Publish the datafeed in a shared memory ring, for any number of
+ * processes on the host to read with sr_shmring_reader_open(). The
+ * writer never waits for readers, readers which fall behind by more
+ * than the ring's size lose data and get told so. See shmring.h for
+ * the layout.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <string.h>
+#include <glib.h>
+#ifdef HAVE_SHM_OPEN
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "shmring.h"
+
+#define LOG_PREFIX "output/shmring"
+
+#ifdef HAVE_SHM_OPEN
+
+#define DEFAULT_NAME	"/sigrok"
+#define DEFAULT_SIZE	(16 * 1024 * 1024)
+#define MIN_SIZE	(64 * 1024)
+#define MAX_SIZE	(1024 * 1024 * 1024)
+
+struct out_context {
+	char *name;
+	struct shmring_control *ctl;
+	size_t map_size;
+	uint8_t *ring;
+	guint32 size;
+	/* The writer's copy of write_pos. */
+	guint32 pos;
+	uint64_t samplerate;
+};
+
+/*
+ * Start a frame of len payload bytes, and return where the payload
+ * goes. The frame is visible to readers after frame_end().
+ */
+static uint8_t *frame_begin(struct out_context *outc, int type, size_t len)
+{
+	uint8_t *frame;
+	guint32 off, total, left;
+
+	total = (NETFEED_FRAME_LEN + len + SHMRING_ALIGN - 1) &
+		~(SHMRING_ALIGN - 1);
+	off = outc->pos & (outc->size - 1);
+	left = outc->size - off;
+	if (left < total) {
+		g_atomic_int_set(&outc->ctl->reserve_pos, outc->pos + left);
+		frame = outc->ring + off;
+		memset(frame, 0, NETFEED_FRAME_LEN);
+		write_u32le(frame, left - NETFEED_FRAME_LEN);
+		frame[4] = SHMRING_PAD;
+		outc->pos += left;
+		g_atomic_int_set(&outc->ctl->write_pos, outc->pos);
+		off = 0;
+	}
+
+	g_atomic_int_set(&outc->ctl->reserve_pos, outc->pos + total);
+	frame = outc->ring + off;
+	memset(frame, 0, NETFEED_FRAME_LEN);
+	write_u32le(frame, len);
+	frame[4] = type;
+	outc->pos += total;
+
+	return frame + NETFEED_FRAME_LEN;
+}
+
+static void frame_end(struct out_context *outc)
+{
+	g_atomic_int_set(&outc->ctl->write_pos, outc->pos);
+}
+
+/* The largest payload which leaves the ring room for readers. */
+static size_t max_payload(const struct out_context *outc)
+{
+	return outc->size / 4 - NETFEED_FRAME_LEN;
+}
+
+static void send_empty(struct out_context *outc, int type)
+{
+	frame_begin(outc, type, 0);
+	frame_end(outc);
+}
+
+/*
+ * Describe the channels for readers which attach later, and to those
+ * attached in the ring when frame is set.
+ */
+static void send_header(const struct sr_output *o, gboolean frame)
+{
+	struct out_context *outc;
+	const struct sr_channel *ch;
+	GByteArray *buf;
+	uint8_t tmp[12], *p;
+	size_t len;
+	GSList *l;
+
+	outc = o->priv;
+	buf = g_byte_array_new();
+	p = tmp;
+	write_u64le_inc(&p, outc->samplerate);
+	write_u32le_inc(&p, g_slist_length(o->sdi->channels));
+	g_byte_array_append(buf, tmp, p - tmp);
+	for (l = o->sdi->channels; l; l = l->next) {
+		ch = l->data;
+		len = MIN(strlen(ch->name), G_MAXUINT16);
+		p = tmp;
+		write_u8_inc(&p, ch->type == SR_CHANNEL_LOGIC ?
+			NETFEED_CHANNEL_LOGIC : NETFEED_CHANNEL_ANALOG);
+		write_u8_inc(&p, ch->enabled);
+		write_u16le_inc(&p, len);
+		g_byte_array_append(buf, tmp, p - tmp);
+		g_byte_array_append(buf, (const uint8_t *)ch->name, len);
+	}
+	if (buf->len > SHMRING_HEADER_MAX) {
+		sr_err("Too many channels to describe.");
+		g_byte_array_free(buf, TRUE);
+		return;
+	}
+
+	/* For readers which attach later. */
+	g_atomic_int_inc(&outc->ctl->header_seq);
+	memcpy((uint8_t *)outc->ctl + SHMRING_HEADER_OFFSET, buf->data,
+		buf->len);
+	g_atomic_int_set(&outc->ctl->header_len, buf->len);
+	g_atomic_int_inc(&outc->ctl->header_seq);
+
+	if (frame) {
+		memcpy(frame_begin(outc, NETFEED_HEADER, buf->len), buf->data,
+			buf->len);
+		frame_end(outc);
+	}
+	g_byte_array_free(buf, TRUE);
+}
+
+static void send_logic(struct out_context *outc,
+		const struct sr_datafeed_logic *logic)
+{
+	const uint8_t *data;
+	uint64_t left, max, len;
+	uint8_t *p;
+
+	if (!logic->unitsize)
+		return;
+
+	max = max_payload(outc) - NETFEED_LOGIC_LEN;
+	max -= max % logic->unitsize;
+	data = logic->data;
+	for (left = logic->length; left > 0; left -= len) {
+		len = MIN(left, max);
+		p = frame_begin(outc, NETFEED_LOGIC, NETFEED_LOGIC_LEN + len);
+		write_u32le(p, logic->unitsize);
+		memcpy(p + NETFEED_LOGIC_LEN, data, len);
+		frame_end(outc);
+		data += len;
+	}
+}
+
+static void send_analog(struct out_context *outc,
+		const struct sr_datafeed_analog *analog)
+{
+	const struct sr_channel *ch;
+	uint8_t *p, *samples;
+	size_t len, i;
+
+	if (!analog->meaning->channels || !analog->num_samples)
+		return;
+	if (g_slist_length(analog->meaning->channels) > 1) {
+		sr_dbg("Skipping analog packet of several channels.");
+		return;
+	}
+	len = analog->num_samples * sizeof(float);
+	if (len > max_payload(outc) - NETFEED_ANALOG_LEN) {
+		sr_warn("Skipping analog packet of %" PRIu32 " samples, too "
+			"large for the ring.", analog->num_samples);
+		return;
+	}
+	ch = analog->meaning->channels->data;
+
+	p = frame_begin(outc, NETFEED_ANALOG, NETFEED_ANALOG_LEN + len);
+	samples = p + NETFEED_ANALOG_LEN;
+	write_u32le_inc(&p, ch->index);
+	write_u32le_inc(&p, analog->meaning->mq);
+	write_u32le_inc(&p, analog->meaning->unit);
+	write_u64le_inc(&p, analog->meaning->mqflags);
+	write_u32le_inc(&p, (uint32_t)(int32_t)analog->encoding->digits);
+	/* The samples are aligned, they get converted in place. */
+	if (sr_analog_to_float(analog, (float *)samples) != SR_OK)
+		memset(samples, 0, len);
+	if (G_BYTE_ORDER != G_LITTLE_ENDIAN) {
+		for (i = 0; i < len; i += sizeof(float))
+			write_fltle(samples + i, *(float *)(samples + i));
+	}
+	frame_end(outc);
+}
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+	struct out_context *outc;
+	struct shmring_control *ctl;
+	const char *name;
+	uint64_t size;
+	size_t map_size;
+	GVariant *gvar;
+	void *map;
+	int fd;
+
+	if (!o || !o->sdi)
+		return SR_ERR_ARG;
+
+	name = g_variant_get_string(g_hash_table_lookup(options, "name"), NULL);
+	size = g_variant_get_uint64(g_hash_table_lookup(options, "size"));
+	if (name[0] != '/' || strchr(name + 1, '/')) {
+		sr_err("Invalid name '%s', expected /<name>.", name);
+		return SR_ERR_ARG;
+	}
+
+	/* Positions wrap at 2^32, which the ring's size has to divide. */
+	size = CLAMP(size, MIN_SIZE, MAX_SIZE);
+	while (size & (size - 1))
+		size &= size - 1;
+	map_size = SHMRING_RING_OFFSET + size;
+
+	fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		sr_err("Cannot create shared memory '%s': %s", name,
+			g_strerror(errno));
+		return SR_ERR;
+	}
+	if (ftruncate(fd, map_size) < 0) {
+		sr_err("Cannot size shared memory '%s': %s", name,
+			g_strerror(errno));
+		close(fd);
+		shm_unlink(name);
+		return SR_ERR;
+	}
+	map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		sr_err("Cannot map shared memory '%s': %s", name,
+			g_strerror(errno));
+		shm_unlink(name);
+		return SR_ERR;
+	}
+
+	/* Readers check the magic last. */
+	ctl = map;
+	ctl->version = SHMRING_VERSION;
+	ctl->size = size;
+	g_atomic_int_set(&ctl->header_len, 0);
+	memcpy(ctl->magic, SHMRING_MAGIC, SHMRING_MAGIC_LEN);
+	sr_info("Publishing the datafeed in '%s' (%" PRIu64 " bytes).",
+		name, size);
+
+	outc = g_malloc0(sizeof(*outc));
+	outc->name = g_strdup(name);
+	outc->ctl = ctl;
+	outc->map_size = map_size;
+	outc->ring = (uint8_t *)map + SHMRING_RING_OFFSET;
+	outc->size = size;
+	if (sr_config_get(o->sdi->driver, o->sdi, NULL, SR_CONF_SAMPLERATE,
+			&gvar) == SR_OK) {
+		outc->samplerate = g_variant_get_uint64(gvar);
+		g_variant_unref(gvar);
+	}
+	o->priv = outc;
+	send_header(o, FALSE);
+
+	return SR_OK;
+}
+
+static int receive(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString **out)
+{
+	struct out_context *outc;
+	const struct sr_datafeed_meta *meta;
+	const struct sr_config *src;
+	GVariant *gvar;
+	GSList *l;
+
+	*out = NULL;
+	if (!o || !o->sdi || !(outc = o->priv))
+		return SR_ERR_ARG;
+
+	switch (packet->type) {
+	case SR_DF_HEADER:
+		if (sr_config_get(o->sdi->driver, o->sdi, NULL,
+				SR_CONF_SAMPLERATE, &gvar) == SR_OK) {
+			outc->samplerate = g_variant_get_uint64(gvar);
+			g_variant_unref(gvar);
+		}
+		send_header(o, TRUE);
+		break;
+	case SR_DF_META:
+		meta = packet->payload;
+		for (l = meta->config; l; l = l->next) {
+			src = l->data;
+			if (src->key != SR_CONF_SAMPLERATE)
+				continue;
+			outc->samplerate = g_variant_get_uint64(src->data);
+			write_u64le(frame_begin(outc, NETFEED_SAMPLERATE, 8),
+				outc->samplerate);
+			frame_end(outc);
+		}
+		break;
+	case SR_DF_LOGIC:
+		send_logic(outc, packet->payload);
+		break;
+	case SR_DF_ANALOG:
+		send_analog(outc, packet->payload);
+		break;
+	case SR_DF_TRIGGER:
+		send_empty(outc, NETFEED_TRIGGER);
+		break;
+	case SR_DF_FRAME_BEGIN:
+		send_empty(outc, NETFEED_FRAME_BEGIN);
+		break;
+	case SR_DF_FRAME_END:
+		send_empty(outc, NETFEED_FRAME_END);
+		break;
+	case SR_DF_END:
+		send_empty(outc, NETFEED_END);
+		break;
+	default:
+		break;
+	}
+
+	return SR_OK;
+}
+
+static struct sr_option options[] = {
+	{ "name", "Name", "Name of the shared memory object, /<name>", NULL, NULL },
+	{ "size", "Size", "Size of the ring in bytes, a power of two", NULL, NULL },
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	if (!options[0].def) {
+		options[0].def = g_variant_ref_sink(
+			g_variant_new_string(DEFAULT_NAME));
+		options[1].def = g_variant_ref_sink(
+			g_variant_new_uint64(DEFAULT_SIZE));
+	}
+
+	return options;
+}
+
+static int cleanup(struct sr_output *o)
+{
+	struct out_context *outc;
+
+	outc = o->priv;
+	if (!outc)
+		return SR_OK;
+
+	/* Attached readers keep their mapping. */
+	munmap(outc->ctl, outc->map_size);
+	shm_unlink(outc->name);
+	g_free(outc->name);
+	g_free(outc);
+	o->priv = NULL;
+
+	return SR_OK;
+}
+
+SR_PRIV struct sr_output_module output_shmring = {
+	.id = "shmring",
+	.name = "Shared memory ring",
+	.desc = "Publish the datafeed to other processes in shared memory",
+	.exts = NULL,
+	.flags = SR_OUTPUT_INTERNAL_IO_HANDLING,
+	.options = get_options,
+	.init = init,
+	.receive = receive,
+	.cleanup = cleanup,
+};
+
+#endif
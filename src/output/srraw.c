@@ -0,0 +1,480 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Uncompressed session directory. Holds the same "version" and
+ * "metadata" entries as an srzip archive, plus one raw file for the
+ * logic data ("logic-1") and one per analog channel ("analog-1-N",
+ * little endian 32bit floats). The session driver memory-maps these
+ * files, and passes the data to the session without copying it.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "output/srraw"
+
+/* Write buffer per file, a multiple of the O_DIRECT alignment. */
+#define BUFFER_SIZE (4 * 1024 * 1024)
+#define BUFFER_ALIGN 4096
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+struct raw_file {
+	int fd;
+	gboolean direct;
+	uint8_t *buf;
+	size_t fill;
+};
+
+struct out_context {
+	gboolean created;
+	gboolean direct;
+	uint64_t samplerate;
+	char *dirname;
+	size_t unit_size;
+	struct raw_file logic;
+	size_t first_analog_index;
+	size_t analog_ch_count;
+	gint *analog_index_map;
+	struct raw_file *analog;
+};
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+	struct out_context *outc;
+
+	if (!o->filename || o->filename[0] == '\0') {
+		sr_info("srraw output module requires a file name, cannot save.");
+		return SR_ERR_ARG;
+	}
+
+	outc = g_malloc0(sizeof(*outc));
+	outc->dirname = g_strdup(o->filename);
+	outc->direct = g_variant_get_boolean(
+		g_hash_table_lookup(options, "direct"));
+	outc->logic.fd = -1;
+	o->priv = outc;
+
+	return SR_OK;
+}
+
+static uint8_t *buffer_alloc(void)
+{
+	void *buf;
+
+#ifdef _WIN32
+	buf = _aligned_malloc(BUFFER_SIZE, BUFFER_ALIGN);
+#else
+	if (posix_memalign(&buf, BUFFER_ALIGN, BUFFER_SIZE) != 0)
+		buf = NULL;
+#endif
+
+	return buf;
+}
+
+static void buffer_free(uint8_t *buf)
+{
+#ifdef _WIN32
+	_aligned_free(buf);
+#else
+	free(buf);
+#endif
+}
+
+static int raw_file_open(struct out_context *outc, struct raw_file *f,
+	const char *name)
+{
+	char *path;
+	int flags;
+
+	f->buf = buffer_alloc();
+	if (!f->buf)
+		return SR_ERR_MALLOC;
+	f->fill = 0;
+
+	path = g_build_filename(outc->dirname, name, NULL);
+	flags = O_WRONLY | O_CREAT | O_TRUNC | O_BINARY;
+	f->direct = FALSE;
+#ifdef O_DIRECT
+	/* Not all file systems support O_DIRECT, fall back silently. */
+	if (outc->direct) {
+		f->fd = g_open(path, flags | O_DIRECT, 0644);
+		f->direct = f->fd >= 0;
+	}
+#endif
+	if (!f->direct)
+		f->fd = g_open(path, flags, 0644);
+	if (f->fd < 0) {
+		sr_err("Cannot create '%s': %s", path, g_strerror(errno));
+		g_free(path);
+		buffer_free(f->buf);
+		f->buf = NULL;
+		return SR_ERR_IO;
+	}
+	g_free(path);
+
+	return SR_OK;
+}
+
+static int raw_file_flush(struct raw_file *f)
+{
+	const uint8_t *p;
+	size_t remain;
+	ssize_t ret;
+
+	p = f->buf;
+	remain = f->fill;
+	while (remain) {
+		ret = write(f->fd, p, remain);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0) {
+			sr_err("Cannot write sample data: %s", g_strerror(errno));
+			return SR_ERR_IO;
+		}
+		p += ret;
+		remain -= ret;
+	}
+	f->fill = 0;
+
+	return SR_OK;
+}
+
+static int raw_file_write(struct raw_file *f, const void *data, size_t len)
+{
+	const uint8_t *rdptr;
+	size_t n;
+	int ret;
+
+	rdptr = data;
+	while (len) {
+		n = MIN(len, BUFFER_SIZE - f->fill);
+		memcpy(&f->buf[f->fill], rdptr, n);
+		f->fill += n;
+		rdptr += n;
+		len -= n;
+		if (f->fill == BUFFER_SIZE) {
+			ret = raw_file_flush(f);
+			if (ret != SR_OK)
+				return ret;
+		}
+	}
+
+	return SR_OK;
+}
+
+static int raw_file_close(struct raw_file *f)
+{
+	int ret;
+
+	if (f->fd < 0)
+		return SR_OK;
+
+	/* O_DIRECT writes must be aligned, the tail is written without. */
+#ifdef O_DIRECT
+	if (f->direct && f->fill % BUFFER_ALIGN)
+		fcntl(f->fd, F_SETFL, fcntl(f->fd, F_GETFL) & ~O_DIRECT);
+#endif
+	ret = raw_file_flush(f);
+	if (close(f->fd) < 0 && ret == SR_OK)
+		ret = SR_ERR_IO;
+	f->fd = -1;
+	buffer_free(f->buf);
+	f->buf = NULL;
+
+	return ret;
+}
+
+static int write_entry(struct out_context *outc, const char *name,
+	const char *data, gsize len)
+{
+	GError *error;
+	char *path;
+
+	path = g_build_filename(outc->dirname, name, NULL);
+	error = NULL;
+	if (!g_file_set_contents(path, data, len, &error)) {
+		sr_err("Cannot write '%s': %s", path, error->message);
+		g_error_free(error);
+		g_free(path);
+		return SR_ERR_IO;
+	}
+	g_free(path);
+
+	return SR_OK;
+}
+
+static int dir_create(const struct sr_output *o)
+{
+	struct out_context *outc;
+	struct sr_channel *ch;
+	GVariant *gvar;
+	GKeyFile *meta;
+	GSList *l;
+	const char *devgroup;
+	char *s, *metabuf;
+	gsize metalen;
+	guint logic_channels, enabled_logic_channels;
+	guint index;
+	int ret;
+
+	outc = o->priv;
+
+	if (outc->samplerate == 0 && sr_config_get(o->sdi->driver, o->sdi, NULL,
+					SR_CONF_SAMPLERATE, &gvar) == SR_OK) {
+		outc->samplerate = g_variant_get_uint64(gvar);
+		g_variant_unref(gvar);
+	}
+
+	if (g_mkdir_with_parents(outc->dirname, 0755) < 0) {
+		sr_err("Cannot create directory '%s': %s",
+			outc->dirname, g_strerror(errno));
+		return SR_ERR_IO;
+	}
+
+	logic_channels = 0;
+	enabled_logic_channels = 0;
+	outc->analog_ch_count = 0;
+	for (l = o->sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->type == SR_CHANNEL_LOGIC) {
+			logic_channels++;
+			if (ch->enabled)
+				enabled_logic_channels++;
+		} else if (ch->type == SR_CHANNEL_ANALOG && ch->enabled) {
+			outc->analog_ch_count++;
+		}
+	}
+	outc->unit_size = (logic_channels + 8 - 1) / 8;
+	outc->first_analog_index = enabled_logic_channels ? logic_channels + 1 : 1;
+
+	meta = g_key_file_new();
+	g_key_file_set_string(meta, "global", "sigrok version",
+			sr_package_version_string_get());
+	devgroup = "device 1";
+	if (enabled_logic_channels > 0) {
+		g_key_file_set_string(meta, devgroup, "capturefile", "logic-1");
+		g_key_file_set_integer(meta, devgroup, "total probes", logic_channels);
+		g_key_file_set_integer(meta, devgroup, "unitsize", outc->unit_size);
+	}
+	s = sr_samplerate_string(outc->samplerate);
+	g_key_file_set_string(meta, devgroup, "samplerate", s);
+	g_free(s);
+	g_key_file_set_integer(meta, devgroup, "total analog", outc->analog_ch_count);
+
+	outc->analog_index_map = g_malloc0(sizeof(gint) * outc->analog_ch_count + 1);
+	outc->analog = g_malloc0(sizeof(outc->analog[0]) * outc->analog_ch_count + 1);
+	for (index = 0; index < outc->analog_ch_count; index++)
+		outc->analog[index].fd = -1;
+	index = 0;
+	for (l = o->sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (!ch->enabled)
+			continue;
+		s = NULL;
+		if (ch->type == SR_CHANNEL_LOGIC) {
+			s = g_strdup_printf("probe%d", ch->index + 1);
+		} else if (ch->type == SR_CHANNEL_ANALOG) {
+			outc->analog_index_map[index] = ch->index;
+			s = g_strdup_printf("analog%zu",
+				outc->first_analog_index + index);
+			index++;
+		}
+		if (s) {
+			g_key_file_set_string(meta, devgroup, s, ch->name);
+			g_free(s);
+		}
+	}
+
+	metabuf = g_key_file_to_data(meta, &metalen, NULL);
+	g_key_file_free(meta);
+	ret = write_entry(outc, "version", "2", 1);
+	if (ret == SR_OK)
+		ret = write_entry(outc, "metadata", metabuf, metalen);
+	g_free(metabuf);
+	if (ret != SR_OK)
+		return ret;
+
+	if (enabled_logic_channels > 0) {
+		ret = raw_file_open(outc, &outc->logic, "logic-1");
+		if (ret != SR_OK)
+			return ret;
+	}
+	for (index = 0; index < outc->analog_ch_count; index++) {
+		s = g_strdup_printf("analog-1-%zu", outc->first_analog_index + index);
+		ret = raw_file_open(outc, &outc->analog[index], s);
+		g_free(s);
+		if (ret != SR_OK)
+			return ret;
+	}
+
+	return SR_OK;
+}
+
+static int write_analog(const struct sr_output *o,
+	const struct sr_datafeed_analog *analog)
+{
+	struct out_context *outc;
+	const struct sr_channel *ch;
+	size_t idx, i;
+	float *values;
+	int ret;
+
+	outc = o->priv;
+
+	if (g_slist_length(analog->meaning->channels) != 1) {
+		sr_err("Analog packets covering multiple channels not supported yet");
+		return SR_ERR;
+	}
+	ch = g_slist_nth_data(analog->meaning->channels, 0);
+	for (idx = 0; idx < outc->analog_ch_count; idx++) {
+		if (outc->analog_index_map[idx] == ch->index)
+			break;
+	}
+	if (idx == outc->analog_ch_count)
+		return SR_ERR_ARG;
+
+	values = g_try_malloc(analog->num_samples * sizeof(values[0]));
+	if (!values)
+		return SR_ERR_MALLOC;
+	ret = sr_analog_to_float(analog, values);
+	if (ret == SR_OK) {
+		/* The file format is little endian. */
+		for (i = 0; i < analog->num_samples; i++)
+			write_fltle((uint8_t *)&values[i], values[i]);
+		ret = raw_file_write(&outc->analog[idx], values,
+			analog->num_samples * sizeof(values[0]));
+	}
+	g_free(values);
+
+	return ret;
+}
+
+static int close_files(struct out_context *outc)
+{
+	size_t idx;
+	int ret, rc;
+
+	ret = raw_file_close(&outc->logic);
+	for (idx = 0; outc->analog && idx < outc->analog_ch_count; idx++) {
+		rc = raw_file_close(&outc->analog[idx]);
+		if (ret == SR_OK)
+			ret = rc;
+	}
+
+	return ret;
+}
+
+static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
+		GString **out)
+{
+	struct out_context *outc;
+	const struct sr_datafeed_meta *meta;
+	const struct sr_datafeed_logic *logic;
+	const struct sr_config *src;
+	GSList *l;
+	int ret;
+
+	*out = NULL;
+	if (!o || !o->sdi || !(outc = o->priv))
+		return SR_ERR_ARG;
+
+	if (!outc->created && (packet->type == SR_DF_LOGIC ||
+			packet->type == SR_DF_ANALOG)) {
+		if ((ret = dir_create(o)) != SR_OK)
+			return ret;
+		outc->created = TRUE;
+	}
+
+	switch (packet->type) {
+	case SR_DF_META:
+		meta = packet->payload;
+		for (l = meta->config; l; l = l->next) {
+			src = l->data;
+			if (src->key != SR_CONF_SAMPLERATE)
+				continue;
+			outc->samplerate = g_variant_get_uint64(src->data);
+		}
+		break;
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		if (outc->logic.fd < 0 || logic->unitsize != outc->unit_size) {
+			sr_warn("Unexpected unit size, discarding logic data.");
+			return SR_ERR_ARG;
+		}
+		return raw_file_write(&outc->logic, logic->data, logic->length);
+	case SR_DF_ANALOG:
+		return write_analog(o, packet->payload);
+	case SR_DF_END:
+		return close_files(outc);
+	}
+
+	return SR_OK;
+}
+
+static struct sr_option options[] = {
+	{ "direct", "Direct I/O",
+		"Bypass the page cache when writing sample data", NULL, NULL },
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	if (!options[0].def)
+		options[0].def = g_variant_ref_sink(g_variant_new_boolean(FALSE));
+
+	return options;
+}
+
+static int cleanup(struct sr_output *o)
+{
+	struct out_context *outc;
+
+	outc = o->priv;
+
+	close_files(outc);
+	g_free(outc->analog);
+	g_free(outc->analog_index_map);
+	g_free(outc->dirname);
+	g_free(outc);
+	o->priv = NULL;
+
+	return SR_OK;
+}
+
+SR_PRIV struct sr_output_module output_srraw = {
+	.id = "srraw",
+	.name = "srraw",
+	.desc = "Uncompressed sigrok session directory",
+	.exts = (const char*[]){"srraw", NULL},
+	.flags = SR_OUTPUT_INTERNAL_IO_HANDLING,
+	.options = get_options,
+	.init = init,
+	.receive = receive,
+	.cleanup = cleanup,
+};
@@ -21,6 +21,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <math.h>
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <zip.h>
@@ -29,11 +30,54 @@
 
 #define LOG_PREFIX "output/srzip"
 #define CHUNK_SIZE (4 * 1024 * 1024)
+#define DEFAULT_COMPRESS_LEVEL 9
+#define DEFAULT_CODEC "deflate"
+#define DEVICE_GROUP "device 1"
+
+/*
+ * Optional multi-resolution summaries. Level 0 covers blocks of
+ * SUMMARY_BLOCK samples, every further level combines SUMMARY_FACTOR
+ * records of the level below, up to a single record for the whole
+ * capture. See sr_sessionfile_logic_summary_read() for the layout.
+ */
+#define SUMMARY_BLOCK 4096
+#define SUMMARY_FACTOR 16
+#define ANALOG_SUMMARY_RECSIZE (3 * sizeof(float))
+
+/*
+ * Adaptive compression stores chunks uncompressed when the byte
+ * entropy of a few sampled blocks (in bits per byte) says that
+ * compressing them would hardly gain anything.
+ */
+#define ADAPTIVE_BLOCKS 16
+#define ADAPTIVE_BLOCK_SIZE 4096
+#define ADAPTIVE_MAX_ENTROPY 7.5
 
 struct out_context {
 	gboolean zip_created;
 	uint64_t samplerate;
 	char *filename;
+	int32_t compress_method;
+	unsigned int compress_level;
+	gboolean adaptive;
+	/* Store logic samples XORed with their predecessor ("filter"). */
+	gboolean xor_delta;
+	/*
+	 * The archive is kept open while the capture is running.
+	 * Chunks get spooled to files in a temporary directory, and
+	 * are compressed into the archive when it gets closed.
+	 */
+	struct zip *archive;
+	/*
+	 * The metadata is added when the archive gets closed, since the
+	 * analog sample encodings are only known from the first packets.
+	 */
+	GKeyFile *meta;
+	char *metabuf;
+	char *spool_dir;
+	GSList *spool_files;
+	unsigned int next_logic_chunk;
+	unsigned int *next_analog_chunk;
 	size_t first_analog_index;
 	size_t analog_ch_count;
 	gint *analog_index_map;
@@ -44,45 +88,635 @@ struct out_context {
 		size_t fill_size;
 	} logic_buff;
 	struct analog_buff {
+		/* Bytes per sample, 0 until the channel's first packet. */
+		size_t unit_size;
 		size_t alloc_size;
-		float *samples;
+		uint8_t *samples;
 		size_t fill_size;
+		/*
+		 * Integer samples are stored as they are received, with
+		 * their encoding in the metadata. All else is stored as
+		 * float values.
+		 */
+		gboolean native;
+		struct sr_analog_encoding encoding;
 	} *analog_buff;
+	/* The chunk buffers are from sr_mem_alloc(). */
+	struct sr_context *mem_ctx;
+	gboolean summary;
+	struct logic_summary {
+		GByteArray *records;
+		uint64_t num_samples;
+		uint8_t *cur_or, *cur_and, *prev;
+		uint64_t transitions;
+		size_t fill;
+	} logic_summary;
+	struct analog_summary {
+		GByteArray *records;
+		uint64_t num_samples;
+		float min, max;
+		double sum;
+		size_t fill;
+	} *analog_summary;
 };
 
 static int init(struct sr_output *o, GHashTable *options)
 {
 	struct out_context *outc;
-
-	(void)options;
+	const char *codec, *filter;
+	int32_t method;
+	unsigned int level, max_level;
 
 	if (!o->filename || o->filename[0] == '\0') {
 		sr_info("srzip output module requires a file name, cannot save.");
 		return SR_ERR_ARG;
 	}
 
+	/*
+	 * The codec is the archive entries' compression method, readers
+	 * need no more than a libzip which supports it.
+	 */
+	codec = g_variant_get_string(g_hash_table_lookup(options, "codec"), NULL);
+	if (!strcmp(codec, "deflate")) {
+		method = ZIP_CM_DEFLATE;
+		max_level = 9;
+#ifdef ZIP_CM_ZSTD
+	} else if (!strcmp(codec, "zstd")) {
+		method = ZIP_CM_ZSTD;
+		max_level = 19;
+#endif
+	} else {
+		sr_err("Unsupported codec '%s'.", codec);
+		return SR_ERR_ARG;
+	}
+#if HAVE_ZIP_COMPRESSION_METHOD_SUPPORTED
+	if (!zip_compression_method_supported(method, 1)) {
+		sr_err("This libzip cannot compress with %s.", codec);
+		return SR_ERR_ARG;
+	}
+#endif
+
+	filter = g_variant_get_string(g_hash_table_lookup(options, "filter"), NULL);
+	if (strcmp(filter, "none") && strcmp(filter, "xor")) {
+		sr_err("Unsupported filter '%s'.", filter);
+		return SR_ERR_ARG;
+	}
+
+	level = g_variant_get_uint32(g_hash_table_lookup(options, "level"));
+	if (level > max_level) {
+		sr_err("Invalid compression level %u, must be 0 to %u.",
+			level, max_level);
+		return SR_ERR_ARG;
+	}
+
 	outc = g_malloc0(sizeof(*outc));
 	outc->filename = g_strdup(o->filename);
+	outc->compress_method = method;
+	outc->compress_level = level;
+	outc->adaptive = g_variant_get_boolean(
+		g_hash_table_lookup(options, "adaptive"));
+	outc->xor_delta = !strcmp(filter, "xor");
+	outc->summary = g_variant_get_boolean(
+		g_hash_table_lookup(options, "summary"));
 	o->priv = outc;
 
 	return SR_OK;
 }
 
+/* Estimate whether a chunk would gain anything from compression. */
+static gboolean chunk_incompressible(const uint8_t *data, size_t length)
+{
+	uint32_t counts[256];
+	size_t block, step, pos, i, total;
+	double entropy, p;
+
+	block = MIN(length, ADAPTIVE_BLOCK_SIZE);
+	if (!block)
+		return FALSE;
+	step = MAX(length / ADAPTIVE_BLOCKS, block);
+
+	memset(counts, 0, sizeof(counts));
+	total = 0;
+	for (pos = 0; pos + block <= length; pos += step) {
+		for (i = 0; i < block; i++)
+			counts[data[pos + i]]++;
+		total += block;
+	}
+
+	entropy = 0;
+	for (i = 0; i < G_N_ELEMENTS(counts); i++) {
+		if (!counts[i])
+			continue;
+		p = (double)counts[i] / total;
+		entropy -= p * log2(p);
+	}
+
+	return entropy > ADAPTIVE_MAX_ENTROPY;
+}
+
+/* Select the compression method of an archive entry. */
+static void zip_entry_compression(struct out_context *outc, int64_t index,
+	const void *data, size_t length)
+{
+#if HAVE_ZIP_SET_FILE_COMPRESSION
+	int32_t method;
+
+	method = outc->compress_level ? outc->compress_method : ZIP_CM_STORE;
+	if (method != ZIP_CM_STORE && outc->adaptive &&
+			chunk_incompressible(data, length))
+		method = ZIP_CM_STORE;
+	if (zip_set_file_compression(outc->archive, index,
+			method, outc->compress_level) < 0)
+		sr_warn("Cannot set compression level: %s",
+			zip_strerror(outc->archive));
+#else
+	(void)outc;
+	(void)index;
+	(void)data;
+	(void)length;
+#endif
+}
+
+/* Remove the spooled chunk files and their temporary directory. */
+static void spool_remove(struct out_context *outc)
+{
+	GSList *l;
+
+	for (l = outc->spool_files; l; l = l->next)
+		g_unlink(l->data);
+	g_slist_free_full(outc->spool_files, g_free);
+	outc->spool_files = NULL;
+	if (outc->spool_dir)
+		g_rmdir(outc->spool_dir);
+	g_free(outc->spool_dir);
+	outc->spool_dir = NULL;
+}
+
+/* Create the temporary directory for spooled chunks. */
+static int spool_create(struct out_context *outc)
+{
+	char *dir;
+
+	dir = g_strdup_printf("%s.XXXXXX", outc->filename);
+	if (!g_mkdtemp(dir)) {
+		sr_err("Cannot create spool directory '%s': %s",
+			dir, g_strerror(errno));
+		g_free(dir);
+		return SR_ERR_IO;
+	}
+	outc->spool_dir = dir;
+
+	return SR_OK;
+}
+
+/* Reopen the archive after it was closed, to append more chunks. */
+static int zip_open_spool(struct out_context *outc)
+{
+	int ret;
+
+	outc->archive = zip_open(outc->filename, 0, NULL);
+	if (!outc->archive)
+		return SR_ERR;
+	ret = spool_create(outc);
+	if (ret != SR_OK) {
+		zip_discard(outc->archive);
+		outc->archive = NULL;
+		return ret;
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Add a chunk of sample data to the open srzip archive.
+ *
+ * The data is written to a spool file, libzip picks it up (and
+ * compresses it) when the archive gets closed at the end of the
+ * capture. Each chunk is written once, instead of rewriting the
+ * archive for every chunk.
+ *
+ * @param[in] o Output module instance.
+ * @param[in] name Archive entry name.
+ * @param[in] data Chunk data.
+ * @param[in] length Chunk size in bytes.
+ *
+ * @returns SR_OK et al error codes.
+ */
+static int zip_add_chunk(const struct sr_output *o,
+	const char *name, const void *data, size_t length)
+{
+	struct out_context *outc;
+	struct zip_source *src;
+	char *path;
+	FILE *f;
+	size_t written;
+	int64_t index;
+	int ret;
+
+	outc = o->priv;
+
+	if (!outc->archive) {
+		ret = zip_open_spool(outc);
+		if (ret != SR_OK)
+			return ret;
+	}
+
+	path = g_build_filename(outc->spool_dir, name, NULL);
+	f = g_fopen(path, "wb");
+	if (!f) {
+		sr_err("Cannot create spool file '%s': %s",
+			path, g_strerror(errno));
+		g_free(path);
+		return SR_ERR_IO;
+	}
+	written = fwrite(data, 1, length, f);
+	if (fclose(f) != 0 || written != length) {
+		sr_err("Cannot write spool file '%s'.", path);
+		g_unlink(path);
+		g_free(path);
+		return SR_ERR_IO;
+	}
+	outc->spool_files = g_slist_prepend(outc->spool_files, path);
+
+	src = zip_source_file(outc->archive, path, 0, -1);
+	if (!src) {
+		sr_err("Failed to read spool file '%s': %s",
+			path, zip_strerror(outc->archive));
+		return SR_ERR;
+	}
+	index = zip_add(outc->archive, name, src);
+	if (index < 0) {
+		sr_err("Failed to add chunk '%s': %s",
+			name, zip_strerror(outc->archive));
+		zip_source_free(src);
+		return SR_ERR;
+	}
+	zip_entry_compression(outc, index, data, length);
+
+	return SR_OK;
+}
+
+/* Add an entry to the archive, or replace the one of that name. */
+static int zip_set_entry(struct zip *archive, const char *name,
+	struct zip_source *src)
+{
+	int64_t index;
+
+	index = zip_name_locate(archive, name, 0);
+	if (index >= 0)
+		index = zip_replace(archive, index, src) < 0 ? -1 : index;
+	else
+		index = zip_add(archive, name, src);
+	if (index < 0) {
+		sr_err("Error saving %s into zipfile: %s",
+			name, zip_strerror(archive));
+		zip_source_free(src);
+		return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
+/*
+ * Add the "version" and "metadata" entries. Version 3 files hold
+ * filtered logic data or analog channels with integer samples, which
+ * older readers would take for plain samples and float values.
+ */
+static int zip_add_metadata(struct out_context *outc)
+{
+	struct zip_source *src;
+	const char *version;
+	gsize metalen;
+	size_t idx;
+	int ret;
+
+	version = "2";
+	if (outc->xor_delta && outc->logic_buff.unit_size)
+		version = "3";
+	for (idx = 0; idx < outc->analog_ch_count; idx++) {
+		if (outc->analog_buff[idx].native)
+			version = "3";
+	}
+	src = zip_source_buffer(outc->archive, version, 1, FALSE);
+	ret = zip_set_entry(outc->archive, "version", src);
+	if (ret != SR_OK)
+		return ret;
+
+	/* The metadata buffer must remain valid until the archive is closed. */
+	g_free(outc->metabuf);
+	outc->metabuf = g_key_file_to_data(outc->meta, &metalen, NULL);
+	src = zip_source_buffer(outc->archive, outc->metabuf, metalen, FALSE);
+
+	return zip_set_entry(outc->archive, "metadata", src);
+}
+
+/* Compress all spooled chunks into the archive, and close it. */
+static int zip_finish(struct out_context *outc)
+{
+	int ret;
+
+	if (!outc->archive)
+		return SR_OK;
+
+	ret = zip_add_metadata(outc);
+	if (ret != SR_OK) {
+		zip_discard(outc->archive);
+	} else if (zip_close(outc->archive) < 0) {
+		sr_err("Error saving session file: %s",
+			zip_strerror(outc->archive));
+		zip_discard(outc->archive);
+		ret = SR_ERR;
+	}
+	outc->archive = NULL;
+	g_free(outc->metabuf);
+	outc->metabuf = NULL;
+	spool_remove(outc);
+
+	return ret;
+}
+
+/* Size of one logic summary record: OR, AND, number of transitions. */
+static size_t logic_summary_recsize(size_t unit_size)
+{
+	return 2 * unit_size + sizeof(uint64_t);
+}
+
+static void logic_summary_emit(struct out_context *outc)
+{
+	struct logic_summary *sum;
+	size_t unit_size;
+	uint8_t trans[sizeof(uint64_t)];
+
+	sum = &outc->logic_summary;
+	unit_size = outc->logic_buff.unit_size;
+	WL64(trans, sum->transitions);
+	g_byte_array_append(sum->records, sum->cur_or, unit_size);
+	g_byte_array_append(sum->records, sum->cur_and, unit_size);
+	g_byte_array_append(sum->records, trans, sizeof(trans));
+	sum->transitions = 0;
+	sum->fill = 0;
+}
+
+/* Accumulate logic samples into level 0 summary records. */
+static void logic_summary_feed(struct out_context *outc,
+	const uint8_t *samples, size_t count)
+{
+	struct logic_summary *sum;
+	size_t unit_size, i;
+
+	sum = &outc->logic_summary;
+	unit_size = outc->logic_buff.unit_size;
+	if (!sum->records || !unit_size)
+		return;
+
+	while (count--) {
+		if (sum->num_samples && memcmp(sum->prev, samples, unit_size)) {
+			sum->transitions++;
+			memcpy(sum->prev, samples, unit_size);
+		} else if (!sum->num_samples) {
+			memcpy(sum->prev, samples, unit_size);
+		}
+		if (!sum->fill) {
+			memcpy(sum->cur_or, samples, unit_size);
+			memcpy(sum->cur_and, samples, unit_size);
+		} else {
+			for (i = 0; i < unit_size; i++) {
+				sum->cur_or[i] |= samples[i];
+				sum->cur_and[i] &= samples[i];
+			}
+		}
+		sum->num_samples++;
+		if (++sum->fill == SUMMARY_BLOCK)
+			logic_summary_emit(outc);
+		samples += unit_size;
+	}
+}
+
+static void analog_summary_emit(struct analog_summary *sum)
+{
+	uint8_t rec[ANALOG_SUMMARY_RECSIZE];
+
+	write_fltle(&rec[0], sum->min);
+	write_fltle(&rec[4], sum->max);
+	write_fltle(&rec[8], sum->sum / sum->fill);
+	g_byte_array_append(sum->records, rec, sizeof(rec));
+	sum->sum = 0;
+	sum->fill = 0;
+}
+
+/*
+ * Accumulate analog samples into level 0 summary records. The values
+ * are every stride'th float, for packets covering several channels.
+ */
+static void analog_summary_feed(struct analog_summary *sum,
+	const float *values, size_t stride, size_t count)
+{
+	float value;
+
+	if (!sum->records)
+		return;
+
+	while (count--) {
+		value = *values;
+		values += stride;
+		if (!sum->fill) {
+			sum->min = value;
+			sum->max = value;
+		} else {
+			sum->min = MIN(sum->min, value);
+			sum->max = MAX(sum->max, value);
+		}
+		sum->sum += value;
+		sum->num_samples++;
+		if (++sum->fill == SUMMARY_BLOCK)
+			analog_summary_emit(sum);
+	}
+}
+
+/* Combine SUMMARY_FACTOR logic records of a level into the next. */
+static GByteArray *logic_summary_merge(const GByteArray *src,
+	size_t unit_size)
+{
+	GByteArray *dst;
+	const uint8_t *rec;
+	uint8_t *out;
+	size_t recsize, num_recs, i, j, k;
+	uint64_t transitions;
+
+	recsize = logic_summary_recsize(unit_size);
+	num_recs = src->len / recsize;
+	dst = g_byte_array_sized_new((num_recs / SUMMARY_FACTOR + 1) * recsize);
+	for (i = 0; i < num_recs; i += SUMMARY_FACTOR) {
+		g_byte_array_append(dst, &src->data[i * recsize], recsize);
+		out = &dst->data[dst->len - recsize];
+		transitions = RL64(&out[2 * unit_size]);
+		for (j = i + 1; j < MIN(i + SUMMARY_FACTOR, num_recs); j++) {
+			rec = &src->data[j * recsize];
+			for (k = 0; k < unit_size; k++) {
+				out[k] |= rec[k];
+				out[unit_size + k] &= rec[unit_size + k];
+			}
+			transitions += RL64(&rec[2 * unit_size]);
+		}
+		WL64(&out[2 * unit_size], transitions);
+	}
+
+	return dst;
+}
+
+/*
+ * Combine SUMMARY_FACTOR analog records of a level into the next.
+ * Only the last record of a level can cover fewer samples, which is
+ * considered for the weighted mean.
+ */
+static GByteArray *analog_summary_merge(const GByteArray *src,
+	uint64_t block, uint64_t num_samples)
+{
+	GByteArray *dst;
+	const uint8_t *rec;
+	uint8_t out[ANALOG_SUMMARY_RECSIZE];
+	size_t num_recs, i, j;
+	float min, max;
+	double sum;
+	uint64_t count, total;
+
+	num_recs = src->len / ANALOG_SUMMARY_RECSIZE;
+	dst = g_byte_array_new();
+	for (i = 0; i < num_recs; i += SUMMARY_FACTOR) {
+		min = G_MAXFLOAT;
+		max = -G_MAXFLOAT;
+		sum = 0;
+		total = 0;
+		for (j = i; j < MIN(i + SUMMARY_FACTOR, num_recs); j++) {
+			rec = &src->data[j * ANALOG_SUMMARY_RECSIZE];
+			count = MIN(block, num_samples - j * block);
+			min = MIN(min, read_fltle(&rec[0]));
+			max = MAX(max, read_fltle(&rec[4]));
+			sum += (double)read_fltle(&rec[8]) * count;
+			total += count;
+		}
+		write_fltle(&out[0], min);
+		write_fltle(&out[4], max);
+		write_fltle(&out[8], sum / total);
+		g_byte_array_append(dst, out, sizeof(out));
+	}
+
+	return dst;
+}
+
+/* Add all summary levels of a stream to the archive. */
+static int summary_write_levels(const struct sr_output *o,
+	const char *basename, GByteArray *level0, size_t recsize,
+	size_t unit_size, uint64_t num_samples)
+{
+	GByteArray *records, *next;
+	char *name;
+	unsigned int level;
+	uint64_t block;
+	int ret;
+
+	records = level0;
+	level = 0;
+	block = SUMMARY_BLOCK;
+	ret = SR_OK;
+	while (records->len && ret == SR_OK) {
+		name = g_strdup_printf("%s-%u", basename, level);
+		ret = zip_add_chunk(o, name, records->data, records->len);
+		g_free(name);
+		if (records->len == recsize)
+			break;
+		if (unit_size)
+			next = logic_summary_merge(records, unit_size);
+		else
+			next = analog_summary_merge(records, block, num_samples);
+		if (records != level0)
+			g_byte_array_free(records, TRUE);
+		records = next;
+		block *= SUMMARY_FACTOR;
+		level++;
+	}
+	if (records != level0)
+		g_byte_array_free(records, TRUE);
+
+	return ret;
+}
+
+/* Complete the partial blocks, and add all summaries to the archive. */
+static int summary_write(const struct sr_output *o)
+{
+	struct out_context *outc;
+	struct logic_summary *lsum;
+	struct analog_summary *asum;
+	char *basename;
+	size_t idx;
+	int ret;
+
+	outc = o->priv;
+	if (!outc->summary)
+		return SR_OK;
+
+	lsum = &outc->logic_summary;
+	if (lsum->records) {
+		if (lsum->fill)
+			logic_summary_emit(outc);
+		ret = summary_write_levels(o, "summary-logic-1", lsum->records,
+			logic_summary_recsize(outc->logic_buff.unit_size),
+			outc->logic_buff.unit_size, lsum->num_samples);
+		g_byte_array_set_size(lsum->records, 0);
+		lsum->num_samples = 0;
+		if (ret != SR_OK)
+			return ret;
+	}
+
+	for (idx = 0; idx < outc->analog_ch_count; idx++) {
+		asum = &outc->analog_summary[idx];
+		if (!asum->records)
+			continue;
+		if (asum->fill)
+			analog_summary_emit(asum);
+		basename = g_strdup_printf("summary-analog-1-%zu",
+			outc->first_analog_index + idx);
+		ret = summary_write_levels(o, basename, asum->records,
+			ANALOG_SUMMARY_RECSIZE, 0, asum->num_samples);
+		g_free(basename);
+		g_byte_array_set_size(asum->records, 0);
+		asum->num_samples = 0;
+		if (ret != SR_OK)
+			return ret;
+	}
+
+	return SR_OK;
+}
+
+static void summary_free(struct out_context *outc)
+{
+	size_t idx;
+
+	if (outc->logic_summary.records)
+		g_byte_array_free(outc->logic_summary.records, TRUE);
+	g_free(outc->logic_summary.cur_or);
+	g_free(outc->logic_summary.cur_and);
+	g_free(outc->logic_summary.prev);
+	for (idx = 0; outc->analog_summary && idx < outc->analog_ch_count; idx++) {
+		if (outc->analog_summary[idx].records)
+			g_byte_array_free(outc->analog_summary[idx].records, TRUE);
+	}
+	g_free(outc->analog_summary);
+}
+
 static int zip_create(const struct sr_output *o)
 {
 	struct out_context *outc;
 	struct zip *zipfile;
-	struct zip_source *versrc, *metasrc;
 	struct sr_channel *ch;
 	size_t ch_nr;
-	size_t alloc_size;
+	size_t alloc_size, unit_size;
 	GVariant *gvar;
 	GKeyFile *meta;
 	GSList *l;
 	const char *devgroup;
-	char *s, *metabuf;
-	gsize metalen;
-	guint logic_channels, enabled_logic_channels;
+	char *s;
+	guint logic_channels, enabled_logic_channels, logic_unitsize;
 	guint enabled_analog_channels;
 	guint index;
 
@@ -100,34 +734,29 @@ static int zip_create(const struct sr_output *o)
 	if (!zipfile)
 		return SR_ERR;
 
-	/* "version" */
-	versrc = zip_source_buffer(zipfile, "2", 1, FALSE);
-	if (zip_add(zipfile, "version", versrc) < 0) {
-		sr_err("Error saving version into zipfile: %s",
-			zip_strerror(zipfile));
-		zip_source_free(versrc);
-		zip_discard(zipfile);
-		return SR_ERR;
-	}
-
 	/* init "metadata" */
 	meta = g_key_file_new();
+	outc->meta = meta;
 
 	g_key_file_set_string(meta, "global", "sigrok version",
 			sr_package_version_string_get());
 
-	devgroup = "device 1";
+	devgroup = DEVICE_GROUP;
 
 	logic_channels = 0;
 	enabled_logic_channels = 0;
+	logic_unitsize = 0;
 	enabled_analog_channels = 0;
 	for (l = o->sdi->channels; l; l = l->next) {
 		ch = l->data;
 
 		switch (ch->type) {
 		case SR_CHANNEL_LOGIC:
-			if (ch->enabled)
+			if (ch->enabled) {
 				enabled_logic_channels++;
+				logic_unitsize = MAX(logic_unitsize,
+					(guint)ch->index / 8 + 1);
+			}
 			logic_channels++;
 			break;
 		case SR_CHANNEL_ANALOG:
@@ -149,6 +778,16 @@ static int zip_create(const struct sr_output *o)
 	if (enabled_logic_channels > 0) {
 		g_key_file_set_string(meta, devgroup, "capturefile", "logic-1");
 		g_key_file_set_integer(meta, devgroup, "total probes", logic_channels);
+		g_key_file_set_integer(meta, devgroup, "unitsize",
+			logic_unitsize);
+		if (outc->xor_delta)
+			g_key_file_set_string(meta, devgroup, "filter", "xor");
+	}
+	if (outc->summary) {
+		g_key_file_set_integer(meta, devgroup, "summary block",
+			SUMMARY_BLOCK);
+		g_key_file_set_integer(meta, devgroup, "summary factor",
+			SUMMARY_FACTOR);
 	}
 
 	s = sr_samplerate_string(outc->samplerate);
@@ -204,10 +843,10 @@ static int zip_create(const struct sr_output *o)
 	 * during execution. This simplifies other locations.
 	 */
 	alloc_size = CHUNK_SIZE;
-	outc->logic_buff.unit_size = logic_channels;
-	outc->logic_buff.unit_size += 8 - 1;
-	outc->logic_buff.unit_size /= 8;
-	outc->logic_buff.samples = g_try_malloc0(alloc_size);
+	outc->mem_ctx = o->sdi->session ? o->sdi->session->ctx : NULL;
+	outc->logic_buff.unit_size = logic_unitsize;
+	outc->logic_buff.samples = sr_mem_alloc(outc->mem_ctx, LOG_PREFIX,
+		alloc_size);
 	if (!outc->logic_buff.samples)
 		return SR_ERR_MALLOC;
 	if (outc->logic_buff.unit_size)
@@ -218,42 +857,60 @@ static int zip_create(const struct sr_output *o)
 	alloc_size = sizeof(outc->analog_buff[0]) * outc->analog_ch_count + 1;
 	outc->analog_buff = g_malloc0(alloc_size);
 	for (index = 0; index < outc->analog_ch_count; index++) {
-		alloc_size = CHUNK_SIZE;
-		outc->analog_buff[index].samples = g_try_malloc0(alloc_size);
+		outc->analog_buff[index].samples = sr_mem_alloc(outc->mem_ctx,
+			LOG_PREFIX, CHUNK_SIZE);
 		if (!outc->analog_buff[index].samples)
 			return SR_ERR_MALLOC;
-		alloc_size /= sizeof(outc->analog_buff[0].samples[0]);
-		outc->analog_buff[index].alloc_size = alloc_size;
 		outc->analog_buff[index].fill_size = 0;
 	}
-
-	metabuf = g_key_file_to_data(meta, &metalen, NULL);
-	g_key_file_free(meta);
-
-	metasrc = zip_source_buffer(zipfile, metabuf, metalen, FALSE);
-	if (zip_add(zipfile, "metadata", metasrc) < 0) {
-		sr_err("Error saving metadata into zipfile: %s",
-			zip_strerror(zipfile));
-		zip_source_free(metasrc);
-		zip_discard(zipfile);
-		g_free(metabuf);
-		return SR_ERR;
+	outc->next_logic_chunk = 1;
+	alloc_size = sizeof(outc->next_analog_chunk[0]) * outc->analog_ch_count + 1;
+	outc->next_analog_chunk = g_malloc0(alloc_size);
+	for (index = 0; index < outc->analog_ch_count; index++)
+		outc->next_analog_chunk[index] = 1;
+
+	alloc_size = sizeof(outc->analog_summary[0]) * outc->analog_ch_count + 1;
+	outc->analog_summary = g_malloc0(alloc_size);
+	if (outc->summary) {
+		if (enabled_logic_channels > 0) {
+			unit_size = outc->logic_buff.unit_size;
+			outc->logic_summary.records = g_byte_array_new();
+			outc->logic_summary.cur_or = g_malloc0(unit_size);
+			outc->logic_summary.cur_and = g_malloc0(unit_size);
+			outc->logic_summary.prev = g_malloc0(unit_size);
+		}
+		for (index = 0; index < outc->analog_ch_count; index++)
+			outc->analog_summary[index].records = g_byte_array_new();
 	}
 
-	if (zip_close(zipfile) < 0) {
-		sr_err("Error saving zipfile: %s", zip_strerror(zipfile));
+	if (spool_create(outc) != SR_OK) {
 		zip_discard(zipfile);
-		g_free(metabuf);
-		return SR_ERR;
+		return SR_ERR_IO;
 	}
-	g_free(metabuf);
+	outc->archive = zipfile;
 
 	return SR_OK;
 }
 
+/*
+ * XOR every sample with the one before it, the first one of a chunk
+ * with zero. Runs of unchanged samples become zeros, which compress
+ * far better than interleaved channel bits. Chunks can be decoded
+ * independently, see sr_sessionfile_xor_decode().
+ */
+static void logic_xor_encode(uint8_t *buf, size_t unitsize, size_t length)
+{
+	size_t i;
+
+	for (i = length; i-- > unitsize;)
+		buf[i] ^= buf[i - unitsize];
+}
+
 /**
  * Append a block of logic data to an srzip archive.
  *
+ * The buffer's content gets filtered in place.
+ *
  * @param[in] o Output module instance.
  * @param[in] buf Logic data samples as byte sequence.
  * @param[in] unitsize Logic data unit size (bytes per sample).
@@ -265,121 +922,26 @@ static int zip_append(const struct sr_output *o,
 	uint8_t *buf, size_t unitsize, size_t length)
 {
 	struct out_context *outc;
-	struct zip *archive;
-	struct zip_source *logicsrc;
-	int64_t i, num_files;
-	struct zip_stat zs;
-	struct zip_source *metasrc;
-	GKeyFile *kf;
-	GError *error;
-	uint64_t chunk_num;
-	const char *entry_name;
-	char *metabuf;
-	gsize metalen;
 	char *chunkname;
-	unsigned int next_chunk_num;
+	int ret;
 
 	if (!length)
 		return SR_OK;
 
 	outc = o->priv;
-	if (!(archive = zip_open(outc->filename, 0, NULL)))
-		return SR_ERR;
-
-	if (zip_stat(archive, "metadata", 0, &zs) < 0) {
-		sr_err("Failed to open metadata: %s", zip_strerror(archive));
-		zip_discard(archive);
-		return SR_ERR;
-	}
-	kf = sr_sessionfile_read_metadata(archive, &zs);
-	if (!kf) {
-		zip_discard(archive);
-		return SR_ERR_DATA;
-	}
-	/*
-	 * If the file was only initialized but doesn't yet have any
-	 * data it in, it won't have a unitsize field in metadata yet.
-	 */
-	error = NULL;
-	metabuf = NULL;
-	if (!g_key_file_has_key(kf, "device 1", "unitsize", &error)) {
-		if (error && error->code != G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
-			sr_err("Failed to check unitsize key: %s", error->message);
-			g_error_free(error);
-			g_key_file_free(kf);
-			zip_discard(archive);
-			return SR_ERR;
-		}
-		g_clear_error(&error);
-
-		/* Add unitsize field. */
-		g_key_file_set_integer(kf, "device 1", "unitsize", unitsize);
-		metabuf = g_key_file_to_data(kf, &metalen, NULL);
-		metasrc = zip_source_buffer(archive, metabuf, metalen, FALSE);
-
-		if (zip_replace(archive, zs.index, metasrc) < 0) {
-			sr_err("Failed to replace metadata: %s",
-				zip_strerror(archive));
-			g_key_file_free(kf);
-			zip_source_free(metasrc);
-			zip_discard(archive);
-			g_free(metabuf);
-			return SR_ERR;
-		}
-	}
-	g_key_file_free(kf);
-
-	next_chunk_num = 1;
-	num_files = zip_get_num_entries(archive, 0);
-	for (i = 0; i < num_files; i++) {
-		entry_name = zip_get_name(archive, i, 0);
-		if (!entry_name || strncmp(entry_name, "logic-1", 7) != 0)
-			continue;
-		if (entry_name[7] == '\0') {
-			/*
-			 * This file has no extra chunks, just a single
-			 * "logic-1". Rename it to "logic-1-1" and continue
-			 * with chunk 2.
-			 */
-			if (zip_rename(archive, i, "logic-1-1") < 0) {
-				sr_err("Failed to rename 'logic-1' to 'logic-1-1': %s",
-					zip_strerror(archive));
-				zip_discard(archive);
-				g_free(metabuf);
-				return SR_ERR;
-			}
-			next_chunk_num = 2;
-			break;
-		} else if (entry_name[7] == '-') {
-			chunk_num = g_ascii_strtoull(entry_name + 8, NULL, 10);
-			if (chunk_num < G_MAXINT && chunk_num >= next_chunk_num)
-				next_chunk_num = chunk_num + 1;
-		}
-	}
-
 	if (length % unitsize != 0) {
 		sr_warn("Chunk size %zu not a multiple of the"
 			" unit size %zu.", length, unitsize);
 	}
-	logicsrc = zip_source_buffer(archive, buf, length, FALSE);
-	chunkname = g_strdup_printf("logic-1-%u", next_chunk_num);
-	i = zip_add(archive, chunkname, logicsrc);
+	logic_summary_feed(outc, buf, length / unitsize);
+	if (outc->xor_delta)
+		logic_xor_encode(buf, unitsize, length - length % unitsize);
+	chunkname = g_strdup_printf("logic-1-%u", outc->next_logic_chunk);
+	ret = zip_add_chunk(o, chunkname, buf, length);
 	g_free(chunkname);
-	if (i < 0) {
-		sr_err("Failed to add chunk 'logic-1-%u': %s",
-			next_chunk_num, zip_strerror(archive));
-		zip_source_free(logicsrc);
-		zip_discard(archive);
-		g_free(metabuf);
-		return SR_ERR;
-	}
-	if (zip_close(archive) < 0) {
-		sr_err("Error saving session file: %s", zip_strerror(archive));
-		zip_discard(archive);
-		g_free(metabuf);
-		return SR_ERR;
-	}
-	g_free(metabuf);
+	if (ret != SR_OK)
+		return ret;
+	outc->next_logic_chunk++;
 
 	return SR_OK;
 }
@@ -400,13 +962,13 @@ static int zip_append_queue(const struct sr_output *o,
 {
 	struct out_context *outc;
 	struct logic_buff *buff;
-	size_t send_size, remain, copy_size;
+	size_t send_size, remain, copy_size, i;
 	uint8_t *wrptr, *rdptr;
 	int ret;
 
 	outc = o->priv;
 	buff = &outc->logic_buff;
-	if (length && unitsize != buff->unit_size) {
+	if (length && unitsize < buff->unit_size) {
 		sr_warn("Unexpected unit size, discarding logic data.");
 		return SR_ERR_ARG;
 	}
@@ -414,9 +976,10 @@ static int zip_append_queue(const struct sr_output *o,
 	/*
 	 * Queue most recently received samples to the local buffer.
 	 * Flush to the ZIP archive when the buffer space is exhausted.
+	 * Bytes above the highest enabled channel get dropped.
 	 */
 	rdptr = buf;
-	send_size = buff->unit_size ? length / buff->unit_size : 0;
+	send_size = buff->unit_size && unitsize ? length / unitsize : 0;
 	while (send_size) {
 		remain = buff->alloc_size - buff->fill_size;
 		if (remain) {
@@ -424,8 +987,14 @@ static int zip_append_queue(const struct sr_output *o,
 			copy_size = MIN(send_size, remain);
 			send_size -= copy_size;
 			buff->fill_size += copy_size;
-			memcpy(wrptr, rdptr, copy_size * buff->unit_size);
-			rdptr += copy_size * buff->unit_size;
+			if (unitsize == buff->unit_size)
+				memcpy(wrptr, rdptr, copy_size * unitsize);
+			else
+				for (i = 0; i < copy_size; i++)
+					memcpy(&wrptr[i * buff->unit_size],
+						&rdptr[i * unitsize],
+						buff->unit_size);
+			rdptr += copy_size * unitsize;
 			remain -= copy_size;
 		}
 		if (send_size && !remain) {
@@ -454,81 +1023,150 @@ static int zip_append_queue(const struct sr_output *o,
  * Append analog data of a channel to an srzip archive.
  *
  * @param[in] o Output module instance.
- * @param[in] values Sample data as array of floating point values.
- * @param[in] count Number of samples (float items, not bytes).
+ * @param[in] buff The channel's samples buffer.
  * @param[in] ch_nr 1-based channel number.
  *
  * @returns SR_OK et al error codes.
  */
 static int zip_append_analog(const struct sr_output *o,
-	const float *values, size_t count, size_t ch_nr)
+	const struct analog_buff *buff, size_t ch_nr)
 {
 	struct out_context *outc;
-	struct zip *archive;
-	struct zip_source *analogsrc;
-	int64_t i, num_files;
-	size_t size;
-	struct zip_stat zs;
-	uint64_t chunk_num;
-	const char *entry_name;
-	char *basename;
-	gsize baselen;
+	unsigned int *next_chunk;
 	char *chunkname;
-	unsigned int next_chunk_num;
+	int ret;
 
 	outc = o->priv;
+	next_chunk = &outc->next_analog_chunk[ch_nr - outc->first_analog_index];
 
-	if (!(archive = zip_open(outc->filename, 0, NULL)))
-		return SR_ERR;
+	chunkname = g_strdup_printf("analog-1-%zu-%u", ch_nr, *next_chunk);
+	ret = zip_add_chunk(o, chunkname, buff->samples,
+		buff->fill_size * buff->unit_size);
+	g_free(chunkname);
+	if (ret != SR_OK)
+		return ret;
+	(*next_chunk)++;
 
-	if (zip_stat(archive, "metadata", 0, &zs) < 0) {
-		sr_err("Failed to open metadata: %s", zip_strerror(archive));
-		zip_discard(archive);
-		return SR_ERR;
-	}
+	return SR_OK;
+}
 
-	basename = g_strdup_printf("analog-1-%zu", ch_nr);
-	baselen = strlen(basename);
-	next_chunk_num = 1;
-	num_files = zip_get_num_entries(archive, 0);
-	for (i = 0; i < num_files; i++) {
-		entry_name = zip_get_name(archive, i, 0);
-		if (!entry_name || strncmp(entry_name, basename, baselen) != 0) {
-			continue;
-		} else if (entry_name[baselen] == '-') {
-			chunk_num = g_ascii_strtoull(entry_name + baselen + 1, NULL, 10);
-			if (chunk_num < G_MAXINT && chunk_num >= next_chunk_num)
-				next_chunk_num = chunk_num + 1;
-		}
-	}
+/* Check whether packets of a channel can be stored as they are. */
+static gboolean analog_encoding_equal(const struct sr_analog_encoding *a,
+	const struct sr_analog_encoding *b)
+{
+	return a->unitsize == b->unitsize &&
+		!a->is_signed == !b->is_signed &&
+		!a->is_float == !b->is_float &&
+		!a->is_bigendian == !b->is_bigendian &&
+		a->scale.p == b->scale.p && a->scale.q == b->scale.q &&
+		a->offset.p == b->offset.p && a->offset.q == b->offset.q;
+}
 
-	size = sizeof(values[0]) * count;
-	analogsrc = zip_source_buffer(archive, values, size, FALSE);
-	chunkname = g_strdup_printf("%s-%u", basename, next_chunk_num);
-	i = zip_add(archive, chunkname, analogsrc);
-	if (i < 0) {
-		sr_err("Failed to add chunk '%s': %s", chunkname, zip_strerror(archive));
-		g_free(chunkname);
-		g_free(basename);
-		zip_source_free(analogsrc);
-		zip_discard(archive);
-		return SR_ERR;
+/*
+ * Select how a channel's samples get stored, from its first packet.
+ * Integer samples are kept, and their encoding is recorded in the
+ * "encodingN", "scaleN" and "offsetN" keys (see sr_session_load()).
+ */
+static void analog_buff_setup(struct out_context *outc, size_t idx,
+	const struct sr_analog_encoding *encoding)
+{
+	struct analog_buff *buff;
+	size_t nr;
+	char *key, *s;
+
+	buff = &outc->analog_buff[idx];
+	nr = outc->first_analog_index + idx;
+	buff->native = !encoding->is_float && (encoding->unitsize == 1 ||
+		encoding->unitsize == 2 || encoding->unitsize == 4);
+	if (!buff->native) {
+		buff->unit_size = sizeof(float);
+		buff->alloc_size = CHUNK_SIZE / buff->unit_size;
+		return;
 	}
-	g_free(chunkname);
-	if (zip_close(archive) < 0) {
-		sr_err("Error saving session file: %s", zip_strerror(archive));
-		g_free(basename);
-		zip_discard(archive);
-		return SR_ERR;
+	buff->unit_size = encoding->unitsize;
+	buff->alloc_size = CHUNK_SIZE / buff->unit_size;
+	buff->encoding = *encoding;
+
+	key = g_strdup_printf("encoding%zu", nr);
+	s = g_strdup_printf("%sint%u%s", encoding->is_signed ? "" : "u",
+		encoding->unitsize * 8, encoding->unitsize == 1 ? "" :
+		encoding->is_bigendian ? "be" : "le");
+	g_key_file_set_string(outc->meta, DEVICE_GROUP, key, s);
+	g_free(s);
+	g_free(key);
+	key = g_strdup_printf("scale%zu", nr);
+	s = g_strdup_printf("%" PRId64 "/%" PRIu64,
+		encoding->scale.p, encoding->scale.q);
+	g_key_file_set_string(outc->meta, DEVICE_GROUP, key, s);
+	g_free(s);
+	g_free(key);
+	key = g_strdup_printf("offset%zu", nr);
+	s = g_strdup_printf("%" PRId64 "/%" PRIu64,
+		encoding->offset.p, encoding->offset.q);
+	g_key_file_set_string(outc->meta, DEVICE_GROUP, key, s);
+	g_free(s);
+	g_free(key);
+}
+
+/* Lookup the index of an analog channel, or -1 when it's not stored. */
+static int analog_channel_index(const struct out_context *outc,
+	const struct sr_channel *ch)
+{
+	size_t idx;
+
+	for (idx = 0; idx < outc->analog_ch_count; idx++) {
+		if (outc->analog_index_map[idx] == ch->index)
+			return idx;
 	}
 
-	g_free(basename);
+	return -1;
+}
+
+/*
+ * Queue samples to a channel's buffer, which are stride bytes apart
+ * in the packet. Flush to the ZIP archive when the buffer space is
+ * exhausted.
+ */
+static int analog_buff_queue(const struct sr_output *o,
+	struct analog_buff *buff, size_t nr, const uint8_t *rdptr,
+	size_t stride, size_t send_size)
+{
+	uint8_t *wrptr;
+	size_t remain, copy_size, i;
+	int ret;
+
+	while (send_size) {
+		remain = buff->alloc_size - buff->fill_size;
+		if (remain) {
+			wrptr = &buff->samples[buff->fill_size * buff->unit_size];
+			copy_size = MIN(send_size, remain);
+			send_size -= copy_size;
+			buff->fill_size += copy_size;
+			if (stride == buff->unit_size) {
+				memcpy(wrptr, rdptr, copy_size * buff->unit_size);
+				rdptr += copy_size * buff->unit_size;
+			} else {
+				for (i = 0; i < copy_size; i++) {
+					memcpy(wrptr, rdptr, buff->unit_size);
+					wrptr += buff->unit_size;
+					rdptr += stride;
+				}
+			}
+			remain -= copy_size;
+		}
+		if (send_size && !remain) {
+			ret = zip_append_analog(o, buff, nr);
+			if (ret != SR_OK)
+				return ret;
+			buff->fill_size = 0;
+		}
+	}
 
 	return SR_OK;
 }
 
 /**
- * Queue analog data of a channel for srzip archive writes.
+ * Queue analog data of one or several channels for srzip archive writes.
  *
  * @param[in] o Output module instance.
  * @param[in] analog Sample data (session feed packet format).
@@ -541,23 +1179,27 @@ static int zip_append_analog_queue(const struct sr_output *o,
 {
 	struct out_context *outc;
 	const struct sr_channel *ch;
-	size_t idx, nr;
+	const GSList *l;
+	int idx;
+	size_t i, nr, num_ch, c;
 	struct analog_buff *buff;
-	float *values, *wrptr, *rdptr;
-	size_t send_size, remain, copy_size;
+	struct analog_summary *sum;
+	gboolean need_values;
+	float *values;
+	const uint8_t *rdptr;
+	size_t stride;
 	int ret;
 
 	outc = o->priv;
 
 	/* Is this the DF_END flush call without samples submission? */
 	if (!analog && flush) {
-		for (idx = 0; idx < outc->analog_ch_count; idx++) {
-			nr = outc->first_analog_index + idx;
-			buff = &outc->analog_buff[idx];
+		for (i = 0; i < outc->analog_ch_count; i++) {
+			nr = outc->first_analog_index + i;
+			buff = &outc->analog_buff[i];
 			if (!buff->fill_size)
 				continue;
-			ret = zip_append_analog(o,
-				buff->samples, buff->fill_size, nr);
+			ret = zip_append_analog(o, buff, nr);
 			if (ret != SR_OK)
 				return ret;
 			buff->fill_size = 0;
@@ -565,70 +1207,86 @@ static int zip_append_analog_queue(const struct sr_output *o,
 		return SR_OK;
 	}
 
-	/* Lookup index and number of the analog channel. */
-	/* TODO: support packets covering multiple channels */
-	if (g_slist_length(analog->meaning->channels) != 1) {
-		sr_err("Analog packets covering multiple channels not supported yet");
-		return SR_ERR;
-	}
-	ch = g_slist_nth_data(analog->meaning->channels, 0);
-	for (idx = 0; idx < outc->analog_ch_count; idx++) {
-		if (outc->analog_index_map[idx] == ch->index)
-			break;
-	}
-	if (idx == outc->analog_ch_count)
+	/*
+	 * Lookup the analog channels, and select or check their storage.
+	 * All channels of a packet share its encoding.
+	 */
+	num_ch = g_slist_length(analog->meaning->channels);
+	if (!num_ch)
 		return SR_ERR_ARG;
-	nr = outc->first_analog_index + idx;
-	buff = &outc->analog_buff[idx];
-
-	/* Convert the analog data to an array of float values. */
-	values = g_try_malloc0(analog->num_samples * sizeof(values[0]));
-	if (!values)
-		return SR_ERR_MALLOC;
-	ret = sr_analog_to_float(analog, values);
-	if (ret != SR_OK) {
-		g_free(values);
-		return ret;
+	need_values = FALSE;
+	for (l = analog->meaning->channels; l; l = l->next) {
+		ch = l->data;
+		if ((idx = analog_channel_index(outc, ch)) < 0)
+			return SR_ERR_ARG;
+		buff = &outc->analog_buff[idx];
+		if (!buff->unit_size) {
+			analog_buff_setup(outc, idx, analog->encoding);
+		} else if (buff->native &&
+				!analog_encoding_equal(&buff->encoding, analog->encoding)) {
+			sr_warn("Analog encoding of channel %s changed, discarding data.",
+				ch->name);
+			return SR_ERR_ARG;
+		}
+		if (!buff->native || outc->analog_summary[idx].records)
+			need_values = TRUE;
 	}
 
 	/*
-	 * Queue most recently received samples to the local buffer.
-	 * Flush to the ZIP archive when the buffer space is exhausted.
+	 * Convert the analog data to an array of float values, unless
+	 * it gets stored as it is and no summary needs the values.
 	 */
-	rdptr = values;
-	send_size = analog->num_samples;
-	while (send_size) {
-		remain = buff->alloc_size - buff->fill_size;
-		if (remain) {
-			wrptr = &buff->samples[buff->fill_size];
-			copy_size = MIN(send_size, remain);
-			send_size -= copy_size;
-			buff->fill_size += copy_size;
-			memcpy(wrptr, rdptr, copy_size * sizeof(values[0]));
-			rdptr += copy_size;
-			remain -= copy_size;
+	values = NULL;
+	if (need_values) {
+		values = g_try_malloc0(analog->num_samples * num_ch *
+			sizeof(values[0]));
+		if (!values)
+			return SR_ERR_MALLOC;
+		ret = sr_analog_to_float(analog, values);
+		if (ret != SR_OK) {
+			g_free(values);
+			return ret;
 		}
-		if (send_size && !remain) {
-			ret = zip_append_analog(o,
-				buff->samples, buff->fill_size, nr);
+	}
+
+	/* Queue each channel's samples, they are interleaved in the packet. */
+	for (l = analog->meaning->channels, c = 0; l; l = l->next, c++) {
+		idx = analog_channel_index(outc, l->data);
+		nr = outc->first_analog_index + idx;
+		buff = &outc->analog_buff[idx];
+		sum = &outc->analog_summary[idx];
+
+		if (values)
+			analog_summary_feed(sum, values + c, num_ch,
+				analog->num_samples);
+
+		if (buff->native) {
+			rdptr = (const uint8_t *)analog->data +
+				c * analog->encoding->unitsize;
+			stride = num_ch * analog->encoding->unitsize;
+		} else {
+			rdptr = (const uint8_t *)(values + c);
+			stride = num_ch * sizeof(values[0]);
+		}
+		ret = analog_buff_queue(o, buff, nr, rdptr, stride,
+			analog->num_samples);
+		if (ret != SR_OK) {
+			g_free(values);
+			return ret;
+		}
+
+		/* Flush to the ZIP archive if the caller wants us to. */
+		if (flush && buff->fill_size) {
+			ret = zip_append_analog(o, buff, nr);
 			if (ret != SR_OK) {
 				g_free(values);
 				return ret;
 			}
 			buff->fill_size = 0;
-			remain = buff->alloc_size - buff->fill_size;
 		}
 	}
 	g_free(values);
 
-	/* Flush to the ZIP archive if the caller wants us to. */
-	if (flush && buff->fill_size) {
-		ret = zip_append_analog(o, buff->samples, buff->fill_size, nr);
-		if (ret != SR_OK)
-			return ret;
-		buff->fill_size = 0;
-	}
-
 	return SR_OK;
 }
 
@@ -688,6 +1346,12 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 			ret = zip_append_analog_queue(o, NULL, TRUE);
 			if (ret != SR_OK)
 				return ret;
+			ret = summary_write(o);
+			if (ret != SR_OK)
+				return ret;
+			ret = zip_finish(outc);
+			if (ret != SR_OK)
+				return ret;
 		}
 		break;
 	}
@@ -696,11 +1360,52 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 }
 
 static struct sr_option options[] = {
+	{ "level", "Compression level",
+		"Compression level of sample data (0 = store uncompressed, "
+		"1-9 for deflate, 1-19 for zstd)",
+		NULL, NULL },
+	{ "summary", "Summaries",
+		"Add multi-resolution summaries for zoomed out views",
+		NULL, NULL },
+	{ "codec", "Codec",
+		"Compression method of sample data (zstd needs libzip 1.8)",
+		NULL, NULL },
+	{ "adaptive", "Adaptive compression",
+		"Store chunks uncompressed which would not compress well",
+		NULL, NULL },
+	{ "filter", "Logic data filter",
+		"Preprocess logic data for compression (xor = XOR with previous sample)",
+		NULL, NULL },
 	ALL_ZERO
 };
 
 static const struct sr_option *get_options(void)
 {
+	if (!options[0].def)
+		options[0].def = g_variant_ref_sink(
+			g_variant_new_uint32(DEFAULT_COMPRESS_LEVEL));
+	if (!options[1].def)
+		options[1].def = g_variant_ref_sink(g_variant_new_boolean(FALSE));
+	if (!options[2].def) {
+		options[2].def = g_variant_ref_sink(
+			g_variant_new_string(DEFAULT_CODEC));
+		options[2].values = g_slist_append(options[2].values,
+			g_variant_ref_sink(g_variant_new_string("deflate")));
+#ifdef ZIP_CM_ZSTD
+		options[2].values = g_slist_append(options[2].values,
+			g_variant_ref_sink(g_variant_new_string("zstd")));
+#endif
+	}
+	if (!options[3].def)
+		options[3].def = g_variant_ref_sink(g_variant_new_boolean(FALSE));
+	if (!options[4].def) {
+		options[4].def = g_variant_ref_sink(g_variant_new_string("none"));
+		options[4].values = g_slist_append(options[4].values,
+			g_variant_ref_sink(g_variant_new_string("none")));
+		options[4].values = g_slist_append(options[4].values,
+			g_variant_ref_sink(g_variant_new_string("xor")));
+	}
+
 	return options;
 }
 
@@ -711,11 +1416,17 @@ static int cleanup(struct sr_output *o)
 
 	outc = o->priv;
 
+	/* Save what was received when the capture was not finished. */
+	zip_finish(outc);
+	summary_free(outc);
+	if (outc->meta)
+		g_key_file_free(outc->meta);
+	g_free(outc->next_analog_chunk);
 	g_free(outc->analog_index_map);
 	g_free(outc->filename);
-	g_free(outc->logic_buff.samples);
-	for (idx = 0; idx < outc->analog_ch_count; idx++)
-		g_free(outc->analog_buff[idx].samples);
+	sr_mem_free(outc->mem_ctx, outc->logic_buff.samples);
+	for (idx = 0; outc->analog_buff && idx < outc->analog_ch_count; idx++)
+		sr_mem_free(outc->mem_ctx, outc->analog_buff[idx].samples);
 	g_free(outc->analog_buff);
 
 	g_free(outc);
@@ -73,6 +73,18 @@ struct context {
 	GList *vcd_queue_last;
 	gboolean immediate_write;
 	uint8_t *last_logic;
+	size_t last_logic_size;
+	/*
+	 * Logic-only fast path: map bit positions of the data image to
+	 * channel descriptions, and mask bits which have a channel. The
+	 * timestamp step is non-zero when timestamps are integer
+	 * multiples of the sample number.
+	 */
+	struct sr_output_logic_map *map;
+	struct vcd_channel_desc **bit_desc;
+	const uint64_t *bit_mask;
+	size_t bit_words;
+	uint64_t ts_step;
 };
 
 /*
@@ -186,6 +198,25 @@ static void append_vcd_timestamp(GString *s, double ts, gboolean lf)
 	g_string_append_c(s, lf ? '\n' : ' ');
 }
 
+/*
+ * Same text as append_vcd_timestamp(), for integer timestamps. Avoids
+ * the floating point conversion and formatting in hot paths.
+ */
+static void append_vcd_timestamp_int(GString *s, uint64_t ts)
+{
+	char buf[24], *p;
+
+	p = &buf[sizeof(buf)];
+	*--p = ' ';
+	do {
+		*--p = '0' + ts % 10;
+		ts /= 10;
+	} while (ts);
+	*--p = '#';
+	*--p = '\n';
+	g_string_append_len(s, p, &buf[sizeof(buf)] - p);
+}
+
 static void format_vcd_value_bit(GString *s, uint8_t bit_value, GString *id)
 {
 
@@ -202,6 +233,36 @@ static void format_vcd_value_real(GString *s, double real_value, GString *id)
 	g_string_append(s, id->str);
 }
 
+/*
+ * Prepare the logic-only fast path, which finds changed channels by
+ * XOR-ing whole words of the data image. This requires the channels'
+ * bit positions in ascending order (to keep the order of emitted value
+ * changes), and data image positions within the last_logic buffer.
+ */
+static void init_bit_map(const struct sr_output *o, struct context *ctx)
+{
+	struct vcd_channel_desc *desc;
+	size_t i;
+
+	if (!ctx->immediate_write || !ctx->logic_count || ctx->analog_count)
+		return;
+
+	ctx->map = sr_output_logic_map_new(o->sdi);
+	if (!ctx->map->ascending ||
+			ctx->map->num_bytes > (ctx->logic_count + 7) / 8)
+		return;
+
+	ctx->bit_words = ctx->map->num_words;
+	ctx->bit_mask = ctx->map->word_mask;
+	ctx->bit_desc = g_malloc0(ctx->bit_words * 64 * sizeof(ctx->bit_desc[0]));
+	for (i = 0; i < ctx->enabled_count; i++) {
+		desc = &ctx->channels[i];
+		if (desc->type != SR_CHANNEL_LOGIC)
+			continue;
+		ctx->bit_desc[desc->index] = desc;
+	}
+}
+
 static int init(struct sr_output *o, GHashTable *options)
 {
 	struct context *ctx;
@@ -279,7 +340,7 @@ static int init(struct sr_output *o, GHashTable *options)
 
 	/*
 	 * Keep channel counts at hand, and a flag which allows to tune
-	 * for special cases' speedup in .receive().
+	 * for special cases' speedup in .receive_append().
 	 */
 	ctx->immediate_write = FALSE;
 	if (ctx->analog_count == 0)
@@ -297,6 +358,9 @@ static int init(struct sr_output *o, GHashTable *options)
 	ctx->last_logic = g_malloc0(alloc_size);
 	if (ctx->logic_count && !ctx->last_logic)
 		return SR_ERR_MALLOC;
+	ctx->last_logic_size = alloc_size;
+
+	init_bit_map(o, ctx);
 
 	return SR_OK;
 }
@@ -334,12 +398,11 @@ static uint64_t get_timescale_freq(uint64_t samplerate)
 }
 
 /* Emit a VCD file header. */
-static GString *gen_header(const struct sr_output *o)
+static void gen_header(const struct sr_output *o, GString *header)
 {
 	struct context *ctx;
 	struct sr_channel *ch;
 	GVariant *gvar;
-	GString *header;
 	GSList *l;
 	time_t t;
 	size_t num_channels, i;
@@ -361,6 +424,9 @@ static GString *gen_header(const struct sr_output *o)
 		}
 	}
 	ctx->period = get_timescale_freq(ctx->samplerate);
+	ctx->ts_step = 0;
+	if (ctx->samplerate && ctx->period % ctx->samplerate == 0)
+		ctx->ts_step = ctx->period / ctx->samplerate;
 	t = time(NULL);
 	timestamp = g_strdup(ctime(&t));
 	timestamp[strlen(timestamp) - 1] = '\0';
@@ -370,8 +436,7 @@ static GString *gen_header(const struct sr_output *o)
 	frequency_s = sr_period_string(1, ctx->period);
 
 	/* Construct the VCD output file header. */
-	header = g_string_sized_new(512);
-	g_string_printf(header, "$date %s $end\n", timestamp);
+	g_string_append_printf(header, "$date %s $end\n", timestamp);
 	g_string_append_printf(header, "$version %s %s $end\n",
 		PACKAGE_NAME, sr_package_version_string_get());
 	g_string_append_printf(header, "$comment\n");
@@ -410,31 +475,24 @@ static GString *gen_header(const struct sr_output *o)
 	g_free(timestamp);
 	g_free(samplerate_s);
 	g_free(frequency_s);
-
-	return header;
 }
 
 /*
- * Gets called when a session feed packet was received. Either creates
- * a VCD file header (once in the output module's lifetime), or an empty
- * GString. Callers will append the text representation of sample data
- * to that string as needed.
+ * Gets called when a session feed packet was received. Appends the
+ * VCD file header (once in the output module's lifetime) to the output.
+ * Callers will append the text representation of sample data after it
+ * as needed.
  */
-static GString *chk_header(const struct sr_output *o)
+static void chk_header(const struct sr_output *o, GString *out)
 {
 	struct context *ctx;
-	GString *s;
 
 	ctx = o->priv;
 
 	if (!ctx->header_done) {
 		ctx->header_done = TRUE;
-		s = gen_header(o);
-	} else {
-		s = g_string_sized_new(512);
+		gen_header(o, out);
 	}
-
-	return s;
 }
 
 /*
@@ -979,29 +1037,187 @@ static int write_completed_changes(struct context *ctx, GString *out)
 	return SR_OK;
 }
 
+/* Read up to 8 bytes of the data image as a little endian word. */
+static uint64_t load_word(const uint8_t *p, size_t len)
+{
+	uint64_t word;
+
+	if (len >= sizeof(word))
+		return RL64(p);
+
+	word = 0;
+	while (len--)
+		word = (word << 8) | p[len];
+
+	return word;
+}
+
+/*
+ * Logic-only variant of logic_sample_process(), for all samples but
+ * the very first one. XOR whole words of the previous and the current
+ * sample, and only visit the bits of channels which did change. Bits
+ * without a channel are ignored.
+ */
+static void logic_sample_process_fast(struct context *ctx, GString *out,
+	const uint8_t *sample, size_t unit_size, uint64_t snum_curr)
+{
+	struct vcd_channel_desc *desc;
+	uint8_t *last_logic;
+	uint64_t prev, curr, diff;
+	size_t w, pos, len;
+	guint32 half;
+	gint bit;
+	gboolean have_ts;
+
+	last_logic = ctx->last_logic;
+	have_ts = FALSE;
+	for (w = 0; w < ctx->bit_words; w++) {
+		pos = w * sizeof(uint64_t);
+		len = MIN(unit_size - pos, sizeof(uint64_t));
+		prev = load_word(&last_logic[pos], len);
+		curr = load_word(&sample[pos], len);
+		diff = (prev ^ curr) & ctx->bit_mask[w];
+		if (!diff)
+			continue;
+		if (!have_ts) {
+			have_ts = TRUE;
+			if (ctx->ts_step)
+				append_vcd_timestamp_int(out,
+					snum_curr * ctx->ts_step);
+			else
+				append_vcd_timestamp(out,
+					snum_to_ts(ctx, snum_curr), FALSE);
+		}
+		/* Visit changed bits, in 32bit halves for g_bit_nth_lsf(). */
+		for (half = 0; half < 2; half++) {
+			bit = -1;
+			while ((bit = g_bit_nth_lsf((guint32)(diff >> (32 * half)),
+					bit)) >= 0) {
+				desc = ctx->bit_desc[w * 64 + half * 32 + bit];
+				desc->last.logic = (curr >> (half * 32 + bit)) & 1;
+				g_string_append_c(out, ' ');
+				g_string_append_c(out, desc->last.logic ? '1' : '0');
+				g_string_append_len(out, desc->name->str,
+					desc->name->len);
+			}
+		}
+	}
+	if (have_ts)
+		memcpy(last_logic, sample, unit_size);
+}
+
+/*
+ * Process one set of logic samples at the given sample number. Emits
+ * or queues the text for all channels which changed their value.
+ */
+static void logic_sample_process(struct context *ctx, GString *out,
+	const uint8_t *sample, size_t unit_size, uint64_t snum_curr)
+{
+	struct vcd_channel_desc *desc;
+	size_t index, p;
+	gboolean changed;
+	GString *s_val;
+	uint8_t *last_logic, prevbit, curbit;
+	double ts;
+
+	if (ctx->bit_desc && snum_curr != 0 &&
+			unit_size >= (ctx->logic_count + 7) / 8) {
+		logic_sample_process_fast(ctx, out, sample, unit_size, snum_curr);
+		return;
+	}
+
+	/* Check whether any logic value has changed. */
+	last_logic = ctx->last_logic;
+	changed = memcmp(last_logic, sample, unit_size) != 0;
+	changed |= snum_curr == 0;
+	if (!changed)
+		return;
+	memcpy(last_logic, sample, unit_size);
+
+	/*
+	 * Start or continue tracking that sample number.
+	 * Avoid string copies for logic-only setups.
+	 */
+	if (ctx->immediate_write) {
+		ts = snum_to_ts(ctx, snum_curr);
+		append_vcd_timestamp(out, ts, FALSE);
+	} else {
+		queue_samplenum(ctx, snum_curr);
+	}
+
+	/* Iterate over individual logic channels. */
+	for (p = 0; p < ctx->enabled_count; p++) {
+		/*
+		 * TODO Check whether the mapping from
+		 * data image positions to channel numbers
+		 * is required. Experiments suggest that
+		 * the data image "is dense", and packs
+		 * bits of enabled channels, and leaves no
+		 * room for positions of disabled channels.
+		 */
+		desc = &ctx->channels[p];
+		if (desc->type != SR_CHANNEL_LOGIC)
+			continue;
+		index = desc->index;
+		prevbit = desc->last.logic;
+
+		/* Skip over unchanged values. */
+		curbit = sample[index / 8];
+		curbit = (curbit & (1 << (index % 8))) ? 1 : 0;
+		if (snum_curr != 0 && prevbit == curbit)
+			continue;
+		desc->last.logic = curbit;
+
+		/*
+		 * Queue, or immediately emit the text for
+		 * the observed value change.
+		 */
+		if (ctx->immediate_write) {
+			g_string_append_c(out, ' ');
+			s_val = out;
+		} else {
+			s_val = queue_value_text_prep(ctx);
+			if (!s_val)
+				break;
+		}
+		format_vcd_value_bit(s_val, curbit, desc->name);
+	}
+}
+
+/* Have the copy of the last logic data cover the packet's unit size. */
+static void last_logic_resize(struct context *ctx, size_t unit_size)
+{
+	if (unit_size <= ctx->last_logic_size)
+		return;
+	ctx->last_logic = g_realloc(ctx->last_logic, unit_size);
+	memset(&ctx->last_logic[ctx->last_logic_size], 0,
+		unit_size - ctx->last_logic_size);
+	ctx->last_logic_size = unit_size;
+}
+
 /* Get packets from the session feed, generate output text. */
-static int receive(const struct sr_output *o,
-	const struct sr_datafeed_packet *packet, GString **out)
+static int receive_append(const struct sr_output *o,
+	const struct sr_datafeed_packet *packet, GString *out)
 {
 	struct context *ctx;
 	const struct sr_datafeed_meta *meta;
 	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_logic_rle *logic_rle;
 	const struct sr_datafeed_analog *analog;
 	const struct sr_config *src;
 	GSList *l;
 	struct vcd_channel_desc *desc;
-	uint64_t snum_curr;
-	size_t count, index, p, unit_size;
+	uint64_t snum_curr, run, total;
+	size_t count, index, unit_size;
 	gboolean changed;
 	GString *s_val;
-	uint8_t *sample, *last_logic, prevbit, curbit;
+	uint8_t *sample;
 	GSList *channels;
 	struct sr_channel *channel;
 	int rc;
 	float *floats, value;
 	double ts;
 
-	*out = NULL;
 	if (!o || !o->priv)
 		return SR_ERR_BUG;
 	ctx = o->priv;
@@ -1017,82 +1233,50 @@ static int receive(const struct sr_output *o,
 		}
 		break;
 	case SR_DF_LOGIC:
-		*out = chk_header(o);
+		chk_header(o, out);
 
 		logic = packet->payload;
 		sample = logic->data;
 		unit_size = logic->unitsize;
 		count = logic->length / unit_size;
+		last_logic_resize(ctx, unit_size);
 		snum_curr = get_last_snum_logic(ctx);
 		upd_last_snum_logic(ctx, count);
 
-		last_logic = ctx->last_logic;
 		while (count--) {
-			/* Check whether any logic value has changed. */
-			changed = memcmp(last_logic, sample, unit_size) != 0;
-			changed |= snum_curr == 0;
-			if (changed)
-				memcpy(last_logic, sample, unit_size);
-
-			/*
-			 * Start or continue tracking that sample number.
-			 * Avoid string copies for logic-only setups.
-			 */
-			if (changed) {
-				if (ctx->immediate_write) {
-					ts = snum_to_ts(ctx, snum_curr);
-					append_vcd_timestamp(*out, ts, FALSE);
-				} else {
-					queue_samplenum(ctx, snum_curr);
-				}
-			}
+			logic_sample_process(ctx, out, sample, unit_size,
+				snum_curr);
+			snum_curr++;
+			sample += unit_size;
+		}
+		write_completed_changes(ctx, out);
+		break;
+	case SR_DF_LOGIC_RLE:
+		chk_header(o, out);
+
+		/* Only the first sample of each run can carry changes. */
+		logic_rle = packet->payload;
+		sample = logic_rle->values;
+		unit_size = logic_rle->unitsize;
+		last_logic_resize(ctx, unit_size);
+		total = 0;
+		for (run = 0; run < logic_rle->num_runs; run++)
+			total += logic_rle->counts[run];
+		snum_curr = get_last_snum_logic(ctx);
+		upd_last_snum_logic(ctx, total);
 
-			/* Iterate over individual logic channels. */
-			for (p = 0; changed && p < ctx->enabled_count; p++) {
-				/*
-				 * TODO Check whether the mapping from
-				 * data image positions to channel numbers
-				 * is required. Experiments suggest that
-				 * the data image "is dense", and packs
-				 * bits of enabled channels, and leaves no
-				 * room for positions of disabled channels.
-				 */
-				desc = &ctx->channels[p];
-				if (desc->type != SR_CHANNEL_LOGIC)
-					continue;
-				index = desc->index;
-				prevbit = desc->last.logic;
-
-				/* Skip over unchanged values. */
-				curbit = sample[index / 8];
-				curbit = (curbit & (1 << (index % 8))) ? 1 : 0;
-				if (snum_curr != 0 && prevbit == curbit)
-					continue;
-				desc->last.logic = curbit;
-
-				/*
-				 * Queue, or immediately emit the text for
-				 * the observed value change.
-				 */
-				if (ctx->immediate_write) {
-					g_string_append_c(*out, ' ');
-					s_val = *out;
-				} else {
-					s_val = queue_value_text_prep(ctx);
-					if (!s_val)
-						break;
-				}
-				format_vcd_value_bit(s_val, curbit, desc->name);
+		for (run = 0; run < logic_rle->num_runs; run++) {
+			if (logic_rle->counts[run]) {
+				logic_sample_process(ctx, out, sample,
+					unit_size, snum_curr);
+				snum_curr += logic_rle->counts[run];
 			}
-
-			/* Advance to next set of logic samples. */
-			snum_curr++;
 			sample += unit_size;
 		}
-		write_completed_changes(ctx, *out);
+		write_completed_changes(ctx, out);
 		break;
 	case SR_DF_ANALOG:
-		*out = chk_header(o);
+		chk_header(o, out);
 
 		/*
 		 * This implementation expects one analog packet per
@@ -1150,8 +1334,8 @@ static int receive(const struct sr_output *o,
 			/* Queue, or emit the timestamp and the new value. */
 			if (ctx->immediate_write) {
 				ts = snum_to_ts(ctx, snum_curr + index);
-				append_vcd_timestamp(*out, ts, FALSE);
-				s_val = *out;
+				append_vcd_timestamp(out, ts, FALSE);
+				s_val = out;
 			} else {
 				queue_samplenum(ctx, snum_curr + index);
 				s_val = queue_value_text_prep(ctx);
@@ -1160,15 +1344,15 @@ static int receive(const struct sr_output *o,
 		}
 
 		g_free(floats);
-		write_completed_changes(ctx, *out);
+		write_completed_changes(ctx, out);
 		break;
 	case SR_DF_END:
-		*out = chk_header(o);
+		chk_header(o, out);
 		/* Push the final timestamp as length indicator. */
 		snum_curr = get_max_snum_flush(ctx);
 		queue_samplenum(ctx, snum_curr);
 		/* Flush previously queued value changes. */
-		write_completed_changes(ctx, *out);
+		write_completed_changes(ctx, out);
 		break;
 	}
 
@@ -1198,6 +1382,9 @@ static int cleanup(struct sr_output *o)
 		g_string_free(desc->name, TRUE);
 	}
 	g_free(ctx->channels);
+	g_free(ctx->last_logic);
+	g_free(ctx->bit_desc);
+	sr_output_logic_map_free(ctx->map);
 	g_free(ctx);
 
 	return SR_OK;
@@ -1208,9 +1395,9 @@ struct sr_output_module output_vcd = {
 	.name = "VCD",
 	.desc = "Value Change Dump data",
 	.exts = (const char*[]){"vcd", NULL},
-	.flags = 0,
+	.flags = SR_OUTPUT_LOGIC_RLE,
 	.options = NULL,
 	.init = init,
-	.receive = receive,
+	.receive_append = receive_append,
 	.cleanup = cleanup,
 };
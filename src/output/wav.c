@@ -27,77 +27,249 @@
 /* Minimum/maximum number of samples per channel to put in a data chunk */
 #define MIN_DATA_CHUNK_SAMPLES 10
 
+/* Sample formats of the data chunk, see the "format" option. */
+enum {
+	FORMAT_FLOAT,
+	FORMAT_PCM16,
+	FORMAT_PCM24,
+};
+
 struct out_context {
 	double scale;
+	int format;
+	/* Bytes per sample of one channel in the data chunk. */
+	int sample_size;
 	gboolean header_done;
 	uint64_t samplerate;
 	int num_channels;
 	GSList *channels;
+	/* Per channel buffers of scaled values, grown as needed. */
 	int chanbuf_size;
 	int *chanbuf_used;
-	uint8_t **chanbuf;
+	float **chanbuf;
+	int *chan_idx;
 	float *fdata;
+	size_t fdata_size;
 };
 
 static int realloc_chanbufs(const struct sr_output *o, int size)
 {
 	struct out_context *outc;
+	float *buf;
 	int i;
 
 	outc = o->priv;
 	for (i = 0; i < outc->num_channels; i++) {
-		if (!(outc->chanbuf[i] = g_try_realloc(outc->chanbuf[i], sizeof(float) * size))) {
+		buf = g_try_realloc(outc->chanbuf[i], sizeof(float) * size);
+		if (!buf) {
 			sr_err("Unable to allocate enough output buffer memory.");
-			return SR_ERR;
+			return SR_ERR_MALLOC;
 		}
-		outc->chanbuf_used[i] = 0;
+		outc->chanbuf[i] = buf;
 	}
 	outc->chanbuf_size = size;
 
 	return SR_OK;
 }
 
+/* Convert to integer PCM, values outside -1..1 (and NaN) get clipped. */
+static inline int32_t float_to_pcm(float value, float max)
+{
+	value *= max;
+	if (value >= max)
+		return max;
+	if (!(value > -max))
+		return -max;
+
+	return value < 0 ? value - 0.5f : value + 0.5f;
+}
+
+#ifdef __SSE2__
+/*
+ * float_to_pcm() for 16 bit PCM, 8 values at a time. SSE2 hosts are
+ * little endian, the values get stored as they are. Returns the number
+ * of converted values.
+ */
+static size_t floats_to_pcm16(uint8_t *bufp, const float *data,
+		size_t num_values, float scale)
+{
+	const __m128 vscale = _mm_set1_ps(scale);
+	const __m128 vmax = _mm_set1_ps(32767);
+	const __m128 vmin = _mm_set1_ps(-32767);
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	__m128 v[2];
+	__m128i pcm[2];
+	size_t i;
+	int k;
+
+	for (i = 0; i + 8 <= num_values; i += 8) {
+		for (k = 0; k < 2; k++) {
+			v[k] = _mm_mul_ps(_mm_mul_ps(
+				_mm_loadu_ps(&data[i + 4 * k]), vscale), vmax);
+			/* Clip, _mm_max_ps() takes the limit for NaN. */
+			v[k] = _mm_min_ps(_mm_max_ps(v[k], vmin), vmax);
+			/* Round half away from zero, then truncate. */
+			v[k] = _mm_add_ps(v[k],
+				_mm_or_ps(_mm_and_ps(v[k], sign), half));
+			pcm[k] = _mm_cvttps_epi32(v[k]);
+		}
+		_mm_storeu_si128((__m128i *)&bufp[i * 2],
+			_mm_packs_epi32(pcm[0], pcm[1]));
+	}
+
+	return i;
+}
+#endif
+
+/*
+ * Interleave the channel buffers right into the output, converting
+ * to the data chunk's sample format on the way. There is one loop per
+ * format, which walks each channel's buffer in order, so there are no
+ * per-sample decisions left to keep compilers from vectorizing.
+ */
 static int flush_chanbufs(const struct sr_output *o, GString *out)
 {
 	struct out_context *outc;
-	int num_samples, i, j;
-	char *buf, *bufp;
+	int num_samples, num_channels, i, j;
+	size_t len;
+	uint8_t *bufp;
+	int32_t v;
 
 	outc = o->priv;
 
 	/* Any one of them will do. */
 	num_samples = outc->chanbuf_used[0];
-	if (!(buf = g_try_malloc(4 * num_samples * outc->num_channels))) {
-		sr_err("Unable to allocate enough interleaved output buffer memory.");
-		return SR_ERR;
-	}
-
-	bufp = buf;
-	for (i = 0; i < num_samples; i++) {
-		for (j = 0; j < outc->num_channels; j++) {
-			memcpy(bufp, outc->chanbuf[j] + i * 4, 4);
-			bufp += 4;
+	num_channels = outc->num_channels;
+	len = out->len;
+	g_string_set_size(out, len +
+		(size_t)num_samples * num_channels * outc->sample_size);
+	bufp = (uint8_t *)&out->str[len];
+
+	switch (outc->format) {
+	case FORMAT_PCM16:
+		for (j = 0; j < num_channels; j++)
+			for (i = 0; i < num_samples; i++)
+				write_u16le(bufp + (i * num_channels + j) * 2,
+					float_to_pcm(outc->chanbuf[j][i], 32767));
+		break;
+	case FORMAT_PCM24:
+		for (j = 0; j < num_channels; j++) {
+			for (i = 0; i < num_samples; i++) {
+				v = float_to_pcm(outc->chanbuf[j][i], 8388607);
+				write_u16le(bufp + (i * num_channels + j) * 3, v);
+				bufp[(i * num_channels + j) * 3 + 2] = v >> 16;
+			}
 		}
+		break;
+	default:
+		for (j = 0; j < num_channels; j++)
+			for (i = 0; i < num_samples; i++)
+				write_fltle(bufp + (i * num_channels + j) * 4,
+					outc->chanbuf[j][i]);
+		break;
 	}
-	g_string_append_len(out, buf, 4 * num_samples * outc->num_channels);
-	g_free(buf);
 
-	for (i = 0; i < outc->num_channels; i++)
+	for (i = 0; i < num_channels; i++)
 		outc->chanbuf_used[i] = 0;
 
 	return SR_OK;
 }
 
+/*
+ * Check whether a packet carries all channels in the data chunk's order,
+ * and nothing of the channels is buffered. Its values then can go out
+ * as they are, without the detour through the channel buffers.
+ */
+static gboolean takes_interleaved(const struct sr_output *o,
+		const GSList *channels)
+{
+	struct out_context *outc;
+	const GSList *l, *m;
+	int i;
+
+	outc = o->priv;
+	for (i = 0; i < outc->num_channels; i++) {
+		if (outc->chanbuf_used[i])
+			return FALSE;
+	}
+	for (l = channels, m = outc->channels; l && m; l = l->next, m = m->next) {
+		if (l->data != m->data)
+			return FALSE;
+	}
+
+	return !l && !m;
+}
+
+/* Convert interleaved values of all channels right into the output. */
+static void write_interleaved(const struct sr_output *o, const float *data,
+		size_t num_values, GString *out)
+{
+	struct out_context *outc;
+	float scale;
+	size_t len, i;
+	uint8_t *bufp;
+	int32_t v;
+
+	outc = o->priv;
+
+	scale = 1.0 / outc->scale;
+	len = out->len;
+	g_string_set_size(out, len + num_values * outc->sample_size);
+	bufp = (uint8_t *)&out->str[len];
+
+	switch (outc->format) {
+	case FORMAT_PCM16:
+		i = 0;
+#ifdef __SSE2__
+		i = floats_to_pcm16(bufp, data, num_values, scale);
+#endif
+		for (; i < num_values; i++)
+			write_u16le(bufp + i * 2,
+				float_to_pcm(data[i] * scale, 32767));
+		break;
+	case FORMAT_PCM24:
+		for (i = 0; i < num_values; i++) {
+			v = float_to_pcm(data[i] * scale, 8388607);
+			write_u16le(bufp + i * 3, v);
+			bufp[i * 3 + 2] = v >> 16;
+		}
+		break;
+	default:
+		for (i = 0; i < num_values; i++)
+			write_fltle(bufp + i * 4, data[i] * scale);
+		break;
+	}
+}
+
 static int init(struct sr_output *o, GHashTable *options)
 {
 	struct out_context *outc;
 	struct sr_channel *ch;
+	const char *format;
 	GSList *l;
 
 	outc = g_malloc0(sizeof(struct out_context));
 	o->priv = outc;
 	outc->scale = g_variant_get_double(g_hash_table_lookup(options, "scale"));
 
+	format = g_variant_get_string(g_hash_table_lookup(options, "format"), NULL);
+	if (!strcmp(format, "float")) {
+		outc->format = FORMAT_FLOAT;
+		outc->sample_size = 4;
+	} else if (!strcmp(format, "pcm16")) {
+		outc->format = FORMAT_PCM16;
+		outc->sample_size = 2;
+	} else if (!strcmp(format, "pcm24")) {
+		outc->format = FORMAT_PCM24;
+		outc->sample_size = 3;
+	} else {
+		sr_err("Unsupported sample format '%s'.", format);
+		g_free(outc);
+		o->priv = NULL;
+		return SR_ERR_ARG;
+	}
+
 	for (l = o->sdi->channels; l; l = l->next) {
 		ch = l->data;
 		if (ch->type != SR_CHANNEL_ANALOG)
@@ -110,6 +282,7 @@ static int init(struct sr_output *o, GHashTable *options)
 
 	outc->chanbuf = g_malloc0(sizeof(float *) * outc->num_channels);
 	outc->chanbuf_used = g_malloc0(sizeof(int) * outc->num_channels);
+	outc->chan_idx = g_malloc0(sizeof(int) * outc->num_channels);
 
 	/* Start off the interleaved buffer with 100 samples/channel. */
 	realloc_chanbufs(o, 100);
@@ -127,8 +300,8 @@ static void add_data_chunk(const struct sr_output *o, GString *gs)
 	/* Remaining chunk size */
 	WL32(tmp, 0x12);
 	g_string_append_len(gs, tmp, 4);
-	/* Format code 3 = IEEE float */
-	WL16(tmp, 0x0003);
+	/* Format code 3 = IEEE float, 1 = PCM */
+	WL16(tmp, outc->format == FORMAT_FLOAT ? 0x0003 : 0x0001);
 	g_string_append_len(gs, tmp, 2);
 	/* Number of channels */
 	WL16(tmp, outc->num_channels);
@@ -136,14 +309,14 @@ static void add_data_chunk(const struct sr_output *o, GString *gs)
 	/* Samplerate */
 	WL32(tmp, outc->samplerate);
 	g_string_append_len(gs, tmp, 4);
-	/* Byterate, using 32-bit floats. */
-	WL32(tmp, outc->samplerate * outc->num_channels * 4);
+	/* Byterate */
+	WL32(tmp, outc->samplerate * outc->num_channels * outc->sample_size);
 	g_string_append_len(gs, tmp, 4);
 	/* Blockalign */
-	WL16(tmp, outc->num_channels * 4);
+	WL16(tmp, outc->num_channels * outc->sample_size);
 	g_string_append_len(gs, tmp, 2);
 	/* Bits per sample */
-	WL16(tmp, 32);
+	WL16(tmp, outc->sample_size * 8);
 	g_string_append_len(gs, tmp, 2);
 	WL16(tmp, 0);
 	g_string_append_len(gs, tmp, 2);
@@ -154,11 +327,10 @@ static void add_data_chunk(const struct sr_output *o, GString *gs)
 	g_string_append_len(gs, tmp, 4);
 }
 
-static GString *gen_header(const struct sr_output *o)
+static void gen_header(const struct sr_output *o, GString *header)
 {
 	struct out_context *outc;
 	GVariant *gvar;
-	GString *header;
 	char tmp[4];
 
 	outc = o->priv;
@@ -170,36 +342,12 @@ static GString *gen_header(const struct sr_output *o)
 		}
 	}
 
-	header = g_string_sized_new(512);
 	g_string_append(header, "RIFF");
 	/* Total size. Max out the field. */
 	WL32(tmp, 0xffffffff);
 	g_string_append_len(header, tmp, 4);
 	g_string_append(header, "WAVE");
 	add_data_chunk(o, header);
-
-	return header;
-}
-
-/*
- * Stores the float in little-endian BINARY32 IEEE-754 2008 format.
- */
-static void float_to_le(uint8_t *buf, float value)
-{
-	uint8_t *old;
-
-	old = (uint8_t *)&value;
-#ifdef WORDS_BIGENDIAN
-	buf[0] = old[3];
-	buf[1] = old[2];
-	buf[2] = old[1];
-	buf[3] = old[0];
-#else
-	buf[0] = old[0];
-	buf[1] = old[1];
-	buf[2] = old[2];
-	buf[3] = old[3];
-#endif
 }
 
 /*
@@ -233,8 +381,8 @@ static int check_chanbuf_size(const struct sr_output *o)
 	return size;
 }
 
-static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
-		GString **out)
+static int receive_append(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString *out)
 {
 	struct out_context *outc;
 	const struct sr_datafeed_meta *meta;
@@ -243,12 +391,10 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 	struct sr_channel *ch;
 	GSList *l;
 	const GSList *channels;
-	float f;
-	int num_channels, num_samples, size, *chan_idx, idx, i, j, ret;
-	float *data;
-	uint8_t *buf;
+	float scale;
+	int num_channels, num_samples, size, needed, idx, i, j, ret;
+	float *data, *buf;
 
-	*out = NULL;
 	if (!o || !o->sdi || !(outc = o->priv))
 		return SR_ERR_ARG;
 
@@ -264,23 +410,14 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		break;
 	case SR_DF_ANALOG:
 		if (!outc->header_done) {
-			*out = gen_header(o);
+			gen_header(o, out);
 			outc->header_done = TRUE;
-		} else {
-			*out = g_string_sized_new(512);
 		}
 
 		analog = packet->payload;
 		num_samples = analog->num_samples;
 		channels = analog->meaning->channels;
 		num_channels = g_slist_length(analog->meaning->channels);
-		if (!(data = g_try_realloc(outc->fdata, sizeof(float) * num_samples * num_channels)))
-			return SR_ERR_MALLOC;
-		outc->fdata = data;
-		ret = sr_analog_to_float(analog, data);
-		if (ret != SR_OK)
-			return ret;
-
 		if (num_samples == 0)
 			return SR_OK;
 
@@ -290,40 +427,63 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 			return SR_ERR;
 		}
 
-		if (num_samples > outc->chanbuf_size) {
-			if (realloc_chanbufs(o, analog->num_samples) != SR_OK)
+		/* The buffers are kept, and only ever grow. */
+		if ((size_t)num_samples * num_channels > outc->fdata_size) {
+			data = g_try_realloc(outc->fdata,
+				sizeof(float) * num_samples * num_channels);
+			if (!data)
 				return SR_ERR_MALLOC;
+			outc->fdata = data;
+			outc->fdata_size = (size_t)num_samples * num_channels;
+		}
+		data = outc->fdata;
+		ret = sr_analog_to_float(analog, data);
+		if (ret != SR_OK)
+			return ret;
+
+		if (num_channels > 1 && num_samples > MIN_DATA_CHUNK_SAMPLES &&
+				takes_interleaved(o, channels)) {
+			write_interleaved(o, data,
+				(size_t)num_samples * num_channels, out);
+			break;
 		}
 
 		/* Index the channels in this packet, so we can interleave quicker. */
-		chan_idx = g_malloc(sizeof(int) * outc->num_channels);
+		needed = 0;
 		for (i = 0; i < num_channels; i++) {
 			ch = g_slist_nth_data((GSList *) channels, i);
-			chan_idx[i] = g_slist_index(outc->channels, ch);
+			idx = g_slist_index(outc->channels, ch);
+			if (idx < 0) {
+				sr_err("Packet has data of a disabled channel.");
+				return SR_ERR;
+			}
+			outc->chan_idx[i] = idx;
+			needed = MAX(needed, outc->chanbuf_used[idx] + num_samples);
+		}
+		if (needed > outc->chanbuf_size) {
+			ret = realloc_chanbufs(o, MAX(needed, 2 * outc->chanbuf_size));
+			if (ret != SR_OK)
+				return ret;
 		}
 
-		for (i = 0; i < num_samples; i++) {
-			for (j = 0; j < num_channels; j++) {
-				idx = chan_idx[j];
-				buf = outc->chanbuf[idx] + outc->chanbuf_used[idx]++ * 4;
-				f = data[i * num_channels + j];
-				if (outc->scale != 1.0)
-					f /= outc->scale;
-				float_to_le(buf, f);
-			}
+		scale = 1.0 / outc->scale;
+		for (j = 0; j < num_channels; j++) {
+			idx = outc->chan_idx[j];
+			buf = outc->chanbuf[idx] + outc->chanbuf_used[idx];
+			for (i = 0; i < num_samples; i++)
+				buf[i] = data[i * num_channels + j] * scale;
+			outc->chanbuf_used[idx] += num_samples;
 		}
-		g_free(chan_idx);
 
 		size = check_chanbuf_size(o);
 		if (size > MIN_DATA_CHUNK_SAMPLES)
-			if (flush_chanbufs(o, *out) != SR_OK)
+			if (flush_chanbufs(o, out) != SR_OK)
 				return SR_ERR;
 		break;
 	case SR_DF_END:
 		size = check_chanbuf_size(o);
 		if (size > 0) {
-			*out = g_string_sized_new(4 * size * outc->num_channels);
-			if (flush_chanbufs(o, *out) != SR_OK)
+			if (flush_chanbufs(o, out) != SR_OK)
 				return SR_ERR;
 		}
 		break;
@@ -334,6 +494,9 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 
 static struct sr_option options[] = {
 	{ "scale", "Scale", "Scale values by factor", NULL, NULL },
+	{ "format", "Sample format",
+		"Sample format of the data (PCM values are clipped to -1..1 after scaling)",
+		NULL, NULL },
 	ALL_ZERO
 };
 
@@ -341,6 +504,15 @@ static const struct sr_option *get_options(void)
 {
 	if (!options[0].def)
 		options[0].def = g_variant_ref_sink(g_variant_new_double(1.0));
+	if (!options[1].def) {
+		options[1].def = g_variant_ref_sink(g_variant_new_string("float"));
+		options[1].values = g_slist_append(options[1].values,
+			g_variant_ref_sink(g_variant_new_string("float")));
+		options[1].values = g_slist_append(options[1].values,
+			g_variant_ref_sink(g_variant_new_string("pcm16")));
+		options[1].values = g_slist_append(options[1].values,
+			g_variant_ref_sink(g_variant_new_string("pcm24")));
+	}
 
 	return options;
 }
@@ -352,10 +524,10 @@ static int cleanup(struct sr_output *o)
 
 	outc = o->priv;
 	g_slist_free(outc->channels);
-	g_variant_unref(options[0].def);
 	for (i = 0; i < outc->num_channels; i++)
 		g_free(outc->chanbuf[i]);
 	g_free(outc->chanbuf_used);
+	g_free(outc->chan_idx);
 	g_free(outc->chanbuf);
 	g_free(outc->fdata);
 	g_free(outc);
@@ -372,6 +544,6 @@ SR_PRIV struct sr_output_module output_wav = {
 	.flags = 0,
 	.options = get_options,
 	.init = init,
-	.receive = receive,
+	.receive_append = receive_append,
 	.cleanup = cleanup,
 };
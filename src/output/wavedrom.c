@@ -24,38 +24,57 @@
 
 #define LOG_PREFIX "output/wavedrom"
 
+/*
+ * Only the transitions of each channel are kept, as the lengths of the
+ * runs of equal values. The values alternate between runs, so the first
+ * value is all that's needed besides the lengths. Lengths count wave
+ * characters, each of which stands for a quantum of samples (the value
+ * of the quantum's first sample, shorter pulses can get lost).
+ */
+struct channel_state {
+	struct sr_channel *channel;
+	/* Lengths of the completed runs. */
+	GArray *runs;
+	/* Value and length of the current run, -1 before the first one. */
+	int value;
+	uint64_t run;
+	int first;
+};
+
 struct context {
-	uint32_t channel_count;
-	struct sr_channel **channels;
-	GString **channel_outputs; /* output strings */
+	uint64_t quantum;
+	/* Number of samples received so far. */
+	uint64_t samplepos;
+	size_t channel_count;
+	struct channel_state *channels;
 };
 
 /* Converts accumulated output data to a JSON string. */
-static GString *wavedrom_render(const struct context *ctx)
+static void wavedrom_render(struct context *ctx, GString *output)
 {
-	GString *output;
-	size_t ch, i;
-	char last_char, curr_char;
+	struct channel_state *cs;
+	size_t ch, i, len;
+	uint64_t run;
+	int value;
 
-	output = g_string_new("{ \"signal\": [");
+	g_string_append(output, "{ \"signal\": [");
 	for (ch = 0; ch < ctx->channel_count; ch++) {
-		if (!ctx->channel_outputs[ch])
-			continue;
+		cs = &ctx->channels[ch];
 
 		/* Channel strip. */
 		g_string_append_printf(output,
-			"{ \"name\": \"%s\", \"wave\": \"", ctx->channels[ch]->name);
-
-		last_char = 0;
-		for (i = 0; i < ctx->channel_outputs[ch]->len; i++) {
-			curr_char = ctx->channel_outputs[ch]->str[i];
-			/* Data point. */
-			if (curr_char == last_char) {
-				g_string_append_c(output, '.');
-			} else {
-				g_string_append_c(output, curr_char);
-				last_char = curr_char;
-			}
+			"{ \"name\": \"%s\", \"wave\": \"", cs->channel->name);
+
+		value = cs->first;
+		for (i = 0; i <= cs->runs->len && cs->value >= 0; i++) {
+			run = (i < cs->runs->len) ?
+				g_array_index(cs->runs, uint64_t, i) : cs->run;
+			/* Data point, then repetitions of it. */
+			g_string_append_c(output, value ? '1' : '0');
+			len = output->len;
+			g_string_set_size(output, len + run - 1);
+			memset(&output->str[len], '.', run - 1);
+			value = !value;
 		}
 		if (ch < ctx->channel_count - 1) {
 			g_string_append(output, "\" },");
@@ -63,67 +82,91 @@ static GString *wavedrom_render(const struct context *ctx)
 			/* Last channel, no comma. */
 			g_string_append(output, "\" }");
 		}
+
+		g_array_set_size(cs->runs, 0);
+		cs->value = -1;
+		cs->run = 0;
 	}
 	g_string_append(output, "], \"config\": { \"skin\": \"narrow\" }}");
+	ctx->samplepos = 0;
+}
+
+/* Add a sample set which repeats count times. */
+static void process_run(struct context *ctx, const uint8_t *sample,
+	size_t unitsize, uint64_t count)
+{
+	struct channel_state *cs;
+	uint64_t first, num;
+	size_t ch;
+	int index, bit;
+
+	/* The number of quantum starts within the run. */
+	first = (ctx->samplepos + ctx->quantum - 1) / ctx->quantum * ctx->quantum;
+	ctx->samplepos += count;
+	if (first >= ctx->samplepos)
+		return;
+	num = (ctx->samplepos - 1 - first) / ctx->quantum + 1;
 
-	return output;
+	for (ch = 0; ch < ctx->channel_count; ch++) {
+		cs = &ctx->channels[ch];
+		index = cs->channel->index;
+		bit = 0;
+		if ((size_t)index / 8 < unitsize)
+			bit = (sample[index / 8] >> (index % 8)) & 1;
+		if (bit == cs->value) {
+			cs->run += num;
+			continue;
+		}
+		if (cs->value < 0)
+			cs->first = bit;
+		else
+			g_array_append_val(cs->runs, cs->run);
+		cs->value = bit;
+		cs->run = num;
+	}
 }
 
-static void process_logic(const struct context *ctx,
+static void process_logic(struct context *ctx,
 	const struct sr_datafeed_logic *logic)
 {
-	size_t sample_count, ch, i;
-	uint8_t *sample, bit;
-	GString *accu;
+	const uint8_t *data, *sample;
+	size_t sample_count, unitsize, i, j;
 
-	if (!ctx->channel_count)
+	if (!ctx->channel_count || !logic->unitsize)
 		return;
 
-	/*
-	 * Extract the logic bits for each channel and store them
-	 * as wavedrom letters (1/0) in each channel's text string.
-	 * This transforms the input which consists of sample sets
-	 * that span multiple channels into output stripes per logic
-	 * channel which consist of bits for that individual channel.
-	 *
-	 * TODO Reduce memory consumption during accumulation of
-	 * output data.
-	 *
-	 * Ideally we'd accumulate binary chunks, and defer conversion
-	 * to the text format. Analog data already won't get here, only
-	 * logic data does. When the per-channel transformation also
-	 * gets deferred until later, then the only overhead would be
-	 * for disabled logic channels. Which may be acceptable or even
-	 * negligable.
-	 *
-	 * An optional addition to the above mentioned accumulation of
-	 * binary data is RLE compression. Mark both the position in the
-	 * accumulated data as well as a repetition counter, instead of
-	 * repeatedly storing the same sample set. The efficiency of
-	 * this approach of course depends on the change rate of input
-	 * data. But the approach perfectly matches the WaveDrom syntax
-	 * for repeated bit patterns, and thus is easily handled in the
-	 * text rendering stage of the output module.
-	 */
-	sample_count = logic->length / logic->unitsize;
-	for (i = 0; i < sample_count; i++) {
-		sample = logic->data + i * logic->unitsize;
-		for (ch = 0; ch < ctx->channel_count; ch++) {
-			accu = ctx->channel_outputs[ch];
-			if (!accu)
-				continue;
-			bit = sample[ch / 8] & (1 << (ch % 8));
-			g_string_append_c(accu, bit ? '1' : '0');
-		}
+	/* Runs of equal sample sets are taken in one go. */
+	data = logic->data;
+	unitsize = logic->unitsize;
+	sample_count = logic->length / unitsize;
+	for (i = 0; i < sample_count; i = j) {
+		sample = data + i * unitsize;
+		for (j = i + 1; j < sample_count; j++)
+			if (memcmp(data + j * unitsize, sample, unitsize))
+				break;
+		process_run(ctx, sample, unitsize, j - i);
 	}
 }
 
-static int receive(const struct sr_output *o,
-	const struct sr_datafeed_packet *packet, GString **out)
+static void process_logic_rle(struct context *ctx,
+	const struct sr_datafeed_logic_rle *rle)
 {
-	struct context *ctx;
+	const uint8_t *values;
+	uint64_t i;
+
+	if (!ctx->channel_count || !rle->unitsize)
+		return;
+
+	values = rle->values;
+	for (i = 0; i < rle->num_runs; i++)
+		process_run(ctx, values + i * rle->unitsize, rle->unitsize,
+			rle->counts[i]);
+}
 
-	*out = NULL;
+static int receive_append(const struct sr_output *o,
+	const struct sr_datafeed_packet *packet, GString *out)
+{
+	struct context *ctx;
 
 	if (!o || !o->sdi || !o->priv)
 		return SR_ERR_ARG;
@@ -134,8 +177,11 @@ static int receive(const struct sr_output *o,
 	case SR_DF_LOGIC:
 		process_logic(ctx, packet->payload);
 		break;
+	case SR_DF_LOGIC_RLE:
+		process_logic_rle(ctx, packet->payload);
+		break;
 	case SR_DF_END:
-		*out = wavedrom_render(ctx);
+		wavedrom_render(ctx, out);
 		break;
 	}
 
@@ -146,37 +192,56 @@ static int init(struct sr_output *o, GHashTable *options)
 {
 	struct context *ctx;
 	struct sr_channel *channel;
+	struct channel_state *cs;
 	GSList *l;
-	size_t i;
-
-	(void)options;
+	uint64_t quantum;
 
 	if (!o || !o->sdi)
 		return SR_ERR_ARG;
 
+	quantum = g_variant_get_uint64(g_hash_table_lookup(options, "quantum"));
+	if (!quantum) {
+		sr_err("The time quantum must be at least one sample.");
+		return SR_ERR_ARG;
+	}
+
 	o->priv = ctx = g_malloc0(sizeof(*ctx));
+	ctx->quantum = quantum;
 
-	ctx->channel_count = g_slist_length(o->sdi->channels);
 	ctx->channels = g_malloc0(
-		sizeof(ctx->channels[0]) * ctx->channel_count);
-	ctx->channel_outputs = g_malloc0(
-		sizeof(ctx->channel_outputs[0]) * ctx->channel_count);
-
-	for (i = 0, l = o->sdi->channels; l; l = l->next, i++) {
+		sizeof(ctx->channels[0]) * g_slist_length(o->sdi->channels));
+	for (l = o->sdi->channels; l; l = l->next) {
 		channel = l->data;
-		if (channel->enabled && channel->type == SR_CHANNEL_LOGIC) {
-			ctx->channels[i] = channel;
-			ctx->channel_outputs[i] = g_string_new(NULL);
-		}
+		if (!channel->enabled || channel->type != SR_CHANNEL_LOGIC)
+			continue;
+		cs = &ctx->channels[ctx->channel_count++];
+		cs->channel = channel;
+		cs->runs = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+		cs->value = -1;
 	}
 
 	return SR_OK;
 }
 
+static struct sr_option options[] = {
+	{ "quantum", "Time quantum",
+		"Number of samples per wave character (shorter pulses can get lost)",
+		NULL, NULL },
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	if (!options[0].def)
+		options[0].def = g_variant_ref_sink(g_variant_new_uint64(1));
+
+	return options;
+}
+
 static int cleanup(struct sr_output *o)
 {
 	struct context *ctx;
-	GString *s;
+	size_t ch;
 
 	if (!o)
 		return SR_ERR_ARG;
@@ -185,12 +250,8 @@ static int cleanup(struct sr_output *o)
 	o->priv = NULL;
 
 	if (ctx) {
-		while (--ctx->channel_count) {
-			s = ctx->channel_outputs[ctx->channel_count];
-			if (s)
-				g_string_free(s, TRUE);
-		}
-		g_free(ctx->channel_outputs);
+		for (ch = 0; ch < ctx->channel_count; ch++)
+			g_array_free(ctx->channels[ch].runs, TRUE);
 		g_free(ctx->channels);
 		g_free(ctx);
 	}
@@ -203,9 +264,9 @@ SR_PRIV struct sr_output_module output_wavedrom = {
 	.name = "WaveDrom",
 	.desc = "WaveDrom.com file format",
 	.exts = (const char *[]){"wavedrom", "json", NULL},
-	.flags = 0,
-	.options = NULL,
+	.flags = SR_OUTPUT_LOGIC_RLE,
+	.options = get_options,
 	.init = init,
-	.receive = receive,
+	.receive_append = receive_append,
 	.cleanup = cleanup,
 };
@@ -233,6 +233,47 @@ static gssize resource_read_default(const struct sr_resource *res,
 	return n_read;
 }
 
+/*
+ * Map a resource file that the default hooks would open. Returns NULL
+ * when the file cannot be found or mapped, a regular read still gets
+ * its chance then.
+ */
+static GBytes *resource_map_default(int type, const char *name)
+{
+	GSList *paths, *p;
+	GMappedFile *file;
+	GBytes *bytes;
+	char *filename;
+
+	if (type != SR_RESOURCE_FIRMWARE)
+		return NULL;
+
+	file = NULL;
+	paths = sr_resourcepaths_get(type);
+	for (p = paths; p && !file; p = p->next) {
+		filename = g_build_filename(p->data, name, NULL);
+		file = g_mapped_file_new(filename, FALSE, NULL);
+		if (file)
+			sr_info("Mapped '%s'.", filename);
+		g_free(filename);
+	}
+	g_slist_free_full(paths, g_free);
+
+	if (!file)
+		return NULL;
+
+	/* Empty files have no mapping, and GBytes wants a non-NULL pointer. */
+	if (!g_mapped_file_get_contents(file)) {
+		g_mapped_file_unref(file);
+		return g_bytes_new(NULL, 0);
+	}
+	bytes = g_bytes_new_with_free_func(g_mapped_file_get_contents(file),
+		g_mapped_file_get_length(file),
+		(GDestroyNotify)g_mapped_file_unref, file);
+
+	return bytes;
+}
+
 /**
  * Install resource access hooks.
  *
@@ -270,6 +311,9 @@ SR_API int sr_resource_set_hooks(struct sr_context *ctx,
 		sr_err("%s: inconsistent callback pointers.", __func__);
 		return SR_ERR_ARG;
 	}
+	/* Resources loaded through other hooks could differ. */
+	sr_resource_cache_clear(ctx);
+
 	return SR_OK;
 }
 
@@ -357,21 +401,24 @@ SR_PRIV gssize sr_resource_read(struct sr_context *ctx,
 }
 
 /**
- * Load a resource into memory.
+ * Drop all resources kept in memory by sr_resource_load_bytes().
  *
- * @param ctx libsigrok context. Must not be NULL.
- * @param type Resource type ID.
- * @param name Name of the resource. Must not be NULL.
- * @param[out] size Size in bytes of the returned buffer. Must not be NULL.
- * @param max_size Size limit. Error out if the resource is larger than this.
+ * Buffers still referenced by callers stay valid.
  *
- * @return A buffer containing the resource data, or NULL on failure. Must
- *         be freed by the caller using g_free().
+ * @param ctx libsigrok context. Must not be NULL.
  *
  * @private
  */
-SR_PRIV void *sr_resource_load(struct sr_context *ctx,
-		int type, const char *name, size_t *size, size_t max_size)
+SR_PRIV void sr_resource_cache_clear(struct sr_context *ctx)
+{
+	g_mutex_lock(&ctx->resource_cache_mutex);
+	if (ctx->resource_cache)
+		g_hash_table_remove_all(ctx->resource_cache);
+	g_mutex_unlock(&ctx->resource_cache_mutex);
+}
+
+static GBytes *resource_read_bytes(struct sr_context *ctx,
+		int type, const char *name, size_t max_size)
 {
 	struct sr_resource res;
 	void *buf;
@@ -407,6 +454,94 @@ SR_PRIV void *sr_resource_load(struct sr_context *ctx,
 		return NULL;
 	}
 
+	return g_bytes_new_take(buf, res_size);
+}
+
+/**
+ * Load a resource into memory, or get the copy loaded before.
+ *
+ * Resources are kept in memory until the hooks change or the context
+ * goes away, so opening several devices of a kind, or reopening one,
+ * only reads its firmware once. With the default hooks, the files get
+ * mapped rather than read.
+ *
+ * @param ctx libsigrok context. Must not be NULL.
+ * @param type Resource type ID.
+ * @param name Name of the resource. Must not be NULL.
+ * @param max_size Size limit. Error out if the resource is larger than this.
+ *
+ * @return The resource data, or NULL on failure. Must be released by the
+ *         caller using g_bytes_unref().
+ *
+ * @private
+ */
+SR_PRIV GBytes *sr_resource_load_bytes(struct sr_context *ctx,
+		int type, const char *name, size_t max_size)
+{
+	GBytes *bytes;
+	char *key;
+
+	key = g_strdup_printf("%d/%s", type, name);
+
+	g_mutex_lock(&ctx->resource_cache_mutex);
+	if (!ctx->resource_cache)
+		ctx->resource_cache = g_hash_table_new_full(g_str_hash,
+			g_str_equal, g_free, (GDestroyNotify)g_bytes_unref);
+	bytes = g_hash_table_lookup(ctx->resource_cache, key);
+	if (bytes) {
+		sr_spew("Using the loaded copy of '%s'.", name);
+		g_bytes_ref(bytes);
+	} else {
+		if (ctx->resource_open_cb == &resource_open_default)
+			bytes = resource_map_default(type, name);
+		if (!bytes)
+			bytes = resource_read_bytes(ctx, type, name, max_size);
+		if (bytes) {
+			g_hash_table_insert(ctx->resource_cache,
+				g_strdup(key), g_bytes_ref(bytes));
+		}
+	}
+	g_mutex_unlock(&ctx->resource_cache_mutex);
+	g_free(key);
+
+	if (bytes && g_bytes_get_size(bytes) > max_size) {
+		sr_err("Size %zu of '%s' exceeds limit %zu.",
+			g_bytes_get_size(bytes), name, max_size);
+		g_bytes_unref(bytes);
+		return NULL;
+	}
+
+	return bytes;
+}
+
+/**
+ * Load a resource into memory.
+ *
+ * @param ctx libsigrok context. Must not be NULL.
+ * @param type Resource type ID.
+ * @param name Name of the resource. Must not be NULL.
+ * @param[out] size Size in bytes of the returned buffer. Must not be NULL.
+ * @param max_size Size limit. Error out if the resource is larger than this.
+ *
+ * @return A buffer containing the resource data, or NULL on failure. Must
+ *         be freed by the caller using g_free().
+ *
+ * @private
+ */
+SR_PRIV void *sr_resource_load(struct sr_context *ctx,
+		int type, const char *name, size_t *size, size_t max_size)
+{
+	GBytes *bytes;
+	void *buf;
+	gsize res_size;
+
+	bytes = sr_resource_load_bytes(ctx, type, name, max_size);
+	if (!bytes)
+		return NULL;
+
+	buf = g_memdup(g_bytes_get_data(bytes, &res_size), res_size);
+	g_bytes_unref(bytes);
+
 	*size = res_size;
 	return buf;
 }
@@ -0,0 +1,178 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "scan-cache"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * On-disk cache of device probe results.
+ */
+
+/*
+ * The cache is a key file with one group per device. The group name is
+ * the device's key (how to find it, e.g. its USB VID:PID and serial
+ * number), the "identity" entry holds what must still match for the
+ * cached results to be valid (e.g. its USB firmware release). All other
+ * entries are probe results, which drivers look up before they probe.
+ */
+#define IDENTITY_ENTRY "identity"
+
+/**
+ * Cache device probe results in a file.
+ *
+ * With a cache file, scans can skip probe steps (like asking a SCPI
+ * instrument for its identification) for devices whose identity still
+ * matches what was recorded in the file. Devices with a different
+ * identity get probed as usual, and their entry gets updated.
+ *
+ * @param ctx The libsigrok context. Must not be NULL.
+ * @param filename The cache file, which need not exist yet. NULL disables
+ *                 the cache (the default).
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_scan_cache_set(struct sr_context *ctx, const char *filename)
+{
+	GKeyFile *cache;
+	GError *error;
+
+	if (!ctx)
+		return SR_ERR_ARG;
+
+	cache = NULL;
+	if (filename) {
+		cache = g_key_file_new();
+		error = NULL;
+		if (!g_key_file_load_from_file(cache, filename,
+				G_KEY_FILE_NONE, &error)) {
+			if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+				sr_warn("Ignoring scan cache '%s': %s.",
+					filename, error->message);
+			g_error_free(error);
+		}
+	}
+
+	g_mutex_lock(&ctx->scan_cache_mutex);
+	if (ctx->scan_cache)
+		g_key_file_free(ctx->scan_cache);
+	g_free(ctx->scan_cache_file);
+	ctx->scan_cache = cache;
+	ctx->scan_cache_file = g_strdup(filename);
+	g_mutex_unlock(&ctx->scan_cache_mutex);
+
+	return SR_OK;
+}
+
+/**
+ * Look up a cached probe result.
+ *
+ * @param ctx The libsigrok context.
+ * @param key The key identifying the device.
+ * @param identity What must match for the entry to be valid.
+ * @param name The name of the probe result.
+ *
+ * @return The cached value, which the caller must g_free(). NULL if the
+ *         cache is disabled, or has no valid entry.
+ *
+ * @private
+ */
+SR_PRIV char *sr_scan_cache_lookup(struct sr_context *ctx, const char *key,
+		const char *identity, const char *name)
+{
+	char *cached_identity, *value;
+
+	if (!ctx)
+		return NULL;
+
+	value = NULL;
+	g_mutex_lock(&ctx->scan_cache_mutex);
+	if (ctx->scan_cache) {
+		cached_identity = g_key_file_get_string(ctx->scan_cache,
+			key, IDENTITY_ENTRY, NULL);
+		if (g_strcmp0(cached_identity, identity) == 0)
+			value = g_key_file_get_string(ctx->scan_cache,
+				key, name, NULL);
+		g_free(cached_identity);
+	}
+	g_mutex_unlock(&ctx->scan_cache_mutex);
+
+	if (value)
+		sr_dbg("Using cached %s of %s.", name, key);
+
+	return value;
+}
+
+/**
+ * Store a probe result in the cache, and write the cache file.
+ *
+ * If the device's identity changed, all its cached results are dropped.
+ *
+ * @param ctx The libsigrok context.
+ * @param key The key identifying the device.
+ * @param identity What must match for the entry to be valid.
+ * @param name The name of the probe result.
+ * @param value The probe result.
+ *
+ * @private
+ */
+SR_PRIV void sr_scan_cache_store(struct sr_context *ctx, const char *key,
+		const char *identity, const char *name, const char *value)
+{
+	char *cached_identity, *data;
+	gsize length;
+	GError *error;
+
+	if (!ctx)
+		return;
+
+	g_mutex_lock(&ctx->scan_cache_mutex);
+	if (!ctx->scan_cache) {
+		g_mutex_unlock(&ctx->scan_cache_mutex);
+		return;
+	}
+
+	cached_identity = g_key_file_get_string(ctx->scan_cache,
+		key, IDENTITY_ENTRY, NULL);
+	if (g_strcmp0(cached_identity, identity) != 0) {
+		g_key_file_remove_group(ctx->scan_cache, key, NULL);
+		g_key_file_set_string(ctx->scan_cache, key,
+			IDENTITY_ENTRY, identity);
+	}
+	g_free(cached_identity);
+	g_key_file_set_string(ctx->scan_cache, key, name, value);
+
+	error = NULL;
+	data = g_key_file_to_data(ctx->scan_cache, &length, NULL);
+	if (!g_file_set_contents(ctx->scan_cache_file, data, length, &error)) {
+		sr_warn("Cannot write scan cache '%s': %s.",
+			ctx->scan_cache_file, error->message);
+		g_error_free(error);
+	}
+	g_free(data);
+	g_mutex_unlock(&ctx->scan_cache_mutex);
+}
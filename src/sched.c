@@ -0,0 +1,210 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Needed for pthread_setaffinity_np() and cpu_set_t. */
+#define _GNU_SOURCE
+
+#include <config.h>
+#include <glib.h>
+#include <errno.h>
+#include <string.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#include <sched.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "sched"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * CPU affinity, scheduling and memory locking of libsigrok's threads.
+ */
+
+/* What a thread ran with before sr_thread_sched_apply() changed it. */
+struct sr_thread_sched_state {
+#ifdef HAVE_PTHREAD_H
+	gboolean sched_saved;
+	int policy;
+	struct sched_param param;
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+	gboolean affinity_saved;
+	cpu_set_t cpus;
+#endif
+#endif
+};
+
+/* Users of the process wide memory lock, see sr_mem_lock_acquire(). */
+static unsigned int mem_lock_users;
+G_LOCK_DEFINE_STATIC(mem_lock);
+
+/* Complain about missing permissions once, not for every thread. */
+static gint warned_sched, warned_affinity;
+
+/**
+ * Apply scheduling settings to the calling thread.
+ *
+ * Settings the system does not support, or the process has no
+ * permission for, are skipped with a warning; the thread then runs
+ * with what it had.
+ *
+ * @param sched The settings. NULL or all zero leaves the thread alone.
+ * @param save Whether to return the previous settings.
+ *
+ * @return The previous settings for sr_thread_sched_restore() when
+ *         "save" was set and something was changed, NULL otherwise.
+ *
+ * @private
+ */
+SR_PRIV struct sr_thread_sched_state *sr_thread_sched_apply(
+		const struct sr_thread_sched *sched, gboolean save)
+{
+	struct sr_thread_sched_state *state;
+#ifdef HAVE_PTHREAD_H
+	struct sched_param param;
+	int policy, ret;
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+	cpu_set_t cpus;
+	unsigned int cpu;
+#endif
+#endif
+
+	if (!sched || (!sched->cpu_mask && sched->policy == SR_SCHED_DEFAULT))
+		return NULL;
+
+	state = save ? g_malloc0(sizeof(*state)) : NULL;
+
+#ifdef HAVE_PTHREAD_H
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+	if (sched->cpu_mask) {
+		if (state && pthread_getaffinity_np(pthread_self(),
+				sizeof(state->cpus), &state->cpus) == 0)
+			state->affinity_saved = TRUE;
+		CPU_ZERO(&cpus);
+		for (cpu = 0; cpu < 64; cpu++) {
+			if (sched->cpu_mask & (1ULL << cpu))
+				CPU_SET(cpu, &cpus);
+		}
+		ret = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+		if (ret != 0 && g_atomic_int_compare_and_exchange(&warned_affinity,
+				0, 1))
+			sr_warn("Cannot set CPU affinity: %s.", g_strerror(ret));
+	}
+#else
+	if (sched->cpu_mask && g_atomic_int_compare_and_exchange(
+			&warned_affinity, 0, 1))
+		sr_warn("CPU affinity not supported on this system.");
+#endif
+
+	if (sched->policy != SR_SCHED_DEFAULT) {
+		if (state && pthread_getschedparam(pthread_self(),
+				&state->policy, &state->param) == 0)
+			state->sched_saved = TRUE;
+		policy = sched->policy == SR_SCHED_RR ? SCHED_RR : SCHED_FIFO;
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = CLAMP(sched->priority,
+			sched_get_priority_min(policy),
+			sched_get_priority_max(policy));
+		ret = pthread_setschedparam(pthread_self(), policy, &param);
+		if (ret != 0 && g_atomic_int_compare_and_exchange(&warned_sched,
+				0, 1))
+			sr_warn("Cannot use real-time scheduling: %s.",
+				g_strerror(ret));
+	}
+#else
+	if (g_atomic_int_compare_and_exchange(&warned_sched, 0, 1))
+		sr_warn("Thread scheduling not supported on this system.");
+#endif
+
+	return state;
+}
+
+/**
+ * Give the calling thread back what sr_thread_sched_apply() changed.
+ *
+ * @param state The previous settings. Gets freed. May be NULL.
+ *
+ * @private
+ */
+SR_PRIV void sr_thread_sched_restore(struct sr_thread_sched_state *state)
+{
+	if (!state)
+		return;
+
+#ifdef HAVE_PTHREAD_H
+	if (state->sched_saved)
+		pthread_setschedparam(pthread_self(), state->policy,
+			&state->param);
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+	if (state->affinity_saved)
+		pthread_setaffinity_np(pthread_self(), sizeof(state->cpus),
+			&state->cpus);
+#endif
+#endif
+
+	g_free(state);
+}
+
+/**
+ * Keep the process' memory from being paged out.
+ *
+ * Locks current and future mappings (sample buffers, USB transfer
+ * buffers, thread stacks) into RAM while at least one user holds the
+ * lock. Without permission (RLIMIT_MEMLOCK, CAP_IPC_LOCK), this only
+ * warns.
+ *
+ * @private
+ */
+SR_PRIV void sr_mem_lock_acquire(void)
+{
+	G_LOCK(mem_lock);
+	if (!mem_lock_users++) {
+#if defined(HAVE_SYS_MMAN_H) && defined(MCL_FUTURE)
+		if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+			sr_warn("Cannot lock memory: %s.", g_strerror(errno));
+		else
+			sr_dbg("Locked memory.");
+#else
+		sr_warn("Memory locking not supported on this system.");
+#endif
+	}
+	G_UNLOCK(mem_lock);
+}
+
+/**
+ * Drop a use of the memory lock which sr_mem_lock_acquire() took.
+ *
+ * @private
+ */
+SR_PRIV void sr_mem_lock_release(void)
+{
+	G_LOCK(mem_lock);
+	if (mem_lock_users && !--mem_lock_users) {
+#if defined(HAVE_SYS_MMAN_H) && defined(MCL_FUTURE)
+		munlockall();
+		sr_dbg("Unlocked memory.");
+#endif
+	}
+	G_UNLOCK(mem_lock);
+}
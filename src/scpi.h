@@ -73,6 +73,7 @@ enum scpi_transport_layer {
 	SCPI_TRANSPORT_USBTMC,
 	SCPI_TRANSPORT_VISA,
 	SCPI_TRANSPORT_VXI,
+	SCPI_TRANSPORT_HISLIP,
 };
 
 struct scpi_command {
@@ -87,6 +88,20 @@ struct sr_scpi_hw_info {
 	char *firmware_version;
 };
 
+/** Receives the data of a block, see sr_scpi_get_block_stream(). */
+typedef int (*sr_scpi_block_callback)(const uint8_t *data, size_t len,
+		size_t total, void *cb_data);
+
+/** A waveform data format, see sr_scpi_wave_format_negotiate(). */
+struct sr_scpi_wave_format {
+	/* The mnemonic of the format command, e.g. "WORD". */
+	const char *name;
+	/* Bytes per value, 0 for comma separated ASCII values. */
+	unsigned int unitsize;
+	gboolean is_signed;
+	gboolean is_bigendian;
+};
+
 struct sr_scpi_dev_inst {
 	const char *name;
 	const char *prefix;
@@ -97,6 +112,8 @@ struct sr_scpi_dev_inst {
 		const char *resource, char **params, const char *serialcomm);
 	int (*open)(struct sr_scpi_dev_inst *scpi);
 	int (*connection_id)(struct sr_scpi_dev_inst *scpi, char **connection_id);
+	/* Optional: where the device is, and what must match for cached IDs. */
+	int (*identity)(struct sr_scpi_dev_inst *scpi, char **key, char **identity);
 	int (*source_add)(struct sr_session *session, void *priv, int events,
 		int timeout, sr_receive_data_callback cb, void *cb_data);
 	int (*source_remove)(struct sr_session *session, void *priv);
@@ -109,6 +126,7 @@ struct sr_scpi_dev_inst {
 	void (*free)(void *priv);
 	unsigned int read_timeout_us;
 	void *priv;
+	struct sr_context *ctx;
 	/* Only used for quirk workarounds, notably the Rigol DS1000 series. */
 	uint64_t firmware_version;
 	GMutex scpi_mutex;
@@ -159,6 +177,36 @@ SR_PRIV int sr_scpi_get_data(struct sr_scpi_dev_inst *scpi,
 			const char *command, GString **scpi_response);
 SR_PRIV int sr_scpi_get_block(struct sr_scpi_dev_inst *scpi,
 			const char *command, GByteArray **scpi_response);
+SR_PRIV int sr_scpi_get_block_into(struct sr_scpi_dev_inst *scpi,
+			const char *command, void *buf, size_t size,
+			size_t *datalen);
+SR_PRIV int sr_scpi_get_block_stream(struct sr_scpi_dev_inst *scpi,
+			const char *command, size_t chunksize,
+			sr_scpi_block_callback cb, void *cb_data);
+
+SR_PRIV const struct sr_scpi_wave_format *sr_scpi_wave_format_negotiate(
+			struct sr_scpi_dev_inst *scpi, const char *command,
+			const struct sr_scpi_wave_format *formats, size_t count);
+SR_PRIV int sr_scpi_wave_encoding(const struct sr_scpi_wave_format *format,
+			double scale, double offset,
+			struct sr_analog_encoding *encoding);
+
+struct sr_scpi_batch;
+SR_PRIV struct sr_scpi_batch *sr_scpi_batch_new(void);
+SR_PRIV void sr_scpi_batch_free(struct sr_scpi_batch *batch);
+SR_PRIV void sr_scpi_batch_add_string(struct sr_scpi_batch *batch,
+			char **response, const char *format, ...);
+SR_PRIV void sr_scpi_batch_add_bool(struct sr_scpi_batch *batch,
+			gboolean *response, const char *format, ...);
+SR_PRIV void sr_scpi_batch_add_int(struct sr_scpi_batch *batch,
+			int *response, const char *format, ...);
+SR_PRIV void sr_scpi_batch_add_float(struct sr_scpi_batch *batch,
+			float *response, const char *format, ...);
+SR_PRIV void sr_scpi_batch_add_double(struct sr_scpi_batch *batch,
+			double *response, const char *format, ...);
+SR_PRIV int sr_scpi_batch_run(struct sr_scpi_dev_inst *scpi,
+			struct sr_scpi_batch *batch);
+
 SR_PRIV int sr_scpi_get_hw_id(struct sr_scpi_dev_inst *scpi,
 			struct sr_scpi_hw_info **scpi_response);
 SR_PRIV void sr_scpi_hw_info_free(struct sr_scpi_hw_info *hw_info);
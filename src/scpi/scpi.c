@@ -80,6 +80,7 @@ static int parse_strict_bool(const char *str, gboolean *ret)
 SR_PRIV extern const struct sr_scpi_dev_inst scpi_serial_dev;
 SR_PRIV extern const struct sr_scpi_dev_inst scpi_tcp_raw_dev;
 SR_PRIV extern const struct sr_scpi_dev_inst scpi_tcp_rigol_dev;
+SR_PRIV extern const struct sr_scpi_dev_inst scpi_hislip_dev;
 SR_PRIV extern const struct sr_scpi_dev_inst scpi_usbtmc_libusb_dev;
 SR_PRIV extern const struct sr_scpi_dev_inst scpi_vxi_dev;
 SR_PRIV extern const struct sr_scpi_dev_inst scpi_visa_dev;
@@ -88,6 +89,7 @@ SR_PRIV extern const struct sr_scpi_dev_inst scpi_libgpib_dev;
 static const struct sr_scpi_dev_inst *scpi_devs[] = {
 	&scpi_tcp_raw_dev,
 	&scpi_tcp_rigol_dev,
+	&scpi_hislip_dev,
 #ifdef HAVE_LIBUSB_1_0
 	&scpi_usbtmc_libusb_dev,
 #endif
@@ -161,6 +163,7 @@ static int scpi_send_variadic(struct sr_scpi_dev_inst *scpi,
 		buf[len] = '\n';
 
 	/* Send command. */
+	SR_PROBE2(scpi_send, scpi, buf);
 	ret = scpi->send(scpi->priv, buf);
 
 	/* Free command buffer. */
@@ -217,7 +220,14 @@ static int scpi_write_data(struct sr_scpi_dev_inst *scpi, char *buf, int maxlen)
  */
 static int scpi_read_data(struct sr_scpi_dev_inst *scpi, char *buf, int maxlen)
 {
-	return scpi->read_data(scpi->priv, buf, maxlen);
+	int len;
+
+	len = scpi->read_data(scpi->priv, buf, maxlen);
+	SR_PROBE2(scpi_receive, scpi, len);
+	if (len > 0)
+		sr_session_receive_mark(g_get_monotonic_time());
+
+	return len;
 }
 
 /**
@@ -237,6 +247,7 @@ static int scpi_read_response(struct sr_scpi_dev_inst *scpi,
 
 	space = response->allocated_len - response->len;
 	len = scpi->read_data(scpi->priv, &response->str[response->len], space);
+	SR_PROBE2(scpi_receive, scpi, len);
 
 	if (len < 0) {
 		sr_err("Incompletely read SCPI response.");
@@ -244,6 +255,7 @@ static int scpi_read_response(struct sr_scpi_dev_inst *scpi,
 	}
 
 	if (len > 0) {
+		sr_session_receive_mark(g_get_monotonic_time());
 		g_string_set_size(response, response->len + len);
 		return len;
 	}
@@ -379,6 +391,7 @@ SR_PRIV struct sr_scpi_dev_inst *scpi_dev_inst_new(struct drv_context *drvc,
 			*scpi = *scpi_dev;
 			scpi->priv = g_malloc0(scpi->priv_size);
 			scpi->read_timeout_us = 1000 * 1000;
+			scpi->ctx = drvc->sr_ctx;
 			params = g_strsplit(resource, "/", 0);
 			if (scpi->dev_inst_new(scpi->priv, drvc, resource,
 			                       params, serialcomm) != SR_OK) {
@@ -830,6 +843,97 @@ SR_PRIV int sr_scpi_get_opc(struct sr_scpi_dev_inst *scpi)
 	return SR_ERR;
 }
 
+/*
+ * Count the values of a comma separated response, which can have
+ * hundreds of thousands of them. With SSE2 the commas get counted 16
+ * bytes at a time, strchr() (vectorised in common C libraries) finds
+ * the rest.
+ */
+static size_t scpi_count_values(const char *str)
+{
+	size_t count, i;
+#ifdef __SSE2__
+	const __m128i comma = _mm_set1_epi8(',');
+	__m128i sum;
+	size_t len;
+	int n;
+#endif
+
+	if (!*str)
+		return 0;
+	count = 1;
+	i = 0;
+#ifdef __SSE2__
+	len = strlen(str);
+	while (i + 16 <= len) {
+		/* Count per byte, and add up before the counts overflow. */
+		sum = _mm_setzero_si128();
+		for (n = 0; n < 255 && i + 16 <= len; n++, i += 16)
+			sum = _mm_sub_epi8(sum, _mm_cmpeq_epi8(comma,
+				_mm_loadu_si128((const __m128i *)&str[i])));
+		sum = _mm_sad_epu8(sum, _mm_setzero_si128());
+		count += _mm_cvtsi128_si32(sum) + _mm_extract_epi16(sum, 4);
+	}
+#endif
+	for (str += i; (str = strchr(str, ',')); str++)
+		count++;
+
+	return count;
+}
+
+/*
+ * Parse comma separated ASCII values into outbuf. The string gets split
+ * in place, so that no token needs an allocation.
+ */
+static int scpi_parse_floats(char *str, float *outbuf, size_t *count)
+{
+	char *token, *end;
+	size_t num;
+	int ret;
+
+	ret = SR_OK;
+	num = 0;
+	token = str;
+	while (token && num < *count) {
+		end = strchr(token, ',');
+		if (end)
+			*end++ = '\0';
+		if (sr_atof_ascii(g_strstrip(token), &outbuf[num]) == SR_OK)
+			num++;
+		else
+			ret = SR_ERR_DATA;
+		token = end;
+	}
+	*count = num;
+
+	return ret;
+}
+
+/* Same as scpi_parse_floats(), for unsigned 8 bit integers. */
+static int scpi_parse_uint8s(char *str, uint8_t *outbuf, size_t *count)
+{
+	char *token, *end;
+	size_t num;
+	int tmp, ret;
+
+	ret = SR_OK;
+	num = 0;
+	token = str;
+	while (token && num < *count) {
+		end = strchr(token, ',');
+		if (end)
+			*end++ = '\0';
+		if (sr_atoi(g_strstrip(token), &tmp) == SR_OK)
+			outbuf[num++] = tmp;
+		else
+			ret = SR_ERR_DATA;
+		token = end;
+	}
+	*count = num;
+
+	return ret;
+}
+
 /**
  * Send a SCPI command, read the reply, parse it as comma separated list of
  * floats and store the as an result in scpi_response.
@@ -847,33 +951,22 @@ SR_PRIV int sr_scpi_get_floatv(struct sr_scpi_dev_inst *scpi,
 			       const char *command, GArray **scpi_response)
 {
 	int ret;
-	float tmp;
 	char *response;
-	gchar **ptr, **tokens;
+	size_t count;
 	GArray *response_array;
 
 	response = NULL;
-	tokens = NULL;
 
 	ret = sr_scpi_get_string(scpi, command, &response);
 	if (ret != SR_OK && !response)
 		return ret;
 
-	tokens = g_strsplit(response, ",", 0);
-	ptr = tokens;
-
-	response_array = g_array_sized_new(TRUE, FALSE, sizeof(float), 256);
-
-	while (*ptr) {
-		if (sr_atof_ascii(*ptr, &tmp) == SR_OK)
-			response_array = g_array_append_val(response_array,
-							    tmp);
-		else
-			ret = SR_ERR_DATA;
-
-		ptr++;
-	}
-	g_strfreev(tokens);
+	count = scpi_count_values(response);
+	response_array = g_array_sized_new(TRUE, FALSE, sizeof(float), count);
+	if (scpi_parse_floats(response, (float *)response_array->data,
+			&count) != SR_OK)
+		ret = SR_ERR_DATA;
+	g_array_set_size(response_array, count);
 	g_free(response);
 
 	if (ret != SR_OK && response_array->len == 0) {
@@ -903,33 +996,23 @@ SR_PRIV int sr_scpi_get_floatv(struct sr_scpi_dev_inst *scpi,
 SR_PRIV int sr_scpi_get_uint8v(struct sr_scpi_dev_inst *scpi,
 			       const char *command, GArray **scpi_response)
 {
-	int tmp, ret;
+	int ret;
 	char *response;
-	gchar **ptr, **tokens;
+	size_t count;
 	GArray *response_array;
 
 	response = NULL;
-	tokens = NULL;
 
 	ret = sr_scpi_get_string(scpi, command, &response);
 	if (ret != SR_OK && !response)
 		return ret;
 
-	tokens = g_strsplit(response, ",", 0);
-	ptr = tokens;
-
-	response_array = g_array_sized_new(TRUE, FALSE, sizeof(uint8_t), 256);
-
-	while (*ptr) {
-		if (sr_atoi(*ptr, &tmp) == SR_OK)
-			response_array = g_array_append_val(response_array,
-							    tmp);
-		else
-			ret = SR_ERR_DATA;
-
-		ptr++;
-	}
-	g_strfreev(tokens);
+	count = scpi_count_values(response);
+	response_array = g_array_sized_new(TRUE, FALSE, sizeof(uint8_t), count);
+	if (scpi_parse_uint8s(response, (uint8_t *)response_array->data,
+			&count) != SR_OK)
+		ret = SR_ERR_DATA;
+	g_array_set_size(response_array, count);
 	g_free(response);
 
 	if (response_array->len == 0) {
@@ -943,6 +1026,133 @@ SR_PRIV int sr_scpi_get_uint8v(struct sr_scpi_dev_inst *scpi,
 	return ret;
 }
 
+/**
+ * Read exactly @a len bytes of a response, without mutex.
+ *
+ * @param scpi Previously initialised SCPI device structure.
+ * @param buf Buffer to store the data.
+ * @param len Number of bytes to read.
+ * @param[out] got Number of bytes actually read.
+ * @param[in,out] timeout Absolute timeout in microseconds, gets extended
+ *                        as data arrives.
+ *
+ * @return SR_OK when all data was read, SR_ERR* on failure.
+ */
+static int scpi_read_exact(struct sr_scpi_dev_inst *scpi,
+		uint8_t *buf, size_t len, size_t *got, gint64 *timeout)
+{
+	size_t pos;
+	int ret;
+
+	pos = 0;
+	ret = SR_OK;
+	while (pos < len) {
+		ret = scpi_read_data(scpi, (char *)&buf[pos],
+			MIN(len - pos, G_MAXINT));
+		if (ret < 0) {
+			sr_err("Incompletely read SCPI response.");
+			ret = SR_ERR;
+			break;
+		}
+		if (ret > 0) {
+			pos += ret;
+			*timeout = g_get_monotonic_time() + scpi->read_timeout_us;
+			ret = SR_OK;
+			continue;
+		}
+		if (g_get_monotonic_time() > *timeout) {
+			sr_err("Timed out waiting for SCPI response.");
+			ret = SR_ERR_TIMEOUT;
+			break;
+		}
+	}
+	*got = pos;
+
+	return ret;
+}
+
+/**
+ * Read the header of a "definite length block", without mutex.
+ *
+ * SCPI protocol data blocks are preceeded with a length spec.
+ * The length spec consists of a '#' marker, one digit which
+ * specifies the character count of the length spec, and the
+ * respective number of characters which specify the data block's
+ * length. Raw data bytes follow (thus one must no longer assume
+ * that the received input stream would be an ASCIIZ string).
+ *
+ * Only the length spec gets read, so that the data bytes can go
+ * straight to their destination.
+ *
+ * @param scpi Previously initialised SCPI device structure.
+ * @param[in,out] timeout Absolute timeout in microseconds.
+ * @param[out] datalen The data block's length. Zero for an empty block,
+ *                     or an indefinite length block (not supported).
+ *
+ * @return SR_OK upon success, SR_ERR* on failure.
+ */
+static int scpi_read_block_header(struct sr_scpi_dev_inst *scpi,
+		gint64 *timeout, size_t *datalen)
+{
+	char buf[10];
+	size_t got;
+	long llen, len;
+	int ret;
+
+	*datalen = 0;
+
+	ret = scpi_read_exact(scpi, (uint8_t *)buf, 2, &got, timeout);
+	if (ret != SR_OK)
+		return ret;
+	if (buf[0] != '#')
+		return SR_ERR_DATA;
+	buf[0] = buf[1];
+	buf[1] = '\0';
+	ret = sr_atol(buf, &llen);
+	if ((ret != SR_OK) || (llen == 0))
+		return ret;
+
+	ret = scpi_read_exact(scpi, (uint8_t *)buf, llen, &got, timeout);
+	if (ret != SR_OK)
+		return ret;
+	buf[llen] = '\0';
+	ret = sr_atol(buf, &len);
+	if (ret != SR_OK)
+		return ret;
+	if (len < 0)
+		return SR_ERR_DATA;
+	*datalen = len;
+
+	return SR_OK;
+}
+
+/**
+ * Skip the rest of a data block, without mutex.
+ *
+ * @param scpi Previously initialised SCPI device structure.
+ * @param len Number of bytes to skip.
+ * @param[in,out] timeout Absolute timeout in microseconds.
+ *
+ * @return SR_OK upon success, SR_ERR* on failure.
+ */
+static int scpi_skip_block(struct sr_scpi_dev_inst *scpi,
+		size_t len, gint64 *timeout)
+{
+	uint8_t buf[4096];
+	size_t got;
+	int ret;
+
+	while (len > 0) {
+		ret = scpi_read_exact(scpi, buf, MIN(len, sizeof(buf)),
+			&got, timeout);
+		if (ret != SR_OK)
+			return ret;
+		len -= got;
+	}
+
+	return SR_OK;
+}
+
 /**
  * Send a SCPI command, read the reply, parse it as binary data with a
  * "definite length block" header and store the as an result in scpi_response.
@@ -960,13 +1170,12 @@ SR_PRIV int sr_scpi_get_block(struct sr_scpi_dev_inst *scpi,
 			       const char *command, GByteArray **scpi_response)
 {
 	int ret;
-	GString* response;
-	gsize oldlen;
-	char buf[10];
-	long llen;
-	long datalen;
+	GByteArray *response;
+	size_t datalen, got;
 	gint64 timeout;
 
+	*scpi_response = NULL;
+
 	g_mutex_lock(&scpi->scpi_mutex);
 
 	if (command)
@@ -980,109 +1189,577 @@ SR_PRIV int sr_scpi_get_block(struct sr_scpi_dev_inst *scpi,
 		return SR_ERR;
 	}
 
-	/*
-	 * Assume an initial maximum length, optionally gets adjusted below.
-	 * Prepare a NULL return value for when error paths will be taken.
+	timeout = g_get_monotonic_time() + scpi->read_timeout_us;
+
+	ret = scpi_read_block_header(scpi, &timeout, &datalen);
+	if ((ret != SR_OK) || (datalen == 0)) {
+		g_mutex_unlock(&scpi->scpi_mutex);
+		return ret;
+	}
+
+	/* The length is known now, read the data in place. */
+	response = g_byte_array_sized_new(datalen);
+	g_byte_array_set_size(response, datalen);
+	ret = scpi_read_exact(scpi, response->data, datalen, &got, &timeout);
+
+	/* On timeout truncate the buffer and send the partial response
+	 * instead of getting stuck on timeouts...
 	 */
-	response = g_string_sized_new(1024);
+	if (ret == SR_ERR_TIMEOUT) {
+		g_byte_array_set_size(response, got);
+		ret = SR_OK;
+	}
 
-	timeout = g_get_monotonic_time() + scpi->read_timeout_us;
+	g_mutex_unlock(&scpi->scpi_mutex);
 
-	*scpi_response = NULL;
+	if (ret != SR_OK) {
+		g_byte_array_free(response, TRUE);
+		return ret;
+	}
+	*scpi_response = response;
 
-	/* Get (the first chunk of) the response. */
-	do {
-		ret = scpi_read_response(scpi, response, timeout);
-		if (ret < 0) {
+	return SR_OK;
+}
+
+/**
+ * Send a SCPI command, read the reply as a "definite length block", and
+ * store the data in a caller provided buffer.
+ *
+ * Unlike sr_scpi_get_block(), this needs no allocation, deep memory
+ * reads can go to a buffer that is allocated once and reused.
+ *
+ * @param scpi Previously initialised SCPI device structure.
+ * @param command The SCPI command to send to the device (can be NULL).
+ * @param buf Buffer to store the data. Must not be NULL.
+ * @param size Size of the buffer in bytes.
+ * @param[out] datalen Number of bytes stored. Less than the block's
+ *                     length when the data stops coming.
+ *
+ * @return SR_OK upon success, SR_ERR_DATA when the block does not fit the
+ *         buffer (the block is skipped then), other SR_ERR* on failure.
+ */
+SR_PRIV int sr_scpi_get_block_into(struct sr_scpi_dev_inst *scpi,
+		const char *command, void *buf, size_t size, size_t *datalen)
+{
+	int ret;
+	size_t len;
+	gint64 timeout;
+
+	*datalen = 0;
+
+	g_mutex_lock(&scpi->scpi_mutex);
+
+	if (command)
+		if (scpi_send(scpi, command) != SR_OK) {
 			g_mutex_unlock(&scpi->scpi_mutex);
-			g_string_free(response, TRUE);
-			return ret;
+			return SR_ERR;
 		}
-	} while (response->len < 2);
 
-	/*
-	 * SCPI protocol data blocks are preceeded with a length spec.
-	 * The length spec consists of a '#' marker, one digit which
-	 * specifies the character count of the length spec, and the
-	 * respective number of characters which specify the data block's
-	 * length. Raw data bytes follow (thus one must no longer assume
-	 * that the received input stream would be an ASCIIZ string).
-	 *
-	 * Get the data block length, and strip off the length spec from
-	 * the input buffer, leaving just the data bytes.
-	 */
-	if (response->str[0] != '#') {
+	if (sr_scpi_read_begin(scpi) != SR_OK) {
 		g_mutex_unlock(&scpi->scpi_mutex);
-		g_string_free(response, TRUE);
-		return SR_ERR_DATA;
+		return SR_ERR;
 	}
-	buf[0] = response->str[1];
-	buf[1] = '\0';
-	ret = sr_atol(buf, &llen);
-	if ((ret != SR_OK) || (llen == 0)) {
+
+	timeout = g_get_monotonic_time() + scpi->read_timeout_us;
+
+	ret = scpi_read_block_header(scpi, &timeout, &len);
+	if (ret == SR_OK && len > size) {
+		sr_err("SCPI block of %zu bytes exceeds buffer of %zu bytes.",
+			len, size);
+		ret = scpi_skip_block(scpi, len, &timeout);
 		g_mutex_unlock(&scpi->scpi_mutex);
-		g_string_free(response, TRUE);
-		return ret;
+		return ret == SR_OK ? SR_ERR_DATA : ret;
 	}
+	if (ret == SR_OK)
+		ret = scpi_read_exact(scpi, buf, len, datalen, &timeout);
+	if (ret == SR_ERR_TIMEOUT && *datalen > 0)
+		ret = SR_OK;
 
-	while (response->len < (unsigned long)(2 + llen)) {
-		ret = scpi_read_response(scpi, response, timeout);
-		if (ret < 0) {
+	g_mutex_unlock(&scpi->scpi_mutex);
+
+	return ret;
+}
+
+/**
+ * Send a SCPI command, read the reply as a "definite length block", and
+ * pass the data to a callback in chunks as they arrive.
+ *
+ * This lets drivers process a deep memory read while it still comes in.
+ * When the callback fails, the rest of the block is read and skipped, so
+ * that the next response can be read.
+ *
+ * @param scpi Previously initialised SCPI device structure.
+ * @param command The SCPI command to send to the device (can be NULL).
+ * @param chunksize Maximum number of bytes per callback.
+ * @param cb Callback to pass the data to. It gets the data, its length,
+ *           and the length of the whole block. Returns SR_OK to go on.
+ * @param cb_data User data for the callback.
+ *
+ * @return SR_OK upon success, the callback's return value when it failed,
+ *         other SR_ERR* on failure.
+ */
+SR_PRIV int sr_scpi_get_block_stream(struct sr_scpi_dev_inst *scpi,
+		const char *command, size_t chunksize,
+		sr_scpi_block_callback cb, void *cb_data)
+{
+	int ret, cb_ret;
+	uint8_t *chunk;
+	size_t datalen, pos, got;
+	gint64 timeout;
+
+	if (!chunksize || !cb)
+		return SR_ERR_ARG;
+
+	g_mutex_lock(&scpi->scpi_mutex);
+
+	if (command)
+		if (scpi_send(scpi, command) != SR_OK) {
 			g_mutex_unlock(&scpi->scpi_mutex);
-			g_string_free(response, TRUE);
-			return ret;
+			return SR_ERR;
 		}
+
+	if (sr_scpi_read_begin(scpi) != SR_OK) {
+		g_mutex_unlock(&scpi->scpi_mutex);
+		return SR_ERR;
 	}
 
-	memcpy(buf, &response->str[2], llen);
-	buf[llen] = '\0';
-	ret = sr_atol(buf, &datalen);
+	timeout = g_get_monotonic_time() + scpi->read_timeout_us;
+
+	ret = scpi_read_block_header(scpi, &timeout, &datalen);
 	if ((ret != SR_OK) || (datalen == 0)) {
 		g_mutex_unlock(&scpi->scpi_mutex);
-		g_string_free(response, TRUE);
 		return ret;
 	}
-	g_string_erase(response, 0, 2 + llen);
-
-	/*
-	 * Re-allocate the buffer size to the now known length
-	 * and keep reading more chunks of response data.
-	 */
-	oldlen = response->len;
-	g_string_set_size(response, datalen);
-	g_string_set_size(response, oldlen);
 
-	if (oldlen < (unsigned long)(datalen)) {
-		do {
-			oldlen = response->len;
-			ret = scpi_read_response(scpi, response, timeout);
-
-			/* On timeout truncate the buffer and send the partial response
-			 * instead of getting stuck on timeouts...
-			 */
-			if (ret == SR_ERR_TIMEOUT) {
-				datalen = oldlen;
-				break;
-			}
-			if (ret < 0) {
-				g_mutex_unlock(&scpi->scpi_mutex);
-				g_string_free(response, TRUE);
-				return ret;
-			}
-			if (ret > 0)
-				timeout = g_get_monotonic_time() + scpi->read_timeout_us;
-		} while (response->len < (unsigned long)(datalen));
+	chunk = g_malloc(MIN(chunksize, datalen));
+	cb_ret = SR_OK;
+	for (pos = 0; pos < datalen; pos += got) {
+		ret = scpi_read_exact(scpi, chunk, MIN(chunksize, datalen - pos),
+			&got, &timeout);
+		if (got > 0 && cb_ret == SR_OK)
+			cb_ret = cb(chunk, got, datalen, cb_data);
+		if (ret != SR_OK)
+			break;
 	}
+	g_free(chunk);
 
 	g_mutex_unlock(&scpi->scpi_mutex);
 
-	/* Convert received data to byte array. */
-	*scpi_response = g_byte_array_new_take(
-		(guint8*)g_string_free(response, FALSE), datalen);
+	if (cb_ret != SR_OK)
+		return cb_ret;
+
+	return ret;
+}
+
+/*
+ * Instruments answer format queries with the short form of a mnemonic
+ * ("ASC" for "ASCii"), or the long one. Either must match.
+ */
+static gboolean scpi_mnemonic_match(const char *response, const char *name)
+{
+	size_t len;
+
+	len = MIN(strlen(response), strlen(name));
+	if (len < 3)
+		return g_ascii_strcasecmp(response, name) == 0;
+
+	return g_ascii_strncasecmp(response, name, len) == 0;
+}
+
+/**
+ * Select the most compact waveform data format which the instrument
+ * supports.
+ *
+ * Each format gets set with "<command> <name>", and is accepted when
+ * "<command>?" reads it back. Binary formats are much faster to transfer
+ * and to convert than ASCII, so drivers pass these first (the widest one
+ * their instrument's resolution needs), and ASCII as the last resort.
+ *
+ * @param scpi Previously initialised SCPI device structure.
+ * @param command The format command, e.g. ":WAV:FORM".
+ * @param formats The formats to try, in order of preference.
+ * @param count The number of formats.
+ *
+ * @return The format the instrument uses now, NULL if it accepted none.
+ */
+SR_PRIV const struct sr_scpi_wave_format *sr_scpi_wave_format_negotiate(
+		struct sr_scpi_dev_inst *scpi, const char *command,
+		const struct sr_scpi_wave_format *formats, size_t count)
+{
+	char *query, *response;
+	size_t i;
+	gboolean match;
+
+	query = g_strdup_printf("%s?", command);
+	for (i = 0; i < count; i++) {
+		if (sr_scpi_send(scpi, "%s %s", command, formats[i].name) != SR_OK)
+			continue;
+		response = NULL;
+		match = sr_scpi_get_string(scpi, query, &response) == SR_OK &&
+			scpi_mnemonic_match(sr_scpi_unquote_string(response),
+				formats[i].name);
+		g_free(response);
+		if (match)
+			break;
+		sr_dbg("Waveform format %s not supported.", formats[i].name);
+	}
+	g_free(query);
+
+	if (i == count) {
+		sr_err("No supported waveform format.");
+		return NULL;
+	}
+	sr_dbg("Using waveform format %s.", formats[i].name);
+
+	return &formats[i];
+}
+
+/**
+ * Describe binary waveform data by an analog encoding.
+ *
+ * Drivers send the instrument's values as they are, sr_analog_to_float()
+ * applies the scale and offset when (and if) the receiver needs floats.
+ *
+ * @param format The format of the data.
+ * @param scale The factor to apply to each value.
+ * @param offset The offset to add to each scaled value.
+ * @param encoding The encoding to set up, e.g. by sr_analog_init().
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA The format is ASCII.
+ */
+SR_PRIV int sr_scpi_wave_encoding(const struct sr_scpi_wave_format *format,
+		double scale, double offset, struct sr_analog_encoding *encoding)
+{
+	if (!format || !encoding)
+		return SR_ERR_ARG;
+
+	if (format->unitsize == 0)
+		return SR_ERR_NA;
+
+	encoding->unitsize = format->unitsize;
+	encoding->is_signed = format->is_signed;
+	encoding->is_float = FALSE;
+	encoding->is_bigendian = format->is_bigendian;
+	sr_rational_from_double(&encoding->scale, scale);
+	sr_rational_from_double(&encoding->offset, offset);
 
 	return SR_OK;
 }
 
+/** @cond PRIVATE */
+#define SCPI_BATCH_MAX_COMMAND_LEN	512
+/** @endcond */
+
+enum scpi_batch_type {
+	SCPI_BATCH_STRING,
+	SCPI_BATCH_BOOL,
+	SCPI_BATCH_INT,
+	SCPI_BATCH_FLOAT,
+	SCPI_BATCH_DOUBLE,
+};
+
+struct scpi_batch_query {
+	char *command;
+	enum scpi_batch_type type;
+	void *response;
+};
+
+struct sr_scpi_batch {
+	GSList *queries;
+};
+
+/**
+ * Create a batch of queries, for sr_scpi_batch_run().
+ *
+ * @return The new batch, to be freed with sr_scpi_batch_free().
+ */
+SR_PRIV struct sr_scpi_batch *sr_scpi_batch_new(void)
+{
+	return g_malloc0(sizeof(struct sr_scpi_batch));
+}
+
+/**
+ * Free a batch of queries.
+ *
+ * @param batch The batch. If NULL, this function does nothing.
+ */
+SR_PRIV void sr_scpi_batch_free(struct sr_scpi_batch *batch)
+{
+	GSList *l;
+	struct scpi_batch_query *query;
+
+	if (!batch)
+		return;
+
+	for (l = batch->queries; l; l = l->next) {
+		query = l->data;
+		g_free(query->command);
+		g_free(query);
+	}
+	g_slist_free(batch->queries);
+	g_free(batch);
+}
+
+static void scpi_batch_add(struct sr_scpi_batch *batch,
+		enum scpi_batch_type type, void *response,
+		const char *format, va_list args)
+{
+	struct scpi_batch_query *query;
+
+	query = g_malloc0(sizeof(*query));
+	query->command = g_strdup_vprintf(format, args);
+	query->type = type;
+	query->response = response;
+	batch->queries = g_slist_append(batch->queries, query);
+}
+
+/**
+ * Add a query to a batch, its response is stored as a string.
+ *
+ * @param batch The batch.
+ * @param response Where to store the response, which the caller must
+ *                 g_free() after a successful run.
+ * @param format Format string for the query, like for sr_scpi_send().
+ */
+SR_PRIV void sr_scpi_batch_add_string(struct sr_scpi_batch *batch,
+		char **response, const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	scpi_batch_add(batch, SCPI_BATCH_STRING, response, format, args);
+	va_end(args);
+}
+
+/**
+ * Add a query to a batch, its response is parsed as a boolean.
+ *
+ * @param batch The batch.
+ * @param response Where to store the response.
+ * @param format Format string for the query, like for sr_scpi_send().
+ */
+SR_PRIV void sr_scpi_batch_add_bool(struct sr_scpi_batch *batch,
+		gboolean *response, const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	scpi_batch_add(batch, SCPI_BATCH_BOOL, response, format, args);
+	va_end(args);
+}
+
+/**
+ * Add a query to a batch, its response is parsed as an integer.
+ *
+ * @param batch The batch.
+ * @param response Where to store the response.
+ * @param format Format string for the query, like for sr_scpi_send().
+ */
+SR_PRIV void sr_scpi_batch_add_int(struct sr_scpi_batch *batch,
+		int *response, const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	scpi_batch_add(batch, SCPI_BATCH_INT, response, format, args);
+	va_end(args);
+}
+
+/**
+ * Add a query to a batch, its response is parsed as a float.
+ *
+ * @param batch The batch.
+ * @param response Where to store the response.
+ * @param format Format string for the query, like for sr_scpi_send().
+ */
+SR_PRIV void sr_scpi_batch_add_float(struct sr_scpi_batch *batch,
+		float *response, const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	scpi_batch_add(batch, SCPI_BATCH_FLOAT, response, format, args);
+	va_end(args);
+}
+
+/**
+ * Add a query to a batch, its response is parsed as a double.
+ *
+ * @param batch The batch.
+ * @param response Where to store the response.
+ * @param format Format string for the query, like for sr_scpi_send().
+ */
+SR_PRIV void sr_scpi_batch_add_double(struct sr_scpi_batch *batch,
+		double *response, const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	scpi_batch_add(batch, SCPI_BATCH_DOUBLE, response, format, args);
+	va_end(args);
+}
+
+/* Parse one response, and store it where the query wants it. */
+static int scpi_batch_parse(struct scpi_batch_query *query, char *str)
+{
+	switch (query->type) {
+	case SCPI_BATCH_STRING:
+		*(char **)query->response = g_strdup(str);
+		return SR_OK;
+	case SCPI_BATCH_BOOL:
+		return parse_strict_bool(str, query->response) == SR_OK ?
+			SR_OK : SR_ERR_DATA;
+	case SCPI_BATCH_INT:
+		return sr_atoi(str, query->response) == SR_OK ?
+			SR_OK : SR_ERR_DATA;
+	case SCPI_BATCH_FLOAT:
+		return sr_atof_ascii(str, query->response) == SR_OK ?
+			SR_OK : SR_ERR_DATA;
+	case SCPI_BATCH_DOUBLE:
+		return sr_atod_ascii(str, query->response) == SR_OK ?
+			SR_OK : SR_ERR_DATA;
+	}
+
+	return SR_ERR_BUG;
+}
+
+/*
+ * Split the response to a compound query at the semicolons which are
+ * not within a quoted string.
+ */
+static GSList *scpi_batch_split(char *response)
+{
+	GSList *responses;
+	char *p, quote;
+
+	responses = g_slist_append(NULL, response);
+	quote = '\0';
+	for (p = response; *p; p++) {
+		if (quote) {
+			if (*p == quote)
+				quote = '\0';
+		} else if (*p == '"' || *p == '\'') {
+			quote = *p;
+		} else if (*p == ';') {
+			*p = '\0';
+			responses = g_slist_append(responses, p + 1);
+		}
+	}
+
+	return responses;
+}
+
+/*
+ * Send some queries of a batch as one compound query. Returns the number
+ * of queries which were answered, zero when the instrument's response
+ * did not have one part per query.
+ */
+static int scpi_batch_run_compound(struct sr_scpi_dev_inst *scpi,
+		GSList *queries, int *result)
+{
+	struct scpi_batch_query *query;
+	GString *command;
+	GSList *l, *responses, *r;
+	char *response;
+	int num, ret;
+
+	/* Absolute headers, so that no query depends on the previous. */
+	command = g_string_sized_new(SCPI_BATCH_MAX_COMMAND_LEN);
+	num = 0;
+	for (l = queries; l; l = l->next) {
+		query = l->data;
+		if (num && command->len + strlen(query->command) + 2 >
+				SCPI_BATCH_MAX_COMMAND_LEN)
+			break;
+		if (num)
+			g_string_append_c(command, ';');
+		if (num && query->command[0] != ':' && query->command[0] != '*')
+			g_string_append_c(command, ':');
+		g_string_append(command, query->command);
+		num++;
+	}
+
+	response = NULL;
+	ret = sr_scpi_get_string(scpi, command->str, &response);
+	g_string_free(command, TRUE);
+	if (ret != SR_OK) {
+		g_free(response);
+		return 0;
+	}
+
+	responses = scpi_batch_split(response);
+	if ((int)g_slist_length(responses) != num) {
+		sr_dbg("Got %u responses for %d compound queries.",
+			g_slist_length(responses), num);
+		g_slist_free(responses);
+		g_free(response);
+		return 0;
+	}
+
+	for (l = queries, r = responses; r; l = l->next, r = r->next) {
+		ret = scpi_batch_parse(l->data, g_strstrip(r->data));
+		if (ret != SR_OK && *result == SR_OK)
+			*result = ret;
+	}
+	g_slist_free(responses);
+	g_free(response);
+
+	return num;
+}
+
+/**
+ * Run a batch of queries.
+ *
+ * The queries get joined into compound queries (separated by semicolons),
+ * so that several of them take a single round trip. Instruments which do
+ * not answer a compound query with one response per query get the
+ * remaining queries one at a time.
+ *
+ * @param scpi Previously initialised SCPI device structure.
+ * @param batch The queries to run.
+ *
+ * @return SR_OK when all responses were received and parsed, the first
+ *         error otherwise. Responses which could be parsed are stored
+ *         either way, string responses must then be freed by the caller.
+ */
+SR_PRIV int sr_scpi_batch_run(struct sr_scpi_dev_inst *scpi,
+		struct sr_scpi_batch *batch)
+{
+	struct scpi_batch_query *query;
+	GSList *l;
+	char *response;
+	int num, ret, result;
+
+	result = SR_OK;
+	l = batch->queries;
+	while (l) {
+		if (l->next) {
+			num = scpi_batch_run_compound(scpi, l, &result);
+			if (num > 0) {
+				l = g_slist_nth(l, num);
+				continue;
+			}
+		}
+
+		/* Single query, or the instrument can't do compounds. */
+		do {
+			query = l->data;
+			response = NULL;
+			ret = sr_scpi_get_string(scpi, query->command, &response);
+			if (ret == SR_OK)
+				ret = scpi_batch_parse(query, response);
+			g_free(response);
+			if (ret != SR_OK && result == SR_OK)
+				result = ret;
+			l = l->next;
+		} while (l);
+	}
+
+	return result;
+}
+
 /**
  * Send the *IDN? SCPI command, receive the reply, parse it and store the
  * reply as a sr_scpi_hw_info structure in the supplied scpi_response pointer.
@@ -1098,17 +1775,35 @@ SR_PRIV int sr_scpi_get_hw_id(struct sr_scpi_dev_inst *scpi,
 			      struct sr_scpi_hw_info **scpi_response)
 {
 	int num_tokens, ret;
-	char *response;
+	char *response, *key, *identity;
 	gchar **tokens;
 	struct sr_scpi_hw_info *hw_info;
 	gchar *idn_substr;
 
 	response = NULL;
 	tokens = NULL;
+	key = identity = NULL;
 
-	ret = sr_scpi_get_string(scpi, SCPI_CMD_IDN, &response);
-	if (ret != SR_OK && !response)
-		return ret;
+	/*
+	 * Use the cached response when the transport can tell cheaply
+	 * that this is still the same device.
+	 */
+	if (scpi->identity && scpi->identity(scpi, &key, &identity) == SR_OK)
+		response = sr_scan_cache_lookup(scpi->ctx, key, identity, "idn");
+
+	if (!response) {
+		ret = sr_scpi_get_string(scpi, SCPI_CMD_IDN, &response);
+		if (ret != SR_OK && !response) {
+			g_free(key);
+			g_free(identity);
+			return ret;
+		}
+		if (key)
+			sr_scan_cache_store(scpi->ctx, key, identity,
+				"idn", response);
+	}
+	g_free(key);
+	g_free(identity);
 
 	/*
 	 * The response to a '*IDN?' is specified by the SCPI spec. It contains
@@ -0,0 +1,548 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * HiSLIP (IVI-6.1) transport. A session uses two TCP connections to the
+ * same port: the synchronous channel carries the SCPI messages, the
+ * asynchronous channel carries the session setup. Messages consist of a
+ * 16 byte header, and an optional payload:
+ *
+ *   "HS" | type (1) | control code (1) | parameter (4) | length (8)
+ *
+ * All numbers are big endian.
+ */
+
+#include <config.h>
+#ifdef _WIN32
+#define _WIN32_WINNT 0x0501
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#endif
+#include <glib.h>
+#include <string.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#endif
+#include <errno.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "scpi.h"
+
+#define LOG_PREFIX "scpi_hislip"
+
+#define HISLIP_PORT		"4880"
+#define HISLIP_SUBADDRESS	"hislip0"
+#define HISLIP_HEADER_SIZE	16
+#define HISLIP_VERSION		0x0100
+#define HISLIP_VENDOR_ID	(('S' << 8) | 'R')
+#define HISLIP_FIRST_MESSAGE_ID	0xffffff00
+/* What we accept in one message, we read them in pieces anyway. */
+#define HISLIP_MAX_MESSAGE_SIZE	(UINT64_C(1) << 32)
+
+enum hislip_message_type {
+	HISLIP_INITIALIZE = 0,
+	HISLIP_INITIALIZE_RESPONSE = 1,
+	HISLIP_FATAL_ERROR = 2,
+	HISLIP_ERROR = 3,
+	HISLIP_DATA = 6,
+	HISLIP_DATA_END = 7,
+	HISLIP_INTERRUPTED = 13,
+	HISLIP_ASYNC_MAXIMUM_MESSAGE_SIZE = 15,
+	HISLIP_ASYNC_MAXIMUM_MESSAGE_SIZE_RESPONSE = 16,
+	HISLIP_ASYNC_INITIALIZE = 17,
+	HISLIP_ASYNC_INITIALIZE_RESPONSE = 18,
+};
+
+/* Control code of Data and DataEnd messages from the client. */
+#define HISLIP_RMT_DELIVERED	0x01
+/* Control code of the InitializeResponse message. */
+#define HISLIP_OVERLAPPED	0x01
+
+struct scpi_hislip {
+	char *address;
+	char *subaddress;
+	int sync_socket;
+	int async_socket;
+	gboolean overlapped;
+	/* ID of the next message to send, and of the last query sent. */
+	uint32_t message_id;
+	uint32_t query_id;
+	/* The most the server accepts in one message. */
+	uint64_t max_message_size;
+	/* Whether the last response was read up to its end. */
+	gboolean rmt_delivered;
+	/* Payload of the current message still to read. */
+	uint64_t payload_remaining;
+	gboolean payload_is_end;
+	gboolean read_complete;
+};
+
+static int scpi_hislip_dev_inst_new(void *priv, struct drv_context *drvc,
+		const char *resource, char **params, const char *serialcomm)
+{
+	struct scpi_hislip *hislip = priv;
+
+	(void)drvc;
+	(void)resource;
+	(void)serialcomm;
+
+	if (!params || !params[1]) {
+		sr_err("Invalid parameters.");
+		return SR_ERR;
+	}
+
+	hislip->address = g_strdup(params[1]);
+	hislip->subaddress = g_strdup(params[2] ?
+		params[2] : HISLIP_SUBADDRESS);
+	hislip->sync_socket = -1;
+	hislip->async_socket = -1;
+
+	return SR_OK;
+}
+
+static int hislip_connect(const char *address)
+{
+	struct addrinfo hints;
+	struct addrinfo *results, *res;
+	int err, fd;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+
+	err = getaddrinfo(address, HISLIP_PORT, &hints, &results);
+	if (err) {
+		sr_err("Address lookup failed: %s:%s: %s", address, HISLIP_PORT,
+			gai_strerror(err));
+		return -1;
+	}
+
+	fd = -1;
+	for (res = results; res; res = res->ai_next) {
+		if ((fd = socket(res->ai_family, res->ai_socktype,
+						res->ai_protocol)) < 0)
+			continue;
+		if (connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+			close(fd);
+			fd = -1;
+			continue;
+		}
+		break;
+	}
+	freeaddrinfo(results);
+
+	if (fd < 0)
+		sr_err("Failed to connect to %s:%s: %s", address, HISLIP_PORT,
+			g_strerror(errno));
+
+	return fd;
+}
+
+static int hislip_send_all(int fd, const void *buf, size_t len)
+{
+	const char *p;
+	int out;
+
+	p = buf;
+	while (len > 0) {
+		out = send(fd, p, len, 0);
+		if (out < 0) {
+			sr_err("Send error: %s", g_strerror(errno));
+			return SR_ERR;
+		}
+		p += out;
+		len -= out;
+	}
+
+	return SR_OK;
+}
+
+static int hislip_recv_all(int fd, void *buf, size_t len)
+{
+	char *p;
+	int in;
+
+	p = buf;
+	while (len > 0) {
+		in = recv(fd, p, len, 0);
+		if (in < 0) {
+			sr_err("Receive error: %s", g_strerror(errno));
+			return SR_ERR;
+		}
+		if (in == 0) {
+			sr_err("Connection closed by the instrument.");
+			return SR_ERR;
+		}
+		p += in;
+		len -= in;
+	}
+
+	return SR_OK;
+}
+
+static int hislip_send_message(int fd, uint8_t type, uint8_t control,
+		uint32_t parameter, const void *payload, uint64_t len)
+{
+	uint8_t header[HISLIP_HEADER_SIZE];
+
+	header[0] = 'H';
+	header[1] = 'S';
+	header[2] = type;
+	header[3] = control;
+	WB32(&header[4], parameter);
+	WB32(&header[8], len >> 32);
+	WB32(&header[12], len);
+
+	if (hislip_send_all(fd, header, sizeof(header)) != SR_OK)
+		return SR_ERR;
+	if (len && hislip_send_all(fd, payload, len) != SR_OK)
+		return SR_ERR;
+
+	return SR_OK;
+}
+
+static int hislip_recv_header(int fd, uint8_t *type, uint8_t *control,
+		uint32_t *parameter, uint64_t *len)
+{
+	uint8_t header[HISLIP_HEADER_SIZE];
+
+	if (hislip_recv_all(fd, header, sizeof(header)) != SR_OK)
+		return SR_ERR;
+	if (header[0] != 'H' || header[1] != 'S') {
+		sr_err("Invalid message header.");
+		return SR_ERR;
+	}
+	*type = header[2];
+	*control = header[3];
+	*parameter = RB32(&header[4]);
+	*len = RB64(&header[8]);
+
+	return SR_OK;
+}
+
+/* Read and log the payload of an error message. */
+static void hislip_log_error(int fd, uint8_t type, uint8_t control,
+		uint64_t len)
+{
+	char msg[256];
+	size_t msglen;
+
+	msglen = MIN(len, sizeof(msg) - 1);
+	if (hislip_recv_all(fd, msg, msglen) != SR_OK)
+		msglen = 0;
+	msg[msglen] = '\0';
+	sr_err("%s error %d: %s",
+		type == HISLIP_FATAL_ERROR ? "Fatal" : "Non-fatal",
+		control, msg);
+}
+
+/* Receive a message of the expected type, with a payload of known size. */
+static int hislip_recv_message(int fd, uint8_t expected, uint8_t *control,
+		uint32_t *parameter, void *payload, uint64_t payload_len)
+{
+	uint8_t type;
+	uint64_t len;
+
+	if (hislip_recv_header(fd, &type, control, parameter, &len) != SR_OK)
+		return SR_ERR;
+	if (type == HISLIP_FATAL_ERROR || type == HISLIP_ERROR) {
+		hislip_log_error(fd, type, *control, len);
+		return SR_ERR;
+	}
+	if (type != expected || len != payload_len) {
+		sr_err("Unexpected message type %d, length %" PRIu64 ".",
+			type, len);
+		return SR_ERR;
+	}
+	if (len && hislip_recv_all(fd, payload, len) != SR_OK)
+		return SR_ERR;
+
+	return SR_OK;
+}
+
+static int hislip_open_session(struct sr_scpi_dev_inst *scpi)
+{
+	struct scpi_hislip *hislip = scpi->priv;
+	uint8_t control, size[8];
+	uint32_t parameter;
+	uint16_t session_id;
+
+	if ((hislip->sync_socket = hislip_connect(hislip->address)) < 0)
+		return SR_ERR;
+
+	if (hislip_send_message(hislip->sync_socket, HISLIP_INITIALIZE, 0,
+			(HISLIP_VERSION << 16) | HISLIP_VENDOR_ID,
+			hislip->subaddress, strlen(hislip->subaddress)) != SR_OK)
+		return SR_ERR;
+	if (hislip_recv_message(hislip->sync_socket,
+			HISLIP_INITIALIZE_RESPONSE, &control, &parameter,
+			NULL, 0) != SR_OK)
+		return SR_ERR;
+	session_id = parameter & 0xffff;
+	hislip->overlapped = control & HISLIP_OVERLAPPED;
+	sr_dbg("Server protocol %d.%d, session %d, %s mode.",
+		parameter >> 24, (parameter >> 16) & 0xff, session_id,
+		hislip->overlapped ? "overlapped" : "synchronized");
+
+	if ((hislip->async_socket = hislip_connect(hislip->address)) < 0)
+		return SR_ERR;
+	if (hislip_send_message(hislip->async_socket, HISLIP_ASYNC_INITIALIZE,
+			0, session_id, NULL, 0) != SR_OK)
+		return SR_ERR;
+	if (hislip_recv_message(hislip->async_socket,
+			HISLIP_ASYNC_INITIALIZE_RESPONSE, &control, &parameter,
+			NULL, 0) != SR_OK)
+		return SR_ERR;
+
+	/* Agree on the message size, which lets bulk data go in one piece. */
+	WB32(&size[0], HISLIP_MAX_MESSAGE_SIZE >> 32);
+	WB32(&size[4], HISLIP_MAX_MESSAGE_SIZE);
+	if (hislip_send_message(hislip->async_socket,
+			HISLIP_ASYNC_MAXIMUM_MESSAGE_SIZE, 0, 0,
+			size, sizeof(size)) != SR_OK)
+		return SR_ERR;
+	if (hislip_recv_message(hislip->async_socket,
+			HISLIP_ASYNC_MAXIMUM_MESSAGE_SIZE_RESPONSE, &control,
+			&parameter, size, sizeof(size)) != SR_OK)
+		return SR_ERR;
+	hislip->max_message_size = RB64(size);
+	if (!hislip->max_message_size)
+		hislip->max_message_size = G_MAXUINT64;
+	sr_dbg("Server accepts messages of up to %" PRIu64 " bytes.",
+		hislip->max_message_size);
+
+	hislip->message_id = HISLIP_FIRST_MESSAGE_ID;
+	hislip->rmt_delivered = FALSE;
+
+	return SR_OK;
+}
+
+static int scpi_hislip_close(struct sr_scpi_dev_inst *scpi);
+
+static int scpi_hislip_open(struct sr_scpi_dev_inst *scpi)
+{
+	/* Scans don't close what failed to open. */
+	if (hislip_open_session(scpi) != SR_OK) {
+		scpi_hislip_close(scpi);
+		return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
+static int scpi_hislip_connection_id(struct sr_scpi_dev_inst *scpi,
+		char **connection_id)
+{
+	struct scpi_hislip *hislip = scpi->priv;
+
+	*connection_id = g_strdup_printf("%s/%s/%s",
+		scpi->prefix, hislip->address, hislip->subaddress);
+
+	return SR_OK;
+}
+
+static int scpi_hislip_source_add(struct sr_session *session, void *priv,
+		int events, int timeout, sr_receive_data_callback cb, void *cb_data)
+{
+	struct scpi_hislip *hislip = priv;
+
+	return sr_session_source_add(session, hislip->sync_socket, events,
+			timeout, cb, cb_data);
+}
+
+static int scpi_hislip_source_remove(struct sr_session *session, void *priv)
+{
+	struct scpi_hislip *hislip = priv;
+
+	return sr_session_source_remove(session, hislip->sync_socket);
+}
+
+static int scpi_hislip_send(void *priv, const char *command)
+{
+	struct scpi_hislip *hislip = priv;
+	const char *p;
+	uint64_t len, chunk;
+	uint8_t type, control;
+
+	/* Large commands go in several messages, the last one ends them. */
+	p = command;
+	len = strlen(command);
+	do {
+		chunk = MIN(len, hislip->max_message_size);
+		type = chunk == len ? HISLIP_DATA_END : HISLIP_DATA;
+		control = hislip->rmt_delivered ? HISLIP_RMT_DELIVERED : 0;
+		if (hislip_send_message(hislip->sync_socket, type, control,
+				hislip->message_id, p, chunk) != SR_OK)
+			return SR_ERR;
+		hislip->rmt_delivered = FALSE;
+		hislip->query_id = hislip->message_id;
+		hislip->message_id += 2;
+		p += chunk;
+		len -= chunk;
+	} while (len > 0);
+
+	sr_spew("Successfully sent SCPI command: '%s'.", command);
+
+	return SR_OK;
+}
+
+static int scpi_hislip_read_begin(void *priv)
+{
+	struct scpi_hislip *hislip = priv;
+
+	hislip->payload_remaining = 0;
+	hislip->payload_is_end = FALSE;
+	hislip->read_complete = FALSE;
+
+	return SR_OK;
+}
+
+/* Skip the payload of a message we are not interested in. */
+static int hislip_skip(int fd, uint64_t len)
+{
+	char buf[256];
+	size_t chunk;
+
+	while (len > 0) {
+		chunk = MIN(len, sizeof(buf));
+		if (hislip_recv_all(fd, buf, chunk) != SR_OK)
+			return SR_ERR;
+		len -= chunk;
+	}
+
+	return SR_OK;
+}
+
+static int scpi_hislip_read_data(void *priv, char *buf, int maxlen)
+{
+	struct scpi_hislip *hislip = priv;
+	uint8_t type, control;
+	uint32_t parameter;
+	uint64_t len;
+	int in;
+
+	while (hislip->payload_remaining == 0) {
+		if (hislip->read_complete)
+			return 0;
+		if (hislip_recv_header(hislip->sync_socket, &type, &control,
+				&parameter, &len) != SR_OK)
+			return SR_ERR;
+		switch (type) {
+		case HISLIP_DATA:
+		case HISLIP_DATA_END:
+			/* In overlapped mode, skip responses to older queries. */
+			if (hislip->overlapped && parameter != hislip->query_id) {
+				sr_dbg("Skipping response to message %08x.",
+					parameter);
+				if (hislip_skip(hislip->sync_socket, len) != SR_OK)
+					return SR_ERR;
+				continue;
+			}
+			hislip->payload_remaining = len;
+			hislip->payload_is_end = type == HISLIP_DATA_END;
+			break;
+		case HISLIP_FATAL_ERROR:
+		case HISLIP_ERROR:
+			hislip_log_error(hislip->sync_socket, type, control, len);
+			return SR_ERR;
+		default:
+			/* Interrupted, and other messages which need no action. */
+			sr_spew("Ignoring message type %d.", type);
+			if (hislip_skip(hislip->sync_socket, len) != SR_OK)
+				return SR_ERR;
+			continue;
+		}
+		if (len == 0 && hislip->payload_is_end) {
+			hislip->read_complete = TRUE;
+			hislip->rmt_delivered = TRUE;
+			return 0;
+		}
+	}
+
+	in = recv(hislip->sync_socket, buf,
+		MIN((uint64_t)maxlen, hislip->payload_remaining), 0);
+	if (in < 0) {
+		sr_err("Receive error: %s", g_strerror(errno));
+		return SR_ERR;
+	}
+	if (in == 0) {
+		sr_err("Connection closed by the instrument.");
+		return SR_ERR;
+	}
+
+	hislip->payload_remaining -= in;
+	if (hislip->payload_remaining == 0 && hislip->payload_is_end) {
+		hislip->read_complete = TRUE;
+		hislip->rmt_delivered = TRUE;
+	}
+
+	return in;
+}
+
+static int scpi_hislip_read_complete(void *priv)
+{
+	struct scpi_hislip *hislip = priv;
+
+	return hislip->read_complete;
+}
+
+static int scpi_hislip_close(struct sr_scpi_dev_inst *scpi)
+{
+	struct scpi_hislip *hislip = scpi->priv;
+	int ret;
+
+	ret = SR_OK;
+	if (hislip->async_socket >= 0 && close(hislip->async_socket) < 0)
+		ret = SR_ERR;
+	hislip->async_socket = -1;
+	if (hislip->sync_socket >= 0 && close(hislip->sync_socket) < 0)
+		ret = SR_ERR;
+	hislip->sync_socket = -1;
+
+	return ret;
+}
+
+static void scpi_hislip_free(void *priv)
+{
+	struct scpi_hislip *hislip = priv;
+
+	g_free(hislip->address);
+	g_free(hislip->subaddress);
+}
+
+SR_PRIV const struct sr_scpi_dev_inst scpi_hislip_dev = {
+	.name          = "HiSLIP",
+	.prefix        = "hislip",
+	.transport     = SCPI_TRANSPORT_HISLIP,
+	.priv_size     = sizeof(struct scpi_hislip),
+	.dev_inst_new  = scpi_hislip_dev_inst_new,
+	.open          = scpi_hislip_open,
+	.connection_id = scpi_hislip_connection_id,
+	.source_add    = scpi_hislip_source_add,
+	.source_remove = scpi_hislip_source_remove,
+	.send          = scpi_hislip_send,
+	.read_begin    = scpi_hislip_read_begin,
+	.read_data     = scpi_hislip_read_data,
+	.read_complete = scpi_hislip_read_complete,
+	.close         = scpi_hislip_close,
+	.free          = scpi_hislip_free,
+};
@@ -28,6 +28,10 @@
 
 #define MAX_TRANSFER_LENGTH 2048
 #define TRANSFER_TIMEOUT 1000
+/* Bulk in data not read in place goes through a buffer of this size. */
+#define BULK_IN_BUFFER_LENGTH (64 * 1024)
+/* Reads of at least this size go straight to the caller's buffer. */
+#define BULK_IN_DIRECT_LENGTH (16 * 1024)
 
 struct scpi_usbtmc_libusb {
 	struct sr_context *ctx;
@@ -42,10 +46,15 @@ struct scpi_usbtmc_libusb {
 	uint8_t usb488_dev_cap;
 	uint8_t bTag;
 	uint8_t bulkin_attributes;
+	int bulk_in_packet_size;
 	uint8_t buffer[MAX_TRANSFER_LENGTH];
+	uint8_t bulkin_buffer[BULK_IN_BUFFER_LENGTH];
 	int response_length;
 	int response_bytes_read;
 	int remaining_length;
+	/* For the throughput, per response. */
+	int64_t read_start;
+	uint64_t read_bytes;
 };
 
 /* Some USBTMC-specific enums, as defined in the USBTMC standard. */
@@ -130,7 +139,7 @@ static GSList *scpi_usbtmc_libusb_scan(struct drv_context *drvc)
 	int confidx, intfidx, ret, i;
 	char *res;
 
-	ret = libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	ret = sr_usb_get_device_list(drvc->sr_ctx, &devlist);
 	if (ret < 0) {
 		sr_err("Failed to get device list: %s.",
 		       libusb_error_name(ret));
@@ -186,7 +195,7 @@ static int scpi_usbtmc_libusb_dev_inst_new(void *priv, struct drv_context *drvc,
 	}
 
 	uscpi->ctx = drvc->sr_ctx;
-	devices = sr_usb_find(uscpi->ctx->libusb_ctx, params[1]);
+	devices = sr_usb_find(uscpi->ctx, params[1]);
 	if (g_slist_length(devices) != 1) {
 		sr_err("Failed to find USB device '%s'.", params[1]);
 		g_slist_free_full(devices, (GDestroyNotify)sr_usb_dev_inst_free);
@@ -410,6 +419,11 @@ static int scpi_usbtmc_libusb_open(struct sr_scpi_dev_inst *scpi)
 	       uscpi->usb488_dev_cap & USB488_DEV_CAP_RL1         ? "RL1"  : "RL0",
 	       uscpi->usb488_dev_cap & USB488_DEV_CAP_DT1         ? "DT1"  : "DT0");
 
+	uscpi->bulk_in_packet_size = libusb_get_max_packet_size(dev,
+		uscpi->bulk_in_ep);
+	if (uscpi->bulk_in_packet_size <= 0)
+		uscpi->bulk_in_packet_size = 64;
+
 	scpi_usbtmc_remote(uscpi);
 
 	return SR_OK;
@@ -427,6 +441,40 @@ static int scpi_usbtmc_libusb_connection_id(struct sr_scpi_dev_inst *scpi,
 	return SR_OK;
 }
 
+static int scpi_usbtmc_libusb_identity(struct sr_scpi_dev_inst *scpi,
+		char **key, char **identity)
+{
+	struct scpi_usbtmc_libusb *uscpi = scpi->priv;
+	struct sr_usb_dev_inst *usb = uscpi->usb;
+	struct libusb_device *dev;
+	struct libusb_device_descriptor des;
+	char path[64];
+	unsigned char serial[64];
+	int ret;
+
+	if (!usb->devhdl)
+		return SR_ERR;
+
+	dev = libusb_get_device(usb->devhdl);
+	libusb_get_device_descriptor(dev, &des);
+	if (usb_get_port_path(dev, path, sizeof(path)) < 0)
+		return SR_ERR;
+
+	serial[0] = '\0';
+	if (des.iSerialNumber) {
+		ret = libusb_get_string_descriptor_ascii(usb->devhdl,
+			des.iSerialNumber, serial, sizeof(serial));
+		if (ret < 0)
+			return SR_ERR;
+	}
+
+	*key = g_strdup_printf("%s/%s", scpi->prefix, path);
+	*identity = g_strdup_printf("%04x.%04x.%04x/%s",
+		des.idVendor, des.idProduct, des.bcdDevice, serial);
+
+	return SR_OK;
+}
+
 static int scpi_usbtmc_libusb_source_add(struct sr_session *session,
 		void *priv, int events, int timeout, sr_receive_data_callback cb,
 		void *cb_data)
@@ -604,46 +652,107 @@ static int scpi_usbtmc_libusb_send(void *priv, const char *command)
 	return SR_OK;
 }
 
-static int scpi_usbtmc_libusb_read_begin(void *priv)
+/*
+ * Read the rest of a large message straight into the caller's buffer.
+ * Only whole packets get requested, so that the end of the message
+ * (and its alignment padding) can't overflow the buffer. libusb submits
+ * a large transfer as several URBs at once, which keeps the bus busy.
+ */
+static int scpi_usbtmc_bulkin_direct(struct scpi_usbtmc_libusb *uscpi,
+                                     void *data, int size)
 {
-	struct scpi_usbtmc_libusb *uscpi = priv;
+	struct sr_usb_dev_inst *usb = uscpi->usb;
+	int ret, transferred;
+
+	size = MIN(size, uscpi->remaining_length);
+	size -= size % uscpi->bulk_in_packet_size;
+
+	/* Allow for at least 1MB/s. */
+	ret = libusb_bulk_transfer(usb->devhdl, uscpi->bulk_in_ep, data, size,
+	                           &transferred, TRANSFER_TIMEOUT + size / 1000);
+	if (ret < 0) {
+		sr_err("USBTMC bulk in transfer error: %s.",
+		       libusb_error_name(ret));
+		return SR_ERR;
+	}
+
+	uscpi->remaining_length -= transferred;
+
+	return transferred;
+}
 
+static int scpi_usbtmc_request_in(struct scpi_usbtmc_libusb *uscpi)
+{
 	uscpi->remaining_length = 0;
 
 	if (scpi_usbtmc_bulkout(uscpi, REQUEST_DEV_DEP_MSG_IN,
 	    NULL, INT32_MAX, 0) < 0)
 		return SR_ERR;
 	if (scpi_usbtmc_bulkin_start(uscpi, DEV_DEP_MSG_IN,
-	                             uscpi->buffer, sizeof(uscpi->buffer),
+	                             uscpi->bulkin_buffer,
+	                             sizeof(uscpi->bulkin_buffer),
 	                             &uscpi->bulkin_attributes) < 0)
 		return SR_ERR;
 
 	return SR_OK;
 }
 
+static int scpi_usbtmc_libusb_read_begin(void *priv)
+{
+	struct scpi_usbtmc_libusb *uscpi = priv;
+
+	uscpi->read_start = g_get_monotonic_time();
+	uscpi->read_bytes = 0;
+
+	return scpi_usbtmc_request_in(uscpi);
+}
+
+static int scpi_usbtmc_libusb_read_complete(void *priv);
+
 static int scpi_usbtmc_libusb_read_data(void *priv, char *buf, int maxlen)
 {
 	struct scpi_usbtmc_libusb *uscpi = priv;
 	int read_length;
+	int64_t duration;
 
 	if (uscpi->response_bytes_read >= uscpi->response_length) {
-		if (uscpi->remaining_length > 0) {
-			if (scpi_usbtmc_bulkin_continue(uscpi, uscpi->buffer,
-			                                sizeof(uscpi->buffer)) <= 0)
+		if (uscpi->remaining_length >= BULK_IN_DIRECT_LENGTH &&
+		    maxlen >= BULK_IN_DIRECT_LENGTH) {
+			read_length = scpi_usbtmc_bulkin_direct(uscpi,
+				buf, maxlen);
+			if (read_length < 0)
+				return SR_ERR;
+			uscpi->read_bytes += read_length;
+			return read_length;
+		} else if (uscpi->remaining_length > 0) {
+			if (scpi_usbtmc_bulkin_continue(uscpi,
+			                                uscpi->bulkin_buffer,
+			                                sizeof(uscpi->bulkin_buffer)) <= 0)
 				return SR_ERR;
 		} else {
 			if (uscpi->bulkin_attributes & EOM)
 				return SR_ERR;
-			if (scpi_usbtmc_libusb_read_begin(uscpi) < 0)
+			if (scpi_usbtmc_request_in(uscpi) < 0)
 				return SR_ERR;
 		}
 	}
 
 	read_length = MIN(uscpi->response_length - uscpi->response_bytes_read, maxlen);
 
-	memcpy(buf, uscpi->buffer + uscpi->response_bytes_read, read_length);
+	memcpy(buf, uscpi->bulkin_buffer + uscpi->response_bytes_read, read_length);
 
 	uscpi->response_bytes_read += read_length;
+	uscpi->read_bytes += read_length;
+
+	/* Report the throughput of large responses. */
+	if (uscpi->read_bytes >= BULK_IN_BUFFER_LENGTH &&
+	    scpi_usbtmc_libusb_read_complete(uscpi)) {
+		duration = MAX(g_get_monotonic_time() - uscpi->read_start, 1);
+		sr_dbg("Read %" PRIu64 " bytes in %" PRIi64 " ms (%.1f kB/s).",
+		       uscpi->read_bytes, duration / 1000,
+		       uscpi->read_bytes * 1000.0 / duration);
+		uscpi->read_bytes = 0;
+	}
 
 	return read_length;
 }
@@ -699,6 +808,7 @@ SR_PRIV const struct sr_scpi_dev_inst scpi_usbtmc_libusb_dev = {
 	.dev_inst_new  = scpi_usbtmc_libusb_dev_inst_new,
 	.open          = scpi_usbtmc_libusb_open,
 	.connection_id = scpi_usbtmc_libusb_connection_id,
+	.identity      = scpi_usbtmc_libusb_identity,
 	.source_add    = scpi_usbtmc_libusb_source_add,
 	.source_remove = scpi_usbtmc_libusb_source_remove,
 	.send          = scpi_usbtmc_libusb_send,
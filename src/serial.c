@@ -39,6 +39,11 @@
 #define LOG_PREFIX "serial"
 /** @endcond */
 
+/* How much serial_peek() reads at least, when the transport can't tell. */
+#define SERIAL_PEEK_CHUNK_SIZE 4096
+/* Pause between two Bluetooth discovery rounds, in seconds. */
+#define SERIAL_BT_DISCOVERY_INTERVAL 5
+
 /**
  * @file
  *
@@ -171,6 +176,11 @@ SR_PRIV int serial_close(struct sr_serial_dev_inst *serial)
 		g_string_free(serial->rcv_buffer, TRUE);
 		serial->rcv_buffer = NULL;
 	}
+	if (rc == SR_OK && serial->peek_buffer) {
+		g_string_free(serial->peek_buffer, TRUE);
+		serial->peek_buffer = NULL;
+		serial->peek_consumed = 0;
+	}
 
 	return rc;
 }
@@ -195,6 +205,10 @@ SR_PRIV int serial_flush(struct sr_serial_dev_inst *serial)
 	sr_spew("Flushing serial port %s.", serial->port);
 
 	sr_ser_discard_queued_data(serial);
+	if (serial->peek_buffer) {
+		g_string_truncate(serial->peek_buffer, 0);
+		serial->peek_consumed = 0;
+	}
 
 	if (!serial->lib_funcs || !serial->lib_funcs->flush)
 		return SR_ERR_NA;
@@ -386,6 +400,8 @@ SR_PRIV size_t serial_has_receive_data(struct sr_serial_dev_inst *serial)
 		lib_count = serial->lib_funcs->get_rx_avail(serial);
 
 	buf_count = sr_ser_has_queued_data(serial);
+	if (serial->peek_buffer)
+		buf_count += serial->peek_buffer->len - serial->peek_consumed;
 
 	return lib_count + buf_count;
 }
@@ -405,6 +421,7 @@ static int _serial_write(struct sr_serial_dev_inst *serial,
 		return SR_ERR_NA;
 	ret = serial->lib_funcs->write(serial, buf, count,
 		nonblocking, timeout_ms);
+	SR_PROBE3(serial_write, serial, count, ret);
 	sr_spew("Wrote %zd/%zu bytes.", ret, count);
 
 	return ret;
@@ -454,6 +471,7 @@ static int _serial_read(struct sr_serial_dev_inst *serial,
 	void *buf, size_t count, int nonblocking, unsigned int timeout_ms)
 {
 	ssize_t ret;
+	size_t peeked;
 
 	if (!serial) {
 		sr_dbg("Invalid serial port.");
@@ -462,10 +480,30 @@ static int _serial_read(struct sr_serial_dev_inst *serial,
 
 	if (!serial->lib_funcs || !serial->lib_funcs->read)
 		return SR_ERR_NA;
+
+	/* Data that serial_peek() read ahead comes first. */
+	peeked = 0;
+	if (serial->peek_buffer) {
+		peeked = serial->peek_buffer->len - serial->peek_consumed;
+		peeked = MIN(peeked, count);
+		memcpy(buf, serial->peek_buffer->str + serial->peek_consumed,
+			peeked);
+		serial_consume(serial, peeked);
+		if (peeked == count)
+			return peeked;
+		buf = (uint8_t *)buf + peeked;
+		count -= peeked;
+	}
+
 	ret = serial->lib_funcs->read(serial, buf, count,
 		nonblocking, timeout_ms);
-	if (ret > 0)
+	SR_PROBE3(serial_read, serial, count, ret);
+	if (ret > 0) {
 		sr_spew("Read %zd/%zu bytes.", ret, count);
+		sr_session_receive_mark(g_get_monotonic_time());
+	}
+	if (peeked)
+		ret = ret < 0 ? (ssize_t)peeked : ret + (ssize_t)peeked;
 
 	return ret;
 }
@@ -511,6 +549,87 @@ SR_PRIV int serial_read_nonblocking(struct sr_serial_dev_inst *serial,
 	return _serial_read(serial, buf, count, 1, 0);
 }
 
+/**
+ * Look at the receive data without consuming it.
+ *
+ * All data the transport has available gets read in one go (appended to
+ * what was read before but not consumed yet), so that protocol parsers
+ * can work on it in place instead of reading it in small pieces. Use
+ * serial_consume() for the data that was parsed. Later reads return data
+ * which was not consumed first.
+ *
+ * @param serial Previously initialized serial port structure.
+ * @param[out] data The receive data. Valid until the next serial call.
+ * @param[out] len The number of bytes at @a data, may be 0.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR Other error.
+ *
+ * @private
+ */
+SR_PRIV int serial_peek(struct sr_serial_dev_inst *serial,
+	const uint8_t **data, size_t *len)
+{
+	GString *buf;
+	size_t avail, pos;
+	ssize_t ret;
+
+	if (!serial || !data || !len)
+		return SR_ERR_ARG;
+
+	if (!serial->lib_funcs || !serial->lib_funcs->read)
+		return SR_ERR_NA;
+
+	if (!serial->peek_buffer)
+		serial->peek_buffer = g_string_sized_new(SERIAL_PEEK_CHUNK_SIZE);
+	buf = serial->peek_buffer;
+
+	/* Drop what was consumed, which is cheaper once than per consume. */
+	g_string_erase(buf, 0, serial->peek_consumed);
+	serial->peek_consumed = 0;
+
+	avail = 0;
+	if (serial->lib_funcs->get_rx_avail)
+		avail = serial->lib_funcs->get_rx_avail(serial);
+	avail = MAX(avail, SERIAL_PEEK_CHUNK_SIZE);
+
+	pos = buf->len;
+	g_string_set_size(buf, pos + avail);
+	ret = serial->lib_funcs->read(serial, buf->str + pos, avail, 1, 0);
+	SR_PROBE3(serial_read, serial, avail, ret);
+	g_string_set_size(buf, pos + MAX(ret, 0));
+	if (ret < 0 && !buf->len)
+		return SR_ERR;
+	if (ret > 0)
+		sr_spew("Read %zd/%zu bytes ahead.", ret, avail);
+
+	*data = (const uint8_t *)buf->str;
+	*len = buf->len;
+
+	return SR_OK;
+}
+
+/**
+ * Consume receive data which serial_peek() returned.
+ *
+ * @param serial Previously initialized serial port structure.
+ * @param[in] len The number of bytes to consume.
+ *
+ * @private
+ */
+SR_PRIV void serial_consume(struct sr_serial_dev_inst *serial, size_t len)
+{
+	if (!serial || !serial->peek_buffer)
+		return;
+
+	serial->peek_consumed += len;
+	if (serial->peek_consumed >= serial->peek_buffer->len) {
+		g_string_truncate(serial->peek_buffer, 0);
+		serial->peek_consumed = 0;
+	}
+}
+
 /**
  * Set serial parameters for the specified serial port.
  *
@@ -775,8 +894,9 @@ SR_PRIV int serial_stream_detect(struct sr_serial_dev_inst *serial,
 	uint64_t timeout_ms)
 {
 	uint64_t start, time, byte_delay_us;
-	size_t ibuf, i, maxlen;
+	size_t ibuf, i, maxlen, want;
 	ssize_t len;
+	GString *text;
 
 	maxlen = *buflen;
 
@@ -792,45 +912,48 @@ SR_PRIV int serial_stream_detect(struct sr_serial_dev_inst *serial,
 	byte_delay_us = serial_timeout(serial, 1) * 1000;
 	start = g_get_monotonic_time();
 
-	i = ibuf = len = 0;
+	i = ibuf = 0;
 	while (ibuf < maxlen) {
-		len = serial_read_nonblocking(serial, &buf[ibuf], 1);
+		time = g_get_monotonic_time() - start;
+		time /= 1000;
+		if (time >= timeout_ms) {
+			/* Timeout */
+			sr_dbg("Detection timed out after %" PRIu64 "ms.", time);
+			break;
+		}
+
+		/*
+		 * Wait for what is missing of a packet at the current
+		 * position, but don't read beyond it. Blocking reads return
+		 * as soon as that has arrived, there's no need to poll.
+		 */
+		want = MIN(i + packet_size - ibuf, maxlen - ibuf);
+		len = serial_read_blocking(serial, &buf[ibuf], want,
+			timeout_ms - time);
 		if (len > 0) {
 			ibuf += len;
-		} else if (len == 0) {
-			/* No logging, already done in serial_read(). */
-		} else {
-			/* Error reading byte, but continuing anyway. */
+		} else if (len < 0) {
+			/* Error reading, but continuing anyway. */
+			g_usleep(byte_delay_us);
 		}
+		if ((ibuf - i) < packet_size)
+			continue;
 
-		time = g_get_monotonic_time() - start;
-		time /= 1000;
-
-		if ((ibuf - i) >= packet_size) {
-			GString *text;
-			/* We have at least a packet's worth of data. */
+		/* We have a packet's worth of data. */
+		if (sr_log_enabled(SR_LOG_SPEW)) {
 			text = sr_hexdump_new(&buf[i], packet_size);
 			sr_spew("Trying packet: %s", text->str);
 			sr_hexdump_free(text);
-			if (is_valid(&buf[i])) {
-				sr_spew("Found valid %zu-byte packet after "
-					"%" PRIu64 "ms.", (ibuf - i), time);
-				*buflen = ibuf;
-				return SR_OK;
-			} else {
-				sr_spew("Got %zu bytes, but not a valid "
-					"packet.", (ibuf - i));
-			}
-			/* Not a valid packet. Continue searching. */
-			i++;
 		}
-		if (time >= timeout_ms) {
-			/* Timeout */
-			sr_dbg("Detection timed out after %" PRIu64 "ms.", time);
-			break;
+		if (is_valid(&buf[i])) {
+			sr_spew("Found valid %zu-byte packet after "
+				"%" PRIu64 "ms.", (ibuf - i), time);
+			*buflen = ibuf;
+			return SR_OK;
 		}
-		if (len < 1)
-			g_usleep(byte_delay_us);
+		sr_spew("Got %zu bytes, but not a valid packet.", (ibuf - i));
+		/* Not a valid packet. Continue searching. */
+		i++;
 	}
 
 	*buflen = ibuf;
@@ -964,9 +1087,199 @@ static GSList *append_port_list(GSList *devs, const char *name, const char *desc
 	return g_slist_append(devs, sr_serial_new(name, desc));
 }
 
+/*
+ * Port enumeration shared by a scan pass. Ports have no context to
+ * hang off, and the OS's list of them is process wide anyway.
+ */
+static struct {
+	GMutex mutex;
+	unsigned int users;
+	gboolean valid;
+	/* struct sr_serial_port of libserialport and HID ports. */
+	GSList *ports;
+	/* Port names by "vid:pid", see sr_serial_find_usb(). */
+	GHashTable *usb_ports;
+} port_cache;
+
+/* Bluetooth ports found by the thread sr_serial_bt_discovery_start() runs. */
+static struct {
+	GMutex mutex;
+	GCond cond;
+	GThread *thread;
+	gboolean stop;
+	GSList *ports;
+} bt_discovery;
+
+static void free_name_list(void *data)
+{
+	g_slist_free_full(data, g_free);
+}
+
+static GSList *copy_port_list(GSList *devs, const GSList *ports)
+{
+	const struct sr_serial_port *port;
+
+	for (; ports; ports = ports->next) {
+		port = ports->data;
+		devs = append_port_list(devs, port->name, port->description);
+	}
+
+	return devs;
+}
+
+static void port_cache_clear(void)
+{
+	g_slist_free_full(port_cache.ports, (GDestroyNotify)sr_serial_free);
+	port_cache.ports = NULL;
+	if (port_cache.usb_ports)
+		g_hash_table_remove_all(port_cache.usb_ports);
+	port_cache.valid = FALSE;
+}
+
+/**
+ * Start a scan pass for serial ports.
+ *
+ * Until the matching sr_serial_cache_end(), sr_serial_list() and
+ * sr_serial_find_usb() enumerate the ports only once, and return
+ * copies of that enumeration after. Passes can nest.
+ *
+ * @private
+ */
+SR_PRIV void sr_serial_cache_begin(void)
+{
+	g_mutex_lock(&port_cache.mutex);
+	port_cache.users++;
+	g_mutex_unlock(&port_cache.mutex);
+}
+
+/**
+ * End a scan pass which sr_serial_cache_begin() started.
+ *
+ * @private
+ */
+SR_PRIV void sr_serial_cache_end(void)
+{
+	g_mutex_lock(&port_cache.mutex);
+	if (port_cache.users && !--port_cache.users)
+		port_cache_clear();
+	g_mutex_unlock(&port_cache.mutex);
+}
+
+/**
+ * Drop the current pass's enumeration, since ports came or went.
+ *
+ * @private
+ */
+SR_PRIV void sr_serial_cache_invalidate(void)
+{
+	g_mutex_lock(&port_cache.mutex);
+	port_cache_clear();
+	g_mutex_unlock(&port_cache.mutex);
+}
+
+static gpointer bt_discovery_thread(gpointer data)
+{
+	GSList *ports;
+	gint64 end_time;
+
+	(void)data;
+
+	g_mutex_lock(&bt_discovery.mutex);
+	while (!bt_discovery.stop) {
+		/* The scan blocks for seconds, don't hold up the readers. */
+		g_mutex_unlock(&bt_discovery.mutex);
+		ports = ser_lib_funcs_bt->list(NULL, append_port_list);
+		g_mutex_lock(&bt_discovery.mutex);
+
+		g_slist_free_full(bt_discovery.ports,
+			(GDestroyNotify)sr_serial_free);
+		bt_discovery.ports = ports;
+		sr_dbg("Bluetooth discovery found %u ports.",
+			g_slist_length(ports));
+
+		end_time = g_get_monotonic_time() +
+			SERIAL_BT_DISCOVERY_INTERVAL * G_TIME_SPAN_SECOND;
+		while (!bt_discovery.stop && g_cond_wait_until(&bt_discovery.cond,
+				&bt_discovery.mutex, end_time))
+			;
+	}
+	g_mutex_unlock(&bt_discovery.mutex);
+
+	return NULL;
+}
+
+/**
+ * Start discovering Bluetooth serial ports in the background.
+ *
+ * Bluetooth (classic and BLE) discovery takes seconds, so sr_serial_list()
+ * does not do it unless asked to. Once started, a thread scans for
+ * devices periodically, and sr_serial_list() includes the ports the last
+ * round found without waiting for a scan. Until the first round has
+ * completed, no Bluetooth ports are listed.
+ *
+ * Ports which the user knows the address of can be opened all the same,
+ * without discovery.
+ *
+ * @retval SR_OK Success, also when discovery was running already.
+ * @retval SR_ERR_NA No Bluetooth support.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_serial_bt_discovery_start(void)
+{
+	if (!ser_lib_funcs_bt || !ser_lib_funcs_bt->list)
+		return SR_ERR_NA;
+
+	g_mutex_lock(&bt_discovery.mutex);
+	if (!bt_discovery.thread) {
+		bt_discovery.stop = FALSE;
+		bt_discovery.thread = g_thread_new("sr-bt-discovery",
+			bt_discovery_thread, NULL);
+	}
+	g_mutex_unlock(&bt_discovery.mutex);
+
+	return SR_OK;
+}
+
+/**
+ * Stop discovering Bluetooth serial ports.
+ *
+ * Waits for a scan round in progress to complete. The ports found so
+ * far are no longer listed by sr_serial_list().
+ *
+ * @retval SR_OK Success, also when no discovery was running.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_serial_bt_discovery_stop(void)
+{
+	GThread *thread;
+
+	g_mutex_lock(&bt_discovery.mutex);
+	thread = bt_discovery.thread;
+	bt_discovery.thread = NULL;
+	bt_discovery.stop = TRUE;
+	g_cond_signal(&bt_discovery.cond);
+	g_mutex_unlock(&bt_discovery.mutex);
+
+	if (thread)
+		g_thread_join(thread);
+
+	g_mutex_lock(&bt_discovery.mutex);
+	g_slist_free_full(bt_discovery.ports, (GDestroyNotify)sr_serial_free);
+	bt_discovery.ports = NULL;
+	g_mutex_unlock(&bt_discovery.mutex);
+
+	return SR_OK;
+}
+
 /**
  * List available serial devices.
  *
+ * Bluetooth ports are only included while sr_serial_bt_discovery_start()
+ * is in effect. Within a scan pass (see sr_scan_begin()), the ports are
+ * enumerated once only.
+ *
  * @return A GSList of strings containing the path of the serial devices or
  *         NULL if no serial device is found. The returned list must be freed
  *         by the caller.
@@ -979,19 +1292,31 @@ SR_API GSList *sr_serial_list(const struct sr_dev_driver *driver)
 	/* Currently unused, but will be used by some drivers later on. */
 	(void)driver;
 
-	tty_devs = NULL;
-	if (ser_lib_funcs_libsp && ser_lib_funcs_libsp->list) {
-		list_func = ser_lib_funcs_libsp->list;
-		tty_devs = list_func(tty_devs, append_port_list);
-	}
-	if (ser_lib_funcs_hid && ser_lib_funcs_hid->list) {
-		list_func = ser_lib_funcs_hid->list;
-		tty_devs = list_func(tty_devs, append_port_list);
-	}
-	if (ser_lib_funcs_bt && ser_lib_funcs_bt->list) {
-		list_func = ser_lib_funcs_bt->list;
-		tty_devs = list_func(tty_devs, append_port_list);
+	g_mutex_lock(&port_cache.mutex);
+	if (!port_cache.users || !port_cache.valid) {
+		tty_devs = NULL;
+		if (ser_lib_funcs_libsp && ser_lib_funcs_libsp->list) {
+			list_func = ser_lib_funcs_libsp->list;
+			tty_devs = list_func(tty_devs, append_port_list);
+		}
+		if (ser_lib_funcs_hid && ser_lib_funcs_hid->list) {
+			list_func = ser_lib_funcs_hid->list;
+			tty_devs = list_func(tty_devs, append_port_list);
+		}
+		if (port_cache.users) {
+			g_slist_free_full(port_cache.ports,
+				(GDestroyNotify)sr_serial_free);
+			port_cache.ports = tty_devs;
+			port_cache.valid = TRUE;
+		}
 	}
+	if (port_cache.users)
+		tty_devs = copy_port_list(NULL, port_cache.ports);
+	g_mutex_unlock(&port_cache.mutex);
+
+	g_mutex_lock(&bt_discovery.mutex);
+	tty_devs = copy_port_list(tty_devs, bt_discovery.ports);
+	g_mutex_unlock(&bt_discovery.mutex);
 
 	return tty_devs;
 }
@@ -1010,6 +1335,9 @@ static GSList *append_port_find(GSList *devs, const char *name)
  * @param[in] vendor_id Vendor ID of the USB device.
  * @param[in] product_id Product ID of the USB device.
  *
+ * Within a scan pass (see sr_scan_begin()), each ID pair is looked up
+ * once only.
+ *
  * @return A GSList of strings containing the path of the serial device or
  *         NULL if no serial device is found. The returned list must be freed
  *         by the caller.
@@ -1018,9 +1346,27 @@ static GSList *append_port_find(GSList *devs, const char *name)
  */
 SR_PRIV GSList *sr_serial_find_usb(uint16_t vendor_id, uint16_t product_id)
 {
-	GSList *tty_devs;
+	GSList *tty_devs, *cached;
 	GSList *(*find_func)(GSList *list, sr_ser_find_append_t append,
 			uint16_t vid, uint16_t pid);
+	char *key;
+
+	key = NULL;
+	g_mutex_lock(&port_cache.mutex);
+	if (port_cache.users) {
+		if (!port_cache.usb_ports)
+			port_cache.usb_ports = g_hash_table_new_full(g_str_hash,
+				g_str_equal, g_free, free_name_list);
+		key = g_strdup_printf("%04x:%04x", vendor_id, product_id);
+		if (g_hash_table_lookup_extended(port_cache.usb_ports, key,
+				NULL, (gpointer *)&cached)) {
+			tty_devs = g_slist_copy_deep(cached,
+				(GCopyFunc)g_strdup, NULL);
+			g_mutex_unlock(&port_cache.mutex);
+			g_free(key);
+			return tty_devs;
+		}
+	}
 
 	tty_devs = NULL;
 	if (ser_lib_funcs_libsp && ser_lib_funcs_libsp->find_usb) {
@@ -1034,6 +1380,12 @@ SR_PRIV GSList *sr_serial_find_usb(uint16_t vendor_id, uint16_t product_id)
 			vendor_id, product_id);
 	}
 
+	if (key) {
+		g_hash_table_insert(port_cache.usb_ports, key,
+			g_slist_copy_deep(tty_devs, (GCopyFunc)g_strdup, NULL));
+	}
+	g_mutex_unlock(&port_cache.mutex);
+
 	return tty_devs;
 }
 
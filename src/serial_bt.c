@@ -31,6 +31,8 @@
 
 #define SER_BT_CONN_PREFIX	"bt"
 #define SER_BT_CHUNK_SIZE	1200
+/* ATT MTU to request, fits 244 bytes of data per notification. */
+#define SER_BT_ATT_MTU		247
 
 /**
  * @file
@@ -352,6 +354,10 @@ static int ser_bt_open(struct sr_serial_dev_inst *serial, int flags)
 	case SER_BT_CONN_CC254x:
 		rc = sr_bt_config_notify(desc,
 			read_hdl, write_hdl, cccd_hdl, cccd_val);
+		if (rc < 0)
+			return SR_ERR;
+		/* Let modules which support it send larger notifications. */
+		rc = sr_bt_config_mtu(desc, SER_BT_ATT_MTU);
 		if (rc < 0)
 			return SR_ERR;
 		serial->bt_notify_handle_read = read_hdl;
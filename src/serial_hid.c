@@ -358,8 +358,11 @@ static int ser_hid_hidapi_open_dev(struct sr_serial_dev_inst *serial)
 	return SR_OK;
 }
 
+static void ser_hid_reader_stop(struct sr_serial_dev_inst *serial);
+
 static void ser_hid_hidapi_close_dev(struct sr_serial_dev_inst *serial)
 {
+	ser_hid_reader_stop(serial);
 	if (serial->hid_dev) {
 		hid_close(serial->hid_dev);
 		serial->hid_dev = NULL;
@@ -369,6 +372,152 @@ static void ser_hid_hidapi_close_dev(struct sr_serial_dev_inst *serial)
 	serial->hid_source_args = NULL;
 }
 
+/*
+ * HIDAPI has no file descriptor which the glib main loop could poll.
+ * While an event source is installed, a thread receives from the HID
+ * device instead, and has the main loop run the source's callback when
+ * data has arrived. HIDAPI permits one thread to read while another
+ * thread writes and exchanges feature reports, like chip support code
+ * does.
+ */
+#define SER_HID_READER_TIMEOUT_MS	100
+
+struct ser_hid_reader {
+	struct sr_serial_dev_inst *serial;
+	struct sr_session *session;
+	GThread *thread;
+	GMutex mutex;
+	GCond cond;
+	/* Data which was received but not yet taken, and read errors. */
+	GString *rx;
+	int error;
+	gboolean stop;
+};
+
+static gpointer ser_hid_reader_thread(gpointer data)
+{
+	struct ser_hid_reader *reader;
+	struct sr_serial_dev_inst *serial;
+	uint8_t rx_buf[SER_HID_CHUNK_SIZE];
+	int rc;
+
+	reader = data;
+	serial = reader->serial;
+
+	while (!g_atomic_int_get(&reader->stop)) {
+		rc = serial->hid_chip_funcs->read_bytes(serial,
+				rx_buf, sizeof(rx_buf), SER_HID_READER_TIMEOUT_MS);
+		if (rc == 0)
+			continue;
+		g_mutex_lock(&reader->mutex);
+		if (rc > 0)
+			g_string_append_len(reader->rx, (const gchar *)rx_buf, rc);
+		else
+			reader->error = rc;
+		g_cond_broadcast(&reader->cond);
+		g_mutex_unlock(&reader->mutex);
+		sr_session_source_notify(reader->session, serial);
+		if (rc < 0) {
+			sr_err("Error receiving from HID device.");
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static int ser_hid_reader_start(struct sr_serial_dev_inst *serial,
+	struct sr_session *session)
+{
+	struct ser_hid_reader *reader;
+	GError *error;
+
+	reader = g_malloc0(sizeof(*reader));
+	reader->serial = serial;
+	reader->session = session;
+	g_mutex_init(&reader->mutex);
+	g_cond_init(&reader->cond);
+	reader->rx = g_string_sized_new(SER_HID_CHUNK_SIZE);
+
+	/* Have the reader in place before its thread gets data. */
+	serial->hid_reader = reader;
+	error = NULL;
+	reader->thread = g_thread_try_new("serial-hid-rx",
+			ser_hid_reader_thread, reader, &error);
+	if (!reader->thread) {
+		sr_warn("Cannot start HID receive thread: %s.",
+			error->message);
+		g_error_free(error);
+		serial->hid_reader = NULL;
+		g_string_free(reader->rx, TRUE);
+		g_cond_clear(&reader->cond);
+		g_mutex_clear(&reader->mutex);
+		g_free(reader);
+		return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
+static void ser_hid_reader_stop(struct sr_serial_dev_inst *serial)
+{
+	struct ser_hid_reader *reader;
+
+	reader = serial->hid_reader;
+	if (!reader)
+		return;
+
+	g_atomic_int_set(&reader->stop, TRUE);
+	g_thread_join(reader->thread);
+	serial->hid_reader = NULL;
+
+	/* Keep data which was received already. */
+	if (reader->rx->len)
+		sr_ser_queue_rx_data(serial, (const uint8_t *)reader->rx->str,
+			reader->rx->len);
+	g_string_free(reader->rx, TRUE);
+	g_cond_clear(&reader->cond);
+	g_mutex_clear(&reader->mutex);
+	g_free(reader);
+}
+
+/*
+ * Get receive data like the chip's read_bytes() routine does, from the
+ * reader thread when one is running.
+ */
+static int ser_hid_read_bytes(struct sr_serial_dev_inst *serial,
+	uint8_t *data, int space, unsigned int timeout)
+{
+	struct ser_hid_reader *reader;
+	gint64 deadline_us;
+	int len;
+
+	reader = serial->hid_reader;
+	if (!reader)
+		return serial->hid_chip_funcs->read_bytes(serial,
+			data, space, timeout);
+
+	g_mutex_lock(&reader->mutex);
+	if (timeout) {
+		deadline_us = g_get_monotonic_time() + timeout * 1000LL;
+		while (!reader->rx->len && !reader->error) {
+			if (!g_cond_wait_until(&reader->cond, &reader->mutex,
+					deadline_us))
+				break;
+		}
+	}
+	len = MIN((size_t)space, reader->rx->len);
+	if (len) {
+		memcpy(data, reader->rx->str, len);
+		g_string_erase(reader->rx, 0, len);
+	} else if (reader->error) {
+		len = reader->error;
+	}
+	g_mutex_unlock(&reader->mutex);
+
+	return len;
+}
+
 struct hidapi_source_args_t {
 	/* Application callback. */
 	sr_receive_data_callback cb;
@@ -378,7 +527,8 @@ struct hidapi_source_args_t {
 };
 
 /*
- * Gets periodically invoked by the glib main loop. "Drives" (checks)
+ * Gets invoked by the glib main loop when the reader thread received
+ * data, or periodically when there is no reader thread. "Drives" (checks)
  * progress of USB communication, and invokes the application's callback
  * which processes RX data (when some has become available), as well as
  * handles application level timeouts.
@@ -398,7 +548,7 @@ static int hidapi_source_cb(int fd, int revents, void *cb_data)
 	 * application is expecting.
 	 */
 	do {
-		rc = args->serial->hid_chip_funcs->read_bytes(args->serial,
+		rc = ser_hid_read_bytes(args->serial,
 				rx_buf, sizeof(rx_buf), 0);
 		if (rc > 0) {
 			ser_hid_mask_databits(args->serial, rx_buf, rc);
@@ -429,9 +579,23 @@ static int ser_hid_hidapi_setup_source_add(struct sr_session *session,
 
 	(void)events;
 
-	/* Optionally enforce a minimum poll period. */
-	if (WITH_MAXIMUM_TIMEOUT_VALUE && timeout > WITH_MAXIMUM_TIMEOUT_VALUE)
-		timeout = WITH_MAXIMUM_TIMEOUT_VALUE;
+	if (serial->hid_reader) {
+		sr_err("Only one event source per HID device is supported.");
+		return SR_ERR_BUG;
+	}
+
+	/*
+	 * Optionally enforce a minimum poll period, when there is no
+	 * reader thread to have the callback run when data arrives.
+	 */
+	if (ser_hid_reader_start(serial, session) != SR_OK) {
+		if (timeout < 0) {
+			sr_err("Cannot poll HID device without timeout.");
+			return SR_ERR_ARG;
+		}
+		if (WITH_MAXIMUM_TIMEOUT_VALUE && timeout > WITH_MAXIMUM_TIMEOUT_VALUE)
+			timeout = WITH_MAXIMUM_TIMEOUT_VALUE;
+	}
 
 	/* Allocate status container for background data reception. */
 	args = g_malloc0(sizeof(*args));
@@ -440,14 +604,15 @@ static int ser_hid_hidapi_setup_source_add(struct sr_session *session,
 	args->serial = serial;
 
 	/*
-	 * Have a periodic timer installed. Register the allocated block
-	 * with the serial device, since the GSource's finalizer won't
-	 * free the memory, and we haven't bothered to create a custom
-	 * HIDAPI specific GSource.
+	 * Have a timer source installed, which the reader thread can
+	 * trigger. Register the allocated block with the serial device,
+	 * since the GSource's finalizer won't free the memory, and we
+	 * haven't bothered to create a custom HIDAPI specific GSource.
 	 */
-	rc = sr_session_source_add(session, -1, events, timeout,
+	rc = sr_session_fd_source_add(session, serial, -1, events, timeout,
 			hidapi_source_cb, args);
 	if (rc != SR_OK) {
+		ser_hid_reader_stop(serial);
 		g_free(args);
 		return rc;
 	}
@@ -459,13 +624,11 @@ static int ser_hid_hidapi_setup_source_add(struct sr_session *session,
 static int ser_hid_hidapi_setup_source_remove(struct sr_session *session,
 	struct sr_serial_dev_inst *serial)
 {
-	(void)serial;
-
-	(void)sr_session_source_remove(session, -1);
+	ser_hid_reader_stop(serial);
+	(void)sr_session_source_remove_internal(session, serial);
 	/*
-	 * Release callback args here already? Can there be more than
-	 * one source registered at any time, given that we pass fd -1
-	 * which is used as the key for the session?
+	 * Release callback args here already? The source might still
+	 * get dispatched before the main loop destroys it.
 	 */
 
 	return SR_OK;
@@ -1130,9 +1293,17 @@ static GSList *ser_hid_find_usb(GSList *list, sr_ser_find_append_t append,
 
 static int ser_hid_flush(struct sr_serial_dev_inst *serial)
 {
+	struct ser_hid_reader *reader;
+
 	if (!serial->hid_chip_funcs || !serial->hid_chip_funcs->flush)
 		return SR_ERR_NA;
 
+	if ((reader = serial->hid_reader)) {
+		g_mutex_lock(&reader->mutex);
+		g_string_truncate(reader->rx, 0);
+		g_mutex_unlock(&reader->mutex);
+	}
+
 	return serial->hid_chip_funcs->flush(serial);
 }
 
@@ -1252,7 +1423,7 @@ static int ser_hid_read(struct sr_serial_dev_inst *serial,
 		 * Check the HID transport for the availability of more
 		 * receive data.
 		 */
-		rc = serial->hid_chip_funcs->read_bytes(serial,
+		rc = ser_hid_read_bytes(serial,
 				buffer, sizeof(buffer), timeout_ms);
 		if (rc < 0) {
 			sr_dbg("DBG: %s() read error %d.", __func__, rc);
@@ -25,6 +25,12 @@
 #include <unistd.h>
 #include <string.h>
 #include <glib.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+#ifdef HAVE_SYS_TIMERFD_H
+#include <sys/timerfd.h>
+#endif
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
 
@@ -43,14 +49,220 @@
  *
  * Creating, using, or destroying libsigrok sessions.
  *
+ * Several sessions can run concurrently, each one in a thread of its
+ * own, typically one per device. A session's state is its own, and the
+ * datafeed of one session never waits for another one. The rules are:
+ *
+ * - A device belongs to a single session at a time, and a session's
+ *   functions are called from one thread at a time (the one running
+ *   it, or any other for sr_session_stop()).
+ * - Scanning with and clearing of different drivers can happen from
+ *   any thread. The device list of a driver (sr_dev_list()) must not
+ *   be walked while the same driver scans, or gets cleared, elsewhere.
+ * - Sessions which use USB devices share the context's libusb event
+ *   handling. With more than one session on a context, USB events get
+ *   handled by a thread of their own, and the datafeed of each session
+ *   is delivered from its queue. Create the sessions before starting
+ *   any of them.
+ * - Logging settings (sr_log_loglevel_set(), sr_log_callback_set())
+ *   are process wide, and may be changed while sessions run. The log
+ *   callback can be called from any of the sessions' threads.
+ *
  * @{
  */
 
 struct datafeed_callback {
 	sr_datafeed_callback cb;
 	void *cb_data;
+	/* See sr_session_datafeed_callback_add_filtered(). */
+	gboolean filtered;
+	uint32_t types;
+	const struct sr_dev_inst *sdi;
+	GSList *channels;
+	gboolean logic_channels;
+	/* Time spent in the callback during the session run, in usecs. */
+	uint64_t busy_us;
+	/* Age of the data it got, see sr_session_latency_trace_set(). */
+	struct latency_hist *latency;
+};
+
+/** @cond PRIVATE */
+/*
+ * Latencies are counted in buckets, exact up to LATENCY_LINEAR usecs,
+ * then in LATENCY_SUB buckets per power of two. Percentiles are thus
+ * accurate to within 1 / LATENCY_SUB.
+ */
+#define LATENCY_LINEAR 16
+#define LATENCY_SUB 8
+#define LATENCY_OCTAVES 36
+#define LATENCY_BUCKETS (LATENCY_LINEAR + LATENCY_OCTAVES * LATENCY_SUB)
+/** @endcond */
+
+struct latency_hist {
+	uint64_t count;
+	uint64_t max_us;
+	uint64_t buckets[LATENCY_BUCKETS];
+};
+
+/** @cond PRIVATE */
+/* Delivery queue depth used with the USB event thread, if none is set. */
+#define DATAFEED_QUEUE_DEFAULT_DEPTH 64
+/** @endcond */
+
+/**
+ * Datafeed packet as seen by datafeed callbacks.
+ *
+ * Every packet which is passed to a datafeed callback is embedded in
+ * this wrapper, which allows callbacks to keep a reference to it via
+ * sr_packet_ref(). Packets which were sent by the driver without a
+ * release hook are "borrowed" (refcount 0), their payload is only
+ * valid during the callback, and taking a reference creates a copy.
+ * Shared packets own their payload until the last reference is gone.
+ */
+struct shared_packet {
+	/* Must be the first member, callbacks only see this field. */
+	struct sr_datafeed_packet packet;
+	/* Points to the wrapper itself while it is valid. */
+	struct shared_packet *self;
+	gint refcount;
+	/* Whether the payload structs below are in use (shallow copy). */
+	gboolean own_payload;
+	GDestroyNotify release;
+	void *release_data;
+	/* Per-device sequence number, 0 if not numbered. */
+	uint64_t seq;
+	/* Whether timing holds the timing of a sample packet. */
+	gboolean timed;
+	struct sr_packet_timing timing;
+	/* Whether a trigger is marked in place, before sample trigger_at. */
+	gboolean triggered;
+	uint64_t trigger_at;
+	union {
+		struct sr_datafeed_logic logic;
+		struct sr_datafeed_logic_rle logic_rle;
+		struct {
+			struct sr_datafeed_analog analog;
+			struct sr_analog_encoding encoding;
+			struct sr_analog_meaning meaning;
+			struct sr_analog_spec spec;
+		} analog;
+	} payload;
+};
+
+/*
+ * Mark a wrapper as valid, until it gets freed or its delivery ends.
+ * The public packet functions only take valid wrappers, any other
+ * packet was not handed out by the session (e.g. one which an
+ * application built itself).
+ */
+static void shared_packet_track(struct shared_packet *sp)
+{
+	sp->self = sp;
+}
+
+static void shared_packet_untrack(struct shared_packet *sp)
+{
+	sp->self = NULL;
+}
+
+/*
+ * Wrap a packet which is only valid while it gets delivered. Must be
+ * undone with shared_packet_untrack() afterwards.
+ */
+static void shared_packet_borrow(struct shared_packet *sp,
+		const struct sr_datafeed_packet *packet)
+{
+	memset(sp, 0, sizeof(*sp));
+	sp->packet = *packet;
+	shared_packet_track(sp);
+}
+
+/** Item in the asynchronous datafeed delivery queue. */
+struct datafeed_queue_item {
+	const struct sr_dev_inst *sdi;
+	/* Referenced packet, or NULL to terminate the delivery thread. */
+	struct sr_datafeed_packet *packet;
+};
+
+/** Asynchronous datafeed delivery, see sr_session_datafeed_queue_set(). */
+struct datafeed_queue {
+	struct sr_session *session;
+	GThread *thread;
+	GAsyncQueue *queue;
+	/* Protects the fill level and counters, signals free space. */
+	GMutex mutex;
+	GCond cond;
+	size_t depth;
+	size_t fill;
+	size_t max_fill;
+	uint64_t dropped;
+	uint64_t stalled;
+};
+
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_TIMERFD_H)
+/** @cond PRIVATE */
+#define HAVE_SESSION_POLL
+/** @endcond */
+
+/**
+ * The main context's fds and timeout as one fd, see sr_session_poll_fd_get().
+ * The epoll fd watches the fds of the last query, and a timer for its
+ * timeout.
+ */
+struct session_poll {
+	int epfd;
+	int timerfd;
+	/* Context the fds were queried from, prepared but not checked yet. */
+	GMainContext *context;
+	int max_priority;
+	GPollFD *fds;
+	int num_fds;
+	int alloc_fds;
+};
+#endif
+
+/** Acquisition thread of one device, see sr_session_dev_threads_set(). */
+struct session_dev_thread {
+	struct sr_session *session;
+	struct sr_dev_inst *sdi;
+	/* The device's event sources are attached to this context. */
+	GMainContext *context;
+	GThread *thread;
+	gint quit;
+	/* Last sequence number assigned to a packet of this device. */
+	volatile gsize seq;
+};
+
+/*
+ * Consecutive SR_DF_ANALOG packets of one channel, which are sent as
+ * one packet. See sr_session_analog_batch_set().
+ */
+struct analog_batch {
+	const struct sr_dev_inst *sdi;
+	gint64 start_us;
+	/* Timing of the first packet in the batch. */
+	struct sr_packet_timing timing;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	uint32_t num_samples;
+	GByteArray *data;
 };
 
+/** @cond PRIVATE */
+/* Batches get sent at this size, regardless of their age. */
+#define ANALOG_BATCH_MAX_BYTES (64 * 1024)
+/** @endcond */
+
+/* Acquisition thread the calling thread belongs to, if any. */
+static GPrivate dev_thread_key = G_PRIVATE_INIT(NULL);
+
+/* FD source whose callback the calling thread runs, if any. */
+static GPrivate fd_source_key = G_PRIVATE_INIT(NULL);
+
+/* When the calling thread last received data, see sr_session_receive_mark(). */
+static GPrivate receive_time_key = G_PRIVATE_INIT(g_free);
+
 /** Custom GLib event source for generic descriptor I/O.
  * @see https://developer.gnome.org/glib/stable/glib-The-Main-Event-Loop.html
  */
@@ -59,6 +271,14 @@ struct fd_source {
 
 	int64_t timeout_us;
 	int64_t due_us;
+	/* Set by sr_session_source_wake_at() during the callback, or 0. */
+	int64_t wake_us;
+	/* Set by sr_session_source_notify(), from any thread. */
+	gint notified;
+	/* Timeouts, and how late they were dispatched in total and at most. */
+	uint64_t num_timeouts;
+	uint64_t latency_us;
+	uint64_t max_latency_us;
 
 	/* Meta-data needed to keep track of installed sources */
 	struct sr_session *session;
@@ -67,6 +287,17 @@ struct fd_source {
 	GPollFD pollfd;
 };
 
+/* Align a timeout to the session's timer slack grid. */
+static int64_t fd_source_align(const struct fd_source *fsource,
+		int64_t due_us)
+{
+	int64_t slack_us;
+
+	slack_us = fsource->session ? fsource->session->timer_slack_us : 0;
+
+	return sr_timer_slack_align(due_us, fsource->timeout_us, slack_us);
+}
+
 /** FD event source prepare() method.
  * This is called immediately before poll().
  */
@@ -83,12 +314,15 @@ static gboolean fd_source_prepare(GSource *source, int *timeout)
 
 		if (fsource->due_us == 0) {
 			/* First-time initialization of the expiration time */
-			fsource->due_us = now_us + fsource->timeout_us;
+			fsource->due_us = fd_source_align(fsource,
+				now_us + fsource->timeout_us);
 		}
 		remaining_ms = (MAX(0, fsource->due_us - now_us) + 999) / 1000;
 	} else {
 		remaining_ms = -1;
 	}
+	if (g_atomic_int_get(&fsource->notified))
+		remaining_ms = 0;
 	*timeout = remaining_ms;
 
 	return (remaining_ms == 0);
@@ -105,7 +339,8 @@ static gboolean fd_source_check(GSource *source)
 	fsource = (struct fd_source *)source;
 	revents = fsource->pollfd.revents;
 
-	return (revents != 0 || (fsource->timeout_us >= 0
+	return (revents != 0 || g_atomic_int_get(&fsource->notified)
+			|| (fsource->timeout_us >= 0
 			&& fsource->due_us <= g_source_get_time(source)));
 }
 
@@ -115,8 +350,10 @@ static gboolean fd_source_check(GSource *source)
 static gboolean fd_source_dispatch(GSource *source,
 		GSourceFunc callback, void *user_data)
 {
-	struct fd_source *fsource;
+	struct fd_source *fsource, *outer;
+	struct sr_session *session;
 	unsigned int revents;
+	int64_t late_us;
 	gboolean keep;
 
 	fsource = (struct fd_source *)source;
@@ -126,13 +363,42 @@ static gboolean fd_source_dispatch(GSource *source,
 		sr_err("Callback not set, cannot dispatch event.");
 		return G_SOURCE_REMOVE;
 	}
+
+	if (g_atomic_int_compare_and_exchange(&fsource->notified, TRUE, FALSE))
+		revents |= G_IO_IN;
+
+	if (!revents && fsource->timeout_us >= 0) {
+		late_us = MAX(0, g_get_monotonic_time() - fsource->due_us);
+		fsource->num_timeouts++;
+		fsource->latency_us += late_us;
+		fsource->max_latency_us = MAX(fsource->max_latency_us,
+			(uint64_t)late_us);
+		if ((session = fsource->session)) {
+			g_mutex_lock(&session->stats_mutex);
+			session->stats.source_timeouts++;
+			session->stats.source_latency_us += late_us;
+			session->stats.source_max_latency_us = MAX(
+				session->stats.source_max_latency_us,
+				(uint64_t)late_us);
+			g_mutex_unlock(&session->stats_mutex);
+		}
+	}
+	outer = g_private_get(&fd_source_key);
+	g_private_set(&fd_source_key, fsource);
+	fsource->wake_us = 0;
+	sr_session_receive_mark(0);
 	keep = (*SR_RECEIVE_DATA_CALLBACK(callback))
 			(fsource->pollfd.fd, revents, user_data);
+	g_private_set(&fd_source_key, outer);
 
 	if (fsource->timeout_us >= 0 && G_LIKELY(keep)
-			&& G_LIKELY(!g_source_is_destroyed(source)))
+			&& G_LIKELY(!g_source_is_destroyed(source))) {
 		fsource->due_us = g_source_get_time(source)
 				+ fsource->timeout_us;
+		if (fsource->wake_us && fsource->wake_us < fsource->due_us)
+			fsource->due_us = fsource->wake_us;
+		fsource->due_us = fd_source_align(fsource, fsource->due_us);
+	}
 	return keep;
 }
 
@@ -145,6 +411,12 @@ static void fd_source_finalize(GSource *source)
 	fsource = (struct fd_source *)source;
 
 	sr_dbg("%s: key %p", __func__, fsource->key);
+	if (fsource->num_timeouts)
+		sr_dbg("Source %p: %" PRIu64 " timeouts, dispatched %" PRIu64
+			" us late on average, %" PRIu64 " us at most.",
+			fsource->key, fsource->num_timeouts,
+			fsource->latency_us / fsource->num_timeouts,
+			fsource->max_latency_us);
 
 	sr_session_source_destroyed(fsource->session, fsource->key, source);
 }
@@ -199,995 +471,4215 @@ static GSource *fd_source_new(struct sr_session *session, void *key,
 	return source;
 }
 
-/**
- * Create a new session.
- *
- * @param ctx         The context in which to create the new session.
- * @param new_session This will contain a pointer to the newly created
- *                    session if the return value is SR_OK, otherwise the value
- *                    is undefined and should not be used. Must not be NULL.
- *
- * @retval SR_OK Success.
- * @retval SR_ERR_ARG Invalid argument.
- *
- * @since 0.4.0
- */
-SR_API int sr_session_new(struct sr_context *ctx,
-		struct sr_session **new_session)
+static int datafeed_deliver(const struct sr_dev_inst *sdi,
+		struct sr_datafeed_packet *packet);
+
+static gpointer datafeed_queue_thread(gpointer data)
 {
-	struct sr_session *session;
+	struct datafeed_queue *q;
+	struct datafeed_queue_item *item;
+	gboolean done;
+
+	q = data;
+	sr_thread_sched_apply(&q->session->thread_sched[
+		SR_SESSION_THREAD_DATAFEED - SR_SESSION_THREAD_MAIN], FALSE);
+
+	done = FALSE;
+	while (!done) {
+		item = g_async_queue_pop(q->queue);
+		if (item->packet) {
+			datafeed_deliver(item->sdi, item->packet);
+			sr_packet_unref(item->packet);
+		} else {
+			done = TRUE;
+		}
+		g_free(item);
 
-	if (!new_session)
-		return SR_ERR_ARG;
+		g_mutex_lock(&q->mutex);
+		if (q->fill > 0)
+			q->fill--;
+		g_cond_signal(&q->cond);
+		g_mutex_unlock(&q->mutex);
+	}
 
-	session = g_malloc0(sizeof(struct sr_session));
+	return NULL;
+}
 
-	session->ctx = ctx;
+static int datafeed_queue_create(struct sr_session *session, size_t depth)
+{
+	struct datafeed_queue *q;
 
-	g_mutex_init(&session->main_mutex);
+	if (session->df_queue) {
+		sr_err("Datafeed delivery thread already running.");
+		return SR_ERR_BUG;
+	}
 
-	/* To maintain API compatibility, we need a lookup table
-	 * which maps poll_object IDs to GSource* pointers.
+	q = g_malloc0(sizeof(*q));
+	q->session = session;
+	q->depth = depth;
+	q->queue = g_async_queue_new();
+	g_mutex_init(&q->mutex);
+	g_cond_init(&q->cond);
+
+	q->thread = g_thread_try_new("sr-datafeed", datafeed_queue_thread,
+		q, NULL);
+	if (!q->thread) {
+		sr_err("Cannot create datafeed delivery thread.");
+		g_async_queue_unref(q->queue);
+		g_mutex_clear(&q->mutex);
+		g_cond_clear(&q->cond);
+		g_free(q);
+		return SR_ERR;
+	}
+	session->df_queue = q;
+
+	sr_dbg("Started datafeed delivery thread (depth %zu).", q->depth);
+
+	return SR_OK;
+}
+
+static int datafeed_queue_start(struct sr_session *session)
+{
+	size_t depth;
+
+	depth = session->queue_depth;
+#ifdef HAVE_LIBUSB_1_0
+	/*
+	 * USB drivers send from the event thread then, don't run the
+	 * application's callbacks there.
 	 */
-	session->event_sources = g_hash_table_new(NULL, NULL);
+	if (!depth && session->ctx && session->ctx->usb_event_thread)
+		depth = DATAFEED_QUEUE_DEFAULT_DEPTH;
+#endif
+	/* Device threads must not run the callbacks concurrently. */
+	if (!depth && session->per_dev_threads)
+		depth = DATAFEED_QUEUE_DEFAULT_DEPTH;
+	if (!depth)
+		return SR_OK;
 
-	*new_session = session;
+	return datafeed_queue_create(session, depth);
+}
+
+/*
+ * Deliver all pending packets, then terminate the delivery thread.
+ * The counters of the last run remain available to the application.
+ */
+static void datafeed_queue_stop(struct sr_session *session)
+{
+	struct datafeed_queue *q;
+	struct datafeed_queue_item *item;
+
+	q = session->df_queue;
+	if (!q)
+		return;
+
+	item = g_malloc0(sizeof(*item));
+	g_mutex_lock(&q->mutex);
+	q->fill++;
+	g_mutex_unlock(&q->mutex);
+	g_async_queue_push(q->queue, item);
+	g_thread_join(q->thread);
+
+	session->queue_dropped = q->dropped;
+	session->queue_stalled = q->stalled;
+	session->queue_max_fill = q->max_fill;
+
+	g_async_queue_unref(q->queue);
+	g_mutex_clear(&q->mutex);
+	g_cond_clear(&q->cond);
+	g_free(q);
+	session->df_queue = NULL;
+
+	if (session->queue_dropped || session->queue_stalled)
+		sr_warn("Datafeed queue overruns: %" PRIu64 " packets dropped, "
+			"%" PRIu64 " times stalled.", session->queue_dropped,
+			session->queue_stalled);
+}
+
+static gboolean packet_is_droppable(const struct sr_datafeed_packet *packet)
+{
+	return packet->type == SR_DF_LOGIC || packet->type == SR_DF_ANALOG ||
+		packet->type == SR_DF_LOGIC_RLE;
+}
+
+static int datafeed_queue_push(struct datafeed_queue *q,
+		const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet)
+{
+	struct datafeed_queue_item *item;
+	struct sr_session *session;
+	struct sr_datafeed_packet *ref;
+
+	session = q->session;
+
+	g_mutex_lock(&q->mutex);
+	if (q->fill >= q->depth && packet_is_droppable(packet)) {
+		switch (session->queue_policy) {
+		case SR_SESSION_QUEUE_DROP:
+			q->dropped++;
+			g_mutex_unlock(&q->mutex);
+			return SR_OK;
+		case SR_SESSION_QUEUE_BLOCK:
+			q->stalled++;
+			while (q->fill >= q->depth)
+				g_cond_wait(&q->cond, &q->mutex);
+			break;
+		default:
+			/* SR_SESSION_QUEUE_GROW */
+			break;
+		}
+	}
+	q->fill++;
+	if (q->fill > q->max_fill)
+		q->max_fill = q->fill;
+	g_mutex_unlock(&q->mutex);
+
+	ref = sr_packet_ref(packet);
+	if (!ref) {
+		g_mutex_lock(&q->mutex);
+		q->fill--;
+		g_mutex_unlock(&q->mutex);
+		return SR_ERR;
+	}
+	item = g_malloc(sizeof(*item));
+	item->sdi = sdi;
+	item->packet = ref;
+	g_async_queue_push(q->queue, item);
 
 	return SR_OK;
 }
 
+/*
+ * While the devices of a session get started in parallel, the packets
+ * they send are held back, until all of them are armed.
+ */
+static gboolean start_hold(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet)
+{
+	struct sr_session *session;
+	struct datafeed_queue_item *item;
+	struct sr_datafeed_packet *ref;
+
+	session = sdi->session;
+	if (G_LIKELY(!g_atomic_int_get(&session->start_holding)))
+		return FALSE;
+
+	g_mutex_lock(&session->hold_mutex);
+	if (!session->start_holding) {
+		/* Released meanwhile, and all held packets delivered. */
+		g_mutex_unlock(&session->hold_mutex);
+		return FALSE;
+	}
+	if ((ref = sr_packet_ref(packet))) {
+		item = g_malloc(sizeof(*item));
+		item->sdi = sdi;
+		item->packet = ref;
+		session->held = g_slist_prepend(session->held, item);
+	}
+	g_mutex_unlock(&session->hold_mutex);
+
+	return TRUE;
+}
+
+/*
+ * Deliver the held packets in the order they were sent, then let
+ * packets through again. Packets which get sent while delivering are
+ * held as well, and delivered in the next round.
+ */
+static void start_release(struct sr_session *session, gboolean deliver)
+{
+	struct datafeed_queue_item *item;
+	GSList *held, *l;
+
+	for (;;) {
+		g_mutex_lock(&session->hold_mutex);
+		held = g_slist_reverse(session->held);
+		session->held = NULL;
+		if (!held)
+			g_atomic_int_set(&session->start_holding, FALSE);
+		g_mutex_unlock(&session->hold_mutex);
+		if (!held)
+			break;
+
+		for (l = held; l; l = l->next) {
+			item = l->data;
+			if (deliver && session->df_queue)
+				datafeed_queue_push(session->df_queue,
+					item->sdi, item->packet);
+			else if (deliver)
+				datafeed_deliver(item->sdi, item->packet);
+			sr_packet_unref(item->packet);
+			g_free(item);
+		}
+		g_slist_free(held);
+	}
+}
+
 /**
- * Destroy a session.
- * This frees up all memory used by the session.
+ * Deliver datafeed packets from a separate thread.
  *
- * @param session The session to destroy. Must not be NULL.
+ * By default, datafeed callbacks are invoked synchronously, in the
+ * context of the thread which runs the session (and usually from
+ * within the hardware driver's receive path). A slow callback then
+ * delays the acquisition. With a queue depth other than zero, packets
+ * are queued instead and get passed to the callbacks by a dedicated
+ * delivery thread. Callbacks must be thread-safe in that case.
+ *
+ * The policy determines what happens when the queue is full: the
+ * acquisition waits for the callbacks (SR_SESSION_QUEUE_BLOCK), sample
+ * data packets are discarded (SR_SESSION_QUEUE_DROP), or the queue
+ * grows beyond its depth (SR_SESSION_QUEUE_GROW). Non-data packets
+ * like SR_DF_HEADER or SR_DF_END are never discarded.
+ *
+ * The session's transforms run in the delivery thread as well, which
+ * takes them off the acquisition path. Transforms still see all packets
+ * in their original order.
+ *
+ * All queued packets are delivered before the session's stopped
+ * callback runs, or sr_session_run() returns.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param depth Maximum number of queued packets, or 0 to disable.
+ * @param policy One of enum sr_session_queue_policy.
  *
  * @retval SR_OK Success.
- * @retval SR_ERR_ARG Invalid session passed.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR The session is currently running.
  *
- * @since 0.4.0
+ * @since 0.6.0
  */
-SR_API int sr_session_destroy(struct sr_session *session)
+SR_API int sr_session_datafeed_queue_set(struct sr_session *session,
+		size_t depth, int policy)
 {
 	if (!session) {
 		sr_err("%s: session was NULL", __func__);
 		return SR_ERR_ARG;
 	}
 
-	sr_session_dev_remove_all(session);
-	g_slist_free_full(session->owned_devs, (GDestroyNotify)sr_dev_inst_free);
-
-	sr_session_datafeed_callback_remove_all(session);
-
-	g_hash_table_unref(session->event_sources);
+	switch (policy) {
+	case SR_SESSION_QUEUE_BLOCK:
+	case SR_SESSION_QUEUE_DROP:
+	case SR_SESSION_QUEUE_GROW:
+		break;
+	default:
+		sr_err("%s: invalid queue policy %d", __func__, policy);
+		return SR_ERR_ARG;
+	}
 
-	g_mutex_clear(&session->main_mutex);
+	if (session->running) {
+		sr_err("Cannot change the datafeed queue of a running session.");
+		return SR_ERR;
+	}
 
-	g_free(session);
+	session->queue_depth = depth;
+	session->queue_policy = policy;
 
 	return SR_OK;
 }
 
 /**
- * Remove all the devices from a session.
+ * Have the session's datafeed callbacks receive run-length encoded data.
  *
- * The session itself (i.e., the struct sr_session) is not free'd and still
- * exists after this function returns.
+ * When enabled, drivers and input modules which produce
+ * SR_DF_LOGIC_RLE packets have them passed to the datafeed callbacks
+ * unmodified. Otherwise (the default), and whenever transform modules
+ * are active, these packets are expanded into SR_DF_LOGIC packets.
  *
  * @param session The session to use. Must not be NULL.
+ * @param enable TRUE if all datafeed callbacks handle SR_DF_LOGIC_RLE.
  *
  * @retval SR_OK Success.
- * @retval SR_ERR_BUG Invalid session passed.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR The session is currently running.
  *
- * @since 0.4.0
+ * @since 0.6.0
  */
-SR_API int sr_session_dev_remove_all(struct sr_session *session)
+SR_API int sr_session_logic_rle_set(struct sr_session *session,
+		gboolean enable)
 {
-	struct sr_dev_inst *sdi;
-	GSList *l;
-
 	if (!session) {
 		sr_err("%s: session was NULL", __func__);
 		return SR_ERR_ARG;
 	}
 
-	for (l = session->devs; l; l = l->next) {
-		sdi = (struct sr_dev_inst *) l->data;
-		sdi->session = NULL;
+	if (session->running) {
+		sr_err("Cannot change the datafeed format of a running session.");
+		return SR_ERR;
 	}
 
-	g_slist_free(session->devs);
-	session->devs = NULL;
+	session->logic_rle = enable;
 
 	return SR_OK;
 }
 
 /**
- * Add a device instance to a session.
+ * Have drivers send all analog channels of a frame in one packet.
  *
- * @param session The session to add to. Must not be NULL.
- * @param sdi The device instance to add to a session. Must not
- *            be NULL. Also, sdi->driver and sdi->driver->dev_open must
- *            not be NULL.
+ * Oscilloscope drivers send one SR_DF_ANALOG packet per channel and
+ * frame by default. When enabled, drivers which support it send the
+ * channels of a frame in a single packet instead, with the values of
+ * all channels interleaved (one value per channel of
+ * sr_analog_meaning.channels for every sample). These packets reach
+ * callbacks filtered to any of their channels.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param enable TRUE if all datafeed callbacks handle SR_DF_ANALOG
+ *               packets with several channels.
  *
  * @retval SR_OK Success.
  * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR The session is currently running.
  *
- * @since 0.4.0
+ * @since 0.6.0
  */
-SR_API int sr_session_dev_add(struct sr_session *session,
-		struct sr_dev_inst *sdi)
+SR_API int sr_session_analog_interleave_set(struct sr_session *session,
+		gboolean enable)
 {
-	int ret;
-
-	if (!sdi) {
-		sr_err("%s: sdi was NULL", __func__);
-		return SR_ERR_ARG;
-	}
-
 	if (!session) {
 		sr_err("%s: session was NULL", __func__);
 		return SR_ERR_ARG;
 	}
 
-	/* If sdi->session is not NULL, the device is already in this or
-	 * another session. */
-	if (sdi->session) {
-		sr_err("%s: already assigned to session", __func__);
-		return SR_ERR_ARG;
+	if (session->running) {
+		sr_err("Cannot change the datafeed format of a running session.");
+		return SR_ERR;
 	}
 
-	/* If sdi->driver is NULL, this is a virtual device. */
-	if (!sdi->driver) {
-		/* Just add the device, don't run dev_open(). */
-		session->devs = g_slist_append(session->devs, sdi);
-		sdi->session = session;
-		return SR_OK;
+	session->analog_interleaved = enable;
+
+	return SR_OK;
+}
+
+/**
+ * Have triggers marked in the sample packets instead of splitting them.
+ *
+ * When a trigger fires in the middle of the data which a driver has at
+ * hand, the driver sends the samples before the trigger, SR_DF_TRIGGER,
+ * and the samples from the trigger on. When enabled, drivers which
+ * support it send their data in one SR_DF_LOGIC or SR_DF_ANALOG packet
+ * which carries the trigger position instead, see
+ * sr_packet_trigger_get(). Without this, and while transforms are set
+ * up, the session splits these packets for the callbacks.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param enable TRUE if all datafeed callbacks check sample packets
+ *               with sr_packet_trigger_get().
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR The session is currently running.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_trigger_inplace_set(struct sr_session *session,
+		gboolean enable)
+{
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
 	}
 
-	/* sdi->driver is non-NULL (i.e. we have a real device). */
-	if (!sdi->driver->dev_open) {
-		sr_err("%s: sdi->driver->dev_open was NULL", __func__);
-		return SR_ERR_BUG;
+	if (session->running) {
+		sr_err("Cannot change the datafeed format of a running session.");
+		return SR_ERR;
 	}
 
-	session->devs = g_slist_append(session->devs, sdi);
-	sdi->session = session;
-
-	/* TODO: This is invalid if the session runs in a different thread.
-	 * The usage semantics and restrictions need to be documented.
-	 */
-	if (session->running) {
-		/* Adding a device to a running session. Commit settings
-		 * and start acquisition on that device now. */
-		if ((ret = sr_config_commit(sdi)) != SR_OK) {
-			sr_err("Failed to commit device settings before "
-			       "starting acquisition in running session (%s)",
-			       sr_strerror(ret));
-			return ret;
-		}
-		if ((ret = sr_dev_acquisition_start(sdi)) != SR_OK) {
-			sr_err("Failed to start acquisition of device in "
-			       "running session (%s)", sr_strerror(ret));
-			return ret;
-		}
-	}
+	session->trigger_inplace = enable;
 
 	return SR_OK;
 }
 
 /**
- * List all device instances attached to a session.
+ * Run the acquisition of each device in a thread of its own.
+ *
+ * By default the event sources of all devices are dispatched by the
+ * session's main context. When enabled, every device of the session
+ * gets its own main context and thread instead, so that the devices
+ * of a multi-device session do not delay each other. The packets of
+ * all devices are passed to the datafeed callbacks by the datafeed
+ * delivery thread (see sr_session_datafeed_queue_set()), one at a
+ * time, and carry per-device sequence numbers (see
+ * sr_packet_sequence_get()).
+ *
+ * The session's main context still handles the session stop, and the
+ * stopped callback runs there.
  *
  * @param session The session to use. Must not be NULL.
- * @param devlist A pointer where the device instance list will be
- *                stored on return. If no devices are in the session,
- *                this will be NULL. Each element in the list points
- *                to a struct sr_dev_inst *.
- *                The list must be freed by the caller, but not the
- *                elements pointed to.
+ * @param enable TRUE to run one acquisition thread per device.
  *
  * @retval SR_OK Success.
  * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR The session is currently running.
  *
- * @since 0.4.0
+ * @since 0.6.0
  */
-SR_API int sr_session_dev_list(struct sr_session *session, GSList **devlist)
+SR_API int sr_session_dev_threads_set(struct sr_session *session,
+		gboolean enable)
 {
-	if (!session)
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
 		return SR_ERR_ARG;
+	}
 
-	if (!devlist)
-		return SR_ERR_ARG;
+	if (session->running) {
+		sr_err("Cannot change the threading of a running session.");
+		return SR_ERR;
+	}
 
-	*devlist = g_slist_copy(session->devs);
+	session->per_dev_threads = enable;
 
 	return SR_OK;
 }
 
 /**
- * Remove a device instance from a session.
+ * Start the devices of a session in parallel.
  *
- * @param session The session to remove from. Must not be NULL.
- * @param sdi The device instance to remove from a session. Must not
- *            be NULL. Also, sdi->driver and sdi->driver->dev_open must
- *            not be NULL.
+ * By default sr_session_start() starts one device after another, so a
+ * multi-device session takes as long to arm as all its devices
+ * together, and the devices start skewed in time. When enabled, all
+ * devices get started at the same time, each from a thread of its own.
+ * Data only flows once every device has been armed: packets which the
+ * drivers send while starting are held back until then, and the
+ * acquisition threads (see sr_session_dev_threads_set()) only start
+ * afterwards. When a device fails to start, the others are stopped
+ * again.
+ *
+ * The drivers' start routines then run concurrently, which not all of
+ * them may be prepared for when several devices share a driver. The
+ * time each device took to start is available from
+ * sr_session_dev_arm_time_get().
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param enable TRUE to start the devices in parallel.
  *
  * @retval SR_OK Success.
  * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR The session is currently running.
  *
- * @since 0.4.0
+ * @since 0.6.0
  */
-SR_API int sr_session_dev_remove(struct sr_session *session,
-		struct sr_dev_inst *sdi)
+SR_API int sr_session_parallel_start_set(struct sr_session *session,
+		gboolean enable)
 {
-	if (!sdi) {
-		sr_err("%s: sdi was NULL", __func__);
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
 		return SR_ERR_ARG;
 	}
 
+	if (session->running) {
+		sr_err("Cannot change the device start of a running session.");
+		return SR_ERR;
+	}
+
+	session->parallel_start = enable;
+
+	return SR_OK;
+}
+
+/**
+ * Combine consecutive analog packets of a channel into larger packets.
+ *
+ * Drivers of low rate instruments (like multimeters and power supplies)
+ * send one SR_DF_ANALOG packet per reading. When batching is enabled,
+ * consecutive packets with the same device, channel, encoding, meaning
+ * and spec are passed to transforms and datafeed callbacks as a single
+ * packet with multiple samples. A batch is sent once it is about
+ * @a max_delay_ms old (at most one and a half times that). Any other
+ * packet of the device flushes its pending batches first, so the order
+ * of a channel's data relative to other packet types is kept. Only
+ * packets for a single channel are batched.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param max_delay_ms The latency budget in milliseconds, 0 disables
+ *                     batching (the default).
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR The session is currently running.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_analog_batch_set(struct sr_session *session,
+		unsigned int max_delay_ms)
+{
 	if (!session) {
 		sr_err("%s: session was NULL", __func__);
 		return SR_ERR_ARG;
 	}
 
-	/* If sdi->session is not session, the device is not in this
-	 * session. */
-	if (sdi->session != session) {
-		sr_err("%s: not assigned to this session", __func__);
-		return SR_ERR_ARG;
+	if (session->running) {
+		sr_err("Cannot change analog batching of a running session.");
+		return SR_ERR;
 	}
 
-	session->devs = g_slist_remove(session->devs, sdi);
-	sdi->session = NULL;
+	session->analog_batch_ms = max_delay_ms;
 
 	return SR_OK;
 }
 
 /**
- * Remove all datafeed callbacks in a session.
+ * Let the timeouts of event sources be late, so they wake up together.
+ *
+ * Drivers of low rate instruments (like multimeters, scales and power
+ * supplies) wake up at their own intervals, which adds up with many
+ * devices in a session. With timer slack, each timeout of an event
+ * source is delayed to the end of a slot of @a slack_ms milliseconds,
+ * so that all timeouts within a slot are handled by a single wakeup.
+ * Sources whose timeout is shorter than the slack are not affected.
+ * How late the timeouts were dispatched is part of the session's
+ * statistics (see sr_session_stats_get()).
  *
  * @param session The session to use. Must not be NULL.
+ * @param slack_ms The slot size in milliseconds, 0 disables timer slack
+ *                 (the default).
  *
  * @retval SR_OK Success.
- * @retval SR_ERR_ARG Invalid session passed.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR The session is currently running.
  *
- * @since 0.4.0
+ * @since 0.6.0
  */
-SR_API int sr_session_datafeed_callback_remove_all(struct sr_session *session)
+SR_API int sr_session_timer_slack_set(struct sr_session *session,
+		unsigned int slack_ms)
 {
 	if (!session) {
 		sr_err("%s: session was NULL", __func__);
 		return SR_ERR_ARG;
 	}
 
-	g_slist_free_full(session->datafeed_callbacks, g_free);
-	session->datafeed_callbacks = NULL;
+	if (session->running) {
+		sr_err("Cannot change the timer slack of a running session.");
+		return SR_ERR;
+	}
+
+	session->timer_slack_us = 1000 * (int64_t)slack_ms;
 
 	return SR_OK;
 }
 
 /**
- * Add a datafeed callback to a session.
+ * Set the CPU affinity and scheduling of one of the session's threads.
+ *
+ * Pinning the threads which move sample data to CPUs of their own, and
+ * giving them real-time priority, keeps background load from delaying
+ * them into USB overruns. The settings get applied when the thread
+ * starts (for SR_SESSION_THREAD_MAIN, when sr_session_run() gets
+ * called, until it returns). Real-time policies usually need extra
+ * permissions (CAP_SYS_NICE, RLIMIT_RTPRIO); without them, the thread
+ * runs with its default settings, and a warning gets logged.
+ *
+ * The USB event thread is shared by the sessions of a context, the
+ * session which starts it determines its settings.
  *
  * @param session The session to use. Must not be NULL.
- * @param cb Function to call when a chunk of data is received.
- *           Must not be NULL.
- * @param cb_data Opaque pointer passed in by the caller.
+ * @param thread Which thread, one of enum sr_session_thread.
+ * @param sched The settings, NULL to leave the thread alone (the default).
  *
  * @retval SR_OK Success.
- * @retval SR_ERR_BUG No session exists.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR The session is currently running.
  *
- * @since 0.3.0
+ * @since 0.6.0
  */
-SR_API int sr_session_datafeed_callback_add(struct sr_session *session,
-		sr_datafeed_callback cb, void *cb_data)
+SR_API int sr_session_thread_sched_set(struct sr_session *session,
+		int thread, const struct sr_thread_sched *sched)
 {
-	struct datafeed_callback *cb_struct;
+	struct sr_thread_sched *dst;
 
 	if (!session) {
 		sr_err("%s: session was NULL", __func__);
-		return SR_ERR_BUG;
+		return SR_ERR_ARG;
 	}
 
-	if (!cb) {
-		sr_err("%s: cb was NULL", __func__);
+	if (thread < SR_SESSION_THREAD_MAIN
+			|| thread > SR_SESSION_THREAD_USB_EVENTS)
 		return SR_ERR_ARG;
-	}
 
-	cb_struct = g_malloc0(sizeof(struct datafeed_callback));
-	cb_struct->cb = cb;
-	cb_struct->cb_data = cb_data;
+	if (sched && (sched->policy < SR_SCHED_DEFAULT
+			|| sched->policy > SR_SCHED_RR))
+		return SR_ERR_ARG;
 
-	session->datafeed_callbacks =
-	    g_slist_append(session->datafeed_callbacks, cb_struct);
+	if (session->running) {
+		sr_err("Cannot change the threads of a running session.");
+		return SR_ERR;
+	}
+
+	dst = &session->thread_sched[thread - SR_SESSION_THREAD_MAIN];
+	if (sched)
+		*dst = *sched;
+	else
+		memset(dst, 0, sizeof(*dst));
 
 	return SR_OK;
 }
 
 /**
- * Get the trigger assigned to this session.
+ * Lock the process' memory into RAM while the session runs.
  *
- * @param session The session to use.
+ * Sample buffers which get paged out stall the thread that touches
+ * them next. With this enabled, all current and future memory of the
+ * process is locked (mlockall()) from sr_session_start() until the
+ * acquisition ends, with several sessions for as long as any of them
+ * runs. Without the permission for it (RLIMIT_MEMLOCK, CAP_IPC_LOCK),
+ * a warning gets logged and the session runs all the same.
  *
- * @retval NULL Invalid (NULL) session was passed to the function.
- * @retval other The trigger assigned to this session (can be NULL).
+ * @param session The session to use. Must not be NULL.
+ * @param enable TRUE to lock memory, FALSE not to (the default).
  *
- * @since 0.4.0
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR The session is currently running.
+ *
+ * @since 0.6.0
  */
-SR_API struct sr_trigger *sr_session_trigger_get(struct sr_session *session)
+SR_API int sr_session_mem_lock_set(struct sr_session *session,
+		gboolean enable)
 {
-	if (!session)
-		return NULL;
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
 
-	return session->trigger;
+	if (session->running) {
+		sr_err("Cannot change memory locking of a running session.");
+		return SR_ERR;
+	}
+
+	session->mem_lock = enable;
+
+	return SR_OK;
 }
 
 /**
- * Set the trigger of this session.
+ * Enable or disable tracing of the data's age.
+ *
+ * While enabled, the session measures how old sample data is when
+ * each datafeed callback gets it. The age counts from when the driver
+ * received the data (the USB transfer's completion, or the serial or
+ * SCPI read), across the datafeed queue and the transforms. The
+ * results are available per device from sr_session_dev_latency_get(),
+ * and per callback from sr_session_stats_get().
  *
  * @param session The session to use. Must not be NULL.
- * @param trig The trigger to assign to this session. Can be NULL.
+ * @param enable Whether to trace the data's age.
  *
  * @retval SR_OK Success.
  * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR The session is running.
  *
- * @since 0.4.0
+ * @since 0.6.0
  */
-SR_API int sr_session_trigger_set(struct sr_session *session, struct sr_trigger *trig)
+SR_API int sr_session_latency_trace_set(struct sr_session *session,
+		gboolean enable)
 {
-	if (!session)
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
 		return SR_ERR_ARG;
+	}
 
-	session->trigger = trig;
+	if (session->running) {
+		sr_err("Cannot change latency tracing of a running session.");
+		return SR_ERR;
+	}
+
+	session->latency_trace = enable;
 
 	return SR_OK;
 }
 
-static int verify_trigger(struct sr_trigger *trigger)
+static void latency_hist_add(struct latency_hist *h, int64_t age_us)
 {
-	struct sr_trigger_stage *stage;
-	struct sr_trigger_match *match;
-	GSList *l, *m;
+	uint64_t v;
+	unsigned int idx, octave;
 
-	if (!trigger->stages) {
-		sr_err("No trigger stages defined.");
-		return SR_ERR;
+	v = MAX(age_us, 0);
+	if (v < LATENCY_LINEAR) {
+		idx = v;
+	} else {
+		/* Octave 0 is [16, 32), in buckets of two usecs. */
+		octave = 0;
+		while ((v >> octave) >= 2 * LATENCY_LINEAR)
+			octave++;
+		idx = LATENCY_LINEAR + octave * LATENCY_SUB +
+			((v >> (octave + 1)) & (LATENCY_SUB - 1));
+		idx = MIN(idx, LATENCY_BUCKETS - 1);
 	}
+	h->buckets[idx]++;
+	h->count++;
+	h->max_us = MAX(h->max_us, v);
+}
 
-	sr_spew("Checking trigger:");
-	for (l = trigger->stages; l; l = l->next) {
-		stage = l->data;
-		if (!stage->matches) {
-			sr_err("Stage %d has no matches defined.", stage->stage);
-			return SR_ERR;
-		}
-		for (m = stage->matches; m; m = m->next) {
-			match = m->data;
-			if (!match->channel) {
-				sr_err("Stage %d match has no channel.", stage->stage);
-				return SR_ERR;
-			}
-			if (!match->match) {
-				sr_err("Stage %d match is not defined.", stage->stage);
-				return SR_ERR;
-			}
-			sr_spew("Stage %d match on channel %s, match %d", stage->stage,
-					match->channel->name, match->match);
-		}
+/* The upper bound of the bucket which holds the given share (in ppm). */
+static uint64_t latency_hist_percentile(const struct latency_hist *h,
+		uint64_t ppm)
+{
+	uint64_t rank, seen, upper;
+	unsigned int idx, octave, sub;
+
+	rank = (h->count * ppm + 999999) / 1000000;
+	seen = 0;
+	for (idx = 0; idx < LATENCY_BUCKETS; idx++) {
+		seen += h->buckets[idx];
+		if (seen >= rank && seen)
+			break;
+	}
+	if (idx < LATENCY_LINEAR) {
+		upper = idx;
+	} else {
+		octave = (idx - LATENCY_LINEAR) / LATENCY_SUB;
+		sub = (idx - LATENCY_LINEAR) % LATENCY_SUB;
+		upper = ((uint64_t)(LATENCY_SUB + sub + 1) << (octave + 1)) - 1;
 	}
 
-	return SR_OK;
+	return MIN(upper, h->max_us);
 }
 
-/** Set up the main context the session will be executing in.
+static void latency_stats_fill(const struct latency_hist *h,
+		struct sr_latency_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	if (!h || !h->count)
+		return;
+	stats->count = h->count;
+	stats->p50_us = latency_hist_percentile(h, 500000);
+	stats->p99_us = latency_hist_percentile(h, 990000);
+	stats->max_us = h->max_us;
+}
+
+/**
+ * Get the age of a device's data when the datafeed callbacks got it.
  *
- * Must be called just before the session starts, by the thread which
- * will execute the session main loop. Once acquired, the main context
- * pointer is immutable for the duration of the session run.
+ * This is measured when the first callback gets a packet, see
+ * sr_session_latency_trace_set(). The counts are reset when the
+ * session starts.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param sdi The device. Must not be NULL.
+ * @param stats The statistics are stored here. Must not be NULL. All
+ *              zero if nothing was traced.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
  */
-static int set_main_context(struct sr_session *session)
+SR_API int sr_session_dev_latency_get(struct sr_session *session,
+		const struct sr_dev_inst *sdi, struct sr_latency_stats *stats)
 {
-	GMainContext *main_context;
-
-	g_mutex_lock(&session->main_mutex);
-
-	/* May happen if sr_session_start() is called a second time
-	 * while the session is still running.
-	 */
-	if (session->main_context) {
-		sr_err("Main context already set.");
-
-		g_mutex_unlock(&session->main_mutex);
-		return SR_ERR;
-	}
-	main_context = g_main_context_ref_thread_default();
-	/*
-	 * Try to use an existing main context if possible, but only if we
-	 * can make it owned by the current thread. Otherwise, create our
-	 * own main context so that event source callbacks can execute in
-	 * the session thread.
-	 */
-	if (g_main_context_acquire(main_context)) {
-		g_main_context_release(main_context);
-
-		sr_dbg("Using thread-default main context.");
-	} else {
-		g_main_context_unref(main_context);
-
-		sr_dbg("Creating our own main context.");
-		main_context = g_main_context_new();
+	if (!session || !sdi || !stats) {
+		sr_err("%s: invalid argument", __func__);
+		return SR_ERR_ARG;
 	}
-	session->main_context = main_context;
 
-	g_mutex_unlock(&session->main_mutex);
+	g_mutex_lock(&session->stats_mutex);
+	latency_stats_fill(g_hash_table_lookup(session->dev_latency, sdi),
+		stats);
+	g_mutex_unlock(&session->stats_mutex);
 
 	return SR_OK;
 }
 
-/** Unset the main context used for the current session run.
+/**
+ * Get the time a device took to start acquisition.
  *
- * Must be called right after stopping the session. Note that if the
- * session is stopped asynchronously, the main loop may still be running
- * after the main context has been unset. This is OK as long as no new
- * event sources are created -- the main loop holds its own reference
- * to the main context.
+ * This is how long the driver's start routine for the device ran in
+ * the last sr_session_start() call, from the start request until the
+ * device was armed. With sr_session_parallel_start_set(), the devices'
+ * times overlap.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param sdi The device instance. Must not be NULL.
+ * @param arm_us The time in microseconds. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA The device was not started by the session.
+ *
+ * @since 0.6.0
  */
-static int unset_main_context(struct sr_session *session)
+SR_API int sr_session_dev_arm_time_get(struct sr_session *session,
+		const struct sr_dev_inst *sdi, uint64_t *arm_us)
 {
-	int ret;
+	uint64_t *us;
 
-	g_mutex_lock(&session->main_mutex);
-
-	if (session->main_context) {
-		g_main_context_unref(session->main_context);
-		session->main_context = NULL;
-		ret = SR_OK;
-	} else {
-		/* May happen if the set/unset calls are not matched.
-		 */
-		sr_err("No main context to unset.");
-		ret = SR_ERR;
+	if (!session || !sdi || !arm_us) {
+		sr_err("%s: invalid argument", __func__);
+		return SR_ERR_ARG;
 	}
-	g_mutex_unlock(&session->main_mutex);
-
-	return ret;
-}
-
-static unsigned int session_source_attach(struct sr_session *session,
-		GSource *source)
-{
-	unsigned int id = 0;
-
-	g_mutex_lock(&session->main_mutex);
-
-	if (session->main_context)
-		id = g_source_attach(source, session->main_context);
-	else
-		sr_err("Cannot add event source without main context.");
 
-	g_mutex_unlock(&session->main_mutex);
+	g_mutex_lock(&session->stats_mutex);
+	us = g_hash_table_lookup(session->dev_arm_us, sdi);
+	if (us)
+		*arm_us = *us;
+	g_mutex_unlock(&session->stats_mutex);
 
-	return id;
+	return us ? SR_OK : SR_ERR_NA;
 }
 
-/* Idle handler; invoked when the number of registered event sources
- * for a running session drops to zero.
+/**
+ * Record when the calling thread received data from a device.
+ *
+ * Drivers' data paths call this after receiving (the core's USB, serial
+ * and SCPI helpers do it for them). Packets which the thread sends
+ * afterwards are stamped with this time, instead of the time they were
+ * sent, see struct sr_packet_timing. The mark is cleared when the next
+ * event source callback of the session runs.
+ *
+ * @param time The time from g_get_monotonic_time(), 0 to clear.
+ *
+ * @private
  */
-static gboolean delayed_stop_check(void *data)
+SR_PRIV void sr_session_receive_mark(int64_t time)
 {
-	struct sr_session *session;
-
-	session = data;
-	session->stop_check_id = 0;
-
-	/* Session already ended? */
-	if (!session->running)
-		return G_SOURCE_REMOVE;
-
-	/* New event sources may have been installed in the meantime. */
-	if (g_hash_table_size(session->event_sources) != 0)
-		return G_SOURCE_REMOVE;
-
-	session->running = FALSE;
-	unset_main_context(session);
-
-	sr_info("Stopped.");
-
-	/* This indicates a bug in user code, since it is not valid to
-	 * restart or destroy a session while it may still be running.
-	 */
-	if (!session->main_loop && !session->stopped_callback) {
-		sr_err("BUG: Session stop left unhandled.");
-		return G_SOURCE_REMOVE;
+	int64_t *mark;
+
+	mark = g_private_get(&receive_time_key);
+	if (!mark) {
+		if (!time)
+			return;
+		mark = g_malloc(sizeof(*mark));
+		g_private_set(&receive_time_key, mark);
 	}
-	if (session->main_loop)
-		g_main_loop_quit(session->main_loop);
-
-	if (session->stopped_callback)
-		(*session->stopped_callback)(session->stopped_cb_data);
-
-	return G_SOURCE_REMOVE;
+	*mark = time;
 }
 
-static int stop_check_later(struct sr_session *session)
+static int64_t receive_mark_get(void)
 {
-	GSource *source;
-	unsigned int source_id;
-
-	if (session->stop_check_id != 0)
-		return SR_OK; /* idle handler already installed */
+	int64_t *mark;
 
-	source = g_idle_source_new();
-	g_source_set_callback(source, &delayed_stop_check, session, NULL);
-
-	source_id = session_source_attach(session, source);
-	session->stop_check_id = source_id;
+	mark = g_private_get(&receive_time_key);
 
-	g_source_unref(source);
+	return mark ? *mark : 0;
+}
 
-	return (source_id != 0) ? SR_OK : SR_ERR;
+static void session_mem_unlock(struct sr_session *session)
+{
+	if (!session->mem_locked)
+		return;
+	sr_mem_lock_release();
+	session->mem_locked = FALSE;
 }
 
 /**
- * Start a session.
- *
- * When this function returns with a status code indicating success, the
- * session is running. Use sr_session_stopped_callback_set() to receive
- * notification upon completion, or call sr_session_run() to block until
- * the session stops.
- *
- * Session events will be processed in the context of the current thread.
- * If a thread-default GLib main context has been set, and is not owned by
- * any other thread, it will be used. Otherwise, libsigrok will create its
- * own main context for the current thread.
+ * Get the datafeed queue statistics of the last session run.
  *
  * @param session The session to use. Must not be NULL.
+ * @param dropped Number of discarded packets. Can be NULL.
+ * @param stalled Number of times the acquisition had to wait for
+ *                the callbacks. Can be NULL.
+ * @param max_fill Highest number of queued packets. Can be NULL.
  *
  * @retval SR_OK Success.
- * @retval SR_ERR_ARG Invalid session passed.
- * @retval SR_ERR Other error.
+ * @retval SR_ERR_ARG Invalid argument.
  *
- * @since 0.4.0
+ * @since 0.6.0
  */
-SR_API int sr_session_start(struct sr_session *session)
+SR_API int sr_session_datafeed_queue_stats_get(struct sr_session *session,
+		uint64_t *dropped, uint64_t *stalled, size_t *max_fill)
 {
-	struct sr_dev_inst *sdi;
-	struct sr_channel *ch;
-	GSList *l, *c, *lend;
-	int ret;
+	struct datafeed_queue *q;
 
 	if (!session) {
 		sr_err("%s: session was NULL", __func__);
 		return SR_ERR_ARG;
 	}
 
-	if (!session->devs) {
-		sr_err("%s: session->devs was NULL; a session "
-		       "cannot be started without devices.", __func__);
-		return SR_ERR_ARG;
-	}
-
-	if (session->running) {
-		sr_err("Cannot (re-)start session while it is still running.");
-		return SR_ERR;
-	}
-
-	if (session->trigger) {
-		ret = verify_trigger(session->trigger);
-		if (ret != SR_OK)
-			return ret;
-	}
-
-	/* Check enabled channels and commit settings of all devices. */
-	for (l = session->devs; l; l = l->next) {
-		sdi = l->data;
-		for (c = sdi->channels; c; c = c->next) {
-			ch = c->data;
-			if (ch->enabled)
-				break;
-		}
-		if (!c) {
-			sr_err("%s device %s has no enabled channels.",
-				sdi->driver->name, sdi->connection_id);
-			return SR_ERR;
-		}
-
-		ret = sr_config_commit(sdi);
-		if (ret != SR_OK) {
-			sr_err("Failed to commit %s device %s settings "
-				"before starting acquisition.",
-				sdi->driver->name, sdi->connection_id);
-			return ret;
-		}
-	}
-
-	ret = set_main_context(session);
-	if (ret != SR_OK)
-		return ret;
-
-	sr_info("Starting.");
-
-	session->running = TRUE;
-
-	/* Have all devices start acquisition. */
-	for (l = session->devs; l; l = l->next) {
-		if (!(sdi = l->data)) {
-			sr_err("Device sdi was NULL, can't start session.");
-			ret = SR_ERR;
-			break;
-		}
-		ret = sr_dev_acquisition_start(sdi);
-		if (ret != SR_OK) {
-			sr_err("Could not start %s device %s acquisition.",
-				sdi->driver->name, sdi->connection_id);
-			break;
-		}
-	}
-
-	if (ret != SR_OK) {
-		/* If there are multiple devices, some of them may already have
-		 * started successfully. Stop them now before returning. */
-		lend = l->next;
-		for (l = session->devs; l != lend; l = l->next) {
-			sdi = l->data;
-			sr_dev_acquisition_stop(sdi);
-		}
-		/* TODO: Handle delayed stops. Need to iterate the event
-		 * sources... */
-		session->running = FALSE;
-
-		unset_main_context(session);
-		return ret;
+	q = session->df_queue;
+	if (q) {
+		g_mutex_lock(&q->mutex);
+		if (dropped)
+			*dropped = q->dropped;
+		if (stalled)
+			*stalled = q->stalled;
+		if (max_fill)
+			*max_fill = q->max_fill;
+		g_mutex_unlock(&q->mutex);
+	} else {
+		if (dropped)
+			*dropped = session->queue_dropped;
+		if (stalled)
+			*stalled = session->queue_stalled;
+		if (max_fill)
+			*max_fill = session->queue_max_fill;
 	}
 
-	if (g_hash_table_size(session->event_sources) == 0)
-		stop_check_later(session);
-
 	return SR_OK;
 }
 
 /**
- * Block until the running session stops.
+ * Get the performance counters of the current or last session run.
  *
- * This is a convenience function which creates a GLib main loop and runs
- * it to process session events until the session stops.
- *
- * Instead of using this function, applications may run their own GLib main
- * loop, and use sr_session_stopped_callback_set() to receive notification
- * when the session finished running.
+ * The counters are maintained by the core, they are reset when the
+ * session starts. They can be read while the session is running.
  *
  * @param session The session to use. Must not be NULL.
+ * @param stats Pointer to store the counters in. Must not be NULL.
+ *              Must be freed by the caller with sr_session_stats_free().
  *
  * @retval SR_OK Success.
- * @retval SR_ERR_ARG Invalid session passed.
- * @retval SR_ERR Other error.
+ * @retval SR_ERR_ARG Invalid argument.
  *
- * @since 0.4.0
+ * @since 0.6.0
  */
-SR_API int sr_session_run(struct sr_session *session)
+SR_API int sr_session_stats_get(struct sr_session *session,
+		struct sr_session_stats **stats)
 {
-	if (!session) {
-		sr_err("%s: session was NULL", __func__);
+	struct sr_session_stats *s;
+	struct datafeed_callback *cb_struct;
+	struct sr_transform *t;
+	GSList *l;
+	size_t i;
+
+	if (!session || !stats) {
+		sr_err("%s: invalid argument", __func__);
 		return SR_ERR_ARG;
 	}
-	if (!session->running) {
-		sr_err("No session running.");
-		return SR_ERR;
-	}
-	if (session->main_loop) {
-		sr_err("Main loop already created.");
-		return SR_ERR;
-	}
 
-	g_mutex_lock(&session->main_mutex);
+	s = g_malloc0(sizeof(*s));
 
-	if (!session->main_context) {
-		sr_err("Cannot run without main context.");
-		g_mutex_unlock(&session->main_mutex);
-		return SR_ERR;
+	g_mutex_lock(&session->stats_mutex);
+	*s = session->stats;
+	s->num_transforms = g_slist_length(session->transforms);
+	s->transform_us = g_malloc0_n(s->num_transforms + 1,
+		sizeof(*s->transform_us));
+	for (l = session->transforms, i = 0; l; l = l->next, i++) {
+		t = l->data;
+		s->transform_us[i] = t->busy_us;
 	}
-	session->main_loop = g_main_loop_new(session->main_context, FALSE);
-
-	g_mutex_unlock(&session->main_mutex);
+	s->num_callbacks = g_slist_length(session->datafeed_callbacks);
+	s->callback_us = g_malloc0_n(s->num_callbacks + 1,
+		sizeof(*s->callback_us));
+	s->callback_latency = g_malloc0_n(s->num_callbacks + 1,
+		sizeof(*s->callback_latency));
+	for (l = session->datafeed_callbacks, i = 0; l; l = l->next, i++) {
+		cb_struct = l->data;
+		s->callback_us[i] = cb_struct->busy_us;
+		latency_stats_fill(cb_struct->latency, &s->callback_latency[i]);
+	}
+	g_mutex_unlock(&session->stats_mutex);
 
-	g_main_loop_run(session->main_loop);
+	sr_session_datafeed_queue_stats_get(session, &s->queue_dropped,
+		&s->queue_stalled, &s->queue_max_fill);
 
-	g_main_loop_unref(session->main_loop);
-	session->main_loop = NULL;
+	*stats = s;
 
 	return SR_OK;
 }
 
-static gboolean session_stop_sync(void *user_data)
+/**
+ * Free the counters returned by sr_session_stats_get().
+ *
+ * @param stats The counters to free. Can be NULL.
+ *
+ * @since 0.6.0
+ */
+SR_API void sr_session_stats_free(struct sr_session_stats *stats)
 {
-	struct sr_session *session;
-	struct sr_dev_inst *sdi;
-	GSList *node;
-
-	session = user_data;
+	if (!stats)
+		return;
 
-	if (!session->running)
-		return G_SOURCE_REMOVE;
+	g_free(stats->transform_us);
+	g_free(stats->callback_us);
+	g_free(stats->callback_latency);
+	g_free(stats);
+}
 
-	sr_info("Stopping.");
+static void session_stats_reset(struct sr_session *session)
+{
+	struct datafeed_callback *cb_struct;
+	struct sr_transform *t;
+	GSList *l;
 
-	for (node = session->devs; node; node = node->next) {
-		sdi = node->data;
-		sr_dev_acquisition_stop(sdi);
+	g_mutex_lock(&session->stats_mutex);
+	memset(&session->stats, 0, sizeof(session->stats));
+	for (l = session->transforms; l; l = l->next) {
+		t = l->data;
+		t->busy_us = 0;
 	}
-
-	return G_SOURCE_REMOVE;
+	for (l = session->datafeed_callbacks; l; l = l->next) {
+		cb_struct = l->data;
+		cb_struct->busy_us = 0;
+		g_free(cb_struct->latency);
+		cb_struct->latency = NULL;
+	}
+	g_hash_table_remove_all(session->dev_latency);
+	g_hash_table_remove_all(session->dev_arm_us);
+	g_mutex_unlock(&session->stats_mutex);
 }
 
-/**
- * Stop a session.
- *
- * This requests the drivers of each device participating in the session to
- * abort the acquisition as soon as possible. Even after this function returns,
- * event processing still continues until all devices have actually stopped.
- *
- * Use sr_session_stopped_callback_set() to receive notification when the event
- * processing finished.
- *
- * This function is reentrant. That is, it may be called from a different
- * thread than the one executing the session, as long as it can be ensured
- * that the session object is valid.
+static void session_stats_count(struct sr_session *session,
+		const struct sr_datafeed_packet *packet)
+{
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_logic_rle *rle;
+	const struct sr_datafeed_analog *analog;
+	unsigned int idx;
+	uint64_t bytes;
+
+	if (packet->type < SR_DF_HEADER ||
+			packet->type >= SR_DF_HEADER + SR_DF_NUM_TYPES)
+		return;
+
+	switch (packet->type) {
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		bytes = logic->length;
+		break;
+	case SR_DF_LOGIC_RLE:
+		rle = packet->payload;
+		bytes = rle->num_runs * (rle->unitsize + sizeof(*rle->counts));
+		break;
+	case SR_DF_ANALOG:
+		analog = packet->payload;
+		bytes = (uint64_t)analog->num_samples * analog->encoding->unitsize;
+		break;
+	default:
+		bytes = 0;
+		break;
+	}
+
+	idx = packet->type - SR_DF_HEADER;
+	g_mutex_lock(&session->stats_mutex);
+	session->stats.packets[idx]++;
+	session->stats.bytes[idx] += bytes;
+	g_mutex_unlock(&session->stats_mutex);
+}
+
+/*
+ * Work out the timing of a sample packet, see sr_packet_timing_get().
+ * Logic samples are counted per device, analog samples per channel. A
+ * sender provided first sample index moves the count ahead (or back),
+ * e.g. when the driver knows that samples were lost. Returns FALSE for
+ * packets without samples.
+ */
+static gboolean packet_timing_fill(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet,
+		const struct sr_packet_timing *given,
+		struct sr_packet_timing *timing)
+{
+	struct sr_session *session;
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_logic_rle *rle;
+	const struct sr_datafeed_analog *analog;
+	const void *key;
+	uint64_t num_samples, i, *count;
+	GSList *l;
+
+	session = sdi->session;
+
+	switch (packet->type) {
+	case SR_DF_HEADER:
+		/* Counting starts over with every acquisition. */
+		g_mutex_lock(&session->stats_mutex);
+		g_hash_table_remove(session->sample_counts, sdi);
+		for (l = sdi->channels; l; l = l->next)
+			g_hash_table_remove(session->sample_counts, l->data);
+		g_mutex_unlock(&session->stats_mutex);
+		return FALSE;
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		key = sdi;
+		num_samples = logic->unitsize ? logic->length / logic->unitsize : 0;
+		break;
+	case SR_DF_LOGIC_RLE:
+		rle = packet->payload;
+		key = sdi;
+		num_samples = 0;
+		for (i = 0; i < rle->num_runs; i++)
+			num_samples += rle->counts[i];
+		break;
+	case SR_DF_ANALOG:
+		analog = packet->payload;
+		if (!analog->meaning || !analog->meaning->channels)
+			return FALSE;
+		key = analog->meaning->channels->data;
+		num_samples = analog->num_samples;
+		break;
+	default:
+		return FALSE;
+	}
+
+	if (given)
+		*timing = *given;
+	else
+		memset(timing, 0, sizeof(*timing));
+	if (!timing->host_time)
+		timing->host_time = receive_mark_get();
+	if (!timing->host_time)
+		timing->host_time = g_get_monotonic_time();
+
+	g_mutex_lock(&session->stats_mutex);
+	count = g_hash_table_lookup(session->sample_counts, key);
+	if (!count) {
+		count = g_malloc0(sizeof(*count));
+		g_hash_table_insert(session->sample_counts, (void *)key, count);
+	}
+	if (!given)
+		timing->first_sample = *count;
+	*count = timing->first_sample + num_samples;
+	g_mutex_unlock(&session->stats_mutex);
+
+	return TRUE;
+}
+
+#ifdef HAVE_SESSION_POLL
+static void session_poll_timer_set(struct session_poll *sp, int timeout)
+{
+	struct itimerspec its;
+
+	/* An all zero expiry would disarm the timer. */
+	memset(&its, 0, sizeof(its));
+	if (timeout == 0) {
+		its.it_value.tv_nsec = 1;
+	} else if (timeout > 0) {
+		its.it_value.tv_sec = timeout / 1000;
+		its.it_value.tv_nsec = (timeout % 1000) * 1000 * 1000;
+	}
+	timerfd_settime(sp->timerfd, 0, &its, NULL);
+}
+
+static void session_poll_clear(struct session_poll *sp)
+{
+	int i;
+
+	for (i = 0; i < sp->num_fds; i++)
+		epoll_ctl(sp->epfd, EPOLL_CTL_DEL, sp->fds[i].fd, NULL);
+	sp->num_fds = 0;
+	session_poll_timer_set(sp, -1);
+
+	if (sp->context) {
+		g_main_context_unref(sp->context);
+		sp->context = NULL;
+	}
+}
+
+/* Sources can poll the same fd, epoll takes it once with all events. */
+static uint32_t session_poll_events(const struct session_poll *sp, int idx,
+		gboolean *seen)
+{
+	uint32_t events;
+	int i;
+
+	events = 0;
+	*seen = FALSE;
+	for (i = 0; i <= idx; i++) {
+		if (sp->fds[i].fd != sp->fds[idx].fd)
+			continue;
+		if (i < idx)
+			*seen = TRUE;
+		if (sp->fds[i].events & G_IO_IN)
+			events |= EPOLLIN;
+		if (sp->fds[i].events & G_IO_OUT)
+			events |= EPOLLOUT;
+		if (sp->fds[i].events & G_IO_PRI)
+			events |= EPOLLPRI;
+	}
+
+	return events;
+}
+
+/* Prepare the context's next iteration and watch what it polls for. */
+static void session_poll_arm(struct session_poll *sp, GMainContext *context)
+{
+	struct epoll_event ev;
+	gboolean seen;
+	int timeout, num, i;
+
+	session_poll_clear(sp);
+
+	g_main_context_prepare(context, &sp->max_priority);
+	while ((num = g_main_context_query(context, sp->max_priority,
+			&timeout, sp->fds, sp->alloc_fds)) > sp->alloc_fds) {
+		sp->fds = g_renew(GPollFD, sp->fds, num);
+		sp->alloc_fds = num;
+	}
+	sp->num_fds = num;
+	sp->context = g_main_context_ref(context);
+
+	for (i = 0; i < num; i++) {
+		memset(&ev, 0, sizeof(ev));
+		ev.events = session_poll_events(sp, i, &seen);
+		if (epoll_ctl(sp->epfd, seen ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+				sp->fds[i].fd, &ev) == 0)
+			continue;
+		/* Regular files and the like are always ready, keep polling. */
+		sr_spew("Cannot watch fd %d: %s.", sp->fds[i].fd,
+			g_strerror(errno));
+		timeout = 0;
+	}
+	session_poll_timer_set(sp, timeout);
+}
+
+static void session_poll_free(struct session_poll *sp)
+{
+	if (!sp)
+		return;
+
+	session_poll_clear(sp);
+	close(sp->timerfd);
+	close(sp->epfd);
+	g_free(sp->fds);
+	g_free(sp);
+}
+#else
+static void session_poll_free(struct session_poll *sp)
+{
+	(void)sp;
+}
+#endif
+
+/**
+ * Create a new session.
  *
- * If the session is not running, sr_session_stop() silently does nothing.
+ * @param ctx         The context in which to create the new session.
+ * @param new_session This will contain a pointer to the newly created
+ *                    session if the return value is SR_OK, otherwise the value
+ *                    is undefined and should not be used. Must not be NULL.
  *
- * @param session The session to use. Must not be NULL.
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.4.0
+ */
+SR_API int sr_session_new(struct sr_context *ctx,
+		struct sr_session **new_session)
+{
+	struct sr_session *session;
+
+	if (!new_session)
+		return SR_ERR_ARG;
+
+	session = g_malloc0(sizeof(struct sr_session));
+
+	session->ctx = ctx;
+
+	/* A second session in the context needs USB events off its loop. */
+	if (ctx && g_atomic_int_add(&ctx->num_sessions, 1) >= 1) {
+#ifdef HAVE_LIBUSB_1_0
+		if (!ctx->usb_event_thread) {
+			sr_info("Several sessions, handling USB events in a "
+				"separate thread.");
+			ctx->usb_event_thread = TRUE;
+		}
+#endif
+	}
+
+	g_mutex_init(&session->main_mutex);
+	g_rec_mutex_init(&session->sources_mutex);
+	g_mutex_init(&session->stats_mutex);
+	g_rec_mutex_init(&session->batch_mutex);
+
+	/* To maintain API compatibility, we need a lookup table
+	 * which maps poll_object IDs to GSource* pointers.
+	 */
+	session->event_sources = g_hash_table_new(NULL, NULL);
+	session->sample_counts = g_hash_table_new_full(NULL, NULL,
+		NULL, g_free);
+	session->dev_latency = g_hash_table_new_full(NULL, NULL,
+		NULL, g_free);
+	session->dev_arm_us = g_hash_table_new_full(NULL, NULL,
+		NULL, g_free);
+	g_mutex_init(&session->hold_mutex);
+
+	session->queue_policy = SR_SESSION_QUEUE_BLOCK;
+
+	*new_session = session;
+
+	return SR_OK;
+}
+
+/**
+ * Destroy a session.
+ * This frees up all memory used by the session.
+ *
+ * @param session The session to destroy. Must not be NULL.
  *
  * @retval SR_OK Success.
  * @retval SR_ERR_ARG Invalid session passed.
  *
  * @since 0.4.0
  */
-SR_API int sr_session_stop(struct sr_session *session)
+SR_API int sr_session_destroy(struct sr_session *session)
 {
-	GMainContext *main_context;
-
 	if (!session) {
 		sr_err("%s: session was NULL", __func__);
 		return SR_ERR_ARG;
 	}
 
-	g_mutex_lock(&session->main_mutex);
+	datafeed_queue_stop(session);
+	session_poll_free(session->poll);
 
-	main_context = (session->main_context)
-		? g_main_context_ref(session->main_context)
-		: NULL;
+	sr_session_dev_remove_all(session);
+	g_slist_free_full(session->owned_devs, (GDestroyNotify)sr_dev_inst_free);
 
-	g_mutex_unlock(&session->main_mutex);
+	sr_session_datafeed_callback_remove_all(session);
+	g_free(session->callback_plan);
+	g_free(session->transform_plan);
 
-	if (!main_context) {
-		sr_dbg("No main context set; already stopped?");
-		/* Not an error; as it would be racy. */
-		return SR_OK;
-	}
-	g_main_context_invoke(main_context, &session_stop_sync, session);
-	g_main_context_unref(main_context);
+	g_hash_table_unref(session->event_sources);
+	g_hash_table_unref(session->sample_counts);
+	g_hash_table_unref(session->dev_latency);
+	g_hash_table_unref(session->dev_arm_us);
+	g_mutex_clear(&session->hold_mutex);
+
+	g_rec_mutex_clear(&session->sources_mutex);
+	g_mutex_clear(&session->stats_mutex);
+	g_rec_mutex_clear(&session->batch_mutex);
+	g_mutex_clear(&session->main_mutex);
+
+	if (session->ctx)
+		g_atomic_int_add(&session->ctx->num_sessions, -1);
+
+	g_free(session);
 
 	return SR_OK;
 }
 
 /**
- * Return whether the session is currently running.
+ * Remove all the devices from a session.
  *
- * Note that this function should be called from the same thread
- * the session was started in.
+ * The session itself (i.e., the struct sr_session) is not free'd and still
+ * exists after this function returns.
  *
  * @param session The session to use. Must not be NULL.
  *
- * @retval TRUE Session is running.
- * @retval FALSE Session is not running.
- * @retval SR_ERR_ARG Invalid session passed.
+ * @retval SR_OK Success.
+ * @retval SR_ERR_BUG Invalid session passed.
  *
  * @since 0.4.0
  */
-SR_API int sr_session_is_running(struct sr_session *session)
+SR_API int sr_session_dev_remove_all(struct sr_session *session)
 {
+	struct sr_dev_inst *sdi;
+	GSList *l;
+
 	if (!session) {
 		sr_err("%s: session was NULL", __func__);
 		return SR_ERR_ARG;
 	}
-	return session->running;
+
+	for (l = session->devs; l; l = l->next) {
+		sdi = (struct sr_dev_inst *) l->data;
+		sdi->session = NULL;
+	}
+
+	g_slist_free(session->devs);
+	session->devs = NULL;
+
+	return SR_OK;
+}
+
+/**
+ * Add a device instance to a session.
+ *
+ * @param session The session to add to. Must not be NULL.
+ * @param sdi The device instance to add to a session. Must not
+ *            be NULL. Also, sdi->driver and sdi->driver->dev_open must
+ *            not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.4.0
+ */
+SR_API int sr_session_dev_add(struct sr_session *session,
+		struct sr_dev_inst *sdi)
+{
+	int ret;
+
+	if (!sdi) {
+		sr_err("%s: sdi was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+
+	/* If sdi->session is not NULL, the device is already in this or
+	 * another session. */
+	if (sdi->session) {
+		sr_err("%s: already assigned to session", __func__);
+		return SR_ERR_ARG;
+	}
+
+	/* If sdi->driver is NULL, this is a virtual device. */
+	if (!sdi->driver) {
+		/* Just add the device, don't run dev_open(). */
+		session->devs = g_slist_append(session->devs, sdi);
+		sdi->session = session;
+		return SR_OK;
+	}
+
+	/* sdi->driver is non-NULL (i.e. we have a real device). */
+	if (!sdi->driver->dev_open) {
+		sr_err("%s: sdi->driver->dev_open was NULL", __func__);
+		return SR_ERR_BUG;
+	}
+
+	session->devs = g_slist_append(session->devs, sdi);
+	sdi->session = session;
+
+	/* TODO: This is invalid if the session runs in a different thread.
+	 * The usage semantics and restrictions need to be documented.
+	 */
+	if (session->running) {
+		/* Adding a device to a running session. Commit settings
+		 * and start acquisition on that device now. */
+		if ((ret = sr_config_commit(sdi)) != SR_OK) {
+			sr_err("Failed to commit device settings before "
+			       "starting acquisition in running session (%s)",
+			       sr_strerror(ret));
+			return ret;
+		}
+		if ((ret = sr_dev_acquisition_start(sdi)) != SR_OK) {
+			sr_err("Failed to start acquisition of device in "
+			       "running session (%s)", sr_strerror(ret));
+			return ret;
+		}
+	}
+
+	return SR_OK;
+}
+
+/**
+ * List all device instances attached to a session.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param devlist A pointer where the device instance list will be
+ *                stored on return. If no devices are in the session,
+ *                this will be NULL. Each element in the list points
+ *                to a struct sr_dev_inst *.
+ *                The list must be freed by the caller, but not the
+ *                elements pointed to.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.4.0
+ */
+SR_API int sr_session_dev_list(struct sr_session *session, GSList **devlist)
+{
+	if (!session)
+		return SR_ERR_ARG;
+
+	if (!devlist)
+		return SR_ERR_ARG;
+
+	*devlist = g_slist_copy(session->devs);
+
+	return SR_OK;
+}
+
+/**
+ * Remove a device instance from a session.
+ *
+ * @param session The session to remove from. Must not be NULL.
+ * @param sdi The device instance to remove from a session. Must not
+ *            be NULL. Also, sdi->driver and sdi->driver->dev_open must
+ *            not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.4.0
+ */
+SR_API int sr_session_dev_remove(struct sr_session *session,
+		struct sr_dev_inst *sdi)
+{
+	if (!sdi) {
+		sr_err("%s: sdi was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+
+	/* If sdi->session is not session, the device is not in this
+	 * session. */
+	if (sdi->session != session) {
+		sr_err("%s: not assigned to this session", __func__);
+		return SR_ERR_ARG;
+	}
+
+	session->devs = g_slist_remove(session->devs, sdi);
+	sdi->session = NULL;
+
+	return SR_OK;
+}
+
+/**
+ * Rebuild the arrays of datafeed callbacks and transforms which packets
+ * get passed through, after either list changed.
+ *
+ * The lists must not change while the session is running.
+ *
+ * @param session The session. Must not be NULL.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_plan_update(struct sr_session *session)
+{
+	GSList *l;
+	unsigned int i;
+
+	g_free(session->callback_plan);
+	session->num_callback_plan = g_slist_length(session->datafeed_callbacks);
+	session->callback_plan = g_malloc_n(session->num_callback_plan + 1,
+		sizeof(*session->callback_plan));
+	session->callback_types = 0;
+	for (l = session->datafeed_callbacks, i = 0; l; l = l->next, i++) {
+		session->callback_plan[i] = l->data;
+		session->callback_types |= session->callback_plan[i]->types;
+	}
+	session->callback_plan[i] = NULL;
+
+	g_free(session->transform_plan);
+	session->num_transform_plan = g_slist_length(session->transforms);
+	session->transform_plan = g_malloc_n(session->num_transform_plan + 1,
+		sizeof(*session->transform_plan));
+	for (l = session->transforms, i = 0; l; l = l->next, i++)
+		session->transform_plan[i] = l->data;
+	session->transform_plan[i] = NULL;
+}
+
+static void datafeed_callback_free(struct datafeed_callback *cb_struct)
+{
+	g_slist_free(cb_struct->channels);
+	g_free(cb_struct->latency);
+	g_free(cb_struct);
+}
+
+/**
+ * Remove all datafeed callbacks in a session.
+ *
+ * @param session The session to use. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid session passed.
+ *
+ * @since 0.4.0
+ */
+SR_API int sr_session_datafeed_callback_remove_all(struct sr_session *session)
+{
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+
+	g_slist_free_full(session->datafeed_callbacks,
+		(GDestroyNotify)datafeed_callback_free);
+	session->datafeed_callbacks = NULL;
+	sr_session_plan_update(session);
+
+	return SR_OK;
+}
+
+/**
+ * Add a datafeed callback to a session.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param cb Function to call when a chunk of data is received.
+ *           Must not be NULL.
+ * @param cb_data Opaque pointer passed in by the caller.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_BUG No session exists.
+ *
+ * @since 0.3.0
+ */
+SR_API int sr_session_datafeed_callback_add(struct sr_session *session,
+		sr_datafeed_callback cb, void *cb_data)
+{
+	struct datafeed_callback *cb_struct;
+
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_BUG;
+	}
+
+	if (!cb) {
+		sr_err("%s: cb was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+
+	cb_struct = g_malloc0(sizeof(struct datafeed_callback));
+	cb_struct->cb = cb;
+	cb_struct->cb_data = cb_data;
+	cb_struct->types = SR_DF_MASK_ALL;
+
+	session->datafeed_callbacks =
+	    g_slist_append(session->datafeed_callbacks, cb_struct);
+	sr_session_plan_update(session);
+
+	return SR_OK;
+}
+
+/**
+ * Remove a datafeed callback from a session.
+ *
+ * The session must not be running.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param cb The callback, as it was added.
+ * @param cb_data The callback's data, as it was added.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid session passed, or no such callback.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_datafeed_callback_remove(struct sr_session *session,
+		sr_datafeed_callback cb, void *cb_data)
+{
+	struct datafeed_callback *cb_struct;
+	GSList *l;
+
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+
+	for (l = session->datafeed_callbacks; l; l = l->next) {
+		cb_struct = l->data;
+		if (cb_struct->cb != cb || cb_struct->cb_data != cb_data)
+			continue;
+		session->datafeed_callbacks = g_slist_delete_link(
+			session->datafeed_callbacks, l);
+		datafeed_callback_free(cb_struct);
+		sr_session_plan_update(session);
+		return SR_OK;
+	}
+
+	return SR_ERR_ARG;
+}
+
+/**
+ * Add a datafeed callback to a session, which only gets the packets it
+ * asks for.
+ *
+ * The session checks the filter before it calls the callback, and skips
+ * the work of delivering packets which no callback (and no transform)
+ * takes. Packets without samples pass the channel filter, logic packets
+ * pass it if any of the channels is a logic channel, and analog packets
+ * if they hold data of any of the channels.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param cb Function to call when a chunk of data is received.
+ *           Must not be NULL.
+ * @param cb_data Opaque pointer passed in by the caller.
+ * @param types The packet types to pass, a combination of SR_DF_MASK()
+ *              values, or SR_DF_MASK_ALL. SR_DF_LOGIC_RLE only reaches
+ *              callbacks of sessions which enabled it, see
+ *              sr_session_logic_rle_set().
+ * @param sdi Only pass the packets of this device. NULL for all devices.
+ * @param channels Only pass the sample packets of these channels
+ *                 (struct sr_channel pointers). NULL for all channels.
+ *                 The list is copied, the channels must exist as long as
+ *                 the callback.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_BUG No session exists.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_datafeed_callback_add_filtered(struct sr_session *session,
+		sr_datafeed_callback cb, void *cb_data, uint32_t types,
+		const struct sr_dev_inst *sdi, const GSList *channels)
+{
+	struct datafeed_callback *cb_struct;
+	const struct sr_channel *ch;
+	const GSList *l;
+
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_BUG;
+	}
+
+	if (!cb || !(types & SR_DF_MASK_ALL)) {
+		sr_err("%s: invalid argument", __func__);
+		return SR_ERR_ARG;
+	}
+
+	cb_struct = g_malloc0(sizeof(struct datafeed_callback));
+	cb_struct->cb = cb;
+	cb_struct->cb_data = cb_data;
+	cb_struct->filtered = TRUE;
+	cb_struct->types = types & SR_DF_MASK_ALL;
+	cb_struct->sdi = sdi;
+	cb_struct->channels = g_slist_copy((GSList *)channels);
+	for (l = channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->type == SR_CHANNEL_LOGIC)
+			cb_struct->logic_channels = TRUE;
+	}
+
+	session->datafeed_callbacks =
+	    g_slist_append(session->datafeed_callbacks, cb_struct);
+	sr_session_plan_update(session);
+
+	return SR_OK;
+}
+
+/**
+ * Get the trigger assigned to this session.
+ *
+ * @param session The session to use.
+ *
+ * @retval NULL Invalid (NULL) session was passed to the function.
+ * @retval other The trigger assigned to this session (can be NULL).
+ *
+ * @since 0.4.0
+ */
+SR_API struct sr_trigger *sr_session_trigger_get(struct sr_session *session)
+{
+	if (!session)
+		return NULL;
+
+	return session->trigger;
+}
+
+/**
+ * Set the trigger of this session.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param trig The trigger to assign to this session. Can be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.4.0
+ */
+SR_API int sr_session_trigger_set(struct sr_session *session, struct sr_trigger *trig)
+{
+	if (!session)
+		return SR_ERR_ARG;
+
+	session->trigger = trig;
+
+	return SR_OK;
+}
+
+static int verify_trigger(struct sr_trigger *trigger)
+{
+	struct sr_trigger_stage *stage;
+	struct sr_trigger_match *match;
+	GSList *l, *m;
+
+	if (!trigger->stages) {
+		sr_err("No trigger stages defined.");
+		return SR_ERR;
+	}
+
+	sr_spew("Checking trigger:");
+	for (l = trigger->stages; l; l = l->next) {
+		stage = l->data;
+		if (!stage->matches) {
+			sr_err("Stage %d has no matches defined.", stage->stage);
+			return SR_ERR;
+		}
+		for (m = stage->matches; m; m = m->next) {
+			match = m->data;
+			if (!match->channel) {
+				sr_err("Stage %d match has no channel.", stage->stage);
+				return SR_ERR;
+			}
+			if (!match->match) {
+				sr_err("Stage %d match is not defined.", stage->stage);
+				return SR_ERR;
+			}
+			sr_spew("Stage %d match on channel %s, match %d", stage->stage,
+					match->channel->name, match->match);
+		}
+	}
+
+	return SR_OK;
+}
+
+/** Set up the main context the session will be executing in.
+ *
+ * Must be called just before the session starts, by the thread which
+ * will execute the session main loop. Once acquired, the main context
+ * pointer is immutable for the duration of the session run.
+ */
+static int set_main_context(struct sr_session *session)
+{
+	GMainContext *main_context;
+
+	g_mutex_lock(&session->main_mutex);
+
+	/* May happen if sr_session_start() is called a second time
+	 * while the session is still running.
+	 */
+	if (session->main_context) {
+		sr_err("Main context already set.");
+
+		g_mutex_unlock(&session->main_mutex);
+		return SR_ERR;
+	}
+	main_context = g_main_context_ref_thread_default();
+	/*
+	 * Try to use an existing main context if possible, but only if we
+	 * can make it owned by the current thread. Otherwise, create our
+	 * own main context so that event source callbacks can execute in
+	 * the session thread.
+	 */
+	if (g_main_context_acquire(main_context)) {
+		g_main_context_release(main_context);
+
+		sr_dbg("Using thread-default main context.");
+	} else {
+		g_main_context_unref(main_context);
+
+		sr_dbg("Creating our own main context.");
+		main_context = g_main_context_new();
+	}
+	session->main_context = main_context;
+
+	g_mutex_unlock(&session->main_mutex);
+
+	return SR_OK;
+}
+
+/** Unset the main context used for the current session run.
+ *
+ * Must be called right after stopping the session. Note that if the
+ * session is stopped asynchronously, the main loop may still be running
+ * after the main context has been unset. This is OK as long as no new
+ * event sources are created -- the main loop holds its own reference
+ * to the main context.
+ */
+static int unset_main_context(struct sr_session *session)
+{
+	int ret;
+
+	g_mutex_lock(&session->main_mutex);
+
+	if (session->main_context) {
+		g_main_context_unref(session->main_context);
+		session->main_context = NULL;
+		ret = SR_OK;
+	} else {
+		/* May happen if the set/unset calls are not matched.
+		 */
+		sr_err("No main context to unset.");
+		ret = SR_ERR;
+	}
+	g_mutex_unlock(&session->main_mutex);
+
+	return ret;
+}
+
+static unsigned int session_source_attach(struct sr_session *session,
+		GSource *source)
+{
+	unsigned int id = 0;
+
+	g_mutex_lock(&session->main_mutex);
+
+	if (session->main_context)
+		id = g_source_attach(source, session->main_context);
+	else
+		sr_err("Cannot add event source without main context.");
+
+	g_mutex_unlock(&session->main_mutex);
+
+	return id;
+}
+
+static struct session_dev_thread *dev_thread_find(
+		struct sr_session *session, const struct sr_dev_inst *sdi)
+{
+	struct session_dev_thread *dt;
+	GSList *l;
+
+	for (l = session->dev_threads; l; l = l->next) {
+		dt = l->data;
+		if (dt->sdi == sdi)
+			return dt;
+	}
+
+	return NULL;
+}
+
+static gpointer dev_thread_run(gpointer data)
+{
+	struct session_dev_thread *dt;
+
+	dt = data;
+	sr_thread_sched_apply(&dt->session->thread_sched[
+		SR_SESSION_THREAD_ACQUISITION - SR_SESSION_THREAD_MAIN], FALSE);
+	g_private_set(&dev_thread_key, dt);
+	g_main_context_push_thread_default(dt->context);
+
+	/* No GMainLoop, an early quit request must not get lost. */
+	while (!g_atomic_int_get(&dt->quit))
+		g_main_context_iteration(dt->context, TRUE);
+
+	g_main_context_pop_thread_default(dt->context);
+	g_private_set(&dev_thread_key, NULL);
+
+	return NULL;
+}
+
+/*
+ * Set up an acquisition context for each device. The threads are
+ * started later, once the device's acquisition has been started.
+ */
+static void dev_threads_create(struct sr_session *session)
+{
+	struct session_dev_thread *dt;
+	GSList *l;
+
+	for (l = session->devs; l; l = l->next) {
+		dt = g_malloc0(sizeof(*dt));
+		dt->session = session;
+		dt->sdi = l->data;
+		dt->context = g_main_context_new();
+		session->dev_threads = g_slist_append(session->dev_threads, dt);
+	}
+}
+
+static int dev_thread_start(struct session_dev_thread *dt)
+{
+	dt->thread = g_thread_try_new("sr-acquisition", dev_thread_run,
+		dt, NULL);
+	if (!dt->thread) {
+		sr_err("Cannot create acquisition thread for %s device %s.",
+			dt->sdi->driver->name, dt->sdi->connection_id);
+		return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
+/* Must not be called from one of the device threads. */
+static void dev_threads_stop(struct sr_session *session)
+{
+	struct session_dev_thread *dt;
+	GSList *l;
+
+	for (l = session->dev_threads; l; l = l->next) {
+		dt = l->data;
+		if (dt->thread) {
+			g_atomic_int_set(&dt->quit, TRUE);
+			g_main_context_wakeup(dt->context);
+			g_thread_join(dt->thread);
+		}
+		g_main_context_unref(dt->context);
+		g_free(dt);
+	}
+	g_slist_free(session->dev_threads);
+	session->dev_threads = NULL;
+}
+
+/*
+ * Have the driver start a device's acquisition, in the device's
+ * acquisition context if any, and note how long that took.
+ */
+static int dev_acquisition_arm(struct sr_session *session,
+		struct sr_dev_inst *sdi)
+{
+	struct session_dev_thread *dt;
+	uint64_t *arm_us;
+	int64_t start;
+	int ret;
+
+	dt = dev_thread_find(session, sdi);
+
+	start = g_get_monotonic_time();
+	g_private_set(&dev_thread_key, dt);
+	ret = sr_dev_acquisition_start(sdi);
+	g_private_set(&dev_thread_key, NULL);
+	if (ret != SR_OK) {
+		sr_err("Could not start %s device %s acquisition.",
+			sdi->driver->name, sdi->connection_id);
+		return ret;
+	}
+
+	arm_us = g_malloc(sizeof(*arm_us));
+	*arm_us = g_get_monotonic_time() - start;
+	sr_dbg("Armed %s device %s in %" PRIu64 " us.",
+		sdi->driver->name, sdi->connection_id, *arm_us);
+	g_mutex_lock(&session->stats_mutex);
+	g_hash_table_insert(session->dev_arm_us, sdi, arm_us);
+	g_mutex_unlock(&session->stats_mutex);
+
+	return SR_OK;
+}
+
+/* Start a device's acquisition, and its acquisition thread if any. */
+static int dev_acquisition_start(struct sr_session *session,
+		struct sr_dev_inst *sdi)
+{
+	struct session_dev_thread *dt;
+	int ret;
+
+	ret = dev_acquisition_arm(session, sdi);
+	if (ret != SR_OK)
+		return ret;
+
+	dt = dev_thread_find(session, sdi);
+	if (!dt)
+		return SR_OK;
+
+	return dev_thread_start(dt);
+}
+
+/* Start all devices, one after another. */
+static int devs_start(struct sr_session *session)
+{
+	struct sr_dev_inst *sdi;
+	GSList *l, *lend;
+	int ret;
+
+	ret = SR_OK;
+	for (l = session->devs; l; l = l->next) {
+		if (!(sdi = l->data)) {
+			sr_err("Device sdi was NULL, can't start session.");
+			ret = SR_ERR;
+			break;
+		}
+		ret = dev_acquisition_start(session, sdi);
+		if (ret != SR_OK)
+			break;
+	}
+
+	if (ret != SR_OK) {
+		/* If there are multiple devices, some of them may already have
+		 * started successfully. Stop them now before returning. */
+		lend = l->next;
+		for (l = session->devs; l != lend; l = l->next) {
+			sdi = l->data;
+			sr_dev_acquisition_stop(sdi);
+		}
+	}
+
+	return ret;
+}
+
+struct dev_start {
+	struct sr_session *session;
+	struct sr_dev_inst *sdi;
+	GThread *thread;
+	int ret;
+};
+
+static gpointer dev_start_run(gpointer data)
+{
+	struct dev_start *ds;
+
+	ds = data;
+	ds->ret = dev_acquisition_arm(ds->session, ds->sdi);
+
+	return NULL;
+}
+
+/*
+ * Start all devices at the same time, each from a thread of its own.
+ * No data flows before every device is armed: the packets sent in the
+ * meantime are held, and the acquisition threads start afterwards.
+ */
+static int devs_start_parallel(struct sr_session *session)
+{
+	struct session_dev_thread *dt;
+	struct dev_start *starts;
+	unsigned int i, num;
+	GSList *l;
+	int ret;
+
+	num = g_slist_length(session->devs);
+	starts = g_malloc0_n(num, sizeof(*starts));
+
+	g_atomic_int_set(&session->start_holding, TRUE);
+
+	for (i = 0, l = session->devs; l; i++, l = l->next) {
+		starts[i].session = session;
+		starts[i].sdi = l->data;
+		if (!starts[i].sdi) {
+			sr_err("Device sdi was NULL, can't start session.");
+			starts[i].ret = SR_ERR;
+			continue;
+		}
+		starts[i].thread = g_thread_try_new("sr-dev-start",
+			dev_start_run, &starts[i], NULL);
+		if (!starts[i].thread) {
+			sr_warn("Cannot create start thread for %s device %s, "
+				"starting it directly.",
+				starts[i].sdi->driver->name,
+				starts[i].sdi->connection_id);
+			dev_start_run(&starts[i]);
+		}
+	}
+
+	/* The barrier, wait for all devices. */
+	ret = SR_OK;
+	for (i = 0; i < num; i++) {
+		if (starts[i].thread)
+			g_thread_join(starts[i].thread);
+		if (starts[i].ret != SR_OK && ret == SR_OK)
+			ret = starts[i].ret;
+	}
+
+	for (l = session->dev_threads; l && ret == SR_OK; l = l->next) {
+		dt = l->data;
+		ret = dev_thread_start(dt);
+	}
+
+	if (ret != SR_OK) {
+		for (i = 0; i < num; i++) {
+			if (starts[i].ret == SR_OK)
+				sr_dev_acquisition_stop(starts[i].sdi);
+		}
+	}
+	start_release(session, ret == SR_OK);
+
+	g_free(starts);
+
+	return ret;
+}
+
+/* Idle handler; invoked when the number of registered event sources
+ * for a running session drops to zero.
+ */
+static gboolean delayed_stop_check(void *data)
+{
+	struct sr_session *session;
+
+	session = data;
+	g_rec_mutex_lock(&session->sources_mutex);
+	session->stop_check_id = 0;
+
+	/* Session already ended? */
+	if (!session->running) {
+		g_rec_mutex_unlock(&session->sources_mutex);
+		return G_SOURCE_REMOVE;
+	}
+
+	/* New event sources may have been installed in the meantime. */
+	if (g_hash_table_size(session->event_sources) != 0) {
+		g_rec_mutex_unlock(&session->sources_mutex);
+		return G_SOURCE_REMOVE;
+	}
+
+	session->running = FALSE;
+	g_rec_mutex_unlock(&session->sources_mutex);
+
+	dev_threads_stop(session);
+	analog_batch_stop(session);
+	unset_main_context(session);
+
+	datafeed_queue_stop(session);
+	session_mem_unlock(session);
+
+	sr_info("Stopped.");
+
+	/* This indicates a bug in user code, since it is not valid to
+	 * restart or destroy a session while it may still be running.
+	 */
+	if (!session->main_loop && !session->stopped_callback) {
+		sr_err("BUG: Session stop left unhandled.");
+		return G_SOURCE_REMOVE;
+	}
+	if (session->main_loop)
+		g_main_loop_quit(session->main_loop);
+
+	if (session->stopped_callback)
+		(*session->stopped_callback)(session->stopped_cb_data);
+
+	return G_SOURCE_REMOVE;
+}
+
+static int stop_check_later(struct sr_session *session)
+{
+	GSource *source;
+	unsigned int source_id;
+
+	g_rec_mutex_lock(&session->sources_mutex);
+
+	if (session->stop_check_id != 0) {
+		g_rec_mutex_unlock(&session->sources_mutex);
+		return SR_OK; /* idle handler already installed */
+	}
+
+	source = g_idle_source_new();
+	g_source_set_callback(source, &delayed_stop_check, session, NULL);
+
+	source_id = session_source_attach(session, source);
+	session->stop_check_id = source_id;
+
+	g_rec_mutex_unlock(&session->sources_mutex);
+
+	g_source_unref(source);
+
+	return (source_id != 0) ? SR_OK : SR_ERR;
+}
+
+/**
+ * Start a session.
+ *
+ * When this function returns with a status code indicating success, the
+ * session is running. Use sr_session_stopped_callback_set() to receive
+ * notification upon completion, or call sr_session_run() to block until
+ * the session stops.
+ *
+ * Session events will be processed in the context of the current thread.
+ * If a thread-default GLib main context has been set, and is not owned by
+ * any other thread, it will be used. Otherwise, libsigrok will create its
+ * own main context for the current thread.
+ *
+ * @param session The session to use. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid session passed.
+ * @retval SR_ERR Other error.
+ *
+ * @since 0.4.0
+ */
+SR_API int sr_session_start(struct sr_session *session)
+{
+	struct sr_dev_inst *sdi;
+	struct sr_channel *ch;
+	GSList *l, *c;
+	int ret;
+
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+
+	if (!session->devs) {
+		sr_err("%s: session->devs was NULL; a session "
+		       "cannot be started without devices.", __func__);
+		return SR_ERR_ARG;
+	}
+
+	if (session->running) {
+		sr_err("Cannot (re-)start session while it is still running.");
+		return SR_ERR;
+	}
+
+	if (session->trigger) {
+		ret = verify_trigger(session->trigger);
+		if (ret != SR_OK)
+			return ret;
+	}
+
+	/* Check enabled channels and commit settings of all devices. */
+	for (l = session->devs; l; l = l->next) {
+		sdi = l->data;
+		for (c = sdi->channels; c; c = c->next) {
+			ch = c->data;
+			if (ch->enabled)
+				break;
+		}
+		if (!c) {
+			sr_err("%s device %s has no enabled channels.",
+				sdi->driver->name, sdi->connection_id);
+			return SR_ERR;
+		}
+
+		ret = sr_config_commit(sdi);
+		if (ret != SR_OK) {
+			sr_err("Failed to commit %s device %s settings "
+				"before starting acquisition.",
+				sdi->driver->name, sdi->connection_id);
+			return ret;
+		}
+	}
+
+	session_stats_reset(session);
+
+	ret = set_main_context(session);
+	if (ret != SR_OK)
+		return ret;
+
+	ret = datafeed_queue_start(session);
+	if (ret != SR_OK) {
+		unset_main_context(session);
+		return ret;
+	}
+
+	sr_info("Starting.");
+
+	session->running = TRUE;
+
+	if (session->mem_lock) {
+		sr_mem_lock_acquire();
+		session->mem_locked = TRUE;
+	}
+
+	if (session->per_dev_threads)
+		dev_threads_create(session);
+	analog_batch_start(session);
+
+	/* Have all devices start acquisition. */
+	if (session->parallel_start && session->devs->next)
+		ret = devs_start_parallel(session);
+	else
+		ret = devs_start(session);
+
+	if (ret != SR_OK) {
+		/* TODO: Handle delayed stops. Need to iterate the event
+		 * sources... */
+		session->running = FALSE;
+
+		dev_threads_stop(session);
+		analog_batch_stop(session);
+		unset_main_context(session);
+		datafeed_queue_stop(session);
+		session_mem_unlock(session);
+		return ret;
+	}
+
+	g_rec_mutex_lock(&session->sources_mutex);
+	if (g_hash_table_size(session->event_sources) == 0)
+		stop_check_later(session);
+	g_rec_mutex_unlock(&session->sources_mutex);
+
+#ifdef HAVE_SESSION_POLL
+	/* Have an external event loop pick up the new main context. */
+	if (session->poll)
+		session_poll_timer_set(session->poll, 0);
+#endif
+
+	return SR_OK;
+}
+
+/**
+ * Block until the running session stops.
+ *
+ * This is a convenience function which creates a GLib main loop and runs
+ * it to process session events until the session stops.
+ *
+ * Instead of using this function, applications may run their own GLib main
+ * loop, and use sr_session_stopped_callback_set() to receive notification
+ * when the session finished running.
+ *
+ * @param session The session to use. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid session passed.
+ * @retval SR_ERR Other error.
+ *
+ * @since 0.4.0
+ */
+SR_API int sr_session_run(struct sr_session *session)
+{
+	struct sr_thread_sched_state *sched_state;
+
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+	if (!session->running) {
+		sr_err("No session running.");
+		return SR_ERR;
+	}
+	if (session->main_loop) {
+		sr_err("Main loop already created.");
+		return SR_ERR;
+	}
+
+	g_mutex_lock(&session->main_mutex);
+
+	if (!session->main_context) {
+		sr_err("Cannot run without main context.");
+		g_mutex_unlock(&session->main_mutex);
+		return SR_ERR;
+	}
+	session->main_loop = g_main_loop_new(session->main_context, FALSE);
+
+	g_mutex_unlock(&session->main_mutex);
+
+	/* The caller's thread, it gets its settings back afterwards. */
+	sched_state = sr_thread_sched_apply(&session->thread_sched[
+		SR_SESSION_THREAD_MAIN - SR_SESSION_THREAD_MAIN], TRUE);
+
+	g_main_loop_run(session->main_loop);
+
+	sr_thread_sched_restore(sched_state);
+
+	g_main_loop_unref(session->main_loop);
+	session->main_loop = NULL;
+
+	return SR_OK;
+}
+
+/**
+ * Get an fd which lets an external event loop drive the session.
+ *
+ * Applications with their own event loop (epoll, libuv, asio, ...) can
+ * watch this fd for readability instead of running sr_session_run() or a
+ * GLib main loop in a separate thread. Whenever the fd is readable, call
+ * sr_session_dispatch_pending() from the application's loop. It runs the
+ * session's USB, serial and SCPI event sources, timeouts included, in the
+ * calling thread.
+ *
+ * The fd may be requested before or after sr_session_start(), and stays
+ * valid until the session is destroyed. Set a callback with
+ * sr_session_stopped_callback_set() to learn when the session stopped.
+ * The application must not close the fd.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param[out] fd The fd to watch for readability. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA Not supported on this platform.
+ * @retval SR_ERR Other error.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_poll_fd_get(struct sr_session *session, int *fd)
+{
+#ifdef HAVE_SESSION_POLL
+	struct session_poll *sp;
+	struct epoll_event ev;
+
+	if (!session || !fd)
+		return SR_ERR_ARG;
+
+	if (!session->poll) {
+		sp = g_malloc0(sizeof(*sp));
+		sp->epfd = epoll_create1(EPOLL_CLOEXEC);
+		sp->timerfd = timerfd_create(CLOCK_MONOTONIC,
+			TFD_NONBLOCK | TFD_CLOEXEC);
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		if (sp->epfd < 0 || sp->timerfd < 0 ||
+				epoll_ctl(sp->epfd, EPOLL_CTL_ADD, sp->timerfd,
+				&ev) < 0) {
+			sr_err("Cannot create the session's poll fd: %s.",
+				g_strerror(errno));
+			if (sp->timerfd >= 0)
+				close(sp->timerfd);
+			if (sp->epfd >= 0)
+				close(sp->epfd);
+			g_free(sp);
+			return SR_ERR;
+		}
+		/* The first dispatch picks up the session's sources. */
+		session_poll_timer_set(sp, 0);
+		session->poll = sp;
+	}
+	*fd = session->poll->epfd;
+
+	return SR_OK;
+#else
+	(void)session;
+	(void)fd;
+
+	return SR_ERR_NA;
+#endif
+}
+
+/**
+ * Run the session's event sources which are ready, without blocking.
+ *
+ * Call this when the fd from sr_session_poll_fd_get() is readable. The
+ * calling thread must not be running another main loop for the session,
+ * as sr_session_run() does. Calling it on a stopped session is harmless.
+ *
+ * @param session The session to use. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA Not supported on this platform.
+ * @retval SR_ERR No poll fd was requested, or another thread runs the
+ *         session's main context.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_dispatch_pending(struct sr_session *session)
+{
+#ifdef HAVE_SESSION_POLL
+	struct session_poll *sp;
+	GMainContext *context;
+	gboolean running;
+	uint64_t expirations;
+
+	if (!session)
+		return SR_ERR_ARG;
+	if (!(sp = session->poll)) {
+		sr_err("No poll fd, see sr_session_poll_fd_get().");
+		return SR_ERR;
+	}
+
+	/* Only the timer's readability gets reset here, the rest is level. */
+	if (read(sp->timerfd, &expirations, sizeof(expirations)) < 0 &&
+			errno != EAGAIN)
+		sr_spew("Cannot read the poll timer: %s.", g_strerror(errno));
+
+	g_mutex_lock(&session->main_mutex);
+	context = session->main_context ?
+		g_main_context_ref(session->main_context) : NULL;
+	g_mutex_unlock(&session->main_mutex);
+	if (!context) {
+		session_poll_clear(sp);
+		return SR_OK;
+	}
+	if (!g_main_context_acquire(context)) {
+		sr_err("Another thread runs the session's main context.");
+		g_main_context_unref(context);
+		return SR_ERR;
+	}
+
+	if (sp->context == context) {
+		g_poll(sp->fds, sp->num_fds, 0);
+		if (g_main_context_check(context, sp->max_priority,
+				sp->fds, sp->num_fds))
+			g_main_context_dispatch(context);
+	}
+
+	/* The session may have stopped in there. */
+	g_mutex_lock(&session->main_mutex);
+	running = session->main_context == context;
+	g_mutex_unlock(&session->main_mutex);
+	if (running)
+		session_poll_arm(sp, context);
+	else
+		session_poll_clear(sp);
+
+	g_main_context_release(context);
+	g_main_context_unref(context);
+
+	return SR_OK;
+#else
+	(void)session;
+
+	return SR_ERR_NA;
+#endif
+}
+
+static gboolean dev_thread_stop_sync(void *user_data)
+{
+	struct session_dev_thread *dt;
+
+	dt = user_data;
+	sr_dev_acquisition_stop(dt->sdi);
+
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean session_stop_sync(void *user_data)
+{
+	struct sr_session *session;
+	struct sr_dev_inst *sdi;
+	struct session_dev_thread *dt;
+	GSList *node;
+
+	session = user_data;
+
+	if (!session->running)
+		return G_SOURCE_REMOVE;
+
+	sr_info("Stopping.");
+
+	for (node = session->devs; node; node = node->next) {
+		sdi = node->data;
+		/* Devices with their own thread get stopped in there. */
+		dt = dev_thread_find(session, sdi);
+		if (dt)
+			g_main_context_invoke(dt->context,
+				&dev_thread_stop_sync, dt);
+		else
+			sr_dev_acquisition_stop(sdi);
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+/**
+ * Stop a session.
+ *
+ * This requests the drivers of each device participating in the session to
+ * abort the acquisition as soon as possible. Even after this function returns,
+ * event processing still continues until all devices have actually stopped.
+ *
+ * Use sr_session_stopped_callback_set() to receive notification when the event
+ * processing finished.
+ *
+ * This function is reentrant. That is, it may be called from a different
+ * thread than the one executing the session, as long as it can be ensured
+ * that the session object is valid.
+ *
+ * If the session is not running, sr_session_stop() silently does nothing.
+ *
+ * @param session The session to use. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid session passed.
+ *
+ * @since 0.4.0
+ */
+SR_API int sr_session_stop(struct sr_session *session)
+{
+	GMainContext *main_context;
+
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+
+	g_mutex_lock(&session->main_mutex);
+
+	main_context = (session->main_context)
+		? g_main_context_ref(session->main_context)
+		: NULL;
+
+	g_mutex_unlock(&session->main_mutex);
+
+	if (!main_context) {
+		sr_dbg("No main context set; already stopped?");
+		/* Not an error; as it would be racy. */
+		return SR_OK;
+	}
+	g_main_context_invoke(main_context, &session_stop_sync, session);
+	g_main_context_unref(main_context);
+
+	return SR_OK;
+}
+
+/**
+ * Return whether the session is currently running.
+ *
+ * Note that this function should be called from the same thread
+ * the session was started in.
+ *
+ * @param session The session to use. Must not be NULL.
+ *
+ * @retval TRUE Session is running.
+ * @retval FALSE Session is not running.
+ * @retval SR_ERR_ARG Invalid session passed.
+ *
+ * @since 0.4.0
+ */
+SR_API int sr_session_is_running(struct sr_session *session)
+{
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+	return session->running;
+}
+
+/**
+ * Apply configuration changes to the devices of a running session.
+ *
+ * Frontends which changed e.g. the samplerate or the enabled channels of
+ * a device while its session runs can call this instead of stopping and
+ * restarting the session. The drivers apply the changes to the running
+ * acquisition, and announce new values with SR_DF_META packets. Nothing
+ * gets applied unless all devices of the session support this.
+ *
+ * This must be called from the thread which the session was started in.
+ *
+ * @param session The session to use. Must not be NULL.
+ *
+ * @retval SR_OK Success, or the session is not running.
+ * @retval SR_ERR_ARG Invalid session passed.
+ * @retval SR_ERR_NA The changes need a restart of the session.
+ * @retval other Error applying the changes.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_reconfigure(struct sr_session *session)
+{
+	struct sr_dev_inst *sdi;
+	GSList *l;
+	int ret;
+
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+	if (!session->running)
+		return SR_OK;
+
+	/* Devices with their own threads get dispatched elsewhere. */
+	if (session->dev_threads)
+		return SR_ERR_NA;
+	for (l = session->devs; l; l = l->next) {
+		sdi = l->data;
+		if (!sdi->driver->dev_acquisition_reconfigure)
+			return SR_ERR_NA;
+	}
+
+	for (l = session->devs; l; l = l->next) {
+		sdi = l->data;
+		ret = sdi->driver->dev_acquisition_reconfigure(sdi);
+		if (ret != SR_OK) {
+			if (ret != SR_ERR_NA)
+				sr_err("Failed to reconfigure device: %s.",
+					sr_strerror(ret));
+			return ret;
+		}
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Set the callback to be invoked after a session stopped running.
+ *
+ * Install a callback to receive notification when a session run stopped.
+ * This can be used to integrate session execution with an existing main
+ * loop, without having to block in sr_session_run().
+ *
+ * Note that the callback will be invoked in the context of the thread
+ * that calls sr_session_start().
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param cb The callback to invoke on session stop. May be NULL to unset.
+ * @param cb_data User data pointer to be passed to the callback.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid session passed.
+ *
+ * @since 0.4.0
+ */
+SR_API int sr_session_stopped_callback_set(struct sr_session *session,
+		sr_session_stopped_callback cb, void *cb_data)
+{
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+	session->stopped_callback = cb;
+	session->stopped_cb_data = cb_data;
+
+	return SR_OK;
+}
+
+/**
+ * Debug helper.
+ *
+ * @param packet The packet to show debugging information for.
+ */
+static void datafeed_dump(const struct sr_datafeed_packet *packet)
+{
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_logic_rle *logic_rle;
+	const struct sr_datafeed_analog *analog;
+
+	/* Please use the same order as in libsigrok.h. */
+	switch (packet->type) {
+	case SR_DF_HEADER:
+		sr_dbg("bus: Received SR_DF_HEADER packet.");
+		break;
+	case SR_DF_END:
+		sr_dbg("bus: Received SR_DF_END packet.");
+		break;
+	case SR_DF_META:
+		sr_dbg("bus: Received SR_DF_META packet.");
+		break;
+	case SR_DF_TRIGGER:
+		sr_dbg("bus: Received SR_DF_TRIGGER packet.");
+		break;
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		sr_dbg("bus: Received SR_DF_LOGIC packet (%" PRIu64 " bytes, "
+		       "unitsize = %d).", logic->length, logic->unitsize);
+		break;
+	case SR_DF_FRAME_BEGIN:
+		sr_dbg("bus: Received SR_DF_FRAME_BEGIN packet.");
+		break;
+	case SR_DF_FRAME_END:
+		sr_dbg("bus: Received SR_DF_FRAME_END packet.");
+		break;
+	case SR_DF_ANALOG:
+		analog = packet->payload;
+		sr_dbg("bus: Received SR_DF_ANALOG packet (%d samples).",
+		       analog->num_samples);
+		break;
+	case SR_DF_LOGIC_RLE:
+		logic_rle = packet->payload;
+		sr_dbg("bus: Received SR_DF_LOGIC_RLE packet (%" PRIu64 " runs, "
+		       "unitsize = %d).", logic_rle->num_runs, logic_rle->unitsize);
+		break;
+	default:
+		sr_dbg("bus: Received unknown packet type: %d.", packet->type);
+		break;
+	}
+}
+
+/**
+ * Helper to send a meta datafeed package (SR_DF_META) to the session bus.
+ *
+ * @param sdi The device instance to send the package from. Must not be NULL.
+ * @param key The config key to send to the session bus.
+ * @param var The value to send to the session bus.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_send_meta(const struct sr_dev_inst *sdi,
+		uint32_t key, GVariant *var)
+{
+	struct sr_config *cfg;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_meta meta;
+	int ret;
+
+	cfg = sr_config_new(key, var);
+
+	memset(&meta, 0, sizeof(meta));
+
+	packet.type = SR_DF_META;
+	packet.payload = &meta;
+
+	meta.config = g_slist_append(NULL, cfg);
+
+	ret = sr_session_send(sdi, &packet);
+	g_slist_free(meta.config);
+	sr_config_free(cfg);
+
+	return ret;
+}
+
+/**
+ * Turn a packet into a shared packet, by means of a shallow copy.
+ *
+ * Only the payload description (not the sample data) gets copied.
+ * The sample data remains owned by whoever provided the release hook.
+ */
+static struct shared_packet *shared_packet_new(
+		const struct sr_datafeed_packet *packet,
+		GDestroyNotify release, void *release_data)
+{
+	struct shared_packet *sp;
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_analog *analog;
+
+	sp = g_malloc0(sizeof(*sp));
+	sp->refcount = 1;
+	sp->release = release;
+	sp->release_data = release_data;
+	sp->packet.type = packet->type;
+
+	switch (packet->type) {
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		sp->payload.logic = *logic;
+		sp->packet.payload = &sp->payload.logic;
+		sp->own_payload = TRUE;
+		break;
+	case SR_DF_LOGIC_RLE:
+		sp->payload.logic_rle =
+			*(const struct sr_datafeed_logic_rle *)packet->payload;
+		sp->packet.payload = &sp->payload.logic_rle;
+		sp->own_payload = TRUE;
+		break;
+	case SR_DF_ANALOG:
+		analog = packet->payload;
+		sp->payload.analog.analog = *analog;
+		sp->payload.analog.encoding = *analog->encoding;
+		sp->payload.analog.meaning = *analog->meaning;
+		sp->payload.analog.meaning.channels =
+			g_slist_copy(analog->meaning->channels);
+		sp->payload.analog.spec = *analog->spec;
+		sp->payload.analog.analog.encoding = &sp->payload.analog.encoding;
+		sp->payload.analog.analog.meaning = &sp->payload.analog.meaning;
+		sp->payload.analog.analog.spec = &sp->payload.analog.spec;
+		sp->packet.payload = &sp->payload.analog.analog;
+		sp->own_payload = TRUE;
+		break;
+	default:
+		sp->packet.payload = packet->payload;
+		break;
+	}
+	shared_packet_track(sp);
+
+	return sp;
+}
+
+static void shared_packet_free(struct shared_packet *sp)
+{
+	shared_packet_untrack(sp);
+	if (sp->own_payload && sp->packet.type == SR_DF_ANALOG)
+		g_slist_free(sp->payload.analog.meaning.channels);
+	if (sp->release)
+		sp->release(sp->release_data);
+	g_free(sp);
+}
+
+static struct shared_packet *shared_packet_get(
+		const struct sr_datafeed_packet *packet)
+{
+	struct shared_packet *sp;
+
+	if (!packet)
+		return NULL;
+
+	/* The packet is the first member, but only of valid wrappers. */
+	sp = (struct shared_packet *)packet;
+	if (sp->self != sp) {
+		sr_err("%s: packet was not received from a datafeed callback",
+			__func__);
+		return NULL;
+	}
+
+	return sp;
+}
+
+/**
+ * Take a reference to a datafeed packet.
+ *
+ * This must only be called for packets which were passed to a datafeed
+ * callback (or for packets which were returned by sr_packet_ref()).
+ * The returned packet remains valid after the callback has returned,
+ * until it gets released by sr_packet_unref().
+ *
+ * When the driver provides the sample data in buffers that it can hand
+ * over to the session, the returned packet is the very same packet and
+ * no data gets copied. Otherwise the packet is copied, and the copy is
+ * returned. Callers must only use the returned pointer after this call.
+ *
+ * @param packet The packet to reference. Must not be NULL.
+ *
+ * @return The referenced packet, or NULL upon error. Must be released
+ *         by the caller using sr_packet_unref().
+ *
+ * @since 0.6.0
+ */
+SR_API struct sr_datafeed_packet *sr_packet_ref(
+		const struct sr_datafeed_packet *packet)
+{
+	struct shared_packet *sp, *copy_sp;
+	struct sr_datafeed_packet *copy;
+
+	sp = shared_packet_get(packet);
+	if (!sp)
+		return NULL;
+
+	if (sp->refcount > 0) {
+		g_atomic_int_inc(&sp->refcount);
+		return &sp->packet;
+	}
+
+	/* Borrowed packet, the data is gone when the callback returns. */
+	if (sr_packet_copy(packet, &copy) != SR_OK) {
+		g_free(copy);
+		return NULL;
+	}
+	copy_sp = g_malloc0(sizeof(*copy_sp));
+	copy_sp->refcount = 1;
+	copy_sp->packet = *copy;
+	copy_sp->release = (GDestroyNotify)sr_packet_free;
+	copy_sp->release_data = copy;
+	copy_sp->seq = sp->seq;
+	copy_sp->timed = sp->timed;
+	copy_sp->timing = sp->timing;
+	copy_sp->triggered = sp->triggered;
+	copy_sp->trigger_at = sp->trigger_at;
+	shared_packet_track(copy_sp);
+
+	return &copy_sp->packet;
+}
+
+/**
+ * Drop a reference to a datafeed packet.
+ *
+ * When the last reference is dropped, the packet's resources get
+ * released (which may return the buffer to the hardware driver).
+ *
+ * @param packet The packet returned by sr_packet_ref(). Can be NULL.
+ *
+ * @since 0.6.0
+ */
+SR_API void sr_packet_unref(struct sr_datafeed_packet *packet)
+{
+	struct shared_packet *sp;
+
+	if (!packet)
+		return;
+
+	sp = shared_packet_get(packet);
+	if (!sp)
+		return;
+
+	if (sp->refcount <= 0) {
+		sr_err("%s: packet is not referenced", __func__);
+		return;
+	}
+	if (g_atomic_int_dec_and_test(&sp->refcount))
+		shared_packet_free(sp);
+}
+
+/**
+ * Get the sequence number of a datafeed packet.
+ *
+ * When the session runs each device in its own thread (see
+ * sr_session_dev_threads_set()), the packets of every device are
+ * numbered consecutively, starting at 1. This allows applications to
+ * tell the order of a device's packets after merging the feeds of
+ * several devices, or after queueing packets of their own.
+ *
+ * @param packet A packet which was passed to a datafeed callback, or
+ *               which was returned by sr_packet_ref(). Must not be NULL.
+ *
+ * @return The packet's sequence number, or 0 if it has none.
+ *
+ * @since 0.6.0
+ */
+SR_API uint64_t sr_packet_sequence_get(
+		const struct sr_datafeed_packet *packet)
+{
+	struct shared_packet *sp;
+
+	sp = shared_packet_get(packet);
+	if (!sp)
+		return 0;
+
+	return sp->seq;
+}
+
+/**
+ * Get the timing of a datafeed packet with samples.
+ *
+ * For SR_DF_LOGIC, SR_DF_LOGIC_RLE and SR_DF_ANALOG packets, the
+ * session tracks the index of the packet's first sample since the
+ * device's SR_DF_HEADER: per device for logic data, per channel (the
+ * first one of the packet) for analog data. Drivers which know better,
+ * e.g. because the device reported lost samples, provide the index
+ * themselves. The host time is when the driver got the data (or sent
+ * the packet, if it does not know), some drivers also provide the
+ * device's own timestamp of the first sample.
+ *
+ * This allows applications to detect gaps, and to line up the data of
+ * several devices, without tracking sample counts themselves.
+ *
+ * @param packet A packet which was passed to a datafeed callback, or
+ *               which was returned by sr_packet_ref(). Must not be NULL.
+ * @param timing The packet's timing is stored here. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA The packet has no timing (e.g. holds no samples).
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_packet_timing_get(const struct sr_datafeed_packet *packet,
+		struct sr_packet_timing *timing)
+{
+	struct shared_packet *sp;
+
+	if (!timing)
+		return SR_ERR_ARG;
+
+	sp = shared_packet_get(packet);
+	if (!sp)
+		return SR_ERR_ARG;
+
+	if (!sp->timed)
+		return SR_ERR_NA;
+	*timing = sp->timing;
+
+	return SR_OK;
+}
+
+/**
+ * Get the position of a trigger which is marked in a sample packet.
+ *
+ * The session only passes such packets to datafeed callbacks after
+ * sr_session_trigger_inplace_set() was enabled. They take the place of
+ * an SR_DF_TRIGGER packet, which would go before the sample at the
+ * trigger position. The position can be the packet's number of samples,
+ * then the trigger goes after its last sample.
+ *
+ * This must only be called for packets which were passed to a datafeed
+ * callback (or for packets which were returned by sr_packet_ref()).
+ *
+ * @param packet The SR_DF_LOGIC or SR_DF_ANALOG packet. Must not be NULL.
+ * @param[out] trigger_at The sample the trigger goes before. Must not
+ *             be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA The packet carries no trigger.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_packet_trigger_get(const struct sr_datafeed_packet *packet,
+		uint64_t *trigger_at)
+{
+	struct shared_packet *sp;
+
+	if (!trigger_at)
+		return SR_ERR_ARG;
+
+	sp = shared_packet_get(packet);
+	if (!sp)
+		return SR_ERR_ARG;
+
+	if (!sp->triggered)
+		return SR_ERR_NA;
+	*trigger_at = sp->trigger_at;
+
+	return SR_OK;
+}
+
+static gboolean datafeed_callback_takes(const struct datafeed_callback *cb_struct,
+		const struct sr_dev_inst *sdi, const struct sr_datafeed_packet *packet)
+{
+	const struct sr_datafeed_analog *analog;
+	const GSList *l;
+
+	if (!(cb_struct->types & SR_DF_MASK(packet->type)))
+		return FALSE;
+	if (cb_struct->sdi && cb_struct->sdi != sdi)
+		return FALSE;
+	if (!cb_struct->channels)
+		return TRUE;
+
+	switch (packet->type) {
+	case SR_DF_LOGIC:
+	case SR_DF_LOGIC_RLE:
+		return cb_struct->logic_channels;
+	case SR_DF_ANALOG:
+		analog = packet->payload;
+		for (l = analog->meaning->channels; l; l = l->next) {
+			if (g_slist_find(cb_struct->channels, l->data))
+				return TRUE;
+		}
+		return FALSE;
+	default:
+		return TRUE;
+	}
+}
+
+/* Count the age of a packet's data, when the first callback gets it. */
+static void datafeed_latency_dev(const struct sr_dev_inst *sdi,
+		int64_t host_time, int64_t now)
+{
+	struct sr_session *session;
+	struct latency_hist *h;
+
+	session = sdi->session;
+	g_mutex_lock(&session->stats_mutex);
+	h = g_hash_table_lookup(session->dev_latency, sdi);
+	if (!h) {
+		h = g_malloc0(sizeof(*h));
+		g_hash_table_insert(session->dev_latency, (void *)sdi, h);
+	}
+	latency_hist_add(h, now - host_time);
+	g_mutex_unlock(&session->stats_mutex);
+}
+
+/* Call with the stats mutex held. */
+static void datafeed_latency_cb(struct datafeed_callback *cb_struct,
+		int64_t host_time, int64_t now)
+{
+	if (!cb_struct->latency)
+		cb_struct->latency = g_malloc0(sizeof(*cb_struct->latency));
+	latency_hist_add(cb_struct->latency, now - host_time);
+}
+
+static void datafeed_fanout(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet)
+{
+	struct sr_session *session;
+	struct datafeed_callback *cb_struct;
+	const struct shared_packet *sp;
+	gint64 start, end, host_time;
+	unsigned int i;
+
+	session = sdi->session;
+	if (!session->num_callback_plan)
+		return;
+
+	if (sr_log_enabled(SR_LOG_DBG))
+		datafeed_dump(packet);
+
+	/* The data's age gets traced for sample packets only. */
+	host_time = 0;
+	if (session->latency_trace) {
+		sp = (const struct shared_packet *)packet;
+		if (sp->timed)
+			host_time = sp->timing.host_time;
+	}
+
+	/* The common case, a single callback (the application's). */
+	if (session->num_callback_plan == 1) {
+		cb_struct = session->callback_plan[0];
+		if (cb_struct->filtered &&
+				!datafeed_callback_takes(cb_struct, sdi, packet))
+			return;
+		start = g_get_monotonic_time();
+		if (host_time)
+			datafeed_latency_dev(sdi, host_time, start);
+		cb_struct->cb(sdi, packet, cb_struct->cb_data);
+		end = g_get_monotonic_time();
+		g_mutex_lock(&session->stats_mutex);
+		cb_struct->busy_us += end - start;
+		if (host_time)
+			datafeed_latency_cb(cb_struct, host_time, start);
+		g_mutex_unlock(&session->stats_mutex);
+		return;
+	}
+
+	/* Each callback's end time is the next one's start time. */
+	start = g_get_monotonic_time();
+	if (host_time)
+		datafeed_latency_dev(sdi, host_time, start);
+	for (i = 0; i < session->num_callback_plan; i++) {
+		cb_struct = session->callback_plan[i];
+		if (cb_struct->filtered &&
+				!datafeed_callback_takes(cb_struct, sdi, packet))
+			continue;
+		cb_struct->cb(sdi, packet, cb_struct->cb_data);
+		end = g_get_monotonic_time();
+		g_mutex_lock(&session->stats_mutex);
+		cb_struct->busy_us += end - start;
+		if (host_time)
+			datafeed_latency_cb(cb_struct, host_time, start);
+		g_mutex_unlock(&session->stats_mutex);
+		start = end;
+	}
+}
+
+/** Number of samples per SR_DF_LOGIC packet when expanding RLE data. */
+#define LOGIC_RLE_CHUNK_SAMPLES (64 * 1024)
+
+/**
+ * Expand run-length encoded logic data into SR_DF_LOGIC packets.
+ *
+ * The callback receives packets of at most LOGIC_RLE_CHUNK_SAMPLES
+ * samples each. The packets and their data are only valid during the
+ * callback.
+ *
+ * @param rle The run-length encoded data. Must not be NULL.
+ * @param cb Callback to pass each SR_DF_LOGIC packet to.
+ * @param cb_data Data passed to the callback.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @return Otherwise the first error which the callback returned.
+ *
+ * @private
+ */
+SR_PRIV int sr_logic_rle_expand(const struct sr_datafeed_logic_rle *rle,
+		int (*cb)(const struct sr_datafeed_packet *packet, void *cb_data),
+		void *cb_data)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	const uint8_t *value;
+	uint8_t *buf, *wp;
+	size_t unitsize, fill, count, done, chunk;
+	uint64_t i, remain;
+	int ret;
+
+	if (!rle || !cb || !rle->unitsize)
+		return SR_ERR_ARG;
+	if (!rle->num_runs)
+		return SR_OK;
+
+	unitsize = rle->unitsize;
+	buf = g_malloc(LOGIC_RLE_CHUNK_SAMPLES * unitsize);
+	fill = 0;
+	ret = SR_OK;
+
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.unitsize = unitsize;
+	logic.data = buf;
+
+	for (i = 0; i < rle->num_runs && ret == SR_OK; i++) {
+		value = (const uint8_t *)rle->values + i * unitsize;
+		remain = rle->counts[i];
+		while (remain && ret == SR_OK) {
+			count = LOGIC_RLE_CHUNK_SAMPLES - fill;
+			if (count > remain)
+				count = remain;
+			/* Doubling copies of the value fill the run quickly. */
+			wp = &buf[fill * unitsize];
+			memcpy(wp, value, unitsize);
+			done = 1;
+			while (done < count) {
+				chunk = MIN(done, count - done);
+				memcpy(&wp[done * unitsize], wp, chunk * unitsize);
+				done += chunk;
+			}
+			fill += count;
+			remain -= count;
+			if (fill == LOGIC_RLE_CHUNK_SAMPLES) {
+				logic.length = fill * unitsize;
+				ret = cb(&packet, cb_data);
+				fill = 0;
+			}
+		}
+	}
+	if (fill && ret == SR_OK) {
+		logic.length = fill * unitsize;
+		ret = cb(&packet, cb_data);
+	}
+
+	g_free(buf);
+
+	return ret;
+}
+
+static int datafeed_deliver_one(const struct sr_dev_inst *sdi,
+		struct sr_datafeed_packet *packet);
+
+/* Origin of the SR_DF_LOGIC_RLE packet which is being expanded. */
+struct logic_rle_deliver {
+	const struct sr_dev_inst *sdi;
+	uint64_t seq;
+	gboolean timed;
+	/* Timing of the next SR_DF_LOGIC packet. */
+	struct sr_packet_timing timing;
+};
+
+static int logic_rle_deliver_cb(const struct sr_datafeed_packet *packet,
+		void *cb_data)
+{
+	struct logic_rle_deliver *origin;
+	struct shared_packet borrowed;
+	const struct sr_datafeed_logic *logic;
+	int ret;
+
+	origin = cb_data;
+	shared_packet_borrow(&borrowed, packet);
+	borrowed.seq = origin->seq;
+	borrowed.timed = origin->timed;
+	borrowed.timing = origin->timing;
+
+	/* The hardware timestamp is that of the first sample only. */
+	logic = packet->payload;
+	origin->timing.first_sample += logic->length / logic->unitsize;
+	origin->timing.hw_time = 0;
+	origin->timing.hw_rate = 0;
+
+	ret = datafeed_deliver_one(origin->sdi, &borrowed.packet);
+	shared_packet_untrack(&borrowed);
+
+	return ret;
+}
+
+/*
+ * Pass a packet through the session's transforms, starting with the one
+ * at index first. The output of the last one is stored in packet, NULL
+ * if a transform didn't return a packet.
+ */
+static int datafeed_transform(const struct sr_dev_inst *sdi,
+		unsigned int first, struct sr_datafeed_packet **packet)
+{
+	struct sr_datafeed_packet *packet_in, *packet_out;
+	struct sr_transform *t;
+	gint64 start, elapsed;
+	unsigned int i;
+	int ret;
+
+	/*
+	 * Pass the packet to the first transform module. If that returns
+	 * another packet (instead of NULL), pass that packet to the next
+	 * transform module in the list, and so on.
+	 */
+	packet_in = *packet;
+	for (i = first; i < sdi->session->num_transform_plan; i++) {
+		t = sdi->session->transform_plan[i];
+		sr_spew("Running transform module '%s'.", t->module->id);
+		start = g_get_monotonic_time();
+		ret = t->module->receive(t, packet_in, &packet_out);
+		elapsed = g_get_monotonic_time() - start;
+		g_mutex_lock(&sdi->session->stats_mutex);
+		t->busy_us += elapsed;
+		g_mutex_unlock(&sdi->session->stats_mutex);
+		if (ret < 0) {
+			sr_err("Error while running transform module: %d.", ret);
+			return SR_ERR;
+		}
+		if (!packet_out) {
+			/*
+			 * If any of the transforms don't return an output
+			 * packet, abort.
+			 */
+			sr_spew("Transform module didn't return a packet, aborting.");
+			*packet = NULL;
+			return SR_OK;
+		}
+		/*
+		 * Use this transform module's output packet as input
+		 * for the next transform module.
+		 */
+		packet_in = packet_out;
+	}
+	*packet = packet_in;
+
+	return SR_OK;
+}
+
+/**
+ * Send another packet from a transform module, while it handles one.
+ *
+ * The packet runs through the transforms after this one, and reaches
+ * the datafeed callbacks before the output packet of the module. This
+ * lets modules output more than one packet for a packet they handle.
+ * The packet is borrowed, it only needs to be valid during the call.
+ *
+ * @param t The transform which sends the packet. Must not be NULL.
+ * @param packet The packet to send. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR A later transform failed.
+ *
+ * @private
+ */
+SR_PRIV int sr_transform_send(const struct sr_transform *t,
+		struct sr_datafeed_packet *packet)
+{
+	struct sr_session *session;
+	struct shared_packet borrowed;
+	struct sr_datafeed_packet *packet_out;
+	unsigned int i;
+	int ret;
+
+	if (!t || !t->sdi || !t->sdi->session || !packet)
+		return SR_ERR_ARG;
+	session = t->sdi->session;
+
+	for (i = 0; i < session->num_transform_plan; i++) {
+		if (session->transform_plan[i] == t)
+			break;
+	}
+	if (i == session->num_transform_plan)
+		return SR_ERR_ARG;
+
+	packet_out = packet;
+	ret = datafeed_transform(t->sdi, i + 1, &packet_out);
+	if (ret != SR_OK || !packet_out)
+		return ret;
+
+	shared_packet_borrow(&borrowed, packet_out);
+	datafeed_fanout(t->sdi, &borrowed.packet);
+	shared_packet_untrack(&borrowed);
+
+	return SR_OK;
+}
+
+/**
+ * Run the session's transforms on a packet, and pass the result to all
+ * datafeed callbacks.
+ *
+ * This runs either in the context of the sender, or in the datafeed
+ * delivery thread. In the latter case the transforms are taken off the
+ * acquisition path, and their order (as well as the packet order) is
+ * kept since there is exactly one delivery thread.
+ */
+static int datafeed_deliver_one(const struct sr_dev_inst *sdi,
+		struct sr_datafeed_packet *packet)
+{
+	struct sr_datafeed_packet *packet_in;
+	struct shared_packet borrowed;
+	int ret;
+
+	packet_in = packet;
+	ret = datafeed_transform(sdi, 0, &packet_in);
+	if (ret != SR_OK || !packet_in)
+		return ret;
+
+	/*
+	 * If the last transform did output a packet, pass it to all datafeed
+	 * callbacks. Packets which the transforms created themselves are
+	 * borrowed, callbacks need to copy them to keep them.
+	 */
+	if (packet_in == packet) {
+		datafeed_fanout(sdi, packet);
+	} else {
+		shared_packet_borrow(&borrowed, packet_in);
+		borrowed.seq = ((struct shared_packet *)packet)->seq;
+		borrowed.timed = ((struct shared_packet *)packet)->timed;
+		borrowed.timing = ((struct shared_packet *)packet)->timing;
+		datafeed_fanout(sdi, &borrowed.packet);
+		shared_packet_untrack(&borrowed);
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Check whether SR_DF_LOGIC_RLE packets reach the datafeed callbacks as
+ * they are. Otherwise the session expands them, and drivers which have
+ * to expand their data anyway can save the work of encoding it.
+ *
+ * @param session The session. Must not be NULL.
+ *
+ * @return TRUE if the packets get passed on without expansion.
+ *
+ * @private
+ */
+SR_PRIV gboolean sr_session_takes_logic_rle(const struct sr_session *session)
+{
+	return session->logic_rle && !session->transforms;
+}
+
+/**
+ * Check whether sample packets with a trigger in place reach the
+ * datafeed callbacks as they are, see sr_session_send_triggered().
+ *
+ * @param session The session. Must not be NULL.
+ *
+ * @return TRUE if the packets get passed on without splitting them.
+ *
+ * @private
+ */
+SR_PRIV gboolean sr_session_takes_trigger_inplace(
+		const struct sr_session *session)
+{
+	return session->trigger_inplace && !session->transforms;
+}
+
+/**
+ * Check whether drivers may send analog packets with several channels.
+ *
+ * @param session The session the device is in. Can be NULL.
+ *
+ * @return TRUE if the channels of a frame may go out in one packet.
+ *
+ * @private
+ */
+SR_PRIV gboolean sr_session_takes_analog_interleaved(
+		const struct sr_session *session)
+{
+	return session && session->analog_interleaved;
+}
+
+/**
+ * Deliver the datafeed from a separate thread outside of a running
+ * session, e.g. while input modules parse a file.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param depth Maximum number of queued packets when the application
+ *              did not set one with sr_session_datafeed_queue_set(),
+ *              0 for a default.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR The session is running, or the thread cannot start.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_datafeed_thread_start(struct sr_session *session,
+		size_t depth)
+{
+	if (!session)
+		return SR_ERR_ARG;
+	if (session->running) {
+		sr_err("The session's datafeed thread is managed while running.");
+		return SR_ERR;
+	}
+
+	if (session->queue_depth)
+		depth = session->queue_depth;
+	else if (!depth)
+		depth = DATAFEED_QUEUE_DEFAULT_DEPTH;
+
+	return datafeed_queue_create(session, depth);
+}
+
+/**
+ * Deliver all pending packets, and terminate the thread which
+ * sr_session_datafeed_thread_start() started.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_datafeed_thread_stop(struct sr_session *session)
+{
+	if (session)
+		datafeed_queue_stop(session);
+}
+
+/*
+ * Deliver a packet with a trigger marked in place the way callbacks
+ * which don't take those expect: the samples before the trigger,
+ * SR_DF_TRIGGER, then the samples from the trigger on.
+ */
+static int trigger_split_deliver(const struct sr_dev_inst *sdi,
+		const struct shared_packet *sp)
+{
+	struct shared_packet part;
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_analog analog;
+	uint64_t num, split, stride;
+	uint8_t *data;
+	int ret;
+
+	if (sp->packet.type == SR_DF_LOGIC) {
+		logic = *(const struct sr_datafeed_logic *)sp->packet.payload;
+		stride = logic.unitsize;
+		num = stride ? logic.length / stride : 0;
+		data = logic.data;
+	} else {
+		analog = *(const struct sr_datafeed_analog *)sp->packet.payload;
+		/* Interleaved packets hold one value per channel and sample. */
+		stride = analog.encoding->unitsize *
+			MAX(g_slist_length(analog.meaning->channels), 1);
+		num = analog.num_samples;
+		data = analog.data;
+	}
+	split = MIN(sp->trigger_at, num);
+
+	shared_packet_borrow(&part, &sp->packet);
+	part.seq = sp->seq;
+	part.timed = sp->timed;
+	part.timing = sp->timing;
+
+	ret = SR_OK;
+	part.packet.type = sp->packet.type;
+	if (sp->packet.type == SR_DF_LOGIC) {
+		logic.length = split * stride;
+		part.packet.payload = &logic;
+	} else {
+		analog.num_samples = split;
+		part.packet.payload = &analog;
+	}
+	if (split)
+		ret = datafeed_deliver_one(sdi, &part.packet);
+
+	part.packet.type = SR_DF_TRIGGER;
+	part.packet.payload = NULL;
+	part.timed = FALSE;
+	if (ret == SR_OK)
+		ret = datafeed_deliver_one(sdi, &part.packet);
+
+	if (ret != SR_OK || split == num) {
+		shared_packet_untrack(&part);
+		return ret;
+	}
+
+	/* The hardware timestamp is that of the first sample only. */
+	part.packet.type = sp->packet.type;
+	part.timed = sp->timed;
+	part.timing.first_sample += split;
+	part.timing.hw_time = 0;
+	part.timing.hw_rate = 0;
+	if (sp->packet.type == SR_DF_LOGIC) {
+		logic.length = (num - split) * stride;
+		logic.data = data + split * stride;
+		part.packet.payload = &logic;
+	} else {
+		analog.num_samples = num - split;
+		analog.data = data + split * stride;
+		part.packet.payload = &analog;
+	}
+	ret = datafeed_deliver_one(sdi, &part.packet);
+	shared_packet_untrack(&part);
+
+	return ret;
+}
+
+/**
+ * Deliver a packet, expanding run-length encoded logic data for
+ * transforms and for datafeed callbacks which did not ask for it.
+ */
+static int datafeed_deliver(const struct sr_dev_inst *sdi,
+		struct sr_datafeed_packet *packet)
+{
+	struct sr_session *session;
+	struct logic_rle_deliver origin;
+
+	session = sdi->session;
+	if (((struct shared_packet *)packet)->triggered &&
+			!sr_session_takes_trigger_inplace(session))
+		return trigger_split_deliver(sdi,
+			(struct shared_packet *)packet);
+
+	if (packet->type != SR_DF_LOGIC_RLE ||
+			sr_session_takes_logic_rle(session)) {
+		/* Nobody would see it. */
+		if (!session->transforms &&
+				!(session->callback_types & SR_DF_MASK(packet->type)))
+			return SR_OK;
+		return datafeed_deliver_one(sdi, packet);
+	}
+
+	/* Don't expand what no callback would see. */
+	if (!session->transforms &&
+			!(session->callback_types & SR_DF_MASK(SR_DF_LOGIC)))
+		return SR_OK;
+
+	origin.sdi = sdi;
+	origin.seq = ((struct shared_packet *)packet)->seq;
+	origin.timed = ((struct shared_packet *)packet)->timed;
+	origin.timing = ((struct shared_packet *)packet)->timing;
+
+	return sr_logic_rle_expand(packet->payload, logic_rle_deliver_cb,
+		&origin);
+}
+
+static int session_send_packet(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet,
+		const struct sr_packet_timing *timing,
+		const uint64_t *trigger_at,
+		GDestroyNotify release, void *release_data)
+{
+	struct shared_packet borrowed, *sp;
+	struct session_dev_thread *dt;
+	int ret;
+
+	/*
+	 * The driver's buffer can be handed to the callbacks when it came
+	 * with a release hook. Otherwise the callbacks see a borrowed
+	 * packet which is only valid during the callback.
+	 */
+	if (release) {
+		sp = shared_packet_new(packet, release, release_data);
+	} else {
+		shared_packet_borrow(&borrowed, packet);
+		sp = &borrowed;
+	}
+	if (timing) {
+		sp->timed = TRUE;
+		sp->timing = *timing;
+	}
+	if (trigger_at) {
+		sp->triggered = TRUE;
+		sp->trigger_at = *trigger_at;
+	}
+
+	dt = dev_thread_find(sdi->session, sdi);
+	if (dt)
+		sp->seq = (uint64_t)g_atomic_pointer_add(&dt->seq, 1) + 1;
+
+	if (start_hold(sdi, &sp->packet))
+		ret = SR_OK;
+	else if (sdi->session->df_queue)
+		ret = datafeed_queue_push(sdi->session->df_queue, sdi,
+			&sp->packet);
+	else
+		ret = datafeed_deliver(sdi, &sp->packet);
+
+	if (sp != &borrowed)
+		sr_packet_unref(&sp->packet);
+	else
+		shared_packet_untrack(&borrowed);
+
+	return ret;
+}
+
+static void analog_batch_free(void *data)
+{
+	struct analog_batch *batch;
+
+	batch = data;
+	g_slist_free(batch->meaning.channels);
+	g_byte_array_free(batch->data, TRUE);
+	g_free(batch);
+}
+
+/* Send a batch as one packet, the callbacks get it without a copy. */
+static int analog_batch_send(struct analog_batch *batch)
+{
+	struct sr_datafeed_analog analog;
+	struct sr_datafeed_packet packet;
+
+	analog.data = batch->data->data;
+	analog.num_samples = batch->num_samples;
+	analog.encoding = &batch->encoding;
+	analog.meaning = &batch->meaning;
+	analog.spec = &batch->spec;
+	packet.type = SR_DF_ANALOG;
+	packet.payload = &analog;
+
+	return session_send_packet(batch->sdi, &packet, &batch->timing,
+		NULL, analog_batch_free, batch);
+}
+
+static gboolean analog_batch_matches(const struct analog_batch *batch,
+		const struct sr_datafeed_analog *analog)
+{
+	const struct sr_analog_encoding *a, *b;
+
+	a = &batch->encoding;
+	b = analog->encoding;
+	if (a->unitsize != b->unitsize || a->is_signed != b->is_signed ||
+			a->is_float != b->is_float ||
+			a->is_bigendian != b->is_bigendian ||
+			a->digits != b->digits ||
+			a->is_digits_decimal != b->is_digits_decimal ||
+			a->scale.p != b->scale.p || a->scale.q != b->scale.q ||
+			a->offset.p != b->offset.p ||
+			a->offset.q != b->offset.q)
+		return FALSE;
+
+	if (batch->meaning.mq != analog->meaning->mq ||
+			batch->meaning.unit != analog->meaning->unit ||
+			batch->meaning.mqflags != analog->meaning->mqflags ||
+			batch->spec.spec_digits != analog->spec->spec_digits)
+		return FALSE;
+
+	return batch->meaning.channels->data ==
+		analog->meaning->channels->data;
+}
+
+/*
+ * Send (and forget) pending batches which must not wait any longer:
+ * - Without @a sdi: all batches started before @a cutoff_us.
+ * - Without @a analog: all batches of @a sdi.
+ * - Otherwise the batches of @a sdi for the channel of @a analog which
+ *   either do not match it, or which were started before @a cutoff_us.
+ * Must be called with the batch mutex held.
+ */
+static int analog_batch_flush(struct sr_session *session,
+		const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_analog *analog, gint64 cutoff_us)
+{
+	struct analog_batch *batch;
+	GSList *l, *next;
+	int ret;
+
+	ret = SR_OK;
+	for (l = session->analog_batches; l; l = next) {
+		next = l->next;
+		batch = l->data;
+		if (!sdi) {
+			if (batch->start_us >= cutoff_us)
+				continue;
+		} else if (batch->sdi != sdi) {
+			continue;
+		} else if (analog) {
+			if (batch->meaning.channels->data !=
+					analog->meaning->channels->data)
+				continue;
+			if (analog_batch_matches(batch, analog) &&
+					batch->start_us >= cutoff_us)
+				continue;
+		}
+		session->analog_batches =
+			g_slist_delete_link(session->analog_batches, l);
+		if (analog_batch_send(batch) != SR_OK)
+			ret = SR_ERR;
+	}
+
+	return ret;
+}
+
+/* Timer callback, flushes batches which exceeded the latency budget. */
+static gboolean analog_batch_timeout(void *data)
+{
+	struct sr_session *session;
+	gint64 budget_us;
+
+	session = data;
+	budget_us = (gint64)session->analog_batch_ms * 1000;
+
+	g_rec_mutex_lock(&session->batch_mutex);
+	analog_batch_flush(session, NULL, NULL,
+		g_get_monotonic_time() - budget_us);
+	g_rec_mutex_unlock(&session->batch_mutex);
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void analog_batch_start(struct sr_session *session)
+{
+	if (!session->analog_batch_ms)
+		return;
+
+	/* Check twice per budget, samples wait 1.5 times it at most. */
+	session->batch_timer = g_timeout_source_new(
+		MAX(session->analog_batch_ms / 2, 1));
+	g_source_set_callback(session->batch_timer, analog_batch_timeout,
+		session, NULL);
+	/* Not an event source of the session, it must not keep it running. */
+	session_source_attach(session, session->batch_timer);
+}
+
+static void analog_batch_stop(struct sr_session *session)
+{
+	if (session->batch_timer) {
+		g_source_destroy(session->batch_timer);
+		g_source_unref(session->batch_timer);
+		session->batch_timer = NULL;
+	}
+
+	/* Only left over by devices which did not send SR_DF_END. */
+	g_rec_mutex_lock(&session->batch_mutex);
+	g_slist_free_full(session->analog_batches, analog_batch_free);
+	session->analog_batches = NULL;
+	g_rec_mutex_unlock(&session->batch_mutex);
+}
+
+/*
+ * Add a packet to the device's pending batches, or flush them before
+ * the packet gets sent. Returns TRUE if the packet was taken. Analog
+ * packets of a single channel always come with their timing.
+ */
+static gboolean analog_batch_add(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet,
+		const struct sr_packet_timing *timing, int *ret)
+{
+	struct sr_session *session;
+	const struct sr_datafeed_analog *analog;
+	struct analog_batch *batch;
+	GSList *l;
+	gint64 now, budget_us;
+	size_t size;
+
+	session = sdi->session;
+	analog = NULL;
+	if (packet->type == SR_DF_ANALOG) {
+		analog = packet->payload;
+		if (!analog->meaning->channels ||
+				analog->meaning->channels->next)
+			analog = NULL;
+	}
+
+	now = g_get_monotonic_time();
+	budget_us = (gint64)session->analog_batch_ms * 1000;
+
+	/* Flush everything of this device which must go before it. */
+	*ret = analog_batch_flush(session, sdi, analog, now - budget_us);
+	if (!analog)
+		return FALSE;
+
+	batch = NULL;
+	for (l = session->analog_batches; l; l = l->next) {
+		if (((struct analog_batch *)l->data)->sdi == sdi &&
+				analog_batch_matches(l->data, analog)) {
+			batch = l->data;
+			break;
+		}
+	}
+	if (!batch) {
+		batch = g_malloc0(sizeof(*batch));
+		batch->sdi = sdi;
+		batch->start_us = now;
+		batch->timing = *timing;
+		batch->encoding = *analog->encoding;
+		batch->meaning = *analog->meaning;
+		batch->meaning.channels = g_slist_copy(analog->meaning->channels);
+		batch->spec = *analog->spec;
+		batch->data = g_byte_array_new();
+		session->analog_batches =
+			g_slist_append(session->analog_batches, batch);
+	}
+
+	size = (size_t)analog->num_samples * analog->encoding->unitsize;
+	g_byte_array_append(batch->data, analog->data, size);
+	batch->num_samples += analog->num_samples;
+
+	if (batch->data->len >= ANALOG_BATCH_MAX_BYTES) {
+		session->analog_batches =
+			g_slist_remove(session->analog_batches, batch);
+		if (analog_batch_send(batch) != SR_OK)
+			*ret = SR_ERR;
+	}
+
+	return TRUE;
+}
+
+static int session_send_internal(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet,
+		const struct sr_packet_timing *given, const uint64_t *trigger_at,
+		GDestroyNotify release, void *release_data)
+{
+	struct sr_session *session;
+	struct sr_packet_timing timing, *t;
+	int ret, flush_ret;
+
+	session = sdi->session;
+
+	SR_PROBE2(packet_send, sdi, packet->type);
+	session_stats_count(session, packet);
+	t = packet_timing_fill(sdi, packet, given, &timing) ? &timing : NULL;
+
+	if (!session->analog_batch_ms)
+		return session_send_packet(sdi, packet, t, trigger_at,
+			release, release_data);
+
+	/* The batch order must match the order of sending. */
+	g_rec_mutex_lock(&session->batch_mutex);
+	if (trigger_at) {
+		/* The trigger position is that of this packet alone. */
+		flush_ret = analog_batch_flush(session, sdi, NULL, 0);
+		ret = session_send_packet(sdi, packet, t, trigger_at,
+			release, release_data);
+		if (flush_ret != SR_OK)
+			ret = flush_ret;
+	} else if (analog_batch_add(sdi, packet, t, &flush_ret)) {
+		/* The samples were copied. */
+		if (release)
+			release(release_data);
+		ret = flush_ret;
+	} else {
+		ret = session_send_packet(sdi, packet, t, NULL,
+			release, release_data);
+		if (flush_ret != SR_OK)
+			ret = flush_ret;
+	}
+	g_rec_mutex_unlock(&session->batch_mutex);
+
+	return ret;
+}
+
+static int session_send_check(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet)
+{
+	if (!sdi) {
+		sr_err("%s: sdi was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+
+	if (!packet) {
+		sr_err("%s: packet was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+
+	if (!sdi->session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_BUG;
+	}
+
+	return SR_OK;
 }
 
 /**
- * Set the callback to be invoked after a session stopped running.
- *
- * Install a callback to receive notification when a session run stopped.
- * This can be used to integrate session execution with an existing main
- * loop, without having to block in sr_session_run().
+ * Send a packet to whatever is listening on the datafeed bus.
  *
- * Note that the callback will be invoked in the context of the thread
- * that calls sr_session_start().
+ * Hardware drivers use this to send a data packet to the frontend.
  *
- * @param session The session to use. Must not be NULL.
- * @param cb The callback to invoke on session stop. May be NULL to unset.
- * @param cb_data User data pointer to be passed to the callback.
+ * @param sdi TODO.
+ * @param packet The datafeed packet to send to the session bus.
  *
  * @retval SR_OK Success.
- * @retval SR_ERR_ARG Invalid session passed.
+ * @retval SR_ERR_ARG Invalid argument.
  *
- * @since 0.4.0
+ * @private
  */
-SR_API int sr_session_stopped_callback_set(struct sr_session *session,
-		sr_session_stopped_callback cb, void *cb_data)
+SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet)
 {
-	if (!session) {
-		sr_err("%s: session was NULL", __func__);
-		return SR_ERR_ARG;
-	}
-	session->stopped_callback = cb;
-	session->stopped_cb_data = cb_data;
+	int ret;
 
-	return SR_OK;
+	ret = session_send_check(sdi, packet);
+	if (ret != SR_OK)
+		return ret;
+
+	return session_send_internal(sdi, packet, NULL, NULL, NULL, NULL);
 }
 
 /**
- * Debug helper.
+ * Send a packet and hand over ownership of its sample data.
  *
- * @param packet The packet to show debugging information for.
+ * Unlike sr_session_send(), the sample data need not be copied by
+ * datafeed callbacks which want to keep it. The packet structs may
+ * still live on the caller's stack, only the memory which the payload
+ * points to must stay valid until @a release gets called. This can
+ * happen before this function returns, or much later when the last
+ * sr_packet_unref() is done (possibly from a different thread).
+ *
+ * @param sdi The device instance the packet belongs to.
+ * @param packet The datafeed packet to send to the session bus.
+ * @param release Callback to release the sample data. Can be NULL.
+ * @param release_data Data passed to the release callback.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @private
  */
-static void datafeed_dump(const struct sr_datafeed_packet *packet)
+SR_PRIV int sr_session_send_zerocopy(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet,
+		GDestroyNotify release, void *release_data)
 {
-	const struct sr_datafeed_logic *logic;
-	const struct sr_datafeed_analog *analog;
+	int ret;
 
-	/* Please use the same order as in libsigrok.h. */
-	switch (packet->type) {
-	case SR_DF_HEADER:
-		sr_dbg("bus: Received SR_DF_HEADER packet.");
-		break;
-	case SR_DF_END:
-		sr_dbg("bus: Received SR_DF_END packet.");
-		break;
-	case SR_DF_META:
-		sr_dbg("bus: Received SR_DF_META packet.");
-		break;
-	case SR_DF_TRIGGER:
-		sr_dbg("bus: Received SR_DF_TRIGGER packet.");
-		break;
-	case SR_DF_LOGIC:
-		logic = packet->payload;
-		sr_dbg("bus: Received SR_DF_LOGIC packet (%" PRIu64 " bytes, "
-		       "unitsize = %d).", logic->length, logic->unitsize);
-		break;
-	case SR_DF_FRAME_BEGIN:
-		sr_dbg("bus: Received SR_DF_FRAME_BEGIN packet.");
-		break;
-	case SR_DF_FRAME_END:
-		sr_dbg("bus: Received SR_DF_FRAME_END packet.");
-		break;
-	case SR_DF_ANALOG:
-		analog = packet->payload;
-		sr_dbg("bus: Received SR_DF_ANALOG packet (%d samples).",
-		       analog->num_samples);
-		break;
-	default:
-		sr_dbg("bus: Received unknown packet type: %d.", packet->type);
-		break;
+	ret = session_send_check(sdi, packet);
+	if (ret != SR_OK) {
+		if (release)
+			release(release_data);
+		return ret;
 	}
+
+	return session_send_internal(sdi, packet, NULL, NULL,
+		release, release_data);
 }
 
 /**
- * Helper to send a meta datafeed package (SR_DF_META) to the session bus.
+ * Send a packet with samples, along with what the driver knows about
+ * their timing.
  *
- * @param sdi The device instance to send the package from. Must not be NULL.
- * @param key The config key to send to the session bus.
- * @param var The value to send to the session bus.
+ * In contrast to sr_session_send(), the packet's first sample index is
+ * taken from @a timing (subsequent packets continue from there), and so
+ * are the hardware timestamp and the host time (unless that is 0).
+ * See sr_packet_timing_get().
+ *
+ * @param sdi The device instance the packet belongs to.
+ * @param packet The datafeed packet to send to the session bus.
+ * @param timing The timing of the packet's first sample. Must not be NULL.
  *
  * @retval SR_OK Success.
  * @retval SR_ERR_ARG Invalid argument.
  *
  * @private
  */
-SR_PRIV int sr_session_send_meta(const struct sr_dev_inst *sdi,
-		uint32_t key, GVariant *var)
+SR_PRIV int sr_session_send_timed(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet,
+		const struct sr_packet_timing *timing)
 {
-	struct sr_config *cfg;
-	struct sr_datafeed_packet packet;
-	struct sr_datafeed_meta meta;
 	int ret;
 
-	cfg = sr_config_new(key, var);
-
-	memset(&meta, 0, sizeof(meta));
-
-	packet.type = SR_DF_META;
-	packet.payload = &meta;
-
-	meta.config = g_slist_append(NULL, cfg);
-
-	ret = sr_session_send(sdi, &packet);
-	g_slist_free(meta.config);
-	sr_config_free(cfg);
+	ret = session_send_check(sdi, packet);
+	if (ret != SR_OK)
+		return ret;
+	if (!timing)
+		return SR_ERR_ARG;
 
-	return ret;
+	return session_send_internal(sdi, packet, timing, NULL, NULL, NULL);
 }
 
 /**
- * Send a packet to whatever is listening on the datafeed bus.
+ * Send a sample packet with a trigger in it.
  *
- * Hardware drivers use this to send a data packet to the frontend.
+ * Drivers use this instead of sending the samples before the trigger,
+ * SR_DF_TRIGGER, and the samples from the trigger on. The session splits
+ * the packet in that way unless its callbacks take the trigger in place,
+ * see sr_session_trigger_inplace_set().
  *
- * @param sdi TODO.
- * @param packet The datafeed packet to send to the session bus.
+ * @param sdi The device instance the packet belongs to.
+ * @param packet The SR_DF_LOGIC or SR_DF_ANALOG packet to send.
+ * @param trigger_at The sample the trigger goes before, up to the number
+ *                   of samples in the packet.
+ * @param release Callback to release the sample data, as with
+ *                sr_session_send_zerocopy(). Can be NULL.
+ * @param release_data Data passed to the release callback.
  *
  * @retval SR_OK Success.
  * @retval SR_ERR_ARG Invalid argument.
  *
  * @private
  */
-SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
-		const struct sr_datafeed_packet *packet)
+SR_PRIV int sr_session_send_triggered(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, uint64_t trigger_at,
+		GDestroyNotify release, void *release_data)
 {
-	GSList *l;
-	struct datafeed_callback *cb_struct;
-	struct sr_datafeed_packet *packet_in, *packet_out;
-	struct sr_transform *t;
 	int ret;
 
-	if (!sdi) {
-		sr_err("%s: sdi was NULL", __func__);
-		return SR_ERR_ARG;
-	}
-
-	if (!packet) {
-		sr_err("%s: packet was NULL", __func__);
-		return SR_ERR_ARG;
-	}
-
-	if (!sdi->session) {
-		sr_err("%s: session was NULL", __func__);
-		return SR_ERR_BUG;
-	}
-
-	/*
-	 * Pass the packet to the first transform module. If that returns
-	 * another packet (instead of NULL), pass that packet to the next
-	 * transform module in the list, and so on.
-	 */
-	packet_in = (struct sr_datafeed_packet *)packet;
-	for (l = sdi->session->transforms; l; l = l->next) {
-		t = l->data;
-		sr_spew("Running transform module '%s'.", t->module->id);
-		ret = t->module->receive(t, packet_in, &packet_out);
-		if (ret < 0) {
-			sr_err("Error while running transform module: %d.", ret);
-			return SR_ERR;
-		}
-		if (!packet_out) {
-			/*
-			 * If any of the transforms don't return an output
-			 * packet, abort.
-			 */
-			sr_spew("Transform module didn't return a packet, aborting.");
-			return SR_OK;
-		} else {
-			/*
-			 * Use this transform module's output packet as input
-			 * for the next transform module.
-			 */
-			packet_in = packet_out;
-		}
+	ret = session_send_check(sdi, packet);
+	if (ret == SR_OK && packet->type != SR_DF_LOGIC &&
+			packet->type != SR_DF_ANALOG) {
+		sr_err("%s: not a sample packet", __func__);
+		ret = SR_ERR_ARG;
 	}
-	packet = packet_in;
-
-	/*
-	 * If the last transform did output a packet, pass it to all datafeed
-	 * callbacks.
-	 */
-	for (l = sdi->session->datafeed_callbacks; l; l = l->next) {
-		if (sr_log_loglevel_get() >= SR_LOG_DBG)
-			datafeed_dump(packet);
-		cb_struct = l->data;
-		cb_struct->cb(sdi, packet, cb_struct->cb_data);
+	if (ret != SR_OK) {
+		if (release)
+			release(release_data);
+		return ret;
 	}
 
-	return SR_OK;
+	return session_send_internal(sdi, packet, NULL, &trigger_at,
+		release, release_data);
 }
 
 /**
@@ -1207,6 +4699,10 @@ SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
 SR_PRIV int sr_session_source_add_internal(struct sr_session *session,
 		void *key, GSource *source)
 {
+	struct session_dev_thread *dt;
+	unsigned int id;
+
+	g_rec_mutex_lock(&session->sources_mutex);
 	/*
 	 * This must not ever happen, since the source has already been
 	 * created and its finalize() method will remove the key for the
@@ -1215,11 +4711,21 @@ SR_PRIV int sr_session_source_add_internal(struct sr_session *session,
 	 */
 	if (g_hash_table_contains(session->event_sources, key)) {
 		sr_err("Event source with key %p already exists.", key);
+		g_rec_mutex_unlock(&session->sources_mutex);
 		return SR_ERR_BUG;
 	}
 	g_hash_table_insert(session->event_sources, key, source);
 
-	if (session_source_attach(session, source) == 0)
+	/* Sources of a device thread are dispatched in that thread. */
+	dt = g_private_get(&dev_thread_key);
+	if (dt && dt->session == session)
+		id = g_source_attach(source, dt->context);
+	else
+		id = session_source_attach(session, source);
+
+	g_rec_mutex_unlock(&session->sources_mutex);
+
+	if (id == 0)
 		return SR_ERR;
 
 	return SR_OK;
@@ -1273,6 +4779,92 @@ SR_PRIV int sr_session_source_add(struct sr_session *session, int fd,
 			fd, events, timeout, cb, cb_data);
 }
 
+/**
+ * Have the callback which is running get called again by a given time.
+ *
+ * This only works from the callback of a source which has a timeout. It
+ * lets callbacks with work due at a known time (e.g. the next request to
+ * a device) sleep until exactly then, rather than wake at a short regular
+ * interval to check. The main loop sorts out which of all sources is due
+ * first. The source's regular timeout applies when it's sooner.
+ *
+ * @param due_us The time (of g_get_monotonic_time()) to time out at, or
+ *               0 to only use the regular timeout.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_source_wake_at(int64_t due_us)
+{
+	struct fd_source *fsource;
+
+	if (!due_us || !(fsource = g_private_get(&fd_source_key)))
+		return;
+
+	if (!fsource->wake_us || due_us < fsource->wake_us)
+		fsource->wake_us = due_us;
+}
+
+/**
+ * Get the current time, cheaply from an event source's callback.
+ *
+ * Callbacks get the time which glib caches for the main loop iteration
+ * which dispatches them. This is at most as old as the callbacks which
+ * ran before in the same iteration. Elsewhere this is the same as
+ * g_get_monotonic_time().
+ *
+ * @return The time, in microseconds of g_get_monotonic_time().
+ *
+ * @private
+ */
+SR_PRIV int64_t sr_session_source_time(void)
+{
+	struct fd_source *fsource;
+
+	if (!(fsource = g_private_get(&fd_source_key)))
+		return g_get_monotonic_time();
+
+	return g_source_get_time(&fsource->base);
+}
+
+/**
+ * Have an event source dispatched soon, from any thread.
+ *
+ * This is for transports which receive data in a thread of their own,
+ * since they have no file descriptor which the main loop could poll.
+ * The source's callback gets called with G_IO_IN, as if its file
+ * descriptor had become readable.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param key The key which identifies the event source.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or no such event source.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_source_notify(struct sr_session *session, void *key)
+{
+	GSource *source;
+	struct fd_source *fsource;
+
+	if (!session)
+		return SR_ERR_ARG;
+
+	g_rec_mutex_lock(&session->sources_mutex);
+	source = g_hash_table_lookup(session->event_sources, key);
+	if (!source || g_source_is_destroyed(source)
+			|| source->source_funcs->prepare != fd_source_prepare) {
+		g_rec_mutex_unlock(&session->sources_mutex);
+		return SR_ERR_ARG;
+	}
+	fsource = (struct fd_source *)source;
+	g_atomic_int_set(&fsource->notified, TRUE);
+	g_main_context_wakeup(g_source_get_context(source));
+	g_rec_mutex_unlock(&session->sources_mutex);
+
+	return SR_OK;
+}
+
 /**
  * Add an event source for a GPollFD.
  *
@@ -1357,16 +4949,19 @@ SR_PRIV int sr_session_source_remove_internal(struct sr_session *session,
 {
 	GSource *source;
 
+	g_rec_mutex_lock(&session->sources_mutex);
 	source = g_hash_table_lookup(session->event_sources, key);
 	/*
 	 * Trying to remove an already removed event source is problematic
 	 * since the poll_object handle may have been reused in the meantime.
 	 */
 	if (!source) {
+		g_rec_mutex_unlock(&session->sources_mutex);
 		sr_warn("Cannot remove non-existing event source %p.", key);
 		return SR_ERR_BUG;
 	}
 	g_source_destroy(source);
+	g_rec_mutex_unlock(&session->sources_mutex);
 
 	return SR_OK;
 }
@@ -1453,31 +5048,92 @@ SR_PRIV int sr_session_source_destroyed(struct sr_session *session,
 		void *key, GSource *source)
 {
 	GSource *registered_source;
+	int ret;
 
+	g_rec_mutex_lock(&session->sources_mutex);
 	registered_source = g_hash_table_lookup(session->event_sources, key);
 	/*
 	 * Trying to remove an already removed event source is problematic
 	 * since the poll_object handle may have been reused in the meantime.
 	 */
 	if (!registered_source) {
+		g_rec_mutex_unlock(&session->sources_mutex);
 		sr_err("No event source for key %p found.", key);
 		return SR_ERR_BUG;
 	}
 	if (registered_source != source) {
+		g_rec_mutex_unlock(&session->sources_mutex);
 		sr_err("Event source for key %p does not match"
 			" destroyed source.", key);
 		return SR_ERR_BUG;
 	}
 	g_hash_table_remove(session->event_sources, key);
 
-	if (g_hash_table_size(session->event_sources) > 0)
-		return SR_OK;
-
 	/* If no event sources are left, consider the acquisition finished.
 	 * This is pretty crude, as it requires all event sources to be
 	 * registered via the libsigrok API.
 	 */
-	return stop_check_later(session);
+	ret = SR_OK;
+	if (g_hash_table_size(session->event_sources) == 0)
+		ret = stop_check_later(session);
+	g_rec_mutex_unlock(&session->sources_mutex);
+
+	return ret;
+}
+
+/*
+ * Copy of an analog packet made by sr_packet_copy(). The packet, its
+ * payload structs and the sample data are allocated in one block,
+ * drivers which send many small analog packets would otherwise cost
+ * six allocations per copy.
+ */
+struct analog_copy {
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	/* Sample data, declared as uint64_t for its alignment. */
+	uint64_t data[];
+};
+
+static struct sr_datafeed_packet *analog_copy_new(
+		const struct sr_datafeed_analog *analog)
+{
+	struct analog_copy *ac;
+	size_t size;
+
+	/* Interleaved packets hold one value per channel and sample. */
+	size = (size_t)analog->encoding->unitsize * analog->num_samples *
+		MAX(g_slist_length(analog->meaning->channels), 1);
+	ac = g_malloc(sizeof(*ac) + size);
+	memcpy(ac->data, analog->data, size);
+	ac->encoding = *analog->encoding;
+	ac->meaning = *analog->meaning;
+	ac->meaning.channels = g_slist_copy(analog->meaning->channels);
+	ac->spec = *analog->spec;
+	ac->analog.data = ac->data;
+	ac->analog.num_samples = analog->num_samples;
+	ac->analog.encoding = &ac->encoding;
+	ac->analog.meaning = &ac->meaning;
+	ac->analog.spec = &ac->spec;
+	ac->packet.type = SR_DF_ANALOG;
+	ac->packet.payload = &ac->analog;
+
+	return &ac->packet;
+}
+
+/* Whether sr_packet_copy() allocated the analog packet in one block. */
+static gboolean analog_copy_check(const struct sr_datafeed_packet *packet)
+{
+	const struct analog_copy *ac;
+	const struct sr_datafeed_analog *analog;
+
+	/* Only dereference the payload, the packet may be a bare struct. */
+	ac = (const struct analog_copy *)packet;
+	analog = packet->payload;
+
+	return analog == &ac->analog && analog->encoding == &ac->encoding;
 }
 
 static void copy_src(struct sr_config *src, struct sr_datafeed_meta *meta_copy)
@@ -1494,16 +5150,23 @@ SR_API int sr_packet_copy(const struct sr_datafeed_packet *packet,
 	struct sr_datafeed_meta *meta_copy;
 	const struct sr_datafeed_logic *logic;
 	struct sr_datafeed_logic *logic_copy;
-	const struct sr_datafeed_analog *analog;
-	struct sr_datafeed_analog *analog_copy;
+	const struct sr_datafeed_logic_rle *logic_rle;
+	struct sr_datafeed_logic_rle *logic_rle_copy;
 	uint8_t *payload;
 
+	if (packet->type == SR_DF_ANALOG) {
+		*copy = analog_copy_new(packet->payload);
+		return SR_OK;
+	}
+
 	*copy = g_malloc0(sizeof(struct sr_datafeed_packet));
 	(*copy)->type = packet->type;
 
 	switch (packet->type) {
 	case SR_DF_TRIGGER:
 	case SR_DF_END:
+	case SR_DF_FRAME_BEGIN:
+	case SR_DF_FRAME_END:
 		/* No payload. */
 		break;
 	case SR_DF_HEADER:
@@ -1514,7 +5177,7 @@ SR_API int sr_packet_copy(const struct sr_datafeed_packet *packet,
 	case SR_DF_META:
 		meta = packet->payload;
 		meta_copy = g_malloc0(sizeof(struct sr_datafeed_meta));
-		g_slist_foreach(meta->config, (GFunc)copy_src, meta_copy->config);
+		g_slist_foreach(meta->config, (GFunc)copy_src, meta_copy);
 		(*copy)->payload = meta_copy;
 		break;
 	case SR_DF_LOGIC:
@@ -1524,31 +5187,24 @@ SR_API int sr_packet_copy(const struct sr_datafeed_packet *packet,
 			return SR_ERR;
 		logic_copy->length = logic->length;
 		logic_copy->unitsize = logic->unitsize;
-		logic_copy->data = g_malloc(logic->length * logic->unitsize);
+		logic_copy->data = g_malloc(logic->length);
 		if (!logic_copy->data) {
 			g_free(logic_copy);
 			return SR_ERR;
 		}
-		memcpy(logic_copy->data, logic->data, logic->length * logic->unitsize);
+		memcpy(logic_copy->data, logic->data, logic->length);
 		(*copy)->payload = logic_copy;
 		break;
-	case SR_DF_ANALOG:
-		analog = packet->payload;
-		analog_copy = g_malloc(sizeof(*analog_copy));
-		analog_copy->data = g_malloc(
-				analog->encoding->unitsize * analog->num_samples);
-		memcpy(analog_copy->data, analog->data,
-				analog->encoding->unitsize * analog->num_samples);
-		analog_copy->num_samples = analog->num_samples;
-		analog_copy->encoding = g_memdup(analog->encoding,
-				sizeof(struct sr_analog_encoding));
-		analog_copy->meaning = g_memdup(analog->meaning,
-				sizeof(struct sr_analog_meaning));
-		analog_copy->meaning->channels = g_slist_copy(
-				analog->meaning->channels);
-		analog_copy->spec = g_memdup(analog->spec,
-				sizeof(struct sr_analog_spec));
-		(*copy)->payload = analog_copy;
+	case SR_DF_LOGIC_RLE:
+		logic_rle = packet->payload;
+		logic_rle_copy = g_malloc(sizeof(*logic_rle_copy));
+		logic_rle_copy->num_runs = logic_rle->num_runs;
+		logic_rle_copy->unitsize = logic_rle->unitsize;
+		logic_rle_copy->values = g_memdup(logic_rle->values,
+				logic_rle->num_runs * logic_rle->unitsize);
+		logic_rle_copy->counts = g_memdup(logic_rle->counts,
+				logic_rle->num_runs * sizeof(uint64_t));
+		(*copy)->payload = logic_rle_copy;
 		break;
 	default:
 		sr_err("Unknown packet type %d", packet->type);
@@ -1562,13 +5218,23 @@ SR_API void sr_packet_free(struct sr_datafeed_packet *packet)
 {
 	const struct sr_datafeed_meta *meta;
 	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_logic_rle *logic_rle;
 	const struct sr_datafeed_analog *analog;
 	struct sr_config *src;
 	GSList *l;
 
+	if (packet->type == SR_DF_ANALOG && analog_copy_check(packet)) {
+		analog = packet->payload;
+		g_slist_free(analog->meaning->channels);
+		g_free(packet);
+		return;
+	}
+
 	switch (packet->type) {
 	case SR_DF_TRIGGER:
 	case SR_DF_END:
+	case SR_DF_FRAME_BEGIN:
+	case SR_DF_FRAME_END:
 		/* No payload. */
 		break;
 	case SR_DF_HEADER:
@@ -1599,6 +5265,12 @@ SR_API void sr_packet_free(struct sr_datafeed_packet *packet)
 		g_free(analog->spec);
 		g_free((void *)packet->payload);
 		break;
+	case SR_DF_LOGIC_RLE:
+		logic_rle = packet->payload;
+		g_free(logic_rle->values);
+		g_free(logic_rle->counts);
+		g_free((void *)packet->payload);
+		break;
 	default:
 		sr_err("Unknown packet type %d", packet->type);
 	}
@@ -18,6 +18,7 @@
  */
 
 #include <config.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -34,8 +35,13 @@
 #define CHUNKSIZE (4 * 1024 * 1024)
 /** @endcond */
 
+/* Threads which decompress logic chunks ahead, see chunk_reader_new(). */
+#define MAX_READER_THREADS 8
+
 SR_PRIV struct sr_dev_driver session_driver_info;
 
+struct chunk_reader;
+
 struct session_vdev {
 	char *sessionfile;
 	char *capturefile;
@@ -50,6 +56,50 @@ struct session_vdev {
 	GArray *analog_channels;
 	int cur_chunk;
 	gboolean finished;
+	/* Uncompressed session directory, files are memory-mapped. */
+	gboolean is_dir;
+	gboolean logic_done;
+	GMappedFile *mapped;
+	size_t map_pos;
+	/* Logic data filter, and the last logic sample sent. */
+	gboolean xor_delta;
+	uint8_t *xor_prev;
+	/* Decompresses chunked logic data in parallel, if there is one. */
+	struct chunk_reader *reader;
+};
+
+/* A decompressed chunk, ready once data or status is set. */
+struct chunk_slot {
+	gboolean ready;
+	GBytes *data;
+	int status;
+};
+
+/*
+ * The logic-1-N chunks get decompressed by worker threads, each with
+ * its own handle to the archive (libzip handles must not be shared
+ * between threads). Workers only claim chunks within a window ahead of
+ * the one to be delivered next, which bounds the memory used. Chunks
+ * are delivered in order.
+ */
+struct chunk_reader {
+	char *sessionfile;
+	char *basename;
+	int unitsize;
+	gboolean xor_delta;
+	GThread *threads[MAX_READER_THREADS];
+	int num_threads;
+	/* Protects everything below, signals claims and completions. */
+	GMutex mutex;
+	GCond cond;
+	struct chunk_slot *slots;
+	int window;
+	/* Next chunk to claim and to deliver. Chunk numbers start at 1. */
+	int next_claim;
+	int next_deliver;
+	/* The first chunk which doesn't exist. */
+	int end;
+	gboolean stop;
 };
 
 static const uint32_t devopts[] = {
@@ -61,6 +111,273 @@ static const uint32_t devopts[] = {
 	SR_CONF_SESSIONFILE | SR_CONF_SET,
 };
 
+/*
+ * Take the sample encoding of an analog channel from its private data,
+ * as set up by sr_session_load(). Channels without one hold floats.
+ */
+static void analog_encoding_get(struct sr_analog_encoding *encoding,
+	const struct sr_channel *ch)
+{
+	const struct sr_analog_encoding *stored;
+
+	if (!(stored = ch->priv))
+		return;
+	encoding->unitsize = stored->unitsize;
+	encoding->is_signed = stored->is_signed;
+	encoding->is_float = stored->is_float;
+	encoding->is_bigendian = stored->is_bigendian;
+	encoding->scale = stored->scale;
+	encoding->offset = stored->offset;
+}
+
+/*
+ * Open a capture file of the archive. libzip decodes whichever method
+ * the srzip output compressed it with, unless it lacks support for it.
+ */
+static struct zip_file *capture_open(struct session_vdev *vdev,
+	const char *name)
+{
+	struct zip_file *zf;
+
+	if (!(zf = zip_fopen(vdev->archive, name, 0))) {
+		sr_err("Cannot read '%s' of session file '%s': %s",
+			name, vdev->sessionfile, zip_strerror(vdev->archive));
+		return NULL;
+	}
+	sr_dbg("Opened %s.", name);
+	if (vdev->xor_prev)
+		memset(vdev->xor_prev, 0, vdev->unitsize);
+
+	return zf;
+}
+
+/* Decompress (and decode) one chunk. Called by the worker threads. */
+static int chunk_read(struct chunk_reader *reader, struct zip *archive,
+	int chunk, GBytes **data)
+{
+	struct zip_stat zs;
+	struct zip_file *zf;
+	char name[128];
+	uint8_t *buf, *prev;
+	zip_int64_t ret;
+
+	*data = NULL;
+	snprintf(name, sizeof(name), "%s-%d", reader->basename, chunk);
+	zip_stat_init(&zs);
+	if (zip_stat(archive, name, 0, &zs) == -1)
+		return SR_OK;
+	if (!(zs.valid & ZIP_STAT_SIZE) || zs.size > G_MAXSIZE) {
+		sr_err("Unknown size of '%s'.", name);
+		return SR_ERR_DATA;
+	}
+	if (!(buf = g_try_malloc(MAX(zs.size, 1)))) {
+		sr_err("Cannot allocate %" PRIu64 " bytes for '%s'.",
+			(uint64_t)zs.size, name);
+		return SR_ERR_MALLOC;
+	}
+	if (!(zf = zip_fopen(archive, name, 0))) {
+		sr_err("Cannot read '%s' of session file '%s': %s",
+			name, reader->sessionfile, zip_strerror(archive));
+		g_free(buf);
+		return SR_ERR_IO;
+	}
+	ret = zip_fread(zf, buf, zs.size);
+	zip_fclose(zf);
+	if (ret != (zip_int64_t)zs.size) {
+		sr_err("Cannot read '%s' of session file '%s'.",
+			name, reader->sessionfile);
+		g_free(buf);
+		return SR_ERR_IO;
+	}
+
+	/* The filter restarts with every chunk, so it decodes here too. */
+	if (reader->xor_delta) {
+		prev = g_malloc0(reader->unitsize);
+		sr_sessionfile_xor_decode(buf,
+			zs.size - zs.size % reader->unitsize,
+			prev, reader->unitsize);
+		g_free(prev);
+	}
+	*data = g_bytes_new_take(buf, zs.size);
+
+	return SR_OK;
+}
+
+static gpointer chunk_reader_thread(gpointer data)
+{
+	struct chunk_reader *reader;
+	struct chunk_slot *slot;
+	struct zip *archive;
+	GBytes *bytes;
+	int chunk, ret, err;
+
+	reader = data;
+	if (!(archive = zip_open(reader->sessionfile, 0, &err)))
+		sr_err("Failed to open session file '%s': zip error %d.",
+			reader->sessionfile, err);
+
+	g_mutex_lock(&reader->mutex);
+	while (TRUE) {
+		while (!reader->stop && reader->next_claim < reader->end &&
+				reader->next_claim >= reader->next_deliver + reader->window)
+			g_cond_wait(&reader->cond, &reader->mutex);
+		if (reader->stop || reader->next_claim >= reader->end)
+			break;
+		chunk = reader->next_claim++;
+		g_mutex_unlock(&reader->mutex);
+
+		ret = archive ? chunk_read(reader, archive, chunk, &bytes) : SR_ERR_IO;
+
+		g_mutex_lock(&reader->mutex);
+		if (ret == SR_OK && !bytes) {
+			/* No such chunk, the ones before it are all there is. */
+			reader->end = MIN(reader->end, chunk);
+		} else {
+			slot = &reader->slots[chunk % reader->window];
+			slot->ready = TRUE;
+			slot->data = bytes;
+			slot->status = ret;
+		}
+		g_cond_broadcast(&reader->cond);
+	}
+	g_mutex_unlock(&reader->mutex);
+
+	if (archive)
+		zip_discard(archive);
+
+	return NULL;
+}
+
+static void chunk_reader_free(struct chunk_reader *reader)
+{
+	int i;
+
+	if (!reader)
+		return;
+
+	g_mutex_lock(&reader->mutex);
+	reader->stop = TRUE;
+	g_cond_broadcast(&reader->cond);
+	g_mutex_unlock(&reader->mutex);
+	for (i = 0; i < reader->num_threads; i++)
+		g_thread_join(reader->threads[i]);
+
+	for (i = 0; i < reader->window; i++)
+		if (reader->slots[i].data)
+			g_bytes_unref(reader->slots[i].data);
+	g_free(reader->slots);
+	g_mutex_clear(&reader->mutex);
+	g_cond_clear(&reader->cond);
+	g_free(reader->sessionfile);
+	g_free(reader->basename);
+	g_free(reader);
+}
+
+/*
+ * Start decompressing the chunks of a capture file in parallel. Returns
+ * NULL when there is no point in that (a single CPU), or when no thread
+ * can be started. The chunks get read one after another then.
+ */
+static struct chunk_reader *chunk_reader_new(const struct session_vdev *vdev)
+{
+	struct chunk_reader *reader;
+	int num_threads;
+
+	num_threads = MIN(g_get_num_processors(), MAX_READER_THREADS);
+	if (num_threads < 2)
+		return NULL;
+
+	reader = g_malloc0(sizeof(*reader));
+	reader->sessionfile = g_strdup(vdev->sessionfile);
+	reader->basename = g_strdup(vdev->capturefile);
+	reader->unitsize = vdev->unitsize;
+	reader->xor_delta = vdev->xor_delta;
+	reader->window = 2 * num_threads;
+	reader->slots = g_malloc0(reader->window * sizeof(reader->slots[0]));
+	reader->next_claim = 1;
+	reader->next_deliver = 1;
+	reader->end = G_MAXINT;
+	g_mutex_init(&reader->mutex);
+	g_cond_init(&reader->cond);
+
+	while (reader->num_threads < num_threads) {
+		reader->threads[reader->num_threads] = g_thread_try_new(
+			"sr-session-read", chunk_reader_thread, reader, NULL);
+		if (!reader->threads[reader->num_threads])
+			break;
+		reader->num_threads++;
+	}
+	if (!reader->num_threads) {
+		chunk_reader_free(reader);
+		return NULL;
+	}
+	sr_dbg("Reading chunks with %d threads.", reader->num_threads);
+
+	return reader;
+}
+
+/*
+ * Send the next chunk from the reader, in packets of at most CHUNKSIZE.
+ * Once all chunks are sent, the reader is done with, and the chunk
+ * number is left at the last chunk, to continue with analog data.
+ */
+static gboolean stream_session_chunks(struct sr_dev_inst *sdi)
+{
+	struct session_vdev *vdev;
+	struct chunk_reader *reader;
+	struct chunk_slot *slot;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	GBytes *bytes;
+	const uint8_t *data;
+	gsize len, pos, n;
+	int ret;
+
+	vdev = sdi->priv;
+	reader = vdev->reader;
+
+	g_mutex_lock(&reader->mutex);
+	slot = &reader->slots[reader->next_deliver % reader->window];
+	while (!slot->ready && reader->next_deliver < reader->end)
+		g_cond_wait(&reader->cond, &reader->mutex);
+	if (!slot->ready) {
+		vdev->cur_chunk = reader->next_deliver - 1;
+		g_mutex_unlock(&reader->mutex);
+		chunk_reader_free(reader);
+		vdev->reader = NULL;
+		return TRUE;
+	}
+	bytes = slot->data;
+	ret = slot->status;
+	slot->ready = FALSE;
+	slot->data = NULL;
+	reader->next_deliver++;
+	g_cond_broadcast(&reader->cond);
+	g_mutex_unlock(&reader->mutex);
+
+	if (ret != SR_OK)
+		return FALSE;
+
+	data = g_bytes_get_data(bytes, &len);
+	if (len % vdev->unitsize != 0)
+		sr_warn("Chunk size %" G_GSIZE_FORMAT " not a multiple of the"
+			" unit size %d.", len, vdev->unitsize);
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.unitsize = vdev->unitsize;
+	for (pos = 0; pos < len; pos += n) {
+		n = MIN(len - pos, CHUNKSIZE / vdev->unitsize * vdev->unitsize);
+		logic.length = n;
+		logic.data = (uint8_t *)data + pos;
+		vdev->bytes_read += n;
+		sr_session_send_zerocopy(sdi, &packet,
+			(GDestroyNotify)g_bytes_unref, g_bytes_ref(bytes));
+	}
+	g_bytes_unref(bytes);
+
+	return TRUE;
+}
+
 static gboolean stream_session_data(struct sr_dev_inst *sdi)
 {
 	struct session_vdev *vdev;
@@ -70,6 +387,7 @@ static gboolean stream_session_data(struct sr_dev_inst *sdi)
 	struct sr_analog_encoding encoding;
 	struct sr_analog_meaning meaning;
 	struct sr_analog_spec spec;
+	struct sr_channel *ch;
 	struct zip_stat zs;
 	int ret, got_data;
 	char capturefile[128];
@@ -78,6 +396,9 @@ static gboolean stream_session_data(struct sr_dev_inst *sdi)
 	got_data = FALSE;
 	vdev = sdi->priv;
 
+	if (vdev->reader)
+		return stream_session_chunks(sdi);
+
 	if (!vdev->capfile) {
 		/* No capture file opened yet, or finished with the last
 		 * chunked one. */
@@ -86,19 +407,20 @@ static gboolean stream_session_data(struct sr_dev_inst *sdi)
 			if (zip_stat(vdev->archive, vdev->capturefile, 0, &zs) != -1) {
 				/* No chunks, just a single capture file. */
 				vdev->cur_chunk = 0;
-				if (!(vdev->capfile = zip_fopen(vdev->archive,
-						vdev->capturefile, 0)))
+				if (!(vdev->capfile = capture_open(vdev,
+						vdev->capturefile)))
 					return FALSE;
-				sr_dbg("Opened %s.", vdev->capturefile);
 			} else {
 				/* Try as first chunk filename. */
 				snprintf(capturefile, sizeof(capturefile) - 1, "%s-1", vdev->capturefile);
 				if (zip_stat(vdev->archive, capturefile, 0, &zs) != -1) {
 					vdev->cur_chunk = 1;
-					if (!(vdev->capfile = zip_fopen(vdev->archive,
-							capturefile, 0)))
+					if (vdev->unitsize &&
+							(vdev->reader = chunk_reader_new(vdev)))
+						return TRUE;
+					if (!(vdev->capfile = capture_open(vdev,
+							capturefile)))
 						return FALSE;
-					sr_dbg("Opened %s.", capturefile);
 				} else {
 					sr_err("No capture file '%s' in " "session file '%s'.",
 							vdev->capturefile, vdev->sessionfile);
@@ -111,10 +433,9 @@ static gboolean stream_session_data(struct sr_dev_inst *sdi)
 			snprintf(capturefile, sizeof(capturefile) - 1, "%s-%d", vdev->capturefile,
 					vdev->cur_chunk);
 			if (zip_stat(vdev->archive, capturefile, 0, &zs) != -1) {
-				if (!(vdev->capfile = zip_fopen(vdev->archive,
-						capturefile, 0)))
+				if (!(vdev->capfile = capture_open(vdev,
+						capturefile)))
 					return FALSE;
-				sr_dbg("Opened %s.", capturefile);
 			} else if (vdev->cur_analog_channel < vdev->num_analog_channels) {
 				vdev->capturefile = g_strdup_printf("analog-1-%d",
 						vdev->num_logic_channels + vdev->cur_analog_channel + 1);
@@ -156,19 +477,24 @@ static gboolean stream_session_data(struct sr_dev_inst *sdi)
 			packet.payload = &analog;
 			/* TODO: Use proper 'digits' value for this device (and its modes). */
 			sr_analog_init(&analog, &encoding, &meaning, &spec, 2);
-			analog.meaning->channels = g_slist_prepend(NULL,
-					g_array_index(vdev->analog_channels,
-						struct sr_channel *, vdev->cur_analog_channel - 1));
-			analog.num_samples = ret / sizeof(float);
+			ch = g_array_index(vdev->analog_channels,
+				struct sr_channel *, vdev->cur_analog_channel - 1);
+			analog_encoding_get(&encoding, ch);
+			analog.meaning->channels = g_slist_prepend(NULL, ch);
+			analog.num_samples = ret / encoding.unitsize;
 			analog.meaning->mq = SR_MQ_VOLTAGE;
 			analog.meaning->unit = SR_UNIT_VOLT;
 			analog.meaning->mqflags = SR_MQFLAG_DC;
-			analog.data = (float *) buf;
+			analog.data = buf;
 		} else if (vdev->unitsize) {
 			got_data = TRUE;
 			if (ret % vdev->unitsize != 0)
 				sr_warn("Read size %d not a multiple of the"
 					" unit size %d.", ret, vdev->unitsize);
+			if (vdev->xor_delta)
+				sr_sessionfile_xor_decode(buf,
+					ret - ret % vdev->unitsize,
+					vdev->xor_prev, vdev->unitsize);
 			packet.type = SR_DF_LOGIC;
 			packet.payload = &logic;
 			logic.length = ret;
@@ -200,6 +526,105 @@ static gboolean stream_session_data(struct sr_dev_inst *sdi)
 	return got_data;
 }
 
+/*
+ * Stream the files of an uncompressed session directory. The data is
+ * not copied, packets point into the mapped files, and the datafeed
+ * callbacks can keep references to them.
+ */
+static gboolean stream_session_dir(struct sr_dev_inst *sdi)
+{
+	struct session_vdev *vdev;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	struct sr_channel *ch;
+	GError *error;
+	char *name, *path;
+	uint8_t *data;
+	size_t len, n;
+
+	vdev = sdi->priv;
+
+	if (!vdev->mapped) {
+		if (vdev->capturefile && !vdev->logic_done) {
+			vdev->logic_done = TRUE;
+			name = g_strdup(vdev->capturefile);
+		} else if (vdev->cur_analog_channel < vdev->num_analog_channels) {
+			vdev->cur_analog_channel++;
+			name = g_strdup_printf("analog-1-%d",
+				vdev->num_logic_channels + vdev->cur_analog_channel);
+		} else {
+			return FALSE;
+		}
+		path = g_build_filename(vdev->sessionfile, name, NULL);
+		g_free(name);
+		error = NULL;
+		vdev->mapped = g_mapped_file_new(path, FALSE, &error);
+		if (!vdev->mapped) {
+			sr_err("Cannot map '%s': %s", path, error->message);
+			g_error_free(error);
+			g_free(path);
+			return FALSE;
+		}
+		sr_dbg("Mapped %s.", path);
+		g_free(path);
+		vdev->map_pos = 0;
+		return TRUE;
+	}
+
+	data = (uint8_t *)g_mapped_file_get_contents(vdev->mapped);
+	len = g_mapped_file_get_length(vdev->mapped);
+	if (vdev->map_pos >= len) {
+		g_mapped_file_unref(vdev->mapped);
+		vdev->mapped = NULL;
+		return TRUE;
+	}
+
+	n = len - vdev->map_pos;
+	if (vdev->cur_analog_channel != 0) {
+		packet.type = SR_DF_ANALOG;
+		packet.payload = &analog;
+		/* TODO: Use proper 'digits' value for this device (and its modes). */
+		sr_analog_init(&analog, &encoding, &meaning, &spec, 2);
+		encoding.is_bigendian = FALSE;
+		ch = g_array_index(vdev->analog_channels,
+			struct sr_channel *, vdev->cur_analog_channel - 1);
+		analog_encoding_get(&encoding, ch);
+		n = MIN(n, CHUNKSIZE) / encoding.unitsize * encoding.unitsize;
+		analog.meaning->channels = g_slist_prepend(NULL, ch);
+		analog.num_samples = n / encoding.unitsize;
+		analog.meaning->mq = SR_MQ_VOLTAGE;
+		analog.meaning->unit = SR_UNIT_VOLT;
+		analog.meaning->mqflags = SR_MQFLAG_DC;
+		analog.data = &data[vdev->map_pos];
+	} else {
+		n = MIN(n, CHUNKSIZE) / vdev->unitsize * vdev->unitsize;
+		packet.type = SR_DF_LOGIC;
+		packet.payload = &logic;
+		logic.length = n;
+		logic.unitsize = vdev->unitsize;
+		logic.data = &data[vdev->map_pos];
+	}
+	if (!n) {
+		sr_warn("Ignoring %zu trailing bytes.", len - vdev->map_pos);
+		vdev->map_pos = len;
+		return TRUE;
+	}
+
+	vdev->map_pos += n;
+	vdev->bytes_read += n;
+	sr_session_send_zerocopy(sdi, &packet,
+		(GDestroyNotify)g_mapped_file_unref,
+		g_mapped_file_ref(vdev->mapped));
+	if (packet.type == SR_DF_ANALOG)
+		g_slist_free(analog.meaning->channels);
+
+	return TRUE;
+}
+
 static int receive_data(int fd, int revents, void *cb_data)
 {
 	struct sr_dev_inst *sdi;
@@ -211,8 +636,11 @@ static int receive_data(int fd, int revents, void *cb_data)
 	sdi = cb_data;
 	vdev = sdi->priv;
 
-	if (!vdev->finished && !stream_session_data(sdi))
-		vdev->finished = TRUE;
+	if (!vdev->finished) {
+		if (vdev->is_dir ? !stream_session_dir(sdi) :
+				!stream_session_data(sdi))
+			vdev->finished = TRUE;
+	}
 	if (!vdev->finished)
 		return G_SOURCE_CONTINUE;
 
@@ -220,10 +648,16 @@ static int receive_data(int fd, int revents, void *cb_data)
 		zip_fclose(vdev->capfile);
 		vdev->capfile = NULL;
 	}
+	chunk_reader_free(vdev->reader);
+	vdev->reader = NULL;
 	if (vdev->archive) {
 		zip_discard(vdev->archive);
 		vdev->archive = NULL;
 	}
+	if (vdev->mapped) {
+		g_mapped_file_unref(vdev->mapped);
+		vdev->mapped = NULL;
+	}
 
 	std_session_send_df_end(sdi);
 
@@ -242,7 +676,9 @@ static int dev_open(struct sr_dev_inst *sdi)
 	drvc = di->context;
 	vdev = g_malloc0(sizeof(struct session_vdev));
 	sdi->priv = vdev;
+	g_mutex_lock(&drvc->instances_mutex);
 	drvc->instances = g_slist_append(drvc->instances, sdi);
+	g_mutex_unlock(&drvc->instances_mutex);
 
 	return SR_OK;
 }
@@ -250,8 +686,10 @@ static int dev_open(struct sr_dev_inst *sdi)
 static int dev_close(struct sr_dev_inst *sdi)
 {
 	const struct session_vdev *const vdev = sdi->priv;
+	chunk_reader_free(vdev->reader);
 	g_free(vdev->sessionfile);
 	g_free(vdev->capturefile);
+	g_free(vdev->xor_prev);
 
 	g_free(sdi->priv);
 	sdi->priv = NULL;
@@ -337,6 +775,7 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	int ret;
 	GSList *l;
 	struct sr_channel *ch;
+	GKeyFile *kf;
 
 	vdev = sdi->priv;
 	vdev->bytes_read = 0;
@@ -350,11 +789,37 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	}
 	vdev->cur_chunk = 0;
 	vdev->finished = FALSE;
+	vdev->logic_done = FALSE;
+	vdev->map_pos = 0;
 
-	sr_info("Opening archive %s file %s", vdev->sessionfile,
-		vdev->capturefile);
+	vdev->is_dir = g_file_test(vdev->sessionfile, G_FILE_TEST_IS_DIR);
+	if (vdev->is_dir) {
+		sr_info("Opening session directory %s", vdev->sessionfile);
+	} else {
+		sr_info("Opening archive %s file %s", vdev->sessionfile,
+			vdev->capturefile);
+	}
 
-	if (!(vdev->archive = zip_open(vdev->sessionfile, 0, &ret))) {
+	/* Filtered logic data gets decoded while it is read. */
+	if (!(kf = sr_sessionfile_load_metadata(vdev->sessionfile)))
+		return SR_ERR_DATA;
+	ret = sr_sessionfile_xor_filter(kf, &vdev->xor_delta);
+	g_key_file_free(kf);
+	if (ret != SR_OK)
+		return ret;
+	if (vdev->xor_delta && vdev->is_dir) {
+		sr_err("Filtered logic data in session directories "
+			"is not supported.");
+		return SR_ERR_DATA;
+	}
+	g_free(vdev->xor_prev);
+	vdev->xor_prev = NULL;
+	if (vdev->xor_delta && vdev->unitsize)
+		vdev->xor_prev = g_malloc0(vdev->unitsize);
+	vdev->xor_delta = vdev->xor_prev != NULL;
+
+	if (!vdev->is_dir &&
+			!(vdev->archive = zip_open(vdev->sessionfile, 0, &ret))) {
 		sr_err("Failed to open session file '%s': "
 		       "zip error %d.", vdev->sessionfile, ret);
 		return SR_ERR;
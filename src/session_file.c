@@ -111,6 +111,142 @@ SR_PRIV GKeyFile *sr_sessionfile_read_metadata(struct zip *archive,
 	return keyfile;
 }
 
+/*
+ * Check an uncompressed session directory, as written by the srraw
+ * output module. It holds the same entries as a session archive.
+ */
+static int sessiondir_check(const char *dirname)
+{
+	char *path, *s;
+	uint64_t version;
+	gboolean ok;
+
+	path = g_build_filename(dirname, "version", NULL);
+	ok = g_file_get_contents(path, &s, NULL, NULL);
+	g_free(path);
+	if (!ok) {
+		sr_dbg("Not a sigrok session directory: no version found.");
+		return SR_ERR;
+	}
+	version = g_ascii_strtoull(s, NULL, 10);
+	g_free(s);
+	if (version == 0 || version > 3) {
+		sr_dbg("Cannot handle sigrok session file version %" PRIu64 ".",
+			version);
+		return SR_ERR;
+	}
+
+	path = g_build_filename(dirname, "metadata", NULL);
+	ok = g_file_test(path, G_FILE_TEST_IS_REGULAR);
+	g_free(path);
+	if (!ok) {
+		sr_dbg("Not a valid sigrok session directory.");
+		return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Read the metadata of a session archive or a session directory.
+ *
+ * @param[in] filename The session file or directory.
+ *
+ * @return A new key/value store containing the session metadata.
+ *
+ * @private
+ */
+SR_PRIV GKeyFile *sr_sessionfile_load_metadata(const char *filename)
+{
+	struct zip *archive;
+	struct zip_stat zs;
+	GKeyFile *kf;
+	GError *error;
+	char *path;
+
+	if (g_file_test(filename, G_FILE_TEST_IS_DIR)) {
+		path = g_build_filename(filename, "metadata", NULL);
+		kf = g_key_file_new();
+		error = NULL;
+		if (!g_key_file_load_from_file(kf, path, G_KEY_FILE_NONE, &error)) {
+			sr_err("Failed to parse metadata: %s", error->message);
+			g_error_free(error);
+			g_key_file_free(kf);
+			kf = NULL;
+		}
+		g_free(path);
+		return kf;
+	}
+
+	if (!(archive = zip_open(filename, 0, NULL)))
+		return NULL;
+	if (zip_stat(archive, "metadata", 0, &zs) < 0) {
+		zip_discard(archive);
+		return NULL;
+	}
+	kf = sr_sessionfile_read_metadata(archive, &zs);
+	zip_discard(archive);
+
+	return kf;
+}
+
+/**
+ * Get the filter which the logic data of a session file went through.
+ *
+ * @param[in] kf The session metadata.
+ * @param[out] xor_delta Whether samples were XORed with their predecessor.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_DATA Unknown filter.
+ *
+ * @private
+ */
+SR_PRIV int sr_sessionfile_xor_filter(GKeyFile *kf, gboolean *xor_delta)
+{
+	char *filter;
+	int ret;
+
+	filter = g_key_file_get_string(kf, "device 1", "filter", NULL);
+	*xor_delta = !g_strcmp0(filter, "xor");
+	ret = SR_OK;
+	if (filter && !*xor_delta && strcmp(filter, "none")) {
+		sr_err("Unsupported logic data filter '%s'.", filter);
+		ret = SR_ERR_DATA;
+	}
+	g_free(filter);
+
+	return ret;
+}
+
+/**
+ * Undo the "xor" filter of the srzip output module, in place.
+ *
+ * Every sample was stored XORed with the one before it, the first
+ * sample of a chunk with zero.
+ *
+ * @param[in,out] data The samples, a multiple of unitsize bytes.
+ * @param[in] length Number of bytes.
+ * @param[in,out] prev The last sample before data, all zeros at the
+ *                     start of a chunk. Gets the last decoded sample.
+ * @param[in] unitsize Size of one sample in bytes.
+ *
+ * @private
+ */
+SR_PRIV void sr_sessionfile_xor_decode(uint8_t *data, size_t length,
+		uint8_t *prev, size_t unitsize)
+{
+	size_t i;
+
+	if (length < unitsize)
+		return;
+
+	for (i = 0; i < unitsize; i++)
+		data[i] ^= prev[i];
+	for (; i < length; i++)
+		data[i] ^= data[i - unitsize];
+	memcpy(prev, &data[length - unitsize], unitsize);
+}
+
 /** @private */
 SR_PRIV int sr_sessionfile_check(const char *filename)
 {
@@ -124,6 +260,9 @@ SR_PRIV int sr_sessionfile_check(const char *filename)
 	if (!filename)
 		return SR_ERR_ARG;
 
+	if (g_file_test(filename, G_FILE_TEST_IS_DIR))
+		return sessiondir_check(filename);
+
 	if (!g_file_test(filename, G_FILE_TEST_IS_REGULAR)) {
 		sr_err("Not a regular file: %s.", filename);
 		return SR_ERR;
@@ -151,7 +290,7 @@ SR_PRIV int sr_sessionfile_check(const char *filename)
 	zip_fclose(zf);
 	s[ret] = '\0';
 	version = g_ascii_strtoull(s, NULL, 10);
-	if (version == 0 || version > 2) {
+	if (version == 0 || version > 3) {
 		sr_dbg("Cannot handle sigrok session file version %" PRIu64 ".",
 			version);
 		zip_discard(archive);
@@ -192,11 +331,98 @@ SR_PRIV struct sr_dev_inst *sr_session_prepare_sdi(const char *filename, struct
 	return sdi;
 }
 
+/* Find the analog channel of an "...N" metadata key's number. */
+static struct sr_channel *analog_channel_find(struct sr_dev_inst *sdi,
+		const char *num)
+{
+	struct sr_channel *ch;
+	GSList *l;
+	uint64_t nr;
+
+	nr = g_ascii_strtoull(num, NULL, 10);
+	if (!sdi || nr == 0 || nr > G_MAXINT)
+		return NULL;
+	for (l = sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->type == SR_CHANNEL_ANALOG && (guint64)ch->index == nr - 1)
+			return ch;
+	}
+
+	return NULL;
+}
+
+/*
+ * The sample encoding of an analog channel is kept in its private
+ * data for the session driver. Channels without one hold float values.
+ */
+static struct sr_analog_encoding *analog_channel_encoding(struct sr_channel *ch)
+{
+	struct sr_analog_encoding *encoding;
+
+	if (!ch->priv) {
+		encoding = g_malloc0(sizeof(*encoding));
+		encoding->unitsize = sizeof(float);
+		encoding->is_signed = TRUE;
+		encoding->is_float = TRUE;
+		encoding->is_bigendian = G_BYTE_ORDER == G_BIG_ENDIAN;
+		encoding->scale.p = 1;
+		encoding->scale.q = 1;
+		encoding->offset.p = 0;
+		encoding->offset.q = 1;
+		ch->priv = encoding;
+	}
+
+	return ch->priv;
+}
+
+/* Parse an integer sample encoding like "uint8" or "int16le". */
+static int parse_analog_encoding(const char *s,
+		struct sr_analog_encoding *encoding)
+{
+	uint64_t bits;
+	char *end;
+
+	encoding->is_signed = !g_str_has_prefix(s, "u");
+	if (!encoding->is_signed)
+		s++;
+	if (!g_str_has_prefix(s, "int"))
+		return SR_ERR_DATA;
+	bits = g_ascii_strtoull(s + 3, &end, 10);
+	if (bits != 8 && bits != 16 && bits != 32)
+		return SR_ERR_DATA;
+	if (bits == 8 && *end)
+		return SR_ERR_DATA;
+	if (bits != 8 && strcmp(end, "le") && strcmp(end, "be"))
+		return SR_ERR_DATA;
+	encoding->unitsize = bits / 8;
+	encoding->is_float = FALSE;
+	encoding->is_bigendian = !strcmp(end, "be");
+
+	return SR_OK;
+}
+
+/* Parse a rational number written as "p/q". */
+static int parse_rational(const char *s, struct sr_rational *r)
+{
+	char *end;
+
+	r->p = g_ascii_strtoll(s, &end, 10);
+	if (end == s || *end != '/')
+		return SR_ERR_DATA;
+	s = end + 1;
+	r->q = g_ascii_strtoull(s, &end, 10);
+	if (end == s || *end || !r->q)
+		return SR_ERR_DATA;
+
+	return SR_OK;
+}
+
 /**
  * Load the session from the specified filename.
  *
  * @param ctx The context in which to load the session.
- * @param filename The name of the session file to load.
+ * @param filename The name of the session file to load. This can also
+ *                 be a session directory, see the srraw output module.
  * @param session The session to load the file into.
  *
  * @retval SR_OK Success
@@ -209,8 +435,6 @@ SR_API int sr_session_load(struct sr_context *ctx, const char *filename,
 {
 	GKeyFile *kf;
 	GError *error;
-	struct zip *archive;
-	struct zip_stat zs;
 	struct sr_dev_inst *sdi;
 	struct sr_channel *ch;
 	int ret, i, j;
@@ -225,16 +449,7 @@ SR_API int sr_session_load(struct sr_context *ctx, const char *filename,
 	if ((ret = sr_sessionfile_check(filename)) != SR_OK)
 		return ret;
 
-	if (!(archive = zip_open(filename, 0, NULL)))
-		return SR_ERR;
-
-	if (zip_stat(archive, "metadata", 0, &zs) < 0) {
-		zip_discard(archive);
-		return SR_ERR;
-	}
-	kf = sr_sessionfile_read_metadata(archive, &zs);
-	zip_discard(archive);
-	if (!kf)
+	if (!(kf = sr_sessionfile_load_metadata(filename)))
 		return SR_ERR_DATA;
 
 	if ((ret = sr_session_new(ctx, session)) != SR_OK) {
@@ -378,6 +593,39 @@ SR_API int sr_session_load(struct sr_context *ctx, const char *filename,
 					sr_dev_channel_name_set(ch, val);
 					g_free(val);
 					sr_dev_channel_enable(ch, TRUE);
+				} else if (!strncmp(keys[j], "encoding", 8)) {
+					ch = analog_channel_find(sdi, keys[j] + 8);
+					val = g_key_file_get_string(kf, sections[i],
+							keys[j], &error);
+					if (!ch || !val || parse_analog_encoding(val,
+							analog_channel_encoding(ch)) != SR_OK) {
+						g_free(val);
+						ret = SR_ERR_DATA;
+						break;
+					}
+					g_free(val);
+				} else if (!strncmp(keys[j], "scale", 5)) {
+					ch = analog_channel_find(sdi, keys[j] + 5);
+					val = g_key_file_get_string(kf, sections[i],
+							keys[j], &error);
+					if (!ch || !val || parse_rational(val,
+							&analog_channel_encoding(ch)->scale) != SR_OK) {
+						g_free(val);
+						ret = SR_ERR_DATA;
+						break;
+					}
+					g_free(val);
+				} else if (!strncmp(keys[j], "offset", 6)) {
+					ch = analog_channel_find(sdi, keys[j] + 6);
+					val = g_key_file_get_string(kf, sections[i],
+							keys[j], &error);
+					if (!ch || !val || parse_rational(val,
+							&analog_channel_encoding(ch)->offset) != SR_OK) {
+						g_free(val);
+						ret = SR_ERR_DATA;
+						break;
+					}
+					g_free(val);
 				}
 			}
 			g_strfreev(keys);
@@ -393,4 +641,660 @@ SR_API int sr_session_load(struct sr_context *ctx, const char *filename,
 	return ret;
 }
 
+/** @cond PRIVATE */
+/* Scratch buffer size for skipping over compressed chunk data. */
+#define SKIP_BUFSIZE (64 * 1024)
+/** @endcond */
+
+/* One logic data chunk of a session file, see sessionfile_index(). */
+struct sessionfile_chunk {
+	uint64_t entry;
+	uint64_t chunk_num;
+	uint64_t first_sample;
+	uint64_t num_samples;
+};
+
+struct sr_sessionfile {
+	struct zip *archive;
+	char *capturefile;
+	unsigned int unitsize;
+	uint64_t samplerate;
+	/* Chunk index, built upon first use. */
+	GArray *chunks;
+	uint64_t num_samples;
+	/* Currently open chunk, keeps sequential reads cheap. */
+	struct zip_file *zf;
+	size_t zf_chunk;
+	uint64_t zf_pos;
+	/* The "xor" filter, and the chunk's last sample read so far. */
+	gboolean xor_delta;
+	uint8_t *xor_prev;
+	/* Summary layout, and summary levels loaded so far. */
+	uint64_t summary_block;
+	unsigned int summary_factor;
+	GHashTable *summaries;
+};
+
+static gint chunk_cmp(gconstpointer a, gconstpointer b)
+{
+	const struct sessionfile_chunk *ca, *cb;
+
+	ca = a;
+	cb = b;
+	if (ca->chunk_num < cb->chunk_num)
+		return -1;
+
+	return ca->chunk_num > cb->chunk_num;
+}
+
+/*
+ * Build the index of logic data chunks. Only the archive's central
+ * directory is inspected, which holds the uncompressed size of every
+ * chunk. No sample data gets decompressed.
+ */
+static int sessionfile_index(struct sr_sessionfile *sf)
+{
+	struct sessionfile_chunk chunk, *c;
+	struct zip_stat zs;
+	const char *name;
+	size_t baselen;
+	int64_t i, num_files;
+	uint64_t pos, expected;
+	guint idx;
+
+	if (sf->chunks)
+		return SR_OK;
+
+	sf->chunks = g_array_new(FALSE, FALSE, sizeof(chunk));
+	baselen = strlen(sf->capturefile);
+	num_files = zip_get_num_entries(sf->archive, 0);
+	for (i = 0; i < num_files; i++) {
+		name = zip_get_name(sf->archive, i, 0);
+		if (!name || strncmp(name, sf->capturefile, baselen) != 0)
+			continue;
+		if (name[baselen] == '\0')
+			chunk.chunk_num = 0;
+		else if (name[baselen] == '-')
+			chunk.chunk_num = g_ascii_strtoull(&name[baselen + 1],
+				NULL, 10);
+		else
+			continue;
+		if (zip_stat_index(sf->archive, i, 0, &zs) < 0 ||
+				!(zs.valid & ZIP_STAT_SIZE)) {
+			sr_err("Failed to stat '%s': %s", name,
+				zip_strerror(sf->archive));
+			return SR_ERR_DATA;
+		}
+		chunk.entry = i;
+		chunk.num_samples = zs.size / sf->unitsize;
+		g_array_append_val(sf->chunks, chunk);
+	}
+	g_array_sort(sf->chunks, chunk_cmp);
+
+	/* Same as the session driver: stop at the first missing chunk. */
+	pos = 0;
+	for (idx = 0; idx < sf->chunks->len; idx++) {
+		c = &g_array_index(sf->chunks, struct sessionfile_chunk, idx);
+		expected = (idx == 0 && c->chunk_num == 0) ? 0 : idx + 1;
+		if (c->chunk_num != expected) {
+			sr_warn("Missing chunk before '%s-%" PRIu64 "'.",
+				sf->capturefile, c->chunk_num);
+			g_array_set_size(sf->chunks, idx);
+			break;
+		}
+		c->first_sample = pos;
+		pos += c->num_samples;
+	}
+	sf->num_samples = pos;
+	sr_dbg("Indexed %u chunks, %" PRIu64 " samples.",
+		sf->chunks->len, sf->num_samples);
+
+	return SR_OK;
+}
+
+/* Find the chunk which holds a sample, the sample must exist. */
+static size_t sessionfile_chunk_find(struct sr_sessionfile *sf,
+		uint64_t sample)
+{
+	const struct sessionfile_chunk *c;
+	size_t lo, hi, mid;
+
+	lo = 0;
+	hi = sf->chunks->len;
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		c = &g_array_index(sf->chunks, struct sessionfile_chunk, mid);
+		if (c->first_sample <= sample)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/* Position the open chunk at a sample offset within that chunk. */
+static int sessionfile_chunk_seek(struct sr_sessionfile *sf,
+		size_t chunk_idx, uint64_t offset)
+{
+	const struct sessionfile_chunk *c;
+	uint8_t *skipbuf;
+	uint64_t skip;
+	int64_t len;
+
+	if (sf->zf && (sf->zf_chunk != chunk_idx || sf->zf_pos > offset)) {
+		zip_fclose(sf->zf);
+		sf->zf = NULL;
+	}
+	if (!sf->zf) {
+		c = &g_array_index(sf->chunks, struct sessionfile_chunk,
+			chunk_idx);
+		sf->zf = zip_fopen_index(sf->archive, c->entry, 0);
+		if (!sf->zf) {
+			sr_err("Failed to open chunk: %s",
+				zip_strerror(sf->archive));
+			return SR_ERR;
+		}
+		sf->zf_chunk = chunk_idx;
+		sf->zf_pos = 0;
+		if (sf->xor_delta)
+			memset(sf->xor_prev, 0, sf->unitsize);
+	}
+
+	/*
+	 * Compressed data cannot be seeked into, read and discard it.
+	 * This is bounded by the chunk size, regardless of file size.
+	 * Filtered data gets decoded, the samples after it need the
+	 * last one.
+	 */
+	skip = (offset - sf->zf_pos) * sf->unitsize;
+	if (!skip)
+		return SR_OK;
+	skipbuf = g_malloc(SKIP_BUFSIZE);
+	while (skip) {
+		len = zip_fread(sf->zf, skipbuf,
+			MIN(skip, SKIP_BUFSIZE / sf->unitsize * sf->unitsize));
+		if (len <= 0 || len % sf->unitsize) {
+			sr_err("Failed to read chunk: %s",
+				zip_file_strerror(sf->zf));
+			g_free(skipbuf);
+			return SR_ERR_DATA;
+		}
+		if (sf->xor_delta)
+			sr_sessionfile_xor_decode(skipbuf, len,
+				sf->xor_prev, sf->unitsize);
+		skip -= len;
+	}
+	g_free(skipbuf);
+	sf->zf_pos = offset;
+
+	return SR_OK;
+}
+
+/**
+ * Open a session file for random access to its sample data.
+ *
+ * Unlike sr_session_load(), no session gets created. Sample ranges
+ * can be read with sr_sessionfile_logic_read() in any order, without
+ * decompressing the data in front of them.
+ *
+ * @param filename The name of the session file to open.
+ * @param sf Pointer to store the new session file handle in.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_DATA Malformed session file, or no logic data.
+ * @retval SR_ERR This is not a session file.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_sessionfile_open(const char *filename,
+		struct sr_sessionfile **sf)
+{
+	struct sr_sessionfile *f;
+	struct zip *archive;
+	struct zip_stat zs;
+	GKeyFile *kf;
+	char *val;
+	int unitsize, num;
+	uint64_t samplerate;
+	gboolean xor_delta;
+	int ret;
+
+	if (!filename || !sf)
+		return SR_ERR_ARG;
+	*sf = NULL;
+
+	if ((ret = sr_sessionfile_check(filename)) != SR_OK)
+		return ret;
+
+	if (!(archive = zip_open(filename, 0, NULL)))
+		return SR_ERR;
+	if (zip_stat(archive, "metadata", 0, &zs) < 0) {
+		zip_discard(archive);
+		return SR_ERR;
+	}
+	kf = sr_sessionfile_read_metadata(archive, &zs);
+	if (!kf) {
+		zip_discard(archive);
+		return SR_ERR_DATA;
+	}
+
+	val = g_key_file_get_string(kf, "device 1", "capturefile", NULL);
+	unitsize = g_key_file_get_integer(kf, "device 1", "unitsize", NULL);
+	if (!val || unitsize <= 0) {
+		sr_err("Session file '%s' has no logic data.", filename);
+		g_free(val);
+		g_key_file_free(kf);
+		zip_discard(archive);
+		return SR_ERR_DATA;
+	}
+	if (sr_sessionfile_xor_filter(kf, &xor_delta) != SR_OK) {
+		g_free(val);
+		g_key_file_free(kf);
+		zip_discard(archive);
+		return SR_ERR_DATA;
+	}
+	samplerate = 0;
+	f = g_malloc0(sizeof(*f));
+	f->archive = archive;
+	f->capturefile = val;
+	f->unitsize = unitsize;
+	f->xor_delta = xor_delta;
+	if (xor_delta)
+		f->xor_prev = g_malloc0(unitsize);
+	val = g_key_file_get_string(kf, "device 1", "samplerate", NULL);
+	if (val && sr_parse_sizestring(val, &samplerate) == SR_OK)
+		f->samplerate = samplerate;
+	g_free(val);
+	num = g_key_file_get_integer(kf, "device 1", "summary block", NULL);
+	f->summary_block = MAX(num, 0);
+	num = g_key_file_get_integer(kf, "device 1", "summary factor", NULL);
+	f->summary_factor = MAX(num, 0);
+	f->summaries = g_hash_table_new_full(g_str_hash, g_str_equal,
+		g_free, (GDestroyNotify)g_bytes_unref);
+	g_key_file_free(kf);
+
+	*sf = f;
+
+	return SR_OK;
+}
+
+/**
+ * Close a session file which was opened by sr_sessionfile_open().
+ *
+ * @param sf The session file handle. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_sessionfile_close(struct sr_sessionfile *sf)
+{
+	if (!sf)
+		return SR_ERR_ARG;
+
+	if (sf->zf)
+		zip_fclose(sf->zf);
+	zip_discard(sf->archive);
+	if (sf->chunks)
+		g_array_free(sf->chunks, TRUE);
+	g_hash_table_destroy(sf->summaries);
+	g_free(sf->xor_prev);
+	g_free(sf->capturefile);
+	g_free(sf);
+
+	return SR_OK;
+}
+
+/**
+ * Get the layout of a session file's logic data.
+ *
+ * @param sf The session file handle. Must not be NULL.
+ * @param num_samples Total number of logic samples. Can be NULL.
+ * @param unitsize Size of one logic sample in bytes. Can be NULL.
+ * @param samplerate Samplerate, or 0 when unknown. Can be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_DATA Malformed session file.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_sessionfile_logic_info(struct sr_sessionfile *sf,
+		uint64_t *num_samples, unsigned int *unitsize,
+		uint64_t *samplerate)
+{
+	int ret;
+
+	if (!sf)
+		return SR_ERR_ARG;
+
+	if (num_samples) {
+		if ((ret = sessionfile_index(sf)) != SR_OK)
+			return ret;
+		*num_samples = sf->num_samples;
+	}
+	if (unitsize)
+		*unitsize = sf->unitsize;
+	if (samplerate)
+		*samplerate = sf->samplerate;
+
+	return SR_OK;
+}
+
+/**
+ * Read a range of logic samples from a session file.
+ *
+ * Only the chunk which holds the first requested sample gets
+ * decompressed from its start, so the cost does not depend on the
+ * position within the file. Reading consecutive ranges continues
+ * where the previous call left off.
+ *
+ * @param sf The session file handle. Must not be NULL.
+ * @param start Number of the first sample to read.
+ * @param count Number of samples to read.
+ * @param buf Buffer for count * unitsize bytes. Must not be NULL.
+ * @param read_count Number of samples which were read, less than
+ *                   count at the end of the file. Can be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_DATA Malformed session file.
+ * @retval SR_ERR Other error.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_sessionfile_logic_read(struct sr_sessionfile *sf,
+		uint64_t start, uint64_t count, void *buf, uint64_t *read_count)
+{
+	const struct sessionfile_chunk *c;
+	uint8_t *wrptr;
+	uint64_t done, offset, n;
+	size_t chunk_idx;
+	int64_t len;
+	int ret;
+
+	if (!sf || !buf)
+		return SR_ERR_ARG;
+	if (read_count)
+		*read_count = 0;
+
+	if ((ret = sessionfile_index(sf)) != SR_OK)
+		return ret;
+	if (start >= sf->num_samples)
+		return SR_OK;
+	count = MIN(count, sf->num_samples - start);
+
+	wrptr = buf;
+	done = 0;
+	chunk_idx = sessionfile_chunk_find(sf, start);
+	while (done < count) {
+		c = &g_array_index(sf->chunks, struct sessionfile_chunk,
+			chunk_idx);
+		offset = start + done - c->first_sample;
+		n = MIN(count - done, c->num_samples - offset);
+		if (n) {
+			ret = sessionfile_chunk_seek(sf, chunk_idx, offset);
+			if (ret != SR_OK)
+				return ret;
+			len = zip_fread(sf->zf, wrptr, n * sf->unitsize);
+			if (len < 0 || (uint64_t)len != n * sf->unitsize) {
+				sr_err("Failed to read chunk: %s",
+					zip_file_strerror(sf->zf));
+				return SR_ERR_DATA;
+			}
+			if (sf->xor_delta)
+				sr_sessionfile_xor_decode(wrptr, len,
+					sf->xor_prev, sf->unitsize);
+			sf->zf_pos += n;
+			wrptr += len;
+			done += n;
+			if (read_count)
+				*read_count = done;
+		}
+		chunk_idx++;
+	}
+
+	return SR_OK;
+}
+
+/* Load a summary level, its records are kept for later calls. */
+static GBytes *sessionfile_summary_get(struct sr_sessionfile *sf,
+		const char *name)
+{
+	GBytes *records;
+	struct zip_stat zs;
+	struct zip_file *zf;
+	uint8_t *buf;
+	int64_t len;
+
+	records = g_hash_table_lookup(sf->summaries, name);
+	if (records)
+		return records;
+
+	if (zip_stat(sf->archive, name, 0, &zs) < 0)
+		return NULL;
+	if (!(zf = zip_fopen_index(sf->archive, zs.index, 0))) {
+		sr_err("Failed to open '%s': %s", name,
+			zip_strerror(sf->archive));
+		return NULL;
+	}
+	buf = g_malloc(zs.size + 1);
+	len = zip_fread(zf, buf, zs.size);
+	zip_fclose(zf);
+	if (len < 0 || (uint64_t)len != zs.size) {
+		sr_err("Failed to read '%s'.", name);
+		g_free(buf);
+		return NULL;
+	}
+	records = g_bytes_new_take(buf, len);
+	g_hash_table_insert(sf->summaries, g_strdup(name), records);
+
+	return records;
+}
+
+/* Get a range of records from a summary level. */
+static int sessionfile_summary_range(struct sr_sessionfile *sf,
+		const char *name, size_t recsize, uint64_t first,
+		uint64_t *count, const uint8_t **records)
+{
+	GBytes *bytes;
+	const uint8_t *data;
+	gsize len;
+	uint64_t num_recs;
+
+	if (!sf->summary_block)
+		return SR_ERR_NA;
+	if (!(bytes = sessionfile_summary_get(sf, name)))
+		return SR_ERR_ARG;
+
+	data = g_bytes_get_data(bytes, &len);
+	num_recs = len / recsize;
+	if (first >= num_recs)
+		*count = 0;
+	else
+		*count = MIN(*count, num_recs - first);
+	*records = &data[first * recsize];
+
+	return SR_OK;
+}
+
+/**
+ * Get the layout of a session file's summaries.
+ *
+ * Session files which were written with the srzip output module's
+ * "summary" option carry precomputed summaries of their sample data,
+ * in several levels of resolution. Level 0 has one record for every
+ * @a block_samples samples, every further level has one record for
+ * @a factor records of the level below. The top level holds a single
+ * record for the whole capture.
+ *
+ * @param sf The session file handle. Must not be NULL.
+ * @param block_samples Samples per level 0 record. Can be NULL.
+ * @param factor Records per record of the next level. Can be NULL.
+ * @param num_levels Number of logic summary levels. Can be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA The session file has no summaries.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_sessionfile_summary_info(struct sr_sessionfile *sf,
+		uint64_t *block_samples, unsigned int *factor,
+		unsigned int *num_levels)
+{
+	unsigned int level;
+	char *name;
+
+	if (!sf)
+		return SR_ERR_ARG;
+	if (!sf->summary_block || sf->summary_factor < 2)
+		return SR_ERR_NA;
+
+	if (block_samples)
+		*block_samples = sf->summary_block;
+	if (factor)
+		*factor = sf->summary_factor;
+	if (num_levels) {
+		for (level = 0; ; level++) {
+			name = g_strdup_printf("summary-logic-1-%u", level);
+			if (zip_name_locate(sf->archive, name, 0) < 0) {
+				g_free(name);
+				break;
+			}
+			g_free(name);
+		}
+		*num_levels = level;
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Read logic summary records from a session file.
+ *
+ * Each record covers a block of samples, see
+ * sr_sessionfile_summary_info(). For each record, the OR and the AND
+ * of all samples in the block (unitsize bytes each), and the number of
+ * samples at which any channel changed its value, are returned. The
+ * output arrays receive one item per record, and can be NULL.
+ *
+ * @param sf The session file handle. Must not be NULL.
+ * @param level The summary level.
+ * @param first Number of the first record to read.
+ * @param count Number of records to read.
+ * @param or_bits Buffer for count * unitsize bytes. Can be NULL.
+ * @param and_bits Buffer for count * unitsize bytes. Can be NULL.
+ * @param transitions Buffer for count values. Can be NULL.
+ * @param read_count Number of records which were read. Can be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or no such summary level.
+ * @retval SR_ERR_NA The session file has no summaries.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_sessionfile_logic_summary_read(struct sr_sessionfile *sf,
+		unsigned int level, uint64_t first, uint64_t count,
+		uint8_t *or_bits, uint8_t *and_bits, uint64_t *transitions,
+		uint64_t *read_count)
+{
+	const uint8_t *rec;
+	size_t recsize;
+	uint64_t i;
+	char *name;
+	int ret;
+
+	if (!sf)
+		return SR_ERR_ARG;
+	if (read_count)
+		*read_count = 0;
+
+	recsize = 2 * sf->unitsize + sizeof(uint64_t);
+	name = g_strdup_printf("summary-logic-1-%u", level);
+	ret = sessionfile_summary_range(sf, name, recsize, first, &count, &rec);
+	g_free(name);
+	if (ret != SR_OK)
+		return ret;
+
+	for (i = 0; i < count; i++) {
+		if (or_bits)
+			memcpy(&or_bits[i * sf->unitsize], rec, sf->unitsize);
+		if (and_bits)
+			memcpy(&and_bits[i * sf->unitsize],
+				&rec[sf->unitsize], sf->unitsize);
+		if (transitions)
+			transitions[i] = RL64(&rec[2 * sf->unitsize]);
+		rec += recsize;
+	}
+	if (read_count)
+		*read_count = count;
+
+	return SR_OK;
+}
+
+/**
+ * Read analog summary records from a session file.
+ *
+ * Like sr_sessionfile_logic_summary_read(), but returns the minimum,
+ * maximum and mean value of each block of samples of an analog
+ * channel.
+ *
+ * @param sf The session file handle. Must not be NULL.
+ * @param channel The analog channel's number in the session file,
+ *                as in its "analogN" metadata key.
+ * @param level The summary level.
+ * @param first Number of the first record to read.
+ * @param count Number of records to read.
+ * @param min Buffer for count values. Can be NULL.
+ * @param max Buffer for count values. Can be NULL.
+ * @param mean Buffer for count values. Can be NULL.
+ * @param read_count Number of records which were read. Can be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or no such summary level.
+ * @retval SR_ERR_NA The session file has no summaries.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_sessionfile_analog_summary_read(struct sr_sessionfile *sf,
+		unsigned int channel, unsigned int level, uint64_t first,
+		uint64_t count, float *min, float *max, float *mean,
+		uint64_t *read_count)
+{
+	const uint8_t *rec;
+	uint64_t i;
+	char *name;
+	int ret;
+
+	if (!sf)
+		return SR_ERR_ARG;
+	if (read_count)
+		*read_count = 0;
+
+	name = g_strdup_printf("summary-analog-1-%u-%u", channel, level);
+	ret = sessionfile_summary_range(sf, name, 3 * sizeof(float),
+		first, &count, &rec);
+	g_free(name);
+	if (ret != SR_OK)
+		return ret;
+
+	for (i = 0; i < count; i++) {
+		if (min)
+			min[i] = RLFL(&rec[0]);
+		if (max)
+			max[i] = RLFL(&rec[4]);
+		if (mean)
+			mean[i] = RLFL(&rec[8]);
+		rec += 3 * sizeof(float);
+	}
+	if (read_count)
+		*read_count = count;
+
+	return SR_OK;
+}
+
 /** @} */
@@ -0,0 +1,535 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <glib.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "session-merge"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Time ordered datafeed of all devices in a session.
+ */
+
+/**
+ * @addtogroup grp_session
+ *
+ * @{
+ */
+
+/*
+ * Every device's packets wait in a queue of their own, until the queues
+ * of all devices which are still acquiring hold data. The packet which
+ * starts earliest on the common timebase goes out then, so callbacks
+ * see the packets of all devices in time order. Packets without samples
+ * stay in order with their device's samples. A device which is far
+ * behind (or silent) holds up the others only until the buffered data
+ * exceeds the limits, then its packets come late.
+ *
+ * A device's sample i is at offset_ns + i / samplerate. The offset is
+ * known from the header on with SR_MERGE_ALIGN_START, from the first
+ * sample packet's host time with SR_MERGE_ALIGN_HOST, and from the
+ * trigger with SR_MERGE_ALIGN_TRIGGER. Devices without a samplerate
+ * (multimeters and the like) are placed by the packets' host time.
+ */
+
+#define MERGE_DEFAULT_MAX_BYTES (64 * 1024 * 1024)
+#define MERGE_DEFAULT_MAX_DELAY_US (1000 * 1000)
+
+struct merge_item {
+	struct sr_datafeed_packet *packet;
+	uint64_t first_sample;
+	uint64_t num_samples;
+	int64_t host_time;
+	/* When it got queued, for the delay limit. */
+	int64_t queued_us;
+	size_t bytes;
+};
+
+struct merge_dev {
+	const struct sr_dev_inst *sdi;
+	GQueue items;
+	uint64_t samplerate;
+	/* Time of sample 0, valid once aligned. */
+	int64_t offset_ns;
+	gboolean aligned;
+	gboolean started;
+	gboolean ended;
+	/* Index of the next sample, for the position of other packets. */
+	uint64_t next_sample;
+};
+
+struct sr_session_merge {
+	struct sr_session *session;
+	enum sr_merge_align align;
+	sr_merge_callback cb;
+	void *cb_data;
+	/* Devices may deliver from different threads. */
+	GMutex mutex;
+	GSList *devs;
+	/* Host time of the earliest header, the origin of host times. */
+	int64_t host_origin;
+	size_t bytes;
+	uint64_t max_bytes;
+	uint64_t max_delay_us;
+};
+
+/* Duration of num samples in ns, without overflowing for long runs. */
+static int64_t samples_to_ns(uint64_t num, uint64_t samplerate)
+{
+	if (!samplerate)
+		return 0;
+
+	return (num / samplerate) * 1000000000 +
+		(num % samplerate) * 1000000000 / samplerate;
+}
+
+static struct merge_dev *merge_dev_get(struct sr_session_merge *merge,
+		const struct sr_dev_inst *sdi)
+{
+	struct merge_dev *dev;
+	GSList *l;
+
+	for (l = merge->devs; l; l = l->next) {
+		dev = l->data;
+		if (dev->sdi == sdi)
+			return dev;
+	}
+
+	dev = g_malloc0(sizeof(*dev));
+	dev->sdi = sdi;
+	g_queue_init(&dev->items);
+	merge->devs = g_slist_append(merge->devs, dev);
+
+	return dev;
+}
+
+/* Devices of the session which did not send anything yet still count. */
+static void merge_devs_sync(struct sr_session_merge *merge)
+{
+	GSList *devlist, *l;
+
+	if (sr_session_dev_list(merge->session, &devlist) != SR_OK)
+		return;
+	for (l = devlist; l; l = l->next)
+		merge_dev_get(merge, l->data);
+	g_slist_free(devlist);
+}
+
+static void merge_dev_clear(struct sr_session_merge *merge,
+		struct merge_dev *dev)
+{
+	struct merge_item *item;
+
+	while ((item = g_queue_pop_head(&dev->items))) {
+		merge->bytes -= item->bytes;
+		sr_packet_unref(item->packet);
+		g_free(item);
+	}
+}
+
+static uint64_t config_samplerate(const struct sr_dev_inst *sdi)
+{
+	GVariant *gvar;
+	uint64_t samplerate;
+
+	if (!sdi->driver || sr_config_get(sdi->driver, sdi, NULL,
+			SR_CONF_SAMPLERATE, &gvar) != SR_OK)
+		return 0;
+	samplerate = g_variant_get_uint64(gvar);
+	g_variant_unref(gvar);
+
+	return samplerate;
+}
+
+/* Keep the time of the next sample when the rate changes mid-stream. */
+static void samplerate_change(struct merge_dev *dev, uint64_t samplerate)
+{
+	if (dev->aligned && dev->samplerate && samplerate)
+		dev->offset_ns += samples_to_ns(dev->next_sample,
+			dev->samplerate) - samples_to_ns(dev->next_sample,
+			samplerate);
+	dev->samplerate = samplerate;
+}
+
+static void meta_samplerate(struct merge_dev *dev,
+		const struct sr_datafeed_meta *meta)
+{
+	const struct sr_config *src;
+	GSList *l;
+
+	for (l = meta->config; l; l = l->next) {
+		src = l->data;
+		if (src->key == SR_CONF_SAMPLERATE)
+			samplerate_change(dev, g_variant_get_uint64(src->data));
+	}
+}
+
+static int64_t item_time(const struct sr_session_merge *merge,
+		const struct merge_dev *dev, const struct merge_item *item)
+{
+	/*
+	 * Before the first sample the rate may still be unknown, e.g. the
+	 * header and meta packets of input modules.
+	 */
+	if (!dev->samplerate && (item->first_sample || item->num_samples))
+		return (item->host_time - merge->host_origin) * 1000;
+
+	return dev->offset_ns + samples_to_ns(item->first_sample,
+		dev->samplerate);
+}
+
+static void merge_emit(struct sr_session_merge *merge, struct merge_dev *dev,
+		gboolean late)
+{
+	struct sr_merge_position pos;
+	struct merge_item *item;
+
+	item = g_queue_pop_head(&dev->items);
+	merge->bytes -= item->bytes;
+
+	pos.time_ns = item_time(merge, dev, item);
+	pos.end_ns = pos.time_ns + samples_to_ns(item->num_samples,
+		dev->samplerate);
+	pos.first_sample = item->first_sample;
+	pos.samplerate = dev->samplerate;
+	pos.late = late;
+	if (item->packet->type == SR_DF_END)
+		dev->ended = TRUE;
+
+	merge->cb(dev->sdi, item->packet, &pos, merge->cb_data);
+
+	sr_packet_unref(item->packet);
+	g_free(item);
+}
+
+/* Whether the limits allow to wait for the devices which are behind. */
+static gboolean merge_over_limits(const struct sr_session_merge *merge)
+{
+	const struct merge_dev *dev;
+	const struct merge_item *item;
+	int64_t now;
+	GSList *l;
+
+	if (merge->bytes > merge->max_bytes)
+		return TRUE;
+
+	now = g_get_monotonic_time();
+	for (l = merge->devs; l; l = l->next) {
+		dev = l->data;
+		item = g_queue_peek_head(&dev->items);
+		if (item && now - item->queued_us > (int64_t)merge->max_delay_us)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*
+ * Send the earliest packets as long as no device can come up with an
+ * earlier one, or as long as the limits are exceeded.
+ */
+static void merge_flush(struct sr_session_merge *merge)
+{
+	struct merge_dev *dev, *first;
+	struct merge_item *item;
+	int64_t t, first_t;
+	gboolean ready, forced;
+	GSList *l;
+
+	for (;;) {
+		ready = TRUE;
+		for (l = merge->devs; l; l = l->next) {
+			dev = l->data;
+			if (dev->ended && g_queue_is_empty(&dev->items))
+				continue;
+			if (g_queue_is_empty(&dev->items) || !dev->aligned)
+				ready = FALSE;
+		}
+		forced = !ready && merge_over_limits(merge);
+		if (!ready && !forced)
+			return;
+
+		first = NULL;
+		first_t = 0;
+		for (l = merge->devs; l; l = l->next) {
+			dev = l->data;
+			if (!(item = g_queue_peek_head(&dev->items)))
+				continue;
+			if (!dev->aligned) {
+				if (!forced)
+					continue;
+				/* No trigger (yet), start with the others. */
+				sr_warn("No trigger from %s, aligning its start.",
+					dev->sdi->model ? dev->sdi->model : "device");
+				dev->offset_ns = 0;
+				dev->aligned = TRUE;
+			}
+			t = item_time(merge, dev, item);
+			if (!first || t < first_t) {
+				first = dev;
+				first_t = t;
+			}
+		}
+		if (!first)
+			return;
+		merge_emit(merge, first, forced);
+	}
+}
+
+static void merge_datafeed(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	struct sr_session_merge *merge;
+	struct sr_packet_timing timing;
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_logic_rle *rle;
+	const struct sr_datafeed_analog *analog;
+	struct merge_dev *dev;
+	struct merge_item *item;
+	gboolean timed;
+	uint64_t i, trigger_at;
+
+	merge = cb_data;
+
+	item = g_malloc0(sizeof(*item));
+	item->queued_us = g_get_monotonic_time();
+	switch (packet->type) {
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		item->bytes = logic->length;
+		item->num_samples = logic->unitsize ?
+			logic->length / logic->unitsize : 0;
+		break;
+	case SR_DF_LOGIC_RLE:
+		rle = packet->payload;
+		item->bytes = rle->num_runs * (rle->unitsize + sizeof(uint64_t));
+		for (i = 0; i < rle->num_runs; i++)
+			item->num_samples += rle->counts[i];
+		break;
+	case SR_DF_ANALOG:
+		analog = packet->payload;
+		item->num_samples = analog->num_samples;
+		item->bytes = analog->num_samples * analog->encoding->unitsize;
+		break;
+	default:
+		break;
+	}
+	timed = sr_packet_timing_get(packet, &timing) == SR_OK;
+	item->host_time = timed ? timing.host_time : item->queued_us;
+
+	g_mutex_lock(&merge->mutex);
+
+	if (!merge->devs)
+		merge_devs_sync(merge);
+	dev = merge_dev_get(merge, sdi);
+
+	switch (packet->type) {
+	case SR_DF_HEADER:
+		if (!merge->host_origin || item->host_time < merge->host_origin)
+			merge->host_origin = item->host_time;
+		merge_dev_clear(merge, dev);
+		dev->started = TRUE;
+		dev->ended = FALSE;
+		dev->next_sample = 0;
+		dev->samplerate = config_samplerate(sdi);
+		dev->offset_ns = 0;
+		dev->aligned = merge->align == SR_MERGE_ALIGN_START ||
+			!dev->samplerate;
+		break;
+	case SR_DF_META:
+		meta_samplerate(dev, packet->payload);
+		if (!dev->samplerate)
+			dev->aligned = TRUE;
+		break;
+	case SR_DF_TRIGGER:
+		if (merge->align == SR_MERGE_ALIGN_TRIGGER && !dev->aligned) {
+			dev->offset_ns = -samples_to_ns(dev->next_sample,
+				dev->samplerate);
+			dev->aligned = TRUE;
+		}
+		break;
+	default:
+		break;
+	}
+
+	item->first_sample = timed ? timing.first_sample : dev->next_sample;
+	/* A trigger marked in place, see sr_session_trigger_inplace_set(). */
+	if (merge->align == SR_MERGE_ALIGN_TRIGGER && !dev->aligned &&
+			(packet->type == SR_DF_LOGIC ||
+			packet->type == SR_DF_ANALOG) &&
+			sr_packet_trigger_get(packet, &trigger_at) == SR_OK) {
+		dev->offset_ns = -samples_to_ns(item->first_sample + trigger_at,
+			dev->samplerate);
+		dev->aligned = TRUE;
+	}
+	if (item->num_samples) {
+		dev->next_sample = item->first_sample + item->num_samples;
+		/* The host time is when the last of the samples arrived. */
+		if (merge->align == SR_MERGE_ALIGN_HOST && !dev->aligned) {
+			dev->offset_ns = (item->host_time - merge->host_origin) *
+				1000 - samples_to_ns(dev->next_sample,
+				dev->samplerate);
+			dev->aligned = TRUE;
+		}
+	}
+	item->packet = sr_packet_ref(packet);
+	if (item->packet) {
+		g_queue_push_tail(&dev->items, item);
+		merge->bytes += item->bytes;
+	} else {
+		g_free(item);
+	}
+
+	merge_flush(merge);
+
+	g_mutex_unlock(&merge->mutex);
+}
+
+/**
+ * Get the packets of all devices in a session in time order.
+ *
+ * The callback gets every packet of every device, like a datafeed
+ * callback, and additionally where the packet is on a timebase which
+ * is common to all devices. Packets arrive in the order of their first
+ * sample's time, so the data of several instruments can be correlated
+ * as it comes in. Packets are held for as long as another device might
+ * still send earlier data, within the limits set with
+ * sr_session_merge_limits_set() (by default 64 MiB and one second).
+ *
+ * The packets can be kept with sr_packet_ref(), and their timing is
+ * available through sr_packet_timing_get() as usual.
+ *
+ * @param session The session. Must not be NULL. It must not be running.
+ * @param merge The new merge is stored here. Must not be NULL.
+ * @param align How the devices' samples are lined up.
+ * @param cb The callback to pass the packets to. Must not be NULL.
+ * @param cb_data Passed to the callback.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_merge_new(struct sr_session *session,
+		struct sr_session_merge **merge, enum sr_merge_align align,
+		sr_merge_callback cb, void *cb_data)
+{
+	struct sr_session_merge *m;
+	int ret;
+
+	if (!session || !merge || !cb)
+		return SR_ERR_ARG;
+	if (align != SR_MERGE_ALIGN_START && align != SR_MERGE_ALIGN_HOST &&
+			align != SR_MERGE_ALIGN_TRIGGER)
+		return SR_ERR_ARG;
+
+	m = g_malloc0(sizeof(*m));
+	m->session = session;
+	m->align = align;
+	m->cb = cb;
+	m->cb_data = cb_data;
+	m->max_bytes = MERGE_DEFAULT_MAX_BYTES;
+	m->max_delay_us = MERGE_DEFAULT_MAX_DELAY_US;
+	g_mutex_init(&m->mutex);
+
+	ret = sr_session_datafeed_callback_add(session, merge_datafeed, m);
+	if (ret != SR_OK) {
+		g_mutex_clear(&m->mutex);
+		g_free(m);
+		return ret;
+	}
+	*merge = m;
+
+	return SR_OK;
+}
+
+/**
+ * Set how much a merge may buffer while it waits for devices to catch up.
+ *
+ * Once the buffered sample data exceeds @a max_bytes, or the oldest
+ * buffered packet waited for longer than @a max_delay_us, packets are
+ * sent without waiting, and marked as late.
+ *
+ * @param merge The merge. Must not be NULL.
+ * @param max_bytes Sample data bytes to buffer at most.
+ * @param max_delay_us Microseconds a packet may wait at most.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_merge_limits_set(struct sr_session_merge *merge,
+		uint64_t max_bytes, uint64_t max_delay_us)
+{
+	if (!merge)
+		return SR_ERR_ARG;
+
+	g_mutex_lock(&merge->mutex);
+	merge->max_bytes = max_bytes;
+	merge->max_delay_us = max_delay_us;
+	g_mutex_unlock(&merge->mutex);
+
+	return SR_OK;
+}
+
+/**
+ * Stop merging, and free the merge.
+ *
+ * Buffered packets get sent to the callback first, in time order.
+ * The session must not be running.
+ *
+ * @param merge The merge. Can be NULL.
+ *
+ * @since 0.6.0
+ */
+SR_API void sr_session_merge_free(struct sr_session_merge *merge)
+{
+	struct merge_dev *dev;
+	GSList *l;
+
+	if (!merge)
+		return;
+
+	sr_session_datafeed_callback_remove(merge->session, merge_datafeed,
+		merge);
+
+	for (l = merge->devs; l; l = l->next) {
+		dev = l->data;
+		dev->ended = TRUE;
+		dev->aligned = TRUE;
+	}
+	merge->max_bytes = 0;
+	merge_flush(merge);
+
+	for (l = merge->devs; l; l = l->next) {
+		dev = l->data;
+		merge_dev_clear(merge, dev);
+	}
+	g_slist_free_full(merge->devs, g_free);
+	g_mutex_clear(&merge->mutex);
+	g_free(merge);
+}
+
+/** @} */
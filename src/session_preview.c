@@ -0,0 +1,562 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <glib.h>
+#include <math.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "session-preview"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Decimated min/max preview of the devices' datafeed.
+ */
+
+/**
+ * @addtogroup grp_session
+ *
+ * @{
+ */
+
+/*
+ * Every point of the preview covers samplerate / rate samples. Logic
+ * points hold the AND (min) and OR (max) of their samples, analog
+ * points the lowest and highest value, per channel. Samples of a point
+ * which is not complete at the end of a packet carry over to the next,
+ * so the points do not depend on how the device splits its data.
+ */
+
+struct preview_chan {
+	struct sr_channel *ch;
+	uint64_t point;
+	uint64_t count;
+	float min;
+	float max;
+};
+
+struct preview_dev {
+	const struct sr_dev_inst *sdi;
+	uint64_t samplerate;
+	uint64_t samples_per_point;
+	/* Logic point in progress. */
+	uint16_t unitsize;
+	uint64_t point;
+	uint64_t count;
+	uint8_t *cur_min;
+	uint8_t *cur_max;
+	/* Analog points in progress. */
+	GSList *chans;
+	/* Completed points of a packet, and analog samples as floats. */
+	void *out_min;
+	void *out_max;
+	size_t out_size;
+	float *fdata;
+	size_t fdata_size;
+};
+
+struct sr_session_preview {
+	struct sr_session *session;
+	uint64_t rate;
+	sr_preview_callback cb;
+	void *cb_data;
+	/* Devices may deliver from different threads. */
+	GMutex mutex;
+	GSList *devs;
+};
+
+/* AND and OR num samples of unitsize bytes into min and max. */
+static void logic_minmax(const uint8_t *data, uint64_t num,
+		unsigned int unitsize, uint8_t *min, uint8_t *max)
+{
+#ifdef __SSE2__
+	__m128i vmin, vmax, v;
+#endif
+	uint8_t lo[16], hi[16];
+	uint64_t wmin, wmax, w;
+	size_t bytes, wide, i, k;
+
+	bytes = num * unitsize;
+	wide = 0;
+	i = 0;
+
+	/* Whole samples per word, so a word's lanes fold into one sample. */
+#ifdef __SSE2__
+	if (16 % unitsize == 0 && bytes >= 32) {
+		vmin = _mm_set1_epi8((char)0xff);
+		vmax = _mm_setzero_si128();
+		for (; i + 16 <= bytes; i += 16) {
+			v = _mm_loadu_si128((const __m128i *)(data + i));
+			vmin = _mm_and_si128(vmin, v);
+			vmax = _mm_or_si128(vmax, v);
+		}
+		_mm_storeu_si128((__m128i *)lo, vmin);
+		_mm_storeu_si128((__m128i *)hi, vmax);
+		wide = 16;
+	}
+#endif
+	if (!wide && 8 % unitsize == 0 && bytes >= 16) {
+		wmin = ~(uint64_t)0;
+		wmax = 0;
+		for (; i + 8 <= bytes; i += 8) {
+			memcpy(&w, data + i, sizeof(w));
+			wmin &= w;
+			wmax |= w;
+		}
+		memcpy(lo, &wmin, sizeof(wmin));
+		memcpy(hi, &wmax, sizeof(wmax));
+		wide = 8;
+	}
+	for (k = 0; k < wide; k++) {
+		min[k % unitsize] &= lo[k];
+		max[k % unitsize] |= hi[k];
+	}
+
+	for (; i < bytes; i += unitsize) {
+		for (k = 0; k < unitsize; k++) {
+			min[k] &= data[i + k];
+			max[k] |= data[i + k];
+		}
+	}
+}
+
+/* Lowest and highest of num values, every stride'th one. NaNs are skipped. */
+static void analog_minmax(const float *data, uint64_t num, size_t stride,
+		float *min, float *max)
+{
+#ifdef __SSE2__
+	__m128 vmin, vmax, v;
+	float lo[4], hi[4];
+#endif
+	uint64_t i;
+	float f;
+
+	i = 0;
+#ifdef __SSE2__
+	if (stride == 1 && num >= 8) {
+		vmin = _mm_set1_ps(*min);
+		vmax = _mm_set1_ps(*max);
+		/* With a NaN, min/max return the second operand. */
+		for (; i + 4 <= num; i += 4) {
+			v = _mm_loadu_ps(data + i);
+			vmin = _mm_min_ps(v, vmin);
+			vmax = _mm_max_ps(v, vmax);
+		}
+		_mm_storeu_ps(lo, vmin);
+		_mm_storeu_ps(hi, vmax);
+		*min = MIN(MIN(lo[0], lo[1]), MIN(lo[2], lo[3]));
+		*max = MAX(MAX(hi[0], hi[1]), MAX(hi[2], hi[3]));
+	}
+#endif
+	for (; i < num; i++) {
+		f = data[i * stride];
+		if (f < *min)
+			*min = f;
+		if (f > *max)
+			*max = f;
+	}
+}
+
+static struct preview_dev *preview_dev_get(struct sr_session_preview *preview,
+		const struct sr_dev_inst *sdi)
+{
+	struct preview_dev *dev;
+	GSList *l;
+
+	for (l = preview->devs; l; l = l->next) {
+		dev = l->data;
+		if (dev->sdi == sdi)
+			return dev;
+	}
+
+	dev = g_malloc0(sizeof(*dev));
+	dev->sdi = sdi;
+	dev->samples_per_point = 1;
+	preview->devs = g_slist_append(preview->devs, dev);
+
+	return dev;
+}
+
+static void preview_dev_free(struct preview_dev *dev)
+{
+	g_slist_free_full(dev->chans, g_free);
+	g_free(dev->cur_min);
+	g_free(dev->cur_max);
+	g_free(dev->out_min);
+	g_free(dev->out_max);
+	g_free(dev->fdata);
+	g_free(dev);
+}
+
+static void out_reserve(struct preview_dev *dev, size_t size)
+{
+	if (size <= dev->out_size)
+		return;
+	dev->out_min = g_realloc(dev->out_min, size);
+	dev->out_max = g_realloc(dev->out_max, size);
+	dev->out_size = size;
+}
+
+static void preview_send(struct sr_session_preview *preview,
+		struct preview_dev *dev, struct sr_channel *ch,
+		uint64_t first_point, uint64_t num_points)
+{
+	struct sr_preview p;
+
+	if (!num_points)
+		return;
+
+	memset(&p, 0, sizeof(p));
+	p.first_point = first_point;
+	p.num_points = num_points;
+	p.samples_per_point = dev->samples_per_point;
+	p.samplerate = dev->samplerate;
+	p.channel = ch;
+	if (ch) {
+		p.analog_min = dev->out_min;
+		p.analog_max = dev->out_max;
+	} else {
+		p.unitsize = dev->unitsize;
+		p.logic_min = dev->out_min;
+		p.logic_max = dev->out_max;
+	}
+	preview->cb(dev->sdi, &p, preview->cb_data);
+}
+
+static void logic_point_reset(struct preview_dev *dev)
+{
+	memset(dev->cur_min, 0xff, dev->unitsize);
+	memset(dev->cur_max, 0, dev->unitsize);
+	dev->count = 0;
+}
+
+static void chan_point_reset(struct preview_chan *chan)
+{
+	chan->min = INFINITY;
+	chan->max = -INFINITY;
+	chan->count = 0;
+}
+
+/* Send the points in progress, at the end or when the rate changes. */
+static void preview_dev_flush(struct sr_session_preview *preview,
+		struct preview_dev *dev)
+{
+	struct preview_chan *chan;
+	GSList *l;
+
+	if (dev->count) {
+		out_reserve(dev, dev->unitsize);
+		memcpy(dev->out_min, dev->cur_min, dev->unitsize);
+		memcpy(dev->out_max, dev->cur_max, dev->unitsize);
+		preview_send(preview, dev, NULL, dev->point++, 1);
+		logic_point_reset(dev);
+	}
+
+	for (l = dev->chans; l; l = l->next) {
+		chan = l->data;
+		if (!chan->count)
+			continue;
+		out_reserve(dev, sizeof(float));
+		((float *)dev->out_min)[0] = chan->min;
+		((float *)dev->out_max)[0] = chan->max;
+		preview_send(preview, dev, chan->ch, chan->point++, 1);
+		chan_point_reset(chan);
+	}
+}
+
+static void preview_dev_reset(struct preview_dev *dev)
+{
+	GSList *l;
+
+	dev->point = 0;
+	dev->count = 0;
+	if (dev->unitsize)
+		logic_point_reset(dev);
+	for (l = dev->chans; l; l = l->next) {
+		((struct preview_chan *)l->data)->point = 0;
+		chan_point_reset(l->data);
+	}
+}
+
+static void samplerate_set(struct sr_session_preview *preview,
+		struct preview_dev *dev, uint64_t samplerate)
+{
+	if (samplerate == dev->samplerate)
+		return;
+
+	preview_dev_flush(preview, dev);
+	dev->samplerate = samplerate;
+	dev->samples_per_point = MAX(samplerate / preview->rate, 1);
+}
+
+static uint64_t config_samplerate(const struct sr_dev_inst *sdi)
+{
+	GVariant *gvar;
+	uint64_t samplerate;
+
+	if (!sdi->driver || sr_config_get(sdi->driver, sdi, NULL,
+			SR_CONF_SAMPLERATE, &gvar) != SR_OK)
+		return 0;
+	samplerate = g_variant_get_uint64(gvar);
+	g_variant_unref(gvar);
+
+	return samplerate;
+}
+
+static void preview_logic(struct sr_session_preview *preview,
+		struct preview_dev *dev, const struct sr_datafeed_logic *logic)
+{
+	const uint8_t *data;
+	uint64_t num, pos, take, first, out;
+	uint8_t *out_min, *out_max;
+
+	if (!logic->unitsize)
+		return;
+	if (logic->unitsize != dev->unitsize) {
+		preview_dev_flush(preview, dev);
+		dev->unitsize = logic->unitsize;
+		dev->cur_min = g_realloc(dev->cur_min, dev->unitsize);
+		dev->cur_max = g_realloc(dev->cur_max, dev->unitsize);
+		logic_point_reset(dev);
+	}
+
+	data = logic->data;
+	num = logic->length / logic->unitsize;
+	out_reserve(dev, (num / dev->samples_per_point + 1) * dev->unitsize);
+	out_min = dev->out_min;
+	out_max = dev->out_max;
+	first = dev->point;
+	out = 0;
+
+	for (pos = 0; pos < num; pos += take) {
+		take = MIN(num - pos, dev->samples_per_point - dev->count);
+		logic_minmax(data + pos * dev->unitsize, take, dev->unitsize,
+			dev->cur_min, dev->cur_max);
+		dev->count += take;
+		if (dev->count < dev->samples_per_point)
+			break;
+		memcpy(out_min + out * dev->unitsize, dev->cur_min, dev->unitsize);
+		memcpy(out_max + out * dev->unitsize, dev->cur_max, dev->unitsize);
+		out++;
+		dev->point++;
+		logic_point_reset(dev);
+	}
+
+	preview_send(preview, dev, NULL, first, out);
+}
+
+static struct preview_chan *chan_get(struct preview_dev *dev,
+		struct sr_channel *ch)
+{
+	struct preview_chan *chan;
+	GSList *l;
+
+	for (l = dev->chans; l; l = l->next) {
+		chan = l->data;
+		if (chan->ch == ch)
+			return chan;
+	}
+
+	chan = g_malloc0(sizeof(*chan));
+	chan->ch = ch;
+	chan_point_reset(chan);
+	dev->chans = g_slist_append(dev->chans, chan);
+
+	return chan;
+}
+
+static void preview_analog(struct sr_session_preview *preview,
+		struct preview_dev *dev, const struct sr_datafeed_analog *analog)
+{
+	struct preview_chan *chan;
+	uint64_t num, pos, take, first, out;
+	size_t num_channels, c;
+	float *out_min, *out_max;
+	GSList *l;
+
+	num = analog->num_samples;
+	num_channels = g_slist_length(analog->meaning->channels);
+	if (!num || !num_channels)
+		return;
+
+	if (dev->fdata_size < num * num_channels) {
+		g_free(dev->fdata);
+		dev->fdata_size = num * num_channels;
+		dev->fdata = g_malloc(dev->fdata_size * sizeof(float));
+	}
+	if (sr_analog_to_float(analog, dev->fdata) != SR_OK)
+		return;
+	out_reserve(dev, (num / dev->samples_per_point + 1) * sizeof(float));
+
+	/* Values of several channels are interleaved. */
+	for (l = analog->meaning->channels, c = 0; l; l = l->next, c++) {
+		chan = chan_get(dev, l->data);
+		out_min = dev->out_min;
+		out_max = dev->out_max;
+		first = chan->point;
+		out = 0;
+		for (pos = 0; pos < num; pos += take) {
+			take = MIN(num - pos, dev->samples_per_point - chan->count);
+			analog_minmax(dev->fdata + pos * num_channels + c, take,
+				num_channels, &chan->min, &chan->max);
+			chan->count += take;
+			if (chan->count < dev->samples_per_point)
+				break;
+			out_min[out] = chan->min;
+			out_max[out] = chan->max;
+			out++;
+			chan->point++;
+			chan_point_reset(chan);
+		}
+		preview_send(preview, dev, chan->ch, first, out);
+	}
+}
+
+static void preview_meta(struct sr_session_preview *preview,
+		struct preview_dev *dev, const struct sr_datafeed_meta *meta)
+{
+	const struct sr_config *src;
+	GSList *l;
+
+	for (l = meta->config; l; l = l->next) {
+		src = l->data;
+		if (src->key == SR_CONF_SAMPLERATE)
+			samplerate_set(preview, dev,
+				g_variant_get_uint64(src->data));
+	}
+}
+
+static void preview_datafeed(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	struct sr_session_preview *preview;
+	struct preview_dev *dev;
+
+	preview = cb_data;
+
+	g_mutex_lock(&preview->mutex);
+
+	dev = preview_dev_get(preview, sdi);
+	switch (packet->type) {
+	case SR_DF_HEADER:
+		preview_dev_reset(dev);
+		dev->samplerate = 0;
+		dev->samples_per_point = 1;
+		samplerate_set(preview, dev, config_samplerate(sdi));
+		break;
+	case SR_DF_META:
+		preview_meta(preview, dev, packet->payload);
+		break;
+	case SR_DF_LOGIC:
+		preview_logic(preview, dev, packet->payload);
+		break;
+	case SR_DF_ANALOG:
+		preview_analog(preview, dev, packet->payload);
+		break;
+	case SR_DF_END:
+		preview_dev_flush(preview, dev);
+		break;
+	default:
+		break;
+	}
+
+	g_mutex_unlock(&preview->mutex);
+}
+
+/**
+ * Get a decimated min/max preview of the datafeed.
+ *
+ * The callback gets the envelope of every device's samples at about
+ * @a rate points per second, e.g. the pixel columns a display shows per
+ * second. Its cost thus depends on the rate, rather than on the
+ * devices' samplerates. The full-rate datafeed is not affected and
+ * still goes to datafeed callbacks and outputs.
+ *
+ * Devices without a samplerate get one point per sample.
+ *
+ * The data pointed to by the struct sr_preview is valid only during
+ * the callback.
+ *
+ * @param session The session. Must not be NULL. It must not be running.
+ * @param preview The new preview is stored here. Must not be NULL.
+ * @param rate Points per second and device, at least 1.
+ * @param cb The callback to pass the points to. Must not be NULL.
+ * @param cb_data Passed to the callback.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_preview_new(struct sr_session *session,
+		struct sr_session_preview **preview, uint64_t rate,
+		sr_preview_callback cb, void *cb_data)
+{
+	struct sr_session_preview *p;
+	int ret;
+
+	if (!session || !preview || !rate || !cb)
+		return SR_ERR_ARG;
+
+	p = g_malloc0(sizeof(*p));
+	p->session = session;
+	p->rate = rate;
+	p->cb = cb;
+	p->cb_data = cb_data;
+	g_mutex_init(&p->mutex);
+
+	ret = sr_session_datafeed_callback_add(session, preview_datafeed, p);
+	if (ret != SR_OK) {
+		g_mutex_clear(&p->mutex);
+		g_free(p);
+		return ret;
+	}
+	*preview = p;
+
+	return SR_OK;
+}
+
+/**
+ * Stop the preview, and free it.
+ *
+ * The session must not be running.
+ *
+ * @param preview The preview. Can be NULL.
+ *
+ * @since 0.6.0
+ */
+SR_API void sr_session_preview_free(struct sr_session_preview *preview)
+{
+	if (!preview)
+		return;
+
+	sr_session_datafeed_callback_remove(preview->session,
+		preview_datafeed, preview);
+	g_slist_free_full(preview->devs, (GDestroyNotify)preview_dev_free);
+	g_mutex_clear(&preview->mutex);
+	g_free(preview);
+}
+
+/** @} */
@@ -0,0 +1,558 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/time.h>
+#include <glib.h>
+#ifdef HAVE_SHM_OPEN
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "shmring.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "shmring"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Read a datafeed which the "shmring" output module publishes.
+ */
+
+/**
+ * @defgroup grp_shmring Shared memory datafeed
+ *
+ * Read a datafeed which another process publishes in shared memory.
+ *
+ * Any number of readers can attach to the datafeed of a session which
+ * has a "shmring" output module. Each reader gets the packets from the
+ * time it attached, with its own position in the ring. The publishing
+ * session never waits for its readers, a reader which falls behind by
+ * more than the ring's size loses packets, and gets told so.
+ *
+ * @{
+ */
+
+struct sr_shmring_reader {
+	struct shmring_control *ctl;
+	size_t map_size;
+	const uint8_t *ring;
+	guint32 size;
+	/* Position of the next frame, and of the one last returned. */
+	guint32 pos;
+	guint32 frame_pos;
+	gboolean header_pending;
+	gboolean meta_pending;
+	uint64_t samplerate;
+	GSList *channels;
+
+	/* The packet last returned. */
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_header header;
+	struct sr_datafeed_meta meta;
+	struct sr_config config;
+	GSList config_link;
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	GSList channel_link;
+};
+
+#ifdef HAVE_SHM_OPEN
+
+static void channels_free(struct sr_shmring_reader *reader)
+{
+	struct sr_channel *ch;
+	GSList *l;
+
+	for (l = reader->channels; l; l = l->next) {
+		ch = l->data;
+		g_free(ch->name);
+		g_free(ch);
+	}
+	g_slist_free(reader->channels);
+	reader->channels = NULL;
+}
+
+static int header_parse(struct sr_shmring_reader *reader, const uint8_t *p,
+		size_t len)
+{
+	struct sr_channel *ch;
+	const uint8_t *end;
+	uint32_t i, num_channels;
+	uint16_t name_len;
+	uint8_t type;
+
+	end = p + len;
+	if (len < 12)
+		return SR_ERR_DATA;
+	reader->samplerate = read_u64le_inc(&p);
+	num_channels = read_u32le_inc(&p);
+
+	channels_free(reader);
+	for (i = 0; i < num_channels; i++) {
+		if (end - p < 4)
+			return SR_ERR_DATA;
+		ch = g_malloc0(sizeof(*ch));
+		ch->index = i;
+		type = read_u8_inc(&p);
+		ch->type = (type == NETFEED_CHANNEL_LOGIC) ?
+			SR_CHANNEL_LOGIC : SR_CHANNEL_ANALOG;
+		ch->enabled = read_u8_inc(&p);
+		name_len = read_u16le_inc(&p);
+		if (end - p < name_len) {
+			g_free(ch);
+			return SR_ERR_DATA;
+		}
+		ch->name = g_strndup((const char *)p, name_len);
+		p += name_len;
+		reader->channels = g_slist_append(reader->channels, ch);
+	}
+
+	return SR_OK;
+}
+
+/* Copy the header out of the writer's way, and parse it. */
+static int header_read(struct sr_shmring_reader *reader)
+{
+	uint8_t *buf;
+	gint seq, len;
+	int i, ret;
+
+	buf = g_malloc(SHMRING_HEADER_MAX);
+	for (i = 0; i < 1000; i++) {
+		seq = g_atomic_int_get(&reader->ctl->header_seq);
+		if (seq & 1) {
+			g_usleep(10);
+			continue;
+		}
+		len = g_atomic_int_get(&reader->ctl->header_len);
+		len = CLAMP(len, 0, SHMRING_HEADER_MAX);
+		memcpy(buf, (const uint8_t *)reader->ctl + SHMRING_HEADER_OFFSET,
+			len);
+		if (g_atomic_int_get(&reader->ctl->header_seq) == seq)
+			break;
+	}
+	if (i == 1000) {
+		g_free(buf);
+		return SR_ERR_TIMEOUT;
+	}
+
+	/* The writer has not described its channels yet. */
+	ret = len ? header_parse(reader, buf, len) : SR_OK;
+	reader->header_pending = len && ret == SR_OK;
+	g_free(buf);
+
+	return ret;
+}
+
+#endif
+
+/**
+ * Attach to a datafeed in shared memory.
+ *
+ * The reader starts with an SR_DF_HEADER packet which describes the
+ * channels (see sr_shmring_reader_channels()), unless the output
+ * module did not get to describe them yet. An SR_DF_META packet with
+ * the samplerate follows, when the samplerate is known.
+ *
+ * @param[in] name The "name" option of the "shmring" output module,
+ *                 e.g. "/sigrok".
+ * @param[out] reader The new reader.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid arguments.
+ * @retval SR_ERR_NA No shared memory support in this build.
+ * @retval SR_ERR Cannot attach, e.g. nothing gets published as name.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_shmring_reader_open(const char *name,
+		struct sr_shmring_reader **reader)
+{
+#ifdef HAVE_SHM_OPEN
+	struct sr_shmring_reader *r;
+	struct shmring_control *ctl;
+	struct stat st;
+	void *map;
+	int fd, ret;
+
+	if (!reader || !name)
+		return SR_ERR_ARG;
+	*reader = NULL;
+
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		sr_err("Cannot open shared memory '%s': %s", name,
+			g_strerror(errno));
+		return SR_ERR;
+	}
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < SHMRING_RING_OFFSET) {
+		sr_err("Shared memory '%s' holds no datafeed.", name);
+		close(fd);
+		return SR_ERR;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		sr_err("Cannot map shared memory '%s': %s", name,
+			g_strerror(errno));
+		return SR_ERR;
+	}
+
+	ctl = map;
+	if (memcmp(ctl->magic, SHMRING_MAGIC, SHMRING_MAGIC_LEN) ||
+			ctl->version != SHMRING_VERSION || !ctl->size ||
+			(ctl->size & (ctl->size - 1)) ||
+			SHMRING_RING_OFFSET + ctl->size > (size_t)st.st_size) {
+		sr_err("Shared memory '%s' holds no datafeed.", name);
+		munmap(map, st.st_size);
+		return SR_ERR;
+	}
+
+	r = g_malloc0(sizeof(*r));
+	r->ctl = ctl;
+	r->map_size = st.st_size;
+	r->ring = (const uint8_t *)map + SHMRING_RING_OFFSET;
+	r->size = ctl->size;
+	r->pos = g_atomic_int_get(&ctl->write_pos);
+	if ((ret = header_read(r)) != SR_OK) {
+		sr_err("Cannot read the header in '%s'.", name);
+		sr_shmring_reader_close(r);
+		return ret;
+	}
+	*reader = r;
+
+	return SR_OK;
+#else
+	(void)reader;
+	(void)name;
+
+	return SR_ERR_NA;
+#endif
+}
+
+/**
+ * Detach from a datafeed in shared memory.
+ *
+ * Packets and channels of the reader are no longer valid afterwards.
+ *
+ * @param reader The reader, may be NULL.
+ *
+ * @since 0.6.0
+ */
+SR_API void sr_shmring_reader_close(struct sr_shmring_reader *reader)
+{
+	if (!reader)
+		return;
+
+#ifdef HAVE_SHM_OPEN
+	munmap(reader->ctl, reader->map_size);
+	channels_free(reader);
+#endif
+	if (reader->config.data)
+		g_variant_unref(reader->config.data);
+	g_free(reader);
+}
+
+/**
+ * Get the channels of a datafeed in shared memory.
+ *
+ * Analog packets refer to these. They change with each SR_DF_HEADER
+ * packet.
+ *
+ * @param reader The reader.
+ *
+ * @return A list of struct sr_channel which belongs to the reader, or
+ *         NULL when the channels are not known yet.
+ *
+ * @since 0.6.0
+ */
+SR_API GSList *sr_shmring_reader_channels(const struct sr_shmring_reader *reader)
+{
+	return reader ? reader->channels : NULL;
+}
+
+#ifdef HAVE_SHM_OPEN
+
+/* Whether the writer started to overwrite a frame at pos. */
+static gboolean overwritten(const struct sr_shmring_reader *reader,
+		guint32 pos)
+{
+	guint32 reserve;
+
+	reserve = g_atomic_int_get(&reader->ctl->reserve_pos);
+
+	return reserve - pos > reader->size;
+}
+
+static void packet_header(struct sr_shmring_reader *reader)
+{
+	memset(&reader->header, 0, sizeof(reader->header));
+	reader->header.feed_version = 1;
+	gettimeofday(&reader->header.starttime, NULL);
+	reader->packet.type = SR_DF_HEADER;
+	reader->packet.payload = &reader->header;
+	reader->meta_pending = reader->samplerate != 0;
+}
+
+static void packet_meta(struct sr_shmring_reader *reader)
+{
+	if (reader->config.data)
+		g_variant_unref(reader->config.data);
+	reader->config.key = SR_CONF_SAMPLERATE;
+	reader->config.data = g_variant_ref_sink(
+		g_variant_new_uint64(reader->samplerate));
+	reader->config_link.data = &reader->config;
+	reader->config_link.next = NULL;
+	reader->meta.config = &reader->config_link;
+	reader->packet.type = SR_DF_META;
+	reader->packet.payload = &reader->meta;
+	reader->meta_pending = FALSE;
+}
+
+static int packet_logic(struct sr_shmring_reader *reader, const uint8_t *p,
+		size_t len)
+{
+	if (len < NETFEED_LOGIC_LEN)
+		return SR_ERR_DATA;
+	reader->logic.unitsize = read_u32le(p);
+	if (!reader->logic.unitsize)
+		return SR_ERR_DATA;
+	len -= NETFEED_LOGIC_LEN;
+	reader->logic.length = len - len % reader->logic.unitsize;
+	reader->logic.data = (void *)(p + NETFEED_LOGIC_LEN);
+	reader->packet.type = SR_DF_LOGIC;
+	reader->packet.payload = &reader->logic;
+
+	return SR_OK;
+}
+
+static int packet_analog(struct sr_shmring_reader *reader, const uint8_t *p,
+		size_t len)
+{
+	struct sr_channel *ch;
+	uint32_t index;
+	GSList *l;
+	int digits;
+
+	if (len < NETFEED_ANALOG_LEN)
+		return SR_ERR_DATA;
+	index = read_u32le_inc(&p);
+	for (l = reader->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->index == (int)index)
+			break;
+	}
+	if (!l)
+		return SR_ERR_DATA;
+
+	sr_analog_init(&reader->analog, &reader->encoding, &reader->meaning,
+		&reader->spec, 0);
+	reader->meaning.mq = read_u32le_inc(&p);
+	reader->meaning.unit = read_u32le_inc(&p);
+	reader->meaning.mqflags = read_u64le_inc(&p);
+	digits = (int32_t)read_u32le_inc(&p);
+	reader->encoding.digits = reader->spec.spec_digits = digits;
+	reader->encoding.is_bigendian = FALSE;
+	reader->channel_link.data = l->data;
+	reader->channel_link.next = NULL;
+	reader->meaning.channels = &reader->channel_link;
+	/* The writer keeps the samples aligned. */
+	reader->analog.data = (void *)p;
+	reader->analog.num_samples = (len - NETFEED_ANALOG_LEN) / sizeof(float);
+	reader->packet.type = SR_DF_ANALOG;
+	reader->packet.payload = &reader->analog;
+
+	return SR_OK;
+}
+
+static int packet_empty(struct sr_shmring_reader *reader, int type)
+{
+	reader->packet.type = type;
+	reader->packet.payload = NULL;
+
+	return SR_OK;
+}
+
+/* Make a packet of a frame, SR_ERR_NA for frames which are none. */
+static int frame_packet(struct sr_shmring_reader *reader, int type,
+		const uint8_t *p, size_t len)
+{
+	int ret;
+
+	switch (type) {
+	case NETFEED_HEADER:
+		if ((ret = header_parse(reader, p, len)) != SR_OK)
+			return ret;
+		packet_header(reader);
+		return SR_OK;
+	case NETFEED_LOGIC:
+		return packet_logic(reader, p, len);
+	case NETFEED_ANALOG:
+		return packet_analog(reader, p, len);
+	case NETFEED_SAMPLERATE:
+		if (len < 8)
+			return SR_ERR_DATA;
+		reader->samplerate = read_u64le(p);
+		packet_meta(reader);
+		return SR_OK;
+	case NETFEED_TRIGGER:
+		return packet_empty(reader, SR_DF_TRIGGER);
+	case NETFEED_FRAME_BEGIN:
+		return packet_empty(reader, SR_DF_FRAME_BEGIN);
+	case NETFEED_FRAME_END:
+		return packet_empty(reader, SR_DF_FRAME_END);
+	case NETFEED_END:
+		return packet_empty(reader, SR_DF_END);
+	default:
+		return SR_ERR_NA;
+	}
+}
+
+#endif
+
+/**
+ * Get the next packet of a datafeed in shared memory.
+ *
+ * This does not wait for packets. The sample data of the packets is
+ * not copied out of the shared memory, where the writer eventually
+ * reuses it. Use sr_shmring_reader_check() after working with the
+ * data of a packet, to see whether it was overwritten meanwhile.
+ *
+ * @param reader The reader.
+ * @param[out] packet The next packet, or NULL if there is none yet. It
+ *                    is valid until the next call.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid arguments.
+ * @retval SR_ERR_DATA The reader fell behind and lost packets, or found
+ *                     an invalid one. It continues with the newest.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_shmring_reader_next(struct sr_shmring_reader *reader,
+		const struct sr_datafeed_packet **packet)
+{
+#ifdef HAVE_SHM_OPEN
+	const uint8_t *frame;
+	guint32 avail, off, len, total;
+	int type, ret;
+
+	if (!reader || !packet)
+		return SR_ERR_ARG;
+	*packet = NULL;
+
+	if (reader->header_pending || reader->meta_pending)
+		reader->frame_pos = reader->pos;
+	if (reader->header_pending) {
+		reader->header_pending = FALSE;
+		packet_header(reader);
+		*packet = &reader->packet;
+		return SR_OK;
+	}
+	if (reader->meta_pending) {
+		packet_meta(reader);
+		*packet = &reader->packet;
+		return SR_OK;
+	}
+
+	while (1) {
+		avail = g_atomic_int_get(&reader->ctl->write_pos) - reader->pos;
+		if (!avail)
+			return SR_OK;
+		if (avail > reader->size)
+			break;
+
+		off = reader->pos & (reader->size - 1);
+		frame = reader->ring + off;
+		len = read_u32le(frame);
+		type = frame[4];
+		total = (NETFEED_FRAME_LEN + (uint64_t)len + SHMRING_ALIGN - 1) &
+			~(SHMRING_ALIGN - 1);
+		if (overwritten(reader, reader->pos))
+			break;
+		if (total > avail || total > reader->size - off) {
+			sr_err("Invalid frame in the ring.");
+			break;
+		}
+
+		reader->frame_pos = reader->pos;
+		reader->pos += total;
+		if (type == SHMRING_PAD)
+			continue;
+		ret = frame_packet(reader, type, frame + NETFEED_FRAME_LEN, len);
+		if (ret == SR_ERR_NA)
+			continue;
+		if (overwritten(reader, reader->frame_pos))
+			break;
+		if (ret != SR_OK) {
+			sr_err("Invalid frame of type %d in the ring.", type);
+			return ret;
+		}
+		*packet = &reader->packet;
+		return SR_OK;
+	}
+
+	avail = g_atomic_int_get(&reader->ctl->write_pos) - reader->pos;
+	sr_warn("Reader fell behind, skipping %" PRIu32 " bytes.", avail);
+	reader->pos += avail;
+
+	return SR_ERR_DATA;
+#else
+	(void)reader;
+	(void)packet;
+
+	return SR_ERR_NA;
+#endif
+}
+
+/**
+ * Check whether the data of the packet last returned is still intact.
+ *
+ * @param reader The reader.
+ *
+ * @retval SR_OK The packet's data was not overwritten yet.
+ * @retval SR_ERR_DATA The writer reused the packet's data, the reader
+ *                     needs to keep up with it.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_shmring_reader_check(const struct sr_shmring_reader *reader)
+{
+	if (!reader)
+		return SR_ERR_ARG;
+
+#ifdef HAVE_SHM_OPEN
+	if (overwritten(reader, reader->frame_pos))
+		return SR_ERR_DATA;
+#endif
+
+	return SR_OK;
+}
+
+/** @} */
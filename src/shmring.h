@@ -0,0 +1,62 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBSIGROK_SHMRING_H
+#define LIBSIGROK_SHMRING_H
+
+#include <glib.h>
+#include "netfeed.h"
+
+/*
+ * Layout of a datafeed in a POSIX shared memory object, as the
+ * "shmring" output module publishes it and sr_shmring_reader_open()
+ * attaches to it: struct shmring_control, the latest NETFEED_HEADER
+ * payload (SHMRING_HEADER_MAX bytes), then the ring.
+ *
+ * The ring holds netfeed frames (see netfeed.h), each padded to
+ * SHMRING_ALIGN bytes. A frame never wraps around the ring's end, a
+ * SHMRING_PAD frame fills the space up to it instead. The positions
+ * count bytes since the start and wrap at 2^32, the ring's size
+ * divides that. The writer moves reserve_pos ahead before it writes
+ * a frame, and write_pos after: a reader's frame is intact as long as
+ * reserve_pos is less than the ring's size ahead of it.
+ */
+#define SHMRING_MAGIC		"SRSHRING"
+#define SHMRING_MAGIC_LEN	8
+#define SHMRING_VERSION		1
+#define SHMRING_HEADER_MAX	(64 * 1024)
+#define SHMRING_ALIGN		8
+
+/* Padding up to the end of the ring. */
+#define SHMRING_PAD		0
+
+struct shmring_control {
+	char magic[SHMRING_MAGIC_LEN];
+	guint32 version;
+	guint32 size;
+	/* Positions and header state, accessed with g_atomic_int_*(). */
+	gint reserve_pos;
+	gint write_pos;
+	/* Odd while the header gets replaced. */
+	gint header_seq;
+	gint header_len;
+};
+
+#define SHMRING_HEADER_OFFSET	sizeof(struct shmring_control)
+#define SHMRING_RING_OFFSET	(SHMRING_HEADER_OFFSET + SHMRING_HEADER_MAX)
+
+#endif
@@ -17,8 +17,15 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE
+
 #include <config.h>
+#include <math.h>
 #include <string.h>
+#ifdef HAVE_MEMFD_CREATE
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
 
@@ -41,31 +48,256 @@ SR_PRIV int logic_channel_unitsize(GSList *channels)
 	return (number + 7) / 8;
 }
 
-SR_PRIV struct soft_trigger_logic *soft_trigger_logic_new(
-		const struct sr_dev_inst *sdi, struct sr_trigger *trigger,
-		int pre_trigger_samples)
+/*
+ * Trigger stages get compiled into bit masks, for each 64bit word of a
+ * sample. A sample matches a stage when all of its level conditions hold
+ * and all edge conditions hold relative to the previous sample. Matches
+ * on disabled channels are ignored.
+ */
+struct soft_trigger_stage {
+	uint64_t *level_mask;
+	uint64_t *level_value;
+	uint64_t *rise_mask;
+	uint64_t *fall_mask;
+	uint64_t *edge_mask;
+	/* Union of all masks above, the channels this stage looks at. */
+	uint64_t *used_mask;
+	/* used_mask replicated over 64 bits, for unit sizes 1/2/4/8. */
+	uint64_t scan_mask;
+	/* The same for the level conditions. */
+	uint64_t scan_level_mask;
+	uint64_t scan_level_value;
+	gboolean has_edges;
+};
+
+/* Lay out the mask in memory order, as the samples are. */
+static uint64_t replicate_mask(const struct soft_trigger_logic *stl,
+		uint64_t mask)
+{
+	uint8_t bytes[sizeof(uint64_t)];
+	uint64_t word;
+	size_t i;
+
+	for (i = 0; i < sizeof(bytes); i++)
+		bytes[i] = mask >> (8 * (i % stl->unitsize));
+	memcpy(&word, bytes, sizeof(word));
+
+	return word;
+}
+
+static void compile_scan_mask(const struct soft_trigger_logic *stl,
+		struct soft_trigger_stage *cs)
+{
+	if (stl->unitsize != 1 && stl->unitsize != 2 &&
+			stl->unitsize != 4 && stl->unitsize != 8)
+		return;
+
+	cs->scan_mask = replicate_mask(stl, cs->used_mask[0]);
+	cs->scan_level_mask = replicate_mask(stl, cs->level_mask[0]);
+	cs->scan_level_value = replicate_mask(stl, cs->level_value[0]);
+}
+
+static int compile_stages(struct soft_trigger_logic *stl)
+{
+	struct sr_trigger_stage *stage;
+	struct sr_trigger_match *match;
+	struct soft_trigger_stage *cs;
+	GSList *l, *m;
+	size_t idx, nwords;
+	uint64_t *words;
+	uint64_t bit;
+	int word;
+
+	stl->num_stages = g_slist_length(stl->trigger->stages);
+	stl->num_words = (stl->unitsize + 7) / 8;
+	nwords = stl->num_words;
+	stl->stages = g_malloc0(stl->num_stages * sizeof(*stl->stages));
+
+	idx = 0;
+	for (l = stl->trigger->stages; l; l = l->next, idx++) {
+		stage = l->data;
+		if (!stage->matches) {
+			/* No matches supplied, client error. */
+			return SR_ERR_ARG;
+		}
+		cs = &stl->stages[idx];
+		words = g_malloc0(6 * nwords * sizeof(uint64_t));
+		cs->level_mask = &words[0 * nwords];
+		cs->level_value = &words[1 * nwords];
+		cs->rise_mask = &words[2 * nwords];
+		cs->fall_mask = &words[3 * nwords];
+		cs->edge_mask = &words[4 * nwords];
+		cs->used_mask = &words[5 * nwords];
+		for (m = stage->matches; m; m = m->next) {
+			match = m->data;
+			if (!match->channel->enabled)
+				continue;
+			word = match->channel->index / 64;
+			if ((size_t)word >= nwords)
+				return SR_ERR_ARG;
+			bit = UINT64_C(1) << (match->channel->index % 64);
+			switch (match->match) {
+			case SR_TRIGGER_ONE:
+				cs->level_value[word] |= bit;
+				/* FALLTHROUGH */
+			case SR_TRIGGER_ZERO:
+				cs->level_mask[word] |= bit;
+				break;
+			case SR_TRIGGER_RISING:
+				cs->rise_mask[word] |= bit;
+				cs->has_edges = TRUE;
+				break;
+			case SR_TRIGGER_FALLING:
+				cs->fall_mask[word] |= bit;
+				cs->has_edges = TRUE;
+				break;
+			case SR_TRIGGER_EDGE:
+				cs->edge_mask[word] |= bit;
+				cs->has_edges = TRUE;
+				break;
+			default:
+				return SR_ERR_ARG;
+			}
+			cs->used_mask[word] |= bit;
+		}
+		compile_scan_mask(stl, cs);
+	}
+
+	return SR_OK;
+}
+
+static void free_stages(struct soft_trigger_logic *stl)
+{
+	size_t i;
+
+	if (!stl->stages)
+		return;
+	for (i = 0; i < stl->num_stages; i++)
+		g_free(stl->stages[i].level_mask);
+	g_free(stl->stages);
+	stl->stages = NULL;
+}
+
+#ifdef HAVE_MEMFD_CREATE
+/*
+ * Map the pages of an anonymous file twice in a row. Writes which run
+ * past the end of the first view land at the start of the buffer, and
+ * any capacity bytes starting within the first view are contiguous.
+ */
+static int history_map_mirrored(struct soft_trigger_history *h)
+{
+	long page;
+	size_t len;
+	uint8_t *base, *view;
+	int fd;
+
+	page = sysconf(_SC_PAGESIZE);
+	if (page <= 0)
+		return SR_ERR;
+	len = (h->size + page - 1) / page * page;
+
+	fd = memfd_create("sr-pre-trigger", MFD_CLOEXEC);
+	if (fd < 0)
+		return SR_ERR;
+	if (ftruncate(fd, len) < 0) {
+		close(fd);
+		return SR_ERR;
+	}
+
+	/* Reserve the address range of both views, then fill it. */
+	base = mmap(NULL, 2 * len, PROT_NONE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED) {
+		close(fd);
+		return SR_ERR;
+	}
+	view = mmap(base, len, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_FIXED, fd, 0);
+	if (view != MAP_FAILED)
+		view = mmap(base + len, len, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_FIXED, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED) {
+		munmap(base, 2 * len);
+		return SR_ERR;
+	}
+
+	h->buffer = base;
+	h->capacity = len;
+	h->mirrored = TRUE;
+
+	return SR_OK;
+}
+#endif
+
+static struct sr_context *history_ctx(const struct sr_dev_inst *sdi)
+{
+	return sdi->session ? sdi->session->ctx : NULL;
+}
+
+static int history_init(struct soft_trigger_history *h, size_t size,
+		struct sr_context *ctx)
+{
+	memset(h, 0, sizeof(*h));
+	h->ctx = ctx;
+	h->size = size;
+	if (!size)
+		return SR_OK;
+
+#ifdef HAVE_MEMFD_CREATE
+	/* Beyond the memory budget, the buffer gets backed by a file. */
+	if (sr_mem_reserve(ctx, LOG_PREFIX, size)) {
+		if (history_map_mirrored(h) == SR_OK)
+			return SR_OK;
+		sr_mem_release(ctx, LOG_PREFIX, size);
+	}
+	sr_dbg("No mirrored pre-trigger buffer, splitting packets.");
+#endif
+
+	h->buffer = sr_mem_alloc(ctx, LOG_PREFIX, size);
+	if (!h->buffer)
+		return SR_ERR_MALLOC;
+	h->capacity = size;
+
+	return SR_OK;
+}
+
+static void history_free(struct soft_trigger_history *h)
+{
+	if (!h->buffer)
+		return;
+#ifdef HAVE_MEMFD_CREATE
+	if (h->mirrored) {
+		munmap(h->buffer, 2 * h->capacity);
+		sr_mem_release(h->ctx, LOG_PREFIX, h->size);
+		h->buffer = NULL;
+		return;
+	}
+#endif
+	sr_mem_free(h->ctx, h->buffer);
+	h->buffer = NULL;
+}
+
+static struct soft_trigger_logic *logic_new(const struct sr_dev_inst *sdi,
+		struct sr_trigger *trigger, int unitsize, int pre_trigger_samples)
 {
 	struct soft_trigger_logic *stl;
 
 	stl = g_malloc0(sizeof(struct soft_trigger_logic));
 	stl->sdi = sdi;
 	stl->trigger = trigger;
-	stl->unitsize = logic_channel_unitsize(sdi->channels);
+	stl->unitsize = unitsize;
 	stl->prev_sample = g_malloc0(stl->unitsize);
-	stl->pre_trigger_size = stl->unitsize * pre_trigger_samples;
-	stl->pre_trigger_buffer = g_try_malloc(stl->pre_trigger_size);
-	if (pre_trigger_samples > 0 && !stl->pre_trigger_buffer) {
-		/*
-		 * Error out if g_try_malloc() failed (or was invoked as
-		 * g_try_malloc(0)) *and* more than 0 pretrigger samples
-		 * were requested.
-		 */
+
+	if (history_init(&stl->pre_trigger,
+			(size_t)MAX(pre_trigger_samples, 0) * stl->unitsize,
+			history_ctx(sdi)) != SR_OK) {
 		soft_trigger_logic_free(stl);
 		return NULL;
 	}
-	stl->pre_trigger_head = stl->pre_trigger_buffer;
 
-	if (stl->pre_trigger_size > 0 && !stl->pre_trigger_buffer) {
+	if (!trigger || compile_stages(stl) != SR_OK) {
+		sr_err("Cannot use soft trigger, invalid trigger stages.");
 		soft_trigger_logic_free(stl);
 		return NULL;
 	}
@@ -73,150 +305,341 @@ SR_PRIV struct soft_trigger_logic *soft_trigger_logic_new(
 	return stl;
 }
 
+SR_PRIV struct soft_trigger_logic *soft_trigger_logic_new(
+		const struct sr_dev_inst *sdi, struct sr_trigger *trigger,
+		int pre_trigger_samples)
+{
+	return logic_new(sdi, trigger, logic_channel_unitsize(sdi->channels),
+		pre_trigger_samples);
+}
+
+/*
+ * Create a soft trigger for the stages which the hardware cannot take,
+ * see soft_trigger_hw_stages(). Drivers locate the trigger in the data
+ * with soft_trigger_logic_scan(), samples are unitsize bytes each.
+ */
+SR_PRIV struct soft_trigger_logic *soft_trigger_logic_new_split(
+		const struct sr_dev_inst *sdi, struct sr_trigger *trigger,
+		int unitsize)
+{
+	return logic_new(sdi, trigger, unitsize, 0);
+}
+
 SR_PRIV void soft_trigger_logic_free(struct soft_trigger_logic *stl)
 {
-	g_free(stl->pre_trigger_buffer);
+	if (!stl)
+		return;
+
+	free_stages(stl);
+	history_free(&stl->pre_trigger);
 	g_free(stl->prev_sample);
 	g_free(stl);
 }
 
-static void pre_trigger_append(struct soft_trigger_logic *stl,
-		uint8_t *buf, int len)
+static void history_append(struct soft_trigger_history *h,
+		const uint8_t *buf, size_t len)
 {
+	size_t size;
+
 	/* Avoid uselessly copying more than the pre-trigger size. */
-	if (len > stl->pre_trigger_size) {
-		buf += len - stl->pre_trigger_size;
-		len = stl->pre_trigger_size;
+	if (len > h->size) {
+		buf += len - h->size;
+		len = h->size;
 	}
+	if (!len)
+		return;
 
-	/* Update the filling level of the pre-trigger circular buffer. */
-	stl->pre_trigger_fill = MIN(stl->pre_trigger_fill + len,
-	                            stl->pre_trigger_size);
+	h->fill = MIN(h->fill + len, h->size);
+
+	if (h->mirrored) {
+		/* The second view takes what runs past the first one. */
+		memcpy(h->buffer + h->head, buf, len);
+		h->head = (h->head + len) % h->capacity;
+		return;
+	}
 
-	/* Actually copy data to the pre-trigger circular buffer. */
 	while (len > 0) {
-		size_t size = MIN(stl->pre_trigger_buffer + stl->pre_trigger_size
-		                  - stl->pre_trigger_head, len);
-		memcpy(stl->pre_trigger_head, buf, size);
-		stl->pre_trigger_head += size;
-		if (stl->pre_trigger_head >= stl->pre_trigger_buffer
-		                             + stl->pre_trigger_size)
-			stl->pre_trigger_head = stl->pre_trigger_buffer;
+		size = MIN(h->capacity - h->head, len);
+		memcpy(h->buffer + h->head, buf, size);
+		h->head = (h->head + size) % h->capacity;
 		buf += size;
 		len -= size;
 	}
 }
 
-static void pre_trigger_send(struct soft_trigger_logic *stl,
-		int *pre_trigger_samples)
+/*
+ * Take the oldest contiguous chunk of the history. Returns its size in
+ * bytes, 0 when the history is empty. A mirrored buffer needs only one.
+ */
+static size_t history_take(struct soft_trigger_history *h,
+		const uint8_t **data)
+{
+	size_t start, size;
+
+	if (!h->fill)
+		return 0;
+
+	start = (h->head + h->capacity - h->fill) % h->capacity;
+	size = h->mirrored ? h->fill : MIN(h->capacity - start, h->fill);
+	*data = h->buffer + start;
+	h->fill -= size;
+
+	return size;
+}
+
+/*
+ * Send the pre-trigger samples, which end with the len bytes at buf.
+ * When these hold all of the pre-trigger size, they get sent from where
+ * they are, without a copy into the history. The last chunk carries the
+ * trigger after its samples. Returns the number of bytes sent.
+ */
+static size_t history_send(struct soft_trigger_history *h,
+		const uint8_t *buf, size_t len,
+		void (*send)(void *cb_data, const uint8_t *data, size_t size,
+			gboolean last),
+		void *cb_data)
+{
+	const uint8_t *data, *prev;
+	size_t size, prev_size, sent;
+
+	if (len >= h->size) {
+		h->fill = 0;
+		if (h->size)
+			send(cb_data, buf + len - h->size, h->size, TRUE);
+		return h->size;
+	}
+
+	history_append(h, buf, len);
+	sent = 0;
+	prev = NULL;
+	prev_size = 0;
+	/* Taken chunks stay valid, nothing gets appended meanwhile. */
+	while ((size = history_take(h, &data))) {
+		if (prev_size)
+			send(cb_data, prev, prev_size, FALSE);
+		prev = data;
+		prev_size = size;
+		sent += size;
+	}
+	if (prev_size)
+		send(cb_data, prev, prev_size, TRUE);
+
+	return sent;
+}
+
+static void send_logic(void *cb_data, const uint8_t *data, size_t size,
+		gboolean last)
 {
+	struct soft_trigger_logic *stl;
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
 
+	stl = cb_data;
 	packet.type = SR_DF_LOGIC;
 	packet.payload = &logic;
 	logic.unitsize = stl->unitsize;
+	logic.length = size;
+	logic.data = (uint8_t *)data;
+	if (last)
+		sr_session_send_triggered(stl->sdi, &packet,
+			size / stl->unitsize, NULL, NULL);
+	else
+		sr_session_send(stl->sdi, &packet);
+}
 
+static size_t pre_trigger_send(struct soft_trigger_logic *stl,
+		const uint8_t *buf, int len, int *pre_trigger_samples)
+{
+	size_t sent;
+
+	sent = history_send(&stl->pre_trigger, buf, len, send_logic, stl);
 	if (pre_trigger_samples)
-		*pre_trigger_samples = 0;
-
-	/* If pre-trigger buffer not full, rewind head to the first valid sample. */
-	if (stl->pre_trigger_fill < stl->pre_trigger_size)
-		stl->pre_trigger_head = stl->pre_trigger_buffer;
-
-	/* Send logic packets for the pre-trigger circular buffer content. */
-	while (stl->pre_trigger_fill > 0) {
-		size_t size = MIN(stl->pre_trigger_buffer + stl->pre_trigger_size
-		                  - stl->pre_trigger_head, stl->pre_trigger_fill);
-		logic.length = size;
-		logic.data = stl->pre_trigger_head;
-		sr_session_send(stl->sdi, &packet);
-		stl->pre_trigger_head = stl->pre_trigger_buffer;
-		stl->pre_trigger_fill -= size;
-		if (pre_trigger_samples)
-			*pre_trigger_samples += size / stl->unitsize;
-	}
-}
-
-static gboolean logic_check_match(struct soft_trigger_logic *stl,
-		uint8_t *sample, struct sr_trigger_match *match)
-{
-	int bit, prev_bit;
-	gboolean result;
-
-	stl->count++;
-	result = FALSE;
-	bit = *(sample + match->channel->index / 8)
-			& (1 << (match->channel->index % 8));
-	if (match->match == SR_TRIGGER_ZERO)
-		result = bit == 0;
-	else if (match->match == SR_TRIGGER_ONE)
-		result = bit != 0;
-	else {
-		/* Edge matches. */
-		if (stl->count == 1)
-			/* First sample, don't have enough for an edge match yet. */
+		*pre_trigger_samples = sent / stl->unitsize;
+
+	return sent;
+}
+
+/* Get one (possibly partial) 64bit word of a sample, little endian. */
+static inline uint64_t sample_word(const uint8_t *sample, int len)
+{
+	uint64_t w;
+
+	switch (len) {
+	case 1:
+		return sample[0];
+	case 2:
+		return read_u16le(sample);
+	case 4:
+		return read_u32le(sample);
+	default:
+		break;
+	}
+	if (len >= 8)
+		return read_u64le(sample);
+	w = 0;
+	while (len--)
+		w = (w << 8) | sample[len];
+
+	return w;
+}
+
+static gboolean stage_check_match(const struct soft_trigger_logic *stl,
+		const struct soft_trigger_stage *cs,
+		const uint8_t *sample, const uint8_t *prev)
+{
+	uint64_t cur, old, changed;
+	size_t w;
+	int len;
+
+	/* First sample, don't have enough for an edge match yet. */
+	if (cs->has_edges && !prev)
+		return FALSE;
+
+	for (w = 0; w < stl->num_words; w++) {
+		len = MIN(8, stl->unitsize - 8 * (int)w);
+		cur = sample_word(&sample[8 * w], len);
+		if ((cur ^ cs->level_value[w]) & cs->level_mask[w])
+			return FALSE;
+		if (!cs->has_edges)
+			continue;
+		old = sample_word(&prev[8 * w], len);
+		changed = cur ^ old;
+		if (cs->rise_mask[w] & ~(changed & cur))
+			return FALSE;
+		if (cs->fall_mask[w] & ~(changed & old))
+			return FALSE;
+		if (cs->edge_mask[w] & ~changed)
 			return FALSE;
-		prev_bit = *(stl->prev_sample + match->channel->index / 8)
-				& (1 << (match->channel->index % 8));
-		if (match->match == SR_TRIGGER_RISING)
-			result = prev_bit == 0 && bit != 0;
-		else if (match->match == SR_TRIGGER_FALLING)
-			result = prev_bit != 0 && bit == 0;
-		else if (match->match == SR_TRIGGER_EDGE)
-			result = prev_bit != bit;
 	}
 
-	return result;
+	return TRUE;
 }
 
-/* Returns the offset (in samples) within buf of where the trigger
- * occurred, or -1 if not triggered. */
-SR_PRIV int soft_trigger_logic_check(struct soft_trigger_logic *stl,
-		uint8_t *buf, int len, int *pre_trigger_samples)
+#ifdef __SSE2__
+/*
+ * Find the first sample at or after offset i which has the levels of a
+ * stage without edge conditions, comparing 16 bytes of samples at a
+ * time. For unit sizes of 1, 2 and 4 bytes only. Returns the offset of
+ * the first sample that matches, or of the first one which didn't fit
+ * into a complete block, so the caller checks the samples from there.
+ */
+static int stage_find_levels(const struct soft_trigger_logic *stl,
+		const struct soft_trigger_stage *cs,
+		const uint8_t *buf, int i, int len)
 {
-	struct sr_trigger_stage *stage;
-	struct sr_trigger_match *match;
-	GSList *l, *l_stage;
-	int offset;
-	int i;
-	gboolean match_found;
+	__m128i mask, value, x;
+	int hits;
 
-	offset = -1;
-	for (i = 0; i < len; i += stl->unitsize) {
-		l_stage = g_slist_nth(stl->trigger->stages, stl->cur_stage);
-		stage = l_stage->data;
-		if (!stage->matches)
-			/* No matches supplied, client error. */
-			return SR_ERR_ARG;
+	mask = _mm_set1_epi64x(cs->scan_level_mask);
+	value = _mm_set1_epi64x(cs->scan_level_value);
+	for (; i + 16 <= len; i += 16) {
+		x = _mm_and_si128(_mm_loadu_si128((const __m128i *)&buf[i]),
+			mask);
+		if (stl->unitsize == 1)
+			x = _mm_cmpeq_epi8(x, value);
+		else if (stl->unitsize == 2)
+			x = _mm_cmpeq_epi16(x, value);
+		else
+			x = _mm_cmpeq_epi32(x, value);
+		/* All bytes of a matching sample are set, take the first. */
+		if ((hits = _mm_movemask_epi8(x)))
+			return i + g_bit_nth_lsf(hits, -1);
+	}
 
-		match_found = TRUE;
-		for (l = stage->matches; l; l = l->next) {
-			match = l->data;
-			if (!match->channel->enabled)
-				/* Ignore disabled channels with a trigger. */
-				continue;
-			if (!logic_check_match(stl, buf + i, match)) {
-				match_found = FALSE;
+	return i;
+}
+#endif
+
+/*
+ * Find the first sample after the one at offset i, where any of the
+ * channels used by the stage differs from its predecessor. A sample
+ * which didn't match a stage can't be followed by a matching sample
+ * until then: levels are the same, and there are no edges. Runs of
+ * idle samples get skipped 128 bits (with SSE2) or 64 bits at a time
+ * where the unit size allows it. Returns len if there is no such sample
+ * in the buffer.
+ */
+static int stage_skip_idle(const struct soft_trigger_logic *stl,
+		const struct soft_trigger_stage *cs,
+		const uint8_t *buf, int i, int len)
+{
+	uint64_t cur, prev;
+	size_t w;
+	int wlen;
+#ifdef __SSE2__
+	__m128i mask, x;
+#endif
+
+	i += stl->unitsize;
+#ifdef __SSE2__
+	if (cs->scan_mask) {
+		mask = _mm_set1_epi64x(cs->scan_mask);
+		while (i + 16 <= len) {
+			x = _mm_xor_si128(
+				_mm_loadu_si128((const __m128i *)&buf[i]),
+				_mm_loadu_si128((const __m128i *)
+					&buf[i - stl->unitsize]));
+			x = _mm_cmpeq_epi8(_mm_and_si128(x, mask),
+				_mm_setzero_si128());
+			if (_mm_movemask_epi8(x) != 0xffff)
 				break;
-			}
+			i += 16;
+		}
+	}
+#endif
+	if (cs->scan_mask) {
+		while (i + (int)sizeof(uint64_t) <= len) {
+			memcpy(&cur, &buf[i], sizeof(cur));
+			memcpy(&prev, &buf[i - stl->unitsize], sizeof(prev));
+			if ((cur ^ prev) & cs->scan_mask)
+				break;
+			i += sizeof(uint64_t);
 		}
-		memcpy(stl->prev_sample, buf + i, stl->unitsize);
-		if (match_found) {
+	}
+
+	for (; i < len; i += stl->unitsize) {
+		for (w = 0; w < stl->num_words; w++) {
+			wlen = MIN(8, stl->unitsize - 8 * (int)w);
+			cur = sample_word(&buf[i + 8 * w], wlen);
+			prev = sample_word(&buf[i - stl->unitsize + 8 * w], wlen);
+			if ((cur ^ prev) & cs->used_mask[w])
+				return i;
+		}
+	}
+
+	return len;
+}
+
+/*
+ * Run the stages over the samples in buf. Returns the byte offset of
+ * the sample which matched the last stage, or -1 when the stages did
+ * not complete within buf.
+ */
+static int stages_scan(struct soft_trigger_logic *stl,
+		const uint8_t *buf, int len)
+{
+	const uint8_t *prev;
+	int i;
+
+	for (i = 0; i < len; i += stl->unitsize) {
+		/*
+		 * The previous sample is in the buffer, except for the first
+		 * sample of a buffer, which refers to the previous buffer.
+		 */
+		if (i >= stl->unitsize)
+			prev = &buf[i - stl->unitsize];
+		else
+			prev = stl->have_prev ? stl->prev_sample : NULL;
+
+		if (stage_check_match(stl, &stl->stages[stl->cur_stage],
+				&buf[i], prev)) {
 			/* Matched on the current stage. */
-			if (l_stage->next) {
+			if ((size_t)stl->cur_stage + 1 < stl->num_stages) {
 				/* Advance to next stage. */
 				stl->cur_stage++;
 			} else {
-				/* Matched on last stage, send pre-trigger data. */
-				pre_trigger_append(stl, buf, i);
-				pre_trigger_send(stl, pre_trigger_samples);
-
-				/* Fire trigger. */
-				offset = i / stl->unitsize;
-
-				std_session_send_df_trigger(stl->sdi);
-				break;
+				/* Matched on last stage. */
+				return i;
 			}
 		} else if (stl->cur_stage > 0) {
 			/*
@@ -229,15 +652,388 @@ SR_PRIV int soft_trigger_logic_check(struct soft_trigger_logic *stl,
 			 * takes care of.
 			 */
 			i -= stl->cur_stage * stl->unitsize;
-			if (i < -1)
-				i = -1; /* Oops, went back past this buffer. */
+			if (i < -stl->unitsize)
+				i = -stl->unitsize; /* Oops, went back past this buffer. */
 			/* Reset trigger stage. */
 			stl->cur_stage = 0;
+		} else {
+			/*
+			 * No partial match, fast forward to the next sample
+			 * that could possibly match the first stage.
+			 */
+#ifdef __SSE2__
+			if (!stl->stages[0].has_edges && stl->unitsize <= 4 &&
+					stl->unitsize != 3) {
+				i = stage_find_levels(stl, &stl->stages[0],
+					buf, i + stl->unitsize, len);
+				i -= stl->unitsize;
+				continue;
+			}
+#endif
+			i = stage_skip_idle(stl, &stl->stages[0], buf, i, len);
+			i -= stl->unitsize;
 		}
 	}
 
-	if (offset == -1)
-		pre_trigger_append(stl, buf, len);
+	return -1;
+}
+
+/* Returns the offset (in samples) within buf of where the trigger
+ * occurred, or -1 if not triggered. */
+SR_PRIV int soft_trigger_logic_check(struct soft_trigger_logic *stl,
+		uint8_t *buf, int len, int *pre_trigger_samples)
+{
+	size_t sent;
+	int offset;
+	int i;
+
+	if (!stl->num_stages)
+		return SR_ERR_ARG;
+
+	offset = -1;
+	i = stages_scan(stl, buf, len);
+	if (i >= 0) {
+		/* Send pre-trigger data, the trigger goes with it. */
+		sent = pre_trigger_send(stl, buf, i, pre_trigger_samples);
+
+		/* Fire trigger. */
+		offset = i / stl->unitsize;
+		memcpy(stl->prev_sample, &buf[i], stl->unitsize);
+		stl->have_prev = TRUE;
+
+		if (!sent)
+			std_session_send_df_trigger(stl->sdi);
+	} else {
+		if (len >= stl->unitsize) {
+			memcpy(stl->prev_sample, &buf[len - stl->unitsize],
+				stl->unitsize);
+			stl->have_prev = TRUE;
+		}
+		history_append(&stl->pre_trigger, buf, len);
+	}
 
 	return offset;
 }
+
+/*
+ * Like soft_trigger_logic_check(), but only locate the trigger. Nothing
+ * gets sent or kept for pre-trigger data, for drivers which send their
+ * sample data themselves, and the stages start over after they fired.
+ */
+SR_PRIV int soft_trigger_logic_scan(struct soft_trigger_logic *stl,
+		const uint8_t *buf, int len)
+{
+	int i;
+
+	if (!stl->num_stages)
+		return SR_ERR_ARG;
+
+	i = stages_scan(stl, buf, len);
+	if (i >= 0) {
+		memcpy(stl->prev_sample, &buf[i], stl->unitsize);
+		stl->cur_stage = 0;
+	} else if (len >= stl->unitsize) {
+		memcpy(stl->prev_sample, &buf[len - stl->unitsize],
+			stl->unitsize);
+	}
+	if (len >= stl->unitsize)
+		stl->have_prev = TRUE;
+
+	return i >= 0 ? i / stl->unitsize : -1;
+}
+
+/*
+ * Hardware triggers often support fewer stages or match types than
+ * sr_trigger can express. Such a trigger gets split: the hardware takes
+ * the leading stages it can express, and when it fired, the soft trigger
+ * continues with the remaining stages. Nothing needs to be checked in
+ * software while waiting for the hardware.
+ *
+ * Returns the number of leading stages which the hardware can take.
+ */
+SR_PRIV int soft_trigger_hw_stages(const struct sr_trigger *trigger,
+		const struct soft_trigger_hw_caps *caps)
+{
+	const struct sr_trigger_stage *stage;
+	const struct sr_trigger_match *match;
+	const GSList *l, *m;
+	int num, edges;
+
+	if (!trigger || !caps)
+		return 0;
+
+	num = 0;
+	for (l = trigger->stages; l && num < caps->max_stages; l = l->next) {
+		stage = l->data;
+		edges = 0;
+		for (m = stage->matches; m; m = m->next) {
+			match = m->data;
+			if (!match->channel->enabled)
+				continue;
+			if (!(caps->matches & SOFT_TRIGGER_MATCH(match->match)))
+				return num;
+			if (match->match == SR_TRIGGER_RISING ||
+					match->match == SR_TRIGGER_FALLING ||
+					match->match == SR_TRIGGER_EDGE)
+				edges++;
+		}
+		if (caps->max_edges >= 0 && edges > caps->max_edges)
+			return num;
+		num++;
+	}
+
+	return num;
+}
+
+/*
+ * The hardware matched the first hw_stages stages of the trigger, the
+ * last of them on the given sample. The soft trigger continues with the
+ * next stage on the sample after it.
+ */
+SR_PRIV void soft_trigger_logic_hw_fired(struct soft_trigger_logic *stl,
+		const uint8_t *sample, int hw_stages)
+{
+	if (hw_stages <= 0 || (size_t)hw_stages >= stl->num_stages) {
+		stl->cur_stage = 0;
+		return;
+	}
+
+	memcpy(stl->prev_sample, sample, stl->unitsize);
+	stl->have_prev = TRUE;
+	stl->cur_stage = hw_stages;
+}
+
+/*
+ * Analog triggers fire on the first sample which crossed the level in
+ * the direction of the match, after the signal was on the other side of
+ * the level by at least the hysteresis. Noise around the level can't
+ * fire the trigger, and neither can a signal which starts beyond it.
+ *
+ * The comparison happens on the samples as they are encoded, the levels
+ * get converted to that encoding instead. Blocks of samples are compared
+ * without branches, which compilers turn into vector instructions.
+ */
+
+/** @cond PRIVATE */
+#define ANALOG_SCAN_BLOCK 16
+
+#define ANALOG_FIND(name, type, op) \
+	static size_t name(const void *data, size_t i, size_t num, \
+			float level) \
+	{ \
+		const type *v; \
+		size_t j; \
+		int hit; \
+		\
+		v = data; \
+		for (; i + ANALOG_SCAN_BLOCK <= num; i += ANALOG_SCAN_BLOCK) { \
+			hit = 0; \
+			for (j = 0; j < ANALOG_SCAN_BLOCK; j++) \
+				hit |= v[i + j] op level; \
+			if (hit) \
+				break; \
+		} \
+		for (; i < num; i++) \
+			if (v[i] op level) \
+				break; \
+		\
+		return i; \
+	}
+/** @endcond */
+
+ANALOG_FIND(find_above_float, float, >)
+ANALOG_FIND(find_below_float, float, <)
+ANALOG_FIND(find_above_u8, uint8_t, >)
+ANALOG_FIND(find_below_u8, uint8_t, <)
+ANALOG_FIND(find_above_s8, int8_t, >)
+ANALOG_FIND(find_below_s8, int8_t, <)
+ANALOG_FIND(find_above_u16, uint16_t, >)
+ANALOG_FIND(find_below_u16, uint16_t, <)
+ANALOG_FIND(find_above_s16, int16_t, >)
+ANALOG_FIND(find_below_s16, int16_t, <)
+
+/* Find the first sample at or after i which is above/below the level. */
+struct analog_scan {
+	uint8_t unitsize;
+	gboolean is_float;
+	gboolean is_signed;
+	size_t (*above)(const void *data, size_t i, size_t num, float level);
+	size_t (*below)(const void *data, size_t i, size_t num, float level);
+};
+
+static const struct analog_scan analog_scans[] = {
+	{ sizeof(float), TRUE, TRUE, find_above_float, find_below_float },
+	{ 1, FALSE, FALSE, find_above_u8, find_below_u8 },
+	{ 1, FALSE, TRUE, find_above_s8, find_below_s8 },
+	{ 2, FALSE, FALSE, find_above_u16, find_below_u16 },
+	{ 2, FALSE, TRUE, find_above_s16, find_below_s16 },
+};
+
+static const struct analog_scan *analog_scan_get(
+		const struct sr_analog_encoding *encoding)
+{
+	const struct analog_scan *scan;
+	size_t i;
+
+	if (encoding->unitsize > 1 &&
+			encoding->is_bigendian != (G_BYTE_ORDER == G_BIG_ENDIAN))
+		return NULL;
+
+	for (i = 0; i < ARRAY_SIZE(analog_scans); i++) {
+		scan = &analog_scans[i];
+		if (scan->unitsize != encoding->unitsize)
+			continue;
+		if (scan->is_float != encoding->is_float)
+			continue;
+		if (!scan->is_float && scan->is_signed != encoding->is_signed)
+			continue;
+		return scan;
+	}
+
+	return NULL;
+}
+
+SR_PRIV struct soft_trigger_analog *soft_trigger_analog_new(
+		const struct sr_dev_inst *sdi, struct sr_trigger *trigger,
+		int pre_trigger_samples, float hysteresis)
+{
+	struct soft_trigger_analog *sta;
+	struct sr_trigger_stage *stage;
+	struct sr_trigger_match *match;
+
+	if (!trigger || g_slist_length(trigger->stages) != 1) {
+		sr_err("Analog soft triggers need exactly one stage.");
+		return NULL;
+	}
+	stage = trigger->stages->data;
+	if (g_slist_length(stage->matches) != 1) {
+		sr_err("Analog soft triggers need exactly one match.");
+		return NULL;
+	}
+	match = stage->matches->data;
+	if (match->channel->type != SR_CHANNEL_ANALOG ||
+			!match->channel->enabled ||
+			(match->match != SR_TRIGGER_OVER &&
+			match->match != SR_TRIGGER_UNDER)) {
+		sr_err("Cannot use soft trigger, invalid analog match.");
+		return NULL;
+	}
+
+	sta = g_malloc0(sizeof(struct soft_trigger_analog));
+	sta->sdi = sdi;
+	sta->channel = match->channel;
+	sta->match = match->match;
+	sta->level = match->value;
+	hysteresis = fabsf(hysteresis);
+	if (match->match == SR_TRIGGER_OVER)
+		sta->arm_level = match->value - hysteresis;
+	else
+		sta->arm_level = match->value + hysteresis;
+	sta->pre_trigger_samples = MAX(pre_trigger_samples, 0);
+
+	return sta;
+}
+
+SR_PRIV void soft_trigger_analog_free(struct soft_trigger_analog *sta)
+{
+	history_free(&sta->pre_trigger);
+	g_free(sta);
+}
+
+struct analog_send {
+	const struct soft_trigger_analog *sta;
+	struct sr_datafeed_analog analog;
+};
+
+static void send_analog(void *cb_data, const uint8_t *data, size_t size,
+		gboolean last)
+{
+	struct analog_send *as;
+	struct sr_datafeed_packet packet;
+
+	as = cb_data;
+	as->analog.data = (void *)data;
+	as->analog.num_samples = size / as->sta->unitsize;
+	packet.type = SR_DF_ANALOG;
+	packet.payload = &as->analog;
+	if (last)
+		sr_session_send_triggered(as->sta->sdi, &packet,
+			as->analog.num_samples, NULL, NULL);
+	else
+		sr_session_send(as->sta->sdi, &packet);
+}
+
+/*
+ * Check a packet of the trigger channel. Pre-trigger packets take the
+ * encoding and meaning of this packet. Returns the offset (in samples)
+ * within the packet where the trigger occurred, or -1 if not triggered.
+ */
+SR_PRIV int soft_trigger_analog_check(struct soft_trigger_analog *sta,
+		const struct sr_datafeed_analog *analog, int *pre_trigger_samples)
+{
+	const struct sr_analog_encoding *encoding;
+	const struct analog_scan *scan;
+	struct analog_send as;
+	double scale, offset;
+	float level, arm_level;
+	gboolean rising;
+	size_t i, num, sent;
+
+	encoding = analog->encoding;
+	scan = analog_scan_get(encoding);
+	if (!scan || !encoding->scale.p || !encoding->scale.q ||
+			!encoding->offset.q)
+		return SR_ERR_ARG;
+
+	if (!sta->unitsize) {
+		if (history_init(&sta->pre_trigger,
+				(size_t)sta->pre_trigger_samples * scan->unitsize,
+				history_ctx(sta->sdi)) != SR_OK)
+			return SR_ERR_MALLOC;
+		sta->unitsize = scan->unitsize;
+	} else if (sta->unitsize != scan->unitsize) {
+		return SR_ERR_ARG;
+	}
+
+	/* Move the levels into the samples' encoding. */
+	scale = (double)encoding->scale.p / encoding->scale.q;
+	offset = (double)encoding->offset.p / encoding->offset.q;
+	level = (sta->level - offset) / scale;
+	arm_level = (sta->arm_level - offset) / scale;
+	rising = (sta->match == SR_TRIGGER_OVER) == (scale > 0);
+
+	num = analog->num_samples;
+	i = 0;
+	if (!sta->armed) {
+		if (rising)
+			i = scan->below(analog->data, i, num, arm_level);
+		else
+			i = scan->above(analog->data, i, num, arm_level);
+		sta->armed = i < num;
+	}
+	if (sta->armed) {
+		if (rising)
+			i = scan->above(analog->data, i, num, level);
+		else
+			i = scan->below(analog->data, i, num, level);
+	}
+
+	if (i >= num) {
+		history_append(&sta->pre_trigger, analog->data,
+			num * sta->unitsize);
+		return -1;
+	}
+
+	as.sta = sta;
+	as.analog = *analog;
+	sent = history_send(&sta->pre_trigger, analog->data,
+		i * sta->unitsize, send_analog, &as);
+	if (pre_trigger_samples)
+		*pre_trigger_samples = sent / sta->unitsize;
+
+	/* Without pre-trigger samples, nothing carried the trigger. */
+	if (!sent)
+		std_session_send_df_trigger(sta->sdi);
+
+	return i;
+}
@@ -65,6 +65,7 @@ SR_PRIV int std_init(struct sr_dev_driver *di, struct sr_context *sr_ctx)
 	drvc = g_malloc0(sizeof(struct drv_context));
 	drvc->sr_ctx = sr_ctx;
 	drvc->instances = NULL;
+	g_mutex_init(&drvc->instances_mutex);
 	di->context = drvc;
 
 	return SR_OK;
@@ -94,6 +95,7 @@ SR_PRIV int std_cleanup(const struct sr_dev_driver *di)
 	}
 
 	ret = sr_dev_clear(di);
+	g_mutex_clear(&((struct drv_context *)di->context)->instances_mutex);
 	g_free(di->context);
 
 	return ret;
@@ -249,6 +251,8 @@ SR_PRIV int std_session_send_df_end(const struct sr_dev_inst *sdi)
  */
 SR_PRIV int std_session_send_df_trigger(const struct sr_dev_inst *sdi)
 {
+	SR_PROBE1(trigger, sdi);
+
 	return send_df_without_payload(sdi, SR_DF_TRIGGER);
 }
 
@@ -407,7 +411,7 @@ SR_PRIV int std_dev_clear_with_callback(const struct sr_dev_driver *driver,
 {
 	struct drv_context *drvc;
 	struct sr_dev_inst *sdi;
-	GSList *l;
+	GSList *instances, *l;
 	int ret;
 
 	if (!driver) {
@@ -417,14 +421,21 @@ SR_PRIV int std_dev_clear_with_callback(const struct sr_dev_driver *driver,
 
 	drvc = driver->context; /* Caller checked for context != NULL. */
 
+	/* Take the list, so that a concurrent scan starts a new one. */
+	g_mutex_lock(&drvc->instances_mutex);
+	instances = drvc->instances;
+	drvc->instances = NULL;
+	g_mutex_unlock(&drvc->instances_mutex);
+
 	ret = SR_OK;
-	for (l = drvc->instances; l; l = l->next) {
+	for (l = instances; l; l = l->next) {
 		if (!(sdi = l->data)) {
 			sr_err("%s: Invalid device instance.", __func__);
 			ret = SR_ERR_BUG;
 			continue;
 		}
-		if (driver->dev_close && sdi->status == SR_ST_ACTIVE)
+		if (driver->dev_close && (sdi->status == SR_ST_ACTIVE ||
+				sdi->parked))
 			driver->dev_close(sdi);
 
 		if (sdi->conn) {
@@ -452,8 +463,7 @@ SR_PRIV int std_dev_clear_with_callback(const struct sr_dev_driver *driver,
 		sr_dev_inst_free(sdi);
 	}
 
-	g_slist_free(drvc->instances);
-	drvc->instances = NULL;
+	g_slist_free(instances);
 
 	return ret;
 }
@@ -544,7 +554,9 @@ SR_PRIV GSList *std_scan_complete(struct sr_dev_driver *di, GSList *devices)
 		sdi->driver = di;
 	}
 
+	g_mutex_lock(&drvc->instances_mutex);
 	drvc->instances = g_slist_concat(drvc->instances, g_slist_copy(devices));
+	g_mutex_unlock(&drvc->instances_mutex);
 
 	return devices;
 }
@@ -592,7 +604,129 @@ SR_PRIV int std_opts_config_list(uint32_t key, GVariant **data,
 	return SR_OK;
 }
 
-SR_PRIV GVariant *std_gvar_tuple_array(const uint64_t a[][2], unsigned int n)
+/*
+ * Cache of GVariants which take many allocations to build, like long
+ * lists of tuples. Drivers build these from the same tables on every
+ * config_list() call. The cache key is a copy of the table contents
+ * (not its address, tables can be on the heap), so a lookup only costs
+ * hashing a few hundred bytes.
+ */
+enum gvar_kind {
+	GVAR_TUPLE_ARRAY,
+	GVAR_TUPLE_RATIONAL,
+	GVAR_THRESHOLDS,
+	GVAR_MIN_MAX_STEP_THRESHOLDS,
+};
+
+/* Limit the size of the cache, in case of ever changing tables. */
+#define GVAR_CACHE_MAX_ENTRIES	256
+
+struct gvar_cache_key {
+	enum gvar_kind kind;
+	gsize size;
+	const uint8_t *data;
+};
+
+static GMutex gvar_cache_mutex;
+static GHashTable *gvar_cache;
+
+static guint gvar_cache_key_hash(gconstpointer key)
+{
+	const struct gvar_cache_key *k;
+	guint hash;
+	gsize i;
+
+	k = key;
+	hash = 5381 + k->kind;
+	for (i = 0; i < k->size; i++)
+		hash = hash * 33 + k->data[i];
+
+	return hash;
+}
+
+static gboolean gvar_cache_key_equal(gconstpointer a, gconstpointer b)
+{
+	const struct gvar_cache_key *ka, *kb;
+
+	ka = a;
+	kb = b;
+
+	return ka->kind == kb->kind && ka->size == kb->size &&
+		!memcmp(ka->data, kb->data, ka->size);
+}
+
+static void gvar_cache_key_free(gpointer key)
+{
+	struct gvar_cache_key *k;
+
+	k = key;
+	g_free((uint8_t *)k->data);
+	g_free(k);
+}
+
+/* A new floating GVariant which shares the cached one's data. */
+static GVariant *gvar_cache_copy(GVariant *cached)
+{
+	return g_variant_new_from_data(g_variant_get_type(cached),
+		g_variant_get_data(cached), g_variant_get_size(cached), TRUE,
+		(GDestroyNotify)g_variant_unref, g_variant_ref(cached));
+}
+
+static GVariant *gvar_cache_lookup(enum gvar_kind kind,
+		const void *data, gsize size)
+{
+	struct gvar_cache_key key;
+	GVariant *cached, *gvar;
+
+	key.kind = kind;
+	key.size = size;
+	key.data = data;
+
+	g_mutex_lock(&gvar_cache_mutex);
+	cached = gvar_cache ? g_hash_table_lookup(gvar_cache, &key) : NULL;
+	if (cached)
+		g_variant_ref(cached);
+	g_mutex_unlock(&gvar_cache_mutex);
+
+	if (!cached)
+		return NULL;
+	gvar = gvar_cache_copy(cached);
+	g_variant_unref(cached);
+
+	return gvar;
+}
+
+/* Cache a newly built GVariant, and return a copy of it. */
+static GVariant *gvar_cache_store(enum gvar_kind kind,
+		const void *data, gsize size, GVariant *gvar)
+{
+	struct gvar_cache_key *key;
+	GVariant *copy;
+
+	g_variant_ref_sink(gvar);
+	copy = gvar_cache_copy(gvar);
+
+	g_mutex_lock(&gvar_cache_mutex);
+	if (!gvar_cache)
+		gvar_cache = g_hash_table_new_full(gvar_cache_key_hash,
+			gvar_cache_key_equal, gvar_cache_key_free,
+			(GDestroyNotify)g_variant_unref);
+	if (g_hash_table_size(gvar_cache) < GVAR_CACHE_MAX_ENTRIES) {
+		key = g_malloc(sizeof(*key));
+		key->kind = kind;
+		key->size = size;
+		key->data = g_memdup(data, size);
+		/* Another thread may have stored the same value meanwhile. */
+		g_hash_table_replace(gvar_cache, key, g_variant_ref(gvar));
+	}
+	g_mutex_unlock(&gvar_cache_mutex);
+
+	g_variant_unref(gvar);
+
+	return copy;
+}
+
+static GVariant *build_tuple_array(const uint64_t a[][2], unsigned int n)
 {
 	unsigned int i;
 	GVariant *rational[2];
@@ -611,7 +745,18 @@ SR_PRIV GVariant *std_gvar_tuple_array(const uint64_t a[][2], unsigned int n)
 	return g_variant_builder_end(&gvb);
 }
 
-SR_PRIV GVariant *std_gvar_tuple_rational(const struct sr_rational *r, unsigned int n)
+SR_PRIV GVariant *std_gvar_tuple_array(const uint64_t a[][2], unsigned int n)
+{
+	GVariant *gvar;
+
+	if ((gvar = gvar_cache_lookup(GVAR_TUPLE_ARRAY, a, n * sizeof(a[0]))))
+		return gvar;
+
+	return gvar_cache_store(GVAR_TUPLE_ARRAY, a, n * sizeof(a[0]),
+		build_tuple_array(a, n));
+}
+
+static GVariant *build_tuple_rational(const struct sr_rational *r, unsigned int n)
 {
 	unsigned int i;
 	GVariant *rational[2];
@@ -630,6 +775,17 @@ SR_PRIV GVariant *std_gvar_tuple_rational(const struct sr_rational *r, unsigned
 	return g_variant_builder_end(&gvb);
 }
 
+SR_PRIV GVariant *std_gvar_tuple_rational(const struct sr_rational *r, unsigned int n)
+{
+	GVariant *gvar;
+
+	if ((gvar = gvar_cache_lookup(GVAR_TUPLE_RATIONAL, r, n * sizeof(r[0]))))
+		return gvar;
+
+	return gvar_cache_store(GVAR_TUPLE_RATIONAL, r, n * sizeof(r[0]),
+		build_tuple_rational(r, n));
+}
+
 static GVariant *samplerate_helper(const uint64_t samplerates[], unsigned int n, const char *str)
 {
 	GVariant *gvar;
@@ -679,7 +835,8 @@ SR_PRIV GVariant *std_gvar_min_max_step_array(const double a[3])
 	return g_variant_builder_end(&gvb);
 }
 
-SR_PRIV GVariant *std_gvar_min_max_step_thresholds(const double min, const double max, const double step)
+static GVariant *build_min_max_step_thresholds(const double min,
+		const double max, const double step)
 {
 	double d, v;
 	GVariant *gvar, *range[2];
@@ -704,6 +861,22 @@ SR_PRIV GVariant *std_gvar_min_max_step_thresholds(const double min, const doubl
 	return g_variant_builder_end(&gvb);
 }
 
+SR_PRIV GVariant *std_gvar_min_max_step_thresholds(const double min, const double max, const double step)
+{
+	GVariant *gvar;
+	double key[3];
+
+	key[0] = min;
+	key[1] = max;
+	key[2] = step;
+	if ((gvar = gvar_cache_lookup(GVAR_MIN_MAX_STEP_THRESHOLDS,
+			key, sizeof(key))))
+		return gvar;
+
+	return gvar_cache_store(GVAR_MIN_MAX_STEP_THRESHOLDS, key, sizeof(key),
+		build_min_max_step_thresholds(min, max, step));
+}
+
 SR_PRIV GVariant *std_gvar_tuple_u64(uint64_t low, uint64_t high)
 {
 	GVariant *range[2];
@@ -759,7 +932,7 @@ SR_PRIV GVariant *std_gvar_array_str(const char *a[], unsigned int n)
 	return gvar;
 }
 
-SR_PRIV GVariant *std_gvar_thresholds(const double a[][2], unsigned int n)
+static GVariant *build_thresholds(const double a[][2], unsigned int n)
 {
 	unsigned int i;
 	GVariant *gvar, *range[2];
@@ -777,6 +950,17 @@ SR_PRIV GVariant *std_gvar_thresholds(const double a[][2], unsigned int n)
 	return g_variant_builder_end(&gvb);
 }
 
+SR_PRIV GVariant *std_gvar_thresholds(const double a[][2], unsigned int n)
+{
+	GVariant *gvar;
+
+	if ((gvar = gvar_cache_lookup(GVAR_THRESHOLDS, a, n * sizeof(a[0]))))
+		return gvar;
+
+	return gvar_cache_store(GVAR_THRESHOLDS, a, n * sizeof(a[0]),
+		build_thresholds(a, n));
+}
+
 /* Return the index of 'data' in the array 'arr' (or -1). */
 static int find_in_array(GVariant *data, const GVariantType *type,
 			 const void *arr, unsigned int n)
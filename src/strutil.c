@@ -35,6 +35,7 @@
 #include <string.h>
 #include <strings.h>
 #include <errno.h>
+#include <float.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
 
@@ -240,6 +241,103 @@ SR_PRIV int sr_atof(const char *str, float *ret)
 	return SR_OK;
 }
 
+/*
+ * Fast path for the conversion of simple decimal numbers, like the ones
+ * found in large amounts in CSV or VCD input files. Accepts an optional
+ * sign, digits with an optional decimal point, and an optional exponent,
+ * and nothing else. When the significant digits fit into the mantissa of
+ * a double and the power of ten is exactly representable, then a single
+ * multiplication or division provides the correctly rounded result (the
+ * same value as strtod() would return). Returns FALSE for all other
+ * input, callers then take the slow path.
+ */
+static gboolean atod_ascii_fast(const char *str, double *ret)
+{
+	static const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+		1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+		1e21, 1e22,
+	};
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+	const char *p;
+	gboolean neg, exp_neg, have_digits;
+	uint64_t mant;
+	int digits, exp10, exp_val;
+	double value;
+
+	p = str;
+	neg = *p == '-';
+	if (*p == '-' || *p == '+')
+		p++;
+
+	mant = 0;
+	digits = 0;
+	exp10 = 0;
+	have_digits = FALSE;
+	while (g_ascii_isdigit(*p)) {
+		have_digits = TRUE;
+		if (mant || *p != '0') {
+			if (++digits > 19)
+				return FALSE;
+			mant = mant * 10 + (*p - '0');
+		}
+		p++;
+	}
+	if (*p == '.') {
+		p++;
+		while (g_ascii_isdigit(*p)) {
+			have_digits = TRUE;
+			if (mant || *p != '0') {
+				if (++digits > 19)
+					return FALSE;
+				mant = mant * 10 + (*p - '0');
+			}
+			exp10--;
+			p++;
+		}
+	}
+	if (!have_digits)
+		return FALSE;
+	if (*p == 'e' || *p == 'E') {
+		p++;
+		exp_neg = *p == '-';
+		if (*p == '-' || *p == '+')
+			p++;
+		if (!g_ascii_isdigit(*p))
+			return FALSE;
+		exp_val = 0;
+		while (g_ascii_isdigit(*p)) {
+			exp_val = exp_val * 10 + (*p - '0');
+			if (exp_val > 1000)
+				return FALSE;
+			p++;
+		}
+		exp10 += exp_neg ? -exp_val : exp_val;
+	}
+	if (*p)
+		return FALSE;
+
+	if (mant >> 53)
+		return FALSE;
+	if (exp10 < -22 || exp10 > 22)
+		return FALSE;
+	value = (double)mant;
+	if (exp10 < 0)
+		value /= pow10[-exp10];
+	else
+		value *= pow10[exp10];
+	*ret = neg ? -value : value;
+
+	return TRUE;
+#else
+	(void)pow10;
+	(void)str;
+	(void)ret;
+
+	return FALSE;
+#endif
+}
+
 /**
  * Convert a string representation of a numeric value to a double. The
  * conversion is strict and will fail if the complete string does not represent
@@ -260,6 +358,8 @@ SR_PRIV int sr_atod_ascii(const char *str, double *ret)
 	char *endptr = NULL;
 
 	errno = 0;
+	if (atod_ascii_fast(str, ret))
+		return SR_OK;
 	tmp = g_ascii_strtod(str, &endptr);
 
 	if (!endptr || *endptr || errno) {
@@ -292,6 +392,10 @@ SR_PRIV int sr_atof_ascii(const char *str, float *ret)
 	char *endptr = NULL;
 
 	errno = 0;
+	if (atod_ascii_fast(str, &tmp)) {
+		*ret = (float) tmp;
+		return SR_OK;
+	}
 	tmp = g_ascii_strtod(str, &endptr);
 
 	if (!endptr || *endptr || errno) {
@@ -127,7 +127,8 @@ SR_PRIV void sr_sw_limits_acquisition_start(struct sr_sw_limits *limits)
  * Check if any of the configured software limits has been reached
  *
  * Usually should be called at the end of the drivers work function after all
- * processing has been done.
+ * processing has been done. Called from an event source's callback, the time
+ * limit check uses the time which the main loop has cached.
  *
  * @param limits software limits instance
  * @returns TRUE if any of the software limits has been reached and the driver
@@ -153,7 +154,7 @@ SR_PRIV gboolean sr_sw_limits_check(struct sr_sw_limits *limits)
 
 	if (limits->limit_msec && limits->start_time) {
 		guint64 now;
-		now = g_get_monotonic_time();
+		now = sr_session_source_time();
 		if (now > limits->start_time &&
 			now - limits->start_time > limits->limit_msec) {
 			sr_dbg("Requested sampling time (%" PRIu64
@@ -165,6 +166,44 @@ SR_PRIV gboolean sr_sw_limits_check(struct sr_sw_limits *limits)
 	return FALSE;
 }
 
+/**
+ * Get the time at which the time limit will be reached.
+ *
+ * Drivers which wake up only when there is work can use this to not miss
+ * the end of the acquisition.
+ *
+ * @param limits software limits instance
+ * @returns The time (of g_get_monotonic_time()) from which on
+ *          sr_sw_limits_check() will return TRUE, or 0 without time limit.
+ */
+SR_PRIV int64_t sr_sw_limits_deadline(const struct sr_sw_limits *limits)
+{
+	if (!limits->limit_msec || !limits->start_time)
+		return 0;
+
+	return limits->start_time + limits->limit_msec + 1;
+}
+
+/**
+ * Get the number of samples which may still be submitted
+ *
+ * Drivers which receive many samples at once can clamp their last packet
+ * to this, so that exactly the requested number of samples gets sent.
+ *
+ * @param limits software limits instance
+ * @returns The number of samples until the sample limit is reached, 0 when
+ *          it has been reached, or UINT64_MAX without sample limit.
+ */
+SR_PRIV uint64_t sr_sw_limits_samples_remaining(const struct sr_sw_limits *limits)
+{
+	if (!limits->limit_samples)
+		return UINT64_MAX;
+	if (limits->samples_read >= limits->limit_samples)
+		return 0;
+
+	return limits->limit_samples - limits->samples_read;
+}
+
 /**
  * Update the amount of samples that have been read
  *
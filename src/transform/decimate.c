@@ -0,0 +1,402 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "transform/decimate"
+
+#define MAX_FACTOR	1000000
+#define MAX_STAGES	5
+
+/* Numbers of the buffers from sr_transform_buffer(). */
+#define BUF_IN		0
+#define BUF_OUT		1
+
+enum decimate_mode {
+	/* The mean of each block of factor samples. */
+	MODE_BOXCAR,
+	/* The minimum and the maximum of each block, in this order. */
+	MODE_MINMAX,
+	/* A CIC filter, i.e. stages boxcars in a row. */
+	MODE_CIC,
+};
+
+/*
+ * The decimation state of one channel. The filter modes keep the last
+ * samples of the channel in buf, and compute an output value from the
+ * whole window each time another factor samples arrived.
+ */
+struct lane {
+	float *buf;
+	uint64_t fill;
+	float min, max;
+};
+
+/* The state of the channels of one analog packet. */
+struct group {
+	unsigned int num_lanes;
+	struct lane *lanes;
+};
+
+struct context {
+	enum decimate_mode mode;
+	uint64_t factor;
+	/* FIR coefficients of the filter modes, and their number. */
+	double *coeffs;
+	uint64_t window;
+	/* struct group by the first struct sr_channel of the packet. */
+	GHashTable *groups;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+};
+
+static void group_free(void *data)
+{
+	struct group *g;
+	unsigned int i;
+
+	g = data;
+	for (i = 0; i < g->num_lanes; i++)
+		g_free(g->lanes[i].buf);
+	g_free(g->lanes);
+	g_free(g);
+}
+
+/*
+ * The impulse response of a CIC filter with differential delay 1 is the
+ * convolution of "stages" boxcars of length "factor". Normalize it to a
+ * gain of 1.
+ */
+static double *cic_coeffs(uint64_t factor, unsigned int stages,
+		uint64_t *window)
+{
+	double *h, *prev, sum;
+	uint64_t len, k;
+	unsigned int s;
+
+	len = stages * (factor - 1) + 1;
+	h = g_malloc0(len * sizeof(*h));
+	prev = g_malloc0(len * sizeof(*prev));
+
+	for (k = 0; k < factor; k++)
+		h[k] = 1.0 / factor;
+	for (s = 1; s < stages; s++) {
+		memcpy(prev, h, len * sizeof(*h));
+		sum = 0;
+		for (k = 0; k < len; k++) {
+			/* Sliding sum over prev[k - factor + 1 .. k]. */
+			sum += prev[k];
+			if (k >= factor)
+				sum -= prev[k - factor];
+			h[k] = sum / factor;
+		}
+	}
+	g_free(prev);
+
+	*window = len;
+
+	return h;
+}
+
+static int init(struct sr_transform *t, GHashTable *options)
+{
+	struct context *ctx;
+	const char *mode;
+	uint64_t factor;
+	uint32_t stages;
+
+	if (!t || !t->sdi || !options)
+		return SR_ERR_ARG;
+
+	factor = g_variant_get_uint64(g_hash_table_lookup(options, "factor"));
+	stages = g_variant_get_uint32(g_hash_table_lookup(options, "stages"));
+	mode = g_variant_get_string(g_hash_table_lookup(options, "mode"), NULL);
+
+	if (factor < 1 || factor > MAX_FACTOR) {
+		sr_err("Factor must be between 1 and %d.", MAX_FACTOR);
+		return SR_ERR_ARG;
+	}
+	if (stages < 1 || stages > MAX_STAGES) {
+		sr_err("Stages must be between 1 and %d.", MAX_STAGES);
+		return SR_ERR_ARG;
+	}
+
+	t->priv = ctx = g_malloc0(sizeof(struct context));
+	ctx->factor = factor;
+
+	if (!strcmp(mode, "boxcar")) {
+		ctx->mode = MODE_BOXCAR;
+		ctx->coeffs = cic_coeffs(factor, 1, &ctx->window);
+	} else if (!strcmp(mode, "minmax")) {
+		ctx->mode = MODE_MINMAX;
+	} else if (!strcmp(mode, "cic")) {
+		ctx->mode = MODE_CIC;
+		ctx->coeffs = cic_coeffs(factor, stages, &ctx->window);
+	} else {
+		sr_err("Unknown mode '%s'.", mode);
+		g_free(ctx);
+		t->priv = NULL;
+		return SR_ERR_ARG;
+	}
+
+	ctx->groups = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+		NULL, group_free);
+
+	return SR_OK;
+}
+
+static struct group *get_group(struct context *ctx,
+		struct sr_channel *ch, unsigned int num_lanes)
+{
+	struct group *g;
+	unsigned int i;
+
+	g = g_hash_table_lookup(ctx->groups, ch);
+	if (g && g->num_lanes == num_lanes)
+		return g;
+
+	g = g_malloc0(sizeof(*g));
+	g->num_lanes = num_lanes;
+	g->lanes = g_malloc0_n(num_lanes, sizeof(*g->lanes));
+	if (ctx->coeffs)
+		for (i = 0; i < num_lanes; i++)
+			g->lanes[i].buf = g_malloc(ctx->window * sizeof(float));
+	g_hash_table_replace(ctx->groups, ch, g);
+
+	return g;
+}
+
+/*
+ * Decimate one channel's samples (every stride'th value of in), and
+ * store its results in every stride'th value of out.
+ *
+ * @return The number of values stored.
+ */
+static uint64_t decimate_lane(const struct context *ctx, struct lane *lane,
+		const float *in, uint64_t count, unsigned int stride, float *out)
+{
+	uint64_t i, n, num, k, keep;
+	double acc;
+	float v;
+
+	num = 0;
+	i = 0;
+
+	if (ctx->mode == MODE_MINMAX) {
+		for (; i < count; i++) {
+			v = in[i * stride];
+			if (lane->fill == 0 || v < lane->min)
+				lane->min = v;
+			if (lane->fill == 0 || v > lane->max)
+				lane->max = v;
+			if (++lane->fill == ctx->factor) {
+				out[num++ * stride] = lane->min;
+				out[num++ * stride] = lane->max;
+				lane->fill = 0;
+			}
+		}
+		return num;
+	}
+
+	keep = ctx->window - ctx->factor;
+	while (i < count) {
+		/* Collect samples until the window is full. */
+		n = MIN(count - i, ctx->window - lane->fill);
+		for (k = 0; k < n; k++)
+			lane->buf[lane->fill + k] = in[(i + k) * stride];
+		lane->fill += n;
+		i += n;
+		if (lane->fill < ctx->window)
+			break;
+
+		acc = 0;
+		for (k = 0; k < ctx->window; k++)
+			acc += ctx->coeffs[k] * lane->buf[k];
+		out[num++ * stride] = acc;
+
+		/* Slide the window by factor samples. */
+		memmove(lane->buf, lane->buf + ctx->factor, keep * sizeof(float));
+		lane->fill = keep;
+	}
+
+	return num;
+}
+
+static int receive_analog(const struct sr_transform *t,
+		struct sr_datafeed_packet *packet_in,
+		struct sr_datafeed_packet **packet_out)
+{
+	struct context *ctx;
+	const struct sr_datafeed_analog *analog;
+	struct group *g;
+	unsigned int num_lanes, i;
+	uint64_t count, num;
+	float *in, *out;
+	int ret;
+
+	ctx = t->priv;
+	analog = packet_in->payload;
+	num_lanes = g_slist_length(analog->meaning->channels);
+	if (num_lanes == 0 || analog->num_samples == 0)
+		return SR_OK;
+	g = get_group(ctx, analog->meaning->channels->data, num_lanes);
+
+	count = analog->num_samples;
+	in = sr_transform_buffer(t, BUF_IN, count * num_lanes * sizeof(float));
+	if ((ret = sr_analog_to_float(analog, in)) != SR_OK)
+		return ret;
+
+	/* At most two values per block, plus one for a window filled up. */
+	out = sr_transform_buffer(t, BUF_OUT,
+		(2 * (count / ctx->factor) + 2) * num_lanes * sizeof(float));
+
+	num = 0;
+	for (i = 0; i < num_lanes; i++)
+		num = decimate_lane(ctx, &g->lanes[i], in + i, count,
+			num_lanes, out + i);
+	if (num == 0)
+		return SR_OK;
+
+	ctx->encoding = *analog->encoding;
+	ctx->encoding.unitsize = sizeof(float);
+	ctx->encoding.is_signed = TRUE;
+	ctx->encoding.is_float = TRUE;
+#ifdef WORDS_BIGENDIAN
+	ctx->encoding.is_bigendian = TRUE;
+#else
+	ctx->encoding.is_bigendian = FALSE;
+#endif
+	sr_rational_set(&ctx->encoding.scale, 1, 1);
+	sr_rational_set(&ctx->encoding.offset, 0, 1);
+
+	ctx->analog = *analog;
+	ctx->analog.data = out;
+	ctx->analog.num_samples = num;
+	ctx->analog.encoding = &ctx->encoding;
+	ctx->packet.type = SR_DF_ANALOG;
+	ctx->packet.payload = &ctx->analog;
+	*packet_out = &ctx->packet;
+
+	return SR_OK;
+}
+
+static int receive(const struct sr_transform *t,
+		struct sr_datafeed_packet *packet_in,
+		struct sr_datafeed_packet **packet_out)
+{
+	struct context *ctx;
+	const struct sr_datafeed_meta *meta;
+	struct sr_config *src;
+	uint64_t samplerate;
+	GSList *l;
+
+	if (!t || !t->sdi || !packet_in || !packet_out)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	if (ctx->factor == 1) {
+		*packet_out = packet_in;
+		return SR_OK;
+	}
+
+	switch (packet_in->type) {
+	case SR_DF_ANALOG:
+		*packet_out = NULL;
+		return receive_analog(t, packet_in, packet_out);
+	case SR_DF_META:
+		/* The analog samplerate is what receivers see from now on. */
+		meta = packet_in->payload;
+		for (l = meta->config; l; l = l->next) {
+			src = l->data;
+			if (src->key != SR_CONF_SAMPLERATE)
+				continue;
+			samplerate = g_variant_get_uint64(src->data) / ctx->factor;
+			if (ctx->mode == MODE_MINMAX)
+				samplerate *= 2;
+			g_variant_unref(src->data);
+			src->data = g_variant_ref_sink(
+				g_variant_new_uint64(samplerate));
+		}
+		break;
+	case SR_DF_END:
+		/* Start over with the next acquisition. */
+		g_hash_table_remove_all(ctx->groups);
+		break;
+	default:
+		sr_spew("Unsupported packet type %d, ignoring.", packet_in->type);
+		break;
+	}
+
+	*packet_out = packet_in;
+
+	return SR_OK;
+}
+
+static int cleanup(struct sr_transform *t)
+{
+	struct context *ctx;
+
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	g_hash_table_destroy(ctx->groups);
+	g_free(ctx->coeffs);
+	g_free(ctx);
+	t->priv = NULL;
+
+	return SR_OK;
+}
+
+static struct sr_option options[] = {
+	{ "factor", "Factor", "Number of input samples per output sample", NULL, NULL },
+	{ "mode", "Mode", "Decimation mode (boxcar: mean of each block, minmax: "
+		"minimum and maximum of each block, cic: CIC filter)", NULL, NULL },
+	{ "stages", "Stages", "Number of CIC filter stages", NULL, NULL },
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	if (!options[0].def) {
+		options[0].def = g_variant_ref_sink(g_variant_new_uint64(1000));
+		options[1].def = g_variant_ref_sink(g_variant_new_string("boxcar"));
+		options[1].values = g_slist_append(options[1].values,
+			g_variant_ref_sink(g_variant_new_string("boxcar")));
+		options[1].values = g_slist_append(options[1].values,
+			g_variant_ref_sink(g_variant_new_string("minmax")));
+		options[1].values = g_slist_append(options[1].values,
+			g_variant_ref_sink(g_variant_new_string("cic")));
+		options[2].def = g_variant_ref_sink(g_variant_new_uint32(3));
+	}
+
+	return options;
+}
+
+SR_PRIV struct sr_transform_module transform_decimate = {
+	.id = "decimate",
+	.name = "Decimate",
+	.desc = "Reduce the samplerate of analog values",
+	.options = get_options,
+	.init = init,
+	.receive = receive,
+	.cleanup = cleanup,
+};
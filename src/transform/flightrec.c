@@ -0,0 +1,314 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "transform/flightrec"
+
+/*
+ * The acquisition keeps running, and only the logic samples around
+ * events get passed on: the last pre samples before each event, and
+ * post samples from the event on. Events are SR_DF_TRIGGER packets,
+ * and samples whose masked value becomes the configured value. Each
+ * event is passed on as an SR_DF_TRIGGER packet, at its position.
+ */
+struct context {
+	uint64_t pre;
+	uint64_t post;
+	uint64_t mask;
+	uint64_t value;
+	unsigned int unitsize;
+	/* Circular buffer of the last pre samples. */
+	uint8_t *buf;
+	uint64_t head;
+	uint64_t fill;
+	/* Samples which still get passed on after the last event. */
+	uint64_t post_left;
+	gboolean prev_match;
+	uint64_t num_events;
+	/* The context whose memory budget buf counts against. */
+	struct sr_context *mem_ctx;
+};
+
+static int init(struct sr_transform *t, GHashTable *options)
+{
+	struct context *ctx;
+
+	if (!t || !t->sdi || !options)
+		return SR_ERR_ARG;
+
+	ctx = g_malloc0(sizeof(struct context));
+	ctx->pre = g_variant_get_uint64(g_hash_table_lookup(options, "pre"));
+	ctx->post = g_variant_get_uint64(g_hash_table_lookup(options, "post"));
+	ctx->mask = g_variant_get_uint64(g_hash_table_lookup(options, "mask"));
+	ctx->value = g_variant_get_uint64(g_hash_table_lookup(options, "value"));
+	ctx->value &= ctx->mask;
+	t->priv = ctx;
+
+	return SR_OK;
+}
+
+static void reset(struct context *ctx, unsigned int unitsize)
+{
+	sr_mem_free(ctx->mem_ctx, ctx->buf);
+	ctx->buf = NULL;
+	ctx->unitsize = unitsize;
+	ctx->head = 0;
+	ctx->fill = 0;
+	ctx->post_left = 0;
+	ctx->prev_match = TRUE;
+}
+
+/* The first 64 channels of a sample, little endian. */
+static uint64_t sample_value(const uint8_t *sample, unsigned int unitsize)
+{
+	uint64_t v;
+	unsigned int i;
+
+	v = 0;
+	for (i = MIN(unitsize, sizeof(v)); i > 0; i--)
+		v = (v << 8) | sample[i - 1];
+
+	return v;
+}
+
+/*
+ * Find the first sample at or after pos whose masked value became the
+ * configured value. Returns num if there is none.
+ */
+static uint64_t find_event(struct context *ctx, const uint8_t *data,
+		uint64_t pos, uint64_t num)
+{
+	gboolean match;
+
+	if (!ctx->mask)
+		return num;
+
+	for (; pos < num; pos++) {
+		match = (sample_value(data + pos * ctx->unitsize,
+			ctx->unitsize) & ctx->mask) == ctx->value;
+		if (match && !ctx->prev_match)
+			break;
+		ctx->prev_match = match;
+	}
+	if (pos < num)
+		ctx->prev_match = TRUE;
+
+	return pos;
+}
+
+static void history_append(struct context *ctx, const uint8_t *data,
+		uint64_t num)
+{
+	uint64_t n;
+
+	if (num > ctx->pre) {
+		data += (num - ctx->pre) * ctx->unitsize;
+		num = ctx->pre;
+	}
+	ctx->fill = MIN(ctx->fill + num, ctx->pre);
+
+	while (num > 0) {
+		n = MIN(ctx->pre - ctx->head, num);
+		memcpy(ctx->buf + ctx->head * ctx->unitsize, data,
+			n * ctx->unitsize);
+		ctx->head = (ctx->head + n) % ctx->pre;
+		data += n * ctx->unitsize;
+		num -= n;
+	}
+}
+
+static int send_logic(const struct sr_transform *t, const uint8_t *data,
+		uint64_t num)
+{
+	struct context *ctx;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+
+	ctx = t->priv;
+	if (!num)
+		return SR_OK;
+
+	logic.length = num * ctx->unitsize;
+	logic.unitsize = ctx->unitsize;
+	logic.data = (uint8_t *)data;
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+
+	return sr_transform_send(t, &packet);
+}
+
+/* Pass on the samples before an event, and the event itself. */
+static int dump(const struct sr_transform *t)
+{
+	struct context *ctx;
+	struct sr_datafeed_packet packet;
+	uint64_t start, n;
+	int ret;
+
+	ctx = t->priv;
+	ctx->num_events++;
+	sr_dbg("Event %" PRIu64 ", passing on %" PRIu64 " samples before it.",
+		ctx->num_events, ctx->fill);
+
+	ret = SR_OK;
+	if (ctx->fill) {
+		start = (ctx->head + ctx->pre - ctx->fill) % ctx->pre;
+		n = MIN(ctx->pre - start, ctx->fill);
+		ret = send_logic(t, ctx->buf + start * ctx->unitsize, n);
+		if (ret == SR_OK)
+			ret = send_logic(t, ctx->buf, ctx->fill - n);
+		ctx->fill = 0;
+	}
+	if (ret != SR_OK)
+		return ret;
+
+	packet.type = SR_DF_TRIGGER;
+	packet.payload = NULL;
+	ret = sr_transform_send(t, &packet);
+	ctx->post_left = ctx->post;
+
+	return ret;
+}
+
+static int receive_logic(const struct sr_transform *t,
+		const struct sr_datafeed_logic *logic)
+{
+	struct context *ctx;
+	const uint8_t *data;
+	uint64_t num, pos, end, n;
+	int ret;
+
+	ctx = t->priv;
+	if (!logic->unitsize)
+		return SR_OK;
+	if (logic->unitsize != ctx->unitsize)
+		reset(ctx, logic->unitsize);
+	if (ctx->pre && !ctx->buf) {
+		ctx->mem_ctx = t->sdi->session ? t->sdi->session->ctx : NULL;
+		ctx->buf = sr_mem_alloc(ctx->mem_ctx, LOG_PREFIX,
+			ctx->pre * ctx->unitsize);
+		if (!ctx->buf)
+			return SR_ERR_MALLOC;
+	}
+
+	data = logic->data;
+	num = logic->length / logic->unitsize;
+	for (pos = 0; pos < num; pos = end) {
+		if (ctx->post_left) {
+			/* Events extend the window they are in. */
+			n = MIN(ctx->post_left, num - pos);
+			end = find_event(ctx, data, pos, pos + n);
+			ret = send_logic(t, data + pos * ctx->unitsize,
+				end - pos);
+			if (ret != SR_OK)
+				return ret;
+			ctx->post_left -= end - pos;
+			if (end < pos + n && (ret = dump(t)) != SR_OK)
+				return ret;
+			continue;
+		}
+		end = find_event(ctx, data, pos, num);
+		if (ctx->pre)
+			history_append(ctx, data + pos * ctx->unitsize,
+				end - pos);
+		if (end < num && (ret = dump(t)) != SR_OK)
+			return ret;
+	}
+
+	return SR_OK;
+}
+
+static int receive(const struct sr_transform *t,
+		struct sr_datafeed_packet *packet_in,
+		struct sr_datafeed_packet **packet_out)
+{
+	struct context *ctx;
+	int ret;
+
+	if (!t || !t->sdi || !packet_in || !packet_out)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	*packet_out = NULL;
+
+	switch (packet_in->type) {
+	case SR_DF_HEADER:
+		reset(ctx, 0);
+		ctx->num_events = 0;
+		break;
+	case SR_DF_TRIGGER:
+		/* The event gets passed on after the samples before it. */
+		return dump(t);
+	case SR_DF_LOGIC:
+		return receive_logic(t, packet_in->payload);
+	default:
+		break;
+	}
+
+	*packet_out = packet_in;
+
+	return SR_OK;
+}
+
+static int cleanup(struct sr_transform *t)
+{
+	struct context *ctx;
+
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	sr_mem_free(ctx->mem_ctx, ctx->buf);
+	g_free(ctx);
+	t->priv = NULL;
+
+	return SR_OK;
+}
+
+static struct sr_option options[] = {
+	{ "pre", "Pre-event samples", "Number of samples before each event to pass on", NULL, NULL },
+	{ "post", "Post-event samples", "Number of samples from each event on to pass on", NULL, NULL },
+	{ "mask", "Mask", "Channels (bit mask of the first 64) whose value becomes an event", NULL, NULL },
+	{ "value", "Value", "Value of the masked channels which becomes an event", NULL, NULL },
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	if (!options[0].def) {
+		options[0].def = g_variant_ref_sink(g_variant_new_uint64(100000));
+		options[1].def = g_variant_ref_sink(g_variant_new_uint64(100000));
+		options[2].def = g_variant_ref_sink(g_variant_new_uint64(0));
+		options[3].def = g_variant_ref_sink(g_variant_new_uint64(0));
+	}
+
+	return options;
+}
+
+SR_PRIV struct sr_transform_module transform_flightrec = {
+	.id = "flightrec",
+	.name = "Flight recorder",
+	.desc = "Pass on logic data around events only, while acquisition runs on",
+	.options = get_options,
+	.init = init,
+	.receive = receive,
+	.cleanup = cleanup,
+};
@@ -32,7 +32,7 @@ static int receive(const struct sr_transform *t,
 	const struct sr_datafeed_analog *analog;
 	uint8_t *b;
 	int64_t p;
-	uint64_t i, j, q;
+	uint64_t i, len, q;
 
 	if (!t || !t->sdi || !packet_in || !packet_out)
 		return SR_ERR_ARG;
@@ -40,13 +40,17 @@ static int receive(const struct sr_transform *t,
 	switch (packet_in->type) {
 	case SR_DF_LOGIC:
 		logic = packet_in->payload;
-		for (i = 0; i <= logic->length - logic->unitsize; i += logic->unitsize) {
-			for (j = 0; j < logic->unitsize; j++) {
-				/* For now invert every bit in every byte. */
-				b = (uint8_t *)logic->data + i + logic->unitsize - 1 - j;
-				*b = ~(*b);
-			}
-		}
+		if (!logic->unitsize)
+			break;
+		/*
+		 * For now invert every bit of every complete unit. Unit
+		 * boundaries don't matter for that, one flat loop over the
+		 * bytes is what compilers vectorize.
+		 */
+		b = logic->data;
+		len = logic->length - logic->length % logic->unitsize;
+		for (i = 0; i < len; i++)
+			b[i] = ~b[i];
 		break;
 	case SR_DF_ANALOG:
 		analog = packet_in->payload;
@@ -0,0 +1,166 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "transform/narrow"
+
+/*
+ * Receivers find a channel's bit by its index, so the bits stay where
+ * they are. Only the bytes above the highest enabled logic channel get
+ * dropped, which is what e.g. 3 enabled channels out of 16 need.
+ */
+struct context {
+	/* Unit size which holds all enabled logic channels, 0 if unknown. */
+	unsigned int unitsize;
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_packet packet;
+};
+
+static int init(struct sr_transform *t, GHashTable *options)
+{
+	(void)options;
+
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+
+	t->priv = g_malloc0(sizeof(struct context));
+
+	return SR_OK;
+}
+
+static unsigned int enabled_unitsize(const struct sr_dev_inst *sdi)
+{
+	const struct sr_channel *ch;
+	const GSList *l;
+	unsigned int unitsize;
+
+	unitsize = 0;
+	for (l = sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->type == SR_CHANNEL_LOGIC && ch->enabled)
+			unitsize = MAX(unitsize, (unsigned int)ch->index / 8 + 1);
+	}
+
+	return unitsize;
+}
+
+/** @cond PRIVATE */
+#define NARROW_LOOP(size) \
+	do { \
+		for (i = 0; i < count; i++) \
+			memcpy(&out[i * (size)], &in[i * in_size], (size)); \
+	} while (0)
+/** @endcond */
+
+static int receive(const struct sr_transform *t,
+		struct sr_datafeed_packet *packet_in,
+		struct sr_datafeed_packet **packet_out)
+{
+	struct context *ctx;
+	const struct sr_datafeed_logic *logic;
+	const uint8_t *in;
+	uint8_t *out;
+	unsigned int in_size, out_size;
+	size_t i, count;
+
+	if (!t || !t->sdi || !packet_in || !packet_out)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	*packet_out = packet_in;
+
+	switch (packet_in->type) {
+	case SR_DF_HEADER:
+	case SR_DF_META:
+		/*
+		 * The enabled channels can change between acquisitions,
+		 * and within one (see sr_session_reconfigure()).
+		 */
+		ctx->unitsize = 0;
+		return SR_OK;
+	case SR_DF_LOGIC:
+		break;
+	default:
+		return SR_OK;
+	}
+
+	if (!ctx->unitsize)
+		ctx->unitsize = enabled_unitsize(t->sdi);
+
+	logic = packet_in->payload;
+	in_size = logic->unitsize;
+	out_size = ctx->unitsize;
+	if (!out_size || out_size >= in_size)
+		return SR_OK;
+
+	count = logic->length / in_size;
+	in = logic->data;
+	out = sr_transform_buffer(t, 0, count * out_size);
+
+	/* Constant sizes let compilers turn the copies into plain moves. */
+	switch (out_size) {
+	case 1:
+		NARROW_LOOP(1);
+		break;
+	case 2:
+		NARROW_LOOP(2);
+		break;
+	case 4:
+		NARROW_LOOP(4);
+		break;
+	default:
+		NARROW_LOOP(out_size);
+		break;
+	}
+
+	ctx->logic.length = count * out_size;
+	ctx->logic.unitsize = out_size;
+	ctx->logic.data = out;
+	ctx->packet.type = SR_DF_LOGIC;
+	ctx->packet.payload = &ctx->logic;
+	*packet_out = &ctx->packet;
+
+	return SR_OK;
+}
+
+static int cleanup(struct sr_transform *t)
+{
+	struct context *ctx;
+
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	g_free(ctx);
+	t->priv = NULL;
+
+	return SR_OK;
+}
+
+SR_PRIV struct sr_transform_module transform_narrow = {
+	.id = "narrow",
+	.name = "Narrow",
+	.desc = "Drop logic data bytes which hold no enabled channel",
+	.options = NULL,
+	.init = init,
+	.receive = receive,
+	.cleanup = cleanup,
+};
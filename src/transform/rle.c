@@ -0,0 +1,173 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "transform/rle"
+
+/* Numbers of the buffers from sr_transform_buffer(). */
+#define BUF_VALUES	0
+#define BUF_COUNTS	1
+
+/*
+ * The output reaches the datafeed callbacks as it is, so all of them
+ * need to handle SR_DF_LOGIC_RLE packets (see sr_session_logic_rle_set()).
+ */
+struct context {
+	struct sr_datafeed_logic_rle rle;
+	/* The number of runs the buffers have room for. */
+	uint64_t max_runs;
+	struct sr_datafeed_packet packet;
+};
+
+static int init(struct sr_transform *t, GHashTable *options)
+{
+	(void)options;
+
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+
+	t->priv = g_malloc0(sizeof(struct context));
+
+	return SR_OK;
+}
+
+/*
+ * Find the end of the run which starts at sample pos, i.e. the first
+ * sample after it which differs. When the unit size divides 8, whole
+ * words of samples get compared against a word of the run's value, and
+ * only a word which differs gets looked at byte by byte.
+ */
+static uint64_t run_end(const uint8_t *data, uint64_t pos, uint64_t num,
+		unsigned int unitsize)
+{
+	const uint8_t *value;
+	uint8_t pattern[sizeof(uint64_t)];
+	uint64_t off, end, word, pword;
+	unsigned int i;
+
+	value = data + pos * unitsize;
+	off = (pos + 1) * unitsize;
+	end = num * unitsize;
+
+	if (sizeof(word) % unitsize == 0) {
+		for (i = 0; i < sizeof(pattern); i++)
+			pattern[i] = value[i % unitsize];
+		memcpy(&pword, pattern, sizeof(pword));
+		for (; off + sizeof(word) <= end; off += sizeof(word)) {
+			memcpy(&word, data + off, sizeof(word));
+			if (word ^ pword)
+				break;
+		}
+		for (; off < end; off++)
+			if (data[off] != value[off % unitsize])
+				break;
+		return off / unitsize;
+	}
+
+	for (; off < end; off += unitsize)
+		if (memcmp(data + off, value, unitsize))
+			break;
+
+	return off / unitsize;
+}
+
+static int receive(const struct sr_transform *t,
+		struct sr_datafeed_packet *packet_in,
+		struct sr_datafeed_packet **packet_out)
+{
+	struct context *ctx;
+	const struct sr_datafeed_logic *logic;
+	const uint8_t *data;
+	uint64_t num, pos, end;
+	unsigned int unitsize;
+
+	if (!t || !t->sdi || !packet_in || !packet_out)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	if (packet_in->type != SR_DF_LOGIC) {
+		*packet_out = packet_in;
+		return SR_OK;
+	}
+
+	logic = packet_in->payload;
+	unitsize = logic->unitsize;
+	if (!unitsize || logic->length < unitsize) {
+		*packet_out = NULL;
+		return SR_OK;
+	}
+	data = logic->data;
+	num = logic->length / unitsize;
+
+	if (ctx->rle.unitsize != unitsize) {
+		ctx->rle.unitsize = unitsize;
+		ctx->max_runs = 0;
+	}
+
+	/*
+	 * Each packet's data ends with a complete run, so that packets
+	 * from other sources (e.g. triggers) keep their position.
+	 */
+	ctx->rle.num_runs = 0;
+	for (pos = 0; pos < num; pos = end) {
+		end = run_end(data, pos, num, unitsize);
+		if (ctx->rle.num_runs == ctx->max_runs) {
+			ctx->max_runs = MAX(2 * ctx->max_runs, 256);
+			ctx->rle.values = sr_transform_buffer(t, BUF_VALUES,
+				ctx->max_runs * unitsize);
+			ctx->rle.counts = sr_transform_buffer(t, BUF_COUNTS,
+				ctx->max_runs * sizeof(*ctx->rle.counts));
+		}
+		memcpy((uint8_t *)ctx->rle.values + ctx->rle.num_runs * unitsize,
+			data + pos * unitsize, unitsize);
+		ctx->rle.counts[ctx->rle.num_runs++] = end - pos;
+	}
+
+	ctx->packet.type = SR_DF_LOGIC_RLE;
+	ctx->packet.payload = &ctx->rle;
+	*packet_out = &ctx->packet;
+
+	return SR_OK;
+}
+
+static int cleanup(struct sr_transform *t)
+{
+	struct context *ctx;
+
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	g_free(ctx);
+	t->priv = NULL;
+
+	return SR_OK;
+}
+
+SR_PRIV struct sr_transform_module transform_rle = {
+	.id = "rle",
+	.name = "Run-length encode",
+	.desc = "Pass logic data on as runs of unchanged samples",
+	.options = NULL,
+	.init = init,
+	.receive = receive,
+	.cleanup = cleanup,
+};
@@ -49,6 +49,7 @@ static int receive(const struct sr_transform *t,
 {
 	struct context *ctx;
 	const struct sr_datafeed_analog *analog;
+	int ret;
 
 	if (!t || !t->sdi || !packet_in || !packet_out)
 		return SR_ERR_ARG;
@@ -56,9 +57,17 @@ static int receive(const struct sr_transform *t,
 
 	switch (packet_in->type) {
 	case SR_DF_ANALOG:
+		/*
+		 * Fold the factor into the encoding, receivers apply it when
+		 * they convert the samples (if they do at all).
+		 */
 		analog = packet_in->payload;
-		analog->encoding->scale.p *= ctx->factor.p;
-		analog->encoding->scale.q *= ctx->factor.q;
+		ret = sr_rational_mult(&analog->encoding->scale,
+			&analog->encoding->scale, &ctx->factor);
+		if (ret != SR_OK) {
+			sr_err("Scale factor overflow.");
+			return ret;
+		}
 		break;
 	default:
 		sr_spew("Unsupported packet type %d, ignoring.", packet_in->type);
@@ -42,15 +42,28 @@
  */
 
 /** @cond PRIVATE */
+struct transform_buffer {
+	void *data;
+	size_t size;
+};
+
 extern SR_PRIV struct sr_transform_module transform_nop;
 extern SR_PRIV struct sr_transform_module transform_scale;
 extern SR_PRIV struct sr_transform_module transform_invert;
+extern SR_PRIV struct sr_transform_module transform_decimate;
+extern SR_PRIV struct sr_transform_module transform_rle;
+extern SR_PRIV struct sr_transform_module transform_narrow;
+extern SR_PRIV struct sr_transform_module transform_flightrec;
 /** @endcond */
 
 static const struct sr_transform_module *transform_module_list[] = {
 	&transform_nop,
 	&transform_scale,
 	&transform_invert,
+	&transform_decimate,
+	&transform_rle,
+	&transform_narrow,
+	&transform_flightrec,
 	NULL,
 };
 
@@ -184,6 +197,15 @@ SR_API void sr_transform_options_free(const struct sr_option **options)
 	g_free(options);
 }
 
+static void buffers_free(GArray *buffers)
+{
+	unsigned int i;
+
+	for (i = 0; i < buffers->len; i++)
+		g_free(g_array_index(buffers, struct transform_buffer, i).data);
+	g_array_free(buffers, TRUE);
+}
+
 /**
  * Create a new transform instance using the specified transform module.
  *
@@ -208,9 +230,15 @@ SR_API const struct sr_transform *sr_transform_new(const struct sr_transform_mod
 	gpointer key, value;
 	int i;
 
-	t = g_malloc(sizeof(struct sr_transform));
+	if (sr_transform_module_sanity_check(tmod) != SR_OK) {
+		sr_err("Internal transform module error(s), can't use it.");
+		return NULL;
+	}
+
+	t = g_malloc0(sizeof(struct sr_transform));
 	t->module = tmod;
 	t->sdi = sdi;
+	t->buffers = g_array_new(FALSE, TRUE, sizeof(struct transform_buffer));
 
 	new_opts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
 			(GDestroyNotify)g_variant_unref);
@@ -224,6 +252,7 @@ SR_API const struct sr_transform *sr_transform_new(const struct sr_transform_mod
 				if (!g_variant_is_of_type(value, gvt)) {
 					sr_err("Invalid type for '%s' option.",
 						(char *)key);
+					buffers_free(t->buffers);
 					g_free(t);
 					return NULL;
 				}
@@ -244,6 +273,7 @@ SR_API const struct sr_transform *sr_transform_new(const struct sr_transform_mod
 					sr_err("Transform module '%s' has no option '%s'.",
 						tmod->id, (char *)key);
 					g_hash_table_destroy(new_opts);
+					buffers_free(t->buffers);
 					g_free(t);
 					return NULL;
 				}
@@ -252,6 +282,7 @@ SR_API const struct sr_transform *sr_transform_new(const struct sr_transform_mod
 	}
 
 	if (t->module->init && t->module->init(t, new_opts) != SR_OK) {
+		buffers_free(t->buffers);
 		g_free(t);
 		t = NULL;
 	}
@@ -260,10 +291,43 @@ SR_API const struct sr_transform *sr_transform_new(const struct sr_transform_mod
 
 	/* Add the transform to the session's list of transforms. */
 	sdi->session->transforms = g_slist_append(sdi->session->transforms, t);
+	sr_session_plan_update(sdi->session);
 
 	return t;
 }
 
+/**
+ * Get a buffer for the output of a transform module.
+ *
+ * Each buffer grows to the largest size it was asked for, and is kept
+ * until the transform gets freed. Modules which create packets thus
+ * don't allocate once they saw their largest input. The buffer's
+ * contents are kept when it grows.
+ *
+ * @param t The transform.
+ * @param id The number of the buffer, as the module chooses (0, 1, ...).
+ * @param size The minimum size in bytes.
+ *
+ * @return The buffer, valid until the next call for the same number.
+ *
+ * @private
+ */
+SR_PRIV void *sr_transform_buffer(const struct sr_transform *t,
+		unsigned int id, size_t size)
+{
+	struct transform_buffer *buf;
+
+	if (id >= t->buffers->len)
+		g_array_set_size(t->buffers, id + 1);
+	buf = &g_array_index(t->buffers, struct transform_buffer, id);
+	if (buf->size < size) {
+		buf->data = g_realloc(buf->data, size);
+		buf->size = size;
+	}
+
+	return buf->data;
+}
+
 /**
  * Free the specified transform instance and all associated resources.
  *
@@ -279,6 +343,7 @@ SR_API int sr_transform_free(const struct sr_transform *t)
 	ret = SR_OK;
 	if (t->module->cleanup)
 		ret = t->module->cleanup((struct sr_transform *)t);
+	buffers_free(t->buffers);
 	g_free((gpointer)t);
 
 	return ret;
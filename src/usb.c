@@ -22,6 +22,7 @@
 #include <config.h>
 #include <stdlib.h>
 #include <memory.h>
+#include <string.h>
 #include <glib.h>
 #include <libusb.h>
 #include <libsigrok/libsigrok.h>
@@ -37,6 +38,23 @@
 typedef int libusb_os_handle;
 #endif
 
+/** Upper bound for a single wait of the USB event thread, in ms. */
+#define USB_EVENT_THREAD_MAX_WAIT 100
+
+/** Thread which handles libusb events outside of the main loop.
+ */
+struct usb_event_thread {
+	struct libusb_context *usb_ctx;
+	GThread *thread;
+	/* Serializes libusb event handling with the main loop callback. */
+	GMutex lock;
+	gint running;
+	/* The main loop callback is running (with the lock held). */
+	gboolean in_dispatch;
+	/* Of the session which started the thread. */
+	struct sr_thread_sched sched;
+};
+
 /** Custom GLib event source for libusb I/O.
  */
 struct usb_source {
@@ -50,6 +68,9 @@ struct usb_source {
 
 	struct libusb_context *usb_ctx;
 	GPtrArray *pollfds;
+
+	/* Set if USB events are handled by a thread, not this source. */
+	struct usb_event_thread *thread;
 };
 
 /** USB event source prepare() method.
@@ -138,7 +159,15 @@ static gboolean usb_source_dispatch(GSource *source,
 		sr_err("Callback not set, cannot dispatch event.");
 		return G_SOURCE_REMOVE;
 	}
+	if (usource->thread) {
+		g_mutex_lock(&usource->thread->lock);
+		usource->thread->in_dispatch = TRUE;
+	}
 	keep = (*SR_RECEIVE_DATA_CALLBACK(callback))(-1, revents, user_data);
+	if (usource->thread) {
+		usource->thread->in_dispatch = FALSE;
+		g_mutex_unlock(&usource->thread->lock);
+	}
 
 	if (G_LIKELY(keep) && G_LIKELY(!g_source_is_destroyed(source))) {
 		if (usource->timeout_us >= 0)
@@ -160,7 +189,8 @@ static void usb_source_finalize(GSource *source)
 
 	sr_spew("%s", __func__);
 
-	libusb_set_pollfd_notifiers(usource->usb_ctx, NULL, NULL, NULL);
+	if (!usource->thread)
+		libusb_set_pollfd_notifiers(usource->usb_ctx, NULL, NULL, NULL);
 
 	g_ptr_array_unref(usource->pollfds);
 	usource->pollfds = NULL;
@@ -243,13 +273,17 @@ static void usb_source_free_pollfd(void *data)
  * API at some point. Instead, drivers should install separate timer
  * event sources for their polling needs.
  *
+ * With an event thread, the source only provides the user timeout.
+ *
  * @param session The session the event source belongs to.
  * @param usb_ctx The libusb context for which to handle events.
  * @param timeout_ms The timeout interval in ms, or -1 to wait indefinitely.
+ * @param thread The USB event thread, or NULL to poll libusb's FDs.
  * @return A new event source object, or NULL on failure.
  */
 static GSource *usb_source_new(struct sr_session *session,
-		struct libusb_context *usb_ctx, int timeout_ms)
+		struct libusb_context *usb_ctx, int timeout_ms,
+		struct usb_event_thread *thread)
 {
 	static GSourceFuncs usb_source_funcs = {
 		.prepare  = &usb_source_prepare,
@@ -261,10 +295,13 @@ static GSource *usb_source_new(struct sr_session *session,
 	struct usb_source *usource;
 	const struct libusb_pollfd **upollfds, **upfd;
 
-	upollfds = libusb_get_pollfds(usb_ctx);
-	if (!upollfds) {
-		sr_err("Failed to get libusb file descriptors.");
-		return NULL;
+	upollfds = NULL;
+	if (!thread) {
+		upollfds = libusb_get_pollfds(usb_ctx);
+		if (!upollfds) {
+			sr_err("Failed to get libusb file descriptors.");
+			return NULL;
+		}
 	}
 	source = g_source_new(&usb_source_funcs, sizeof(struct usb_source));
 	usource = (struct usb_source *)source;
@@ -281,6 +318,10 @@ static GSource *usb_source_new(struct sr_session *session,
 	usource->session = session;
 	usource->usb_ctx = usb_ctx;
 	usource->pollfds = g_ptr_array_new_full(8, &usb_source_free_pollfd);
+	usource->thread = thread;
+
+	if (thread)
+		return source;
 
 	for (upfd = upollfds; *upfd != NULL; upfd++)
 		usb_pollfd_added((*upfd)->fd, (*upfd)->events, usource);
@@ -296,10 +337,364 @@ static GSource *usb_source_new(struct sr_session *session,
 	return source;
 }
 
+/** Wait until libusb has work, or for at most USB_EVENT_THREAD_MAX_WAIT.
+ */
+static void usb_event_thread_wait(struct usb_event_thread *t)
+{
+	const struct libusb_pollfd **upollfds;
+	struct timeval tv;
+	GPollFD *fds;
+	int num_fds, timeout_ms;
+
+	upollfds = libusb_get_pollfds(t->usb_ctx);
+	if (!upollfds) {
+		g_usleep(1000 * USB_EVENT_THREAD_MAX_WAIT);
+		return;
+	}
+	for (num_fds = 0; upollfds[num_fds]; num_fds++)
+		;
+	fds = g_new(GPollFD, num_fds);
+	for (num_fds = 0; upollfds[num_fds]; num_fds++) {
+		fds[num_fds].fd = (gintptr)upollfds[num_fds]->fd;
+		fds[num_fds].events = upollfds[num_fds]->events;
+		fds[num_fds].revents = 0;
+	}
+#if (LIBUSB_API_VERSION >= 0x01000104)
+	libusb_free_pollfds(upollfds);
+#else
+	free(upollfds);
+#endif
+
+	timeout_ms = USB_EVENT_THREAD_MAX_WAIT;
+	if (libusb_get_next_timeout(t->usb_ctx, &tv) == 1)
+		timeout_ms = MIN(timeout_ms,
+			tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000);
+
+	g_poll(fds, num_fds, timeout_ms);
+	g_free(fds);
+}
+
+/** USB event thread main function.
+ *
+ * Waiting for events happens without the lock held, so that the main
+ * loop callback never has to wait for I/O. Transfer callbacks run
+ * in this thread, with the lock held.
+ */
+static gpointer usb_event_thread_run(gpointer data)
+{
+	struct usb_event_thread *t;
+	struct timeval tv;
+	int ret;
+
+	t = data;
+	sr_thread_sched_apply(&t->sched, FALSE);
+
+	while (g_atomic_int_get(&t->running)) {
+		usb_event_thread_wait(t);
+		tv.tv_sec = tv.tv_usec = 0;
+		g_mutex_lock(&t->lock);
+		ret = libusb_handle_events_timeout_completed(t->usb_ctx,
+			&tv, NULL);
+		g_mutex_unlock(&t->lock);
+		sr_session_receive_mark(0);
+		if (ret < 0 && ret != LIBUSB_ERROR_INTERRUPTED)
+			sr_err("Failed to handle USB events: %s.",
+				libusb_error_name(ret));
+	}
+
+	return NULL;
+}
+
+/* Called with ctx->usb_thread_mutex held. */
+static void usb_event_thread_join_locked(struct sr_context *ctx)
+{
+	struct usb_event_thread *t;
+
+	if (!(t = ctx->usb_thread))
+		return;
+
+	g_atomic_int_set(&t->running, 0);
+#if (LIBUSB_API_VERSION >= 0x01000105)
+	libusb_interrupt_event_handler(t->usb_ctx);
+#endif
+	g_thread_join(t->thread);
+	g_mutex_clear(&t->lock);
+	g_free(t);
+	ctx->usb_thread = NULL;
+	ctx->usb_thread_users = 0;
+
+	sr_dbg("Stopped USB event thread.");
+}
+
+static void usb_event_thread_join(struct sr_context *ctx)
+{
+	g_mutex_lock(&ctx->usb_thread_mutex);
+	usb_event_thread_join_locked(ctx);
+	g_mutex_unlock(&ctx->usb_thread_mutex);
+}
+
+/*
+ * Get the context's event thread, starting it if needed. Sessions which
+ * run concurrently share the thread, each one holds a use of it.
+ */
+static struct usb_event_thread *usb_event_thread_start(struct sr_context *ctx,
+		const struct sr_thread_sched *sched)
+{
+	struct usb_event_thread *t;
+
+	g_mutex_lock(&ctx->usb_thread_mutex);
+
+	/* A thread which was stopped from within itself, collect it now. */
+	if (ctx->usb_thread && !g_atomic_int_get(&ctx->usb_thread->running))
+		usb_event_thread_join_locked(ctx);
+	if ((t = ctx->usb_thread)) {
+		ctx->usb_thread_users++;
+		g_mutex_unlock(&ctx->usb_thread_mutex);
+		return t;
+	}
+
+	t = g_malloc0(sizeof(*t));
+	t->usb_ctx = ctx->libusb_ctx;
+	t->sched = *sched;
+	g_mutex_init(&t->lock);
+	t->running = 1;
+	t->thread = g_thread_try_new("sr-usb-events", usb_event_thread_run,
+		t, NULL);
+	if (!t->thread) {
+		sr_err("Cannot create USB event thread.");
+		g_mutex_clear(&t->lock);
+		g_free(t);
+		g_mutex_unlock(&ctx->usb_thread_mutex);
+		return NULL;
+	}
+	ctx->usb_thread = t;
+	ctx->usb_thread_users = 1;
+	g_mutex_unlock(&ctx->usb_thread_mutex);
+
+	sr_dbg("Started USB event thread.");
+
+	return t;
+}
+
+/** Stop and collect the USB event thread, if there is one. */
+SR_PRIV void usb_event_thread_cleanup(struct sr_context *ctx)
+{
+	usb_event_thread_join(ctx);
+}
+
+/* Event source removal, deferred to the session's main loop. */
+struct usb_source_removal {
+	struct sr_session *session;
+	struct sr_context *ctx;
+};
+
+static gboolean usb_source_remove_deferred(void *data)
+{
+	struct usb_source_removal *r;
+
+	r = data;
+	sr_session_source_remove_internal(r->session, r->ctx->libusb_ctx);
+	usb_event_thread_join(r->ctx);
+	g_free(r);
+
+	return G_SOURCE_REMOVE;
+}
+
+/*
+ * Enumeration snapshot of a scan pass. All scans of the pass look at the
+ * same device list, and the string descriptors of a device get read
+ * once, instead of each driver enumerating the bus and opening devices
+ * again.
+ */
+struct usb_strings {
+	gboolean read;
+	char *manufacturer;
+	char *product;
+	char *serial_number;
+};
+
+struct sr_usb_snapshot {
+	libusb_device **devlist;
+	ssize_t count;
+	struct usb_strings *strings;
+};
+
+static void usb_strings_read(libusb_device *dev, struct usb_strings *s)
+{
+	struct libusb_device_descriptor des;
+	struct libusb_device_handle *hdl;
+	unsigned char strdesc[64];
+
+	s->read = TRUE;
+	if (libusb_get_device_descriptor(dev, &des) != 0)
+		return;
+	if (libusb_open(dev, &hdl) != 0)
+		return;
+
+	if (des.iManufacturer && libusb_get_string_descriptor_ascii(hdl,
+			des.iManufacturer, strdesc, sizeof(strdesc)) >= 0)
+		s->manufacturer = g_strdup((const char *)strdesc);
+	if (des.iProduct && libusb_get_string_descriptor_ascii(hdl,
+			des.iProduct, strdesc, sizeof(strdesc)) >= 0)
+		s->product = g_strdup((const char *)strdesc);
+	if (des.iSerialNumber && libusb_get_string_descriptor_ascii(hdl,
+			des.iSerialNumber, strdesc, sizeof(strdesc)) >= 0)
+		s->serial_number = g_strdup((const char *)strdesc);
+
+	libusb_close(hdl);
+}
+
+static void usb_strings_clear(struct usb_strings *s)
+{
+	g_free(s->manufacturer);
+	g_free(s->product);
+	g_free(s->serial_number);
+	memset(s, 0, sizeof(*s));
+}
+
+/* Must be called with the snapshot mutex held. */
+static void usb_snapshot_free(struct sr_context *ctx)
+{
+	struct sr_usb_snapshot *snap;
+	ssize_t i;
+
+	if (!(snap = ctx->usb_snapshot))
+		return;
+	for (i = 0; i < snap->count; i++)
+		usb_strings_clear(&snap->strings[i]);
+	g_free(snap->strings);
+	libusb_free_device_list(snap->devlist, 1);
+	g_free(snap);
+	ctx->usb_snapshot = NULL;
+}
+
+/* Must be called with the snapshot mutex held. */
+static struct usb_strings *usb_snapshot_strings(struct sr_context *ctx,
+		libusb_device *dev)
+{
+	struct sr_usb_snapshot *snap;
+	ssize_t i;
+
+	if (!(snap = ctx->usb_snapshot))
+		return NULL;
+	for (i = 0; i < snap->count; i++) {
+		if (snap->devlist[i] != dev)
+			continue;
+		if (!snap->strings[i].read)
+			usb_strings_read(dev, &snap->strings[i]);
+		return &snap->strings[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * Start using an enumeration snapshot, see sr_scan_begin().
+ *
+ * @param ctx The libsigrok context. Must not be NULL.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_snapshot_begin(struct sr_context *ctx)
+{
+	g_mutex_lock(&ctx->usb_snapshot_mutex);
+	ctx->usb_snapshot_users++;
+	g_mutex_unlock(&ctx->usb_snapshot_mutex);
+}
+
+/**
+ * Stop using the enumeration snapshot, the last user frees it.
+ *
+ * @param ctx The libsigrok context. Must not be NULL.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_snapshot_end(struct sr_context *ctx)
+{
+	g_mutex_lock(&ctx->usb_snapshot_mutex);
+	if (ctx->usb_snapshot_users && !--ctx->usb_snapshot_users)
+		usb_snapshot_free(ctx);
+	g_mutex_unlock(&ctx->usb_snapshot_mutex);
+}
+
+/**
+ * Drop the enumeration snapshot, when devices are about to change,
+ * e.g. since they renumerate after a firmware upload. The next call to
+ * sr_usb_get_device_list() enumerates the bus again.
+ *
+ * @param ctx The libsigrok context. Must not be NULL.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_snapshot_invalidate(struct sr_context *ctx)
+{
+	g_mutex_lock(&ctx->usb_snapshot_mutex);
+	usb_snapshot_free(ctx);
+	g_mutex_unlock(&ctx->usb_snapshot_mutex);
+}
+
+/**
+ * Get the list of USB devices, like libusb_get_device_list() does.
+ *
+ * During a scan pass, the list comes from the context's snapshot, and
+ * only the first call enumerates the bus. The list must be freed with
+ * libusb_free_device_list(list, 1) in either case.
+ *
+ * @param ctx The libsigrok context. Must not be NULL.
+ * @param list The NULL terminated device list is stored here.
+ *
+ * @return The number of devices, or a (negative) libusb error code.
+ *
+ * @private
+ */
+SR_PRIV ssize_t sr_usb_get_device_list(struct sr_context *ctx,
+		libusb_device ***list)
+{
+	struct sr_usb_snapshot *snap;
+	libusb_device **copy;
+	ssize_t i, count;
+
+	g_mutex_lock(&ctx->usb_snapshot_mutex);
+
+	if (!ctx->usb_snapshot_users) {
+		g_mutex_unlock(&ctx->usb_snapshot_mutex);
+		return libusb_get_device_list(ctx->libusb_ctx, list);
+	}
+
+	if (!(snap = ctx->usb_snapshot)) {
+		snap = g_malloc0(sizeof(*snap));
+		count = libusb_get_device_list(ctx->libusb_ctx, &snap->devlist);
+		if (count < 0) {
+			g_free(snap);
+			g_mutex_unlock(&ctx->usb_snapshot_mutex);
+			return count;
+		}
+		snap->count = count;
+		snap->strings = g_malloc0_n(count + 1, sizeof(*snap->strings));
+		ctx->usb_snapshot = snap;
+	}
+
+	/* Callers free the list like libusb's, which needs malloc(). */
+	copy = calloc(snap->count + 1, sizeof(*copy));
+	if (!copy) {
+		g_mutex_unlock(&ctx->usb_snapshot_mutex);
+		return LIBUSB_ERROR_NO_MEM;
+	}
+	for (i = 0; i < snap->count; i++)
+		copy[i] = libusb_ref_device(snap->devlist[i]);
+	count = snap->count;
+
+	g_mutex_unlock(&ctx->usb_snapshot_mutex);
+
+	*list = copy;
+
+	return count;
+}
+
 /**
  * Find USB devices according to a connection string.
  *
- * @param usb_ctx libusb context to use while scanning.
+ * @param ctx libsigrok context to use while scanning.
  * @param conn Connection string specifying the device(s) to match. This
  * can be of the form "<bus>.<address>", or "<vendorid>.<productid>".
  *
@@ -307,7 +702,7 @@ static GSource *usb_source_new(struct sr_session *session,
  * matching the device that matched the connection string. The GSList and
  * its contents must be freed by the caller.
  */
-SR_PRIV GSList *sr_usb_find(libusb_context *usb_ctx, const char *conn)
+SR_PRIV GSList *sr_usb_find(struct sr_context *ctx, const char *conn)
 {
 	struct sr_usb_dev_inst *usb;
 	struct libusb_device **devlist;
@@ -364,7 +759,11 @@ SR_PRIV GSList *sr_usb_find(libusb_context *usb_ctx, const char *conn)
 
 	/* Looks like a valid USB device specification, but is it connected? */
 	devices = NULL;
-	libusb_get_device_list(usb_ctx, &devlist);
+	if ((ret = sr_usb_get_device_list(ctx, &devlist)) < 0) {
+		sr_err("Failed to get device list: %s.",
+		       libusb_error_name(ret));
+		return NULL;
+	}
 	for (i = 0; devlist[i]; i++) {
 		if ((ret = libusb_get_device_descriptor(devlist[i], &des))) {
 			sr_err("Failed to get device descriptor: %s.",
@@ -449,9 +848,16 @@ SR_PRIV int usb_source_add(struct sr_session *session, struct sr_context *ctx,
 		int timeout, sr_receive_data_callback cb, void *cb_data)
 {
 	GSource *source;
+	struct usb_event_thread *thread;
 	int ret;
 
-	source = usb_source_new(session, ctx->libusb_ctx, timeout);
+	thread = NULL;
+	if (ctx->usb_event_thread && !(thread = usb_event_thread_start(ctx,
+			&session->thread_sched[SR_SESSION_THREAD_USB_EVENTS -
+			SR_SESSION_THREAD_MAIN])))
+		sr_warn("Falling back to USB event handling in the main loop.");
+
+	source = usb_source_new(session, ctx->libusb_ctx, timeout, thread);
 	if (!source)
 		return SR_ERR;
 
@@ -465,7 +871,51 @@ SR_PRIV int usb_source_add(struct sr_session *session, struct sr_context *ctx,
 
 SR_PRIV int usb_source_remove(struct sr_session *session, struct sr_context *ctx)
 {
-	return sr_session_source_remove_internal(session, ctx->libusb_ctx);
+	struct usb_source_removal *r;
+	GSource *source;
+	gboolean last;
+	int ret;
+
+	if (!ctx->usb_thread)
+		return sr_session_source_remove_internal(session,
+			ctx->libusb_ctx);
+
+	/* Other sessions still need the thread, just drop this one's use. */
+	g_mutex_lock(&ctx->usb_thread_mutex);
+	last = ctx->usb_thread_users <= 1;
+	if (!last)
+		ctx->usb_thread_users--;
+	g_mutex_unlock(&ctx->usb_thread_mutex);
+	if (!last)
+		return sr_session_source_remove_internal(session,
+			ctx->libusb_ctx);
+
+	/*
+	 * Drivers usually end the acquisition from a transfer callback,
+	 * i.e. in the USB event thread, or from their main loop callback
+	 * which holds the event thread's lock. Either way the thread can't
+	 * be joined here. Remove the event source from the session's main
+	 * loop once the callback returned, the thread terminates after
+	 * its current iteration.
+	 */
+	if (g_thread_self() == ctx->usb_thread->thread ||
+			ctx->usb_thread->in_dispatch) {
+		g_atomic_int_set(&ctx->usb_thread->running, 0);
+		r = g_malloc(sizeof(*r));
+		r->session = session;
+		r->ctx = ctx;
+		source = g_idle_source_new();
+		g_source_set_callback(source, usb_source_remove_deferred,
+			r, NULL);
+		g_source_attach(source, session->main_context);
+		g_source_unref(source);
+		return SR_OK;
+	}
+
+	ret = sr_session_source_remove_internal(session, ctx->libusb_ctx);
+	usb_event_thread_join(ctx);
+
+	return ret;
 }
 
 SR_PRIV int usb_get_port_path(libusb_device *dev, char *path, int path_len)
@@ -514,39 +964,740 @@ SR_PRIV int usb_get_port_path(libusb_device *dev, char *path, int path_len)
  * @return TRUE if the device's configuration profile strings
  *         configuration, FALSE otherwise.
  */
-SR_PRIV gboolean usb_match_manuf_prod(libusb_device *dev,
-		const char *manufacturer, const char *product)
+SR_PRIV gboolean usb_match_manuf_prod(struct sr_context *ctx,
+		libusb_device *dev, const char *manufacturer, const char *product)
 {
-	struct libusb_device_descriptor des;
-	struct libusb_device_handle *hdl;
+	struct usb_strings tmp, *s;
 	gboolean ret;
-	unsigned char strdesc[64];
 
-	hdl = NULL;
-	ret = FALSE;
-	while (!ret) {
-		/* Assume the FW has not been loaded, unless proven wrong. */
-		libusb_get_device_descriptor(dev, &des);
+	/* Scan passes read each device's strings only once. */
+	g_mutex_lock(&ctx->usb_snapshot_mutex);
+	s = usb_snapshot_strings(ctx, dev);
+	if (!s) {
+		memset(&tmp, 0, sizeof(tmp));
+		usb_strings_read(dev, &tmp);
+		s = &tmp;
+	}
 
-		if (libusb_open(dev, &hdl) != 0)
-			break;
+	/* Assume the FW has not been loaded, unless proven wrong. */
+	ret = s->manufacturer && !strcmp(s->manufacturer, manufacturer) &&
+		s->product && !strcmp(s->product, product);
 
-		if (libusb_get_string_descriptor_ascii(hdl,
-				des.iManufacturer, strdesc, sizeof(strdesc)) < 0)
-			break;
-		if (strcmp((const char *)strdesc, manufacturer))
-			break;
+	if (s == &tmp)
+		usb_strings_clear(&tmp);
+	g_mutex_unlock(&ctx->usb_snapshot_mutex);
 
-		if (libusb_get_string_descriptor_ascii(hdl,
-				des.iProduct, strdesc, sizeof(strdesc)) < 0)
-			break;
-		if (strcmp((const char *)strdesc, product))
-			break;
+	return ret;
+}
+
+/** @cond PRIVATE */
+#define USB_XFER_POOL_ALIGN 4096
+/* Bounds of the runtime buffer size adjustment, as a power of two. */
+#define USB_XFER_POOL_MAX_SHIFT 4
+/* Transfers completing faster or slower than this get resized. */
+#define USB_XFER_POOL_MIN_PERIOD_US 1000
+#define USB_XFER_POOL_MAX_PERIOD_US 100000
+/* Minimum number of completions to base a sizing decision on. */
+#define USB_XFER_POOL_MIN_WINDOW 8
+/** @endcond */
+
+static unsigned char *xfer_pool_buffer_alloc(struct sr_usb_xfer_pool *pool,
+		size_t size)
+{
+	void *buf;
 
-		ret = TRUE;
+#if (LIBUSB_API_VERSION >= 0x01000105)
+	/*
+	 * Prefer memory that the kernel can DMA into directly (Linux
+	 * usbfs zero-copy). Either all buffers of the pool are device
+	 * memory or none of them, as they need to be freed differently.
+	 */
+	if ((pool->dev_mem || pool->num_transfers == 0) &&
+			!sr_usb_replay_get(pool->devhdl)) {
+		buf = libusb_dev_mem_alloc(pool->devhdl, size);
+		if (buf) {
+			pool->dev_mem = TRUE;
+			return buf;
+		}
+		if (pool->dev_mem)
+			return NULL;
 	}
-	if (hdl)
-		libusb_close(hdl);
+#endif
 
-	return ret;
+#ifdef _WIN32
+	buf = _aligned_malloc(size, USB_XFER_POOL_ALIGN);
+#else
+	if (posix_memalign(&buf, USB_XFER_POOL_ALIGN, size) != 0)
+		buf = NULL;
+#endif
+
+	return buf;
+}
+
+static void xfer_pool_buffer_free(struct sr_usb_xfer_pool *pool,
+		unsigned char *buf)
+{
+	if (!buf)
+		return;
+
+#if (LIBUSB_API_VERSION >= 0x01000105)
+	if (pool->dev_mem) {
+		libusb_dev_mem_free(pool->devhdl, buf, pool->buffer_size);
+		return;
+	}
+#endif
+
+#ifdef _WIN32
+	_aligned_free(buf);
+#else
+	free(buf);
+#endif
+}
+
+/**
+ * Get the USB transfer buffer size to use for an acquisition.
+ *
+ * @param pool The transfer pool of the device.
+ * @param size The size the driver would use by default.
+ *
+ * @return The user configured size (rounded up to a multiple of 512) if
+ *         there is one. Otherwise @a size, scaled by what previous
+ *         acquisitions found to work better (see sr_usb_xfer_pool_adapt()).
+ */
+SR_PRIV size_t sr_usb_xfer_pool_buffer_size(const struct sr_usb_xfer_pool *pool,
+		size_t size)
+{
+	if (pool->user_size)
+		return (pool->user_size + 511) & ~(size_t)511;
+
+	if (pool->size_shift > 0)
+		size <<= pool->size_shift;
+	else if (pool->size_shift < 0)
+		size >>= -pool->size_shift;
+	size = (size + 511) & ~(size_t)511;
+	if (size < 512)
+		size = 512;
+	if (size > USB_XFER_POOL_MAX_SIZE)
+		size = USB_XFER_POOL_MAX_SIZE;
+
+	return size;
+}
+
+/**
+ * Get the number of simultaneous USB transfers to use for an acquisition.
+ *
+ * @param pool The transfer pool of the device.
+ * @param num The number the driver would use by default.
+ *
+ * @return The user configured number if there is one, @a num otherwise.
+ */
+SR_PRIV unsigned int sr_usb_xfer_pool_depth(const struct sr_usb_xfer_pool *pool,
+		unsigned int num)
+{
+	return pool->user_depth ? pool->user_depth : num;
+}
+
+/**
+ * Make sure that a USB transfer pool holds at least @a num transfers with
+ * buffers of at least @a size bytes each.
+ *
+ * Transfers and their buffers are kept across acquisitions, so that only
+ * a change to larger or more buffers (or a different device handle)
+ * results in new allocations. Buffers are page aligned, and allocated
+ * with libusb_dev_mem_alloc() where libusb and the OS support it.
+ *
+ * Unless the user configured a fixed depth, the pool gets room for more
+ * than @a num transfers, which sr_usb_xfer_pool_adapt() can put in flight
+ * when the host cannot keep up.
+ *
+ * The pool must not be resized while any of its transfers is submitted.
+ *
+ * @param pool The transfer pool of the device.
+ * @param devhdl The USB device handle the transfers will be used on.
+ * @param num The number of transfers to start the acquisition with.
+ * @param size The buffer size needed.
+ *
+ * @retval SR_OK Success, the first pool->num_transfers entries of
+ *         pool->transfers (at least @a num) are usable. Each transfer's
+ *         buffer field points to its buffer.
+ * @retval SR_ERR_MALLOC Out of memory, the pool is empty.
+ */
+SR_PRIV int sr_usb_xfer_pool_alloc(struct sr_usb_xfer_pool *pool,
+		libusb_device_handle *devhdl, unsigned int num, size_t size)
+{
+	struct libusb_transfer *transfer;
+	unsigned int i, capacity;
+
+	pool->depth = num;
+	pool->min_depth = MAX(num / 2, 2);
+	pool->size = size;
+	pool->warmup = num;
+	pool->window_count = 0;
+	pool->max_burst = 0;
+
+	if (pool->devhdl == devhdl && num <= pool->num_transfers &&
+			size <= pool->buffer_size) {
+		sr_spew("Reusing %u of %u USB transfers of %zu bytes.",
+			num, pool->num_transfers, pool->buffer_size);
+		return SR_OK;
+	}
+
+	sr_usb_xfer_pool_free(pool);
+
+	capacity = num;
+	if (!pool->user_depth)
+		capacity = MIN(2 * num, USB_XFER_POOL_MAX_DEPTH);
+
+	pool->devhdl = devhdl;
+	pool->buffer_size = size;
+	pool->transfers = g_try_malloc0(capacity * sizeof(*pool->transfers));
+	if (!pool->transfers) {
+		sr_err("USB transfers malloc failed.");
+		return SR_ERR_MALLOC;
+	}
+
+	for (i = 0; i < capacity; i++) {
+		if (!(transfer = libusb_alloc_transfer(0))) {
+			sr_err("USB transfer allocation failed.");
+			sr_usb_xfer_pool_free(pool);
+			return SR_ERR_MALLOC;
+		}
+		transfer->buffer = xfer_pool_buffer_alloc(pool, size);
+		if (!transfer->buffer) {
+			sr_err("USB transfer buffer malloc failed.");
+			libusb_free_transfer(transfer);
+			sr_usb_xfer_pool_free(pool);
+			return SR_ERR_MALLOC;
+		}
+		transfer->length = size;
+		pool->transfers[i] = transfer;
+		pool->num_transfers++;
+	}
+
+	sr_dbg("Allocated %u USB transfers of %zu bytes%s.", capacity, size,
+		pool->dev_mem ? " (device memory)" : "");
+
+	return SR_OK;
+}
+
+/**
+ * Adjust the number of USB transfers in flight to how well the host keeps
+ * up with the device.
+ *
+ * Drivers call this for every transfer they are about to resubmit, and
+ * keep the returned number of transfers in flight: they retire the
+ * transfer instead of resubmitting it while more are in flight, and
+ * submit idle transfers from the pool while fewer are.
+ *
+ * When the host is late to handle completions (e.g. because the session
+ * is busy), the callbacks of all transfers the device filled in the
+ * meantime arrive in one burst. A burst which used up most of the
+ * transfers in flight came close to losing data, so the pool grows. With
+ * short bursts only, it slowly shrinks again, but not below half of what
+ * the driver started with.
+ *
+ * Transfers completing much faster or slower than the driver expected
+ * (more than 1000 per second, or less than 10) cost CPU time or add
+ * latency. Their buffer size can't change during an acquisition, so the
+ * adjustment applies to the next one (see sr_usb_xfer_pool_buffer_size()).
+ *
+ * User configured depth or size are never changed.
+ *
+ * @param pool The transfer pool of the device.
+ * @param transfer The finished transfer.
+ *
+ * @return The number of transfers to keep in flight.
+ */
+SR_PRIV unsigned int sr_usb_xfer_pool_adapt(struct sr_usb_xfer_pool *pool,
+		const struct libusb_transfer *transfer)
+{
+	int64_t now, period;
+	unsigned int window, step;
+
+	if (transfer->actual_length <= 0 ||
+			(transfer->status != LIBUSB_TRANSFER_COMPLETED &&
+			transfer->status != LIBUSB_TRANSFER_TIMED_OUT))
+		return pool->depth;
+
+	now = g_get_monotonic_time();
+
+	/* The first round of transfers was submitted all at once. */
+	if (pool->warmup > 0) {
+		pool->warmup--;
+		pool->window_start = pool->last_complete = now;
+		pool->burst = 1;
+		return pool->depth;
+	}
+
+	/* Completions less than a quarter period apart were queued up. */
+	if (pool->window_count > 0 && (now - pool->last_complete) * 4 <
+			(pool->last_complete - pool->window_start) /
+			pool->window_count)
+		pool->burst++;
+	else
+		pool->burst = 1;
+	pool->last_complete = now;
+	pool->max_burst = MAX(pool->max_burst, pool->burst);
+
+	window = MAX(pool->depth, USB_XFER_POOL_MIN_WINDOW);
+	if (++pool->window_count < window)
+		return pool->depth;
+
+	period = (now - pool->window_start) / pool->window_count;
+
+	if (!pool->user_depth) {
+		if (pool->max_burst * 4 > pool->depth * 3 &&
+				pool->depth < pool->num_transfers) {
+			step = MAX(pool->depth / 2, 1);
+			pool->depth = MIN(pool->depth + step, pool->num_transfers);
+			sr_dbg("Host fell %u USB transfers behind, now using %u.",
+				pool->max_burst, pool->depth);
+		} else if (pool->max_burst * 4 < pool->depth &&
+				pool->depth > pool->min_depth) {
+			pool->depth--;
+			sr_spew("Now using %u USB transfers.", pool->depth);
+		}
+	}
+
+	if (!pool->user_size) {
+		if (period < USB_XFER_POOL_MIN_PERIOD_US &&
+				pool->size_shift < USB_XFER_POOL_MAX_SHIFT &&
+				pool->size < USB_XFER_POOL_MAX_SIZE / 2) {
+			pool->size_shift++;
+			sr_dbg("USB transfers take %" PRIi64 "us, will use "
+				"larger ones.", period);
+		} else if (period > USB_XFER_POOL_MAX_PERIOD_US &&
+				pool->size_shift > -USB_XFER_POOL_MAX_SHIFT &&
+				pool->size > 1024) {
+			pool->size_shift--;
+			sr_dbg("USB transfers take %" PRIi64 "us, will use "
+				"smaller ones.", period);
+		}
+	}
+
+	pool->window_start = now;
+	pool->window_count = 0;
+	pool->max_burst = 0;
+
+	return pool->depth;
+}
+
+/**
+ * Release all transfers and buffers of a USB transfer pool.
+ *
+ * This must be called before the device handle the pool was allocated
+ * for gets closed, and while none of the transfers is submitted. User
+ * configured depth and size are kept.
+ *
+ * @param pool The transfer pool to release. Can be empty.
+ */
+SR_PRIV void sr_usb_xfer_pool_free(struct sr_usb_xfer_pool *pool)
+{
+	unsigned int i;
+
+	for (i = 0; i < pool->num_transfers; i++) {
+		xfer_pool_buffer_free(pool, pool->transfers[i]->buffer);
+		pool->transfers[i]->buffer = NULL;
+		libusb_free_transfer(pool->transfers[i]);
+	}
+	g_free(pool->transfers);
+	pool->transfers = NULL;
+	pool->num_transfers = 0;
+	pool->buffer_size = 0;
+	pool->dev_mem = FALSE;
+	pool->devhdl = NULL;
+}
+
+/**
+ * Handle the USB transfer pool config keys for a driver's config_get().
+ *
+ * Without a user configured value, this reports what the current (or
+ * last) acquisition uses, 0 before the first one.
+ *
+ * @return SR_OK if @a key was handled, SR_ERR_NA otherwise.
+ */
+SR_PRIV int sr_usb_xfer_pool_config_get(const struct sr_usb_xfer_pool *pool,
+		uint32_t key, GVariant **data)
+{
+	switch (key) {
+	case SR_CONF_USB_TRANSFER_DEPTH:
+		*data = g_variant_new_uint64(pool->user_depth ?
+			pool->user_depth : pool->depth);
+		break;
+	case SR_CONF_USB_TRANSFER_SIZE:
+		*data = g_variant_new_uint64(pool->user_size ?
+			pool->user_size : pool->size);
+		break;
+	default:
+		return SR_ERR_NA;
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Handle the USB transfer pool config keys for a driver's config_set().
+ *
+ * A value of 0 selects the driver's default. New values take effect on
+ * the next acquisition start.
+ *
+ * @return SR_OK if @a key was handled, SR_ERR_ARG for invalid values,
+ *         SR_ERR_NA for other keys.
+ */
+SR_PRIV int sr_usb_xfer_pool_config_set(struct sr_usb_xfer_pool *pool,
+		uint32_t key, GVariant *data)
+{
+	uint64_t value;
+
+	switch (key) {
+	case SR_CONF_USB_TRANSFER_DEPTH:
+		value = g_variant_get_uint64(data);
+		if (value > USB_XFER_POOL_MAX_DEPTH)
+			return SR_ERR_ARG;
+		pool->user_depth = value;
+		break;
+	case SR_CONF_USB_TRANSFER_SIZE:
+		value = g_variant_get_uint64(data);
+		if (value > USB_XFER_POOL_MAX_SIZE)
+			return SR_ERR_ARG;
+		pool->user_size = value;
+		break;
+	default:
+		return SR_ERR_NA;
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Count a finished USB transfer in the session's performance counters.
+ *
+ * Drivers call this first thing in their transfer callback.
+ *
+ * @param sdi The device the transfer belongs to.
+ * @param transfer The finished transfer.
+ */
+SR_PRIV void sr_usb_transfer_account(const struct sr_dev_inst *sdi,
+		const struct libusb_transfer *transfer)
+{
+	struct sr_session *session;
+
+	SR_PROBE3(usb_transfer_complete, transfer, transfer->status,
+		transfer->actual_length);
+	sr_session_receive_mark(transfer->actual_length > 0 ?
+		g_get_monotonic_time() : 0);
+	sr_usb_record_transfer(sdi, transfer);
+
+	if (!sdi || !(session = sdi->session))
+		return;
+
+	/* Runs in the USB event thread, if there is one. */
+	g_mutex_lock(&session->stats_mutex);
+	switch (transfer->status) {
+	case LIBUSB_TRANSFER_COMPLETED:
+		session->stats.usb_completed++;
+		break;
+	case LIBUSB_TRANSFER_TIMED_OUT:
+		session->stats.usb_timed_out++;
+		break;
+	case LIBUSB_TRANSFER_CANCELLED:
+		break;
+	default:
+		session->stats.usb_errors++;
+		break;
+	}
+	g_mutex_unlock(&session->stats_mutex);
+}
+
+/**
+ * Submit a USB transfer on the acquisition data path.
+ *
+ * This is libusb_submit_transfer(), plus a probe point for tracing.
+ *
+ * @param transfer The transfer to submit.
+ *
+ * @return The libusb_submit_transfer() result.
+ */
+SR_PRIV int sr_usb_transfer_submit(struct libusb_transfer *transfer)
+{
+	struct sr_usb_replay *r;
+
+	SR_PROBE2(usb_transfer_submit, transfer, transfer->length);
+
+	if ((r = sr_usb_replay_get(transfer->dev_handle)))
+		return sr_usb_replay_submit(r, transfer);
+
+	return libusb_submit_transfer(transfer);
+}
+
+/**
+ * Cancel a USB transfer on the acquisition data path.
+ *
+ * This is libusb_cancel_transfer(), which also works for replayed
+ * devices (see sr_usb_replay_open()).
+ *
+ * @param transfer The transfer to cancel.
+ *
+ * @return The libusb_cancel_transfer() result.
+ */
+SR_PRIV int sr_usb_transfer_cancel(struct libusb_transfer *transfer)
+{
+	struct sr_usb_replay *r;
+
+	if ((r = sr_usb_replay_get(transfer->dev_handle)))
+		return sr_usb_replay_cancel(r, transfer);
+
+	return libusb_cancel_transfer(transfer);
+}
+
+/**
+ * Find the NUMA node of the host controller a USB device is attached to.
+ *
+ * Buffers which the controller fills by DMA are best allocated there,
+ * see sr_mem_alloc_node().
+ *
+ * @param usb The USB device.
+ *
+ * @return The node, or -1 if unknown or not a NUMA system.
+ */
+SR_PRIV int sr_usb_numa_node(const struct sr_usb_dev_inst *usb)
+{
+#ifdef __linux__
+	char *path, *contents;
+	int node;
+
+	if (!usb)
+		return -1;
+
+	/* The root hub's parent is the controller's (PCI) device. */
+	path = g_strdup_printf("/sys/bus/usb/devices/usb%d/../numa_node",
+		usb->bus);
+	node = -1;
+	if (g_file_get_contents(path, &contents, NULL, NULL)) {
+		node = (int)g_ascii_strtoll(contents, NULL, 10);
+		g_free(contents);
+	}
+	g_free(path);
+
+	return node;
+#else
+	(void)usb;
+
+	return -1;
+#endif
+}
+
+/** @cond PRIVATE */
+#define USB_BULK_WRITE_XFER_SIZE (64 * 1024)
+#define USB_BULK_WRITE_XFERS 4
+/** @endcond */
+
+struct bulk_write {
+	gint pending;
+	gint status;
+};
+
+static void LIBUSB_CALL bulk_write_cb(struct libusb_transfer *transfer)
+{
+	struct bulk_write *bw;
+
+	bw = transfer->user_data;
+	if (transfer->status != LIBUSB_TRANSFER_COMPLETED
+			|| transfer->actual_length != transfer->length) {
+		sr_err("Bulk write of %d bytes failed (status %d, %d written).",
+			transfer->length, transfer->status,
+			transfer->actual_length);
+		g_atomic_int_set(&bw->status, SR_ERR);
+	}
+	g_atomic_int_dec_and_test(&bw->pending);
+}
+
+/**
+ * Write a buffer to a bulk OUT endpoint, with several large asynchronous
+ * transfers in flight.
+ *
+ * The bus stays busy between transfers, which synchronous writes of
+ * small blocks fail to achieve. Returns when all of the data was written
+ * or a transfer failed.
+ *
+ * @param ctx The libsigrok context.
+ * @param usb The opened device.
+ * @param endpoint The bulk OUT endpoint.
+ * @param data The data to write.
+ * @param len Length of the data.
+ * @param timeout Timeout per transfer, in ms.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR A transfer failed.
+ * @retval SR_ERR_MALLOC Transfers could not be allocated.
+ */
+SR_PRIV int sr_usb_bulk_write(struct sr_context *ctx,
+		const struct sr_usb_dev_inst *usb, unsigned char endpoint,
+		const uint8_t *data, size_t len, unsigned int timeout)
+{
+	struct libusb_transfer *xfers[USB_BULK_WRITE_XFERS];
+	struct bulk_write bw;
+	size_t pos, chunk;
+	int i, ret;
+
+	for (i = 0; i < USB_BULK_WRITE_XFERS; i++) {
+		if (!(xfers[i] = libusb_alloc_transfer(0))) {
+			while (i--)
+				libusb_free_transfer(xfers[i]);
+			return SR_ERR_MALLOC;
+		}
+	}
+
+	bw.pending = 0;
+	bw.status = SR_OK;
+	pos = 0;
+	while (pos < len && g_atomic_int_get(&bw.status) == SR_OK) {
+		for (i = 0; i < USB_BULK_WRITE_XFERS && pos < len; i++) {
+			chunk = MIN(len - pos, USB_BULK_WRITE_XFER_SIZE);
+			/* OUT transfers leave the buffer alone. */
+			libusb_fill_bulk_transfer(xfers[i], usb->devhdl,
+				endpoint, (unsigned char *)&data[pos], chunk,
+				bulk_write_cb, &bw, timeout);
+			g_atomic_int_inc(&bw.pending);
+			if ((ret = libusb_submit_transfer(xfers[i])) != 0) {
+				sr_err("Failed to submit bulk write: %s.",
+					libusb_error_name(ret));
+				g_atomic_int_dec_and_test(&bw.pending);
+				g_atomic_int_set(&bw.status, SR_ERR);
+				break;
+			}
+			pos += chunk;
+		}
+		/* The USB event thread may be the one completing them. */
+		while (g_atomic_int_get(&bw.pending))
+			libusb_handle_events_completed(ctx->libusb_ctx, NULL);
+	}
+
+	for (i = 0; i < USB_BULK_WRITE_XFERS; i++)
+		libusb_free_transfer(xfers[i]);
+
+	return g_atomic_int_get(&bw.status);
+}
+
+/**
+ * Get a bitstream into a device's FPGA, unless it runs it already.
+ *
+ * The context remembers a checksum of the bitstream it last uploaded to
+ * each device (by driver and USB address, which changes when the device
+ * gets reconnected). When that matches the requested bitstream, and the
+ * device tells that its FPGA is still configured, the upload is skipped.
+ * Otherwise, the bitstream is written to the loader's endpoint with
+ * sr_usb_bulk_write().
+ *
+ * @param sdi The opened device.
+ * @param loader How to talk to the device.
+ * @param name The bitstream's firmware resource name.
+ * @param max_size Largest bitstream size accepted.
+ * @param[out] size The bitstream's size, before padding. May be NULL.
+ *
+ * @retval SR_OK Success, the FPGA runs the bitstream.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR The bitstream could not be loaded, or the upload failed.
+ */
+SR_PRIV int sr_usb_fpga_configure(const struct sr_dev_inst *sdi,
+		const struct sr_usb_fpga_loader *loader, const char *name,
+		size_t max_size, size_t *size)
+{
+	struct drv_context *drvc;
+	struct sr_context *ctx;
+	const struct sr_usb_dev_inst *usb;
+	GBytes *bitstream;
+	const uint8_t *data;
+	uint8_t *padded;
+	gsize data_size, len;
+	gboolean matches, configured;
+	char *key, *checksum;
+	const char *uploaded;
+	int ret;
+
+	if (!sdi || !loader || !name || !sdi->conn)
+		return SR_ERR_ARG;
+
+	drvc = sdi->driver->context;
+	ctx = drvc->sr_ctx;
+	usb = sdi->conn;
+
+	bitstream = sr_resource_load_bytes(ctx, SR_RESOURCE_FIRMWARE, name,
+		max_size);
+	if (!bitstream)
+		return SR_ERR;
+	data = g_bytes_get_data(bitstream, &data_size);
+	if (size)
+		*size = data_size;
+
+	checksum = g_compute_checksum_for_data(G_CHECKSUM_SHA256,
+		data, data_size);
+	key = g_strdup_printf("%s/%d.%d", sdi->driver->name,
+		usb->bus, usb->address);
+
+	g_mutex_lock(&ctx->fpga_mutex);
+	uploaded = ctx->fpga_bitstreams ?
+		g_hash_table_lookup(ctx->fpga_bitstreams, key) : NULL;
+	matches = uploaded && !strcmp(uploaded, checksum);
+	g_mutex_unlock(&ctx->fpga_mutex);
+
+	/* Without asking the device, a power cycle would go unnoticed. */
+	configured = FALSE;
+	if (matches && loader->is_configured
+			&& loader->is_configured(sdi, &configured) != SR_OK)
+		configured = FALSE;
+
+	if (configured) {
+		sr_dbg("FPGA runs bitstream '%s' already.", name);
+		g_bytes_unref(bitstream);
+		g_free(checksum);
+		g_free(key);
+		return SR_OK;
+	}
+
+	sr_info("Uploading FPGA bitstream '%s'.", name);
+
+	/* Nothing known to run on the device while the upload is going. */
+	g_mutex_lock(&ctx->fpga_mutex);
+	if (ctx->fpga_bitstreams)
+		g_hash_table_remove(ctx->fpga_bitstreams, key);
+	g_mutex_unlock(&ctx->fpga_mutex);
+
+	padded = NULL;
+	len = data_size;
+	if (loader->pad_to > data_size) {
+		padded = g_malloc0(loader->pad_to);
+		memcpy(padded, data, data_size);
+		data = padded;
+		len = loader->pad_to;
+	}
+
+	ret = SR_OK;
+	if (loader->begin)
+		ret = loader->begin(sdi, data_size);
+	if (ret == SR_OK)
+		ret = sr_usb_bulk_write(ctx, usb, loader->endpoint, data, len,
+			loader->timeout);
+	if (ret == SR_OK && loader->end)
+		ret = loader->end(sdi);
+	g_free(padded);
+	g_bytes_unref(bitstream);
+
+	if (ret != SR_OK) {
+		sr_err("FPGA bitstream upload failed.");
+		g_free(checksum);
+		g_free(key);
+		return ret;
+	}
+	sr_info("FPGA bitstream upload (%" G_GSIZE_FORMAT " bytes) done.",
+		data_size);
+
+	g_mutex_lock(&ctx->fpga_mutex);
+	if (!ctx->fpga_bitstreams)
+		ctx->fpga_bitstreams = g_hash_table_new_full(g_str_hash,
+			g_str_equal, g_free, g_free);
+	g_hash_table_insert(ctx->fpga_bitstreams, key, checksum);
+	g_mutex_unlock(&ctx->fpga_mutex);
+
+	return SR_OK;
 }
@@ -0,0 +1,711 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_LIBUSB_1_0
+#include <libusb.h>
+#endif
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "usb-replay"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Recording of USB transfers, and their replay into drivers.
+ */
+
+/**
+ * @defgroup grp_usb_replay USB recording and replay
+ *
+ * Record the bulk transfers of a USB device, and feed them into the
+ * driver again without the hardware.
+ *
+ * While a device records (sr_usb_record_start()), the transfers which
+ * its driver receives are written to a file. A driver which supports
+ * replay opens such a file with SR_CONF_CONN set to "replay:<file>".
+ * The device then acquires from the file: the driver's transfer
+ * callbacks get the recorded payloads, as fast as they take them.
+ * This allows benchmarking and regression testing of the drivers'
+ * decoding without the hardware.
+ *
+ * @{
+ */
+
+/*
+ * File layout, all numbers little endian:
+ *
+ *   "SRUSBREC", uint32 version, uint32 metadata length,
+ *   metadata (a GKeyFile, group "device"),
+ *
+ * then one record per transfer:
+ *
+ *   uint64 time since the recording started in usecs, int32 libusb
+ *   transfer status, uint32 payload length, uint8 endpoint, three
+ *   bytes of padding, the payload.
+ */
+#define REC_MAGIC "SRUSBREC"
+#define REC_VERSION 1
+#define REC_HEADER_SIZE 16
+#define REC_RECORD_SIZE 20
+#define REC_GROUP "device"
+
+#ifdef HAVE_LIBUSB_1_0
+
+struct sr_usb_record {
+	GMutex mutex;
+	FILE *file;
+	int64_t start;
+	uint64_t transfers;
+	uint64_t bytes;
+};
+
+struct sr_usb_replay {
+	GMappedFile *file;
+	const uint8_t *data;
+	size_t size;
+	/* Offset of the first record, and of the next one to replay. */
+	size_t first;
+	size_t pos;
+	struct sr_usb_replay_info info;
+	/* Submitted and cancelled transfers, completed by replay_feed(). */
+	GMutex mutex;
+	GQueue pending;
+	GQueue cancelled;
+	struct sr_session *session;
+	uint64_t transfers;
+	uint64_t bytes;
+	int64_t start;
+};
+
+/*
+ * A replayed device's handle is its struct sr_usb_replay. These are
+ * never passed to libusb, the core looks them up here.
+ */
+static GHashTable *replay_handles;
+static gint num_replays;
+G_LOCK_DEFINE_STATIC(replay_handles);
+
+static struct sr_usb_record *record_get(const struct sr_dev_inst *sdi)
+{
+	struct sr_usb_dev_inst *usb;
+
+	if (!sdi || sdi->inst_type != SR_INST_USB || !(usb = sdi->conn))
+		return NULL;
+
+	return usb->record;
+}
+
+static char *record_metadata(const struct sr_dev_inst *sdi, gsize *len)
+{
+	struct sr_usb_dev_inst *usb;
+	struct libusb_device_descriptor des;
+	struct sr_channel *ch;
+	GKeyFile *meta;
+	GVariant *gvar;
+	GPtrArray *names;
+	GSList *l;
+	char *text;
+
+	usb = sdi->conn;
+	meta = g_key_file_new();
+	g_key_file_set_string(meta, REC_GROUP, "driver", sdi->driver->name);
+	if (usb->devhdl && libusb_get_device_descriptor(
+			libusb_get_device(usb->devhdl), &des) == 0) {
+		g_key_file_set_integer(meta, REC_GROUP, "vid", des.idVendor);
+		g_key_file_set_integer(meta, REC_GROUP, "pid", des.idProduct);
+	}
+	if (sdi->model)
+		g_key_file_set_string(meta, REC_GROUP, "model", sdi->model);
+	if (sr_config_get(sdi->driver, sdi, NULL, SR_CONF_SAMPLERATE,
+			&gvar) == SR_OK) {
+		g_key_file_set_uint64(meta, REC_GROUP, "samplerate",
+			g_variant_get_uint64(gvar));
+		g_variant_unref(gvar);
+	}
+	names = g_ptr_array_new();
+	for (l = sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->enabled)
+			g_ptr_array_add(names, ch->name);
+	}
+	g_key_file_set_string_list(meta, REC_GROUP, "channels",
+		(const char * const *)names->pdata, names->len);
+	g_ptr_array_free(names, TRUE);
+
+	text = g_key_file_to_data(meta, len, NULL);
+	g_key_file_free(meta);
+
+	return text;
+}
+
+/**
+ * Start recording a USB device's transfers to a file.
+ *
+ * Every transfer which the device's driver receives gets recorded
+ * with its timing, until sr_usb_record_stop(). This works with the
+ * drivers which account their transfers to the session, which the
+ * ones supporting replay all do. Start the recording after
+ * configuring the device, the file keeps its samplerate and enabled
+ * channels.
+ *
+ * @param sdi The device. Must be an opened USB device.
+ * @param path The file to write. An existing file is overwritten.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or not a USB device.
+ * @retval SR_ERR The file could not be written.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_usb_record_start(struct sr_dev_inst *sdi, const char *path)
+{
+	struct sr_usb_dev_inst *usb;
+	struct sr_usb_record *rec;
+	uint8_t header[REC_HEADER_SIZE];
+	char *meta;
+	gsize meta_len;
+	FILE *file;
+
+	if (!sdi || !path || sdi->inst_type != SR_INST_USB || !sdi->conn ||
+			!sdi->driver)
+		return SR_ERR_ARG;
+	usb = sdi->conn;
+	if (usb->record || usb->replay)
+		return SR_ERR_ARG;
+
+	if (!(file = g_fopen(path, "wb"))) {
+		sr_err("Cannot create '%s': %s.", path, g_strerror(errno));
+		return SR_ERR;
+	}
+
+	meta = record_metadata(sdi, &meta_len);
+	memcpy(header, REC_MAGIC, 8);
+	WL32(&header[8], REC_VERSION);
+	WL32(&header[12], meta_len);
+	if (fwrite(header, sizeof(header), 1, file) != 1 ||
+			fwrite(meta, meta_len, 1, file) != 1) {
+		sr_err("Cannot write '%s': %s.", path, g_strerror(errno));
+		g_free(meta);
+		fclose(file);
+		return SR_ERR;
+	}
+	g_free(meta);
+
+	rec = g_malloc0(sizeof(*rec));
+	g_mutex_init(&rec->mutex);
+	rec->file = file;
+	rec->start = g_get_monotonic_time();
+	usb->record = rec;
+	sr_info("Recording USB transfers to '%s'.", path);
+
+	return SR_OK;
+}
+
+/**
+ * Stop recording a USB device's transfers.
+ *
+ * Call this while the device does not acquire.
+ *
+ * @param sdi The device. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or the device did not record.
+ * @retval SR_ERR The file could not be written completely.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_usb_record_stop(struct sr_dev_inst *sdi)
+{
+	struct sr_usb_dev_inst *usb;
+	struct sr_usb_record *rec;
+	int ret;
+
+	if (!(rec = record_get(sdi)))
+		return SR_ERR_ARG;
+	usb = sdi->conn;
+
+	usb->record = NULL;
+	sr_info("Recorded %" PRIu64 " USB transfers, %" PRIu64 " bytes.",
+		rec->transfers, rec->bytes);
+	ret = fclose(rec->file) == 0 ? SR_OK : SR_ERR;
+	rec->file = NULL;
+	sr_usb_record_free(rec);
+
+	return ret;
+}
+
+/** @private */
+SR_PRIV void sr_usb_record_free(struct sr_usb_record *rec)
+{
+	if (!rec)
+		return;
+
+	if (rec->file)
+		fclose(rec->file);
+	g_mutex_clear(&rec->mutex);
+	g_free(rec);
+}
+
+/**
+ * Record a transfer which the driver received.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_record_transfer(const struct sr_dev_inst *sdi,
+		const struct libusb_transfer *transfer)
+{
+	struct sr_usb_record *rec;
+	uint8_t header[REC_RECORD_SIZE];
+	size_t len;
+
+	if (!(rec = record_get(sdi)))
+		return;
+
+	len = MAX(transfer->actual_length, 0);
+	WL64(&header[0], g_get_monotonic_time() - rec->start);
+	WL32(&header[8], (uint32_t)transfer->status);
+	WL32(&header[12], len);
+	header[16] = transfer->endpoint;
+	header[17] = header[18] = header[19] = 0;
+
+	/* Transfers may complete in the USB event thread. */
+	g_mutex_lock(&rec->mutex);
+	if (fwrite(header, sizeof(header), 1, rec->file) != 1 ||
+			(len && fwrite(transfer->buffer, len, 1, rec->file) != 1))
+		sr_err("Failed to record USB transfer: %s.", g_strerror(errno));
+	rec->transfers++;
+	rec->bytes += len;
+	g_mutex_unlock(&rec->mutex);
+}
+
+/* Map a recording, and check its header. */
+static GMappedFile *recording_open(const char *path, GKeyFile **meta,
+		size_t *first)
+{
+	GMappedFile *file;
+	GError *error;
+	const uint8_t *data;
+	size_t size, meta_len;
+
+	error = NULL;
+	if (!(file = g_mapped_file_new(path, FALSE, &error))) {
+		sr_err("Cannot open '%s': %s.", path, error->message);
+		g_error_free(error);
+		return NULL;
+	}
+	data = (const uint8_t *)g_mapped_file_get_contents(file);
+	size = g_mapped_file_get_length(file);
+
+	meta_len = size >= REC_HEADER_SIZE ? RL32(&data[12]) : 0;
+	if (size < REC_HEADER_SIZE || memcmp(data, REC_MAGIC, 8) ||
+			RL32(&data[8]) != REC_VERSION ||
+			meta_len > size - REC_HEADER_SIZE) {
+		sr_err("'%s' is not a USB recording.", path);
+		g_mapped_file_unref(file);
+		return NULL;
+	}
+
+	*meta = g_key_file_new();
+	if (!g_key_file_load_from_data(*meta,
+			(const char *)&data[REC_HEADER_SIZE], meta_len,
+			G_KEY_FILE_NONE, NULL) ||
+			!g_key_file_has_key(*meta, REC_GROUP, "driver", NULL)) {
+		sr_err("'%s' has no valid metadata.", path);
+		g_key_file_free(*meta);
+		g_mapped_file_unref(file);
+		return NULL;
+	}
+	*first = REC_HEADER_SIZE + meta_len;
+
+	return file;
+}
+
+/**
+ * Get the name of the driver a USB recording was made with.
+ *
+ * The recording is replayed by that driver, see sr_usb_record_start().
+ *
+ * @param path The recording.
+ * @param driver The driver's name is stored here. Free it with g_free().
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_DATA Not a USB recording.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_usb_recording_driver_get(const char *path, char **driver)
+{
+	GMappedFile *file;
+	GKeyFile *meta;
+	size_t first;
+
+	if (!path || !driver)
+		return SR_ERR_ARG;
+
+	if (!(file = recording_open(path, &meta, &first)))
+		return SR_ERR_DATA;
+	*driver = g_key_file_get_string(meta, REC_GROUP, "driver", NULL);
+	g_key_file_free(meta);
+	g_mapped_file_unref(file);
+
+	return SR_OK;
+}
+
+/**
+ * Open a USB recording for replay by a driver.
+ *
+ * Drivers call this from their scan() when they get a "replay:<file>"
+ * connection. The device instance's handle must not be passed to
+ * libusb. Transfers which the driver submits or cancels with
+ * sr_usb_transfer_submit() and sr_usb_transfer_cancel() get completed
+ * from the recording, once sr_usb_replay_start() was called.
+ *
+ * @param conn The connection, see SR_USB_REPLAY_PREFIX.
+ * @param driver The driver's name, which must match the recording's.
+ *
+ * @return The device instance, NULL when the recording can't be used.
+ *
+ * @private
+ */
+SR_PRIV struct sr_usb_dev_inst *sr_usb_replay_open(const char *conn,
+		const char *driver)
+{
+	struct sr_usb_dev_inst *usb;
+	struct sr_usb_replay *r;
+	struct sr_usb_replay_info *info;
+	GMappedFile *file;
+	GKeyFile *meta;
+	size_t first;
+	char *name;
+
+	if (!conn || !g_str_has_prefix(conn, SR_USB_REPLAY_PREFIX))
+		return NULL;
+
+	if (!(file = recording_open(conn + strlen(SR_USB_REPLAY_PREFIX),
+			&meta, &first)))
+		return NULL;
+	name = g_key_file_get_string(meta, REC_GROUP, "driver", NULL);
+	if (g_strcmp0(name, driver)) {
+		sr_err("Recording is from driver '%s', not '%s'.", name, driver);
+		g_free(name);
+		g_key_file_free(meta);
+		g_mapped_file_unref(file);
+		return NULL;
+	}
+	g_free(name);
+
+	r = g_malloc0(sizeof(*r));
+	r->file = file;
+	r->data = (const uint8_t *)g_mapped_file_get_contents(file);
+	r->size = g_mapped_file_get_length(file);
+	r->first = r->pos = first;
+	g_mutex_init(&r->mutex);
+	g_queue_init(&r->pending);
+	g_queue_init(&r->cancelled);
+
+	info = &r->info;
+	info->vid = g_key_file_get_integer(meta, REC_GROUP, "vid", NULL);
+	info->pid = g_key_file_get_integer(meta, REC_GROUP, "pid", NULL);
+	info->model = g_key_file_get_string(meta, REC_GROUP, "model", NULL);
+	info->samplerate = g_key_file_get_uint64(meta, REC_GROUP,
+		"samplerate", NULL);
+	info->channels = g_key_file_get_string_list(meta, REC_GROUP,
+		"channels", NULL, NULL);
+	g_key_file_free(meta);
+
+	G_LOCK(replay_handles);
+	if (!replay_handles)
+		replay_handles = g_hash_table_new(NULL, NULL);
+	g_hash_table_add(replay_handles, r);
+	g_atomic_int_inc(&num_replays);
+	G_UNLOCK(replay_handles);
+
+	usb = sr_usb_dev_inst_new(0, 0, (struct libusb_device_handle *)r);
+	usb->replay = r;
+
+	return usb;
+}
+
+/**
+ * Get what a USB recording tells about the recorded device.
+ *
+ * @param usb A device instance from sr_usb_replay_open().
+ *
+ * @private
+ */
+SR_PRIV const struct sr_usb_replay_info *sr_usb_replay_info_get(
+		const struct sr_usb_dev_inst *usb)
+{
+	return usb && usb->replay ? &usb->replay->info : NULL;
+}
+
+/**
+ * Enable the channels which were enabled during the recording.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_replay_channels_apply(struct sr_dev_inst *sdi)
+{
+	const struct sr_usb_replay_info *info;
+	struct sr_channel *ch;
+	GSList *l;
+
+	if (!(info = sr_usb_replay_info_get(sdi->conn)) || !info->channels)
+		return;
+
+	for (l = sdi->channels; l; l = l->next) {
+		ch = l->data;
+		ch->enabled = g_strv_contains(
+			(const char * const *)info->channels, ch->name);
+	}
+}
+
+/** @private */
+SR_PRIV void sr_usb_replay_free(struct sr_usb_replay *r)
+{
+	if (!r)
+		return;
+
+	G_LOCK(replay_handles);
+	g_hash_table_remove(replay_handles, r);
+	g_atomic_int_add(&num_replays, -1);
+	G_UNLOCK(replay_handles);
+
+	g_queue_clear(&r->pending);
+	g_queue_clear(&r->cancelled);
+	g_mutex_clear(&r->mutex);
+	g_free(r->info.model);
+	g_strfreev(r->info.channels);
+	g_mapped_file_unref(r->file);
+	g_free(r);
+}
+
+/**
+ * Find the replay a device handle belongs to.
+ *
+ * @return The replay, NULL for the handles of real devices.
+ *
+ * @private
+ */
+SR_PRIV struct sr_usb_replay *sr_usb_replay_get(
+		const struct libusb_device_handle *devhdl)
+{
+	struct sr_usb_replay *r;
+
+	/* Only look when anything replays, this is on the data path. */
+	if (!devhdl || !g_atomic_int_get(&num_replays))
+		return NULL;
+
+	G_LOCK(replay_handles);
+	r = g_hash_table_contains(replay_handles, devhdl) ?
+		(struct sr_usb_replay *)devhdl : NULL;
+	G_UNLOCK(replay_handles);
+
+	return r;
+}
+
+/** @private */
+SR_PRIV int sr_usb_replay_submit(struct sr_usb_replay *r,
+		struct libusb_transfer *transfer)
+{
+	g_mutex_lock(&r->mutex);
+	g_queue_push_tail(&r->pending, transfer);
+	g_mutex_unlock(&r->mutex);
+
+	return LIBUSB_SUCCESS;
+}
+
+/** @private */
+SR_PRIV int sr_usb_replay_cancel(struct sr_usb_replay *r,
+		struct libusb_transfer *transfer)
+{
+	int ret;
+
+	g_mutex_lock(&r->mutex);
+	if (g_queue_remove(&r->pending, transfer)) {
+		g_queue_push_tail(&r->cancelled, transfer);
+		ret = LIBUSB_SUCCESS;
+	} else {
+		ret = LIBUSB_ERROR_NOT_FOUND;
+	}
+	g_mutex_unlock(&r->mutex);
+
+	return ret;
+}
+
+/* Fill a transfer from the next record. FALSE at the end of the file. */
+static gboolean replay_next(struct sr_usb_replay *r,
+		struct libusb_transfer *transfer)
+{
+	const uint8_t *rec;
+	size_t len;
+
+	if (r->size - r->pos < REC_RECORD_SIZE)
+		return FALSE;
+	rec = &r->data[r->pos];
+	len = RL32(&rec[12]);
+	if (len > r->size - r->pos - REC_RECORD_SIZE) {
+		sr_warn("Recording is truncated.");
+		r->pos = r->size;
+		return FALSE;
+	}
+	r->pos += REC_RECORD_SIZE + len;
+
+	len = MIN(len, (size_t)MAX(transfer->length, 0));
+	memcpy(transfer->buffer, &rec[REC_RECORD_SIZE], len);
+	transfer->actual_length = len;
+	transfer->status = (enum libusb_transfer_status)RL32(&rec[8]);
+	r->transfers++;
+	r->bytes += len;
+
+	return TRUE;
+}
+
+/*
+ * Complete the transfers which the driver submitted (and cancelled)
+ * since the last call. The recording's timing is not kept, transfers
+ * complete as soon as the driver submits them.
+ */
+static int replay_feed(int fd, int revents, void *cb_data)
+{
+	struct sr_usb_replay *r;
+	struct libusb_transfer *transfer;
+	unsigned int num;
+	gboolean empty;
+	int64_t elapsed;
+
+	(void)fd;
+	(void)revents;
+
+	r = cb_data;
+
+	g_mutex_lock(&r->mutex);
+	num = g_queue_get_length(&r->pending);
+	g_mutex_unlock(&r->mutex);
+
+	while (num--) {
+		g_mutex_lock(&r->mutex);
+		transfer = g_queue_pop_head(&r->pending);
+		g_mutex_unlock(&r->mutex);
+		if (!transfer)
+			break;
+		if (!replay_next(r, transfer)) {
+			/* Like a device that got unplugged. */
+			transfer->actual_length = 0;
+			transfer->status = LIBUSB_TRANSFER_NO_DEVICE;
+		}
+		transfer->callback(transfer);
+	}
+
+	for (;;) {
+		g_mutex_lock(&r->mutex);
+		transfer = g_queue_pop_head(&r->cancelled);
+		g_mutex_unlock(&r->mutex);
+		if (!transfer)
+			break;
+		transfer->actual_length = 0;
+		transfer->status = LIBUSB_TRANSFER_CANCELLED;
+		transfer->callback(transfer);
+	}
+
+	g_mutex_lock(&r->mutex);
+	empty = g_queue_is_empty(&r->pending) && g_queue_is_empty(&r->cancelled);
+	g_mutex_unlock(&r->mutex);
+	if (!empty)
+		return G_SOURCE_CONTINUE;
+
+	/* The driver has nothing in flight, its acquisition ended. */
+	elapsed = MAX(g_get_monotonic_time() - r->start, 1);
+	sr_info("Replayed %" PRIu64 " transfers, %" PRIu64 " bytes in "
+		"%" PRIi64 " us (%.1f MB/s).", r->transfers, r->bytes,
+		elapsed, (double)r->bytes / elapsed);
+	r->session = NULL;
+
+	return G_SOURCE_REMOVE;
+}
+
+/**
+ * Start completing a replayed device's transfers.
+ *
+ * Drivers call this from their acquisition start, instead of adding
+ * the libusb event source, after they submitted their transfers. The
+ * replay restarts from the beginning of the recording. It ends after
+ * the driver did not resubmit any of its transfers, i.e. when the
+ * recording ran out or the acquisition got stopped.
+ *
+ * @param sdi The device, opened by sr_usb_replay_open().
+ *
+ * @private
+ */
+SR_PRIV int sr_usb_replay_start(const struct sr_dev_inst *sdi)
+{
+	struct sr_usb_dev_inst *usb;
+	struct sr_usb_replay *r;
+
+	usb = sdi->conn;
+	if (!usb || !(r = usb->replay))
+		return SR_ERR_ARG;
+	if (r->session)
+		return SR_ERR;
+
+	r->pos = r->first;
+	r->transfers = r->bytes = 0;
+	r->start = g_get_monotonic_time();
+	r->session = sdi->session;
+
+	return sr_session_fd_source_add(sdi->session, r, -1, 0, 0,
+		replay_feed, r);
+}
+
+#else
+
+SR_API int sr_usb_record_start(struct sr_dev_inst *sdi, const char *path)
+{
+	(void)sdi;
+	(void)path;
+
+	return SR_ERR_NA;
+}
+
+SR_API int sr_usb_record_stop(struct sr_dev_inst *sdi)
+{
+	(void)sdi;
+
+	return SR_ERR_NA;
+}
+
+SR_API int sr_usb_recording_driver_get(const char *path, char **driver)
+{
+	(void)path;
+	(void)driver;
+
+	return SR_ERR_NA;
+}
+
+#endif
+
+/** @} */
@@ -85,6 +85,221 @@ START_TEST(test_analog_to_float)
 }
 END_TEST
 
+START_TEST(test_analog_to_float_int)
+{
+	int ret;
+	unsigned int i;
+	float fout[4];
+	struct sr_channel ch;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	/* -2, 1, 256, 32767 as 16 bit big endian and little endian. */
+	const uint8_t be16[] = { 0xff, 0xfe, 0x00, 0x01, 0x01, 0x00, 0x7f, 0xff };
+	const uint8_t le16[] = { 0xfe, 0xff, 0x01, 0x00, 0x00, 0x01, 0xff, 0x7f };
+	const float expect[] = { -2 * 0.5 + 1, 1 * 0.5 + 1, 256 * 0.5 + 1,
+		32767 * 0.5 + 1 };
+	const float expect_unsigned = 65534 * 0.5 + 1;
+
+	sr_analog_init_(&analog, &encoding, &meaning, &spec, 3);
+	analog.num_samples = ARRAY_SIZE(fout);
+	meaning.channels = g_slist_append(NULL, &ch);
+	encoding.is_float = FALSE;
+	encoding.unitsize = 2;
+	encoding.is_signed = TRUE;
+	encoding.scale.p = 1;
+	encoding.scale.q = 2;
+	encoding.offset.p = 1;
+	encoding.offset.q = 1;
+
+	encoding.is_bigendian = TRUE;
+	analog.data = (void *)be16;
+	ret = sr_analog_to_float(&analog, fout);
+	fail_unless(ret == SR_OK, "sr_analog_to_float() failed: %d.", ret);
+	for (i = 0; i < ARRAY_SIZE(fout); i++)
+		fail_unless(fabs(fout[i] - expect[i]) <= 0.001,
+			"%f != %f (BE, i=%u)", fout[i], expect[i], i);
+
+	encoding.is_bigendian = FALSE;
+	analog.data = (void *)le16;
+	ret = sr_analog_to_float(&analog, fout);
+	fail_unless(ret == SR_OK, "sr_analog_to_float() failed: %d.", ret);
+	for (i = 0; i < ARRAY_SIZE(fout); i++)
+		fail_unless(fabs(fout[i] - expect[i]) <= 0.001,
+			"%f != %f (LE, i=%u)", fout[i], expect[i], i);
+
+	encoding.is_signed = FALSE;
+	ret = sr_analog_to_float(&analog, fout);
+	fail_unless(ret == SR_OK, "sr_analog_to_float() failed: %d.", ret);
+	fail_unless(fabs(fout[0] - expect_unsigned) <= 0.001,
+		"%f != %f (unsigned)", fout[0], expect_unsigned);
+
+	encoding.unitsize = 5;
+	ret = sr_analog_to_float(&analog, fout);
+	fail_unless(ret == SR_ERR, "Bogus unit size was accepted.");
+
+	g_slist_free(meaning.channels);
+}
+END_TEST
+
+/* Enough host order samples for the vectorized loops and a remainder. */
+START_TEST(test_analog_to_float_native)
+{
+	int ret;
+	unsigned int i;
+	float fout[19], expect;
+	struct sr_channel ch;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	uint8_t data8[ARRAY_SIZE(fout)];
+	uint16_t data16[ARRAY_SIZE(fout)];
+
+	for (i = 0; i < ARRAY_SIZE(fout); i++) {
+		data8[i] = i * 29;
+		data16[i] = i * 7919;
+	}
+
+	sr_analog_init_(&analog, &encoding, &meaning, &spec, 3);
+	analog.num_samples = ARRAY_SIZE(fout);
+	meaning.channels = g_slist_append(NULL, &ch);
+	encoding.is_float = FALSE;
+	encoding.scale.p = 3;
+	encoding.scale.q = 4;
+	encoding.offset.p = -5;
+	encoding.offset.q = 1;
+
+	encoding.unitsize = 1;
+	analog.data = data8;
+	for (encoding.is_signed = 0; encoding.is_signed < 2; encoding.is_signed++) {
+		ret = sr_analog_to_float(&analog, fout);
+		fail_unless(ret == SR_OK, "sr_analog_to_float() failed: %d.", ret);
+		for (i = 0; i < ARRAY_SIZE(fout); i++) {
+			expect = (encoding.is_signed ? (int8_t)data8[i] : data8[i]);
+			expect = expect * 0.75 - 5;
+			fail_unless(fabs(fout[i] - expect) <= 0.001,
+				"%f != %f (8 bit, i=%u)", fout[i], expect, i);
+		}
+	}
+
+	encoding.unitsize = 2;
+	analog.data = data16;
+	for (encoding.is_signed = 0; encoding.is_signed < 2; encoding.is_signed++) {
+		ret = sr_analog_to_float(&analog, fout);
+		fail_unless(ret == SR_OK, "sr_analog_to_float() failed: %d.", ret);
+		for (i = 0; i < ARRAY_SIZE(fout); i++) {
+			expect = (encoding.is_signed ? (int16_t)data16[i] : data16[i]);
+			expect = expect * 0.75 - 5;
+			fail_unless(fabs(fout[i] - expect) <= 0.01,
+				"%f != %f (16 bit, i=%u)", fout[i], expect, i);
+		}
+	}
+
+	g_slist_free(meaning.channels);
+}
+END_TEST
+
+START_TEST(test_analog_to_float_24_64)
+{
+	int ret;
+	unsigned int i;
+	float fout[2];
+	double din[2];
+	struct sr_channel ch;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	/* -2, 8388607 as 24 bit big endian and little endian. */
+	const uint8_t be24[] = { 0xff, 0xff, 0xfe, 0x7f, 0xff, 0xff };
+	const uint8_t le24[] = { 0xfe, 0xff, 0xff, 0xff, 0xff, 0x7f };
+	const float expect[] = { -2, 8388607 };
+
+	sr_analog_init_(&analog, &encoding, &meaning, &spec, 3);
+	analog.num_samples = ARRAY_SIZE(fout);
+	meaning.channels = g_slist_append(NULL, &ch);
+	encoding.is_float = FALSE;
+	encoding.unitsize = 3;
+	encoding.is_signed = TRUE;
+
+	encoding.is_bigendian = TRUE;
+	analog.data = (void *)be24;
+	ret = sr_analog_to_float(&analog, fout);
+	fail_unless(ret == SR_OK, "sr_analog_to_float() failed: %d.", ret);
+	for (i = 0; i < ARRAY_SIZE(fout); i++)
+		fail_unless(fabs(fout[i] - expect[i]) <= 0.001,
+			"%f != %f (BE, i=%u)", fout[i], expect[i], i);
+
+	encoding.is_bigendian = FALSE;
+	analog.data = (void *)le24;
+	ret = sr_analog_to_float(&analog, fout);
+	fail_unless(ret == SR_OK, "sr_analog_to_float() failed: %d.", ret);
+	for (i = 0; i < ARRAY_SIZE(fout); i++)
+		fail_unless(fabs(fout[i] - expect[i]) <= 0.001,
+			"%f != %f (LE, i=%u)", fout[i], expect[i], i);
+
+	encoding.is_signed = FALSE;
+	ret = sr_analog_to_float(&analog, fout);
+	fail_unless(ret == SR_OK, "sr_analog_to_float() failed: %d.", ret);
+	fail_unless(fabs(fout[0] - 16777214) <= 1,
+		"%f != 16777214 (unsigned)", fout[0]);
+
+	/* Doubles in host byte order, with a scale factor. */
+	encoding.is_float = TRUE;
+	encoding.is_signed = TRUE;
+#ifdef WORDS_BIGENDIAN
+	encoding.is_bigendian = TRUE;
+#endif
+	din[0] = 0.25;
+	din[1] = -1.5;
+	analog.data = din;
+	encoding.unitsize = sizeof(double);
+	encoding.scale.p = 2;
+	ret = sr_analog_to_float(&analog, fout);
+	fail_unless(ret == SR_OK, "sr_analog_to_float() failed: %d.", ret);
+	for (i = 0; i < ARRAY_SIZE(fout); i++)
+		fail_unless(fabs(fout[i] - 2 * din[i]) <= 0.001,
+			"%f != %f (double, i=%u)", fout[i], 2 * din[i], i);
+
+	g_slist_free(meaning.channels);
+}
+END_TEST
+
+START_TEST(test_analog_to_float_swapped)
+{
+	int ret;
+	unsigned int i;
+	union { float f; uint8_t b[sizeof(float)]; } in, swapped;
+	float fout;
+	struct sr_channel ch;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+
+	sr_analog_init_(&analog, &encoding, &meaning, &spec, 3);
+	analog.num_samples = 1;
+	analog.data = swapped.b;
+	meaning.channels = g_slist_append(NULL, &ch);
+
+	/* Float data in non-native byte order, with a scale factor. */
+	in.f = 12.5;
+	for (i = 0; i < sizeof(float); i++)
+		swapped.b[i] = in.b[sizeof(float) - 1 - i];
+	encoding.is_bigendian = !encoding.is_bigendian;
+	encoding.scale.p = 2;
+	encoding.scale.q = 1;
+
+	ret = sr_analog_to_float(&analog, &fout);
+	fail_unless(ret == SR_OK, "sr_analog_to_float() failed: %d.", ret);
+	fail_unless(fabs(fout - 25.0) <= 0.001, "%f != 25.0", fout);
+
+	g_slist_free(meaning.channels);
+}
+END_TEST
+
 START_TEST(test_analog_to_float_null)
 {
 	int ret;
@@ -123,6 +338,70 @@ START_TEST(test_analog_to_float_null)
 }
 END_TEST
 
+START_TEST(test_a2l_packed)
+{
+	int ret;
+	unsigned int i;
+	uint8_t data[20], out[3], state;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	const uint8_t expect_pos[] = { 0x00, 0xfc, 0x0f };
+	const uint8_t expect_neg[] = { 0xff, 0x07, 0x00 };
+	const uint8_t schmitt_in[] = { 0, 16, 10, 6, 3, 12, 15, 16, 4 };
+	const uint8_t expect_schmitt[] = { 0x8e, 0x00 };
+
+	for (i = 0; i < ARRAY_SIZE(data); i++)
+		data[i] = i;
+
+	/* Values are raw / 10 - 1, i.e. -1.0 .. 0.9. */
+	sr_analog_init_(&analog, &encoding, &meaning, &spec, 1);
+	encoding.is_float = FALSE;
+	encoding.unitsize = 1;
+	encoding.is_signed = FALSE;
+	encoding.scale.p = 1;
+	encoding.scale.q = 10;
+	encoding.offset.p = -1;
+	encoding.offset.q = 1;
+	analog.data = data;
+	analog.num_samples = ARRAY_SIZE(data);
+
+	ret = sr_a2l_threshold_packed(&analog, 0.0, out, ARRAY_SIZE(data));
+	fail_unless(ret == SR_OK, "sr_a2l_threshold_packed() failed: %d.", ret);
+	for (i = 0; i < ARRAY_SIZE(out); i++)
+		fail_unless(out[i] == expect_pos[i], "0x%02x != 0x%02x (i=%u)",
+			out[i], expect_pos[i], i);
+
+	/* Values are 1 - raw / 10, i.e. 1.0 .. -0.9. */
+	encoding.scale.p = -1;
+	encoding.offset.p = 1;
+	ret = sr_a2l_threshold_packed(&analog, 0.0, out, ARRAY_SIZE(data));
+	fail_unless(ret == SR_OK, "sr_a2l_threshold_packed() failed: %d.", ret);
+	for (i = 0; i < ARRAY_SIZE(out); i++)
+		fail_unless(out[i] == expect_neg[i], "0x%02x != 0x%02x (i=%u)",
+			out[i], expect_neg[i], i);
+
+	encoding.scale.p = 1;
+	encoding.offset.p = -1;
+	analog.data = (void *)schmitt_in;
+	analog.num_samples = ARRAY_SIZE(schmitt_in);
+	state = 0;
+	ret = sr_a2l_schmitt_trigger_packed(&analog, -0.5, 0.5, &state, out,
+		ARRAY_SIZE(schmitt_in));
+	fail_unless(ret == SR_OK, "sr_a2l_schmitt_trigger_packed() failed: %d.",
+		ret);
+	for (i = 0; i < ARRAY_SIZE(expect_schmitt); i++)
+		fail_unless(out[i] == expect_schmitt[i],
+			"0x%02x != 0x%02x (i=%u)", out[i], expect_schmitt[i], i);
+	fail_unless(state == 0, "Final state %u != 0.", state);
+
+	encoding.unitsize = 3;
+	ret = sr_a2l_threshold_packed(&analog, 0.0, out, 1);
+	fail_unless(ret == SR_ERR, "Bogus unit size was accepted.");
+}
+END_TEST
+
 START_TEST(test_analog_si_prefix)
 {
 	struct {
@@ -385,7 +664,12 @@ Suite *suite_analog(void)
 
 	tc = tcase_create("analog_to_float");
 	tcase_add_test(tc, test_analog_to_float);
+	tcase_add_test(tc, test_analog_to_float_int);
+	tcase_add_test(tc, test_analog_to_float_native);
+	tcase_add_test(tc, test_analog_to_float_24_64);
+	tcase_add_test(tc, test_analog_to_float_swapped);
 	tcase_add_test(tc, test_analog_to_float_null);
+	tcase_add_test(tc, test_a2l_packed);
 	tcase_add_test(tc, test_analog_si_prefix);
 	tcase_add_test(tc, test_analog_si_prefix_null);
 	tcase_add_test(tc, test_analog_unit_to_string);
@@ -0,0 +1,464 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Microbenchmarks for the datafeed hot paths, run with "make bench".
+ *
+ * All data comes from the demo driver at a fixed samplerate and sample
+ * count, so runs are comparable between builds. The optional argument
+ * scales the amount of data (default 1).
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+
+#define BENCH_SAMPLES (32 * 1000 * 1000)
+#define BENCH_KEEP_BYTES (4 * 1024 * 1024)
+#define BENCH_ANALOG_SAMPLES (1024 * 1024)
+#define BENCH_ANALOG_ROUNDS 64
+#define BENCH_INPUT_CHUNK (1024 * 1024)
+
+struct capture {
+	uint64_t bytes;
+	uint64_t samples;
+	/* Copies of the first BENCH_KEEP_BYTES of logic data, if set. */
+	gboolean keep;
+	uint64_t kept_bytes;
+	GSList *packets;
+};
+
+static struct sr_context *ctx;
+static uint64_t scale = 1;
+
+static void report(const char *name, uint64_t bytes, uint64_t samples,
+		int64_t us)
+{
+	double secs;
+
+	secs = MAX(us, 1) / (double)G_USEC_PER_SEC;
+	printf("%-32s %10.1f MB/s %10.2f MSa/s\n", name,
+		bytes / secs / (1000 * 1000), samples / secs / (1000 * 1000));
+}
+
+static void datafeed_count(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_logic *logic;
+	struct sr_datafeed_packet *copy;
+	struct capture *cap;
+
+	(void)sdi;
+
+	cap = cb_data;
+
+	if (packet->type != SR_DF_LOGIC)
+		return;
+
+	logic = packet->payload;
+	cap->bytes += logic->length;
+	cap->samples += logic->length / logic->unitsize;
+
+	if (!cap->keep || cap->kept_bytes >= BENCH_KEEP_BYTES)
+		return;
+	if (sr_packet_copy(packet, &copy) != SR_OK)
+		return;
+	cap->packets = g_slist_append(cap->packets, copy);
+	cap->kept_bytes += logic->length;
+}
+
+static struct sr_channel_group *channel_group_get(struct sr_dev_inst *sdi,
+		const char *name)
+{
+	struct sr_channel_group *cg;
+	GSList *l;
+
+	for (l = sr_dev_inst_channel_groups_get(sdi); l; l = l->next) {
+		cg = l->data;
+		if (!strcmp(cg->name, name))
+			return cg;
+	}
+
+	return NULL;
+}
+
+static void logic_pattern_set(struct sr_dev_inst *sdi, const char *pattern)
+{
+	sr_config_set(sdi, channel_group_get(sdi, "Logic"),
+		SR_CONF_PATTERN_MODE, g_variant_new_string(pattern));
+}
+
+/* Get the demo device, logic channels only, running as fast as it can. */
+static struct sr_dev_inst *demo_dev_get(void)
+{
+	struct sr_dev_driver **drivers, *driver;
+	struct sr_dev_inst *sdi;
+	struct sr_channel *ch;
+	GSList *devices, *l;
+	int i;
+
+	drivers = sr_driver_list(ctx);
+	driver = NULL;
+	for (i = 0; drivers[i]; i++) {
+		if (!strcmp(drivers[i]->name, "demo"))
+			driver = drivers[i];
+	}
+	if (!driver || sr_driver_init(ctx, driver) != SR_OK)
+		return NULL;
+
+	devices = sr_driver_scan(driver, NULL);
+	if (!devices)
+		return NULL;
+	sdi = devices->data;
+	g_slist_free(devices);
+
+	if (sr_dev_open(sdi) != SR_OK)
+		return NULL;
+
+	for (l = sr_dev_inst_channels_get(sdi); l; l = l->next) {
+		ch = l->data;
+		sr_dev_channel_enable(ch, ch->type == SR_CHANNEL_LOGIC);
+	}
+	sr_config_set(sdi, NULL, SR_CONF_SAMPLERATE,
+		g_variant_new_uint64(SR_GHZ(1)));
+	sr_config_set(sdi, NULL, SR_CONF_LIMIT_SAMPLES,
+		g_variant_new_uint64(scale * BENCH_SAMPLES));
+	logic_pattern_set(sdi, "sigrok");
+
+	return sdi;
+}
+
+static int64_t demo_run(struct sr_dev_inst *sdi, int num_callbacks,
+		struct sr_trigger *trigger, struct capture *cap)
+{
+	struct sr_session *session;
+	struct capture *extra;
+	int64_t start;
+	int i;
+
+	extra = g_malloc0(num_callbacks * sizeof(*extra));
+
+	sr_session_new(ctx, &session);
+	sr_session_dev_add(session, sdi);
+	sr_session_datafeed_callback_add(session, datafeed_count, cap);
+	for (i = 1; i < num_callbacks; i++)
+		sr_session_datafeed_callback_add(session, datafeed_count,
+			&extra[i]);
+	sr_session_trigger_set(session, trigger);
+
+	start = g_get_monotonic_time();
+	if (sr_session_start(session) == SR_OK)
+		sr_session_run(session);
+	start = g_get_monotonic_time() - start;
+
+	sr_session_destroy(session);
+	g_free(extra);
+
+	return start;
+}
+
+static void bench_session(struct sr_dev_inst *sdi)
+{
+	static const int fanout[] = { 1, 4 };
+	struct capture cap;
+	char name[64];
+	unsigned int i;
+	int64_t us;
+
+	for (i = 0; i < G_N_ELEMENTS(fanout); i++) {
+		memset(&cap, 0, sizeof(cap));
+		us = demo_run(sdi, fanout[i], NULL, &cap);
+		snprintf(name, sizeof(name), "session send, %d callback(s)",
+			fanout[i]);
+		report(name, cap.bytes * fanout[i], cap.samples * fanout[i], us);
+	}
+}
+
+static void bench_soft_trigger(struct sr_dev_inst *sdi)
+{
+	struct sr_trigger *trigger;
+	struct sr_trigger_stage *stage;
+	struct sr_channel *ch;
+	struct capture cap;
+	uint64_t samples;
+	int64_t us;
+
+	/* A rising edge on an all-low signal never fires. */
+	ch = sr_dev_inst_channels_get(sdi)->data;
+	trigger = sr_trigger_new(NULL);
+	stage = sr_trigger_stage_add(trigger);
+	sr_trigger_match_add(stage, ch, SR_TRIGGER_RISING, 0);
+
+	logic_pattern_set(sdi, "all-low");
+	memset(&cap, 0, sizeof(cap));
+	us = demo_run(sdi, 1, trigger, &cap);
+	logic_pattern_set(sdi, "sigrok");
+	sr_trigger_free(trigger);
+
+	/* Nothing is sent, all samples went through the trigger. */
+	samples = scale * BENCH_SAMPLES;
+	report("soft trigger, no match", samples, samples, us);
+}
+
+static void bench_analog_one(const char *name, void *data,
+		struct sr_analog_encoding *encoding, float *outbuf)
+{
+	struct sr_datafeed_analog analog;
+	uint64_t rounds, i;
+	int64_t us;
+
+	memset(&analog, 0, sizeof(analog));
+	analog.data = data;
+	analog.num_samples = BENCH_ANALOG_SAMPLES;
+	analog.encoding = encoding;
+
+	rounds = scale * BENCH_ANALOG_ROUNDS;
+	us = g_get_monotonic_time();
+	for (i = 0; i < rounds; i++)
+		sr_analog_to_float(&analog, outbuf);
+	us = g_get_monotonic_time() - us;
+
+	report(name, rounds * BENCH_ANALOG_SAMPLES * encoding->unitsize,
+		rounds * BENCH_ANALOG_SAMPLES, us);
+}
+
+static void bench_analog(void)
+{
+	struct sr_analog_encoding encoding;
+	int16_t *ibuf;
+	float *fbuf, *outbuf;
+	int i;
+
+	fbuf = g_malloc(BENCH_ANALOG_SAMPLES * sizeof(float));
+	ibuf = g_malloc(BENCH_ANALOG_SAMPLES * sizeof(int16_t));
+	outbuf = g_malloc(BENCH_ANALOG_SAMPLES * sizeof(float));
+	for (i = 0; i < BENCH_ANALOG_SAMPLES; i++) {
+		fbuf[i] = i / 1000.0;
+		ibuf[i] = i;
+	}
+
+	memset(&encoding, 0, sizeof(encoding));
+	encoding.unitsize = sizeof(float);
+	encoding.is_signed = TRUE;
+	encoding.is_float = TRUE;
+#ifdef WORDS_BIGENDIAN
+	encoding.is_bigendian = TRUE;
+#endif
+	encoding.scale.p = encoding.scale.q = 1;
+	encoding.offset.p = 0;
+	encoding.offset.q = 1;
+	bench_analog_one("analog to float, float", fbuf, &encoding, outbuf);
+
+	encoding.scale.p = 2;
+	encoding.scale.q = 3;
+	bench_analog_one("analog to float, float scaled", fbuf, &encoding,
+		outbuf);
+
+	encoding.unitsize = sizeof(int16_t);
+	encoding.is_float = FALSE;
+	bench_analog_one("analog to float, int16 scaled", ibuf, &encoding,
+		outbuf);
+
+	g_free(outbuf);
+	g_free(ibuf);
+	g_free(fbuf);
+}
+
+static void string_free(void *s)
+{
+	g_string_free(s, TRUE);
+}
+
+/*
+ * Run the captured packets through each output module. Keep the output
+ * of modules for which a same named input module exists, as test data
+ * for the input benchmark.
+ */
+static GHashTable *bench_outputs(struct sr_dev_inst *sdi, GSList *packets)
+{
+	const struct sr_output_module **omods;
+	const struct sr_output *o;
+	const struct sr_datafeed_packet *packet;
+	const struct sr_datafeed_logic *logic;
+	struct sr_datafeed_packet hdr_end;
+	struct sr_datafeed_header header;
+	GHashTable *results;
+	GString *out, *all;
+	GSList *l;
+	uint64_t bytes, samples;
+	gboolean keep;
+	int64_t us;
+	char name[64];
+	int i;
+
+	results = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+		string_free);
+
+	memset(&header, 0, sizeof(header));
+	header.feed_version = 1;
+
+	omods = sr_output_list();
+	for (i = 0; omods[i]; i++) {
+		if (sr_output_test_flag(omods[i], SR_OUTPUT_INTERNAL_IO_HANDLING))
+			continue;
+		if (!(o = sr_output_new(omods[i], NULL, sdi, NULL)))
+			continue;
+		keep = sr_input_find((char *)sr_output_id_get(omods[i])) != NULL;
+		all = g_string_new(NULL);
+		bytes = samples = 0;
+
+		us = g_get_monotonic_time();
+		hdr_end.type = SR_DF_HEADER;
+		hdr_end.payload = &header;
+		if (sr_output_send(o, &hdr_end, &out) == SR_OK && out) {
+			if (keep)
+				g_string_append_len(all, out->str, out->len);
+			g_string_free(out, TRUE);
+		}
+		for (l = packets; l; l = l->next) {
+			packet = l->data;
+			logic = packet->payload;
+			bytes += logic->length;
+			samples += logic->length / logic->unitsize;
+			out = NULL;
+			if (sr_output_send(o, packet, &out) != SR_OK || !out)
+				continue;
+			if (keep)
+				g_string_append_len(all, out->str, out->len);
+			g_string_free(out, TRUE);
+		}
+		hdr_end.type = SR_DF_END;
+		hdr_end.payload = NULL;
+		out = NULL;
+		if (sr_output_send(o, &hdr_end, &out) == SR_OK && out) {
+			if (keep)
+				g_string_append_len(all, out->str, out->len);
+			g_string_free(out, TRUE);
+		}
+		us = g_get_monotonic_time() - us;
+		sr_output_free(o);
+
+		snprintf(name, sizeof(name), "output %s",
+			sr_output_id_get(omods[i]));
+		report(name, bytes, samples, us);
+
+		if (keep && all->len)
+			g_hash_table_insert(results,
+				(void *)sr_output_id_get(omods[i]), all);
+		else
+			g_string_free(all, TRUE);
+	}
+
+	return results;
+}
+
+static void bench_input_one(const char *id, GString *data)
+{
+	const struct sr_input_module *imod;
+	const struct sr_input *in;
+	struct sr_session *session;
+	struct sr_dev_inst *sdi;
+	struct capture cap;
+	GString *chunk;
+	char name[64];
+	size_t pos, len;
+	int64_t us;
+	int ret;
+
+	if (!(imod = sr_input_find((char *)id)))
+		return;
+	if (!(in = sr_input_new(imod, NULL)))
+		return;
+
+	memset(&cap, 0, sizeof(cap));
+	sr_session_new(ctx, &session);
+	sr_session_datafeed_callback_add(session, datafeed_count, &cap);
+	sdi = NULL;
+	ret = SR_OK;
+
+	us = g_get_monotonic_time();
+	for (pos = 0; pos < data->len && ret == SR_OK; pos += len) {
+		len = MIN(data->len - pos, BENCH_INPUT_CHUNK);
+		chunk = g_string_new_len(data->str + pos, len);
+		ret = sr_input_send(in, chunk);
+		g_string_free(chunk, TRUE);
+		/* Modules only create the device after seeing some data. */
+		if (!sdi && (sdi = sr_input_dev_inst_get(in)))
+			sr_session_dev_add(session, sdi);
+	}
+	if (ret == SR_OK)
+		ret = sr_input_end(in);
+	us = g_get_monotonic_time() - us;
+
+	snprintf(name, sizeof(name), "input %s", id);
+	if (ret == SR_OK)
+		report(name, data->len, cap.samples, us);
+	else
+		printf("%-32s failed (%s)\n", name, sr_strerror(ret));
+
+	sr_input_free(in);
+	sr_session_destroy(session);
+}
+
+static void bench_inputs(GHashTable *data)
+{
+	GHashTableIter iter;
+	void *key, *value;
+
+	g_hash_table_iter_init(&iter, data);
+	while (g_hash_table_iter_next(&iter, &key, &value))
+		bench_input_one(key, value);
+}
+
+int main(int argc, char **argv)
+{
+	struct sr_dev_inst *sdi;
+	struct capture cap;
+	GHashTable *outputs;
+
+	if (argc > 1)
+		scale = MAX(1, g_ascii_strtoull(argv[1], NULL, 10));
+
+	if (sr_init(&ctx) != SR_OK)
+		return 1;
+	if (!(sdi = demo_dev_get())) {
+		fprintf(stderr, "Cannot set up the demo device.\n");
+		sr_exit(ctx);
+		return 1;
+	}
+
+	bench_session(sdi);
+	bench_soft_trigger(sdi);
+	bench_analog();
+
+	memset(&cap, 0, sizeof(cap));
+	cap.keep = TRUE;
+	demo_run(sdi, 1, NULL, &cap);
+	outputs = bench_outputs(sdi, cap.packets);
+	g_slist_free_full(cap.packets, (GDestroyNotify)sr_packet_free);
+
+	bench_inputs(outputs);
+	g_hash_table_destroy(outputs);
+
+	sr_dev_close(sdi);
+	sr_exit(ctx);
+
+	return 0;
+}
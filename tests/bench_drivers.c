@@ -0,0 +1,167 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Decode throughput of hardware drivers, run with
+ * "make bench-drivers BENCH_RECORDINGS='file...'".
+ *
+ * Every file is a USB recording taken with sr_usb_record_start() on
+ * real hardware. It gets replayed into the driver which recorded it,
+ * as fast as the driver takes the transfers, so the numbers show what
+ * the driver's receive path plus the session's datafeed cost.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+
+struct capture {
+	uint64_t bytes;
+	uint64_t samples;
+};
+
+static struct sr_context *ctx;
+
+static void datafeed_count(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_analog *analog;
+	struct capture *cap;
+
+	(void)sdi;
+
+	cap = cb_data;
+
+	if (packet->type == SR_DF_LOGIC) {
+		logic = packet->payload;
+		cap->bytes += logic->length;
+		cap->samples += logic->length / logic->unitsize;
+	} else if (packet->type == SR_DF_ANALOG) {
+		analog = packet->payload;
+		cap->bytes += analog->num_samples * analog->encoding->unitsize;
+		cap->samples += analog->num_samples;
+	}
+}
+
+static struct sr_dev_driver *driver_get(const char *name)
+{
+	struct sr_dev_driver **drivers;
+	int i;
+
+	drivers = sr_driver_list(ctx);
+	for (i = 0; drivers[i]; i++) {
+		if (!strcmp(drivers[i]->name, name))
+			return drivers[i];
+	}
+
+	return NULL;
+}
+
+static void bench_recording(const char *path)
+{
+	struct sr_dev_driver *driver;
+	struct sr_dev_inst *sdi;
+	struct sr_session *session;
+	struct sr_config src;
+	struct capture cap;
+	GSList *devices, *options;
+	char *name, *conn;
+	double secs;
+	int64_t us;
+	int ret;
+
+	if (sr_usb_recording_driver_get(path, &name) != SR_OK) {
+		printf("%-32s not a USB recording\n", path);
+		return;
+	}
+	if (!(driver = driver_get(name)) ||
+			sr_driver_init(ctx, driver) != SR_OK) {
+		printf("%-32s driver %s not available\n", path, name);
+		g_free(name);
+		return;
+	}
+
+	conn = g_strdup_printf("replay:%s", path);
+	src.key = SR_CONF_CONN;
+	src.data = g_variant_ref_sink(g_variant_new_string(conn));
+	options = g_slist_append(NULL, &src);
+	devices = sr_driver_scan(driver, options);
+	g_slist_free(options);
+	g_variant_unref(src.data);
+	g_free(conn);
+	if (!devices) {
+		printf("%-32s driver %s cannot replay it\n", path, name);
+		g_free(name);
+		return;
+	}
+	sdi = devices->data;
+	g_slist_free(devices);
+
+	if (sr_dev_open(sdi) != SR_OK) {
+		printf("%-32s cannot open the replay\n", path);
+		g_free(name);
+		return;
+	}
+
+	memset(&cap, 0, sizeof(cap));
+	sr_session_new(ctx, &session);
+	sr_session_dev_add(session, sdi);
+	sr_session_datafeed_callback_add(session, datafeed_count, &cap);
+
+	us = g_get_monotonic_time();
+	if ((ret = sr_session_start(session)) == SR_OK)
+		ret = sr_session_run(session);
+	us = g_get_monotonic_time() - us;
+
+	if (ret == SR_OK) {
+		secs = MAX(us, 1) / (double)G_USEC_PER_SEC;
+		printf("%-16s %-15s %10.1f MB/s %10.2f MSa/s\n", name,
+			sr_dev_inst_model_get(sdi),
+			cap.bytes / secs / (1000 * 1000),
+			cap.samples / secs / (1000 * 1000));
+	} else {
+		printf("%-32s failed (%s)\n", path, sr_strerror(ret));
+	}
+
+	sr_session_destroy(session);
+	sr_dev_close(sdi);
+	g_free(name);
+}
+
+int main(int argc, char **argv)
+{
+	int i;
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s recording...\n", argv[0]);
+		return 1;
+	}
+
+	if (sr_init(&ctx) != SR_OK)
+		return 1;
+
+	for (i = 1; i < argc; i++)
+		bench_recording(argv[i]);
+
+	sr_exit(ctx);
+
+	return 0;
+}
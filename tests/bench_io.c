@@ -0,0 +1,403 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Round trips of large captures through output and input modules, run
+ * with "make bench-io".
+ *
+ * A synthetic capture gets encoded by an output module, and the result
+ * is streamed straight into the input module of the same format, chunk
+ * by chunk, so nothing but the modules themselves holds on to data.
+ * srzip writes to and loads from a temporary file instead. For each
+ * format, the time and heap allocations of both directions, and the
+ * peak RSS of the whole round trip are reported. Memory that grows with
+ * the capture size shows up as a peak RSS which grows with the
+ * optional argument, the capture size in MiB (default 1024).
+ *
+ * MB/s and allocations per MiB both refer to the raw capture size, for
+ * either direction.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libsigrok/libsigrok.h>
+#include "bench_mem.h"
+
+#define IO_CHUNK (1024 * 1024)
+#define IO_SAMPLERATE SR_MHZ(100)
+#define IO_LOGIC_CHANNELS 8
+
+struct roundtrip {
+	const char *id;
+	gboolean analog;
+	const struct sr_output *out;
+	const struct sr_input *in;
+	struct sr_session *session;
+	gboolean dev_added;
+	int ret;
+	/* Raw capture bytes and samples, as sent and as read back. */
+	uint64_t bytes;
+	uint64_t samples_out;
+	uint64_t samples_in;
+	/* Size of the encoded capture. */
+	uint64_t encoded;
+	int64_t out_us, in_us;
+	uint64_t out_allocs, in_allocs;
+};
+
+static const struct {
+	const char *id;
+	gboolean analog;
+} formats[] = {
+	{ "binary", FALSE },
+	{ "csv", FALSE },
+	{ "vcd", FALSE },
+	{ "srzip", FALSE },
+	{ "wav", TRUE },
+};
+
+static struct sr_context *ctx;
+static uint64_t capture_bytes = 1024ULL * 1024 * 1024;
+
+static void datafeed_count(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_analog *analog;
+	struct roundtrip *rt;
+
+	(void)sdi;
+
+	rt = cb_data;
+
+	if (packet->type == SR_DF_LOGIC) {
+		logic = packet->payload;
+		rt->samples_in += logic->length / logic->unitsize;
+	} else if (packet->type == SR_DF_ANALOG) {
+		analog = packet->payload;
+		rt->samples_in += analog->num_samples;
+	}
+}
+
+/* Hand encoded data to the input module. */
+static void input_feed(struct roundtrip *rt, GString *data)
+{
+	struct sr_dev_inst *sdi;
+	uint64_t allocs;
+	int64_t us;
+
+	if (!rt->in || rt->ret != SR_OK)
+		return;
+
+	allocs = bench_mem_allocs();
+	us = g_get_monotonic_time();
+	rt->ret = sr_input_send(rt->in, data);
+	/* Modules only create the device after seeing some data. */
+	if (!rt->dev_added && (sdi = sr_input_dev_inst_get(rt->in))) {
+		sr_session_dev_add(rt->session, sdi);
+		rt->dev_added = TRUE;
+	}
+	rt->in_us += g_get_monotonic_time() - us;
+	rt->in_allocs += bench_mem_allocs() - allocs;
+}
+
+static void output_send(struct roundtrip *rt,
+		const struct sr_datafeed_packet *packet)
+{
+	GString *out;
+	uint64_t allocs;
+	int64_t us;
+
+	if (rt->ret != SR_OK)
+		return;
+
+	out = NULL;
+	allocs = bench_mem_allocs();
+	us = g_get_monotonic_time();
+	rt->ret = sr_output_send(rt->out, packet, &out);
+	rt->out_us += g_get_monotonic_time() - us;
+	rt->out_allocs += bench_mem_allocs() - allocs;
+
+	if (!out)
+		return;
+	rt->encoded += out->len;
+	input_feed(rt, out);
+	g_string_free(out, TRUE);
+}
+
+/* Every channel toggles at half the rate of the previous one. */
+static void logic_fill(uint8_t *buf, size_t len, uint64_t offset)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = (offset + i) >> 2;
+}
+
+static void analog_fill(float *buf, size_t num, uint64_t offset)
+{
+	size_t i;
+
+	for (i = 0; i < num; i++)
+		buf[i] = ((offset + i) % 1000) / 1000.0;
+}
+
+/* Send the whole synthetic capture through the output module. */
+static void capture_send(struct roundtrip *rt, struct sr_dev_inst *sdi)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_header header;
+	struct sr_datafeed_meta meta;
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	struct sr_config src;
+	GSList *l;
+	struct sr_channel *ch;
+	void *buf;
+	uint64_t pos;
+
+	memset(&header, 0, sizeof(header));
+	header.feed_version = 1;
+	packet.type = SR_DF_HEADER;
+	packet.payload = &header;
+	output_send(rt, &packet);
+
+	src.key = SR_CONF_SAMPLERATE;
+	src.data = g_variant_ref_sink(g_variant_new_uint64(IO_SAMPLERATE));
+	meta.config = g_slist_append(NULL, &src);
+	packet.type = SR_DF_META;
+	packet.payload = &meta;
+	output_send(rt, &packet);
+	g_slist_free(meta.config);
+	g_variant_unref(src.data);
+
+	buf = g_malloc(IO_CHUNK);
+
+	memset(&logic, 0, sizeof(logic));
+	logic.length = IO_CHUNK;
+	logic.unitsize = 1;
+	logic.data = buf;
+
+	memset(&analog, 0, sizeof(analog));
+	memset(&encoding, 0, sizeof(encoding));
+	memset(&meaning, 0, sizeof(meaning));
+	memset(&spec, 0, sizeof(spec));
+	encoding.unitsize = sizeof(float);
+	encoding.is_signed = TRUE;
+	encoding.is_float = TRUE;
+#ifdef WORDS_BIGENDIAN
+	encoding.is_bigendian = TRUE;
+#endif
+	encoding.digits = spec.spec_digits = 3;
+	encoding.is_digits_decimal = TRUE;
+	encoding.scale.p = encoding.scale.q = 1;
+	encoding.offset.p = 0;
+	encoding.offset.q = 1;
+	meaning.mq = SR_MQ_VOLTAGE;
+	meaning.unit = SR_UNIT_VOLT;
+	for (l = sr_dev_inst_channels_get(sdi); l; l = l->next) {
+		ch = l->data;
+		if (ch->type == SR_CHANNEL_ANALOG)
+			meaning.channels = g_slist_append(meaning.channels, ch);
+	}
+	analog.data = buf;
+	analog.num_samples = IO_CHUNK / sizeof(float);
+	analog.encoding = &encoding;
+	analog.meaning = &meaning;
+	analog.spec = &spec;
+
+	for (pos = 0; pos < capture_bytes && rt->ret == SR_OK;
+			pos += IO_CHUNK) {
+		if (rt->analog) {
+			analog_fill(buf, analog.num_samples,
+				pos / sizeof(float));
+			packet.type = SR_DF_ANALOG;
+			packet.payload = &analog;
+			rt->samples_out += analog.num_samples;
+		} else {
+			logic_fill(buf, IO_CHUNK, pos);
+			packet.type = SR_DF_LOGIC;
+			packet.payload = &logic;
+			rt->samples_out += IO_CHUNK;
+		}
+		output_send(rt, &packet);
+		rt->bytes += IO_CHUNK;
+	}
+
+	packet.type = SR_DF_END;
+	packet.payload = NULL;
+	output_send(rt, &packet);
+
+	g_slist_free(meaning.channels);
+	g_free(buf);
+}
+
+/* Load a session file the srzip output wrote, like a user would. */
+static void session_file_read(struct roundtrip *rt, const char *path)
+{
+	struct sr_session *session;
+	uint64_t allocs;
+	int64_t us;
+
+	allocs = bench_mem_allocs();
+	us = g_get_monotonic_time();
+	if ((rt->ret = sr_session_load(ctx, path, &session)) != SR_OK)
+		return;
+	sr_session_datafeed_callback_add(session, datafeed_count, rt);
+	if ((rt->ret = sr_session_start(session)) == SR_OK)
+		rt->ret = sr_session_run(session);
+	sr_session_destroy(session);
+	rt->in_us += g_get_monotonic_time() - us;
+	rt->in_allocs += bench_mem_allocs() - allocs;
+}
+
+static void report(const struct roundtrip *rt, uint64_t peak_kb)
+{
+	double mib, out_secs, in_secs;
+	char allocs[48];
+
+	if (rt->ret != SR_OK) {
+		printf("%-8s failed (%s)\n", rt->id, sr_strerror(rt->ret));
+		return;
+	}
+
+	mib = rt->bytes / (1024.0 * 1024);
+	out_secs = MAX(rt->out_us, 1) / (double)G_USEC_PER_SEC;
+	in_secs = MAX(rt->in_us, 1) / (double)G_USEC_PER_SEC;
+	if (bench_mem_counting())
+		snprintf(allocs, sizeof(allocs), "%9.1f %9.1f",
+			rt->out_allocs / mib, rt->in_allocs / mib);
+	else
+		snprintf(allocs, sizeof(allocs), "%9s %9s", "n/a", "n/a");
+
+	printf("%-8s %9.1f %9.1f %s %8" PRIu64 " %10.1f%s\n", rt->id,
+		rt->bytes / out_secs / (1000 * 1000),
+		rt->bytes / in_secs / (1000 * 1000), allocs,
+		peak_kb / 1024, rt->encoded / mib,
+		rt->samples_in == rt->samples_out ? "" : "  sample count differs");
+}
+
+static void bench_format(struct sr_dev_inst *sdi, const char *id,
+		gboolean analog)
+{
+	const struct sr_output_module *omod;
+	const struct sr_input_module *imod;
+	struct sr_channel *ch;
+	struct roundtrip rt;
+	GStatBuf st;
+	GSList *l;
+	char *path;
+	int fd;
+
+	if (!(omod = sr_output_find((char *)id)))
+		return;
+	imod = sr_input_find((char *)id);
+	if (!imod && strcmp(id, "srzip"))
+		return;
+
+	for (l = sr_dev_inst_channels_get(sdi); l; l = l->next) {
+		ch = l->data;
+		sr_dev_channel_enable(ch, analog == (ch->type == SR_CHANNEL_ANALOG));
+	}
+
+	memset(&rt, 0, sizeof(rt));
+	rt.id = id;
+	rt.analog = analog;
+	path = NULL;
+	if (!imod) {
+		if ((fd = g_file_open_tmp("bench-io-XXXXXX.sr", &path, NULL)) < 0)
+			return;
+		g_close(fd, NULL);
+	}
+
+	bench_mem_rss_peak_reset();
+	if (!(rt.out = sr_output_new(omod, NULL, sdi, path))) {
+		printf("%-8s cannot create the output\n", id);
+		goto out;
+	}
+	if (imod) {
+		if (!(rt.in = sr_input_new(imod, NULL))) {
+			printf("%-8s cannot create the input\n", id);
+			sr_output_free(rt.out);
+			goto out;
+		}
+		sr_session_new(ctx, &rt.session);
+		sr_session_datafeed_callback_add(rt.session, datafeed_count, &rt);
+	}
+
+	capture_send(&rt, sdi);
+	sr_output_free(rt.out);
+
+	if (rt.in) {
+		if (rt.ret == SR_OK)
+			rt.ret = sr_input_end(rt.in);
+		sr_input_free(rt.in);
+		sr_session_destroy(rt.session);
+	} else if (rt.ret == SR_OK) {
+		/* The output writes the file itself, get its size from there. */
+		if (g_stat(path, &st) == 0)
+			rt.encoded = st.st_size;
+		session_file_read(&rt, path);
+	}
+
+	report(&rt, bench_mem_rss_peak_kb());
+
+out:
+	if (path) {
+		g_unlink(path);
+		g_free(path);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct sr_dev_inst *sdi;
+	char name[8];
+	unsigned int i;
+
+	if (argc > 1)
+		capture_bytes = MAX(1, g_ascii_strtoull(argv[1], NULL, 10))
+			* 1024 * 1024;
+
+	if (sr_init(&ctx) != SR_OK)
+		return 1;
+
+	sdi = sr_dev_inst_user_new("sigrok", "bench", NULL);
+	for (i = 0; i < IO_LOGIC_CHANNELS; i++) {
+		snprintf(name, sizeof(name), "D%u", i);
+		sr_dev_inst_channel_add(sdi, i, SR_CHANNEL_LOGIC, name);
+	}
+	sr_dev_inst_channel_add(sdi, IO_LOGIC_CHANNELS, SR_CHANNEL_ANALOG, "A0");
+
+	printf("%" PRIu64 " MiB per format\n", capture_bytes / (1024 * 1024));
+	printf("%-8s %9s %9s %9s %9s %8s %10s\n", "format", "out MB/s",
+		"in MB/s", "out a/MiB", "in a/MiB", "peak MiB",
+		"enc B/MiB");
+	for (i = 0; i < G_N_ELEMENTS(formats); i++)
+		bench_format(sdi, formats[i].id, formats[i].analog);
+
+	sr_exit(ctx);
+
+	return 0;
+}
@@ -0,0 +1,131 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Heap allocations are counted by wrapping malloc() and friends of the
+ * C library, which g_malloc() ends up in as well. The wrappers take
+ * precedence over libc's for libsigrok and glib when linked into the
+ * benchmark program. That needs glibc's __libc_malloc() family; on
+ * other systems, nothing gets counted.
+ *
+ * The RSS comes from /proc, i.e. Linux only; elsewhere it reads 0.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include "bench_mem.h"
+
+#ifdef __GLIBC__
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static uint64_t num_allocs;
+
+void *malloc(size_t size)
+{
+	__atomic_add_fetch(&num_allocs, 1, __ATOMIC_RELAXED);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	__atomic_add_fetch(&num_allocs, 1, __ATOMIC_RELAXED);
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	/* Resizing is not a new allocation, realloc(NULL, ...) is. */
+	if (!ptr)
+		__atomic_add_fetch(&num_allocs, 1, __ATOMIC_RELAXED);
+	return __libc_realloc(ptr, size);
+}
+
+gboolean bench_mem_counting(void)
+{
+	return TRUE;
+}
+
+uint64_t bench_mem_allocs(void)
+{
+	return __atomic_load_n(&num_allocs, __ATOMIC_RELAXED);
+}
+
+#else
+
+gboolean bench_mem_counting(void)
+{
+	return FALSE;
+}
+
+uint64_t bench_mem_allocs(void)
+{
+	return 0;
+}
+
+#endif
+
+static uint64_t status_kb(const char *field)
+{
+	FILE *f;
+	char line[128];
+	size_t len;
+	uint64_t kb;
+
+	if (!(f = fopen("/proc/self/status", "r")))
+		return 0;
+
+	kb = 0;
+	len = strlen(field);
+	while (fgets(line, sizeof(line), f)) {
+		if (!strncmp(line, field, len) && line[len] == ':') {
+			kb = g_ascii_strtoull(line + len + 1, NULL, 10);
+			break;
+		}
+	}
+	fclose(f);
+
+	return kb;
+}
+
+/* Current resident set size in KiB. */
+uint64_t bench_mem_rss_kb(void)
+{
+	return status_kb("VmRSS");
+}
+
+/* Highest resident set size in KiB since start or the last reset. */
+uint64_t bench_mem_rss_peak_kb(void)
+{
+	return status_kb("VmHWM");
+}
+
+void bench_mem_rss_peak_reset(void)
+{
+	FILE *f;
+
+	/* Linux 4.0 and later reset the peak RSS on a write of "5". */
+	if (!(f = fopen("/proc/self/clear_refs", "w")))
+		return;
+	fputs("5", f);
+	fclose(f);
+}
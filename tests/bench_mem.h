@@ -0,0 +1,35 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Memory accounting for the benchmarks: heap allocation counts and
+ * the process' resident set size.
+ */
+
+#ifndef LIBSIGROK_TESTS_BENCH_MEM_H
+#define LIBSIGROK_TESTS_BENCH_MEM_H
+
+#include <stdint.h>
+#include <glib.h>
+
+gboolean bench_mem_counting(void);
+uint64_t bench_mem_allocs(void);
+uint64_t bench_mem_rss_kb(void);
+uint64_t bench_mem_rss_peak_kb(void);
+void bench_mem_rss_peak_reset(void);
+
+#endif
@@ -0,0 +1,270 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Soak test for long running sessions, run with
+ * "make bench-soak [BENCH_SOAK_ARGS='seconds [allocs [MiB]]']".
+ *
+ * The demo driver acquires continuously, through transforms, into a
+ * callback which copies and frees every packet like a front end would,
+ * and into output modules. Every few seconds the heap allocations per
+ * packet and the RSS get sampled and printed.
+ *
+ * After a warm-up of a tenth of the run, allocation counts and RSS are
+ * expected to be steady. The program fails when the allocations per
+ * packet exceed the second argument (default 64), or the RSS grew by
+ * more than the third argument (default 16 MiB) between the end of the
+ * warm-up and the end of the run. The first argument is the run time
+ * in seconds, by default two hours.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "bench_mem.h"
+
+#define SOAK_SAMPLERATE SR_MHZ(200)
+#define SOAK_INTERVAL_SECS 10
+
+static const char *const transforms[] = { "invert", "scale", "nop" };
+static const char *const outputs[] = { "binary", "vcd", "analog" };
+
+struct soak {
+	struct sr_session *session;
+	const struct sr_output *outputs[G_N_ELEMENTS(outputs)];
+	uint64_t packets;
+	uint64_t duration_secs;
+	uint64_t max_allocs;
+	uint64_t max_growth_kb;
+	/* Set when the session ended before the run time was over. */
+	gint ended;
+	gboolean failed;
+};
+
+static struct sr_context *ctx;
+
+static void datafeed_copy(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	struct sr_datafeed_packet *copy;
+	struct soak *soak;
+
+	(void)sdi;
+
+	soak = cb_data;
+
+	if (sr_packet_copy(packet, &copy) == SR_OK)
+		sr_packet_free(copy);
+	__atomic_add_fetch(&soak->packets, 1, __ATOMIC_RELAXED);
+}
+
+static void datafeed_output(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	struct soak *soak;
+	GString *out;
+	unsigned int i;
+
+	(void)sdi;
+
+	soak = cb_data;
+
+	for (i = 0; i < G_N_ELEMENTS(outputs); i++) {
+		if (!soak->outputs[i])
+			continue;
+		out = NULL;
+		if (sr_output_send(soak->outputs[i], packet, &out) == SR_OK && out)
+			g_string_free(out, TRUE);
+	}
+}
+
+static struct sr_dev_inst *demo_dev_get(void)
+{
+	struct sr_dev_driver **drivers, *driver;
+	struct sr_dev_inst *sdi;
+	GSList *devices;
+	int i;
+
+	drivers = sr_driver_list(ctx);
+	driver = NULL;
+	for (i = 0; drivers[i]; i++) {
+		if (!strcmp(drivers[i]->name, "demo"))
+			driver = drivers[i];
+	}
+	if (!driver || sr_driver_init(ctx, driver) != SR_OK)
+		return NULL;
+
+	devices = sr_driver_scan(driver, NULL);
+	if (!devices)
+		return NULL;
+	sdi = devices->data;
+	g_slist_free(devices);
+
+	if (sr_dev_open(sdi) != SR_OK)
+		return NULL;
+
+	/* No limit, the monitor stops the session. */
+	sr_config_set(sdi, NULL, SR_CONF_SAMPLERATE,
+		g_variant_new_uint64(SOAK_SAMPLERATE));
+
+	return sdi;
+}
+
+/*
+ * Sample allocations and RSS, and stop the session after the run time.
+ * Runs in its own thread, the session's thread is busy acquiring.
+ */
+static void *monitor_thread(void *data)
+{
+	struct soak *soak;
+	uint64_t packets, allocs, rss_kb, warm_packets, warm_allocs;
+	uint64_t last_packets, last_allocs, elapsed, warmup, growth_kb;
+	uint64_t warm_rss_kb;
+	double per_packet;
+
+	soak = data;
+
+	warmup = MAX(soak->duration_secs / 10, SOAK_INTERVAL_SECS);
+	warm_packets = warm_allocs = warm_rss_kb = 0;
+	packets = allocs = rss_kb = last_packets = last_allocs = 0;
+
+	printf("%8s %12s %12s %10s\n", "seconds", "packets", "allocs/pkt",
+		"RSS KiB");
+	for (elapsed = 0; elapsed < soak->duration_secs &&
+			!g_atomic_int_get(&soak->ended);) {
+		g_usleep(SOAK_INTERVAL_SECS * G_USEC_PER_SEC);
+		elapsed += SOAK_INTERVAL_SECS;
+
+		packets = __atomic_load_n(&soak->packets, __ATOMIC_RELAXED);
+		allocs = bench_mem_allocs();
+		rss_kb = bench_mem_rss_kb();
+		per_packet = packets > last_packets ? (allocs - last_allocs) /
+			(double)(packets - last_packets) : 0;
+		printf("%8" PRIu64 " %12" PRIu64 " %12.1f %10" PRIu64 "\n",
+			elapsed, packets, per_packet, rss_kb);
+		fflush(stdout);
+		last_packets = packets;
+		last_allocs = allocs;
+
+		if (!warm_packets && elapsed >= warmup) {
+			warm_packets = MAX(packets, 1);
+			warm_allocs = allocs;
+			warm_rss_kb = rss_kb;
+		}
+	}
+
+	sr_session_stop(soak->session);
+
+	if (g_atomic_int_get(&soak->ended)) {
+		printf("FAIL: the acquisition ended early.\n");
+		soak->failed = TRUE;
+		return NULL;
+	}
+	if (!warm_packets || packets <= warm_packets) {
+		printf("FAIL: no packets after the warm-up.\n");
+		soak->failed = TRUE;
+		return NULL;
+	}
+
+	per_packet = (allocs - warm_allocs) / (double)(packets - warm_packets);
+	growth_kb = rss_kb > warm_rss_kb ? rss_kb - warm_rss_kb : 0;
+	printf("steady state: %.1f allocations per packet, RSS grew by "
+		"%" PRIu64 " KiB\n", per_packet, growth_kb);
+
+	if (bench_mem_counting() && per_packet > soak->max_allocs) {
+		printf("FAIL: more than %" PRIu64 " allocations per packet.\n",
+			soak->max_allocs);
+		soak->failed = TRUE;
+	}
+	if (growth_kb > soak->max_growth_kb) {
+		printf("FAIL: RSS grew by more than %" PRIu64 " KiB.\n",
+			soak->max_growth_kb);
+		soak->failed = TRUE;
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	const struct sr_transform_module *tmod;
+	const struct sr_output_module *omod;
+	struct sr_dev_inst *sdi;
+	struct soak soak;
+	GThread *monitor;
+	unsigned int i;
+	int ret;
+
+	memset(&soak, 0, sizeof(soak));
+	soak.duration_secs = 2 * 60 * 60;
+	soak.max_allocs = 64;
+	soak.max_growth_kb = 16 * 1024;
+	if (argc > 1)
+		soak.duration_secs = MAX(1, g_ascii_strtoull(argv[1], NULL, 10));
+	if (argc > 2)
+		soak.max_allocs = g_ascii_strtoull(argv[2], NULL, 10);
+	if (argc > 3)
+		soak.max_growth_kb = g_ascii_strtoull(argv[3], NULL, 10) * 1024;
+
+	if (!bench_mem_counting())
+		printf("Allocations cannot be counted here, checking RSS only.\n");
+
+	if (sr_init(&ctx) != SR_OK)
+		return 1;
+	if (!(sdi = demo_dev_get())) {
+		fprintf(stderr, "Cannot set up the demo device.\n");
+		sr_exit(ctx);
+		return 1;
+	}
+
+	sr_session_new(ctx, &soak.session);
+	sr_session_dev_add(soak.session, sdi);
+	for (i = 0; i < G_N_ELEMENTS(transforms); i++) {
+		if ((tmod = sr_transform_find(transforms[i])))
+			sr_transform_new(tmod, NULL, sdi);
+	}
+	for (i = 0; i < G_N_ELEMENTS(outputs); i++) {
+		if ((omod = sr_output_find((char *)outputs[i])))
+			soak.outputs[i] = sr_output_new(omod, NULL, sdi, NULL);
+	}
+	sr_session_datafeed_callback_add(soak.session, datafeed_copy, &soak);
+	sr_session_datafeed_callback_add(soak.session, datafeed_output, &soak);
+
+	if ((ret = sr_session_start(soak.session)) != SR_OK) {
+		fprintf(stderr, "Cannot start the session: %s.\n",
+			sr_strerror(ret));
+		soak.failed = TRUE;
+	} else {
+		monitor = g_thread_new("soak-monitor", monitor_thread, &soak);
+		sr_session_run(soak.session);
+		g_atomic_int_set(&soak.ended, 1);
+		g_thread_join(monitor);
+	}
+
+	sr_session_destroy(soak.session);
+	for (i = 0; i < G_N_ELEMENTS(outputs); i++) {
+		if (soak.outputs[i])
+			sr_output_free(soak.outputs[i]);
+	}
+	sr_dev_close(sdi);
+	sr_exit(ctx);
+
+	return soak.failed ? 1 : 0;
+}
@@ -211,6 +211,125 @@ START_TEST(test_endian_write_inc)
 }
 END_TEST
 
+/*
+ * The bit by bit reference of the transposes: bit c of sample s is
+ * sample s of the width bits in words[c].
+ */
+static uint16_t transpose_ref(const uint64_t *words, int width, int s,
+		gboolean msb_first)
+{
+	uint16_t sample;
+	int c, bit;
+
+	sample = 0;
+	bit = msb_first ? width - 1 - s : s;
+	for (c = 0; c < 16; c++)
+		sample |= ((words[c] >> bit) & 1) << c;
+
+	return sample;
+}
+
+/* Random words, some channels disabled. */
+static void transpose_words(GRand *rand, uint64_t *words, int width)
+{
+	int c;
+
+	for (c = 0; c < 16; c++) {
+		words[c] = (uint64_t)g_rand_int(rand) << 32 | g_rand_int(rand);
+		if (width < 64)
+			words[c] &= (UINT64_C(1) << width) - 1;
+		if (g_rand_int_range(rand, 0, 4) == 0)
+			words[c] = 0;
+	}
+}
+
+START_TEST(test_transpose8x8)
+{
+	GRand *rand;
+	uint64_t x, t;
+	int i, r, c;
+
+	rand = g_rand_new_with_seed(8);
+	for (i = 0; i < 1000; i++) {
+		x = (uint64_t)g_rand_int(rand) << 32 | g_rand_int(rand);
+		t = sr_transpose8x8(x);
+		for (r = 0; r < 8; r++)
+			for (c = 0; c < 8; c++)
+				fail_unless(((t >> (8 * c + r)) & 1) ==
+					((x >> (8 * r + c)) & 1));
+	}
+	g_rand_free(rand);
+}
+END_TEST
+
+START_TEST(test_transpose16x16)
+{
+	GRand *rand;
+	uint64_t words[16];
+	uint16_t words16[16], samples[16], portable[16];
+	int i, c, s;
+
+	rand = g_rand_new_with_seed(16);
+	for (i = 0; i < 1000; i++) {
+		transpose_words(rand, words, 16);
+		for (c = 0; c < 16; c++)
+			words16[c] = words[c];
+		sr_transpose16x16(words16, samples);
+		sr_transpose16x16_portable(words16, portable);
+		for (s = 0; s < 16; s++) {
+			fail_unless(samples[s] == transpose_ref(words, 16, s, TRUE));
+			fail_unless(portable[s] == samples[s]);
+		}
+	}
+	g_rand_free(rand);
+}
+END_TEST
+
+START_TEST(test_transpose16x32)
+{
+	GRand *rand;
+	uint64_t words[16];
+	uint32_t words32[16];
+	uint16_t samples[32], portable[32];
+	int i, c, s;
+
+	rand = g_rand_new_with_seed(32);
+	for (i = 0; i < 1000; i++) {
+		transpose_words(rand, words, 32);
+		for (c = 0; c < 16; c++)
+			words32[c] = words[c];
+		sr_transpose16x32(words32, samples);
+		sr_transpose16x32_portable(words32, portable);
+		for (s = 0; s < 32; s++) {
+			fail_unless(samples[s] == transpose_ref(words, 32, s, TRUE));
+			fail_unless(portable[s] == samples[s]);
+		}
+	}
+	g_rand_free(rand);
+}
+END_TEST
+
+START_TEST(test_transpose16x64)
+{
+	GRand *rand;
+	uint64_t words[16];
+	uint16_t samples[64], portable[64];
+	int i, s;
+
+	rand = g_rand_new_with_seed(64);
+	for (i = 0; i < 1000; i++) {
+		transpose_words(rand, words, 64);
+		sr_transpose16x64(words, samples);
+		sr_transpose16x64_portable(words, portable);
+		for (s = 0; s < 64; s++) {
+			fail_unless(samples[s] == transpose_ref(words, 64, s, FALSE));
+			fail_unless(portable[s] == samples[s]);
+		}
+	}
+	g_rand_free(rand);
+}
+END_TEST
+
 Suite *suite_conv(void)
 {
 	Suite *s;
@@ -226,5 +345,12 @@ Suite *suite_conv(void)
 	tcase_add_test(tc, test_endian_write_inc);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("transpose");
+	tcase_add_test(tc, test_transpose8x8);
+	tcase_add_test(tc, test_transpose16x16);
+	tcase_add_test(tc, test_transpose16x32);
+	tcase_add_test(tc, test_transpose16x64);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
@@ -20,6 +20,8 @@
 #include <config.h>
 #include <stdlib.h>
 #include <check.h>
+#include <glib.h>
+#include <glib/gstdio.h>
 #include <libsigrok/libsigrok.h>
 #include "lib.h"
 
@@ -162,6 +164,135 @@ START_TEST(test_exit_null)
 }
 END_TEST
 
+/* Check whether the scan cache can be enabled and disabled. */
+START_TEST(test_scan_cache)
+{
+	int ret;
+	struct sr_context *sr_ctx;
+	char *dir, *filename;
+
+	ret = sr_init(&sr_ctx);
+	fail_unless(ret == SR_OK, "sr_init() failed: %d.", ret);
+
+	ret = sr_scan_cache_set(NULL, NULL);
+	fail_unless(ret == SR_ERR_ARG, "sr_scan_cache_set(NULL) failed: %d.", ret);
+
+	dir = g_dir_make_tmp("sr-test-XXXXXX", NULL);
+	fail_unless(dir != NULL, "g_dir_make_tmp() failed.");
+	filename = g_build_filename(dir, "scan-cache", NULL);
+	ret = sr_scan_cache_set(sr_ctx, filename);
+	fail_unless(ret == SR_OK, "sr_scan_cache_set() failed: %d.", ret);
+	ret = sr_scan_cache_set(sr_ctx, NULL);
+	fail_unless(ret == SR_OK, "sr_scan_cache_set(NULL) failed: %d.", ret);
+
+	/* Leave the cache enabled, sr_exit() must release it. */
+	ret = sr_scan_cache_set(sr_ctx, filename);
+	fail_unless(ret == SR_OK, "sr_scan_cache_set() failed: %d.", ret);
+	ret = sr_exit(sr_ctx);
+	fail_unless(ret == SR_OK, "sr_exit() failed: %d.", ret);
+
+	g_rmdir(dir);
+	g_free(filename);
+	g_free(dir);
+}
+END_TEST
+
+/* Check whether the memory budget can be set, and usage queried. */
+START_TEST(test_mem_budget)
+{
+	int ret;
+	struct sr_context *sr_ctx;
+	uint64_t in_memory, spilled;
+
+	ret = sr_init(&sr_ctx);
+	fail_unless(ret == SR_OK, "sr_init() failed: %d.", ret);
+
+	ret = sr_mem_budget_set(NULL, 0, NULL);
+	fail_unless(ret == SR_ERR_ARG, "sr_mem_budget_set(NULL) failed: %d.", ret);
+	ret = sr_mem_budget_set(sr_ctx, 1024 * 1024, NULL);
+	fail_unless(ret == SR_OK, "sr_mem_budget_set() failed: %d.", ret);
+
+	ret = sr_mem_usage_get(sr_ctx, NULL, &in_memory, &spilled);
+	fail_unless(ret == SR_OK, "sr_mem_usage_get() failed: %d.", ret);
+	fail_unless(in_memory == 0 && spilled == 0, "Unexpected memory usage.");
+	ret = sr_mem_usage_get(NULL, NULL, &in_memory, &spilled);
+	fail_unless(ret == SR_ERR_ARG, "sr_mem_usage_get(NULL) failed: %d.", ret);
+
+	ret = sr_exit(sr_ctx);
+	fail_unless(ret == SR_OK, "sr_exit() failed: %d.", ret);
+}
+END_TEST
+
+/* Check whether keys can be looked up by key and by name. */
+START_TEST(test_key_info)
+{
+	const struct sr_key_info *info;
+
+	info = sr_key_info_get(SR_KEY_CONFIG, SR_CONF_SAMPLERATE);
+	fail_unless(info != NULL, "SR_CONF_SAMPLERATE not found.");
+	fail_unless(info->datatype == SR_T_UINT64);
+	fail_unless(sr_key_info_name_get(SR_KEY_CONFIG, info->id) == info);
+
+	info = sr_key_info_name_get(SR_KEY_MQFLAGS, "rms");
+	fail_unless(info != NULL && info->key == SR_MQFLAG_RMS);
+
+	fail_unless(sr_key_info_get(SR_KEY_MQ, 0) == NULL);
+	fail_unless(sr_key_info_name_get(SR_KEY_CONFIG, "nosuchkey") == NULL);
+	fail_unless(sr_key_info_name_get(SR_KEY_CONFIG, NULL) == NULL);
+}
+END_TEST
+
+static int log_async_count;
+static gboolean log_async_in_caller;
+static GThread *log_async_caller;
+
+static int log_async_cb(void *cb_data, int loglevel, const char *format,
+		va_list args)
+{
+	(void)cb_data;
+	(void)loglevel;
+	(void)format;
+	(void)args;
+
+	if (g_thread_self() == log_async_caller)
+		log_async_in_caller = TRUE;
+	log_async_count++;
+
+	return SR_OK;
+}
+
+/* Check whether the asynchronous log sink emits, and folds repeats. */
+START_TEST(test_log_async)
+{
+	int ret, i;
+
+	log_async_count = 0;
+	log_async_in_caller = FALSE;
+	log_async_caller = g_thread_self();
+	sr_log_callback_set(log_async_cb, NULL);
+	sr_log_loglevel_set(SR_LOG_ERR);
+
+	ret = sr_log_async_start(16);
+	fail_unless(ret == SR_OK, "sr_log_async_start() failed: %d.", ret);
+	fail_unless(sr_log_async_start(16) == SR_ERR);
+
+	/* Logs the same "Invalid loglevel" error every time. */
+	for (i = 0; i < 5; i++)
+		sr_log_loglevel_set(SR_LOG_SPEW + 1);
+	ret = sr_log_async_stop();
+	fail_unless(ret == SR_OK, "sr_log_async_stop() failed: %d.", ret);
+
+	/* "Already started", the error once, and the number of repeats. */
+	fail_unless(log_async_count == 3, "%d messages emitted.",
+		log_async_count);
+	fail_unless(!log_async_in_caller,
+		"Asynchronous log message emitted by the caller.");
+
+	sr_log_loglevel_set(SR_LOG_NONE);
+	sr_log_callback_set_default();
+}
+END_TEST
+
 Suite *suite_core(void)
 {
 	Suite *s;
@@ -179,5 +310,21 @@ Suite *suite_core(void)
 	tcase_add_test(tc, test_exit_null);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("scan_cache");
+	tcase_add_test(tc, test_scan_cache);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("mem_budget");
+	tcase_add_test(tc, test_mem_budget);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("log_async");
+	tcase_add_test(tc, test_log_async);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("key_info");
+	tcase_add_test(tc, test_key_info);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
@@ -40,6 +40,100 @@ START_TEST(test_driver_init_all)
 }
 END_TEST
 
+/* Check whether a parallel scan finds the demo driver's devices. */
+START_TEST(test_driver_scan_parallel)
+{
+	struct sr_dev_driver *drivers[2];
+	GSList *devices;
+
+	drivers[0] = srtest_driver_get("demo");
+	drivers[1] = NULL;
+	srtest_driver_init(srtest_ctx, drivers[0]);
+
+	devices = sr_driver_scan_parallel(drivers, NULL, 0, 0);
+	fail_unless(devices != NULL, "Parallel scan found no devices.");
+	g_slist_free(devices);
+
+	devices = sr_driver_scan_parallel(NULL, NULL, 0, 0);
+	fail_unless(devices == NULL, "NULL driver list was accepted.");
+}
+END_TEST
+
+/* Check whether several keys can be set and read back at once. */
+START_TEST(test_config_multi)
+{
+	struct sr_dev_driver *driver;
+	struct sr_dev_inst *sdi;
+	struct sr_config configs[3];
+	GSList *devices;
+	int results[3], ret;
+
+	driver = srtest_driver_get("demo");
+	srtest_driver_init(srtest_ctx, driver);
+	devices = sr_driver_scan(driver, NULL);
+	fail_unless(devices != NULL, "No demo device found.");
+	sdi = devices->data;
+	g_slist_free(devices);
+	fail_unless(sr_dev_open(sdi) == SR_OK, "Cannot open the demo device.");
+
+	configs[0].key = SR_CONF_SAMPLERATE;
+	configs[0].data = g_variant_new_uint64(SR_KHZ(19));
+	configs[1].key = SR_CONF_LIMIT_SAMPLES;
+	configs[1].data = g_variant_new_uint64(1234);
+	ret = sr_config_set_multi(sdi, NULL, configs, 2, results);
+	fail_unless(ret == SR_OK, "Cannot set keys: %d.", ret);
+
+	configs[2].key = SR_CONF_PATTERN_MODE;
+	ret = sr_config_get_multi(driver, sdi, NULL, configs, 3, results);
+	fail_unless(ret == SR_ERR_ARG, "Unavailable key was accepted.");
+	fail_unless(results[0] == SR_OK && results[1] == SR_OK);
+	fail_unless(g_variant_get_uint64(configs[0].data) == SR_KHZ(19));
+	fail_unless(g_variant_get_uint64(configs[1].data) == 1234);
+	fail_unless(results[2] == SR_ERR_ARG && configs[2].data == NULL);
+	g_variant_unref(configs[0].data);
+	g_variant_unref(configs[1].data);
+
+	sr_dev_close(sdi);
+}
+END_TEST
+
+/* Check whether a kept alive device gets reopened with its settings. */
+START_TEST(test_dev_keepalive)
+{
+	struct sr_dev_driver *driver;
+	struct sr_dev_inst *sdi;
+	GSList *devices;
+	GVariant *data;
+	int ret;
+
+	driver = srtest_driver_get("demo");
+	srtest_driver_init(srtest_ctx, driver);
+	devices = sr_driver_scan(driver, NULL);
+	fail_unless(devices != NULL, "No demo device found.");
+	sdi = devices->data;
+	g_slist_free(devices);
+	fail_unless(sr_dev_open(sdi) == SR_OK, "Cannot open the demo device.");
+
+	ret = sr_dev_keepalive_set(sdi, TRUE);
+	fail_unless(ret == SR_OK, "sr_dev_keepalive_set() failed: %d.", ret);
+	sr_config_set(sdi, NULL, SR_CONF_SAMPLERATE,
+		g_variant_new_uint64(SR_KHZ(19)));
+	fail_unless(sr_dev_close(sdi) == SR_OK, "Cannot close the device.");
+	fail_unless(sr_dev_open(sdi) == SR_OK, "Cannot reopen the device.");
+
+	ret = sr_config_get(driver, sdi, NULL, SR_CONF_SAMPLERATE, &data);
+	fail_unless(ret == SR_OK, "Cannot get the samplerate: %d.", ret);
+	fail_unless(g_variant_get_uint64(data) == SR_KHZ(19));
+	g_variant_unref(data);
+
+	fail_unless(sr_dev_close(sdi) == SR_OK, "Cannot close the device.");
+	ret = sr_dev_keepalive_set(sdi, FALSE);
+	fail_unless(ret == SR_OK, "Closing the kept open device failed.");
+	ret = sr_dev_keepalive_set(NULL, TRUE);
+	fail_unless(ret == SR_ERR_ARG, "NULL device was accepted.");
+}
+END_TEST
+
 /*
  * Check whether setting a samplerate works.
  *
@@ -70,6 +164,9 @@ Suite *suite_driver_all(void)
 	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
 	tcase_add_test(tc, test_driver_available);
 	tcase_add_test(tc, test_driver_init_all);
+	tcase_add_test(tc, test_driver_scan_parallel);
+	tcase_add_test(tc, test_config_multi);
+	tcase_add_test(tc, test_dev_keepalive);
 	// TODO: Currently broken.
 	// tcase_add_test(tc, test_config_get_set_samplerate);
 	suite_add_tcase(s, tc);
@@ -19,6 +19,7 @@
 
 #include <config.h>
 #include <stdlib.h>
+#include <string.h>
 #include <check.h>
 #include <libsigrok/libsigrok.h>
 #include "lib.h"
@@ -33,6 +34,26 @@ START_TEST(test_input_available)
 }
 END_TEST
 
+/* Check that a buffer with a VCD header gets detected as such. */
+START_TEST(test_input_scan_buffer_vcd)
+{
+	const struct sr_input *in;
+	const char *id;
+	GString *buf;
+	int ret;
+
+	buf = g_string_new("$timescale 1 ns $end\n"
+		"$var wire 1 ! clk $end\n$enddefinitions $end\n");
+	ret = sr_input_scan_buffer(buf, &in);
+	fail_unless(ret == SR_OK, "sr_input_scan_buffer() failed: %d.", ret);
+	fail_unless(in != NULL, "No input instance created.");
+	id = sr_input_id_get(sr_input_module_get(in));
+	fail_unless(!strcmp(id, "vcd"), "Detected '%s' instead of 'vcd'.", id);
+	sr_input_free(in);
+	g_string_free(buf, TRUE);
+}
+END_TEST
+
 Suite *suite_input_all(void)
 {
 	Suite *s;
@@ -44,5 +65,10 @@ Suite *suite_input_all(void)
 	tcase_add_test(tc, test_input_available);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("scan");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_input_scan_buffer_vcd);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
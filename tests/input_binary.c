@@ -19,6 +19,7 @@
 
 #include <config.h>
 #include <check.h>
+#include <unistd.h>
 #include <glib/gstdio.h>
 #include <libsigrok/libsigrok.h>
 #include "lib.h"
@@ -308,6 +309,119 @@ START_TEST(test_input_binary_hello_world)
 }
 END_TEST
 
+START_TEST(test_input_binary_mapped)
+{
+	int ret, fd;
+	struct sr_input *in;
+	struct sr_session *session;
+	struct sr_dev_inst *sdi;
+	char *filename;
+
+	df_packet_counter = sample_counter = 0;
+	have_seen_df_end = FALSE;
+	logic_channellist = NULL;
+	check_to_perform = CHECK_HELLO_WORLD;
+	expected_samples = 11;
+	expected_samplerate = NULL;
+
+	fd = g_file_open_tmp("sr-input-binary-XXXXXX", &filename, NULL);
+	fail_unless(fd >= 0, "Failed to create temporary file.");
+	close(fd);
+	fail_unless(g_file_set_contents(filename, "Hello world", 11, NULL));
+
+	in = sr_input_new(sr_input_find("binary"), NULL);
+	fail_unless(in != NULL, "Failed to create input instance.");
+
+	/* The first call returns once the device instance is ready. */
+	ret = sr_input_send_mapped(in, filename);
+	fail_unless(ret == SR_OK, "sr_input_send_mapped() error: %d", ret);
+	sdi = sr_input_dev_inst_get(in);
+	fail_unless(sdi != NULL, "No device instance after mapping.");
+	fail_unless(df_packet_counter == 0, "Got packets before setup.");
+
+	sr_session_new(srtest_ctx, &session);
+	sr_session_datafeed_callback_add(session, datafeed_in, NULL);
+	sr_session_dev_add(session, sdi);
+
+	ret = sr_input_send_mapped(in, filename);
+	fail_unless(ret == SR_OK, "sr_input_send_mapped() error: %d", ret);
+	fail_unless(sample_counter == 11, "Expected 11 samples, got %"
+		PRIu64 ".", sample_counter);
+	ret = sr_input_end(in);
+	fail_unless(ret == SR_OK, "sr_input_end() error: %d", ret);
+	fail_unless(have_seen_df_end, "No SR_DF_END after sr_input_end().");
+
+	/* A missing file is an error. */
+	ret = sr_input_send_mapped(in, "/nonexistent/sigrok-input-file");
+	fail_unless(ret == SR_ERR, "Mapping a missing file didn't fail.");
+	fail_unless(sr_input_send_mapped(NULL, filename) == SR_ERR_ARG);
+	fail_unless(sr_input_send_mapped(in, NULL) == SR_ERR_ARG);
+
+	sr_input_free(in);
+	sr_session_destroy(session);
+	g_unlink(filename);
+	g_free(filename);
+}
+END_TEST
+
+START_TEST(test_input_binary_runner)
+{
+	int ret, fd;
+	struct sr_input *in;
+	struct sr_input_runner *runner;
+	struct sr_session *session;
+	struct sr_dev_inst *sdi;
+	char *filename;
+
+	df_packet_counter = sample_counter = 0;
+	have_seen_df_end = FALSE;
+	logic_channellist = NULL;
+	check_to_perform = CHECK_HELLO_WORLD;
+	expected_samples = 11;
+	expected_samplerate = NULL;
+
+	fd = g_file_open_tmp("sr-input-binary-XXXXXX", &filename, NULL);
+	fail_unless(fd >= 0, "Failed to create temporary file.");
+	close(fd);
+	fail_unless(g_file_set_contents(filename, "Hello world", 11, NULL));
+
+	in = sr_input_new(sr_input_find("binary"), NULL);
+	fail_unless(in != NULL, "Failed to create input instance.");
+
+	ret = sr_input_runner_new(in, filename, 0, &runner);
+	fail_unless(ret == SR_OK, "sr_input_runner_new() error: %d", ret);
+	ret = sr_input_runner_wait_ready(runner);
+	fail_unless(ret == SR_OK, "sr_input_runner_wait_ready() error: %d", ret);
+	sdi = sr_input_dev_inst_get(in);
+	fail_unless(sdi != NULL, "No device instance when ready.");
+	fail_unless(df_packet_counter == 0, "Got packets before setup.");
+
+	sr_session_new(srtest_ctx, &session);
+	sr_session_datafeed_callback_add(session, datafeed_in, NULL);
+	sr_session_dev_add(session, sdi);
+
+	/* All packets are delivered when the run returns. */
+	ret = sr_input_runner_run(runner);
+	fail_unless(ret == SR_OK, "sr_input_runner_run() error: %d", ret);
+	fail_unless(have_seen_df_end, "No SR_DF_END after the run.");
+	fail_unless(sample_counter == 11, "Expected 11 samples, got %"
+		PRIu64 ".", sample_counter);
+	sr_input_runner_free(runner);
+
+	/* A missing file is an error. */
+	ret = sr_input_runner_new(in, "/nonexistent/sigrok-input-file", 0,
+		&runner);
+	fail_unless(ret == SR_ERR, "Opening a missing file didn't fail.");
+	fail_unless(runner == NULL);
+	fail_unless(sr_input_runner_new(NULL, filename, 0, &runner) == SR_ERR_ARG);
+
+	sr_input_free(in);
+	sr_session_destroy(session);
+	g_unlink(filename);
+	g_free(filename);
+}
+END_TEST
+
 Suite *suite_input_binary(void)
 {
 	Suite *s;
@@ -321,6 +435,8 @@ Suite *suite_input_binary(void)
 	tcase_add_test(tc, test_input_binary_all_high);
 	tcase_add_loop_test(tc, test_input_binary_all_high_loop, 1, 10);
 	tcase_add_test(tc, test_input_binary_hello_world);
+	tcase_add_test(tc, test_input_binary_mapped);
+	tcase_add_test(tc, test_input_binary_runner);
 	suite_add_tcase(s, tc);
 
 	return s;
@@ -160,3 +160,52 @@ GArray *srtest_get_enabled_logic_channels(const struct sr_dev_inst *sdi)
 
 	return channels;
 }
+
+/* Scan and open a demo device with the given numbers of channels. */
+struct sr_dev_inst *srtest_demo_dev_new(int num_logic, int num_analog)
+{
+	struct sr_dev_driver *driver;
+	struct sr_dev_inst *sdi;
+	struct sr_config opts[2];
+	GSList *options, *devices;
+
+	driver = srtest_driver_get("demo");
+	srtest_driver_init(srtest_ctx, driver);
+
+	opts[0].key = SR_CONF_NUM_LOGIC_CHANNELS;
+	opts[0].data = g_variant_ref_sink(g_variant_new_int32(num_logic));
+	opts[1].key = SR_CONF_NUM_ANALOG_CHANNELS;
+	opts[1].data = g_variant_ref_sink(g_variant_new_int32(num_analog));
+	options = g_slist_append(g_slist_append(NULL, &opts[0]), &opts[1]);
+	devices = sr_driver_scan(driver, options);
+	g_slist_free(options);
+	g_variant_unref(opts[0].data);
+	g_variant_unref(opts[1].data);
+	fail_unless(devices != NULL, "No demo device found.");
+
+	sdi = devices->data;
+	g_slist_free(devices);
+	fail_unless(sr_dev_open(sdi) == SR_OK, "Cannot open the demo device.");
+
+	return sdi;
+}
+
+/* Set the pattern of a demo device's logic channels. */
+void srtest_demo_pattern_set(struct sr_dev_inst *sdi, const char *pattern)
+{
+	struct sr_channel_group *cg;
+	GSList *l;
+	int ret;
+
+	for (l = sr_dev_inst_channel_groups_get(sdi); l; l = l->next) {
+		cg = l->data;
+		if (strcmp(cg->name, "Logic"))
+			continue;
+		ret = sr_config_set(sdi, cg, SR_CONF_PATTERN_MODE,
+			g_variant_new_string(pattern));
+		fail_unless(ret == SR_OK, "Cannot set pattern '%s': %d.",
+			pattern, ret);
+		return;
+	}
+	fail("No logic channel group found.");
+}
@@ -41,6 +41,9 @@ void srtest_check_samplerate(struct sr_context *sr_ctx, const char *drivername,
 
 GArray *srtest_get_enabled_logic_channels(const struct sr_dev_inst *sdi);
 
+struct sr_dev_inst *srtest_demo_dev_new(int num_logic, int num_analog);
+void srtest_demo_pattern_set(struct sr_dev_inst *sdi, const char *pattern);
+
 Suite *suite_core(void);
 Suite *suite_driver_all(void);
 Suite *suite_input_all(void);
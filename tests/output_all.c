@@ -18,8 +18,13 @@
  */
 
 #include <config.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
 #include <check.h>
+#include <glib/gstdio.h>
 #include <libsigrok/libsigrok.h>
 #include "lib.h"
 
@@ -96,6 +101,575 @@ START_TEST(test_output_options)
 }
 END_TEST
 
+static int output_sink_append(const void *data, size_t length, void *cb_data)
+{
+	g_string_append_len(cb_data, data, length);
+
+	return SR_OK;
+}
+
+/* How output_run_logic() gets the output. */
+enum {
+	RUN_SEND,
+	RUN_SINK,
+	RUN_WRITER,
+};
+
+static int output_run_packet(const struct sr_output *o,
+		struct sr_output_writer *writer, int how,
+		const struct sr_datafeed_packet *packet, GString *all)
+{
+	GString *out;
+	int ret;
+
+	switch (how) {
+	case RUN_SINK:
+		return sr_output_send_sink(o, packet, output_sink_append, all);
+	case RUN_WRITER:
+		return sr_output_writer_send(writer, packet);
+	default:
+		out = NULL;
+		ret = sr_output_send(o, packet, &out);
+		if (out) {
+			g_string_append_len(all, out->str, out->len);
+			g_string_free(out, TRUE);
+		} else if (packet->type == SR_DF_END) {
+			fail("No output at end of stream.");
+		}
+		return ret;
+	}
+}
+
+/*
+ * Run 16 samples of two logic channels (A toggles, B is its inverse)
+ * through an output module, in two packets of different length, with
+ * sr_output_send(), sr_output_send_sink() or an output writer. Returns
+ * the complete text output.
+ */
+static GString *output_run_logic(const char *id, int how)
+{
+	const struct sr_output *o;
+	struct sr_output_writer *writer;
+	struct sr_dev_inst *sdi;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	GString *all;
+	uint8_t data[16];
+	char *filename, *contents;
+	gsize length;
+	int i, fd;
+
+	sdi = sr_dev_inst_user_new("Vendor", "Model", "Version");
+	sr_dev_inst_channel_add(sdi, 0, SR_CHANNEL_LOGIC, "A");
+	sr_dev_inst_channel_add(sdi, 1, SR_CHANNEL_LOGIC, "B");
+	o = sr_output_new(sr_output_find((char *)id), NULL, sdi, NULL);
+	fail_unless(o != NULL, "Cannot create '%s' output.", id);
+
+	writer = NULL;
+	filename = NULL;
+	if (how == RUN_WRITER) {
+		fd = g_file_open_tmp("sr-output-XXXXXX", &filename, NULL);
+		fail_unless(fd >= 0, "Cannot create a temporary file.");
+		close(fd);
+		fail_unless(sr_output_writer_new(o, filename, 0,
+			SR_OUTPUT_SYNC_NONE, FALSE, &writer) == SR_OK);
+	}
+
+	for (i = 0; i < 16; i++)
+		data[i] = (i & 1) ? 0x01 : 0x02;
+	all = g_string_new(NULL);
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.unitsize = 1;
+	for (i = 0; i < 16; i += 12) {
+		logic.data = &data[i];
+		logic.length = (i == 0) ? 12 : 4;
+		fail_unless(output_run_packet(o, writer, how, &packet,
+			all) == SR_OK);
+	}
+	packet.type = SR_DF_END;
+	packet.payload = NULL;
+	fail_unless(output_run_packet(o, writer, how, &packet, all) == SR_OK,
+		"Cannot send end of stream to '%s'.", id);
+
+	if (writer) {
+		fail_unless(sr_output_writer_free(writer) == SR_OK);
+		fail_unless(g_file_get_contents(filename, &contents,
+			&length, NULL));
+		g_string_append_len(all, contents, length);
+		g_free(contents);
+		g_unlink(filename);
+		g_free(filename);
+	}
+	sr_output_free(o);
+
+	return all;
+}
+
+/* Check the text layout of the 'bits' and 'hex' logic outputs. */
+START_TEST(test_output_logic_text)
+{
+	GString *text;
+
+	text = output_run_logic("bits", RUN_SEND);
+	fail_unless(strstr(text->str, "\nA:01010101 01010101 \nB:10101010 10101010 \n") != NULL,
+		"Unexpected 'bits' output: %s", text->str);
+	g_string_free(text, TRUE);
+
+	text = output_run_logic("hex", RUN_SEND);
+	fail_unless(strstr(text->str, "\nA:55 55 \nB:aa aa \n") != NULL,
+		"Unexpected 'hex' output: %s", text->str);
+	g_string_free(text, TRUE);
+
+	text = output_run_logic("ascii", RUN_SEND);
+	fail_unless(strstr(text->str, "\nA:./\\/\\/\\/\\/\\/\\/\\/\\/\nB:\"\\/\\/\\/\\/\\/\\/\\/\\/\\\n") != NULL,
+		"Unexpected 'ascii' output: %s", text->str);
+	g_string_free(text, TRUE);
+}
+END_TEST
+
+/* Drop the wall clock time of a 'vcd' header, it differs between runs. */
+static void output_date_strip(GString *out)
+{
+	char *date, *end;
+
+	if (!(date = strstr(out->str, "$date ")))
+		return;
+	if (!(end = strstr(date, " $end\n")))
+		return;
+	g_string_erase(out, date - out->str, end - date);
+}
+
+/* Check that sr_output_send_sink() passes on the same output. */
+START_TEST(test_output_send_sink)
+{
+	const char *ids[] = { "bits", "hex", "ascii", "vcd", "csv" };
+	GString *text, *sunk;
+	unsigned int i;
+
+	for (i = 0; i < G_N_ELEMENTS(ids); i++) {
+		text = output_run_logic(ids[i], RUN_SEND);
+		sunk = output_run_logic(ids[i], RUN_SINK);
+		fail_unless(text->len > 0, "No '%s' output.", ids[i]);
+		output_date_strip(text);
+		output_date_strip(sunk);
+		fail_unless(g_string_equal(text, sunk),
+			"Different '%s' output with a sink: %s", ids[i], sunk->str);
+		g_string_free(text, TRUE);
+		g_string_free(sunk, TRUE);
+	}
+}
+END_TEST
+
+/* Check that an output writer writes the same output to its file. */
+START_TEST(test_output_writer)
+{
+	const char *ids[] = { "bits", "hex", "ascii" };
+	GString *text, *written;
+	unsigned int i;
+
+	for (i = 0; i < G_N_ELEMENTS(ids); i++) {
+		text = output_run_logic(ids[i], RUN_SEND);
+		written = output_run_logic(ids[i], RUN_WRITER);
+		fail_unless(g_string_equal(text, written),
+			"Different '%s' output from a writer: %s",
+			ids[i], written->str);
+		g_string_free(text, TRUE);
+		g_string_free(written, TRUE);
+	}
+}
+END_TEST
+
+/* Check the framing of an 'arrow' file: magic, footer, end of stream. */
+START_TEST(test_output_arrow)
+{
+	GString *out;
+	uint32_t footer_len;
+	const uint8_t *p;
+
+	out = output_run_logic("arrow", RUN_SEND);
+	fail_unless(out->len > 32, "Short 'arrow' output.");
+	p = (const uint8_t *)out->str;
+	fail_unless(!memcmp(p, "ARROW1\0\0", 8), "No magic at the start.");
+	fail_unless(!memcmp(p + out->len - 6, "ARROW1", 6),
+		"No magic at the end.");
+	fail_unless(!memcmp(p + 8, "\xff\xff\xff\xff", 4),
+		"No schema message after the magic.");
+	footer_len = p[out->len - 10] | p[out->len - 9] << 8 |
+		p[out->len - 8] << 16 | (uint32_t)p[out->len - 7] << 24;
+	fail_unless(footer_len + 10 + 8 <= out->len, "Invalid footer length.");
+	fail_unless(!memcmp(p + out->len - 10 - footer_len - 8,
+		"\xff\xff\xff\xff\0\0\0\0", 8),
+		"No end of stream before the footer.");
+	g_string_free(out, TRUE);
+}
+END_TEST
+
+/* Check that 'framed' output is the magic and whole frames, header first. */
+START_TEST(test_output_framed)
+{
+	GString *out;
+	const uint8_t *p;
+	size_t pos, len;
+	int type;
+
+	out = output_run_logic("framed", RUN_SEND);
+	p = (const uint8_t *)out->str;
+	fail_unless(out->len > 16, "Short 'framed' output.");
+	fail_unless(!memcmp(p, "SRNF\x01\0\0\0", 8), "No magic at the start.");
+	fail_unless(p[12] == 1, "No header frame after the magic.");
+	type = 0;
+	for (pos = 8; pos + 8 <= out->len; pos += 8 + len) {
+		len = p[pos] | p[pos + 1] << 8 | p[pos + 2] << 16 |
+			(size_t)p[pos + 3] << 24;
+		type = p[pos + 4];
+	}
+	fail_unless(pos == out->len, "Frames don't add up to the output.");
+	fail_unless(type == 8, "The last frame is not the end.");
+	g_string_free(out, TRUE);
+}
+END_TEST
+
+/* Values of the two analog channels in output_run_analog(). */
+#define ANALOG_SAMPLES 40
+#define ANALOG_A(i) (((int)(i) - 20) / 16.0f)
+#define ANALOG_B(i) (0.3f - (i) / 50.0f)
+
+/*
+ * Run samples of two analog channels through an output module, either
+ * in one interleaved packet which carries both channels, or in one
+ * packet per channel. Returns the complete output.
+ */
+static GString *output_run_analog(const char *id, GHashTable *options,
+		gboolean interleaved)
+{
+	const struct sr_output *o;
+	struct sr_dev_inst *sdi;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	GSList *channels, *l;
+	GString *all;
+	float data[2 * ANALOG_SAMPLES];
+	int i;
+
+	sdi = sr_dev_inst_user_new("Vendor", "Model", "Version");
+	sr_dev_inst_channel_add(sdi, 0, SR_CHANNEL_ANALOG, "A");
+	sr_dev_inst_channel_add(sdi, 1, SR_CHANNEL_ANALOG, "B");
+	channels = sr_dev_inst_channels_get(sdi);
+	o = sr_output_new(sr_output_find((char *)id), options, sdi, NULL);
+	fail_unless(o != NULL, "Cannot create '%s' output.", id);
+
+	memset(&analog, 0, sizeof(analog));
+	memset(&encoding, 0, sizeof(encoding));
+	memset(&meaning, 0, sizeof(meaning));
+	memset(&spec, 0, sizeof(spec));
+	analog.encoding = &encoding;
+	analog.meaning = &meaning;
+	analog.spec = &spec;
+	encoding.unitsize = sizeof(float);
+	encoding.is_float = TRUE;
+#ifdef WORDS_BIGENDIAN
+	encoding.is_bigendian = TRUE;
+#endif
+	encoding.digits = 3;
+	encoding.is_digits_decimal = TRUE;
+	encoding.scale.p = encoding.scale.q = 1;
+	encoding.offset.q = 1;
+	meaning.mq = SR_MQ_VOLTAGE;
+	meaning.unit = SR_UNIT_VOLT;
+	spec.spec_digits = 3;
+
+	all = g_string_new(NULL);
+	packet.type = SR_DF_ANALOG;
+	packet.payload = &analog;
+	analog.data = data;
+	analog.num_samples = ANALOG_SAMPLES;
+	if (interleaved) {
+		for (i = 0; i < ANALOG_SAMPLES; i++) {
+			data[2 * i] = ANALOG_A(i);
+			data[2 * i + 1] = ANALOG_B(i);
+		}
+		meaning.channels = channels;
+		fail_unless(output_run_packet(o, NULL, RUN_SEND, &packet,
+			all) == SR_OK);
+	} else {
+		for (l = channels; l; l = l->next) {
+			for (i = 0; i < ANALOG_SAMPLES; i++)
+				data[i] = (l == channels) ? ANALOG_A(i) : ANALOG_B(i);
+			meaning.channels = g_slist_append(NULL, l->data);
+			fail_unless(output_run_packet(o, NULL, RUN_SEND,
+				&packet, all) == SR_OK);
+			g_slist_free(meaning.channels);
+		}
+	}
+	packet.type = SR_DF_END;
+	packet.payload = NULL;
+	fail_unless(output_run_packet(o, NULL, RUN_SEND, &packet, all) == SR_OK,
+		"Cannot send end of stream to '%s'.", id);
+	sr_output_free(o);
+
+	return all;
+}
+
+/* 16 bit PCM of a value, clipped to -1..1 and rounded. */
+static int16_t pcm16_ref(float value)
+{
+	value = CLAMP(value, -1.0f, 1.0f) * 32767;
+
+	return value < 0 ? value - 0.5f : value + 0.5f;
+}
+
+/*
+ * Check that 'wav' writes the same 16 bit PCM for an interleaved packet
+ * as for one packet per channel, which take different conversions.
+ */
+START_TEST(test_output_wav_pcm16)
+{
+	GHashTable *options;
+	GString *interleaved, *per_channel;
+	const uint8_t *p;
+	int16_t v;
+	int i;
+
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+		(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(options, g_strdup("format"),
+		g_variant_ref_sink(g_variant_new_string("pcm16")));
+	interleaved = output_run_analog("wav", options, TRUE);
+	per_channel = output_run_analog("wav", options, FALSE);
+	g_hash_table_destroy(options);
+
+	fail_unless(interleaved->len > 4 * ANALOG_SAMPLES, "Short output.");
+	fail_unless(g_string_equal(interleaved, per_channel),
+		"Different output for interleaved packets.");
+	p = (const uint8_t *)interleaved->str + interleaved->len -
+		4 * ANALOG_SAMPLES;
+	for (i = 0; i < 2 * ANALOG_SAMPLES; i++) {
+		v = p[2 * i] | p[2 * i + 1] << 8;
+		fail_unless(v == pcm16_ref((i & 1) ? ANALOG_B(i / 2) :
+			ANALOG_A(i / 2)), "Wrong value %d at %d.", v, i);
+	}
+	g_string_free(interleaved, TRUE);
+	g_string_free(per_channel, TRUE);
+}
+END_TEST
+/*
+ * Check that 'wav' writes the same floats for an interleaved packet as
+ * for one packet per channel.
+ */
+START_TEST(test_output_wav_float)
+{
+	GString *interleaved, *per_channel;
+	const uint8_t *p;
+	uint32_t bits;
+	float v;
+	int i;
+
+	interleaved = output_run_analog("wav", NULL, TRUE);
+	per_channel = output_run_analog("wav", NULL, FALSE);
+
+	fail_unless(interleaved->len > 8 * ANALOG_SAMPLES, "Short output.");
+	fail_unless(g_string_equal(interleaved, per_channel),
+		"Different output for interleaved packets.");
+	p = (const uint8_t *)interleaved->str + interleaved->len -
+		8 * ANALOG_SAMPLES;
+	for (i = 0; i < 2 * ANALOG_SAMPLES; i++) {
+		bits = p[4 * i] | p[4 * i + 1] << 8 | p[4 * i + 2] << 16 |
+			(uint32_t)p[4 * i + 3] << 24;
+		memcpy(&v, &bits, sizeof(v));
+		fail_unless(v == ((i & 1) ? ANALOG_B(i / 2) : ANALOG_A(i / 2)),
+			"Wrong value %f at %d.", v, i);
+	}
+	g_string_free(interleaved, TRUE);
+	g_string_free(per_channel, TRUE);
+}
+END_TEST
+
+/*
+ * Check that 'csv' writes the same rows for an interleaved packet as
+ * for one packet per channel, which it has to put together itself.
+ */
+START_TEST(test_output_csv_analog)
+{
+	GHashTable *options;
+	GString *interleaved, *per_channel;
+	gchar **lines, **row;
+	double a, b;
+	guint num;
+	int i;
+
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+		(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(options, g_strdup("header"),
+		g_variant_ref_sink(g_variant_new_boolean(FALSE)));
+	interleaved = output_run_analog("csv", options, TRUE);
+	per_channel = output_run_analog("csv", options, FALSE);
+	g_hash_table_destroy(options);
+
+	fail_unless(g_string_equal(interleaved, per_channel),
+		"Different output for interleaved packets.");
+
+	/* The rows are the last lines, after any column labels. */
+	lines = g_strsplit(g_strchomp(interleaved->str), "\n", 0);
+	num = g_strv_length(lines);
+	fail_unless(num >= ANALOG_SAMPLES, "Got %u lines.", num);
+	row = lines + num - ANALOG_SAMPLES;
+	for (i = 0; i < ANALOG_SAMPLES; i++) {
+		fail_unless(sscanf(row[i], "%lf,%lf", &a, &b) == 2,
+			"Bad row '%s'.", row[i]);
+		fail_unless(fabs(a - ANALOG_A(i)) <= 0.001 &&
+			fabs(b - ANALOG_B(i)) <= 0.001,
+			"Wrong values '%s' in row %d.", row[i], i);
+	}
+	g_strfreev(lines);
+	g_string_free(interleaved, TRUE);
+	g_string_free(per_channel, TRUE);
+}
+END_TEST
+
+/* Collect the values of the analog packets which 'framed' input sends. */
+static void datafeed_floats(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_analog *analog;
+	GArray *values;
+	guint num;
+
+	(void)sdi;
+
+	if (packet->type != SR_DF_ANALOG)
+		return;
+	analog = packet->payload;
+	values = cb_data;
+	fail_unless(g_slist_length(analog->meaning->channels) == 2,
+		"Analog packet is not of both channels.");
+	num = values->len;
+	g_array_set_size(values, num + 2 * analog->num_samples);
+	fail_unless(sr_analog_to_float(analog,
+		&g_array_index(values, float, num)) == SR_OK);
+}
+
+/*
+ * Check that an interleaved packet through 'framed' output and input
+ * comes back with all values of both channels.
+ */
+START_TEST(test_output_framed_analog)
+{
+	struct sr_input *in;
+	struct sr_session *session;
+	GString *out, *none;
+	GArray *values;
+	float v;
+	int i;
+
+	out = output_run_analog("framed", NULL, TRUE);
+	in = sr_input_new(sr_input_find("framed"), NULL);
+	fail_unless(in != NULL, "Cannot create 'framed' input.");
+
+	/* The first call returns once the device instance is ready. */
+	fail_unless(sr_input_send(in, out) == SR_OK);
+	fail_unless(sr_input_dev_inst_get(in) != NULL);
+	values = g_array_new(FALSE, FALSE, sizeof(float));
+	sr_session_new(srtest_ctx, &session);
+	sr_session_datafeed_callback_add(session, datafeed_floats, values);
+	sr_session_dev_add(session, sr_input_dev_inst_get(in));
+	none = g_string_new(NULL);
+	fail_unless(sr_input_send(in, none) == SR_OK);
+	fail_unless(sr_input_end(in) == SR_OK);
+
+	fail_unless(values->len == 2 * ANALOG_SAMPLES,
+		"Got %u values.", values->len);
+	for (i = 0; i < 2 * ANALOG_SAMPLES; i++) {
+		v = g_array_index(values, float, i);
+		fail_unless(v == ((i & 1) ? ANALOG_B(i / 2) : ANALOG_A(i / 2)),
+			"Wrong value %f at %d.", v, i);
+	}
+
+	sr_input_free(in);
+	sr_session_destroy(session);
+	g_array_free(values, TRUE);
+	g_string_free(none, TRUE);
+	g_string_free(out, TRUE);
+}
+END_TEST
+
+#ifdef HAVE_SHM_OPEN
+/*
+ * Check that a "shmring" reader gets the header, the logic data and the
+ * end of stream, and notices when it falls behind.
+ */
+START_TEST(test_output_shmring)
+{
+	const struct sr_output *o;
+	const struct sr_datafeed_packet *got;
+	const struct sr_datafeed_logic *glogic;
+	struct sr_shmring_reader *reader;
+	struct sr_dev_inst *sdi;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	GHashTable *options;
+	GString *out;
+	uint8_t data[8000];
+	char *name;
+	int i;
+
+	sdi = sr_dev_inst_user_new("Vendor", "Model", "Version");
+	sr_dev_inst_channel_add(sdi, 0, SR_CHANNEL_LOGIC, "A");
+	sr_dev_inst_channel_add(sdi, 1, SR_CHANNEL_LOGIC, "B");
+	name = g_strdup_printf("/sr-test-%d", (int)getpid());
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+		(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(options, "name",
+		g_variant_ref_sink(g_variant_new_string(name)));
+	g_hash_table_insert(options, "size",
+		g_variant_ref_sink(g_variant_new_uint64(64 * 1024)));
+	o = sr_output_new(sr_output_find("shmring"), options, sdi, NULL);
+	g_hash_table_destroy(options);
+	fail_unless(o != NULL, "Cannot create 'shmring' output.");
+
+	fail_unless(sr_shmring_reader_open(name, &reader) == SR_OK);
+	fail_unless(g_slist_length(sr_shmring_reader_channels(reader)) == 2);
+	fail_unless(sr_shmring_reader_next(reader, &got) == SR_OK);
+	fail_unless(got && got->type == SR_DF_HEADER);
+	fail_unless(sr_shmring_reader_next(reader, &got) == SR_OK && !got);
+
+	for (i = 0; i < (int)sizeof(data); i++)
+		data[i] = i;
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.unitsize = 1;
+	logic.length = 12;
+	logic.data = data;
+	fail_unless(sr_output_send(o, &packet, &out) == SR_OK);
+	fail_unless(sr_shmring_reader_next(reader, &got) == SR_OK);
+	fail_unless(got && got->type == SR_DF_LOGIC);
+	glogic = got->payload;
+	fail_unless(glogic->length == 12 && !memcmp(glogic->data, data, 12));
+	fail_unless(sr_shmring_reader_check(reader) == SR_OK);
+
+	/* Several times the ring's size, without reading. */
+	logic.length = sizeof(data);
+	for (i = 0; i < 32; i++)
+		fail_unless(sr_output_send(o, &packet, &out) == SR_OK);
+	fail_unless(sr_shmring_reader_check(reader) == SR_ERR_DATA);
+	fail_unless(sr_shmring_reader_next(reader, &got) == SR_ERR_DATA);
+
+	packet.type = SR_DF_END;
+	packet.payload = NULL;
+	fail_unless(sr_output_send(o, &packet, &out) == SR_OK);
+	fail_unless(sr_shmring_reader_next(reader, &got) == SR_OK);
+	fail_unless(got && got->type == SR_DF_END);
+
+	sr_shmring_reader_close(reader);
+	sr_output_free(o);
+	g_free(name);
+}
+END_TEST
+#endif
+
 Suite *suite_output_all(void)
 {
 	Suite *s;
@@ -112,5 +686,21 @@ Suite *suite_output_all(void)
 	tcase_add_test(tc, test_output_options);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("logic_text");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_output_logic_text);
+	tcase_add_test(tc, test_output_send_sink);
+	tcase_add_test(tc, test_output_writer);
+	tcase_add_test(tc, test_output_arrow);
+	tcase_add_test(tc, test_output_framed);
+	tcase_add_test(tc, test_output_framed_analog);
+	tcase_add_test(tc, test_output_wav_pcm16);
+	tcase_add_test(tc, test_output_wav_float);
+	tcase_add_test(tc, test_output_csv_analog);
+#ifdef HAVE_SHM_OPEN
+	tcase_add_test(tc, test_output_shmring);
+#endif
+	suite_add_tcase(s, tc);
+
 	return s;
 }
@@ -19,9 +19,11 @@
 
 #include <config.h>
 #include <stdlib.h>
+#include <string.h>
 #include <check.h>
 #include <libsigrok/libsigrok.h>
 #include "lib.h"
+#include "libsigrok-internal.h"
 
 /*
  * Check whether sr_session_new() works.
@@ -185,6 +187,1423 @@ START_TEST(test_session_trigger_get_null)
 }
 END_TEST
 
+static void datafeed_keep(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	GSList **kept;
+	struct sr_datafeed_packet *ref;
+
+	(void)sdi;
+
+	kept = cb_data;
+	if (packet->type != SR_DF_LOGIC)
+		return;
+	ref = sr_packet_ref(packet);
+	fail_unless(ref != NULL, "sr_packet_ref() failed.");
+	*kept = g_slist_append(*kept, ref);
+}
+
+/*
+ * Check whether packets referenced in a datafeed callback remain valid
+ * after the callback returned and the sender's buffer is gone.
+ */
+START_TEST(test_session_packet_ref)
+{
+	const char *text = "Hello world";
+	struct sr_session *sess;
+	const struct sr_input_module *imod;
+	struct sr_input *in;
+	struct sr_datafeed_packet *ref, *ref2, foreign;
+	const struct sr_datafeed_logic *logic;
+	GSList *kept, *l;
+	GString *buf;
+	size_t pos;
+	int ret;
+
+	kept = NULL;
+	imod = sr_input_find("binary");
+	fail_unless(imod != NULL, "Failed to find input module.");
+	in = sr_input_new(imod, NULL);
+	fail_unless(in != NULL, "Failed to create input instance.");
+
+	sr_session_new(srtest_ctx, &sess);
+	sr_session_datafeed_callback_add(sess, datafeed_keep, &kept);
+	sr_session_dev_add(sess, sr_input_dev_inst_get(in));
+
+	buf = g_string_new(text);
+	ret = sr_input_send(in, buf);
+	fail_unless(ret == SR_OK, "sr_input_send() error: %d", ret);
+	g_string_free(buf, TRUE);
+	sr_input_free(in);
+
+	fail_unless(kept != NULL, "No logic packets were referenced.");
+	pos = 0;
+	for (l = kept; l; l = l->next) {
+		ref = l->data;
+		fail_unless(ref->type == SR_DF_LOGIC);
+		logic = ref->payload;
+		fail_unless(pos + logic->length <= strlen(text));
+		fail_unless(!memcmp(logic->data, &text[pos], logic->length));
+		pos += logic->length;
+
+		/* Additional references are cheap and must be balanced. */
+		ref2 = sr_packet_ref(ref);
+		fail_unless(ref2 == ref, "Referenced packet was copied again.");
+		sr_packet_unref(ref2);
+	}
+	fail_unless(pos == strlen(text), "Got %zu of %zu bytes.",
+		pos, strlen(text));
+
+	g_slist_free_full(kept, (GDestroyNotify)sr_packet_unref);
+
+	/* Packets which the session did not hand out are refused. */
+	foreign.type = SR_DF_TRIGGER;
+	foreign.payload = NULL;
+	fail_unless(sr_packet_ref(&foreign) == NULL,
+		"Foreign packet was referenced.");
+
+	sr_session_destroy(sess);
+}
+END_TEST
+
+static void datafeed_timing(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	uint64_t *next_sample;
+	const struct sr_datafeed_logic *logic;
+	struct sr_packet_timing timing;
+	int ret;
+
+	(void)sdi;
+
+	next_sample = cb_data;
+	ret = sr_packet_timing_get(packet, &timing);
+	if (packet->type != SR_DF_LOGIC) {
+		fail_unless(ret == SR_ERR_NA, "Packet without samples timed.");
+		return;
+	}
+	fail_unless(ret == SR_OK, "sr_packet_timing_get() error: %d", ret);
+	fail_unless(timing.first_sample == *next_sample,
+		"First sample %" PRIu64 ", expected %" PRIu64 ".",
+		timing.first_sample, *next_sample);
+	fail_unless(timing.host_time > 0, "No host time.");
+	logic = packet->payload;
+	*next_sample += logic->length / logic->unitsize;
+}
+
+/* Check whether the session keeps track of the packets' sample index. */
+START_TEST(test_session_packet_timing)
+{
+	struct sr_session *sess;
+	const struct sr_input_module *imod;
+	struct sr_input *in;
+	GString *buf;
+	uint64_t next_sample;
+	int ret;
+
+	imod = sr_input_find("binary");
+	fail_unless(imod != NULL, "Failed to find input module.");
+	in = sr_input_new(imod, NULL);
+	fail_unless(in != NULL, "Failed to create input instance.");
+
+	next_sample = 0;
+	sr_session_new(srtest_ctx, &sess);
+	sr_session_datafeed_callback_add(sess, datafeed_timing, &next_sample);
+	sr_session_dev_add(sess, sr_input_dev_inst_get(in));
+
+	buf = g_string_sized_new(100000);
+	g_string_set_size(buf, 100000);
+	memset(buf->str, 0x55, buf->len);
+	ret = sr_input_send(in, buf);
+	fail_unless(ret == SR_OK, "sr_input_send() error: %d", ret);
+	ret = sr_input_end(in);
+	fail_unless(ret == SR_OK, "sr_input_end() error: %d", ret);
+	g_string_free(buf, TRUE);
+	fail_unless(next_sample == 100000, "Got %" PRIu64 " samples.",
+		next_sample);
+
+	fail_unless(sr_packet_timing_get(NULL, NULL) == SR_ERR_ARG);
+
+	sr_input_free(in);
+	sr_session_destroy(sess);
+}
+END_TEST
+
+struct merged {
+	int64_t last_ns;
+	uint64_t samples;
+	int ends;
+	gboolean late;
+};
+
+static void merge_check(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet,
+		const struct sr_merge_position *pos, void *cb_data)
+{
+	const struct sr_datafeed_logic *logic;
+	struct merged *m;
+
+	(void)sdi;
+
+	m = cb_data;
+	fail_unless(pos->time_ns >= m->last_ns,
+		"Packet at %" PRId64 " ns after %" PRId64 " ns.",
+		pos->time_ns, m->last_ns);
+	m->last_ns = pos->time_ns;
+	m->late |= pos->late;
+	if (packet->type == SR_DF_LOGIC) {
+		logic = packet->payload;
+		m->samples += logic->length / logic->unitsize;
+	} else if (packet->type == SR_DF_END) {
+		m->ends++;
+	}
+}
+
+static struct sr_input *merge_input_new(uint64_t samplerate)
+{
+	const struct sr_input_module *imod;
+	GHashTable *options;
+	struct sr_input *in;
+
+	imod = sr_input_find("binary");
+	fail_unless(imod != NULL, "Failed to find input module.");
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+		(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(options, g_strdup("samplerate"),
+		g_variant_ref_sink(g_variant_new_uint64(samplerate)));
+	in = sr_input_new(imod, options);
+	g_hash_table_destroy(options);
+	fail_unless(in != NULL, "Failed to create input instance.");
+
+	return in;
+}
+
+/*
+ * Check whether the packets of two devices with different samplerates
+ * come out of a merge in time order, however they were sent.
+ */
+START_TEST(test_session_merge)
+{
+	struct sr_session *sess;
+	struct sr_session_merge *merge;
+	struct sr_input *in[2];
+	struct merged m;
+	GString *buf;
+	int ret, i;
+
+	in[0] = merge_input_new(SR_MHZ(1));
+	in[1] = merge_input_new(SR_MHZ(2));
+
+	memset(&m, 0, sizeof(m));
+	m.last_ns = G_MININT64;
+	sr_session_new(srtest_ctx, &sess);
+	sr_session_dev_add(sess, sr_input_dev_inst_get(in[0]));
+	sr_session_dev_add(sess, sr_input_dev_inst_get(in[1]));
+	ret = sr_session_merge_new(sess, &merge, SR_MERGE_ALIGN_START,
+		merge_check, &m);
+	fail_unless(ret == SR_OK, "sr_session_merge_new() error: %d", ret);
+
+	/* Both cover 0 to 1 ms, sent half by half. */
+	buf = g_string_sized_new(1000);
+	for (i = 0; i < 2; i++) {
+		g_string_set_size(buf, 500);
+		memset(buf->str, 0x55, buf->len);
+		ret = sr_input_send(in[0], buf);
+		fail_unless(ret == SR_OK, "sr_input_send() error: %d", ret);
+		g_string_set_size(buf, 1000);
+		memset(buf->str, 0xaa, buf->len);
+		ret = sr_input_send(in[1], buf);
+		fail_unless(ret == SR_OK, "sr_input_send() error: %d", ret);
+	}
+	g_string_free(buf, TRUE);
+	sr_input_end(in[0]);
+	sr_input_end(in[1]);
+	sr_session_merge_free(merge);
+
+	fail_unless(m.samples == 3000, "Got %" PRIu64 " samples.", m.samples);
+	fail_unless(m.ends == 2, "Got %d ends.", m.ends);
+	fail_unless(!m.late, "Packets came late.");
+
+	fail_unless(sr_session_merge_new(NULL, &merge, SR_MERGE_ALIGN_START,
+		merge_check, &m) == SR_ERR_ARG);
+	fail_unless(sr_session_datafeed_callback_remove(sess, NULL, NULL) ==
+		SR_ERR_ARG);
+
+	sr_input_free(in[0]);
+	sr_input_free(in[1]);
+	sr_session_destroy(sess);
+}
+END_TEST
+
+static void preview_check(const struct sr_dev_inst *sdi,
+		const struct sr_preview *preview, void *cb_data)
+{
+	uint64_t *next_point, i;
+
+	(void)sdi;
+
+	next_point = cb_data;
+	fail_unless(preview->first_point == *next_point,
+		"First point %" PRIu64 ", expected %" PRIu64 ".",
+		preview->first_point, *next_point);
+	fail_unless(preview->samples_per_point == 1000,
+		"%" PRIu64 " samples per point.", preview->samples_per_point);
+	fail_unless(preview->unitsize == 1 && !preview->channel);
+	for (i = 0; i < preview->num_points; i++) {
+		fail_unless(preview->logic_min[i] == 0x03,
+			"Point min 0x%02x.", preview->logic_min[i]);
+		fail_unless(preview->logic_max[i] == 0x0f,
+			"Point max 0x%02x.", preview->logic_max[i]);
+	}
+	*next_point += preview->num_points;
+}
+
+/*
+ * Check whether the preview's points cover a fixed number of samples,
+ * also when they span packets.
+ */
+START_TEST(test_session_preview)
+{
+	struct sr_session *sess;
+	struct sr_session_preview *preview;
+	struct sr_input *in;
+	GString *buf;
+	uint64_t next_point;
+	int ret, i;
+
+	in = merge_input_new(SR_MHZ(1));
+
+	next_point = 0;
+	sr_session_new(srtest_ctx, &sess);
+	sr_session_dev_add(sess, sr_input_dev_inst_get(in));
+	ret = sr_session_preview_new(sess, &preview, 1000, preview_check,
+		&next_point);
+	fail_unless(ret == SR_OK, "sr_session_preview_new() error: %d", ret);
+
+	buf = g_string_sized_new(2500);
+	g_string_set_size(buf, 2500);
+	for (i = 0; i < 2500; i++)
+		buf->str[i] = i % 2 ? 0x0f : 0x03;
+	for (i = 0; i < 2; i++) {
+		ret = sr_input_send(in, buf);
+		fail_unless(ret == SR_OK, "sr_input_send() error: %d", ret);
+	}
+	g_string_free(buf, TRUE);
+	sr_input_end(in);
+	fail_unless(next_point == 5, "Got %" PRIu64 " points.", next_point);
+
+	sr_session_preview_free(preview);
+	fail_unless(sr_session_preview_new(sess, &preview, 0, preview_check,
+		&next_point) == SR_ERR_ARG);
+
+	sr_input_free(in);
+	sr_session_destroy(sess);
+}
+END_TEST
+
+/* Check whether the age of the data gets traced per device and callback. */
+START_TEST(test_session_latency_trace)
+{
+	struct sr_session *sess;
+	const struct sr_input_module *imod;
+	struct sr_input *in;
+	struct sr_session_stats *stats;
+	struct sr_latency_stats lat;
+	GString *buf;
+	uint64_t next_sample;
+	int ret;
+
+	imod = sr_input_find("binary");
+	fail_unless(imod != NULL, "Failed to find input module.");
+	in = sr_input_new(imod, NULL);
+	fail_unless(in != NULL, "Failed to create input instance.");
+
+	next_sample = 0;
+	sr_session_new(srtest_ctx, &sess);
+	ret = sr_session_latency_trace_set(sess, TRUE);
+	fail_unless(ret == SR_OK, "sr_session_latency_trace_set() error: %d",
+		ret);
+	sr_session_datafeed_callback_add(sess, datafeed_timing, &next_sample);
+	sr_session_dev_add(sess, sr_input_dev_inst_get(in));
+
+	buf = g_string_sized_new(100000);
+	g_string_set_size(buf, 100000);
+	memset(buf->str, 0xaa, buf->len);
+	ret = sr_input_send(in, buf);
+	fail_unless(ret == SR_OK, "sr_input_send() error: %d", ret);
+	ret = sr_input_end(in);
+	fail_unless(ret == SR_OK, "sr_input_end() error: %d", ret);
+	g_string_free(buf, TRUE);
+
+	ret = sr_session_dev_latency_get(sess, sr_input_dev_inst_get(in), &lat);
+	fail_unless(ret == SR_OK, "sr_session_dev_latency_get() error: %d",
+		ret);
+	fail_unless(lat.count > 0, "No packets traced.");
+	fail_unless(lat.p50_us <= lat.p99_us && lat.p99_us <= lat.max_us,
+		"Percentiles out of order.");
+
+	ret = sr_session_stats_get(sess, &stats);
+	fail_unless(ret == SR_OK, "sr_session_stats_get() failed.");
+	fail_unless(stats->num_callbacks == 1, "Unexpected callback count.");
+	fail_unless(stats->callback_latency[0].count == lat.count,
+		"Callback traced %" PRIu64 " packets, device %" PRIu64 ".",
+		stats->callback_latency[0].count, lat.count);
+	sr_session_stats_free(stats);
+
+	ret = sr_session_dev_latency_get(sess, NULL, &lat);
+	fail_unless(ret == SR_ERR_ARG, "NULL device was accepted.");
+	ret = sr_session_latency_trace_set(NULL, TRUE);
+	fail_unless(ret == SR_ERR_ARG, "NULL session was accepted.");
+
+	sr_input_free(in);
+	sr_session_destroy(sess);
+}
+END_TEST
+
+static void datafeed_types(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	uint32_t *seen;
+
+	(void)sdi;
+
+	seen = cb_data;
+	*seen |= SR_DF_MASK(packet->type);
+}
+
+/* Check whether filtered callbacks only get the packet types they take. */
+START_TEST(test_session_callback_filtered)
+{
+	struct sr_session *sess;
+	const struct sr_input_module *imod;
+	struct sr_input *in;
+	GString *buf;
+	uint32_t seen_all, seen_markers;
+	int ret;
+
+	imod = sr_input_find("binary");
+	fail_unless(imod != NULL, "Failed to find input module.");
+	in = sr_input_new(imod, NULL);
+	fail_unless(in != NULL, "Failed to create input instance.");
+
+	seen_all = seen_markers = 0;
+	sr_session_new(srtest_ctx, &sess);
+	ret = sr_session_datafeed_callback_add_filtered(sess, datafeed_types,
+		&seen_markers, 0, NULL, NULL);
+	fail_unless(ret == SR_ERR_ARG, "Empty filter accepted.");
+	sr_session_datafeed_callback_add(sess, datafeed_types, &seen_all);
+	ret = sr_session_datafeed_callback_add_filtered(sess, datafeed_types,
+		&seen_markers, SR_DF_MASK(SR_DF_HEADER) | SR_DF_MASK(SR_DF_END),
+		NULL, NULL);
+	fail_unless(ret == SR_OK, "Filtered callback not added: %d", ret);
+	sr_session_dev_add(sess, sr_input_dev_inst_get(in));
+
+	buf = g_string_new("Hello world");
+	ret = sr_input_send(in, buf);
+	fail_unless(ret == SR_OK, "sr_input_send() error: %d", ret);
+	ret = sr_input_end(in);
+	fail_unless(ret == SR_OK, "sr_input_end() error: %d", ret);
+	g_string_free(buf, TRUE);
+
+	fail_unless(seen_all & SR_DF_MASK(SR_DF_LOGIC), "No logic data sent.");
+	fail_unless(seen_markers ==
+		(SR_DF_MASK(SR_DF_HEADER) | SR_DF_MASK(SR_DF_END)),
+		"Filtered callback got packet types 0x%x.", seen_markers);
+
+	sr_input_free(in);
+	sr_session_destroy(sess);
+}
+END_TEST
+
+START_TEST(test_session_datafeed_queue_set)
+{
+	int ret;
+	struct sr_session *sess;
+	uint64_t dropped, stalled;
+	size_t max_fill;
+
+	sr_session_new(srtest_ctx, &sess);
+
+	ret = sr_session_datafeed_queue_set(sess, 64, SR_SESSION_QUEUE_DROP);
+	fail_unless(ret == SR_OK, "sr_session_datafeed_queue_set() failed.");
+	ret = sr_session_datafeed_queue_set(sess, 0, SR_SESSION_QUEUE_BLOCK);
+	fail_unless(ret == SR_OK, "Disabling the datafeed queue failed.");
+	ret = sr_session_datafeed_queue_set(sess, 64, 0);
+	fail_unless(ret == SR_ERR_ARG, "Bogus queue policy was accepted.");
+	ret = sr_session_datafeed_queue_set(NULL, 64, SR_SESSION_QUEUE_GROW);
+	fail_unless(ret == SR_ERR_ARG, "NULL session was accepted.");
+
+	/* Nothing ran yet, all counters must be zero. */
+	ret = sr_session_datafeed_queue_stats_get(sess,
+		&dropped, &stalled, &max_fill);
+	fail_unless(ret == SR_OK);
+	fail_unless(dropped == 0 && stalled == 0 && max_fill == 0);
+
+	sr_session_destroy(sess);
+}
+END_TEST
+/* Bytes a callback got of the demo device's incremental pattern. */
+struct queue_feed {
+	unsigned int unitsize;
+	uint64_t bytes;
+	int next, wrong;
+};
+
+static void datafeed_queued(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_logic *logic;
+	const uint8_t *data;
+	struct queue_feed *feed;
+	uint64_t i;
+
+	(void)sdi;
+
+	if (packet->type != SR_DF_LOGIC)
+		return;
+	feed = cb_data;
+	logic = packet->payload;
+	feed->unitsize = logic->unitsize;
+	data = logic->data;
+	for (i = 0; i < logic->length; i++) {
+		if (feed->next >= 0 && data[i] != feed->next)
+			feed->wrong++;
+		feed->next = (data[i] + 1) & 0xff;
+	}
+	feed->bytes += logic->length;
+}
+
+/*
+ * Check whether the delivery thread passes on the data of multi-byte
+ * samples, which the queue copies out of the driver's buffer.
+ */
+START_TEST(test_session_datafeed_queue)
+{
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	struct queue_feed feed;
+	int ret;
+
+	/* Every byte of the pattern is one more than the one before. */
+	sdi = srtest_demo_dev_new(16, 0);
+	srtest_demo_pattern_set(sdi, "incremental");
+	sr_config_set(sdi, NULL, SR_CONF_SAMPLERATE,
+		g_variant_new_uint64(SR_MHZ(1)));
+	sr_config_set(sdi, NULL, SR_CONF_LIMIT_SAMPLES,
+		g_variant_new_uint64(10000));
+
+	memset(&feed, 0, sizeof(feed));
+	feed.next = -1;
+	sr_session_new(srtest_ctx, &sess);
+	sr_session_dev_add(sess, sdi);
+	sr_session_datafeed_callback_add(sess, datafeed_queued, &feed);
+	ret = sr_session_datafeed_queue_set(sess, 64, SR_SESSION_QUEUE_BLOCK);
+	fail_unless(ret == SR_OK, "sr_session_datafeed_queue_set() failed.");
+	ret = sr_session_start(sess);
+	fail_unless(ret == SR_OK, "sr_session_start() failed: %d.", ret);
+	sr_session_run(sess);
+	sr_session_destroy(sess);
+
+	fail_unless(feed.unitsize == 2, "Unitsize %u.", feed.unitsize);
+	fail_unless(feed.bytes == 2 * 10000, "Got %" PRIu64 " bytes.",
+		feed.bytes);
+	fail_unless(feed.wrong == 0, "%d bytes differ.", feed.wrong);
+
+	sr_dev_close(sdi);
+}
+END_TEST
+
+START_TEST(test_session_logic_rle_set)
+{
+	int ret;
+	struct sr_session *sess;
+
+	sr_session_new(srtest_ctx, &sess);
+
+	ret = sr_session_logic_rle_set(sess, TRUE);
+	fail_unless(ret == SR_OK, "sr_session_logic_rle_set() failed.");
+	ret = sr_session_logic_rle_set(sess, FALSE);
+	fail_unless(ret == SR_OK, "Disabling RLE logic data failed.");
+	ret = sr_session_logic_rle_set(NULL, TRUE);
+	fail_unless(ret == SR_ERR_ARG, "NULL session was accepted.");
+
+	sr_session_destroy(sess);
+}
+END_TEST
+
+START_TEST(test_session_analog_interleave_set)
+{
+	int ret;
+	struct sr_session *sess;
+
+	sr_session_new(srtest_ctx, &sess);
+
+	ret = sr_session_analog_interleave_set(sess, TRUE);
+	fail_unless(ret == SR_OK, "sr_session_analog_interleave_set() failed.");
+	ret = sr_session_analog_interleave_set(sess, FALSE);
+	fail_unless(ret == SR_OK, "Disabling interleaved analog data failed.");
+	ret = sr_session_analog_interleave_set(NULL, TRUE);
+	fail_unless(ret == SR_ERR_ARG, "NULL session was accepted.");
+
+	sr_session_destroy(sess);
+}
+END_TEST
+
+START_TEST(test_session_trigger_inplace_set)
+{
+	int ret;
+	struct sr_session *sess;
+	uint64_t trigger_at;
+
+	sr_session_new(srtest_ctx, &sess);
+
+	ret = sr_session_trigger_inplace_set(sess, TRUE);
+	fail_unless(ret == SR_OK, "sr_session_trigger_inplace_set() failed.");
+	ret = sr_session_trigger_inplace_set(sess, FALSE);
+	fail_unless(ret == SR_OK, "Disabling in place triggers failed.");
+	ret = sr_session_trigger_inplace_set(NULL, TRUE);
+	fail_unless(ret == SR_ERR_ARG, "NULL session was accepted.");
+	ret = sr_packet_trigger_get(NULL, &trigger_at);
+	fail_unless(ret == SR_ERR_ARG, "NULL packet was accepted.");
+
+	sr_session_destroy(sess);
+}
+END_TEST
+
+/* What a datafeed callback saw of the demo device's incremental pattern. */
+struct trigger_feed {
+	/* SR_DF_TRIGGER packets, and packets with the trigger in place. */
+	int triggers, inplace;
+	uint64_t trigger_at, trigger_num;
+	gboolean fired;
+	uint64_t before;
+	int first_after;
+	/* The expected next sample value, and how often it was not. */
+	int next, gaps;
+};
+
+static void datafeed_trigger(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	struct trigger_feed *feed;
+	const struct sr_datafeed_logic *logic;
+	const uint8_t *data;
+	uint64_t num, at, i;
+	gboolean triggered;
+
+	(void)sdi;
+
+	feed = cb_data;
+	if (packet->type == SR_DF_TRIGGER) {
+		feed->triggers++;
+		feed->fired = TRUE;
+		return;
+	}
+	if (packet->type != SR_DF_LOGIC)
+		return;
+
+	logic = packet->payload;
+	data = logic->data;
+	num = logic->length / logic->unitsize;
+	triggered = sr_packet_trigger_get(packet, &at) == SR_OK;
+	if (triggered) {
+		feed->inplace++;
+		feed->trigger_at = at;
+		feed->trigger_num = num;
+	}
+	for (i = 0; i < num; i++) {
+		if (triggered && i == at)
+			feed->fired = TRUE;
+		if (feed->next >= 0 && data[i] != feed->next)
+			feed->gaps++;
+		feed->next = (data[i] + 1) & 0xff;
+		if (!feed->fired)
+			feed->before++;
+		else if (feed->first_after < 0)
+			feed->first_after = data[i];
+	}
+	if (triggered && at >= num)
+		feed->fired = TRUE;
+}
+
+/*
+ * Run the demo device with a soft trigger on sample 0xa5 of its
+ * incremental pattern. The soft trigger sends the last chunk of
+ * pre-trigger data with the trigger in place, after its samples.
+ */
+static void trigger_inplace_run(struct sr_dev_inst *sdi, gboolean inplace,
+		gboolean transform, struct trigger_feed *feed)
+{
+	struct sr_session *sess;
+	struct sr_trigger *trigger;
+	struct sr_trigger_stage *stage;
+	const struct sr_transform *t;
+	struct sr_channel *ch;
+	GSList *l;
+	int ret;
+
+	trigger = sr_trigger_new(NULL);
+	stage = sr_trigger_stage_add(trigger);
+	for (l = sr_dev_inst_channels_get(sdi); l; l = l->next) {
+		ch = l->data;
+		sr_trigger_match_add(stage, ch, (0xa5 >> ch->index) & 1 ?
+			SR_TRIGGER_ONE : SR_TRIGGER_ZERO, 0);
+	}
+
+	memset(feed, 0, sizeof(*feed));
+	feed->first_after = -1;
+	feed->next = -1;
+
+	sr_session_new(srtest_ctx, &sess);
+	sr_session_dev_add(sess, sdi);
+	sr_session_trigger_set(sess, trigger);
+	sr_session_trigger_inplace_set(sess, inplace);
+	sr_session_datafeed_callback_add(sess, datafeed_trigger, feed);
+	t = NULL;
+	if (transform)
+		t = sr_transform_new(sr_transform_find("nop"), NULL, sdi);
+	ret = sr_session_start(sess);
+	fail_unless(ret == SR_OK, "sr_session_start() failed: %d.", ret);
+	sr_session_run(sess);
+	sr_session_destroy(sess);
+
+	if (t)
+		sr_transform_free(t);
+	sr_trigger_free(trigger);
+}
+
+/*
+ * Check whether a callback which takes triggers in place gets them in
+ * the packet, and whether all other callbacks, and all callbacks while
+ * there are transforms, get the packet split around SR_DF_TRIGGER.
+ */
+START_TEST(test_session_trigger_inplace)
+{
+	struct sr_dev_inst *sdi;
+	struct trigger_feed feed;
+
+	/* 100 samples of pre-trigger data. */
+	sdi = srtest_demo_dev_new(8, 0);
+	srtest_demo_pattern_set(sdi, "incremental");
+	sr_config_set(sdi, NULL, SR_CONF_SAMPLERATE,
+		g_variant_new_uint64(SR_MHZ(1)));
+	sr_config_set(sdi, NULL, SR_CONF_LIMIT_SAMPLES,
+		g_variant_new_uint64(1000));
+	sr_config_set(sdi, NULL, SR_CONF_CAPTURE_RATIO,
+		g_variant_new_uint64(10));
+
+	trigger_inplace_run(sdi, FALSE, FALSE, &feed);
+	fail_unless(feed.triggers == 1 && feed.inplace == 0,
+		"Got %d trigger packets, %d triggers in place.",
+		feed.triggers, feed.inplace);
+	fail_unless(feed.before == 100, "Got %" PRIu64 " pre-trigger "
+		"samples.", feed.before);
+	fail_unless(feed.first_after == 0xa5, "Triggered at %d, not 0xa5.",
+		feed.first_after);
+	fail_unless(feed.gaps == 0, "Samples were lost in the split.");
+
+	trigger_inplace_run(sdi, TRUE, FALSE, &feed);
+	fail_unless(feed.triggers == 0 && feed.inplace == 1,
+		"Got %d trigger packets, %d triggers in place.",
+		feed.triggers, feed.inplace);
+	fail_unless(feed.trigger_at == feed.trigger_num,
+		"Trigger at %" PRIu64 ", not after the %" PRIu64 " samples.",
+		feed.trigger_at, feed.trigger_num);
+	fail_unless(feed.before == 100, "Got %" PRIu64 " pre-trigger "
+		"samples.", feed.before);
+	fail_unless(feed.first_after == 0xa5, "Triggered at %d, not 0xa5.",
+		feed.first_after);
+	fail_unless(feed.gaps == 0, "Samples were lost.");
+
+	/* Transforms don't take triggers in place. */
+	trigger_inplace_run(sdi, TRUE, TRUE, &feed);
+	fail_unless(feed.triggers == 1 && feed.inplace == 0,
+		"Got %d trigger packets, %d triggers in place with a "
+		"transform.", feed.triggers, feed.inplace);
+	fail_unless(feed.before == 100, "Got %" PRIu64 " pre-trigger "
+		"samples.", feed.before);
+	fail_unless(feed.first_after == 0xa5, "Triggered at %d, not 0xa5.",
+		feed.first_after);
+	fail_unless(feed.gaps == 0, "Samples were lost in the split.");
+
+	sr_dev_close(sdi);
+}
+END_TEST
+
+START_TEST(test_session_parallel_start_set)
+{
+	int ret;
+	struct sr_session *sess;
+	uint64_t arm_us;
+
+	sr_session_new(srtest_ctx, &sess);
+
+	ret = sr_session_parallel_start_set(sess, TRUE);
+	fail_unless(ret == SR_OK, "sr_session_parallel_start_set() failed.");
+	ret = sr_session_parallel_start_set(sess, FALSE);
+	fail_unless(ret == SR_OK, "Disabling parallel start failed.");
+	ret = sr_session_parallel_start_set(NULL, TRUE);
+	fail_unless(ret == SR_ERR_ARG, "NULL session was accepted.");
+	ret = sr_session_dev_arm_time_get(sess, NULL, &arm_us);
+	fail_unless(ret == SR_ERR_ARG, "NULL device was accepted.");
+
+	sr_session_destroy(sess);
+}
+END_TEST
+
+/* A session with two demo devices, which send 1000 samples each. */
+static struct sr_session *two_dev_session_new(struct sr_dev_inst *sdi[2])
+{
+	struct sr_session *sess;
+	int i;
+
+	sr_session_new(srtest_ctx, &sess);
+	for (i = 0; i < 2; i++) {
+		sdi[i] = srtest_demo_dev_new(8, 0);
+		sr_config_set(sdi[i], NULL, SR_CONF_SAMPLERATE,
+			g_variant_new_uint64(SR_MHZ(1)));
+		sr_config_set(sdi[i], NULL, SR_CONF_LIMIT_SAMPLES,
+			g_variant_new_uint64(1000));
+		sr_session_dev_add(sess, sdi[i]);
+	}
+
+	return sess;
+}
+
+/* Which thread delivered a device's packets, with which numbers. */
+struct seq_feed {
+	const struct sr_dev_inst *sdi[2];
+	uint64_t next[2];
+	int wrong;
+	GThread *thread;
+	int threads;
+};
+
+static void datafeed_seq(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	struct seq_feed *feed;
+	uint64_t seq;
+	int i;
+
+	feed = cb_data;
+	if (feed->thread != g_thread_self()) {
+		feed->thread = g_thread_self();
+		feed->threads++;
+	}
+	i = sdi == feed->sdi[1];
+	/* Expect no numbers when next is 0. */
+	seq = sr_packet_sequence_get(packet);
+	if (seq != feed->next[i])
+		feed->wrong++;
+	if (feed->next[i])
+		feed->next[i]++;
+}
+
+/*
+ * Check whether the packets of devices which run in threads of their
+ * own are numbered per device, and all reach the callbacks from one
+ * thread, other than the session's.
+ */
+START_TEST(test_session_dev_threads)
+{
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi[2];
+	struct seq_feed feed;
+	int ret, i;
+
+	sess = two_dev_session_new(sdi);
+	memset(&feed, 0, sizeof(feed));
+	feed.sdi[0] = sdi[0];
+	feed.sdi[1] = sdi[1];
+	sr_session_datafeed_callback_add(sess, datafeed_seq, &feed);
+
+	/* Without device threads, packets have no numbers. */
+	ret = sr_session_start(sess);
+	fail_unless(ret == SR_OK, "sr_session_start() failed: %d.", ret);
+	sr_session_run(sess);
+	fail_unless(feed.wrong == 0, "Numbered packets without threads.");
+	fail_unless(feed.thread == g_thread_self(),
+		"Callbacks ran in another thread.");
+
+	memset(&feed, 0, sizeof(feed));
+	feed.sdi[0] = sdi[0];
+	feed.sdi[1] = sdi[1];
+	feed.next[0] = feed.next[1] = 1;
+	sr_session_dev_threads_set(sess, TRUE);
+	ret = sr_session_start(sess);
+	fail_unless(ret == SR_OK, "sr_session_start() failed: %d.", ret);
+	sr_session_run(sess);
+	for (i = 0; i < 2; i++) {
+		fail_unless(feed.next[i] > 3, "Device %d sent %" PRIu64
+			" packets.", i, feed.next[i] - 1);
+	}
+	fail_unless(feed.wrong == 0, "%d packets out of sequence.",
+		feed.wrong);
+	fail_unless(feed.threads == 1 && feed.thread != g_thread_self(),
+		"Callbacks ran in %d threads.", feed.threads);
+
+	ret = sr_session_dev_threads_set(NULL, TRUE);
+	fail_unless(ret == SR_ERR_ARG, "NULL session was accepted.");
+
+	sr_session_destroy(sess);
+	sr_dev_close(sdi[0]);
+	sr_dev_close(sdi[1]);
+}
+END_TEST
+
+/* What a datafeed callback saw of two devices. */
+struct two_dev_feed {
+	const struct sr_dev_inst *sdi[2];
+	int headers[2], ends[2], packets;
+	uint64_t samples[2];
+	/* Logic packets before both devices sent SR_DF_HEADER. */
+	int early;
+};
+
+static void datafeed_two_dev(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	struct two_dev_feed *feed;
+	const struct sr_datafeed_logic *logic;
+	int i;
+
+	feed = cb_data;
+	i = sdi == feed->sdi[1];
+	feed->packets++;
+	switch (packet->type) {
+	case SR_DF_HEADER:
+		feed->headers[i]++;
+		break;
+	case SR_DF_LOGIC:
+		if (!feed->headers[0] || !feed->headers[1])
+			feed->early++;
+		logic = packet->payload;
+		feed->samples[i] += logic->length / logic->unitsize;
+		break;
+	case SR_DF_END:
+		feed->ends[i]++;
+		break;
+	default:
+		break;
+	}
+}
+
+static int two_dev_run(struct sr_session *sess, struct two_dev_feed *feed)
+{
+	const struct sr_dev_inst *sdi[2];
+	int ret;
+
+	sdi[0] = feed->sdi[0];
+	sdi[1] = feed->sdi[1];
+	memset(feed, 0, sizeof(*feed));
+	feed->sdi[0] = sdi[0];
+	feed->sdi[1] = sdi[1];
+
+	ret = sr_session_start(sess);
+	if (ret == SR_OK)
+		sr_session_run(sess);
+
+	return ret;
+}
+
+/*
+ * Check whether two devices started in parallel only deliver data once
+ * both are armed, and whether a device which fails to start takes the
+ * other one down with it, without any of its packets getting through.
+ */
+START_TEST(test_session_parallel_start)
+{
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi[2];
+	struct two_dev_feed feed;
+	uint64_t arm_us;
+	int ret, i;
+
+	sess = two_dev_session_new(sdi);
+	feed.sdi[0] = sdi[0];
+	feed.sdi[1] = sdi[1];
+	sr_session_datafeed_callback_add(sess, datafeed_two_dev, &feed);
+	sr_session_parallel_start_set(sess, TRUE);
+	/* Acquisition threads could send right away, without the barrier. */
+	sr_session_dev_threads_set(sess, TRUE);
+
+	ret = sr_session_dev_arm_time_get(sess, sdi[0], &arm_us);
+	fail_unless(ret == SR_ERR_NA, "Got an arm time before the start.");
+
+	ret = two_dev_run(sess, &feed);
+	fail_unless(ret == SR_OK, "sr_session_start() failed: %d.", ret);
+	for (i = 0; i < 2; i++) {
+		fail_unless(feed.headers[i] == 1 && feed.ends[i] == 1,
+			"Device %d sent %d headers, %d ends.",
+			i, feed.headers[i], feed.ends[i]);
+		fail_unless(feed.samples[i] == 1000,
+			"Device %d sent %" PRIu64 " samples.",
+			i, feed.samples[i]);
+		ret = sr_session_dev_arm_time_get(sess, sdi[i], &arm_us);
+		fail_unless(ret == SR_OK, "No arm time for device %d.", i);
+	}
+	fail_unless(feed.early == 0,
+		"%d logic packets before both devices were armed.", feed.early);
+
+	/* The first device starts, the closed second one doesn't. */
+	sr_dev_close(sdi[1]);
+	ret = two_dev_run(sess, &feed);
+	fail_unless(ret == SR_ERR_DEV_CLOSED,
+		"Started with a closed device: %d.", ret);
+	fail_unless(feed.packets == 0,
+		"%d held packets were delivered.", feed.packets);
+	ret = sr_session_dev_arm_time_get(sess, sdi[0], &arm_us);
+	fail_unless(ret == SR_OK, "No arm time for the started device.");
+	ret = sr_session_dev_arm_time_get(sess, sdi[1], &arm_us);
+	fail_unless(ret == SR_ERR_NA, "Arm time for the closed device.");
+
+	/* The started device was stopped, and starts over. */
+	fail_unless(sr_dev_open(sdi[1]) == SR_OK, "Cannot reopen device.");
+	ret = two_dev_run(sess, &feed);
+	fail_unless(ret == SR_OK, "sr_session_start() failed: %d.", ret);
+	for (i = 0; i < 2; i++) {
+		fail_unless(feed.samples[i] == 1000,
+			"Device %d sent %" PRIu64 " samples after a failed "
+			"start.", i, feed.samples[i]);
+	}
+
+	sr_session_destroy(sess);
+	sr_dev_close(sdi[0]);
+	sr_dev_close(sdi[1]);
+}
+END_TEST
+
+/* The samples and number of analog packets a callback got. */
+struct analog_feed {
+	GArray *values;
+	unsigned int packets;
+};
+
+static void datafeed_analog_values(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_analog *analog;
+	struct analog_feed *feed;
+	unsigned int len;
+	int ret;
+
+	(void)sdi;
+
+	if (packet->type != SR_DF_ANALOG)
+		return;
+	feed = cb_data;
+	analog = packet->payload;
+	feed->packets++;
+	len = feed->values->len;
+	g_array_set_size(feed->values, len + analog->num_samples);
+	ret = sr_analog_to_float(analog,
+		&g_array_index(feed->values, float, len));
+	fail_unless(ret == SR_OK, "sr_analog_to_float() failed: %d.", ret);
+}
+
+static void analog_batch_run(struct sr_dev_inst *sdi,
+		uint32_t max_delay_ms, struct analog_feed *feed)
+{
+	struct sr_session *sess;
+	int ret;
+
+	feed->values = g_array_new(FALSE, FALSE, sizeof(float));
+	feed->packets = 0;
+	sr_session_new(srtest_ctx, &sess);
+	sr_session_dev_add(sess, sdi);
+	sr_session_datafeed_callback_add(sess, datafeed_analog_values, feed);
+	ret = sr_session_analog_batch_set(sess, max_delay_ms);
+	fail_unless(ret == SR_OK, "sr_session_analog_batch_set() failed.");
+	ret = sr_session_start(sess);
+	fail_unless(ret == SR_OK, "sr_session_start() failed: %d.", ret);
+	sr_session_run(sess);
+	sr_session_destroy(sess);
+}
+
+/*
+ * Check whether batching combines the one sample packets of a
+ * multimeter-like device, without losing or reordering samples.
+ */
+START_TEST(test_session_analog_batch)
+{
+	struct sr_dev_inst *sdi;
+	struct analog_feed single, batched;
+	int ret;
+
+	/* Averaging over one sample sends every sample on its own. */
+	sdi = srtest_demo_dev_new(0, 1);
+	sr_config_set(sdi, NULL, SR_CONF_SAMPLERATE,
+		g_variant_new_uint64(SR_KHZ(10)));
+	sr_config_set(sdi, NULL, SR_CONF_LIMIT_SAMPLES,
+		g_variant_new_uint64(1000));
+	sr_config_set(sdi, NULL, SR_CONF_AVERAGING,
+		g_variant_new_boolean(TRUE));
+	sr_config_set(sdi, NULL, SR_CONF_AVG_SAMPLES,
+		g_variant_new_uint64(1));
+
+	analog_batch_run(sdi, 0, &single);
+	fail_unless(single.values->len == 1000 && single.packets == 1000,
+		"Got %u samples in %u packets unbatched.",
+		single.values->len, single.packets);
+
+	analog_batch_run(sdi, 20, &batched);
+	fail_unless(batched.values->len == 1000,
+		"Got %u samples batched.", batched.values->len);
+	fail_unless(!memcmp(batched.values->data, single.values->data,
+		1000 * sizeof(float)), "Batching changed the samples.");
+	fail_unless(batched.packets < 1000 / 10,
+		"Got %u batches.", batched.packets);
+
+	g_array_free(single.values, TRUE);
+	g_array_free(batched.values, TRUE);
+
+	ret = sr_session_analog_batch_set(NULL, 10);
+	fail_unless(ret == SR_ERR_ARG, "NULL session was accepted.");
+
+	sr_dev_close(sdi);
+}
+END_TEST
+
+static void datafeed_slack(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	(void)sdi;
+
+	if (packet->type == SR_DF_LOGIC)
+		(*(int *)cb_data)++;
+}
+
+/*
+ * Check that timeouts are moved to the end of their slot of the slack
+ * grid, unless they are shorter than the slack, and that a demo device
+ * with 100 ms timeouts still runs to its limit with 50 ms slots.
+ */
+START_TEST(test_session_timer_slack)
+{
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	int ret, packets;
+
+	fail_unless(sr_timer_slack_align(1234567, 100000, 0) == 1234567,
+		"Timeout moved without slack.");
+	fail_unless(sr_timer_slack_align(1234567, 100000, 50000) == 1250000,
+		"Timeout not moved to the end of its slot.");
+	fail_unless(sr_timer_slack_align(1250000, 100000, 50000) == 1250000,
+		"Timeout at the end of a slot was moved.");
+	fail_unless(sr_timer_slack_align(1250001, 100000, 50000) == 1300000,
+		"Timeout not moved to the next slot.");
+	fail_unless(sr_timer_slack_align(1234567, 20000, 50000) == 1234567,
+		"Timeout shorter than the slack was moved.");
+
+	sdi = srtest_demo_dev_new(8, 0);
+	sr_config_set(sdi, NULL, SR_CONF_SAMPLERATE,
+		g_variant_new_uint64(SR_KHZ(1)));
+	sr_config_set(sdi, NULL, SR_CONF_LIMIT_SAMPLES,
+		g_variant_new_uint64(400));
+
+	packets = 0;
+	sr_session_new(srtest_ctx, &sess);
+	sr_session_dev_add(sess, sdi);
+	sr_session_datafeed_callback_add(sess, datafeed_slack, &packets);
+	ret = sr_session_timer_slack_set(sess, 50);
+	fail_unless(ret == SR_OK, "sr_session_timer_slack_set() failed.");
+	ret = sr_session_start(sess);
+	fail_unless(ret == SR_OK, "sr_session_start() failed: %d.", ret);
+	sr_session_run(sess);
+	fail_unless(packets > 0, "No logic packets.");
+
+	ret = sr_session_timer_slack_set(NULL, 20);
+	fail_unless(ret == SR_ERR_ARG, "NULL session was accepted.");
+
+	sr_session_destroy(sess);
+	sr_dev_close(sdi);
+}
+END_TEST
+
+static void datafeed_count_samples(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_logic *logic;
+	uint64_t *samples;
+
+	(void)sdi;
+
+	if (packet->type != SR_DF_LOGIC)
+		return;
+	samples = cb_data;
+	logic = packet->payload;
+	*samples += logic->length / logic->unitsize;
+}
+
+static void session_stopped(void *data)
+{
+	*(gboolean *)data = TRUE;
+}
+
+/*
+ * Check whether an external loop which waits for the session's poll fd
+ * and dispatches when it is readable runs a demo device's acquisition.
+ */
+START_TEST(test_session_poll_fd)
+{
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	GPollFD pfd;
+	uint64_t samples;
+	gboolean stopped;
+	int ret, fd, i;
+
+	sr_session_new(srtest_ctx, &sess);
+
+	ret = sr_session_dispatch_pending(sess);
+	fail_unless(ret == SR_ERR || ret == SR_ERR_NA,
+		"Dispatching without a poll fd was accepted.");
+	ret = sr_session_poll_fd_get(NULL, &fd);
+	fail_unless(ret == SR_ERR_ARG || ret == SR_ERR_NA,
+		"NULL session was accepted.");
+	ret = sr_session_poll_fd_get(sess, &fd);
+	if (ret == SR_ERR_NA) {
+		sr_session_destroy(sess);
+		return;
+	}
+	fail_unless(ret == SR_OK, "sr_session_poll_fd_get() failed.");
+	fail_unless(fd >= 0, "Invalid poll fd.");
+	ret = sr_session_dispatch_pending(sess);
+	fail_unless(ret == SR_OK, "Dispatching a stopped session failed.");
+
+	sdi = srtest_demo_dev_new(8, 0);
+	sr_config_set(sdi, NULL, SR_CONF_SAMPLERATE,
+		g_variant_new_uint64(SR_KHZ(10)));
+	sr_config_set(sdi, NULL, SR_CONF_LIMIT_SAMPLES,
+		g_variant_new_uint64(1000));
+	samples = 0;
+	stopped = FALSE;
+	sr_session_dev_add(sess, sdi);
+	sr_session_datafeed_callback_add(sess, datafeed_count_samples,
+		&samples);
+	sr_session_stopped_callback_set(sess, session_stopped, &stopped);
+	ret = sr_session_start(sess);
+	fail_unless(ret == SR_OK, "sr_session_start() failed: %d.", ret);
+
+	/* The demo device's timer sends 100 ms of samples at a time. */
+	pfd.fd = fd;
+	pfd.events = G_IO_IN;
+	for (i = 0; i < 30 && !stopped; i++) {
+		if (g_poll(&pfd, 1, 100) <= 0)
+			continue;
+		ret = sr_session_dispatch_pending(sess);
+		fail_unless(ret == SR_OK, "Dispatching failed: %d.", ret);
+	}
+	fail_unless(stopped, "The session did not stop.");
+	fail_unless(samples == 1000, "Got %" PRIu64 " samples.", samples);
+
+	sr_session_destroy(sess);
+	sr_dev_close(sdi);
+}
+END_TEST
+
+/* What reconfiguring a running session from a callback resulted in. */
+struct reconf_feed {
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	gboolean called;
+	int ret;
+	int metas;
+	uint64_t samplerate;
+};
+
+static void datafeed_reconf(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_meta *meta;
+	const struct sr_config *src;
+	struct reconf_feed *feed;
+	GSList *l;
+
+	(void)sdi;
+
+	feed = cb_data;
+	if (packet->type == SR_DF_LOGIC && !feed->called) {
+		feed->called = TRUE;
+		sr_config_set(feed->sdi, NULL, SR_CONF_SAMPLERATE,
+			g_variant_new_uint64(SR_MHZ(2)));
+		feed->ret = sr_session_reconfigure(feed->sess);
+	} else if (packet->type == SR_DF_META && feed->called) {
+		meta = packet->payload;
+		feed->metas++;
+		for (l = meta->config; l; l = l->next) {
+			src = l->data;
+			if (src->key == SR_CONF_SAMPLERATE)
+				feed->samplerate = g_variant_get_uint64(src->data);
+		}
+	}
+}
+
+static void reconf_run(struct sr_dev_inst *sdi, struct reconf_feed *feed)
+{
+	int ret;
+
+	memset(feed, 0, sizeof(*feed));
+	feed->sdi = sdi;
+	sr_config_set(sdi, NULL, SR_CONF_SAMPLERATE,
+		g_variant_new_uint64(SR_MHZ(1)));
+	sr_session_new(srtest_ctx, &feed->sess);
+	sr_session_dev_add(feed->sess, sdi);
+	sr_session_datafeed_callback_add(feed->sess, datafeed_reconf, feed);
+	ret = sr_session_start(feed->sess);
+	fail_unless(ret == SR_OK, "sr_session_start() failed: %d.", ret);
+	sr_session_run(feed->sess);
+	sr_session_destroy(feed->sess);
+}
+
+/*
+ * Check whether a running demo device takes a new samplerate and
+ * announces it, and whether a configuration which needs a restart
+ * (max throughput mode) is refused.
+ */
+START_TEST(test_session_reconfigure)
+{
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	struct reconf_feed feed;
+	int ret;
+
+	sr_session_new(srtest_ctx, &sess);
+	ret = sr_session_reconfigure(sess);
+	fail_unless(ret == SR_OK, "Reconfiguring a stopped session failed.");
+	ret = sr_session_reconfigure(NULL);
+	fail_unless(ret == SR_ERR_ARG, "NULL session was accepted.");
+	sr_session_destroy(sess);
+
+	sdi = srtest_demo_dev_new(8, 0);
+	sr_config_set(sdi, NULL, SR_CONF_LIMIT_SAMPLES,
+		g_variant_new_uint64(100000));
+
+	reconf_run(sdi, &feed);
+	fail_unless(feed.called, "No logic packets.");
+	fail_unless(feed.ret == SR_OK, "sr_session_reconfigure() failed: %d.",
+		feed.ret);
+	fail_unless(feed.samplerate == SR_MHZ(2),
+		"Samplerate %" PRIu64 " announced in %d packets.",
+		feed.samplerate, feed.metas);
+
+	sr_config_set(sdi, NULL, SR_CONF_MAX_THROUGHPUT,
+		g_variant_new_boolean(TRUE));
+	reconf_run(sdi, &feed);
+	fail_unless(feed.called, "No logic packets at max throughput.");
+	fail_unless(feed.ret == SR_ERR_NA,
+		"Reconfigured at max throughput: %d.", feed.ret);
+	fail_unless(feed.metas == 0, "Got %d SR_DF_META packets.",
+		feed.metas);
+
+	sr_dev_close(sdi);
+}
+END_TEST
+
+START_TEST(test_session_stats_get)
+{
+	int ret, i;
+	struct sr_session *sess;
+	struct sr_session_stats *stats;
+
+	sr_session_new(srtest_ctx, &sess);
+
+	ret = sr_session_stats_get(sess, &stats);
+	fail_unless(ret == SR_OK, "sr_session_stats_get() failed.");
+	for (i = 0; i < SR_DF_NUM_TYPES; i++)
+		fail_unless(stats->packets[i] == 0, "Unexpected packet count.");
+	fail_unless(stats->num_callbacks == 0, "Unexpected callback count.");
+	sr_session_stats_free(stats);
+
+	ret = sr_session_stats_get(NULL, &stats);
+	fail_unless(ret == SR_ERR_ARG, "NULL session was accepted.");
+	ret = sr_session_stats_get(sess, NULL);
+	fail_unless(ret == SR_ERR_ARG, "NULL stats pointer was accepted.");
+
+	sr_session_destroy(sess);
+}
+END_TEST
+
+START_TEST(test_packet_copy_analog)
+{
+	int ret;
+	float samples[3] = { 1.5, -2.0, 3.25 };
+	const float *copied;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	struct sr_datafeed_analog analog;
+	struct sr_datafeed_packet packet, *copy;
+	const struct sr_datafeed_analog *analog_copy;
+
+	memset(&encoding, 0, sizeof(encoding));
+	memset(&meaning, 0, sizeof(meaning));
+	memset(&spec, 0, sizeof(spec));
+	encoding.unitsize = sizeof(float);
+	encoding.is_float = TRUE;
+	meaning.mq = SR_MQ_VOLTAGE;
+	meaning.channels = g_slist_append(NULL, &meaning);
+	spec.spec_digits = 2;
+	analog.data = samples;
+	analog.num_samples = 3;
+	analog.encoding = &encoding;
+	analog.meaning = &meaning;
+	analog.spec = &spec;
+	packet.type = SR_DF_ANALOG;
+	packet.payload = &analog;
+
+	ret = sr_packet_copy(&packet, &copy);
+	fail_unless(ret == SR_OK, "sr_packet_copy() failed.");
+	fail_unless(copy->type == SR_DF_ANALOG, "Wrong packet type.");
+	analog_copy = copy->payload;
+	fail_unless(analog_copy->num_samples == 3, "Wrong sample count.");
+	copied = analog_copy->data;
+	fail_unless(copied != samples, "Sample data was not copied.");
+	fail_unless(copied[0] == 1.5 && copied[1] == -2.0 && copied[2] == 3.25,
+		"Wrong sample data.");
+	fail_unless(analog_copy->encoding->is_float, "Wrong encoding.");
+	fail_unless(analog_copy->meaning->mq == SR_MQ_VOLTAGE, "Wrong meaning.");
+	fail_unless(analog_copy->meaning->channels != meaning.channels,
+		"Channel list was not copied.");
+	fail_unless(g_slist_length(analog_copy->meaning->channels) == 1,
+		"Wrong channel list.");
+	fail_unless(analog_copy->spec->spec_digits == 2, "Wrong spec.");
+	sr_packet_free(copy);
+
+	/* Interleaved, one sample of three channels. */
+	meaning.channels = g_slist_append(meaning.channels, &encoding);
+	meaning.channels = g_slist_append(meaning.channels, &spec);
+	analog.num_samples = 1;
+	ret = sr_packet_copy(&packet, &copy);
+	fail_unless(ret == SR_OK, "sr_packet_copy() failed.");
+	analog_copy = copy->payload;
+	copied = analog_copy->data;
+	fail_unless(copied[0] == 1.5 && copied[1] == -2.0 && copied[2] == 3.25,
+		"Wrong interleaved sample data.");
+	sr_packet_free(copy);
+
+	g_slist_free(meaning.channels);
+}
+END_TEST
+
+START_TEST(test_sessionfile_open_bogus)
+{
+	int ret;
+	struct sr_sessionfile *sf;
+
+	ret = sr_sessionfile_open(NULL, &sf);
+	fail_unless(ret == SR_ERR_ARG, "NULL file name was accepted.");
+	ret = sr_sessionfile_open("/nonexistent/file.sr", &sf);
+	fail_unless(ret != SR_OK, "Nonexistent file was opened.");
+	fail_unless(sf == NULL, "Failed open returned a handle.");
+	ret = sr_sessionfile_logic_read(NULL, 0, 1, &ret, NULL);
+	fail_unless(ret == SR_ERR_ARG, "NULL handle was accepted.");
+	ret = sr_sessionfile_close(NULL);
+	fail_unless(ret == SR_ERR_ARG, "NULL handle was accepted.");
+}
+END_TEST
+
 Suite *suite_session(void)
 {
 	Suite *s;
@@ -209,5 +1628,86 @@ Suite *suite_session(void)
 	tcase_add_test(tc, test_session_trigger_get_null);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("packet_ref");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_session_packet_ref);
+	tcase_add_test(tc, test_session_packet_timing);
+	tcase_add_test(tc, test_session_latency_trace);
+	tcase_add_test(tc, test_session_callback_filtered);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("merge");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_session_merge);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("preview");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_session_preview);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("datafeed_queue");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_session_datafeed_queue_set);
+	tcase_add_test(tc, test_session_datafeed_queue);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("logic_rle");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_session_logic_rle_set);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("analog_interleave");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_session_analog_interleave_set);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("trigger_inplace");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_session_trigger_inplace_set);
+	tcase_add_test(tc, test_session_trigger_inplace);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("dev_threads");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_session_dev_threads);
+	tcase_add_test(tc, test_session_parallel_start_set);
+	tcase_add_test(tc, test_session_parallel_start);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("analog_batch");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_session_analog_batch);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("timer_slack");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_session_timer_slack);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("poll_fd");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_session_poll_fd);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("reconfigure");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_session_reconfigure);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("packet_copy");
+	tcase_add_test(tc, test_packet_copy_analog);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("stats");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_session_stats_get);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("sessionfile");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_sessionfile_open_bogus);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
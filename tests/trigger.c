@@ -249,6 +249,184 @@ START_TEST(test_trigger_match_add_bogus)
 }
 END_TEST
 
+/* The first logic sample after the trigger, -1 if there is none. */
+static void datafeed_first_after(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_logic *logic;
+	int *first;
+
+	(void)sdi;
+
+	first = cb_data;
+	if (packet->type == SR_DF_TRIGGER) {
+		*first = -2;
+		return;
+	}
+	if (packet->type != SR_DF_LOGIC || *first != -2)
+		return;
+	logic = packet->payload;
+	if (logic->length)
+		*first = ((const uint8_t *)logic->data)[0];
+}
+
+/*
+ * Run the demo device's incremental pattern, where the value of every
+ * sample is its number, through a soft trigger without pre-trigger
+ * samples. Returns the first sample after the trigger.
+ */
+static int soft_trigger_run(struct sr_dev_inst *sdi, struct sr_trigger *t)
+{
+	struct sr_session *session;
+	int first, ret;
+
+	sr_session_new(srtest_ctx, &session);
+	sr_session_dev_add(session, sdi);
+	first = -1;
+	sr_session_datafeed_callback_add(session, datafeed_first_after, &first);
+	sr_session_trigger_set(session, t);
+	ret = sr_session_start(session);
+	fail_unless(ret == SR_OK, "sr_session_start() failed: %d.", ret);
+	sr_session_run(session);
+	sr_session_destroy(session);
+
+	return first;
+}
+
+/* Add matches for the levels of value on all 8 channels to a stage. */
+static void soft_trigger_levels_add(struct sr_dev_inst *sdi,
+		struct sr_trigger_stage *stage, unsigned int value)
+{
+	struct sr_channel *ch;
+	GSList *l;
+
+	for (l = sr_dev_inst_channels_get(sdi); l; l = l->next) {
+		ch = l->data;
+		sr_trigger_match_add(stage, ch, (value >> ch->index) & 1 ?
+			SR_TRIGGER_ONE : SR_TRIGGER_ZERO, 0);
+	}
+}
+
+static struct sr_dev_inst *soft_trigger_dev_new(void)
+{
+	struct sr_dev_inst *sdi;
+
+	sdi = srtest_demo_dev_new(8, 0);
+	srtest_demo_pattern_set(sdi, "incremental");
+	sr_config_set(sdi, NULL, SR_CONF_SAMPLERATE,
+		g_variant_new_uint64(SR_MHZ(1)));
+	sr_config_set(sdi, NULL, SR_CONF_LIMIT_SAMPLES,
+		g_variant_new_uint64(1000));
+	sr_config_set(sdi, NULL, SR_CONF_CAPTURE_RATIO,
+		g_variant_new_uint64(0));
+
+	return sdi;
+}
+
+/* Check whether soft triggers fire on the first sample with the levels. */
+START_TEST(test_trigger_soft_levels)
+{
+	struct sr_dev_inst *sdi;
+	struct sr_trigger *t;
+	struct sr_trigger_stage *stage;
+	int first;
+
+	sdi = soft_trigger_dev_new();
+
+	/* Past the first 16 samples, which are compared at once. */
+	t = sr_trigger_new(NULL);
+	soft_trigger_levels_add(sdi, sr_trigger_stage_add(t), 0xa5);
+	first = soft_trigger_run(sdi, t);
+	fail_unless(first == 0xa5, "Triggered at %d, not 0xa5.", first);
+	sr_trigger_free(t);
+
+	/* The second stage has to match on the sample after the first. */
+	t = sr_trigger_new(NULL);
+	soft_trigger_levels_add(sdi, sr_trigger_stage_add(t), 0x10);
+	soft_trigger_levels_add(sdi, sr_trigger_stage_add(t), 0x11);
+	first = soft_trigger_run(sdi, t);
+	fail_unless(first == 0x11, "Triggered at %d, not 0x11.", first);
+	sr_trigger_free(t);
+
+	/* Only some channels, D0 low and D4, D5 high. */
+	t = sr_trigger_new(NULL);
+	stage = sr_trigger_stage_add(t);
+	sr_trigger_match_add(stage, g_slist_nth_data(
+		sr_dev_inst_channels_get(sdi), 0), SR_TRIGGER_ZERO, 0);
+	sr_trigger_match_add(stage, g_slist_nth_data(
+		sr_dev_inst_channels_get(sdi), 4), SR_TRIGGER_ONE, 0);
+	sr_trigger_match_add(stage, g_slist_nth_data(
+		sr_dev_inst_channels_get(sdi), 5), SR_TRIGGER_ONE, 0);
+	first = soft_trigger_run(sdi, t);
+	fail_unless(first == 0x30, "Triggered at %d, not 0x30.", first);
+	sr_trigger_free(t);
+
+	sr_dev_close(sdi);
+}
+END_TEST
+
+/* Check whether soft triggers fire on the first sample with the edges. */
+START_TEST(test_trigger_soft_edges)
+{
+	struct sr_dev_inst *sdi;
+	struct sr_trigger *t;
+	struct sr_trigger_stage *stage;
+	GSList *channels;
+	int first;
+
+	sdi = soft_trigger_dev_new();
+	channels = sr_dev_inst_channels_get(sdi);
+
+	t = sr_trigger_new(NULL);
+	stage = sr_trigger_stage_add(t);
+	sr_trigger_match_add(stage, g_slist_nth_data(channels, 7),
+		SR_TRIGGER_RISING, 0);
+	first = soft_trigger_run(sdi, t);
+	fail_unless(first == 0x80, "Triggered at %d, not 0x80.", first);
+	sr_trigger_free(t);
+
+	/* From 0xff to 0x00, after a run of 127 idle samples. */
+	t = sr_trigger_new(NULL);
+	stage = sr_trigger_stage_add(t);
+	sr_trigger_match_add(stage, g_slist_nth_data(channels, 7),
+		SR_TRIGGER_FALLING, 0);
+	first = soft_trigger_run(sdi, t);
+	fail_unless(first == 0x00, "Triggered at %d, not 0x00.", first);
+	sr_trigger_free(t);
+
+	t = sr_trigger_new(NULL);
+	stage = sr_trigger_stage_add(t);
+	sr_trigger_match_add(stage, g_slist_nth_data(channels, 6),
+		SR_TRIGGER_EDGE, 0);
+	first = soft_trigger_run(sdi, t);
+	fail_unless(first == 0x40, "Triggered at %d, not 0x40.", first);
+	sr_trigger_free(t);
+
+	/* D3 rises along with D0 falling, never with D0 high. */
+	t = sr_trigger_new(NULL);
+	stage = sr_trigger_stage_add(t);
+	sr_trigger_match_add(stage, g_slist_nth_data(channels, 3),
+		SR_TRIGGER_RISING, 0);
+	sr_trigger_match_add(stage, g_slist_nth_data(channels, 0),
+		SR_TRIGGER_ZERO, 0);
+	first = soft_trigger_run(sdi, t);
+	fail_unless(first == 0x08, "Triggered at %d, not 0x08.", first);
+	sr_trigger_free(t);
+
+	t = sr_trigger_new(NULL);
+	stage = sr_trigger_stage_add(t);
+	sr_trigger_match_add(stage, g_slist_nth_data(channels, 3),
+		SR_TRIGGER_RISING, 0);
+	sr_trigger_match_add(stage, g_slist_nth_data(channels, 0),
+		SR_TRIGGER_ONE, 0);
+	first = soft_trigger_run(sdi, t);
+	fail_unless(first == -1, "Impossible trigger fired at %d.", first);
+	sr_trigger_free(t);
+
+	sr_dev_close(sdi);
+}
+END_TEST
+
 Suite *suite_trigger(void)
 {
 	Suite *s;
@@ -276,5 +454,11 @@ Suite *suite_trigger(void)
 	tcase_add_test(tc, test_trigger_match_add_bogus);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("soft");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_trigger_soft_levels);
+	tcase_add_test(tc, test_trigger_soft_edges);
+	suite_add_tcase(s, tc);
+
 	return s;
 }